@@ -1,11 +1,29 @@
 #include "EpdFont.h"
 
+#include <HotPath.h>
 #include <Utf8.h>
 
 #include <algorithm>
+#include <cstring>
 
-void EpdFont::getTextBounds(const char* string, const int startX, const int startY, int* minX, int* minY, int* maxX,
-                            int* maxY) const {
+#if HOT_PATH_IN_IRAM
+#include <esp_memory_utils.h>
+#endif
+
+EpdFont::EpdFont(const EpdFontData* data) : glyphCount(0), data(data) {
+  // The glyph array has no stored length; it ends with the last code point interval
+  for (uint32_t i = 0; i < data->intervalCount; i++) {
+    const EpdUnicodeInterval& interval = data->intervals[i];
+    glyphCount = std::max(glyphCount, interval.offset + (interval.last - interval.first) + 1);
+  }
+}
+
+namespace {
+// Ink bounds of string drawn from (startX, startY). beforeCodepoint(next) is called with the bounds so far before each
+// codepoint, next pointing at it; returning false stops the walk there.
+template <typename BeforeCodepoint>
+void walkTextBounds(const EpdFont& font, const char* string, const int startX, const int startY, int* minX, int* minY,
+                    int* maxX, int* maxY, BeforeCodepoint&& beforeCodepoint) {
   *minX = startX;
   *minY = startY;
   *maxX = startX;
@@ -23,14 +41,14 @@ void EpdFont::getTextBounds(const char* string, const int startX, const int star
   constexpr int MIN_COMBINING_GAP_PX = 1;
   uint32_t cp;
   uint32_t prevCp = 0;
-  while ((cp = utf8NextCodepoint(reinterpret_cast<const uint8_t**>(&string)))) {
+  while (beforeCodepoint(string) && (cp = utf8NextCodepoint(reinterpret_cast<const uint8_t**>(&string)))) {
     const bool isCombining = utf8IsCombiningMark(cp);
 
     if (!isCombining) {
-      cp = applyLigatures(cp, string);
+      cp = font.applyLigatures(cp, string);
     }
 
-    const EpdGlyph* glyph = getGlyph(cp);
+    const EpdGlyph* glyph = font.getGlyph(cp);
     if (!glyph) {
       // TODO: Better handle this?
       prevCp = 0;
@@ -46,7 +64,7 @@ void EpdFont::getTextBounds(const char* string, const int startX, const int star
     }
 
     if (!isCombining && prevCp != 0) {
-      cursorX += getKerning(prevCp, cp);
+      cursorX += font.getKerning(prevCp, cp);
     }
 
     const int glyphBaseX = isCombining ? (lastBaseX + lastBaseAdvance / 2) : cursorX;
@@ -66,6 +84,12 @@ void EpdFont::getTextBounds(const char* string, const int startX, const int star
     }
   }
 }
+}  // namespace
+
+void EpdFont::getTextBounds(const char* string, const int startX, const int startY, int* minX, int* minY, int* maxX,
+                            int* maxY) const {
+  walkTextBounds(*this, string, startX, startY, minX, minY, maxX, maxY, [](const char*) { return true; });
+}
 
 void EpdFont::getTextDimensions(const char* string, int* w, int* h) const {
   int minX = 0, minY = 0, maxX = 0, maxY = 0;
@@ -76,7 +100,78 @@ void EpdFont::getTextDimensions(const char* string, int* w, int* h) const {
   *h = maxY - minY;
 }
 
-static uint8_t lookupKernClass(const EpdKernClassEntry* entries, const uint16_t count, const uint32_t cp) {
+size_t EpdFont::getWrapLength(const char* string, const int maxWidth) const {
+  const char* const start = string;
+  size_t spaceFit = 0;  // Longest prefix that fits and ends before a space
+  size_t wordFit = 0;   // Longest prefix of the first word that fits
+  bool spaceSeen = false;
+  bool fitsWhole = false;
+  int minX = 0, minY = 0, maxX = 0, maxY = 0;
+  walkTextBounds(*this, string, 0, 0, &minX, &minY, &maxX, &maxY, [&](const char* next) {
+    // Bounds only grow as the prefix does, so nothing after the first prefix that's too wide fits either
+    if (maxX - minX > maxWidth) {
+      return false;
+    }
+    const auto offset = static_cast<size_t>(next - start);
+    if (*next == '\0') {
+      fitsWhole = true;
+    } else if (*next == ' ' && offset > 0) {
+      spaceFit = offset;
+      spaceSeen = true;
+    } else if (!spaceSeen) {
+      wordFit = offset;
+    }
+    return true;
+  });
+
+  if (fitsWhole) {
+    return strlen(start);
+  }
+  if (spaceFit > 0) {
+    return spaceFit;
+  }
+  if (wordFit > 0) {
+    return wordFit;
+  }
+  // Not even one character fits, it goes on the line anyway
+  const auto* next = reinterpret_cast<const uint8_t*>(start);
+  utf8NextCodepoint(&next);
+  return static_cast<size_t>(reinterpret_cast<const char*>(next) - start);
+}
+
+#if HOT_PATH_IN_IRAM
+namespace {
+// DRAM copies of the ASCII kerning classes of the faces kerned last, for tables built in or mapped from the fonts
+// partition; those of faces loaded from the card are in RAM already. Two, so a regular and an italic face in one
+// paragraph don't keep replacing each other. Keyed by the table in flash, which stays where it is.
+struct KernAsciiCopy {
+  const uint8_t* left;
+  uint8_t leftClasses[128];
+  uint8_t rightClasses[128];
+};
+KernAsciiCopy kernAsciiCopies[2] = {};
+size_t nextKernAsciiCopy = 0;
+
+const KernAsciiCopy* kernAsciiCopy(const EpdFontData* data) {
+  if (!esp_ptr_in_drom(data->kernLeftAscii)) {
+    return nullptr;
+  }
+  for (const auto& copy : kernAsciiCopies) {
+    if (copy.left == data->kernLeftAscii) {
+      return &copy;
+    }
+  }
+  auto& copy = kernAsciiCopies[nextKernAsciiCopy];
+  nextKernAsciiCopy = (nextKernAsciiCopy + 1) % 2;
+  copy.left = data->kernLeftAscii;
+  memcpy(copy.leftClasses, data->kernLeftAscii, sizeof(copy.leftClasses));
+  memcpy(copy.rightClasses, data->kernRightAscii, sizeof(copy.rightClasses));
+  return &copy;
+}
+}  // namespace
+#endif
+
+static HOT_CODE uint8_t lookupKernClass(const EpdKernClassEntry* entries, const uint16_t count, const uint32_t cp) {
   if (!entries || count == 0 || cp > 0xFFFF) {
     return 0;
   }
@@ -98,13 +193,28 @@ static uint8_t lookupKernClass(const EpdKernClassEntry* entries, const uint16_t
   return 0;
 }
 
-int8_t EpdFont::getKerning(const uint32_t leftCp, const uint32_t rightCp) const {
+HOT_CODE int8_t EpdFont::getKerning(const uint32_t leftCp, const uint32_t rightCp) const {
   if (!data->kernMatrix) {
     return 0;
   }
-  const uint8_t lc = lookupKernClass(data->kernLeftClasses, data->kernLeftEntryCount, leftCp);
+  // ASCII pairs (the bulk of most text) read their classes straight from the flat tables
+  const uint8_t* leftAscii = data->kernLeftAscii;
+  const uint8_t* rightAscii = data->kernRightAscii;
+#if HOT_PATH_IN_IRAM
+  if (leftAscii && (leftCp < 128 || rightCp < 128)) {
+    if (const KernAsciiCopy* copy = kernAsciiCopy(data)) {
+      leftAscii = copy->leftClasses;
+      rightAscii = copy->rightClasses;
+    }
+  }
+#endif
+  const uint8_t lc = leftCp < 128 && leftAscii
+                         ? leftAscii[leftCp]
+                         : lookupKernClass(data->kernLeftClasses, data->kernLeftEntryCount, leftCp);
   if (lc == 0) return 0;
-  const uint8_t rc = lookupKernClass(data->kernRightClasses, data->kernRightEntryCount, rightCp);
+  const uint8_t rc = rightCp < 128 && rightAscii
+                         ? rightAscii[rightCp]
+                         : lookupKernClass(data->kernRightClasses, data->kernRightEntryCount, rightCp);
   if (rc == 0) return 0;
   return data->kernMatrix[(lc - 1) * data->kernRightClassCount + (rc - 1)];
 }
@@ -140,6 +250,10 @@ uint32_t EpdFont::applyLigatures(uint32_t cp, const char*& text) const {
     return cp;
   }
   while (true) {
+    // Most ASCII code points never start a ligature; skip decoding the next one and the pair search
+    if (cp < 128 && data->ligatureStartAscii && !(data->ligatureStartAscii[cp >> 5] & (1u << (cp & 31)))) {
+      break;
+    }
     const auto saved = reinterpret_cast<const uint8_t*>(text);
     const uint32_t nextCp = utf8NextCodepoint(reinterpret_cast<const uint8_t**>(&text));
     if (nextCp == 0) break;
@@ -153,7 +267,34 @@ uint32_t EpdFont::applyLigatures(uint32_t cp, const char*& text) const {
   return cp;
 }
 
-const EpdGlyph* EpdFont::getGlyph(const uint32_t cp) const {
+uint32_t EpdFont::applyLigatures(uint32_t cp, const uint32_t*& next, const uint32_t* end) const {
+  if (!data->ligaturePairs || data->ligaturePairCount == 0) {
+    return cp;
+  }
+  while (next < end) {
+    if (cp < 128 && data->ligatureStartAscii && !(data->ligatureStartAscii[cp >> 5] & (1u << (cp & 31)))) {
+      break;
+    }
+    const uint32_t lig = getLigature(cp, *next);
+    if (lig == 0) {
+      break;
+    }
+    cp = lig;
+    ++next;
+  }
+  return cp;
+}
+
+HOT_CODE const EpdGlyph* EpdFont::getGlyph(const uint32_t cp) const {
+  // Direct lookup for the code points that make up almost all text
+  if (data->hotGlyphs && cp >= EPD_HOT_GLYPH_FIRST && cp <= EPD_HOT_GLYPH_LAST) {
+    const uint16_t index = data->hotGlyphs[cp - EPD_HOT_GLYPH_FIRST];
+    if (index != EPD_HOT_GLYPH_MISSING) {
+      return &data->glyph[index];
+    }
+    return getGlyph(REPLACEMENT_GLYPH);
+  }
+
   const EpdUnicodeInterval* intervals = data->intervals;
   const int count = data->intervalCount;
 
@@ -1,16 +1,26 @@
 #pragma once
+#include <cstddef>
+
 #include "EpdFontData.h"
 
 class EpdFont {
+  uint32_t glyphCount;
+
   void getTextBounds(const char* string, int startX, int startY, int* minX, int* minY, int* maxX, int* maxY) const;
 
  public:
   const EpdFontData* data;
-  explicit EpdFont(const EpdFontData* data) : data(data) {}
+  explicit EpdFont(const EpdFontData* data);
   ~EpdFont() = default;
   void getTextDimensions(const char* string, int* w, int* h) const;
+  /// Bytes of string that go on a line maxWidth wide: up to the last space at which the text still fits, or when not
+  /// even the first word fits, as much of it as does (at least one codepoint). Measures the same ink width as
+  /// getTextDimensions(), in one pass that stops at the first character past maxWidth.
+  size_t getWrapLength(const char* string, int maxWidth) const;
 
   const EpdGlyph* getGlyph(uint32_t cp) const;
+  /// Entry of the glyph array, nullptr if index is past its end.
+  const EpdGlyph* getGlyphByIndex(uint32_t index) const { return index < glyphCount ? &data->glyph[index] : nullptr; }
 
   /// Returns the kerning adjustment (in pixels) between two codepoints.
   /// Returns 0 if no kerning data exists for the pair.
@@ -23,4 +33,6 @@ class EpdFont {
   /// as many following codepoints from text as possible. Returns the
   /// (possibly substituted) codepoint; advances text past consumed chars.
   uint32_t applyLigatures(uint32_t cp, const char*& text) const;
+  /// Same, for text already decoded: consumes the codepoints from next on, up to end.
+  uint32_t applyLigatures(uint32_t cp, const uint32_t*& next, const uint32_t* end) const;
 };
@@ -4,6 +4,14 @@
 #pragma once
 #include <cstdint>
 
+class EpdFontFile;
+
+/// Code point range covered by EpdFontData::hotGlyphs (Latin, Greek and Cyrillic, i.e. nearly all book text)
+#define EPD_HOT_GLYPH_FIRST 0x20
+#define EPD_HOT_GLYPH_LAST 0x4FF
+/// Marks a code point of the hot range that the font has no glyph for
+#define EPD_HOT_GLYPH_MISSING 0xFFFF
+
 /// Font data stored PER GLYPH
 typedef struct {
   uint8_t width;        ///< Bitmap dimensions in pixels
@@ -15,13 +23,18 @@ typedef struct {
   uint32_t dataOffset;  ///< Pointer into EpdFont->bitmap (or within-group offset for compressed fonts)
 } EpdGlyph;
 
-/// Compressed font group: a DEFLATE-compressed block of glyph bitmaps
+/// EpdFontGroup::flags bit of a group whose glyph bitmaps are stored as they are instead of DEFLATE-compressed
+#define EPD_GROUP_STORED 0x01
+
+/// Compressed font group: a DEFLATE-compressed block of glyph bitmaps, or the bitmaps themselves for a group stored
+/// raw (EPD_GROUP_STORED), like the most frequent glyphs the generator keeps uncompressed
 typedef struct {
   uint32_t compressedOffset;  ///< Byte offset into compressed data array
-  uint32_t compressedSize;    ///< Compressed DEFLATE stream size
+  uint32_t compressedSize;    ///< Compressed DEFLATE stream size, uncompressedSize if stored raw
   uint32_t uncompressedSize;  ///< Decompressed size
   uint16_t glyphCount;        ///< Number of glyphs in this group
   uint16_t firstGlyphIndex;   ///< First glyph index in the global glyph array
+  uint8_t flags;              ///< EPD_GROUP_* bits
 } EpdFontGroup;
 
 /// Glyph interval structure
@@ -66,4 +79,9 @@ typedef struct {
   uint8_t kernRightClassCount;                ///< Number of distinct right classes (matrix cols)
   const EpdLigaturePair* ligaturePairs;       ///< Sorted ligature pair table (nullptr if none)
   uint32_t ligaturePairCount;                 ///< Number of entries in ligaturePairs
+  const uint16_t* hotGlyphs;                  ///< Glyph index per hot range code point (nullptr if not generated)
+  const uint8_t* kernLeftAscii;               ///< Left class ID per ASCII code point, 0 = none (nullptr if absent)
+  const uint8_t* kernRightAscii;              ///< Right class ID per ASCII code point, 0 = none (nullptr if absent)
+  const uint32_t* ligatureStartAscii;         ///< 128-bit set of ASCII code points that start a ligature pair
+  EpdFontFile* file;  ///< Container the compressed groups are read in from, bitmap is nullptr (nullptr if built in)
 } EpdFontData;
@@ -22,12 +22,20 @@ void EpdFontFamily::getTextDimensions(const char* string, int* w, int* h, const
   getFont(style)->getTextDimensions(string, w, h);
 }
 
+size_t EpdFontFamily::getWrapLength(const char* string, const int maxWidth, const Style style) const {
+  return getFont(style)->getWrapLength(string, maxWidth);
+}
+
 const EpdFontData* EpdFontFamily::getData(const Style style) const { return getFont(style)->data; }
 
 const EpdGlyph* EpdFontFamily::getGlyph(const uint32_t cp, const Style style) const {
   return getFont(style)->getGlyph(cp);
 }
 
+const EpdGlyph* EpdFontFamily::getGlyphByIndex(const uint32_t index, const Style style) const {
+  return getFont(style)->getGlyphByIndex(index);
+}
+
 int8_t EpdFontFamily::getKerning(const uint32_t leftCp, const uint32_t rightCp, const Style style) const {
   return getFont(style)->getKerning(leftCp, rightCp);
 }
@@ -35,3 +43,8 @@ int8_t EpdFontFamily::getKerning(const uint32_t leftCp, const uint32_t rightCp,
 uint32_t EpdFontFamily::applyLigatures(const uint32_t cp, const char*& text, const Style style) const {
   return getFont(style)->applyLigatures(cp, text);
 }
+
+uint32_t EpdFontFamily::applyLigatures(const uint32_t cp, const uint32_t*& next, const uint32_t* end,
+                                       const Style style) const {
+  return getFont(style)->applyLigatures(cp, next, end);
+}
@@ -10,10 +10,13 @@ class EpdFontFamily {
       : regular(regular), bold(bold), italic(italic), boldItalic(boldItalic) {}
   ~EpdFontFamily() = default;
   void getTextDimensions(const char* string, int* w, int* h, Style style = REGULAR) const;
+  size_t getWrapLength(const char* string, int maxWidth, Style style = REGULAR) const;
   const EpdFontData* getData(Style style = REGULAR) const;
   const EpdGlyph* getGlyph(uint32_t cp, Style style = REGULAR) const;
+  const EpdGlyph* getGlyphByIndex(uint32_t index, Style style = REGULAR) const;
   int8_t getKerning(uint32_t leftCp, uint32_t rightCp, Style style = REGULAR) const;
   uint32_t applyLigatures(uint32_t cp, const char*& text, Style style = REGULAR) const;
+  uint32_t applyLigatures(uint32_t cp, const uint32_t*& next, const uint32_t* end, Style style = REGULAR) const;
 
  private:
   const EpdFont* regular;
@@ -0,0 +1,114 @@
+#include "EpdFontFile.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+
+#include "EpdFontFormat.h"
+
+namespace {
+// Free heap the tables must leave for the layout, the glyph cache and the pages
+constexpr uint32_t MIN_FREE_HEAP = 64 * 1024;
+}  // namespace
+
+template <typename T>
+bool EpdFontFile::readTable(std::vector<T>& table, const uint32_t count) {
+  table.resize(count);
+  const size_t bytes = count * sizeof(T);
+  return bytes == 0 || file.read(reinterpret_cast<uint8_t*>(table.data()), bytes) == static_cast<int>(bytes);
+}
+
+bool EpdFontFile::open(const char* path) {
+  close();
+  if (!Storage.openFileForRead("EFF", path, file)) {
+    return false;
+  }
+
+  EpdFontFormat::Header header;
+  if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+      !EpdFontFormat::headerValid(header)) {
+    LOG_ERR("EFF", "%s is not an .epdfont file of version %u with compressed glyphs", path, EpdFontFormat::VERSION);
+    close();
+    return false;
+  }
+
+  const uint32_t kernEntries = header.kernLeftEntryCount + header.kernRightEntryCount;
+  const bool hasKerning = kernEntries > 0;
+  const uint32_t tableBytes = EpdFontFormat::tableBytes(header);
+  if (tableBytes + MIN_FREE_HEAP > ESP.getFreeHeap()) {
+    LOG_ERR("EFF", "No room for the %u bytes of tables of %s", tableBytes, path);
+    close();
+    return false;
+  }
+
+  bool ok = readTable(intervals, header.intervalCount) && readTable(glyphs, header.glyphCount) &&
+            readTable(groups, header.groupCount) && readTable(hotGlyphs, EpdFontFormat::HOT_GLYPH_COUNT);
+  if (ok && hasKerning) {
+    ok = readTable(kernClasses, kernEntries) &&
+         readTable(kernMatrix, header.kernLeftClassCount * header.kernRightClassCount) &&
+         readTable(kernAscii, EpdFontFormat::KERN_ASCII_SIZE);
+  }
+  if (ok && header.ligaturePairCount > 0) {
+    ok = readTable(ligaturePairs, header.ligaturePairCount) &&
+         file.read(reinterpret_cast<uint8_t*>(ligatureStartAscii), sizeof(ligatureStartAscii)) ==
+             sizeof(ligatureStartAscii);
+  }
+  groupsOffset = file.position();
+  groupsSize = header.groupsSize;
+  if (!ok || groupsOffset + groupsSize != file.size()) {
+    LOG_ERR("EFF", "%s is truncated", path);
+    close();
+    return false;
+  }
+
+  EpdFontFormat::setMetrics(header, data);
+  data.bitmap = nullptr;
+  data.glyph = glyphs.data();
+  data.intervals = intervals.data();
+  data.groups = groups.data();
+  data.hotGlyphs = hotGlyphs.data();
+  if (hasKerning) {
+    data.kernLeftClasses = kernClasses.data();
+    data.kernRightClasses = kernClasses.data() + header.kernLeftEntryCount;
+    data.kernMatrix = kernMatrix.data();
+    data.kernLeftAscii = kernAscii.data();
+    data.kernRightAscii = kernAscii.data() + EpdFontFormat::KERN_ASCII_SIZE / 2;
+  }
+  if (!ligaturePairs.empty()) {
+    data.ligaturePairs = ligaturePairs.data();
+    data.ligatureStartAscii = ligatureStartAscii;
+  }
+  if (!EpdFontFormat::tablesValid(header, data)) {
+    LOG_ERR("EFF", "%s has inconsistent tables", path);
+    close();
+    return false;
+  }
+  data.file = this;
+  LOG_DBG("EFF", "Opened %s: %u glyphs in %u groups, %u bytes of tables", path, header.glyphCount, header.groupCount,
+          tableBytes);
+  return true;
+}
+
+void EpdFontFile::close() {
+  if (file) {
+    file.close();
+  }
+  data = {};
+  // Give the tables' memory back, not just their contents
+  std::vector<EpdUnicodeInterval>().swap(intervals);
+  std::vector<EpdGlyph>().swap(glyphs);
+  std::vector<EpdFontGroup>().swap(groups);
+  std::vector<uint16_t>().swap(hotGlyphs);
+  std::vector<EpdKernClassEntry>().swap(kernClasses);
+  std::vector<int8_t>().swap(kernMatrix);
+  std::vector<uint8_t>().swap(kernAscii);
+  std::vector<EpdLigaturePair>().swap(ligaturePairs);
+  groupsOffset = 0;
+  groupsSize = 0;
+}
+
+bool EpdFontFile::readGroups(const uint32_t offset, uint8_t* out, const uint32_t size) {
+  if (!file || offset + size > groupsSize || !file.seek(groupsOffset + offset)) {
+    return false;
+  }
+  return file.read(out, size) == static_cast<int>(size);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "EpdFontData.h"
+
+// A font face read from an .epdfont container on the SD card (see EpdFontFormat.h). Only the tables are read in; the
+// groups stay in the file, and the FontDecompressor reads one in when it misses it in its cache. The file stays open
+// while the face is.
+class EpdFontFile {
+ public:
+  EpdFontFile() = default;
+  ~EpdFontFile() { close(); }
+  EpdFontFile(const EpdFontFile&) = delete;
+  EpdFontFile& operator=(const EpdFontFile&) = delete;
+
+  bool open(const char* path);
+  void close();
+  bool isOpen() const { return data.glyph != nullptr; }
+
+  // Points into this object: valid while it is open
+  const EpdFontData* getData() const { return &data; }
+
+  // Reads size bytes of the compressed groups, from offset within them on
+  bool readGroups(uint32_t offset, uint8_t* out, uint32_t size);
+
+ private:
+  FsFile file;
+  uint32_t groupsOffset = 0;
+  uint32_t groupsSize = 0;
+  EpdFontData data = {};
+
+  std::vector<EpdUnicodeInterval> intervals;
+  std::vector<EpdGlyph> glyphs;
+  std::vector<EpdFontGroup> groups;
+  std::vector<uint16_t> hotGlyphs;
+  std::vector<EpdKernClassEntry> kernClasses;  // Left ones, then right ones
+  std::vector<int8_t> kernMatrix;
+  std::vector<uint8_t> kernAscii;  // Left, then right
+  std::vector<EpdLigaturePair> ligaturePairs;
+  uint32_t ligatureStartAscii[4] = {};
+
+  template <typename T>
+  bool readTable(std::vector<T>& table, uint32_t count);
+};
@@ -0,0 +1,94 @@
+#include "EpdFontFormat.h"
+
+namespace EpdFontFormat {
+
+bool headerValid(const Header& header) {
+  // Every interval holds a glyph; the bounds keep the table sizes from overflowing
+  return header.magic == MAGIC && header.version == VERSION && header.intervalCount > 0 && header.groupCount > 0 &&
+         header.glyphCount <= UINT16_MAX && header.intervalCount <= header.glyphCount &&
+         header.ligaturePairCount <= UINT16_MAX;
+}
+
+uint32_t tableBytes(const Header& header) {
+  uint32_t bytes = header.intervalCount * sizeof(EpdUnicodeInterval) + header.glyphCount * sizeof(EpdGlyph) +
+                   header.groupCount * sizeof(EpdFontGroup) + HOT_GLYPH_COUNT * sizeof(uint16_t);
+  const uint32_t kernEntries = header.kernLeftEntryCount + header.kernRightEntryCount;
+  if (kernEntries > 0) {
+    bytes += kernEntries * sizeof(EpdKernClassEntry) + header.kernLeftClassCount * header.kernRightClassCount +
+             KERN_ASCII_SIZE;
+  }
+  if (header.ligaturePairCount > 0) {
+    bytes += header.ligaturePairCount * sizeof(EpdLigaturePair) + LIGATURE_START_ASCII_SIZE;
+  }
+  return bytes;
+}
+
+void setMetrics(const Header& header, EpdFontData& data) {
+  data.intervalCount = header.intervalCount;
+  data.advanceY = header.advanceY;
+  data.ascender = header.ascender;
+  data.descender = header.descender;
+  data.is2Bit = (header.flags & FLAG_2BIT) != 0;
+  data.groupCount = header.groupCount;
+  if (header.kernLeftEntryCount + header.kernRightEntryCount > 0) {
+    data.kernLeftEntryCount = header.kernLeftEntryCount;
+    data.kernRightEntryCount = header.kernRightEntryCount;
+    data.kernLeftClassCount = header.kernLeftClassCount;
+    data.kernRightClassCount = header.kernRightClassCount;
+  }
+  data.ligaturePairCount = header.ligaturePairCount;
+}
+
+bool tablesValid(const Header& header, const EpdFontData& data) {
+  // Intervals are in code point order for the binary search; their glyphs needn't be, the generator lays glyphs out
+  // group by group. Each must lie within the glyph array, and together they must account for all of it.
+  uint32_t glyphCount = 0;
+  for (uint32_t i = 0; i < header.intervalCount; i++) {
+    const EpdUnicodeInterval& interval = data.intervals[i];
+    const uint32_t intervalGlyphs = interval.last - interval.first + 1;
+    if (interval.last < interval.first || (i > 0 && interval.first <= data.intervals[i - 1].last) ||
+        interval.offset > header.glyphCount || intervalGlyphs > header.glyphCount - interval.offset) {
+      return false;
+    }
+    glyphCount += intervalGlyphs;
+  }
+  if (glyphCount != header.glyphCount) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header.groupCount; i++) {
+    const EpdFontGroup& group = data.groups[i];
+    if (group.firstGlyphIndex + group.glyphCount > glyphCount ||
+        group.compressedOffset + group.compressedSize > header.groupsSize ||
+        ((group.flags & EPD_GROUP_STORED) && group.compressedSize != group.uncompressedSize)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < HOT_GLYPH_COUNT; i++) {
+    if (data.hotGlyphs[i] >= glyphCount && data.hotGlyphs[i] != EPD_HOT_GLYPH_MISSING) {
+      return false;
+    }
+  }
+  if (header.kernLeftEntryCount + header.kernRightEntryCount == 0) {
+    return true;
+  }
+  for (uint32_t i = 0; i < header.kernLeftEntryCount; i++) {
+    const uint8_t classId = data.kernLeftClasses[i].classId;
+    if (classId < 1 || classId > header.kernLeftClassCount) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header.kernRightEntryCount; i++) {
+    const uint8_t classId = data.kernRightClasses[i].classId;
+    if (classId < 1 || classId > header.kernRightClassCount) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < KERN_ASCII_SIZE / 2; i++) {
+    if (data.kernLeftAscii[i] > header.kernLeftClassCount || data.kernRightAscii[i] > header.kernRightClassCount) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace EpdFontFormat
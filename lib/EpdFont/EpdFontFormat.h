@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "EpdFontData.h"
+
+// The .epdfont container of fontconvert.py --binary: this header, the EpdFontData tables laid out as they are in RAM,
+// then the DEFLATE-compressed glyph groups. EpdFontFile reads one from the SD card.
+namespace EpdFontFormat {
+
+struct __attribute__((packed)) Header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t flags;  // Bit 0: 2-bit glyphs
+  uint8_t advanceY;
+  uint8_t reserved;
+  int16_t ascender;
+  int16_t descender;
+  uint32_t glyphCount;
+  uint32_t intervalCount;
+  uint16_t groupCount;
+  uint16_t kernLeftEntryCount;
+  uint16_t kernRightEntryCount;
+  uint8_t kernLeftClassCount;
+  uint8_t kernRightClassCount;
+  uint32_t ligaturePairCount;
+  uint32_t groupsSize;
+};
+static_assert(sizeof(Header) == 36, "the header is read as it is laid out in the file");
+static_assert(sizeof(EpdGlyph) == 16 && sizeof(EpdUnicodeInterval) == 12 && sizeof(EpdFontGroup) == 20 &&
+                  sizeof(EpdKernClassEntry) == 3 && sizeof(EpdLigaturePair) == 8,
+              "the tables are read as they are laid out in RAM");
+
+constexpr uint32_t MAGIC = 0x46445045;  // "EPDF"
+constexpr uint8_t VERSION = 2;
+constexpr uint8_t FLAG_2BIT = 0x01;
+constexpr size_t HOT_GLYPH_COUNT = EPD_HOT_GLYPH_LAST - EPD_HOT_GLYPH_FIRST + 1;
+constexpr size_t KERN_ASCII_SIZE = 256;  // Left classes of ASCII, then right ones
+constexpr size_t LIGATURE_START_ASCII_SIZE = 4 * sizeof(uint32_t);
+
+// Whether the header is one of this version, of a font with compressed glyphs
+bool headerValid(const Header& header);
+
+// Bytes of the tables between the header and the groups
+uint32_t tableBytes(const Header& header);
+
+// Sets the metrics and table sizes of data from the header; the table pointers are left to the caller
+void setMetrics(const Header& header, EpdFontData& data);
+
+// Whether every index the lookups follow stays within data's tables: the glyph array, the groups and the kerning
+// classes. intervals, groups, hotGlyphs and (with kerning) the kern class tables and ASCII maps must be set.
+bool tablesValid(const Header& header, const EpdFontData& data);
+
+}  // namespace EpdFontFormat
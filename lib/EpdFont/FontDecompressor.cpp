@@ -1,22 +1,40 @@
 #include "FontDecompressor.h"
 
+#include <Arduino.h>
 #include <Logging.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+
+#if HOT_PATH_IN_IRAM
+#include <esp_memory_utils.h>
+#endif
+
+#include "EpdFontFile.h"
 
 bool FontDecompressor::init() {
   clearCache();
   return true;
 }
 
+void FontDecompressor::freeEntry(CacheEntry& entry) {
+  if (entry.data) {
+    free(entry.data);
+    entry.data = nullptr;
+  }
+  if (entry.valid) {
+    cachedBytes -= entry.dataSize;
+  }
+  entry.dataSize = 0;
+  entry.valid = false;
+}
+
 void FontDecompressor::freeAllEntries() {
   for (auto& entry : cache) {
-    if (entry.data) {
-      free(entry.data);
-      entry.data = nullptr;
-    }
-    entry.valid = false;
+    freeEntry(entry);
   }
+  cachedBytes = 0;
 }
 
 void FontDecompressor::deinit() { freeAllEntries(); }
@@ -26,76 +44,219 @@ void FontDecompressor::clearCache() {
   accessCounter = 0;
 }
 
-uint16_t FontDecompressor::getGroupIndex(const EpdFontData* fontData, uint16_t glyphIndex) {
-  for (uint16_t i = 0; i < fontData->groupCount; i++) {
-    uint16_t first = fontData->groups[i].firstGlyphIndex;
-    if (glyphIndex >= first && glyphIndex < first + fontData->groups[i].glyphCount) {
-      return i;
+void FontDecompressor::trimCache() {
+  while (ESP.getFreeHeap() < MIN_FREE_HEAP && evictLeastRecentlyUsed()) {
+  }
+  LOG_DBG("FDC", "Glyph cache: %u bytes, %u hits, %u misses, %u direct, %u ms inflating, %u ms reading", cachedBytes,
+          stats.hits, stats.misses, stats.direct, stats.inflateTimeUs / 1000, stats.readTimeUs / 1000);
+}
+
+void FontDecompressor::setCacheBudget(const uint32_t bytes) {
+  cacheBudgetBytes = bytes;
+  while (cachedBytes > cacheBudgetBytes && evictLeastRecentlyUsed()) {
+  }
+}
+
+bool FontDecompressor::evictLeastRecentlyUsed() {
+  CacheEntry* lru = nullptr;
+  for (auto& entry : cache) {
+    if (entry.valid && (!lru || entry.lastUsed < lru->lastUsed)) {
+      lru = &entry;
+    }
+  }
+  if (!lru) {
+    return false;
+  }
+  freeEntry(*lru);
+  return true;
+}
+
+HOT_CODE uint16_t FontDecompressor::getGroupIndex(const EpdFontData* fontData, uint16_t glyphIndex) {
+#if HOT_PATH_IN_IRAM
+  // Groups of a font in flash are searched in a copy of their first glyphs; those in RAM need no copy
+  if (fontData->groupCount <= MAX_INDEXED_GROUPS && esp_ptr_in_drom(fontData->groups)) {
+    if (indexedGroups != fontData->groups) {
+      indexedGroups = fontData->groups;
+      for (uint16_t i = 0; i < fontData->groupCount; i++) {
+        indexedGroupStarts[i] = fontData->groups[i].firstGlyphIndex;
+      }
+    }
+    const uint16_t* starts = indexedGroupStarts;
+    const auto index =
+        static_cast<uint16_t>(std::upper_bound(starts, starts + fontData->groupCount, glyphIndex) - starts);
+    if (index == 0 || glyphIndex >= starts[index - 1] + fontData->groups[index - 1].glyphCount) {
+      return fontData->groupCount;
+    }
+    return index - 1;
+  }
+#endif
+  // Groups are emitted in glyph order, so binary search on firstGlyphIndex
+  int left = 0;
+  int right = static_cast<int>(fontData->groupCount) - 1;
+  while (left <= right) {
+    const int mid = left + (right - left) / 2;
+    const EpdFontGroup& group = fontData->groups[mid];
+    if (glyphIndex < group.firstGlyphIndex) {
+      right = mid - 1;
+    } else if (glyphIndex >= group.firstGlyphIndex + group.glyphCount) {
+      left = mid + 1;
+    } else {
+      return static_cast<uint16_t>(mid);
     }
   }
   return fontData->groupCount;  // sentinel = not found
 }
 
-FontDecompressor::CacheEntry* FontDecompressor::findInCache(const EpdFontData* fontData, uint16_t groupIndex) {
+FontDecompressor::CacheEntry* FontDecompressor::findInCache(const EpdFontData* fontData, uint16_t groupIndex,
+                                                            const Layout layout) {
   for (auto& entry : cache) {
-    if (entry.valid && entry.font == fontData && entry.groupIndex == groupIndex) {
+    if (entry.valid && entry.font == fontData && entry.groupIndex == groupIndex && entry.layout == layout) {
       return &entry;
     }
   }
   return nullptr;
 }
 
-FontDecompressor::CacheEntry* FontDecompressor::findEvictionCandidate() {
-  // Find an invalid slot first
+FontDecompressor::CacheEntry* FontDecompressor::makeRoom(const uint32_t size) {
+  // Stay within the byte budget and keep some heap free, evicting the least recently used groups first
+  while (cachedBytes > 0 &&
+         (cachedBytes + size > cacheBudgetBytes || ESP.getFreeHeap() < MIN_FREE_HEAP + size)) {
+    evictLeastRecentlyUsed();
+  }
+
   for (auto& entry : cache) {
     if (!entry.valid) {
       return &entry;
     }
   }
-  // Otherwise evict LRU
-  CacheEntry* lru = &cache[0];
+  // All slots taken by small groups
+  evictLeastRecentlyUsed();
   for (auto& entry : cache) {
-    if (entry.lastUsed < lru->lastUsed) {
-      lru = &entry;
+    if (!entry.valid) {
+      return &entry;
     }
   }
-  return lru;
+  return nullptr;
 }
 
-bool FontDecompressor::decompressGroup(const EpdFontData* fontData, uint16_t groupIndex, CacheEntry* entry) {
+// Rearranges every glyph of a decompressed group into layout, each in the bytes it had: a glyph has as many pixels
+// in any of them. out must be zeroed.
+static bool arrangeGroup(const EpdFontData* fontData, const EpdFontGroup& group, const FontDecompressor::Layout layout,
+                         const uint8_t* in, uint8_t* out) {
+  const int bitsPerPixel = fontData->is2Bit ? 2 : 1;
+  const int pixelsPerByte = 8 / bitsPerPixel;
+  const uint8_t pixelMask = (1 << bitsPerPixel) - 1;
+  for (uint16_t i = 0; i < group.glyphCount; i++) {
+    const EpdGlyph& glyph = fontData->glyph[group.firstGlyphIndex + i];
+    const int width = glyph.width;
+    const int height = glyph.height;
+    if (glyph.dataOffset + (width * height + pixelsPerByte - 1) / pixelsPerByte > group.uncompressedSize) {
+      return false;
+    }
+    const uint8_t* const src = in + glyph.dataOffset;
+    uint8_t* const dst = out + glyph.dataOffset;
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        const int from = y * width + x;
+        int to = from;
+        switch (layout) {
+          case FontDecompressor::Layout::Rows:
+            break;
+          case FontDecompressor::Layout::MirroredRows:
+            to = y * width + (width - 1 - x);
+            break;
+          case FontDecompressor::Layout::Columns:
+            to = x * height + y;
+            break;
+          case FontDecompressor::Layout::MirroredColumns:
+            to = x * height + (height - 1 - y);
+            break;
+        }
+        // MSB first
+        const int fromShift = ((pixelsPerByte - 1) - from % pixelsPerByte) * bitsPerPixel;
+        const int toShift = ((pixelsPerByte - 1) - to % pixelsPerByte) * bitsPerPixel;
+        dst[to / pixelsPerByte] |= ((src[from / pixelsPerByte] >> fromShift) & pixelMask) << toShift;
+      }
+    }
+  }
+  return true;
+}
+
+bool FontDecompressor::decompressGroup(const EpdFontData* fontData, uint16_t groupIndex, const Layout layout,
+                                       CacheEntry* entry) {
   const EpdFontGroup& group = fontData->groups[groupIndex];
 
   // Free old buffer if reusing a slot
-  if (entry->data) {
-    free(entry->data);
-    entry->data = nullptr;
-  }
-  entry->valid = false;
+  freeEntry(*entry);
 
-  // Allocate output buffer
+  // Allocate output buffer, giving up the rest of the cache if the heap is too fragmented
   auto* outBuf = static_cast<uint8_t*>(malloc(group.uncompressedSize));
+  if (!outBuf && cachedBytes > 0) {
+    freeAllEntries();
+    outBuf = static_cast<uint8_t*>(malloc(group.uncompressedSize));
+  }
   if (!outBuf) {
     LOG_ERR("FDC", "Failed to allocate %u bytes for group %u", group.uncompressedSize, groupIndex);
     return false;
   }
 
-  inflateReader.init(false);
-  inflateReader.setSource(&fontData->bitmap[group.compressedOffset], group.compressedSize);
-  if (!inflateReader.read(outBuf, group.uncompressedSize)) {
+  // A font on the SD card keeps its groups in the file: read this one in for the time it is inflated
+  const uint8_t* source = fontData->bitmap ? &fontData->bitmap[group.compressedOffset] : nullptr;
+  uint8_t* pagedIn = nullptr;
+  if (fontData->file) {
+    const unsigned long readStart = micros();
+    pagedIn = static_cast<uint8_t*>(malloc(group.compressedSize));
+    if (!pagedIn || !fontData->file->readGroups(group.compressedOffset, pagedIn, group.compressedSize)) {
+      LOG_ERR("FDC", "Failed to read group %u from the font file", groupIndex);
+      free(pagedIn);
+      free(outBuf);
+      return false;
+    }
+    source = pagedIn;
+    stats.readTimeUs += micros() - readStart;
+  }
+
+  const unsigned long start = micros();
+  bool inflated = true;
+  if (isStored(group)) {
+    memcpy(outBuf, source, group.uncompressedSize);
+  } else {
+    inflateReader.init(false);
+    inflateReader.setSource(source, group.compressedSize);
+    inflated = inflateReader.read(outBuf, group.uncompressedSize);
+  }
+  free(pagedIn);
+  if (!inflated) {
     LOG_ERR("FDC", "Decompression failed for group %u", groupIndex);
     free(outBuf);
     return false;
   }
+  stats.inflateTimeUs += micros() - start;
+
+  if (layout != Layout::Rows) {
+    auto* arrangedBuf = static_cast<uint8_t*>(calloc(1, group.uncompressedSize));
+    if (!arrangedBuf || !arrangeGroup(fontData, group, layout, outBuf, arrangedBuf)) {
+      LOG_ERR("FDC", "Failed to rearrange group %u", groupIndex);
+      free(arrangedBuf);
+      free(outBuf);
+      return false;
+    }
+    free(outBuf);
+    outBuf = arrangedBuf;
+  }
 
   entry->font = fontData;
   entry->groupIndex = groupIndex;
+  entry->layout = layout;
   entry->data = outBuf;
   entry->dataSize = group.uncompressedSize;
   entry->valid = true;
+  cachedBytes += entry->dataSize;
   return true;
 }
 
-const uint8_t* FontDecompressor::getBitmap(const EpdFontData* fontData, const EpdGlyph* glyph, uint16_t glyphIndex) {
+const uint8_t* FontDecompressor::getBitmap(const EpdFontData* fontData, const EpdGlyph* glyph, uint16_t glyphIndex,
+                                           const Layout layout) {
   if (!fontData->groups || fontData->groupCount == 0) {
     return &fontData->bitmap[glyph->dataOffset];
   }
@@ -106,9 +267,22 @@ const uint8_t* FontDecompressor::getBitmap(const EpdFontData* fontData, const Ep
     return nullptr;
   }
 
+  // A group stored raw in flash is read in place, as long as it's wanted in the layout it is stored in
+  const EpdFontGroup& group = fontData->groups[groupIndex];
+  if (isStored(group) && fontData->bitmap && layout == Layout::Rows) {
+    if (glyph->dataOffset + glyph->dataLength > group.uncompressedSize) {
+      LOG_ERR("FDC", "dataOffset %u + dataLength %u out of bounds for stored group %u (size %u)", glyph->dataOffset,
+              glyph->dataLength, groupIndex, group.uncompressedSize);
+      return nullptr;
+    }
+    stats.direct++;
+    return &fontData->bitmap[group.compressedOffset + glyph->dataOffset];
+  }
+
   // Check cache
-  CacheEntry* entry = findInCache(fontData, groupIndex);
+  CacheEntry* entry = findInCache(fontData, groupIndex, layout);
   if (entry) {
+    stats.hits++;
     entry->lastUsed = ++accessCounter;
     if (glyph->dataOffset + glyph->dataLength > entry->dataSize) {
       LOG_ERR("FDC", "dataOffset %u + dataLength %u out of bounds for group %u (size %u)", glyph->dataOffset,
@@ -119,8 +293,9 @@ const uint8_t* FontDecompressor::getBitmap(const EpdFontData* fontData, const Ep
   }
 
   // Cache miss - decompress
-  entry = findEvictionCandidate();
-  if (!decompressGroup(fontData, groupIndex, entry)) {
+  stats.misses++;
+  entry = makeRoom(group.uncompressedSize);
+  if (!entry || !decompressGroup(fontData, groupIndex, layout, entry)) {
     return nullptr;
   }
 
@@ -1,23 +1,59 @@
 #pragma once
 
+#include <HotPath.h>
 #include <InflateReader.h>
 
 #include "EpdFontData.h"
 
 class FontDecompressor {
  public:
+  struct Stats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t direct = 0;         // Glyphs read straight from a raw group in flash
+    uint32_t inflateTimeUs = 0;  // Total time spent inflating groups
+    uint32_t readTimeUs = 0;     // Total time spent reading groups in from font files
+  };
+
   bool init();
   void deinit();
 
+  // How the pixels of a glyph bitmap follow each other: pixel (x, y) of a width x height glyph is pixel
+  //   Rows:            y * width + x (as stored in the font)
+  //   MirroredRows:    y * width + (width - 1 - x)
+  //   Columns:         x * height + y
+  //   MirroredColumns: x * height + (height - 1 - y)
+  // The renderer asks for the one that runs along the panel rows in the current orientation, so it can copy the
+  // pixels of a row a byte at a time.
+  enum class Layout : uint8_t { Rows, MirroredRows, Columns, MirroredColumns };
+
   // Returns pointer to decompressed bitmap data for the given glyph.
   // Valid until LRU eviction (safe for the duration of one glyph render).
-  const uint8_t* getBitmap(const EpdFontData* fontData, const EpdGlyph* glyph, uint16_t glyphIndex);
+  // Groups are rearranged into the layout once as they're decompressed, and cached apart for each layout.
+  const uint8_t* getBitmap(const EpdFontData* fontData, const EpdGlyph* glyph, uint16_t glyphIndex,
+                           Layout layout = Layout::Rows);
 
-  // Evict all cached decompressed groups (call between pages for within-page-only caching).
+  // Evict all cached decompressed groups (e.g. when leaving the reader to give the heap back).
   void clearCache();
 
+  // Evict least recently used groups while the heap is running low. Decompressed groups otherwise stay cached
+  // across pages, so a page turn doesn't inflate the reader font's groups again. Call between pages.
+  void trimCache();
+
+  // Bytes of decompressed groups kept across pages, evicting least recently used groups down to it right away. Not
+  // to be called while a glyph is being rendered.
+  void setCacheBudget(uint32_t bytes);
+
+  const Stats& getStats() const { return stats; }
+  uint32_t getCachedBytes() const { return cachedBytes; }
+
  private:
-  static constexpr uint8_t CACHE_SLOTS = 4;
+  static constexpr uint8_t CACHE_SLOTS = 12;
+  // Decompressed bytes kept across pages until setCacheBudget() says otherwise; a single larger group is still cached
+  // on its own
+  static constexpr uint32_t DEFAULT_CACHE_BUDGET_BYTES = 24 * 1024;
+  // Free heap to keep beyond a group allocation before cached groups get evicted
+  static constexpr uint32_t MIN_FREE_HEAP = 48 * 1024;
 
   struct CacheEntry {
     const EpdFontData* font = nullptr;
@@ -25,16 +61,30 @@ class FontDecompressor {
     uint8_t* data = nullptr;
     uint32_t dataSize = 0;
     uint32_t lastUsed = 0;
+    Layout layout = Layout::Rows;
     bool valid = false;
   };
 
   InflateReader inflateReader;
   CacheEntry cache[CACHE_SLOTS] = {};
   uint32_t accessCounter = 0;
+  uint32_t cachedBytes = 0;
+  uint32_t cacheBudgetBytes = DEFAULT_CACHE_BUDGET_BYTES;
+  Stats stats;
+#if HOT_PATH_IN_IRAM
+  // First glyph of each group of the font looked up last, copied out of flash for getGroupIndex()
+  static constexpr size_t MAX_INDEXED_GROUPS = 128;
+  const EpdFontGroup* indexedGroups = nullptr;
+  uint16_t indexedGroupStarts[MAX_INDEXED_GROUPS] = {};
+#endif
+
+  static bool isStored(const EpdFontGroup& group) { return group.flags & EPD_GROUP_STORED; }
 
   void freeAllEntries();
+  void freeEntry(CacheEntry& entry);
+  bool evictLeastRecentlyUsed();
   uint16_t getGroupIndex(const EpdFontData* fontData, uint16_t glyphIndex);
-  CacheEntry* findInCache(const EpdFontData* fontData, uint16_t groupIndex);
-  CacheEntry* findEvictionCandidate();
-  bool decompressGroup(const EpdFontData* fontData, uint16_t groupIndex, CacheEntry* entry);
+  CacheEntry* findInCache(const EpdFontData* fontData, uint16_t groupIndex, Layout layout);
+  CacheEntry* makeRoom(uint32_t size);
+  bool decompressGroup(const EpdFontData* fontData, uint16_t groupIndex, Layout layout, CacheEntry* entry);
 };
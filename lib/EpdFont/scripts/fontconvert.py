@@ -4,6 +4,7 @@ import zlib
 import sys
 import re
 import math
+import struct
 import argparse
 from collections import namedtuple
 from fontTools.ttLib import TTFont
@@ -17,6 +18,9 @@ parser.add_argument("fontstack", action="store", nargs='+', help="list of font f
 parser.add_argument("--2bit", dest="is2Bit", action="store_true", help="generate 2-bit greyscale bitmap instead of 1-bit black and white.")
 parser.add_argument("--additional-intervals", dest="additional_intervals", action="append", help="Additional code point intervals to export as min,max. This argument can be repeated.")
 parser.add_argument("--compress", dest="compress", action="store_true", help="Compress glyph bitmaps using DEFLATE with group-based compression.")
+parser.add_argument("--binary", dest="binary", action="store_true", help="Write a binary .epdfont container to stdout instead of a header, for loading the font from the SD card (implies --compress).")
+parser.add_argument("--group-corpus", dest="group_corpus", action="append", help="UTF-8 text file to measure which glyphs share pages when grouping compressed glyphs. This argument can be repeated.")
+parser.add_argument("--raw-glyphs", dest="raw_glyphs", type=int, default=100, help="Number of the most frequent glyphs kept as raw bitmaps in an uncompressed first group, drawn without inflating (0 to compress every group).")
 parser.add_argument("--force-autohint", dest="force_autohint", action="store_true", help="Force FreeType auto-hinter instead of native font hinting. Improves stem width consistency for fonts with weak or no native TrueType hints.")
 args = parser.parse_args()
 
@@ -659,14 +663,14 @@ for packed, lig_cp in ligature_pairs:
 ligature_pairs = sorted(unique_ligature_pairs, key=lambda p: p[0])
 print(f"ligatures: {len(ligature_pairs)} pairs extracted", file=sys.stderr)
 
-compress = args.compress
+compress = args.compress or args.binary
 
 # Build groups for compression
 if compress:
     # Script-based grouping: glyphs that co-occur in typical text rendering
     # are grouped together for efficient LRU caching on the embedded target.
-    # Since glyphs are in codepoint order, glyphs in the same Unicode block
-    # are contiguous in the array and form natural groups.
+    # Glyphs of the same Unicode block mostly share a group, and the glyphs are
+    # then reordered so every group is a contiguous run of the glyph array.
     SCRIPT_GROUP_RANGES = [
         (0x0000, 0x007F),   # ASCII
         (0x0080, 0x00FF),   # Latin-1 Supplement
@@ -690,27 +694,79 @@ if compress:
                 return i
         return -1
 
-    groups = []  # list of (first_glyph_index, glyph_count)
-    current_group_id = None
-    group_start = 0
-    group_count = 0
-
+    # A page inflates every group it has a glyph of, so the glyphs that nearly every page of prose mixes in with
+    # ASCII join the ASCII group: then a typical page takes one group, not one per Unicode block it touches.
+    # Without a corpus these are typographic punctuation; with one, the glyphs found on enough of its pages.
+    CORE_EXTRA_CODEPOINTS = [0x00A0, 0x00AD, 0x2013, 0x2014, 0x2018, 0x2019, 0x201C, 0x201D, 0x2026]
+    CORPUS_PAGE_CHARS = 1500     # About a page of book text
+    CORE_PAGE_FRACTION = 0.02    # Share of the corpus pages a glyph must be found on to join the ASCII group
+    CORE_EXTRA_LIMIT = 48        # Keeps the ASCII group small enough to stay in the glyph cache
+
+    # The most frequent glyphs are stored raw in a group of their own, which the device reads straight out of flash.
+    # Without a corpus they're taken in this order, roughly that of English and other European text.
+    DEFAULT_RAW_GLYPH_ORDER = (" etaoinsrhldcumfpgwybvkxjqz.,'\u2019\"\u201C\u201D-\u2014\u2013\u2026;:!?()"
+                               "TAISOWHBCMFPDRLEGNYUKVJQXZ0123456789\u00A0\u00AD/&*%$#@[]_+=<>|\\^`{}~")
+
+    page_frequency = {}  # code point -> share of corpus pages it is found on
+    char_count = {}  # code point -> occurrences in the corpus
+    if args.group_corpus:
+        page_count = 0
+        pages_with = {}
+        for corpus_path in args.group_corpus:
+            with open(corpus_path, encoding="utf-8", errors="ignore") as corpus_file:
+                text = corpus_file.read()
+            for ch in text:
+                char_count[ord(ch)] = char_count.get(ord(ch), 0) + 1
+            for start in range(0, len(text), CORPUS_PAGE_CHARS):
+                page_count += 1
+                for cp in set(map(ord, text[start:start + CORPUS_PAGE_CHARS])):
+                    pages_with[cp] = pages_with.get(cp, 0) + 1
+        page_frequency = {cp: count / max(page_count, 1) for cp, count in pages_with.items()}
+        core_extras = sorted((cp for cp, freq in page_frequency.items()
+                              if cp > 0x7F and freq >= CORE_PAGE_FRACTION), key=lambda cp: -page_frequency[cp])
+        core_extras = set(core_extras[:CORE_EXTRA_LIMIT])
+    else:
+        core_extras = set(CORE_EXTRA_CODEPOINTS)
+
+    font_codepoints = [props.code_point for props, packed in all_glyphs]
+    if args.group_corpus:
+        ranked = sorted((cp for cp in font_codepoints if char_count.get(cp, 0) > 0), key=lambda cp: -char_count[cp])
+    else:
+        available = set(font_codepoints)
+        ranked = [ord(ch) for ch in DEFAULT_RAW_GLYPH_ORDER if ord(ch) in available]
+    raw_codepoints = set(ranked[:max(args.raw_glyphs, 0)])
+
+    # Glyph indices of each group: the raw glyphs first, then the rest of the ASCII group, then a group per script
+    # range. With a corpus, the glyphs of a range it has and those it never has are grouped apart, so the common
+    # accented letters don't come with the rare ones.
+    raw_members = []
+    core_members = []
+    range_members = {}
     for i, (props, packed) in enumerate(all_glyphs):
-        sg = get_script_group(props.code_point)
-        if sg != current_group_id:
-            if group_count > 0:
-                groups.append((group_start, group_count))
-            current_group_id = sg
-            group_start = i
-            group_count = 1
+        cp = props.code_point
+        sg = get_script_group(cp)
+        if cp in raw_codepoints:
+            raw_members.append(i)
+        elif sg == 0 or cp in core_extras:
+            core_members.append(i)
         else:
-            group_count += 1
-
-    if group_count > 0:
-        groups.append((group_start, group_count))
+            seen = not args.group_corpus or page_frequency.get(cp, 0) > 0
+            range_members.setdefault((sg, not seen), []).append(i)
+    group_members = [raw_members, core_members] + [range_members[key] for key in sorted(range_members)]
+    group_members = [members for members in group_members if members]
+
+    # Groups are runs of the glyph array, so the glyphs are laid out group by group
+    order = [i for members in group_members for i in members]
+    all_glyphs = [all_glyphs[i] for i in order]
+    glyph_props = [glyph_props[i] for i in order]
+    groups = []  # list of (first_glyph_index, glyph_count)
+    group_start = 0
+    for members in group_members:
+        groups.append((group_start, len(members)))
+        group_start += len(members)
 
     # Compress each group
-    compressed_groups = []  # list of (compressed_bytes, uncompressed_size, glyph_count, first_glyph_index)
+    compressed_groups = []  # list of (compressed_bytes, uncompressed_size, glyph_count, first_glyph_index, stored)
     compressed_bitmap_data = []
     compressed_offset = 0
 
@@ -737,18 +793,95 @@ if compress:
             )
             group_data += packed
 
-        # Compress with raw DEFLATE (no zlib/gzip header)
+        # Compress with raw DEFLATE (no zlib/gzip header). The raw glyphs are stored as they are, and so is a group
+        # DEFLATE doesn't make any smaller.
         compressor = zlib.compressobj(level=9, wbits=-15)
         compressed = compressor.compress(group_data) + compressor.flush()
+        stored = bool(raw_members and first_idx == 0) or len(compressed) >= len(group_data)
+        if stored:
+            compressed = group_data
 
-        compressed_groups.append((compressed, len(group_data), count, first_idx))
+        compressed_groups.append((compressed, len(group_data), count, first_idx, stored))
         compressed_bitmap_data.extend(compressed)
         compressed_offset += len(compressed)
 
     glyph_props = modified_glyph_props
     total_compressed = len(compressed_bitmap_data)
     total_uncompressed = len(glyph_data)
-    print(f"// Compression: {total_uncompressed} -> {total_compressed} bytes ({100*total_compressed/total_uncompressed:.1f}%), {len(groups)} groups", file=sys.stderr)
+    print(f"// Compression: {total_uncompressed} -> {total_compressed} bytes ({100*total_compressed/total_uncompressed:.1f}%), {len(groups)} groups, {len(raw_members)} raw glyphs", file=sys.stderr)
+
+# (first, last, index of the first glyph) of each interval. Grouped glyphs are no longer in code point order, so their
+# intervals are split wherever consecutive code points ended up apart, and sorted back into code point order.
+glyph_intervals = []
+if compress:
+    for index, props in enumerate(glyph_props):
+        cp = props.code_point
+        if glyph_intervals and glyph_intervals[-1][1] == cp - 1 and \
+                glyph_intervals[-1][2] + cp - glyph_intervals[-1][0] == index:
+            glyph_intervals[-1] = (glyph_intervals[-1][0], cp, glyph_intervals[-1][2])
+        else:
+            glyph_intervals.append((cp, cp, index))
+    glyph_intervals.sort()
+else:
+    offset = 0
+    for i_start, i_end in intervals:
+        glyph_intervals.append((i_start, i_end, offset))
+        offset += i_end - i_start + 1
+
+# Direct glyph index table for the hot code point range (must match EPD_HOT_GLYPH_FIRST/LAST in EpdFontData.h)
+HOT_GLYPH_FIRST = 0x20
+HOT_GLYPH_LAST = 0x4FF
+hot_glyphs = [0xFFFF] * (HOT_GLYPH_LAST - HOT_GLYPH_FIRST + 1)
+for i_start, i_end, i_offset in glyph_intervals:
+    for cp in range(max(i_start, HOT_GLYPH_FIRST), min(i_end, HOT_GLYPH_LAST) + 1):
+        hot_glyphs[cp - HOT_GLYPH_FIRST] = i_offset + cp - i_start
+
+# Flat ASCII class maps so the common pairs skip the binary searches
+kern_ascii = {}
+for side, classes in (("Left", kern_left_classes), ("Right", kern_right_classes)):
+    kern_ascii[side] = [0] * 128
+    for cp, cls in classes:
+        if cp < 128:
+            kern_ascii[side][cp] = cls
+
+# Bit per ASCII code point that is the left side of at least one ligature pair
+ligature_start_ascii = [0] * 4
+for packed_pair, _ in ligature_pairs:
+    left_cp = packed_pair >> 16
+    if left_cp < 128:
+        ligature_start_ascii[left_cp >> 5] |= 1 << (left_cp & 31)
+
+if args.binary:
+    # Read by EpdFontFile: a header, then the EpdFontData tables laid out as they are in RAM, then the compressed
+    # groups, which stay on the SD card and are read in one at a time.
+    out = bytearray()
+    out += struct.pack("<4sBBBxhhIIHHHBBII", b"EPDF", 2, 1 if is2Bit else 0, norm_ceil(face.size.height),
+                       norm_ceil(face.size.ascender), norm_floor(face.size.descender), len(glyph_props),
+                       len(glyph_intervals), len(compressed_groups), len(kern_left_classes), len(kern_right_classes),
+                       kern_left_class_count, kern_right_class_count, len(ligature_pairs),
+                       len(compressed_bitmap_data))
+    for i_start, i_end, i_offset in glyph_intervals:
+        out += struct.pack("<III", i_start, i_end, i_offset)
+    for g in glyph_props:
+        out += struct.pack("<BBBxhhHxxI", g.width, g.height, g.advance_x, g.left, g.top, g.data_length, g.data_offset)
+    compressed_offset = 0
+    for compressed, uncompressed_size, count, first_idx, stored in compressed_groups:
+        out += struct.pack("<IIIHHBxxx", compressed_offset, len(compressed), uncompressed_size, count, first_idx,
+                           1 if stored else 0)
+        compressed_offset += len(compressed)
+    out += struct.pack(f"<{len(hot_glyphs)}H", *hot_glyphs)
+    if kern_map:
+        for cp, cls in kern_left_classes + kern_right_classes:
+            out += struct.pack("<HB", cp, cls)
+        out += struct.pack(f"<{len(kern_matrix)}b", *kern_matrix)
+        out += bytes(kern_ascii["Left"]) + bytes(kern_ascii["Right"])
+    if ligature_pairs:
+        for packed_pair, lig_cp in ligature_pairs:
+            out += struct.pack("<II", packed_pair, lig_cp)
+        out += struct.pack("<4I", *ligature_start_ascii)
+    out += bytes(compressed_bitmap_data)
+    sys.stdout.buffer.write(out)
+    sys.exit(0)
 
 print(f"""/**
  * generated by fontconvert.py
@@ -783,17 +916,20 @@ for i, g in enumerate(glyph_props):
 print ("};\n");
 
 print(f"static const EpdUnicodeInterval {font_name}Intervals[] = {{")
-offset = 0
-for i_start, i_end in intervals:
-    print (f"    {{ 0x{i_start:X}, 0x{i_end:X}, 0x{offset:X} }},")
-    offset += i_end - i_start + 1
+for i_start, i_end, i_offset in glyph_intervals:
+    print (f"    {{ 0x{i_start:X}, 0x{i_end:X}, 0x{i_offset:X} }},")
+print ("};\n");
+
+print(f"static const uint16_t {font_name}HotGlyphs[] = {{")
+for c in chunks(hot_glyphs, 16):
+    print ("    " + " ".join(f"0x{g:04X}," for g in c))
 print ("};\n");
 
 if compress:
     print(f"static const EpdFontGroup {font_name}Groups[] = {{")
     compressed_offset = 0
-    for compressed, uncompressed_size, count, first_idx in compressed_groups:
-        print(f"    {{ {compressed_offset}, {len(compressed)}, {uncompressed_size}, {count}, {first_idx} }},")
+    for compressed, uncompressed_size, count, first_idx, stored in compressed_groups:
+        print(f"    {{ {compressed_offset}, {len(compressed)}, {uncompressed_size}, {count}, {first_idx}, {1 if stored else 0} }},")
         compressed_offset += len(compressed)
     print("};\n")
 
@@ -815,17 +951,27 @@ if kern_map:
         print("    " + ", ".join(f"{v:4d}" for v in row_vals) + ",")
     print("};\n")
 
+    for side in ("Left", "Right"):
+        print(f"static const uint8_t {font_name}Kern{side}Ascii[] = {{")
+        for c in chunks(kern_ascii[side], 16):
+            print("    " + " ".join(f"{v:3d}," for v in c))
+        print("};\n")
+
 if ligature_pairs:
     print(f"static const EpdLigaturePair {font_name}LigaturePairs[] = {{")
     for packed_pair, lig_cp in ligature_pairs:
         print(f"    {{ 0x{packed_pair:08X}, 0x{lig_cp:04X} }}, // {cp_label(packed_pair >> 16)} {cp_label(packed_pair & 0xFFFF)} -> {cp_label(lig_cp)}")
     print("};\n")
 
+    print(f"static const uint32_t {font_name}LigatureStartAscii[] = {{")
+    print("    " + " ".join(f"0x{w:08X}," for w in ligature_start_ascii))
+    print("};\n")
+
 print(f"static const EpdFontData {font_name} = {{")
 print(f"    {font_name}Bitmaps,")
 print(f"    {font_name}Glyphs,")
 print(f"    {font_name}Intervals,")
-print(f"    {len(intervals)},")
+print(f"    {len(glyph_intervals)},")
 print(f"    {norm_ceil(face.size.height)},")
 print(f"    {norm_ceil(face.size.ascender)},")
 print(f"    {norm_floor(face.size.descender)},")
@@ -858,4 +1004,15 @@ if ligature_pairs:
 else:
     print(f"    nullptr,")
     print(f"    0,")
+print(f"    {font_name}HotGlyphs,")
+if kern_map:
+    print(f"    {font_name}KernLeftAscii,")
+    print(f"    {font_name}KernRightAscii,")
+else:
+    print(f"    nullptr,")
+    print(f"    nullptr,")
+if ligature_pairs:
+    print(f"    {font_name}LigatureStartAscii,")
+else:
+    print(f"    nullptr,")
 print("};")
@@ -3,8 +3,9 @@
 Round-trip verification for compressed font headers.
 
 Parses each generated .h file in the given directory, identifies compressed fonts
-(those with a Groups array), decompresses each group, and verifies that
-decompression succeeds and all glyph offsets/lengths fall within bounds.
+(those with a Groups array), decompresses each group (stored ones are taken as they
+are), and verifies that decompression succeeds and all glyph offsets/lengths fall
+within bounds.
 """
 import os
 import re
@@ -19,15 +20,16 @@ def parse_hex_array(text):
 
 
 def parse_groups(text):
-    """Parse EpdFontGroup array entries: { compressedOffset, compressedSize, uncompressedSize, glyphCount, firstGlyphIndex }"""
+    """Parse EpdFontGroup array entries: { compressedOffset, compressedSize, uncompressedSize, glyphCount, firstGlyphIndex, flags }"""
     groups = []
-    for match in re.finditer(r'\{\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*\}', text):
+    for match in re.finditer(r'\{\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*,\s*(\d+)\s*\}', text):
         groups.append({
             'compressedOffset': int(match.group(1)),
             'compressedSize': int(match.group(2)),
             'uncompressedSize': int(match.group(3)),
             'glyphCount': int(match.group(4)),
             'firstGlyphIndex': int(match.group(5)),
+            'flags': int(match.group(6)),
         })
     return groups
 
@@ -99,11 +101,14 @@ def verify_font_file(filepath):
         if len(chunk) != group['compressedSize']:
             return (font_name, False, f"group {gi}: compressed data truncated (expected {group['compressedSize']}, got {len(chunk)})")
 
-        # Decompress with raw DEFLATE
-        try:
-            decompressed = zlib.decompress(chunk, -15)
-        except zlib.error as e:
-            return (font_name, False, f"group {gi}: decompression failed: {e}")
+        # Decompress with raw DEFLATE, unless the group is stored raw (EPD_GROUP_STORED)
+        if group['flags'] & 0x01:
+            decompressed = chunk
+        else:
+            try:
+                decompressed = zlib.decompress(chunk, -15)
+            except zlib.error as e:
+                return (font_name, False, f"group {gi}: decompression failed: {e}")
 
         if len(decompressed) != group['uncompressedSize']:
             return (font_name, False, f"group {gi}: size mismatch (expected {group['uncompressedSize']}, got {len(decompressed)})")
@@ -1,17 +1,47 @@
 #include "Epub.h"
 
+#include <BookCacheKey.h>
 #include <FsHelpers.h>
+#include <GrayBmpToBmpConverter.h>
 #include <HalStorage.h>
 #include <JpegToBmpConverter.h>
 #include <Logging.h>
 #include <PngToBmpConverter.h>
 #include <ZipFile.h>
 
+#include "Epub/CacheBundle.h"
+#include "Epub/css/CssNameFilter.h"
 #include "Epub/parsers/ContainerParser.h"
 #include "Epub/parsers/ContentOpfParser.h"
 #include "Epub/parsers/TocNavParser.h"
 #include "Epub/parsers/TocNcxParser.h"
 
+// RAM the compiled CSS rules of a book may keep between chapter builds (see Epub::releaseCssRules)
+#ifndef CSS_RESIDENT_MAX_BYTES
+#define CSS_RESIDENT_MAX_BYTES (32 * 1024)
+#endif
+
+namespace {
+// Size the cover master is scaled down to fill, that of the panel in portrait
+constexpr int coverMasterWidth = 480;
+constexpr int coverMasterHeight = 800;
+}  // namespace
+
+Epub::Epub(std::string filepath, const std::string& cacheDir) : filepath(std::move(filepath)) {
+  cachePath = BookCacheKey::cachePath(this->filepath, cacheDir, "epub_");
+}
+
+Epub::~Epub() = default;
+
+template <typename Fn>
+auto Epub::withArchive(Fn&& fn) const {
+  if (archive) {
+    return fn(*archive);
+  }
+  ZipFile zip(filepath, ZipFile::getIndexPath(cachePath));
+  return fn(zip);
+}
+
 bool Epub::findContentOpfFile(std::string* contentOpfFile) const {
   const auto containerPath = "META-INF/container.xml";
   size_t containerSize;
@@ -152,50 +182,25 @@ bool Epub::parseTocNcxFile() const {
 
   LOG_DBG("EBP", "Parsing toc ncx file: %s", tocNcxItem.c_str());
 
-  const auto tmpNcxPath = getCachePath() + "/toc.ncx";
-  FsFile tempNcxFile;
-  if (!Storage.openFileForWrite("EBP", tmpNcxPath, tempNcxFile)) {
+  size_t ncxSize;
+  if (!getItemSize(tocNcxItem, &ncxSize)) {
+    LOG_ERR("EBP", "Could not get size of toc ncx file");
     return false;
   }
-  readItemContentsToStream(tocNcxItem, tempNcxFile, 1024);
-  tempNcxFile.close();
-  if (!Storage.openFileForRead("EBP", tmpNcxPath, tempNcxFile)) {
-    return false;
-  }
-  const auto ncxSize = tempNcxFile.size();
 
   TocNcxParser ncxParser(contentBasePath, ncxSize, bookMetadataCache.get());
 
   if (!ncxParser.setup()) {
     LOG_ERR("EBP", "Could not setup toc ncx parser");
-    tempNcxFile.close();
     return false;
   }
 
-  const auto ncxBuffer = static_cast<uint8_t*>(malloc(1024));
-  if (!ncxBuffer) {
-    LOG_ERR("EBP", "Could not allocate memory for toc ncx parser");
-    tempNcxFile.close();
+  // Parsed as it is inflated, like content.opf
+  if (!readItemContentsToStream(tocNcxItem, ncxParser, 1024)) {
+    LOG_ERR("EBP", "Could not process all toc ncx data");
     return false;
   }
 
-  while (tempNcxFile.available()) {
-    const auto readSize = tempNcxFile.read(ncxBuffer, 1024);
-    if (readSize == 0) break;
-    const auto processedSize = ncxParser.write(ncxBuffer, readSize);
-
-    if (processedSize != readSize) {
-      LOG_ERR("EBP", "Could not process all toc ncx data");
-      free(ncxBuffer);
-      tempNcxFile.close();
-      return false;
-    }
-  }
-
-  free(ncxBuffer);
-  tempNcxFile.close();
-  Storage.remove(tmpNcxPath.c_str());
-
   LOG_DBG("EBP", "Parsed TOC items");
   return true;
 }
@@ -209,17 +214,11 @@ bool Epub::parseTocNavFile() const {
 
   LOG_DBG("EBP", "Parsing toc nav file: %s", tocNavItem.c_str());
 
-  const auto tmpNavPath = getCachePath() + "/toc.nav";
-  FsFile tempNavFile;
-  if (!Storage.openFileForWrite("EBP", tmpNavPath, tempNavFile)) {
+  size_t navSize;
+  if (!getItemSize(tocNavItem, &navSize)) {
+    LOG_ERR("EBP", "Could not get size of toc nav file");
     return false;
   }
-  readItemContentsToStream(tocNavItem, tempNavFile, 1024);
-  tempNavFile.close();
-  if (!Storage.openFileForRead("EBP", tmpNavPath, tempNavFile)) {
-    return false;
-  }
-  const auto navSize = tempNavFile.size();
 
   // Note: We can't use `contentBasePath` here as the nav file may be in a different folder to the content.opf
   // and the HTMLX nav file will have hrefs relative to itself
@@ -231,28 +230,11 @@ bool Epub::parseTocNavFile() const {
     return false;
   }
 
-  const auto navBuffer = static_cast<uint8_t*>(malloc(1024));
-  if (!navBuffer) {
-    LOG_ERR("EBP", "Could not allocate memory for toc nav parser");
+  if (!readItemContentsToStream(tocNavItem, navParser, 1024)) {
+    LOG_ERR("EBP", "Could not process all toc nav data");
     return false;
   }
 
-  while (tempNavFile.available()) {
-    const auto readSize = tempNavFile.read(navBuffer, 1024);
-    const auto processedSize = navParser.write(navBuffer, readSize);
-
-    if (processedSize != readSize) {
-      LOG_ERR("EBP", "Could not process all toc nav data");
-      free(navBuffer);
-      tempNavFile.close();
-      return false;
-    }
-  }
-
-  free(navBuffer);
-  tempNavFile.close();
-  Storage.remove(tmpNavPath.c_str());
-
   LOG_DBG("EBP", "Parsed TOC nav items");
   return true;
 }
@@ -270,13 +252,7 @@ void Epub::parseCssFiles() const {
 
   LOG_DBG("EBP", "CSS files to parse: %zu", cssFiles.size());
 
-  // See if we have a cached version of the CSS rules
-  if (cssParser->hasCache()) {
-    LOG_DBG("EBP", "CSS cache exists, skipping parseCssFiles");
-    return;
-  }
-
-  // No cache yet - parse CSS files
+  // Only called without cached rules - parse CSS files
   for (const auto& cssPath : cssFiles) {
     LOG_DBG("EBP", "Parsing CSS file: %s", cssPath.c_str());
 
@@ -288,44 +264,25 @@ void Epub::parseCssFiles() const {
       continue;
     }
 
-    // Check CSS file size before decompressing - skip files that are too large
-    size_t cssFileSize = 0;
-    if (getItemSize(cssPath, &cssFileSize)) {
-      if (cssFileSize > MAX_CSS_FILE_SIZE) {
-        LOG_ERR("EBP", "CSS file too large (%zu bytes > %zu max), skipping: %s", cssFileSize, MAX_CSS_FILE_SIZE,
-                cssPath.c_str());
-        continue;
+    // The stylesheet is parsed as it is inflated, so nothing is staged on the SD card
+    withArchive([&](ZipFile& zip) {
+      if (!zip.beginEntryStream(FsHelpers::normalisePath(cssPath).c_str(), 1024)) {
+        LOG_ERR("EBP", "Could not read CSS file: %s", cssPath.c_str());
+        return;
       }
-    }
-
-    // Extract CSS file to temp location
-    const auto tmpCssPath = getCachePath() + "/.tmp.css";
-    FsFile tempCssFile;
-    if (!Storage.openFileForWrite("EBP", tmpCssPath, tempCssFile)) {
-      LOG_ERR("EBP", "Could not create temp CSS file");
-      continue;
-    }
-    if (!readItemContentsToStream(cssPath, tempCssFile, 1024)) {
-      LOG_ERR("EBP", "Could not read CSS file: %s", cssPath.c_str());
-      tempCssFile.close();
-      Storage.remove(tmpCssPath.c_str());
-      continue;
-    }
-    tempCssFile.close();
-
-    // Parse the CSS file
-    if (!Storage.openFileForRead("EBP", tmpCssPath, tempCssFile)) {
-      LOG_ERR("EBP", "Could not open temp CSS file for reading");
-      Storage.remove(tmpCssPath.c_str());
-      continue;
-    }
-    cssParser->loadFromStream(tempCssFile);
-    tempCssFile.close();
-    Storage.remove(tmpCssPath.c_str());
+      // Skip files that are too large before inflating them
+      if (zip.getEntryStreamSize() > MAX_CSS_FILE_SIZE) {
+        LOG_ERR("EBP", "CSS file too large (%zu bytes > %zu max), skipping: %s", zip.getEntryStreamSize(),
+                MAX_CSS_FILE_SIZE, cssPath.c_str());
+      } else if (!cssParser->loadFromStream(zip)) {
+        LOG_ERR("EBP", "Could not parse CSS file: %s", cssPath.c_str());
+      }
+      zip.endEntryStream();
+    });
   }
 
   // Save to cache for next time
-  if (!cssParser->saveToCache()) {
+  if (!bookMetadataCache->saveCssRules(*cssParser)) {
     LOG_ERR("EBP", "Failed to save CSS rules to cache");
   }
   cssParser->clear();
@@ -340,23 +297,34 @@ bool Epub::load(const bool buildIfMissing, const bool skipLoadingCss) {
   // Initialize spine/TOC cache
   bookMetadataCache.reset(new BookMetadataCache(cachePath));
   // Always create CssParser - needed for inline style parsing even without CSS files
-  cssParser.reset(new CssParser(cachePath));
+  cssParser.reset(new CssParser());
+
+  // A cache built on a desktop and put next to the book spares indexing it; it's only unpacked once
+  const std::string bundlePath = filepath + CacheBundle::EXTENSION;
+  if (Storage.exists(bundlePath.c_str())) {
+    CacheBundle::unpack(bundlePath, filepath, cachePath);
+    Storage.remove(bundlePath.c_str());
+  }
 
   // Try to load existing cache first
   if (bookMetadataCache->load()) {
     if (!skipLoadingCss) {
-      // Rebuild CSS cache when missing or when cache version changed (loadFromCache removes stale file)
-      if (!cssParser->hasCache() || !cssParser->loadFromCache()) {
+      // Rebuild CSS cache when missing or when cache version changed
+      if (!bookMetadataCache->loadCssRules(*cssParser)) {
         LOG_DBG("EBP", "CSS rules cache missing or stale, attempting to parse CSS files");
-        cssParser->deleteCache();
 
+        archive.reset(new ZipFile(filepath, ZipFile::getIndexPath(cachePath)));
+        archive->open();
         if (!parseContentOpf(bookMetadataCache->coreMetadata)) {
           LOG_ERR("EBP", "Could not parse content.opf from cached bookMetadata for CSS files");
           // continue anyway - book will work without CSS and we'll still load any inline style CSS
         }
         parseCssFiles();
+        archive.reset();
         // Invalidate section caches so they are rebuilt with the new CSS
         Storage.removeDir((cachePath + "/sections").c_str());
+      } else {
+        releaseCssRules(true);
       }
     }
     LOG_DBG("EBP", "Loaded ePub: %s", filepath.c_str());
@@ -372,6 +340,23 @@ bool Epub::load(const bool buildIfMissing, const bool skipLoadingCss) {
   LOG_DBG("EBP", "Cache not found, building spine/TOC cache");
   setupCacheDir();
 
+  // Every pass reads through one open zip, whose entries are all looked up in the central directory index the first
+  // lookup writes to the cache directory, rather than each pass reopening the zip and walking its central directory
+  archive.reset(new ZipFile(filepath, ZipFile::getIndexPath(cachePath)));
+  if (!archive->open()) {
+    LOG_ERR("EBP", "Could not open %s", filepath.c_str());
+    archive.reset();
+    return false;
+  }
+  const bool built = buildCache(skipLoadingCss);
+  archive.reset();
+  if (built) {
+    LOG_DBG("EBP", "Loaded ePub: %s", filepath.c_str());
+  }
+  return built;
+}
+
+bool Epub::buildCache(const bool skipLoadingCss) {
   const uint32_t indexingStart = millis();
 
   // Begin building cache - stream entries to disk immediately
@@ -437,12 +422,11 @@ bool Epub::load(const bool buildIfMissing, const bool skipLoadingCss) {
 
   // Build final book.bin
   const uint32_t buildStart = millis();
-  if (!bookMetadataCache->buildBookBin(filepath, bookMetadata)) {
+  if (!bookMetadataCache->buildBookBin(*archive, bookMetadata)) {
     LOG_ERR("EBP", "Could not update mappings and sizes");
     return false;
   }
   LOG_DBG("EBP", "buildBookBin completed in %lu ms", millis() - buildStart);
-  LOG_DBG("EBP", "Total indexing completed in %lu ms", millis() - indexingStart);
 
   if (!bookMetadataCache->cleanupTmpFiles()) {
     LOG_DBG("EBP", "Could not cleanup tmp files - ignoring");
@@ -461,7 +445,7 @@ bool Epub::load(const bool buildIfMissing, const bool skipLoadingCss) {
     Storage.removeDir((cachePath + "/sections").c_str());
   }
 
-  LOG_DBG("EBP", "Loaded ePub: %s", filepath.c_str());
+  LOG_DBG("EBP", "Total indexing completed in %lu ms", millis() - indexingStart);
   return true;
 }
 
@@ -524,14 +508,16 @@ std::string Epub::getCoverBmpPath(bool cropped) const {
   return cachePath + "/" + coverFileName + ".bmp";
 }
 
-bool Epub::generateCoverBmp(bool cropped) const {
+std::string Epub::getCoverMasterPath() const { return cachePath + "/cover_gray.bmp"; }
+
+bool Epub::generateCoverMaster() const {
   // Already generated, return true
-  if (Storage.exists(getCoverBmpPath(cropped).c_str())) {
+  if (Storage.exists(getCoverMasterPath().c_str())) {
     return true;
   }
 
   if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
-    LOG_ERR("EBP", "Cannot generate cover BMP, cache not loaded");
+    LOG_ERR("EBP", "Cannot generate cover master, cache not loaded");
     return false;
   }
 
@@ -541,75 +527,80 @@ bool Epub::generateCoverBmp(bool cropped) const {
     return false;
   }
 
-  if (coverImageHref.substr(coverImageHref.length() - 4) == ".jpg" ||
-      coverImageHref.substr(coverImageHref.length() - 5) == ".jpeg") {
-    LOG_DBG("EBP", "Generating BMP from JPG cover image (%s mode)", cropped ? "cropped" : "fit");
-    const auto coverJpgTempPath = getCachePath() + "/.cover.jpg";
+  const bool isJpg = coverImageHref.substr(coverImageHref.length() - 4) == ".jpg" ||
+                     coverImageHref.substr(coverImageHref.length() - 5) == ".jpeg";
+  const bool isPng = coverImageHref.substr(coverImageHref.length() - 4) == ".png";
+  if (!isJpg && !isPng) {
+    LOG_ERR("EBP", "Cover image is not a supported format, skipping");
+    return false;
+  }
 
-    FsFile coverJpg;
-    if (!Storage.openFileForWrite("EBP", coverJpgTempPath, coverJpg)) {
-      return false;
-    }
-    readItemContentsToStream(coverImageHref, coverJpg, 1024);
-    coverJpg.close();
+  LOG_DBG("EBP", "Generating gray master from %s cover image", isJpg ? "JPG" : "PNG");
+  const auto coverTempPath = getCachePath() + (isJpg ? "/.cover.jpg" : "/.cover.png");
 
-    if (!Storage.openFileForRead("EBP", coverJpgTempPath, coverJpg)) {
-      return false;
-    }
+  FsFile coverImage;
+  if (!Storage.openFileForWrite("EBP", coverTempPath, coverImage)) {
+    return false;
+  }
+  readItemContentsToStream(coverImageHref, coverImage, 1024);
+  coverImage.close();
 
-    FsFile coverBmp;
-    if (!Storage.openFileForWrite("EBP", getCoverBmpPath(cropped), coverBmp)) {
-      coverJpg.close();
-      return false;
-    }
-    const bool success = JpegToBmpConverter::jpegFileToBmpStream(coverJpg, coverBmp, cropped);
-    coverJpg.close();
-    coverBmp.close();
-    Storage.remove(coverJpgTempPath.c_str());
+  if (!Storage.openFileForRead("EBP", coverTempPath, coverImage)) {
+    return false;
+  }
 
-    if (!success) {
-      LOG_ERR("EBP", "Failed to generate BMP from cover image");
-      Storage.remove(getCoverBmpPath(cropped).c_str());
-    }
-    LOG_DBG("EBP", "Generated BMP from JPG cover image, success: %s", success ? "yes" : "no");
-    return success;
+  FsFile master;
+  if (!Storage.openFileForWrite("EBP", getCoverMasterPath(), master)) {
+    coverImage.close();
+    return false;
   }
+  // Panel-sized: the cropped cover is the largest variant, every other one is scaled down from it
+  const bool success =
+      isJpg ? JpegToBmpConverter::jpegFileToGrayMasterStream(coverImage, master, coverMasterWidth, coverMasterHeight)
+            : PngToBmpConverter::pngFileToGrayMasterStream(coverImage, master, coverMasterWidth, coverMasterHeight);
+  coverImage.close();
+  master.close();
+  Storage.remove(coverTempPath.c_str());
 
-  if (coverImageHref.substr(coverImageHref.length() - 4) == ".png") {
-    LOG_DBG("EBP", "Generating BMP from PNG cover image (%s mode)", cropped ? "cropped" : "fit");
-    const auto coverPngTempPath = getCachePath() + "/.cover.png";
+  if (!success) {
+    LOG_ERR("EBP", "Failed to generate gray master from cover image");
+    Storage.remove(getCoverMasterPath().c_str());
+  }
+  LOG_DBG("EBP", "Generated gray master from cover image, success: %s", success ? "yes" : "no");
+  return success;
+}
 
-    FsFile coverPng;
-    if (!Storage.openFileForWrite("EBP", coverPngTempPath, coverPng)) {
-      return false;
-    }
-    readItemContentsToStream(coverImageHref, coverPng, 1024);
-    coverPng.close();
+bool Epub::generateCoverBmp(bool cropped) const {
+  // Already generated, return true
+  if (Storage.exists(getCoverBmpPath(cropped).c_str())) {
+    return true;
+  }
 
-    if (!Storage.openFileForRead("EBP", coverPngTempPath, coverPng)) {
-      return false;
-    }
+  if (!generateCoverMaster()) {
+    return false;
+  }
 
-    FsFile coverBmp;
-    if (!Storage.openFileForWrite("EBP", getCoverBmpPath(cropped), coverBmp)) {
-      coverPng.close();
-      return false;
-    }
-    const bool success = PngToBmpConverter::pngFileToBmpStream(coverPng, coverBmp, cropped);
-    coverPng.close();
-    coverBmp.close();
-    Storage.remove(coverPngTempPath.c_str());
+  LOG_DBG("EBP", "Generating BMP from cover master (%s mode)", cropped ? "cropped" : "fit");
+  FsFile master;
+  if (!Storage.openFileForRead("EBP", getCoverMasterPath(), master)) {
+    return false;
+  }
 
-    if (!success) {
-      LOG_ERR("EBP", "Failed to generate BMP from PNG cover image");
-      Storage.remove(getCoverBmpPath(cropped).c_str());
-    }
-    LOG_DBG("EBP", "Generated BMP from PNG cover image, success: %s", success ? "yes" : "no");
-    return success;
+  FsFile coverBmp;
+  if (!Storage.openFileForWrite("EBP", getCoverBmpPath(cropped), coverBmp)) {
+    master.close();
+    return false;
   }
+  const bool success = GrayBmpToBmpConverter::grayBmpToBmpStream(master, coverBmp, cropped);
+  master.close();
+  coverBmp.close();
 
-  LOG_ERR("EBP", "Cover image is not a supported format, skipping");
-  return false;
+  if (!success) {
+    LOG_ERR("EBP", "Failed to generate BMP from cover master");
+    Storage.remove(getCoverBmpPath(cropped).c_str());
+  }
+  LOG_DBG("EBP", "Generated BMP from cover master, success: %s", success ? "yes" : "no");
+  return success;
 }
 
 std::string Epub::getThumbBmpPath() const { return cachePath + "/thumb_[HEIGHT].bmp"; }
@@ -626,82 +617,33 @@ bool Epub::generateThumbBmp(int height) const {
     return false;
   }
 
-  const auto coverImageHref = bookMetadataCache->coreMetadata.coverItemHref;
-  if (coverImageHref.empty()) {
-    LOG_DBG("EBP", "No known cover image for thumbnail");
-  } else if (coverImageHref.substr(coverImageHref.length() - 4) == ".jpg" ||
-             coverImageHref.substr(coverImageHref.length() - 5) == ".jpeg") {
-    LOG_DBG("EBP", "Generating thumb BMP from JPG cover image");
-    const auto coverJpgTempPath = getCachePath() + "/.cover.jpg";
-
-    FsFile coverJpg;
-    if (!Storage.openFileForWrite("EBP", coverJpgTempPath, coverJpg)) {
-      return false;
-    }
-    readItemContentsToStream(coverImageHref, coverJpg, 1024);
-    coverJpg.close();
-
-    if (!Storage.openFileForRead("EBP", coverJpgTempPath, coverJpg)) {
+  if (generateCoverMaster()) {
+    LOG_DBG("EBP", "Generating thumb BMP from cover master");
+    FsFile master;
+    if (!Storage.openFileForRead("EBP", getCoverMasterPath(), master)) {
       return false;
     }
 
     FsFile thumbBmp;
     if (!Storage.openFileForWrite("EBP", getThumbBmpPath(height), thumbBmp)) {
-      coverJpg.close();
+      master.close();
       return false;
     }
     // Use smaller target size for Continue Reading card (half of screen: 240x400)
     // Generate 1-bit BMP for fast home screen rendering (no gray passes needed)
     int THUMB_TARGET_WIDTH = height * 0.6;
     int THUMB_TARGET_HEIGHT = height;
-    const bool success = JpegToBmpConverter::jpegFileTo1BitBmpStreamWithSize(coverJpg, thumbBmp, THUMB_TARGET_WIDTH,
-                                                                             THUMB_TARGET_HEIGHT);
-    coverJpg.close();
-    thumbBmp.close();
-    Storage.remove(coverJpgTempPath.c_str());
-
-    if (!success) {
-      LOG_ERR("EBP", "Failed to generate thumb BMP from JPG cover image");
-      Storage.remove(getThumbBmpPath(height).c_str());
-    }
-    LOG_DBG("EBP", "Generated thumb BMP from JPG cover image, success: %s", success ? "yes" : "no");
-    return success;
-  } else if (coverImageHref.substr(coverImageHref.length() - 4) == ".png") {
-    LOG_DBG("EBP", "Generating thumb BMP from PNG cover image");
-    const auto coverPngTempPath = getCachePath() + "/.cover.png";
-
-    FsFile coverPng;
-    if (!Storage.openFileForWrite("EBP", coverPngTempPath, coverPng)) {
-      return false;
-    }
-    readItemContentsToStream(coverImageHref, coverPng, 1024);
-    coverPng.close();
-
-    if (!Storage.openFileForRead("EBP", coverPngTempPath, coverPng)) {
-      return false;
-    }
-
-    FsFile thumbBmp;
-    if (!Storage.openFileForWrite("EBP", getThumbBmpPath(height), thumbBmp)) {
-      coverPng.close();
-      return false;
-    }
-    int THUMB_TARGET_WIDTH = height * 0.6;
-    int THUMB_TARGET_HEIGHT = height;
-    const bool success =
-        PngToBmpConverter::pngFileTo1BitBmpStreamWithSize(coverPng, thumbBmp, THUMB_TARGET_WIDTH, THUMB_TARGET_HEIGHT);
-    coverPng.close();
+    const bool success = GrayBmpToBmpConverter::grayBmpTo1BitBmpStreamWithSize(master, thumbBmp, THUMB_TARGET_WIDTH,
+                                                                                THUMB_TARGET_HEIGHT);
+    master.close();
     thumbBmp.close();
-    Storage.remove(coverPngTempPath.c_str());
 
     if (!success) {
-      LOG_ERR("EBP", "Failed to generate thumb BMP from PNG cover image");
+      LOG_ERR("EBP", "Failed to generate thumb BMP from cover master");
       Storage.remove(getThumbBmpPath(height).c_str());
     }
-    LOG_DBG("EBP", "Generated thumb BMP from PNG cover image, success: %s", success ? "yes" : "no");
+    LOG_DBG("EBP", "Generated thumb BMP from cover master, success: %s", success ? "yes" : "no");
     return success;
-  } else {
-    LOG_ERR("EBP", "Cover image is not a supported format, skipping thumbnail");
   }
 
   // Write an empty bmp file to avoid generation attempts in the future
@@ -719,7 +661,8 @@ uint8_t* Epub::readItemContentsToBytes(const std::string& itemHref, size_t* size
 
   const std::string path = FsHelpers::normalisePath(itemHref);
 
-  const auto content = ZipFile(filepath).readFileToMemory(path.c_str(), size, trailingNullByte);
+  const auto content =
+      withArchive([&](ZipFile& zip) { return zip.readFileToMemory(path.c_str(), size, trailingNullByte); });
   if (!content) {
     LOG_DBG("EBP", "Failed to read item %s", path.c_str());
     return nullptr;
@@ -735,12 +678,69 @@ bool Epub::readItemContentsToStream(const std::string& itemHref, Print& out, con
   }
 
   const std::string path = FsHelpers::normalisePath(itemHref);
-  return ZipFile(filepath).readFileToStream(path.c_str(), out, chunkSize);
+  return withArchive([&](ZipFile& zip) { return zip.readFileToStream(path.c_str(), out, chunkSize); });
 }
 
 bool Epub::getItemSize(const std::string& itemHref, size_t* size) const {
   const std::string path = FsHelpers::normalisePath(itemHref);
-  return ZipFile(filepath).getInflatedFileSize(path.c_str(), size);
+  return withArchive([&](ZipFile& zip) { return zip.getInflatedFileSize(path.c_str(), size); });
+}
+
+std::unique_ptr<ZipFile> Epub::openItemStream(const std::string& itemHref, const size_t chunkSize) const {
+  if (itemHref.empty()) {
+    LOG_DBG("EBP", "Failed to open item stream, empty href");
+    return nullptr;
+  }
+
+  const std::string path = FsHelpers::normalisePath(itemHref);
+  auto zip = std::unique_ptr<ZipFile>(new ZipFile(filepath, ZipFile::getIndexPath(cachePath)));
+  if (!zip->beginEntryStream(path.c_str(), chunkSize)) {
+    return nullptr;
+  }
+  return zip;
+}
+
+bool Epub::loadCssRules(const int spineIndex) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded() || !cssParser) {
+    return false;
+  }
+  if (cssRulesResident && (cssRulesSpineIndex < 0 || cssRulesSpineIndex == spineIndex)) {
+    return true;
+  }
+  cssRulesResident = false;
+  CssNameFilter names;
+  const bool narrowed = spineIndex >= 0 && names.load(CssNameFilter::getPath(cachePath), spineIndex);
+  cssRulesSpineIndex = narrowed ? spineIndex : -1;
+  return bookMetadataCache->loadCssRules(*cssParser, narrowed ? &names : nullptr);
+}
+
+void Epub::releaseCssRules(const bool keepResident) const {
+  if (!cssParser) {
+    return;
+  }
+  if (keepResident && cssParser->getHeapUsage() <= CSS_RESIDENT_MAX_BYTES) {
+    cssRulesResident = true;
+    return;
+  }
+  if (cssRulesResident || !cssParser->empty()) {
+    LOG_DBG("EBP", "Freeing %zu CSS rules (%zu bytes)", cssParser->ruleCount(), cssParser->getHeapUsage());
+  }
+  cssParser->clear();
+  cssRulesResident = false;
+  cssRulesSpineIndex = -1;
+}
+
+void Epub::suspend() {
+  if (bookMetadataCache) {
+    bookMetadataCache->suspend();
+  }
+}
+
+bool Epub::resume() { return bookMetadataCache && bookMetadataCache->resume(); }
+
+size_t Epub::getHeapUsage() const {
+  return sizeof(*this) + (bookMetadataCache ? bookMetadataCache->getHeapUsage() : 0) +
+         (cssParser ? cssParser->getHeapUsage() : 0);
 }
 
 int Epub::getSpineItemsCount() const {
@@ -750,7 +750,19 @@ int Epub::getSpineItemsCount() const {
   return bookMetadataCache->getSpineCount();
 }
 
-size_t Epub::getCumulativeSpineItemSize(const int spineIndex) const { return getSpineItem(spineIndex).cumulativeSize; }
+size_t Epub::getCumulativeSpineItemSize(const int spineIndex) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    LOG_ERR("EBP", "getCumulativeSpineItemSize called but cache not loaded");
+    return 0;
+  }
+
+  if (spineIndex < 0 || spineIndex >= bookMetadataCache->getSpineCount()) {
+    LOG_ERR("EBP", "getCumulativeSpineItemSize index:%d is out of range", spineIndex);
+    return bookMetadataCache->getSpineCumulativeSize(0);
+  }
+
+  return bookMetadataCache->getSpineCumulativeSize(spineIndex);
+}
 
 BookMetadataCache::SpineEntry Epub::getSpineItem(const int spineIndex) const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
@@ -780,6 +792,17 @@ BookMetadataCache::TocEntry Epub::getTocItem(const int tocIndex) const {
   return bookMetadataCache->getTocEntry(tocIndex);
 }
 
+bool Epub::getTocTitles(const int firstTocIndex, const int count,
+                        std::vector<BookMetadataCache::TocTitle>& titles) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    LOG_DBG("EBP", "getTocTitles called but cache not loaded");
+    titles.clear();
+    return false;
+  }
+
+  return bookMetadataCache->getTocTitles(firstTocIndex, count, titles);
+}
+
 int Epub::getTocItemsCount() const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
     return 0;
@@ -788,6 +811,14 @@ int Epub::getTocItemsCount() const {
   return bookMetadataCache->getTocCount();
 }
 
+int Epub::getTocSubtreeEnd(const int tocIndex) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    return tocIndex + 1;
+  }
+
+  return bookMetadataCache->getTocSubtreeEnd(tocIndex);
+}
+
 // work out the section index for a toc index
 int Epub::getSpineIndexForTocIndex(const int tocIndex) const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
@@ -800,7 +831,7 @@ int Epub::getSpineIndexForTocIndex(const int tocIndex) const {
     return 0;
   }
 
-  const int spineIndex = bookMetadataCache->getTocEntry(tocIndex).spineIndex;
+  const int spineIndex = bookMetadataCache->getTocSpineIndex(tocIndex);
   if (spineIndex < 0) {
     LOG_DBG("EBP", "Section not found for TOC index %d", tocIndex);
     return 0;
@@ -809,7 +840,19 @@ int Epub::getSpineIndexForTocIndex(const int tocIndex) const {
   return spineIndex;
 }
 
-int Epub::getTocIndexForSpineIndex(const int spineIndex) const { return getSpineItem(spineIndex).tocIndex; }
+int Epub::getTocIndexForSpineIndex(const int spineIndex) const {
+  if (!bookMetadataCache || !bookMetadataCache->isLoaded()) {
+    LOG_ERR("EBP", "getTocIndexForSpineIndex called but cache not loaded");
+    return -1;
+  }
+
+  if (spineIndex < 0 || spineIndex >= bookMetadataCache->getSpineCount()) {
+    LOG_ERR("EBP", "getTocIndexForSpineIndex index:%d is out of range", spineIndex);
+    return bookMetadataCache->getSpineTocIndex(0);
+  }
+
+  return bookMetadataCache->getSpineTocIndex(spineIndex);
+}
 
 size_t Epub::getBookSize() const {
   if (!bookMetadataCache || !bookMetadataCache->isLoaded() || bookMetadataCache->getSpineCount() == 0) {
@@ -27,21 +27,33 @@ class Epub {
   std::unique_ptr<BookMetadataCache> bookMetadataCache;
   // CSS parser for styling
   std::unique_ptr<CssParser> cssParser;
+  // The parser's rules stay loaded between chapter builds
+  mutable bool cssRulesResident = false;
+  // Spine item the loaded rules were narrowed down to (CssNameFilter), or -1 when they are all of the book's
+  mutable int cssRulesSpineIndex = -1;
   // CSS files
   std::vector<std::string> cssFiles;
+  // While load() reads the book, the zip every pass goes through: opened once, with its central directory index
+  // loaded once. Null otherwise, when each read opens the zip for itself.
+  std::unique_ptr<ZipFile> archive;
 
   bool findContentOpfFile(std::string* contentOpfFile) const;
   bool parseContentOpf(BookMetadataCache::BookMetadata& bookMetadata);
   bool parseTocNcxFile() const;
   bool parseTocNavFile() const;
   void parseCssFiles() const;
+  // The 8-bit grayscale cover, decoded once, that the cover and thumbnail BMPs are all resampled from
+  std::string getCoverMasterPath() const;
+  bool generateCoverMaster() const;
+  // The container, OPF, TOC, size and CSS passes that build the cache of a book opened for the first time
+  bool buildCache(bool skipLoadingCss);
+  // Calls fn with the zip of load() if it is open, or with one opened for the call
+  template <typename Fn>
+  auto withArchive(Fn&& fn) const;
 
  public:
-  explicit Epub(std::string filepath, const std::string& cacheDir) : filepath(std::move(filepath)) {
-    // create a cache key based on the filepath
-    cachePath = cacheDir + "/epub_" + std::to_string(std::hash<std::string>{}(this->filepath));
-  }
-  ~Epub() = default;
+  explicit Epub(std::string filepath, const std::string& cacheDir);
+  ~Epub();
   std::string& getBasePath() { return contentBasePath; }
   bool load(bool buildIfMissing = true, bool skipLoadingCss = false);
   bool clearCache() const;
@@ -60,10 +72,15 @@ class Epub {
                                    bool trailingNullByte = false) const;
   bool readItemContentsToStream(const std::string& itemHref, Print& out, size_t chunkSize) const;
   bool getItemSize(const std::string& itemHref, size_t* size) const;
+  // Opens an entry for pull-style reading (see ZipFile::beginEntryStream). Returns nullptr on failure.
+  std::unique_ptr<ZipFile> openItemStream(const std::string& itemHref, size_t chunkSize) const;
   BookMetadataCache::SpineEntry getSpineItem(int spineIndex) const;
   BookMetadataCache::TocEntry getTocItem(int tocIndex) const;
+  bool getTocTitles(int firstTocIndex, int count, std::vector<BookMetadataCache::TocTitle>& titles) const;
   int getSpineItemsCount() const;
   int getTocItemsCount() const;
+  // End of the entries nested under a TOC entry (see BookMetadataCache::getTocSubtreeEnd)
+  int getTocSubtreeEnd(int tocIndex) const;
   int getSpineIndexForTocIndex(int tocIndex) const;
   int getTocIndexForSpineIndex(int spineIndex) const;
   size_t getCumulativeSpineItemSize(int spineIndex) const;
@@ -72,5 +89,17 @@ class Epub {
   size_t getBookSize() const;
   float calculateProgress(int currentSpineIndex, float currentSpineRead) const;
   CssParser* getCssParser() const { return cssParser.get(); }
+  // Loads the book's cached CSS rules into getCssParser(), unless they are still resident. Given a spine item whose
+  // tag and class names were recorded by an earlier build, only the rules that may match them are loaded.
+  bool loadCssRules(int spineIndex = -1) const;
+  // Done with the rules for now: they stay resident for the next chapter build if keepResident is set and they fit
+  // under CSS_RESIDENT_MAX_BYTES, otherwise they're freed
+  void releaseCssRules(bool keepResident) const;
   int resolveHrefToSpineIndex(const std::string& href) const;
+  // Closes the book's files while it is kept loaded without being read; resume() makes it readable again, false if
+  // its cache changed in between and it has to be loaded again
+  void suspend();
+  bool resume();
+  // RAM held by the loaded book: its metadata tables and resident CSS rules
+  size_t getHeapUsage() const;
 };
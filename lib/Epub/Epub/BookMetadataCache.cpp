@@ -7,9 +7,17 @@
 #include <vector>
 
 #include "FsHelpers.h"
+#include "css/CssParser.h"
 
 namespace {
-constexpr uint8_t BOOK_CACHE_VERSION = 5;
+constexpr uint8_t BOOK_CACHE_VERSION = 9;
+// Header fields after the version, LUT offset and counts: spine info offset, CSS rules offset and size
+constexpr uint32_t SPINE_INFO_OFFSET_FIELD = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t) * 2;
+constexpr uint32_t CSS_RULES_FIELDS = SPINE_INFO_OFFSET_FIELD + sizeof(uint32_t);
+// cumulative size, toc index
+constexpr uint32_t SPINE_INFO_ENTRY_SIZE = sizeof(uint32_t) + sizeof(int16_t);
+// spine index, subtree end, level
+constexpr uint32_t TOC_INFO_ENTRY_SIZE = sizeof(int16_t) + sizeof(uint16_t) + sizeof(uint8_t);
 constexpr char bookBinFile[] = "/book.bin";
 constexpr char tmpSpineBinFile[] = "/spine.bin.tmp";
 constexpr char tmpTocBinFile[] = "/toc.bin.tmp";
@@ -52,8 +60,9 @@ bool BookMetadataCache::beginTocPass() {
     spineHrefIndex.clear();
     spineHrefIndex.reserve(spineCount);
     spineFile.seek(0);
+    BufferedFileReader spineReader(spineFile);
     for (int i = 0; i < spineCount; i++) {
-      auto entry = readSpineEntry(spineFile);
+      auto entry = readSpineEntry(spineReader);
       SpineHrefIndexEntry idx;
       idx.hrefHash = fnvHash64(entry.href);
       idx.hrefLen = static_cast<uint16_t>(entry.href.size());
@@ -96,7 +105,7 @@ bool BookMetadataCache::endWrite() {
   return true;
 }
 
-bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMetadata& metadata) {
+bool BookMetadataCache::buildBookBin(ZipFile& zip, const BookMetadata& metadata) {
   // Open all three files, writing to meta, reading from spine and toc
   if (!Storage.openFileForWrite("BMC", cachePath + bookBinFile, bookFile)) {
     return false;
@@ -113,71 +122,84 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     return false;
   }
 
-  constexpr uint32_t headerASize =
-      sizeof(BOOK_CACHE_VERSION) + /* LUT Offset */ sizeof(uint32_t) + sizeof(spineCount) + sizeof(tocCount);
+  constexpr uint32_t headerASize = CSS_RULES_FIELDS + /* CSS rules offset and size */ sizeof(uint32_t) * 2;
   const uint32_t metadataSize = metadata.title.size() + metadata.author.size() + metadata.language.size() +
                                 metadata.coverItemHref.size() + metadata.textReferenceHref.size() +
                                 sizeof(uint32_t) * 5;
   const uint32_t lutSize = sizeof(uint32_t) * spineCount + sizeof(uint32_t) * tocCount;
   const uint32_t lutOffset = headerASize + metadataSize;
+  // The entries are copied over as they are from the temp files; truncated to what was written at the end
+  Storage.preAllocate("BMC", bookFile,
+                      lutOffset + lutSize + spineFile.size() + tocFile.size() + SPINE_INFO_ENTRY_SIZE * spineCount +
+                          TOC_INFO_ENTRY_SIZE * tocCount);
+
+  BufferedFileWriter book(bookFile);
+  BufferedFileReader spine(spineFile);
+  BufferedFileReader toc(tocFile);
 
   // Header A
-  serialization::writePod(bookFile, BOOK_CACHE_VERSION);
-  serialization::writePod(bookFile, lutOffset);
-  serialization::writePod(bookFile, spineCount);
-  serialization::writePod(bookFile, tocCount);
+  serialization::writePod(book, BOOK_CACHE_VERSION);
+  serialization::writePod(book, lutOffset);
+  serialization::writePod(book, spineCount);
+  serialization::writePod(book, tocCount);
+  // Patched in once the spine info table is written; no CSS rules yet
+  serialization::writePod(book, static_cast<uint32_t>(0));
+  serialization::writePod(book, static_cast<uint32_t>(0));
+  serialization::writePod(book, static_cast<uint32_t>(0));
   // Metadata
-  serialization::writeString(bookFile, metadata.title);
-  serialization::writeString(bookFile, metadata.author);
-  serialization::writeString(bookFile, metadata.language);
-  serialization::writeString(bookFile, metadata.coverItemHref);
-  serialization::writeString(bookFile, metadata.textReferenceHref);
+  serialization::writeString(book, metadata.title);
+  serialization::writeString(book, metadata.author);
+  serialization::writeString(book, metadata.language);
+  serialization::writeString(book, metadata.coverItemHref);
+  serialization::writeString(book, metadata.textReferenceHref);
 
   // Loop through spine entries, writing LUT positions
-  spineFile.seek(0);
+  spine.seek(0);
   for (int i = 0; i < spineCount; i++) {
-    uint32_t pos = spineFile.position();
-    auto spineEntry = readSpineEntry(spineFile);
-    serialization::writePod(bookFile, pos + lutOffset + lutSize);
+    uint32_t pos = spine.position();
+    auto spineEntry = readSpineEntry(spine);
+    serialization::writePod(book, pos + lutOffset + lutSize);
   }
 
   // Loop through toc entries, writing LUT positions
-  tocFile.seek(0);
+  toc.seek(0);
   for (int i = 0; i < tocCount; i++) {
-    uint32_t pos = tocFile.position();
-    auto tocEntry = readTocEntry(tocFile);
-    serialization::writePod(bookFile, pos + lutOffset + lutSize + static_cast<uint32_t>(spineFile.position()));
+    uint32_t pos = toc.position();
+    auto tocEntry = readTocEntry(toc);
+    serialization::writePod(book, pos + lutOffset + lutSize + static_cast<uint32_t>(spine.position()));
   }
 
   // LUTs complete
   // Loop through spines from spine file matching up TOC indexes, calculating cumulative size and writing to book.bin
 
-  // Build spineIndex->tocIndex mapping in one pass (O(n) instead of O(n*m))
+  // Build spineIndex->tocIndex mapping in one pass (O(n) instead of O(n*m)), along with the TOC info table. An
+  // entry's subtree ends at the next entry of its level or above, so the entries still open are a stack by level.
   std::vector<int16_t> spineToTocIndex(spineCount, -1);
-  tocFile.seek(0);
+  std::vector<TocInfo> tocTable(tocCount);
+  std::vector<uint16_t> openEntries;
+  toc.seek(0);
   for (int j = 0; j < tocCount; j++) {
-    auto tocEntry = readTocEntry(tocFile);
+    auto tocEntry = readTocEntry(toc);
     if (tocEntry.spineIndex >= 0 && tocEntry.spineIndex < spineCount) {
       if (spineToTocIndex[tocEntry.spineIndex] == -1) {
         spineToTocIndex[tocEntry.spineIndex] = static_cast<int16_t>(j);
       }
     }
+    while (!openEntries.empty() && tocTable[openEntries.back()].level >= tocEntry.level) {
+      tocTable[openEntries.back()].subtreeEnd = static_cast<uint16_t>(j);
+      openEntries.pop_back();
+    }
+    tocTable[j] = {tocEntry.spineIndex, tocCount, tocEntry.level};
+    openEntries.push_back(static_cast<uint16_t>(j));
   }
 
-  ZipFile zip(epubPath);
-  // Pre-open zip file to speed up size calculations
-  if (!zip.open()) {
-    LOG_ERR("BMC", "Could not open EPUB zip for size calculations");
-    bookFile.close();
-    spineFile.close();
-    tocFile.close();
-    return false;
-  }
+  // The sizes are looked up in the zip the rest of the indexing read through, which is kept open with its central
+  // directory index loaded
   // NOTE: We intentionally skip calling loadAllFileStatSlims() here.
   // For large EPUBs (2000+ chapters), pre-loading all ZIP central directory entries
   // into memory causes OOM crashes on ESP32-C3's limited ~380KB RAM.
   // Instead, for large books we use a one-pass batch lookup that scans the ZIP
-  // central directory once and matches against spine targets using hash comparison.
+  // central directory (or its index) once and matches against spine targets using hash comparison.
   // This is O(n*log(m)) instead of O(n*m) while avoiding memory exhaustion.
   // See: https://github.com/crosspoint-reader/crosspoint-reader/issues/134
 
@@ -190,9 +212,9 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     std::vector<ZipFile::SizeTarget> targets;
     targets.reserve(spineCount);
 
-    spineFile.seek(0);
+    spine.seek(0);
     for (int i = 0; i < spineCount; i++) {
-      auto entry = readSpineEntry(spineFile);
+      auto entry = readSpineEntry(spine);
       std::string path = FsHelpers::normalisePath(entry.href);
 
       ZipFile::SizeTarget t;
@@ -216,11 +238,14 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     useBatchSizes = true;
   }
 
+  // Also kept in a fixed-size table after the TOC entries
+  std::vector<SpineInfo> info(spineCount);
+
   uint32_t cumSize = 0;
-  spineFile.seek(0);
+  spine.seek(0);
   int lastSpineTocIndex = -1;
   for (int i = 0; i < spineCount; i++) {
-    auto spineEntry = readSpineEntry(spineFile);
+    auto spineEntry = readSpineEntry(spine);
 
     spineEntry.tocIndex = spineToTocIndex[i];
 
@@ -253,16 +278,36 @@ bool BookMetadataCache::buildBookBin(const std::string& epubPath, const BookMeta
     spineEntry.cumulativeSize = cumSize;
 
     // Write out spine data to book.bin
-    writeSpineEntry(bookFile, spineEntry);
+    writeSpineEntry(book, spineEntry);
+    info[i] = {cumSize, spineEntry.tocIndex};
   }
-  // Close opened zip file
-  zip.close();
 
   // Loop through toc entries from toc file writing to book.bin
-  tocFile.seek(0);
+  toc.seek(0);
   for (int i = 0; i < tocCount; i++) {
-    auto tocEntry = readTocEntry(tocFile);
-    writeTocEntry(bookFile, tocEntry);
+    auto tocEntry = readTocEntry(toc);
+    writeTocEntry(book, tocEntry);
+  }
+
+  const uint32_t infoOffset = book.position();
+  for (const auto& entry : info) {
+    serialization::writePod(book, entry.cumulativeSize);
+    serialization::writePod(book, entry.tocIndex);
+  }
+  for (const auto& entry : tocTable) {
+    serialization::writePod(book, entry.spineIndex);
+    serialization::writePod(book, entry.subtreeEnd);
+    serialization::writePod(book, entry.level);
+  }
+  const uint32_t bookEnd = book.position();
+  book.seek(SPINE_INFO_OFFSET_FIELD);
+  serialization::writePod(book, infoOffset);
+  if (!book.flush() || !bookFile.truncate(bookEnd)) {
+    LOG_ERR("BMC", "Failed to write book.bin");
+    bookFile.close();
+    spineFile.close();
+    tocFile.close();
+    return false;
   }
 
   bookFile.close();
@@ -283,7 +328,8 @@ bool BookMetadataCache::cleanupTmpFiles() const {
   return true;
 }
 
-uint32_t BookMetadataCache::writeSpineEntry(FsFile& file, const SpineEntry& entry) const {
+template <typename File>
+uint32_t BookMetadataCache::writeSpineEntry(File& file, const SpineEntry& entry) const {
   const uint32_t pos = file.position();
   serialization::writeString(file, entry.href);
   serialization::writePod(file, entry.cumulativeSize);
@@ -291,7 +337,8 @@ uint32_t BookMetadataCache::writeSpineEntry(FsFile& file, const SpineEntry& entr
   return pos;
 }
 
-uint32_t BookMetadataCache::writeTocEntry(FsFile& file, const TocEntry& entry) const {
+template <typename File>
+uint32_t BookMetadataCache::writeTocEntry(File& file, const TocEntry& entry) const {
   const uint32_t pos = file.position();
   serialization::writeString(file, entry.title);
   serialization::writeString(file, entry.href);
@@ -343,8 +390,9 @@ void BookMetadataCache::createTocEntry(const std::string& title, const std::stri
     }
   } else {
     spineFile.seek(0);
+    BufferedFileReader spineReader(spineFile);
     for (int i = 0; i < spineCount; i++) {
-      auto spineEntry = readSpineEntry(spineFile);
+      auto spineEntry = readSpineEntry(spineReader);
       if (spineEntry.href == href) {
         spineIndex = static_cast<int16_t>(i);
         break;
@@ -378,6 +426,9 @@ bool BookMetadataCache::load() {
   serialization::readPod(bookFile, lutOffset);
   serialization::readPod(bookFile, spineCount);
   serialization::readPod(bookFile, tocCount);
+  serialization::readPod(bookFile, spineInfoOffset);
+  serialization::readPod(bookFile, cssRulesOffset);
+  serialization::readPod(bookFile, cssRulesSize);
 
   serialization::readString(bookFile, coreMetadata.title);
   serialization::readString(bookFile, coreMetadata.author);
@@ -385,11 +436,78 @@ bool BookMetadataCache::load() {
   serialization::readString(bookFile, coreMetadata.coverItemHref);
   serialization::readString(bookFile, coreMetadata.textReferenceHref);
 
+  if (spineInfoOffset < lutOffset || bookFile.size() < getTocInfoOffset() + TOC_INFO_ENTRY_SIZE * tocCount ||
+      bookFile.size() < cssRulesOffset + cssRulesSize) {
+    LOG_ERR("BMC", "book.bin is truncated");
+    bookFile.close();
+    return false;
+  }
+  spineInfo.clear();
+  spineInfoFirst = 0;
+  if (spineCount <= LARGE_SPINE_THRESHOLD) {
+    loadSpineInfo(0, spineCount);
+  }
+  tocInfo.clear();
+  tocInfoFirst = 0;
+  if (tocCount <= LARGE_TOC_THRESHOLD) {
+    loadTocInfo(0, tocCount);
+  }
+
   loaded = true;
   LOG_DBG("BMC", "Loaded cache data: %d spine, %d TOC entries", spineCount, tocCount);
   return true;
 }
 
+void BookMetadataCache::suspend() {
+  if (bookFile) {
+    bookFile.close();
+  }
+}
+
+bool BookMetadataCache::resume() {
+  if (!loaded) {
+    return false;
+  }
+  if (bookFile) {
+    return true;
+  }
+  if (!Storage.openFileForRead("BMC", cachePath + bookBinFile, bookFile)) {
+    loaded = false;
+    return false;
+  }
+  // The header of a book.bin built again, or given other CSS rules, doesn't match the tables in RAM
+  uint8_t version = 0;
+  uint32_t fileLutOffset = 0;
+  uint16_t fileSpineCount = 0;
+  uint16_t fileTocCount = 0;
+  uint32_t fileSpineInfoOffset = 0;
+  uint32_t fileCssRulesOffset = 0;
+  uint32_t fileCssRulesSize = 0;
+  serialization::readPod(bookFile, version);
+  serialization::readPod(bookFile, fileLutOffset);
+  serialization::readPod(bookFile, fileSpineCount);
+  serialization::readPod(bookFile, fileTocCount);
+  serialization::readPod(bookFile, fileSpineInfoOffset);
+  serialization::readPod(bookFile, fileCssRulesOffset);
+  serialization::readPod(bookFile, fileCssRulesSize);
+  if (version != BOOK_CACHE_VERSION || fileLutOffset != lutOffset || fileSpineCount != spineCount ||
+      fileTocCount != tocCount || fileSpineInfoOffset != spineInfoOffset || fileCssRulesOffset != cssRulesOffset ||
+      fileCssRulesSize != cssRulesSize) {
+    LOG_DBG("BMC", "book.bin changed while the book was closed");
+    bookFile.close();
+    loaded = false;
+    return false;
+  }
+  return true;
+}
+
+size_t BookMetadataCache::getHeapUsage() const {
+  return sizeof(*this) + spineHrefIndex.capacity() * sizeof(SpineHrefIndexEntry) +
+         spineInfo.capacity() * sizeof(SpineInfo) + tocInfo.capacity() * sizeof(TocInfo) +
+         coreMetadata.title.capacity() + coreMetadata.author.capacity() + coreMetadata.language.capacity() +
+         coreMetadata.coverItemHref.capacity() + coreMetadata.textReferenceHref.capacity();
+}
+
 BookMetadataCache::SpineEntry BookMetadataCache::getSpineEntry(const int index) {
   if (!loaded) {
     LOG_ERR("BMC", "getSpineEntry called but cache not loaded");
@@ -409,6 +527,90 @@ BookMetadataCache::SpineEntry BookMetadataCache::getSpineEntry(const int index)
   return readSpineEntry(bookFile);
 }
 
+void BookMetadataCache::loadSpineInfo(const int first, const int count) {
+  spineInfo.resize(count);
+  spineInfoFirst = first;
+  bookFile.seek(spineInfoOffset + SPINE_INFO_ENTRY_SIZE * first);
+  for (auto& entry : spineInfo) {
+    serialization::readPod(bookFile, entry.cumulativeSize);
+    serialization::readPod(bookFile, entry.tocIndex);
+  }
+}
+
+const BookMetadataCache::SpineInfo* BookMetadataCache::getSpineInfo(const int index) {
+  if (!loaded) {
+    LOG_ERR("BMC", "getSpineInfo called but cache not loaded");
+    return nullptr;
+  }
+
+  if (index < 0 || index >= static_cast<int>(spineCount)) {
+    LOG_ERR("BMC", "getSpineInfo index %d out of range", index);
+    return nullptr;
+  }
+
+  if (index < spineInfoFirst || index >= spineInfoFirst + static_cast<int>(spineInfo.size())) {
+    const int first = index - index % SPINE_INFO_PAGE_SIZE;
+    loadSpineInfo(first, std::min<int>(SPINE_INFO_PAGE_SIZE, spineCount - first));
+  }
+  return &spineInfo[index - spineInfoFirst];
+}
+
+size_t BookMetadataCache::getSpineCumulativeSize(const int index) {
+  const SpineInfo* info = getSpineInfo(index);
+  return info ? info->cumulativeSize : 0;
+}
+
+int16_t BookMetadataCache::getSpineTocIndex(const int index) {
+  const SpineInfo* info = getSpineInfo(index);
+  return info ? info->tocIndex : -1;
+}
+
+bool BookMetadataCache::loadCssRules(CssParser& parser, const CssNameFilter* names) {
+  if (!loaded || cssRulesSize == 0) {
+    return false;
+  }
+  bookFile.seek(cssRulesOffset);
+  BufferedFileReader reader(bookFile);
+  return parser.loadFromCache(reader, names);
+}
+
+bool BookMetadataCache::saveCssRules(const CssParser& parser) {
+  if (!loaded) {
+    LOG_ERR("BMC", "saveCssRules called but cache not loaded");
+    return false;
+  }
+
+  // Replaces any previous rules, which are always the last section
+  const std::string path = cachePath + bookBinFile;
+  const uint32_t offset = getTocInfoOffset() + TOC_INFO_ENTRY_SIZE * tocCount;
+  bookFile.close();
+  FsFile file = Storage.open(path.c_str(), O_RDWR);
+  bool saved = false;
+  if (file) {
+    file.seek(offset);
+    {
+      BufferedFileWriter writer(file);
+      saved = parser.saveToCache(writer) && writer.flush();
+    }
+    const uint32_t size = saved ? static_cast<uint32_t>(file.position()) - offset : 0;
+    file.truncate(offset + size);
+    file.seek(CSS_RULES_FIELDS);
+    serialization::writePod(file, offset);
+    serialization::writePod(file, size);
+    file.close();
+    cssRulesOffset = offset;
+    cssRulesSize = size;
+  } else {
+    LOG_ERR("BMC", "Could not open %s to save CSS rules", path.c_str());
+  }
+
+  if (!Storage.openFileForRead("BMC", path, bookFile)) {
+    loaded = false;
+    return false;
+  }
+  return saved;
+}
+
 BookMetadataCache::TocEntry BookMetadataCache::getTocEntry(const int index) {
   if (!loaded) {
     LOG_ERR("BMC", "getTocEntry called but cache not loaded");
@@ -428,7 +630,81 @@ BookMetadataCache::TocEntry BookMetadataCache::getTocEntry(const int index) {
   return readTocEntry(bookFile);
 }
 
-BookMetadataCache::SpineEntry BookMetadataCache::readSpineEntry(FsFile& file) const {
+uint32_t BookMetadataCache::getTocInfoOffset() const {
+  return spineInfoOffset + SPINE_INFO_ENTRY_SIZE * spineCount;
+}
+
+void BookMetadataCache::loadTocInfo(const int first, const int count) {
+  tocInfo.resize(count);
+  tocInfoFirst = first;
+  bookFile.seek(getTocInfoOffset() + TOC_INFO_ENTRY_SIZE * first);
+  for (auto& entry : tocInfo) {
+    serialization::readPod(bookFile, entry.spineIndex);
+    serialization::readPod(bookFile, entry.subtreeEnd);
+    serialization::readPod(bookFile, entry.level);
+  }
+}
+
+const BookMetadataCache::TocInfo* BookMetadataCache::getTocInfo(const int index) {
+  if (!loaded) {
+    LOG_ERR("BMC", "getTocInfo called but cache not loaded");
+    return nullptr;
+  }
+
+  if (index < 0 || index >= static_cast<int>(tocCount)) {
+    LOG_ERR("BMC", "getTocInfo index %d out of range", index);
+    return nullptr;
+  }
+
+  if (index < tocInfoFirst || index >= tocInfoFirst + static_cast<int>(tocInfo.size())) {
+    const int first = index - index % TOC_INFO_PAGE_SIZE;
+    loadTocInfo(first, std::min<int>(TOC_INFO_PAGE_SIZE, tocCount - first));
+  }
+  return &tocInfo[index - tocInfoFirst];
+}
+
+int16_t BookMetadataCache::getTocSpineIndex(const int index) {
+  const TocInfo* info = getTocInfo(index);
+  return info ? info->spineIndex : -1;
+}
+
+int BookMetadataCache::getTocSubtreeEnd(const int index) {
+  const TocInfo* info = getTocInfo(index);
+  return info ? info->subtreeEnd : index + 1;
+}
+
+bool BookMetadataCache::getTocTitles(const int first, const int count, std::vector<TocTitle>& titles) {
+  titles.clear();
+  if (!loaded || first < 0 || first >= static_cast<int>(tocCount)) {
+    return false;
+  }
+
+  bookFile.seek(lutOffset + sizeof(uint32_t) * spineCount + sizeof(uint32_t) * first);
+  uint32_t tocEntryPos;
+  serialization::readPod(bookFile, tocEntryPos);
+  bookFile.seek(tocEntryPos);
+  BufferedFileReader toc(bookFile);
+  const int end = std::min(first + count, static_cast<int>(tocCount));
+  titles.reserve(end - first);
+  for (int i = first; i < end; i++) {
+    TocTitle entry;
+    serialization::readString(toc, entry.title);
+    // href and anchor
+    for (int skipped = 0; skipped < 2; skipped++) {
+      uint32_t len = 0;
+      serialization::readPod(toc, len);
+      toc.seek(toc.position() + len);
+    }
+    serialization::readPod(toc, entry.level);
+    int16_t spineIndex;
+    serialization::readPod(toc, spineIndex);
+    titles.push_back(std::move(entry));
+  }
+  return true;
+}
+
+template <typename File>
+BookMetadataCache::SpineEntry BookMetadataCache::readSpineEntry(File& file) const {
   SpineEntry entry;
   serialization::readString(file, entry.href);
   serialization::readPod(file, entry.cumulativeSize);
@@ -436,7 +712,8 @@ BookMetadataCache::SpineEntry BookMetadataCache::readSpineEntry(FsFile& file) co
   return entry;
 }
 
-BookMetadataCache::TocEntry BookMetadataCache::readTocEntry(FsFile& file) const {
+template <typename File>
+BookMetadataCache::TocEntry BookMetadataCache::readTocEntry(File& file) const {
   TocEntry entry;
   serialization::readString(file, entry.title);
   serialization::readString(file, entry.href);
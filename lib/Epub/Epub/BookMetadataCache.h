@@ -6,6 +6,12 @@
 #include <string>
 #include <vector>
 
+class CssNameFilter;
+class CssParser;
+class ZipFile;
+
+// book.bin: a fixed header pointing at the metadata, the spine/TOC LUTs and entries, the spine and TOC info tables
+// and the book's CSS rules, so a warm open of a book reads one file.
 class BookMetadataCache {
  public:
   struct BookMetadata {
@@ -18,11 +24,11 @@ class BookMetadataCache {
 
   struct SpineEntry {
     std::string href;
-    size_t cumulativeSize;
+    uint32_t cumulativeSize;  // Fixed width like every field written to book.bin
     int16_t tocIndex;
 
     SpineEntry() : cumulativeSize(0), tocIndex(-1) {}
-    SpineEntry(std::string href, const size_t cumulativeSize, const int16_t tocIndex)
+    SpineEntry(std::string href, const uint32_t cumulativeSize, const int16_t tocIndex)
         : href(std::move(href)), cumulativeSize(cumulativeSize), tocIndex(tocIndex) {}
   };
 
@@ -42,9 +48,15 @@ class BookMetadataCache {
           spineIndex(spineIndex) {}
   };
 
+  // What a list of chapters shows of a TOC entry
+  struct TocTitle {
+    std::string title;
+    uint8_t level;
+  };
+
  private:
   std::string cachePath;
-  size_t lutOffset;
+  uint32_t lutOffset;
   uint16_t spineCount;
   uint16_t tocCount;
   bool loaded;
@@ -66,6 +78,31 @@ class BookMetadataCache {
 
   static constexpr uint16_t LARGE_SPINE_THRESHOLD = 400;
 
+  // Cumulative size and TOC index of each spine item, from the fixed-size table at the end of book.bin, so progress
+  // and chapter lookups don't read the SD card. Books above LARGE_SPINE_THRESHOLD keep one page of it at a time.
+  struct SpineInfo {
+    uint32_t cumulativeSize;
+    int16_t tocIndex;
+  };
+  static constexpr uint16_t SPINE_INFO_PAGE_SIZE = 64;
+  std::vector<SpineInfo> spineInfo;
+  uint32_t spineInfoOffset = 0;
+  int spineInfoFirst = 0;  // Spine index of spineInfo[0]
+  // Spine index and subtree of each TOC entry, from the fixed-size table after the spine info one, so jumping to a
+  // chapter and walking the TOC tree read no entries. Paged above LARGE_TOC_THRESHOLD entries like the spine info.
+  struct TocInfo {
+    int16_t spineIndex;
+    uint16_t subtreeEnd;  // Index of the first entry after those nested under this one
+    uint8_t level;
+  };
+  static constexpr uint16_t LARGE_TOC_THRESHOLD = 400;
+  static constexpr uint16_t TOC_INFO_PAGE_SIZE = 64;
+  std::vector<TocInfo> tocInfo;
+  int tocInfoFirst = 0;  // TOC index of tocInfo[0]
+  // CSS rules section, last in the file; empty until saveCssRules()
+  uint32_t cssRulesOffset = 0;
+  uint32_t cssRulesSize = 0;
+
   // FNV-1a 64-bit hash function
   static uint64_t fnvHash64(const std::string& s) {
     uint64_t hash = 14695981039346656037ull;
@@ -76,10 +113,20 @@ class BookMetadataCache {
     return hash;
   }
 
-  uint32_t writeSpineEntry(FsFile& file, const SpineEntry& entry) const;
-  uint32_t writeTocEntry(FsFile& file, const TocEntry& entry) const;
-  SpineEntry readSpineEntry(FsFile& file) const;
-  TocEntry readTocEntry(FsFile& file) const;
+  // File is an FsFile or one of the buffered adapters in front of it
+  template <typename File>
+  uint32_t writeSpineEntry(File& file, const SpineEntry& entry) const;
+  template <typename File>
+  uint32_t writeTocEntry(File& file, const TocEntry& entry) const;
+  template <typename File>
+  SpineEntry readSpineEntry(File& file) const;
+  template <typename File>
+  TocEntry readTocEntry(File& file) const;
+  void loadSpineInfo(int first, int count);
+  const SpineInfo* getSpineInfo(int index);
+  uint32_t getTocInfoOffset() const;
+  void loadTocInfo(int first, int count);
+  const TocInfo* getTocInfo(int index);
 
  public:
   BookMetadata coreMetadata;
@@ -99,14 +146,33 @@ class BookMetadataCache {
   bool endWrite();
   bool cleanupTmpFiles() const;
 
-  // Post-processing to update mappings and sizes
-  bool buildBookBin(const std::string& epubPath, const BookMetadata& metadata);
+  // Post-processing to update mappings and sizes, with the sizes of the spine items looked up in the book's zip
+  bool buildBookBin(ZipFile& zip, const BookMetadata& metadata);
 
   // Reading phase (read mode)
   bool load();
   SpineEntry getSpineEntry(int index);
+  // Without reading the href
+  size_t getSpineCumulativeSize(int index);
+  int16_t getSpineTocIndex(int index);
+  // CSS rules of the book, parsed once from its stylesheets; only those that may match names if it's set
+  bool loadCssRules(CssParser& parser, const CssNameFilter* names = nullptr);
+  bool saveCssRules(const CssParser& parser);
   TocEntry getTocEntry(int index);
+  // Without reading the entry
+  int16_t getTocSpineIndex(int index);
+  // Entries from index + 1 to the subtree end are nested under the entry; its children are the first of them and
+  // each next one at the subtree end of the one before
+  int getTocSubtreeEnd(int index);
+  // Titles of the count TOC entries from first on (fewer at the end of the TOC), read in one pass over book.bin where
+  // the entries follow each other; their hrefs and anchors are skipped
+  bool getTocTitles(int first, int count, std::vector<TocTitle>& titles);
   int getSpineCount() const { return spineCount; }
   int getTocCount() const { return tocCount; }
   bool isLoaded() const { return loaded; }
+  // Closes book.bin while what load() read stays in RAM; resume() reopens it, failing if the file was rebuilt since
+  void suspend();
+  bool resume();
+  // RAM held by the tables loaded from book.bin
+  size_t getHeapUsage() const;
 };
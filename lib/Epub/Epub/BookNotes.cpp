@@ -0,0 +1,341 @@
+#include "BookNotes.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <ZipFile.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "../Epub.h"
+#include "Page.h"
+#include "parsers/ChapterHtmlSlimParser.h"
+#include "parsers/ChapterTokenizer.h"
+
+namespace {
+constexpr uint8_t NOTES_FILE_VERSION = 1;
+constexpr uint32_t RECORD_HEADER_SIZE = sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint32_t);
+constexpr uint32_t TABLE_ENTRY_SIZE = sizeof(uint32_t) + sizeof(uint32_t);
+constexpr size_t SCAN_BUFFER_SIZE = 1024;
+constexpr size_t MAX_NOTES_PER_ITEM = 4096;
+constexpr char ELLIPSIS[] = "\xe2\x80\xa6";
+
+// Elements that don't start a block of their own; an id on one of them, but for a link, isn't taken for a note
+constexpr const char* INLINE_TAGS[] = {"span", "sup", "sub", "b", "i", "em", "strong", "small", "u", "cite", "abbr",
+                                       "code", "q", "s", "del", "ins", "font", "tt", "big", "mark", "var", "kbd",
+                                       "samp", "dfn", "bdi", "bdo", "wbr", "br", "img", "a"};
+constexpr const char* SKIPPED_TAGS[] = {"head", "script", "style"};
+
+bool isOneOf(const char* name, const char* const* names, const size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(name, names[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Tokenizer handlers for one scan. Texts are written out as their element closes, so only the table of ids and the
+// texts still open (one per nesting level at most) are held.
+class NoteScanner {
+ public:
+  explicit NoteScanner(BufferedFileWriter& writer) : writer(writer) {}
+
+  std::unique_ptr<ChapterTokenizer> tokenizer;
+  std::vector<std::pair<uint32_t, uint32_t>> table;  // <id hash, text offset>
+
+  void finishAll() {
+    while (!captures.empty()) {
+      finish(captures.size() - 1);
+    }
+  }
+
+  static void startElement(void* userData, const char* name, const char** atts) {
+    auto* self = static_cast<NoteScanner*>(userData);
+    self->depth++;
+    if (isOneOf(name, SKIPPED_TAGS, sizeof(SKIPPED_TAGS) / sizeof(SKIPPED_TAGS[0]))) {
+      self->tokenizer->skipElementContent(name);
+      return;
+    }
+    const bool isLink = strcmp(name, "a") == 0;
+    const bool isBlock = !isOneOf(name, INLINE_TAGS, sizeof(INLINE_TAGS) / sizeof(INLINE_TAGS[0]));
+    if (isBlock) {
+      self->blockDepths.push_back(self->depth);
+      self->separateWords();
+    }
+
+    const char* id = nullptr;
+    for (int i = 0; atts && atts[i]; i += 2) {
+      if (strcmp(atts[i], "id") == 0) {
+        id = atts[i + 1];
+      }
+    }
+    if (!id || id[0] == '\0' || (!isBlock && !isLink) ||
+        self->table.size() + self->captures.size() >= MAX_NOTES_PER_ITEM) {
+      return;
+    }
+    // A link's note is the rest of the block it's in
+    const int endDepth = isBlock || self->blockDepths.empty() ? self->depth : self->blockDepths.back();
+    self->captures.push_back({ChapterHtmlSlimParser::anchorHash(id, strlen(id)), endDepth, {}, false});
+  }
+
+  static void endElement(void* userData, const char* /*name*/) {
+    auto* self = static_cast<NoteScanner*>(userData);
+    if (!self->blockDepths.empty() && self->blockDepths.back() == self->depth) {
+      self->blockDepths.pop_back();
+      self->separateWords();
+    }
+    for (size_t i = self->captures.size(); i-- > 0;) {
+      if (self->captures[i].endDepth >= self->depth) {
+        self->finish(i);
+      }
+    }
+    self->depth--;
+  }
+
+  static void characterData(void* userData, const char* s, const int len) {
+    auto* self = static_cast<NoteScanner*>(userData);
+    for (size_t i = self->captures.size(); i-- > 0;) {
+      if (self->captures[i].append(s, len)) {
+        self->finish(i);
+      }
+    }
+  }
+
+ private:
+  struct Capture {
+    uint32_t hash;
+    int endDepth;
+    std::string text;
+    bool space;
+
+    // Appends with whitespace collapsed; true once the text is full (and ends in an ellipsis)
+    bool append(const char* s, const int len) {
+      for (int i = 0; i < len; i++) {
+        const char c = s[i];
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+          space = true;
+          continue;
+        }
+        if (space && !text.empty()) {
+          text += ' ';
+        }
+        space = false;
+        text += c;
+        if (text.size() >= BookNotes::MAX_NOTE_LENGTH) {
+          size_t cut = BookNotes::MAX_NOTE_LENGTH - (sizeof(ELLIPSIS) - 1);
+          while (cut > 0 && (static_cast<uint8_t>(text[cut]) & 0xC0) == 0x80) {
+            cut--;
+          }
+          text.resize(cut);
+          text += ELLIPSIS;
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+
+  BufferedFileWriter& writer;
+  std::vector<Capture> captures;
+  std::vector<int> blockDepths;
+  int depth = 0;
+
+  void separateWords() {
+    for (auto& capture : captures) {
+      capture.space = true;
+    }
+  }
+
+  void finish(const size_t index) {
+    const Capture& capture = captures[index];
+    if (!capture.text.empty()) {
+      table.emplace_back(capture.hash, writer.position());
+      serialization::writePod(writer, static_cast<uint16_t>(capture.text.size()));
+      writer.write(capture.text.data(), capture.text.size());
+    }
+    captures.erase(captures.begin() + index);
+  }
+};
+}  // namespace
+
+bool BookNotes::load() {
+  if (loaded) {
+    return true;
+  }
+  records.clear();
+  FsFile file;
+  if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("BNT", path, file)) {
+    loaded = true;
+    return true;
+  }
+  BufferedFileReader reader(file);
+  uint8_t version = 0;
+  serialization::readPod(reader, version);
+  if (version != NOTES_FILE_VERSION) {
+    LOG_DBG("BNT", "Ignoring notes of version %u", version);
+    file.close();
+    Storage.remove(path.c_str());
+    loaded = true;
+    return true;
+  }
+  const uint32_t size = static_cast<uint32_t>(file.size());
+  uint32_t position = reader.position();
+  while (position + RECORD_HEADER_SIZE <= size) {
+    Record record = {};
+    reader.seek(position);
+    serialization::readPod(reader, record.spineIndex);
+    serialization::readPod(reader, record.count);
+    serialization::readPod(reader, record.tableOffset);
+    const uint32_t end = record.tableOffset + record.count * TABLE_ENTRY_SIZE;
+    if (record.tableOffset < position + RECORD_HEADER_SIZE || end > size) {
+      // Cut off while it was being written; scanned again when next wanted
+      break;
+    }
+    records.push_back(record);
+    position = end;
+  }
+  file.close();
+  loaded = true;
+  return true;
+}
+
+const BookNotes::Record* BookNotes::findRecord(const int spineIndex) const {
+  for (const auto& record : records) {
+    if (record.spineIndex == spineIndex) {
+      return &record;
+    }
+  }
+  return nullptr;
+}
+
+bool BookNotes::isScanned(const int spineIndex) { return load() && findRecord(spineIndex) != nullptr; }
+
+bool BookNotes::scan(const Epub& epub, const int spineIndex, const std::function<bool()>& shouldAbort) {
+  if (isScanned(spineIndex)) {
+    return true;
+  }
+  if (spineIndex < 0 || spineIndex >= epub.getSpineItemsCount()) {
+    return false;
+  }
+  auto source = epub.openItemStream(epub.getSpineItem(spineIndex).href, SCAN_BUFFER_SIZE);
+  if (!source) {
+    LOG_ERR("BNT", "Failed to open spine item %d", spineIndex);
+    return false;
+  }
+
+  FsFile file = Storage.open(path.c_str(), O_RDWR | O_CREAT);
+  if (!file) {
+    LOG_ERR("BNT", "Failed to open %s for writing", path.c_str());
+    return false;
+  }
+  // Anything after the last complete record is dropped
+  const uint32_t recordStart = records.empty() ? sizeof(NOTES_FILE_VERSION)
+                                               : records.back().tableOffset + records.back().count * TABLE_ENTRY_SIZE;
+  file.truncate(recordStart);
+  file.seek(0);
+  serialization::writePod(file, NOTES_FILE_VERSION);
+  file.seek(recordStart);
+
+  BufferedFileWriter writer(file);
+  serialization::writePod(writer, static_cast<uint16_t>(spineIndex));
+  serialization::writePod(writer, static_cast<uint16_t>(0));  // Placeholder for count
+  serialization::writePod(writer, static_cast<uint32_t>(0));  // Placeholder for table offset
+
+  NoteScanner scanner(writer);
+  scanner.tokenizer = ChapterTokenizer::create(
+      false, {&scanner, NoteScanner::startElement, NoteScanner::endElement, NoteScanner::characterData});
+  bool aborted = !scanner.tokenizer;
+  while (!aborted) {
+    char* const buffer = scanner.tokenizer->getBuffer(SCAN_BUFFER_SIZE);
+    const int len = buffer ? source->readEntryStream(reinterpret_cast<uint8_t*>(buffer), SCAN_BUFFER_SIZE) : -1;
+    if (len < 0) {
+      LOG_ERR("BNT", "Failed to read spine item %d", spineIndex);
+      aborted = true;
+      break;
+    }
+    if (!scanner.tokenizer->parseBuffer(len, len == 0)) {
+      // What came before the error is kept, so a broken chapter isn't read again and again
+      LOG_DBG("BNT", "Parse error in spine item %d at line %lu", spineIndex, scanner.tokenizer->getCurrentLine());
+      break;
+    }
+    if (len == 0) {
+      break;
+    }
+    aborted = shouldAbort && shouldAbort();
+  }
+  scanner.tokenizer.reset();
+  source.reset();
+  if (aborted) {
+    writer.flush();
+    file.truncate(recordStart);
+    file.close();
+    return false;
+  }
+  scanner.finishAll();
+
+  auto& table = scanner.table;
+  std::stable_sort(table.begin(), table.end(),
+                   [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                     return a.first < b.first;
+                   });
+  table.erase(std::unique(table.begin(), table.end(),
+                          [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) {
+                            return a.first == b.first;
+                          }),
+              table.end());
+  const Record record = {static_cast<uint16_t>(spineIndex), static_cast<uint16_t>(table.size()), writer.position()};
+  for (const auto& [hash, offset] : table) {
+    serialization::writePod(writer, hash);
+    serialization::writePod(writer, offset);
+  }
+  writer.seek(recordStart + sizeof(uint16_t));
+  serialization::writePod(writer, record.count);
+  serialization::writePod(writer, record.tableOffset);
+  const bool ok = writer.flush();
+  file.close();
+  if (!ok) {
+    LOG_ERR("BNT", "Failed to write notes of spine item %d", spineIndex);
+    return false;
+  }
+  records.push_back(record);
+  LOG_DBG("BNT", "Spine item %d: %u notes", spineIndex, record.count);
+  return true;
+}
+
+bool BookNotes::getNote(const int spineIndex, const std::string& id, std::string& text) {
+  const Record* record = load() ? findRecord(spineIndex) : nullptr;
+  FsFile file;
+  if (!record || record->count == 0 || id.empty() || !Storage.openFileForRead("BNT", path, file)) {
+    return false;
+  }
+  const uint32_t hash = ChapterHtmlSlimParser::anchorHash(id.data(), id.size());
+  int low = 0;
+  int high = record->count - 1;
+  uint32_t textOffset = 0;
+  while (low <= high && textOffset == 0) {
+    const int mid = (low + high) / 2;
+    uint32_t entryHash = 0;
+    uint32_t entryOffset = 0;
+    file.seek(record->tableOffset + mid * TABLE_ENTRY_SIZE);
+    serialization::readPod(file, entryHash);
+    serialization::readPod(file, entryOffset);
+    if (entryHash == hash) {
+      textOffset = entryOffset;
+    } else if (entryHash < hash) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  uint16_t length = 0;
+  bool found = false;
+  if (textOffset != 0 && file.seek(textOffset)) {
+    serialization::readPod(file, length);
+    text.resize(length);
+    found = length <= MAX_NOTE_LENGTH && file.read(&text[0], length) == static_cast<int>(length);
+  }
+  file.close();
+  return found;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Epub;
+
+// Text of the notes a book's footnote links point to, so they can be shown where the link is instead of opening
+// (and indexing) the chapter they're in. Stored as notes.bin in the book's cache directory.
+//
+// A spine item is scanned the first time a note in it is wanted: one streaming pass over its XHTML, with no layout,
+// that keeps the start of every element with an id that reads like a note (a block element, or a link such as the
+// number of "<p><a id="n1" href="...">1</a> Note text</p>", whose note is the rest of its block). Each text is kept
+// up to MAX_NOTE_LENGTH bytes. Every scanned item appends one record to the file:
+//   u16 spineIndex, u16 count, u32 tableOffset, then the texts (u16 length + UTF-8 each), then count entries of
+//   u32 id hash (ChapterHtmlSlimParser::anchorHash) and u32 text offset, sorted by hash.
+class BookNotes {
+  struct Record {
+    uint16_t spineIndex;
+    uint16_t count;
+    uint32_t tableOffset;
+  };
+
+  std::string path;
+  std::vector<Record> records;
+  bool loaded = false;
+
+  bool load();
+  const Record* findRecord(int spineIndex) const;
+
+ public:
+  static constexpr size_t MAX_NOTE_LENGTH = 400;
+
+  explicit BookNotes(std::string path) : path(std::move(path)) {}
+
+  bool isScanned(int spineIndex);
+  // Scans the spine item for notes and appends them to the file, unless it already was. False if it couldn't be
+  // read, or shouldAbort (checked between chunks of the XHTML) returned true; nothing is kept then.
+  bool scan(const Epub& epub, int spineIndex, const std::function<bool()>& shouldAbort = nullptr);
+  // Text of the element with id in a scanned spine item; false if the item has no such note or isn't scanned yet
+  bool getNote(int spineIndex, const std::string& id, std::string& text);
+};
@@ -0,0 +1,96 @@
+#include "BookPageIndex.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr uint8_t PAGE_INDEX_FILE_VERSION = 1;
+}  // namespace
+
+BookPageIndex::BookPageIndex(std::string path, const int spineCount)
+    : path(std::move(path)), pageCounts(spineCount > 0 ? spineCount : 0, UNKNOWN) {
+  updatePagesBefore();
+}
+
+void BookPageIndex::updatePagesBefore() {
+  pagesBefore.assign(pageCounts.size() + 1, 0);
+  for (size_t i = 0; i < pageCounts.size(); i++) {
+    pagesBefore[i + 1] = pagesBefore[i] + (pageCounts[i] != UNKNOWN ? pageCounts[i] : 0);
+  }
+}
+
+bool BookPageIndex::load() {
+  FsFile file;
+  if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("BPI", path, file)) {
+    return false;
+  }
+
+  uint8_t version;
+  uint16_t count;
+  serialization::readPod(file, version);
+  serialization::readPod(file, count);
+  if (version != PAGE_INDEX_FILE_VERSION || count != pageCounts.size()) {
+    LOG_ERR("BPI", "Ignoring stale page index (version %u, %u items)", version, count);
+    file.close();
+    return false;
+  }
+
+  const size_t bytes = count * sizeof(uint16_t);
+  const bool ok = file.read(reinterpret_cast<uint8_t*>(pageCounts.data()), bytes) == static_cast<int>(bytes);
+  file.close();
+  if (!ok) {
+    LOG_ERR("BPI", "Truncated page index");
+    pageCounts.assign(pageCounts.size(), UNKNOWN);
+  }
+  updatePagesBefore();
+  return ok;
+}
+
+bool BookPageIndex::save() const {
+  FsFile file;
+  if (!Storage.openFileForWrite("BPI", path, file)) {
+    return false;
+  }
+  serialization::writePod(file, PAGE_INDEX_FILE_VERSION);
+  serialization::writePod(file, static_cast<uint16_t>(pageCounts.size()));
+  file.write(reinterpret_cast<const uint8_t*>(pageCounts.data()), pageCounts.size() * sizeof(uint16_t));
+  file.close();
+  return true;
+}
+
+bool BookPageIndex::setPageCount(const int spineIndex, const uint16_t pageCount) {
+  if (spineIndex < 0 || spineIndex >= static_cast<int>(pageCounts.size()) || pageCounts[spineIndex] == pageCount) {
+    return false;
+  }
+  pageCounts[spineIndex] = pageCount;
+  updatePagesBefore();
+  return true;
+}
+
+int BookPageIndex::firstUnknown() const {
+  for (size_t i = 0; i < pageCounts.size(); i++) {
+    if (pageCounts[i] == UNKNOWN) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+uint32_t BookPageIndex::getPagesBefore(const int spineIndex) const {
+  return pagesBefore[std::max(0, std::min(spineIndex, static_cast<int>(pageCounts.size())))];
+}
+
+int BookPageIndex::findPage(const uint32_t bookPage, uint16_t& pageInSpine) const {
+  if (bookPage >= getTotalPages()) {
+    return -1;
+  }
+  // The last spine item starting at or before bookPage; empty ones share their start with the next and are skipped
+  const auto next = std::upper_bound(pagesBefore.begin(), pagesBefore.end(), bookPage);
+  const int spineIndex = static_cast<int>(next - pagesBefore.begin()) - 1;
+  pageInSpine = static_cast<uint16_t>(bookPage - pagesBefore[spineIndex]);
+  return spineIndex;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Page count of every spine item for one layout of a book, stored as pages.bin next to that layout's section files
+// (so it goes away with them). Filled in as chapters get indexed; once complete it gives exact book page numbers
+// instead of the byte-size based progress estimate.
+class BookPageIndex {
+  std::string path;
+  std::vector<uint16_t> pageCounts;
+  // pagesBefore[i] is the sum of the known page counts of spine items 0 to i-1, with the book's total at the end
+  std::vector<uint32_t> pagesBefore;
+
+  void updatePagesBefore();
+
+ public:
+  static constexpr uint16_t UNKNOWN = 0xFFFF;
+
+  BookPageIndex(std::string path, int spineCount);
+
+  bool load();
+  bool save() const;
+  const std::string& getPath() const { return path; }
+
+  // Returns true if the stored count changed (and the index should be saved)
+  bool setPageCount(int spineIndex, uint16_t pageCount);
+  // First spine item whose page count isn't known yet, or -1 once the index is complete
+  int firstUnknown() const;
+  bool isComplete() const { return firstUnknown() < 0; }
+  uint32_t getPagesBefore(int spineIndex) const;
+  uint32_t getTotalPages() const { return pagesBefore.back(); }
+  // Spine item holding page bookPage (0-based) of the whole book, and the page within it; -1 past the end
+  int findPage(uint32_t bookPage, uint16_t& pageInSpine) const;
+};
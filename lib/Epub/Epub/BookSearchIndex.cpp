@@ -0,0 +1,672 @@
+#include "BookSearchIndex.h"
+
+#include <Arduino.h>
+#include <BufferedFile.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <Utf8.h>
+
+#include <algorithm>
+#include <string_view>
+
+#include "Page.h"
+#include "Section.h"
+
+namespace {
+constexpr uint8_t SEARCH_INDEX_FILE_VERSION = 1;
+constexpr uint32_t HEADER_SIZE = sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t);
+constexpr uint32_t DIRECTORY_ENTRY_SIZE = 2 * sizeof(uint32_t);
+// Longest encoding of a posting: a 5 byte hash delta and 3 bytes each for spine and page
+constexpr size_t MAX_POSTING_BYTES = 11;
+// Postings read from a run at a time while merging
+constexpr size_t CURSOR_POSTINGS = 16;
+// A term with more pages than this (more than most books have) is cut off there
+constexpr size_t MAX_TERM_HITS = 4096;
+constexpr size_t MAX_TERM_LENGTH = 48;
+// Hyphenated parts a joined term is made of at most
+constexpr size_t MAX_JOINED_PARTS = 4;
+// Time budgets are checked after this many postings or pages
+constexpr uint32_t BUDGET_CHECK_INTERVAL = 64;
+constexpr int SNIPPET_WORDS_BEFORE = 3;
+constexpr int SNIPPET_WORDS_AFTER = 8;
+
+// Lowercase letters 0xE0-0xFF without their accents; '?' keeps the letter, '/' (division sign) separates words
+constexpr char LATIN1_BASE_LETTERS[] = "aaaaaa?ceeeeiiii?nooooo/ouuuuy?y";
+
+// What a codepoint is in a term: itself (lowercased, without accent), 0 to leave it out of the term, or UINT32_MAX
+// for a character between terms
+uint32_t foldCodepoint(uint32_t cp) {
+  constexpr uint32_t SEPARATOR = UINT32_MAX;
+  if (cp < 0x80) {
+    if (cp >= 'A' && cp <= 'Z') {
+      return cp + ('a' - 'A');
+    }
+    if ((cp >= 'a' && cp <= 'z') || (cp >= '0' && cp <= '9')) {
+      return cp;
+    }
+    return cp == '\'' ? 0 : SEPARATOR;
+  }
+  if (cp == 0xAD || cp == 0x2019 || utf8IsCombiningMark(cp)) {
+    return 0;  // Soft hyphen, typographic apostrophe, combining accent
+  }
+  if (cp < 0xC0 || cp == 0xD7 || (cp >= 0x2000 && cp <= 0x206F) || (cp >= 0x3000 && cp <= 0x303F)) {
+    return SEPARATOR;
+  }
+  if (cp < 0x100) {
+    if (cp < 0xDF) {
+      cp += 0x20;
+    }
+    if (cp < 0xE0) {
+      return cp;  // Sharp s
+    }
+    const char base = LATIN1_BASE_LETTERS[cp - 0xE0];
+    return base == '/' ? SEPARATOR : base == '?' ? cp : static_cast<uint32_t>(base);
+  }
+  if ((cp >= 0x391 && cp <= 0x3A9) || (cp >= 0x410 && cp <= 0x42F)) {
+    return cp + 0x20;  // Greek and Cyrillic capitals
+  }
+  if (cp >= 0x400 && cp <= 0x40F) {
+    return cp + 0x50;
+  }
+  return cp;
+}
+
+void appendUtf8(std::string& out, const uint32_t cp) {
+  if (cp < 0x80) {
+    out += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    out += static_cast<char>(0xC0 | (cp >> 6));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += static_cast<char>(0xE0 | (cp >> 12));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (cp >> 18));
+    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+// FNV-1a
+uint32_t termHash(const std::string& term) {
+  uint32_t hash = 2166136261u;
+  for (const char c : term) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+void putVarint(uint8_t* out, size_t& used, uint32_t value) {
+  while (value >= 0x80) {
+    out[used++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[used++] = static_cast<uint8_t>(value);
+}
+
+bool getVarint(const uint8_t* data, const size_t size, size_t& pos, uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 35 && pos < size; shift += 7) {
+    const uint8_t byte = data[pos++];
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A word of a page, with where its rest was joined on if it was hyphenated at the end of a line (0 if it wasn't)
+struct PageWord {
+  std::string text;
+  size_t joinedAt;
+};
+
+// The words of a page in reading order. One hyphenated at the end of a line is joined with its rest on the next, so
+// splitTerms() sees the whole word.
+std::vector<PageWord> pageWords(const Page& page) {
+  std::vector<PageWord> words;
+  bool continues = false;
+  for (const auto& element : page.getElements()) {
+    if (element.tag != TAG_PageLine) {
+      continue;
+    }
+    const auto& lineWords = element.line->getWords();
+    for (size_t i = 0; i < lineWords.size(); i++) {
+      if (continues && i == 0 && !words.empty()) {
+        words.back().joinedAt = words.back().text.size();
+        words.back().text.append(lineWords[i].data(), lineWords[i].size());
+      } else {
+        words.push_back({std::string(lineWords[i]), 0});
+      }
+    }
+    continues = !lineWords.empty() && !words.empty() && words.back().text.size() > 1 && words.back().text.back() == '-';
+  }
+  return words;
+}
+}  // namespace
+
+struct BookSearchIndex::BuildState {
+  int nextSpine = 0;
+  int nextPage = 0;
+  std::vector<Posting> run;
+  // Scratch file of sorted runs, and where each of them ends
+  FsFile runs;
+  std::vector<uint32_t> runEnds;
+
+  struct Cursor {
+    uint32_t next;
+    uint32_t end;
+    Posting buffer[CURSOR_POSTINGS];
+    uint8_t count;
+    uint8_t pos;
+  };
+  std::vector<Cursor> cursors;
+  bool merging = false;
+  bool mergeFailed = false;
+  FsFile out;
+  std::unique_ptr<BufferedFileWriter> writer;
+  bool haveLast = false;
+  Posting last = {};
+  Posting previousInBlock = {};
+  uint8_t block[BLOCK_POSTINGS * MAX_POSTING_BYTES];
+  size_t blockBytes = 0;
+  uint8_t blockCount = 0;
+  uint32_t blockFirstHash = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> directory;
+};
+
+BookSearchIndex::BookSearchIndex(std::string path) : path(std::move(path)) {}
+
+BookSearchIndex::~BookSearchIndex() { abortBuild(); }
+
+bool BookSearchIndex::isBuilt() {
+  if (build) {
+    return false;
+  }
+  FsFile file;
+  if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("BSI", path, file)) {
+    return false;
+  }
+  uint8_t version = 0;
+  serialization::readPod(file, version);
+  file.close();
+  return version == SEARCH_INDEX_FILE_VERSION;
+}
+
+bool BookSearchIndex::beginBuild() {
+  abortBuild();
+  if (Storage.exists(path.c_str())) {
+    Storage.remove(path.c_str());
+  }
+  build.reset(new BuildState());
+  build->runs = Storage.open((path + ".runs").c_str(), O_RDWR | O_CREAT | O_TRUNC);
+  if (!build->runs) {
+    LOG_ERR("BSI", "Failed to create %s.runs", path.c_str());
+    build.reset();
+    return false;
+  }
+  build->run.reserve(RUN_POSTINGS);
+  return true;
+}
+
+int BookSearchIndex::nextBuildSpine() const { return build ? build->nextSpine : -1; }
+
+void BookSearchIndex::abortBuild() {
+  if (!build) {
+    return;
+  }
+  build->writer.reset();
+  if (build->out) {
+    build->out.close();
+    Storage.remove((path + ".tmp").c_str());
+  }
+  if (build->runs) {
+    build->runs.close();
+    Storage.remove((path + ".runs").c_str());
+  }
+  build.reset();
+}
+
+bool BookSearchIndex::flushRun() {
+  auto& run = build->run;
+  if (run.empty()) {
+    return true;
+  }
+  std::sort(run.begin(), run.end(), [](const Posting& a, const Posting& b) {
+    if (a.hash != b.hash) return a.hash < b.hash;
+    return Hit{a.spineIndex, a.page} < Hit{b.spineIndex, b.page};
+  });
+  const size_t bytes = run.size() * sizeof(Posting);
+  if (build->runs.write(reinterpret_cast<const uint8_t*>(run.data()), bytes) != bytes) {
+    LOG_ERR("BSI", "Failed to write a run of %zu postings", run.size());
+    return false;
+  }
+  build->runEnds.push_back(static_cast<uint32_t>(build->runs.position()));
+  run.clear();
+  return true;
+}
+
+BookSearchIndex::BuildStatus BookSearchIndex::addSectionPages(Section& section, const uint32_t timeBudgetMs) {
+  if (!build || build->merging || section.isBuilding() || section.getSpineIndex() != build->nextSpine) {
+    return BuildStatus::Failed;
+  }
+  const uint32_t sliceStart = millis();
+  std::vector<std::string> terms;
+  std::vector<uint32_t> hashes;
+  while (build->nextPage < section.pageCount) {
+    if (timeBudgetMs > 0 && millis() - sliceStart >= timeBudgetMs) {
+      return BuildStatus::InProgress;
+    }
+    const auto page = section.peekPage(build->nextPage);
+    if (!page) {
+      LOG_ERR("BSI", "Failed to read page %d of section %d", build->nextPage, build->nextSpine);
+      return BuildStatus::Failed;
+    }
+    terms.clear();
+    for (const auto& word : pageWords(*page)) {
+      splitTerms(word.text, terms);
+    }
+    hashes.clear();
+    for (const auto& term : terms) {
+      hashes.push_back(termHash(term));
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    for (const uint32_t hash : hashes) {
+      build->run.push_back({hash, static_cast<uint16_t>(build->nextSpine), static_cast<uint16_t>(build->nextPage)});
+      if (build->run.size() == RUN_POSTINGS && !flushRun()) {
+        return BuildStatus::Failed;
+      }
+    }
+    build->nextPage++;
+  }
+  build->nextSpine++;
+  build->nextPage = 0;
+  return BuildStatus::Done;
+}
+
+void BookSearchIndex::skipSection() {
+  if (build && !build->merging) {
+    build->nextSpine++;
+    build->nextPage = 0;
+  }
+}
+
+bool BookSearchIndex::startMerge() {
+  if (!flushRun()) {
+    return false;
+  }
+  std::vector<Posting>().swap(build->run);
+  uint32_t start = 0;
+  for (const uint32_t end : build->runEnds) {
+    BuildState::Cursor cursor;
+    cursor.next = start;
+    cursor.end = end;
+    cursor.count = 0;
+    cursor.pos = 0;
+    build->cursors.push_back(cursor);
+    start = end;
+  }
+  build->out = Storage.open((path + ".tmp").c_str(), O_RDWR | O_CREAT | O_TRUNC);
+  if (!build->out) {
+    LOG_ERR("BSI", "Failed to create %s.tmp", path.c_str());
+    return false;
+  }
+  build->writer.reset(new BufferedFileWriter(build->out));
+  // The header is written once the directory's place is known
+  const uint8_t header[HEADER_SIZE] = {};
+  build->writer->write(header, sizeof(header));
+  build->merging = true;
+  return true;
+}
+
+// Smallest posting left in the runs; false once they're all used up (or one can't be read)
+bool BookSearchIndex::nextMerged(Posting& posting) {
+  BuildState::Cursor* smallest = nullptr;
+  for (auto& cursor : build->cursors) {
+    if (cursor.pos == cursor.count) {
+      if (cursor.next >= cursor.end) {
+        continue;
+      }
+      const uint32_t count = std::min<uint32_t>(CURSOR_POSTINGS, (cursor.end - cursor.next) / sizeof(Posting));
+      const int bytes = static_cast<int>(count * sizeof(Posting));
+      if (!build->runs.seek(cursor.next) ||
+          build->runs.read(reinterpret_cast<uint8_t*>(cursor.buffer), bytes) != bytes) {
+        LOG_ERR("BSI", "Failed to read a run at %u", cursor.next);
+        build->mergeFailed = true;
+        return false;
+      }
+      cursor.next += bytes;
+      cursor.count = static_cast<uint8_t>(count);
+      cursor.pos = 0;
+    }
+    const Posting& candidate = cursor.buffer[cursor.pos];
+    if (!smallest) {
+      smallest = &cursor;
+      continue;
+    }
+    const Posting& best = smallest->buffer[smallest->pos];
+    if (candidate.hash < best.hash ||
+        (candidate.hash == best.hash && Hit{candidate.spineIndex, candidate.page} < Hit{best.spineIndex, best.page})) {
+      smallest = &cursor;
+    }
+  }
+  if (!smallest) {
+    return false;
+  }
+  posting = smallest->buffer[smallest->pos++];
+  return true;
+}
+
+bool BookSearchIndex::writePosting(const Posting& posting) {
+  auto& b = *build;
+  if (b.blockCount == 0) {
+    b.blockFirstHash = posting.hash;
+    b.previousInBlock = {};
+  }
+  const Posting& previous = b.previousInBlock;
+  putVarint(b.block, b.blockBytes, posting.hash - previous.hash);
+  if (b.blockCount > 0 && posting.hash == previous.hash) {
+    putVarint(b.block, b.blockBytes, posting.spineIndex - previous.spineIndex);
+    putVarint(b.block, b.blockBytes,
+              posting.spineIndex == previous.spineIndex ? posting.page - previous.page : posting.page);
+  } else {
+    putVarint(b.block, b.blockBytes, posting.spineIndex);
+    putVarint(b.block, b.blockBytes, posting.page);
+  }
+  b.previousInBlock = posting;
+  return ++b.blockCount < BLOCK_POSTINGS || writeBlock();
+}
+
+bool BookSearchIndex::writeBlock() {
+  auto& b = *build;
+  if (b.blockCount == 0) {
+    return true;
+  }
+  if (b.directory.size() == UINT16_MAX) {
+    LOG_ERR("BSI", "Too many postings for the index");
+    return false;
+  }
+  b.directory.emplace_back(b.blockFirstHash, b.writer->position());
+  b.writer->write(b.blockCount);
+  b.writer->write(b.block, b.blockBytes);
+  b.blockCount = 0;
+  b.blockBytes = 0;
+  return true;
+}
+
+BookSearchIndex::BuildStatus BookSearchIndex::finishBuild(const uint32_t timeBudgetMs) {
+  if (!build) {
+    return BuildStatus::Failed;
+  }
+  if (!build->merging && !startMerge()) {
+    abortBuild();
+    return BuildStatus::Failed;
+  }
+  const uint32_t sliceStart = millis();
+  uint32_t merged = 0;
+  Posting posting;
+  while (true) {
+    if (timeBudgetMs > 0 && ++merged % BUDGET_CHECK_INTERVAL == 0 && millis() - sliceStart >= timeBudgetMs) {
+      return BuildStatus::InProgress;
+    }
+    if (!nextMerged(posting)) {
+      break;
+    }
+    const Posting& last = build->last;
+    if (build->haveLast && posting.hash == last.hash && posting.spineIndex == last.spineIndex &&
+        posting.page == last.page) {
+      continue;
+    }
+    build->last = posting;
+    build->haveLast = true;
+    if (!writePosting(posting)) {
+      abortBuild();
+      return BuildStatus::Failed;
+    }
+  }
+  if (build->mergeFailed || !writeBlock()) {
+    abortBuild();
+    return BuildStatus::Failed;
+  }
+
+  auto& writer = *build->writer;
+  const uint32_t directoryOffset = writer.position();
+  for (const auto& [firstHash, offset] : build->directory) {
+    serialization::writePod(writer, firstHash);
+    serialization::writePod(writer, offset);
+  }
+  writer.seek(0);
+  serialization::writePod(writer, SEARCH_INDEX_FILE_VERSION);
+  serialization::writePod(writer, static_cast<uint16_t>(build->directory.size()));
+  serialization::writePod(writer, directoryOffset);
+  if (!writer.flush()) {
+    LOG_ERR("BSI", "Failed to write %s", path.c_str());
+    abortBuild();
+    return BuildStatus::Failed;
+  }
+  build->writer.reset();
+  build->out.close();
+  build->runs.close();
+  Storage.remove((path + ".runs").c_str());
+  const bool renamed = Storage.rename((path + ".tmp").c_str(), path.c_str());
+  LOG_DBG("BSI", "Search index built: %zu blocks, %u bytes", build->directory.size(),
+          directoryOffset + static_cast<uint32_t>(build->directory.size()) * DIRECTORY_ENTRY_SIZE);
+  build.reset();
+  return renamed ? BuildStatus::Done : BuildStatus::Failed;
+}
+
+bool BookSearchIndex::lookup(const uint32_t hash, std::vector<Hit>& hits) const {
+  FsFile file;
+  if (!Storage.openFileForRead("BSI", path, file)) {
+    return false;
+  }
+  uint8_t version;
+  uint16_t blockCount;
+  uint32_t directoryOffset;
+  serialization::readPod(file, version);
+  serialization::readPod(file, blockCount);
+  serialization::readPod(file, directoryOffset);
+  if (version != SEARCH_INDEX_FILE_VERSION) {
+    file.close();
+    return false;
+  }
+
+  const auto readEntry = [&](const int index, uint32_t& firstHash, uint32_t& offset) {
+    file.seek(directoryOffset + index * DIRECTORY_ENTRY_SIZE);
+    serialization::readPod(file, firstHash);
+    serialization::readPod(file, offset);
+  };
+  // Postings of hash start in the last block beginning before it (where it can't be the first of the next block)
+  int lo = 0;
+  int hi = blockCount - 1;
+  int first = 0;
+  while (lo <= hi) {
+    const int mid = (lo + hi) / 2;
+    uint32_t firstHash, offset;
+    readEntry(mid, firstHash, offset);
+    if (firstHash < hash) {
+      first = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  uint8_t block[1 + BLOCK_POSTINGS * MAX_POSTING_BYTES];
+  bool ok = true;
+  for (int index = first; index < blockCount && hits.size() < MAX_TERM_HITS; index++) {
+    uint32_t firstHash, offset, end = directoryOffset;
+    readEntry(index, firstHash, offset);
+    if (firstHash > hash) {
+      break;
+    }
+    if (index + 1 < blockCount) {
+      uint32_t nextFirstHash;
+      readEntry(index + 1, nextFirstHash, end);
+    }
+    const size_t size = end - offset;
+    if (size > sizeof(block) || !file.seek(offset) || file.read(block, size) != static_cast<int>(size)) {
+      ok = false;
+      break;
+    }
+    size_t pos = 1;
+    Posting posting = {};
+    bool passed = false;
+    for (int i = 0; i < block[0]; i++) {
+      uint32_t hashDelta, spine, page;
+      if (!getVarint(block, size, pos, hashDelta) || !getVarint(block, size, pos, spine) ||
+          !getVarint(block, size, pos, page)) {
+        ok = false;
+        break;
+      }
+      if (i > 0 && hashDelta == 0) {
+        page = spine == 0 ? posting.page + page : page;
+        spine += posting.spineIndex;
+      }
+      posting = {posting.hash + hashDelta, static_cast<uint16_t>(spine), static_cast<uint16_t>(page)};
+      if (posting.hash > hash) {
+        passed = true;
+        break;
+      }
+      if (posting.hash == hash && hits.size() < MAX_TERM_HITS) {
+        hits.push_back({posting.spineIndex, posting.page});
+      }
+    }
+    if (!ok || passed) {
+      break;
+    }
+  }
+  file.close();
+  if (!ok) {
+    LOG_ERR("BSI", "Corrupt search index %s", path.c_str());
+  }
+  return ok;
+}
+
+bool BookSearchIndex::search(const std::string& query, const size_t maxHits, std::vector<Hit>& hits) {
+  hits.clear();
+  std::vector<std::string> terms;
+  splitTerms(query, terms);
+  if (terms.empty() || !isBuilt()) {
+    return false;
+  }
+  std::vector<uint32_t> hashes;
+  for (const auto& term : terms) {
+    hashes.push_back(termHash(term));
+  }
+  std::sort(hashes.begin(), hashes.end());
+  hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+  std::vector<Hit> termHits;
+  for (size_t i = 0; i < hashes.size(); i++) {
+    termHits.clear();
+    if (!lookup(hashes[i], termHits)) {
+      hits.clear();
+      return false;
+    }
+    if (i == 0) {
+      hits.swap(termHits);
+    } else {
+      const auto end = std::set_intersection(hits.begin(), hits.end(), termHits.begin(), termHits.end(), hits.begin());
+      hits.erase(end, hits.end());
+    }
+    if (hits.empty()) {
+      break;
+    }
+  }
+  if (hits.size() > maxHits) {
+    hits.resize(maxHits);
+  }
+  return true;
+}
+
+void BookSearchIndex::splitTerms(const std::string& text, std::vector<std::string>& terms) {
+  std::string term;
+  // Terms joined by single hyphens so far. Any run of them joined together is a term too: where a line break
+  // hyphenated the word, the text of the page only has that run, e.g. "inter-" and "national-ization".
+  std::vector<std::string> parts;
+  const auto endParts = [&] {
+    for (size_t first = 0; first + 1 < parts.size(); first++) {
+      std::string joined = parts[first];
+      for (size_t last = first + 1; last < parts.size() && last < first + MAX_JOINED_PARTS; last++) {
+        joined += parts[last];
+        if (joined.size() <= MAX_TERM_LENGTH) {
+          terms.push_back(joined);
+        }
+      }
+    }
+    parts.clear();
+  };
+  const auto* p = reinterpret_cast<const unsigned char*>(text.c_str());
+  while (true) {
+    const uint32_t raw = *p == '\0' ? 0 : utf8NextCodepoint(&p);
+    const uint32_t cp = raw == 0 ? UINT32_MAX : foldCodepoint(raw);
+    if (cp == 0) {
+      continue;
+    }
+    if (cp != UINT32_MAX) {
+      if (term.size() < MAX_TERM_LENGTH) {
+        appendUtf8(term, cp);
+      }
+      continue;
+    }
+    const bool hyphenAfterTerm = raw == '-' && !term.empty();
+    if (!term.empty()) {
+      parts.push_back(term);
+      terms.push_back(std::move(term));
+      term.clear();
+    }
+    if (!hyphenAfterTerm) {
+      endParts();
+    }
+    if (raw == 0) {
+      break;
+    }
+  }
+}
+
+bool BookSearchIndex::findOnPage(const Page& page, const std::vector<std::string>& terms, std::string& snippet) {
+  snippet.clear();
+  const auto words = pageWords(page);
+  std::vector<bool> found(terms.size(), false);
+  int firstMatch = -1;
+  std::vector<std::string> wordTerms;
+  for (size_t i = 0; i < words.size(); i++) {
+    wordTerms.clear();
+    splitTerms(words[i].text, wordTerms);
+    for (size_t t = 0; t < terms.size(); t++) {
+      if (!found[t] && std::find(wordTerms.begin(), wordTerms.end(), terms[t]) != wordTerms.end()) {
+        found[t] = true;
+        if (firstMatch < 0) {
+          firstMatch = static_cast<int>(i);
+        }
+      }
+    }
+  }
+  if (firstMatch < 0 || std::find(found.begin(), found.end(), false) != found.end()) {
+    return false;
+  }
+
+  const int from = std::max(0, firstMatch - SNIPPET_WORDS_BEFORE);
+  const int to = std::min(static_cast<int>(words.size()), firstMatch + SNIPPET_WORDS_AFTER + 1);
+  if (from > 0) {
+    snippet = "\xE2\x80\xA6";
+  }
+  for (int i = from; i < to; i++) {
+    if (!snippet.empty()) {
+      snippet += ' ';
+    }
+    // Shown as the word it is, without the hyphen of the line break
+    const auto& word = words[i];
+    snippet += word.joinedAt > 0 ? word.text.substr(0, word.joinedAt - 1) + word.text.substr(word.joinedAt) : word.text;
+  }
+  if (to < static_cast<int>(words.size())) {
+    snippet += " \xE2\x80\xA6";
+  }
+  return true;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Page;
+class Section;
+
+// Which pages of a book each word is on, for full-text search. Stored as search.bin next to the section files of one
+// layout (pages are those of the layout, and the index goes away with it).
+//
+// Built from the laid-out sections, a time slice at a time: every page's words are normalized into terms (lowercased,
+// Latin-1 accents dropped, split at punctuation), hashed, and kept once per page as {u32 hash, u16 spine index,
+// u16 page} postings. They're sorted in runs of RUN_POSTINGS in RAM and written to a scratch file, and the runs are
+// merged into the index file:
+//   u8 version, u16 block count, u32 directory offset, then the blocks, then the directory: u32 first hash and
+//   u32 offset of each block.
+// A block is a u8 count and up to BLOCK_POSTINGS postings in order, each as varints relative to the one before it:
+// the hash delta, then for the same hash the spine delta and the page (delta for the same spine), for a new hash the
+// spine and page themselves. Looking a term up is a binary search of the directory on the SD card and a read of the
+// one or two blocks its postings are in.
+class BookSearchIndex {
+ public:
+  enum class BuildStatus { InProgress, Done, Failed };
+
+  struct Hit {
+    uint16_t spineIndex;
+    uint16_t page;
+    bool operator<(const Hit& other) const {
+      return spineIndex != other.spineIndex ? spineIndex < other.spineIndex : page < other.page;
+    }
+    bool operator==(const Hit& other) const { return spineIndex == other.spineIndex && page == other.page; }
+  };
+
+  explicit BookSearchIndex(std::string path);
+  ~BookSearchIndex();
+
+  const std::string& getPath() const { return path; }
+  // True once the index file is complete
+  bool isBuilt();
+
+  // Starts over, dropping any earlier index or unfinished build
+  bool beginBuild();
+  bool isBuilding() const { return build != nullptr; }
+  // Spine item addSectionPages() wants next; the sections go in spine order
+  int nextBuildSpine() const;
+  // Adds the pages of a fully built section, from where the last call left off, until timeBudgetMs elapses (0 = no
+  // limit). Done once all of them are in.
+  BuildStatus addSectionPages(Section& section, uint32_t timeBudgetMs = 0);
+  // Leaves the next spine item out, e.g. one that can't be laid out
+  void skipSection();
+  // Once every spine item was added: merges the runs into the index file
+  BuildStatus finishBuild(uint32_t timeBudgetMs = 0);
+  void abortBuild();
+
+  // Pages holding every term of query, in book order, at most maxHits of them. A hash collision can bring in a page
+  // that doesn't have the words; findOnPage() tells.
+  bool search(const std::string& query, size_t maxHits, std::vector<Hit>& hits);
+
+  // Normalized terms of a query or word. A word with hyphens also gives the whole of it without them, so a word
+  // hyphenated at the end of a line is found either way.
+  static void splitTerms(const std::string& text, std::vector<std::string>& terms);
+  // Whether page has every one of terms, and if so the words around the first of them
+  static bool findOnPage(const Page& page, const std::vector<std::string>& terms, std::string& snippet);
+
+ private:
+  struct Posting {
+    uint32_t hash;
+    uint16_t spineIndex;
+    uint16_t page;
+  };
+  struct BuildState;
+
+  static constexpr size_t RUN_POSTINGS = 2048;
+  static constexpr size_t BLOCK_POSTINGS = 128;
+
+  std::string path;
+  std::unique_ptr<BuildState> build;
+
+  bool flushRun();
+  bool startMerge();
+  bool nextMerged(Posting& posting);
+  bool writePosting(const Posting& posting);
+  bool writeBlock();
+  bool lookup(uint32_t hash, std::vector<Hit>& hits) const;
+};
@@ -0,0 +1,78 @@
+#include "BumpArena.h"
+
+#include <cstdint>
+
+namespace {
+// Block header rounded up so the data behind it is suitably aligned for any type
+constexpr size_t HEADER_SIZE = (sizeof(void*) * 3 + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+}  // namespace
+
+BumpArena::Block* BumpArena::newBlock(const size_t dataSize) {
+  // Allocated like any other heap object, so running out of memory fails the same way a std::vector would
+  auto* block = static_cast<Block*>(::operator new(HEADER_SIZE + dataSize));
+  block->next = head;
+  block->size = dataSize;
+  block->used = 0;
+  head = block;
+  return block;
+}
+
+void* BumpArena::allocate(const size_t size, const size_t alignment) {
+  if (head) {
+    const size_t offset = (head->used + alignment - 1) & ~(alignment - 1);
+    if (offset + size <= head->size) {
+      head->used = offset + size;
+      return reinterpret_cast<uint8_t*>(head) + HEADER_SIZE + offset;
+    }
+  }
+
+  if (size > blockSize) {
+    // Oversized requests get a block of their own, queued behind the current one so its free space stays usable
+    Block* block = newBlock(size);
+    block->used = size;
+    if (block->next) {
+      head = block->next;
+      block->next = head->next;
+      head->next = block;
+    }
+    return reinterpret_cast<uint8_t*>(block) + HEADER_SIZE;
+  }
+
+  Block* block = newBlock(blockSize);
+  block->used = size;
+  return reinterpret_cast<uint8_t*>(block) + HEADER_SIZE;
+}
+
+void BumpArena::reset() {
+  Block* kept = nullptr;
+  while (head) {
+    Block* next = head->next;
+    if (!kept && head->size == blockSize) {
+      kept = head;
+    } else {
+      ::operator delete(head);
+    }
+    head = next;
+  }
+  if (kept) {
+    kept->next = nullptr;
+    kept->used = 0;
+  }
+  head = kept;
+}
+
+size_t BumpArena::footprint() const {
+  size_t bytes = 0;
+  for (const Block* block = head; block; block = block->next) {
+    bytes += HEADER_SIZE + block->size;
+  }
+  return bytes;
+}
+
+void BumpArena::release() {
+  while (head) {
+    Block* next = head->next;
+    ::operator delete(head);
+    head = next;
+  }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+// Bump allocator for the short-lived word storage of a paragraph being laid out. Allocations are carved out of
+// larger blocks and only handed back all at once by reset(), so growing a paragraph's word vectors costs a few
+// block allocations instead of one malloc per growth step, and leaves no holes behind in the heap once the paragraph
+// has been turned into lines.
+class BumpArena {
+  struct Block {
+    Block* next;
+    size_t size;
+    size_t used;
+  };
+
+  Block* head = nullptr;
+  size_t blockSize;
+
+  Block* newBlock(size_t dataSize);
+
+ public:
+  explicit BumpArena(const size_t blockSize = 4096) : blockSize(blockSize) {}
+  ~BumpArena() { release(); }
+  BumpArena(const BumpArena&) = delete;
+  BumpArena& operator=(const BumpArena&) = delete;
+
+  void* allocate(size_t size, size_t alignment);
+  // Forget every allocation but keep one standard block around for the next paragraph
+  void reset();
+  // Free all blocks
+  void release();
+  // Heap taken by the blocks, headers included
+  size_t footprint() const;
+};
+
+// std allocator backed by a BumpArena. Deallocation is a no-op; the memory comes back with BumpArena::reset().
+// Without an arena it behaves like std::allocator, so containers using it work the same outside of indexing.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  BumpArena* arena;
+
+  explicit ArenaAllocator(BumpArena* arena = nullptr) noexcept : arena(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+  T* allocate(const size_t n) {
+    if (!arena) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t) noexcept {
+    if (!arena) {
+      ::operator delete(p);
+    }
+  }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const noexcept {
+    return arena == other.arena;
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const noexcept {
+    return arena != other.arena;
+  }
+};
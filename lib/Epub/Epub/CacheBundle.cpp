@@ -0,0 +1,192 @@
+#include "CacheBundle.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr char BUNDLE_MAGIC[4] = {'C', 'P', 'C', 'B'};
+constexpr uint8_t BUNDLE_VERSION = 1;
+// Enough for the zip directory of a book with a few hundred entries
+constexpr uint32_t FINGERPRINT_TAIL_SIZE = 16 * 1024;
+constexpr uint16_t MAX_NAME_LENGTH = 128;
+constexpr size_t COPY_CHUNK_SIZE = 512;
+
+// A path below the cache directory: relative, without "..", in the separators the card uses
+bool isCacheName(const std::string& name) {
+  if (name.empty() || name.size() > MAX_NAME_LENGTH || name[0] == '/' || name.find('\\') != std::string::npos ||
+      name.find(':') != std::string::npos) {
+    return false;
+  }
+  size_t start = 0;
+  while (start <= name.size()) {
+    const size_t end = std::min(name.find('/', start), name.size());
+    if (name.compare(start, end - start, "..") == 0 || end == start) {
+      return false;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+bool copyBytes(FsFile& from, FsFile& to, uint32_t size) {
+  uint8_t buffer[COPY_CHUNK_SIZE];
+  while (size > 0) {
+    const size_t chunk = std::min<size_t>(size, sizeof(buffer));
+    if (from.read(buffer, chunk) != static_cast<int>(chunk) || to.write(buffer, chunk) != chunk) {
+      return false;
+    }
+    size -= chunk;
+  }
+  return true;
+}
+}  // namespace
+
+bool CacheBundle::fingerprint(const std::string& epubPath, uint32_t& size, uint32_t& hash) {
+  FsFile epub;
+  if (!Storage.openFileForRead("CBU", epubPath, epub)) {
+    return false;
+  }
+  size = static_cast<uint32_t>(epub.size());
+  const uint32_t tail = std::min(size, FINGERPRINT_TAIL_SIZE);
+  epub.seek(size - tail);
+  hash = 2166136261u;
+  uint8_t buffer[COPY_CHUNK_SIZE];
+  for (uint32_t done = 0; done < tail;) {
+    const int read = epub.read(buffer, std::min<size_t>(tail - done, sizeof(buffer)));
+    if (read <= 0) {
+      epub.close();
+      return false;
+    }
+    for (int i = 0; i < read; i++) {
+      hash = (hash ^ buffer[i]) * 16777619u;
+    }
+    done += read;
+  }
+  epub.close();
+  return true;
+}
+
+bool CacheBundle::pack(const std::string& bundlePath, const std::string& epubPath, const std::string& cacheDir,
+                       const std::vector<std::string>& names) {
+  uint32_t epubSize, epubHash;
+  if (names.size() > UINT16_MAX || !fingerprint(epubPath, epubSize, epubHash)) {
+    return false;
+  }
+  FsFile bundle;
+  if (!Storage.openFileForWrite("CBU", bundlePath, bundle)) {
+    return false;
+  }
+  bundle.write(reinterpret_cast<const uint8_t*>(BUNDLE_MAGIC), sizeof(BUNDLE_MAGIC));
+  serialization::writePod(bundle, BUNDLE_VERSION);
+  serialization::writePod(bundle, epubSize);
+  serialization::writePod(bundle, epubHash);
+  serialization::writePod(bundle, static_cast<uint16_t>(names.size()));
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < names.size(); i++) {
+    FsFile file;
+    if (!isCacheName(names[i]) || !Storage.openFileForRead("CBU", cacheDir + "/" + names[i], file)) {
+      LOG_ERR("CBU", "Can't pack %s", names[i].c_str());
+      ok = false;
+      break;
+    }
+    const uint32_t size = static_cast<uint32_t>(file.size());
+    serialization::writePod(bundle, static_cast<uint16_t>(names[i].size()));
+    bundle.write(reinterpret_cast<const uint8_t*>(names[i].data()), names[i].size());
+    serialization::writePod(bundle, size);
+    ok = copyBytes(file, bundle, size);
+    file.close();
+  }
+  bundle.close();
+  if (!ok) {
+    Storage.remove(bundlePath.c_str());
+  }
+  return ok;
+}
+
+bool CacheBundle::unpack(const std::string& bundlePath, const std::string& epubPath, const std::string& cacheDir) {
+  FsFile bundle;
+  if (!Storage.openFileForRead("CBU", bundlePath, bundle)) {
+    return false;
+  }
+  char magic[sizeof(BUNDLE_MAGIC)] = {};
+  uint8_t version = 0;
+  uint32_t bundleEpubSize = 0, bundleEpubHash = 0;
+  bundle.read(reinterpret_cast<uint8_t*>(magic), sizeof(magic));
+  serialization::readPod(bundle, version);
+  serialization::readPod(bundle, bundleEpubSize);
+  serialization::readPod(bundle, bundleEpubHash);
+  if (memcmp(magic, BUNDLE_MAGIC, sizeof(magic)) != 0 || version != BUNDLE_VERSION) {
+    LOG_ERR("CBU", "Not a cache bundle of version %u: %s", BUNDLE_VERSION, bundlePath.c_str());
+    bundle.close();
+    return false;
+  }
+  uint32_t epubSize, epubHash;
+  if (!fingerprint(epubPath, epubSize, epubHash) || epubSize != bundleEpubSize || epubHash != bundleEpubHash) {
+    LOG_ERR("CBU", "%s was built from a different file", bundlePath.c_str());
+    bundle.close();
+    return false;
+  }
+
+  // Sections laid out from an older book.bin may not match the new one
+  const std::string bookBin = cacheDir + "/book.bin";
+  const std::string sectionsDir = cacheDir + "/sections";
+  Storage.remove(bookBin.c_str());
+  Storage.removeDir(sectionsDir.c_str());
+  Storage.mkdir(cacheDir.c_str());
+
+  const bool ok = unpackFiles(bundle, cacheDir);
+  bundle.close();
+  if (!ok) {
+    Storage.remove(bookBin.c_str());
+    Storage.removeDir(sectionsDir.c_str());
+    return false;
+  }
+  LOG_DBG("CBU", "Unpacked %s", bundlePath.c_str());
+  return true;
+}
+
+bool CacheBundle::unpackFiles(FsFile& bundle, const std::string& cacheDir) {
+  uint16_t count = 0;
+  serialization::readPod(bundle, count);
+  std::string name;
+  for (uint16_t i = 0; i < count; i++) {
+    uint16_t nameLength = 0;
+    serialization::readPod(bundle, nameLength);
+    if (nameLength > MAX_NAME_LENGTH) {
+      LOG_ERR("CBU", "Bad name length %u", nameLength);
+      return false;
+    }
+    name.resize(nameLength);
+    uint32_t size = 0;
+    if (bundle.read(reinterpret_cast<uint8_t*>(&name[0]), nameLength) != static_cast<int>(nameLength) ||
+        !isCacheName(name)) {
+      LOG_ERR("CBU", "Bad file name in bundle");
+      return false;
+    }
+    serialization::readPod(bundle, size);
+
+    const std::string path = cacheDir + "/" + name;
+    const size_t slash = path.rfind('/');
+    if (slash > cacheDir.size()) {
+      Storage.mkdir(path.substr(0, slash).c_str());
+    }
+    FsFile file;
+    if (!Storage.openFileForWrite("CBU", path, file)) {
+      return false;
+    }
+    Storage.preAllocate("CBU", file, size);
+    const bool copied = copyBytes(bundle, file, size);
+    file.close();
+    if (!copied) {
+      LOG_ERR("CBU", "Failed to unpack %s", name.c_str());
+      Storage.remove(path.c_str());
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class FsFile;
+
+// Cache of a book built elsewhere (test/cache_builder, from these same sources) and put on the card next to the EPUB
+// as <book>.epub.cpcache. Epub::load() unpacks it into the book's cache directory before looking for book.bin, so the
+// device doesn't index the book itself. The layout is in docs/file-formats.md.
+//
+// A bundle holds the files of the cache directory by their names in it. It's tied to the EPUB it was built from by
+// the file's size and a hash over its tail, where the zip directory keeps the CRC of every entry. The files inside
+// are checked as if the device had written them: a section built for other layout parameters, or by a different
+// firmware version, is built again on the device when it's needed.
+class CacheBundle {
+ public:
+  static constexpr char EXTENSION[] = ".cpcache";
+
+  // Writes the files at names (relative to cacheDir) into a bundle for the EPUB at epubPath
+  static bool pack(const std::string& bundlePath, const std::string& epubPath, const std::string& cacheDir,
+                   const std::vector<std::string>& names);
+  // Unpacks the bundle into cacheDir if it was built from the EPUB at epubPath. The book.bin and sections cached for
+  // the book before are dropped first, other files are overwritten; on failure the book is indexed as usual.
+  static bool unpack(const std::string& bundlePath, const std::string& epubPath, const std::string& cacheDir);
+
+ private:
+  static bool fingerprint(const std::string& epubPath, uint32_t& size, uint32_t& hash);
+  static bool unpackFiles(FsFile& bundle, const std::string& cacheDir);
+};
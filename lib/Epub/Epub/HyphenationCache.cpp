@@ -0,0 +1,87 @@
+#include "HyphenationCache.h"
+
+namespace {
+uint32_t wordHash(const std::string& word, const void* language, const bool includeFallback) {
+  uint32_t hash = 2166136261u;
+  for (const char c : word) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  hash ^= static_cast<uint32_t>(reinterpret_cast<uintptr_t>(language)) * 2654435761u;
+  hash ^= includeFallback ? 1 : 0;
+  return hash * 16777619u;
+}
+}  // namespace
+
+HyphenationCache::Entry* HyphenationCache::lookup(const uint32_t hash, const void* language, const std::string& word,
+                                                  const bool includeFallback) {
+  for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+    Entry& entry = entries[(hash + probe) & (SLOT_COUNT - 1)];
+    if (entry.length == 0) {
+      break;
+    }
+    if (entry.hash == hash && entry.length == word.size() && entry.language == language &&
+        entry.includeFallback == includeFallback) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+bool HyphenationCache::find(const std::string& word, const bool includeFallback, Hyphenator::BreakInfo* out,
+                            size_t& count) {
+  if (word.empty() || word.size() > MAX_WORD_LENGTH) {
+    return false;
+  }
+
+  const void* language = Hyphenator::languageKey();
+  Entry* entry = lookup(wordHash(word, language, includeFallback), language, word, includeFallback);
+  if (!entry) {
+    misses++;
+    return false;
+  }
+  hits++;
+  entry->lastUse = ++useClock;
+  count = entry->breakCount;
+  for (uint8_t i = 0; i < entry->breakCount; i++) {
+    out[i] = {entry->offsets[i], (entry->hyphenMask & (1u << i)) != 0};
+  }
+  return true;
+}
+
+void HyphenationCache::insert(const std::string& word, const bool includeFallback, const Hyphenator::BreakInfo* breaks,
+                              const size_t count) {
+  if (word.empty() || word.size() > MAX_WORD_LENGTH || count > MAX_BREAKS) {
+    return;
+  }
+
+  const void* language = Hyphenator::languageKey();
+  const uint32_t hash = wordHash(word, language, includeFallback);
+  // Take the first free slot of the probe run, otherwise the one used longest ago
+  Entry* slot = nullptr;
+  for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+    Entry& entry = entries[(hash + probe) & (SLOT_COUNT - 1)];
+    if (entry.length == 0) {
+      slot = &entry;
+      break;
+    }
+    if (!slot || static_cast<uint16_t>(useClock - entry.lastUse) > static_cast<uint16_t>(useClock - slot->lastUse)) {
+      slot = &entry;
+    }
+  }
+
+  slot->hash = hash;
+  slot->language = language;
+  slot->lastUse = ++useClock;
+  slot->hyphenMask = 0;
+  slot->length = static_cast<uint8_t>(word.size());
+  slot->breakCount = static_cast<uint8_t>(count);
+  slot->includeFallback = includeFallback;
+  for (size_t i = 0; i < count; i++) {
+    // Offsets are inside the word, so they fit in a byte
+    slot->offsets[i] = static_cast<uint8_t>(breaks[i].byteOffset);
+    if (breaks[i].requiresInsertedHyphen) {
+      slot->hyphenMask |= 1u << i;
+    }
+  }
+}
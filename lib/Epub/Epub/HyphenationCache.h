@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "hyphenation/Hyphenator.h"
+
+// Hyphenation break offsets of recently split words, kept for a whole section build. Names and technical terms keep
+// landing at line ends, and each Hyphenator::breakOffsets() call walks the Liang pattern trie again. Fixed size open
+// addressing keyed by word hash and language; a full probe run evicts its least recently used entry.
+class HyphenationCache {
+ public:
+  // Words longer than this, or with more break points, aren't cached
+  static constexpr size_t MAX_WORD_LENGTH = 255;
+  static constexpr size_t MAX_BREAKS = 16;
+
+  // On a hit writes the breaks to out, which must have room for MAX_BREAKS, and their number to count
+  bool find(const std::string& word, bool includeFallback, Hyphenator::BreakInfo* out, size_t& count);
+  void insert(const std::string& word, bool includeFallback, const Hyphenator::BreakInfo* breaks, size_t count);
+  uint32_t getHits() const { return hits; }
+  uint32_t getMisses() const { return misses; }
+
+ private:
+  struct Entry {
+    uint32_t hash;
+    const void* language;
+    uint16_t lastUse;
+    uint16_t hyphenMask;  // Bit i set: break i needs an inserted hyphen
+    uint8_t length;       // 0 = empty slot
+    uint8_t breakCount;
+    bool includeFallback;
+    uint8_t offsets[MAX_BREAKS];
+  };
+
+  static constexpr size_t SLOT_COUNT = 64;  // Power of two
+  static constexpr size_t MAX_PROBES = 4;
+
+  Entry entries[SLOT_COUNT] = {};
+  uint16_t useClock = 0;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+
+  Entry* lookup(uint32_t hash, const void* language, const std::string& word, bool includeFallback);
+};
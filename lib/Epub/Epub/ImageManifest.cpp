@@ -0,0 +1,100 @@
+#include "ImageManifest.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <ZipFile.h>
+
+#include <algorithm>
+
+namespace {
+constexpr uint8_t IMAGE_MANIFEST_FILE_VERSION = 1;
+// Bounds what a damaged count can make load() allocate
+constexpr uint16_t MAX_ENTRIES = 4096;
+
+bool hashLess(const ImageManifest::Entry& entry, const uint64_t hash) { return entry.hrefHash < hash; }
+}  // namespace
+
+void ImageManifest::load(const std::string& manifestPath) {
+  if (loaded) {
+    return;
+  }
+  loaded = true;
+  path = manifestPath;
+
+  FsFile file;
+  if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("IMF", path, file)) {
+    return;
+  }
+
+  uint8_t version = 0;
+  uint16_t count = 0;
+  serialization::readPod(file, version);
+  serialization::readPod(file, count);
+  if (version != IMAGE_MANIFEST_FILE_VERSION || count > MAX_ENTRIES) {
+    LOG_ERR("IMF", "Ignoring stale image manifest (version %u, %u images)", version, count);
+    file.close();
+    return;
+  }
+
+  entries.resize(count);
+  const size_t bytes = count * sizeof(Entry);
+  const bool ok = file.read(reinterpret_cast<uint8_t*>(entries.data()), bytes) == static_cast<int>(bytes);
+  file.close();
+  if (!ok) {
+    LOG_ERR("IMF", "Truncated image manifest");
+    entries.clear();
+    return;
+  }
+  // A damaged file mustn't break the binary search
+  if (!std::is_sorted(entries.begin(), entries.end(),
+                      [](const Entry& a, const Entry& b) { return a.hrefHash < b.hrefHash; })) {
+    LOG_ERR("IMF", "Unsorted image manifest");
+    entries.clear();
+    return;
+  }
+  LOG_DBG("IMF", "Loaded %u image sizes", count);
+}
+
+bool ImageManifest::save() {
+  if (!dirty) {
+    return true;
+  }
+  FsFile file;
+  if (!Storage.openFileForWrite("IMF", path, file)) {
+    return false;
+  }
+  serialization::writePod(file, IMAGE_MANIFEST_FILE_VERSION);
+  serialization::writePod(file, static_cast<uint16_t>(entries.size()));
+  file.write(reinterpret_cast<const uint8_t*>(entries.data()), entries.size() * sizeof(Entry));
+  file.close();
+  dirty = false;
+  return true;
+}
+
+bool ImageManifest::find(const std::string& href, const ImageDecoderFactory::Format format, uint16_t& width,
+                         uint16_t& height) const {
+  const uint64_t hash = ZipFile::fnvHash64(href.c_str(), href.size());
+  const auto it = std::lower_bound(entries.begin(), entries.end(), hash, hashLess);
+  if (it == entries.end() || it->hrefHash != hash || it->format != format) {
+    return false;
+  }
+  width = it->width;
+  height = it->height;
+  return true;
+}
+
+void ImageManifest::add(const std::string& href, const ImageDecoderFactory::Format format, const uint16_t width,
+                        const uint16_t height) {
+  if (entries.size() >= MAX_ENTRIES) {
+    return;
+  }
+  const uint64_t hash = ZipFile::fnvHash64(href.c_str(), href.size());
+  auto it = std::lower_bound(entries.begin(), entries.end(), hash, hashLess);
+  if (it != entries.end() && it->hrefHash == hash) {
+    *it = Entry{hash, width, height, format};
+  } else {
+    entries.insert(it, Entry{hash, width, height, format});
+  }
+  dirty = true;
+}
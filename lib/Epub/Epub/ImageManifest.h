@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "converters/ImageDecoderFactory.h"
+
+// Intrinsic size of every image of a book found so far, stored as images.bin in the book's cache directory (so it
+// outlives the section files of any one layout). Filled in when a chapter first meets an image; building the chapter
+// again for another font or viewport then sizes its images without opening them in the archive.
+class ImageManifest {
+ public:
+  struct Entry {
+    uint64_t hrefHash;  // ZipFile::fnvHash64 of the image's path in the archive
+    uint16_t width;
+    uint16_t height;
+    ImageDecoderFactory::Format format;
+  };
+
+  // Where a book cache directory keeps its manifest
+  static std::string getPath(const std::string& cacheDir) { return cacheDir + "/images.bin"; }
+
+  // Reads the manifest at path once; later calls, and calls after a failed read, do nothing
+  void load(const std::string& manifestPath);
+  // Writes the manifest back to where it was loaded from, if anything was added since
+  bool save();
+
+  // Whether the image at href was sized before, as the same format
+  bool find(const std::string& href, ImageDecoderFactory::Format format, uint16_t& width, uint16_t& height) const;
+  void add(const std::string& href, ImageDecoderFactory::Format format, uint16_t width, uint16_t height);
+
+ private:
+  std::string path;
+  std::vector<Entry> entries;  // Sorted by hrefHash
+  bool loaded = false;
+  bool dirty = false;
+};
@@ -1,68 +1,82 @@
 #include "Page.h"
 
 #include <Logging.h>
+#include <MemoryReader.h>
 #include <Serialization.h>
 
-void PageLine::render(GfxRenderer& renderer, const int fontId, const int xOffset, const int yOffset) {
-  block->render(renderer, fontId, xPos + xOffset, yPos + yOffset);
-}
-
-bool PageLine::serialize(FsFile& file) {
-  serialization::writePod(file, xPos);
-  serialization::writePod(file, yPos);
+namespace {
+constexpr size_t ARENA_BYTES_PER_RECORD_BYTE = 4;
+constexpr size_t ARENA_SLACK = 512;
+}  // namespace
 
-  // serialize TextBlock pointed to by PageLine
-  return block->serialize(file);
+Page::Blocks& Page::ownBlocks() {
+  if (!blocks) {
+    // Pages laid out while indexing never put anything in the arena, which only takes memory once used
+    blocks = std::make_shared<Blocks>(ARENA_SLACK);
+  }
+  return *blocks;
 }
 
-std::unique_ptr<PageLine> PageLine::deserialize(FsFile& file) {
-  int16_t xPos;
-  int16_t yPos;
-  serialization::readPod(file, xPos);
-  serialization::readPod(file, yPos);
-
-  auto tb = TextBlock::deserialize(file);
-  return std::unique_ptr<PageLine>(new PageLine(std::move(tb), xPos, yPos));
+void Page::addLine(TextBlock::Ptr line, const int16_t xPos, const int16_t yPos) {
+  PageElement el{TAG_PageLine, xPos, yPos, {}};
+  el.line = line.get();
+  ownBlocks().lines.push_back(std::move(line));
+  elements.push_back(el);
 }
 
-void PageImage::render(GfxRenderer& renderer, const int fontId, const int xOffset, const int yOffset) {
-  // Images don't use fontId or text rendering
-  imageBlock->render(renderer, xPos + xOffset, yPos + yOffset);
+void Page::addImage(std::unique_ptr<ImageBlock> image, const int16_t xPos, const int16_t yPos) {
+  PageElement el{TAG_PageImage, xPos, yPos, {}};
+  el.image = image.get();
+  ownBlocks().images.push_back(std::move(image));
+  elements.push_back(el);
 }
 
-bool PageImage::serialize(FsFile& file) {
-  serialization::writePod(file, xPos);
-  serialization::writePod(file, yPos);
-
-  // serialize ImageBlock
-  return imageBlock->serialize(file);
+void Page::render(GfxRenderer& renderer, const int fontId, const int xOffset, const int yOffset) const {
+  for (const auto& el : elements) {
+    if (el.tag == TAG_PageLine) {
+      el.line->render(renderer, fontId, el.xPos + xOffset, el.yPos + yOffset);
+    } else {
+      // Images don't use fontId or text rendering
+      el.image->render(renderer, el.xPos + xOffset, el.yPos + yOffset);
+    }
+  }
 }
 
-std::unique_ptr<PageImage> PageImage::deserialize(FsFile& file) {
-  int16_t xPos;
-  int16_t yPos;
-  serialization::readPod(file, xPos);
-  serialization::readPod(file, yPos);
-
-  auto ib = ImageBlock::deserialize(file);
-  return std::unique_ptr<PageImage>(new PageImage(std::move(ib), xPos, yPos));
+void Page::setImagePixelRetention(const bool retain) const {
+  if (blocks) {
+    for (const auto& image : blocks->images) {
+      image->setPixelRetention(retain);
+    }
+  }
 }
 
-void Page::render(GfxRenderer& renderer, const int fontId, const int xOffset, const int yOffset) const {
-  for (auto& element : elements) {
-    element->render(renderer, fontId, xOffset, yOffset);
+size_t Page::getHeapUsage() const {
+  size_t bytes =
+      sizeof(Page) + elements.capacity() * sizeof(PageElement) + footnotes.capacity() * sizeof(FootnoteEntry);
+  if (blocks) {
+    bytes += sizeof(Blocks) + blocks->arena.footprint() +
+             blocks->lines.capacity() * sizeof(TextBlock::Ptr) +
+             blocks->images.capacity() * sizeof(std::unique_ptr<ImageBlock>);
+    for (const auto& line : blocks->lines) {
+      bytes += line->getHeapUsage();
+    }
+    for (const auto& image : blocks->images) {
+      bytes += image->getHeapUsage();
+    }
   }
+  return bytes;
 }
 
-bool Page::serialize(FsFile& file) const {
+bool Page::serialize(BufferedFileWriter& file, SectionDictionary& dictionary) const {
   const uint16_t count = elements.size();
   serialization::writePod(file, count);
 
   for (const auto& el : elements) {
-    // Use getTag() method to determine type
-    serialization::writePod(file, static_cast<uint8_t>(el->getTag()));
+    serialization::writePod(file, static_cast<uint8_t>(el.tag));
+    serialization::writePod(file, el.xPos);
+    serialization::writePod(file, el.yPos);
 
-    if (!el->serialize(file)) {
+    if (el.tag == TAG_PageLine ? !el.line->serialize(file, dictionary) : !el.image->serialize(file)) {
       return false;
     }
   }
@@ -82,31 +96,49 @@ bool Page::serialize(FsFile& file) const {
   return true;
 }
 
-std::unique_ptr<Page> Page::deserialize(FsFile& file) {
+std::unique_ptr<Page> Page::deserialize(const uint8_t* data, const size_t size, const SectionDictionary& dictionary) {
   auto page = std::unique_ptr<Page>(new Page());
+  // Decoded lines take about four times their record, one block is then enough for most pages
+  page->blocks = std::make_shared<Blocks>(size * ARENA_BYTES_PER_RECORD_BYTE + ARENA_SLACK);
+  BumpArena& arena = page->blocks->arena;
+  MemoryReader record(data, size);
 
   uint16_t count;
-  serialization::readPod(file, count);
+  serialization::readPod(record, count);
+  if (count > record.remaining()) {
+    LOG_ERR("PGE", "Deserialization failed: %u elements in a %u byte record", count, static_cast<unsigned>(size));
+    return nullptr;
+  }
+  page->elements.reserve(count);
 
   for (uint16_t i = 0; i < count; i++) {
     uint8_t tag;
-    serialization::readPod(file, tag);
+    PageElement el{};
+    serialization::readPod(record, tag);
+    serialization::readPod(record, el.xPos);
+    serialization::readPod(record, el.yPos);
 
     if (tag == TAG_PageLine) {
-      auto pl = PageLine::deserialize(file);
-      page->elements.push_back(std::move(pl));
+      el.tag = TAG_PageLine;
+      el.line = TextBlock::deserialize(record, dictionary, arena);
+      if (!el.line) {
+        return nullptr;
+      }
     } else if (tag == TAG_PageImage) {
-      auto pi = PageImage::deserialize(file);
-      page->elements.push_back(std::move(pi));
+      auto image = ImageBlock::deserialize(record);
+      el.tag = TAG_PageImage;
+      el.image = image.get();
+      page->blocks->images.push_back(std::move(image));
     } else {
       LOG_ERR("PGE", "Deserialization failed: Unknown tag %u", tag);
       return nullptr;
     }
+    page->elements.push_back(el);
   }
 
   // Deserialize footnotes
   uint16_t fnCount;
-  serialization::readPod(file, fnCount);
+  serialization::readPod(record, fnCount);
   if (fnCount > MAX_FOOTNOTES_PER_PAGE) {
     LOG_ERR("PGE", "Invalid footnote count %u", fnCount);
     return nullptr;
@@ -114,8 +146,8 @@ std::unique_ptr<Page> Page::deserialize(FsFile& file) {
   page->footnotes.resize(fnCount);
   for (uint16_t i = 0; i < fnCount; i++) {
     auto& entry = page->footnotes[i];
-    if (file.read(entry.number, sizeof(entry.number)) != sizeof(entry.number) ||
-        file.read(entry.href, sizeof(entry.href)) != sizeof(entry.href)) {
+    if (record.read(entry.number, sizeof(entry.number)) != sizeof(entry.number) ||
+        record.read(entry.href, sizeof(entry.href)) != sizeof(entry.href)) {
       LOG_ERR("PGE", "Failed to read footnote %u", i);
       return nullptr;
     }
@@ -1,66 +1,59 @@
 #pragma once
-#include <HalStorage.h>
+#include <BufferedFile.h>
 
 #include <algorithm>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "FootnoteEntry.h"
+#include "SectionDictionary.h"
 #include "blocks/ImageBlock.h"
 #include "blocks/TextBlock.h"
 
 enum PageElementTag : uint8_t {
   TAG_PageLine = 1,
-  TAG_PageImage = 2,  // New tag
+  TAG_PageImage = 2,
 };
 
-// represents something that has been added to a page
-class PageElement {
- public:
+// Something placed on a page: a line of a block element or an image, told apart by tag. The block is owned by the
+// page, so a page is a flat array of these with nothing to reference-count and no virtual call per element.
+struct PageElement {
+  PageElementTag tag;
   int16_t xPos;
   int16_t yPos;
-  explicit PageElement(const int16_t xPos, const int16_t yPos) : xPos(xPos), yPos(yPos) {}
-  virtual ~PageElement() = default;
-  virtual void render(GfxRenderer& renderer, int fontId, int xOffset, int yOffset) = 0;
-  virtual bool serialize(FsFile& file) = 0;
-  virtual PageElementTag getTag() const = 0;  // Add type identification
+  union {
+    const TextBlock* line;  // TAG_PageLine
+    ImageBlock* image;      // TAG_PageImage
+  };
 };
 
-// a line from a block element
-class PageLine final : public PageElement {
-  std::shared_ptr<TextBlock> block;
-
- public:
-  PageLine(std::shared_ptr<TextBlock> block, const int16_t xPos, const int16_t yPos)
-      : PageElement(xPos, yPos), block(std::move(block)) {}
-  const std::shared_ptr<TextBlock>& getBlock() const { return block; }
-  void render(GfxRenderer& renderer, int fontId, int xOffset, int yOffset) override;
-  bool serialize(FsFile& file) override;
-  PageElementTag getTag() const override { return TAG_PageLine; }
-  static std::unique_ptr<PageLine> deserialize(FsFile& file);
-};
+class Page {
+  // What the elements point to. Copies of the page share it, so a copy is one reference however many elements it
+  // has, and its elements stay valid for as long as the copy does.
+  struct Blocks {
+    explicit Blocks(const size_t arenaBlockSize) : arena(arenaBlockSize) {}
+    // Lines of a deserialized page, the blocks themselves included. They hold nothing but arena memory and are
+    // dropped with it, without being destroyed one by one.
+    BumpArena arena;
+    // Lines handed over while laying out, and the images of the page. A line built in the parser's page arena is only
+    // valid until the parser moves on to the next page.
+    std::vector<TextBlock::Ptr> lines;
+    std::vector<std::unique_ptr<ImageBlock>> images;
+  };
+  std::shared_ptr<Blocks> blocks;
+  std::vector<PageElement> elements;
 
-// New PageImage class
-class PageImage final : public PageElement {
-  std::shared_ptr<ImageBlock> imageBlock;
+  Blocks& ownBlocks();
 
  public:
-  PageImage(std::shared_ptr<ImageBlock> block, const int16_t xPos, const int16_t yPos)
-      : PageElement(xPos, yPos), imageBlock(std::move(block)) {}
-  void render(GfxRenderer& renderer, int fontId, int xOffset, int yOffset) override;
-  bool serialize(FsFile& file) override;
-  PageElementTag getTag() const override { return TAG_PageImage; }
-  static std::unique_ptr<PageImage> deserialize(FsFile& file);
-  const ImageBlock& getImageBlock() const { return *imageBlock; }
-};
-
-class Page {
- public:
-  // the list of block index and line numbers on this page
-  std::vector<std::shared_ptr<PageElement>> elements;
   std::vector<FootnoteEntry> footnotes;
   static constexpr uint16_t MAX_FOOTNOTES_PER_PAGE = 16;
 
+  const std::vector<PageElement>& getElements() const { return elements; }
+  void addLine(TextBlock::Ptr line, int16_t xPos, int16_t yPos);
+  void addImage(std::unique_ptr<ImageBlock> image, int16_t xPos, int16_t yPos);
+
   void addFootnote(const char* number, const char* href) {
     if (footnotes.size() >= MAX_FOOTNOTES_PER_PAGE) return;  // Cap per-page footnotes
     FootnoteEntry entry;
@@ -72,13 +65,20 @@ class Page {
   }
 
   void render(GfxRenderer& renderer, int fontId, int xOffset, int yOffset) const;
-  bool serialize(FsFile& file) const;
-  static std::unique_ptr<Page> deserialize(FsFile& file);
+  // Keep decoded image pixels in RAM across the render passes of one page turn; turn off again to free them
+  void setImagePixelRetention(bool retain) const;
+  // Words are written through (and read back with) the section's shared dictionary
+  bool serialize(BufferedFileWriter& file, SectionDictionary& dictionary) const;
+  // Decodes a page record read from the section file in one go. Its lines, blocks included, are laid out in a single
+  // arena, so loading a page costs a handful of allocations however many words it has, and dropping it frees them
+  // together.
+  static std::unique_ptr<Page> deserialize(const uint8_t* record, size_t size, const SectionDictionary& dictionary);
+
+  size_t getHeapUsage() const;
 
   // Check if page contains any images (used to force full refresh)
   bool hasImages() const {
-    return std::any_of(elements.begin(), elements.end(),
-                       [](const std::shared_ptr<PageElement>& el) { return el->getTag() == TAG_PageImage; });
+    return std::any_of(elements.begin(), elements.end(), [](const PageElement& el) { return el.tag == TAG_PageImage; });
   }
 
   // Get bounding box of all images on the page (union of image rects)
@@ -87,12 +87,11 @@ class Page {
     bool found = false;
     int16_t minX = INT16_MAX, minY = INT16_MAX, maxX = INT16_MIN, maxY = INT16_MIN;
     for (const auto& el : elements) {
-      if (el->getTag() == TAG_PageImage) {
-        const auto& img = static_cast<const PageImage&>(*el);
-        int16_t x = img.xPos;
-        int16_t y = img.yPos;
-        int16_t right = x + img.getImageBlock().getWidth();
-        int16_t bottom = y + img.getImageBlock().getHeight();
+      if (el.tag == TAG_PageImage) {
+        int16_t x = el.xPos;
+        int16_t y = el.yPos;
+        int16_t right = x + el.image->getWidth();
+        int16_t bottom = y + el.image->getHeight();
         minX = std::min(minX, x);
         minY = std::min(minY, y);
         maxX = std::max(maxX, right);
@@ -0,0 +1,303 @@
+#include "PageFrameCache.h"
+
+#include <Arduino.h>
+#include <HalDisplay.h>
+#include <Logging.h>
+#include <PackBits.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr uint32_t FRAME_FILE_MAGIC = 0x31434650;  // "PFC1"
+constexpr uint8_t INDEX_FILE_VERSION = 1;
+constexpr char INDEX_FILE[] = "/index.bin";
+// Version byte and entry count ahead of the entries
+constexpr size_t INDEX_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint16_t);
+// Planes are packed in slices of 8 panel rows, so reading one back only needs a small stack buffer
+constexpr size_t SLICE_SIZE = HalDisplay::DISPLAY_WIDTH_BYTES * 8;
+constexpr size_t SLICE_COUNT = HalDisplay::BUFFER_SIZE / SLICE_SIZE;
+static_assert(SLICE_SIZE * SLICE_COUNT == HalDisplay::BUFFER_SIZE, "Frame slices must cover the whole buffer");
+// Don't take the last contiguous block of the heap for a packed plane
+constexpr uint32_t PACK_MIN_FREE_BLOCK = 16 * 1024;
+}  // namespace
+
+PageFrameCache::PageFrameCache(std::string layoutDir, const uint32_t budgetBytes)
+    : layoutDir(std::move(layoutDir)), budgetBytes(budgetBytes) {
+  loadIndex();
+}
+
+PageFrameCache::~PageFrameCache() {
+  abortFrame();
+  close();
+  if (indexDirty) {
+    saveIndex();
+  }
+}
+
+std::string PageFrameCache::framePath(const int spineIndex, const int page) const {
+  return framesDir() + "/" + std::to_string(spineIndex) + "/" + std::to_string(page) + ".fb";
+}
+
+void PageFrameCache::dropSpine(const std::string& layoutDir, const int spineIndex) {
+  const std::string spineDir = layoutDir + "/frames/" + std::to_string(spineIndex);
+  if (Storage.exists(spineDir.c_str())) {
+    LOG_DBG("PFC", "Dropping cached frames of spine %d", spineIndex);
+    Storage.removeDir(spineDir.c_str());
+  }
+}
+
+void PageFrameCache::loadIndex() {
+  entries.clear();
+  totalBytes = 0;
+
+  const std::string indexPath = framesDir() + INDEX_FILE;
+  FsFile indexFile;
+  if (!Storage.exists(indexPath.c_str()) || !Storage.openFileForRead("PFC", indexPath, indexFile)) {
+    // Frames without an index can't be accounted for in the budget
+    if (Storage.exists(framesDir().c_str())) {
+      Storage.removeDir(framesDir().c_str());
+    }
+    return;
+  }
+
+  // The count is checked against the file size before it sizes anything: a torn or foreign index drops the frames
+  uint8_t version = 0;
+  uint16_t count = 0;
+  const size_t fileSize = indexFile.fileSize();
+  if (fileSize < INDEX_HEADER_SIZE || indexFile.read(&version, sizeof(version)) != sizeof(version) ||
+      indexFile.read(reinterpret_cast<uint8_t*>(&count), sizeof(count)) != sizeof(count) ||
+      version != INDEX_FILE_VERSION || count * sizeof(Entry) != fileSize - INDEX_HEADER_SIZE) {
+    LOG_ERR("PFC", "Invalid frame index, dropping cached frames");
+    indexFile.close();
+    Storage.removeDir(framesDir().c_str());
+    return;
+  }
+  entries.resize(count);
+  const size_t bytes = count * sizeof(Entry);
+  if (indexFile.read(reinterpret_cast<uint8_t*>(entries.data()), bytes) != static_cast<int>(bytes)) {
+    LOG_ERR("PFC", "Truncated frame index, dropping cached frames");
+    indexFile.close();
+    entries.clear();
+    Storage.removeDir(framesDir().c_str());
+    return;
+  }
+  indexFile.close();
+
+  for (const auto& entry : entries) {
+    totalBytes += entry.bytes;
+  }
+}
+
+void PageFrameCache::saveIndex() {
+  Storage.mkdir(framesDir().c_str());
+  FsFile indexFile;
+  if (!Storage.openFileForWrite("PFC", framesDir() + INDEX_FILE, indexFile)) {
+    return;
+  }
+  serialization::writePod(indexFile, INDEX_FILE_VERSION);
+  serialization::writePod(indexFile, static_cast<uint16_t>(entries.size()));
+  indexFile.write(reinterpret_cast<const uint8_t*>(entries.data()), entries.size() * sizeof(Entry));
+  indexFile.close();
+  indexDirty = false;
+}
+
+int PageFrameCache::findEntry(const int spineIndex, const int page) const {
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].spineIndex == spineIndex && entries[i].page == page) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+void PageFrameCache::removeEntry(const int index, const bool removeFile) {
+  const Entry entry = entries[index];
+  if (removeFile) {
+    Storage.remove(framePath(entry.spineIndex, entry.page).c_str());
+  }
+  totalBytes -= std::min(totalBytes, entry.bytes);
+  entries.erase(entries.begin() + index);
+  indexDirty = true;
+}
+
+bool PageFrameCache::packPlane(const uint8_t* frame, std::vector<uint8_t>& packed) {
+  size_t total = 0;
+  for (size_t i = 0; i < SLICE_COUNT; i++) {
+    total += sizeof(uint16_t) + PackBits::pack(frame + i * SLICE_SIZE, SLICE_SIZE, nullptr);
+  }
+  if (ESP.getMaxAllocHeap() < total + PACK_MIN_FREE_BLOCK) {
+    LOG_DBG("PFC", "Not enough memory to pack a %u byte plane", static_cast<unsigned>(total));
+    return false;
+  }
+
+  packed.resize(total);
+  uint8_t* out = packed.data();
+  for (size_t i = 0; i < SLICE_COUNT; i++) {
+    const auto sliceSize = static_cast<uint16_t>(PackBits::pack(frame + i * SLICE_SIZE, SLICE_SIZE, out + 2));
+    memcpy(out, &sliceSize, sizeof(sliceSize));
+    out += sizeof(sliceSize) + sliceSize;
+  }
+  return true;
+}
+
+bool PageFrameCache::open(const int spineIndex, const int page, const FrameKey& key) {
+  close();
+  const int index = findEntry(spineIndex, page);
+  if (index < 0) {
+    return false;
+  }
+
+  if (!Storage.openFileForRead("PFC", framePath(spineIndex, page), file)) {
+    removeEntry(index, false);
+    return false;
+  }
+
+  uint32_t magic;
+  FrameKey fileFrameKey;
+  serialization::readPod(file, magic);
+  serialization::readPod(file, fileFrameKey.orientation);
+  serialization::readPod(file, fileFrameKey.antiAliasing);
+  serialization::readPod(file, fileFrameKey.marginLeft);
+  serialization::readPod(file, fileFrameKey.marginTop);
+  serialization::readPod(file, header.planeCount);
+  for (auto& offset : header.planeOffsets) {
+    serialization::readPod(file, offset);
+  }
+
+  if (magic != FRAME_FILE_MAGIC || fileFrameKey.orientation != key.orientation ||
+      fileFrameKey.antiAliasing != key.antiAliasing || fileFrameKey.marginLeft != key.marginLeft ||
+      fileFrameKey.marginTop != key.marginTop || header.planeCount == 0 || header.planeCount > MAX_PLANES) {
+    // Rendered for a different orientation or margin; it gets replaced by the fresh render
+    file.close();
+    header = {};
+    removeEntry(index, true);
+    return false;
+  }
+
+  if (index > 0) {
+    std::rotate(entries.begin(), entries.begin() + index, entries.begin() + index + 1);
+    indexDirty = true;
+  }
+  return true;
+}
+
+bool PageFrameCache::readPlane(const uint8_t plane, uint8_t* frame) {
+  if (!file || writing || plane >= header.planeCount) {
+    return false;
+  }
+
+  uint8_t packed[PackBits::maxPackedSize(SLICE_SIZE)];
+  file.seek(header.planeOffsets[plane]);
+  for (size_t i = 0; i < SLICE_COUNT; i++) {
+    uint16_t sliceSize;
+    serialization::readPod(file, sliceSize);
+    if (sliceSize > sizeof(packed) || file.read(packed, sliceSize) != sliceSize ||
+        !PackBits::unpack(packed, sliceSize, frame + i * SLICE_SIZE, SLICE_SIZE)) {
+      LOG_ERR("PFC", "Corrupt plane %u in cached frame", plane);
+      return false;
+    }
+  }
+  return true;
+}
+
+void PageFrameCache::close() {
+  if (file && !writing) {
+    file.close();
+  }
+  if (!writing) {
+    header = {};
+  }
+}
+
+void PageFrameCache::writeHeader() {
+  serialization::writePod(file, FRAME_FILE_MAGIC);
+  serialization::writePod(file, fileKey.orientation);
+  serialization::writePod(file, fileKey.antiAliasing);
+  serialization::writePod(file, fileKey.marginLeft);
+  serialization::writePod(file, fileKey.marginTop);
+  serialization::writePod(file, header.planeCount);
+  for (const auto offset : header.planeOffsets) {
+    serialization::writePod(file, offset);
+  }
+}
+
+bool PageFrameCache::beginFrame(const int spineIndex, const int page, const FrameKey& key) {
+  close();
+  if (writing) {
+    return false;
+  }
+
+  Storage.mkdir((framesDir() + "/" + std::to_string(spineIndex)).c_str());
+  if (!Storage.openFileForWrite("PFC", framePath(spineIndex, page), file)) {
+    return false;
+  }
+  writing = true;
+  fileSpineIndex = spineIndex;
+  filePage = page;
+  fileKey = key;
+  header = {};
+  // Written with no planes first, so an interrupted write never looks like a valid frame
+  writeHeader();
+  return true;
+}
+
+bool PageFrameCache::writePlane(const std::vector<uint8_t>& packed) {
+  if (!writing || header.planeCount >= MAX_PLANES) {
+    return false;
+  }
+  header.planeOffsets[header.planeCount] = file.position();
+  if (file.write(packed.data(), packed.size()) != packed.size()) {
+    LOG_ERR("PFC", "Failed to write cached frame plane");
+    return false;
+  }
+  header.planeCount++;
+  return true;
+}
+
+void PageFrameCache::finishFrame() {
+  if (!writing) {
+    return;
+  }
+  const uint32_t bytes = file.position();
+  file.seek(0);
+  writeHeader();
+  file.close();
+  writing = false;
+
+  const std::string path = framePath(fileSpineIndex, filePage);
+  const int existing = findEntry(fileSpineIndex, filePage);
+  if (existing >= 0) {
+    removeEntry(existing, false);
+  }
+  if (header.planeCount == 0) {
+    Storage.remove(path.c_str());
+    header = {};
+    saveIndex();
+    return;
+  }
+  header = {};
+
+  entries.insert(entries.begin(), Entry{static_cast<uint16_t>(fileSpineIndex), static_cast<uint16_t>(filePage), bytes});
+  totalBytes += bytes;
+  while (totalBytes > budgetBytes && entries.size() > 1) {
+    removeEntry(static_cast<int>(entries.size()) - 1, true);
+  }
+  saveIndex();
+}
+
+void PageFrameCache::abortFrame() {
+  if (!writing) {
+    return;
+  }
+  // Never let a partial frame file be picked up later
+  file.close();
+  writing = false;
+  header = {};
+  Storage.remove(framePath(fileSpineIndex, filePage).c_str());
+  const int existing = findEntry(fileSpineIndex, filePage);
+  if (existing >= 0) {
+    removeEntry(existing, false);
+  }
+}
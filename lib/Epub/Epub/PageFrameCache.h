@@ -0,0 +1,79 @@
+#pragma once
+
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rendered frames of one layout's pages, stored under <layoutDir>/frames/<spine>/<page>.fb: the BW frame buffer and,
+// when anti-aliasing is on, the two gray planes, each PackBits-compressed in 8-row slices. Showing a cached page is a
+// sequential SD read instead of rendering glyphs and images again. The frames of a layout are kept within a byte
+// budget, least recently shown first out.
+class PageFrameCache {
+ public:
+  // What a frame depends on besides the layout: where the viewport sits on the panel, and the gray planes
+  struct FrameKey {
+    uint8_t orientation;
+    uint8_t antiAliasing;
+    int16_t marginLeft;
+    int16_t marginTop;
+  };
+  // BW, then the LSB and MSB gray planes
+  static constexpr uint8_t MAX_PLANES = 3;
+
+  explicit PageFrameCache(std::string layoutDir, uint32_t budgetBytes = 2 * 1024 * 1024);
+  ~PageFrameCache();
+  const std::string& getLayoutDir() const { return layoutDir; }
+
+  // Remove every cached frame of a spine item, e.g. because its section file is rebuilt
+  static void dropSpine(const std::string& layoutDir, int spineIndex);
+
+  // Pack a frame buffer plane into the stored form, so it can be written after the buffer has been drawn over
+  static bool packPlane(const uint8_t* frame, std::vector<uint8_t>& packed);
+
+  // Reading: open() succeeds if a frame for the page exists with a matching key
+  bool open(int spineIndex, int page, const FrameKey& key);
+  uint8_t getPlaneCount() const { return header.planeCount; }
+  bool readPlane(uint8_t plane, uint8_t* frame);
+  void close();
+
+  // Writing: planes are appended in order; the frame only becomes visible to open() after finishFrame()
+  bool beginFrame(int spineIndex, int page, const FrameKey& key);
+  bool writePlane(const std::vector<uint8_t>& packed);
+  void finishFrame();
+  void abortFrame();
+
+ private:
+  struct Header {
+    uint8_t planeCount = 0;
+    uint32_t planeOffsets[MAX_PLANES] = {};
+  };
+  struct Entry {
+    uint16_t spineIndex;
+    uint16_t page;
+    uint32_t bytes;
+  };
+
+  std::string layoutDir;
+  uint32_t budgetBytes;
+  // Most recently shown first, persisted as frames/index.bin
+  std::vector<Entry> entries;
+  uint32_t totalBytes = 0;
+  bool indexDirty = false;
+
+  FsFile file;
+  bool writing = false;
+  int fileSpineIndex = -1;
+  int filePage = -1;
+  FrameKey fileKey = {};
+  Header header;
+
+  std::string framesDir() const { return layoutDir + "/frames"; }
+  std::string framePath(int spineIndex, int page) const;
+  void loadIndex();
+  void saveIndex();
+  int findEntry(int spineIndex, int page) const;
+  void removeEntry(int index, bool removeFile);
+  void writeHeader();
+};
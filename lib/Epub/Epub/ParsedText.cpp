@@ -1,16 +1,25 @@
 #include "ParsedText.h"
 
 #include <GfxRenderer.h>
+#include <HotPath.h>
+#include <Trace.h>
 #include <Utf8.h>
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <functional>
 #include <limits>
 #include <vector>
 
 #include "hyphenation/Hyphenator.h"
 
+// Store lines in section files with their glyphs already shaped, so pages render without decoding and kerning every
+// word again. Costs about three bytes per glyph on the SD card and six per glyph in cached pages.
+#ifndef SECTION_SHAPED_TEXT
+#define SECTION_SHAPED_TEXT 0
+#endif
+
 constexpr int MAX_COST = std::numeric_limits<int>::max();
 
 namespace {
@@ -19,27 +28,12 @@ namespace {
 constexpr char SOFT_HYPHEN_UTF8[] = "\xC2\xAD";
 constexpr size_t SOFT_HYPHEN_BYTES = 2;
 
-// Returns the first rendered codepoint of a word (skipping leading soft hyphens).
-uint32_t firstCodepoint(const std::string& word) {
-  const auto* ptr = reinterpret_cast<const unsigned char*>(word.c_str());
-  while (true) {
-    const uint32_t cp = utf8NextCodepoint(&ptr);
-    if (cp == 0) return 0;
-    if (cp != 0x00AD) return cp;  // skip soft hyphens
-  }
-}
+// Lines a partial layout keeps back for the next one. The optimal breaks near the end of the buffered words depend on
+// the words that haven't arrived yet, while those a few lines further up practically never change.
+constexpr size_t WINDOW_HELD_LINES = 3;
 
-// Returns the last codepoint of a word by scanning backward for the start of the last UTF-8 sequence.
-uint32_t lastCodepoint(const std::string& word) {
-  if (word.empty()) return 0;
-  // UTF-8 continuation bytes start with 10xxxxxx; scan backward to find the leading byte.
-  size_t i = word.size() - 1;
-  while (i > 0 && (static_cast<uint8_t>(word[i]) & 0xC0) == 0x80) {
-    --i;
-  }
-  const auto* ptr = reinterpret_cast<const unsigned char*>(word.c_str() + i);
-  return utf8NextCodepoint(&ptr);
-}
+constexpr char EM_SPACE_UTF8[] = "\xe2\x80\x83";
+constexpr size_t EM_SPACE_BYTES = 3;
 
 bool containsSoftHyphen(const std::string& word) { return word.find(SOFT_HYPHEN_UTF8) != std::string::npos; }
 
@@ -54,8 +48,8 @@ void stripSoftHyphensInPlace(std::string& word) {
 // Returns the advance width for a word while ignoring soft hyphen glyphs and optionally appending a visible hyphen.
 // Uses advance width (sum of glyph advances + kerning) rather than bounding box width so that italic glyph overhangs
 // don't inflate inter-word spacing.
-uint16_t measureWordWidth(const GfxRenderer& renderer, const int fontId, const std::string& word,
-                          const EpdFontFamily::Style style, const bool appendHyphen = false) {
+uint16_t measureUncachedWordWidth(const GfxRenderer& renderer, const int fontId, const std::string& word,
+                                  const EpdFontFamily::Style style, const bool appendHyphen) {
   if (word.size() == 1 && word[0] == ' ' && !appendHyphen) {
     return renderer.getSpaceWidth(fontId, style);
   }
@@ -74,28 +68,109 @@ uint16_t measureWordWidth(const GfxRenderer& renderer, const int fontId, const s
   return renderer.getTextAdvanceX(fontId, sanitized.c_str(), style);
 }
 
+uint16_t measureWordWidth(const GfxRenderer& renderer, WordWidthCache* cache, const int fontId,
+                          const std::string& word, const EpdFontFamily::Style style, const bool appendHyphen = false) {
+  uint16_t width;
+  if (cache && cache->find(fontId, style, appendHyphen, word, width)) {
+    return width;
+  }
+  width = measureUncachedWordWidth(renderer, fontId, word, style, appendHyphen);
+  if (cache) {
+    cache->insert(fontId, style, appendHyphen, word, width);
+  }
+  return width;
+}
+
+// Fills breaks, which has room for Hyphenator::MAX_BREAKS, and returns how many it holds
+size_t wordBreakOffsets(HyphenationCache* cache, const std::string& word, const bool includeFallback,
+                        Hyphenator::BreakInfo* breaks) {
+  size_t count = 0;
+  if (cache && cache->find(word, includeFallback, breaks, count)) {
+    return count;
+  }
+  count = Hyphenator::breakOffsets(word, includeFallback, breaks, Hyphenator::MAX_BREAKS);
+  if (cache) {
+    cache->insert(word, includeFallback, breaks, count);
+  }
+  return count;
+}
+
 }  // namespace
 
-void ParsedText::addWord(std::string word, const EpdFontFamily::Style fontStyle, const bool underline,
-                         const bool attachToPrevious) {
-  if (word.empty()) return;
+void ParsedText::addWord(const char* word, const EpdFontFamily::Style fontStyle, const bool underline,
+                         const bool attachToPrevious, const uint32_t textPosition) {
+  const size_t length = strlen(word);
+  if (length == 0 || length > std::numeric_limits<uint16_t>::max()) return;
 
-  words.push_back(std::move(word));
-  EpdFontFamily::Style combinedStyle = fontStyle;
+  // Each word is followed by a NUL, so its codepoints can be decoded in place like those of a C string
+  wordSpans.push_back({static_cast<uint32_t>(text.size()), static_cast<uint16_t>(length)});
+  text.insert(text.end(), word, word + length + 1);
+  uint8_t flags = fontStyle & STYLE_MASK;
   if (underline) {
-    combinedStyle = static_cast<EpdFontFamily::Style>(combinedStyle | EpdFontFamily::UNDERLINE);
+    flags |= EpdFontFamily::UNDERLINE;
+  }
+  if (attachToPrevious) {
+    flags |= WORD_CONTINUES;
+  }
+  wordFlags.push_back(flags);
+  wordPositions.push_back(textPosition);
+}
+
+void ParsedText::copyWord(const size_t index, std::string& out) const {
+  const WordSpan& span = wordSpans[index];
+  out.assign(text.data() + span.offset, span.length);
+  if (wordFlags[index] & WORD_HYPHEN) {
+    out.push_back('-');
+  }
+}
+
+// Returns the first rendered codepoint of a word (skipping leading soft hyphens).
+uint32_t ParsedText::firstCodepoint(const size_t index) const {
+  const WordSpan& span = wordSpans[index];
+  const auto* ptr = reinterpret_cast<const unsigned char*>(text.data() + span.offset);
+  const auto* const end = ptr + span.length;
+  while (ptr < end) {
+    const uint32_t cp = utf8NextCodepoint(&ptr);
+    if (cp == 0) return 0;
+    if (cp != 0x00AD) return cp;  // skip soft hyphens
+  }
+  return wordFlags[index] & WORD_HYPHEN ? '-' : 0;
+}
+
+// Returns the last codepoint of a word by scanning backward for the start of the last UTF-8 sequence.
+uint32_t ParsedText::lastCodepoint(const size_t index) const {
+  if (wordFlags[index] & WORD_HYPHEN) return '-';
+  const WordSpan& span = wordSpans[index];
+  if (span.length == 0) return 0;
+  // UTF-8 continuation bytes start with 10xxxxxx; scan backward to find the leading byte.
+  size_t i = span.offset + span.length - 1;
+  while (i > span.offset && (static_cast<uint8_t>(text[i]) & 0xC0) == 0x80) {
+    --i;
   }
-  wordStyles.push_back(combinedStyle);
-  wordContinues.push_back(attachToPrevious);
+  const auto* ptr = reinterpret_cast<const unsigned char*>(text.data() + i);
+  return utf8NextCodepoint(&ptr);
+}
+
+// Width between the previous word and this one when both are on the same line: a space plus its kerning, or for
+// continuation words (e.g. nonbreaking spaces, attached punctuation) just the kerning across the boundary
+int ParsedText::gapBefore(const GfxRenderer& renderer, const int fontId, const int spaceWidth,
+                          const size_t index) const {
+  const uint32_t left = lastCodepoint(index - 1);
+  const uint32_t right = firstCodepoint(index);
+  if (wordContinues(index)) {
+    return renderer.getKerning(fontId, left, right, wordStyle(index - 1));
+  }
+  return spaceWidth + renderer.getSpaceKernAdjust(fontId, left, right, wordStyle(index - 1));
 }
 
 // Consumes data to minimize memory usage
 void ParsedText::layoutAndExtractLines(const GfxRenderer& renderer, const int fontId, const uint16_t viewportWidth,
-                                       const std::function<void(std::shared_ptr<TextBlock>)>& processLine,
-                                       const bool includeLastLine) {
-  if (words.empty()) {
+                                       const std::function<void(TextBlock::Ptr)>& processLine,
+                                       const bool includeLastLine, BumpArena* lineArena) {
+  if (wordSpans.empty()) {
     return;
   }
+  TRACE_SCOPE(Layout, wordSpans.size());
 
   // Apply fixed transforms before any per-line layout work.
   applyParagraphIndent();
@@ -103,75 +178,127 @@ void ParsedText::layoutAndExtractLines(const GfxRenderer& renderer, const int fo
   const int pageWidth = viewportWidth;
   const int spaceWidth = renderer.getSpaceWidth(fontId, EpdFontFamily::REGULAR);
   auto wordWidths = calculateWordWidths(renderer, fontId);
+  auto gaps = calculateGaps(renderer, fontId, spaceWidth);
 
   std::vector<size_t> lineBreakIndices;
   if (hyphenationEnabled) {
     // Use greedy layout that can split words mid-loop when a hyphenated prefix fits.
-    lineBreakIndices = computeHyphenatedLineBreaks(renderer, fontId, pageWidth, spaceWidth, wordWidths, wordContinues);
+    lineBreakIndices = computeHyphenatedLineBreaks(renderer, fontId, pageWidth, spaceWidth, wordWidths, gaps);
   } else {
-    lineBreakIndices = computeLineBreaks(renderer, fontId, pageWidth, spaceWidth, wordWidths, wordContinues);
+    lineBreakIndices = computeLineBreaks(renderer, fontId, pageWidth, spaceWidth, wordWidths, gaps);
+  }
+  size_t lineCount = lineBreakIndices.size();
+  if (!includeLastLine) {
+    // Greedy breaks only leave the last line open to the words still to come, optimal ones a few more
+    const size_t heldLines = hyphenationEnabled ? 1 : WINDOW_HELD_LINES;
+    lineCount = lineCount > heldLines ? lineCount - heldLines : 0;
   }
-  const size_t lineCount = includeLastLine ? lineBreakIndices.size() : lineBreakIndices.size() - 1;
 
   for (size_t i = 0; i < lineCount; ++i) {
-    extractLine(i, pageWidth, spaceWidth, wordWidths, wordContinues, lineBreakIndices, processLine, renderer, fontId);
+    TextBlock::Ptr line = extractLine(i, pageWidth, spaceWidth, wordWidths, gaps, lineBreakIndices, lineArena);
+#if SECTION_SHAPED_TEXT
+    line->shape(renderer, fontId);
+#endif
+    processLine(std::move(line));
   }
 
   // Remove consumed words so size() reflects only remaining words
   if (lineCount > 0) {
+    linesExtracted = true;
     const size_t consumed = lineBreakIndices[lineCount - 1];
-    words.erase(words.begin(), words.begin() + consumed);
-    wordStyles.erase(wordStyles.begin(), wordStyles.begin() + consumed);
-    wordContinues.erase(wordContinues.begin(), wordContinues.begin() + consumed);
+    wordSpans.erase(wordSpans.begin(), wordSpans.begin() + consumed);
+    wordFlags.erase(wordFlags.begin(), wordFlags.begin() + consumed);
+    wordPositions.erase(wordPositions.begin(), wordPositions.begin() + consumed);
+
+    // Drop the text in front of the earliest remaining word. Anything left behind it (an indented first word that
+    // was moved to the end) goes once the words in front of it are consumed.
+    auto textStart = static_cast<uint32_t>(text.size());
+    for (const auto& span : wordSpans) {
+      textStart = std::min(textStart, span.offset);
+    }
+    text.erase(text.begin(), text.begin() + textStart);
+    for (auto& span : wordSpans) {
+      span.offset -= textStart;
+    }
   }
 }
 
+void ParsedText::measure(const GfxRenderer& renderer, const int fontId, int& minWidth, int& maxWidth) {
+  minWidth = 0;
+  maxWidth = 0;
+  if (wordSpans.empty()) {
+    return;
+  }
+  const int spaceWidth = renderer.getSpaceWidth(fontId, EpdFontFamily::REGULAR);
+  const auto wordWidths = calculateWordWidths(renderer, fontId);
+  const auto gaps = calculateGaps(renderer, fontId, spaceWidth);
+  int runWidth = 0;
+  for (size_t i = 0; i < wordWidths.size(); ++i) {
+    const int gap = gaps[i];
+    runWidth = i > 0 && wordContinues(i) ? runWidth + gap + wordWidths[i] : wordWidths[i];
+    minWidth = std::max(minWidth, runWidth);
+    maxWidth += gap + wordWidths[i];
+  }
+  minWidth += paragraphIndent();
+  maxWidth += paragraphIndent();
+}
+
 std::vector<uint16_t> ParsedText::calculateWordWidths(const GfxRenderer& renderer, const int fontId) {
   std::vector<uint16_t> wordWidths;
-  wordWidths.reserve(words.size());
+  wordWidths.reserve(wordSpans.size());
 
-  for (size_t i = 0; i < words.size(); ++i) {
-    wordWidths.push_back(measureWordWidth(renderer, fontId, words[i], wordStyles[i]));
+  std::string word;
+  for (size_t i = 0; i < wordSpans.size(); ++i) {
+    copyWord(i, word);
+    wordWidths.push_back(measureWordWidth(renderer, widthCache, fontId, word, wordStyle(i)));
   }
 
   return wordWidths;
 }
 
-std::vector<size_t> ParsedText::computeLineBreaks(const GfxRenderer& renderer, const int fontId, const int pageWidth,
-                                                  const int spaceWidth, std::vector<uint16_t>& wordWidths,
-                                                  std::vector<bool>& continuesVec) {
-  if (words.empty()) {
+// Gaps don't change with where lines break, so they are worked out once for the breaking and the extraction of every
+// line instead of for each candidate. 'gaps[i]' is the width between word i - 1 and word i, and 0 for the first word.
+std::vector<int16_t> ParsedText::calculateGaps(const GfxRenderer& renderer, const int fontId,
+                                               const int spaceWidth) const {
+  std::vector<int16_t> gaps(wordSpans.size());
+  for (size_t i = 1; i < wordSpans.size(); ++i) {
+    gaps[i] = static_cast<int16_t>(gapBefore(renderer, fontId, spaceWidth, i));
+  }
+  return gaps;
+}
+
+HOT_CODE std::vector<size_t> ParsedText::computeLineBreaks(const GfxRenderer& renderer, const int fontId,
+                                                           const int pageWidth, const int spaceWidth,
+                                                           std::vector<uint16_t>& wordWidths,
+                                                           std::vector<int16_t>& gaps) {
+  if (wordSpans.empty()) {
     return {};
   }
 
-  // Calculate first line indent (only for left/justified text without extra paragraph spacing)
-  const int firstLineIndent =
-      blockStyle.textIndent > 0 && !extraParagraphSpacing &&
-              (blockStyle.alignment == CssTextAlign::Justify || blockStyle.alignment == CssTextAlign::Left)
-          ? blockStyle.textIndent
-          : 0;
+  const int firstLineIndent = paragraphIndent();
 
   // Ensure any word that would overflow even as the first entry on a line is split using fallback hyphenation.
   for (size_t i = 0; i < wordWidths.size(); ++i) {
     // First word needs to fit in reduced width if there's an indent
     const int effectiveWidth = i == 0 ? pageWidth - firstLineIndent : pageWidth;
     while (wordWidths[i] > effectiveWidth) {
-      if (!hyphenateWordAtIndex(i, effectiveWidth, renderer, fontId, wordWidths, /*allowFallbackBreaks=*/true)) {
+      if (!hyphenateWordAtIndex(i, effectiveWidth, renderer, fontId, spaceWidth, wordWidths, gaps,
+                                /*allowFallbackBreaks=*/true)) {
         break;
       }
     }
   }
 
-  const size_t totalWordCount = words.size();
+  const size_t totalWordCount = wordSpans.size();
 
   // DP table to store the minimum badness (cost) of lines starting at index i
   std::vector<int> dp(totalWordCount);
-  // 'ans[i]' stores the index 'j' of the *last word* in the optimal line starting at 'i'
-  std::vector<size_t> ans(totalWordCount);
+  // 'ans[i]' stores how many words follow 'i' in the optimal line starting at 'i', so the *last word* is i + ans[i]
+  std::vector<uint16_t> ans(totalWordCount);
 
   // Base Case
   dp[totalWordCount - 1] = 0;
-  ans[totalWordCount - 1] = totalWordCount - 1;
+  ans[totalWordCount - 1] = 0;
 
   for (int i = totalWordCount - 2; i >= 0; --i) {
     int currlen = 0;
@@ -180,25 +307,17 @@ std::vector<size_t> ParsedText::computeLineBreaks(const GfxRenderer& renderer, c
     // First line has reduced width due to text-indent
     const int effectivePageWidth = i == 0 ? pageWidth - firstLineIndent : pageWidth;
 
-    for (size_t j = i; j < totalWordCount; ++j) {
-      // Add space before word j, unless it's the first word on the line or a continuation
-      int gap = 0;
-      if (j > static_cast<size_t>(i) && !continuesVec[j]) {
-        gap = spaceWidth;
-        gap += renderer.getSpaceKernAdjust(fontId, lastCodepoint(words[j - 1]), firstCodepoint(words[j]),
-                                           wordStyles[j - 1]);
-      } else if (j > static_cast<size_t>(i) && continuesVec[j]) {
-        // Cross-boundary kerning for continuation words (e.g. nonbreaking spaces, attached punctuation)
-        gap = renderer.getKerning(fontId, lastCodepoint(words[j - 1]), firstCodepoint(words[j]), wordStyles[j - 1]);
-      }
-      currlen += wordWidths[j] + gap;
+    const size_t lastCandidate = std::min(totalWordCount - 1, i + static_cast<size_t>(UINT16_MAX));
+    for (size_t j = i; j <= lastCandidate; ++j) {
+      // Add the gap before word j, unless it's the first word on the line
+      currlen += wordWidths[j] + (j > static_cast<size_t>(i) ? gaps[j] : 0);
 
       if (currlen > effectivePageWidth) {
         break;
       }
 
       // Cannot break after word j if the next word attaches to it (continuation group)
-      if (j + 1 < totalWordCount && continuesVec[j + 1]) {
+      if (j + 1 < totalWordCount && wordContinues(j + 1)) {
         continue;
       }
 
@@ -219,14 +338,14 @@ std::vector<size_t> ParsedText::computeLineBreaks(const GfxRenderer& renderer, c
 
       if (cost < dp[i]) {
         dp[i] = cost;
-        ans[i] = j;  // j is the index of the last word in this optimal line
+        ans[i] = static_cast<uint16_t>(j - i);  // j is the index of the last word in this optimal line
       }
     }
 
     // Handle oversized word: if no valid configuration found, force single-word line
     // This prevents cascade failure where one oversized word breaks all preceding words
     if (dp[i] == MAX_COST) {
-      ans[i] = i;  // Just this word on its own line
+      ans[i] = 0;  // Just this word on its own line
       // Inherit cost from next word to allow subsequent words to find valid configurations
       if (i + 1 < static_cast<int>(totalWordCount)) {
         dp[i] = dp[i + 1];
@@ -241,14 +360,7 @@ std::vector<size_t> ParsedText::computeLineBreaks(const GfxRenderer& renderer, c
   size_t currentWordIndex = 0;
 
   while (currentWordIndex < totalWordCount) {
-    size_t nextBreakIndex = ans[currentWordIndex] + 1;
-
-    // Safety check: prevent infinite loop if nextBreakIndex doesn't advance
-    if (nextBreakIndex <= currentWordIndex) {
-      // Force advance by at least one word to avoid infinite loop
-      nextBreakIndex = currentWordIndex + 1;
-    }
-
+    const size_t nextBreakIndex = currentWordIndex + ans[currentWordIndex] + 1;
     lineBreakIndices.push_back(nextBreakIndex);
     currentWordIndex = nextBreakIndex;
   }
@@ -256,8 +368,17 @@ std::vector<size_t> ParsedText::computeLineBreaks(const GfxRenderer& renderer, c
   return lineBreakIndices;
 }
 
+// First line indent (only for left/justified text without extra paragraph spacing). Lines laid out after a partial
+// layout continue the paragraph, so they're never indented.
+int ParsedText::paragraphIndent() const {
+  return !linesExtracted && blockStyle.textIndent > 0 && !extraParagraphSpacing &&
+                 (blockStyle.alignment == CssTextAlign::Justify || blockStyle.alignment == CssTextAlign::Left)
+             ? blockStyle.textIndent
+             : 0;
+}
+
 void ParsedText::applyParagraphIndent() {
-  if (extraParagraphSpacing || words.empty()) {
+  if (extraParagraphSpacing || linesExtracted || wordSpans.empty()) {
     return;
   }
 
@@ -265,8 +386,18 @@ void ParsedText::applyParagraphIndent() {
     // CSS text-indent is explicitly set (even if 0) - don't use fallback EmSpace
     // The actual indent positioning is handled in extractLine()
   } else if (blockStyle.alignment == CssTextAlign::Justify || blockStyle.alignment == CssTextAlign::Left) {
-    // No CSS text-indent defined - use EmSpace fallback for visual indent
-    words.front().insert(0, "\xe2\x80\x83");
+    // No CSS text-indent defined - use EmSpace fallback for visual indent. The word is moved to the end of the text
+    // with the EmSpace in front, rather than shifting the text of every other word along.
+    WordSpan& span = wordSpans.front();
+    if (span.length > std::numeric_limits<uint16_t>::max() - EM_SPACE_BYTES) {
+      return;
+    }
+    const size_t offset = text.size();
+    text.resize(offset + EM_SPACE_BYTES + span.length + 1);
+    memcpy(text.data() + offset, EM_SPACE_UTF8, EM_SPACE_BYTES);
+    memcpy(text.data() + offset + EM_SPACE_BYTES, text.data() + span.offset, span.length + 1);
+    span.offset = static_cast<uint32_t>(offset);
+    span.length += EM_SPACE_BYTES;
   }
 }
 
@@ -274,13 +405,8 @@ void ParsedText::applyParagraphIndent() {
 std::vector<size_t> ParsedText::computeHyphenatedLineBreaks(const GfxRenderer& renderer, const int fontId,
                                                             const int pageWidth, const int spaceWidth,
                                                             std::vector<uint16_t>& wordWidths,
-                                                            std::vector<bool>& continuesVec) {
-  // Calculate first line indent (only for left/justified text without extra paragraph spacing)
-  const int firstLineIndent =
-      blockStyle.textIndent > 0 && !extraParagraphSpacing &&
-              (blockStyle.alignment == CssTextAlign::Justify || blockStyle.alignment == CssTextAlign::Left)
-          ? blockStyle.textIndent
-          : 0;
+                                                            std::vector<int16_t>& gaps) {
+  const int firstLineIndent = paragraphIndent();
 
   std::vector<size_t> lineBreakIndices;
   size_t currentIndex = 0;
@@ -296,16 +422,7 @@ std::vector<size_t> ParsedText::computeHyphenatedLineBreaks(const GfxRenderer& r
     // Consume as many words as possible for current line, splitting when prefixes fit
     while (currentIndex < wordWidths.size()) {
       const bool isFirstWord = currentIndex == lineStart;
-      int spacing = 0;
-      if (!isFirstWord && !continuesVec[currentIndex]) {
-        spacing = spaceWidth;
-        spacing += renderer.getSpaceKernAdjust(fontId, lastCodepoint(words[currentIndex - 1]),
-                                               firstCodepoint(words[currentIndex]), wordStyles[currentIndex - 1]);
-      } else if (!isFirstWord && continuesVec[currentIndex]) {
-        // Cross-boundary kerning for continuation words (e.g. nonbreaking spaces, attached punctuation)
-        spacing = renderer.getKerning(fontId, lastCodepoint(words[currentIndex - 1]),
-                                      firstCodepoint(words[currentIndex]), wordStyles[currentIndex - 1]);
-      }
+      const int spacing = isFirstWord ? 0 : gaps[currentIndex];
       const int candidateWidth = spacing + wordWidths[currentIndex];
 
       // Word fits on current line
@@ -320,7 +437,8 @@ std::vector<size_t> ParsedText::computeHyphenatedLineBreaks(const GfxRenderer& r
       const bool allowFallbackBreaks = isFirstWord;  // Only for first word on line
 
       if (availableWidth > 0 &&
-          hyphenateWordAtIndex(currentIndex, availableWidth, renderer, fontId, wordWidths, allowFallbackBreaks)) {
+          hyphenateWordAtIndex(currentIndex, availableWidth, renderer, fontId, spaceWidth, wordWidths, gaps,
+                               allowFallbackBreaks)) {
         // Prefix now fits; append it to this line and move to next line
         lineWidth += spacing + wordWidths[currentIndex];
         ++currentIndex;
@@ -337,7 +455,7 @@ std::vector<size_t> ParsedText::computeHyphenatedLineBreaks(const GfxRenderer& r
 
     // Don't break before a continuation word (e.g., orphaned "?" after "question").
     // Backtrack to the start of the continuation group so the whole group moves to the next line.
-    while (currentIndex > lineStart + 1 && currentIndex < wordWidths.size() && continuesVec[currentIndex]) {
+    while (currentIndex > lineStart + 1 && currentIndex < wordWidths.size() && wordContinues(currentIndex)) {
       --currentIndex;
     }
 
@@ -348,38 +466,45 @@ std::vector<size_t> ParsedText::computeHyphenatedLineBreaks(const GfxRenderer& r
   return lineBreakIndices;
 }
 
-// Splits words[wordIndex] into prefix (adding a hyphen only when needed) and remainder when a legal breakpoint fits the
+// Splits word wordIndex into prefix (adding a hyphen only when needed) and remainder when a legal breakpoint fits the
 // available width.
 bool ParsedText::hyphenateWordAtIndex(const size_t wordIndex, const int availableWidth, const GfxRenderer& renderer,
-                                      const int fontId, std::vector<uint16_t>& wordWidths,
-                                      const bool allowFallbackBreaks) {
+                                      const int fontId, const int spaceWidth, std::vector<uint16_t>& wordWidths,
+                                      std::vector<int16_t>& gaps, const bool allowFallbackBreaks) {
   // Guard against invalid indices or zero available width before attempting to split.
-  if (availableWidth <= 0 || wordIndex >= words.size()) {
+  if (availableWidth <= 0 || wordIndex >= wordSpans.size()) {
     return false;
   }
 
-  const std::string& word = words[wordIndex];
-  const auto style = wordStyles[wordIndex];
+  std::string word;
+  copyWord(wordIndex, word);
+  const WordSpan span = wordSpans[wordIndex];
+  const uint8_t flags = wordFlags[wordIndex];
+  const auto style = wordStyle(wordIndex);
 
   // Collect candidate breakpoints (byte offsets and hyphen requirements).
-  auto breakInfos = Hyphenator::breakOffsets(word, allowFallbackBreaks);
-  if (breakInfos.empty()) {
+  Hyphenator::BreakInfo breakInfos[Hyphenator::MAX_BREAKS];
+  const size_t breakCount = wordBreakOffsets(hyphenationCache, word, allowFallbackBreaks, breakInfos);
+  if (breakCount == 0) {
     return false;
   }
 
   size_t chosenOffset = 0;
   int chosenWidth = -1;
   bool chosenNeedsHyphen = true;
+  std::string prefix;
 
   // Iterate over each legal breakpoint and retain the widest prefix that still fits.
-  for (const auto& info : breakInfos) {
+  for (size_t i = 0; i < breakCount; i++) {
+    const auto& info = breakInfos[i];
     const size_t offset = info.byteOffset;
-    if (offset == 0 || offset >= word.size()) {
+    if (offset == 0 || offset >= span.length) {
       continue;
     }
 
     const bool needsHyphen = info.requiresInsertedHyphen;
-    const int prefixWidth = measureWordWidth(renderer, fontId, word.substr(0, offset), style, needsHyphen);
+    prefix.assign(word, 0, offset);
+    const int prefixWidth = measureWordWidth(renderer, widthCache, fontId, prefix, style, needsHyphen);
     if (prefixWidth > availableWidth || prefixWidth <= chosenWidth) {
       continue;  // Skip if too wide or not an improvement
     }
@@ -394,16 +519,15 @@ bool ParsedText::hyphenateWordAtIndex(const size_t wordIndex, const int availabl
     return false;
   }
 
-  // Split the word at the selected breakpoint and append a hyphen if required.
-  std::string remainder = word.substr(chosenOffset);
-  words[wordIndex].resize(chosenOffset);
-  if (chosenNeedsHyphen) {
-    words[wordIndex].push_back('-');
-  }
+  // Split the word at the selected breakpoint and append a hyphen if required. Both halves keep their text where it
+  // is; a hyphen the word already had goes with the remainder.
+  wordSpans[wordIndex].length = static_cast<uint16_t>(chosenOffset);
+  wordFlags[wordIndex] = static_cast<uint8_t>((flags & ~WORD_HYPHEN) | (chosenNeedsHyphen ? WORD_HYPHEN : 0));
 
   // Insert the remainder word (with matching style and continuation flag) directly after the prefix.
-  words.insert(words.begin() + wordIndex + 1, remainder);
-  wordStyles.insert(wordStyles.begin() + wordIndex + 1, style);
+  const WordSpan remainder{static_cast<uint32_t>(span.offset + chosenOffset),
+                           static_cast<uint16_t>(span.length - chosenOffset)};
+  wordSpans.insert(wordSpans.begin() + wordIndex + 1, remainder);
 
   // Continuation flag handling after splitting a word into prefix + remainder.
   //
@@ -424,32 +548,35 @@ bool ParsedText::hyphenateWordAtIndex(const size_t wordIndex, const int availabl
   //
   // This lets the backtracking loop keep the entire prefix group ("200 Quadrat-") on one
   // line, while "kilometer" moves to the next line.
-  // wordContinues[wordIndex] is intentionally left unchanged — the prefix keeps its original attachment.
-  wordContinues.insert(wordContinues.begin() + wordIndex + 1, false);
+  // WORD_CONTINUES of the prefix is intentionally left unchanged — it keeps its original attachment.
+  wordFlags.insert(wordFlags.begin() + wordIndex + 1, flags & (STYLE_MASK | WORD_HYPHEN));
+  // Words hold no whitespace, so the remainder's text starts chosenOffset text positions after the prefix's
+  wordPositions.insert(wordPositions.begin() + wordIndex + 1,
+                       wordPositions[wordIndex] + static_cast<uint32_t>(chosenOffset));
 
   // Update cached widths to reflect the new prefix/remainder pairing.
   wordWidths[wordIndex] = static_cast<uint16_t>(chosenWidth);
-  const uint16_t remainderWidth = measureWordWidth(renderer, fontId, remainder, style);
+  const uint16_t remainderWidth = measureWordWidth(renderer, widthCache, fontId, word.substr(chosenOffset), style);
   wordWidths.insert(wordWidths.begin() + wordIndex + 1, remainderWidth);
+
+  // The remainder gets a gap of its own, and the word after it now follows the remainder instead of the whole word
+  const auto remainderGap = static_cast<int16_t>(gapBefore(renderer, fontId, spaceWidth, wordIndex + 1));
+  gaps.insert(gaps.begin() + wordIndex + 1, remainderGap);
+  if (wordIndex + 2 < gaps.size()) {
+    gaps[wordIndex + 2] = static_cast<int16_t>(gapBefore(renderer, fontId, spaceWidth, wordIndex + 2));
+  }
   return true;
 }
 
-void ParsedText::extractLine(const size_t breakIndex, const int pageWidth, const int spaceWidth,
-                             const std::vector<uint16_t>& wordWidths, const std::vector<bool>& continuesVec,
-                             const std::vector<size_t>& lineBreakIndices,
-                             const std::function<void(std::shared_ptr<TextBlock>)>& processLine,
-                             const GfxRenderer& renderer, const int fontId) {
+TextBlock::Ptr ParsedText::extractLine(const size_t breakIndex, const int pageWidth, const int spaceWidth,
+                                       const std::vector<uint16_t>& wordWidths, const std::vector<int16_t>& gaps,
+                                       const std::vector<size_t>& lineBreakIndices, BumpArena* lineArena) {
   const size_t lineBreak = lineBreakIndices[breakIndex];
   const size_t lastBreakAt = breakIndex > 0 ? lineBreakIndices[breakIndex - 1] : 0;
   const size_t lineWordCount = lineBreak - lastBreakAt;
 
-  // Calculate first line indent (only for left/justified text without extra paragraph spacing)
   const bool isFirstLine = breakIndex == 0;
-  const int firstLineIndent =
-      isFirstLine && blockStyle.textIndent > 0 && !extraParagraphSpacing &&
-              (blockStyle.alignment == CssTextAlign::Justify || blockStyle.alignment == CssTextAlign::Left)
-          ? blockStyle.textIndent
-          : 0;
+  const int firstLineIndent = isFirstLine ? paragraphIndent() : 0;
 
   // Calculate total word width for this line, count actual word gaps,
   // and accumulate total natural gap widths (including space kerning adjustments).
@@ -459,19 +586,12 @@ void ParsedText::extractLine(const size_t breakIndex, const int pageWidth, const
 
   for (size_t wordIdx = 0; wordIdx < lineWordCount; wordIdx++) {
     lineWordWidthSum += wordWidths[lastBreakAt + wordIdx];
-    // Count gaps: each word after the first creates a gap, unless it's a continuation
-    if (wordIdx > 0 && !continuesVec[lastBreakAt + wordIdx]) {
-      actualGapCount++;
-      int naturalGap = spaceWidth;
-      naturalGap += renderer.getSpaceKernAdjust(fontId, lastCodepoint(words[lastBreakAt + wordIdx - 1]),
-                                                firstCodepoint(words[lastBreakAt + wordIdx]),
-                                                wordStyles[lastBreakAt + wordIdx - 1]);
-      totalNaturalGaps += naturalGap;
-    } else if (wordIdx > 0 && continuesVec[lastBreakAt + wordIdx]) {
-      // Cross-boundary kerning for continuation words (e.g. nonbreaking spaces, attached punctuation)
-      totalNaturalGaps +=
-          renderer.getKerning(fontId, lastCodepoint(words[lastBreakAt + wordIdx - 1]),
-                              firstCodepoint(words[lastBreakAt + wordIdx]), wordStyles[lastBreakAt + wordIdx - 1]);
+    if (wordIdx > 0) {
+      // Count gaps: each word after the first creates a gap, unless it's a continuation
+      if (!wordContinues(lastBreakAt + wordIdx)) {
+        actualGapCount++;
+      }
+      totalNaturalGaps += gaps[lastBreakAt + wordIdx];
     }
   }
 
@@ -493,47 +613,30 @@ void ParsedText::extractLine(const size_t breakIndex, const int pageWidth, const
     xpos = (effectivePageWidth - lineWordWidthSum - totalNaturalGaps) / 2;
   }
 
-  // Pre-calculate X positions for words
-  // Continuation words attach to the previous word with no space before them
-  std::vector<uint16_t> lineXPos;
-  lineXPos.reserve(lineWordCount);
+  // Each word takes its bytes, a NUL and maybe a hyphen; room for all of them is made at once
+  size_t textBytes = 0;
+  for (size_t wordIdx = 0; wordIdx < lineWordCount; wordIdx++) {
+    textBytes += wordSpans[lastBreakAt + wordIdx].length + 2;
+  }
+  TextBlock::Ptr line = TextBlock::create(lineArena, lineWordCount, textBytes, blockStyle);
 
+  // Continuation words attach to the previous word with no space before them
   for (size_t wordIdx = 0; wordIdx < lineWordCount; wordIdx++) {
-    lineXPos.push_back(xpos);
-
-    const bool nextIsContinuation = wordIdx + 1 < lineWordCount && continuesVec[lastBreakAt + wordIdx + 1];
-    if (nextIsContinuation) {
-      int advance = wordWidths[lastBreakAt + wordIdx];
-      // Cross-boundary kerning for continuation words (e.g. nonbreaking spaces, attached punctuation)
-      advance +=
-          renderer.getKerning(fontId, lastCodepoint(words[lastBreakAt + wordIdx]),
-                              firstCodepoint(words[lastBreakAt + wordIdx + 1]), wordStyles[lastBreakAt + wordIdx]);
-      xpos += advance;
-    } else {
-      int gap = spaceWidth;
-      if (wordIdx + 1 < lineWordCount) {
-        gap += renderer.getSpaceKernAdjust(fontId, lastCodepoint(words[lastBreakAt + wordIdx]),
-                                           firstCodepoint(words[lastBreakAt + wordIdx + 1]),
-                                           wordStyles[lastBreakAt + wordIdx]);
-      }
+    const size_t index = lastBreakAt + wordIdx;
+    const WordSpan& span = wordSpans[index];
+    line->addWord(text.data() + span.offset, span.length, wordFlags[index] & WORD_HYPHEN, xpos, wordStyle(index));
+
+    const bool hasNext = wordIdx + 1 < lineWordCount;
+    int gap = hasNext ? gaps[index + 1] : spaceWidth;
+    // Justification only widens real gaps, not the join to a continuation word
+    if (!hasNext || !wordContinues(index + 1)) {
       if (blockStyle.alignment == CssTextAlign::Justify && !isLastLine) {
         gap += justifyExtra;
       }
-      xpos += wordWidths[lastBreakAt + wordIdx] + gap;
-    }
-  }
-
-  // Build line data by moving from the original vectors using index range
-  std::vector<std::string> lineWords(std::make_move_iterator(words.begin() + lastBreakAt),
-                                     std::make_move_iterator(words.begin() + lineBreak));
-  std::vector<EpdFontFamily::Style> lineWordStyles(wordStyles.begin() + lastBreakAt, wordStyles.begin() + lineBreak);
-
-  for (auto& word : lineWords) {
-    if (containsSoftHyphen(word)) {
-      stripSoftHyphensInPlace(word);
     }
+    xpos += wordWidths[index] + gap;
   }
 
-  processLine(
-      std::make_shared<TextBlock>(std::move(lineWords), std::move(lineXPos), std::move(lineWordStyles), blockStyle));
+  linePosition = wordPositions[lastBreakAt];
+  return line;
 }
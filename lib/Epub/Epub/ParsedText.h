@@ -2,50 +2,109 @@
 
 #include <EpdFontFamily.h>
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "BumpArena.h"
+#include "HyphenationCache.h"
+#include "WordWidthCache.h"
 #include "blocks/BlockStyle.h"
 #include "blocks/TextBlock.h"
 
 class GfxRenderer;
 
 class ParsedText {
-  std::vector<std::string> words;
-  std::vector<EpdFontFamily::Style> wordStyles;
-  std::vector<bool> wordContinues;  // true = word attaches to previous (no space before it)
+  template <typename T>
+  using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+  // Where a word's bytes are in text
+  struct WordSpan {
+    uint32_t offset;
+    uint16_t length;
+  };
+
+  // Per word flags: the style in the low bits, then
+  static constexpr uint8_t STYLE_MASK = 0x07;
+  static constexpr uint8_t WORD_CONTINUES = 0x08;  // Attaches to the previous word (no space before it)
+  static constexpr uint8_t WORD_HYPHEN = 0x10;     // Was split off a longer word, a hyphen goes after its text
+
+  // Backed by the parser's arena while indexing; the arena is reset once this block has been laid out. The text of
+  // all words is kept back to back in one buffer and only turned into strings for the lines handed out.
+  ArenaVector<char> text;
+  ArenaVector<WordSpan> wordSpans;
+  ArenaVector<uint8_t> wordFlags;
+  // Text position of each word in the chapter (see ChapterHtmlSlimParser::getPageTextPositions)
+  ArenaVector<uint32_t> wordPositions;
+  uint32_t linePosition = 0;
   BlockStyle blockStyle;
   bool extraParagraphSpacing;
   bool hyphenationEnabled;
+  bool linesExtracted = false;  // A partial layout handed out the start of the paragraph already
+  WordWidthCache* widthCache;          // Shared across the section build, may be null
+  HyphenationCache* hyphenationCache;  // Likewise
 
+  EpdFontFamily::Style wordStyle(const size_t index) const {
+    return static_cast<EpdFontFamily::Style>(wordFlags[index] & STYLE_MASK);
+  }
+  bool wordContinues(const size_t index) const { return wordFlags[index] & WORD_CONTINUES; }
+  void copyWord(size_t index, std::string& out) const;
+  uint32_t firstCodepoint(size_t index) const;
+  uint32_t lastCodepoint(size_t index) const;
+  int gapBefore(const GfxRenderer& renderer, int fontId, int spaceWidth, size_t index) const;
+
+  int paragraphIndent() const;
   void applyParagraphIndent();
   std::vector<size_t> computeLineBreaks(const GfxRenderer& renderer, int fontId, int pageWidth, int spaceWidth,
-                                        std::vector<uint16_t>& wordWidths, std::vector<bool>& continuesVec);
+                                        std::vector<uint16_t>& wordWidths, std::vector<int16_t>& gaps);
   std::vector<size_t> computeHyphenatedLineBreaks(const GfxRenderer& renderer, int fontId, int pageWidth,
                                                   int spaceWidth, std::vector<uint16_t>& wordWidths,
-                                                  std::vector<bool>& continuesVec);
+                                                  std::vector<int16_t>& gaps);
   bool hyphenateWordAtIndex(size_t wordIndex, int availableWidth, const GfxRenderer& renderer, int fontId,
-                            std::vector<uint16_t>& wordWidths, bool allowFallbackBreaks);
-  void extractLine(size_t breakIndex, int pageWidth, int spaceWidth, const std::vector<uint16_t>& wordWidths,
-                   const std::vector<bool>& continuesVec, const std::vector<size_t>& lineBreakIndices,
-                   const std::function<void(std::shared_ptr<TextBlock>)>& processLine, const GfxRenderer& renderer,
-                   int fontId);
+                            int spaceWidth, std::vector<uint16_t>& wordWidths, std::vector<int16_t>& gaps,
+                            bool allowFallbackBreaks);
+  TextBlock::Ptr extractLine(size_t breakIndex, int pageWidth, int spaceWidth, const std::vector<uint16_t>& wordWidths,
+                             const std::vector<int16_t>& gaps, const std::vector<size_t>& lineBreakIndices,
+                             BumpArena* lineArena);
   std::vector<uint16_t> calculateWordWidths(const GfxRenderer& renderer, int fontId);
+  std::vector<int16_t> calculateGaps(const GfxRenderer& renderer, int fontId, int spaceWidth) const;
 
  public:
+  // Words buffered before the parser lays out what it can of a paragraph, so giant ones (a whole chapter without <p>
+  // tags) are laid out in windows and never held in full
+  static constexpr size_t LAYOUT_WINDOW_WORDS = 750;
+
   explicit ParsedText(const bool extraParagraphSpacing, const bool hyphenationEnabled = false,
-                      const BlockStyle& blockStyle = BlockStyle())
-      : blockStyle(blockStyle), extraParagraphSpacing(extraParagraphSpacing), hyphenationEnabled(hyphenationEnabled) {}
+                      const BlockStyle& blockStyle = BlockStyle(), BumpArena* arena = nullptr,
+                      WordWidthCache* widthCache = nullptr, HyphenationCache* hyphenationCache = nullptr)
+      : text(ArenaAllocator<char>(arena)),
+        wordSpans(ArenaAllocator<WordSpan>(arena)),
+        wordFlags(ArenaAllocator<uint8_t>(arena)),
+        wordPositions(ArenaAllocator<uint32_t>(arena)),
+        blockStyle(blockStyle),
+        extraParagraphSpacing(extraParagraphSpacing),
+        hyphenationEnabled(hyphenationEnabled),
+        widthCache(widthCache),
+        hyphenationCache(hyphenationCache) {}
   ~ParsedText() = default;
 
-  void addWord(std::string word, EpdFontFamily::Style fontStyle, bool underline = false, bool attachToPrevious = false);
+  void addWord(const char* word, EpdFontFamily::Style fontStyle, bool underline = false, bool attachToPrevious = false,
+               uint32_t textPosition = 0);
   void setBlockStyle(const BlockStyle& blockStyle) { this->blockStyle = blockStyle; }
   BlockStyle& getBlockStyle() { return blockStyle; }
-  size_t size() const { return words.size(); }
-  bool isEmpty() const { return words.empty(); }
+  size_t size() const { return wordSpans.size(); }
+  bool isEmpty() const { return wordSpans.empty(); }
+  // Without includeLastLine this is a partial layout: the last lines are kept back, to be laid out again together with
+  // the words added next. The lines are built in lineArena if there is one, which has to outlive them, on the heap
+  // otherwise.
   void layoutAndExtractLines(const GfxRenderer& renderer, int fontId, uint16_t viewportWidth,
-                             const std::function<void(std::shared_ptr<TextBlock>)>& processLine,
-                             bool includeLastLine = true);
+                             const std::function<void(TextBlock::Ptr)>& processLine, bool includeLastLine = true,
+                             BumpArena* lineArena = nullptr);
+  // Narrowest width the paragraph can be laid out in without splitting a word (its widest run of attached words), and
+  // its width set on one line
+  void measure(const GfxRenderer& renderer, int fontId, int& minWidth, int& maxWidth);
+  // Text position of the first word of the line last handed to processLine
+  uint32_t getLinePosition() const { return linePosition; }
 };
\ No newline at end of file
@@ -1,36 +1,263 @@
 #include "Section.h"
 
+#include <Arduino.h>
 #include <HalStorage.h>
 #include <Logging.h>
 #include <Serialization.h>
+#include <Trace.h>
 
+#include <algorithm>
+#include <cstdlib>
+
+#include "Epub/css/CssNameFilter.h"
 #include "Epub/css/CssParser.h"
 #include "Page.h"
+#include "PageFrameCache.h"
 #include "hyphenation/Hyphenator.h"
 #include "parsers/ChapterHtmlSlimParser.h"
 
 namespace {
-constexpr uint8_t SECTION_FILE_VERSION = 14;
+constexpr uint8_t SECTION_FILE_VERSION = 22;
 constexpr uint32_t HEADER_SIZE = sizeof(uint8_t) + sizeof(int) + sizeof(float) + sizeof(bool) + sizeof(uint8_t) +
                                  sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(bool) + sizeof(bool) +
-                                 sizeof(uint32_t);
+                                 sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t);
+// pageCount, lutOffset, anchorsOffset and dictionaryOffset close the header and are patched in once the build is done
+constexpr uint32_t PAGE_COUNT_OFFSET = HEADER_SIZE - 3 * sizeof(uint32_t) - sizeof(uint16_t);
+constexpr uint32_t ANCHORS_OFFSET_OFFSET = HEADER_SIZE - 2 * sizeof(uint32_t);
+// Pages per sub-section. A longer chapter is split into files of this many pages: <spine>.bin holds the first of them
+// and the chapter's anchor and position tables, <spine>.<n>.bin the nth after it, each with its own LUT and
+// dictionary. Only those of the sub-section being read are loaded, and each file stays a size FAT seeks well in.
+constexpr uint16_t SUBSECTION_PAGES = 200;
+// An anchor table entry: u32 id hash, u16 page
+constexpr uint32_t ANCHOR_ENTRY_SIZE = sizeof(uint32_t) + sizeof(uint16_t);
+// Decoded page cache: a text page is typically 2-4KB on the heap, so this holds current and both neighbours
+constexpr size_t PAGE_CACHE_BUDGET = 16 * 1024;
+// Drop cached pages rather than compete with layout and image decoding for the last of the heap
+constexpr uint32_t PAGE_CACHE_MIN_FREE_HEAP = 64 * 1024;
+// Most recently used first: u8 count, then count * u32 layout hash
+constexpr char LAYOUT_INDEX_FILE[] = "/layouts.bin";
+// Far above a real page (a few KB), only guards against a corrupt LUT
+constexpr uint32_t MAX_PAGE_RECORD_SIZE = 64 * 1024;
+constexpr uint8_t MAX_LAYOUT_INDEX_ENTRIES = 8;
+// Section files come out at 1.2-2x the chapter's XHTML; reserved at that much, the rest is truncated when done
+constexpr uint32_t SECTION_SIZE_ESTIMATE_FACTOR = 2;
+// Checkpoint of a build (see writeCheckpoint): u8 version, u32 size of the sub-section file it counts, u16 page
+// count, u16 sub-section, bool Expat, u32 dictionary offset, the sub-section's LUT, the parser's state, and the
+// sub-section's dictionary
+constexpr uint8_t CHECKPOINT_VERSION = 2;
+// Pages between checkpoints; a chapter that doesn't get this far is quick to build again from the start
+constexpr uint16_t CHECKPOINT_INTERVAL_PAGES = 64;
+
+std::string layoutDirName(const uint32_t layoutId) {
+  char name[9];
+  snprintf(name, sizeof(name), "%08x", static_cast<unsigned>(layoutId));
+  return name;
+}
 }  // namespace
 
-uint32_t Section::onPageComplete(std::unique_ptr<Page> page) {
+uint8_t Section::maxCachedLayouts = 2;
+
+void Section::setMaxCachedLayouts(const uint8_t count) {
+  maxCachedLayouts = std::max<uint8_t>(1, std::min(count, MAX_LAYOUT_INDEX_ENTRIES));
+}
+
+void Section::selectLayout(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                           const uint8_t paragraphAlignment, const uint16_t viewportWidth, const uint16_t viewportHeight,
+                           const bool hyphenationEnabled, const bool embeddedStyle) {
+  // FNV-1a over the same parameters the section header validates
+  uint32_t hash = 2166136261u;
+  const auto mix = [&hash](const void* data, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      hash ^= static_cast<const uint8_t*>(data)[i];
+      hash *= 16777619u;
+    }
+  };
+  mix(&fontId, sizeof(fontId));
+  mix(&lineCompression, sizeof(lineCompression));
+  mix(&extraParagraphSpacing, sizeof(extraParagraphSpacing));
+  mix(&paragraphAlignment, sizeof(paragraphAlignment));
+  mix(&viewportWidth, sizeof(viewportWidth));
+  mix(&viewportHeight, sizeof(viewportHeight));
+  mix(&hyphenationEnabled, sizeof(hyphenationEnabled));
+  mix(&embeddedStyle, sizeof(embeddedStyle));
+
+  layoutId = hash;
+  const std::string base =
+      epub->getCachePath() + "/sections/" + layoutDirName(layoutId) + "/" + std::to_string(spineIndex);
+  filePath = base + ".bin";
+  checkpointPath = base + ".ckp";
+}
+
+std::string Section::getLayoutDir() const {
+  return epub->getCachePath() + "/sections/" + layoutDirName(layoutId);
+}
+
+// Move this section's layout to the front of the book's layout index and drop the directories of layouts that
+// fell off the end. The index is only rewritten when the order actually changes.
+void Section::touchLayout() const {
+  const std::string sectionsDir = epub->getCachePath() + "/sections";
+  const std::string indexPath = sectionsDir + LAYOUT_INDEX_FILE;
+
+  uint32_t layouts[MAX_LAYOUT_INDEX_ENTRIES];
+  uint8_t count = 0;
+  FsFile indexFile;
+  if (Storage.exists(indexPath.c_str()) && Storage.openFileForRead("SCT", indexPath, indexFile)) {
+    serialization::readPod(indexFile, count);
+    count = std::min(count, MAX_LAYOUT_INDEX_ENTRIES);
+    for (uint8_t i = 0; i < count; i++) {
+      serialization::readPod(indexFile, layouts[i]);
+    }
+    indexFile.close();
+  } else {
+    // First layout-keyed use of this cache: drop section files from before layouts had their own directories
+    for (int i = 0; i < epub->getSpineItemsCount(); i++) {
+      const std::string legacyPath = sectionsDir + "/" + std::to_string(i) + ".bin";
+      if (Storage.exists(legacyPath.c_str())) {
+        Storage.remove(legacyPath.c_str());
+      }
+    }
+  }
+
+  if (count > 0 && layouts[0] == layoutId) {
+    return;
+  }
+
+  uint32_t updated[MAX_LAYOUT_INDEX_ENTRIES];
+  uint8_t updatedCount = 0;
+  updated[updatedCount++] = layoutId;
+  for (uint8_t i = 0; i < count; i++) {
+    if (layouts[i] == layoutId) {
+      continue;
+    }
+    if (updatedCount < maxCachedLayouts) {
+      updated[updatedCount++] = layouts[i];
+    } else {
+      LOG_DBG("SCT", "Evicting cached layout %08x", static_cast<unsigned>(layouts[i]));
+      Storage.removeDir((sectionsDir + "/" + layoutDirName(layouts[i])).c_str());
+    }
+  }
+
+  Storage.mkdir(sectionsDir.c_str());
+  if (!Storage.openFileForWrite("SCT", indexPath, indexFile)) {
+    return;
+  }
+  serialization::writePod(indexFile, updatedCount);
+  for (uint8_t i = 0; i < updatedCount; i++) {
+    serialization::writePod(indexFile, updated[i]);
+  }
+  indexFile.close();
+}
+
+// A page that fails to be written gets a LUT entry of 0, which fails the build once it is finished
+void Section::onPageComplete(std::unique_ptr<Page> page) {
+  if (pageLut.size() >= SUBSECTION_PAGES && !startNextSubsection()) {
+    LOG_ERR("SCT", "Failed to start sub-section %u", loadedSubsection + 1);
+    pageLut.emplace_back(0);
+    return;
+  }
   if (!file) {
     LOG_ERR("SCT", "File not open for writing page %d", pageCount);
-    return 0;
+    pageLut.emplace_back(0);
+    return;
   }
 
-  const uint32_t position = file.position();
-  if (!page->serialize(file)) {
+  BufferedFileWriter writer(file);
+  const uint32_t position = writer.position();
+  if (!page->serialize(writer, dictionary) || !writer.flush()) {
     LOG_ERR("SCT", "Failed to serialize page %d", pageCount);
-    return 0;
+    pageLut.emplace_back(0);
+    return;
   }
   LOG_DBG("SCT", "Page %d processed", pageCount);
 
   pageCount++;
-  return position;
+  pageLut.emplace_back(position);
+}
+
+std::string Section::subsectionPath(const int subsection) const {
+  if (subsection == 0) {
+    return filePath;
+  }
+  // <spine>.bin becomes <spine>.<n>.bin
+  return filePath.substr(0, filePath.size() - 4) + "." + std::to_string(subsection) + ".bin";
+}
+
+// Reads the LUT (lutCount entries) and the dictionary of the sub-section file reader is on
+bool Section::readSubsectionTables(BufferedFileReader& reader, const uint16_t lutCount, const uint32_t lutOffset,
+                                   const uint32_t dictionaryOffset) {
+  pageLut.resize(lutCount);
+  const size_t lutBytes = lutCount * sizeof(uint32_t);
+  if (!reader.seek(lutOffset) ||
+      reader.read(reinterpret_cast<uint8_t*>(pageLut.data()), lutBytes) != static_cast<int>(lutBytes)) {
+    LOG_ERR("SCT", "Deserialization failed: Truncated LUT");
+    pageLut.clear();
+    return false;
+  }
+  pageRecordsEnd = lutOffset;
+  if (!reader.seek(dictionaryOffset) || !dictionary.deserialize(reader)) {
+    LOG_ERR("SCT", "Deserialization failed: Bad dictionary");
+    pageLut.clear();
+    return false;
+  }
+  return true;
+}
+
+// Swaps the loaded sub-section of a complete section for another one
+bool Section::loadSubsection(const int subsection) {
+  if (file) {
+    file.close();
+  }
+  pageLut.clear();
+  dictionary.clear();
+  loadedSubsection = subsection;
+  if (!Storage.openFileForRead("SCT", subsectionPath(subsection), file)) {
+    return false;
+  }
+
+  BufferedFileReader reader(file);
+  uint8_t version = 0;
+  uint16_t pages = 0;
+  uint32_t lutOffset = 0;
+  uint32_t subsectionAnchorsOffset = 0;
+  uint32_t dictionaryOffset = 0;
+  serialization::readPod(reader, version);
+  reader.seek(PAGE_COUNT_OFFSET);
+  serialization::readPod(reader, pages);
+  serialization::readPod(reader, lutOffset);
+  serialization::readPod(reader, subsectionAnchorsOffset);
+  serialization::readPod(reader, dictionaryOffset);
+  // The first file counts the chapter's pages, the others their own
+  const uint16_t lutCount = std::min<int>(SUBSECTION_PAGES, pageCount - subsection * SUBSECTION_PAGES);
+  if (version != SECTION_FILE_VERSION || pages != (subsection == 0 ? pageCount : lutCount) || lutOffset == 0 ||
+      !readSubsectionTables(reader, lutCount, lutOffset, dictionaryOffset)) {
+    LOG_ERR("SCT", "Bad sub-section %d of section %d", subsection, spineIndex);
+    file.close();
+    return false;
+  }
+  LOG_DBG("SCT", "Loaded sub-section %d of section %d", subsection, spineIndex);
+  return true;
+}
+
+// <spine>.bin, where the chapter's anchor and position tables are whichever sub-section is loaded
+FsFile* Section::openChapterTables() {
+  FsFile& tables = loadedSubsection == 0 ? file : tableFile;
+  if (!tables && !Storage.openFileForRead("SCT", filePath, tables)) {
+    return nullptr;
+  }
+  return &tables;
+}
+
+void Section::removeSubsectionFiles() {
+  if (tableFile) {
+    tableFile.close();
+  }
+  for (int subsection = 1;; subsection++) {
+    const std::string path = subsectionPath(subsection);
+    if (!Storage.exists(path.c_str())) {
+      break;
+    }
+    Storage.remove(path.c_str());
+  }
 }
 
 void Section::writeSectionFileHeader(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
@@ -44,32 +271,74 @@ void Section::writeSectionFileHeader(const int fontId, const float lineCompressi
   static_assert(HEADER_SIZE == sizeof(SECTION_FILE_VERSION) + sizeof(fontId) + sizeof(lineCompression) +
                                    sizeof(extraParagraphSpacing) + sizeof(paragraphAlignment) + sizeof(viewportWidth) +
                                    sizeof(viewportHeight) + sizeof(pageCount) + sizeof(hyphenationEnabled) +
-                                   sizeof(embeddedStyle) + sizeof(uint32_t),
+                                   sizeof(embeddedStyle) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t),
                 "Header size mismatch");
-  serialization::writePod(file, SECTION_FILE_VERSION);
-  serialization::writePod(file, fontId);
-  serialization::writePod(file, lineCompression);
-  serialization::writePod(file, extraParagraphSpacing);
-  serialization::writePod(file, paragraphAlignment);
-  serialization::writePod(file, viewportWidth);
-  serialization::writePod(file, viewportHeight);
-  serialization::writePod(file, hyphenationEnabled);
-  serialization::writePod(file, embeddedStyle);
-  serialization::writePod(file, pageCount);  // Placeholder for page count (will be initially 0 when written)
-  serialization::writePod(file, static_cast<uint32_t>(0));  // Placeholder for LUT offset
+  BufferedFileWriter writer(file);
+  serialization::writePod(writer, SECTION_FILE_VERSION);
+  serialization::writePod(writer, fontId);
+  serialization::writePod(writer, lineCompression);
+  serialization::writePod(writer, extraParagraphSpacing);
+  serialization::writePod(writer, paragraphAlignment);
+  serialization::writePod(writer, viewportWidth);
+  serialization::writePod(writer, viewportHeight);
+  serialization::writePod(writer, hyphenationEnabled);
+  serialization::writePod(writer, embeddedStyle);
+  serialization::writePod(writer, pageCount);  // Placeholder for page count (will be initially 0 when written)
+  serialization::writePod(writer, static_cast<uint32_t>(0));  // Placeholder for LUT offset
+  serialization::writePod(writer, static_cast<uint32_t>(0));  // Placeholder for anchor table offset
+  serialization::writePod(writer, static_cast<uint32_t>(0));  // Placeholder for dictionary offset
+}
+
+bool Section::readBuildParams(const std::string& path, BuildParams& params) {
+  FsFile input;
+  if (!Storage.openFileForRead("SCT", path, input)) {
+    return false;
+  }
+  uint8_t version = 0;
+  serialization::readPod(input, version);
+  serialization::readPod(input, params.fontId);
+  serialization::readPod(input, params.lineCompression);
+  serialization::readPod(input, params.extraParagraphSpacing);
+  serialization::readPod(input, params.paragraphAlignment);
+  serialization::readPod(input, params.viewportWidth);
+  serialization::readPod(input, params.viewportHeight);
+  serialization::readPod(input, params.hyphenationEnabled);
+  serialization::readPod(input, params.embeddedStyle);
+  const bool complete = input.size() >= HEADER_SIZE;
+  input.close();
+  if (!complete || version != SECTION_FILE_VERSION) {
+    LOG_ERR("SCT", "Not a section file of version %u: %s", SECTION_FILE_VERSION, path.c_str());
+    return false;
+  }
+  return true;
 }
 
 bool Section::loadSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
                               const uint8_t paragraphAlignment, const uint16_t viewportWidth,
                               const uint16_t viewportHeight, const bool hyphenationEnabled, const bool embeddedStyle) {
+  if (file) {
+    file.close();
+  }
+  if (tableFile) {
+    tableFile.close();
+  }
+  loadedSubsection = 0;
+  pageLut.clear();
+  dictionary.clear();
+  anchorCount = 0;
+  positionsOffset = 0;
+  clearPageCache();
+  selectLayout(fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth, viewportHeight,
+               hyphenationEnabled, embeddedStyle);
   if (!Storage.openFileForRead("SCT", filePath, file)) {
     return false;
   }
 
+  BufferedFileReader reader(file);
   // Match parameters
   {
     uint8_t version;
-    serialization::readPod(file, version);
+    serialization::readPod(reader, version);
     if (version != SECTION_FILE_VERSION) {
       file.close();
       LOG_ERR("SCT", "Deserialization failed: Unknown version %u", version);
@@ -84,14 +353,14 @@ bool Section::loadSectionFile(const int fontId, const float lineCompression, con
     uint8_t fileParagraphAlignment;
     bool fileHyphenationEnabled;
     bool fileEmbeddedStyle;
-    serialization::readPod(file, fileFontId);
-    serialization::readPod(file, fileLineCompression);
-    serialization::readPod(file, fileExtraParagraphSpacing);
-    serialization::readPod(file, fileParagraphAlignment);
-    serialization::readPod(file, fileViewportWidth);
-    serialization::readPod(file, fileViewportHeight);
-    serialization::readPod(file, fileHyphenationEnabled);
-    serialization::readPod(file, fileEmbeddedStyle);
+    serialization::readPod(reader, fileFontId);
+    serialization::readPod(reader, fileLineCompression);
+    serialization::readPod(reader, fileExtraParagraphSpacing);
+    serialization::readPod(reader, fileParagraphAlignment);
+    serialization::readPod(reader, fileViewportWidth);
+    serialization::readPod(reader, fileViewportHeight);
+    serialization::readPod(reader, fileHyphenationEnabled);
+    serialization::readPod(reader, fileEmbeddedStyle);
 
     if (fontId != fileFontId || lineCompression != fileLineCompression ||
         extraParagraphSpacing != fileExtraParagraphSpacing || paragraphAlignment != fileParagraphAlignment ||
@@ -104,15 +373,71 @@ bool Section::loadSectionFile(const int fontId, const float lineCompression, con
     }
   }
 
-  serialization::readPod(file, pageCount);
-  file.close();
+  serialization::readPod(reader, pageCount);
+  uint32_t lutOffset;
+  uint32_t dictionaryOffset;
+  serialization::readPod(reader, lutOffset);
+  serialization::readPod(reader, anchorsOffset);
+  serialization::readPod(reader, dictionaryOffset);
+  if (lutOffset == 0 || anchorsOffset == 0) {
+    // Left by a build that was stopped, kept for it to resume
+    file.close();
+    pageCount = 0;
+    LOG_DBG("SCT", "Section %d isn't built completely", spineIndex);
+    return false;
+  }
+
+  // Load the LUT of the first sub-section up front (4 bytes per page) so page turns don't have to go through it on
+  // the SD card
+  if (!readSubsectionTables(reader, std::min(pageCount, SUBSECTION_PAGES), lutOffset, dictionaryOffset)) {
+    file.close();
+    pageCount = 0;
+    clearCache();
+    return false;
+  }
+
+  // Only the count: a lookup goes through the table on the SD card. The tables end the file.
+  const uint32_t fileSize = file.size();
+  reader.seek(anchorsOffset);
+  serialization::readPod(reader, anchorCount);
+  if (anchorsOffset + sizeof(anchorCount) + anchorCount * ANCHOR_ENTRY_SIZE > fileSize) {
+    LOG_ERR("SCT", "Bad anchor table, in-chapter links go to the chapter start");
+    anchorCount = 0;
+    positionsOffset = 0;
+  } else {
+    positionsOffset = anchorsOffset + sizeof(anchorCount) + anchorCount * ANCHOR_ENTRY_SIZE;
+  }
+  if (positionsOffset != 0 && positionsOffset + pageCount * sizeof(uint32_t) > fileSize) {
+    LOG_ERR("SCT", "Bad page position table, synced positions go by percentage");
+    positionsOffset = 0;
+  }
+
+  touchLayout();
   LOG_DBG("SCT", "Deserialization succeeded: %d pages", pageCount);
   return true;
 }
 
 // Your updated class method (assuming you are using the 'SD' object, which is a wrapper for a specific filesystem)
-bool Section::clearCache() const {
-  if (!Storage.exists(filePath.c_str())) {
+bool Section::clearCache() {
+  if (file) {
+    file.close();
+  }
+  loadedSubsection = 0;
+  pageLut.clear();
+  dictionary.clear();
+  anchorCount = 0;
+  positionsOffset = 0;
+  clearPageCache();
+
+  if (!filePath.empty()) {
+    PageFrameCache::dropSpine(getLayoutDir(), spineIndex);
+    if (Storage.exists(checkpointPath.c_str())) {
+      Storage.remove(checkpointPath.c_str());
+    }
+    removeSubsectionFiles();
+  }
+
+  if (filePath.empty() || !Storage.exists(filePath.c_str())) {
     LOG_DBG("SCT", "Cache does not exist, no action needed");
     return true;
   }
@@ -126,139 +451,733 @@ bool Section::clearCache() const {
   return true;
 }
 
+Section::Section(const std::shared_ptr<Epub>& epub, const int spineIndex, GfxRenderer& renderer)
+    : epub(epub),
+      spineIndex(spineIndex),
+      renderer(renderer) {}
+
+Section::~Section() {
+  if (builder) {
+    abortSectionBuild();
+  }
+  if (file) {
+    file.close();
+  }
+  if (tableFile) {
+    tableFile.close();
+  }
+}
+
 bool Section::createSectionFile(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
                                 const uint8_t paragraphAlignment, const uint16_t viewportWidth,
                                 const uint16_t viewportHeight, const bool hyphenationEnabled, const bool embeddedStyle,
                                 const std::function<void()>& popupFn) {
-  const auto localPath = epub->getSpineItem(spineIndex).href;
-  const auto tmpHtmlPath = epub->getCachePath() + "/.tmp_" + std::to_string(spineIndex) + ".html";
+  if (!beginSectionBuild(fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth,
+                         viewportHeight, hyphenationEnabled, embeddedStyle, popupFn)) {
+    return false;
+  }
+  return continueSectionBuild() == BuildStatus::Done;
+}
+
+bool Section::beginSectionBuild(const int fontId, const float lineCompression, const bool extraParagraphSpacing,
+                                const uint8_t paragraphAlignment, const uint16_t viewportWidth,
+                                const uint16_t viewportHeight, const bool hyphenationEnabled, const bool embeddedStyle,
+                                const std::function<void()>& popupFn) {
+  if (builder) {
+    LOG_ERR("SCT", "Section build already in progress");
+    return false;
+  }
+  if (file) {
+    file.close();
+  }
+
+  selectLayout(fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth, viewportHeight,
+               hyphenationEnabled, embeddedStyle);
+  touchLayout();
 
   // Create cache directory if it doesn't exist
   {
     const auto sectionsDir = epub->getCachePath() + "/sections";
     Storage.mkdir(sectionsDir.c_str());
+    Storage.mkdir((sectionsDir + "/" + layoutDirName(layoutId)).c_str());
   }
+  // Frames rendered from a previous build of this chapter may not match the new pages
+  PageFrameCache::dropSpine(getLayoutDir(), spineIndex);
 
-  // Retry logic for SD card timing issues
-  bool success = false;
-  uint32_t fileSize = 0;
-  for (int attempt = 0; attempt < 3 && !success; attempt++) {
-    if (attempt > 0) {
-      LOG_DBG("SCT", "Retrying stream (attempt %d)...", attempt + 1);
-      delay(50);  // Brief delay before retry
-    }
+  buildParams = {fontId,        lineCompression, extraParagraphSpacing, paragraphAlignment,
+                 viewportWidth, viewportHeight,  hyphenationEnabled,    embeddedStyle};
+  buildAttempt = 0;
+  buildWithExpat = false;
+  checkpointPageCount = 0;
 
-    // Remove any incomplete file from previous attempt before retrying
-    if (Storage.exists(tmpHtmlPath.c_str())) {
-      Storage.remove(tmpHtmlPath.c_str());
+  buildCssParser = nullptr;
+  if (!embeddedStyle) {
+    epub->releaseCssRules(false);
+  } else {
+    buildCssParser = epub->getCssParser();
+    if (buildCssParser && !epub->loadCssRules(spineIndex)) {
+      LOG_ERR("SCT", "Failed to load CSS from cache");
     }
+  }
+  Hyphenator::setPreferredLanguage(epub->getLanguage());
 
-    FsFile tmpHtml;
-    if (!Storage.openFileForWrite("SCT", tmpHtmlPath, tmpHtml)) {
-      continue;
-    }
-    success = epub->readItemContentsToStream(localPath, tmpHtml, 1024);
-    fileSize = tmpHtml.size();
-    tmpHtml.close();
+  if (!startBuildAttempt(popupFn)) {
+    discardSectionBuild();
+    return false;
+  }
+  return true;
+}
+
+void Section::createBuilder(const std::function<void()>& popupFn) {
+  // Derive the content base directory and image cache path prefix for the parser
+  const auto localPath = epub->getSpineItem(spineIndex).href;
+  size_t lastSlash = localPath.find_last_of('/');
+  std::string contentBase = (lastSlash != std::string::npos) ? localPath.substr(0, lastSlash + 1) : "";
+  std::string imageBasePath = epub->getCachePath() + "/img_" + std::to_string(spineIndex) + "_";
+
+  builder.reset(new ChapterHtmlSlimParser(
+      epub, localPath, renderer, buildParams.fontId, buildParams.lineCompression, buildParams.extraParagraphSpacing,
+      buildParams.paragraphAlignment, buildParams.viewportWidth, buildParams.viewportHeight,
+      buildParams.hyphenationEnabled,
+      [this](std::unique_ptr<Page> page) { this->onPageComplete(std::move(page)); },
+      buildParams.embeddedStyle, contentBase, imageBasePath, popupFn, buildCssParser, buildWithExpat));
+  builder->setCheckpointFn([this]() { writeCheckpoint(); });
+}
 
-    // If streaming failed, remove the incomplete file immediately
-    if (!success && Storage.exists(tmpHtmlPath.c_str())) {
-      Storage.remove(tmpHtmlPath.c_str());
-      LOG_DBG("SCT", "Removed incomplete temp file after failed attempt");
+// (Re)starts the section file and the chapter stream from the last checkpoint, or else from the beginning. The
+// chapter is inflated straight from the epub into the parser, so a read failure part-way through can't be resumed
+// where it happened and the build goes back to one of those instead.
+bool Section::startBuildAttempt(const std::function<void()>& popupFn) {
+  builder.reset();
+  if (file) {
+    file.close();
+  }
+  if (tableFile) {
+    tableFile.close();
+  }
+  if (Storage.exists(checkpointPath.c_str())) {
+    if (resumeBuildAttempt(popupFn)) {
+      return true;
+    }
+    LOG_DBG("SCT", "Building section %d from the start", spineIndex);
+    builder.reset();
+    if (file) {
+      file.close();
     }
+    Storage.remove(checkpointPath.c_str());
+    checkpointPageCount = 0;
   }
 
-  if (!success) {
-    LOG_ERR("SCT", "Failed to stream item contents to temp file after retries");
+  removeSubsectionFiles();
+  loadedSubsection = 0;
+  buildResumed = false;
+  if (!Storage.openFileForWrite("SCT", filePath, file)) {
     return false;
   }
+  const size_t chapterStart = spineIndex > 0 ? epub->getCumulativeSpineItemSize(spineIndex - 1) : 0;
+  const size_t chapterSize = epub->getCumulativeSpineItemSize(spineIndex) - chapterStart;
+  Storage.preAllocate("SCT", file, HEADER_SIZE + SECTION_SIZE_ESTIMATE_FACTOR * static_cast<uint64_t>(chapterSize));
+  pageCount = 0;
+  anchorCount = 0;
+  positionsOffset = 0;
+  dictionary.clear();
+  writeSectionFileHeader(buildParams.fontId, buildParams.lineCompression, buildParams.extraParagraphSpacing,
+                         buildParams.paragraphAlignment, buildParams.viewportWidth, buildParams.viewportHeight,
+                         buildParams.hyphenationEnabled, buildParams.embeddedStyle);
+  pageLut.clear();
 
-  LOG_DBG("SCT", "Streamed temp HTML to %s (%d bytes)", tmpHtmlPath.c_str(), fileSize);
+  createBuilder(popupFn);
+  if (!builder->beginParse()) {
+    LOG_ERR("SCT", "Failed to start XML parser");
+    return false;
+  }
+  return true;
+}
 
-  if (!Storage.openFileForWrite("SCT", filePath, file)) {
+// Goes on from the checkpoint: the file of the sub-section it was in is cut back to the pages it counts and the parser
+// picks up from the block it was at
+bool Section::resumeBuildAttempt(const std::function<void()>& popupFn) {
+  FsFile input;
+  if (!Storage.openFileForRead("SCT", checkpointPath, input)) {
+    return false;
+  }
+  uint8_t version = 0;
+  uint32_t fileSize = 0;
+  uint16_t pages = 0;
+  uint16_t subsection = 0;
+  bool expat = false;
+  uint32_t dictionaryOffset = 0;
+  bool loaded;
+  {
+    BufferedFileReader reader(input);
+    serialization::readPod(reader, version);
+    serialization::readPod(reader, fileSize);
+    serialization::readPod(reader, pages);
+    serialization::readPod(reader, subsection);
+    serialization::readPod(reader, expat);
+    serialization::readPod(reader, dictionaryOffset);
+    // The earlier sub-sections are complete files
+    const int lutCount = pages - subsection * SUBSECTION_PAGES;
+    loaded = version == CHECKPOINT_VERSION && lutCount >= 0 && lutCount <= SUBSECTION_PAGES;
+    pageLut.resize(loaded ? lutCount : 0);
+    const size_t lutBytes = pageLut.size() * sizeof(uint32_t);
+    loaded = loaded &&
+             reader.read(reinterpret_cast<uint8_t*>(pageLut.data()), lutBytes) == static_cast<int>(lutBytes) &&
+             (pageLut.empty() || (pageLut.front() >= HEADER_SIZE && pageLut.back() < fileSize));
+    const uint32_t parserOffset = reader.position();
+    dictionary.clear();
+    loaded = loaded && reader.seek(dictionaryOffset) && dictionary.deserialize(reader) && reader.seek(parserOffset);
+    if (loaded) {
+      // What the light tokenizer gave up on before stays with Expat
+      buildWithExpat = buildWithExpat || expat;
+      createBuilder(popupFn);
+      loaded = builder->loadCheckpoint(reader, dictionary);
+    }
+  }
+  input.close();
+  if (!loaded) {
+    LOG_ERR("SCT", "Bad checkpoint for section %d", spineIndex);
     return false;
   }
-  writeSectionFileHeader(fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth,
-                         viewportHeight, hyphenationEnabled, embeddedStyle);
-  std::vector<uint32_t> lut = {};
 
-  // Derive the content base directory and image cache path prefix for the parser
-  size_t lastSlash = localPath.find_last_of('/');
-  std::string contentBase = (lastSlash != std::string::npos) ? localPath.substr(0, lastSlash + 1) : "";
-  std::string imageBasePath = epub->getCachePath() + "/img_" + std::to_string(spineIndex) + "_";
+  loadedSubsection = subsection;
+  file = Storage.open(subsectionPath(subsection).c_str(), O_RDWR);
+  if (!file || file.size() < fileSize || !file.truncate(fileSize) || !file.seek(fileSize)) {
+    LOG_ERR("SCT", "Section file doesn't go as far as its checkpoint");
+    return false;
+  }
+  pageCount = pages;
+  anchorCount = 0;
+  positionsOffset = 0;
+  checkpointPageCount = pages;
+  if (!builder->beginParse()) {
+    return false;
+  }
+  buildResumed = true;
+  LOG_DBG("SCT", "Resuming build of section %d at page %u", spineIndex, pages);
+  return true;
+}
+
+// Called by the parser at each point it can be resumed from; saves one once enough pages were added since the last.
+// The pages it counts are flushed to the card first, and the checkpoint replaces the last one only once complete.
+void Section::writeCheckpoint() {
+  if (pageCount < checkpointPageCount + CHECKPOINT_INTERVAL_PAGES) {
+    return;
+  }
+  file.flush();
+  const uint32_t fileSize = file.position();
+  const std::string tempPath = checkpointPath + ".tmp";
+  FsFile output;
+  if (!Storage.openFileForWrite("SCT", tempPath, output)) {
+    return;
+  }
+  bool written;
+  {
+    BufferedFileWriter writer(output);
+    serialization::writePod(writer, CHECKPOINT_VERSION);
+    serialization::writePod(writer, fileSize);
+    serialization::writePod(writer, pageCount);
+    serialization::writePod(writer, loadedSubsection);
+    serialization::writePod(writer, buildWithExpat);
+    const uint32_t dictionaryOffsetAt = writer.position();
+    serialization::writePod(writer, static_cast<uint32_t>(0));
+    writer.write(pageLut.data(), pageLut.size() * sizeof(uint32_t));
+    written = builder->saveCheckpoint(writer, dictionary);
+    const uint32_t dictionaryOffset = writer.position();
+    written = written && dictionary.serialize(writer) && writer.seek(dictionaryOffsetAt);
+    serialization::writePod(writer, dictionaryOffset);
+    written = written && writer.flush();
+  }
+  output.close();
+  if (!written || (Storage.exists(checkpointPath.c_str()) && !Storage.remove(checkpointPath.c_str())) ||
+      !Storage.rename(tempPath.c_str(), checkpointPath.c_str())) {
+    LOG_ERR("SCT", "Failed to write checkpoint of section %d", spineIndex);
+    Storage.remove(tempPath.c_str());
+    return;
+  }
+  checkpointPageCount = pageCount;
+  LOG_DBG("SCT", "Checkpoint of section %d at page %u", spineIndex, pageCount);
+}
+
+Section::BuildStatus Section::continueSectionBuild(const uint32_t timeBudgetMs, const uint16_t untilPageCount) {
+  if (!builder) {
+    LOG_ERR("SCT", "No section build in progress");
+    return BuildStatus::Failed;
+  }
+
+  const uint32_t sliceStart = millis();
+  while (true) {
+    ChapterHtmlSlimParser::ParseStatus status;
+    do {
+      status = builder->parseNextChunk();
+    } while (status == ChapterHtmlSlimParser::ParseStatus::InProgress &&
+             (timeBudgetMs == 0 || millis() - sliceStart < timeBudgetMs) &&
+             (untilPageCount == 0 || pageCount < untilPageCount));
+
+    if (status == ChapterHtmlSlimParser::ParseStatus::InProgress) {
+      return BuildStatus::InProgress;
+    }
+
+    if (status == ChapterHtmlSlimParser::ParseStatus::Done) {
+      return finishSectionBuild() ? BuildStatus::Done : BuildStatus::Failed;
+    }
 
-  CssParser* cssParser = nullptr;
-  if (embeddedStyle) {
-    cssParser = epub->getCssParser();
-    if (cssParser) {
-      if (!cssParser->loadFromCache()) {
-        LOG_ERR("SCT", "Failed to load CSS from cache");
+    // What the light tokenizer rejects may still be well-formed enough for Expat
+    if (builder->hadTokenizerError()) {
+      LOG_DBG("SCT", "Rebuilding section with Expat");
+      buildWithExpat = true;
+      if (!startBuildAttempt(nullptr)) {
+        discardSectionBuild();
+        return BuildStatus::Failed;
       }
+      continue;
+    }
+
+    // Read errors from the SD card are usually transient, so restart the stream a couple of times before giving up.
+    // Malformed XML would fail the same way again.
+    if (!builder->hadSourceError() || ++buildAttempt >= 3) {
+      LOG_ERR("SCT", "Failed to parse XML and build pages");
+      discardSectionBuild();
+      return BuildStatus::Failed;
+    }
+    LOG_DBG("SCT", "Restarting section stream (attempt %d)...", buildAttempt + 1);
+    delay(50);  // Brief delay before retry
+    if (!startBuildAttempt(nullptr)) {
+      discardSectionBuild();
+      return BuildStatus::Failed;
     }
   }
+}
 
-  ChapterHtmlSlimParser visitor(
-      epub, tmpHtmlPath, renderer, fontId, lineCompression, extraParagraphSpacing, paragraphAlignment, viewportWidth,
-      viewportHeight, hyphenationEnabled,
-      [this, &lut](std::unique_ptr<Page> page) { lut.emplace_back(this->onPageComplete(std::move(page))); },
-      embeddedStyle, contentBase, imageBasePath, popupFn, cssParser);
-  Hyphenator::setPreferredLanguage(epub->getLanguage());
-  success = visitor.parseAndBuildPages();
+void Section::abortSectionBuild() {
+  if (!builder) {
+    return;
+  }
+  if (checkpointPageCount > 0) {
+    LOG_DBG("SCT", "Stopping build of section %d, %u pages kept", spineIndex, checkpointPageCount);
+    discardSectionBuild(true);
+    return;
+  }
+  LOG_DBG("SCT", "Aborting build of section %d", spineIndex);
+  discardSectionBuild();
+}
 
-  Storage.remove(tmpHtmlPath.c_str());
-  if (!success) {
-    LOG_ERR("SCT", "Failed to parse XML and build pages");
+void Section::discardSectionBuild(const bool keepCheckpoint) {
+  builder.reset();
+  clearPageCache();
+  pageLut.clear();
+  pageLut.shrink_to_fit();
+  dictionary.clear();
+  if (file) {
     file.close();
+  }
+  if (tableFile) {
+    tableFile.close();
+  }
+  if (!keepCheckpoint) {
     Storage.remove(filePath.c_str());
-    if (cssParser) {
-      cssParser->clear();
+    removeSubsectionFiles();
+    if (Storage.exists(checkpointPath.c_str())) {
+      Storage.remove(checkpointPath.c_str());
     }
+  }
+  loadedSubsection = 0;
+  checkpointPageCount = 0;
+  pageCount = 0;
+  if (buildCssParser) {
+    epub->releaseCssRules(true);
+    buildCssParser = nullptr;
+  }
+}
+
+// Ends the sub-section file being written with its LUT and dictionary, and fills in its header but for the anchor
+// table: that of the first file is only set once the chapter's tables follow, so it reads as incomplete until then
+bool Section::finishSubsectionFile() {
+  if (std::find(pageLut.begin(), pageLut.end(), 0) != pageLut.end()) {
+    LOG_ERR("SCT", "Failed to write LUT due to invalid page positions");
     return false;
   }
 
-  const uint32_t lutOffset = file.position();
-  bool hasFailedLutRecords = false;
-  // Write LUT
-  for (const uint32_t& pos : lut) {
-    if (pos == 0) {
-      hasFailedLutRecords = true;
-      break;
-    }
-    serialization::writePod(file, pos);
+  BufferedFileWriter writer(file);
+  const uint32_t lutOffset = writer.position();
+  pageRecordsEnd = lutOffset;
+  writer.write(pageLut.data(), pageLut.size() * sizeof(uint32_t));
+
+  const uint32_t dictionaryOffset = writer.position();
+  if (!dictionary.serialize(writer)) {
+    LOG_ERR("SCT", "Failed to write dictionary");
+    return false;
   }
+  LOG_DBG("SCT", "Sub-section %u dictionary: %u words", loadedSubsection, static_cast<unsigned>(dictionary.size()));
+  dictionary.releaseIndex();
+  const uint32_t fileEnd = writer.position();
 
-  if (hasFailedLutRecords) {
-    LOG_ERR("SCT", "Failed to write LUT due to invalid page positions");
-    file.close();
-    Storage.remove(filePath.c_str());
+  writer.seek(PAGE_COUNT_OFFSET);
+  serialization::writePod(writer, static_cast<uint16_t>(pageLut.size()));
+  serialization::writePod(writer, lutOffset);
+  serialization::writePod(writer, static_cast<uint32_t>(0));
+  serialization::writePod(writer, dictionaryOffset);
+  if (!writer.flush() || !file.truncate(fileEnd) || !file.seek(fileEnd)) {
+    LOG_ERR("SCT", "Failed to write sub-section %u", loadedSubsection);
     return false;
   }
+  return true;
+}
 
-  // Go back and write LUT offset
-  file.seek(HEADER_SIZE - sizeof(uint32_t) - sizeof(pageCount));
-  serialization::writePod(file, pageCount);
-  serialization::writePod(file, lutOffset);
+// Called once the sub-section being written is full, before the page that goes on the next one
+bool Section::startNextSubsection() {
+  if (!finishSubsectionFile()) {
+    return false;
+  }
+  // The next one takes about as much room as this one
+  const uint32_t previousSize = file.size();
   file.close();
-  if (cssParser) {
-    cssParser->clear();
+  loadedSubsection++;
+  pageLut.clear();
+  dictionary.clear();
+  if (!Storage.openFileForWrite("SCT", subsectionPath(loadedSubsection), file)) {
+    return false;
   }
+  Storage.preAllocate("SCT", file, previousSize);
+  writeSectionFileHeader(buildParams.fontId, buildParams.lineCompression, buildParams.extraParagraphSpacing,
+                         buildParams.paragraphAlignment, buildParams.viewportWidth, buildParams.viewportHeight,
+                         buildParams.hyphenationEnabled, buildParams.embeddedStyle);
+  LOG_DBG("SCT", "Section %d goes on in sub-section %u at page %u", spineIndex, loadedSubsection, pageCount);
   return true;
 }
 
-std::unique_ptr<Page> Section::loadPageFromSectionFile() {
-  if (!Storage.openFileForRead("SCT", filePath, file)) {
+bool Section::finishSectionBuild() {
+  // Sorted by hash for lookups; an id used twice leads to its first page
+  std::vector<ChapterHtmlSlimParser::AnchorPage> anchors = builder->getAnchors();
+  std::vector<uint32_t> pagePositions = builder->getPageTextPositions();
+  if (pagePositions.empty()) {
+    pagePositions.push_back(0);
+  }
+  // Parsed from the start, the chapter has met every name its elements are styled by, so the next build of it can
+  // load only the rules for those
+  if (buildCssParser && !buildResumed) {
+    builder->getCssNames().save(CssNameFilter::getPath(epub->getCachePath()), spineIndex);
+  }
+  builder.reset();
+  std::stable_sort(anchors.begin(), anchors.end(),
+                   [](const ChapterHtmlSlimParser::AnchorPage& a, const ChapterHtmlSlimParser::AnchorPage& b) {
+                     return a.hash < b.hash;
+                   });
+  anchors.erase(std::unique(anchors.begin(), anchors.end(),
+                            [](const ChapterHtmlSlimParser::AnchorPage& a,
+                               const ChapterHtmlSlimParser::AnchorPage& b) { return a.hash == b.hash; }),
+                anchors.end());
+
+  if (!finishSubsectionFile()) {
+    discardSectionBuild();
+    return false;
+  }
+
+  // The chapter's tables follow the first sub-section, whose header then gets the chapter's page count. The file
+  // stays open (and the LUT and dictionary of the last sub-section in memory) for reading pages back.
+  if (loadedSubsection != 0) {
+    tableFile = Storage.open(filePath.c_str(), O_RDWR);
+  }
+  FsFile& tables = loadedSubsection == 0 ? file : tableFile;
+  if (!tables || !tables.seek(tables.size())) {
+    LOG_ERR("SCT", "Failed to open section file for its tables");
+    discardSectionBuild();
+    return false;
+  }
+  BufferedFileWriter writer(tables);
+  anchorsOffset = writer.position();
+  anchorCount = static_cast<uint16_t>(std::min<size_t>(anchors.size(), UINT16_MAX));
+  serialization::writePod(writer, anchorCount);
+  for (uint16_t i = 0; i < anchorCount; i++) {
+    serialization::writePod(writer, anchors[i].hash);
+    serialization::writePod(writer, anchors[i].page);
+  }
+  anchors = {};
+
+  // The text position of every page follows, ascending
+  positionsOffset = writer.position();
+  for (uint16_t i = 0; i < pageCount; i++) {
+    serialization::writePod(writer, i < pagePositions.size() ? pagePositions[i] : pagePositions.back());
+  }
+  pagePositions = {};
+
+  writer.seek(PAGE_COUNT_OFFSET);
+  serialization::writePod(writer, pageCount);
+  writer.seek(ANCHORS_OFFSET_OFFSET);
+  serialization::writePod(writer, anchorsOffset);
+  if (!writer.flush()) {
+    LOG_ERR("SCT", "Failed to write section file");
+    discardSectionBuild();
+    return false;
+  }
+  tables.flush();
+  if (loadedSubsection != 0) {
+    LOG_DBG("SCT", "Section %d built in %u sub-sections", spineIndex, loadedSubsection + 1);
+  }
+  if (Storage.exists(checkpointPath.c_str())) {
+    Storage.remove(checkpointPath.c_str());
+  }
+  checkpointPageCount = 0;
+  if (buildCssParser) {
+    epub->releaseCssRules(true);
+    buildCssParser = nullptr;
+  }
+  return true;
+}
+
+std::unique_ptr<Page> Section::readPage(const int index) {
+  if (index < 0 || index >= pageCount) {
+    return nullptr;
+  }
+  const int subsection = index / SUBSECTION_PAGES;
+  if (subsection != loadedSubsection) {
+    if (builder) {
+      return readFinishedSubsectionPage(subsection, index);
+    }
+    if (!loadSubsection(subsection)) {
+      return nullptr;
+    }
+  }
+  const int lutIndex = index - subsection * SUBSECTION_PAGES;
+  if (lutIndex >= static_cast<int>(pageLut.size()) || pageLut[lutIndex] == 0) {
+    return nullptr;
+  }
+  if (!file && !Storage.openFileForRead("SCT", subsectionPath(loadedSubsection), file)) {
     return nullptr;
   }
 
-  file.seek(HEADER_SIZE - sizeof(uint32_t));
-  uint32_t lutOffset;
-  serialization::readPod(file, lutOffset);
-  file.seek(lutOffset + sizeof(uint32_t) * currentPage);
-  uint32_t pagePos;
-  serialization::readPod(file, pagePos);
-  file.seek(pagePos);
+  // While building, the file is also being appended to: the last page ends where the next write goes, and the write
+  // position is put back afterwards
+  const uint32_t writePosition = builder ? file.position() : 0;
+  const uint32_t start = pageLut[lutIndex];
+  uint32_t end = pageRecordsEnd;
+  if (lutIndex + 1 < static_cast<int>(pageLut.size())) {
+    end = pageLut[lutIndex + 1];
+  } else if (builder) {
+    end = writePosition;
+  }
+  if (end <= start || end - start > MAX_PAGE_RECORD_SIZE) {
+    LOG_ERR("SCT", "Bad record bounds for page %d: %u-%u", index, start, end);
+    return nullptr;
+  }
+  const size_t size = end - start;
+  if (pageRecord.size() < size) {
+    pageRecord.resize(size);
+  }
 
-  auto page = Page::deserialize(file);
-  file.close();
+  bool complete;
+  {
+    TRACE_SCOPE(SdRead, size);
+    complete = file.seek(start) && file.read(pageRecord.data(), size) == static_cast<int>(size);
+  }
+  if (builder) {
+    file.seek(writePosition);
+  }
+  if (!complete) {
+    LOG_ERR("SCT", "Failed to read page %d", index);
+    return nullptr;
+  }
+  return Page::deserialize(pageRecord.data(), size, dictionary);
+}
+
+// A page of a sub-section finished earlier in the build, which can't be loaded in place of the one being written.
+// Its LUT entries and dictionary are read for the page alone.
+std::unique_ptr<Page> Section::readFinishedSubsectionPage(const int subsection, const int index) {
+  FsFile input;
+  if (!Storage.openFileForRead("SCT", subsectionPath(subsection), input)) {
+    return nullptr;
+  }
+  BufferedFileReader reader(input);
+  uint16_t pages = 0;
+  uint32_t lutOffset = 0;
+  uint32_t subsectionAnchorsOffset = 0;
+  uint32_t dictionaryOffset = 0;
+  reader.seek(PAGE_COUNT_OFFSET);
+  serialization::readPod(reader, pages);
+  serialization::readPod(reader, lutOffset);
+  serialization::readPod(reader, subsectionAnchorsOffset);
+  serialization::readPod(reader, dictionaryOffset);
+
+  const uint16_t lutIndex = index - subsection * SUBSECTION_PAGES;
+  uint32_t start = 0;
+  uint32_t end = lutOffset;
+  SectionDictionary subsectionDictionary;
+  bool complete = lutIndex < pages && reader.seek(lutOffset + lutIndex * sizeof(uint32_t));
+  if (complete) {
+    serialization::readPod(reader, start);
+    if (lutIndex + 1 < pages) {
+      serialization::readPod(reader, end);
+    }
+    complete = end > start && end - start <= MAX_PAGE_RECORD_SIZE && reader.seek(dictionaryOffset) &&
+               subsectionDictionary.deserialize(reader);
+  }
+  const size_t size = end - start;
+  if (complete) {
+    if (pageRecord.size() < size) {
+      pageRecord.resize(size);
+    }
+    complete = reader.seek(start) && reader.read(pageRecord.data(), size) == static_cast<int>(size);
+  }
+  input.close();
+  if (!complete) {
+    LOG_ERR("SCT", "Failed to read page %d from sub-section %d", index, subsection);
+    return nullptr;
+  }
+  return Page::deserialize(pageRecord.data(), size, subsectionDictionary);
+}
+
+int Section::findAnchorPage(const std::string& anchor) {
+  FsFile* tables = builder || anchorCount == 0 || anchor.empty() ? nullptr : openChapterTables();
+  if (!tables) {
+    return -1;
+  }
+  const uint32_t hash = ChapterHtmlSlimParser::anchorHash(anchor.data(), anchor.size());
+  int low = 0;
+  int high = anchorCount - 1;
+  while (low <= high) {
+    const int mid = (low + high) / 2;
+    uint32_t entryHash = 0;
+    uint16_t page = 0;
+    if (!tables->seek(anchorsOffset + sizeof(anchorCount) + mid * ANCHOR_ENTRY_SIZE)) {
+      return -1;
+    }
+    serialization::readPod(*tables, entryHash);
+    serialization::readPod(*tables, page);
+    if (entryHash == hash) {
+      return page < pageCount ? page : -1;
+    }
+    if (entryHash < hash) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  return -1;
+}
+
+bool Section::getPageTextPosition(const int page, uint32_t& position) {
+  FsFile* tables = builder || positionsOffset == 0 || page < 0 || page >= pageCount ? nullptr : openChapterTables();
+  if (!tables || !tables->seek(positionsOffset + page * sizeof(uint32_t))) {
+    return false;
+  }
+  serialization::readPod(*tables, position);
+  return true;
+}
+
+int Section::findTextPositionPage(const uint32_t position) {
+  FsFile* tables = builder || positionsOffset == 0 || pageCount == 0 ? nullptr : openChapterTables();
+  if (!tables) {
+    return -1;
+  }
+  // Last page starting at or before position
+  int low = 1;
+  int high = pageCount - 1;
+  int page = 0;
+  while (low <= high) {
+    const int mid = (low + high) / 2;
+    uint32_t start = 0;
+    if (!tables->seek(positionsOffset + mid * sizeof(uint32_t))) {
+      return -1;
+    }
+    serialization::readPod(*tables, start);
+    if (start <= position) {
+      page = mid;
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
   return page;
 }
+
+std::unique_ptr<Page> Section::loadPageFromSectionFile() {
+  for (const auto& entry : pageCache) {
+    if (entry.page && entry.index == currentPage) {
+      return std::unique_ptr<Page>(new Page(*entry.page));
+    }
+  }
+
+  auto page = readPage(currentPage);
+  if (page) {
+    cachePage(currentPage, *page);
+  }
+  return page;
+}
+
+std::unique_ptr<Page> Section::peekPage(const int index) {
+  for (const auto& entry : pageCache) {
+    if (entry.page && entry.index == index) {
+      return std::unique_ptr<Page>(new Page(*entry.page));
+    }
+  }
+  return readPage(index);
+}
+
+void Section::prefetchNeighbourPages() {
+  for (const int index : {currentPage, currentPage + 1, currentPage - 1}) {
+    if (index < 0 || index >= pageCount) {
+      continue;
+    }
+    bool cached = false;
+    for (const auto& entry : pageCache) {
+      cached |= entry.page && entry.index == index;
+    }
+    if (cached) {
+      continue;
+    }
+
+    auto page = readPage(index);
+    if (!page || !cachePage(index, *page)) {
+      return;
+    }
+  }
+}
+
+bool Section::cachePage(const int index, const Page& page) {
+  if (ESP.getFreeHeap() < PAGE_CACHE_MIN_FREE_HEAP) {
+    clearPageCache();
+    return false;
+  }
+
+  // Make room by evicting whatever is furthest from the reading position, but never for a page further away
+  const size_t bytes = page.getHeapUsage();
+  const int distance = std::abs(index - currentPage);
+  CachedPage* slot;
+  while (true) {
+    slot = nullptr;
+    CachedPage* furthest = nullptr;
+    for (auto& entry : pageCache) {
+      if (!entry.page) {
+        slot = &entry;
+      } else if (!furthest || std::abs(entry.index - currentPage) > std::abs(furthest->index - currentPage)) {
+        furthest = &entry;
+      }
+    }
+    if (slot && pageCacheBytes + bytes <= PAGE_CACHE_BUDGET) {
+      break;
+    }
+    if (!furthest || std::abs(furthest->index - currentPage) <= distance) {
+      return false;
+    }
+    evictCachedPage(*furthest);
+  }
+
+  slot->index = index;
+  slot->page.reset(new Page(page));
+  slot->bytes = bytes;
+  pageCacheBytes += bytes;
+  return true;
+}
+
+void Section::evictCachedPage(CachedPage& entry) {
+  pageCacheBytes -= entry.bytes;
+  entry.page.reset();
+  entry.index = -1;
+  entry.bytes = 0;
+}
+
+void Section::clearPageCache() {
+  for (auto& entry : pageCache) {
+    evictCachedPage(entry);
+  }
+}
@@ -3,37 +3,154 @@
 #include <memory>
 
 #include "Epub.h"
+#include "SectionDictionary.h"
 
 class Page;
 class GfxRenderer;
+class ChapterHtmlSlimParser;
 
 class Section {
+ public:
+  // Layout parameters a section is built with, in the order beginSectionBuild() takes them
+  struct BuildParams {
+    int fontId;
+    float lineCompression;
+    bool extraParagraphSpacing;
+    uint8_t paragraphAlignment;
+    uint16_t viewportWidth;
+    uint16_t viewportHeight;
+    bool hyphenationEnabled;
+    bool embeddedStyle;
+  };
+
+ private:
   std::shared_ptr<Epub> epub;
   const int spineIndex;
   GfxRenderer& renderer;
+  // sections/<layout hash>/<spine index>.bin, set once the layout parameters are known
   std::string filePath;
+  // Next to it while the section is being built, see writeCheckpoint()
+  std::string checkpointPath;
+  uint32_t layoutId = 0;
+  static uint8_t maxCachedLayouts;
+  // A long chapter is split into sub-sections of a fixed number of pages, each in a file of its own (see
+  // SUBSECTION_PAGES). file, pageLut and dictionary are those of loadedSubsection, the one being written while
+  // building; the first one is the only one of a shorter chapter.
+  uint16_t loadedSubsection = 0;
+  // Kept open for the lifetime of the section once loaded or built, so a page turn is a single seek and read
   FsFile file;
+  // <spine>.bin, for the chapter's anchor and position tables while a later sub-section is loaded
+  FsFile tableFile;
+  // Page offsets into the sub-section file; filled by loadSectionFile() or page by page while building
+  std::vector<uint32_t> pageLut;
+  // End of the last page record once the file is complete (the LUT follows it)
+  uint32_t pageRecordsEnd = 0;
+  // A page record is read into this in one go; kept so page turns don't allocate it again
+  std::vector<uint8_t> pageRecord;
+  // Shared word table of the sub-section's pages; loaded with the LUT, or grown page by page while building
+  SectionDictionary dictionary;
+  // Table of the chapter's ids and their pages, sorted by id hash, right after the LUT; looked up on the SD card
+  uint32_t anchorsOffset = 0;
+  uint16_t anchorCount = 0;
+  // Text position each page starts at (ChapterHtmlSlimParser::getPageTextPositions), u32 each after the anchor
+  // table; 0 when there is none
+  uint32_t positionsOffset = 0;
+
+  // Deserialized pages around currentPage, so a page turn doesn't have to go back to the SD card. Entries are
+  // copied out on load (copies share the blocks), which keeps the cache intact when paging back and forth.
+  static constexpr int PAGE_CACHE_SLOTS = 3;
+  struct CachedPage {
+    int index = -1;
+    std::unique_ptr<Page> page;
+    size_t bytes = 0;
+  } pageCache[PAGE_CACHE_SLOTS];
+  size_t pageCacheBytes = 0;
+
+  // In-progress build state, only set between beginSectionBuild() and the build finishing or being aborted
+  std::unique_ptr<ChapterHtmlSlimParser> builder;
+  CssParser* buildCssParser = nullptr;
+  BuildParams buildParams = {};
+  int buildAttempt = 0;
+  bool buildWithExpat = false;
+  // The parser began at a checkpoint rather than at the start of the chapter
+  bool buildResumed = false;
+  // Pages of the section file the last checkpoint counts, 0 if this build has none
+  uint16_t checkpointPageCount = 0;
 
   void writeSectionFileHeader(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
                               uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled,
                               bool embeddedStyle);
-  uint32_t onPageComplete(std::unique_ptr<Page> page);
+  void selectLayout(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
+                    uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle);
+  void touchLayout() const;
+  void onPageComplete(std::unique_ptr<Page> page);
+  std::string subsectionPath(int subsection) const;
+  bool readSubsectionTables(BufferedFileReader& reader, uint16_t lutCount, uint32_t lutOffset,
+                            uint32_t dictionaryOffset);
+  bool loadSubsection(int subsection);
+  FsFile* openChapterTables();
+  void removeSubsectionFiles();
+  bool finishSubsectionFile();
+  bool startNextSubsection();
+  std::unique_ptr<Page> readPage(int index);
+  std::unique_ptr<Page> readFinishedSubsectionPage(int subsection, int index);
+  bool cachePage(int index, const Page& page);
+  void evictCachedPage(CachedPage& entry);
+  void createBuilder(const std::function<void()>& popupFn);
+  bool startBuildAttempt(const std::function<void()>& popupFn);
+  bool resumeBuildAttempt(const std::function<void()>& popupFn);
+  void writeCheckpoint();
+  bool finishSectionBuild();
+  void discardSectionBuild(bool keepCheckpoint = false);
 
  public:
   uint16_t pageCount = 0;
   int currentPage = 0;
 
-  explicit Section(const std::shared_ptr<Epub>& epub, const int spineIndex, GfxRenderer& renderer)
-      : epub(epub),
-        spineIndex(spineIndex),
-        renderer(renderer),
-        filePath(epub->getCachePath() + "/sections/" + std::to_string(spineIndex) + ".bin") {}
-  ~Section() = default;
+  explicit Section(const std::shared_ptr<Epub>& epub, int spineIndex, GfxRenderer& renderer);
+  ~Section();
+  // Each distinct set of layout parameters gets its own section cache directory, so switching back to a recently
+  // used font or orientation doesn't re-index. Beyond this many layouts per book the least recently used is removed.
+  static void setMaxCachedLayouts(uint8_t count);
+  // Parameters the section file at path was built with, e.g. to lay a book out elsewhere the way the device does;
+  // false if it can't be read or is from another version
+  static bool readBuildParams(const std::string& path, BuildParams& params);
+  // Cache directory of this section's layout; valid once loadSectionFile() or beginSectionBuild() was called
+  std::string getLayoutDir() const;
   bool loadSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
                        uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle);
-  bool clearCache() const;
+  bool clearCache();
   bool createSectionFile(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
                          uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle,
                          const std::function<void()>& popupFn = nullptr);
+
+  // Incremental build, used to index a section in small time slices (e.g. while the reader is idle).
+  // createSectionFile() is equivalent to beginSectionBuild() followed by continueSectionBuild() until it finishes.
+  enum class BuildStatus { InProgress, Done, Failed };
+  bool beginSectionBuild(int fontId, float lineCompression, bool extraParagraphSpacing, uint8_t paragraphAlignment,
+                         uint16_t viewportWidth, uint16_t viewportHeight, bool hyphenationEnabled, bool embeddedStyle,
+                         const std::function<void()>& popupFn = nullptr);
+  // Parse chunks until the build completes, timeBudgetMs elapses or at least untilPageCount pages have been laid out
+  // (0 = no limit for either). Pages finished so far can already be loaded while the build is paused, but pageCount
+  // only becomes the chapter's total once the build is Done.
+  BuildStatus continueSectionBuild(uint32_t timeBudgetMs = 0, uint16_t untilPageCount = 0);
+  // Drop an in-progress build. Its partial output is removed, unless a checkpoint was saved: the next build of the
+  // section then goes on from there, the pages up to it kept.
+  void abortSectionBuild();
+  bool isBuilding() const { return builder != nullptr; }
+  int getSpineIndex() const { return spineIndex; }
+
+  // Page the element with id anchor starts on, -1 if the chapter has no such id or is still being built
+  int findAnchorPage(const std::string& anchor);
+  // Text position the page starts at, e.g. to tell another reader where it is; false while the chapter is built
+  bool getPageTextPosition(int page, uint32_t& position);
+  // Page the character at text position is on, -1 if unknown (still building)
+  int findTextPositionPage(uint32_t position);
+
   std::unique_ptr<Page> loadPageFromSectionFile();
+  // Copy of an arbitrary page, from the page cache when it's there; leaves the cache and currentPage alone
+  std::unique_ptr<Page> peekPage(int index);
+  // Fill the page cache with currentPage and its neighbours, within the cache's byte budget (call when idle)
+  void prefetchNeighbourPages();
+  void clearPageCache();
 };
@@ -0,0 +1,126 @@
+#include "SectionDictionary.h"
+
+#include <Logging.h>
+#include <Serialization.h>
+
+namespace {
+constexpr size_t HASH_SLOT_COUNT = SectionDictionary::MAX_WORDS * 2;  // Power of two, load factor <= 0.5
+
+uint32_t fnv1a(const char* data, const size_t len) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+}  // namespace
+
+int SectionDictionary::findOrAdd(const std::string_view word) {
+  if (word.empty() || word.size() > MAX_WORD_LENGTH) {
+    return -1;
+  }
+
+  if (hashSlots.empty()) {
+    // Index whatever is already in the table (e.g. nothing, or a table being rebuilt)
+    hashSlots.assign(HASH_SLOT_COUNT, 0);
+    for (uint16_t i = 0; i < size(); i++) {
+      size_t slot = fnv1a(blob.data() + offsets[i], wordLength(i)) & (HASH_SLOT_COUNT - 1);
+      while (hashSlots[slot] != 0) {
+        slot = (slot + 1) & (HASH_SLOT_COUNT - 1);
+      }
+      hashSlots[slot] = i + 1;
+    }
+  }
+
+  size_t slot = fnv1a(word.data(), word.size()) & (HASH_SLOT_COUNT - 1);
+  while (hashSlots[slot] != 0) {
+    const uint16_t index = hashSlots[slot] - 1;
+    if (wordLength(index) == word.size() && blob.compare(offsets[index], word.size(), word) == 0) {
+      return index;
+    }
+    slot = (slot + 1) & (HASH_SLOT_COUNT - 1);
+  }
+
+  if (size() >= MAX_WORDS) {
+    return -1;
+  }
+
+  if (offsets.empty()) {
+    offsets.reserve(MAX_WORDS + 1);
+    offsets.push_back(0);
+  }
+  const uint16_t index = size();
+  blob.append(word);
+  offsets.push_back(blob.size());
+  hashSlots[slot] = index + 1;
+  return index;
+}
+
+bool SectionDictionary::getWord(const uint32_t index, std::string_view& out) const {
+  if (index >= size()) {
+    return false;
+  }
+  out = std::string_view(blob).substr(offsets[index], wordLength(index));
+  return true;
+}
+
+void SectionDictionary::clear() {
+  blob.clear();
+  blob.shrink_to_fit();
+  offsets.clear();
+  offsets.shrink_to_fit();
+  hashSlots.clear();
+  hashSlots.shrink_to_fit();
+}
+
+void SectionDictionary::releaseIndex() {
+  hashSlots.clear();
+  hashSlots.shrink_to_fit();
+}
+
+bool SectionDictionary::serialize(BufferedFileWriter& file) const {
+  const uint16_t count = size();
+  serialization::writePod(file, count);
+  for (uint16_t i = 0; i < count; i++) {
+    const uint8_t len = wordLength(i);
+    serialization::writePod(file, len);
+    if (file.write(reinterpret_cast<const uint8_t*>(blob.data() + offsets[i]), len) != len) {
+      LOG_ERR("DIC", "Failed to write word %u", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SectionDictionary::deserialize(BufferedFileReader& file) {
+  clear();
+
+  uint16_t count;
+  serialization::readPod(file, count);
+  if (count > MAX_WORDS) {
+    LOG_ERR("DIC", "Deserialization failed: word count %u exceeds maximum", count);
+    return false;
+  }
+
+  offsets.reserve(count + 1);
+  offsets.push_back(0);
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t len;
+    serialization::readPod(file, len);
+    if (len == 0 || len > MAX_WORD_LENGTH) {
+      LOG_ERR("DIC", "Deserialization failed: invalid word length %u", len);
+      clear();
+      return false;
+    }
+    const size_t start = blob.size();
+    blob.resize(start + len);
+    if (file.read(&blob[start], len) != len) {
+      LOG_ERR("DIC", "Deserialization failed: truncated word %u", i);
+      clear();
+      return false;
+    }
+    offsets.push_back(blob.size());
+  }
+  return true;
+}
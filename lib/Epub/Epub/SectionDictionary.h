@@ -0,0 +1,35 @@
+#pragma once
+#include <BufferedFile.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Per-section table of short, frequently repeated words ("the", "and", ...). Text blocks store a dictionary word as
+// a varint index instead of its bytes. The table is capped and filled first-come during the build; in natural
+// language text the first distinct short words of a chapter are largely the common ones, and the cap keeps both the
+// build-time index and the copy loaded alongside the section to a few KB.
+class SectionDictionary {
+  std::string blob;                 // All words back to back
+  std::vector<uint16_t> offsets;    // Start of each word in blob, plus a trailing end offset
+  std::vector<uint16_t> hashSlots;  // Open-addressing index (word index + 1, 0 = empty), only built while writing
+
+  uint16_t wordLength(uint16_t index) const { return offsets[index + 1] - offsets[index]; }
+
+ public:
+  static constexpr uint16_t MAX_WORDS = 512;
+  static constexpr uint8_t MAX_WORD_LENGTH = 12;
+
+  // Index of the word in the table, adding it if there is room. -1 if the word isn't (and can't be) in the table.
+  int findOrAdd(std::string_view word);
+  // Points into the table, valid until it is cleared or grows
+  bool getWord(uint32_t index, std::string_view& out) const;
+  size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  void clear();
+  // Free the lookup index once no more words will be added (findOrAdd() rebuilds it if needed)
+  void releaseIndex();
+
+  bool serialize(BufferedFileWriter& file) const;
+  bool deserialize(BufferedFileReader& file);
+};
@@ -0,0 +1,173 @@
+#include "TableLayout.h"
+
+#include <GfxRenderer.h>
+
+#include <algorithm>
+
+void TableLayout::beginRow(const uint32_t position, const uint16_t firstColumn) {
+  rows.push_back({position, firstColumn, {}, {}});
+  nextColumn = firstColumn;
+  rowOpen = true;
+}
+
+void TableLayout::beginCell(const uint8_t colspan) {
+  const uint8_t span = std::max<uint8_t>(1, std::min(colspan, MAX_COLSPAN));
+  cells.push_back({static_cast<uint16_t>(rows.size() - 1), nextColumn, span, {}});
+  nextColumn += span;
+}
+
+void TableLayout::addParagraph(std::unique_ptr<ParsedText> paragraph) {
+  if (!paragraph || paragraph->isEmpty() || cells.empty()) {
+    return;
+  }
+  wordCount += paragraph->size();
+  cells.back().paragraphs.push_back(std::move(paragraph));
+}
+
+size_t TableLayout::anchorCount() const {
+  size_t count = 0;
+  for (const auto& row : rows) {
+    count += row.anchors.size();
+  }
+  return count;
+}
+
+uint16_t TableLayout::openCellColumn() const { return cells.empty() ? 0 : cells.back().column; }
+
+void TableLayout::computeColumnWidths(const GfxRenderer& renderer, const int fontId, const uint16_t width,
+                                      const uint16_t columnCount) {
+  columnGap = 2 * renderer.getSpaceWidth(fontId, EpdFontFamily::REGULAR);
+  if (columnCount > 1 && width - (columnCount - 1) * columnGap < columnCount * columnGap) {
+    // Too many columns to spare the gaps
+    columnGap = 0;
+  }
+  const int available = width - (columnCount - 1) * columnGap;
+
+  // The narrowest a cell can be set in is its widest unbreakable run of words, the widest is its paragraphs on one
+  // line each. Single column cells set their column's bounds, spanning ones then widen the columns they span.
+  std::vector<int> minWidths(columnCount, 0);
+  std::vector<int> maxWidths(columnCount, 0);
+  struct SpanningCell {
+    uint16_t column;
+    uint16_t end;
+    int minWidth;
+    int maxWidth;
+  };
+  std::vector<SpanningCell> spanning;
+  for (const auto& cell : cells) {
+    int cellMin = 0;
+    int cellMax = 0;
+    for (const auto& paragraph : cell.paragraphs) {
+      int paragraphMin;
+      int paragraphMax;
+      paragraph->measure(renderer, fontId, paragraphMin, paragraphMax);
+      cellMin = std::max(cellMin, paragraphMin);
+      cellMax = std::max(cellMax, paragraphMax);
+    }
+    if (cell.colspan == 1) {
+      minWidths[cell.column] = std::max(minWidths[cell.column], cellMin);
+      maxWidths[cell.column] = std::max(maxWidths[cell.column], cellMax);
+    } else {
+      const auto end = static_cast<uint16_t>(std::min<int>(cell.column + cell.colspan, columnCount));
+      spanning.push_back({cell.column, end, cellMin, cellMax});
+    }
+  }
+  const auto widen = [this](std::vector<int>& widths, const SpanningCell& cell, const int needed) {
+    const int count = cell.end - cell.column;
+    int spanned = (count - 1) * columnGap;
+    for (int c = cell.column; c < cell.end; c++) {
+      spanned += widths[c];
+    }
+    if (spanned >= needed) {
+      return;
+    }
+    const int extra = needed - spanned;
+    for (int c = cell.column; c < cell.end; c++) {
+      widths[c] += extra / count + (c == cell.end - 1 ? extra % count : 0);
+    }
+  };
+  for (const auto& cell : spanning) {
+    widen(minWidths, cell, cell.minWidth);
+    widen(maxWidths, cell, cell.maxWidth);
+  }
+
+  long long sumMin = 0;
+  long long sumMax = 0;
+  for (uint16_t c = 0; c < columnCount; c++) {
+    maxWidths[c] = std::max(maxWidths[c], minWidths[c]);
+    sumMin += minWidths[c];
+    sumMax += maxWidths[c];
+  }
+
+  // Every column gets its widest when they all fit, otherwise its narrowest plus a share of the room left in
+  // proportion to how much wider it would like to be. Columns that don't fit even at their narrowest are scaled down
+  // together and their words split.
+  columnWidths.assign(columnCount, 0);
+  for (uint16_t c = 0; c < columnCount; c++) {
+    long long columnWidth;
+    if (sumMax <= available) {
+      columnWidth = maxWidths[c];
+    } else if (sumMin >= available) {
+      columnWidth = sumMin > 0 ? minWidths[c] * available / sumMin : available / columnCount;
+    } else {
+      columnWidth = minWidths[c] + (maxWidths[c] - minWidths[c]) * (available - sumMin) / (sumMax - sumMin);
+    }
+    columnWidths[c] = static_cast<uint16_t>(std::max<long long>(columnWidth, 1));
+  }
+}
+
+void TableLayout::layout(const GfxRenderer& renderer, const int fontId, const uint16_t width,
+                         const std::function<void(Row& row, std::vector<VisualLine>& lines)>& emitRow) {
+  uint16_t columnCount = 0;
+  for (const auto& cell : cells) {
+    columnCount = std::max<uint16_t>(columnCount, cell.column + cell.colspan);
+  }
+  if (columnWidths.size() < columnCount) {
+    computeColumnWidths(renderer, fontId, width, columnCount);
+  }
+
+  std::vector<int16_t> columnX(columnWidths.size() + 1, 0);
+  for (size_t c = 0; c < columnWidths.size(); c++) {
+    columnX[c + 1] = static_cast<int16_t>(columnX[c] + columnWidths[c] + columnGap);
+  }
+
+  size_t cellIndex = 0;
+  std::vector<std::vector<TextBlock::Ptr>> cellLines;
+  std::vector<int16_t> cellX;
+  for (size_t r = 0; r < rows.size(); r++) {
+    cellLines.clear();
+    cellX.clear();
+    for (; cellIndex < cells.size() && cells[cellIndex].row == r; cellIndex++) {
+      Cell& cell = cells[cellIndex];
+      const uint16_t end = cell.column + cell.colspan;
+      const int cellWidth = columnX[end] - columnX[cell.column] - columnGap;
+      cellX.push_back(columnX[cell.column]);
+      cellLines.emplace_back();
+      auto& lines = cellLines.back();
+      for (auto& paragraph : cell.paragraphs) {
+        paragraph->layoutAndExtractLines(
+            renderer, fontId, static_cast<uint16_t>(std::max(cellWidth, 1)),
+            [&lines](TextBlock::Ptr line) { lines.push_back(std::move(line)); });
+      }
+      cell.paragraphs.clear();
+    }
+
+    size_t lineCount = 0;
+    for (const auto& lines : cellLines) {
+      lineCount = std::max(lineCount, lines.size());
+    }
+    std::vector<VisualLine> visualLines(lineCount);
+    for (size_t c = 0; c < cellLines.size(); c++) {
+      for (size_t i = 0; i < cellLines[c].size(); i++) {
+        visualLines[i].push_back({cellX[c], std::move(cellLines[c][i])});
+      }
+    }
+    emitRow(rows[r], visualLines);
+  }
+
+  rows.clear();
+  cells.clear();
+  nextColumn = 0;
+  rowOpen = false;
+  wordCount = 0;
+}
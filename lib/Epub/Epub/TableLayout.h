@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "FootnoteEntry.h"
+#include "ParsedText.h"
+#include "blocks/TextBlock.h"
+
+class GfxRenderer;
+
+// Rows of a table buffered while it is parsed, and laid out once enough of them are in: the column widths come from
+// the narrowest and widest each column's cells can be set in, so the whole batch shares one set of columns instead of
+// every cell being flowed as it streams past. The cells' words are kept in the parser's table arena; a batch is
+// bounded by the word counts below, and batches after the first keep the columns of the first.
+class TableLayout {
+ public:
+  // Buffered words after which a table is laid out at the end of the next row, and within the row at the latest
+  static constexpr size_t FLUSH_WORDS = 1024;
+  static constexpr size_t MAX_BUFFERED_WORDS = 2048;
+  static constexpr uint8_t MAX_COLSPAN = 32;
+
+  struct Row {
+    uint32_t position;     // Text position the row starts at
+    uint16_t firstColumn;  // Column of the first cell, past 0 for the rest of a row that was split
+    std::vector<uint32_t> anchors;
+    std::vector<FootnoteEntry> footnotes;
+  };
+
+  // A line of one cell, at x across the table
+  struct PlacedLine {
+    int16_t x;
+    TextBlock::Ptr line;
+  };
+  using VisualLine = std::vector<PlacedLine>;
+
+  void beginRow(uint32_t position, uint16_t firstColumn = 0);
+  void endRow() { rowOpen = false; }
+  bool hasOpenRow() const { return rowOpen; }
+  void beginCell(uint8_t colspan);
+  // Appends a paragraph to the cell begun last
+  void addParagraph(std::unique_ptr<ParsedText> paragraph);
+  // Ids and footnote references are placed on the page the row's first line goes to
+  void addAnchor(const uint32_t hash) { rows.back().anchors.push_back(hash); }
+  void addFootnote(const FootnoteEntry& footnote) { rows.back().footnotes.push_back(footnote); }
+  size_t anchorCount() const;
+  // Column the cell begun last starts at, and its span
+  uint16_t openCellColumn() const;
+  uint8_t openCellSpan() const { return cells.empty() ? 1 : cells.back().colspan; }
+
+  size_t bufferedWords() const { return wordCount; }
+  bool empty() const { return rows.empty(); }
+
+  // Lays out the buffered rows in width and hands emitRow the lines of each, top to bottom, then drops them. The
+  // cells' paragraphs are gone afterwards, so their arena can be reset.
+  void layout(const GfxRenderer& renderer, int fontId, uint16_t width,
+              const std::function<void(Row& row, std::vector<VisualLine>& lines)>& emitRow);
+
+ private:
+  struct Cell {
+    uint16_t row;
+    uint16_t column;
+    uint8_t colspan;
+    std::vector<std::unique_ptr<ParsedText>> paragraphs;
+  };
+
+  std::vector<Row> rows;
+  std::vector<Cell> cells;  // In document order, across all rows
+  uint16_t nextColumn = 0;
+  bool rowOpen = false;
+  size_t wordCount = 0;
+  // Columns of the first batch, kept for the ones after it
+  std::vector<uint16_t> columnWidths;
+  int columnGap = 0;
+
+  void computeColumnWidths(const GfxRenderer& renderer, int fontId, uint16_t width, uint16_t columnCount);
+};
@@ -0,0 +1,60 @@
+#include "WordWidthCache.h"
+
+namespace {
+uint32_t wordHash(const int fontId, const uint8_t styleKey, const std::string& word) {
+  uint32_t hash = 2166136261u;
+  for (const char c : word) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  hash ^= static_cast<uint32_t>(fontId) * 2654435761u;
+  hash ^= styleKey;
+  return hash * 16777619u;
+}
+
+uint8_t makeStyleKey(const EpdFontFamily::Style style, const bool appendHyphen) {
+  return static_cast<uint8_t>(style) | (appendHyphen ? 0x80 : 0);
+}
+}  // namespace
+
+bool WordWidthCache::find(const int fontId, const EpdFontFamily::Style style, const bool appendHyphen,
+                          const std::string& word, uint16_t& width) {
+  if (word.empty() || word.size() > MAX_WORD_LENGTH) {
+    return false;
+  }
+
+  const uint8_t styleKey = makeStyleKey(style, appendHyphen);
+  const uint32_t hash = wordHash(fontId, styleKey, word);
+  for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+    const Entry& entry = entries[(hash + probe) & (SLOT_COUNT - 1)];
+    if (entry.length == 0) {
+      break;
+    }
+    if (entry.hash == hash && entry.length == word.size() && entry.fontId == fontId && entry.styleKey == styleKey) {
+      hits++;
+      width = entry.width;
+      return true;
+    }
+  }
+  misses++;
+  return false;
+}
+
+void WordWidthCache::insert(const int fontId, const EpdFontFamily::Style style, const bool appendHyphen,
+                            const std::string& word, const uint16_t width) {
+  if (word.empty() || word.size() > MAX_WORD_LENGTH) {
+    return;
+  }
+
+  const uint8_t styleKey = makeStyleKey(style, appendHyphen);
+  const uint32_t hash = wordHash(fontId, styleKey, word);
+  Entry* slot = &entries[hash & (SLOT_COUNT - 1)];
+  for (size_t probe = 0; probe < MAX_PROBES; probe++) {
+    Entry& entry = entries[(hash + probe) & (SLOT_COUNT - 1)];
+    if (entry.length == 0) {
+      slot = &entry;
+      break;
+    }
+  }
+  *slot = {hash, fontId, width, styleKey, static_cast<uint8_t>(word.size())};
+}
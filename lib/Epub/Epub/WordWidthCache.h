@@ -0,0 +1,35 @@
+#pragma once
+
+#include <EpdFontFamily.h>
+
+#include <cstdint>
+#include <string>
+
+// Advance widths of recently measured words, kept for a whole section build. Running text repeats the same words
+// over and over, and every measurement otherwise goes through the full decode/kerning/ligature walk of
+// GfxRenderer::getTextAdvanceX. Fixed size open addressing: a full probe run overwrites the home slot.
+class WordWidthCache {
+  struct Entry {
+    uint32_t hash;
+    int fontId;
+    uint16_t width;
+    uint8_t styleKey;  // Style bits plus whether a hyphen was appended
+    uint8_t length;    // 0 = empty slot
+  };
+
+  static constexpr size_t SLOT_COUNT = 256;  // Power of two
+  static constexpr size_t MAX_PROBES = 4;
+
+  Entry entries[SLOT_COUNT] = {};
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+
+ public:
+  // Words longer than this aren't cached (they rarely repeat)
+  static constexpr size_t MAX_WORD_LENGTH = 255;
+
+  bool find(int fontId, EpdFontFamily::Style style, bool appendHyphen, const std::string& word, uint16_t& width);
+  void insert(int fontId, EpdFontFamily::Style style, bool appendHyphen, const std::string& word, uint16_t width);
+  uint32_t getHits() const { return hits; }
+  uint32_t getMisses() const { return misses; }
+};
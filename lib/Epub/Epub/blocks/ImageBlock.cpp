@@ -1,21 +1,53 @@
 #include "ImageBlock.h"
 
+#include <Arduino.h>
 #include <GfxRenderer.h>
+#include <HalDisplay.h>
 #include <Logging.h>
+#include <MemoryReader.h>
+#include <PackBits.h>
 #include <Serialization.h>
+#include <ZipFile.h>
 
-#include "../converters/DitherUtils.h"
-#include "../converters/ImageDecoderFactory.h"
+#include <cstring>
 
-// Cache file format:
-// - uint16_t width
-// - uint16_t height
-// - uint8_t pixels[...] - 2 bits per pixel, packed (4 pixels per byte), row-major order
+#include "../converters/ImageDecoderFactory.h"
+#include "../converters/ImageSource.h"
+#include "../converters/PixelCache.h"
+
+ImageBlock::ImageBlock(const std::string& imagePath, int16_t width, int16_t height, std::string archivePath,
+                       std::string entryPath)
+    : imagePath(imagePath),
+      archivePath(std::move(archivePath)),
+      entryPath(std::move(entryPath)),
+      width(width),
+      height(height) {}
+
+ImageBlock::~ImageBlock() { setPixelRetention(false); }
+
+void ImageBlock::setPixelRetention(const bool retain) {
+  retainPixels = retain;
+  if (!retain && retainedSlabs) {
+    free(retainedSlabs);
+    retainedSlabs = nullptr;
+    retainedSize = 0;
+    retainedSlabCount = 0;
+    retainedFlags = 0;
+  }
+}
 
-ImageBlock::ImageBlock(const std::string& imagePath, int16_t width, int16_t height)
-    : imagePath(imagePath), width(width), height(height) {}
+bool ImageBlock::imageExists() const {
+  return Storage.exists(archivePath.empty() ? imagePath.c_str() : archivePath.c_str());
+}
 
-bool ImageBlock::imageExists() const { return Storage.exists(imagePath.c_str()); }
+std::unique_ptr<ImageSource> ImageBlock::openSource() const {
+  if (archivePath.empty()) {
+    return ImageSource::open(imagePath);
+  }
+  // imagePath lives in the book's cache directory, next to the archive's central directory index
+  const std::string cacheDir = imagePath.substr(0, imagePath.rfind('/'));
+  return ImageSource::open(entryPath, archivePath, ZipFile::getIndexPath(cacheDir));
+}
 
 namespace {
 
@@ -28,70 +60,233 @@ std::string getCachePath(const std::string& imagePath) {
   return imagePath + ".pxc";
 }
 
-bool renderFromCache(GfxRenderer& renderer, const std::string& cachePath, int x, int y, int expectedWidth,
-                     int expectedHeight) {
-  FsFile cacheFile;
-  if (!Storage.openFileForRead("IMG", cachePath, cacheFile)) {
-    return false;
+// Retained slabs are only kept while this much heap stays free beside them
+constexpr size_t RETAINED_PIXELS_MIN_FREE_HEAP = 64 * 1024;
+// A slab covers at most a physical row of bytes or a physical column
+constexpr size_t MAX_SLAB_BYTES = HalDisplay::DISPLAY_HEIGHT;
+
+// Slabs are read from the cache file, or from its contents kept in RAM
+struct SlabSource {
+  FsFile* file = nullptr;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  size_t pos = 0;
+
+  bool read(void* dst, const size_t n) {
+    if (file) return file->read(static_cast<uint8_t*>(dst), n) == static_cast<int>(n);
+    if (pos + n > size) return false;
+    memcpy(dst, data + pos, n);
+    pos += n;
+    return true;
   }
 
-  uint16_t cachedWidth, cachedHeight;
-  if (cacheFile.read(&cachedWidth, 2) != 2 || cacheFile.read(&cachedHeight, 2) != 2) {
-    cacheFile.close();
+  bool skip(const size_t n) {
+    if (file) return file->seekCur(n);
+    pos += n;
+    return pos <= size;
+  }
+};
+
+// Draws the plane of the current render pass from each slab: a masked copy into the frame buffer, no per-pixel work
+bool drawSlabs(const GfxRenderer& renderer, SlabSource& source, const uint16_t slabCount, const uint8_t flags) {
+  uint8_t plane;
+  bool state;
+  switch (renderer.getRenderMode()) {
+    case GfxRenderer::BW:
+      plane = 0;
+      state = true;
+      if (flags & PIXEL_CACHE_HAS_GRAY) {
+        renderer.markGrayPixelDrawn();
+      }
+      break;
+    case GfxRenderer::GRAYSCALE_LSB:
+      plane = 1;
+      state = false;
+      break;
+    case GfxRenderer::GRAYSCALE_MSB:
+      plane = 2;
+      state = false;
+      break;
+    default:
+      return true;  // Images draw nothing in the other passes
+  }
+
+  uint8_t packed[PackBits::maxPackedSize(MAX_SLAB_BYTES)];
+  uint8_t mask[MAX_SLAB_BYTES];
+  for (uint16_t i = 0; i < slabCount; i++) {
+    uint16_t start, count;
+    int16_t step;
+    uint16_t packedSizes[PIXEL_CACHE_PLANES];
+    if (!source.read(&start, 2) || !source.read(&step, 2) || !source.read(&count, 2) ||
+        !source.read(packedSizes, sizeof(packedSizes)) || count > MAX_SLAB_BYTES ||
+        packedSizes[plane] > sizeof(packed)) {
+      LOG_ERR("IMG", "Corrupt cache slab %u", i);
+      return false;
+    }
+
+    size_t before = 0;
+    size_t after = 0;
+    for (uint8_t p = 0; p < PIXEL_CACHE_PLANES; p++) {
+      if (p < plane) before += packedSizes[p];
+      if (p > plane) after += packedSizes[p];
+    }
+    if (!source.skip(before) || !source.read(packed, packedSizes[plane]) ||
+        !PackBits::unpack(packed, packedSizes[plane], mask, count) || !source.skip(after)) {
+      LOG_ERR("IMG", "Cache read error at slab %u", i);
+      return false;
+    }
+    renderer.drawByteMask(start, step, mask, count, state);
+  }
+  return true;
+}
+
+struct CacheHeader {
+  uint16_t width;
+  uint16_t height;
+  uint8_t flags;
+  uint16_t slabCount;
+};
+
+// Reads the header of an open pixel cache file; false unless it is a v2 cache laid out for this image at (x, y)
+bool readCacheHeader(FsFile& cacheFile, const GfxRenderer& renderer, const int x, const int y, const int expectedWidth,
+                     const int expectedHeight, CacheHeader& header) {
+  uint32_t magic;
+  uint8_t orientation;
+  int16_t cachedX, cachedY;
+  serialization::readPod(cacheFile, magic);
+  serialization::readPod(cacheFile, header.width);
+  serialization::readPod(cacheFile, header.height);
+  serialization::readPod(cacheFile, orientation);
+  serialization::readPod(cacheFile, header.flags);
+  serialization::readPod(cacheFile, cachedX);
+  serialization::readPod(cacheFile, cachedY);
+  serialization::readPod(cacheFile, header.slabCount);
+  if (magic != PIXEL_CACHE_MAGIC || cacheFile.size() < PIXEL_CACHE_HEADER_SIZE) {
+    // Older 2-bit cache; decoding again replaces it
     return false;
   }
 
   // Verify dimensions are close (allow 1 pixel tolerance for rounding differences)
-  int widthDiff = abs(cachedWidth - expectedWidth);
-  int heightDiff = abs(cachedHeight - expectedHeight);
+  int widthDiff = abs(header.width - expectedWidth);
+  int heightDiff = abs(header.height - expectedHeight);
   if (widthDiff > 1 || heightDiff > 1) {
-    LOG_ERR("IMG", "Cache dimension mismatch: %dx%d vs %dx%d", cachedWidth, cachedHeight, expectedWidth,
+    LOG_ERR("IMG", "Cache dimension mismatch: %dx%d vs %dx%d", header.width, header.height, expectedWidth,
             expectedHeight);
-    cacheFile.close();
     return false;
   }
+  // The planes are laid out for one frame buffer position
+  if (orientation != renderer.getOrientation() || cachedX != x || cachedY != y) {
+    LOG_DBG("IMG", "Cache laid out for %d,%d orientation %d, decoding again", cachedX, cachedY, orientation);
+    return false;
+  }
+  return true;
+}
 
-  // Use cached dimensions for rendering (they're the actual decoded size)
-  expectedWidth = cachedWidth;
-  expectedHeight = cachedHeight;
-
-  LOG_DBG("IMG", "Loading from cache: %s (%dx%d)", cachePath.c_str(), cachedWidth, cachedHeight);
+// Renders the pixel cache file. With `retained` set, the slabs are read in one go and handed over to the caller (if
+// the heap allows) instead of being streamed one by one.
+bool renderFromCache(const GfxRenderer& renderer, const std::string& cachePath, int x, int y, int expectedWidth,
+                     int expectedHeight, uint8_t** retained, size_t* retainedSize, uint16_t* retainedSlabCount,
+                     uint8_t* retainedFlags) {
+  FsFile cacheFile;
+  if (!Storage.openFileForRead("IMG", cachePath, cacheFile)) {
+    return false;
+  }
 
-  // Read and render row by row to minimize memory usage
-  const int bytesPerRow = (cachedWidth + 3) / 4;  // 2 bits per pixel, 4 pixels per byte
-  uint8_t* rowBuffer = (uint8_t*)malloc(bytesPerRow);
-  if (!rowBuffer) {
-    LOG_ERR("IMG", "Failed to allocate row buffer");
+  CacheHeader header;
+  if (!readCacheHeader(cacheFile, renderer, x, y, expectedWidth, expectedHeight, header)) {
     cacheFile.close();
     return false;
   }
-
-  for (int row = 0; row < cachedHeight; row++) {
-    if (cacheFile.read(rowBuffer, bytesPerRow) != bytesPerRow) {
-      LOG_ERR("IMG", "Cache read error at row %d", row);
-      free(rowBuffer);
+  LOG_DBG("IMG", "Loading from cache: %s (%dx%d)", cachePath.c_str(), header.width, header.height);
+
+  const size_t slabBytes = cacheFile.size() - PIXEL_CACHE_HEADER_SIZE;
+  if (retained && ESP.getFreeHeap() >= slabBytes + RETAINED_PIXELS_MIN_FREE_HEAP) {
+    auto* slabs = static_cast<uint8_t*>(malloc(slabBytes));
+    if (slabs) {
+      if (cacheFile.read(slabs, slabBytes) != static_cast<int>(slabBytes)) {
+        LOG_ERR("IMG", "Cache read error");
+        free(slabs);
+        cacheFile.close();
+        return false;
+      }
       cacheFile.close();
-      return false;
-    }
-
-    int destY = y + row;
-    for (int col = 0; col < cachedWidth; col++) {
-      int byteIdx = col / 4;
-      int bitShift = 6 - (col % 4) * 2;  // MSB first within byte
-      uint8_t pixelValue = (rowBuffer[byteIdx] >> bitShift) & 0x03;
-
-      drawPixelWithRenderMode(renderer, x + col, destY, pixelValue);
+      SlabSource source;
+      source.data = slabs;
+      source.size = slabBytes;
+      if (!drawSlabs(renderer, source, header.slabCount, header.flags)) {
+        free(slabs);
+        return false;
+      }
+      *retained = slabs;
+      *retainedSize = slabBytes;
+      *retainedSlabCount = header.slabCount;
+      *retainedFlags = header.flags;
+      LOG_DBG("IMG", "Cache render complete, keeping %zu bytes of slabs", slabBytes);
+      return true;
     }
   }
 
-  free(rowBuffer);
+  SlabSource source;
+  source.file = &cacheFile;
+  const bool drawn = drawSlabs(renderer, source, header.slabCount, header.flags);
   cacheFile.close();
-  LOG_DBG("IMG", "Cache render complete");
-  return true;
+  if (drawn) {
+    LOG_DBG("IMG", "Cache render complete");
+  }
+  return drawn;
+}
+
+RenderConfig makeDecodeConfig(const int x, const int y, const int width, const int height,
+                              const std::string& cachePath) {
+  RenderConfig config;
+  config.x = x;
+  config.y = y;
+  config.maxWidth = width;
+  config.maxHeight = height;
+  config.useGrayscale = true;
+  config.useDithering = true;
+  config.performanceMode = false;
+  config.useExactDimensions = true;  // Use pre-calculated dimensions to avoid rounding mismatches
+  config.cachePath = cachePath;      // Enable caching during decode
+  return config;
 }
 
 }  // namespace
 
+ImageBlock::CacheStatus ImageBlock::buildCache(GfxRenderer& renderer, const int x, const int y,
+                                               const std::function<bool()>& shouldAbort) const {
+  if (x < 0 || y < 0 || x + width > renderer.getScreenWidth() || y + height > renderer.getScreenHeight()) {
+    return CacheStatus::Failed;
+  }
+
+  const std::string cachePath = getCachePath(imagePath);
+  FsFile cacheFile;
+  if (Storage.openFileForRead("IMG", cachePath, cacheFile)) {
+    CacheHeader header;
+    const bool ready = readCacheHeader(cacheFile, renderer, x, y, width, height, header);
+    cacheFile.close();
+    if (ready) {
+      return CacheStatus::Ready;
+    }
+  }
+
+  ImageToFramebufferDecoder* decoder = ImageDecoderFactory::getDecoder(imagePath);
+  const auto source = decoder ? openSource() : nullptr;
+  if (!source) {
+    return CacheStatus::Failed;
+  }
+
+  LOG_DBG("IMG", "Pre-decoding %s", imagePath.c_str());
+  RenderConfig config = makeDecodeConfig(x, y, width, height, cachePath);
+  config.cacheOnly = true;
+  bool aborted = false;
+  config.shouldAbort = [&aborted, &shouldAbort] { return aborted = aborted || (shouldAbort && shouldAbort()); };
+  if (decoder->decodeToFramebuffer(*source, renderer, config)) {
+    return CacheStatus::Built;
+  }
+  return aborted ? CacheStatus::Aborted : CacheStatus::Failed;
+}
+
 void ImageBlock::render(GfxRenderer& renderer, const int x, const int y) {
   LOG_DBG("IMG", "Rendering image at %d,%d: %s (%dx%d)", x, y, imagePath.c_str(), width, height);
 
@@ -105,39 +300,37 @@ void ImageBlock::render(GfxRenderer& renderer, const int x, const int y) {
     return;
   }
 
+  // Slabs kept from an earlier pass of this page turn
+  if (retainedSlabs) {
+    SlabSource source;
+    source.data = retainedSlabs;
+    source.size = retainedSize;
+    drawSlabs(renderer, source, retainedSlabCount, retainedFlags);
+    return;
+  }
+
   // Try to render from cache first
   std::string cachePath = getCachePath(imagePath);
-  if (renderFromCache(renderer, cachePath, x, y, width, height)) {
+  if (renderFromCache(renderer, cachePath, x, y, width, height, retainPixels ? &retainedSlabs : nullptr,
+                      &retainedSize, &retainedSlabCount, &retainedFlags)) {
     return;  // Successfully rendered from cache
   }
 
   // No cache - need to decode the image
-  // Check if image file exists
-  FsFile file;
-  if (!Storage.openFileForRead("IMG", imagePath, file)) {
-    LOG_ERR("IMG", "Image file not found: %s", imagePath.c_str());
+  const auto source = openSource();
+  if (!source) {
+    LOG_ERR("IMG", "Image not found: %s", imagePath.c_str());
     return;
   }
-  size_t fileSize = file.size();
-  file.close();
 
-  if (fileSize == 0) {
-    LOG_ERR("IMG", "Image file is empty: %s", imagePath.c_str());
+  if (source->size() == 0) {
+    LOG_ERR("IMG", "Image is empty: %s", imagePath.c_str());
     return;
   }
 
   LOG_DBG("IMG", "Decoding and caching: %s", imagePath.c_str());
 
-  RenderConfig config;
-  config.x = x;
-  config.y = y;
-  config.maxWidth = width;
-  config.maxHeight = height;
-  config.useGrayscale = true;
-  config.useDithering = true;
-  config.performanceMode = false;
-  config.useExactDimensions = true;  // Use pre-calculated dimensions to avoid rounding mismatches
-  config.cachePath = cachePath;      // Enable caching during decode
+  const RenderConfig config = makeDecodeConfig(x, y, width, height, cachePath);
 
   ImageToFramebufferDecoder* decoder = ImageDecoderFactory::getDecoder(imagePath);
   if (!decoder) {
@@ -147,7 +340,7 @@ void ImageBlock::render(GfxRenderer& renderer, const int x, const int y) {
 
   LOG_DBG("IMG", "Using %s decoder", decoder->getFormatName());
 
-  bool success = decoder->decodeToFramebuffer(imagePath, renderer, config);
+  bool success = decoder->decodeToFramebuffer(*source, renderer, config);
   if (!success) {
     LOG_ERR("IMG", "Failed to decode image: %s", imagePath.c_str());
     return;
@@ -156,18 +349,23 @@ void ImageBlock::render(GfxRenderer& renderer, const int x, const int y) {
   LOG_DBG("IMG", "Decode successful");
 }
 
-bool ImageBlock::serialize(FsFile& file) {
+bool ImageBlock::serialize(BufferedFileWriter& file) {
   serialization::writeString(file, imagePath);
   serialization::writePod(file, width);
   serialization::writePod(file, height);
+  serialization::writeString(file, archivePath);
+  serialization::writeString(file, entryPath);
   return true;
 }
 
-std::unique_ptr<ImageBlock> ImageBlock::deserialize(FsFile& file) {
+std::unique_ptr<ImageBlock> ImageBlock::deserialize(MemoryReader& record) {
   std::string path;
-  serialization::readString(file, path);
+  serialization::readString(record, path);
   int16_t w, h;
-  serialization::readPod(file, w);
-  serialization::readPod(file, h);
-  return std::unique_ptr<ImageBlock>(new ImageBlock(path, w, h));
+  serialization::readPod(record, w);
+  serialization::readPod(record, h);
+  std::string archive, entry;
+  serialization::readString(record, archive);
+  serialization::readString(record, entry);
+  return std::unique_ptr<ImageBlock>(new ImageBlock(path, w, h, std::move(archive), std::move(entry)));
 }
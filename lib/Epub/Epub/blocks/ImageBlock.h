@@ -1,31 +1,61 @@
 #pragma once
-#include <HalStorage.h>
+#include <BufferedFile.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 
 #include "Block.h"
 
+class ImageSource;
+class MemoryReader;
+
 class ImageBlock final : public Block {
  public:
-  ImageBlock(const std::string& imagePath, int16_t width, int16_t height);
-  ~ImageBlock() override = default;
+  // imagePath names the image (its format and pixel cache path). With archivePath set the bytes are read in place
+  // from entryPath inside that ZIP; otherwise imagePath is a file on the SD card.
+  ImageBlock(const std::string& imagePath, int16_t width, int16_t height, std::string archivePath = "",
+             std::string entryPath = "");
+  ~ImageBlock() override;
+  ImageBlock(const ImageBlock&) = delete;
+  ImageBlock& operator=(const ImageBlock&) = delete;
 
   const std::string& getImagePath() const { return imagePath; }
   int16_t getWidth() const { return width; }
   int16_t getHeight() const { return height; }
 
   bool imageExists() const;
+  size_t getHeapUsage() const {
+    return sizeof(ImageBlock) + imagePath.capacity() + archivePath.capacity() + entryPath.capacity();
+  }
 
   BlockType getType() override { return IMAGE_BLOCK; }
   bool isEmpty() override { return false; }
 
   void render(GfxRenderer& renderer, const int x, const int y);
-  bool serialize(FsFile& file);
-  static std::unique_ptr<ImageBlock> deserialize(FsFile& file);
+  // While retention is on, the cached image planes are kept in RAM after the first render, so the other render passes
+  // of the same page turn (BW, LSB and MSB planes) don't read the pixel cache from the SD card again. Turning it off
+  // frees them.
+  void setPixelRetention(bool retain);
+  // Decode the image into its pixel cache for rendering at (x, y), without drawing it, unless a matching cache is
+  // already there. shouldAbort is polled during the decode; an abandoned decode leaves no cache file.
+  enum class CacheStatus { Ready, Built, Aborted, Failed };
+  CacheStatus buildCache(GfxRenderer& renderer, int x, int y, const std::function<bool()>& shouldAbort) const;
+  bool serialize(BufferedFileWriter& file);
+  static std::unique_ptr<ImageBlock> deserialize(MemoryReader& record);
 
  private:
   std::string imagePath;
+  std::string archivePath;
+  std::string entryPath;
   int16_t width;
   int16_t height;
+  bool retainPixels = false;
+  // Slabs of the .pxc file, while retained
+  uint8_t* retainedSlabs = nullptr;
+  size_t retainedSize = 0;
+  uint16_t retainedSlabCount = 0;
+  uint8_t retainedFlags = 0;
+
+  std::unique_ptr<ImageSource> openSource() const;
 };
@@ -2,8 +2,120 @@
 
 #include <GfxRenderer.h>
 #include <Logging.h>
+#include <MemoryReader.h>
 #include <Serialization.h>
 
+#include <algorithm>
+#include <cstring>
+
+#include "../SectionDictionary.h"
+
+namespace {
+// Upper bound for a literal word on read; the parser splits words at 200 bytes
+constexpr uint32_t MAX_LITERAL_WORD_LENGTH = 1024;
+// Same bound for the glyphs of a shaped word, which has at most one per codepoint
+constexpr uint32_t MAX_WORD_GLYPHS = MAX_LITERAL_WORD_LENGTH;
+
+uint32_t zigzagEncode(const int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+int32_t zigzagDecode(const uint32_t value) { return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1))); }
+
+// Room for a word in the arena, with the NUL render() relies on already in place
+char* allocateWord(BumpArena& arena, const size_t length) {
+  auto* word = static_cast<char*>(arena.allocate(length + 1, 1));
+  word[length] = '\0';
+  return word;
+}
+}  // namespace
+
+TextBlock::TextBlock(BumpArena* arena)
+    : words(ArenaAllocator<std::string_view>(arena)),
+      text(ArenaAllocator<char>(arena)),
+      wordXpos(ArenaAllocator<uint16_t>(arena)),
+      wordStyles(ArenaAllocator<EpdFontFamily::Style>(arena)),
+      glyphs(ArenaAllocator<GfxRenderer::ShapedGlyph>(arena)),
+      wordGlyphEnds(ArenaAllocator<uint16_t>(arena)) {}
+
+void TextBlock::Deleter::operator()(TextBlock* block) const {
+  if (!block->inArena()) {
+    delete block;
+  }
+}
+
+TextBlock::Ptr TextBlock::create(BumpArena* arena, const size_t wordCount, const size_t textBytes,
+                                 const BlockStyle& blockStyle) {
+  auto* block = arena ? new (arena->allocate(sizeof(TextBlock), alignof(TextBlock))) TextBlock(arena)
+                      : new TextBlock(nullptr);
+  block->blockStyle = blockStyle;
+  block->words.reserve(wordCount);
+  block->text.reserve(textBytes);
+  block->wordXpos.reserve(wordCount);
+  block->wordStyles.reserve(wordCount);
+  return Ptr(block);
+}
+
+bool TextBlock::addWord(const char* word, const size_t length, const bool appendHyphen, const uint16_t x,
+                        const EpdFontFamily::Style style) {
+  // The words already in point into text, which mustn't grow past what was reserved
+  if (text.size() + length + 2 > text.capacity()) {
+    LOG_ERR("TXB", "No room for a word of %u bytes", static_cast<unsigned>(length));
+    return false;
+  }
+  const size_t start = text.size();
+  for (size_t i = 0; i < length; i++) {
+    // Soft hyphens (U+00AD) are dropped so rendered glyphs match measured widths
+    if (static_cast<uint8_t>(word[i]) == 0xC2 && i + 1 < length && static_cast<uint8_t>(word[i + 1]) == 0xAD) {
+      i++;
+      continue;
+    }
+    text.push_back(word[i]);
+  }
+  if (appendHyphen) {
+    text.push_back('-');
+  }
+  text.push_back('\0');
+  words.emplace_back(text.data() + start, text.size() - start - 1);
+  wordXpos.push_back(x);
+  wordStyles.push_back(style);
+  return true;
+}
+
+TextBlock::Ptr TextBlock::copy(BumpArena* arena) const {
+  size_t textBytes = 0;
+  for (const auto& word : words) {
+    textBytes += word.size() + 2;
+  }
+  Ptr block = create(arena, words.size(), textBytes, blockStyle);
+  for (size_t i = 0; i < words.size() && i < wordXpos.size() && i < wordStyles.size(); i++) {
+    block->addWord(words[i].data(), words[i].size(), false, wordXpos[i], wordStyles[i]);
+  }
+  block->glyphs.assign(glyphs.begin(), glyphs.end());
+  block->wordGlyphEnds.assign(wordGlyphEnds.begin(), wordGlyphEnds.end());
+  return block;
+}
+
+bool TextBlock::shape(const GfxRenderer& renderer, const int fontId) {
+  if (words.size() != wordStyles.size()) {
+    return false;
+  }
+  // The renderer shapes into a plain vector
+  std::vector<GfxRenderer::ShapedGlyph> shaped;
+  glyphs.clear();
+  wordGlyphEnds.clear();
+  wordGlyphEnds.reserve(words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    if (!renderer.shapeText(fontId, words[i].data(), wordStyles[i], shaped) || shaped.size() > UINT16_MAX) {
+      wordGlyphEnds.clear();
+      return false;
+    }
+    wordGlyphEnds.push_back(static_cast<uint16_t>(shaped.size()));
+  }
+  glyphs.assign(shaped.begin(), shaped.end());
+  return true;
+}
+
 void TextBlock::render(const GfxRenderer& renderer, const int fontId, const int x, const int y) const {
   // Validate iterator bounds before rendering
   if (words.size() != wordXpos.size() || words.size() != wordStyles.size()) {
@@ -12,14 +124,20 @@ void TextBlock::render(const GfxRenderer& renderer, const int fontId, const int
     return;
   }
 
+  const bool shaped = isShaped() && wordGlyphEnds.size() == words.size();
   for (size_t i = 0; i < words.size(); i++) {
     const int wordX = wordXpos[i] + x;
     const EpdFontFamily::Style currentStyle = wordStyles[i];
-    renderer.drawText(fontId, wordX, y, words[i].c_str(), true, currentStyle);
+    if (shaped) {
+      const size_t first = i > 0 ? wordGlyphEnds[i - 1] : 0;
+      renderer.drawShapedText(fontId, wordX, y, glyphs.data() + first, wordGlyphEnds[i] - first, true, currentStyle);
+    } else {
+      renderer.drawText(fontId, wordX, y, words[i].data(), true, currentStyle);
+    }
 
     if ((currentStyle & EpdFontFamily::UNDERLINE) != 0) {
-      const std::string& w = words[i];
-      const int fullWordWidth = renderer.getTextWidth(fontId, w.c_str(), currentStyle);
+      const std::string_view w = words[i];
+      const int fullWordWidth = renderer.getTextWidth(fontId, w.data(), currentStyle);
       // y is the top of the text line; add ascender to reach baseline, then offset 2px below
       const int underlineY = y + renderer.getFontAscenderSize(fontId) + 2;
 
@@ -29,7 +147,7 @@ void TextBlock::render(const GfxRenderer& renderer, const int fontId, const int
       // if word starts with em-space ("\xe2\x80\x83"), account for the additional indent before drawing the line
       if (w.size() >= 3 && static_cast<uint8_t>(w[0]) == 0xE2 && static_cast<uint8_t>(w[1]) == 0x80 &&
           static_cast<uint8_t>(w[2]) == 0x83) {
-        const char* visiblePtr = w.c_str() + 3;
+        const char* visiblePtr = w.data() + 3;
         const int prefixWidth = renderer.getTextAdvanceX(fontId, "\xe2\x80\x83", currentStyle);
         const int visibleWidth = renderer.getTextWidth(fontId, visiblePtr, currentStyle);
         startX = wordX + prefixWidth;
@@ -41,19 +159,63 @@ void TextBlock::render(const GfxRenderer& renderer, const int fontId, const int
   }
 }
 
-bool TextBlock::serialize(FsFile& file) const {
+size_t TextBlock::getHeapUsage() const {
+  if (inArena()) {
+    return 0;
+  }
+  return sizeof(TextBlock) + words.capacity() * sizeof(std::string_view) + text.capacity() +
+         wordXpos.capacity() * sizeof(uint16_t) + wordStyles.capacity() * sizeof(EpdFontFamily::Style) +
+         glyphs.capacity() * sizeof(GfxRenderer::ShapedGlyph) + wordGlyphEnds.capacity() * sizeof(uint16_t);
+}
+
+bool TextBlock::serialize(BufferedFileWriter& file, SectionDictionary& dictionary) const {
   if (words.size() != wordXpos.size() || words.size() != wordStyles.size()) {
     LOG_ERR("TXB", "Serialization failed: size mismatch (words=%u, xpos=%u, styles=%u)\n", words.size(),
             wordXpos.size(), wordStyles.size());
     return false;
   }
 
-  // Word data
-  serialization::writePod(file, static_cast<uint16_t>(words.size()));
-  for (const auto& w : words) serialization::writeString(file, w);
-  for (auto x : wordXpos) serialization::writePod(file, x);
+  // Word data. Each word is a varint: (dictionary index << 1) | 1, or (byte length << 1) followed by the bytes.
+  serialization::writeVarint(file, words.size());
+  for (const auto& w : words) {
+    const int index = dictionary.findOrAdd(w);
+    if (index >= 0) {
+      serialization::writeVarint(file, (static_cast<uint32_t>(index) << 1) | 1);
+    } else {
+      serialization::writeVarint(file, static_cast<uint32_t>(w.size()) << 1);
+      file.write(reinterpret_cast<const uint8_t*>(w.data()), w.size());
+    }
+  }
+  // X positions as zigzag varint deltas from the previous word (mostly one byte)
+  int32_t prevX = 0;
+  for (auto x : wordXpos) {
+    serialization::writeVarint(file, zigzagEncode(static_cast<int32_t>(x) - prevX));
+    prevX = x;
+  }
   for (auto s : wordStyles) serialization::writePod(file, s);
 
+  // Shaped glyphs, if any. Per word a glyph count, then per glyph a varint (glyph index << 1) | has raise, the zigzag
+  // delta from the previous glyph's x within the word and the raise byte if flagged.
+  const bool shaped = isShaped() && wordGlyphEnds.size() == words.size();
+  serialization::writePod(file, static_cast<uint8_t>(shaped));
+  if (shaped) {
+    size_t first = 0;
+    for (const uint16_t end : wordGlyphEnds) {
+      serialization::writeVarint(file, end - first);
+      int32_t prevGlyphX = 0;
+      for (size_t g = first; g < end; g++) {
+        const auto& glyph = glyphs[g];
+        serialization::writeVarint(file, (static_cast<uint32_t>(glyph.glyphIndex) << 1) | (glyph.raise != 0));
+        serialization::writeVarint(file, zigzagEncode(glyph.x - prevGlyphX));
+        if (glyph.raise != 0) {
+          serialization::writePod(file, glyph.raise);
+        }
+        prevGlyphX = glyph.x;
+      }
+      first = end;
+    }
+  }
+
   // Style (alignment + margins/padding/indent)
   serialization::writePod(file, blockStyle.alignment);
   serialization::writePod(file, blockStyle.textAlignDefined);
@@ -71,44 +233,119 @@ bool TextBlock::serialize(FsFile& file) const {
   return true;
 }
 
-std::unique_ptr<TextBlock> TextBlock::deserialize(FsFile& file) {
-  uint16_t wc;
-  std::vector<std::string> words;
-  std::vector<uint16_t> wordXpos;
-  std::vector<EpdFontFamily::Style> wordStyles;
-  BlockStyle blockStyle;
+TextBlock* TextBlock::deserialize(MemoryReader& record, const SectionDictionary& dictionary, BumpArena& arena) {
+  uint32_t wc;
+  auto* block = new (arena.allocate(sizeof(TextBlock), alignof(TextBlock))) TextBlock(&arena);
 
   // Word count
-  serialization::readPod(file, wc);
+  if (!serialization::readVarint(record, wc)) {
+    LOG_ERR("TXB", "Deserialization failed: unreadable word count");
+    return nullptr;
+  }
 
-  // Sanity check: prevent allocation of unreasonably large vectors (max 10000 words per block)
-  if (wc > 10000) {
+  // Sanity check: each word takes at least three bytes of the record, which also bounds the vectors below
+  if (wc > 10000 || wc * 3 > record.remaining()) {
     LOG_ERR("TXB", "Deserialization failed: word count %u exceeds maximum", wc);
     return nullptr;
   }
 
   // Word data
+  auto& words = block->words;
   words.resize(wc);
-  wordXpos.resize(wc);
-  wordStyles.resize(wc);
-  for (auto& w : words) serialization::readString(file, w);
-  for (auto& x : wordXpos) serialization::readPod(file, x);
-  for (auto& s : wordStyles) serialization::readPod(file, s);
+  block->wordXpos.resize(wc);
+  block->wordStyles.resize(wc);
+  size_t textBytes = 0;
+  for (auto& w : words) {
+    uint32_t tag;
+    if (!serialization::readVarint(record, tag)) {
+      LOG_ERR("TXB", "Deserialization failed: unreadable word");
+      return nullptr;
+    }
+    if (tag & 1) {
+      std::string_view word;
+      if (!dictionary.getWord(tag >> 1, word)) {
+        LOG_ERR("TXB", "Deserialization failed: unknown dictionary word %u", tag >> 1);
+        return nullptr;
+      }
+      char* copy = allocateWord(arena, word.size());
+      memcpy(copy, word.data(), word.size());
+      w = std::string_view(copy, word.size());
+      textBytes += word.size();
+      continue;
+    }
+    const uint32_t len = tag >> 1;
+    if (len > MAX_LITERAL_WORD_LENGTH) {
+      LOG_ERR("TXB", "Deserialization failed: word length %u exceeds maximum", len);
+      return nullptr;
+    }
+    if (len > record.remaining()) {
+      LOG_ERR("TXB", "Deserialization failed: truncated word");
+      return nullptr;
+    }
+    char* copy = allocateWord(arena, len);
+    record.read(copy, len);
+    w = std::string_view(copy, len);
+    textBytes += len;
+  }
+  int32_t x = 0;
+  for (auto& xpos : block->wordXpos) {
+    uint32_t zigzag;
+    if (!serialization::readVarint(record, zigzag)) {
+      LOG_ERR("TXB", "Deserialization failed: unreadable word position");
+      return nullptr;
+    }
+    x += zigzagDecode(zigzag);
+    xpos = static_cast<uint16_t>(x);
+  }
+  for (auto& s : block->wordStyles) serialization::readPod(record, s);
+
+  uint8_t shaped = 0;
+  serialization::readPod(record, shaped);
+  if (shaped) {
+    auto& glyphs = block->glyphs;
+    // At most one glyph per byte of text; growing the vector in the arena would leave the old copies behind
+    glyphs.reserve(std::min<size_t>(textBytes, UINT16_MAX));
+    block->wordGlyphEnds.resize(wc);
+    for (auto& end : block->wordGlyphEnds) {
+      uint32_t glyphCount;
+      if (!serialization::readVarint(record, glyphCount) || glyphCount > MAX_WORD_GLYPHS ||
+          glyphs.size() + glyphCount > UINT16_MAX) {
+        LOG_ERR("TXB", "Deserialization failed: bad shaped word");
+        return nullptr;
+      }
+      int32_t glyphX = 0;
+      for (uint32_t g = 0; g < glyphCount; g++) {
+        uint32_t tag;
+        uint32_t zigzag;
+        if (!serialization::readVarint(record, tag) || !serialization::readVarint(record, zigzag) ||
+            (tag >> 1) > UINT16_MAX) {
+          LOG_ERR("TXB", "Deserialization failed: unreadable glyph");
+          return nullptr;
+        }
+        glyphX += zigzagDecode(zigzag);
+        GfxRenderer::ShapedGlyph glyph{static_cast<uint16_t>(tag >> 1), static_cast<int16_t>(glyphX), 0};
+        if (tag & 1) {
+          serialization::readPod(record, glyph.raise);
+        }
+        glyphs.push_back(glyph);
+      }
+      end = static_cast<uint16_t>(glyphs.size());
+    }
+  }
 
   // Style (alignment + margins/padding/indent)
-  serialization::readPod(file, blockStyle.alignment);
-  serialization::readPod(file, blockStyle.textAlignDefined);
-  serialization::readPod(file, blockStyle.marginTop);
-  serialization::readPod(file, blockStyle.marginBottom);
-  serialization::readPod(file, blockStyle.marginLeft);
-  serialization::readPod(file, blockStyle.marginRight);
-  serialization::readPod(file, blockStyle.paddingTop);
-  serialization::readPod(file, blockStyle.paddingBottom);
-  serialization::readPod(file, blockStyle.paddingLeft);
-  serialization::readPod(file, blockStyle.paddingRight);
-  serialization::readPod(file, blockStyle.textIndent);
-  serialization::readPod(file, blockStyle.textIndentDefined);
-
-  return std::unique_ptr<TextBlock>(
-      new TextBlock(std::move(words), std::move(wordXpos), std::move(wordStyles), blockStyle));
+  serialization::readPod(record, block->blockStyle.alignment);
+  serialization::readPod(record, block->blockStyle.textAlignDefined);
+  serialization::readPod(record, block->blockStyle.marginTop);
+  serialization::readPod(record, block->blockStyle.marginBottom);
+  serialization::readPod(record, block->blockStyle.marginLeft);
+  serialization::readPod(record, block->blockStyle.marginRight);
+  serialization::readPod(record, block->blockStyle.paddingTop);
+  serialization::readPod(record, block->blockStyle.paddingBottom);
+  serialization::readPod(record, block->blockStyle.paddingLeft);
+  serialization::readPod(record, block->blockStyle.paddingRight);
+  serialization::readPod(record, block->blockStyle.textIndent);
+  serialization::readPod(record, block->blockStyle.textIndentDefined);
+
+  return block;
 }
@@ -1,38 +1,77 @@
 #pragma once
+#include <BufferedFile.h>
 #include <EpdFontFamily.h>
-#include <HalStorage.h>
+#include <GfxRenderer.h>
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "../BumpArena.h"
 #include "Block.h"
 #include "BlockStyle.h"
 
+class MemoryReader;
+class SectionDictionary;
+
 // Represents a line of text on a page
 class TextBlock final : public Block {
+ public:
+  template <typename T>
+  using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+  // Deletes blocks on the heap; those in an arena hold nothing but its memory and are left to it
+  struct Deleter {
+    void operator()(TextBlock* block) const;
+  };
+  using Ptr = std::unique_ptr<TextBlock, Deleter>;
+
  private:
-  std::vector<std::string> words;
-  std::vector<uint16_t> wordXpos;
-  std::vector<EpdFontFamily::Style> wordStyles;
+  // Every word is followed by a NUL in the memory it points to, so data() can be drawn as a C string. Blocks laid out
+  // while indexing keep the words in text, reserved up front so it never moves; deserialized ones point into the
+  // page's arena.
+  ArenaVector<std::string_view> words;
+  ArenaVector<char> text;
+  ArenaVector<uint16_t> wordXpos;
+  ArenaVector<EpdFontFamily::Style> wordStyles;
+  // Glyphs of all words when the line was shaped while indexing, empty otherwise; wordGlyphEnds[i] is one past the
+  // last glyph of word i
+  ArenaVector<GfxRenderer::ShapedGlyph> glyphs;
+  ArenaVector<uint16_t> wordGlyphEnds;
   BlockStyle blockStyle;
 
  public:
-  explicit TextBlock(std::vector<std::string> words, std::vector<uint16_t> word_xpos,
-                     std::vector<EpdFontFamily::Style> word_styles, const BlockStyle& blockStyle = BlockStyle())
-      : words(std::move(words)),
-        wordXpos(std::move(word_xpos)),
-        wordStyles(std::move(word_styles)),
-        blockStyle(blockStyle) {}
+  // Empty block whose storage all comes from arena, which has to outlive it
+  explicit TextBlock(BumpArena* arena);
+  // Empty line with room for wordCount words of textBytes in all, NULs and appended hyphens included. The block and
+  // its storage come from arena if there is one, from the heap otherwise.
+  static Ptr create(BumpArena* arena, size_t wordCount, size_t textBytes, const BlockStyle& blockStyle);
+  // Appends a word at x, minus its soft hyphens and plus a hyphen if it was split off a longer one. False if it doesn't
+  // fit in the room create() was given.
+  bool addWord(const char* word, size_t length, bool appendHyphen, uint16_t x, EpdFontFamily::Style style);
+  // The same line, glyphs included, in arena or on the heap
+  Ptr copy(BumpArena* arena) const;
+  TextBlock(const TextBlock&) = delete;
+  TextBlock& operator=(const TextBlock&) = delete;
   ~TextBlock() override = default;
   void setBlockStyle(const BlockStyle& blockStyle) { this->blockStyle = blockStyle; }
   const BlockStyle& getBlockStyle() const { return blockStyle; }
-  const std::vector<std::string>& getWords() const { return words; }
+  const ArenaVector<std::string_view>& getWords() const { return words; }
   bool isEmpty() override { return words.empty(); }
   size_t wordCount() const { return words.size(); }
+  bool inArena() const { return words.get_allocator().arena != nullptr; }
+  // Resolves the glyphs of every word now (ligatures, kerning, combining marks), so render() only blits them and
+  // serialize() stores them with the words
+  bool shape(const GfxRenderer& renderer, int fontId);
+  bool isShaped() const { return !wordGlyphEnds.empty(); }
+  // Approximate heap footprint, for budgeting caches of deserialized pages; 0 for a block living in an arena
+  size_t getHeapUsage() const;
   // given a renderer works out where to break the words into lines
   void render(const GfxRenderer& renderer, int fontId, int x, int y) const;
   BlockType getType() override { return TEXT_BLOCK; }
-  bool serialize(FsFile& file) const;
-  static std::unique_ptr<TextBlock> deserialize(FsFile& file);
+  bool serialize(BufferedFileWriter& file, SectionDictionary& dictionary) const;
+  // Everything of the block, the object itself included, is allocated from arena. It only holds arena memory, so it
+  // needn't be destroyed: it goes when the arena does. nullptr if the record is malformed.
+  static TextBlock* deserialize(MemoryReader& record, const SectionDictionary& dictionary, BumpArena& arena);
 };
@@ -1,16 +1,9 @@
 #pragma once
 
+#include <BitmapHelpers.h>
 #include <GfxRenderer.h>
 #include <stdint.h>
 
-// 4x4 Bayer matrix for ordered dithering
-inline const uint8_t bayer4x4[4][4] = {
-    {0, 8, 2, 10},
-    {12, 4, 14, 6},
-    {3, 11, 1, 9},
-    {15, 7, 13, 5},
-};
-
 // Apply Bayer dithering and quantize to 4 levels (0-3)
 // Stateless - works correctly with any pixel processing order
 inline uint8_t applyBayerDither4Level(uint8_t gray, int x, int y) {
@@ -32,9 +25,38 @@ inline void drawPixelWithRenderMode(GfxRenderer& renderer, int x, int y, uint8_t
   GfxRenderer::RenderMode renderMode = renderer.getRenderMode();
   if (renderMode == GfxRenderer::BW && pixelValue < 3) {
     renderer.drawPixel(x, y, true);
+    if (pixelValue != 0) {
+      renderer.markGrayPixelDrawn();
+    }
   } else if (renderMode == GfxRenderer::GRAYSCALE_MSB && (pixelValue == 1 || pixelValue == 2)) {
     renderer.drawPixel(x, y, false);
   } else if (renderMode == GfxRenderer::GRAYSCALE_LSB && pixelValue == 1) {
     renderer.drawPixel(x, y, false);
   }
 }
+
+// Draws a row of 4-level pixels from x on, looking up the render mode once for the row
+inline void drawRowWithRenderMode(GfxRenderer& renderer, const int x, const int y, const uint8_t* pixelValues,
+                                  const int count) {
+  const GfxRenderer::RenderMode renderMode = renderer.getRenderMode();
+  if (renderMode == GfxRenderer::BW) {
+    bool gray = false;
+    for (int i = 0; i < count; i++) {
+      if (pixelValues[i] < 3) {
+        renderer.drawPixel(x + i, y, true);
+        gray |= pixelValues[i] != 0;
+      }
+    }
+    if (gray) {
+      renderer.markGrayPixelDrawn();
+    }
+  } else if (renderMode == GfxRenderer::GRAYSCALE_MSB) {
+    for (int i = 0; i < count; i++) {
+      if (pixelValues[i] == 1 || pixelValues[i] == 2) renderer.drawPixel(x + i, y, false);
+    }
+  } else if (renderMode == GfxRenderer::GRAYSCALE_LSB) {
+    for (int i = 0; i < count; i++) {
+      if (pixelValues[i] == 1) renderer.drawPixel(x + i, y, false);
+    }
+  }
+}
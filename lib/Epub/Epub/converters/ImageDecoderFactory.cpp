@@ -11,7 +11,7 @@
 std::unique_ptr<JpegToFramebufferConverter> ImageDecoderFactory::jpegDecoder = nullptr;
 std::unique_ptr<PngToFramebufferConverter> ImageDecoderFactory::pngDecoder = nullptr;
 
-ImageToFramebufferDecoder* ImageDecoderFactory::getDecoder(const std::string& imagePath) {
+ImageDecoderFactory::Format ImageDecoderFactory::getFormat(const std::string& imagePath) {
   std::string ext = imagePath;
   size_t dotPos = ext.rfind('.');
   if (dotPos != std::string::npos) {
@@ -24,15 +24,28 @@ ImageToFramebufferDecoder* ImageDecoderFactory::getDecoder(const std::string& im
   }
 
   if (JpegToFramebufferConverter::supportsFormat(ext)) {
-    if (!jpegDecoder) {
-      jpegDecoder.reset(new JpegToFramebufferConverter());
-    }
-    return jpegDecoder.get();
-  } else if (PngToFramebufferConverter::supportsFormat(ext)) {
-    if (!pngDecoder) {
-      pngDecoder.reset(new PngToFramebufferConverter());
-    }
-    return pngDecoder.get();
+    return Format::Jpeg;
+  }
+  if (PngToFramebufferConverter::supportsFormat(ext)) {
+    return Format::Png;
+  }
+  return Format::None;
+}
+
+ImageToFramebufferDecoder* ImageDecoderFactory::getDecoder(const std::string& imagePath) {
+  switch (getFormat(imagePath)) {
+    case Format::Jpeg:
+      if (!jpegDecoder) {
+        jpegDecoder.reset(new JpegToFramebufferConverter());
+      }
+      return jpegDecoder.get();
+    case Format::Png:
+      if (!pngDecoder) {
+        pngDecoder.reset(new PngToFramebufferConverter());
+      }
+      return pngDecoder.get();
+    case Format::None:
+      break;
   }
 
   LOG_ERR("DEC", "No decoder found for image: %s", imagePath.c_str());
@@ -10,6 +10,11 @@ class PngToFramebufferConverter;
 
 class ImageDecoderFactory {
  public:
+  // Stored in image manifests, so values must not change
+  enum class Format : uint8_t { None = 0, Jpeg = 1, Png = 2 };
+
+  // Format by the file extension, or None if no decoder takes it
+  static Format getFormat(const std::string& imagePath);
   // Returns non-owning pointer - factory owns the decoder lifetime
   static ImageToFramebufferDecoder* getDecoder(const std::string& imagePath);
   static bool isFormatSupported(const std::string& imagePath);
@@ -0,0 +1,83 @@
+#include "ImageSource.h"
+
+#include <FsHelpers.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <ZipFile.h>
+
+#include <utility>
+
+namespace {
+// Compressed bytes read from the archive per refill while inflating
+constexpr size_t ZIP_READ_CHUNK_SIZE = 1024;
+
+class FileImageSource final : public ImageSource {
+  FsFile file;
+
+ public:
+  explicit FileImageSource(const std::string& path) : ImageSource(path) {}
+  ~FileImageSource() override { file.close(); }
+
+  bool begin() { return Storage.openFileForRead("IMG", getName(), file); }
+  int read(uint8_t* buf, const size_t len) override { return file.read(buf, len); }
+  bool seek(const size_t pos) override { return file.seek(pos); }
+  size_t size() override { return file.size(); }
+  size_t position() override { return file.position(); }
+};
+
+class ZipImageSource final : public ImageSource {
+  // ZipFile keeps a reference to the archive path, so it lives here
+  std::string archivePath;
+  std::string indexPath;
+  std::unique_ptr<ZipFile> zip;
+
+ public:
+  ZipImageSource(std::string archivePath, std::string indexPath, const std::string& entryPath)
+      : ImageSource(FsHelpers::normalisePath(entryPath)),
+        archivePath(std::move(archivePath)),
+        indexPath(std::move(indexPath)) {}
+
+  bool begin() {
+    zip.reset(new ZipFile(archivePath, indexPath));
+    if (!zip->beginEntryStream(getName().c_str(), ZIP_READ_CHUNK_SIZE)) {
+      LOG_ERR("IMG", "Failed to open %s in %s", getName().c_str(), archivePath.c_str());
+      zip.reset();
+      return false;
+    }
+    return true;
+  }
+
+  int read(uint8_t* buf, const size_t len) override { return zip ? zip->readEntryStream(buf, len) : -1; }
+
+  bool seek(const size_t pos) override {
+    if (!zip) {
+      return false;
+    }
+    if (zip->seekEntryStream(pos)) {
+      return true;
+    }
+    // Deflated entries only go forward
+    return pos < zip->getEntryStreamPosition() && begin() && zip->seekEntryStream(pos);
+  }
+
+  size_t size() override { return zip ? zip->getEntryStreamSize() : 0; }
+  size_t position() override { return zip ? zip->getEntryStreamPosition() : 0; }
+};
+}  // namespace
+
+std::unique_ptr<ImageSource> ImageSource::open(const std::string& path, const std::string& archivePath,
+                                               const std::string& archiveIndexPath) {
+  if (archivePath.empty()) {
+    auto source = std::unique_ptr<FileImageSource>(new FileImageSource(path));
+    if (!source->begin()) {
+      return nullptr;
+    }
+    return source;
+  }
+
+  auto source = std::unique_ptr<ZipImageSource>(new ZipImageSource(archivePath, archiveIndexPath, path));
+  if (!source->begin()) {
+    return nullptr;
+  }
+  return source;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+// Bytes of an image to decode: a file on the SD card, or an entry of the EPUB archive read in place (stored entries
+// straight from their data offset, deflated ones inflated as they're read).
+class ImageSource {
+ public:
+  virtual ~ImageSource() = default;
+
+  // Returns the number of bytes read (0 at the end) or -1 on error
+  virtual int read(uint8_t* buf, size_t len) = 0;
+  // Absolute position; seeking backwards in a deflated entry restarts the inflate from its beginning
+  virtual bool seek(size_t pos) = 0;
+  virtual size_t size() = 0;
+  virtual size_t position() = 0;
+  // For log messages
+  const std::string& getName() const { return name; }
+
+  // Opens `path` on the SD card, or the entry `path` of the ZIP at archivePath when that is set, looked up through the
+  // central directory index at archiveIndexPath if given (see ZipFile). nullptr on failure.
+  static std::unique_ptr<ImageSource> open(const std::string& path, const std::string& archivePath = "",
+                                           const std::string& archiveIndexPath = "");
+
+ protected:
+  explicit ImageSource(std::string name) : name(std::move(name)) {}
+
+ private:
+  std::string name;
+};
@@ -1,10 +1,12 @@
 #pragma once
 #include <HalStorage.h>
 
+#include <functional>
 #include <memory>
 #include <string>
 
 class GfxRenderer;
+class ImageSource;
 
 struct ImageDimensions {
   int16_t width;
@@ -17,17 +19,19 @@ struct RenderConfig {
   bool useGrayscale = true;
   bool useDithering = true;
   bool performanceMode = false;
-  bool useExactDimensions = false;  // If true, use maxWidth/maxHeight as exact output size (no recalculation)
-  std::string cachePath;            // If non-empty, decoder will write pixel cache to this path
+  bool useExactDimensions = false;    // If true, use maxWidth/maxHeight as exact output size (no recalculation)
+  std::string cachePath;              // If non-empty, decoder will write pixel cache to this path
+  bool cacheOnly = false;             // If true, only the pixel cache is written; the frame buffer is left alone
+  std::function<bool()> shouldAbort;  // Polled between rows (JPEG: MCU rows); returning true abandons the decode
 };
 
 class ImageToFramebufferDecoder {
  public:
   virtual ~ImageToFramebufferDecoder() = default;
 
-  virtual bool decodeToFramebuffer(const std::string& imagePath, GfxRenderer& renderer, const RenderConfig& config) = 0;
+  virtual bool decodeToFramebuffer(ImageSource& source, GfxRenderer& renderer, const RenderConfig& config) = 0;
 
-  virtual bool getDimensions(const std::string& imagePath, ImageDimensions& dims) const = 0;
+  virtual bool getDimensions(ImageSource& source, ImageDimensions& dims) const = 0;
 
   virtual const char* getFormatName() const = 0;
 
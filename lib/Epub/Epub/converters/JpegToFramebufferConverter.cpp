@@ -9,28 +9,22 @@
 #include <cstring>
 
 #include "DitherUtils.h"
+#include "ImageSource.h"
 #include "PixelCache.h"
 
 struct JpegContext {
-  FsFile& file;
+  ImageSource& source;
   uint8_t buffer[512];
   size_t bufferPos;
   size_t bufferFilled;
-  JpegContext(FsFile& f) : file(f), bufferPos(0), bufferFilled(0) {}
+  JpegContext(ImageSource& s) : source(s), bufferPos(0), bufferFilled(0) {}
 };
 
-bool JpegToFramebufferConverter::getDimensionsStatic(const std::string& imagePath, ImageDimensions& out) {
-  FsFile file;
-  if (!Storage.openFileForRead("JPG", imagePath, file)) {
-    LOG_ERR("JPG", "Failed to open file for dimensions: %s", imagePath.c_str());
-    return false;
-  }
-
-  JpegContext context(file);
+bool JpegToFramebufferConverter::getDimensionsStatic(ImageSource& source, ImageDimensions& out) {
+  JpegContext context(source);
   pjpeg_image_info_t imageInfo;
 
   int status = pjpeg_decode_init(&imageInfo, jpegReadCallback, &context, 0);
-  file.close();
 
   if (status != 0) {
     LOG_ERR("JPG", "Failed to init JPEG for dimensions: %d", status);
@@ -43,28 +37,20 @@ bool JpegToFramebufferConverter::getDimensionsStatic(const std::string& imagePat
   return true;
 }
 
-bool JpegToFramebufferConverter::decodeToFramebuffer(const std::string& imagePath, GfxRenderer& renderer,
+bool JpegToFramebufferConverter::decodeToFramebuffer(ImageSource& source, GfxRenderer& renderer,
                                                      const RenderConfig& config) {
-  LOG_DBG("JPG", "Decoding JPEG: %s", imagePath.c_str());
-
-  FsFile file;
-  if (!Storage.openFileForRead("JPG", imagePath, file)) {
-    LOG_ERR("JPG", "Failed to open file: %s", imagePath.c_str());
-    return false;
-  }
+  LOG_DBG("JPG", "Decoding JPEG: %s", source.getName().c_str());
 
-  JpegContext context(file);
+  JpegContext context(source);
   pjpeg_image_info_t imageInfo;
 
   int status = pjpeg_decode_init(&imageInfo, jpegReadCallback, &context, 0);
   if (status != 0) {
     LOG_ERR("JPG", "picojpeg init failed: %d", status);
-    file.close();
     return false;
   }
 
   if (!validateImageDimensions(imageInfo.m_width, imageInfo.m_height, "JPEG")) {
-    file.close();
     return false;
   }
 
@@ -92,24 +78,41 @@ bool JpegToFramebufferConverter::decodeToFramebuffer(const std::string& imagePat
     destHeight = (int)(imageInfo.m_height * scale);
   }
 
-  LOG_DBG("JPG", "JPEG %dx%d -> %dx%d (scale %.2f), scan type: %d, MCU: %dx%d", imageInfo.m_width, imageInfo.m_height,
-          destWidth, destHeight, scale, imageInfo.m_scanType, imageInfo.m_MCUWidth, imageInfo.m_MCUHeight);
+  // When the target is no larger than 1/8 of the source, decode only the DC value (the block average) of each 8x8
+  // block: picojpeg then skips the AC coefficients and IDCT, and the result is no coarser than point-sampling the
+  // full image.
+  const bool reduced = (imageInfo.m_width + 7) / 8 >= destWidth && (imageInfo.m_height + 7) / 8 >= destHeight;
+  if (reduced) {
+    source.seek(0);
+    context.bufferPos = 0;
+    context.bufferFilled = 0;
+    status = pjpeg_decode_init(&imageInfo, jpegReadCallback, &context, 1);
+    if (status != 0) {
+      LOG_ERR("JPG", "picojpeg reduced init failed: %d", status);
+      return false;
+    }
+  }
+
+  LOG_DBG("JPG", "JPEG %dx%d -> %dx%d (scale %.2f%s), scan type: %d, MCU: %dx%d", imageInfo.m_width,
+          imageInfo.m_height, destWidth, destHeight, scale, reduced ? ", DC only" : "", imageInfo.m_scanType,
+          imageInfo.m_MCUWidth, imageInfo.m_MCUHeight);
 
   if (!imageInfo.m_pMCUBufR || !imageInfo.m_pMCUBufG || !imageInfo.m_pMCUBufB) {
     LOG_ERR("JPG", "Null buffer pointers in imageInfo");
-    file.close();
     return false;
   }
 
   const int screenWidth = renderer.getScreenWidth();
   const int screenHeight = renderer.getScreenHeight();
 
-  // Allocate pixel cache if cachePath is provided
+  // Stream a pixel cache if cachePath is provided. MCUs arrive left to right, so the band holds the output rows of
+  // one MCU row (plus the row it may share with the next one when downscaling)
   PixelCache cache;
   bool caching = !config.cachePath.empty();
   if (caching) {
-    if (!cache.allocate(destWidth, destHeight, config.x, config.y)) {
-      LOG_ERR("JPG", "Failed to allocate cache buffer, continuing without caching");
+    const int bandRows = (int)(imageInfo.m_MCUHeight * scale) + 2;
+    if (!cache.begin(renderer, config.cachePath, destWidth, destHeight, config.x, config.y, bandRows)) {
+      LOG_ERR("JPG", "Failed to start cache file, continuing without caching");
       caching = false;
     }
   }
@@ -124,7 +127,6 @@ bool JpegToFramebufferConverter::decodeToFramebuffer(const std::string& imagePat
     }
     if (status != 0) {
       LOG_ERR("JPG", "MCU decode failed: %d", status);
-      file.close();
       return false;
     }
 
@@ -132,132 +134,168 @@ bool JpegToFramebufferConverter::decodeToFramebuffer(const std::string& imagePat
     int srcStartX = mcuX * imageInfo.m_MCUWidth;
     int srcStartY = mcuY * imageInfo.m_MCUHeight;
 
-    switch (imageInfo.m_scanType) {
-      case PJPG_GRAYSCALE:
-        for (int row = 0; row < 8; row++) {
-          int srcY = srcStartY + row;
-          int destY = config.y + (int)(srcY * scale);
-          if (destY >= screenHeight || destY >= config.y + destHeight) continue;
-          for (int col = 0; col < 8; col++) {
-            int srcX = srcStartX + col;
-            int destX = config.x + (int)(srcX * scale);
-            if (destX >= screenWidth || destX >= config.x + destWidth) continue;
-            uint8_t gray = imageInfo.m_pMCUBufR[row * 8 + col];
-            uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
-            if (dithered > 3) dithered = 3;
-            drawPixelWithRenderMode(renderer, destX, destY, dithered);
-            if (caching) cache.setPixel(destX, destY, dithered);
+    if (reduced) {
+      // One pixel per 8x8 block, at the block's top-left source position
+      for (int blockY = 0; blockY < imageInfo.m_MCUHeight / 8; blockY++) {
+        int srcY = srcStartY + blockY * 8;
+        int destY = config.y + (int)(srcY * scale);
+        if (destY >= screenHeight || destY >= config.y + destHeight) continue;
+        uint8_t* cacheRow = caching ? cache.getRow(destY) : nullptr;
+        for (int blockX = 0; blockX < imageInfo.m_MCUWidth / 8; blockX++) {
+          int srcX = srcStartX + blockX * 8;
+          int destX = config.x + (int)(srcX * scale);
+          if (destX >= screenWidth || destX >= config.x + destWidth) continue;
+          int blockOffset = blockY * 128 + blockX * 64;
+          uint8_t gray = imageInfo.m_pMCUBufR[blockOffset];
+          if (imageInfo.m_scanType != PJPG_GRAYSCALE) {
+            uint8_t g = imageInfo.m_pMCUBufG[blockOffset];
+            uint8_t b = imageInfo.m_pMCUBufB[blockOffset];
+            gray = (uint8_t)((gray * 77 + g * 150 + b * 29) >> 8);
           }
+          uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
+          if (dithered > 3) dithered = 3;
+          if (!config.cacheOnly) drawPixelWithRenderMode(renderer, destX, destY, dithered);
+          if (cacheRow) cache.setRowPixel(cacheRow, destX, dithered);
         }
-        break;
-
-      case PJPG_YH1V1:
-        for (int row = 0; row < 8; row++) {
-          int srcY = srcStartY + row;
-          int destY = config.y + (int)(srcY * scale);
-          if (destY >= screenHeight || destY >= config.y + destHeight) continue;
-          for (int col = 0; col < 8; col++) {
-            int srcX = srcStartX + col;
-            int destX = config.x + (int)(srcX * scale);
-            if (destX >= screenWidth || destX >= config.x + destWidth) continue;
-            uint8_t r = imageInfo.m_pMCUBufR[row * 8 + col];
-            uint8_t g = imageInfo.m_pMCUBufG[row * 8 + col];
-            uint8_t b = imageInfo.m_pMCUBufB[row * 8 + col];
-            uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
-            uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
-            if (dithered > 3) dithered = 3;
-            drawPixelWithRenderMode(renderer, destX, destY, dithered);
-            if (caching) cache.setPixel(destX, destY, dithered);
+      }
+    } else {
+      switch (imageInfo.m_scanType) {
+        case PJPG_GRAYSCALE:
+          for (int row = 0; row < 8; row++) {
+            int srcY = srcStartY + row;
+            int destY = config.y + (int)(srcY * scale);
+            if (destY >= screenHeight || destY >= config.y + destHeight) continue;
+            uint8_t* cacheRow = caching ? cache.getRow(destY) : nullptr;
+            for (int col = 0; col < 8; col++) {
+              int srcX = srcStartX + col;
+              int destX = config.x + (int)(srcX * scale);
+              if (destX >= screenWidth || destX >= config.x + destWidth) continue;
+              uint8_t gray = imageInfo.m_pMCUBufR[row * 8 + col];
+              uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
+              if (dithered > 3) dithered = 3;
+              if (!config.cacheOnly) drawPixelWithRenderMode(renderer, destX, destY, dithered);
+              if (cacheRow) cache.setRowPixel(cacheRow, destX, dithered);
+            }
           }
-        }
-        break;
-
-      case PJPG_YH2V1:
-        for (int row = 0; row < 8; row++) {
-          int srcY = srcStartY + row;
-          int destY = config.y + (int)(srcY * scale);
-          if (destY >= screenHeight || destY >= config.y + destHeight) continue;
-          for (int col = 0; col < 16; col++) {
-            int srcX = srcStartX + col;
-            int destX = config.x + (int)(srcX * scale);
-            if (destX >= screenWidth || destX >= config.x + destWidth) continue;
-            int blockIndex = (col < 8) ? 0 : 1;
-            int pixelIndex = row * 8 + (col % 8);
-            uint8_t r = imageInfo.m_pMCUBufR[blockIndex * 64 + pixelIndex];
-            uint8_t g = imageInfo.m_pMCUBufG[blockIndex * 64 + pixelIndex];
-            uint8_t b = imageInfo.m_pMCUBufB[blockIndex * 64 + pixelIndex];
-            uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
-            uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
-            if (dithered > 3) dithered = 3;
-            drawPixelWithRenderMode(renderer, destX, destY, dithered);
-            if (caching) cache.setPixel(destX, destY, dithered);
+          break;
+
+        case PJPG_YH1V1:
+          for (int row = 0; row < 8; row++) {
+            int srcY = srcStartY + row;
+            int destY = config.y + (int)(srcY * scale);
+            if (destY >= screenHeight || destY >= config.y + destHeight) continue;
+            uint8_t* cacheRow = caching ? cache.getRow(destY) : nullptr;
+            for (int col = 0; col < 8; col++) {
+              int srcX = srcStartX + col;
+              int destX = config.x + (int)(srcX * scale);
+              if (destX >= screenWidth || destX >= config.x + destWidth) continue;
+              uint8_t r = imageInfo.m_pMCUBufR[row * 8 + col];
+              uint8_t g = imageInfo.m_pMCUBufG[row * 8 + col];
+              uint8_t b = imageInfo.m_pMCUBufB[row * 8 + col];
+              uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+              uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
+              if (dithered > 3) dithered = 3;
+              if (!config.cacheOnly) drawPixelWithRenderMode(renderer, destX, destY, dithered);
+              if (cacheRow) cache.setRowPixel(cacheRow, destX, dithered);
+            }
           }
-        }
-        break;
-
-      case PJPG_YH1V2:
-        for (int row = 0; row < 16; row++) {
-          int srcY = srcStartY + row;
-          int destY = config.y + (int)(srcY * scale);
-          if (destY >= screenHeight || destY >= config.y + destHeight) continue;
-          for (int col = 0; col < 8; col++) {
-            int srcX = srcStartX + col;
-            int destX = config.x + (int)(srcX * scale);
-            if (destX >= screenWidth || destX >= config.x + destWidth) continue;
-            int blockIndex = (row < 8) ? 0 : 1;
-            int pixelIndex = (row % 8) * 8 + col;
-            uint8_t r = imageInfo.m_pMCUBufR[blockIndex * 128 + pixelIndex];
-            uint8_t g = imageInfo.m_pMCUBufG[blockIndex * 128 + pixelIndex];
-            uint8_t b = imageInfo.m_pMCUBufB[blockIndex * 128 + pixelIndex];
-            uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
-            uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
-            if (dithered > 3) dithered = 3;
-            drawPixelWithRenderMode(renderer, destX, destY, dithered);
-            if (caching) cache.setPixel(destX, destY, dithered);
+          break;
+
+        case PJPG_YH2V1:
+          for (int row = 0; row < 8; row++) {
+            int srcY = srcStartY + row;
+            int destY = config.y + (int)(srcY * scale);
+            if (destY >= screenHeight || destY >= config.y + destHeight) continue;
+            uint8_t* cacheRow = caching ? cache.getRow(destY) : nullptr;
+            for (int col = 0; col < 16; col++) {
+              int srcX = srcStartX + col;
+              int destX = config.x + (int)(srcX * scale);
+              if (destX >= screenWidth || destX >= config.x + destWidth) continue;
+              int blockIndex = (col < 8) ? 0 : 1;
+              int pixelIndex = row * 8 + (col % 8);
+              uint8_t r = imageInfo.m_pMCUBufR[blockIndex * 64 + pixelIndex];
+              uint8_t g = imageInfo.m_pMCUBufG[blockIndex * 64 + pixelIndex];
+              uint8_t b = imageInfo.m_pMCUBufB[blockIndex * 64 + pixelIndex];
+              uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+              uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
+              if (dithered > 3) dithered = 3;
+              if (!config.cacheOnly) drawPixelWithRenderMode(renderer, destX, destY, dithered);
+              if (cacheRow) cache.setRowPixel(cacheRow, destX, dithered);
+            }
           }
-        }
-        break;
-
-      case PJPG_YH2V2:
-        for (int row = 0; row < 16; row++) {
-          int srcY = srcStartY + row;
-          int destY = config.y + (int)(srcY * scale);
-          if (destY >= screenHeight || destY >= config.y + destHeight) continue;
-          for (int col = 0; col < 16; col++) {
-            int srcX = srcStartX + col;
-            int destX = config.x + (int)(srcX * scale);
-            if (destX >= screenWidth || destX >= config.x + destWidth) continue;
-            int blockX = (col < 8) ? 0 : 1;
-            int blockY = (row < 8) ? 0 : 1;
-            int blockIndex = blockY * 2 + blockX;
-            int pixelIndex = (row % 8) * 8 + (col % 8);
-            int blockOffset = blockIndex * 64;
-            uint8_t r = imageInfo.m_pMCUBufR[blockOffset + pixelIndex];
-            uint8_t g = imageInfo.m_pMCUBufG[blockOffset + pixelIndex];
-            uint8_t b = imageInfo.m_pMCUBufB[blockOffset + pixelIndex];
-            uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
-            uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
-            if (dithered > 3) dithered = 3;
-            drawPixelWithRenderMode(renderer, destX, destY, dithered);
-            if (caching) cache.setPixel(destX, destY, dithered);
+          break;
+
+        case PJPG_YH1V2:
+          for (int row = 0; row < 16; row++) {
+            int srcY = srcStartY + row;
+            int destY = config.y + (int)(srcY * scale);
+            if (destY >= screenHeight || destY >= config.y + destHeight) continue;
+            uint8_t* cacheRow = caching ? cache.getRow(destY) : nullptr;
+            for (int col = 0; col < 8; col++) {
+              int srcX = srcStartX + col;
+              int destX = config.x + (int)(srcX * scale);
+              if (destX >= screenWidth || destX >= config.x + destWidth) continue;
+              int blockIndex = (row < 8) ? 0 : 1;
+              int pixelIndex = (row % 8) * 8 + col;
+              uint8_t r = imageInfo.m_pMCUBufR[blockIndex * 128 + pixelIndex];
+              uint8_t g = imageInfo.m_pMCUBufG[blockIndex * 128 + pixelIndex];
+              uint8_t b = imageInfo.m_pMCUBufB[blockIndex * 128 + pixelIndex];
+              uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+              uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
+              if (dithered > 3) dithered = 3;
+              if (!config.cacheOnly) drawPixelWithRenderMode(renderer, destX, destY, dithered);
+              if (cacheRow) cache.setRowPixel(cacheRow, destX, dithered);
+            }
           }
-        }
-        break;
+          break;
+
+        case PJPG_YH2V2:
+          for (int row = 0; row < 16; row++) {
+            int srcY = srcStartY + row;
+            int destY = config.y + (int)(srcY * scale);
+            if (destY >= screenHeight || destY >= config.y + destHeight) continue;
+            uint8_t* cacheRow = caching ? cache.getRow(destY) : nullptr;
+            for (int col = 0; col < 16; col++) {
+              int srcX = srcStartX + col;
+              int destX = config.x + (int)(srcX * scale);
+              if (destX >= screenWidth || destX >= config.x + destWidth) continue;
+              int blockX = (col < 8) ? 0 : 1;
+              int blockY = (row < 8) ? 0 : 1;
+              int blockIndex = blockY * 2 + blockX;
+              int pixelIndex = (row % 8) * 8 + (col % 8);
+              int blockOffset = blockIndex * 64;
+              uint8_t r = imageInfo.m_pMCUBufR[blockOffset + pixelIndex];
+              uint8_t g = imageInfo.m_pMCUBufG[blockOffset + pixelIndex];
+              uint8_t b = imageInfo.m_pMCUBufB[blockOffset + pixelIndex];
+              uint8_t gray = (uint8_t)((r * 77 + g * 150 + b * 29) >> 8);
+              uint8_t dithered = config.useDithering ? applyBayerDither4Level(gray, destX, destY) : gray / 85;
+              if (dithered > 3) dithered = 3;
+              if (!config.cacheOnly) drawPixelWithRenderMode(renderer, destX, destY, dithered);
+              if (cacheRow) cache.setRowPixel(cacheRow, destX, dithered);
+            }
+          }
+          break;
+      }
     }
 
     mcuX++;
     if (mcuX >= imageInfo.m_MCUSPerRow) {
       mcuX = 0;
       mcuY++;
+      // Rows above the next MCU row are final
+      if (caching) cache.flushRowsBefore(config.y + (int)(mcuY * imageInfo.m_MCUHeight * scale));
+      if (config.shouldAbort && config.shouldAbort()) {
+        LOG_DBG("JPG", "Decode abandoned at MCU row %d", mcuY);
+        return false;
+      }
     }
   }
 
   LOG_DBG("JPG", "Decoding complete");
-  file.close();
 
-  // Write cache file if caching was enabled
+  // Complete the cache file if caching was enabled
   if (caching) {
-    cache.writeToFile(config.cachePath);
+    cache.finish();
   }
 
   return true;
@@ -268,7 +306,7 @@ unsigned char JpegToFramebufferConverter::jpegReadCallback(unsigned char* pBuf,
   JpegContext* context = reinterpret_cast<JpegContext*>(pCallback_data);
 
   if (context->bufferPos >= context->bufferFilled) {
-    int readCount = context->file.read(context->buffer, sizeof(context->buffer));
+    int readCount = context->source.read(context->buffer, sizeof(context->buffer));
     if (readCount <= 0) {
       *pBytes_actually_read = 0;
       return 0;
@@ -7,12 +7,12 @@
 
 class JpegToFramebufferConverter final : public ImageToFramebufferDecoder {
  public:
-  static bool getDimensionsStatic(const std::string& imagePath, ImageDimensions& out);
+  static bool getDimensionsStatic(ImageSource& source, ImageDimensions& out);
 
-  bool decodeToFramebuffer(const std::string& imagePath, GfxRenderer& renderer, const RenderConfig& config) override;
+  bool decodeToFramebuffer(ImageSource& source, GfxRenderer& renderer, const RenderConfig& config) override;
 
-  bool getDimensions(const std::string& imagePath, ImageDimensions& dims) const override {
-    return getDimensionsStatic(imagePath, dims);
+  bool getDimensions(ImageSource& source, ImageDimensions& dims) const override {
+    return getDimensionsStatic(source, dims);
   }
 
   static bool supportsFormat(const std::string& extension);
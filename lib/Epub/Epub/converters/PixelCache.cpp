@@ -0,0 +1,205 @@
+#include "PixelCache.h"
+
+#include <GfxRenderer.h>
+#include <HalDisplay.h>
+#include <Logging.h>
+#include <PackBits.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstring>
+
+PixelCache::~PixelCache() {
+  if (band) {
+    // Decode didn't finish: drop the partial file
+    file.close();
+    Storage.remove(path.c_str());
+  }
+  release();
+}
+
+void PixelCache::release() {
+  free(band);
+  free(slab);
+  free(packed);
+  band = nullptr;
+  slab = nullptr;
+  packed = nullptr;
+}
+
+bool PixelCache::begin(const GfxRenderer& gfxRenderer, const std::string& cachePath, const int w, const int h,
+                       const int ox, const int oy, const int rowsInBand) {
+  renderer = &gfxRenderer;
+  width = w;
+  height = h;
+  originX = ox;
+  originY = oy;
+  bytesPerRow = (w + 3) / 4;  // 2 bits per pixel, 4 pixels per byte
+  bandRows = rowsInBand < 1 ? 1 : (rowsInBand > h ? h : rowsInBand);
+  bandStart = 0;
+  failed = false;
+  flags = 0;
+  slabKey = -1;
+  slabCount = 0;
+  if (w <= 0 || h <= 0) {
+    return false;
+  }
+
+  // Physical extent of the image, clipped to the panel
+  int x0, y0, x1, y1, nextX, nextY;
+  renderer->toPhysical(ox, oy, &x0, &y0);
+  renderer->toPhysical(ox + w - 1, oy + h - 1, &x1, &y1);
+  renderer->toPhysical(ox + 1, oy, &nextX, &nextY);
+  rowsAlongPanelRows = nextY == y0;
+  const int left = std::max(0, std::min(x0, x1));
+  const int right = std::min(HalDisplay::DISPLAY_WIDTH - 1, std::max(x0, x1));
+  phyTop = std::max(0, std::min(y0, y1));
+  const int bottom = std::min(HalDisplay::DISPLAY_HEIGHT - 1, std::max(y0, y1));
+  phyLeft = left / 8;
+  slabCapacity = rowsAlongPanelRows ? right / 8 - phyLeft + 1 : bottom - phyTop + 1;
+  if (slabCapacity <= 0) {
+    return false;
+  }
+
+  const size_t bandSize = static_cast<size_t>(bytesPerRow) * bandRows;
+  band = static_cast<uint8_t*>(malloc(bandSize));
+  slab = static_cast<uint8_t*>(malloc(slabCapacity * PIXEL_CACHE_PLANES));
+  packed = static_cast<uint8_t*>(malloc(PackBits::maxPackedSize(slabCapacity)));
+  if (!band || !slab || !packed) {
+    LOG_ERR("IMG", "Failed to allocate cache buffers for %dx%d", w, h);
+    release();
+    return false;
+  }
+  memset(band, 0, bandSize);
+  memset(slab, 0, slabCapacity * PIXEL_CACHE_PLANES);
+
+  if (!Storage.openFileForWrite("IMG", cachePath, file)) {
+    LOG_ERR("IMG", "Failed to open cache file for writing: %s", cachePath.c_str());
+    release();
+    return false;
+  }
+  path = cachePath;
+  // Reserved for every slab packing to its worst case; finish() truncates to what was written
+  const int slabs = rowsAlongPanelRows ? bottom - phyTop + 1 : right / 8 - phyLeft + 1;
+  const size_t slabSize = PIXEL_CACHE_SLAB_HEADER_SIZE + PIXEL_CACHE_PLANES * PackBits::maxPackedSize(slabCapacity);
+  Storage.preAllocate("IMG", file, PIXEL_CACHE_HEADER_SIZE + static_cast<uint64_t>(slabs) * slabSize);
+  // Written with no slabs first, finish() fills in the count
+  writeHeader();
+  LOG_DBG("IMG", "Streaming cache for %dx%d through a %d row band", w, h, bandRows);
+  return true;
+}
+
+void PixelCache::writeHeader() {
+  serialization::writePod(file, PIXEL_CACHE_MAGIC);
+  serialization::writePod(file, static_cast<uint16_t>(width));
+  serialization::writePod(file, static_cast<uint16_t>(height));
+  serialization::writePod(file, static_cast<uint8_t>(renderer->getOrientation()));
+  serialization::writePod(file, flags);
+  serialization::writePod(file, static_cast<int16_t>(originX));
+  serialization::writePod(file, static_cast<int16_t>(originY));
+  serialization::writePod(file, slabCount);
+}
+
+uint8_t* PixelCache::getRow(const int screenY) {
+  if (!band) return nullptr;
+  const int localY = screenY - originY;
+  if (localY < bandStart || localY >= height) return nullptr;
+  while (localY >= bandStart + bandRows) {
+    flushRow();
+  }
+  return band + (localY % bandRows) * bytesPerRow;
+}
+
+void PixelCache::flushRowsBefore(const int screenY) {
+  const int localY = screenY - originY;
+  while (band && bandStart < localY && bandStart < height) {
+    flushRow();
+  }
+}
+
+void PixelCache::flushRow() {
+  uint8_t* row = band + (bandStart % bandRows) * bytesPerRow;
+  const int screenY = originY + bandStart;
+
+  int phyX, phyY;
+  renderer->toPhysical(originX, screenY, &phyX, &phyY);
+  const int key = rowsAlongPanelRows ? phyY : phyX / 8;
+  if (key != slabKey) {
+    if (slabKey >= 0) writeSlab();
+    slabKey = key;
+  }
+
+  // Same plane split as drawPixelWithRenderMode
+  uint8_t* bwPlane = slab;
+  uint8_t* lsbPlane = slab + slabCapacity;
+  uint8_t* msbPlane = slab + 2 * slabCapacity;
+  for (int localX = 0; localX < width; localX++) {
+    const uint8_t value = (row[localX / 4] >> (6 - (localX % 4) * 2)) & 0x03;
+    if (value == 3) continue;
+    renderer->toPhysical(originX + localX, screenY, &phyX, &phyY);
+    if (phyX < 0 || phyX >= HalDisplay::DISPLAY_WIDTH || phyY < 0 || phyY >= HalDisplay::DISPLAY_HEIGHT) continue;
+    const int index = rowsAlongPanelRows ? phyX / 8 - phyLeft : phyY - phyTop;
+    if (index < 0 || index >= slabCapacity) continue;
+
+    const uint8_t bit = 0x80 >> (phyX % 8);
+    bwPlane[index] |= bit;
+    if (value == 1 || value == 2) {
+      msbPlane[index] |= bit;
+      flags |= PIXEL_CACHE_HAS_GRAY;
+    }
+    if (value == 1) {
+      lsbPlane[index] |= bit;
+    }
+  }
+
+  memset(row, 0, bytesPerRow);
+  bandStart++;
+}
+
+void PixelCache::writeSlab() {
+  const int start = rowsAlongPanelRows ? slabKey * HalDisplay::DISPLAY_WIDTH_BYTES + phyLeft
+                                       : phyTop * HalDisplay::DISPLAY_WIDTH_BYTES + slabKey;
+  const int step = rowsAlongPanelRows ? 1 : HalDisplay::DISPLAY_WIDTH_BYTES;
+
+  serialization::writePod(file, static_cast<uint16_t>(start));
+  serialization::writePod(file, static_cast<int16_t>(step));
+  serialization::writePod(file, static_cast<uint16_t>(slabCapacity));
+  for (uint8_t plane = 0; plane < PIXEL_CACHE_PLANES; plane++) {
+    serialization::writePod(file,
+                            static_cast<uint16_t>(PackBits::pack(slab + plane * slabCapacity, slabCapacity, nullptr)));
+  }
+  for (uint8_t plane = 0; plane < PIXEL_CACHE_PLANES; plane++) {
+    const size_t packedSize = PackBits::pack(slab + plane * slabCapacity, slabCapacity, packed);
+    if (!failed && file.write(packed, packedSize) != packedSize) {
+      failed = true;
+    }
+  }
+
+  memset(slab, 0, slabCapacity * PIXEL_CACHE_PLANES);
+  slabCount++;
+}
+
+bool PixelCache::finish() {
+  if (!band) return false;
+  while (bandStart < height) {
+    flushRow();
+  }
+  if (slabKey >= 0) {
+    writeSlab();
+  }
+  const size_t fileSize = file.position();
+  if (!file.truncate(fileSize)) {
+    failed = true;
+  }
+  file.seek(0);
+  writeHeader();
+  file.close();
+  release();
+  if (failed) {
+    LOG_ERR("IMG", "Failed to write cache file: %s", path.c_str());
+    Storage.remove(path.c_str());
+    return false;
+  }
+  LOG_DBG("IMG", "Cache written: %s (%dx%d, %d slabs, %zu bytes)", path.c_str(), width, height, slabCount, fileSize);
+  return true;
+}
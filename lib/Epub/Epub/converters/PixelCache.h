@@ -1,82 +1,88 @@
 #pragma once
 
 #include <HalStorage.h>
-#include <Logging.h>
 #include <stdint.h>
 
-#include <cstring>
 #include <string>
 
-// Cache buffer for storing 2-bit pixels (4 levels) during decode.
-// Packs 4 pixels per byte, MSB first.
-struct PixelCache {
-  uint8_t* buffer;
-  int width;
-  int height;
-  int bytesPerRow;
-  int originX;  // config.x - to convert screen coords to cache coords
-  int originY;  // config.y
+class GfxRenderer;
+
+// Pixel cache file (.pxc v2): the three 1-bit planes an image draws in the BW, GRAYSCALE_LSB and GRAYSCALE_MSB render
+// passes, laid out like the frame buffer of the orientation and position the image was decoded at, so drawing it
+// again is a masked copy of bytes instead of a pixel-by-pixel conversion.
+//
+// - uint32_t magic ("PXC2")
+// - uint16_t width, height (logical)
+// - uint8_t orientation
+// - uint8_t flags (PIXEL_CACHE_HAS_GRAY)
+// - int16_t x, y (logical position)
+// - uint16_t slabCount
+// - slabs: uint16_t start, int16_t step, uint16_t count, uint16_t packedSize[3], then the three PackBits-packed
+//   planes. Byte i of a plane covers frame buffer byte start + i * step: a physical row (step 1) when the image rows
+//   run along the panel rows, otherwise a column of 8 physical pixels (step DISPLAY_WIDTH_BYTES).
+constexpr uint32_t PIXEL_CACHE_MAGIC = 0x32435850;  // "PXC2"
+constexpr uint8_t PIXEL_CACHE_HAS_GRAY = 0x01;
+constexpr uint8_t PIXEL_CACHE_PLANES = 3;
+constexpr size_t PIXEL_CACHE_HEADER_SIZE = 16;
+constexpr size_t PIXEL_CACHE_SLAB_HEADER_SIZE = 6 + 2 * PIXEL_CACHE_PLANES;
 
-  PixelCache() : buffer(nullptr), width(0), height(0), bytesPerRow(0), originX(0), originY(0) {}
+// Streams the 2-bit pixels (4 levels) of an image being decoded into its cache file. Only a band of rows is held in
+// RAM: decoders fill rows top to bottom (within the band in any order), and rows leaving the band are split into
+// the frame buffer planes and appended to the file. Rows that never get a pixel (e.g. skipped while upscaling) stay
+// 0. The file is only kept once finish() succeeds.
+struct PixelCache {
+  PixelCache() = default;
   PixelCache(const PixelCache&) = delete;
   PixelCache& operator=(const PixelCache&) = delete;
+  ~PixelCache();
 
-  static constexpr size_t MAX_CACHE_BYTES = 256 * 1024;  // 256KB limit for embedded targets
+  // rowsInBand: how many rows a decoder may fill out of order (e.g. the output rows of one JPEG MCU row)
+  bool begin(const GfxRenderer& renderer, const std::string& cachePath, int w, int h, int ox, int oy, int rowsInBand);
 
-  bool allocate(int w, int h, int ox, int oy) {
-    width = w;
-    height = h;
-    originX = ox;
-    originY = oy;
-    bytesPerRow = (w + 3) / 4;  // 2 bits per pixel, 4 pixels per byte
-    size_t bufferSize = (size_t)bytesPerRow * h;
-    if (bufferSize > MAX_CACHE_BYTES) {
-      LOG_ERR("IMG", "Cache buffer too large: %d bytes for %dx%d (limit %d)", bufferSize, w, h, MAX_CACHE_BYTES);
-      return false;
-    }
-    buffer = (uint8_t*)malloc(bufferSize);
-    if (buffer) {
-      memset(buffer, 0, bufferSize);
-      LOG_DBG("IMG", "Allocated cache buffer: %d bytes for %dx%d", bufferSize, w, h);
-    }
-    return buffer != nullptr;
-  }
+  // Packed 2-bit buffer of a screen row, for setRowPixel(). Rows above it still in the band are written out first
+  // when it doesn't fit. nullptr if the row is outside the image or already written.
+  uint8_t* getRow(int screenY);
 
-  void setPixel(int screenX, int screenY, uint8_t value) {
-    if (!buffer) return;
-    int localX = screenX - originX;
-    int localY = screenY - originY;
-    if (localX < 0 || localX >= width || localY < 0 || localY >= height) return;
-
-    int byteIdx = localY * bytesPerRow + localX / 4;
-    int bitShift = 6 - (localX % 4) * 2;  // MSB first: pixel 0 at bits 6-7
-    buffer[byteIdx] = (buffer[byteIdx] & ~(0x03 << bitShift)) | ((value & 0x03) << bitShift);
+  void setRowPixel(uint8_t* row, int screenX, uint8_t value) const {
+    const int localX = screenX - originX;
+    if (localX < 0 || localX >= width) return;
+    const int bitShift = 6 - (localX % 4) * 2;  // MSB first: pixel 0 at bits 6-7
+    row[localX / 4] = (row[localX / 4] & ~(0x03 << bitShift)) | ((value & 0x03) << bitShift);
   }
 
-  bool writeToFile(const std::string& cachePath) {
-    if (!buffer) return false;
+  // Rows above screenY are complete and can go to the file
+  void flushRowsBefore(int screenY);
 
-    FsFile cacheFile;
-    if (!Storage.openFileForWrite("IMG", cachePath, cacheFile)) {
-      LOG_ERR("IMG", "Failed to open cache file for writing: %s", cachePath.c_str());
-      return false;
-    }
+  // Writes the remaining rows and completes the header. Returns false (and removes the file) if any write failed.
+  bool finish();
 
-    uint16_t w = width;
-    uint16_t h = height;
-    cacheFile.write(&w, 2);
-    cacheFile.write(&h, 2);
-    cacheFile.write(buffer, bytesPerRow * height);
-    cacheFile.close();
+ private:
+  const GfxRenderer* renderer = nullptr;
+  FsFile file;
+  std::string path;
+  uint8_t* band = nullptr;
+  int width = 0;
+  int height = 0;
+  int bytesPerRow = 0;
+  int bandRows = 0;
+  int bandStart = 0;  // First image row not yet written to the file
+  int originX = 0;    // config.x - to convert screen coords to cache coords
+  int originY = 0;    // config.y
+  bool failed = false;
+  uint8_t flags = 0;
 
-    LOG_DBG("IMG", "Cache written: %s (%dx%d, %d bytes)", cachePath.c_str(), width, height, 4 + bytesPerRow * height);
-    return true;
-  }
+  // Plane bytes of the slab being collected, and room to pack one of them
+  bool rowsAlongPanelRows = false;
+  int phyLeft = 0;
+  int phyTop = 0;
+  int slabCapacity = 0;
+  uint8_t* slab = nullptr;
+  uint8_t* packed = nullptr;
+  int slabKey = -1;  // Physical row, or physical byte column, of the slab being collected
+  uint16_t slabCount = 0;
 
-  ~PixelCache() {
-    if (buffer) {
-      free(buffer);
-      buffer = nullptr;
-    }
-  }
+  void flushRow();
+  void writeSlab();
+  void writeHeader();
+  void release();
 };
@@ -5,17 +5,19 @@
 #include <Logging.h>
 #include <PNGdec.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <new>
 
 #include "DitherUtils.h"
+#include "ImageSource.h"
 #include "PixelCache.h"
 
 namespace {
 
 // Context struct passed through PNGdec callbacks to avoid global mutable state.
 // The draw callback receives this via pDraw->pUser (set by png.decode()).
-// The file I/O callbacks receive the FsFile* via pFile->fHandle (set by pngOpen()).
+// The file I/O callbacks receive the ImageSource* via pFile->fHandle (set by pngOpenWithHandle()).
 struct PngContext {
   GfxRenderer* renderer;
   const RenderConfig* config;
@@ -33,7 +35,11 @@ struct PngContext {
   PixelCache cache;
   bool caching;
 
-  uint8_t* grayLineBuffer;
+  // Output row: the source sample of each output pixel is converted to gray and dithered in place, so the buffers
+  // are sized by the output width however wide the PNG is
+  int rowWidth;          // Output pixels of a row that land on the screen
+  uint16_t* srcOffsets;  // Byte offset in the source scanline of each output pixel
+  uint8_t* grayRow;
 
   PngContext()
       : renderer(nullptr),
@@ -47,39 +53,45 @@ struct PngContext {
         dstHeight(0),
         lastDstY(-1),
         caching(false),
-        grayLineBuffer(nullptr) {}
+        rowWidth(0),
+        srcOffsets(nullptr),
+        grayRow(nullptr) {}
 };
 
-// File I/O callbacks use pFile->fHandle to access the FsFile*,
-// avoiding the need for global file state.
-void* pngOpenWithHandle(const char* filename, int32_t* size) {
-  FsFile* f = new FsFile();
-  if (!Storage.openFileForRead("PNG", std::string(filename), *f)) {
-    delete f;
-    return nullptr;
-  }
-  *size = f->size();
-  return f;
+// File I/O callbacks use pFile->fHandle to access the ImageSource*. PNGdec's open callback only gets a name, so the
+// source being opened is handed over through openingSource (decodes run one at a time).
+ImageSource* openingSource = nullptr;
+
+void* pngOpenWithHandle(const char* /*filename*/, int32_t* size) {
+  ImageSource* source = openingSource;
+  if (!source) return nullptr;
+  *size = source->size();
+  return source;
 }
 
-void pngCloseWithHandle(void* handle) {
-  FsFile* f = reinterpret_cast<FsFile*>(handle);
-  if (f) {
-    f->close();
-    delete f;
-  }
+void pngCloseWithHandle(void* /*handle*/) {
+  // The source belongs to the caller of decodeToFramebuffer() / getDimensionsStatic()
 }
 
 int32_t pngReadWithHandle(PNGFILE* pFile, uint8_t* pBuf, int32_t len) {
-  FsFile* f = reinterpret_cast<FsFile*>(pFile->fHandle);
-  if (!f) return 0;
-  return f->read(pBuf, len);
+  ImageSource* source = reinterpret_cast<ImageSource*>(pFile->fHandle);
+  if (!source) return 0;
+  const int read = source->read(pBuf, len);
+  return read < 0 ? 0 : read;
 }
 
 int32_t pngSeekWithHandle(PNGFILE* pFile, int32_t pos) {
-  FsFile* f = reinterpret_cast<FsFile*>(pFile->fHandle);
-  if (!f) return -1;
-  return f->seek(pos);
+  ImageSource* source = reinterpret_cast<ImageSource*>(pFile->fHandle);
+  if (!source) return -1;
+  return source->seek(pos);
+}
+
+int openPng(PNG* png, ImageSource& source, PNG_DRAW_CALLBACK* drawCallback) {
+  openingSource = &source;
+  const int rc = png->open(source.getName().c_str(), pngOpenWithHandle, pngCloseWithHandle, pngReadWithHandle,
+                           pngSeekWithHandle, drawCallback);
+  openingSource = nullptr;
+  return rc;
 }
 
 // The PNG decoder (PNGdec) is ~42 KB due to internal zlib decompression buffers.
@@ -115,19 +127,22 @@ int requiredPngInternalBufferBytes(int srcWidth, int pixelType) {
   return ((pitch + 1) * 2) + 32;
 }
 
-// Convert entire source line to grayscale with alpha blending to white background.
+// Converts the source pixels at srcOffsets of a scanline to grayscale with alpha blending to white background, one
+// per output pixel, which downsamples the line to the output width as it is read.
 // For indexed PNGs with tRNS chunk, alpha values are stored at palette[768] onwards.
-// Processing the whole line at once improves cache locality and reduces per-pixel overhead.
-void convertLineToGray(uint8_t* pPixels, uint8_t* grayLine, int width, int pixelType, uint8_t* palette, int hasAlpha) {
+void convertRowToGray(const uint8_t* pPixels, const uint16_t* srcOffsets, uint8_t* grayRow, int width, int pixelType,
+                      const uint8_t* palette, int hasAlpha) {
   switch (pixelType) {
     case PNG_PIXEL_GRAYSCALE:
-      memcpy(grayLine, pPixels, width);
+      for (int x = 0; x < width; x++) {
+        grayRow[x] = pPixels[srcOffsets[x]];
+      }
       break;
 
     case PNG_PIXEL_TRUECOLOR:
       for (int x = 0; x < width; x++) {
-        uint8_t* p = &pPixels[x * 3];
-        grayLine[x] = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
+        const uint8_t* p = &pPixels[srcOffsets[x]];
+        grayRow[x] = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
       }
       break;
 
@@ -135,52 +150,54 @@ void convertLineToGray(uint8_t* pPixels, uint8_t* grayLine, int width, int pixel
       if (palette) {
         if (hasAlpha) {
           for (int x = 0; x < width; x++) {
-            uint8_t idx = pPixels[x];
-            uint8_t* p = &palette[idx * 3];
+            uint8_t idx = pPixels[srcOffsets[x]];
+            const uint8_t* p = &palette[idx * 3];
             uint8_t gray = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
             uint8_t alpha = palette[768 + idx];
-            grayLine[x] = (uint8_t)((gray * alpha + 255 * (255 - alpha)) / 255);
+            grayRow[x] = (uint8_t)((gray * alpha + 255 * (255 - alpha)) / 255);
           }
         } else {
           for (int x = 0; x < width; x++) {
-            uint8_t* p = &palette[pPixels[x] * 3];
-            grayLine[x] = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
+            const uint8_t* p = &palette[pPixels[srcOffsets[x]] * 3];
+            grayRow[x] = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
           }
         }
       } else {
-        memcpy(grayLine, pPixels, width);
+        for (int x = 0; x < width; x++) {
+          grayRow[x] = pPixels[srcOffsets[x]];
+        }
       }
       break;
 
     case PNG_PIXEL_GRAY_ALPHA:
       for (int x = 0; x < width; x++) {
-        uint8_t gray = pPixels[x * 2];
-        uint8_t alpha = pPixels[x * 2 + 1];
-        grayLine[x] = (uint8_t)((gray * alpha + 255 * (255 - alpha)) / 255);
+        const uint8_t* p = &pPixels[srcOffsets[x]];
+        uint8_t gray = p[0];
+        uint8_t alpha = p[1];
+        grayRow[x] = (uint8_t)((gray * alpha + 255 * (255 - alpha)) / 255);
       }
       break;
 
     case PNG_PIXEL_TRUECOLOR_ALPHA:
       for (int x = 0; x < width; x++) {
-        uint8_t* p = &pPixels[x * 4];
+        const uint8_t* p = &pPixels[srcOffsets[x]];
         uint8_t gray = (uint8_t)((p[0] * 77 + p[1] * 150 + p[2] * 29) >> 8);
         uint8_t alpha = p[3];
-        grayLine[x] = (uint8_t)((gray * alpha + 255 * (255 - alpha)) / 255);
+        grayRow[x] = (uint8_t)((gray * alpha + 255 * (255 - alpha)) / 255);
       }
       break;
 
     default:
-      memset(grayLine, 128, width);
+      memset(grayRow, 128, width);
       break;
   }
 }
 
 int pngDrawCallback(PNGDRAW* pDraw) {
   PngContext* ctx = reinterpret_cast<PngContext*>(pDraw->pUser);
-  if (!ctx || !ctx->config || !ctx->renderer || !ctx->grayLineBuffer) return 0;
+  if (!ctx || !ctx->config || !ctx->renderer || !ctx->grayRow) return 0;
 
   int srcY = pDraw->y;
-  int srcWidth = ctx->srcWidth;
 
   // Calculate destination Y with scaling
   int dstY = (int)(srcY * ctx->scale);
@@ -189,47 +206,36 @@ int pngDrawCallback(PNGDRAW* pDraw) {
   if (dstY == ctx->lastDstY) return 1;
   ctx->lastDstY = dstY;
 
+  // Returning 0 stops the decode
+  if (ctx->config->shouldAbort && ctx->config->shouldAbort()) return 0;
+
   // Check bounds
   if (dstY >= ctx->dstHeight) return 1;
 
   int outY = ctx->config->y + dstY;
   if (outY >= ctx->screenHeight) return 1;
 
-  // Convert entire source line to grayscale (improves cache locality)
-  convertLineToGray(pDraw->pPixels, ctx->grayLineBuffer, srcWidth, pDraw->iPixelType, pDraw->pPalette,
-                    pDraw->iHasAlpha);
-
-  // Render scaled row using Bresenham-style integer stepping (no floating-point division)
-  int dstWidth = ctx->dstWidth;
-  int outXBase = ctx->config->x;
-  int screenWidth = ctx->screenWidth;
-  bool useDithering = ctx->config->useDithering;
-  bool caching = ctx->caching;
-
-  int srcX = 0;
-  int error = 0;
-
-  for (int dstX = 0; dstX < dstWidth; dstX++) {
-    int outX = outXBase + dstX;
-    if (outX < screenWidth) {
-      uint8_t gray = ctx->grayLineBuffer[srcX];
-
-      uint8_t ditheredGray;
-      if (useDithering) {
-        ditheredGray = applyBayerDither4Level(gray, outX, outY);
-      } else {
-        ditheredGray = gray / 85;
-        if (ditheredGray > 3) ditheredGray = 3;
-      }
-      drawPixelWithRenderMode(*ctx->renderer, outX, outY, ditheredGray);
-      if (caching) ctx->cache.setPixel(outX, outY, ditheredGray);
+  // Only the source pixels the output row samples are converted
+  const int rowWidth = ctx->rowWidth;
+  uint8_t* row = ctx->grayRow;
+  convertRowToGray(pDraw->pPixels, ctx->srcOffsets, row, rowWidth, pDraw->iPixelType, pDraw->pPalette,
+                   pDraw->iHasAlpha);
+
+  // Dithered once in place to the 4 levels, then handed to the frame buffer and the cache
+  const int outXBase = ctx->config->x;
+  if (ctx->config->useDithering) {
+    for (int dstX = 0; dstX < rowWidth; dstX++) {
+      row[dstX] = applyBayerDither4Level(row[dstX], outXBase + dstX, outY);
     }
-
-    // Bresenham-style stepping: advance srcX based on ratio srcWidth/dstWidth
-    error += srcWidth;
-    while (error >= dstWidth) {
-      error -= dstWidth;
-      srcX++;
+  } else {
+    for (int dstX = 0; dstX < rowWidth; dstX++) {
+      row[dstX] = row[dstX] / 85 > 3 ? 3 : row[dstX] / 85;
+    }
+  }
+  if (!ctx->config->cacheOnly) drawRowWithRenderMode(*ctx->renderer, outXBase, outY, row, rowWidth);
+  if (uint8_t* cacheRow = ctx->caching ? ctx->cache.getRow(outY) : nullptr) {
+    for (int dstX = 0; dstX < rowWidth; dstX++) {
+      ctx->cache.setRowPixel(cacheRow, outXBase + dstX, row[dstX]);
     }
   }
 
@@ -238,7 +244,7 @@ int pngDrawCallback(PNGDRAW* pDraw) {
 
 }  // namespace
 
-bool PngToFramebufferConverter::getDimensionsStatic(const std::string& imagePath, ImageDimensions& out) {
+bool PngToFramebufferConverter::getDimensionsStatic(ImageSource& source, ImageDimensions& out) {
   size_t freeHeap = ESP.getFreeHeap();
   if (freeHeap < MIN_FREE_HEAP_FOR_PNG) {
     LOG_ERR("PNG", "Not enough heap for PNG decoder (%u free, need %u)", freeHeap, MIN_FREE_HEAP_FOR_PNG);
@@ -251,8 +257,7 @@ bool PngToFramebufferConverter::getDimensionsStatic(const std::string& imagePath
     return false;
   }
 
-  int rc = png->open(imagePath.c_str(), pngOpenWithHandle, pngCloseWithHandle, pngReadWithHandle, pngSeekWithHandle,
-                     nullptr);
+  int rc = openPng(png, source, nullptr);
 
   if (rc != 0) {
     LOG_ERR("PNG", "Failed to open PNG for dimensions: %d", rc);
@@ -268,9 +273,9 @@ bool PngToFramebufferConverter::getDimensionsStatic(const std::string& imagePath
   return true;
 }
 
-bool PngToFramebufferConverter::decodeToFramebuffer(const std::string& imagePath, GfxRenderer& renderer,
+bool PngToFramebufferConverter::decodeToFramebuffer(ImageSource& source, GfxRenderer& renderer,
                                                     const RenderConfig& config) {
-  LOG_DBG("PNG", "Decoding PNG: %s", imagePath.c_str());
+  LOG_DBG("PNG", "Decoding PNG: %s", source.getName().c_str());
 
   size_t freeHeap = ESP.getFreeHeap();
   if (freeHeap < MIN_FREE_HEAP_FOR_PNG) {
@@ -291,8 +296,7 @@ bool PngToFramebufferConverter::decodeToFramebuffer(const std::string& imagePath
   ctx.screenWidth = renderer.getScreenWidth();
   ctx.screenHeight = renderer.getScreenHeight();
 
-  int rc = png->open(imagePath.c_str(), pngOpenWithHandle, pngCloseWithHandle, pngReadWithHandle, pngSeekWithHandle,
-                     pngDrawCallback);
+  int rc = openPng(png, source, pngDrawCallback);
   if (rc != PNG_SUCCESS) {
     LOG_ERR("PNG", "Failed to open PNG: %d", rc);
     delete png;
@@ -342,24 +346,33 @@ bool PngToFramebufferConverter::decodeToFramebuffer(const std::string& imagePath
   }
 
   if (png->getBpp() != 8) {
-    warnUnsupportedFeature("bit depth (" + std::to_string(png->getBpp()) + "bpp)", imagePath);
+    warnUnsupportedFeature("bit depth (" + std::to_string(png->getBpp()) + "bpp)", source.getName());
   }
 
-  // Allocate grayscale line buffer on demand (~3.2 KB) - freed after decode
-  const size_t grayBufSize = PNG_MAX_BUFFERED_PIXELS / 2;
-  ctx.grayLineBuffer = static_cast<uint8_t*>(malloc(grayBufSize));
-  if (!ctx.grayLineBuffer) {
-    LOG_ERR("PNG", "Failed to allocate gray line buffer");
+  // Output row buffers (3 bytes per output pixel, at most a screen width) - freed after decode. Each output pixel
+  // samples the source pixel under it, the same one Bresenham-style stepping across the row would land on.
+  ctx.rowWidth = std::max(0, std::min(ctx.dstWidth, ctx.screenWidth - config.x));
+  const int bytesPerPixel = bytesPerPixelFromType(pixelType);
+  ctx.srcOffsets = static_cast<uint16_t*>(malloc(std::max(1, ctx.rowWidth) * sizeof(uint16_t)));
+  ctx.grayRow = static_cast<uint8_t*>(malloc(std::max(1, ctx.rowWidth)));
+  if (!ctx.srcOffsets || !ctx.grayRow) {
+    LOG_ERR("PNG", "Failed to allocate row buffers");
+    free(ctx.srcOffsets);
+    free(ctx.grayRow);
     png->close();
     delete png;
     return false;
   }
+  for (int dstX = 0; dstX < ctx.rowWidth; dstX++) {
+    const int srcX = static_cast<int>(static_cast<int64_t>(dstX) * ctx.srcWidth / ctx.dstWidth);
+    ctx.srcOffsets[dstX] = static_cast<uint16_t>(std::min(srcX, ctx.srcWidth - 1) * bytesPerPixel);
+  }
 
-  // Allocate cache buffer using SCALED dimensions
+  // Stream the cache using SCALED dimensions; PNG rows arrive in order, so one row is buffered at a time
   ctx.caching = !config.cachePath.empty();
   if (ctx.caching) {
-    if (!ctx.cache.allocate(ctx.dstWidth, ctx.dstHeight, config.x, config.y)) {
-      LOG_ERR("PNG", "Failed to allocate cache buffer, continuing without caching");
+    if (!ctx.cache.begin(renderer, config.cachePath, ctx.dstWidth, ctx.dstHeight, config.x, config.y, 1)) {
+      LOG_ERR("PNG", "Failed to start cache file, continuing without caching");
       ctx.caching = false;
     }
   }
@@ -368,8 +381,10 @@ bool PngToFramebufferConverter::decodeToFramebuffer(const std::string& imagePath
   rc = png->decode(&ctx, 0);
   unsigned long decodeTime = millis() - decodeStart;
 
-  free(ctx.grayLineBuffer);
-  ctx.grayLineBuffer = nullptr;
+  free(ctx.srcOffsets);
+  free(ctx.grayRow);
+  ctx.srcOffsets = nullptr;
+  ctx.grayRow = nullptr;
 
   if (rc != PNG_SUCCESS) {
     LOG_ERR("PNG", "Decode failed: %d", rc);
@@ -382,9 +397,9 @@ bool PngToFramebufferConverter::decodeToFramebuffer(const std::string& imagePath
   delete png;
   LOG_DBG("PNG", "PNG decoding complete - render time: %lu ms", decodeTime);
 
-  // Write cache file if caching was enabled and buffer was allocated
+  // Complete the cache file if caching was enabled
   if (ctx.caching) {
-    ctx.cache.writeToFile(config.cachePath);
+    ctx.cache.finish();
   }
 
   return true;
@@ -0,0 +1,131 @@
+#include "CssNameFilter.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+constexpr uint8_t CSS_NAMES_FILE_VERSION = 1;
+constexpr uint32_t BIT_COUNT = CssNameFilter::BYTES * 8;
+// 3 bits per name keeps false positives under 1% up to ~150 distinct names in a chapter
+constexpr int HASH_COUNT = 3;
+
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+uint64_t nameHash(const std::string_view name) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (const char c : name) {
+    hash ^= static_cast<uint8_t>(std::tolower(static_cast<unsigned char>(c)));
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+// The bits of a name are picked by double hashing the two halves of its 64-bit hash
+template <typename Fn>
+void forEachBit(const std::string_view name, const Fn& fn) {
+  const uint64_t hash = nameHash(name);
+  const auto h1 = static_cast<uint32_t>(hash);
+  const auto h2 = static_cast<uint32_t>(hash >> 32) | 1;
+  for (int i = 0; i < HASH_COUNT; i++) {
+    fn((h1 + i * h2) % BIT_COUNT);
+  }
+}
+
+bool isClassSeparator(const char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
+
+uint32_t slotOffset(const int spineIndex) {
+  return sizeof(CSS_NAMES_FILE_VERSION) + static_cast<uint32_t>(spineIndex) * CssNameFilter::BYTES;
+}
+}  // namespace
+
+void CssNameFilter::addElement(const std::string_view tagName, const std::string_view classAttr) {
+  add(tagName);
+  size_t start = 0;
+  while (start < classAttr.size()) {
+    while (start < classAttr.size() && isClassSeparator(classAttr[start])) start++;
+    size_t end = start;
+    while (end < classAttr.size() && !isClassSeparator(classAttr[end])) end++;
+    if (end > start) {
+      add(classAttr.substr(start, end - start));
+    }
+    start = end;
+  }
+}
+
+void CssNameFilter::add(const std::string_view name) {
+  forEachBit(name, [this](const uint32_t bit) { bits[bit / 8] |= 1 << (bit % 8); });
+}
+
+bool CssNameFilter::mayContain(const std::string_view name) const {
+  bool found = true;
+  forEachBit(name, [this, &found](const uint32_t bit) { found = found && (bits[bit / 8] & 1 << (bit % 8)) != 0; });
+  return found;
+}
+
+bool CssNameFilter::empty() const {
+  for (const uint8_t byte : bits) {
+    if (byte != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CssNameFilter::load(const std::string& path, const int spineIndex) {
+  FsFile file;
+  if (spineIndex < 0 || !Storage.exists(path.c_str()) || !Storage.openFileForRead("CSS", path, file)) {
+    return false;
+  }
+  uint8_t version = 0;
+  serialization::readPod(file, version);
+  const bool ok = version == CSS_NAMES_FILE_VERSION && file.size() >= slotOffset(spineIndex) + BYTES &&
+                  file.seek(slotOffset(spineIndex)) && file.read(bits, BYTES) == static_cast<int>(BYTES);
+  file.close();
+  // A slot never written is all zeroes
+  if (!ok || empty()) {
+    *this = {};
+    return false;
+  }
+  return true;
+}
+
+bool CssNameFilter::save(const std::string& path, const int spineIndex) const {
+  if (spineIndex < 0) {
+    return false;
+  }
+  FsFile file = Storage.open(path.c_str(), O_RDWR | O_CREAT);
+  if (!file) {
+    LOG_ERR("CSS", "Failed to open %s for writing", path.c_str());
+    return false;
+  }
+  uint8_t version = 0;
+  if (file.size() > 0) {
+    serialization::readPod(file, version);
+  }
+  if (version != CSS_NAMES_FILE_VERSION) {
+    file.truncate(0);
+    file.seek(0);
+    serialization::writePod(file, CSS_NAMES_FILE_VERSION);
+  }
+  // Chapters not recorded yet before this one get empty slots
+  const uint32_t offset = slotOffset(spineIndex);
+  if (file.size() < offset) {
+    static constexpr uint8_t zeroes[BYTES] = {};
+    file.seek(file.size());
+    while (file.size() < offset) {
+      if (file.write(zeroes, std::min<size_t>(BYTES, offset - file.size())) == 0) {
+        file.close();
+        return false;
+      }
+    }
+  }
+  file.seek(offset);
+  const bool ok = file.write(bits, BYTES) == BYTES;
+  file.close();
+  return ok;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Bloom filter of the tag and class names a chapter styles its elements by, kept per spine item in css_names.bin in
+// the book's cache directory (the names come from the XHTML alone, so they serve every layout). A build of the chapter
+// after the first loads only the CSS rules whose selectors could match one of its elements: a rule for a name the
+// filter has never seen can't apply, one it may have seen is kept.
+class CssNameFilter {
+ public:
+  static constexpr size_t BYTES = 256;
+
+  // Where a book cache directory keeps the filters of its chapters
+  static std::string getPath(const std::string& cacheDir) { return cacheDir + "/css_names.bin"; }
+
+  // Adds an element's tag name and each of the whitespace-separated names of its class attribute
+  void addElement(std::string_view tagName, std::string_view classAttr);
+  void add(std::string_view name);
+  // Whether name was possibly added; compared lowercased, as CssParser stores selectors
+  bool mayContain(std::string_view name) const;
+  bool empty() const;
+
+  // Reads the filter recorded for a spine item; false if there is none
+  bool load(const std::string& path, int spineIndex);
+  // Records the filter of a spine item, replacing any it had
+  bool save(const std::string& path, int spineIndex) const;
+
+ private:
+  uint8_t bits[BYTES] = {};
+};
@@ -2,37 +2,17 @@
 
 #include <Arduino.h>
 #include <Logging.h>
+#include <ZipFile.h>
 
 #include <algorithm>
 #include <array>
 #include <cctype>
+#include <cstdlib>
 #include <string_view>
 
-namespace {
-
-// Stack-allocated string buffer to avoid heap reallocations during parsing
-// Provides string-like interface with fixed capacity
-struct StackBuffer {
-  static constexpr size_t CAPACITY = 1024;
-  char data[CAPACITY];
-  size_t len = 0;
+#include "CssNameFilter.h"
 
-  void push_back(char c) {
-    if (len < CAPACITY - 1) {
-      data[len++] = c;
-    }
-  }
-
-  void clear() { len = 0; }
-  bool empty() const { return len == 0; }
-  size_t size() const { return len; }
-
-  // Get string view of current content (zero-copy)
-  std::string_view view() const { return std::string_view(data, len); }
-
-  // Convert to string for passing to functions (single allocation)
-  std::string str() const { return std::string(data, len); }
-};
+namespace {
 
 // Buffer size for reading CSS files
 constexpr size_t READ_BUFFER_SIZE = 512;
@@ -49,99 +29,142 @@ constexpr size_t MIN_FREE_HEAP_FOR_CSS = 48 * 1024;
 // Prevents parsing of extremely long or malformed selectors
 constexpr size_t MAX_SELECTOR_LENGTH = 256;
 
+// Capacity of the buffers a selector group and a declaration are collected into
+constexpr size_t SELECTOR_GROUP_CAPACITY = MAX_SELECTOR_LENGTH * 4;
+constexpr size_t PROPERTY_NAME_CAPACITY = 32;
+constexpr size_t PROPERTY_VALUE_CAPACITY = 256;
+
 // Check if character is CSS whitespace
 bool isCssWhitespace(const char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f'; }
 
-}  // anonymous namespace
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
 
-// String utilities implementation
+char lowered(const char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); }
 
-std::string CssParser::normalized(const std::string& s) {
-  std::string result;
-  result.reserve(s.size());
+// FNV-1a of the text lowercased (as selectors are stored), continuing from hash
+uint64_t hashLowered(uint64_t hash, const std::string_view text) {
+  for (const char c : text) {
+    hash ^= static_cast<uint8_t>(lowered(c));
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
 
-  bool inSpace = true;  // Start true to skip leading space
-  for (const char c : s) {
-    if (isCssWhitespace(c)) {
-      if (!inSpace) {
-        result.push_back(' ');
-        inSpace = true;
-      }
-    } else {
-      result.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
-      inSpace = false;
+bool equalsLowered(const char* stored, const std::string_view text) {
+  for (size_t i = 0; i < text.size(); i++) {
+    if (stored[i] != lowered(text[i])) {
+      return false;
     }
   }
+  return true;
+}
 
-  // Remove trailing space
-  while (!result.empty() && (result.back() == ' ' || result.back() == '\n')) {
-    result.pop_back();
+uint64_t selectorHash(const std::string_view tag, const std::string_view cls) {
+  uint64_t hash = hashLowered(FNV_OFFSET_BASIS, tag);
+  if (!cls.empty()) {
+    hash = hashLowered(hash, ".");
+    hash = hashLowered(hash, cls);
   }
-  return result;
+  return hash;
 }
 
-void CssParser::normalizedInto(const std::string& s, std::string& out) {
-  out.clear();
-  out.reserve(s.size());
+// Stack-allocated text collected a character at a time, normalized as it arrives: lowercased, with each run of
+// whitespace collapsed to one space and none kept at either end. Text past the capacity is dropped and marks the
+// buffer truncated.
+template <size_t Capacity>
+struct NormalizedBuffer {
+  char data[Capacity];
+  size_t len = 0;
+  bool spacePending = false;
+  bool overflowed = false;
 
-  bool inSpace = true;  // Start true to skip leading space
-  for (const char c : s) {
+  void push_back(const char c) {
     if (isCssWhitespace(c)) {
-      if (!inSpace) {
-        out.push_back(' ');
-        inSpace = true;
-      }
-    } else {
-      out.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
-      inSpace = false;
+      spacePending = len > 0;
+      return;
+    }
+    if (len + (spacePending ? 2 : 1) > Capacity) {
+      overflowed = true;
+      return;
+    }
+    if (spacePending) {
+      data[len++] = ' ';
+      spacePending = false;
     }
+    data[len++] = lowered(c);
   }
 
-  if (!out.empty() && out.back() == ' ') {
-    out.pop_back();
+  void clear() {
+    len = 0;
+    spacePending = false;
+    overflowed = false;
   }
-}
+  bool empty() const { return len == 0; }
+  bool truncated() const { return overflowed; }
 
-std::vector<std::string> CssParser::splitOnChar(const std::string& s, const char delimiter) {
-  std::vector<std::string> parts;
-  size_t start = 0;
+  // Get string view of current content (zero-copy)
+  std::string_view view() const { return std::string_view(data, len); }
+};
 
-  for (size_t i = 0; i <= s.size(); ++i) {
-    if (i == s.size() || s[i] == delimiter) {
-      std::string part = s.substr(start, i - start);
-      std::string trimmed = normalized(part);
-      if (!trimmed.empty()) {
-        parts.push_back(trimmed);
-      }
-      start = i + 1;
-    }
+// Text of a normalized view up to the first `delimiter` (or all of it), without the space normalization may have
+// left on either side of the delimiter; rest is left after the delimiter
+std::string_view takeUntil(std::string_view& rest, const char delimiter) {
+  const size_t end = rest.find(delimiter);
+  std::string_view part = rest.substr(0, end);
+  rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+  if (!part.empty() && part.front() == ' ') part.remove_prefix(1);
+  if (!part.empty() && part.back() == ' ') part.remove_suffix(1);
+  return part;
+}
+
+// Copies a short normalized value NUL-terminated for the strto* functions; false if it doesn't fit
+template <size_t Size>
+bool copyTerminated(const std::string_view text, char (&out)[Size]) {
+  if (text.size() >= Size) {
+    return false;
   }
-  return parts;
+  text.copy(out, text.size());
+  out[text.size()] = '\0';
+  return true;
 }
 
-std::vector<std::string> CssParser::splitWhitespace(const std::string& s) {
-  std::vector<std::string> parts;
-  size_t start = 0;
-  bool inWord = false;
+}  // anonymous namespace
 
-  for (size_t i = 0; i <= s.size(); ++i) {
-    const bool isSpace = i == s.size() || isCssWhitespace(s[i]);
-    if (isSpace && inWord) {
-      parts.push_back(s.substr(start, i - start));
-      inWord = false;
-    } else if (!isSpace && !inWord) {
-      start = i;
-      inWord = true;
+class CssParser::DeclarationReader {
+ public:
+  // A ';' ends the declaration in progress and the first ':' of one separates its name from its value
+  void push(const char c, CssStyle& style) {
+    if (c == ';') {
+      finish(style);
+    } else if (c == ':' && !inValue) {
+      inValue = true;
+    } else if (inValue) {
+      value.push_back(c);
+    } else {
+      name.push_back(c);
     }
   }
-  return parts;
-}
 
-// Property value interpreters
+  // Applies the declaration in progress to style, unless it is incomplete or didn't fit the buffers
+  void finish(CssStyle& style) {
+    if (inValue && !name.empty() && !value.empty() && !name.truncated() && !value.truncated()) {
+      applyDeclaration(name.view(), value.view(), style);
+    }
+    name.clear();
+    value.clear();
+    inValue = false;
+  }
 
-CssTextAlign CssParser::interpretAlignment(const std::string& val) {
-  const std::string v = normalized(val);
+ private:
+  NormalizedBuffer<PROPERTY_NAME_CAPACITY> name;
+  NormalizedBuffer<PROPERTY_VALUE_CAPACITY> value;
+  bool inValue = false;
+};
 
+// Property value interpreters
+
+CssTextAlign CssParser::interpretAlignment(const std::string_view v) {
   if (v == "left" || v == "start") return CssTextAlign::Left;
   if (v == "right" || v == "end") return CssTextAlign::Right;
   if (v == "center") return CssTextAlign::Center;
@@ -150,16 +173,12 @@ CssTextAlign CssParser::interpretAlignment(const std::string& val) {
   return CssTextAlign::Left;
 }
 
-CssFontStyle CssParser::interpretFontStyle(const std::string& val) {
-  const std::string v = normalized(val);
-
+CssFontStyle CssParser::interpretFontStyle(const std::string_view v) {
   if (v == "italic" || v == "oblique") return CssFontStyle::Italic;
   return CssFontStyle::Normal;
 }
 
-CssFontWeight CssParser::interpretFontWeight(const std::string& val) {
-  const std::string v = normalized(val);
-
+CssFontWeight CssParser::interpretFontWeight(const std::string_view v) {
   // Named values
   if (v == "bold" || v == "bolder") return CssFontWeight::Bold;
   if (v == "normal" || v == "lighter") return CssFontWeight::Normal;
@@ -167,56 +186,59 @@ CssFontWeight CssParser::interpretFontWeight(const std::string& val) {
   // Numeric values: 100-900
   // CSS spec: 400 = normal, 700 = bold
   // We use: 0-400 = normal, 700+ = bold, 500-600 = normal (conservative)
+  char number[16];
+  if (!copyTerminated(v, number)) {
+    return CssFontWeight::Normal;
+  }
   char* endPtr = nullptr;
-  const long numericWeight = std::strtol(v.c_str(), &endPtr, 10);
+  const long numericWeight = std::strtol(number, &endPtr, 10);
 
   // If we parsed a number and consumed the whole string
-  if (endPtr != v.c_str() && *endPtr == '\0') {
+  if (endPtr != number && *endPtr == '\0') {
     return numericWeight >= 700 ? CssFontWeight::Bold : CssFontWeight::Normal;
   }
 
   return CssFontWeight::Normal;
 }
 
-CssTextDecoration CssParser::interpretDecoration(const std::string& val) {
-  const std::string v = normalized(val);
-
+CssTextDecoration CssParser::interpretDecoration(const std::string_view v) {
   // text-decoration can have multiple space-separated values
-  if (v.find("underline") != std::string::npos) {
+  if (v.find("underline") != std::string_view::npos) {
     return CssTextDecoration::Underline;
   }
   return CssTextDecoration::None;
 }
 
-CssLength CssParser::interpretLength(const std::string& val) {
+CssLength CssParser::interpretLength(const std::string_view val) {
   CssLength result;
   tryInterpretLength(val, result);
   return result;
 }
 
-bool CssParser::tryInterpretLength(const std::string& val, CssLength& out) {
-  const std::string v = normalized(val);
+bool CssParser::tryInterpretLength(const std::string_view v, CssLength& out) {
+  out = CssLength{};
   if (v.empty()) {
-    out = CssLength{};
     return false;
   }
 
   size_t unitStart = v.size();
   for (size_t i = 0; i < v.size(); ++i) {
     const char c = v[i];
-    if (!std::isdigit(c) && c != '.' && c != '-' && c != '+') {
+    if (!std::isdigit(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '+') {
       unitStart = i;
       break;
     }
   }
 
-  const std::string numPart = v.substr(0, unitStart);
-  const std::string unitPart = v.substr(unitStart);
+  const std::string_view unitPart = v.substr(unitStart);
 
+  char numPart[32];
+  if (!copyTerminated(v.substr(0, unitStart), numPart)) {
+    return false;
+  }
   char* endPtr = nullptr;
-  const float numericValue = std::strtof(numPart.c_str(), &endPtr);
-  if (endPtr == numPart.c_str()) {
-    out = CssLength{};
+  const float numericValue = std::strtof(numPart, &endPtr);
+  if (endPtr == numPart) {
     return false;  // No number parsed (e.g. auto, inherit, initial)
   }
 
@@ -237,134 +259,103 @@ bool CssParser::tryInterpretLength(const std::string& val, CssLength& out) {
 
 // Declaration parsing
 
-void CssParser::parseDeclarationIntoStyle(const std::string& decl, CssStyle& style, std::string& propNameBuf,
-                                          std::string& propValueBuf) {
-  const size_t colonPos = decl.find(':');
-  if (colonPos == std::string::npos || colonPos == 0) return;
-
-  normalizedInto(decl.substr(0, colonPos), propNameBuf);
-  normalizedInto(decl.substr(colonPos + 1), propValueBuf);
-
-  if (propNameBuf.empty() || propValueBuf.empty()) return;
+void CssParser::applyDeclaration(const std::string_view name, const std::string_view value, CssStyle& style) {
+  // Up to four space-separated values of a box shorthand (margin, padding)
+  const auto boxValues = [value](CssLength& top, CssLength& right, CssLength& bottom, CssLength& left) {
+    std::string_view rest = value;
+    std::string_view parts[4];
+    size_t count = 0;
+    while (!rest.empty() && count < 4) {
+      parts[count++] = takeUntil(rest, ' ');
+    }
+    top = interpretLength(parts[0]);
+    right = count >= 2 ? interpretLength(parts[1]) : top;
+    bottom = count >= 3 ? interpretLength(parts[2]) : top;
+    left = count >= 4 ? interpretLength(parts[3]) : right;
+  };
 
-  if (propNameBuf == "text-align") {
-    style.textAlign = interpretAlignment(propValueBuf);
+  if (name == "text-align") {
+    style.textAlign = interpretAlignment(value);
     style.defined.textAlign = 1;
-  } else if (propNameBuf == "font-style") {
-    style.fontStyle = interpretFontStyle(propValueBuf);
+  } else if (name == "font-style") {
+    style.fontStyle = interpretFontStyle(value);
     style.defined.fontStyle = 1;
-  } else if (propNameBuf == "font-weight") {
-    style.fontWeight = interpretFontWeight(propValueBuf);
+  } else if (name == "font-weight") {
+    style.fontWeight = interpretFontWeight(value);
     style.defined.fontWeight = 1;
-  } else if (propNameBuf == "text-decoration" || propNameBuf == "text-decoration-line") {
-    style.textDecoration = interpretDecoration(propValueBuf);
+  } else if (name == "text-decoration" || name == "text-decoration-line") {
+    style.textDecoration = interpretDecoration(value);
     style.defined.textDecoration = 1;
-  } else if (propNameBuf == "text-indent") {
-    style.textIndent = interpretLength(propValueBuf);
+  } else if (name == "text-indent") {
+    style.textIndent = interpretLength(value);
     style.defined.textIndent = 1;
-  } else if (propNameBuf == "margin-top") {
-    style.marginTop = interpretLength(propValueBuf);
+  } else if (name == "margin-top") {
+    style.marginTop = interpretLength(value);
     style.defined.marginTop = 1;
-  } else if (propNameBuf == "margin-bottom") {
-    style.marginBottom = interpretLength(propValueBuf);
+  } else if (name == "margin-bottom") {
+    style.marginBottom = interpretLength(value);
     style.defined.marginBottom = 1;
-  } else if (propNameBuf == "margin-left") {
-    style.marginLeft = interpretLength(propValueBuf);
+  } else if (name == "margin-left") {
+    style.marginLeft = interpretLength(value);
     style.defined.marginLeft = 1;
-  } else if (propNameBuf == "margin-right") {
-    style.marginRight = interpretLength(propValueBuf);
+  } else if (name == "margin-right") {
+    style.marginRight = interpretLength(value);
     style.defined.marginRight = 1;
-  } else if (propNameBuf == "margin") {
-    const auto values = splitWhitespace(propValueBuf);
-    if (!values.empty()) {
-      style.marginTop = interpretLength(values[0]);
-      style.marginRight = values.size() >= 2 ? interpretLength(values[1]) : style.marginTop;
-      style.marginBottom = values.size() >= 3 ? interpretLength(values[2]) : style.marginTop;
-      style.marginLeft = values.size() >= 4 ? interpretLength(values[3]) : style.marginRight;
-      style.defined.marginTop = style.defined.marginRight = style.defined.marginBottom = style.defined.marginLeft = 1;
-    }
-  } else if (propNameBuf == "padding-top") {
-    style.paddingTop = interpretLength(propValueBuf);
+  } else if (name == "margin") {
+    boxValues(style.marginTop, style.marginRight, style.marginBottom, style.marginLeft);
+    style.defined.marginTop = style.defined.marginRight = style.defined.marginBottom = style.defined.marginLeft = 1;
+  } else if (name == "padding-top") {
+    style.paddingTop = interpretLength(value);
     style.defined.paddingTop = 1;
-  } else if (propNameBuf == "padding-bottom") {
-    style.paddingBottom = interpretLength(propValueBuf);
+  } else if (name == "padding-bottom") {
+    style.paddingBottom = interpretLength(value);
     style.defined.paddingBottom = 1;
-  } else if (propNameBuf == "padding-left") {
-    style.paddingLeft = interpretLength(propValueBuf);
+  } else if (name == "padding-left") {
+    style.paddingLeft = interpretLength(value);
     style.defined.paddingLeft = 1;
-  } else if (propNameBuf == "padding-right") {
-    style.paddingRight = interpretLength(propValueBuf);
+  } else if (name == "padding-right") {
+    style.paddingRight = interpretLength(value);
     style.defined.paddingRight = 1;
-  } else if (propNameBuf == "padding") {
-    const auto values = splitWhitespace(propValueBuf);
-    if (!values.empty()) {
-      style.paddingTop = interpretLength(values[0]);
-      style.paddingRight = values.size() >= 2 ? interpretLength(values[1]) : style.paddingTop;
-      style.paddingBottom = values.size() >= 3 ? interpretLength(values[2]) : style.paddingTop;
-      style.paddingLeft = values.size() >= 4 ? interpretLength(values[3]) : style.paddingRight;
-      style.defined.paddingTop = style.defined.paddingRight = style.defined.paddingBottom = style.defined.paddingLeft =
-          1;
-    }
-  } else if (propNameBuf == "height") {
+  } else if (name == "padding") {
+    boxValues(style.paddingTop, style.paddingRight, style.paddingBottom, style.paddingLeft);
+    style.defined.paddingTop = style.defined.paddingRight = style.defined.paddingBottom = style.defined.paddingLeft =
+        1;
+  } else if (name == "height") {
     CssLength len;
-    if (tryInterpretLength(propValueBuf, len)) {
+    if (tryInterpretLength(value, len)) {
       style.imageHeight = len;
       style.defined.imageHeight = 1;
     }
-  } else if (propNameBuf == "width") {
+  } else if (name == "width") {
     CssLength len;
-    if (tryInterpretLength(propValueBuf, len)) {
+    if (tryInterpretLength(value, len)) {
       style.imageWidth = len;
       style.defined.imageWidth = 1;
     }
   }
 }
 
-CssStyle CssParser::parseDeclarations(const std::string& declBlock) {
-  CssStyle style;
-  std::string propNameBuf;
-  std::string propValueBuf;
-
-  size_t start = 0;
-  for (size_t i = 0; i <= declBlock.size(); ++i) {
-    if (i == declBlock.size() || declBlock[i] == ';') {
-      if (i > start) {
-        const size_t len = i - start;
-        std::string decl = declBlock.substr(start, len);
-        if (!decl.empty()) {
-          parseDeclarationIntoStyle(decl, style, propNameBuf, propValueBuf);
-        }
-      }
-      start = i + 1;
-    }
-  }
-
-  return style;
-}
-
 // Rule processing
 
-void CssParser::processRuleBlockWithStyle(const std::string& selectorGroup, const CssStyle& style) {
+void CssParser::processRuleBlockWithStyle(const std::string_view selectorGroup, const CssStyle& style) {
   // Check if we've reached the rule limit before processing
-  if (rulesBySelector_.size() >= MAX_RULES) {
+  if (ruleCount() >= MAX_RULES) {
     LOG_DBG("CSS", "Reached max rules limit (%zu), stopping CSS parsing", MAX_RULES);
     return;
   }
 
-  // Handle comma-separated selectors
-  const auto selectors = splitOnChar(selectorGroup, ',');
+  // Handle comma-separated selectors; the group is already normalized, so each is too once trimmed
+  std::string_view rest = selectorGroup;
+  while (!rest.empty()) {
+    const std::string_view key = takeUntil(rest, ',');
+    if (key.empty()) continue;
 
-  for (const auto& sel : selectors) {
     // Validate selector length before processing
-    if (sel.size() > MAX_SELECTOR_LENGTH) {
-      LOG_DBG("CSS", "Selector too long (%zu > %zu), skipping", sel.size(), MAX_SELECTOR_LENGTH);
+    if (key.size() > MAX_SELECTOR_LENGTH) {
+      LOG_DBG("CSS", "Selector too long (%zu > %zu), skipping", key.size(), MAX_SELECTOR_LENGTH);
       continue;
     }
 
-    // Normalize the selector
-    std::string key = normalized(sel);
-    if (key.empty()) continue;
-
     // TODO: Consider adding support for sibling css selectors in the future
     // Ensure no + in selector as we don't support adjacent CSS selectors for now
     if (key.find('+') != std::string_view::npos) {
@@ -416,37 +407,30 @@ void CssParser::processRuleBlockWithStyle(const std::string& selectorGroup, cons
     }
 
     // Skip if this would exceed the rule limit
-    if (rulesBySelector_.size() >= MAX_RULES) {
+    if (ruleCount() >= MAX_RULES) {
       LOG_DBG("CSS", "Reached max rules limit, stopping selector processing");
       return;
     }
 
     // Store or merge with existing
-    auto it = rulesBySelector_.find(key);
+    std::string stored(key);
+    auto it = rulesBySelector_.find(stored);
     if (it != rulesBySelector_.end()) {
       it->second.applyOver(style);
     } else {
-      rulesBySelector_[key] = style;
+      rulesBySelector_.emplace(std::move(stored), style);
     }
   }
 }
 
 // Main parsing entry point
 
-bool CssParser::loadFromStream(FsFile& source) {
-  if (!source) {
-    LOG_ERR("CSS", "Cannot read from invalid file");
-    return false;
-  }
-
+bool CssParser::loadFromStream(ZipFile& source) {
   size_t totalRead = 0;
 
-  // Use stack-allocated buffers for parsing to avoid heap reallocations
-  StackBuffer selector;
-  StackBuffer declBuffer;
-  // Keep these as std::string since they're passed by reference to parseDeclarationIntoStyle
-  std::string propNameBuf;
-  std::string propValueBuf;
+  // Use stack-allocated buffers for parsing to avoid heap allocations per selector and declaration
+  NormalizedBuffer<SELECTOR_GROUP_CAPACITY> selector;
+  DeclarationReader declaration;
 
   bool inComment = false;
   bool maybeSlash = false;
@@ -456,7 +440,6 @@ bool CssParser::loadFromStream(FsFile& source) {
   int atDepth = 0;
 
   int bodyDepth = 0;
-  bool skippingRule = false;
   CssStyle currentStyle;
 
   auto handleChar = [&](const char c) {
@@ -473,9 +456,6 @@ bool CssParser::loadFromStream(FsFile& source) {
     }
 
     if (bodyDepth == 0) {
-      if (selector.empty() && isCssWhitespace(c)) {
-        return;
-      }
       if (c == '@' && selector.empty()) {
         inAtRule = true;
         atDepth = 0;
@@ -484,10 +464,6 @@ bool CssParser::loadFromStream(FsFile& source) {
       if (c == '{') {
         bodyDepth = 1;
         currentStyle = CssStyle{};
-        declBuffer.clear();
-        if (selector.size() > MAX_SELECTOR_LENGTH * 4) {
-          skippingRule = true;
-        }
         return;
       }
       selector.push_back(c);
@@ -502,15 +478,15 @@ bool CssParser::loadFromStream(FsFile& source) {
     if (c == '}') {
       --bodyDepth;
       if (bodyDepth == 0) {
-        if (!skippingRule && !declBuffer.empty()) {
-          parseDeclarationIntoStyle(declBuffer.str(), currentStyle, propNameBuf, propValueBuf);
-        }
-        if (!skippingRule) {
-          processRuleBlockWithStyle(selector.str(), currentStyle);
+        declaration.finish(currentStyle);
+        std::string_view group = selector.view();
+        if (selector.truncated()) {
+          // The group was cut off in the middle of a selector, which is dropped with whatever followed it
+          const size_t lastComma = group.rfind(',');
+          group = lastComma == std::string_view::npos ? std::string_view() : group.substr(0, lastComma);
         }
+        processRuleBlockWithStyle(group, currentStyle);
         selector.clear();
-        declBuffer.clear();
-        skippingRule = false;
         return;
       }
       return;
@@ -518,27 +494,16 @@ bool CssParser::loadFromStream(FsFile& source) {
     if (bodyDepth > 1) {
       return;
     }
-    if (!skippingRule) {
-      if (c == ';') {
-        if (!declBuffer.empty()) {
-          parseDeclarationIntoStyle(declBuffer.str(), currentStyle, propNameBuf, propValueBuf);
-          declBuffer.clear();
-        }
-      } else {
-        declBuffer.push_back(c);
-      }
-    }
+    declaration.push(c, currentStyle);
   };
 
-  char buffer[READ_BUFFER_SIZE];
-  while (source.available()) {
-    int bytesRead = source.read(buffer, sizeof(buffer));
-    if (bytesRead <= 0) break;
-
+  uint8_t buffer[READ_BUFFER_SIZE];
+  int bytesRead;
+  while ((bytesRead = source.readEntryStream(buffer, sizeof(buffer))) > 0) {
     totalRead += static_cast<size_t>(bytesRead);
 
     for (int i = 0; i < bytesRead; ++i) {
-      const char c = buffer[i];
+      const char c = static_cast<char>(buffer[i]);
 
       if (inComment) {
         if (prevStar && c == '/') {
@@ -571,14 +536,55 @@ bool CssParser::loadFromStream(FsFile& source) {
     }
   }
 
+  if (bytesRead < 0) {
+    LOG_ERR("CSS", "Failed to read stylesheet after %zu bytes", totalRead);
+    rulesBySelector_.clear();
+    return false;
+  }
   if (maybeSlash) {
     handleChar('/');
   }
 
-  LOG_DBG("CSS", "Parsed %zu rules from %zu bytes", rulesBySelector_.size(), totalRead);
+  compileRules();
+  LOG_DBG("CSS", "Parsed %zu rules from %zu bytes", rules_.size(), totalRead);
   return true;
 }
 
+void CssParser::compileRules() {
+  const size_t compiledCount = rules_.size();
+  rules_.reserve(compiledCount + rulesBySelector_.size());
+  for (const auto& pair : rulesBySelector_) {
+    // A selector of an earlier stylesheet gets this one's declarations on top
+    const int existing = findRule(compiledCount, pair.first, {});
+    if (existing >= 0) {
+      rules_[existing].style.applyOver(pair.second);
+    } else {
+      rules_.push_back({selectorHash(pair.first, {}), static_cast<uint32_t>(selectors_.size()),
+                        static_cast<uint16_t>(pair.first.size()), pair.second});
+      selectors_ += pair.first;
+    }
+  }
+  rulesBySelector_.clear();
+  std::sort(rules_.begin(), rules_.end(), [](const Rule& a, const Rule& b) { return a.hash < b.hash; });
+  rules_.shrink_to_fit();
+  selectors_.shrink_to_fit();
+}
+
+int CssParser::findRule(const size_t count, const std::string_view tag, const std::string_view cls) const {
+  const uint64_t hash = selectorHash(tag, cls);
+  const size_t keyLen = tag.size() + (cls.empty() ? 0 : 1 + cls.size());
+  auto it = std::lower_bound(rules_.begin(), rules_.begin() + count, hash,
+                             [](const Rule& rule, const uint64_t h) { return rule.hash < h; });
+  for (; it != rules_.begin() + count && it->hash == hash; ++it) {
+    const char* key = selectors_.data() + it->selectorOffset;
+    if (it->selectorLength == keyLen && equalsLowered(key, tag) &&
+        (cls.empty() || (key[tag.size()] == '.' && equalsLowered(key + tag.size() + 1, cls)))) {
+      return static_cast<int>(it - rules_.begin());
+    }
+  }
+  return -1;
+}
+
 // Style resolution
 
 CssStyle CssParser::resolveStyle(const std::string& tagName, const std::string& classAttr) const {
@@ -592,38 +598,51 @@ CssStyle CssParser::resolveStyle(const std::string& tagName, const std::string&
     return CssStyle{};
   }
   CssStyle result;
-  const std::string tag = normalized(tagName);
+  if (rules_.empty()) {
+    return result;
+  }
+
+  // Tag names never contain whitespace, so normalizing them is just the lowercasing done while hashing
+  const std::string_view tag = tagName;
 
   // 1. Apply element-level style (lowest priority)
-  const auto tagIt = rulesBySelector_.find(tag);
-  if (tagIt != rulesBySelector_.end()) {
-    result.applyOver(tagIt->second);
+  const int tagRule = findRule(rules_.size(), tag, {});
+  if (tagRule >= 0) {
+    result.applyOver(rules_[tagRule].style);
   }
 
+  // Calls fn with each whitespace-separated class name of the attribute
+  const auto forEachClass = [&classAttr](const auto& fn) {
+    size_t start = 0;
+    while (start < classAttr.size()) {
+      while (start < classAttr.size() && isCssWhitespace(classAttr[start])) start++;
+      size_t end = start;
+      while (end < classAttr.size() && !isCssWhitespace(classAttr[end])) end++;
+      if (end > start) {
+        fn(std::string_view(classAttr).substr(start, end - start));
+      }
+      start = end;
+    }
+  };
+
   // TODO: Support combinations of classes (e.g. style on .class1.class2)
   // 2. Apply class styles (medium priority)
   if (!classAttr.empty()) {
-    const auto classes = splitWhitespace(classAttr);
-
-    for (const auto& cls : classes) {
-      std::string classKey = "." + normalized(cls);
-
-      auto classIt = rulesBySelector_.find(classKey);
-      if (classIt != rulesBySelector_.end()) {
-        result.applyOver(classIt->second);
+    forEachClass([&](const std::string_view cls) {
+      const int classRule = findRule(rules_.size(), {}, cls);
+      if (classRule >= 0) {
+        result.applyOver(rules_[classRule].style);
       }
-    }
+    });
 
     // TODO: Support combinations of classes (e.g. style on p.class1.class2)
     // 3. Apply element.class styles (higher priority)
-    for (const auto& cls : classes) {
-      std::string combinedKey = tag + "." + normalized(cls);
-
-      auto combinedIt = rulesBySelector_.find(combinedKey);
-      if (combinedIt != rulesBySelector_.end()) {
-        result.applyOver(combinedIt->second);
+    forEachClass([&](const std::string_view cls) {
+      const int combinedRule = findRule(rules_.size(), tag, cls);
+      if (combinedRule >= 0) {
+        result.applyOver(rules_[combinedRule].style);
       }
-    }
+    });
   }
 
   return result;
@@ -631,45 +650,35 @@ CssStyle CssParser::resolveStyle(const std::string& tagName, const std::string&
 
 // Inline style parsing (static - doesn't need rule database)
 
-CssStyle CssParser::parseInlineStyle(const std::string& styleValue) { return parseDeclarations(styleValue); }
-
-// Cache serialization
-
-// Cache file name (version is CssParser::CSS_CACHE_VERSION)
-constexpr char rulesCache[] = "/css_rules.cache";
-
-bool CssParser::hasCache() const { return Storage.exists((cachePath + rulesCache).c_str()); }
-
-void CssParser::deleteCache() const {
-  if (hasCache()) Storage.remove((cachePath + rulesCache).c_str());
-}
-
-bool CssParser::saveToCache() const {
-  if (cachePath.empty()) {
-    return false;
+CssStyle CssParser::parseInlineStyle(const std::string& styleValue) {
+  CssStyle style;
+  DeclarationReader declaration;
+  for (const char c : styleValue) {
+    declaration.push(c, style);
   }
+  declaration.finish(style);
+  return style;
+}
 
-  FsFile file;
-  if (!Storage.openFileForWrite("CSS", cachePath + rulesCache, file)) {
-    return false;
-  }
+// Cache serialization
 
+bool CssParser::saveToCache(BufferedFileWriter& file) const {
   // Write version
   file.write(CssParser::CSS_CACHE_VERSION);
 
   // Write rule count
-  const auto ruleCount = static_cast<uint16_t>(rulesBySelector_.size());
+  const auto ruleCount = static_cast<uint16_t>(rules_.size());
   file.write(reinterpret_cast<const uint8_t*>(&ruleCount), sizeof(ruleCount));
 
-  // Write each rule: selector string + CssStyle fields
-  for (const auto& pair : rulesBySelector_) {
+  // Write each rule, in hash order: selector string + CssStyle fields
+  for (const auto& rule : rules_) {
     // Write selector string (length-prefixed)
-    const auto selectorLen = static_cast<uint16_t>(pair.first.size());
+    const uint16_t selectorLen = rule.selectorLength;
     file.write(reinterpret_cast<const uint8_t*>(&selectorLen), sizeof(selectorLen));
-    file.write(reinterpret_cast<const uint8_t*>(pair.first.data()), selectorLen);
+    file.write(reinterpret_cast<const uint8_t*>(selectors_.data() + rule.selectorOffset), selectorLen);
 
     // Write CssStyle fields (all are POD types)
-    const CssStyle& style = pair.second;
+    const CssStyle& style = rule.style;
     file.write(static_cast<uint8_t>(style.textAlign));
     file.write(static_cast<uint8_t>(style.fontStyle));
     file.write(static_cast<uint8_t>(style.fontWeight));
@@ -714,55 +723,41 @@ bool CssParser::saveToCache() const {
   }
 
   LOG_DBG("CSS", "Saved %u rules to cache", ruleCount);
-  file.close();
   return true;
 }
 
-bool CssParser::loadFromCache() {
-  if (cachePath.empty()) {
-    return false;
-  }
-
-  FsFile file;
-  if (!Storage.openFileForRead("CSS", cachePath + rulesCache, file)) {
-    return false;
-  }
-
+bool CssParser::loadFromCache(BufferedFileReader& file, const CssNameFilter* names) {
   // Clear existing rules
   clear();
 
   // Read and verify version
   uint8_t version = 0;
   if (file.read(&version, 1) != 1 || version != CssParser::CSS_CACHE_VERSION) {
-    LOG_DBG("CSS", "Cache version mismatch (got %u, expected %u), removing stale cache for rebuild", version,
+    LOG_DBG("CSS", "Cache version mismatch (got %u, expected %u), rules need a rebuild", version,
             CssParser::CSS_CACHE_VERSION);
-    file.close();
-    Storage.remove((cachePath + rulesCache).c_str());
     return false;
   }
 
   // Read rule count
   uint16_t ruleCount = 0;
   if (file.read(&ruleCount, sizeof(ruleCount)) != sizeof(ruleCount)) {
-    file.close();
     return false;
   }
+  rules_.reserve(ruleCount);
 
   // Read each rule
   for (uint16_t i = 0; i < ruleCount; ++i) {
     // Read selector string
     uint16_t selectorLen = 0;
     if (file.read(&selectorLen, sizeof(selectorLen)) != sizeof(selectorLen)) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
 
-    std::string selector;
-    selector.resize(selectorLen);
-    if (file.read(&selector[0], selectorLen) != selectorLen) {
-      rulesBySelector_.clear();
-      file.close();
+    const auto selectorOffset = static_cast<uint32_t>(selectors_.size());
+    selectors_.resize(selectorOffset + selectorLen);
+    if (file.read(&selectors_[selectorOffset], selectorLen) != selectorLen) {
+      clear();
       return false;
     }
 
@@ -771,29 +766,25 @@ bool CssParser::loadFromCache() {
     uint8_t enumVal;
 
     if (file.read(&enumVal, 1) != 1) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
     style.textAlign = static_cast<CssTextAlign>(enumVal);
 
     if (file.read(&enumVal, 1) != 1) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
     style.fontStyle = static_cast<CssFontStyle>(enumVal);
 
     if (file.read(&enumVal, 1) != 1) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
     style.fontWeight = static_cast<CssFontWeight>(enumVal);
 
     if (file.read(&enumVal, 1) != 1) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
     style.textDecoration = static_cast<CssTextDecoration>(enumVal);
@@ -815,16 +806,14 @@ bool CssParser::loadFromCache() {
         !readLength(style.marginLeft) || !readLength(style.marginRight) || !readLength(style.paddingTop) ||
         !readLength(style.paddingBottom) || !readLength(style.paddingLeft) || !readLength(style.paddingRight) ||
         !readLength(style.imageHeight) || !readLength(style.imageWidth)) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
 
     // Read defined flags
     uint16_t definedBits = 0;
     if (file.read(&definedBits, sizeof(definedBits)) != sizeof(definedBits)) {
-      rulesBySelector_.clear();
-      file.close();
+      clear();
       return false;
     }
     style.defined.textAlign = (definedBits & 1 << 0) != 0;
@@ -843,10 +832,31 @@ bool CssParser::loadFromCache() {
     style.defined.imageHeight = (definedBits & 1 << 13) != 0;
     style.defined.imageWidth = (definedBits & 1 << 14) != 0;
 
-    rulesBySelector_[selector] = style;
+    const std::string_view selector = std::string_view(selectors_).substr(selectorOffset, selectorLen);
+    if (names) {
+      // "tag", ".cls" or "tag.cls": a rule can only match if every name in it was seen
+      const size_t dot = selector.find('.');
+      const std::string_view tag = selector.substr(0, dot);
+      const std::string_view cls = dot == std::string_view::npos ? std::string_view{} : selector.substr(dot + 1);
+      if ((!tag.empty() && !names->mayContain(tag)) || (!cls.empty() && !names->mayContain(cls))) {
+        selectors_.resize(selectorOffset);
+        continue;
+      }
+    }
+    rules_.push_back({selectorHash(selector, {}), selectorOffset, selectorLen, style});
   }
+  // Saved in hash order; only a cache from an older build needs sorting
+  const auto byHash = [](const Rule& a, const Rule& b) { return a.hash < b.hash; };
+  if (!std::is_sorted(rules_.begin(), rules_.end(), byHash)) {
+    std::sort(rules_.begin(), rules_.end(), byHash);
+  }
+  selectors_.shrink_to_fit();
 
-  LOG_DBG("CSS", "Loaded %u rules from cache", ruleCount);
-  file.close();
+  if (names) {
+    rules_.shrink_to_fit();
+    LOG_DBG("CSS", "Loaded %zu of %u rules from cache", rules_.size(), ruleCount);
+  } else {
+    LOG_DBG("CSS", "Loaded %u rules from cache", ruleCount);
+  }
   return true;
 }
@@ -1,20 +1,25 @@
 #pragma once
 
-#include <HalStorage.h>
+#include <BufferedFile.h>
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "CssStyle.h"
 
+class CssNameFilter;
+class ZipFile;
+
 /**
  * Lightweight CSS parser for EPUB stylesheets
  *
  * Parses CSS files and extracts styling information relevant for e-ink display.
- * Uses a two-phase approach: first tokenizes the CSS content, then builds
- * a rule database that can be queried during HTML parsing.
+ * Stylesheets are tokenized in a single pass as they are inflated from the EPUB,
+ * selectors and declarations collected into fixed buffers, and the rules built
+ * into a database that can be queried during HTML parsing.
  *
  * Supported selectors:
  *   - Element selectors: p, div, h1, etc.
@@ -33,7 +38,7 @@ class CssParser {
   // Bump when CSS cache format or rules change; section caches are invalidated when this changes
   static constexpr uint8_t CSS_CACHE_VERSION = 3;
 
-  explicit CssParser(std::string cachePath) : cachePath(std::move(cachePath)) {}
+  CssParser() = default;
   ~CssParser() = default;
 
   // Non-copyable
@@ -41,12 +46,12 @@ class CssParser {
   CssParser& operator=(const CssParser&) = delete;
 
   /**
-   * Load and parse CSS from a file stream.
+   * Load and parse CSS as it is inflated from the EPUB, without staging it on the SD card.
    * Can be called multiple times to accumulate rules from multiple stylesheets.
-   * @param source Open file handle to read from
-   * @return true if parsing completed (even if no rules found)
+   * @param source Zip with the stylesheet entry open for streaming (Epub::openItemStream)
+   * @return true if parsing completed (even if no rules found), false if the entry could not be read
    */
-  bool loadFromStream(FsFile& source);
+  bool loadFromStream(ZipFile& source);
 
   /**
    * Look up the style for an HTML element, considering tag name and class attributes.
@@ -68,65 +73,77 @@ class CssParser {
   /**
    * Check if any rules have been loaded
    */
-  [[nodiscard]] bool empty() const { return rulesBySelector_.empty(); }
+  [[nodiscard]] bool empty() const { return rules_.empty() && rulesBySelector_.empty(); }
 
   /**
    * Get count of loaded rule sets
    */
-  [[nodiscard]] size_t ruleCount() const { return rulesBySelector_.size(); }
+  [[nodiscard]] size_t ruleCount() const { return rules_.size() + rulesBySelector_.size(); }
 
   /**
    * Clear all loaded rules
    */
-  void clear() { rulesBySelector_.clear(); }
+  void clear() {
+    rules_.clear();
+    rules_.shrink_to_fit();
+    selectors_.clear();
+    selectors_.shrink_to_fit();
+    rulesBySelector_.clear();
+  }
 
   /**
-   * Check if CSS rules cache file exists
+   * RAM held by the compiled rules
    */
-  bool hasCache() const;
+  [[nodiscard]] size_t getHeapUsage() const { return rules_.capacity() * sizeof(Rule) + selectors_.capacity(); }
 
   /**
-   * Delete CSS rules cache file exists
-   */
-  void deleteCache() const;
-
-  /**
-   * Save parsed CSS rules to a cache file.
+   * Save parsed CSS rules at the current position of a cache file (the CSS section of book.bin).
    * @return true if cache was written successfully
    */
-  bool saveToCache() const;
+  bool saveToCache(BufferedFileWriter& file) const;
 
   /**
-   * Load CSS rules from a cache file.
+   * Load CSS rules from the current position of a cache file.
    * Clears any existing rules before loading.
-   * @return true if cache was loaded successfully
+   * @param names If set, only the rules whose tag and class names it may contain are kept (those of one chapter)
+   * @return true if cache was loaded successfully, false if it is unreadable or from another CSS_CACHE_VERSION
    */
-  bool loadFromCache();
+  bool loadFromCache(BufferedFileReader& file, const CssNameFilter* names = nullptr);
 
  private:
-  // Storage: maps normalized selector -> style properties
+  // Rules of the stylesheet being parsed: normalized selector -> style properties
   std::unordered_map<std::string, CssStyle> rulesBySelector_;
 
-  std::string cachePath;
+  // Compiled rules, sorted by the FNV-1a hash of the selector, so resolveStyle() looks them up with a binary search
+  // over hashes built from the tag and class names in place, without building selector strings. The selectors are
+  // packed into selectors_.
+  struct Rule {
+    uint64_t hash;
+    uint32_t selectorOffset;
+    uint16_t selectorLength;
+    CssStyle style;
+  };
+  std::vector<Rule> rules_;
+  std::string selectors_;
+
+  // Moves the rules of the stylesheet just parsed into rules_, on top of those of earlier stylesheets
+  void compileRules();
+  // Index in the first `count` entries of rules_ of the rule for `tag` (`tag.cls` if cls isn't empty), or -1
+  int findRule(size_t count, std::string_view tag, std::string_view cls) const;
+
+  // Collects the property name and value of a declaration as its characters arrive
+  class DeclarationReader;
 
   // Internal parsing helpers
-  void processRuleBlockWithStyle(const std::string& selectorGroup, const CssStyle& style);
-  static CssStyle parseDeclarations(const std::string& declBlock);
-  static void parseDeclarationIntoStyle(const std::string& decl, CssStyle& style, std::string& propNameBuf,
-                                        std::string& propValueBuf);
-
-  // Individual property value parsers
-  static CssTextAlign interpretAlignment(const std::string& val);
-  static CssFontStyle interpretFontStyle(const std::string& val);
-  static CssFontWeight interpretFontWeight(const std::string& val);
-  static CssTextDecoration interpretDecoration(const std::string& val);
-  static CssLength interpretLength(const std::string& val);
+  void processRuleBlockWithStyle(std::string_view selectorGroup, const CssStyle& style);
+  static void applyDeclaration(std::string_view name, std::string_view value, CssStyle& style);
+
+  // Individual property value parsers, given values lowercased with whitespace collapsed
+  static CssTextAlign interpretAlignment(std::string_view val);
+  static CssFontStyle interpretFontStyle(std::string_view val);
+  static CssFontWeight interpretFontWeight(std::string_view val);
+  static CssTextDecoration interpretDecoration(std::string_view val);
+  static CssLength interpretLength(std::string_view val);
   /** Returns true only when a numeric length was parsed (e.g. 2em, 50%). False for auto/inherit/initial. */
-  static bool tryInterpretLength(const std::string& val, CssLength& out);
-
-  // String utilities
-  static std::string normalized(const std::string& s);
-  static void normalizedInto(const std::string& s, std::string& out);
-  static std::vector<std::string> splitOnChar(const std::string& s, char delimiter);
-  static std::vector<std::string> splitWhitespace(const std::string& s);
+  static bool tryInterpretLength(std::string_view val, CssLength& out);
 };
@@ -170,6 +170,12 @@ void trimSurroundingPunctuationAndFootnote(std::vector<CodepointInfo>& cps) {
 
 std::vector<CodepointInfo> collectCodepoints(const std::string& word) {
   std::vector<CodepointInfo> cps;
+  collectCodepoints(word, cps);
+  return cps;
+}
+
+void collectCodepoints(const std::string& word, std::vector<CodepointInfo>& cps) {
+  cps.clear();
   cps.reserve(word.size());
 
   const unsigned char* base = reinterpret_cast<const unsigned char*>(word.c_str());
@@ -386,6 +392,4 @@ std::vector<CodepointInfo> collectCodepoints(const std::string& word) {
 
     cps.push_back({cp, static_cast<size_t>(current - base)});
   }
-
-  return cps;
 }
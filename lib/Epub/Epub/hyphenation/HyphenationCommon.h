@@ -23,3 +23,5 @@ bool isExplicitHyphen(uint32_t cp);
 bool isSoftHyphen(uint32_t cp);
 void trimSurroundingPunctuationAndFootnote(std::vector<CodepointInfo>& cps);
 std::vector<CodepointInfo> collectCodepoints(const std::string& word);
+// Same, into cps (cleared first), so a buffer kept by the caller can be reused
+void collectCodepoints(const std::string& word, std::vector<CodepointInfo>& cps);
@@ -33,47 +33,61 @@ size_t byteOffsetForIndex(const std::vector<CodepointInfo>& cps, const size_t in
   return (index < cps.size()) ? cps[index].byteOffset : (cps.empty() ? 0 : cps.back().byteOffset);
 }
 
-// Builds a vector of break information from explicit hyphen markers in the given codepoints.
+// Writes break information from explicit hyphen markers in the given codepoints to out, returning the count.
 // Only hyphens that appear between two alphabetic characters are considered valid breaks.
 //
 // Example: "US-Satellitensystems" (cps: U, S, -, S, a, t, ...)
 //   -> finds '-' at index 2 with alphabetic neighbors 'S' and 'S'
-//   -> returns one BreakInfo at the byte offset of 'S' (the char after '-'),
+//   -> writes one BreakInfo at the byte offset of 'S' (the char after '-'),
 //      with requiresInsertedHyphen=false because '-' is already visible.
 //
 // Example: "Satel\u00ADliten" (soft-hyphen between 'l' and 'l')
-//   -> returns one BreakInfo with requiresInsertedHyphen=true (soft-hyphen
+//   -> writes one BreakInfo with requiresInsertedHyphen=true (soft-hyphen
 //      is invisible and needs a visible '-' when the break is used).
-std::vector<Hyphenator::BreakInfo> buildExplicitBreakInfos(const std::vector<CodepointInfo>& cps) {
-  std::vector<Hyphenator::BreakInfo> breaks;
+size_t buildExplicitBreakInfos(const std::vector<CodepointInfo>& cps, Hyphenator::BreakInfo* out,
+                               const size_t capacity) {
+  size_t count = 0;
 
-  for (size_t i = 1; i + 1 < cps.size(); ++i) {
+  for (size_t i = 1; i + 1 < cps.size() && count < capacity; ++i) {
     const uint32_t cp = cps[i].value;
     if (!isExplicitHyphen(cp) || !isAlphabetic(cps[i - 1].value) || !isAlphabetic(cps[i + 1].value)) {
       continue;
     }
     // Offset points to the next codepoint so rendering starts after the hyphen marker.
-    breaks.push_back({cps[i + 1].byteOffset, isSoftHyphen(cp)});
+    out[count++] = {cps[i + 1].byteOffset, isSoftHyphen(cp)};
   }
 
-  return breaks;
+  return count;
 }
 
+// Codepoints of the word being hyphenated. Kept across calls so its capacity is reused.
+std::vector<CodepointInfo> scratchCodepoints;
+
 }  // namespace
 
 std::vector<Hyphenator::BreakInfo> Hyphenator::breakOffsets(const std::string& word, const bool includeFallback) {
-  if (word.empty()) {
-    return {};
+  BreakInfo breaks[MAX_BREAKS];
+  const size_t count = breakOffsets(word, includeFallback, breaks, MAX_BREAKS);
+  return std::vector<BreakInfo>(breaks, breaks + count);
+}
+
+size_t Hyphenator::breakOffsets(const std::string& word, const bool includeFallback, BreakInfo* out,
+                                const size_t capacity) {
+  if (word.empty() || capacity == 0) {
+    return 0;
   }
 
   // Convert to codepoints and normalize word boundaries.
-  auto cps = collectCodepoints(word);
+  auto& cps = scratchCodepoints;
+  collectCodepoints(word, cps);
   trimSurroundingPunctuationAndFootnote(cps);
   const auto* hyphenator = cachedHyphenator_;
+  // Codepoint indexes from the language hyphenator, at most one per codepoint of the longest word it handles
+  size_t indexes[MAX_BREAKS];
 
   // Explicit hyphen markers (soft or hard) take precedence over language breaks.
-  auto explicitBreakInfos = buildExplicitBreakInfos(cps);
-  if (!explicitBreakInfos.empty()) {
+  size_t count = buildExplicitBreakInfos(cps, out, capacity);
+  if (count > 0) {
     // When a word contains explicit hyphens we also run Liang patterns on each alphabetic
     // segment between them. Without this, "US-Satellitensystems" would only offer one split
     // point (after "US-"), making it impossible to break mid-"Satellitensystems" even when
@@ -95,12 +109,11 @@ std::vector<Hyphenator::BreakInfo> Hyphenator::breakOffsets(const std::string& w
         const bool atHyphen = !atEnd && isExplicitHyphen(cps[i].value);
         if (atEnd || atHyphen) {
           if (i > segStart) {
-            std::vector<CodepointInfo> segment(cps.begin() + segStart, cps.begin() + i);
-            auto segIndexes = hyphenator->breakIndexes(segment);
-            for (const size_t idx : segIndexes) {
-              const size_t cpIdx = segStart + idx;
+            const size_t segCount = hyphenator->breakIndexes(cps.data() + segStart, i - segStart, indexes, MAX_BREAKS);
+            for (size_t j = 0; j < segCount && count < capacity; ++j) {
+              const size_t cpIdx = segStart + indexes[j];
               if (cpIdx < cps.size()) {
-                explicitBreakInfos.push_back({cps[cpIdx].byteOffset, true});
+                out[count++] = {cps[cpIdx].byteOffset, true};
               }
             }
           }
@@ -108,38 +121,30 @@ std::vector<Hyphenator::BreakInfo> Hyphenator::breakOffsets(const std::string& w
         }
       }
       // Merge explicit and pattern breaks into ascending byte-offset order.
-      std::sort(explicitBreakInfos.begin(), explicitBreakInfos.end(),
-                [](const BreakInfo& a, const BreakInfo& b) { return a.byteOffset < b.byteOffset; });
+      std::sort(out, out + count, [](const BreakInfo& a, const BreakInfo& b) { return a.byteOffset < b.byteOffset; });
     }
-    return explicitBreakInfos;
+    return count;
   }
 
   // Ask language hyphenator for legal break points.
-  std::vector<size_t> indexes;
+  size_t indexCount = 0;
   if (hyphenator) {
-    indexes = hyphenator->breakIndexes(cps);
+    indexCount = hyphenator->breakIndexes(cps.data(), cps.size(), indexes, std::min(capacity, MAX_BREAKS));
+  }
+  for (size_t i = 0; i < indexCount; ++i) {
+    out[count++] = {byteOffsetForIndex(cps, indexes[i]), true};
   }
 
   // Only add fallback breaks if needed
-  if (includeFallback && indexes.empty()) {
+  if (includeFallback && count == 0) {
     const size_t minPrefix = hyphenator ? hyphenator->minPrefix() : LiangWordConfig::kDefaultMinPrefix;
     const size_t minSuffix = hyphenator ? hyphenator->minSuffix() : LiangWordConfig::kDefaultMinSuffix;
-    for (size_t idx = minPrefix; idx + minSuffix <= cps.size(); ++idx) {
-      indexes.push_back(idx);
+    for (size_t idx = minPrefix; idx + minSuffix <= cps.size() && count < capacity; ++idx) {
+      out[count++] = {byteOffsetForIndex(cps, idx), true};
     }
   }
 
-  if (indexes.empty()) {
-    return {};
-  }
-
-  std::vector<Hyphenator::BreakInfo> breaks;
-  breaks.reserve(indexes.size());
-  for (const size_t idx : indexes) {
-    breaks.push_back({byteOffsetForIndex(cps, idx), true});
-  }
-
-  return breaks;
+  return count;
 }
 
 void Hyphenator::setPreferredLanguage(const std::string& lang) { cachedHyphenator_ = hyphenatorForLanguage(lang); }
@@ -29,8 +29,18 @@ class Hyphenator {
   //      word from overflowing the page width.
   static std::vector<BreakInfo> breakOffsets(const std::string& word, bool includeFallback);
 
+  // Enough room for every pattern break of the longest word Liang handles (68 codepoints). Fallback breaks past it
+  // are dropped; the remainder of the word gets split again on the next line.
+  static constexpr size_t MAX_BREAKS = 68;
+  // Same as above without allocating: writes at most capacity breaks to out and returns how many it wrote. Codepoint
+  // scratch space is kept between calls, so once it has grown to the longest word seen the hyphenator stays off the
+  // heap.
+  static size_t breakOffsets(const std::string& word, bool includeFallback, BreakInfo* out, size_t capacity);
+
   // Provide a publication-level language hint (e.g. "en", "en-US", "ru") used to select hyphenation rules.
   static void setPreferredLanguage(const std::string& lang);
+  // Identifies the rules breakOffsets() currently applies, for keying cached results
+  static const void* languageKey() { return cachedHyphenator_; }
 
  private:
   static const LanguageHyphenator* cachedHyphenator_;
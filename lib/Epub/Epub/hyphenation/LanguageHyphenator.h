@@ -10,8 +10,14 @@ class LanguageHyphenator {
                      size_t minSuffix = LiangWordConfig::kDefaultMinSuffix)
       : patterns_(patterns), config_(isLetterFn, toLowerFn, minPrefix, minSuffix) {}
 
+  size_t breakIndexes(const CodepointInfo* cps, const size_t count, size_t* out, const size_t capacity) const {
+    return liangBreakIndexes(cps, count, patterns_, config_, out, capacity);
+  }
+
   std::vector<size_t> breakIndexes(const std::vector<CodepointInfo>& cps) const {
-    return liangBreakIndexes(cps, patterns_, config_);
+    std::vector<size_t> indexes(cps.size());
+    indexes.resize(breakIndexes(cps.data(), cps.size(), indexes.data(), indexes.size()));
+    return indexes;
   }
 
   size_t minPrefix() const { return config_.minPrefix; }
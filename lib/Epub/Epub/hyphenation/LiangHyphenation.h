@@ -33,6 +33,8 @@ struct LiangWordConfig {
       : isLetter(letterFn), toLower(lowerFn), minPrefix(prefix), minSuffix(suffix) {}
 };
 
-// Shared Liang pattern evaluator used by every language-specific hyphenator.
-std::vector<size_t> liangBreakIndexes(const std::vector<CodepointInfo>& cps,
-                                      const SerializedHyphenationPatterns& patterns, const LiangWordConfig& config);
+// Shared Liang pattern evaluator used by every language-specific hyphenator. Writes the codepoint indexes where the
+// word may break to `out`, at most `capacity` of them, and returns how many it wrote. Never allocates; there are
+// fewer breaks than codepoints, so `count` entries are always enough.
+size_t liangBreakIndexes(const CodepointInfo* cps, size_t count, const SerializedHyphenationPatterns& patterns,
+                         const LiangWordConfig& config, size_t* out, size_t capacity);
@@ -4,55 +4,167 @@
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <Logging.h>
-#include <expat.h>
+#include <Serialization.h>
+#include <Trace.h>
+#include <ZipFile.h>
+
+#include <algorithm>
 
 #include "../../Epub.h"
 #include "../Page.h"
 #include "../converters/ImageDecoderFactory.h"
+#include "../converters/ImageSource.h"
 #include "../converters/ImageToFramebufferDecoder.h"
-#include "../htmlEntities.h"
-
-const char* HEADER_TAGS[] = {"h1", "h2", "h3", "h4", "h5", "h6"};
-constexpr int NUM_HEADER_TAGS = sizeof(HEADER_TAGS) / sizeof(HEADER_TAGS[0]);
 
-// Minimum file size (in bytes) to show indexing popup - smaller chapters don't benefit from it
+// Minimum chapter size (in bytes, uncompressed) to show indexing popup - smaller chapters don't benefit from it
 constexpr size_t MIN_SIZE_FOR_POPUP = 10 * 1024;  // 10KB
 constexpr size_t PARSE_BUFFER_SIZE = 1024;
+// Ids recorded per chapter; beyond this (8 bytes each) links to the rest land at the chapter's start
+constexpr size_t MAX_ANCHORS = 4096;
+// Bytes of the chapter inflated and dropped per parseNextChunk() on the way to a checkpoint
+constexpr size_t CHECKPOINT_SKIP_SLICE = 16 * 1024;
+// Far above a real page record (a few KB), only guards against a corrupt checkpoint
+constexpr uint32_t MAX_CHECKPOINT_PAGE_SIZE = 64 * 1024;
+
+// Tokenize chapters with XhtmlTokenizer instead of Expat, which is still used for a chapter the light one rejects
+#ifndef CHAPTER_LIGHT_TOKENIZER
+#define CHAPTER_LIGHT_TOKENIZER 0
+#endif
+
+// What the parser does with an element, as a bitmask of roles per tag name
+enum TagRole : uint16_t {
+  TAG_HEADER = 1 << 0,
+  TAG_BLOCK = 1 << 1,
+  TAG_BR = 1 << 2,
+  TAG_LI = 1 << 3,
+  TAG_BOLD = 1 << 4,
+  TAG_ITALIC = 1 << 5,
+  TAG_UNDERLINE = 1 << 6,
+  TAG_IMAGE = 1 << 7,
+  TAG_SKIP = 1 << 8,
+  TAG_TABLE = 1 << 9,
+  TAG_TABLE_ROW = 1 << 10,
+  TAG_TABLE_CELL = 1 << 11,
+  TAG_ANCHOR = 1 << 12,
+};
+constexpr uint16_t TAG_HEADER_OR_BLOCK = TAG_HEADER | TAG_BLOCK;
+constexpr uint16_t TAG_TABLE_STRUCTURAL = TAG_TABLE | TAG_TABLE_ROW | TAG_TABLE_CELL;
+
+// Attributes the parser reads
+enum AttrId : uint16_t {
+  ATTR_OTHER,
+  ATTR_CLASS,
+  ATTR_STYLE,
+  ATTR_ROLE,
+  ATTR_EPUB_TYPE,
+  ATTR_SRC,
+  ATTR_ALT,
+  ATTR_HREF,
+  ATTR_ID,
+  ATTR_COLSPAN,
+};
+
+struct NameEntry {
+  const char* name;
+  uint16_t value;
+};
+
+constexpr NameEntry TAG_NAMES[] = {
+    {"h1", TAG_HEADER},
+    {"h2", TAG_HEADER},
+    {"h3", TAG_HEADER},
+    {"h4", TAG_HEADER},
+    {"h5", TAG_HEADER},
+    {"h6", TAG_HEADER},
+    {"p", TAG_BLOCK},
+    {"li", TAG_BLOCK | TAG_LI},
+    {"div", TAG_BLOCK},
+    {"br", TAG_BLOCK | TAG_BR},
+    {"blockquote", TAG_BLOCK},
+    {"b", TAG_BOLD},
+    {"strong", TAG_BOLD},
+    {"i", TAG_ITALIC},
+    {"em", TAG_ITALIC},
+    {"u", TAG_UNDERLINE},
+    {"ins", TAG_UNDERLINE},
+    {"img", TAG_IMAGE},
+    {"head", TAG_SKIP},
+    {"script", TAG_SKIP},
+    {"style", TAG_SKIP},
+    {"table", TAG_TABLE},
+    {"tr", TAG_TABLE_ROW},
+    {"td", TAG_TABLE_CELL},
+    {"th", TAG_TABLE_CELL},
+    {"a", TAG_ANCHOR},
+};
+
+constexpr NameEntry ATTR_NAMES[] = {
+    {"class", ATTR_CLASS}, {"style", ATTR_STYLE}, {"role", ATTR_ROLE}, {"epub:type", ATTR_EPUB_TYPE},
+    {"src", ATTR_SRC},     {"alt", ATTR_ALT},     {"href", ATTR_HREF},           {"id", ATTR_ID},
+    {"colspan", ATTR_COLSPAN},
+};
+
+constexpr uint32_t seededNameHash(const char* name, const uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (; *name; name++) {
+    hash = (hash ^ static_cast<uint8_t>(*name)) * 16777619u;
+  }
+  // FNV's low bits only depend on the low bits of the input, fold the high ones in before masking to a slot
+  return hash ^ (hash >> 16);
+}
 
-const char* BLOCK_TAGS[] = {"p", "li", "div", "br", "blockquote"};
-constexpr int NUM_BLOCK_TAGS = sizeof(BLOCK_TAGS) / sizeof(BLOCK_TAGS[0]);
+// Perfect hash over a fixed set of names: the constructor searches, at compile time, for the first seed under which
+// every name lands in its own slot, so a lookup is one hash, one slot load and one strcmp to reject unknown names.
+template <size_t N, size_t SLOTS>
+class NameTable {
+  static_assert((SLOTS & (SLOTS - 1)) == 0 && SLOTS >= N, "SLOTS must be a power of two no smaller than N");
+
+ public:
+  constexpr explicit NameTable(const NameEntry (&names)[N]) : names(names) {
+    for (uint32_t candidate = 1; candidate < 4096 && seed == 0; candidate++) {
+      for (auto& slot : slots) {
+        slot = 0;
+      }
+      bool collides = false;
+      for (size_t i = 0; i < N && !collides; i++) {
+        uint8_t& slot = slots[seededNameHash(names[i].name, candidate) & (SLOTS - 1)];
+        collides = slot != 0;
+        slot = static_cast<uint8_t>(i + 1);
+      }
+      if (!collides) {
+        seed = candidate;
+      }
+    }
+  }
 
-const char* BOLD_TAGS[] = {"b", "strong"};
-constexpr int NUM_BOLD_TAGS = sizeof(BOLD_TAGS) / sizeof(BOLD_TAGS[0]);
+  constexpr bool valid() const { return seed != 0; }
 
-const char* ITALIC_TAGS[] = {"i", "em"};
-constexpr int NUM_ITALIC_TAGS = sizeof(ITALIC_TAGS) / sizeof(ITALIC_TAGS[0]);
+  // Value of name, 0 if it isn't in the table
+  uint16_t lookup(const char* name) const {
+    const uint8_t slot = slots[seededNameHash(name, seed) & (SLOTS - 1)];
+    return slot != 0 && strcmp(names[slot - 1].name, name) == 0 ? names[slot - 1].value : 0;
+  }
 
-const char* UNDERLINE_TAGS[] = {"u", "ins"};
-constexpr int NUM_UNDERLINE_TAGS = sizeof(UNDERLINE_TAGS) / sizeof(UNDERLINE_TAGS[0]);
+ private:
+  const NameEntry* names;
+  uint32_t seed = 0;
+  uint8_t slots[SLOTS] = {};
+};
 
-const char* IMAGE_TAGS[] = {"img"};
-constexpr int NUM_IMAGE_TAGS = sizeof(IMAGE_TAGS) / sizeof(IMAGE_TAGS[0]);
+constexpr NameTable<sizeof(TAG_NAMES) / sizeof(TAG_NAMES[0]), 64> TAG_TABLE_LOOKUP(TAG_NAMES);
+constexpr NameTable<sizeof(ATTR_NAMES) / sizeof(ATTR_NAMES[0]), 16> ATTR_TABLE_LOOKUP(ATTR_NAMES);
+static_assert(TAG_TABLE_LOOKUP.valid(), "No collision-free seed for the tag table, grow its slot count");
+static_assert(ATTR_TABLE_LOOKUP.valid(), "No collision-free seed for the attribute table, grow its slot count");
 
-const char* SKIP_TAGS[] = {"head"};
-constexpr int NUM_SKIP_TAGS = sizeof(SKIP_TAGS) / sizeof(SKIP_TAGS[0]);
+uint16_t tagRoles(const char* name) { return TAG_TABLE_LOOKUP.lookup(name); }
+uint16_t attrId(const char* name) { return ATTR_TABLE_LOOKUP.lookup(name); }
 
 bool isWhitespace(const char c) { return c == ' ' || c == '\r' || c == '\n' || c == '\t'; }
 
-// given the start and end of a tag, check to see if it matches a known tag
-bool matches(const char* tag_name, const char* possible_tags[], const int possible_tag_count) {
-  for (int i = 0; i < possible_tag_count; i++) {
-    if (strcmp(tag_name, possible_tags[i]) == 0) {
-      return true;
-    }
-  }
-  return false;
-}
-
-const char* getAttribute(const XML_Char** atts, const char* attrName) {
+const char* getAttribute(const char** atts, const uint16_t attrName) {
   if (!atts) return nullptr;
   for (int i = 0; atts[i]; i += 2) {
-    if (strcmp(atts[i], attrName) == 0) return atts[i + 1];
+    if (attrId(atts[i]) == attrName) return atts[i + 1];
   }
   return nullptr;
 }
@@ -67,34 +179,43 @@ bool isInternalEpubLink(const char* href) {
   return true;
 }
 
-bool isHeaderOrBlock(const char* name) {
-  return matches(name, HEADER_TAGS, NUM_HEADER_TAGS) || matches(name, BLOCK_TAGS, NUM_BLOCK_TAGS);
+void ChapterHtmlSlimParser::pushInlineStyle(const StyleStackEntry& entry) {
+  if (inlineStyleCount == MAX_INLINE_STYLE_DEPTH) {
+    // Its end tag finds no level of its depth to pop either
+    return;
+  }
+  const auto resolve = [](const bool has, const bool value, const InlineFlag outer) {
+    return has ? (value ? InlineFlag::On : InlineFlag::Off) : outer;
+  };
+  const InlineStyleLevel outer = inlineStyleCount > 0
+                                     ? inlineStyleStack[inlineStyleCount - 1]
+                                     : InlineStyleLevel{0, InlineFlag::FromBlock, InlineFlag::FromBlock,
+                                                        InlineFlag::FromBlock};
+  inlineStyleStack[inlineStyleCount++] = {entry.depth, resolve(entry.hasBold, entry.bold, outer.bold),
+                                          resolve(entry.hasItalic, entry.italic, outer.italic),
+                                          resolve(entry.hasUnderline, entry.underline, outer.underline)};
+  updateEffectiveInlineStyle();
 }
 
-bool isTableStructuralTag(const char* name) {
-  return strcmp(name, "table") == 0 || strcmp(name, "tr") == 0 || strcmp(name, "td") == 0 || strcmp(name, "th") == 0;
+void ChapterHtmlSlimParser::setBlockStyle(const CssStyle& cssStyle) {
+  blockBold = cssStyle.hasFontWeight() && cssStyle.fontWeight == CssFontWeight::Bold;
+  blockItalic = cssStyle.hasFontStyle() && cssStyle.fontStyle == CssFontStyle::Italic;
+  blockUnderline = cssStyle.hasTextDecoration() && cssStyle.textDecoration == CssTextDecoration::Underline;
+  updateEffectiveInlineStyle();
 }
 
 // Update effective bold/italic/underline based on block style and inline style stack
 void ChapterHtmlSlimParser::updateEffectiveInlineStyle() {
-  // Start with block-level styles
-  effectiveBold = currentCssStyle.hasFontWeight() && currentCssStyle.fontWeight == CssFontWeight::Bold;
-  effectiveItalic = currentCssStyle.hasFontStyle() && currentCssStyle.fontStyle == CssFontStyle::Italic;
-  effectiveUnderline =
-      currentCssStyle.hasTextDecoration() && currentCssStyle.textDecoration == CssTextDecoration::Underline;
-
-  // Apply inline style stack in order
-  for (const auto& entry : inlineStyleStack) {
-    if (entry.hasBold) {
-      effectiveBold = entry.bold;
-    }
-    if (entry.hasItalic) {
-      effectiveItalic = entry.italic;
-    }
-    if (entry.hasUnderline) {
-      effectiveUnderline = entry.underline;
-    }
+  if (inlineStyleCount == 0) {
+    effectiveBold = blockBold;
+    effectiveItalic = blockItalic;
+    effectiveUnderline = blockUnderline;
+    return;
   }
+  const auto& top = inlineStyleStack[inlineStyleCount - 1];
+  effectiveBold = top.bold == InlineFlag::FromBlock ? blockBold : top.bold == InlineFlag::On;
+  effectiveItalic = top.italic == InlineFlag::FromBlock ? blockItalic : top.italic == InlineFlag::On;
+  effectiveUnderline = top.underline == InlineFlag::FromBlock ? blockUnderline : top.underline == InlineFlag::On;
 }
 
 // flush the contents of partWordBuffer to currentTextBlock
@@ -118,7 +239,7 @@ void ChapterHtmlSlimParser::flushPartWordBuffer() {
 
   // flush the buffer
   partWordBuffer[partWordBufferIndex] = '\0';
-  currentTextBlock->addWord(partWordBuffer, fontStyle, false, nextWordContinues);
+  currentTextBlock->addWord(partWordBuffer, fontStyle, false, nextWordContinues, partWordPosition);
   partWordBufferIndex = 0;
   nextWordContinues = false;
 }
@@ -126,6 +247,15 @@ void ChapterHtmlSlimParser::flushPartWordBuffer() {
 // start a new text block if needed
 void ChapterHtmlSlimParser::startNewTextBlock(const BlockStyle& blockStyle) {
   nextWordContinues = false;  // New block = new paragraph, no continuation
+  if (inTableCell) {
+    // Paragraphs in a cell take the cell's style and are laid out with the table
+    if (!currentTextBlock->isEmpty()) {
+      table->addParagraph(std::move(currentTextBlock));
+      currentTextBlock.reset(new ParsedText(extraParagraphSpacing, hyphenationEnabled, tableCellStyle, &tableArena,
+                                            &widthCache, &hyphenationCache));
+    }
+    return;
+  }
   if (currentTextBlock) {
     // already have a text block running and it is empty - just reuse it
     if (currentTextBlock->isEmpty()) {
@@ -136,30 +266,70 @@ void ChapterHtmlSlimParser::startNewTextBlock(const BlockStyle& blockStyle) {
       return;
     }
 
+    // Text in a table outside its cells comes after the rows buffered so far
+    layoutTable();
     makePages();
+    // The previous block's words are all on pages now; drop it before its arena storage is reclaimed
+    currentTextBlock.reset();
+    textArena.reset();
   }
-  currentTextBlock.reset(new ParsedText(extraParagraphSpacing, hyphenationEnabled, blockStyle));
+  currentTextBlock.reset(
+      new ParsedText(extraParagraphSpacing, hyphenationEnabled, blockStyle, &textArena, &widthCache,
+                     &hyphenationCache));
   wordsExtractedInBlock = 0;
+  // Ids left after the last block's words (e.g. the one of the element starting this block) lead to its first word
+  for (auto& anchor : pendingAnchors) {
+    anchor.wordIndex = 0;
+  }
 }
 
-void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char* name, const XML_Char** atts) {
+void ChapterHtmlSlimParser::startElement(void* userData, const char* name, const char** atts) {
   auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
 
+  // The prefix of a resumed parse opens elements that were handled before the checkpoint
+  if (self->replayedStartTags > 0) {
+    self->replayedStartTags--;
+    return;
+  }
+  if (self->openElements.empty()) {
+    uint32_t tagEnd = 0;
+    self->rootTagEnd = self->tokenizer->getStartTagEnd(tagEnd) ? tagEnd + self->inputShift : 0;
+  }
+  self->openElements += ' ';
+  self->openElements += name;
+
   // Middle of skip
   if (self->skipUntilDepth < self->depth) {
     self->depth += 1;
     return;
   }
 
-  // Extract class and style attributes for CSS processing
+  const uint16_t roles = tagRoles(name);
+
+  // Extract class and style attributes for CSS processing, and note page break markers
   std::string classAttr;
   std::string styleAttr;
+  bool pageBreak = false;
   if (atts != nullptr) {
     for (int i = 0; atts[i]; i += 2) {
-      if (strcmp(atts[i], "class") == 0) {
-        classAttr = atts[i + 1];
-      } else if (strcmp(atts[i], "style") == 0) {
-        styleAttr = atts[i + 1];
+      switch (attrId(atts[i])) {
+        case ATTR_CLASS:
+          classAttr = atts[i + 1];
+          break;
+        case ATTR_STYLE:
+          styleAttr = atts[i + 1];
+          break;
+        case ATTR_ROLE:
+          pageBreak = pageBreak || strcmp(atts[i + 1], "doc-pagebreak") == 0;
+          break;
+        case ATTR_EPUB_TYPE:
+          pageBreak = pageBreak || strcmp(atts[i + 1], "pagebreak") == 0;
+          break;
+        case ATTR_ID:
+          self->addAnchor(atts[i + 1]);
+          break;
+        default:
+          break;
       }
     }
   }
@@ -168,8 +338,8 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
   centeredBlockStyle.textAlignDefined = true;
   centeredBlockStyle.alignment = CssTextAlign::Center;
 
-  // Special handling for tables/cells: flatten into per-cell paragraphs with a prefixed header.
-  if (strcmp(name, "table") == 0) {
+  // Tables are buffered a batch of rows at a time and laid out in columns, see TableLayout
+  if (roles & TAG_TABLE) {
     // skip nested tables
     if (self->tableDepth > 0) {
       self->tableDepth += 1;
@@ -179,66 +349,40 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     if (self->partWordBufferIndex > 0) {
       self->flushPartWordBuffer();
     }
+    self->startNewTextBlock(self->paragraphBlockStyle());
     self->tableDepth += 1;
-    self->tableRowIndex = 0;
-    self->tableColIndex = 0;
+    self->table.reset(new TableLayout());
     self->depth += 1;
     return;
   }
 
-  if (self->tableDepth == 1 && strcmp(name, "tr") == 0) {
-    self->tableRowIndex += 1;
-    self->tableColIndex = 0;
+  if (self->tableDepth == 1 && (roles & TAG_TABLE_ROW)) {
+    self->table->beginRow(self->textPosition);
     self->depth += 1;
     return;
   }
 
-  if (self->tableDepth == 1 && (strcmp(name, "td") == 0 || strcmp(name, "th") == 0)) {
+  if (self->tableDepth == 1 && (roles & TAG_TABLE_CELL)) {
     if (self->partWordBufferIndex > 0) {
       self->flushPartWordBuffer();
     }
-    self->tableColIndex += 1;
-
-    auto tableCellBlockStyle = BlockStyle();
-    tableCellBlockStyle.textAlignDefined = true;
-    const auto align = (self->paragraphAlignment == static_cast<uint8_t>(CssTextAlign::None))
-                           ? CssTextAlign::Justify
-                           : static_cast<CssTextAlign>(self->paragraphAlignment);
-    tableCellBlockStyle.alignment = align;
-    self->startNewTextBlock(tableCellBlockStyle);
-
-    const std::string headerText =
-        "Tab Row " + std::to_string(self->tableRowIndex) + ", Cell " + std::to_string(self->tableColIndex) + ":";
-    StyleStackEntry headerStyle;
-    headerStyle.depth = self->depth;
-    headerStyle.hasBold = true;
-    headerStyle.bold = false;
-    headerStyle.hasItalic = true;
-    headerStyle.italic = true;
-    headerStyle.hasUnderline = true;
-    headerStyle.underline = false;
-    self->inlineStyleStack.push_back(headerStyle);
-    self->updateEffectiveInlineStyle();
-    self->characterData(userData, headerText.c_str(), static_cast<int>(headerText.length()));
-    if (self->partWordBufferIndex > 0) {
-      self->flushPartWordBuffer();
-    }
-    self->nextWordContinues = false;
-    self->inlineStyleStack.pop_back();
-    self->updateEffectiveInlineStyle();
-
+    const char* colspan = getAttribute(atts, ATTR_COLSPAN);
+    const int span = colspan ? atoi(colspan) : 1;
+    self->beginTableCell(strcmp(name, "th") == 0,
+                         static_cast<uint8_t>(std::max(1, std::min(span, static_cast<int>(TableLayout::MAX_COLSPAN)))));
     self->depth += 1;
     return;
   }
 
-  if (matches(name, IMAGE_TAGS, NUM_IMAGE_TAGS)) {
+  if (roles & TAG_IMAGE) {
     std::string src;
     std::string alt;
     if (atts != nullptr) {
       for (int i = 0; atts[i]; i += 2) {
-        if (strcmp(atts[i], "src") == 0) {
+        const uint16_t attr = attrId(atts[i]);
+        if (attr == ATTR_SRC) {
           src = atts[i + 1];
-        } else if (strcmp(atts[i], "alt") == 0) {
+        } else if (attr == ATTR_ALT) {
           alt = atts[i + 1];
         }
       }
@@ -251,7 +395,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
           std::string resolvedPath = FsHelpers::normalisePath(self->contentBase + src);
 
           if (ImageDecoderFactory::isFormatSupported(resolvedPath)) {
-            // Create a unique filename for the cached image
+            // Name for the image's pixel cache; the bytes stay in the archive and are read from there
             std::string ext;
             size_t extPos = resolvedPath.rfind('.');
             if (extPos != std::string::npos) {
@@ -259,153 +403,140 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
             }
             std::string cachedImagePath = self->imageBasePath + std::to_string(self->imageCounter++) + ext;
 
-            // Extract image to cache file
-            FsFile cachedImageFile;
-            bool extractSuccess = false;
-            if (Storage.openFileForWrite("EHP", cachedImagePath, cachedImageFile)) {
-              extractSuccess = self->epub->readItemContentsToStream(resolvedPath, cachedImageFile, 4096);
-              cachedImageFile.flush();
-              cachedImageFile.close();
-              delay(50);  // Give SD card time to sync
-            }
-
-            if (extractSuccess) {
-              // Get image dimensions
-              ImageDimensions dims = {0, 0};
-              ImageToFramebufferDecoder* decoder = ImageDecoderFactory::getDecoder(cachedImagePath);
-              if (decoder && decoder->getDimensions(cachedImagePath, dims)) {
-                LOG_DBG("EHP", "Image dimensions: %dx%d", dims.width, dims.height);
-
-                int displayWidth = 0;
-                int displayHeight = 0;
-                const float emSize =
-                    static_cast<float>(self->renderer.getLineHeight(self->fontId)) * self->lineCompression;
-                CssStyle imgStyle = self->cssParser ? self->cssParser->resolveStyle("img", classAttr) : CssStyle{};
-                // Merge inline style (e.g. style="height: 2em") so it overrides stylesheet rules
-                if (!styleAttr.empty()) {
-                  imgStyle.applyOver(CssParser::parseInlineStyle(styleAttr));
-                }
-                const bool hasCssHeight = imgStyle.hasImageHeight();
-                const bool hasCssWidth = imgStyle.hasImageWidth();
-
-                if (hasCssHeight && hasCssWidth && dims.width > 0 && dims.height > 0) {
-                  // Both CSS height and width set: resolve both, then clamp to viewport preserving requested ratio
-                  displayHeight = static_cast<int>(
-                      imgStyle.imageHeight.toPixels(emSize, static_cast<float>(self->viewportHeight)) + 0.5f);
-                  displayWidth = static_cast<int>(
-                      imgStyle.imageWidth.toPixels(emSize, static_cast<float>(self->viewportWidth)) + 0.5f);
-                  if (displayHeight < 1) displayHeight = 1;
+            ImageDimensions dims = {0, 0};
+            if (self->getImageDimensions(resolvedPath, dims)) {
+              int displayWidth = 0;
+              int displayHeight = 0;
+              const float emSize =
+                  static_cast<float>(self->renderer.getLineHeight(self->fontId)) * self->lineCompression;
+              CssStyle imgStyle;
+              if (self->cssParser) {
+                self->cssNames.addElement("img", classAttr);
+                imgStyle = self->cssParser->resolveStyle("img", classAttr);
+              }
+              // Merge inline style (e.g. style="height: 2em") so it overrides stylesheet rules
+              if (!styleAttr.empty()) {
+                imgStyle.applyOver(CssParser::parseInlineStyle(styleAttr));
+              }
+              const bool hasCssHeight = imgStyle.hasImageHeight();
+              const bool hasCssWidth = imgStyle.hasImageWidth();
+
+              if (hasCssHeight && hasCssWidth && dims.width > 0 && dims.height > 0) {
+                // Both CSS height and width set: resolve both, then clamp to viewport preserving requested ratio
+                displayHeight = static_cast<int>(
+                    imgStyle.imageHeight.toPixels(emSize, static_cast<float>(self->viewportHeight)) + 0.5f);
+                displayWidth = static_cast<int>(
+                    imgStyle.imageWidth.toPixels(emSize, static_cast<float>(self->viewportWidth)) + 0.5f);
+                if (displayHeight < 1) displayHeight = 1;
+                if (displayWidth < 1) displayWidth = 1;
+                if (displayWidth > self->viewportWidth || displayHeight > self->viewportHeight) {
+                  float scaleX = (displayWidth > self->viewportWidth)
+                                     ? static_cast<float>(self->viewportWidth) / displayWidth
+                                     : 1.0f;
+                  float scaleY = (displayHeight > self->viewportHeight)
+                                     ? static_cast<float>(self->viewportHeight) / displayHeight
+                                     : 1.0f;
+                  float scale = (scaleX < scaleY) ? scaleX : scaleY;
+                  displayWidth = static_cast<int>(displayWidth * scale + 0.5f);
+                  displayHeight = static_cast<int>(displayHeight * scale + 0.5f);
                   if (displayWidth < 1) displayWidth = 1;
-                  if (displayWidth > self->viewportWidth || displayHeight > self->viewportHeight) {
-                    float scaleX = (displayWidth > self->viewportWidth)
-                                       ? static_cast<float>(self->viewportWidth) / displayWidth
-                                       : 1.0f;
-                    float scaleY = (displayHeight > self->viewportHeight)
-                                       ? static_cast<float>(self->viewportHeight) / displayHeight
-                                       : 1.0f;
-                    float scale = (scaleX < scaleY) ? scaleX : scaleY;
-                    displayWidth = static_cast<int>(displayWidth * scale + 0.5f);
-                    displayHeight = static_cast<int>(displayHeight * scale + 0.5f);
-                    if (displayWidth < 1) displayWidth = 1;
-                    if (displayHeight < 1) displayHeight = 1;
-                  }
-                  LOG_DBG("EHP", "Display size from CSS height+width: %dx%d", displayWidth, displayHeight);
-                } else if (hasCssHeight && !hasCssWidth && dims.width > 0 && dims.height > 0) {
-                  // Use CSS height (resolve % against viewport height) and derive width from aspect ratio
-                  displayHeight = static_cast<int>(
-                      imgStyle.imageHeight.toPixels(emSize, static_cast<float>(self->viewportHeight)) + 0.5f);
                   if (displayHeight < 1) displayHeight = 1;
+                }
+                LOG_DBG("EHP", "Display size from CSS height+width: %dx%d", displayWidth, displayHeight);
+              } else if (hasCssHeight && !hasCssWidth && dims.width > 0 && dims.height > 0) {
+                // Use CSS height (resolve % against viewport height) and derive width from aspect ratio
+                displayHeight = static_cast<int>(
+                    imgStyle.imageHeight.toPixels(emSize, static_cast<float>(self->viewportHeight)) + 0.5f);
+                if (displayHeight < 1) displayHeight = 1;
+                displayWidth = static_cast<int>(displayHeight * (static_cast<float>(dims.width) / dims.height) + 0.5f);
+                if (displayHeight > self->viewportHeight) {
+                  displayHeight = self->viewportHeight;
+                  // Rescale width to preserve aspect ratio when height is clamped
                   displayWidth =
                       static_cast<int>(displayHeight * (static_cast<float>(dims.width) / dims.height) + 0.5f);
-                  if (displayHeight > self->viewportHeight) {
-                    displayHeight = self->viewportHeight;
-                    // Rescale width to preserve aspect ratio when height is clamped
-                    displayWidth =
-                        static_cast<int>(displayHeight * (static_cast<float>(dims.width) / dims.height) + 0.5f);
-                    if (displayWidth < 1) displayWidth = 1;
-                  }
-                  if (displayWidth > self->viewportWidth) {
-                    displayWidth = self->viewportWidth;
-                    // Rescale height to preserve aspect ratio when width is clamped
-                    displayHeight =
-                        static_cast<int>(displayWidth * (static_cast<float>(dims.height) / dims.width) + 0.5f);
-                    if (displayHeight < 1) displayHeight = 1;
-                  }
-                  if (displayWidth < 1) displayWidth = 1;
-                  LOG_DBG("EHP", "Display size from CSS height: %dx%d", displayWidth, displayHeight);
-                } else if (hasCssWidth && !hasCssHeight && dims.width > 0 && dims.height > 0) {
-                  // Use CSS width (resolve % against viewport width) and derive height from aspect ratio
-                  displayWidth = static_cast<int>(
-                      imgStyle.imageWidth.toPixels(emSize, static_cast<float>(self->viewportWidth)) + 0.5f);
-                  if (displayWidth > self->viewportWidth) displayWidth = self->viewportWidth;
                   if (displayWidth < 1) displayWidth = 1;
+                }
+                if (displayWidth > self->viewportWidth) {
+                  displayWidth = self->viewportWidth;
+                  // Rescale height to preserve aspect ratio when width is clamped
                   displayHeight =
                       static_cast<int>(displayWidth * (static_cast<float>(dims.height) / dims.width) + 0.5f);
-                  if (displayHeight > self->viewportHeight) {
-                    displayHeight = self->viewportHeight;
-                    // Rescale width to preserve aspect ratio when height is clamped
-                    displayWidth =
-                        static_cast<int>(displayHeight * (static_cast<float>(dims.width) / dims.height) + 0.5f);
-                    if (displayWidth < 1) displayWidth = 1;
-                  }
                   if (displayHeight < 1) displayHeight = 1;
-                  LOG_DBG("EHP", "Display size from CSS width: %dx%d", displayWidth, displayHeight);
-                } else {
-                  // Scale to fit viewport while maintaining aspect ratio
-                  int maxWidth = self->viewportWidth;
-                  int maxHeight = self->viewportHeight;
-                  float scaleX = (dims.width > maxWidth) ? (float)maxWidth / dims.width : 1.0f;
-                  float scaleY = (dims.height > maxHeight) ? (float)maxHeight / dims.height : 1.0f;
-                  float scale = (scaleX < scaleY) ? scaleX : scaleY;
-                  if (scale > 1.0f) scale = 1.0f;
-
-                  displayWidth = (int)(dims.width * scale);
-                  displayHeight = (int)(dims.height * scale);
-                  LOG_DBG("EHP", "Display size: %dx%d (scale %.2f)", displayWidth, displayHeight, scale);
                 }
-
-                // Create page for image - only break if image won't fit remaining space
-                if (self->currentPage && !self->currentPage->elements.empty() &&
-                    (self->currentPageNextY + displayHeight > self->viewportHeight)) {
-                  self->completePageFn(std::move(self->currentPage));
-                  self->currentPage.reset(new Page());
-                  if (!self->currentPage) {
-                    LOG_ERR("EHP", "Failed to create new page");
-                    return;
-                  }
-                  self->currentPageNextY = 0;
-                } else if (!self->currentPage) {
-                  self->currentPage.reset(new Page());
-                  if (!self->currentPage) {
-                    LOG_ERR("EHP", "Failed to create initial page");
-                    return;
-                  }
-                  self->currentPageNextY = 0;
+                if (displayWidth < 1) displayWidth = 1;
+                LOG_DBG("EHP", "Display size from CSS height: %dx%d", displayWidth, displayHeight);
+              } else if (hasCssWidth && !hasCssHeight && dims.width > 0 && dims.height > 0) {
+                // Use CSS width (resolve % against viewport width) and derive height from aspect ratio
+                displayWidth = static_cast<int>(
+                    imgStyle.imageWidth.toPixels(emSize, static_cast<float>(self->viewportWidth)) + 0.5f);
+                if (displayWidth > self->viewportWidth) displayWidth = self->viewportWidth;
+                if (displayWidth < 1) displayWidth = 1;
+                displayHeight = static_cast<int>(displayWidth * (static_cast<float>(dims.height) / dims.width) + 0.5f);
+                if (displayHeight > self->viewportHeight) {
+                  displayHeight = self->viewportHeight;
+                  // Rescale width to preserve aspect ratio when height is clamped
+                  displayWidth =
+                      static_cast<int>(displayHeight * (static_cast<float>(dims.width) / dims.height) + 0.5f);
+                  if (displayWidth < 1) displayWidth = 1;
                 }
+                if (displayHeight < 1) displayHeight = 1;
+                LOG_DBG("EHP", "Display size from CSS width: %dx%d", displayWidth, displayHeight);
+              } else {
+                // Scale to fit viewport while maintaining aspect ratio
+                int maxWidth = self->viewportWidth;
+                int maxHeight = self->viewportHeight;
+                float scaleX = (dims.width > maxWidth) ? (float)maxWidth / dims.width : 1.0f;
+                float scaleY = (dims.height > maxHeight) ? (float)maxHeight / dims.height : 1.0f;
+                float scale = (scaleX < scaleY) ? scaleX : scaleY;
+                if (scale > 1.0f) scale = 1.0f;
+
+                displayWidth = (int)(dims.width * scale);
+                displayHeight = (int)(dims.height * scale);
+                LOG_DBG("EHP", "Display size: %dx%d (scale %.2f)", displayWidth, displayHeight, scale);
+              }
 
-                // Create ImageBlock and add to page
-                auto imageBlock = std::make_shared<ImageBlock>(cachedImagePath, displayWidth, displayHeight);
-                if (!imageBlock) {
-                  LOG_ERR("EHP", "Failed to create ImageBlock");
+              if (self->inTableCell) {
+                // A picture in a cell splits its row: the row so far goes above it, the rest of the cell below
+                self->splitTableRow();
+              } else {
+                // Rows of the table the image is in come before it
+                self->layoutTable();
+              }
+              // Create page for image - only break if image won't fit remaining space
+              if (self->currentPage && !self->currentPage->getElements().empty() &&
+                  (self->currentPageNextY + displayHeight > self->viewportHeight)) {
+                self->completePage();
+                self->currentPage.reset(new Page());
+                if (!self->currentPage) {
+                  LOG_ERR("EHP", "Failed to create new page");
                   return;
                 }
-                int xPos = (self->viewportWidth - displayWidth) / 2;
-                auto pageImage = std::make_shared<PageImage>(imageBlock, xPos, self->currentPageNextY);
-                if (!pageImage) {
-                  LOG_ERR("EHP", "Failed to create PageImage");
+                self->currentPageNextY = 0;
+              } else if (!self->currentPage) {
+                self->currentPage.reset(new Page());
+                if (!self->currentPage) {
+                  LOG_ERR("EHP", "Failed to create initial page");
                   return;
                 }
-                self->currentPage->elements.push_back(pageImage);
-                self->currentPageNextY += displayHeight;
-
-                self->depth += 1;
-                return;
-              } else {
-                LOG_ERR("EHP", "Failed to get image dimensions");
-                Storage.remove(cachedImagePath.c_str());
+                self->currentPageNextY = 0;
               }
-            } else {
-              LOG_ERR("EHP", "Failed to extract image");
+
+              // Create ImageBlock and add to page
+              auto imageBlock = std::unique_ptr<ImageBlock>(
+                  new ImageBlock(cachedImagePath, displayWidth, displayHeight, self->epub->getPath(), resolvedPath));
+              int xPos = (self->viewportWidth - displayWidth) / 2;
+              self->currentPage->addImage(std::move(imageBlock), xPos, self->currentPageNextY);
+              self->currentPageNextY += displayHeight;
+              self->notePageStart(self->textPosition);
+              // Ids on the image or just before it lead here; those of words still to be laid out wait for them
+              self->placeAnchors(self->completedPages,
+                                 self->wordsExtractedInBlock + (self->currentTextBlock
+                                                                    ? static_cast<int>(self->currentTextBlock->size())
+                                                                    : 0),
+                                 INT_MAX);
+
+              self->depth += 1;
+              return;
             }
           }  // isFormatSupported
         }
@@ -430,30 +561,27 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     }
   }
 
-  if (matches(name, SKIP_TAGS, NUM_SKIP_TAGS)) {
+  if (roles & TAG_SKIP) {
     // start skip
+    self->skippingRawText = true;
     self->skipUntilDepth = self->depth;
     self->depth += 1;
+    self->tokenizer->skipElementContent(name);
     return;
   }
 
   // Skip blocks with role="doc-pagebreak" and epub:type="pagebreak"
-  if (atts != nullptr) {
-    for (int i = 0; atts[i]; i += 2) {
-      if (strcmp(atts[i], "role") == 0 && strcmp(atts[i + 1], "doc-pagebreak") == 0 ||
-          strcmp(atts[i], "epub:type") == 0 && strcmp(atts[i + 1], "pagebreak") == 0) {
-        self->skipUntilDepth = self->depth;
-        self->depth += 1;
-        return;
-      }
-    }
+  if (pageBreak) {
+    self->skipUntilDepth = self->depth;
+    self->depth += 1;
+    return;
   }
 
   // Detect internal <a href="..."> links (footnotes, cross-references)
   // Note: <aside epub:type="footnote"> elements are rendered as normal content
   // without special handling. Links pointing to them are collected as footnotes.
-  if (strcmp(name, "a") == 0) {
-    const char* href = getAttribute(atts, "href");
+  if (roles & TAG_ANCHOR) {
+    const char* href = getAttribute(atts, ATTR_HREF);
 
     bool isInternalLink = isInternalEpubLink(href);
 
@@ -484,8 +612,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
       entry.depth = self->depth;
       entry.hasUnderline = true;
       entry.underline = true;
-      self->inlineStyleStack.push_back(entry);
-      self->updateEffectiveInlineStyle();
+      self->pushInlineStyle(entry);
 
       // Skip CSS resolution — we already handled styling for this <a> tag
       self->depth += 1;
@@ -497,6 +624,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
   CssStyle cssStyle;
   if (self->cssParser) {
     // Get combined tag + class styles
+    self->cssNames.addElement(name, classAttr);
     cssStyle = self->cssParser->resolveStyle(name, classAttr);
     // Merge inline style (highest priority)
     if (!styleAttr.empty()) {
@@ -509,8 +637,7 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
   const auto userAlignmentBlockStyle = BlockStyle::fromCssStyle(
       cssStyle, emSize, static_cast<CssTextAlign>(self->paragraphAlignment), self->viewportWidth);
 
-  if (matches(name, HEADER_TAGS, NUM_HEADER_TAGS)) {
-    self->currentCssStyle = cssStyle;
+  if (roles & TAG_HEADER) {
     auto headerBlockStyle = BlockStyle::fromCssStyle(cssStyle, emSize, CssTextAlign::Center, self->viewportWidth);
     headerBlockStyle.textAlignDefined = true;
     if (self->embeddedStyle && cssStyle.hasTextAlign()) {
@@ -518,24 +645,25 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
     }
     self->startNewTextBlock(headerBlockStyle);
     self->boldUntilDepth = std::min(self->boldUntilDepth, self->depth);
-    self->updateEffectiveInlineStyle();
-  } else if (matches(name, BLOCK_TAGS, NUM_BLOCK_TAGS)) {
-    if (strcmp(name, "br") == 0) {
+    self->setBlockStyle(cssStyle);
+  } else if (roles & TAG_BLOCK) {
+    if (roles & TAG_BR) {
       if (self->partWordBufferIndex > 0) {
         // flush word preceding <br/> to currentTextBlock before calling startNewTextBlock
         self->flushPartWordBuffer();
       }
-      self->startNewTextBlock(self->currentTextBlock->getBlockStyle());
+      // A copy: the current block, and the style in it, is gone once the new block starts
+      const BlockStyle lineBreakStyle = self->currentTextBlock->getBlockStyle();
+      self->startNewTextBlock(lineBreakStyle);
     } else {
-      self->currentCssStyle = cssStyle;
       self->startNewTextBlock(userAlignmentBlockStyle);
-      self->updateEffectiveInlineStyle();
+      self->setBlockStyle(cssStyle);
 
-      if (strcmp(name, "li") == 0) {
-        self->currentTextBlock->addWord("\xe2\x80\xa2", EpdFontFamily::REGULAR);
+      if (roles & TAG_LI) {
+        self->currentTextBlock->addWord("\xe2\x80\xa2", EpdFontFamily::REGULAR, false, false, self->textPosition);
       }
     }
-  } else if (matches(name, UNDERLINE_TAGS, NUM_UNDERLINE_TAGS)) {
+  } else if (roles & TAG_UNDERLINE) {
     // Flush buffer before style change so preceding text gets current style
     if (self->partWordBufferIndex > 0) {
       self->flushPartWordBuffer();
@@ -555,9 +683,8 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
       entry.hasItalic = true;
       entry.italic = cssStyle.fontStyle == CssFontStyle::Italic;
     }
-    self->inlineStyleStack.push_back(entry);
-    self->updateEffectiveInlineStyle();
-  } else if (matches(name, BOLD_TAGS, NUM_BOLD_TAGS)) {
+    self->pushInlineStyle(entry);
+  } else if (roles & TAG_BOLD) {
     // Flush buffer before style change so preceding text gets current style
     if (self->partWordBufferIndex > 0) {
       self->flushPartWordBuffer();
@@ -577,9 +704,8 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
       entry.hasUnderline = true;
       entry.underline = cssStyle.textDecoration == CssTextDecoration::Underline;
     }
-    self->inlineStyleStack.push_back(entry);
-    self->updateEffectiveInlineStyle();
-  } else if (matches(name, ITALIC_TAGS, NUM_ITALIC_TAGS)) {
+    self->pushInlineStyle(entry);
+  } else if (roles & TAG_ITALIC) {
     // Flush buffer before style change so preceding text gets current style
     if (self->partWordBufferIndex > 0) {
       self->flushPartWordBuffer();
@@ -599,9 +725,8 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
       entry.hasUnderline = true;
       entry.underline = cssStyle.textDecoration == CssTextDecoration::Underline;
     }
-    self->inlineStyleStack.push_back(entry);
-    self->updateEffectiveInlineStyle();
-  } else if (strcmp(name, "span") == 0 || !isHeaderOrBlock(name)) {
+    self->pushInlineStyle(entry);
+  } else {
     // Handle span and other inline elements for CSS styling
     if (cssStyle.hasFontWeight() || cssStyle.hasFontStyle() || cssStyle.hasTextDecoration()) {
       // Flush buffer before style change so preceding text gets current style
@@ -623,16 +748,19 @@ void XMLCALL ChapterHtmlSlimParser::startElement(void* userData, const XML_Char*
         entry.hasUnderline = true;
         entry.underline = cssStyle.textDecoration == CssTextDecoration::Underline;
       }
-      self->inlineStyleStack.push_back(entry);
-      self->updateEffectiveInlineStyle();
+      self->pushInlineStyle(entry);
     }
   }
 
   // Unprocessed tag, just increasing depth and continue forward
   self->depth += 1;
+
+  if (roles & TAG_HEADER_OR_BLOCK) {
+    self->offerCheckpoint();
+  }
 }
 
-void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char* s, const int len) {
+void ChapterHtmlSlimParser::characterData(void* userData, const char* s, const int len) {
   auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
 
   // Skip content of nested table
@@ -658,6 +786,16 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
     }
   }
 
+  // Text position of s[index], counted up as the loop goes; text the parser makes up itself has none of its own
+  int countedTo = 0;
+  uint32_t position = self->textPosition;
+  const auto positionOf = [&](const int index) {
+    for (; self->readingSource && countedTo < index; countedTo++) {
+      position += !isWhitespace(s[countedTo]);
+    }
+    return position;
+  };
+
   for (int i = 0; i < len; i++) {
     if (isWhitespace(s[i])) {
       // Currently looking at whitespace, if there's anything in the partWordBuffer, flush it
@@ -696,6 +834,7 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
       self->partWordBuffer[0] = ' ';
       self->partWordBuffer[1] = '\0';
       self->partWordBufferIndex = 1;
+      self->partWordPosition = positionOf(i);
       self->nextWordContinues = true;  // Attach space to previous word (no break).
       self->flushPartWordBuffer();
 
@@ -715,6 +854,7 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
       self->partWordBuffer[0] = ' ';
       self->partWordBuffer[1] = '\0';
       self->partWordBufferIndex = 1;
+      self->partWordPosition = positionOf(i);
       self->nextWordContinues = true;
       self->flushPartWordBuffer();
 
@@ -725,9 +865,9 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
     }
 
     // Skip Zero Width No-Break Space / BOM (U+FEFF) = 0xEF 0xBB 0xBF
-    const XML_Char FEFF_BYTE_1 = static_cast<XML_Char>(0xEF);
-    const XML_Char FEFF_BYTE_2 = static_cast<XML_Char>(0xBB);
-    const XML_Char FEFF_BYTE_3 = static_cast<XML_Char>(0xBF);
+    const char FEFF_BYTE_1 = static_cast<char>(0xEF);
+    const char FEFF_BYTE_2 = static_cast<char>(0xBB);
+    const char FEFF_BYTE_3 = static_cast<char>(0xBF);
 
     if (s[i] == FEFF_BYTE_1) {
       // Check if the next two bytes complete the 3-byte sequence
@@ -743,54 +883,61 @@ void XMLCALL ChapterHtmlSlimParser::characterData(void* userData, const XML_Char
       self->flushPartWordBuffer();
     }
 
+    if (self->partWordBufferIndex == 0) {
+      self->partWordPosition = positionOf(i);
+    }
     self->partWordBuffer[self->partWordBufferIndex++] = s[i];
   }
 
-  // If we have > 750 words buffered up, perform the layout and consume out all but the last line
+  // If too many words are buffered up, lay out the lines that are settled and keep only the last few
   // There should be enough here to build out 1-2 full pages and doing this will free up a lot of
   // memory.
   // Spotted when reading Intermezzo, there are some really long text blocks in there.
-  if (self->currentTextBlock->size() > 750) {
+  if (self->inTableCell) {
+    if (self->table->bufferedWords() + self->currentTextBlock->size() > TableLayout::MAX_BUFFERED_WORDS) {
+      LOG_DBG("EHP", "Table row too long, laying it out in parts");
+      self->splitTableRow();
+    }
+  } else if (self->currentTextBlock->size() > ParsedText::LAYOUT_WINDOW_WORDS) {
     LOG_DBG("EHP", "Text block too long, splitting into multiple pages");
-    self->currentTextBlock->layoutAndExtractLines(
-        self->renderer, self->fontId, self->viewportWidth,
-        [self](const std::shared_ptr<TextBlock>& textBlock) { self->addLineToPage(textBlock); }, false);
+    self->makePages(false);
   }
 }
 
-void XMLCALL ChapterHtmlSlimParser::defaultHandlerExpand(void* userData, const XML_Char* s, const int len) {
-  // Check if this looks like an entity reference (&...;)
-  if (len >= 3 && s[0] == '&' && s[len - 1] == ';') {
-    const char* utf8Value = lookupHtmlEntity(s, static_cast<size_t>(len));
-    if (utf8Value != nullptr) {
-      // Known entity: expand to its UTF-8 value
-      characterData(userData, utf8Value, strlen(utf8Value));
-      return;
-    }
-    // Unknown entity: preserve original &...; sequence
-    characterData(userData, s, len);
+void ChapterHtmlSlimParser::sourceCharacterData(void* userData, const char* s, const int len) {
+  auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
+  if (self->skippingRawText) {
     return;
   }
-  // Not an entity we recognize - skip it
+  self->readingSource = true;
+  characterData(userData, s, len);
+  self->readingSource = false;
+  for (int i = 0; i < len; i++) {
+    self->textPosition += !isWhitespace(s[i]);
+  }
 }
 
-void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* name) {
+void ChapterHtmlSlimParser::endElement(void* userData, const char* name) {
   auto* self = static_cast<ChapterHtmlSlimParser*>(userData);
+  const size_t nameStart = self->openElements.rfind(' ');
+  if (nameStart != std::string::npos) {
+    self->openElements.erase(nameStart);
+  }
 
   // Check if any style state will change after we decrement depth
   // If so, we MUST flush the partWordBuffer with the CURRENT style first
   // Note: depth hasn't been decremented yet, so we check against (depth - 1)
-  const bool willPopStyleStack =
-      !self->inlineStyleStack.empty() && self->inlineStyleStack.back().depth == self->depth - 1;
+  const bool willPopStyleStack = self->inlineStyleOpenAt(self->depth - 1);
   const bool willClearBold = self->boldUntilDepth == self->depth - 1;
   const bool willClearItalic = self->italicUntilDepth == self->depth - 1;
   const bool willClearUnderline = self->underlineUntilDepth == self->depth - 1;
 
   const bool styleWillChange = willPopStyleStack || willClearBold || willClearItalic || willClearUnderline;
-  const bool headerOrBlockTag = isHeaderOrBlock(name);
-  const bool tableStructuralTag = isTableStructuralTag(name);
+  const uint16_t roles = tagRoles(name);
+  const bool headerOrBlockTag = roles & TAG_HEADER_OR_BLOCK;
+  const bool tableStructuralTag = roles & TAG_TABLE_STRUCTURAL;
 
-  if (self->tableDepth > 1 && strcmp(name, "table") == 0) {
+  if (self->tableDepth > 1 && (roles & TAG_TABLE)) {
     // get rid of all text inside the nested table
     self->partWordBufferIndex = 0;
     self->tableDepth -= 1;
@@ -801,12 +948,11 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
   // Flush buffer with current style BEFORE any style changes
   if (self->partWordBufferIndex > 0) {
     // Flush if style will change OR if we're closing a block/structural element
-    const bool isInlineTag =
-        !headerOrBlockTag && !tableStructuralTag && !matches(name, IMAGE_TAGS, NUM_IMAGE_TAGS) && self->depth != 1;
-    const bool shouldFlush = styleWillChange || headerOrBlockTag || matches(name, BOLD_TAGS, NUM_BOLD_TAGS) ||
-                             matches(name, ITALIC_TAGS, NUM_ITALIC_TAGS) ||
-                             matches(name, UNDERLINE_TAGS, NUM_UNDERLINE_TAGS) || tableStructuralTag ||
-                             matches(name, IMAGE_TAGS, NUM_IMAGE_TAGS) || self->depth == 1;
+    const bool isInlineTag = !headerOrBlockTag && !tableStructuralTag && !(roles & TAG_IMAGE) && self->depth != 1;
+    const bool shouldFlush =
+        styleWillChange ||
+        (roles & (TAG_HEADER_OR_BLOCK | TAG_BOLD | TAG_ITALIC | TAG_UNDERLINE | TAG_TABLE_STRUCTURAL | TAG_IMAGE)) ||
+        self->depth == 1;
 
     if (shouldFlush) {
       self->flushPartWordBuffer();
@@ -827,9 +973,13 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
       entry.number[sizeof(entry.number) - 1] = '\0';
       strncpy(entry.href, self->currentFootnoteLinkHref, sizeof(entry.href) - 1);
       entry.href[sizeof(entry.href) - 1] = '\0';
-      int wordIndex =
-          self->wordsExtractedInBlock + (self->currentTextBlock ? static_cast<int>(self->currentTextBlock->size()) : 0);
-      self->pendingFootnotes.push_back({wordIndex, entry});
+      if (self->inTableCell) {
+        self->table->addFootnote(entry);
+      } else {
+        int wordIndex = self->wordsExtractedInBlock +
+                        (self->currentTextBlock ? static_cast<int>(self->currentTextBlock->size()) : 0);
+        self->pendingFootnotes.push_back({wordIndex, entry});
+      }
     }
     self->insideFootnoteLink = false;
   }
@@ -837,20 +987,32 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
   // Leaving skip
   if (self->skipUntilDepth == self->depth) {
     self->skipUntilDepth = INT_MAX;
+    self->skippingRawText = false;
   }
 
-  if (self->tableDepth == 1 && (strcmp(name, "td") == 0 || strcmp(name, "th") == 0)) {
+  if (self->tableDepth == 1 && (roles & (TAG_TABLE_CELL | TAG_TABLE_ROW))) {
     self->nextWordContinues = false;
   }
 
-  if (self->tableDepth == 1 && (strcmp(name, "tr") == 0)) {
-    self->nextWordContinues = false;
+  if (self->tableDepth == 1 && (roles & TAG_TABLE_CELL) && self->inTableCell) {
+    self->endTableCell();
+  }
+
+  if (self->tableDepth == 1 && (roles & TAG_TABLE_ROW)) {
+    self->table->endRow();
+    if (self->table->bufferedWords() >= TableLayout::FLUSH_WORDS) {
+      self->layoutTable();
+    }
   }
 
-  if (self->tableDepth == 1 && strcmp(name, "table") == 0) {
+  if (self->tableDepth == 1 && (roles & TAG_TABLE)) {
+    if (self->inTableCell) {
+      self->endTableCell();
+    }
+    self->layoutTable();
+    self->table.reset();
+    self->tableArena.release();
     self->tableDepth -= 1;
-    self->tableRowIndex = 0;
-    self->tableColIndex = 0;
     self->nextWordContinues = false;
   }
 
@@ -871,22 +1033,21 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
 
   // Pop from inline style stack if we pushed an entry at this depth
   // This handles all inline elements: b, i, u, span, etc.
-  if (!self->inlineStyleStack.empty() && self->inlineStyleStack.back().depth == self->depth) {
-    self->inlineStyleStack.pop_back();
+  if (self->inlineStyleOpenAt(self->depth)) {
+    self->inlineStyleCount--;
     self->updateEffectiveInlineStyle();
   }
 
   // Clear block style when leaving header or block elements
   if (headerOrBlockTag) {
-    self->currentCssStyle.reset();
-    self->updateEffectiveInlineStyle();
+    self->setBlockStyle(CssStyle());
 
     // Reset alignment on empty text blocks to prevent stale alignment from bleeding
     // into the next sibling element. This fixes issue #1026 where an empty <h1> (default
     // Center) followed by an image-only <p> causes Center to persist through the chain
     // of empty block reuse into subsequent text paragraphs.
     // Margins/padding are preserved so parent element spacing still accumulates correctly.
-    if (self->currentTextBlock && self->currentTextBlock->isEmpty()) {
+    if (self->currentTextBlock && self->currentTextBlock->isEmpty() && !self->inTableCell) {
       auto style = self->currentTextBlock->getBlockStyle();
       style.textAlignDefined = false;
       style.alignment = (self->paragraphAlignment == static_cast<uint8_t>(CssTextAlign::None))
@@ -897,112 +1058,496 @@ void XMLCALL ChapterHtmlSlimParser::endElement(void* userData, const XML_Char* n
   }
 }
 
-bool ChapterHtmlSlimParser::parseAndBuildPages() {
+BlockStyle ChapterHtmlSlimParser::paragraphBlockStyle() const {
   auto paragraphAlignmentBlockStyle = BlockStyle();
   paragraphAlignmentBlockStyle.textAlignDefined = true;
-  // Resolve None sentinel to Justify for initial block (no CSS context yet)
-  const auto align = (this->paragraphAlignment == static_cast<uint8_t>(CssTextAlign::None))
-                         ? CssTextAlign::Justify
-                         : static_cast<CssTextAlign>(this->paragraphAlignment);
-  paragraphAlignmentBlockStyle.alignment = align;
-  startNewTextBlock(paragraphAlignmentBlockStyle);
+  // Resolve None sentinel to Justify (no CSS context)
+  paragraphAlignmentBlockStyle.alignment = (paragraphAlignment == static_cast<uint8_t>(CssTextAlign::None))
+                                               ? CssTextAlign::Justify
+                                               : static_cast<CssTextAlign>(paragraphAlignment);
+  return paragraphAlignmentBlockStyle;
+}
 
-  const XML_Parser parser = XML_ParserCreate(nullptr);
-  int done;
+bool ChapterHtmlSlimParser::beginParse() {
+  // A resumed parse has the block the checkpoint was at already
+  if (!currentTextBlock) {
+    startNewTextBlock(paragraphBlockStyle());
+  }
 
-  if (!parser) {
+  tokenizerFailed = false;
+  tokenizer = ChapterTokenizer::create(CHAPTER_LIGHT_TOKENIZER && !expatTokenizer,
+                                       {this, startElement, endElement, sourceCharacterData});
+  if (!tokenizer) {
     LOG_ERR("EHP", "Couldn't allocate memory for parser");
     return false;
   }
 
-  // Handle HTML entities (like &nbsp;) that aren't in XML spec or DTD
-  // Using DefaultHandlerExpand preserves normal entity expansion from DOCTYPE
-  XML_SetDefaultHandlerExpand(parser, defaultHandlerExpand);
-
-  FsFile file;
-  if (!Storage.openFileForRead("EHP", filepath, file)) {
-    XML_ParserFree(parser);
+  // Retry opening the entry for SD card timing issues
+  sourceFailed = false;
+  for (int attempt = 0; attempt < 3 && !source; attempt++) {
+    if (attempt > 0) {
+      LOG_DBG("EHP", "Retrying stream (attempt %d)...", attempt + 1);
+      delay(50);  // Brief delay before retry
+    }
+    source = epub->openItemStream(itemHref, PARSE_BUFFER_SIZE);
+  }
+  if (!source) {
+    LOG_ERR("EHP", "Failed to open %s for streaming", itemHref.c_str());
+    sourceFailed = true;
+    releaseParser();
+    return false;
+  }
+  if (resumeOffset > 0 && resumeSourceSize != source->getEntryStreamSize()) {
+    LOG_ERR("EHP", "Checkpoint is for another version of %s", itemHref.c_str());
+    releaseParser();
     return false;
   }
 
-  // Get file size to decide whether to show indexing popup.
-  if (popupFn && file.size() >= MIN_SIZE_FOR_POPUP) {
+  // Use the inflated size to decide whether to show indexing popup.
+  if (popupFn && source->getEntryStreamSize() >= MIN_SIZE_FOR_POPUP) {
     popupFn();
   }
 
-  XML_SetUserData(parser, this);
-  XML_SetElementHandler(parser, startElement, endElement);
-  XML_SetCharacterDataHandler(parser, characterData);
-
   // Compute the time taken to parse and build pages
-  const uint32_t chapterStartTime = millis();
-  do {
-    void* const buf = XML_GetBuffer(parser, PARSE_BUFFER_SIZE);
-    if (!buf) {
-      LOG_ERR("EHP", "Couldn't allocate memory for buffer");
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
-      return false;
-    }
+  chapterStartTime = millis();
+  return true;
+}
 
-    const size_t len = file.read(buf, PARSE_BUFFER_SIZE);
+bool ChapterHtmlSlimParser::getImageDimensions(const std::string& resolvedPath, ImageDimensions& dims) {
+  // Images sized by an earlier build of any chapter of the book aren't opened again
+  const auto format = ImageDecoderFactory::getFormat(resolvedPath);
+  imageManifest.load(ImageManifest::getPath(epub->getCachePath()));
+  uint16_t width = 0;
+  uint16_t height = 0;
+  if (imageManifest.find(resolvedPath, format, width, height)) {
+    dims = {static_cast<int16_t>(width), static_cast<int16_t>(height)};
+    LOG_DBG("EHP", "Image dimensions (manifest): %dx%d", dims.width, dims.height);
+    return true;
+  }
 
-    if (len == 0 && file.available() > 0) {
-      LOG_ERR("EHP", "File read error");
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
-      return false;
-    }
+  ImageToFramebufferDecoder* decoder = ImageDecoderFactory::getDecoder(resolvedPath);
+  auto source = ImageSource::open(resolvedPath, epub->getPath(), ZipFile::getIndexPath(epub->getCachePath()));
+  if (!source) {
+    LOG_ERR("EHP", "Failed to open image");
+    return false;
+  }
+  if (!decoder || !decoder->getDimensions(*source, dims)) {
+    LOG_ERR("EHP", "Failed to get image dimensions");
+    return false;
+  }
+  LOG_DBG("EHP", "Image dimensions: %dx%d", dims.width, dims.height);
+  if (dims.width > 0 && dims.height > 0) {
+    imageManifest.add(resolvedPath, format, dims.width, dims.height);
+  }
+  return true;
+}
 
-    done = file.available() == 0;
+void ChapterHtmlSlimParser::releaseParser() {
+  tokenizer.reset();
+  source.reset();
+}
 
-    if (XML_ParseBuffer(parser, static_cast<int>(len), done) == XML_STATUS_ERROR) {
-      LOG_ERR("EHP", "Parse error at line %lu:\n%s", XML_GetCurrentLineNumber(parser),
-              XML_ErrorString(XML_GetErrorCode(parser)));
-      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-      XML_SetCharacterDataHandler(parser, nullptr);
-      XML_ParserFree(parser);
-      file.close();
-      return false;
-    }
-  } while (!done);
-  LOG_DBG("EHP", "Time to parse and build pages: %lu ms", millis() - chapterStartTime);
+ChapterHtmlSlimParser::~ChapterHtmlSlimParser() { releaseParser(); }
+
+ChapterHtmlSlimParser::ParseStatus ChapterHtmlSlimParser::parseNextChunk() {
+  if (!tokenizer) {
+    LOG_ERR("EHP", "parseNextChunk called without an active parser");
+    return ParseStatus::Failed;
+  }
+  if (resumeOffset > 0) {
+    return skipToCheckpoint();
+  }
+
+  char* const buf = tokenizer->getBuffer(PARSE_BUFFER_SIZE);
+  if (!buf) {
+    LOG_ERR("EHP", "Couldn't get a parse buffer: %s", tokenizer->getErrorString());
+    tokenizerFailed = CHAPTER_LIGHT_TOKENIZER && !expatTokenizer;
+    releaseParser();
+    return ParseStatus::Failed;
+  }
+
+  const int len = source->readEntryStream(reinterpret_cast<uint8_t*>(buf), PARSE_BUFFER_SIZE);
+
+  if (len < 0 || (len == 0 && !source->isEntryStreamDone())) {
+    LOG_ERR("EHP", "Stream read error");
+    sourceFailed = true;
+    releaseParser();
+    return ParseStatus::Failed;
+  }
 
-  XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
-  XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
-  XML_SetCharacterDataHandler(parser, nullptr);
-  XML_ParserFree(parser);
-  file.close();
+  const bool done = source->isEntryStreamDone();
+
+  TRACE_BEGIN(Parse, len);
+  const bool parsed = tokenizer->parseBuffer(len, done);
+  TRACE_END(Parse);
+  if (!parsed) {
+    LOG_ERR("EHP", "Parse error at line %lu:\n%s", tokenizer->getCurrentLine(), tokenizer->getErrorString());
+    tokenizerFailed = CHAPTER_LIGHT_TOKENIZER && !expatTokenizer;
+    releaseParser();
+    return ParseStatus::Failed;
+  }
+
+  if (!done) {
+    return ParseStatus::InProgress;
+  }
+
+  LOG_DBG("EHP", "Time to parse and build pages: %lu ms", millis() - chapterStartTime);
+  LOG_DBG("EHP", "Word width cache: %lu hits, %lu misses", static_cast<unsigned long>(widthCache.getHits()),
+          static_cast<unsigned long>(widthCache.getMisses()));
+  LOG_DBG("EHP", "Hyphenation cache: %lu hits, %lu misses", static_cast<unsigned long>(hyphenationCache.getHits()),
+          static_cast<unsigned long>(hyphenationCache.getMisses()));
+  releaseParser();
+  imageManifest.save();
+
+  // A table still open at the end of the chapter
+  if (table) {
+    if (inTableCell) {
+      endTableCell();
+    }
+    layoutTable();
+    table.reset();
+    tableDepth = 0;
+  }
 
   // Process last page if there is still text
   if (currentTextBlock) {
     makePages();
-    completePageFn(std::move(currentPage));
+    completePage();
     currentPage.reset();
     currentTextBlock.reset();
   }
+  // Ids after the last words lead to the last page
+  placeAnchors(completedPages > 0 ? completedPages - 1 : 0, 0, INT_MAX);
+  textArena.release();
+  tableArena.release();
+  pageArena.release();
 
+  return ParseStatus::Done;
+}
+
+bool ChapterHtmlSlimParser::parseAndBuildPages() {
+  if (!beginParse()) {
+    return false;
+  }
+
+  ParseStatus status;
+  do {
+    status = parseNextChunk();
+  } while (status == ParseStatus::InProgress);
+
+  return status == ParseStatus::Done;
+}
+
+void ChapterHtmlSlimParser::offerCheckpoint() {
+  // What is still to be tied to words, rows or a link can't be put back on resuming: only an empty block with nothing
+  // pending will do
+  if (!checkpointFn || rootTagEnd == 0 || tableDepth > 0 || table || inTableCell || insideFootnoteLink ||
+      skipUntilDepth != INT_MAX || partWordBufferIndex > 0 || !currentTextBlock->isEmpty() ||
+      !pendingFootnotes.empty()) {
+    return;
+  }
+  uint32_t tagEnd = 0;
+  if (!tokenizer->getStartTagEnd(tagEnd)) {
+    return;
+  }
+  checkpointOffset = tagEnd + inputShift;
+  checkpointFn();
+}
+
+bool ChapterHtmlSlimParser::saveCheckpoint(BufferedFileWriter& out, SectionDictionary& dictionary) const {
+  serialization::writePod(out, static_cast<uint32_t>(source->getEntryStreamSize()));
+  serialization::writePod(out, checkpointOffset);
+  serialization::writePod(out, rootTagEnd);
+  serialization::writeString(out, openElements);
+
+  serialization::writePod(out, static_cast<int32_t>(depth));
+  serialization::writePod(out, static_cast<int32_t>(boldUntilDepth));
+  serialization::writePod(out, static_cast<int32_t>(italicUntilDepth));
+  serialization::writePod(out, static_cast<int32_t>(underlineUntilDepth));
+  serialization::writePod(out, static_cast<uint8_t>(inlineStyleCount));
+  for (int i = 0; i < inlineStyleCount; i++) {
+    serialization::writePod(out, static_cast<int32_t>(inlineStyleStack[i].depth));
+    serialization::writePod(out, static_cast<uint8_t>(inlineStyleStack[i].bold));
+    serialization::writePod(out, static_cast<uint8_t>(inlineStyleStack[i].italic));
+    serialization::writePod(out, static_cast<uint8_t>(inlineStyleStack[i].underline));
+  }
+  serialization::writePod(out, blockBold);
+  serialization::writePod(out, blockItalic);
+  serialization::writePod(out, blockUnderline);
+  serialization::writePod(out, currentTextBlock->getBlockStyle());
+  serialization::writePod(out, static_cast<int32_t>(wordsExtractedInBlock));
+  serialization::writePod(out, static_cast<int32_t>(imageCounter));
+  serialization::writePod(out, textPosition);
+  serialization::writePod(out, completedPages);
+  serialization::writePod(out, anchorsDropped);
+
+  serialization::writePod(out, static_cast<uint32_t>(pendingAnchors.size()));
+  for (const auto& anchor : pendingAnchors) {
+    serialization::writePod(out, static_cast<int32_t>(anchor.wordIndex));
+    serialization::writePod(out, anchor.hash);
+  }
+  serialization::writePod(out, static_cast<uint32_t>(anchors.size()));
+  for (const auto& anchor : anchors) {
+    serialization::writePod(out, anchor.hash);
+    serialization::writePod(out, anchor.page);
+  }
+  serialization::writePod(out, static_cast<uint32_t>(pagePositions.size()));
+  for (const uint32_t position : pagePositions) {
+    serialization::writePod(out, position);
+  }
+
+  // The page being filled, as a page record preceded by its size
+  serialization::writePod(out, currentPageNextY);
+  const uint32_t sizeOffset = out.position();
+  serialization::writePod(out, static_cast<uint32_t>(0));
+  if (currentPage && !currentPage->serialize(out, dictionary)) {
+    return false;
+  }
+  const uint32_t end = out.position();
+  if (currentPage) {
+    out.seek(sizeOffset);
+    serialization::writePod(out, end - sizeOffset - static_cast<uint32_t>(sizeof(uint32_t)));
+    out.seek(end);
+  }
+  return out.flush();
+}
+
+bool ChapterHtmlSlimParser::loadCheckpoint(BufferedFileReader& in, const SectionDictionary& dictionary) {
+  int32_t value = 0;
+  const auto readInt = [&in, &value]() {
+    serialization::readPod(in, value);
+    return static_cast<int>(value);
+  };
+
+  serialization::readPod(in, resumeSourceSize);
+  serialization::readPod(in, resumeOffset);
+  serialization::readPod(in, rootTagEnd);
+  serialization::readString(in, openElements);
+  depth = readInt();
+  boldUntilDepth = readInt();
+  italicUntilDepth = readInt();
+  underlineUntilDepth = readInt();
+  uint8_t styleCount = 0;
+  serialization::readPod(in, styleCount);
+  if (styleCount > MAX_INLINE_STYLE_DEPTH) {
+    LOG_ERR("EHP", "Bad checkpoint: %u inline styles", styleCount);
+    return false;
+  }
+  inlineStyleCount = styleCount;
+  for (int i = 0; i < inlineStyleCount; i++) {
+    uint8_t flags[3];
+    inlineStyleStack[i].depth = readInt();
+    in.read(flags, sizeof(flags));
+    inlineStyleStack[i].bold = static_cast<InlineFlag>(flags[0]);
+    inlineStyleStack[i].italic = static_cast<InlineFlag>(flags[1]);
+    inlineStyleStack[i].underline = static_cast<InlineFlag>(flags[2]);
+  }
+  serialization::readPod(in, blockBold);
+  serialization::readPod(in, blockItalic);
+  serialization::readPod(in, blockUnderline);
+  updateEffectiveInlineStyle();
+  BlockStyle blockStyle;
+  serialization::readPod(in, blockStyle);
+  currentTextBlock.reset(new ParsedText(extraParagraphSpacing, hyphenationEnabled, blockStyle, &textArena,
+                                        &widthCache, &hyphenationCache));
+  wordsExtractedInBlock = readInt();
+  imageCounter = readInt();
+  serialization::readPod(in, textPosition);
+  serialization::readPod(in, completedPages);
+  serialization::readPod(in, anchorsDropped);
+
+  uint32_t count = 0;
+  serialization::readPod(in, count);
+  if (count > MAX_ANCHORS) {
+    LOG_ERR("EHP", "Bad checkpoint: %u pending ids", static_cast<unsigned>(count));
+    return false;
+  }
+  pendingAnchors.resize(count);
+  for (auto& anchor : pendingAnchors) {
+    anchor.wordIndex = readInt();
+    serialization::readPod(in, anchor.hash);
+  }
+  serialization::readPod(in, count);
+  if (count > MAX_ANCHORS) {
+    LOG_ERR("EHP", "Bad checkpoint: %u ids", static_cast<unsigned>(count));
+    return false;
+  }
+  anchors.resize(count);
+  for (auto& anchor : anchors) {
+    serialization::readPod(in, anchor.hash);
+    serialization::readPod(in, anchor.page);
+  }
+  serialization::readPod(in, count);
+  if (count > static_cast<uint32_t>(completedPages) + 1) {
+    LOG_ERR("EHP", "Bad checkpoint: %u page positions for %u pages", static_cast<unsigned>(count), completedPages);
+    return false;
+  }
+  pagePositions.resize(count);
+  for (uint32_t& position : pagePositions) {
+    serialization::readPod(in, position);
+  }
+
+  uint32_t pageSize = 0;
+  serialization::readPod(in, currentPageNextY);
+  serialization::readPod(in, pageSize);
+  if (pageSize > MAX_CHECKPOINT_PAGE_SIZE) {
+    LOG_ERR("EHP", "Bad checkpoint: %u byte page", static_cast<unsigned>(pageSize));
+    return false;
+  }
+  if (pageSize > 0) {
+    std::vector<uint8_t> record(pageSize);
+    if (in.read(record.data(), pageSize) != static_cast<int>(pageSize) ||
+        !(currentPage = Page::deserialize(record.data(), pageSize, dictionary))) {
+      LOG_ERR("EHP", "Bad checkpoint: unreadable page");
+      return false;
+    }
+  }
+
+  // Every element open at the checkpoint is opened again by the prefix, the root in its own start tag
+  replayedStartTags = static_cast<int>(std::count(openElements.begin(), openElements.end(), ' '));
+  if (resumeOffset == 0 || rootTagEnd == 0 || rootTagEnd > resumeOffset || replayedStartTags < 2) {
+    LOG_ERR("EHP", "Bad checkpoint: offset %u", static_cast<unsigned>(resumeOffset));
+    resumeOffset = 0;
+    return false;
+  }
   return true;
 }
 
-void ChapterHtmlSlimParser::addLineToPage(std::shared_ptr<TextBlock> line) {
+// The prolog and root start tag of the chapter are tokenized again, as they are, then the other elements open at the
+// checkpoint get bare start tags of their own. Their attributes had their effect already; what they set is restored.
+ChapterHtmlSlimParser::ParseStatus ChapterHtmlSlimParser::skipToCheckpoint() {
+  const size_t position = source->getEntryStreamPosition();
+  if (position >= rootTagEnd) {
+    // Inflated and dropped a slice at a time
+    const size_t target = std::min<size_t>(resumeOffset, position + CHECKPOINT_SKIP_SLICE);
+    if (!source->seekEntryStream(target)) {
+      LOG_ERR("EHP", "Couldn't skip to the checkpoint at %u", static_cast<unsigned>(resumeOffset));
+      sourceFailed = true;
+      releaseParser();
+      return ParseStatus::Failed;
+    }
+    if (target == resumeOffset) {
+      LOG_DBG("EHP", "Resuming at %u of %u, page %u", static_cast<unsigned>(resumeOffset),
+              static_cast<unsigned>(resumeSourceSize), completedPages);
+      resumeOffset = 0;
+    }
+    return ParseStatus::InProgress;
+  }
+
+  const int wanted = static_cast<int>(std::min<size_t>(PARSE_BUFFER_SIZE, rootTagEnd - position));
+  char* const buf = tokenizer->getBuffer(wanted);
+  if (!buf) {
+    LOG_ERR("EHP", "Couldn't get a parse buffer: %s", tokenizer->getErrorString());
+    releaseParser();
+    return ParseStatus::Failed;
+  }
+  const int len = source->readEntryStream(reinterpret_cast<uint8_t*>(buf), wanted);
+  if (len <= 0) {
+    LOG_ERR("EHP", "Stream read error");
+    sourceFailed = true;
+    releaseParser();
+    return ParseStatus::Failed;
+  }
+  bool parsed = tokenizer->parseBuffer(len, false);
+  if (parsed && position + len == rootTagEnd) {
+    std::string tags;
+    for (size_t start = openElements.find(' ', 1); start != std::string::npos;) {
+      const size_t next = openElements.find(' ', start + 1);
+      tags += '<';
+      tags.append(openElements, start + 1, (next == std::string::npos ? openElements.size() : next) - start - 1);
+      tags += '>';
+      start = next;
+    }
+    char* const tagBuf = tokenizer->getBuffer(static_cast<int>(tags.size()));
+    parsed = tagBuf != nullptr;
+    if (parsed) {
+      memcpy(tagBuf, tags.data(), tags.size());
+      parsed = tokenizer->parseBuffer(static_cast<int>(tags.size()), false);
+    }
+    inputShift = static_cast<int32_t>(resumeOffset - rootTagEnd - tags.size());
+  }
+  if (!parsed) {
+    LOG_ERR("EHP", "Couldn't tokenize the way back to the checkpoint: %s", tokenizer->getErrorString());
+    releaseParser();
+    return ParseStatus::Failed;
+  }
+  return ParseStatus::InProgress;
+}
+
+uint32_t ChapterHtmlSlimParser::anchorHash(const char* id, const size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ static_cast<uint8_t>(id[i])) * 16777619u;
+  }
+  return hash;
+}
+
+void ChapterHtmlSlimParser::completePage() {
+  notePageStart(textPosition);
+  completePageFn(std::move(currentPage));
+  completedPages++;
+  pageArena.reset();
+}
+
+void ChapterHtmlSlimParser::addAnchor(const char* id) {
+  if (id[0] == '\0') {
+    return;
+  }
+  if (anchors.size() + pendingAnchors.size() + (table ? table->anchorCount() : 0) >= MAX_ANCHORS) {
+    if (!anchorsDropped) {
+      LOG_DBG("EHP", "More than %u ids in chapter, ignoring the rest", static_cast<unsigned>(MAX_ANCHORS));
+      anchorsDropped = true;
+    }
+    return;
+  }
+  if (table && table->hasOpenRow()) {
+    table->addAnchor(anchorHash(id, strlen(id)));
+    return;
+  }
+  // The word the id comes before: a partial word in the buffer is still to be added to the block
+  const int wordIndex = wordsExtractedInBlock +
+                        (currentTextBlock ? static_cast<int>(currentTextBlock->size()) : 0) +
+                        (partWordBufferIndex > 0 ? 1 : 0);
+  pendingAnchors.push_back({wordIndex, anchorHash(id, strlen(id))});
+}
+
+void ChapterHtmlSlimParser::placeAnchors(const uint16_t page, const int fromWord, const int endWord) {
+  auto it = pendingAnchors.begin();
+  while (it != pendingAnchors.end()) {
+    if (it->wordIndex >= fromWord && it->wordIndex < endWord) {
+      anchors.push_back({it->hash, page});
+      it = pendingAnchors.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ChapterHtmlSlimParser::notePageStart(const uint32_t position) {
+  if (pagePositions.size() > completedPages) {
+    return;
+  }
+  // Kept ascending for lookups: an image goes to a page before the words of its paragraph that came ahead of it
+  pagePositions.push_back(pagePositions.empty() ? position : std::max(pagePositions.back(), position));
+}
+
+void ChapterHtmlSlimParser::addLineToPage(TextBlock::Ptr line) {
   const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
 
   if (currentPageNextY + lineHeight > viewportHeight) {
-    completePageFn(std::move(currentPage));
+    // The page arena goes with the page being completed; the line starting the next one is moved out of it
+    if (line->inArena()) {
+      line = line->copy(nullptr);
+    }
+    completePage();
     currentPage.reset(new Page());
     currentPageNextY = 0;
   }
+  notePageStart(currentTextBlock ? currentTextBlock->getLinePosition() : textPosition);
 
   // Track cumulative words to assign footnotes to the page containing their anchor
   wordsExtractedInBlock += line->wordCount();
+  placeAnchors(completedPages, 0, wordsExtractedInBlock);
   auto footnoteIt = pendingFootnotes.begin();
   while (footnoteIt != pendingFootnotes.end() && footnoteIt->first <= wordsExtractedInBlock) {
     currentPage->addFootnote(footnoteIt->second.number, footnoteIt->second.href);
@@ -1012,11 +1557,11 @@ void ChapterHtmlSlimParser::addLineToPage(std::shared_ptr<TextBlock> line) {
 
   // Apply horizontal left inset (margin + padding) as x position offset
   const int16_t xOffset = line->getBlockStyle().leftInset();
-  currentPage->elements.push_back(std::make_shared<PageLine>(line, xOffset, currentPageNextY));
+  currentPage->addLine(std::move(line), xOffset, currentPageNextY);
   currentPageNextY += lineHeight;
 }
 
-void ChapterHtmlSlimParser::makePages() {
+void ChapterHtmlSlimParser::makePages(const bool includeLastLine) {
   if (!currentTextBlock) {
     LOG_ERR("EHP", "!! No text block to make pages for !!");
     return;
@@ -1029,13 +1574,15 @@ void ChapterHtmlSlimParser::makePages() {
 
   const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
 
-  // Apply top spacing before the paragraph (stored in pixels)
+  // Apply top spacing before the paragraph (stored in pixels), unless a partial layout started it already
   const BlockStyle& blockStyle = currentTextBlock->getBlockStyle();
-  if (blockStyle.marginTop > 0) {
-    currentPageNextY += blockStyle.marginTop;
-  }
-  if (blockStyle.paddingTop > 0) {
-    currentPageNextY += blockStyle.paddingTop;
+  if (wordsExtractedInBlock == 0) {
+    if (blockStyle.marginTop > 0) {
+      currentPageNextY += blockStyle.marginTop;
+    }
+    if (blockStyle.paddingTop > 0) {
+      currentPageNextY += blockStyle.paddingTop;
+    }
   }
 
   // Calculate effective width accounting for horizontal margins/padding
@@ -1045,7 +1592,11 @@ void ChapterHtmlSlimParser::makePages() {
 
   currentTextBlock->layoutAndExtractLines(
       renderer, fontId, effectiveWidth,
-      [this](const std::shared_ptr<TextBlock>& textBlock) { addLineToPage(textBlock); });
+      [this](TextBlock::Ptr textBlock) { addLineToPage(std::move(textBlock)); }, includeLastLine, &pageArena);
+  if (!includeLastLine) {
+    // The rest of the paragraph is still to come
+    return;
+  }
 
   // Fallback: transfer any remaining pending footnotes to current page.
   // Normally addLineToPage handles this via word-index tracking, but this catches
@@ -1070,3 +1621,101 @@ void ChapterHtmlSlimParser::makePages() {
     currentPageNextY += lineHeight / 2;
   }
 }
+
+void ChapterHtmlSlimParser::beginTableCell(const bool header, const uint8_t colspan) {
+  // Text of the table outside its cells (e.g. a caption) is laid out on its own, in the order it comes in
+  if (!currentTextBlock->isEmpty()) {
+    startNewTextBlock(paragraphBlockStyle());
+  }
+  if (!table->hasOpenRow()) {
+    table->beginRow(textPosition);
+  }
+  table->beginCell(colspan);
+
+  tableCellStyle = BlockStyle();
+  tableCellStyle.textAlignDefined = true;
+  tableCellStyle.alignment = header ? CssTextAlign::Center : CssTextAlign::Left;
+  tableCellStyle.textIndentDefined = true;
+  inTableCell = true;
+  currentTextBlock.reset(new ParsedText(extraParagraphSpacing, hyphenationEnabled, tableCellStyle, &tableArena,
+                                        &widthCache, &hyphenationCache));
+  textArena.reset();
+  if (header) {
+    boldUntilDepth = std::min(boldUntilDepth, depth);
+  }
+}
+
+void ChapterHtmlSlimParser::endTableCell() {
+  table->addParagraph(std::move(currentTextBlock));
+  inTableCell = false;
+  currentTextBlock.reset(new ParsedText(extraParagraphSpacing, hyphenationEnabled, paragraphBlockStyle(), &textArena,
+                                        &widthCache, &hyphenationCache));
+  wordsExtractedInBlock = 0;
+}
+
+void ChapterHtmlSlimParser::splitTableRow() {
+  const uint16_t column = table->openCellColumn();
+  const uint8_t colspan = table->openCellSpan();
+  table->addParagraph(std::move(currentTextBlock));
+  layoutTable();
+  table->beginRow(textPosition, column);
+  table->beginCell(colspan);
+  currentTextBlock.reset(new ParsedText(extraParagraphSpacing, hyphenationEnabled, tableCellStyle, &tableArena,
+                                        &widthCache, &hyphenationCache));
+}
+
+void ChapterHtmlSlimParser::layoutTable() {
+  if (!table || table->empty()) {
+    return;
+  }
+  if (!currentPage) {
+    currentPage.reset(new Page());
+    currentPageNextY = 0;
+  }
+  table->layout(renderer, fontId, viewportWidth,
+                [this](TableLayout::Row& row, std::vector<TableLayout::VisualLine>& lines) {
+                  addTableRowToPage(row, lines);
+                });
+  // The cells' paragraphs are gone, and the one being filled, if any, is with them
+  tableArena.reset();
+}
+
+void ChapterHtmlSlimParser::addTableRowToPage(TableLayout::Row& row, std::vector<TableLayout::VisualLine>& lines) {
+  const int lineHeight = renderer.getLineHeight(fontId) * lineCompression;
+
+  // Ids ahead of the row (on the table, the row itself) and those in it lead to the page the row starts on
+  const auto placeRowNotes = [this, &row]() {
+    notePageStart(row.position);
+    placeAnchors(completedPages, 0, INT_MAX);
+    for (const uint32_t hash : row.anchors) {
+      anchors.push_back({hash, completedPages});
+    }
+    for (const auto& footnote : row.footnotes) {
+      currentPage->addFootnote(footnote.number, footnote.href);
+    }
+  };
+  if (lines.empty()) {
+    placeRowNotes();
+    return;
+  }
+
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (currentPageNextY + lineHeight > viewportHeight) {
+      completePage();
+      currentPage.reset(new Page());
+      currentPageNextY = 0;
+    }
+    if (i == 0) {
+      placeRowNotes();
+    } else {
+      notePageStart(row.position);
+    }
+    for (auto& placed : lines[i]) {
+      currentPage->addLine(std::move(placed.line), placed.x, currentPageNextY);
+    }
+    currentPageNextY += lineHeight;
+  }
+
+  // Rows are set apart by a bit of space, in place of rules
+  currentPageNextY += lineHeight / 4;
+}
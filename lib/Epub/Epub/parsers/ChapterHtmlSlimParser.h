@@ -1,18 +1,28 @@
 #pragma once
 
-#include <expat.h>
+#include <BufferedFile.h>
+#include <ZipFile.h>
 
 #include <climits>
 #include <functional>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "../BumpArena.h"
 #include "../FootnoteEntry.h"
+#include "../HyphenationCache.h"
+#include "../ImageManifest.h"
 #include "../ParsedText.h"
+#include "../SectionDictionary.h"
+#include "../TableLayout.h"
+#include "../WordWidthCache.h"
 #include "../blocks/ImageBlock.h"
 #include "../blocks/TextBlock.h"
+#include "../css/CssNameFilter.h"
 #include "../css/CssParser.h"
 #include "../css/CssStyle.h"
+#include "ChapterTokenizer.h"
 
 class Page;
 class GfxRenderer;
@@ -21,8 +31,16 @@ class Epub;
 #define MAX_WORD_SIZE 200
 
 class ChapterHtmlSlimParser {
+ public:
+  // Page an element with an id attribute starts on, by the id's anchorHash()
+  struct AnchorPage {
+    uint32_t hash;
+    uint16_t page;
+  };
+
+ private:
   std::shared_ptr<Epub> epub;
-  const std::string& filepath;
+  std::string itemHref;
   GfxRenderer& renderer;
   std::function<void(std::unique_ptr<Page>)> completePageFn;
   std::function<void()> popupFn;  // Popup callback
@@ -36,7 +54,15 @@ class ChapterHtmlSlimParser {
   char partWordBuffer[MAX_WORD_SIZE + 1] = {};
   int partWordBufferIndex = 0;
   bool nextWordContinues = false;  // true when next flushed word attaches to previous (inline element boundary)
+  // Word storage of currentTextBlock, reset whenever a new text block starts. Declared first so it outlives the block.
+  BumpArena textArena;
+  // Word storage of the cells of the table being buffered, reset once its rows are laid out
+  BumpArena tableArena;
+  // Lines of currentPage, reset once it has been handed to completePageFn
+  BumpArena pageArena;
   std::unique_ptr<ParsedText> currentTextBlock = nullptr;
+  WordWidthCache widthCache;          // Lives for the whole section build
+  HyphenationCache hyphenationCache;  // Likewise
   std::unique_ptr<Page> currentPage = nullptr;
   int16_t currentPageNextY = 0;
   int fontId;
@@ -47,26 +73,45 @@ class ChapterHtmlSlimParser {
   uint16_t viewportHeight;
   bool hyphenationEnabled;
   const CssParser* cssParser;
+  CssNameFilter cssNames;  // Tag and class names styles were resolved for
   bool embeddedStyle;
   std::string contentBase;
   std::string imageBasePath;
   int imageCounter = 0;
+  ImageManifest imageManifest;  // Loaded at the chapter's first image, saved once it is parsed
 
   // Style tracking (replaces depth-based approach)
+  // What an inline element sets of bold, italic and underline
   struct StyleStackEntry {
     int depth = 0;
     bool hasBold = false, bold = false;
     bool hasItalic = false, italic = false;
     bool hasUnderline = false, underline = false;
   };
-  std::vector<StyleStackEntry> inlineStyleStack;
-  CssStyle currentCssStyle;
+  // Each level of the stack holds what its element and those around it come to, so a push, a pop and the effective
+  // style are O(1) however deep the spans of Word or InDesign exports nest. Elements nested past the last level keep
+  // the style around them.
+  enum class InlineFlag : uint8_t { FromBlock, Off, On };
+  struct InlineStyleLevel {
+    int depth;
+    InlineFlag bold, italic, underline;
+  };
+  static constexpr int MAX_INLINE_STYLE_DEPTH = 32;
+  InlineStyleLevel inlineStyleStack[MAX_INLINE_STYLE_DEPTH] = {};
+  int inlineStyleCount = 0;
+  // All the inline styles use of the current block's CSS
+  bool blockBold = false;
+  bool blockItalic = false;
+  bool blockUnderline = false;
   bool effectiveBold = false;
   bool effectiveItalic = false;
   bool effectiveUnderline = false;
   int tableDepth = 0;
-  int tableRowIndex = 0;
-  int tableColIndex = 0;
+  // Rows of the table being parsed, laid out in batches. While a cell is open currentTextBlock is a paragraph of it,
+  // kept in tableArena and handed to the table when the next paragraph or the cell ends.
+  std::unique_ptr<TableLayout> table;
+  bool inTableCell = false;
+  BlockStyle tableCellStyle;
 
   // Footnote link tracking
   bool insideFootnoteLink = false;
@@ -77,28 +122,94 @@ class ChapterHtmlSlimParser {
   std::vector<std::pair<int, FootnoteEntry>> pendingFootnotes;  // <wordIndex, entry>
   int wordsExtractedInBlock = 0;
 
+  // Ids seen but not placed yet, by the index in the current text block of the word they come before. They're placed
+  // on the page that word's line goes to, like footnotes are.
+  struct PendingAnchor {
+    int wordIndex;
+    uint32_t hash;
+  };
+  std::vector<PendingAnchor> pendingAnchors;
+  std::vector<AnchorPage> anchors;
+  bool anchorsDropped = false;
+  uint16_t completedPages = 0;
+
+  // Text positions (see getPageTextPositions): where the chapter's text is up to, where the word in partWordBuffer
+  // started, and those of the pages started so far
+  uint32_t textPosition = 0;
+  uint32_t partWordPosition = 0;
+  bool readingSource = false;    // characterData() is handed the chapter's own text, not generated labels
+  bool skippingRawText = false;  // Inside head, script or style, whose text has no positions
+  std::vector<uint32_t> pagePositions;
+
+  // Incremental parse state (see beginParse / parseNextChunk)
+  std::unique_ptr<ChapterTokenizer> tokenizer;
+  // Use Expat even when built with the light tokenizer, see hadTokenizerError()
+  bool expatTokenizer;
+  bool tokenizerFailed = false;
+  std::unique_ptr<ZipFile> source;
+  bool sourceFailed = false;
+  uint32_t chapterStartTime = 0;
+
+  // Checkpoints (see saveCheckpoint). Offsets are into the chapter's XHTML; a resumed tokenizer is fed a prefix of
+  // the root start tag and the elements open at the checkpoint first, and inputShift turns its offsets into these.
+  std::function<void()> checkpointFn;
+  std::string openElements;  // Names of the open elements, each after a space
+  uint32_t rootTagEnd = 0;   // Past the root element's start tag, 0 if there's no getting back inside it
+  uint32_t checkpointOffset = 0;
+  int32_t inputShift = 0;
+  // Set by loadCheckpoint() until the input has been skipped up to the checkpoint
+  uint32_t resumeOffset = 0;
+  uint32_t resumeSourceSize = 0;
+  int replayedStartTags = 0;  // Start tags of the prefix still to come, which opened their elements the first time
+
+  void pushInlineStyle(const StyleStackEntry& entry);
+  bool inlineStyleOpenAt(int elementDepth) const {
+    return inlineStyleCount > 0 && inlineStyleStack[inlineStyleCount - 1].depth == elementDepth;
+  }
+  void setBlockStyle(const CssStyle& cssStyle);
   void updateEffectiveInlineStyle();
   void startNewTextBlock(const BlockStyle& blockStyle);
+  // Style of a paragraph with no CSS of its own, in the user's alignment
+  BlockStyle paragraphBlockStyle() const;
+  void beginTableCell(bool header, uint8_t colspan);
+  void endTableCell();
+  // Lays out the cell being filled and the rest of its row, to go on in a row of their own: keeps one giant row from
+  // being held in full
+  void splitTableRow();
+  // Lays out the buffered rows of the table
+  void layoutTable();
+  void addTableRowToPage(TableLayout::Row& row, std::vector<TableLayout::VisualLine>& lines);
   void flushPartWordBuffer();
-  void makePages();
-  // XML callbacks
-  static void XMLCALL startElement(void* userData, const XML_Char* name, const XML_Char** atts);
-  static void XMLCALL characterData(void* userData, const XML_Char* s, int len);
-  static void XMLCALL defaultHandlerExpand(void* userData, const XML_Char* s, int len);
-  static void XMLCALL endElement(void* userData, const XML_Char* name);
+  void makePages(bool includeLastLine = true);
+  void completePage();
+  void addAnchor(const char* id);
+  // Places the pending ids coming before words fromWord up to endWord on page
+  void placeAnchors(uint16_t page, int fromWord, int endWord);
+  // The page being filled starts at position, unless something is on it already
+  void notePageStart(uint32_t position);
+  void releaseParser();
+  // At the start of a block: calls checkpointFn if the state there is one saveCheckpoint() can save
+  void offerCheckpoint();
+  // Intrinsic size of the image at resolvedPath, from the book's manifest or else its header
+  bool getImageDimensions(const std::string& resolvedPath, ImageDimensions& dims);
+  // Tokenizer callbacks
+  static void startElement(void* userData, const char* name, const char** atts);
+  static void characterData(void* userData, const char* s, int len);
+  static void sourceCharacterData(void* userData, const char* s, int len);
+  static void endElement(void* userData, const char* name);
 
  public:
-  explicit ChapterHtmlSlimParser(std::shared_ptr<Epub> epub, const std::string& filepath, GfxRenderer& renderer,
+  explicit ChapterHtmlSlimParser(std::shared_ptr<Epub> epub, const std::string& itemHref, GfxRenderer& renderer,
                                  const int fontId, const float lineCompression, const bool extraParagraphSpacing,
                                  const uint8_t paragraphAlignment, const uint16_t viewportWidth,
                                  const uint16_t viewportHeight, const bool hyphenationEnabled,
                                  const std::function<void(std::unique_ptr<Page>)>& completePageFn,
                                  const bool embeddedStyle, const std::string& contentBase,
                                  const std::string& imageBasePath, const std::function<void()>& popupFn = nullptr,
-                                 const CssParser* cssParser = nullptr)
+                                 const CssParser* cssParser = nullptr, const bool expatTokenizer = false)
 
       : epub(epub),
-        filepath(filepath),
+        itemHref(itemHref),
         renderer(renderer),
         fontId(fontId),
         lineCompression(lineCompression),
@@ -112,9 +223,55 @@ class ChapterHtmlSlimParser {
         cssParser(cssParser),
         embeddedStyle(embeddedStyle),
         contentBase(contentBase),
-        imageBasePath(imageBasePath) {}
+        imageBasePath(imageBasePath),
+        expatTokenizer(expatTokenizer) {}
+
+  ~ChapterHtmlSlimParser();
+
+  enum class ParseStatus { InProgress, Done, Failed };
+
+  // Incremental parsing: beginParse() opens the chapter entry in the epub and sets up Expat, then each
+  // parseNextChunk() call inflates one PARSE_BUFFER_SIZE chunk straight into the parser. This lets callers interleave
+  // a chapter build with other work (e.g. idle-time pre-indexing) and stop between chunks. Dropping the parser
+  // mid-way releases everything.
+  bool beginParse();
+  ParseStatus parseNextChunk();
+  // True when the last failure came from reading the epub rather than from malformed XML, i.e. a restart may succeed
+  bool hadSourceError() const { return sourceFailed; }
+  // True when the light tokenizer (CHAPTER_LIGHT_TOKENIZER builds) gave up on the chapter, which may still parse with
+  // Expat: pass expatTokenizer to start over with it
+  bool hadTokenizerError() const { return tokenizerFailed; }
 
-  ~ChapterHtmlSlimParser() = default;
+  // Checkpoints: at the start of a block outside tables and footnote links, the parser's state comes down to the
+  // page being filled, the open elements and the styles and positions reached, and is saved by saveCheckpoint() for a
+  // later build to pick up from with loadCheckpoint(). checkpointFn is called at each such point, from within
+  // parseNextChunk(), and may save a checkpoint there. The page is saved with the section's dictionary, so its words
+  // go into it in the order they would once the page is complete.
+  void setCheckpointFn(const std::function<void()>& fn) { checkpointFn = fn; }
+  bool saveCheckpoint(BufferedFileWriter& out, SectionDictionary& dictionary) const;
+  // Before beginParse(): the parse goes on from the checkpoint, completePageFn getting the pages after it. False if
+  // the checkpoint can't be read; beginParse() fails if it's for another version of the chapter.
+  bool loadCheckpoint(BufferedFileReader& in, const SectionDictionary& dictionary);
+
+  // Names of the elements styled with the CSS rules; those of the whole chapter once parsing is Done, unless it began
+  // at a checkpoint
+  const CssNameFilter& getCssNames() const { return cssNames; }
+  // Ids of the chapter and the pages they're on, in document order; complete once parsing is Done
+  const std::vector<AnchorPage>& getAnchors() const { return anchors; }
+  // FNV-1a of an id, as the anchors are keyed by
+  static uint32_t anchorHash(const char* id, size_t length);
+  // Text position each page starts at, complete once parsing is Done. A text position counts the non-whitespace bytes
+  // of the chapter's text (entities expanded, head, script and style left out) before a character, so it depends on
+  // the XHTML alone and not on the layout: it's how a place in the chapter is found again from outside (e.g. a
+  // KOReader xpointer) and in other layouts.
+  const std::vector<uint32_t>& getPageTextPositions() const { return pagePositions; }
+
+  // Parse the whole chapter in one go. The pages handed to completePageFn are theirs, but the lines on a page are
+  // only valid until the call returns: they are built in an arena that is then reused for the next page.
   bool parseAndBuildPages();
-  void addLineToPage(std::shared_ptr<TextBlock> line);
+  void addLineToPage(TextBlock::Ptr line);
+
+ private:
+  // A chunk of the way from the start of the chapter to the checkpoint a resumed parse picks up from
+  ParseStatus skipToCheckpoint();
 };
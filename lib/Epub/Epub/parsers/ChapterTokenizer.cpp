@@ -0,0 +1,228 @@
+#include "ChapterTokenizer.h"
+
+#include <expat.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "../htmlEntities.h"
+#include "XhtmlTokenizer.h"
+
+namespace {
+bool isWhitespace(const char c) { return c == ' ' || c == '\r' || c == '\n' || c == '\t'; }
+
+class ExpatChapterTokenizer final : public ChapterTokenizer {
+  XML_Parser parser = nullptr;
+  Handlers handlers;
+  int level = 0;
+
+  // Raw skip: once skipElementContent() is called the parser is suspended, and the content of the element is dropped
+  // by scanning for its close tag before Expat gets to tokenize it
+  bool rawSkipPending = false;  // Suspended at the start tag, see beginRawSkip()
+  bool rawSkipping = false;     // Close tag not seen yet, chunks are scanned instead of parsed
+  int rawSkipLevel = 0;
+  char rawSkipCloseTag[16] = {};
+  uint8_t rawSkipCloseTagLen = 0;
+  // Tail of the last scanned bytes, which may hold the start of the close tag
+  char rawSkipCarry[16] = {};
+  uint8_t rawSkipCarryLen = 0;
+  // Input bytes raw skipping kept from Expat, which its byte index doesn't count
+  uint32_t droppedBytes = 0;
+  char* chunk = nullptr;
+
+  static void XMLCALL onStartElement(void* userData, const XML_Char* name, const XML_Char** atts) {
+    auto* self = static_cast<ExpatChapterTokenizer*>(userData);
+    self->level++;
+    self->handlers.startElement(self->handlers.userData, name, atts);
+  }
+
+  static void XMLCALL onEndElement(void* userData, const XML_Char* name) {
+    auto* self = static_cast<ExpatChapterTokenizer*>(userData);
+    // An empty element (<script src="..."/>) ends with its start tag, there is nothing to skip
+    if (self->rawSkipPending && self->level == self->rawSkipLevel) {
+      self->rawSkipPending = false;
+    }
+    self->level--;
+    self->handlers.endElement(self->handlers.userData, name);
+  }
+
+  static void XMLCALL onCharacterData(void* userData, const XML_Char* s, const int len) {
+    auto* self = static_cast<ExpatChapterTokenizer*>(userData);
+    self->handlers.characterData(self->handlers.userData, s, len);
+  }
+
+  // Handle HTML entities (like &nbsp;) that aren't in XML spec or DTD
+  static void XMLCALL onDefault(void* userData, const XML_Char* s, const int len) {
+    // Check if this looks like an entity reference (&...;)
+    if (len >= 3 && s[0] == '&' && s[len - 1] == ';') {
+      auto* self = static_cast<ExpatChapterTokenizer*>(userData);
+      const char* utf8Value = lookupHtmlEntity(s, static_cast<size_t>(len));
+      if (utf8Value != nullptr) {
+        // Known entity: expand to its UTF-8 value
+        self->handlers.characterData(self->handlers.userData, utf8Value, strlen(utf8Value));
+        return;
+      }
+      // Unknown entity: preserve original &...; sequence
+      self->handlers.characterData(self->handlers.userData, s, len);
+      return;
+    }
+    // Not an entity we recognize - skip it
+  }
+
+  // Offset of the close tag of the skipped element in data, -1 if it isn't (completely) there
+  int findRawSkipEnd(const char* data, const int len) const {
+    const char* const end = data + len;
+    const char* p = data;
+    while ((p = static_cast<const char*>(memchr(p, '<', end - p))) != nullptr) {
+      if (end - p <= rawSkipCloseTagLen) {
+        return -1;
+      }
+      const char next = p[rawSkipCloseTagLen];
+      if (memcmp(p, rawSkipCloseTag, rawSkipCloseTagLen) == 0 && (next == '>' || isWhitespace(next))) {
+        return static_cast<int>(p - data);
+      }
+      p++;
+    }
+    return -1;
+  }
+
+  void keepRawSkipCarry(const char* data, const int len) {
+    rawSkipCarryLen = static_cast<uint8_t>(std::min(len, static_cast<int>(rawSkipCloseTagLen)));
+    memcpy(rawSkipCarry, data + len - rawSkipCarryLen, rawSkipCarryLen);
+  }
+
+  // The parser is suspended right after the start tag of a skipped element. What follows it is already in Expat's
+  // buffer, so it can't be taken out; it is blanked up to the close tag instead, which Expat reads as a single run of
+  // whitespace. If the close tag isn't in the buffer, the following chunks are scanned by skipRawChunk().
+  void beginRawSkip() {
+    rawSkipPending = false;
+    int offset = 0;
+    int size = 0;
+    // Expat's own input buffer, writable memory behind the const
+    auto* const context = const_cast<char*>(XML_GetInputContext(parser, &offset, &size));
+    if (!context) {
+      return;
+    }
+    char* const rest = context + offset;
+    const int restLen = size - offset;
+    int end = findRawSkipEnd(rest, restLen);
+    if (end < 0) {
+      keepRawSkipCarry(rest, restLen);
+      // Expat has counted the carry already, in the blanked run, and is handed it again with the next chunk
+      droppedBytes -= rawSkipCarryLen;
+      rawSkipping = true;
+      end = restLen;
+    }
+    for (int i = 0; i < end; i++) {
+      // Keep line breaks so parse errors still report the right line
+      if (rest[i] != '\n') {
+        rest[i] = ' ';
+      }
+    }
+  }
+
+  // Drops the skipped bytes at the front of a chunk that hasn't been handed to Expat yet. Returns how many bytes are
+  // left for Expat, moved to the start of data.
+  int skipRawChunk(char* data, const int len) {
+    const int end = findRawSkipEnd(data, len);
+    if (end < 0) {
+      keepRawSkipCarry(data, len);
+      // The carry goes to Expat's next buffer and is counted then
+      droppedBytes += len - rawSkipCarryLen;
+      return 0;
+    }
+    rawSkipping = false;
+    droppedBytes += end;
+    memmove(data, data + end, len - end);
+    return len - end;
+  }
+
+ public:
+  explicit ExpatChapterTokenizer(const Handlers& handlers) : handlers(handlers) {}
+
+  ~ExpatChapterTokenizer() override {
+    if (parser) {
+      XML_StopParser(parser, XML_FALSE);                // Stop any pending processing
+      XML_SetElementHandler(parser, nullptr, nullptr);  // Clear callbacks
+      XML_SetCharacterDataHandler(parser, nullptr);
+      XML_ParserFree(parser);
+    }
+  }
+
+  bool begin() {
+    parser = XML_ParserCreate(nullptr);
+    if (!parser) {
+      return false;
+    }
+    // Using DefaultHandlerExpand preserves normal entity expansion from DOCTYPE
+    XML_SetDefaultHandlerExpand(parser, onDefault);
+    XML_SetUserData(parser, this);
+    XML_SetElementHandler(parser, onStartElement, onEndElement);
+    XML_SetCharacterDataHandler(parser, onCharacterData);
+    return true;
+  }
+
+  char* getBuffer(const int len) override {
+    // While raw skipping, the bytes carried over from the last chunk go first
+    const int carried = rawSkipping ? rawSkipCarryLen : 0;
+    chunk = static_cast<char*>(XML_GetBuffer(parser, len + carried));
+    if (!chunk) {
+      return nullptr;
+    }
+    memcpy(chunk, rawSkipCarry, carried);
+    return chunk + carried;
+  }
+
+  bool parseBuffer(const int len, const bool isFinal) override {
+    const int parseLen = rawSkipping ? skipRawChunk(chunk, rawSkipCarryLen + len) : len;
+    XML_Status status = XML_ParseBuffer(parser, parseLen, isFinal);
+    while (status == XML_STATUS_SUSPENDED) {
+      if (rawSkipPending) {
+        beginRawSkip();
+      }
+      status = XML_ResumeParser(parser);
+    }
+    return status != XML_STATUS_ERROR;
+  }
+
+  void skipElementContent(const char* name) override {
+    const size_t nameLen = strlen(name);
+    if (nameLen + 2 > sizeof(rawSkipCloseTag)) {
+      return;
+    }
+    rawSkipCloseTag[0] = '<';
+    rawSkipCloseTag[1] = '/';
+    memcpy(rawSkipCloseTag + 2, name, nameLen);
+    rawSkipCloseTagLen = static_cast<uint8_t>(nameLen + 2);
+    rawSkipLevel = level;
+    // Suspend so the bytes after the start tag can be dealt with before Expat tokenizes them
+    rawSkipPending = XML_StopParser(parser, XML_TRUE) == XML_STATUS_OK;
+  }
+
+  bool getStartTagEnd(uint32_t& offset) const override {
+    int contextOffset = 0;
+    int size = 0;
+    const char* const context = XML_GetInputContext(parser, &contextOffset, &size);
+    const int count = XML_GetCurrentByteCount(parser);
+    if (!context || count < 2 || contextOffset + count > size || context[contextOffset + count - 2] == '/') {
+      return false;
+    }
+    offset = static_cast<uint32_t>(XML_GetCurrentByteIndex(parser)) + count + droppedBytes;
+    return true;
+  }
+
+  unsigned long getCurrentLine() const override { return XML_GetCurrentLineNumber(parser); }
+  const char* getErrorString() const override { return XML_ErrorString(XML_GetErrorCode(parser)); }
+};
+}  // namespace
+
+std::unique_ptr<ChapterTokenizer> ChapterTokenizer::create(const bool light, const Handlers& handlers) {
+  if (light) {
+    return std::unique_ptr<ChapterTokenizer>(new XhtmlTokenizer(handlers));
+  }
+  auto tokenizer = std::unique_ptr<ExpatChapterTokenizer>(new ExpatChapterTokenizer(handlers));
+  if (!tokenizer->begin()) {
+    return nullptr;
+  }
+  return tokenizer;
+}
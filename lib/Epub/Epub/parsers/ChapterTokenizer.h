@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+// Streaming XML tokenizer behind ChapterHtmlSlimParser. Input is written in chunks into getBuffer() and tokenized by
+// parseBuffer(), which fires the handlers for what it finds. Entities (XML, numeric and HTML named ones such as
+// &nbsp;) reach characterData already expanded.
+class ChapterTokenizer {
+ public:
+  struct Handlers {
+    void* userData;
+    // atts is a nullptr-terminated array of name, value pairs
+    void (*startElement)(void* userData, const char* name, const char** atts);
+    void (*endElement)(void* userData, const char* name);
+    void (*characterData)(void* userData, const char* s, int len);
+  };
+
+  virtual ~ChapterTokenizer() = default;
+
+  // Space for the next len bytes of input, nullptr if out of memory
+  virtual char* getBuffer(int len) = 0;
+  // Tokenizes the len bytes written to the last getBuffer(). False on malformed input or out of memory.
+  virtual bool parseBuffer(int len, bool isFinal) = 0;
+  // Only from the startElement handler: the content of that element is dropped without being tokenized, up to its
+  // close tag, whose endElement still fires. Meant for elements whose content is never rendered (head, script).
+  virtual void skipElementContent(const char* name) = 0;
+  // Only from the startElement handler: offset in the input just past that start tag, where tokenizing can be picked
+  // up again inside the element (see ChapterHtmlSlimParser::saveCheckpoint). False for an empty-element tag (<p/>),
+  // which has no inside.
+  virtual bool getStartTagEnd(uint32_t& offset) const = 0;
+
+  virtual unsigned long getCurrentLine() const = 0;
+  virtual const char* getErrorString() const = 0;
+
+  // Expat, or with light set the purpose-built XhtmlTokenizer. nullptr if out of memory.
+  static std::unique_ptr<ChapterTokenizer> create(bool light, const Handlers& handlers);
+};
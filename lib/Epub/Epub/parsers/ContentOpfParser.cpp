@@ -4,12 +4,35 @@
 #include <Logging.h>
 #include <Serialization.h>
 
+#include <algorithm>
+
 #include "../BookMetadataCache.h"
 
 namespace {
 constexpr char MEDIA_TYPE_NCX[] = "application/x-dtbncx+xml";
 constexpr char MEDIA_TYPE_CSS[] = "text/css";
 constexpr char itemCacheFile[] = "/.items.bin";
+constexpr char itemKeysFile[] = "/.items.keys";
+constexpr char itemTableFile[] = "/.items.tbl";
+// Buckets are sized to about half fill their page, so one overflowing is vanishingly rare
+constexpr uint32_t itemsPerBucket = 21;
+// Table pages built per pass over the keys, 16KB of RAM
+constexpr uint32_t itemTableBucketsPerPass = 32;
+constexpr size_t maxMetadataLength = 512;
+
+// Appends to bounded metadata, cutting at a UTF-8 sequence boundary
+void appendMetadata(std::string& out, const XML_Char* s, const int len) {
+  if (out.size() >= maxMetadataLength) {
+    return;
+  }
+  size_t take = std::min(static_cast<size_t>(len), maxMetadataLength - out.size());
+  if (take < static_cast<size_t>(len)) {
+    while (take > 0 && (static_cast<uint8_t>(s[take]) & 0xC0) == 0x80) {
+      take--;
+    }
+  }
+  out.append(s, take);
+}
 }  // namespace
 
 bool ContentOpfParser::setup() {
@@ -36,12 +59,107 @@ ContentOpfParser::~ContentOpfParser() {
   if (tempItemStore) {
     tempItemStore.close();
   }
-  if (Storage.exists((cachePath + itemCacheFile).c_str())) {
-    Storage.remove((cachePath + itemCacheFile).c_str());
+  if (itemKeys) {
+    itemKeys.close();
+  }
+  if (itemTable) {
+    itemTable.close();
+  }
+  for (const char* file : {itemCacheFile, itemKeysFile, itemTableFile}) {
+    if (Storage.exists((cachePath + file).c_str())) {
+      Storage.remove((cachePath + file).c_str());
+    }
+  }
+}
+
+bool ContentOpfParser::buildItemTable() {
+  itemTableBuckets = 0;
+  if (!Storage.openFileForRead("COF", cachePath + itemKeysFile, itemKeys)) {
+    return false;
+  }
+  if (!Storage.openFileForWrite("COF", cachePath + itemTableFile, itemTable)) {
+    itemKeys.close();
+    return false;
+  }
+  const unsigned long start = millis();
+  const uint32_t buckets = std::max<uint32_t>(1, (itemCount + itemsPerBucket - 1) / itemsPerBucket);
+
+  // Pages are filled one slice of the buckets at a time, re-reading the keys for each slice, so only the slice is in
+  // RAM however large the manifest
+  std::vector<ItemTablePage> pages(std::min(buckets, itemTableBucketsPerPass));
+  ItemKey keys[32];
+  bool ok = true;
+  for (uint32_t first = 0; ok && first < buckets; first += pages.size()) {
+    const uint32_t count = std::min<uint32_t>(pages.size(), buckets - first);
+    std::fill(pages.begin(), pages.end(), ItemTablePage{});
+    ok = itemKeys.seek(0);
+    int bytes = 0;
+    while (ok && (bytes = itemKeys.read(keys, sizeof(keys))) > 0) {
+      for (size_t i = 0; i < static_cast<size_t>(bytes) / sizeof(ItemKey); i++) {
+        const uint32_t bucket = keys[i].idHash % buckets;
+        if (bucket < first || bucket >= first + count) {
+          continue;
+        }
+        ItemTablePage& page = pages[bucket - first];
+        if (page.count < ITEM_TABLE_SLOTS) {
+          page.slots[page.count++] = keys[i];
+        } else {
+          page.overflowed = 1;
+        }
+      }
+    }
+    const size_t pageBytes = count * sizeof(ItemTablePage);
+    ok = ok && bytes == 0 && itemTable.write(reinterpret_cast<const uint8_t*>(pages.data()), pageBytes) == pageBytes;
+  }
+  itemKeys.close();
+  itemTable.close();
+  Storage.remove((cachePath + itemKeysFile).c_str());
+
+  if (!ok || !Storage.openFileForRead("COF", cachePath + itemTableFile, itemTable)) {
+    return false;
+  }
+  itemTableBuckets = buckets;
+  LOG_DBG("COF", "Indexed %u manifest items in %u buckets in %lu ms", itemCount, buckets, millis() - start);
+  return true;
+}
+
+bool ContentOpfParser::findItemHref(const std::string& idref, std::string& href) {
+  if (itemTableBuckets == 0) {
+    return scanItemHref(idref, href);
+  }
+  const uint32_t hash = fnvHash(idref);
+  ItemTablePage page;
+  if (!itemTable.seek((hash % itemTableBuckets) * sizeof(page)) ||
+      itemTable.read(&page, sizeof(page)) != sizeof(page)) {
+    return scanItemHref(idref, href);
+  }
+  for (uint16_t i = 0; i < page.count && i < ITEM_TABLE_SLOTS; i++) {
+    const ItemKey& key = page.slots[i];
+    if (key.idHash != hash || key.idLen != idref.size()) {
+      continue;
+    }
+    std::string itemId;
+    tempItemStore.seek(key.fileOffset);
+    serialization::readString(tempItemStore, itemId);
+    if (itemId == idref) {
+      serialization::readString(tempItemStore, href);
+      return true;
+    }
   }
-  itemIndex.clear();
-  itemIndex.shrink_to_fit();
-  useItemIndex = false;
+  return page.overflowed && scanItemHref(idref, href);
+}
+
+bool ContentOpfParser::scanItemHref(const std::string& idref, std::string& href) {
+  tempItemStore.seek(0);
+  std::string itemId;
+  while (tempItemStore.available()) {
+    serialization::readString(tempItemStore, itemId);
+    serialization::readString(tempItemStore, href);
+    if (itemId == idref) {
+      return true;
+    }
+  }
+  return false;
 }
 
 size_t ContentOpfParser::write(const uint8_t data) { return write(&data, 1); }
@@ -124,6 +242,9 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
     if (!Storage.openFileForWrite("COF", self->cachePath + itemCacheFile, self->tempItemStore)) {
       LOG_ERR("COF", "Couldn't open temp items file for writing. This is probably going to be a fatal error.");
     }
+    if (!Storage.openFileForWrite("COF", self->cachePath + itemKeysFile, self->itemKeys)) {
+      LOG_ERR("COF", "Couldn't open item keys file for writing, spine items will be looked up by scanning");
+    }
     return;
   }
 
@@ -132,14 +253,8 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
     if (!Storage.openFileForRead("COF", self->cachePath + itemCacheFile, self->tempItemStore)) {
       LOG_ERR("COF", "Couldn't open temp items file for reading. This is probably going to be a fatal error.");
     }
-
-    // Sort item index for binary search if we have enough items
-    if (self->itemIndex.size() >= LARGE_SPINE_THRESHOLD) {
-      std::sort(self->itemIndex.begin(), self->itemIndex.end(), [](const ItemIndexEntry& a, const ItemIndexEntry& b) {
-        return a.idHash < b.idHash || (a.idHash == b.idHash && a.idLen < b.idLen);
-      });
-      self->useItemIndex = true;
-      LOG_DBG("COF", "Using fast index for %zu manifest items", self->itemIndex.size());
+    if (self->cache && !self->buildItemTable()) {
+      LOG_ERR("COF", "Couldn't build the item table, spine items will be looked up by scanning");
     }
     return;
   }
@@ -190,13 +305,16 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
       }
     }
 
-    // Record index entry for fast lookup later
-    if (self->tempItemStore) {
-      ItemIndexEntry entry;
-      entry.idHash = fnvHash(itemId);
-      entry.idLen = static_cast<uint16_t>(itemId.size());
-      entry.fileOffset = static_cast<uint32_t>(self->tempItemStore.position());
-      self->itemIndex.push_back(entry);
+    // Record the key for the item table built at the spine
+    if (self->tempItemStore && self->itemKeys) {
+      const ItemKey key = {fnvHash(itemId), static_cast<uint16_t>(itemId.size()), 0,
+                           static_cast<uint32_t>(self->tempItemStore.position())};
+      if (self->itemKeys.write(reinterpret_cast<const uint8_t*>(&key), sizeof(key)) == sizeof(key)) {
+        self->itemCount++;
+      } else {
+        self->itemKeys.close();
+        Storage.remove((self->cachePath + itemKeysFile).c_str());
+      }
     }
 
     // Write items down to SD card
@@ -247,48 +365,7 @@ void XMLCALL ContentOpfParser::startElement(void* userData, const XML_Char* name
         if (strcmp(atts[i], "idref") == 0) {
           const std::string idref = atts[i + 1];
           std::string href;
-          bool found = false;
-
-          if (self->useItemIndex) {
-            // Fast path: binary search
-            uint32_t targetHash = fnvHash(idref);
-            uint16_t targetLen = static_cast<uint16_t>(idref.size());
-
-            auto it = std::lower_bound(self->itemIndex.begin(), self->itemIndex.end(),
-                                       ItemIndexEntry{targetHash, targetLen, 0},
-                                       [](const ItemIndexEntry& a, const ItemIndexEntry& b) {
-                                         return a.idHash < b.idHash || (a.idHash == b.idHash && a.idLen < b.idLen);
-                                       });
-
-            // Check for match (may need to check a few due to hash collisions)
-            while (it != self->itemIndex.end() && it->idHash == targetHash) {
-              self->tempItemStore.seek(it->fileOffset);
-              std::string itemId;
-              serialization::readString(self->tempItemStore, itemId);
-              if (itemId == idref) {
-                serialization::readString(self->tempItemStore, href);
-                found = true;
-                break;
-              }
-              ++it;
-            }
-          } else {
-            // Slow path: linear scan (for small manifests, keeps original behavior)
-            // TODO: This lookup is slow as need to scan through all items each time.
-            //       It can take up to 200ms per item when getting to 1500 items.
-            self->tempItemStore.seek(0);
-            std::string itemId;
-            while (self->tempItemStore.available()) {
-              serialization::readString(self->tempItemStore, itemId);
-              serialization::readString(self->tempItemStore, href);
-              if (itemId == idref) {
-                found = true;
-                break;
-              }
-            }
-          }
-
-          if (found && self->cache) {
+          if (self->findItemHref(idref, href)) {
             self->cache->createSpineEntry(href);
           }
         }
@@ -324,7 +401,7 @@ void XMLCALL ContentOpfParser::characterData(void* userData, const XML_Char* s,
   auto* self = static_cast<ContentOpfParser*>(userData);
 
   if (self->state == IN_BOOK_TITLE) {
-    self->title.append(s, len);
+    appendMetadata(self->title, s, len);
     return;
   }
 
@@ -332,12 +409,12 @@ void XMLCALL ContentOpfParser::characterData(void* userData, const XML_Char* s,
     if (!self->author.empty()) {
       self->author.append(", ");  // Add separator for multiple authors
     }
-    self->author.append(s, len);
+    appendMetadata(self->author, s, len);
     return;
   }
 
   if (self->state == IN_BOOK_LANGUAGE) {
-    self->language.append(s, len);
+    appendMetadata(self->language, s, len);
     return;
   }
 }
@@ -349,6 +426,7 @@ void XMLCALL ContentOpfParser::endElement(void* userData, const XML_Char* name)
   if (self->state == IN_SPINE && (strcmp(name, "spine") == 0 || strcmp(name, "opf:spine") == 0)) {
     self->state = IN_PACKAGE;
     self->tempItemStore.close();
+    self->itemTable.close();
     return;
   }
 
@@ -361,6 +439,7 @@ void XMLCALL ContentOpfParser::endElement(void* userData, const XML_Char* name)
   if (self->state == IN_MANIFEST && (strcmp(name, "manifest") == 0 || strcmp(name, "opf:manifest") == 0)) {
     self->state = IN_PACKAGE;
     self->tempItemStore.close();
+    self->itemKeys.close();
     return;
   }
 
@@ -1,7 +1,6 @@
 #pragma once
 #include <Print.h>
 
-#include <algorithm>
 #include <vector>
 
 #include "Epub.h"
@@ -31,16 +30,31 @@ class ContentOpfParser final : public Print {
   FsFile tempItemStore;
   std::string coverItemId;
 
-  // Index for fast idref→href lookup (used only for large EPUBs)
-  struct ItemIndexEntry {
+  // Manifest items are looked up by id through a hash table on the SD card, so the parser's RAM doesn't grow with the
+  // manifest: .items.bin holds the id and href of each item, .items.keys the hash and offset of each as the manifest
+  // is read, and when the spine starts .items.tbl is built from those with one page of slots per bucket.
+  struct ItemKey {
     uint32_t idHash;      // FNV-1a hash of itemId
     uint16_t idLen;       // length for collision reduction
+    uint16_t reserved;    // keeps the slots 4-byte aligned
     uint32_t fileOffset;  // offset in .items.bin
   };
-  std::vector<ItemIndexEntry> itemIndex;
-  bool useItemIndex = false;
+  static constexpr uint16_t ITEM_TABLE_SLOTS = 42;
+  struct ItemTablePage {
+    uint16_t count;
+    uint16_t overflowed;  // Keys that didn't fit are only found by scanning .items.bin
+    ItemKey slots[ITEM_TABLE_SLOTS];
+    uint8_t reserved[4];
+  };
+  static_assert(sizeof(ItemTablePage) == 512, "one bucket per SD sector");
+  FsFile itemKeys;
+  FsFile itemTable;
+  uint32_t itemCount = 0;
+  uint32_t itemTableBuckets = 0;  // 0 without a table, when every idref is looked up by scanning .items.bin
 
-  static constexpr uint16_t LARGE_SPINE_THRESHOLD = 400;
+  bool buildItemTable();
+  bool findItemHref(const std::string& idref, std::string& href);
+  bool scanItemHref(const std::string& idref, std::string& href);
 
   // FNV-1a hash function
   static uint32_t fnvHash(const std::string& s) {
@@ -0,0 +1,590 @@
+#include "XhtmlTokenizer.h"
+
+#include <strings.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "../htmlEntities.h"
+
+namespace {
+// The buffer grows to hold a token cut off at the end of a chunk, up to this size
+constexpr int MAX_BUFFER_SIZE = 16 * 1024;
+// Longest entity or character reference looked for, & and ; included
+constexpr int MAX_REFERENCE_LENGTH = 32;
+
+bool isWhitespace(const char c) { return c == ' ' || c == '\r' || c == '\n' || c == '\t'; }
+
+bool isNameEnd(const char c) { return isWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '\0'; }
+
+uint32_t nameHash(const char* name, const int len) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ static_cast<uint8_t>(name[i])) * 16777619u;
+  }
+  return hash;
+}
+
+// UTF-8 encoding of codepoint into out (4 bytes), returns its length or 0 if it isn't an XML character
+int encodeUtf8(const uint32_t codepoint, char* out) {
+  if (codepoint == 0 || (codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF) {
+    return 0;
+  }
+  if (codepoint < 0x80) {
+    out[0] = static_cast<char>(codepoint);
+    return 1;
+  }
+  if (codepoint < 0x800) {
+    out[0] = static_cast<char>(0xC0 | (codepoint >> 6));
+    out[1] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 2;
+  }
+  if (codepoint < 0x10000) {
+    out[0] = static_cast<char>(0xE0 | (codepoint >> 12));
+    out[1] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+    out[2] = static_cast<char>(0x80 | (codepoint & 0x3F));
+    return 3;
+  }
+  out[0] = static_cast<char>(0xF0 | (codepoint >> 18));
+  out[1] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+  out[2] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+  out[3] = static_cast<char>(0x80 | (codepoint & 0x3F));
+  return 4;
+}
+
+// Expansion of the reference ref (&...;, refLen bytes), written to scratch (4 bytes) or pointing at static storage.
+// Returns its length, or -1 for a malformed character reference. Unknown named entities expand to themselves, like
+// ChapterHtmlSlimParser did with Expat.
+int expandReference(const char* ref, const int refLen, char* scratch, const char** value) {
+  if (ref[1] == '#') {
+    const bool hex = ref[2] == 'x';
+    uint32_t codepoint = 0;
+    int digits = 0;
+    for (int i = hex ? 3 : 2; i < refLen - 1; i++, digits++) {
+      const char c = ref[i];
+      uint32_t digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (hex && c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else if (hex && c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+      } else {
+        return -1;
+      }
+      codepoint = codepoint * (hex ? 16 : 10) + digit;
+      if (codepoint > 0x10FFFF) {
+        return -1;
+      }
+    }
+    const int len = digits > 0 ? encodeUtf8(codepoint, scratch) : 0;
+    *value = scratch;
+    return len > 0 ? len : -1;
+  }
+  if (refLen == 6 && memcmp(ref, "&apos;", 6) == 0) {
+    *value = "'";
+    return 1;
+  }
+  const char* utf8Value = lookupHtmlEntity(ref, static_cast<size_t>(refLen));
+  if (utf8Value) {
+    *value = utf8Value;
+    return static_cast<int>(strlen(utf8Value));
+  }
+  *value = ref;
+  return refLen;
+}
+}  // namespace
+
+XhtmlTokenizer::XhtmlTokenizer(const Handlers& handlers) : handlers(handlers) {
+  openElements.reserve(32);
+  atts.reserve(17);
+}
+
+XhtmlTokenizer::~XhtmlTokenizer() { free(buffer); }
+
+char* XhtmlTokenizer::getBuffer(const int len) {
+  // Move the unconsumed tail to the front
+  if (pos > 0) {
+    linesBeforeBuffer += std::count(buffer, buffer + pos, '\n');
+    consumedBeforeBuffer += pos;
+    memmove(buffer, buffer + pos, end - pos);
+    end -= pos;
+    pos = 0;
+  }
+  // One more for the terminator the scans stop at
+  const int needed = end + len + 1;
+  if (needed > capacity) {
+    if (needed > MAX_BUFFER_SIZE) {
+      error = "token too long";
+      return nullptr;
+    }
+    auto* grown = static_cast<char*>(realloc(buffer, needed));
+    if (!grown) {
+      error = "out of memory";
+      return nullptr;
+    }
+    buffer = grown;
+    capacity = needed;
+  }
+  return buffer + end;
+}
+
+bool XhtmlTokenizer::getStartTagEnd(uint32_t& offset) const {
+  offset = startTagEnd;
+  return !startTagEmpty;
+}
+
+unsigned long XhtmlTokenizer::getCurrentLine() const {
+  return linesBeforeBuffer + (buffer ? std::count(buffer, buffer + pos, '\n') : 0);
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::fail(const char* message) {
+  error = message;
+  return Step::Failed;
+}
+
+// Offset of needle in the unconsumed input, -1 if it isn't there
+int XhtmlTokenizer::find(const char* needle, const int needleLen) const {
+  const char* const inputEnd = buffer + end;
+  const char* p = buffer + pos;
+  while ((p = static_cast<const char*>(memchr(p, needle[0], inputEnd - p))) != nullptr) {
+    if (inputEnd - p < needleLen) {
+      return -1;
+    }
+    if (memcmp(p, needle, needleLen) == 0) {
+      return static_cast<int>(p - buffer);
+    }
+    p++;
+  }
+  return -1;
+}
+
+// Where text running to `to` can be cut without splitting a UTF-8 sequence
+int XhtmlTokenizer::completeUtf8End(const int from, const int to) const {
+  for (int i = to - 1; i >= from && i >= to - 3; i--) {
+    const auto c = static_cast<uint8_t>(buffer[i]);
+    if (c < 0x80) {
+      return to;
+    }
+    if (c >= 0xC0) {
+      const int length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+      return to - i >= length ? to : i;
+    }
+  }
+  return to;
+}
+
+void XhtmlTokenizer::emitText(const int from, const int to) {
+  if (to > from) {
+    handlers.characterData(handlers.userData, buffer + from, to - from);
+  }
+}
+
+bool XhtmlTokenizer::parseBuffer(const int len, const bool isFinal) {
+  if (error) {
+    return false;
+  }
+  end += len;
+  buffer[end] = '\0';
+
+  if (state == State::Prolog) {
+    if (end - pos < 3 && !isFinal) {
+      return true;
+    }
+    if (end - pos >= 3 && memcmp(buffer + pos, "\xEF\xBB\xBF", 3) == 0) {
+      pos += 3;
+    } else if (static_cast<uint8_t>(buffer[pos]) == 0xFE || static_cast<uint8_t>(buffer[pos]) == 0xFF) {
+      // UTF-16 byte order mark
+      fail("unsupported encoding");
+      return false;
+    }
+    state = State::Content;
+  }
+
+  while (pos < end) {
+    Step step;
+    switch (state) {
+      case State::Comment:
+        step = skipTo("-->", 3, false);
+        break;
+      case State::CData:
+        step = skipTo("]]>", 3, true);
+        break;
+      case State::SkippedContent:
+        step = skipElement();
+        break;
+      default:
+        step = buffer[pos] == '<'   ? parseMarkup(isFinal)
+               : buffer[pos] == '&' ? parseReference(isFinal)
+                                    : parseText(isFinal);
+        break;
+    }
+    if (step == Step::Failed) {
+      return false;
+    }
+    if (step == Step::NeedMore) {
+      if (isFinal) {
+        fail("unclosed token");
+        return false;
+      }
+      break;
+    }
+  }
+
+  if (isFinal) {
+    if (state != State::Content) {
+      fail("unclosed token");
+      return false;
+    }
+    if (!rootSeen || !openElements.empty()) {
+      fail("no element found");
+      return false;
+    }
+  }
+  return true;
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseText(const bool isFinal) {
+  int textEnd = pos + static_cast<int>(strcspn(buffer + pos, "<&"));
+  if (textEnd < end && buffer[textEnd] == '\0') {
+    return fail("invalid token");
+  }
+  if (openElements.empty()) {
+    for (int i = pos; i < textEnd; i++) {
+      if (!isWhitespace(buffer[i])) {
+        return fail(rootSeen ? "junk after document element" : "syntax error");
+      }
+    }
+    pos = textEnd;
+    return Step::Consumed;
+  }
+  if (textEnd == end && !isFinal) {
+    textEnd = completeUtf8End(pos, textEnd);
+    if (textEnd == pos) {
+      return Step::NeedMore;
+    }
+  }
+  emitText(pos, textEnd);
+  pos = textEnd;
+  return Step::Consumed;
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseReference(const bool isFinal) {
+  if (openElements.empty()) {
+    return fail("syntax error");
+  }
+  const int limit = std::min(end, pos + MAX_REFERENCE_LENGTH);
+  int refEnd = pos + 1;
+  while (refEnd < limit && buffer[refEnd] != ';' && buffer[refEnd] != '<' && buffer[refEnd] != '&' &&
+         !isWhitespace(buffer[refEnd])) {
+    refEnd++;
+  }
+  if (refEnd == end && !isFinal && end - pos < MAX_REFERENCE_LENGTH) {
+    return Step::NeedMore;
+  }
+  if (refEnd == limit || buffer[refEnd] != ';' || refEnd == pos + 1) {
+    return fail("not well-formed (invalid token)");
+  }
+  const int refLen = refEnd + 1 - pos;
+  char scratch[4];
+  const char* value;
+  const int valueLen = expandReference(buffer + pos, refLen, scratch, &value);
+  if (valueLen < 0) {
+    return fail("reference to invalid character number");
+  }
+  handlers.characterData(handlers.userData, value, valueLen);
+  pos += refLen;
+  return Step::Consumed;
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseMarkup(const bool isFinal) {
+  if (end - pos < 2) {
+    return Step::NeedMore;
+  }
+  switch (buffer[pos + 1]) {
+    case '/':
+      return parseEndTag();
+    case '!':
+      return parseDeclaration(isFinal);
+    case '?':
+      return parseProcessingInstruction();
+    default:
+      return parseStartTag();
+  }
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseStartTag() {
+  // Find the closing > of the tag, outside attribute values
+  int tagEnd = pos + 1;
+  char quote = 0;
+  while (true) {
+    tagEnd += static_cast<int>(strcspn(buffer + tagEnd, quote == '"' ? "\"" : quote == '\'' ? "'" : "\"'>"));
+    if (tagEnd >= end) {
+      return Step::NeedMore;
+    }
+    const char c = buffer[tagEnd];
+    if (c == '\0') {
+      return fail("invalid token");
+    }
+    if (c == '>' && !quote) {
+      break;
+    }
+    quote = quote ? 0 : c;
+    tagEnd++;
+  }
+
+  if (openElements.empty() && rootSeen) {
+    return fail("junk after document element");
+  }
+  const bool empty = buffer[tagEnd - 1] == '/';
+  const int contentEnd = empty ? tagEnd - 1 : tagEnd;
+
+  char* const name = buffer + pos + 1;
+  int nameLen = 0;
+  while (!isNameEnd(name[nameLen])) {
+    nameLen++;
+  }
+  if (nameLen == 0 || pos + 1 + nameLen > contentEnd) {
+    return fail("not well-formed (invalid token)");
+  }
+
+  atts.clear();
+  char* p = name + nameLen;
+  char* const attsEnd = buffer + contentEnd;
+  while (p < attsEnd) {
+    if (!isWhitespace(*p)) {
+      return fail("not well-formed (invalid token)");
+    }
+    while (p < attsEnd && isWhitespace(*p)) {
+      p++;
+    }
+    if (p == attsEnd) {
+      break;
+    }
+    char* const attrName = p;
+    while (p < attsEnd && !isNameEnd(*p)) {
+      p++;
+    }
+    char* const attrNameEnd = p;
+    while (p < attsEnd && isWhitespace(*p)) {
+      p++;
+    }
+    if (attrNameEnd == attrName || p == attsEnd || *p != '=') {
+      return fail("not well-formed (invalid token)");
+    }
+    p++;
+    while (p < attsEnd && isWhitespace(*p)) {
+      p++;
+    }
+    if (p == attsEnd || (*p != '"' && *p != '\'')) {
+      return fail("not well-formed (invalid token)");
+    }
+    char* const value = p + 1;
+    char* const valueEnd = static_cast<char*>(memchr(value, *p, attsEnd - value));
+    if (!valueEnd) {
+      return fail("not well-formed (invalid token)");
+    }
+    *attrNameEnd = '\0';
+    if (!decodeValue(value, valueEnd)) {
+      return fail("not well-formed (invalid token)");
+    }
+    atts.push_back(attrName);
+    atts.push_back(value);
+    p = valueEnd + 1;
+    // Attributes have to be separated by whitespace; the terminator written to the value end doesn't count
+    if (p < attsEnd && !isWhitespace(*p)) {
+      return fail("not well-formed (invalid token)");
+    }
+  }
+  atts.push_back(nullptr);
+  name[nameLen] = '\0';
+
+  rootSeen = true;
+  openElements.push_back(nameHash(name, nameLen));
+  pos = tagEnd + 1;
+  startTagEnd = consumedBeforeBuffer + pos;
+  startTagEmpty = empty;
+  skipRequested = false;
+  handlers.startElement(handlers.userData, name, atts.data());
+  if (empty) {
+    openElements.pop_back();
+    handlers.endElement(handlers.userData, name);
+  } else if (skipRequested) {
+    state = State::SkippedContent;
+  }
+  skipRequested = false;
+  return Step::Consumed;
+}
+
+// Expands references and normalizes whitespace of the attribute value [value, valueEnd) in place, and terminates it.
+// nullptr if the value is malformed.
+char* XhtmlTokenizer::decodeValue(char* value, char* const valueEnd) const {
+  char* out = value;
+  for (char* in = value; in < valueEnd;) {
+    const char c = *in;
+    if (c == '<') {
+      return nullptr;
+    }
+    if (c != '&') {
+      *out++ = isWhitespace(c) ? ' ' : c;
+      in++;
+      continue;
+    }
+    const char* const semicolon = static_cast<const char*>(memchr(in, ';', valueEnd - in));
+    if (!semicolon || semicolon - in > MAX_REFERENCE_LENGTH) {
+      return nullptr;
+    }
+    const int refLen = static_cast<int>(semicolon + 1 - in);
+    char scratch[4];
+    const char* expansion;
+    const int expansionLen = expandReference(in, refLen, scratch, &expansion);
+    if (expansionLen < 0) {
+      return nullptr;
+    }
+    // Every expansion is shorter than its reference, unknown entities are kept as they are
+    if (expansionLen <= refLen) {
+      memmove(out, expansion, expansionLen);
+      out += expansionLen;
+    }
+    in += refLen;
+  }
+  *out = '\0';
+  return value;
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseEndTag() {
+  const auto* const tagEndPtr = static_cast<const char*>(memchr(buffer + pos + 2, '>', end - pos - 2));
+  if (!tagEndPtr) {
+    return Step::NeedMore;
+  }
+  const int tagEnd = static_cast<int>(tagEndPtr - buffer);
+  char* const name = buffer + pos + 2;
+  int nameLen = 0;
+  while (!isNameEnd(name[nameLen])) {
+    nameLen++;
+  }
+  for (int i = pos + 2 + nameLen; i < tagEnd; i++) {
+    if (!isWhitespace(buffer[i])) {
+      return fail("not well-formed (invalid token)");
+    }
+  }
+  if (nameLen == 0 || openElements.empty() || openElements.back() != nameHash(name, nameLen)) {
+    return fail("mismatched tag");
+  }
+  name[nameLen] = '\0';
+  openElements.pop_back();
+  pos = tagEnd + 1;
+  handlers.endElement(handlers.userData, name);
+  return Step::Consumed;
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseDeclaration(const bool isFinal) {
+  const int available = end - pos;
+  if (available >= 4 && memcmp(buffer + pos, "<!--", 4) == 0) {
+    pos += 4;
+    state = State::Comment;
+    return Step::Consumed;
+  }
+  if (available >= 9 && memcmp(buffer + pos, "<![CDATA[", 9) == 0) {
+    if (openElements.empty()) {
+      return fail("syntax error");
+    }
+    pos += 9;
+    state = State::CData;
+    return Step::Consumed;
+  }
+  if (available >= 9 && memcmp(buffer + pos, "<!DOCTYPE", 9) == 0) {
+    const int declEnd = find(">", 1);
+    if (declEnd < 0) {
+      return Step::NeedMore;
+    }
+    // Entities declared in an internal subset are Expat's job
+    if (memchr(buffer + pos, '[', declEnd - pos)) {
+      return fail("internal DTD subset not supported");
+    }
+    pos = declEnd + 1;
+    return Step::Consumed;
+  }
+  return available < 9 && !isFinal ? Step::NeedMore : fail("syntax error");
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::parseProcessingInstruction() {
+  const int piEnd = find("?>", 2);
+  if (piEnd < 0) {
+    return Step::NeedMore;
+  }
+  // Everything else in the XML declaration doesn't matter here, but the encoding has to be UTF-8 (or ASCII, a subset)
+  if (piEnd - pos > 5 && memcmp(buffer + pos, "<?xml", 5) == 0 && isWhitespace(buffer[pos + 5])) {
+    buffer[piEnd] = '\0';
+    const char* encoding = strstr(buffer + pos, "encoding");
+    buffer[piEnd] = '?';
+    if (encoding) {
+      encoding += 8;
+      while (isWhitespace(*encoding) || *encoding == '=') {
+        encoding++;
+      }
+      const char quote = *encoding++;
+      const int nameLen = strncasecmp(encoding, "utf-8", 5) == 0      ? 5
+                          : strncasecmp(encoding, "us-ascii", 8) == 0 ? 8
+                                                                      : 0;
+      if ((quote != '"' && quote != '\'') || nameLen == 0 || encoding[nameLen] != quote) {
+        return fail("unsupported encoding");
+      }
+    }
+  }
+  pos = piEnd + 2;
+  return Step::Consumed;
+}
+
+// Skips input up to and including terminator, handing it out as text if emitText is set (CDATA sections). Without
+// the terminator in the buffer all but its possible start is consumed.
+XhtmlTokenizer::Step XhtmlTokenizer::skipTo(const char* terminator, const int terminatorLen, const bool emitText) {
+  const int found = find(terminator, terminatorLen);
+  int consumedEnd = found >= 0 ? found : std::max(pos, end - (terminatorLen - 1));
+  if (emitText) {
+    if (found < 0) {
+      consumedEnd = completeUtf8End(pos, consumedEnd);
+    }
+    this->emitText(pos, consumedEnd);
+  }
+  if (found < 0) {
+    pos = consumedEnd;
+    return Step::NeedMore;
+  }
+  pos = found + terminatorLen;
+  state = State::Content;
+  return Step::Consumed;
+}
+
+XhtmlTokenizer::Step XhtmlTokenizer::skipElement() {
+  const char* const inputEnd = buffer + end;
+  const char* p = buffer + pos;
+  while ((p = static_cast<const char*>(memchr(p, '<', inputEnd - p))) != nullptr) {
+    if (inputEnd - p <= skipCloseTagLen) {
+      break;
+    }
+    const char next = p[skipCloseTagLen];
+    if (memcmp(p, skipCloseTag, skipCloseTagLen) == 0 && (next == '>' || isWhitespace(next))) {
+      // The close tag itself is tokenized as usual
+      pos = static_cast<int>(p - buffer);
+      state = State::Content;
+      return Step::Consumed;
+    }
+    p++;
+  }
+  pos = std::max(pos, end - skipCloseTagLen);
+  return Step::NeedMore;
+}
+
+void XhtmlTokenizer::skipElementContent(const char* name) {
+  const size_t nameLen = strlen(name);
+  if (nameLen + 2 > sizeof(skipCloseTag)) {
+    return;
+  }
+  skipCloseTag[0] = '<';
+  skipCloseTag[1] = '/';
+  memcpy(skipCloseTag + 2, name, nameLen);
+  skipCloseTagLen = static_cast<uint8_t>(nameLen + 2);
+  skipRequested = true;
+}
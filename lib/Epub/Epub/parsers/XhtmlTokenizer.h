@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ChapterTokenizer.h"
+
+// Tokenizer for the XHTML that EPUB chapters are written in, a lighter alternative to Expat. Tokens are tokenized in
+// place in the input buffer: names and attribute values are terminated and entity-decoded where they are, and text
+// is handed out as pointers into the buffer, so nothing is copied. Only a token cut off at the end of a chunk is kept,
+// and moved to the front for the next one.
+// It checks what ChapterHtmlSlimParser relies on (tags nest and match, attributes are quoted, entities are closed)
+// and fails on anything it doesn't handle: encodings other than UTF-8, DOCTYPEs with an internal subset. The caller
+// is expected to fall back to Expat then.
+class XhtmlTokenizer final : public ChapterTokenizer {
+ public:
+  explicit XhtmlTokenizer(const Handlers& handlers);
+  ~XhtmlTokenizer() override;
+  XhtmlTokenizer(const XhtmlTokenizer&) = delete;
+  XhtmlTokenizer& operator=(const XhtmlTokenizer&) = delete;
+
+  char* getBuffer(int len) override;
+  bool parseBuffer(int len, bool isFinal) override;
+  void skipElementContent(const char* name) override;
+  bool getStartTagEnd(uint32_t& offset) const override;
+
+  unsigned long getCurrentLine() const override;
+  const char* getErrorString() const override { return error ? error : "no error"; }
+
+ private:
+  enum class State : uint8_t { Prolog, Content, Comment, CData, SkippedContent };
+  enum class Step : uint8_t { Consumed, NeedMore, Failed };
+
+  Handlers handlers;
+  char* buffer = nullptr;
+  int capacity = 0;
+  int pos = 0;  // Next byte to tokenize
+  int end = 0;  // End of the input written so far
+  uint32_t consumedBeforeBuffer = 0;
+  // Input offset past the start tag being handed out, and whether it was an empty-element tag
+  uint32_t startTagEnd = 0;
+  bool startTagEmpty = false;
+  unsigned long linesBeforeBuffer = 1;
+  State state = State::Prolog;
+  bool rootSeen = false;
+  const char* error = nullptr;
+  // Hashes of the names of the open elements, to check that close tags match
+  std::vector<uint32_t> openElements;
+  std::vector<const char*> atts;
+  // Close tag that ends SkippedContent
+  char skipCloseTag[16] = {};
+  uint8_t skipCloseTagLen = 0;
+  bool skipRequested = false;
+
+  Step fail(const char* message);
+  int find(const char* needle, int needleLen) const;
+  int completeUtf8End(int from, int to) const;
+  Step parseText(bool isFinal);
+  Step parseReference(bool isFinal);
+  Step parseMarkup(bool isFinal);
+  Step parseStartTag();
+  Step parseEndTag();
+  Step parseDeclaration(bool isFinal);
+  Step parseProcessingInstruction();
+  Step skipTo(const char* terminator, int terminatorLen, bool emitText);
+  Step skipElement();
+  void emitText(int from, int to);
+  char* decodeValue(char* value, char* valueEnd) const;
+};
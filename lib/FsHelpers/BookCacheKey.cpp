@@ -0,0 +1,345 @@
+#include "BookCacheKey.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
+
+namespace {
+constexpr char INDEX_FILE[] = "/book_keys.idx";
+constexpr uint8_t INDEX_FILE_VERSION = 1;
+// Bounds the index at 48 KiB; past it an entry is dropped for each new one
+constexpr size_t MAX_ENTRIES = 2048;
+// Entries read or moved at a time when the index is scanned or updated in place, 384 bytes of stack
+constexpr size_t SHIFT_ENTRIES = 16;
+// Bytes hashed at either end of the book
+constexpr uint32_t SAMPLE_SIZE = 16 * 1024;
+constexpr size_t READ_CHUNK = 1024;
+
+constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+struct Entry {
+  uint64_t pathHash;
+  uint64_t key;
+  uint32_t size;
+  uint16_t date;
+  uint16_t time;
+};
+
+uint64_t fnv(uint64_t hash, const uint8_t* data, const size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+uint64_t pathHash(const std::string& path) {
+  return fnv(FNV_OFFSET, reinterpret_cast<const uint8_t*>(path.data()), path.size());
+}
+
+std::string indexPath(const std::string& cacheDir) { return cacheDir + INDEX_FILE; }
+
+// Index files of an older layout or broken by a failed update are started over
+bool indexValid(FsFile& file, const size_t size) {
+  uint8_t version = 0;
+  return size > 0 && file.read(&version, 1) == 1 && version == INDEX_FILE_VERSION && (size - 1) % sizeof(Entry) == 0 &&
+         (size - 1) / sizeof(Entry) <= MAX_ENTRIES;
+}
+
+bool readEntries(FsFile& file, const size_t index, Entry* entries, const size_t n) {
+  const size_t bytes = n * sizeof(Entry);
+  return file.seekSet(1 + index * sizeof(Entry)) &&
+         file.read(reinterpret_cast<uint8_t*>(entries), bytes) == static_cast<int>(bytes);
+}
+
+bool writeEntries(FsFile& file, const size_t index, const Entry* entries, const size_t n) {
+  const size_t bytes = n * sizeof(Entry);
+  return file.seekSet(1 + index * sizeof(Entry)) &&
+         file.write(reinterpret_cast<const uint8_t*>(entries), bytes) == bytes;
+}
+
+// Binary search straight in the file: position is that of the first entry whose path hash isn't below hash, and
+// found is set when it is the entry of hash
+bool findEntry(FsFile& file, const size_t count, const uint64_t hash, size_t& position, Entry& found) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    Entry entry;
+    if (!readEntries(file, mid, &entry, 1)) {
+      return false;
+    }
+    if (entry.pathHash == hash) {
+      position = mid;
+      found = entry;
+      return true;
+    }
+    if (entry.pathHash < hash) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  position = low;
+  return false;
+}
+
+bool readEntry(const std::string& cacheDir, const uint64_t hash, Entry& out) {
+  FsFile file;
+  const std::string path = indexPath(cacheDir);
+  if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("BCK", path, file)) {
+    return false;
+  }
+  size_t position = 0;
+  const size_t size = file.fileSize();
+  const bool found = indexValid(file, size) && findEntry(file, (size - 1) / sizeof(Entry), hash, position, out);
+  file.close();
+  return found;
+}
+
+// Opens the index for an update, starting it over when it's missing or invalid; count is its number of entries
+bool openIndex(const std::string& cacheDir, FsFile& file, size_t& count) {
+  const std::string path = indexPath(cacheDir);
+  file = Storage.open(path.c_str(), O_RDWR | O_CREAT);
+  if (!file) {
+    LOG_ERR("BCK", "Failed to open %s", path.c_str());
+    return false;
+  }
+  const size_t size = file.fileSize();
+  if (indexValid(file, size)) {
+    count = (size - 1) / sizeof(Entry);
+    return true;
+  }
+  if (size > 0) {
+    LOG_ERR("BCK", "Starting over stale book key index");
+  }
+  count = 0;
+  if (!file.truncate(0) || !file.seekSet(0) || file.write(&INDEX_FILE_VERSION, 1) != 1) {
+    file.close();
+    return false;
+  }
+  return true;
+}
+
+// Moves entries [first, end) one slot towards the end of the file, or towards its start, a few at a time
+bool shiftEntries(FsFile& file, const size_t first, const size_t end, const bool up) {
+  Entry buffer[SHIFT_ENTRIES];
+  if (up) {
+    for (size_t stop = end; stop > first;) {
+      const size_t n = std::min(SHIFT_ENTRIES, stop - first);
+      stop -= n;
+      if (!readEntries(file, stop, buffer, n) || !writeEntries(file, stop + 1, buffer, n)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  for (size_t start = first; start < end;) {
+    const size_t n = std::min(SHIFT_ENTRIES, end - start);
+    if (!readEntries(file, start, buffer, n) || !writeEntries(file, start - 1, buffer, n)) {
+      return false;
+    }
+    start += n;
+  }
+  return true;
+}
+
+bool insertEntry(FsFile& file, size_t& count, const size_t position, const Entry& entry) {
+  if (!shiftEntries(file, position, count, true) || !writeEntries(file, position, &entry, 1)) {
+    return false;
+  }
+  count++;
+  return true;
+}
+
+bool eraseEntry(FsFile& file, size_t& count, const size_t position) {
+  if (!shiftEntries(file, position + 1, count, false) || !file.truncate(1 + (count - 1) * sizeof(Entry))) {
+    return false;
+  }
+  count--;
+  return true;
+}
+
+// Replaces the entry of the same path or inserts it in order
+bool putEntry(FsFile& file, size_t& count, const Entry& entry) {
+  size_t position = 0;
+  Entry found;
+  if (findEntry(file, count, entry.pathHash, position, found)) {
+    return writeEntries(file, position, &entry, 1);
+  }
+  if (count >= MAX_ENTRIES) {
+    // The index is only a shortcut: a book whose entry is dropped is hashed again when it is next looked up
+    const size_t dropped = entry.pathHash % count;
+    if (!eraseEntry(file, count, dropped)) {
+      return false;
+    }
+    if (dropped < position) {
+      position--;
+    }
+  }
+  return insertEntry(file, count, position, entry);
+}
+
+// A half-done shift leaves the entries out of order, so the index is dropped rather than trusted
+void closeIndex(const std::string& cacheDir, FsFile& file, const bool ok) {
+  file.close();
+  if (!ok) {
+    LOG_ERR("BCK", "Failed to update book key index");
+    Storage.remove(indexPath(cacheDir).c_str());
+  }
+}
+
+void storeEntry(const std::string& cacheDir, const Entry& entry) {
+  FsFile file;
+  size_t count = 0;
+  if (!openIndex(cacheDir, file, count)) {
+    return;
+  }
+  closeIndex(cacheDir, file, putEntry(file, count, entry));
+}
+
+// Size, modification time and content key of the book, the key only when the stamp differs from known's
+bool stampBook(const std::string& path, Entry& entry, const Entry* known) {
+  FsFile file;
+  if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("BCK", path, file)) {
+    return false;
+  }
+  entry.size = static_cast<uint32_t>(file.fileSize());
+  file.getModifyDateTime(&entry.date, &entry.time);
+  if (known && known->size == entry.size && known->date == entry.date && known->time == entry.time) {
+    entry.key = known->key;
+    file.close();
+    return true;
+  }
+
+  uint8_t buffer[READ_CHUNK];
+  uint64_t key = fnv(FNV_OFFSET, reinterpret_cast<const uint8_t*>(&entry.size), sizeof(entry.size));
+  const auto hashRange = [&](const uint32_t start, const uint32_t length) {
+    if (!file.seekSet(start)) {
+      return false;
+    }
+    for (uint32_t done = 0; done < length;) {
+      const int n = file.read(buffer, std::min<size_t>(READ_CHUNK, length - done));
+      if (n <= 0) {
+        return false;
+      }
+      key = fnv(key, buffer, n);
+      done += n;
+    }
+    return true;
+  };
+  const uint32_t head = std::min(entry.size, SAMPLE_SIZE);
+  const uint32_t tailStart = std::max(head, entry.size > SAMPLE_SIZE ? entry.size - SAMPLE_SIZE : 0);
+  const bool ok = hashRange(0, head) && hashRange(tailStart, entry.size - tailStart);
+  file.close();
+  if (!ok) {
+    LOG_ERR("BCK", "Failed to read %s", path.c_str());
+    return false;
+  }
+  entry.key = key;
+  return true;
+}
+
+std::string dirName(const char* prefix, const uint64_t key) {
+  char name[40];
+  snprintf(name, sizeof(name), "%s%016" PRIx64, prefix, key);
+  return name;
+}
+}  // namespace
+
+namespace BookCacheKey {
+
+std::string cachePath(const std::string& path, const std::string& cacheDir, const char* prefix) {
+  const uint64_t hash = pathHash(path);
+  Entry known = {};
+  const bool haveKnown = readEntry(cacheDir, hash, known);
+
+  Entry entry = {};
+  entry.pathHash = hash;
+  if (!stampBook(path, entry, haveKnown ? &known : nullptr)) {
+    if (haveKnown) {
+      // The book is gone, e.g. deleted a moment ago; its cache is still found to be cleared
+      return cacheDir + "/" + dirName(prefix, known.key);
+    }
+    return cacheDir + "/" + prefix + std::to_string(std::hash<std::string>{}(path));
+  }
+
+  const std::string keyed = cacheDir + "/" + dirName(prefix, entry.key);
+  if (!haveKnown || known.key != entry.key || known.size != entry.size || known.date != entry.date ||
+      known.time != entry.time) {
+    storeEntry(cacheDir, entry);
+  }
+  if (!haveKnown) {
+    const std::string legacy = cacheDir + "/" + prefix + std::to_string(std::hash<std::string>{}(path));
+    if (Storage.exists(legacy.c_str()) && !Storage.exists(keyed.c_str())) {
+      LOG_DBG("BCK", "Renaming cache %s to %s", legacy.c_str(), keyed.c_str());
+      Storage.rename(legacy.c_str(), keyed.c_str());
+    }
+  }
+  return keyed;
+}
+
+bool shared(const std::string& path, const std::string& cacheDir) {
+  const uint64_t hash = pathHash(path);
+  Entry own;
+  if (!readEntry(cacheDir, hash, own)) {
+    return false;
+  }
+  FsFile file;
+  if (!Storage.openFileForRead("BCK", indexPath(cacheDir), file)) {
+    return false;
+  }
+  const size_t count = (file.fileSize() - 1) / sizeof(Entry);
+  Entry buffer[SHIFT_ENTRIES];
+  bool found = false;
+  for (size_t start = 0; start < count && !found;) {
+    const size_t n = std::min(SHIFT_ENTRIES, count - start);
+    if (!readEntries(file, start, buffer, n)) {
+      break;
+    }
+    found = std::any_of(buffer, buffer + n,
+                        [&](const Entry& entry) { return entry.key == own.key && entry.pathHash != hash; });
+    start += n;
+  }
+  file.close();
+  return found;
+}
+
+void moved(const std::string& from, const std::string& to, const std::string& cacheDir) {
+  FsFile file;
+  size_t count = 0;
+  if (!Storage.exists(indexPath(cacheDir).c_str()) || !openIndex(cacheDir, file, count)) {
+    return;
+  }
+  size_t position = 0;
+  Entry entry;
+  if (!findEntry(file, count, pathHash(from), position, entry)) {
+    file.close();
+    return;
+  }
+  entry.pathHash = pathHash(to);
+  closeIndex(cacheDir, file, eraseEntry(file, count, position) && putEntry(file, count, entry));
+  LOG_DBG("BCK", "Cache key of %s moved to %s", from.c_str(), to.c_str());
+}
+
+void forget(const std::string& path, const std::string& cacheDir) {
+  FsFile file;
+  size_t count = 0;
+  if (!Storage.exists(indexPath(cacheDir).c_str()) || !openIndex(cacheDir, file, count)) {
+    return;
+  }
+  size_t position = 0;
+  Entry entry;
+  if (!findEntry(file, count, pathHash(path), position, entry)) {
+    file.close();
+    return;
+  }
+  closeIndex(cacheDir, file, eraseEntry(file, count, position));
+}
+
+}  // namespace BookCacheKey
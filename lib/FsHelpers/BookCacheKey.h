@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+
+// Book caches are named after what the book holds rather than where it is: its size and a 64-bit FNV-1a hash of its
+// first and last 16 KiB, in the spirit of KOReader's partial MD5 document id. Moving or renaming a book then keeps its
+// indexed sections, image caches and thumbnails.
+//
+// The key of each path is kept in <cacheDir>/book_keys.idx with the size and modification time it was taken at, so a
+// lookup opens the book only to compare those; the hash is taken again once the file changes. Books whose key can't
+// be worked out (a file that's gone and was never seen) keep the name hashed from their path.
+namespace BookCacheKey {
+
+// Cache directory of the book at path: cacheDir + "/" + prefix + key. A cache still under the path-hashed name of
+// older versions is renamed to it the first time.
+std::string cachePath(const std::string& path, const std::string& cacheDir, const char* prefix);
+// Whether another path still maps to the key of the book at path, as two copies of the same book do: their cache
+// directory is one and the same, so it stays when only one of them is deleted or replaced
+bool shared(const std::string& path, const std::string& cacheDir);
+// Hands the key of a book that was moved or renamed to its new path
+void moved(const std::string& from, const std::string& to, const std::string& cacheDir);
+// Drops the key of a book that was deleted or replaced
+void forget(const std::string& path, const std::string& cacheDir);
+
+}  // namespace BookCacheKey
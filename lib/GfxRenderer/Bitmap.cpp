@@ -1,5 +1,6 @@
 #include "Bitmap.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
@@ -13,12 +14,20 @@
 constexpr bool USE_ATKINSON = true;  // Use Atkinson dithering instead of Floyd-Steinberg
 // ============================================================================
 
+namespace {
+// Upper bound of the read-ahead window; it holds as many whole rows as fit
+constexpr int READ_AHEAD_MAX_BYTES = 4096;
+}  // namespace
+
 Bitmap::~Bitmap() {
   delete[] errorCurRow;
   delete[] errorNextRow;
 
   delete atkinsonDitherer;
   delete fsDitherer;
+
+  free(readAhead);
+  free(rowLut);
 }
 
 uint16_t Bitmap::readLE16(FsFile& f) {
@@ -84,7 +93,7 @@ const char* Bitmap::errorToString(BmpReaderError err) {
 
 BmpReaderError Bitmap::parseHeaders() {
   if (!file) return BmpReaderError::FileInvalid;
-  if (!file.seek(0)) return BmpReaderError::SeekStartFailed;
+  if (!file.seek(fileOffset)) return BmpReaderError::SeekStartFailed;
 
   // --- BMP FILE HEADER ---
   const uint16_t bfType = readLE16(file);
@@ -140,9 +149,11 @@ BmpReaderError Bitmap::parseHeaders() {
     }
   }
 
-  if (!file.seek(bfOffBits)) {
+  if (!file.seek(fileOffset + bfOffBits)) {
     return BmpReaderError::SeekPixelDataFailed;
   }
+  readAheadPos = 0;
+  readAheadLen = 0;
 
   // Check if palette luminances map cleanly to the display's 4 native gray levels.
   // Native levels are 0, 85, 170, 255 — i.e. values where (lum >> 6) is lossless.
@@ -173,17 +184,83 @@ BmpReaderError Bitmap::parseHeaders() {
       fsDitherer = new FloydSteinbergDitherer(width);
     }
   }
+  if (nativePalette && bpp <= 8) {
+    buildRowLut();
+  }
 
   return BmpReaderError::Ok;
 }
 
+void Bitmap::buildRowLut() {
+  if (!rowLut) {
+    rowLut = static_cast<uint16_t*>(malloc(256 * sizeof(uint16_t)));
+    if (!rowLut) {
+      return;  // Rows are converted pixel by pixel
+    }
+  }
+  const int pixelsPerByte = 8 / bpp;
+  const uint8_t indexMask = (1 << bpp) - 1;
+  for (int byte = 0; byte < 256; byte++) {
+    uint16_t packed = 0;
+    for (int i = 0; i < pixelsPerByte; i++) {
+      const uint8_t index = (byte >> (8 - bpp * (i + 1))) & indexMask;
+      packed = (packed << 2) | static_cast<uint8_t>(adjustPixel(paletteLum[index]) >> 6);
+    }
+    rowLut[byte] = packed;
+  }
+}
+
+// Each output byte holds 4 pixels; the one holding the last pixels of a row narrower than a multiple of 4 is masked
+// like readNextRow() leaves it. Rows are padded to 4 bytes, so the source bytes read for it are there.
+void Bitmap::convertNativeRow(uint8_t* data, const uint8_t* rowBuffer) const {
+  const int outBytes = (width + 3) / 4;
+  const uint8_t* src = rowBuffer;
+  for (int i = 0; i < outBytes; i++) {
+    uint8_t out;
+    switch (bpp) {
+      case 1:
+        out = static_cast<uint8_t>(rowLut[src[i >> 1]] >> ((i & 1) ? 0 : 8));
+        break;
+      case 2:
+        out = static_cast<uint8_t>(rowLut[src[i]]);
+        break;
+      case 4:
+        out = static_cast<uint8_t>(rowLut[src[2 * i]] << 4 | rowLut[src[2 * i + 1]]);
+        break;
+      default:
+        out = static_cast<uint8_t>(rowLut[src[4 * i]] << 6 | rowLut[src[4 * i + 1]] << 4 | rowLut[src[4 * i + 2]] << 2 |
+                                   rowLut[src[4 * i + 3]]);
+        break;
+    }
+    data[i] = out;
+  }
+  if (width % 4 != 0) {
+    data[outBytes - 1] &= 0xFF << (8 - 2 * (width % 4));
+  }
+}
+
+bool Bitmap::readRowBytes(uint8_t* rowBuffer) const {
+  if (readAheadPos + rowBytes > readAheadLen && !fillReadAhead()) {
+    // Rows too wide to batch, or no memory for the window: read them one by one
+    return !readAhead && file.read(rowBuffer, rowBytes) == rowBytes;
+  }
+  memcpy(rowBuffer, readAhead + readAheadPos, rowBytes);
+  readAheadPos += rowBytes;
+  return true;
+}
+
 // packed 2bpp output, 0 = black, 1 = dark gray, 2 = light gray, 3 = white
 BmpReaderError Bitmap::readNextRow(uint8_t* data, uint8_t* rowBuffer) const {
   // Note: rowBuffer should be pre-allocated by the caller to size 'rowBytes'
-  if (file.read(rowBuffer, rowBytes) != rowBytes) return BmpReaderError::ShortReadRow;
+  if (!readRowBytes(rowBuffer)) return BmpReaderError::ShortReadRow;
 
   prevRowY += 1;
 
+  if (rowLut) {
+    convertNativeRow(data, rowBuffer);
+    return BmpReaderError::Ok;
+  }
+
   uint8_t* outPtr = data;
   uint8_t currentOutByte = 0;
   int bitShift = 6;
@@ -282,10 +359,99 @@ BmpReaderError Bitmap::readNextRow(uint8_t* data, uint8_t* rowBuffer) const {
   return BmpReaderError::Ok;
 }
 
+BmpReaderError Bitmap::readNextRowGray(uint8_t* gray, uint8_t* rowBuffer) const {
+  if (!readRowBytes(rowBuffer)) return BmpReaderError::ShortReadRow;
+  prevRowY += 1;
+
+  switch (bpp) {
+    case 32:
+    case 24: {
+      const int step = bpp / 8;
+      const uint8_t* p = rowBuffer;
+      for (int x = 0; x < width; x++) {
+        gray[x] = (77u * p[2] + 150u * p[1] + 29u * p[0]) >> 8;
+        p += step;
+      }
+      break;
+    }
+    case 8:
+      for (int x = 0; x < width; x++) {
+        gray[x] = paletteLum[rowBuffer[x]];
+      }
+      break;
+    case 4:
+      for (int x = 0; x < width; x++) {
+        gray[x] = paletteLum[(x & 1) ? (rowBuffer[x >> 1] & 0x0F) : (rowBuffer[x >> 1] >> 4)];
+      }
+      break;
+    case 2:
+      for (int x = 0; x < width; x++) {
+        gray[x] = paletteLum[(rowBuffer[x >> 2] >> (6 - ((x & 3) * 2))) & 0x03];
+      }
+      break;
+    case 1:
+      for (int x = 0; x < width; x++) {
+        gray[x] = paletteLum[(rowBuffer[x >> 3] & (0x80 >> (x & 7))) ? 1 : 0];
+      }
+      break;
+    default:
+      return BmpReaderError::UnsupportedBpp;
+  }
+  return BmpReaderError::Ok;
+}
+
+BmpReaderError Bitmap::seekToRow(const int row) const {
+  if (row < 0 || row >= height ||
+      !file.seek(fileOffset + bfOffBits + static_cast<uint32_t>(row) * static_cast<uint32_t>(rowBytes))) {
+    return BmpReaderError::SeekPixelDataFailed;
+  }
+  readAheadPos = 0;
+  readAheadLen = 0;
+
+  // The error carried down from the rows skipped is dropped
+  if (fsDitherer) fsDitherer->reset();
+  if (atkinsonDitherer) atkinsonDitherer->reset();
+  prevRowY = row - 1;
+  return BmpReaderError::Ok;
+}
+
+bool Bitmap::fillReadAhead() const {
+  if (!readAheadTried) {
+    readAheadTried = true;
+    const int rows = std::min(READ_AHEAD_MAX_BYTES / rowBytes, height);
+    if (rows < 2) {
+      return false;
+    }
+    readAhead = static_cast<uint8_t*>(malloc(rows * rowBytes));
+    if (!readAhead) {
+      return false;
+    }
+    readAheadSize = rows * rowBytes;
+  }
+  if (!readAhead) {
+    return false;
+  }
+
+  // Keep a partial row left over from a short read in front of the new data
+  const int leftover = readAheadLen - readAheadPos;
+  if (leftover > 0) {
+    memmove(readAhead, readAhead + readAheadPos, leftover);
+  }
+  readAheadPos = 0;
+  readAheadLen = leftover;
+  const int n = file.read(readAhead + leftover, readAheadSize - leftover);
+  if (n > 0) {
+    readAheadLen += n;
+  }
+  return readAheadLen >= rowBytes;
+}
+
 BmpReaderError Bitmap::rewindToData() const {
-  if (!file.seek(bfOffBits)) {
+  if (!file.seek(fileOffset + bfOffBits)) {
     return BmpReaderError::SeekPixelDataFailed;
   }
+  readAheadPos = 0;
+  readAheadLen = 0;
 
   // Reset dithering when rewinding
   if (fsDitherer) fsDitherer->reset();
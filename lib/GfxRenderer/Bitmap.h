@@ -64,11 +64,18 @@ class Bitmap {
  public:
   static const char* errorToString(BmpReaderError err);
 
-  explicit Bitmap(FsFile& file, bool dithering = false) : file(file), dithering(dithering) {}
+  // fileOffset is where the BMP starts in file, for bitmaps stored inside a larger file
+  explicit Bitmap(FsFile& file, bool dithering = false, uint32_t fileOffset = 0)
+      : file(file), dithering(dithering), fileOffset(fileOffset) {}
   ~Bitmap();
   BmpReaderError parseHeaders();
   BmpReaderError readNextRow(uint8_t* data, uint8_t* rowBuffer) const;
+  // The next row as width 8-bit luminance values, before brightness adjustment and quantization, for resampling
+  BmpReaderError readNextRowGray(uint8_t* gray, uint8_t* rowBuffer) const;
   BmpReaderError rewindToData() const;
+  // Goes to row, counted in file order (bottom-up bitmaps store the bottom row first), so the rows before it are never
+  // read. Error diffusion starts over there.
+  BmpReaderError seekToRow(int row) const;
   int getWidth() const { return width; }
   int getHeight() const { return height; }
   bool isTopDown() const { return topDown; }
@@ -83,6 +90,7 @@ class Bitmap {
 
   FsFile& file;
   bool dithering = false;
+  uint32_t fileOffset = 0;
   int width = 0;
   int height = 0;
   bool topDown = false;
@@ -100,4 +108,21 @@ class Bitmap {
 
   mutable AtkinsonDitherer* atkinsonDitherer = nullptr;
   mutable FloydSteinbergDitherer* fsDitherer = nullptr;
+
+  // Native palettes with at most 8 bits per pixel: the packed 2-bit pixels of each possible source byte, so rows
+  // convert a source byte per lookup. 8 pixels (1 bpp) down to 1 (8 bpp) per entry, last pixel in the low bits.
+  void buildRowLut();
+  void convertNativeRow(uint8_t* data, const uint8_t* rowBuffer) const;
+  uint16_t* rowLut = nullptr;
+
+  // Read-ahead window over the pixel data, so rows come from a few large sequential reads
+  // instead of one SD transaction per row. Allocated on the first readNextRow.
+  bool fillReadAhead() const;
+  // Next row's bytes into rowBuffer, from the window when there is one
+  bool readRowBytes(uint8_t* rowBuffer) const;
+  mutable uint8_t* readAhead = nullptr;
+  mutable int readAheadSize = 0;
+  mutable int readAheadPos = 0;
+  mutable int readAheadLen = 0;
+  mutable bool readAheadTried = false;
 };
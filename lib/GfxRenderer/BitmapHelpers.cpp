@@ -108,6 +108,97 @@ uint8_t quantize1bit(int gray, int x, int y) {
   return (gray >= adjustedThreshold) ? 1 : 0;
 }
 
+void quantizeRow(const uint8_t* gray, const int count, const int y, uint8_t* out) {
+  RowPacker<2> packer(out);
+  for (int x = 0; x < count; x++) {
+    packer.push(quantize(gray[x], x, y));
+  }
+  packer.finish();
+}
+
+void quantize1bitRow(const uint8_t* gray, const int count, const int y, uint8_t* out) {
+  RowPacker<1> packer(out);
+  for (int x = 0; x < count; x++) {
+    packer.push(quantize1bit(gray[x], x, y));
+  }
+  packer.finish();
+}
+
+// Same levels as applyBayerDither4Level of the framebuffer decoders: the matrix nudges each pixel by up to half a
+// quantization step before it is cut into 4 levels
+void quantizeBayerRow(const uint8_t* gray, const int count, const int y, uint8_t* out) {
+  const uint8_t* bayerRow = bayer4x4[y & 3];
+  int offsets[4];
+  for (int i = 0; i < 4; i++) {
+    offsets[i] = (bayerRow[i] - 8) * 5;
+  }
+  RowPacker<2> packer(out);
+  for (int x = 0; x < count; x++) {
+    const int adjusted = gray[x] + offsets[x & 3];
+    packer.push(adjusted < 64 ? 0 : adjusted < 128 ? 1 : adjusted < 192 ? 2 : 3);
+  }
+  packer.finish();
+}
+
+void quantizeBayer1bitRow(const uint8_t* gray, const int count, const int y, uint8_t* out) {
+  const uint8_t* bayerRow = bayer4x4[y & 3];
+  int thresholds[4];
+  for (int i = 0; i < 4; i++) {
+    thresholds[i] = bayerRow[i] * 16 + 8;
+  }
+  RowPacker<1> packer(out);
+  for (int x = 0; x < count; x++) {
+    packer.push(adjustPixel(gray[x]) >= thresholds[x & 3] ? 1 : 0);
+  }
+  packer.finish();
+}
+
+BmpRowQuantizer::BmpRowQuantizer(const int width, const bool oneBit, const Method method)
+    : width(width), oneBit(oneBit), method(method) {
+  if (oneBit && (method == Method::Atkinson || method == Method::FloydSteinberg)) {
+    atkinson1BitDitherer = new Atkinson1BitDitherer(width);
+  } else if (!oneBit && method == Method::Atkinson) {
+    atkinsonDitherer = new AtkinsonDitherer(width);
+  } else if (!oneBit && method == Method::FloydSteinberg) {
+    fsDitherer = new FloydSteinbergDitherer(width);
+  }
+}
+
+BmpRowQuantizer::~BmpRowQuantizer() {
+  delete atkinsonDitherer;
+  delete fsDitherer;
+  delete atkinson1BitDitherer;
+}
+
+void BmpRowQuantizer::processRow(uint8_t* gray, const int y, uint8_t* out) {
+  if (oneBit) {
+    if (atkinson1BitDitherer) {
+      atkinson1BitDitherer->processRow(gray, width, out);
+      atkinson1BitDitherer->nextRow();
+    } else if (method == Method::Ordered) {
+      quantizeBayer1bitRow(gray, width, y, out);
+    } else {
+      quantize1bitRow(gray, width, y, out);
+    }
+    return;
+  }
+
+  for (int x = 0; x < width; x++) {
+    gray[x] = static_cast<uint8_t>(adjustPixel(gray[x]));
+  }
+  if (atkinsonDitherer) {
+    atkinsonDitherer->processRow(gray, width, out);
+    atkinsonDitherer->nextRow();
+  } else if (fsDitherer) {
+    fsDitherer->processRow(gray, width, out);
+    fsDitherer->nextRow();
+  } else if (method == Method::Ordered) {
+    quantizeBayerRow(gray, width, y, out);
+  } else {
+    quantizeRow(gray, width, y, out);
+  }
+}
+
 void createBmpHeader(BmpHeader* bmpHeader, int width, int height) {
   if (!bmpHeader) return;
 
@@ -11,9 +11,114 @@ uint8_t quantizeSimple(int gray);
 uint8_t quantize1bit(int gray, int x, int y);
 int adjustPixel(int gray);
 
+// 4x4 Bayer matrix for ordered dithering
+inline const uint8_t bayer4x4[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+// Row forms of the quantizers above, and of the 4x4 Bayer ordered dither, which carries no error from pixel to pixel
+// and is the cheapest of them. count gray pixels of row y go to out packed MSB first, 2 bits per pixel (1 for the
+// 1-bit ones), with the bits after the last pixel of its byte 0.
+void quantizeRow(const uint8_t* gray, int count, int y, uint8_t* out);
+void quantize1bitRow(const uint8_t* gray, int count, int y, uint8_t* out);
+void quantizeBayerRow(const uint8_t* gray, int count, int y, uint8_t* out);
+void quantizeBayer1bitRow(const uint8_t* gray, int count, int y, uint8_t* out);
+
+// Packs quantized pixels MSB first, bitsPerPixel each, into whole bytes
+template <int bitsPerPixel>
+class RowPacker {
+ public:
+  explicit RowPacker(uint8_t* out) : out(out) {}
+
+  void push(const uint8_t value) {
+    packed = static_cast<uint8_t>(packed << bitsPerPixel | value);
+    if (++pending == 8 / bitsPerPixel) {
+      *out++ = packed;
+      packed = 0;
+      pending = 0;
+    }
+  }
+
+  void finish() {
+    if (pending > 0) {
+      *out = static_cast<uint8_t>(packed << (8 - pending * bitsPerPixel));
+    }
+  }
+
+ private:
+  uint8_t* out;
+  uint8_t packed = 0;
+  int pending = 0;
+};
+
+// Row form of the Atkinson error distribution below: the errors a pixel passes to the two after it are carried in
+// registers, and the three it passes to the next row are summed into one store there. The sums are the same as the
+// pixel by pixel ones, so are the results. quantize(gray, error, adjusted, quantizedValue) returns the packed value of
+// a pixel given the error it received, with the clamped sum of both in adjusted and the level it stands for in
+// quantizedValue.
+template <int bitsPerPixel, typename Quantize>
+void atkinsonRow(const uint8_t* gray, const int count, uint8_t* out, const int16_t* errorRow0, int16_t* errorRow1,
+                 int16_t* errorRow2, Quantize quantize) {
+  RowPacker<bitsPerPixel> packer(out);
+  int error1 = 0;  // Error of the pixel before
+  int error2 = 0;  // and of the one before that
+  for (int x = 0; x < count; x++) {
+    int quantizedValue;
+    int adjusted;
+    packer.push(quantize(gray[x], errorRow0[x + 2] + error1 + error2, adjusted, quantizedValue));
+    const int error = (adjusted - quantizedValue) >> 3;  // error/8
+    errorRow1[x + 1] += error + error1 + error2;         // Bottom-right, bottom and bottom-left of the ones before
+    errorRow2[x + 2] += error;                            // Two rows down
+    error2 = error1;
+    error1 = error;
+  }
+  if (count > 0) {
+    errorRow1[count + 1] += error1 + error2;
+    errorRow1[count + 2] += error1;
+  }
+  packer.finish();
+}
+
 // Populates a 1-bit BMP header in the provided memory.
 void createBmpHeader(BmpHeader* bmpHeader, int width, int height);
 
+// The 4 levels of the error diffusion ditherers: returns the 2-bit value of a clamped gray value, and sets the gray
+// level it stands for
+inline uint8_t quantizeLevels(const int adjusted, int& quantizedValue) {
+  if (false) {  // original thresholds
+    if (adjusted < 43) {
+      quantizedValue = 0;
+      return 0;
+    } else if (adjusted < 128) {
+      quantizedValue = 85;
+      return 1;
+    } else if (adjusted < 213) {
+      quantizedValue = 170;
+      return 2;
+    } else {
+      quantizedValue = 255;
+      return 3;
+    }
+  } else {  // fine-tuned to X4 eink display
+    if (adjusted < 30) {
+      quantizedValue = 15;
+      return 0;
+    } else if (adjusted < 50) {
+      quantizedValue = 30;
+      return 1;
+    } else if (adjusted < 140) {
+      quantizedValue = 80;
+      return 2;
+    } else {
+      quantizedValue = 210;
+      return 3;
+    }
+  }
+}
+
 // 1-bit Atkinson dithering - better quality than noise dithering for thumbnails
 // Error distribution pattern (same as 2-bit but quantizes to 2 levels):
 //     X  1/8 1/8
@@ -39,6 +144,18 @@ class Atkinson1BitDitherer {
   // EXPLICITLY DELETE THE COPY ASSIGNMENT OPERATOR
   Atkinson1BitDitherer& operator=(const Atkinson1BitDitherer& other) = delete;
 
+  // Dithers a row of count pixels into out, 1 bit each (see atkinsonRow), the same as processPixel for each x
+  void processRow(const uint8_t* gray, const int count, uint8_t* out) {
+    atkinsonRow<1>(gray, count, out, errorRow0, errorRow1, errorRow2,
+                   [](const int pixel, const int error, int& adjusted, int& quantizedValue) -> uint8_t {
+                     adjusted = adjustPixel(pixel) + error;
+                     if (adjusted < 0) adjusted = 0;
+                     if (adjusted > 255) adjusted = 255;
+                     quantizedValue = adjusted < 128 ? 0 : 255;
+                     return adjusted < 128 ? 0 : 1;
+                   });
+  }
+
   uint8_t processPixel(int gray, int x) {
     // Apply brightness/contrast/gamma adjustments
     gray = adjustPixel(gray);
@@ -119,6 +236,17 @@ class AtkinsonDitherer {
   // **2. EXPLICITLY DELETE THE COPY ASSIGNMENT OPERATOR**
   AtkinsonDitherer& operator=(const AtkinsonDitherer& other) = delete;
 
+  // Dithers a row of count pixels into out, 2 bits each (see atkinsonRow), the same as processPixel for each x
+  void processRow(const uint8_t* gray, const int count, uint8_t* out) {
+    atkinsonRow<2>(gray, count, out, errorRow0, errorRow1, errorRow2,
+                   [](const int pixel, const int error, int& adjusted, int& quantizedValue) {
+                     adjusted = pixel + error;
+                     if (adjusted < 0) adjusted = 0;
+                     if (adjusted > 255) adjusted = 255;
+                     return quantizeLevels(adjusted, quantizedValue);
+                   });
+  }
+
   uint8_t processPixel(int gray, int x) {
     // Add accumulated error
     int adjusted = gray + errorRow0[x + 2];
@@ -126,37 +254,8 @@ class AtkinsonDitherer {
     if (adjusted > 255) adjusted = 255;
 
     // Quantize to 4 levels
-    uint8_t quantized;
     int quantizedValue;
-    if (false) {  // original thresholds
-      if (adjusted < 43) {
-        quantized = 0;
-        quantizedValue = 0;
-      } else if (adjusted < 128) {
-        quantized = 1;
-        quantizedValue = 85;
-      } else if (adjusted < 213) {
-        quantized = 2;
-        quantizedValue = 170;
-      } else {
-        quantized = 3;
-        quantizedValue = 255;
-      }
-    } else {  // fine-tuned to X4 eink display
-      if (adjusted < 30) {
-        quantized = 0;
-        quantizedValue = 15;
-      } else if (adjusted < 50) {
-        quantized = 1;
-        quantizedValue = 30;
-      } else if (adjusted < 140) {
-        quantized = 2;
-        quantizedValue = 80;
-      } else {
-        quantized = 3;
-        quantizedValue = 210;
-      }
-    }
+    const uint8_t quantized = quantizeLevels(adjusted, quantizedValue);
 
     // Calculate error (only distribute 6/8 = 75%)
     int error = (adjusted - quantizedValue) >> 3;  // error/8
@@ -219,6 +318,39 @@ class FloydSteinbergDitherer {
   // **2. EXPLICITLY DELETE THE COPY ASSIGNMENT OPERATOR**
   FloydSteinbergDitherer& operator=(const FloydSteinbergDitherer& other) = delete;
 
+  // Dithers a row of count pixels into out, 2 bits each, the same as processPixel for each x from left to right. As in
+  // atkinsonRow, the error passed along the row is carried in a register and those passed to the next row are summed
+  // into one store per pixel. The mirrored distribution of reverse rows passes its along-the-row share to the pixel
+  // before, which is already done, so it is dropped there as well.
+  void processRow(const uint8_t* gray, const int count, uint8_t* out) {
+    RowPacker<2> packer(out);
+    const bool reverse = isReverseRow();
+    int carried = 0;  // Error passed on by the pixel before
+    int error1 = 0;   // Error of the pixel before
+    int error2 = 0;   // and of the one before that
+    for (int x = 0; x < count; x++) {
+      int adjusted = gray[x] + errorCurRow[x + 1] + carried;
+      if (adjusted < 0) adjusted = 0;
+      if (adjusted > 255) adjusted = 255;
+      int quantizedValue;
+      packer.push(quantizeLevels(adjusted, quantizedValue));
+      const int error = adjusted - quantizedValue;
+      if (!reverse) {
+        carried = (error * 7) >> 4;
+        errorNextRow[x] += ((error * 3) >> 4) + ((error1 * 5) >> 4) + (error2 >> 4);
+      } else {
+        errorNextRow[x] += (error >> 4) + ((error1 * 5) >> 4) + ((error2 * 3) >> 4);
+      }
+      error2 = error1;
+      error1 = error;
+    }
+    if (count > 0) {
+      errorNextRow[count] += reverse ? ((error1 * 5) >> 4) + ((error2 * 3) >> 4) : ((error1 * 5) >> 4) + (error2 >> 4);
+      errorNextRow[count + 1] += reverse ? (error1 * 3) >> 4 : error1 >> 4;
+    }
+    packer.finish();
+  }
+
   // Process a single pixel and return quantized 2-bit value
   // x is the logical x position (0 to width-1), direction handled internally
   uint8_t processPixel(int gray, int x) {
@@ -230,37 +362,8 @@ class FloydSteinbergDitherer {
     if (adjusted > 255) adjusted = 255;
 
     // Quantize to 4 levels (0, 85, 170, 255)
-    uint8_t quantized;
     int quantizedValue;
-    if (false) {  // original thresholds
-      if (adjusted < 43) {
-        quantized = 0;
-        quantizedValue = 0;
-      } else if (adjusted < 128) {
-        quantized = 1;
-        quantizedValue = 85;
-      } else if (adjusted < 213) {
-        quantized = 2;
-        quantizedValue = 170;
-      } else {
-        quantized = 3;
-        quantizedValue = 255;
-      }
-    } else {  // fine-tuned to X4 eink display
-      if (adjusted < 30) {
-        quantized = 0;
-        quantizedValue = 15;
-      } else if (adjusted < 50) {
-        quantized = 1;
-        quantizedValue = 30;
-      } else if (adjusted < 140) {
-        quantized = 2;
-        quantizedValue = 80;
-      } else {
-        quantized = 3;
-        quantizedValue = 210;
-      }
-    }
+    const uint8_t quantized = quantizeLevels(adjusted, quantizedValue);
 
     // Calculate error
     int error = adjusted - quantizedValue;
@@ -318,3 +421,30 @@ class FloydSteinbergDitherer {
   int16_t* errorCurRow;
   int16_t* errorNextRow;
 };
+
+// How a BMP conversion quantizes its rows, set up for its output width and depth. 1-bit output has Atkinson
+// dithering (also for FloydSteinberg, which has no 1-bit form), the noise thresholds of quantize1bit() as Simple, or
+// the 4x4 Bayer pattern as Ordered, the cheapest and the only one carrying no error between pixels; meant for
+// thumbnails, where speed matters more than quality.
+class BmpRowQuantizer {
+ public:
+  enum class Method { Atkinson, FloydSteinberg, Simple, Ordered };
+
+  BmpRowQuantizer(int width, bool oneBit, Method method);
+  ~BmpRowQuantizer();
+
+  BmpRowQuantizer(const BmpRowQuantizer& other) = delete;
+  BmpRowQuantizer& operator=(const BmpRowQuantizer& other) = delete;
+
+  // Quantizes row y of width gray pixels into out, packed MSB first with 1 or 2 bits per pixel. The gray values of
+  // 2-bit rows are brightness adjusted (adjustPixel) in place first.
+  void processRow(uint8_t* gray, int y, uint8_t* out);
+
+ private:
+  int width;
+  bool oneBit;
+  Method method;
+  AtkinsonDitherer* atkinsonDitherer = nullptr;
+  FloydSteinbergDitherer* fsDitherer = nullptr;
+  Atkinson1BitDitherer* atkinson1BitDitherer = nullptr;
+};
@@ -1,16 +1,26 @@
 #include "GfxRenderer.h"
 
+#include <HotPath.h>
 #include <Logging.h>
+#include <Trace.h>
 #include <Utf8.h>
 
-const uint8_t* GfxRenderer::getGlyphBitmap(const EpdFontData* fontData, const EpdGlyph* glyph) const {
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+
+#include "PackBits.h"
+
+const uint8_t* GfxRenderer::getGlyphBitmap(const EpdFontData* fontData, const EpdGlyph* glyph,
+                                           const FontDecompressor::Layout layout) const {
   if (fontData->groups != nullptr) {
     if (!fontDecompressor) {
       LOG_ERR("GFX", "Compressed font but no FontDecompressor set");
       return nullptr;
     }
     uint16_t glyphIndex = static_cast<uint16_t>(glyph - fontData->glyph);
-    return fontDecompressor->getBitmap(fontData, glyph, glyphIndex);
+    return fontDecompressor->getBitmap(fontData, glyph, glyphIndex, layout);
   }
   return &fontData->bitmap[glyph->dataOffset];
 }
@@ -23,7 +33,43 @@ void GfxRenderer::begin() {
   }
 }
 
-void GfxRenderer::insertFont(const int fontId, EpdFontFamily font) { fontMap.insert({fontId, font}); }
+void GfxRenderer::insertFont(const int fontId, const EpdFontFamily& font) {
+  if (findFont(fontId)) {
+    return;
+  }
+  if (fontCount == MAX_FONTS) {
+    LOG_ERR("GFX", "No room for font %d", fontId);
+    return;
+  }
+  fonts[fontCount++] = {fontId, &font};
+}
+
+void GfxRenderer::removeFont(const int fontId) {
+  for (uint8_t i = 0; i < fontCount; i++) {
+    if (fonts[i].id == fontId) {
+      fonts[i] = fonts[--fontCount];
+      lastFont = 0;
+      // Cached groups are known by their font's address, which a family loaded next may reuse
+      clearFontCache();
+      return;
+    }
+  }
+}
+
+const EpdFontFamily* GfxRenderer::findFont(const int fontId) const {
+  // Text calls come in long runs on the same font, so the last hit is nearly always the one asked for again
+  const uint8_t last = lastFont;
+  if (last < fontCount && fonts[last].id == fontId) {
+    return fonts[last].family;
+  }
+  for (uint8_t i = 0; i < fontCount; i++) {
+    if (fonts[i].id == fontId) {
+      lastFont = i;
+      return fonts[i].family;
+    }
+  }
+  return nullptr;
+}
 
 // Translate logical (x,y) coordinates to physical panel coordinates based on current orientation
 // This should always be inlined for better performance
@@ -59,32 +105,356 @@ static inline void rotateCoordinates(const GfxRenderer::Orientation orientation,
   }
 }
 
+// Inverse of rotateCoordinates()
+static inline void toLogical(const GfxRenderer::Orientation orientation, const int phyX, const int phyY, int* x,
+                             int* y) {
+  switch (orientation) {
+    case GfxRenderer::Portrait:
+      *x = HalDisplay::DISPLAY_HEIGHT - 1 - phyY;
+      *y = phyX;
+      break;
+    case GfxRenderer::LandscapeClockwise:
+      *x = HalDisplay::DISPLAY_WIDTH - 1 - phyX;
+      *y = HalDisplay::DISPLAY_HEIGHT - 1 - phyY;
+      break;
+    case GfxRenderer::PortraitInverted:
+      *x = phyY;
+      *y = HalDisplay::DISPLAY_WIDTH - 1 - phyX;
+      break;
+    case GfxRenderer::LandscapeCounterClockwise:
+      *x = phyX;
+      *y = phyY;
+      break;
+  }
+}
+
+// Calls f with the orientation as a std::integral_constant, so the code it runs per pixel gets the rotation folded in.
+// Orientation only changes between screens; dispatching once per draw call keeps the switch out of the pixel loops.
+template <typename F>
+static inline void withOrientation(const GfxRenderer::Orientation orientation, F&& f) {
+  switch (orientation) {
+    case GfxRenderer::Portrait:
+      f(std::integral_constant<GfxRenderer::Orientation, GfxRenderer::Portrait>{});
+      break;
+    case GfxRenderer::LandscapeClockwise:
+      f(std::integral_constant<GfxRenderer::Orientation, GfxRenderer::LandscapeClockwise>{});
+      break;
+    case GfxRenderer::PortraitInverted:
+      f(std::integral_constant<GfxRenderer::Orientation, GfxRenderer::PortraitInverted>{});
+      break;
+    case GfxRenderer::LandscapeCounterClockwise:
+      f(std::integral_constant<GfxRenderer::Orientation, GfxRenderer::LandscapeCounterClockwise>{});
+      break;
+  }
+}
+
+// drawPixel() for an orientation known at compile time. Callers clip to the screen, so nothing off the panel is
+// logged here; it is only dropped.
+template <GfxRenderer::Orientation orientation>
+static inline void plotPixel(uint8_t* frameBuffer, const int x, const int y, const bool state) {
+  int phyX = 0;
+  int phyY = 0;
+  rotateCoordinates(orientation, x, y, &phyX, &phyY);
+  if (phyX < 0 || phyX >= HalDisplay::DISPLAY_WIDTH || phyY < 0 || phyY >= HalDisplay::DISPLAY_HEIGHT) {
+    return;
+  }
+  uint8_t* byte = frameBuffer + phyY * HalDisplay::DISPLAY_WIDTH_BYTES + phyX / 8;
+  const uint8_t bit = 0x80 >> (phyX % 8);
+  if (state) {
+    *byte &= ~bit;
+  } else {
+    *byte |= bit;
+  }
+}
+
+// Whether a dithered gray is black at logical (x, y)
+template <Color color>
+static inline bool ditherInk(const int x, const int y) {
+  if (color == Color::LightGray) {
+    return x % 2 == 0 && y % 2 == 0;
+  }
+  return (x + y) % 2 == 0;  // TODO: maybe find a better pattern?
+}
+
+// The dither patterns repeat every two pixels along both logical axes, and rotations keep that, so a physical row of
+// a dithered fill is one byte over and over: the pixels at even and at odd panel columns each come out the same.
+template <Color color>
+static inline uint8_t ditherRowByte(const GfxRenderer::Orientation orientation, const int phyY) {
+  int x = 0, y = 0;
+  toLogical(orientation, 0, phyY, &x, &y);
+  const bool evenInk = ditherInk<color>(x, y);
+  toLogical(orientation, 1, phyY, &x, &y);
+  const bool oddInk = ditherInk<color>(x, y);
+  // MSB first, so even columns are the 0xAA bits; white pixels are set
+  return (evenInk ? 0x00 : 0xAA) | (oddInk ? 0x00 : 0x55);
+}
+
 enum class TextRotation { None, Rotated90CW };
 
-// Shared glyph rendering logic for normal and rotated text.
-// Coordinate mapping and cursor advance direction are selected at compile time via the template parameter.
-template <TextRotation rotation>
-static void renderCharImpl(const GfxRenderer& renderer, GfxRenderer::RenderMode renderMode,
-                           const EpdFontFamily& fontFamily, const uint32_t cp, int* cursorX, int* cursorY,
-                           const bool pixelState, const EpdFontFamily::Style style) {
-  const EpdGlyph* glyph = fontFamily.getGlyph(cp, style);
-  if (!glyph) {
-    LOG_ERR("GFX", "No glyph for codepoint %d", cp);
+// The glyph bitmap layout whose pixels follow each other from left to right along the panel rows
+static inline FontDecompressor::Layout panelLayout(const GfxRenderer::Orientation orientation,
+                                                   const TextRotation rotation) {
+  using Layout = FontDecompressor::Layout;
+  const bool rotated = rotation == TextRotation::Rotated90CW;
+  switch (orientation) {
+    case GfxRenderer::Portrait:
+      return rotated ? Layout::MirroredRows : Layout::Columns;
+    case GfxRenderer::LandscapeClockwise:
+      return rotated ? Layout::MirroredColumns : Layout::MirroredRows;
+    case GfxRenderer::PortraitInverted:
+      return rotated ? Layout::Rows : Layout::MirroredColumns;
+    case GfxRenderer::LandscapeCounterClockwise:
+    default:
+      return rotated ? Layout::Columns : Layout::Rows;
+  }
+}
+
+// Which glyph pixels a blit draws: those set in a 1-bit glyph, or of some 2-bit values (0 white, 1 light gray,
+// 2 dark gray, 3 black)
+enum class GlyphInk { Set, NotWhite, Gray, DarkGray };
+
+template <GlyphInk ink>
+static constexpr std::array<uint8_t, 256> makeInkNibbles() {
+  std::array<uint8_t, 256> nibbles{};
+  for (int byte = 0; byte < 256; byte++) {
+    for (int pixel = 0; pixel < 4; pixel++) {
+      const int value = (byte >> ((3 - pixel) * 2)) & 0x3;
+      bool inked;
+      if constexpr (ink == GlyphInk::NotWhite) {
+        inked = value != 0;
+      } else if constexpr (ink == GlyphInk::Gray) {
+        inked = value == 1 || value == 2;
+      } else {
+        inked = value == 2;
+      }
+      nibbles[byte] |= static_cast<uint8_t>(inked << (3 - pixel));
+    }
+  }
+  return nibbles;
+}
+
+// The ink of the four 2-bit pixels of a glyph byte as a nibble, the first pixel in its high bit: one lookup per byte
+// instead of picking the pixels apart
+template <GlyphInk ink>
+static constexpr std::array<uint8_t, 256> inkNibbles = makeInkNibbles<ink>();
+
+template <GlyphInk ink>
+static inline bool glyphInkAt(const uint8_t* bitmap, const int pixelPosition) {
+  if constexpr (ink == GlyphInk::Set) {
+    return (bitmap[pixelPosition >> 3] >> (7 - (pixelPosition & 7))) & 1;
+  } else {
+    return (inkNibbles<ink>[bitmap[pixelPosition >> 2]] >> (3 - (pixelPosition & 3))) & 1;
+  }
+}
+
+// ORs count bits of src from bit srcBit on into dst from bit dstBit on, MSB first, a byte at a time. Reads no byte of
+// src beyond the last bit.
+static inline void orBits(uint8_t* dst, int dstBit, const uint8_t* src, int srcBit, int count) {
+  while (count > 0) {
+    const int take = std::min(count, 8);
+    const int srcShift = srcBit & 7;
+    uint32_t window = static_cast<uint32_t>(src[srcBit >> 3]) << 8;
+    if (srcShift + take > 8) {
+      window |= src[(srcBit >> 3) + 1];
+    }
+    const auto bits = static_cast<uint8_t>(((window << srcShift) >> 8) & (0xFF00 >> take));
+    const int dstShift = dstBit & 7;
+    dst[dstBit >> 3] |= bits >> dstShift;
+    if (dstShift + take > 8) {
+      dst[(dstBit >> 3) + 1] |= static_cast<uint8_t>(bits << (8 - dstShift));
+    }
+    srcBit += take;
+    dstBit += take;
+    count -= take;
+  }
+}
+
+// A glyph bitmap in the panelLayout() of the orientation, stored line by line along the panel rows from left to
+// right. The pixels of a line then follow each other in the bitmap and are gathered a byte at a time instead of one
+// by one.
+template <GlyphInk ink>
+struct GlyphLines {
+  const uint8_t* bitmap;
+  int lineLength;
+
+  // ORs the ink of count pixels of a line from pixel first on into out from bit outBit on, MSB first
+  void gather(const int line, const int first, const int count, uint8_t* out, const int outBit) const {
+    const int start = line * lineLength + first;
+    if constexpr (ink == GlyphInk::Set) {
+      orBits(out, outBit, bitmap, start, count);
+    } else {
+      // Four 2-bit pixels a byte: turn each pair of bytes of the line into a byte of ink bits, then align those
+      const int firstByte = start >> 2;
+      const int lastByte = (start + count - 1) >> 2;
+      uint8_t nibbles[(UINT8_MAX + 3) / 8 + 2];
+      int i = 0;
+      int b = firstByte;
+      for (; b < lastByte; b += 2) {
+        nibbles[i++] = static_cast<uint8_t>(inkNibbles<ink>[bitmap[b]] << 4 | inkNibbles<ink>[bitmap[b + 1]]);
+      }
+      if (b == lastByte) {
+        nibbles[i] = static_cast<uint8_t>(inkNibbles<ink>[bitmap[b]] << 4);
+      }
+      orBits(out, outBit, nibbles, start & 3, count);
+    }
+  }
+};
+
+// Draws the glyph pixels selected by pixels in one state, merging them into the framebuffer 8 pixels per
+// read-modify-write. Orientation and text rotation are template parameters, so the mapping from glyph to panel
+// coordinates folds into constant steps. The glyph is clipped against the panel once; then each physical row it
+// covers is gathered into a small bit buffer laid out like the framebuffer row and merged byte by byte.
+// pixels is either isSet(glyphX, glyphY), tested pixel by pixel, or GlyphLines, gathered a byte at a time (their
+// lines are stored reversed where spanStep is negative, so they always run left to right).
+// rowAt(phyY) returns the start of a physical panel row in the target plane.
+template <GfxRenderer::Orientation orientation, TextRotation rotation, typename RowAt, typename Pixels>
+static HOT_CODE void blitGlyph(const RowAt& rowAt, const int outerBase, const int innerBase, const int width,
+                               const int height, const bool state, const Pixels& pixels) {
+  // Physical position of glyph pixel (glyphX, glyphY); affine, so three samples give origin and steps
+  const auto toPhysical = [&](const int glyphX, const int glyphY, int* phyX, int* phyY) {
+    if constexpr (rotation == TextRotation::Rotated90CW) {
+      rotateCoordinates(orientation, outerBase + glyphY, innerBase - glyphX, phyX, phyY);
+    } else {
+      rotateCoordinates(orientation, innerBase + glyphX, outerBase + glyphY, phyX, phyY);
+    }
+  };
+  int originX, originY, stepXx, stepXy, stepYx, stepYy;
+  toPhysical(0, 0, &originX, &originY);
+  toPhysical(1, 0, &stepXx, &stepXy);
+  toPhysical(0, 1, &stepYx, &stepYy);
+  stepXx -= originX;
+  stepXy -= originY;
+  stepYx -= originX;
+  stepYy -= originY;
+
+  // Spans run along the glyph axis that maps to the panel's x axis, lines along the other one
+  const bool spanAlongGlyphX = stepXx != 0;
+  const int spanLength = spanAlongGlyphX ? width : height;
+  const int lineCount = spanAlongGlyphX ? height : width;
+  const int spanStep = spanAlongGlyphX ? stepXx : stepYx;  // +-1 physical x per span pixel
+  const int lineStep = spanAlongGlyphX ? stepYy : stepXy;  // +-1 physical y per line
+
+  const auto clip = [](const int origin, const int step, const int count, const int limit, int* first, int* last) {
+    if (step > 0) {
+      *first = std::max(0, -origin);
+      *last = std::min(count - 1, limit - 1 - origin);
+    } else {
+      *first = std::max(0, origin - limit + 1);
+      *last = std::min(count - 1, origin);
+    }
+  };
+  int firstSpan, lastSpan, firstLine, lastLine;
+  clip(originX, spanStep, spanLength, HalDisplay::DISPLAY_WIDTH, &firstSpan, &lastSpan);
+  clip(originY, lineStep, lineCount, HalDisplay::DISPLAY_HEIGHT, &firstLine, &lastLine);
+  if (firstSpan > lastSpan || firstLine > lastLine) {
     return;
   }
 
-  const EpdFontData* fontData = fontFamily.getData(style);
+  const int phyXLow = std::min(originX + spanStep * firstSpan, originX + spanStep * lastSpan);
+  const int phyXHigh = std::max(originX + spanStep * firstSpan, originX + spanStep * lastSpan);
+  const int firstByte = phyXLow >> 3;
+  const int byteCount = (phyXHigh >> 3) - firstByte + 1;
+  const int bitBase = originX - firstByte * 8;  // Span bit of glyph span pixel k is bitBase + spanStep * k
+
+  uint8_t spanBits[(UINT8_MAX + 7) / 8 + 1];
+  for (int line = firstLine; line <= lastLine; line++) {
+    memset(spanBits, 0, byteCount);
+    bool anySet = false;
+    if constexpr (std::is_invocable_v<const Pixels&, int, int>) {
+      for (int k = firstSpan; k <= lastSpan; k++) {
+        if (spanAlongGlyphX ? pixels(k, line) : pixels(line, k)) {
+          const int bit = bitBase + spanStep * k;
+          spanBits[bit >> 3] |= 0x80 >> (bit & 7);  // MSB first
+          anySet = true;
+        }
+      }
+    } else {
+      // The leftmost pixel on the panel comes first: span pixel firstSpan, or lastSpan where the line is reversed
+      const int count = lastSpan - firstSpan + 1;
+      if (spanStep > 0) {
+        pixels.gather(line, firstSpan, count, spanBits, bitBase + firstSpan);
+      } else {
+        pixels.gather(line, spanLength - 1 - lastSpan, count, spanBits, bitBase - lastSpan);
+      }
+      for (int i = 0; i < byteCount && !anySet; i++) {
+        anySet = spanBits[i] != 0;
+      }
+    }
+    if (!anySet) {
+      continue;
+    }
+
+    uint8_t* row = rowAt(originY + lineStep * line) + firstByte;
+    if (state) {
+      for (int i = 0; i < byteCount; i++) row[i] &= ~spanBits[i];  // Clear bits = black
+    } else {
+      for (int i = 0; i < byteCount; i++) row[i] |= spanBits[i];
+    }
+  }
+}
+
+template <TextRotation rotation, typename RowAt, typename Pixels>
+static HOT_CODE void blitGlyph(const GfxRenderer& renderer, const RowAt& rowAt, const int outerBase,
+                               const int innerBase, const int width, const int height, const bool state,
+                               const Pixels& pixels) {
+  switch (renderer.getOrientation()) {
+    case GfxRenderer::Portrait:
+      blitGlyph<GfxRenderer::Portrait, rotation>(rowAt, outerBase, innerBase, width, height, state, pixels);
+      break;
+    case GfxRenderer::LandscapeClockwise:
+      blitGlyph<GfxRenderer::LandscapeClockwise, rotation>(rowAt, outerBase, innerBase, width, height, state, pixels);
+      break;
+    case GfxRenderer::PortraitInverted:
+      blitGlyph<GfxRenderer::PortraitInverted, rotation>(rowAt, outerBase, innerBase, width, height, state, pixels);
+      break;
+    case GfxRenderer::LandscapeCounterClockwise:
+      blitGlyph<GfxRenderer::LandscapeCounterClockwise, rotation>(rowAt, outerBase, innerBase, width, height, state,
+                                                                  pixels);
+      break;
+  }
+}
+
+// Blits one ink of a glyph, gathering whole lines when the bitmap is in the panelLayout(), otherwise pixel by pixel
+// from the rows it is stored in
+template <TextRotation rotation, GlyphInk ink, typename RowAt>
+static HOT_CODE void blitGlyphInk(const GfxRenderer& renderer, const RowAt& rowAt, const int outerBase,
+                                  const int innerBase, const int width, const int height, const bool state,
+                                  const uint8_t* bitmap, const FontDecompressor::Layout layout,
+                                  const bool inPanelLayout) {
+  if (inPanelLayout) {
+    const bool columns =
+        layout == FontDecompressor::Layout::Columns || layout == FontDecompressor::Layout::MirroredColumns;
+    blitGlyph<rotation>(renderer, rowAt, outerBase, innerBase, width, height, state,
+                        GlyphLines<ink>{bitmap, columns ? height : width});
+  } else {
+    blitGlyph<rotation>(renderer, rowAt, outerBase, innerBase, width, height, state,
+                        [bitmap, width](const int glyphX, const int glyphY) {
+                          return glyphInkAt<ink>(bitmap, glyphY * width + glyphX);
+                        });
+  }
+}
+
+// Shared glyph rendering logic for normal and rotated text.
+// Coordinate mapping and cursor advance direction are selected at compile time via the template parameter.
+template <TextRotation rotation>
+static HOT_CODE void renderGlyphImpl(const GfxRenderer& renderer, GfxRenderer::RenderMode renderMode,
+                                     const EpdFontData* fontData, const EpdGlyph* glyph, int* cursorX, int* cursorY,
+                                     const bool pixelState) {
   const bool is2Bit = fontData->is2Bit;
   const uint8_t width = glyph->width;
   const uint8_t height = glyph->height;
   const int left = glyph->left;
   const int top = glyph->top;
 
-  const uint8_t* bitmap = renderer.getGlyphBitmap(fontData, glyph);
+  // Compressed fonts hand out their bitmaps arranged for the orientation; the others only have them in rows
+  const FontDecompressor::Layout layout = panelLayout(renderer.getOrientation(), rotation);
+  const bool inPanelLayout = fontData->groups != nullptr || layout == FontDecompressor::Layout::Rows;
+  const uint8_t* bitmap =
+      renderer.getGlyphBitmap(fontData, glyph, inPanelLayout ? layout : FontDecompressor::Layout::Rows);
 
   if (bitmap != nullptr) {
-    // For Normal:  outer loop advances screenY, inner loop advances screenX
-    // For Rotated: outer loop advances screenX, inner loop advances screenY (in reverse)
+    // For Normal:  glyph rows advance screenY, glyph columns advance screenX
+    // For Rotated: glyph rows advance screenX, glyph columns advance screenY (in reverse)
     int outerBase, innerBase;
     if constexpr (rotation == TextRotation::Rotated90CW) {
       outerBase = *cursorX + fontData->ascender - top;  // screenX = outerBase + glyphY
@@ -93,63 +463,46 @@ static void renderCharImpl(const GfxRenderer& renderer, GfxRenderer::RenderMode
       outerBase = *cursorY - top;   // screenY = outerBase + glyphY
       innerBase = *cursorX + left;  // screenX = innerBase + glyphX
     }
+    uint8_t* frameBuffer = renderer.getFrameBuffer();
+    const auto frameRow = [frameBuffer](const int phyY) {
+      return frameBuffer + phyY * HalDisplay::DISPLAY_WIDTH_BYTES;
+    };
 
     if (is2Bit) {
-      int pixelPosition = 0;
-      for (int glyphY = 0; glyphY < height; glyphY++) {
-        const int outerCoord = outerBase + glyphY;
-        for (int glyphX = 0; glyphX < width; glyphX++, pixelPosition++) {
-          int screenX, screenY;
-          if constexpr (rotation == TextRotation::Rotated90CW) {
-            screenX = outerCoord;
-            screenY = innerBase - glyphX;
-          } else {
-            screenX = innerBase + glyphX;
-            screenY = outerCoord;
-          }
-
-          const uint8_t byte = bitmap[pixelPosition >> 2];
-          const uint8_t bit_index = (3 - (pixelPosition & 3)) * 2;
-          // the direct bit from the font is 0 -> white, 1 -> light gray, 2 -> dark gray, 3 -> black
-          // we swap this to better match the way images and screen think about colors:
-          // 0 -> black, 1 -> dark grey, 2 -> light grey, 3 -> white
-          const uint8_t bmpVal = 3 - ((byte >> bit_index) & 0x3);
-
-          if (renderMode == GfxRenderer::BW && bmpVal < 3) {
-            // Black (also paints over the grays in BW mode)
-            renderer.drawPixel(screenX, screenY, pixelState);
-          } else if (renderMode == GfxRenderer::GRAYSCALE_MSB && (bmpVal == 1 || bmpVal == 2)) {
-            // Light gray (also mark the MSB if it's going to be a dark gray too)
-            // We have to flag pixels in reverse for the gray buffers, as 0 leave alone, 1 update
-            renderer.drawPixel(screenX, screenY, false);
-          } else if (renderMode == GfxRenderer::GRAYSCALE_LSB && bmpVal == 1) {
-            // Dark gray
-            renderer.drawPixel(screenX, screenY, false);
+      if (renderMode == GfxRenderer::BW) {
+        if (!renderer.wereGrayPixelsDrawn()) {
+          // A 2-bit value of 1 or 2 has differing bits
+          const int byteCount = (width * height + 3) / 4;
+          for (int i = 0; i < byteCount; i++) {
+            if ((bitmap[i] ^ (bitmap[i] >> 1)) & 0x55) {
+              renderer.markGrayPixelDrawn();
+              break;
+            }
           }
         }
+        // Black (also paints over the grays in BW mode)
+        blitGlyphInk<rotation, GlyphInk::NotWhite>(renderer, frameRow, outerBase, innerBase, width, height,
+                                                   pixelState, bitmap, layout, inPanelLayout);
+      } else if (renderMode == GfxRenderer::GRAYSCALE_MSB) {
+        // Light gray (also mark the MSB if it's going to be a dark gray too)
+        // We have to flag pixels in reverse for the gray buffers, as 0 leave alone, 1 update
+        blitGlyphInk<rotation, GlyphInk::Gray>(renderer, frameRow, outerBase, innerBase, width, height, false, bitmap,
+                                               layout, inPanelLayout);
+      } else if (renderMode == GfxRenderer::GRAYSCALE_LSB) {
+        // Dark gray
+        blitGlyphInk<rotation, GlyphInk::DarkGray>(renderer, frameRow, outerBase, innerBase, width, height, false,
+                                                   bitmap, layout, inPanelLayout);
+      } else if (renderMode == GfxRenderer::GRAYSCALE_BOTH) {
+        // Both gray planes from the same decoded glyph: LSB into the frame buffer, MSB into the side plane
+        blitGlyphInk<rotation, GlyphInk::DarkGray>(renderer, frameRow, outerBase, innerBase, width, height, false,
+                                                   bitmap, layout, inPanelLayout);
+        blitGlyphInk<rotation, GlyphInk::Gray>(
+            renderer, [&renderer](const int phyY) { return renderer.getGrayscaleMsbRow(phyY); }, outerBase, innerBase,
+            width, height, false, bitmap, layout, inPanelLayout);
       }
     } else {
-      int pixelPosition = 0;
-      for (int glyphY = 0; glyphY < height; glyphY++) {
-        const int outerCoord = outerBase + glyphY;
-        for (int glyphX = 0; glyphX < width; glyphX++, pixelPosition++) {
-          int screenX, screenY;
-          if constexpr (rotation == TextRotation::Rotated90CW) {
-            screenX = outerCoord;
-            screenY = innerBase - glyphX;
-          } else {
-            screenX = innerBase + glyphX;
-            screenY = outerCoord;
-          }
-
-          const uint8_t byte = bitmap[pixelPosition >> 3];
-          const uint8_t bit_index = 7 - (pixelPosition & 7);
-
-          if ((byte >> bit_index) & 1) {
-            renderer.drawPixel(screenX, screenY, pixelState);
-          }
-        }
-      }
+      blitGlyphInk<rotation, GlyphInk::Set>(renderer, frameRow, outerBase, innerBase, width, height, pixelState,
+                                            bitmap, layout, inPanelLayout);
     }
   }
 
@@ -160,9 +513,21 @@ static void renderCharImpl(const GfxRenderer& renderer, GfxRenderer::RenderMode
   }
 }
 
+template <TextRotation rotation>
+static HOT_CODE void renderCharImpl(const GfxRenderer& renderer, GfxRenderer::RenderMode renderMode,
+                                    const EpdFontFamily& fontFamily, const uint32_t cp, int* cursorX, int* cursorY,
+                                    const bool pixelState, const EpdFontFamily::Style style) {
+  const EpdGlyph* glyph = fontFamily.getGlyph(cp, style);
+  if (!glyph) {
+    LOG_ERR("GFX", "No glyph for codepoint %d", cp);
+    return;
+  }
+  renderGlyphImpl<rotation>(renderer, renderMode, fontFamily.getData(style), glyph, cursorX, cursorY, pixelState);
+}
+
 // IMPORTANT: This function is in critical rendering path and is called for every pixel. Please keep it as simple and
 // efficient as possible.
-void GfxRenderer::drawPixel(const int x, const int y, const bool state) const {
+HOT_CODE void GfxRenderer::drawPixel(const int x, const int y, const bool state) const {
   int phyX = 0;
   int phyY = 0;
 
@@ -186,18 +551,145 @@ void GfxRenderer::drawPixel(const int x, const int y, const bool state) const {
   }
 }
 
+void GfxRenderer::toPhysical(const int x, const int y, int* phyX, int* phyY) const {
+  rotateCoordinates(orientation, x, y, phyX, phyY);
+}
+
+void GfxRenderer::drawByteMask(const size_t start, const int step, const uint8_t* mask, const size_t count,
+                               const bool state) const {
+  const long last = static_cast<long>(start) + static_cast<long>(count - 1) * step;
+  if (count == 0 || last < 0 || last >= static_cast<long>(HalDisplay::BUFFER_SIZE) ||
+      start >= HalDisplay::BUFFER_SIZE) {
+    LOG_ERR("GFX", "!! Byte mask outside frame buffer (%zu, %d, %zu)", start, step, count);
+    return;
+  }
+
+  uint8_t* out = frameBuffer + start;
+  if (state) {
+    for (size_t i = 0; i < count; i++, out += step) {
+      *out &= ~mask[i];
+    }
+  } else {
+    for (size_t i = 0; i < count; i++, out += step) {
+      *out |= mask[i];
+    }
+  }
+}
+
+// Transposes an 8x8 bit block held one row per byte, top row in the high byte and MSB first, so that row i becomes
+// column i (Hacker's Delight, transpose8)
+static inline uint64_t transpose8x8(uint64_t x) {
+  uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x ^= t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x ^= t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x ^= t ^ (t << 28);
+  return x;
+}
+
+template <typename Merge>
+static void blitPlaneRows(uint8_t* frameBuffer, const uint8_t* src, const size_t stride,
+                          const GfxRenderer::Orientation layout, const int firstRow, const int rowCount,
+                          const Merge merge) {
+  constexpr int rowBytes = HalDisplay::DISPLAY_WIDTH_BYTES;
+  if (layout == GfxRenderer::LandscapeCounterClockwise) {
+    for (int row = 0; row < rowCount; row++) {
+      uint8_t* const out = frameBuffer + (firstRow + row) * rowBytes;
+      const uint8_t* const in = src + row * stride;
+      for (int i = 0; i < rowBytes; i++) {
+        out[i] = merge(out[i], in[i]);
+      }
+    }
+    return;
+  }
+
+  // Portrait: logical (x, y) is panel (y, DISPLAY_HEIGHT - 1 - x). Eight logical rows make one panel byte column,
+  // and each source byte in them eight panel rows, bottom up.
+  constexpr int blockColumns = HalDisplay::DISPLAY_HEIGHT / 8;
+  for (int row = 0; row < rowCount; row += 8) {
+    const int phyByte = (firstRow + row) / 8;
+    const uint8_t* const rows = src + row * stride;
+    for (int column = 0; column < blockColumns; column++) {
+      uint64_t block = 0;
+      for (int i = 0; i < 8; i++) {
+        block = (block << 8) | rows[i * stride + column];
+      }
+      block = transpose8x8(block);
+      uint8_t* out = frameBuffer + (HalDisplay::DISPLAY_HEIGHT - 1 - column * 8) * rowBytes + phyByte;
+      for (int i = 0; i < 8; i++, out -= rowBytes) {
+        *out = merge(*out, static_cast<uint8_t>(block >> (56 - 8 * i)));
+      }
+    }
+  }
+}
+
+bool GfxRenderer::blitPlane1Bit(const uint8_t* src, const size_t stride, const Orientation layout, const PlaneOp op,
+                                const int firstRow, int rowCount) const {
+  TRACE_SCOPE(PlaneCopy, rowCount);
+  if (layout != LandscapeCounterClockwise && layout != Portrait) {
+    LOG_ERR("GFX", "!! Plane blit in unsupported layout %d", layout);
+    return false;
+  }
+  const bool portrait = layout == Portrait;
+  const int rows = portrait ? HalDisplay::DISPLAY_WIDTH : HalDisplay::DISPLAY_HEIGHT;
+  const size_t minStride = portrait ? HalDisplay::DISPLAY_HEIGHT / 8 : HalDisplay::DISPLAY_WIDTH_BYTES;
+  if (rowCount < 0) {
+    rowCount = rows - firstRow;
+  }
+  if (firstRow < 0 || rowCount < 0 || firstRow + rowCount > rows || stride < minStride ||
+      (portrait && (firstRow % 8 != 0 || rowCount % 8 != 0))) {
+    LOG_ERR("GFX", "!! Plane blit of rows %d+%d (stride %zu) outside the screen", firstRow, rowCount, stride);
+    return false;
+  }
+
+  switch (op) {
+    case PlaneOp::Copy:
+      blitPlaneRows(frameBuffer, src, stride, layout, firstRow, rowCount, [](uint8_t, const uint8_t s) { return s; });
+      break;
+    case PlaneOp::Invert:
+      blitPlaneRows(frameBuffer, src, stride, layout, firstRow, rowCount,
+                    [](uint8_t, const uint8_t s) -> uint8_t { return ~s; });
+      break;
+    case PlaneOp::And:
+      blitPlaneRows(frameBuffer, src, stride, layout, firstRow, rowCount,
+                    [](const uint8_t f, const uint8_t s) -> uint8_t { return f & s; });
+      break;
+    case PlaneOp::Nor:
+      blitPlaneRows(frameBuffer, src, stride, layout, firstRow, rowCount,
+                    [](const uint8_t f, const uint8_t s) -> uint8_t { return ~(f | s); });
+      break;
+    case PlaneOp::Xor:
+      blitPlaneRows(frameBuffer, src, stride, layout, firstRow, rowCount,
+                    [](const uint8_t f, const uint8_t s) -> uint8_t { return f ^ s; });
+      break;
+  }
+  return true;
+}
+
 int GfxRenderer::getTextWidth(const int fontId, const char* text, const EpdFontFamily::Style style) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return 0;
   }
 
   int w = 0, h = 0;
-  fontIt->second.getTextDimensions(text, &w, &h, style);
+  family->getTextDimensions(text, &w, &h, style);
   return w;
 }
 
+size_t GfxRenderer::getTextWrapLength(const int fontId, const char* text, const int maxWidth,
+                                      const EpdFontFamily::Style style) const {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
+    LOG_ERR("GFX", "Font %d not found", fontId);
+    return strlen(text);
+  }
+
+  return family->getWrapLength(text, maxWidth, style);
+}
+
 void GfxRenderer::drawCenteredText(const int fontId, const int y, const char* text, const bool black,
                                    const EpdFontFamily::Style style) const {
   const int x = (getScreenWidth() - getTextWidth(fontId, text, style)) / 2;
@@ -206,6 +698,7 @@ void GfxRenderer::drawCenteredText(const int fontId, const int y, const char* te
 
 void GfxRenderer::drawText(const int fontId, const int x, const int y, const char* text, const bool black,
                            const EpdFontFamily::Style style) const {
+  TRACE_SCOPE(GlyphRender, y);
   int yPos = y + getFontAscenderSize(fontId);
   int xPos = x;
   int lastBaseX = x;
@@ -218,12 +711,12 @@ void GfxRenderer::drawText(const int fontId, const int x, const int y, const cha
     return;
   }
 
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return;
   }
-  const auto& font = fontIt->second;
+  const auto& font = *family;
   constexpr int MIN_COMBINING_GAP_PX = 1;
 
   uint32_t cp;
@@ -262,21 +755,96 @@ void GfxRenderer::drawText(const int fontId, const int x, const int y, const cha
   }
 }
 
+bool GfxRenderer::shapeText(const int fontId, const char* text, const EpdFontFamily::Style style,
+                            std::vector<ShapedGlyph>& out) const {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
+    LOG_ERR("GFX", "Font %d not found", fontId);
+    return false;
+  }
+  if (text == nullptr) {
+    return true;
+  }
+  const auto& font = *family;
+  const EpdGlyph* const glyphBase = font.getData(style)->glyph;
+  constexpr int MIN_COMBINING_GAP_PX = 1;
+
+  // Same walk as drawText(), recording glyphs instead of drawing them
+  int xPos = 0;
+  int lastBaseX = 0;
+  int lastBaseAdvance = 0;
+  int lastBaseTop = 0;
+  uint32_t cp;
+  uint32_t prevCp = 0;
+  while ((cp = utf8NextCodepoint(reinterpret_cast<const uint8_t**>(&text)))) {
+    if (utf8IsCombiningMark(cp)) {
+      const EpdGlyph* combiningGlyph = font.getGlyph(cp, style);
+      if (!combiningGlyph) {
+        continue;
+      }
+      const int currentGap = combiningGlyph->top - combiningGlyph->height - lastBaseTop;
+      const int raiseBy = currentGap < MIN_COMBINING_GAP_PX ? MIN_COMBINING_GAP_PX - currentGap : 0;
+      const auto combiningX = static_cast<int16_t>(lastBaseX + lastBaseAdvance / 2);
+      out.push_back({static_cast<uint16_t>(combiningGlyph - glyphBase), combiningX,
+                     static_cast<int8_t>(std::min(raiseBy, 127))});
+      continue;
+    }
+
+    cp = font.applyLigatures(cp, text, style);
+    if (prevCp != 0) {
+      xPos += font.getKerning(prevCp, cp, style);
+    }
+
+    const EpdGlyph* glyph = font.getGlyph(cp, style);
+    lastBaseX = xPos;
+    lastBaseAdvance = glyph ? glyph->advanceX : 0;
+    lastBaseTop = glyph ? glyph->top : 0;
+    if (glyph) {
+      out.push_back({static_cast<uint16_t>(glyph - glyphBase), static_cast<int16_t>(xPos), 0});
+      xPos += glyph->advanceX;
+    }
+    prevCp = cp;
+  }
+  return true;
+}
+
+void GfxRenderer::drawShapedText(const int fontId, const int x, const int y, const ShapedGlyph* glyphs,
+                                 const size_t count, const bool black, const EpdFontFamily::Style style) const {
+  TRACE_SCOPE(GlyphRender, count);
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
+    LOG_ERR("GFX", "Font %d not found", fontId);
+    return;
+  }
+  const auto& font = *family;
+  const EpdFontData* fontData = font.getData(style);
+  // drawText() puts the baseline by the regular style's ascender for all styles
+  const int baselineY = y + font.getData(EpdFontFamily::REGULAR)->ascender;
+
+  for (size_t i = 0; i < count; i++) {
+    // Indexes come from section files on the SD card, so they are range checked
+    const EpdGlyph* glyph = font.getGlyphByIndex(glyphs[i].glyphIndex, style);
+    if (!glyph) {
+      LOG_ERR("GFX", "No glyph at index %u", glyphs[i].glyphIndex);
+      continue;
+    }
+    int glyphX = x + glyphs[i].x;
+    int glyphY = baselineY - glyphs[i].raise;
+    renderGlyphImpl<TextRotation::None>(*this, renderMode, fontData, glyph, &glyphX, &glyphY, black);
+  }
+}
+
 void GfxRenderer::drawLine(int x1, int y1, int x2, int y2, const bool state) const {
   if (x1 == x2) {
     if (y2 < y1) {
       std::swap(y1, y2);
     }
-    for (int y = y1; y <= y2; y++) {
-      drawPixel(x1, y, state);
-    }
+    fillRect(x1, y1, 1, y2 - y1 + 1, state);
   } else if (y1 == y2) {
     if (x2 < x1) {
       std::swap(x1, x2);
     }
-    for (int x = x1; x <= x2; x++) {
-      drawPixel(x, y1, state);
-    }
+    fillRect(x1, y1, x2 - x1 + 1, 1, state);
   } else {
     // Bresenham's line algorithm — integer arithmetic only
     int dx = x2 - x1;
@@ -327,6 +895,17 @@ void GfxRenderer::drawRect(const int x, const int y, const int width, const int
   }
 }
 
+// Largest dx with dx * dx <= remaining, or -1 if remaining is negative
+static int floorSqrt(const int remaining) {
+  if (remaining < 0) return -1;
+  int dx = static_cast<int>(std::sqrt(static_cast<float>(remaining)));
+  while (dx * dx > remaining) dx--;
+  while ((dx + 1) * (dx + 1) <= remaining) dx++;
+  return dx;
+}
+
+// A quarter ring crosses each of its rows as one run of pixels, from the inner circle out to the outer one, so it's
+// drawn as one span per row
 void GfxRenderer::drawArc(const int maxRadius, const int cx, const int cy, const int xDir, const int yDir,
                           const int lineWidth, const bool state) const {
   const int stroke = std::min(lineWidth, maxRadius);
@@ -334,15 +913,18 @@ void GfxRenderer::drawArc(const int maxRadius, const int cx, const int cy, const
   const int outerRadiusSq = maxRadius * maxRadius;
   const int innerRadiusSq = innerRadius * innerRadius;
   for (int dy = 0; dy <= maxRadius; ++dy) {
-    for (int dx = 0; dx <= maxRadius; ++dx) {
-      const int distSq = dx * dx + dy * dy;
-      if (distSq > outerRadiusSq || distSq < innerRadiusSq) {
-        continue;
-      }
-      const int px = cx + xDir * dx;
-      const int py = cy + yDir * dy;
-      drawPixel(px, py, state);
+    const int outer = floorSqrt(outerRadiusSq - dy * dy);
+    const int innerSq = innerRadiusSq - dy * dy;
+    int inner = 0;
+    if (innerSq > 0) {
+      inner = floorSqrt(innerSq);
+      if (inner * inner < innerSq) inner++;
     }
+    if (inner > outer) {
+      continue;
+    }
+    const int left = xDir > 0 ? cx + inner : cx - outer;
+    fillRect(left, cy + yDir * dy, outer - inner + 1, 1, state);
   }
 };
 
@@ -404,12 +986,43 @@ void GfxRenderer::drawRoundedRect(const int x, const int y, const int width, con
   }
 }
 
-void GfxRenderer::fillRect(const int x, const int y, const int width, const int height, const bool state) const {
-  for (int fillY = y; fillY < y + height; fillY++) {
-    drawLine(x, fillY, x + width - 1, fillY, state);
+// A rotation maps the rectangle onto a rectangle of the panel, so each of its physical rows is one run of bytes: a
+// masked byte at either end and a memset in between. Whatever lies off the panel is clipped.
+template <typename RowByte>
+void GfxRenderer::fillSpans(const int x, const int y, const int width, const int height, RowByte rowByte) const {
+  if (width <= 0 || height <= 0) return;
+  int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+  rotateCoordinates(orientation, x, y, &x0, &y0);
+  rotateCoordinates(orientation, x + width - 1, y + height - 1, &x1, &y1);
+  const int left = std::max(0, std::min(x0, x1));
+  const int right = std::min(HalDisplay::DISPLAY_WIDTH - 1, std::max(x0, x1));
+  const int top = std::max(0, std::min(y0, y1));
+  const int bottom = std::min(HalDisplay::DISPLAY_HEIGHT - 1, std::max(y0, y1));
+  if (left > right || top > bottom) return;
+
+  const int firstByte = left / 8;
+  const int lastByte = right / 8;
+  const uint8_t leftMask = 0xFF >> (left % 8);
+  const uint8_t rightMask = 0xFF << (7 - right % 8);
+  for (int phyY = top; phyY <= bottom; phyY++) {
+    uint8_t* row = frameBuffer + phyY * HalDisplay::DISPLAY_WIDTH_BYTES;
+    const uint8_t value = rowByte(phyY);
+    if (firstByte == lastByte) {
+      const uint8_t mask = leftMask & rightMask;
+      row[firstByte] = (row[firstByte] & ~mask) | (value & mask);
+      continue;
+    }
+    row[firstByte] = (row[firstByte] & ~leftMask) | (value & leftMask);
+    memset(row + firstByte + 1, value, lastByte - firstByte - 1);
+    row[lastByte] = (row[lastByte] & ~rightMask) | (value & rightMask);
   }
 }
 
+void GfxRenderer::fillRect(const int x, const int y, const int width, const int height, const bool state) const {
+  const uint8_t value = state ? 0x00 : 0xFF;
+  fillSpans(x, y, width, height, [value](int) { return value; });
+}
+
 // NOTE: Those are in critical path, and need to be templated to avoid runtime checks for every pixel.
 // Any branching must be done outside the loops to avoid performance degradation.
 template <>
@@ -429,12 +1042,12 @@ void GfxRenderer::drawPixelDither<Color::White>(const int x, const int y) const
 
 template <>
 void GfxRenderer::drawPixelDither<Color::LightGray>(const int x, const int y) const {
-  drawPixel(x, y, x % 2 == 0 && y % 2 == 0);
+  drawPixel(x, y, ditherInk<Color::LightGray>(x, y));
 }
 
 template <>
 void GfxRenderer::drawPixelDither<Color::DarkGray>(const int x, const int y) const {
-  drawPixel(x, y, (x + y) % 2 == 0);  // TODO: maybe find a better pattern?
+  drawPixel(x, y, ditherInk<Color::DarkGray>(x, y));
 }
 
 void GfxRenderer::fillRectDither(const int x, const int y, const int width, const int height, Color color) const {
@@ -444,17 +1057,9 @@ void GfxRenderer::fillRectDither(const int x, const int y, const int width, cons
   } else if (color == Color::White) {
     fillRect(x, y, width, height, false);
   } else if (color == Color::LightGray) {
-    for (int fillY = y; fillY < y + height; fillY++) {
-      for (int fillX = x; fillX < x + width; fillX++) {
-        drawPixelDither<Color::LightGray>(fillX, fillY);
-      }
-    }
+    fillSpans(x, y, width, height, [this](int phyY) { return ditherRowByte<Color::LightGray>(orientation, phyY); });
   } else if (color == Color::DarkGray) {
-    for (int fillY = y; fillY < y + height; fillY++) {
-      for (int fillX = x; fillX < x + width; fillX++) {
-        drawPixelDither<Color::DarkGray>(fillX, fillY);
-      }
-    }
+    fillSpans(x, y, width, height, [this](int phyY) { return ditherRowByte<Color::DarkGray>(orientation, phyY); });
   }
 }
 
@@ -462,14 +1067,8 @@ template <Color color>
 void GfxRenderer::fillArc(const int maxRadius, const int cx, const int cy, const int xDir, const int yDir) const {
   const int radiusSq = maxRadius * maxRadius;
   for (int dy = 0; dy <= maxRadius; ++dy) {
-    for (int dx = 0; dx <= maxRadius; ++dx) {
-      const int distSq = dx * dx + dy * dy;
-      const int px = cx + xDir * dx;
-      const int py = cy + yDir * dy;
-      if (distSq <= radiusSq) {
-        drawPixelDither<color>(px, py);
-      }
-    }
+    const int extent = floorSqrt(radiusSq - dy * dy);
+    fillRectDither(xDir > 0 ? cx : cx - extent, cy + yDir * dy, extent + 1, 1, color);
   }
 }
 
@@ -566,11 +1165,77 @@ void GfxRenderer::drawImage(const uint8_t bitmap[], const int x, const int y, co
       break;
   }
   // TODO: Rotate bits
-  display.drawImage(bitmap, rotatedX, rotatedY, width, height);
+  blitPanelBitmap(bitmap, rotatedX, rotatedY, width, height, false);
 }
 
+// Icons are stored rotated for portrait, where they go to the panel as they are
 void GfxRenderer::drawIcon(const uint8_t bitmap[], const int x, const int y, const int width, const int height) const {
-  display.drawImageTransparent(bitmap, y, getScreenWidth() - width - x, height, width);
+  if (orientation == Portrait) {
+    blitPanelBitmap(bitmap, y, getScreenWidth() - width - x, height, width, true);
+    return;
+  }
+  // Stored row r and column c hold the logical pixel (x + width - 1 - r, y + c)
+  const int rowBytes = (height + 7) / 8;
+  for (int r = 0; r < width; r++) {
+    for (int c = 0; c < height; c++) {
+      if (!(bitmap[r * rowBytes + c / 8] & (0x80 >> (c % 8)))) {
+        drawPixel(x + width - 1 - r, y + c, true);
+      }
+    }
+  }
+}
+
+void GfxRenderer::blitPanelBitmap(const uint8_t bitmap[], const int phyX, const int phyY, const int phyWidth,
+                                  const int phyHeight, const bool transparent) const {
+  if (phyWidth <= 0 || phyHeight <= 0) return;
+  const int rowBytes = (phyWidth + 7) / 8;
+  // Each source byte straddles two frame buffer bytes unless phyX is a multiple of 8
+  const int shift = ((phyX % 8) + 8) % 8;
+  const int firstByte = (phyX - shift) / 8;
+  const uint8_t lastMask = 0xFF << (rowBytes * 8 - phyWidth);
+  const auto put = [transparent](uint8_t* row, const int byte, const uint8_t value, const uint8_t mask) {
+    if (byte < 0 || byte >= HalDisplay::DISPLAY_WIDTH_BYTES || !mask) return;
+    if (transparent) {
+      row[byte] &= value | ~mask;
+    } else {
+      row[byte] = (row[byte] & ~mask) | (value & mask);
+    }
+  };
+  for (int r = std::max(0, -phyY); r < phyHeight && phyY + r < HalDisplay::DISPLAY_HEIGHT; r++) {
+    const uint8_t* src = bitmap + r * rowBytes;
+    uint8_t* row = frameBuffer + (phyY + r) * HalDisplay::DISPLAY_WIDTH_BYTES;
+    for (int b = 0; b < rowBytes; b++) {
+      const uint8_t mask = b == rowBytes - 1 ? lastMask : 0xFF;
+      put(row, firstByte + b, src[b] >> shift, mask >> shift);
+      if (shift) {
+        put(row, firstByte + b + 1, src[b] << (8 - shift), mask << (8 - shift));
+      }
+    }
+  }
+}
+
+// Screen x of the source columns from crop up to width - crop, worked out once per image rather than for every pixel
+// of every row. The screen x only grows with the column, so the visible ones are a run: [*first, *last).
+static void mapBitmapColumns(int16_t* columnX, const int width, const int crop, const float scale, const bool isScaled,
+                             const int x, const int screenWidth, int* first, int* last) {
+  *first = crop;
+  *last = crop;
+  for (int bmpX = crop; bmpX < width - crop; bmpX++) {
+    int screenX = bmpX - crop;
+    if (isScaled) {
+      screenX = std::floor(screenX * scale);
+    }
+    screenX += x;  // the offset should not be scaled
+    if (screenX >= screenWidth) {
+      break;
+    }
+    if (screenX < 0) {
+      *first = bmpX + 1;
+      continue;
+    }
+    columnX[bmpX] = static_cast<int16_t>(screenX);
+    *last = bmpX + 1;
+  }
 }
 
 void GfxRenderer::drawBitmap(const Bitmap& bitmap, const int x, const int y, const int maxWidth, const int maxHeight,
@@ -603,14 +1268,19 @@ void GfxRenderer::drawBitmap(const Bitmap& bitmap, const int x, const int y, con
   const int outputRowSize = (bitmap.getWidth() + 3) / 4;
   auto* outputRow = static_cast<uint8_t*>(malloc(outputRowSize));
   auto* rowBytes = static_cast<uint8_t*>(malloc(bitmap.getRowBytes()));
+  auto* columnX = static_cast<int16_t*>(malloc(bitmap.getWidth() * sizeof(int16_t)));
 
-  if (!outputRow || !rowBytes) {
+  if (!outputRow || !rowBytes || !columnX) {
     LOG_ERR("GFX", "!! Failed to allocate BMP row buffers");
     free(outputRow);
     free(rowBytes);
+    free(columnX);
     return;
   }
 
+  int firstColumn, lastColumn;
+  mapBitmapColumns(columnX, bitmap.getWidth(), cropPixX, scale, isScaled, x, getScreenWidth(), &firstColumn,
+                   &lastColumn);
   for (int bmpY = 0; bmpY < (bitmap.getHeight() - cropPixY); bmpY++) {
     // The BMP's (0, 0) is the bottom-left corner (if the height is positive, top-left if negative).
     // Screen's (0, 0) is the top-left corner.
@@ -627,6 +1297,7 @@ void GfxRenderer::drawBitmap(const Bitmap& bitmap, const int x, const int y, con
       LOG_ERR("GFX", "Failed to read row %d from bitmap", bmpY);
       free(outputRow);
       free(rowBytes);
+      free(columnX);
       return;
     }
 
@@ -639,29 +1310,82 @@ void GfxRenderer::drawBitmap(const Bitmap& bitmap, const int x, const int y, con
       continue;
     }
 
-    for (int bmpX = cropPixX; bmpX < bitmap.getWidth() - cropPixX; bmpX++) {
-      int screenX = bmpX - cropPixX;
-      if (isScaled) {
-        screenX = std::floor(screenX * scale);
-      }
-      screenX += x;  // the offset should not be scaled
-      if (screenX >= getScreenWidth()) {
-        break;
-      }
-      if (screenX < 0) {
-        continue;
+    withOrientation(orientation, [&](auto o) {
+      for (int bmpX = firstColumn; bmpX < lastColumn; bmpX++) {
+        const int screenX = columnX[bmpX];
+        const uint8_t val = outputRow[bmpX / 4] >> (6 - ((bmpX * 2) % 8)) & 0x3;
+
+        if (renderMode == BW && val < 3) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, true);
+          if (val != 0) {
+            grayPixelsDrawn = true;
+          }
+        } else if (renderMode == GRAYSCALE_MSB && (val == 1 || val == 2)) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, false);
+        } else if (renderMode == GRAYSCALE_LSB && val == 1) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, false);
+        }
       }
+    });
+  }
 
-      const uint8_t val = outputRow[bmpX / 4] >> (6 - ((bmpX * 2) % 8)) & 0x3;
+  free(outputRow);
+  free(rowBytes);
+  free(columnX);
+}
 
-      if (renderMode == BW && val < 3) {
-        drawPixel(screenX, screenY);
-      } else if (renderMode == GRAYSCALE_MSB && (val == 1 || val == 2)) {
-        drawPixel(screenX, screenY, false);
-      } else if (renderMode == GRAYSCALE_LSB && val == 1) {
-        drawPixel(screenX, screenY, false);
-      }
+void GfxRenderer::drawBitmapRegion(const Bitmap& bitmap, const int srcX, const int srcY, const int x, const int y,
+                                   const int width, const int height) const {
+  const int rowCount = std::min(height, bitmap.getHeight() - srcY);
+  const int firstColumn = std::max(srcX, srcX - x);
+  const int lastColumn = std::min({bitmap.getWidth(), srcX + width, srcX + getScreenWidth() - x});
+  if (srcX < 0 || srcY < 0 || rowCount <= 0 || firstColumn >= lastColumn) {
+    return;
+  }
+
+  // A bottom-up bitmap stores the region's last row first
+  const int firstRow = bitmap.isTopDown() ? srcY : bitmap.getHeight() - srcY - rowCount;
+  if (bitmap.seekToRow(firstRow) != BmpReaderError::Ok) {
+    LOG_ERR("GFX", "Failed to seek to row %d of bitmap", firstRow);
+    return;
+  }
+
+  auto* outputRow = static_cast<uint8_t*>(malloc((bitmap.getWidth() + 3) / 4));
+  auto* rowBytes = static_cast<uint8_t*>(malloc(bitmap.getRowBytes()));
+  if (!outputRow || !rowBytes) {
+    LOG_ERR("GFX", "!! Failed to allocate BMP row buffers");
+    free(outputRow);
+    free(rowBytes);
+    return;
+  }
+
+  for (int i = 0; i < rowCount; i++) {
+    if (bitmap.readNextRow(outputRow, rowBytes) != BmpReaderError::Ok) {
+      LOG_ERR("GFX", "Failed to read row %d from bitmap", firstRow + i);
+      break;
+    }
+    const int screenY = y + (bitmap.isTopDown() ? i : rowCount - 1 - i);
+    if (screenY < 0 || screenY >= getScreenHeight()) {
+      continue;
     }
+
+    withOrientation(orientation, [&](auto o) {
+      for (int bmpX = firstColumn; bmpX < lastColumn; bmpX++) {
+        const int screenX = x + bmpX - srcX;
+        const uint8_t val = outputRow[bmpX / 4] >> (6 - ((bmpX * 2) % 8)) & 0x3;
+
+        if (renderMode == BW && val < 3) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, true);
+          if (val != 0) {
+            grayPixelsDrawn = true;
+          }
+        } else if (renderMode == GRAYSCALE_MSB && (val == 1 || val == 2)) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, false);
+        } else if (renderMode == GRAYSCALE_LSB && val == 1) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, false);
+        }
+      }
+    });
   }
 
   free(outputRow);
@@ -685,56 +1409,59 @@ void GfxRenderer::drawBitmap1Bit(const Bitmap& bitmap, const int x, const int y,
   const int outputRowSize = (bitmap.getWidth() + 3) / 4;
   auto* outputRow = static_cast<uint8_t*>(malloc(outputRowSize));
   auto* rowBytes = static_cast<uint8_t*>(malloc(bitmap.getRowBytes()));
+  auto* columnX = static_cast<int16_t*>(malloc(bitmap.getWidth() * sizeof(int16_t)));
 
-  if (!outputRow || !rowBytes) {
+  if (!outputRow || !rowBytes || !columnX) {
     LOG_ERR("GFX", "!! Failed to allocate 1-bit BMP row buffers");
     free(outputRow);
     free(rowBytes);
+    free(columnX);
     return;
   }
 
+  int firstColumn, lastColumn;
+  mapBitmapColumns(columnX, bitmap.getWidth(), 0, scale, isScaled, x, getScreenWidth(), &firstColumn, &lastColumn);
+  const int screenHeight = getScreenHeight();
   for (int bmpY = 0; bmpY < bitmap.getHeight(); bmpY++) {
     // Read rows sequentially using readNextRow
     if (bitmap.readNextRow(outputRow, rowBytes) != BmpReaderError::Ok) {
       LOG_ERR("GFX", "Failed to read row %d from 1-bit bitmap", bmpY);
       free(outputRow);
       free(rowBytes);
+      free(columnX);
       return;
     }
 
     // Calculate screen Y based on whether BMP is top-down or bottom-up
     const int bmpYOffset = bitmap.isTopDown() ? bmpY : bitmap.getHeight() - 1 - bmpY;
     int screenY = y + (isScaled ? static_cast<int>(std::floor(bmpYOffset * scale)) : bmpYOffset);
-    if (screenY >= getScreenHeight()) {
+    if (screenY >= screenHeight) {
       continue;  // Continue reading to keep row counter in sync
     }
     if (screenY < 0) {
       continue;
     }
 
-    for (int bmpX = 0; bmpX < bitmap.getWidth(); bmpX++) {
-      int screenX = x + (isScaled ? static_cast<int>(std::floor(bmpX * scale)) : bmpX);
-      if (screenX >= getScreenWidth()) {
-        break;
-      }
-      if (screenX < 0) {
-        continue;
-      }
+    withOrientation(orientation, [&](auto o) {
+      for (int bmpX = firstColumn; bmpX < lastColumn; bmpX++) {
+        const int screenX = columnX[bmpX];
 
-      // Get 2-bit value (result of readNextRow quantization)
-      const uint8_t val = outputRow[bmpX / 4] >> (6 - ((bmpX * 2) % 8)) & 0x3;
+        // Get 2-bit value (result of readNextRow quantization)
+        const uint8_t val = outputRow[bmpX / 4] >> (6 - ((bmpX * 2) % 8)) & 0x3;
 
-      // For 1-bit source: 0 or 1 -> map to black (0,1,2) or white (3)
-      // val < 3 means black pixel (draw it)
-      if (val < 3) {
-        drawPixel(screenX, screenY, true);
+        // For 1-bit source: 0 or 1 -> map to black (0,1,2) or white (3)
+        // val < 3 means black pixel (draw it)
+        if (val < 3) {
+          plotPixel<decltype(o)::value>(frameBuffer, screenX, screenY, true);
+        }
+        // White pixels (val == 3) are not drawn (leave background)
       }
-      // White pixels (val == 3) are not drawn (leave background)
-    }
+    });
   }
 
   free(outputRow);
   free(rowBytes);
+  free(columnX);
 }
 
 void GfxRenderer::fillPolygon(const int* xPoints, const int* yPoints, int numPoints, bool state) const {
@@ -796,9 +1523,7 @@ void GfxRenderer::fillPolygon(const int* xPoints, const int* yPoints, int numPoi
       if (endX >= getScreenWidth()) endX = getScreenWidth() - 1;
 
       // Draw horizontal line
-      for (int x = startX; x <= endX; x++) {
-        drawPixel(x, scanY, state);
-      }
+      fillRect(startX, scanY, endX - startX + 1, 1, state);
     }
   }
 
@@ -819,10 +1544,176 @@ void GfxRenderer::invertScreen() const {
   }
 }
 
+namespace {
+// Windowed fast refreshes only pay off while the changed region stays well below the full panel
+constexpr uint32_t MAX_WINDOW_AREA = HalDisplay::DISPLAY_WIDTH * HalDisplay::DISPLAY_HEIGHT / 2;
+constexpr uint32_t FNV_OFFSET = 2166136261u;
+constexpr uint32_t FNV_PRIME = 16777619u;
+}  // namespace
+
+// Returns how many pixels at least changed between the shown frame and the frame buffer, counted as the ink
+// difference per tile. Word-wise popcounts keep this to ~12k operations per frame.
+uint32_t GfxRenderer::measureInkChurn(const bool store) const {
+  static_assert(HalDisplay::DISPLAY_HEIGHT % INK_TILE_ROWS == 0, "Ink tiles must cover whole panel rows");
+  static_assert(INK_TILE_WORDS * 4 == HalDisplay::DISPLAY_WIDTH_BYTES, "Ink tiles must cover whole panel rows");
+
+  uint32_t churn = 0;
+  const uint8_t* row = frameBuffer;
+  for (int tileRow = 0; tileRow < HalDisplay::DISPLAY_HEIGHT / INK_TILE_ROWS; tileRow++) {
+    uint8_t ink[INK_TILE_WORDS] = {};
+    for (int r = 0; r < INK_TILE_ROWS; r++, row += HalDisplay::DISPLAY_WIDTH_BYTES) {
+      for (int w = 0; w < INK_TILE_WORDS; w++) {
+        uint32_t word;
+        memcpy(&word, row + w * 4, sizeof(word));
+        // Cleared bits are black
+        ink[w] += __builtin_popcount(~word);
+      }
+    }
+    uint8_t* shown = shownInk[tileRow];
+    for (int w = 0; w < INK_TILE_WORDS; w++) {
+      churn += ink[w] > shown[w] ? ink[w] - shown[w] : shown[w] - ink[w];
+    }
+    if (store) {
+      memcpy(shown, ink, sizeof(ink));
+    }
+  }
+  return churn;
+}
+
+uint32_t GfxRenderer::getChurnSinceCleanRefresh() const {
+  if (!shownInkValid) return UINT32_MAX;
+  constexpr uint32_t panelPixels = HalDisplay::DISPLAY_WIDTH * HalDisplay::DISPLAY_HEIGHT;
+  const uint32_t churn = churnSinceCleanRefresh + measureInkChurn(false);
+  return static_cast<uint32_t>(static_cast<uint64_t>(churn) * 1000 / panelPixels);
+}
+
+void GfxRenderer::rememberShownFrame(const HalDisplay::RefreshMode refreshMode) const {
+  const uint32_t churn = measureInkChurn(true);
+  if (refreshMode != HalDisplay::FAST_REFRESH) {
+    churnSinceCleanRefresh = 0;
+  } else if (shownInkValid) {
+    churnSinceCleanRefresh += churn;
+  }
+  shownInkValid = true;
+  uint32_t columnHash[HalDisplay::DISPLAY_WIDTH_BYTES];
+  std::fill(columnHash, columnHash + HalDisplay::DISPLAY_WIDTH_BYTES, FNV_OFFSET);
+  const uint8_t* row = frameBuffer;
+  for (int y = 0; y < HalDisplay::DISPLAY_HEIGHT; y++, row += HalDisplay::DISPLAY_WIDTH_BYTES) {
+    uint32_t rowHash = FNV_OFFSET;
+    for (int x = 0; x < HalDisplay::DISPLAY_WIDTH_BYTES; x++) {
+      rowHash = (rowHash ^ row[x]) * FNV_PRIME;
+      columnHash[x] = (columnHash[x] ^ row[x]) * FNV_PRIME;
+    }
+    shownRowHash[y] = rowHash;
+  }
+  std::copy(columnHash, columnHash + HalDisplay::DISPLAY_WIDTH_BYTES, shownColumnHash);
+  shownHashesValid = true;
+}
+
+// Compares the frame buffer against the hashes of the last shown frame and returns the bounding box of the changed
+// physical rows and byte columns. Returns false when nothing changed or the previous frame is unknown.
+bool GfxRenderer::findChangedWindow(int* phyX, int* phyY, int* phyWidth, int* phyHeight) const {
+  if (!shownHashesValid) return false;
+
+  uint32_t columnHash[HalDisplay::DISPLAY_WIDTH_BYTES];
+  std::fill(columnHash, columnHash + HalDisplay::DISPLAY_WIDTH_BYTES, FNV_OFFSET);
+  int firstRow = -1;
+  int lastRow = -1;
+  const uint8_t* row = frameBuffer;
+  for (int y = 0; y < HalDisplay::DISPLAY_HEIGHT; y++, row += HalDisplay::DISPLAY_WIDTH_BYTES) {
+    uint32_t rowHash = FNV_OFFSET;
+    for (int x = 0; x < HalDisplay::DISPLAY_WIDTH_BYTES; x++) {
+      rowHash = (rowHash ^ row[x]) * FNV_PRIME;
+      columnHash[x] = (columnHash[x] ^ row[x]) * FNV_PRIME;
+    }
+    if (rowHash != shownRowHash[y]) {
+      if (firstRow < 0) firstRow = y;
+      lastRow = y;
+    }
+  }
+  if (firstRow < 0) return false;
+
+  int firstColumn = 0;
+  while (firstColumn < HalDisplay::DISPLAY_WIDTH_BYTES && columnHash[firstColumn] == shownColumnHash[firstColumn]) {
+    firstColumn++;
+  }
+  int lastColumn = HalDisplay::DISPLAY_WIDTH_BYTES - 1;
+  while (lastColumn > firstColumn && columnHash[lastColumn] == shownColumnHash[lastColumn]) {
+    lastColumn--;
+  }
+  if (firstColumn == HalDisplay::DISPLAY_WIDTH_BYTES) {
+    // Row hashes changed but no column did: treat it as a change spanning the full width
+    firstColumn = 0;
+    lastColumn = HalDisplay::DISPLAY_WIDTH_BYTES - 1;
+  }
+
+  *phyX = firstColumn * 8;
+  *phyY = firstRow;
+  *phyWidth = (lastColumn - firstColumn + 1) * 8;
+  *phyHeight = lastRow - firstRow + 1;
+  return true;
+}
+
+void GfxRenderer::displayPhysicalWindow(const int phyX, const int phyY, const int phyWidth,
+                                        const int phyHeight) const {
+  LOG_DBG("GFX", "Windowed refresh %dx%d at %d,%d", phyWidth, phyHeight, phyX, phyY);
+  display.displayWindow(phyX, phyY, phyWidth, phyHeight, fadingFix);
+  rememberShownFrame(HalDisplay::FAST_REFRESH);
+}
+
 void GfxRenderer::displayBuffer(const HalDisplay::RefreshMode refreshMode) const {
   auto elapsed = millis() - start_ms;
   LOG_DBG("GFX", "Time = %lu ms from clearScreen to displayBuffer", elapsed);
+
+  if (refreshMode == HalDisplay::FAST_REFRESH) {
+    int phyX, phyY, phyWidth, phyHeight;
+    if (findChangedWindow(&phyX, &phyY, &phyWidth, &phyHeight) &&
+        static_cast<uint32_t>(phyWidth) * phyHeight <= MAX_WINDOW_AREA) {
+      displayPhysicalWindow(phyX, phyY, phyWidth, phyHeight);
+      return;
+    }
+  }
+
   display.displayBuffer(refreshMode, fadingFix);
+  rememberShownFrame(refreshMode);
+}
+
+void GfxRenderer::displayWindow(const int x, const int y, const int width, const int height,
+                                const HalDisplay::RefreshMode refreshMode) const {
+  if (width <= 0 || height <= 0) return;
+  if (refreshMode != HalDisplay::FAST_REFRESH || !shownHashesValid) {
+    // Windowed updates need a known previous frame on the panel and only exist as fast refreshes
+    displayBuffer(refreshMode);
+    return;
+  }
+
+  int x0, y0, x1, y1;
+  rotateCoordinates(orientation, x, y, &x0, &y0);
+  rotateCoordinates(orientation, x + width - 1, y + height - 1, &x1, &y1);
+  int left = std::max(0, std::min(x0, x1));
+  int right = std::min(HalDisplay::DISPLAY_WIDTH - 1, std::max(x0, x1));
+  int top = std::max(0, std::min(y0, y1));
+  int bottom = std::min(HalDisplay::DISPLAY_HEIGHT - 1, std::max(y0, y1));
+  if (left > right || top > bottom) return;
+
+  // The controller addresses RAM a byte (8 pixels) at a time along the physical x axis
+  left &= ~7;
+  right |= 7;
+
+  // Anything drawn outside the requested window since the last update has to go out with it
+  int phyX, phyY, phyWidth, phyHeight;
+  if (findChangedWindow(&phyX, &phyY, &phyWidth, &phyHeight)) {
+    left = std::min(left, phyX);
+    right = std::max(right, phyX + phyWidth - 1);
+    top = std::min(top, phyY);
+    bottom = std::max(bottom, phyY + phyHeight - 1);
+  }
+  if (static_cast<uint32_t>(right - left + 1) * (bottom - top + 1) > MAX_WINDOW_AREA) {
+    display.displayBuffer(refreshMode, fadingFix);
+    rememberShownFrame(refreshMode);
+    return;
+  }
+  displayPhysicalWindow(left, top, right - left + 1, bottom - top + 1);
 }
 
 std::string GfxRenderer::truncatedText(const int fontId, const char* text, const int maxWidth,
@@ -939,84 +1830,125 @@ int GfxRenderer::getScreenHeight() const {
 }
 
 int GfxRenderer::getSpaceWidth(const int fontId, const EpdFontFamily::Style style) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return 0;
   }
 
-  const EpdGlyph* spaceGlyph = fontIt->second.getGlyph(' ', style);
+  const EpdGlyph* spaceGlyph = family->getGlyph(' ', style);
   return spaceGlyph ? spaceGlyph->advanceX : 0;
 }
 
 int GfxRenderer::getSpaceKernAdjust(const int fontId, const uint32_t leftCp, const uint32_t rightCp,
                                     const EpdFontFamily::Style style) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) return 0;
-  const auto& font = fontIt->second;
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) return 0;
+  const auto& font = *family;
   return font.getKerning(leftCp, ' ', style) + font.getKerning(' ', rightCp, style);
 }
 
 int GfxRenderer::getKerning(const int fontId, const uint32_t leftCp, const uint32_t rightCp,
                             const EpdFontFamily::Style style) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) return 0;
-  return fontIt->second.getKerning(leftCp, rightCp, style);
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) return 0;
+  return family->getKerning(leftCp, rightCp, style);
 }
 
+namespace {
+// Longest text, in bytes, that getTextAdvanceX() decodes in one go; a word almost always is
+constexpr size_t WORD_CODEPOINTS = 48;
+
+// The codepoints of a text as the measuring walk takes them, decoded one at a time as it goes...
+struct TextCodepoints {
+  const char* text;
+  uint32_t next() { return utf8NextCodepoint(reinterpret_cast<const uint8_t**>(&text)); }
+  uint32_t ligate(const EpdFontFamily& font, const uint32_t cp, const EpdFontFamily::Style style) {
+    return font.applyLigatures(cp, text, style);
+  }
+};
+
+// ...or all decoded beforehand
+struct DecodedCodepoints {
+  const uint32_t* cursor;
+  const uint32_t* end;
+  uint32_t next() { return cursor < end ? *cursor++ : 0; }
+  uint32_t ligate(const EpdFontFamily& font, const uint32_t cp, const EpdFontFamily::Style style) {
+    return font.applyLigatures(cp, cursor, end, style);
+  }
+};
+
+// Runs walk over the codepoints of text, decoded up front into an array on the stack when it is short enough
+template <typename Walk>
+auto walkCodepoints(const char* text, Walk&& walk) {
+  const size_t length = strlen(text);
+  if (length <= WORD_CODEPOINTS) {
+    uint32_t codepoints[WORD_CODEPOINTS];
+    size_t used;
+    const size_t count = utf8DecodeCodepoints(text, length, codepoints, WORD_CODEPOINTS, &used);
+    if (used == length) {
+      return walk(DecodedCodepoints{codepoints, codepoints + count});
+    }
+  }
+  return walk(TextCodepoints{text});
+}
+}  // namespace
+
 int GfxRenderer::getTextAdvanceX(const int fontId, const char* text, EpdFontFamily::Style style) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return 0;
   }
 
-  uint32_t cp;
-  uint32_t prevCp = 0;
-  int width = 0;
-  const auto& font = fontIt->second;
-  while ((cp = utf8NextCodepoint(reinterpret_cast<const uint8_t**>(&text)))) {
-    if (utf8IsCombiningMark(cp)) {
-      continue;
-    }
-    cp = font.applyLigatures(cp, text, style);
-    if (prevCp != 0) {
-      width += font.getKerning(prevCp, cp, style);
+  const auto& font = *family;
+  return walkCodepoints(text, [&](auto codepoints) {
+    uint32_t cp;
+    uint32_t prevCp = 0;
+    int width = 0;
+    while ((cp = codepoints.next())) {
+      if (utf8IsCombiningMark(cp)) {
+        continue;
+      }
+      cp = codepoints.ligate(font, cp, style);
+      if (prevCp != 0) {
+        width += font.getKerning(prevCp, cp, style);
+      }
+      const EpdGlyph* glyph = font.getGlyph(cp, style);
+      if (glyph) width += glyph->advanceX;
+      prevCp = cp;
     }
-    const EpdGlyph* glyph = font.getGlyph(cp, style);
-    if (glyph) width += glyph->advanceX;
-    prevCp = cp;
-  }
-  return width;
+    return width;
+  });
 }
 
 int GfxRenderer::getFontAscenderSize(const int fontId) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return 0;
   }
 
-  return fontIt->second.getData(EpdFontFamily::REGULAR)->ascender;
+  return family->getData(EpdFontFamily::REGULAR)->ascender;
 }
 
 int GfxRenderer::getLineHeight(const int fontId) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return 0;
   }
 
-  return fontIt->second.getData(EpdFontFamily::REGULAR)->advanceY;
+  return family->getData(EpdFontFamily::REGULAR)->advanceY;
 }
 
 int GfxRenderer::getTextHeight(const int fontId) const {
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return 0;
   }
-  return fontIt->second.getData(EpdFontFamily::REGULAR)->ascender;
+  return family->getData(EpdFontFamily::REGULAR)->ascender;
 }
 
 void GfxRenderer::drawTextRotated90CW(const int fontId, const int x, const int y, const char* text, const bool black,
@@ -1026,13 +1958,13 @@ void GfxRenderer::drawTextRotated90CW(const int fontId, const int x, const int y
     return;
   }
 
-  const auto fontIt = fontMap.find(fontId);
-  if (fontIt == fontMap.end()) {
+  const EpdFontFamily* family = findFont(fontId);
+  if (!family) {
     LOG_ERR("GFX", "Font %d not found", fontId);
     return;
   }
 
-  const auto& font = fontIt->second;
+  const auto& font = *family;
 
   int xPos = x;
   int yPos = y;
@@ -1089,25 +2021,35 @@ void GfxRenderer::copyGrayscaleLsbBuffers() const { display.copyGrayscaleLsbBuff
 
 void GfxRenderer::copyGrayscaleMsbBuffers() const { display.copyGrayscaleMsbBuffers(frameBuffer); }
 
-void GfxRenderer::displayGrayBuffer() const { display.displayGrayBuffer(fadingFix); }
+void GfxRenderer::displayGrayBuffer() const {
+  display.displayGrayBuffer(fadingFix);
+  // The panel now shows the grayscale planes, which the BW frame hashes no longer describe
+  shownHashesValid = false;
+}
 
 void GfxRenderer::freeBwBufferChunks() {
-  for (auto& bwBufferChunk : bwBufferChunks) {
-    if (bwBufferChunk) {
-      free(bwBufferChunk);
-      bwBufferChunk = nullptr;
+  for (size_t i = 0; i < BW_BUFFER_NUM_CHUNKS; i++) {
+    if (bwBufferChunks[i]) {
+      free(bwBufferChunks[i]);
+      bwBufferChunks[i] = nullptr;
     }
+    bwBufferChunkSizes[i] = 0;
   }
 }
 
+
 /**
  * This should be called before grayscale buffers are populated.
  * A `restoreBwBuffer` call should always follow the grayscale render if this method was called.
- * Uses chunked allocation to avoid needing 48KB of contiguous memory.
+ * Each chunk is compressed when that pays off (a text page typically needs 5-10KB in total), otherwise copied as-is,
+ * so there is never a need for 48KB of contiguous memory.
  * Returns true if buffer was stored successfully, false if allocation failed.
  */
 bool GfxRenderer::storeBwBuffer() {
-  // Allocate and copy each chunk
+  TRACE_SCOPE(PlaneCopy, 0);
+  // A chunk is only kept compressed when it shrinks to at most 7/8 of its raw size
+  constexpr size_t maxPackedSize = BW_BUFFER_CHUNK_SIZE * 7 / 8;
+  size_t storedBytes = 0;
   for (size_t i = 0; i < BW_BUFFER_NUM_CHUNKS; i++) {
     // Check if any chunks are already allocated
     if (bwBufferChunks[i]) {
@@ -1116,20 +2058,30 @@ bool GfxRenderer::storeBwBuffer() {
       bwBufferChunks[i] = nullptr;
     }
 
-    const size_t offset = i * BW_BUFFER_CHUNK_SIZE;
-    bwBufferChunks[i] = static_cast<uint8_t*>(malloc(BW_BUFFER_CHUNK_SIZE));
+    const uint8_t* chunk = frameBuffer + i * BW_BUFFER_CHUNK_SIZE;
+    const size_t packedSize = PackBits::pack(chunk, BW_BUFFER_CHUNK_SIZE, nullptr);
+    const bool packed = packedSize <= maxPackedSize;
+    const size_t storedSize = packed ? packedSize : BW_BUFFER_CHUNK_SIZE;
+    bwBufferChunks[i] = static_cast<uint8_t*>(malloc(storedSize));
 
     if (!bwBufferChunks[i]) {
-      LOG_ERR("GFX", "!! Failed to allocate BW buffer chunk %zu (%zu bytes)", i, BW_BUFFER_CHUNK_SIZE);
+      LOG_ERR("GFX", "!! Failed to allocate BW buffer chunk %zu (%zu bytes)", i, storedSize);
       // Free previously allocated chunks
       freeBwBufferChunks();
       return false;
     }
 
-    memcpy(bwBufferChunks[i], frameBuffer + offset, BW_BUFFER_CHUNK_SIZE);
+    if (packed) {
+      PackBits::pack(chunk, BW_BUFFER_CHUNK_SIZE, bwBufferChunks[i]);
+    } else {
+      memcpy(bwBufferChunks[i], chunk, BW_BUFFER_CHUNK_SIZE);
+    }
+    bwBufferChunkSizes[i] = static_cast<uint16_t>(storedSize);
+    storedBytes += storedSize;
   }
 
-  LOG_DBG("GFX", "Stored BW buffer in %zu chunks (%zu bytes each)", BW_BUFFER_NUM_CHUNKS, BW_BUFFER_CHUNK_SIZE);
+  LOG_DBG("GFX", "Stored BW buffer in %zu chunks (%zu of %lu bytes)", BW_BUFFER_NUM_CHUNKS, storedBytes,
+          static_cast<unsigned long>(HalDisplay::BUFFER_SIZE));
   return true;
 }
 
@@ -1139,6 +2091,7 @@ bool GfxRenderer::storeBwBuffer() {
  * Uses chunked restoration to match chunked storage.
  */
 void GfxRenderer::restoreBwBuffer() {
+  TRACE_SCOPE(PlaneCopy, 0);
   // Check if all chunks are allocated
   bool missingChunks = false;
   for (const auto& bwBufferChunk : bwBufferChunks) {
@@ -1154,8 +2107,12 @@ void GfxRenderer::restoreBwBuffer() {
   }
 
   for (size_t i = 0; i < BW_BUFFER_NUM_CHUNKS; i++) {
-    const size_t offset = i * BW_BUFFER_CHUNK_SIZE;
-    memcpy(frameBuffer + offset, bwBufferChunks[i], BW_BUFFER_CHUNK_SIZE);
+    uint8_t* chunk = frameBuffer + i * BW_BUFFER_CHUNK_SIZE;
+    if (bwBufferChunkSizes[i] == BW_BUFFER_CHUNK_SIZE) {
+      memcpy(chunk, bwBufferChunks[i], BW_BUFFER_CHUNK_SIZE);
+    } else if (!PackBits::unpack(bwBufferChunks[i], bwBufferChunkSizes[i], chunk, BW_BUFFER_CHUNK_SIZE)) {
+      LOG_ERR("GFX", "!! Stored BW buffer chunk %zu is corrupt", i);
+    }
   }
 
   display.cleanupGrayscaleBuffers(frameBuffer);
@@ -1174,6 +2131,44 @@ void GfxRenderer::cleanupGrayscaleWithFrameBuffer() const {
   }
 }
 
+void GfxRenderer::freeGrayMsbChunks() {
+  for (auto& chunk : grayMsbChunks) {
+    free(chunk);
+    chunk = nullptr;
+  }
+}
+
+bool GfxRenderer::beginGrayscaleBoth() {
+  for (auto& chunk : grayMsbChunks) {
+    if (!chunk) {
+      chunk = static_cast<uint8_t*>(malloc(BW_BUFFER_CHUNK_SIZE));
+    }
+    if (!chunk) {
+      LOG_DBG("GFX", "Not enough memory for single-pass grayscale, rendering the planes separately");
+      freeGrayMsbChunks();
+      return false;
+    }
+    memset(chunk, 0x00, BW_BUFFER_CHUNK_SIZE);
+  }
+
+  clearScreen(0x00);
+  renderMode = GRAYSCALE_BOTH;
+  return true;
+}
+
+void GfxRenderer::copyGrayscaleBothBuffers() {
+  TRACE_SCOPE(PlaneCopy, 0);
+  display.copyGrayscaleLsbBuffers(frameBuffer);
+  for (size_t i = 0; i < BW_BUFFER_NUM_CHUNKS; i++) {
+    if (grayMsbChunks[i]) {
+      memcpy(frameBuffer + i * BW_BUFFER_CHUNK_SIZE, grayMsbChunks[i], BW_BUFFER_CHUNK_SIZE);
+    }
+  }
+  display.copyGrayscaleMsbBuffers(frameBuffer);
+  freeGrayMsbChunks();
+  renderMode = BW;
+}
+
 void GfxRenderer::renderChar(const EpdFontFamily& fontFamily, uint32_t cp, int* x, int* y, bool pixelState,
                              EpdFontFamily::Style style) const {
   renderCharImpl<TextRotation::None>(*this, renderMode, fontFamily, cp, x, y, pixelState, style);
@@ -4,7 +4,6 @@
 #include <FontDecompressor.h>
 #include <HalDisplay.h>
 
-#include <map>
 #include <string>
 #include <vector>
 
@@ -16,7 +15,16 @@ enum Color : uint8_t { Clear = 0x00, White = 0x01, LightGray = 0x05, DarkGray =
 
 class GfxRenderer {
  public:
-  enum RenderMode { BW, GRAYSCALE_LSB, GRAYSCALE_MSB };
+  // GRAYSCALE_BOTH renders text into the LSB plane (frame buffer) and MSB plane (side buffers) in one pass
+  enum RenderMode { BW, GRAYSCALE_LSB, GRAYSCALE_MSB, GRAYSCALE_BOTH };
+
+  // One glyph of shaped text: what drawText() would draw, with ligatures, kerning and combining mark placement
+  // already resolved
+  struct ShapedGlyph {
+    uint16_t glyphIndex;  // Into the glyph array of the style's font
+    int16_t x;            // Pen position relative to the start of the text
+    int8_t raise;         // Pixels a combining mark is lifted to clear its base, 0 otherwise
+  };
 
   // Logical screen orientation from the perspective of callers
   enum Orientation {
@@ -37,21 +45,66 @@ class GfxRenderer {
   Orientation orientation;
   bool fadingFix;
   uint8_t* frameBuffer = nullptr;
+  mutable bool grayPixelsDrawn = false;
+  // Row and byte-column hashes of the frame last shown on the panel, used to narrow fast refreshes to what changed
+  mutable uint32_t shownRowHash[HalDisplay::DISPLAY_HEIGHT] = {};
+  mutable uint32_t shownColumnHash[HalDisplay::DISPLAY_WIDTH_BYTES] = {};
+  mutable bool shownHashesValid = false;
+  // Ink pixels per 32x4 physical tile of the last shown frame, and the tile-level churn accumulated since the last
+  // half or full refresh; used to schedule ghosting cleanup by how much the panel actually changed
+  static constexpr int INK_TILE_ROWS = 4;
+  static constexpr int INK_TILE_WORDS = HalDisplay::DISPLAY_WIDTH_BYTES / 4;
+  mutable uint8_t shownInk[HalDisplay::DISPLAY_HEIGHT / INK_TILE_ROWS][INK_TILE_WORDS] = {};
+  mutable bool shownInkValid = false;
+  mutable uint32_t churnSinceCleanRefresh = 0;
+  // Stored BW frame, one allocation per chunk. A chunk is PackBits-compressed unless that doesn't save enough, in
+  // which case it is a raw copy of BW_BUFFER_CHUNK_SIZE bytes.
   uint8_t* bwBufferChunks[BW_BUFFER_NUM_CHUNKS] = {nullptr};
-  std::map<int, EpdFontFamily> fontMap;
+  uint16_t bwBufferChunkSizes[BW_BUFFER_NUM_CHUNKS] = {};
+  // MSB gray plane while rendering in GRAYSCALE_BOTH mode, chunked like the stored BW buffer
+  uint8_t* grayMsbChunks[BW_BUFFER_NUM_CHUNKS] = {nullptr};
+  static constexpr size_t GRAY_MSB_ROWS_PER_CHUNK = BW_BUFFER_CHUNK_SIZE / HalDisplay::DISPLAY_WIDTH_BYTES;
+  static_assert(GRAY_MSB_ROWS_PER_CHUNK * HalDisplay::DISPLAY_WIDTH_BYTES == BW_BUFFER_CHUNK_SIZE,
+                "Gray plane chunks must hold whole panel rows");
+  // Registered fonts, looked up by a scan of this flat array from the last hit. The families are the static ones of
+  // the firmware, or loaded from the SD card, and are not copied.
+  struct FontSlot {
+    int id;
+    const EpdFontFamily* family;
+  };
+  static constexpr uint8_t MAX_FONTS = 20;
+  FontSlot fonts[MAX_FONTS] = {};
+  uint8_t fontCount = 0;
+  mutable uint8_t lastFont = 0;
+  const EpdFontFamily* findFont(int fontId) const;
   FontDecompressor* fontDecompressor = nullptr;
   void renderChar(const EpdFontFamily& fontFamily, uint32_t cp, int* x, int* y, bool pixelState,
                   EpdFontFamily::Style style) const;
   void freeBwBufferChunks();
+  void freeGrayMsbChunks();
+  void rememberShownFrame(HalDisplay::RefreshMode refreshMode) const;
+  uint32_t measureInkChurn(bool store) const;
+  bool findChangedWindow(int* phyX, int* phyY, int* phyWidth, int* phyHeight) const;
+  void displayPhysicalWindow(int phyX, int phyY, int phyWidth, int phyHeight) const;
   template <Color color>
   void drawPixelDither(int x, int y) const;
+  // Fills the panel rows a logical rectangle covers, rowByte(phyY) giving the frame buffer byte for each row
+  template <typename RowByte>
+  void fillSpans(int x, int y, int width, int height, RowByte rowByte) const;
   template <Color color>
   void fillArc(int maxRadius, int cx, int cy, int xDir, int yDir) const;
+  // Copies a bitmap stored as panel rows (rows padded to whole bytes, a 0 bit is black) to the frame buffer at a
+  // physical position, a byte at a time; transparent leaves what's under its white pixels
+  void blitPanelBitmap(const uint8_t bitmap[], int phyX, int phyY, int phyWidth, int phyHeight,
+                       bool transparent) const;
 
  public:
   explicit GfxRenderer(HalDisplay& halDisplay)
       : display(halDisplay), renderMode(BW), orientation(Portrait), fadingFix(false) {}
-  ~GfxRenderer() { freeBwBufferChunks(); }
+  ~GfxRenderer() {
+    freeBwBufferChunks();
+    freeGrayMsbChunks();
+  }
 
   static constexpr int VIEWABLE_MARGIN_TOP = 9;
   static constexpr int VIEWABLE_MARGIN_RIGHT = 3;
@@ -60,11 +113,19 @@ class GfxRenderer {
 
   // Setup
   void begin();  // must be called right after display.begin()
-  void insertFont(int fontId, EpdFontFamily font);
+  // The family must outlive the renderer (or its removeFont()), it is kept by reference. A second font with the same
+  // id is ignored.
+  void insertFont(int fontId, const EpdFontFamily& font);
+  // For a family that goes away, like one loaded from the SD card; its decompressed glyphs are dropped too
+  void removeFont(int fontId);
   void setFontDecompressor(FontDecompressor* d) { fontDecompressor = d; }
   void clearFontCache() {
     if (fontDecompressor) fontDecompressor->clearCache();
   }
+  // Keep decompressed glyph groups for the next page unless the heap is running low
+  void trimFontCache() {
+    if (fontDecompressor) fontDecompressor->trimCache();
+  }
 
   // Orientation control (affects logical width/height and coordinate transforms)
   void setOrientation(const Orientation o) { orientation = o; }
@@ -76,15 +137,40 @@ class GfxRenderer {
   // Screen ops
   int getScreenWidth() const;
   int getScreenHeight() const;
+  // A FAST_REFRESH is narrowed to a windowed update when only a small part of the frame changed since the last one
   void displayBuffer(HalDisplay::RefreshMode refreshMode = HalDisplay::FAST_REFRESH) const;
-  // EXPERIMENTAL: Windowed update - display only a rectangular region
-  // void displayWindow(int x, int y, int width, int height) const;
+  // Refreshes only the given logical rectangle (widened to panel byte boundaries). Windowed updates are always fast
+  // refreshes; any other mode falls back to a full displayBuffer().
+  void displayWindow(int x, int y, int width, int height,
+                     HalDisplay::RefreshMode refreshMode = HalDisplay::FAST_REFRESH) const;
+  // True while the panel refreshes, that is while a display call (on whichever task) is still waiting for it
+  bool isDisplayBusy() const { return display.isBusy(); }
   void invertScreen() const;
   void clearScreen(uint8_t color = 0xFF) const;
   void getOrientedViewableTRBL(int* outTop, int* outRight, int* outBottom, int* outLeft) const;
 
   // Drawing
   void drawPixel(int x, int y, bool state = true) const;
+  // Physical panel position of logical (x, y) in the current orientation
+  void toPhysical(int x, int y, int* phyX, int* phyY) const;
+  // Byte i of `mask` covers 8 physical pixels at frame buffer byte start + i * step; set bits are drawn with `state`
+  void drawByteMask(size_t start, int step, const uint8_t* mask, size_t count, bool state = true) const;
+  // How blitPlane1Bit() merges each source byte s into the frame buffer byte f it lands on
+  enum class PlaneOp : uint8_t {
+    Copy,    // s
+    Invert,  // ~s
+    And,     // f & s
+    Nor,     // ~(f | s)
+    Xor,     // f ^ s
+  };
+  // Merges rows of a pre-rendered plane covering the whole panel into the frame buffer, a byte at a time instead of
+  // pixel by pixel. The plane is row-major in the logical coordinates of `layout` (MSB first, 0 bits black, rows
+  // `stride` bytes apart); src holds rowCount of its rows from firstRow on, all of them by default. Two planes are
+  // combined by copying the first and merging the second. LandscapeCounterClockwise rows are panel rows and merged as
+  // they are, Portrait ones are bit-transposed in 8x8 blocks and so come in multiples of 8. Returns false for other
+  // layouts or rows outside the screen.
+  bool blitPlane1Bit(const uint8_t* src, size_t stride, Orientation layout, PlaneOp op = PlaneOp::Copy,
+                     int firstRow = 0, int rowCount = -1) const;
   void drawLine(int x1, int y1, int x2, int y2, bool state = true) const;
   void drawLine(int x1, int y1, int x2, int y2, int lineWidth, bool state) const;
   void drawArc(int maxRadius, int cx, int cy, int xDir, int yDir, int lineWidth, bool state) const;
@@ -103,14 +189,24 @@ class GfxRenderer {
   void drawBitmap(const Bitmap& bitmap, int x, int y, int maxWidth, int maxHeight, float cropX = 0,
                   float cropY = 0) const;
   void drawBitmap1Bit(const Bitmap& bitmap, int x, int y, int maxWidth, int maxHeight) const;
+  // The width by height region of bitmap from (srcX, srcY), unscaled at x, y. Only the rows in it are read.
+  void drawBitmapRegion(const Bitmap& bitmap, int srcX, int srcY, int x, int y, int width, int height) const;
   void fillPolygon(const int* xPoints, const int* yPoints, int numPoints, bool state = true) const;
 
   // Text
   int getTextWidth(int fontId, const char* text, EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
+  // Bytes of text to put on a line maxWidth wide, breaking at the last space that fits (see EpdFont::getWrapLength)
+  size_t getTextWrapLength(int fontId, const char* text, int maxWidth,
+                           EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
   void drawCenteredText(int fontId, int y, const char* text, bool black = true,
                         EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
   void drawText(int fontId, int x, int y, const char* text, bool black = true,
                 EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
+  // Appends the glyphs drawText() would draw for text to out. False if the font isn't loaded.
+  bool shapeText(int fontId, const char* text, EpdFontFamily::Style style, std::vector<ShapedGlyph>& out) const;
+  // Draws glyphs from shapeText() with the same font and style, without decoding or measuring anything again
+  void drawShapedText(int fontId, int x, int y, const ShapedGlyph* glyphs, size_t count, bool black = true,
+                      EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
   int getSpaceWidth(int fontId, EpdFontFamily::Style style = EpdFontFamily::REGULAR) const;
   /// Returns the kerning adjustment for a space between two codepoints:
   /// kern(leftCp, ' ') + kern(' ', rightCp). Returns 0 if kerning is unavailable.
@@ -136,15 +232,34 @@ class GfxRenderer {
   // Grayscale functions
   void setRenderMode(const RenderMode mode) { this->renderMode = mode; }
   RenderMode getRenderMode() const { return renderMode; }
+  // Tracks whether a BW render emitted any pixel that has a gray level, so the grayscale passes can be skipped
+  void resetGrayPixelsDrawn() { grayPixelsDrawn = false; }
+  void markGrayPixelDrawn() const { grayPixelsDrawn = true; }
+  bool wereGrayPixelsDrawn() const { return grayPixelsDrawn; }
+  // Share of panel pixels (in 1/1000) that changed since the last half or full refresh, including the frame buffer
+  // contents not yet displayed. Accumulates past 1000 over several frames; UINT32_MAX while the shown frame is unknown.
+  uint32_t getChurnSinceCleanRefresh() const;
   void copyGrayscaleLsbBuffers() const;
   void copyGrayscaleMsbBuffers() const;
   void displayGrayBuffer() const;
   bool storeBwBuffer();    // Returns true if buffer was stored successfully
   void restoreBwBuffer();  // Restore and free the stored buffer
   void cleanupGrayscaleWithFrameBuffer() const;
+  // Single-pass anti-aliasing for text-only content. beginGrayscaleBoth() clears the frame buffer, allocates the MSB
+  // plane and switches to GRAYSCALE_BOTH (returns false if there isn't enough memory, leaving the mode unchanged).
+  // copyGrayscaleBothBuffers() hands both planes to the display, frees the MSB plane and switches back to BW.
+  bool beginGrayscaleBoth();
+  void copyGrayscaleBothBuffers();
+  // Start of a physical panel row in the MSB plane; only valid between the two calls above
+  uint8_t* getGrayscaleMsbRow(const int phyY) const {
+    return grayMsbChunks[phyY / GRAY_MSB_ROWS_PER_CHUNK] +
+           (phyY % GRAY_MSB_ROWS_PER_CHUNK) * HalDisplay::DISPLAY_WIDTH_BYTES;
+  }
 
   // Font helpers
-  const uint8_t* getGlyphBitmap(const EpdFontData* fontData, const EpdGlyph* glyph) const;
+  // layout is how a compressed font hands out the bitmap (see FontDecompressor::getBitmap); others only have Rows
+  const uint8_t* getGlyphBitmap(const EpdFontData* fontData, const EpdGlyph* glyph,
+                                FontDecompressor::Layout layout = FontDecompressor::Layout::Rows) const;
 
   // Low level functions
   uint8_t* getFrameBuffer() const;
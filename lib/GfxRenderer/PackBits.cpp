@@ -0,0 +1,66 @@
+#include "PackBits.h"
+
+#include <cstring>
+
+namespace {
+constexpr size_t MIN_RUN = 3;
+constexpr size_t MAX_RUN = 0x7F + MIN_RUN;
+constexpr size_t MAX_LITERAL = 0x80;
+
+bool runStartsAt(const uint8_t* src, const size_t pos, const size_t size) {
+  return pos + 2 < size && src[pos] == src[pos + 1] && src[pos] == src[pos + 2];
+}
+}  // namespace
+
+size_t PackBits::pack(const uint8_t* src, const size_t size, uint8_t* dst) {
+  size_t out = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    if (runStartsAt(src, pos, size)) {
+      size_t run = MIN_RUN;
+      while (pos + run < size && run < MAX_RUN && src[pos + run] == src[pos]) {
+        run++;
+      }
+      if (dst) {
+        dst[out] = static_cast<uint8_t>(0x80 | (run - MIN_RUN));
+        dst[out + 1] = src[pos];
+      }
+      out += 2;
+      pos += run;
+      continue;
+    }
+
+    size_t literal = 1;
+    while (pos + literal < size && literal < MAX_LITERAL && !runStartsAt(src, pos + literal, size)) {
+      literal++;
+    }
+    if (dst) {
+      dst[out] = static_cast<uint8_t>(literal - 1);
+      memcpy(dst + out + 1, src + pos, literal);
+    }
+    out += 1 + literal;
+    pos += literal;
+  }
+  return out;
+}
+
+bool PackBits::unpack(const uint8_t* src, const size_t packedSize, uint8_t* dst, const size_t size) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < packedSize) {
+    const uint8_t control = src[in++];
+    if (control & 0x80) {
+      const size_t run = (control & 0x7F) + MIN_RUN;
+      if (in >= packedSize || out + run > size) return false;
+      memset(dst + out, src[in++], run);
+      out += run;
+    } else {
+      const size_t literal = control + 1;
+      if (in + literal > packedSize || out + literal > size) return false;
+      memcpy(dst + out, src + in, literal);
+      in += literal;
+      out += literal;
+    }
+  }
+  return out == size;
+}
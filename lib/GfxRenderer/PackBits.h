@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// PackBits variant used for stashing frame buffers: a control byte with the high bit set repeats the next byte
+// (control & 0x7F) + 3 times, otherwise (control + 1) literal bytes follow. Mostly white text pages shrink to a
+// small fraction of their size.
+namespace PackBits {
+
+// Upper bound of the packed size of `size` bytes (all literals)
+constexpr size_t maxPackedSize(const size_t size) { return size + (size + 127) / 128; }
+
+// Returns the packed size; with dst == nullptr only measures
+size_t pack(const uint8_t* src, size_t size, uint8_t* dst);
+
+// Returns false if the packed data is malformed or doesn't expand to exactly `size` bytes
+bool unpack(const uint8_t* src, size_t packedSize, uint8_t* dst, size_t size);
+
+}  // namespace PackBits
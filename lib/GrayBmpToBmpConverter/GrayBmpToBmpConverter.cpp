@@ -0,0 +1,351 @@
+#include "GrayBmpToBmpConverter.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Bitmap.h"
+#include "BitmapHelpers.h"
+
+// ============================================================================
+// IMAGE PROCESSING OPTIONS - Same as JpegToBmpConverter for consistency
+// ============================================================================
+constexpr bool USE_ATKINSON = true;
+constexpr bool USE_FLOYD_STEINBERG = false;
+constexpr bool USE_ORDERED_THUMBNAILS = false;
+constexpr int TARGET_MAX_WIDTH = 480;
+constexpr int TARGET_MAX_HEIGHT = 800;
+// Source rows averaged into an output row when a bitmap is fitted (bitmapToFitBmpStream); the rest are skipped
+constexpr int MAX_ROWS_PER_OUTPUT_ROW = 2;
+// ============================================================================
+
+// BMP writing helpers (same as JpegToBmpConverter)
+inline void write16(Print& out, const uint16_t value) {
+  out.write(value & 0xFF);
+  out.write((value >> 8) & 0xFF);
+}
+
+inline void write32(Print& out, const uint32_t value) {
+  out.write(value & 0xFF);
+  out.write((value >> 8) & 0xFF);
+  out.write((value >> 16) & 0xFF);
+  out.write((value >> 24) & 0xFF);
+}
+
+inline void write32Signed(Print& out, const int32_t value) {
+  out.write(value & 0xFF);
+  out.write((value >> 8) & 0xFF);
+  out.write((value >> 16) & 0xFF);
+  out.write((value >> 24) & 0xFF);
+}
+
+namespace {
+constexpr int HEADER_SIZE = 54;  // File header and BITMAPINFOHEADER
+
+inline uint32_t readLE32(const uint8_t* p) {
+  return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void writeBmpHeader1bit(FsFile& bmpOut, const int width, const int height) {
+  const int bytesPerRow = (width + 31) / 32 * 4;
+  const int imageSize = bytesPerRow * height;
+  const uint32_t fileSize = 62 + imageSize;
+  Storage.preAllocate("GBM", bmpOut, fileSize);
+
+  bmpOut.write('B');
+  bmpOut.write('M');
+  write32(bmpOut, fileSize);
+  write32(bmpOut, 0);
+  write32(bmpOut, 62);
+
+  write32(bmpOut, 40);
+  write32Signed(bmpOut, width);
+  write32Signed(bmpOut, -height);
+  write16(bmpOut, 1);
+  write16(bmpOut, 1);
+  write32(bmpOut, 0);
+  write32(bmpOut, imageSize);
+  write32(bmpOut, 2835);
+  write32(bmpOut, 2835);
+  write32(bmpOut, 2);
+  write32(bmpOut, 2);
+
+  uint8_t palette[8] = {0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00};
+  for (const uint8_t i : palette) {
+    bmpOut.write(i);
+  }
+}
+
+void writeBmpHeader2bit(FsFile& bmpOut, const int width, const int height, const bool topDown = true) {
+  const int bytesPerRow = (width * 2 + 31) / 32 * 4;
+  const int imageSize = bytesPerRow * height;
+  const uint32_t fileSize = 70 + imageSize;
+  Storage.preAllocate("GBM", bmpOut, fileSize);
+
+  bmpOut.write('B');
+  bmpOut.write('M');
+  write32(bmpOut, fileSize);
+  write32(bmpOut, 0);
+  write32(bmpOut, 70);
+
+  write32(bmpOut, 40);
+  write32Signed(bmpOut, width);
+  write32Signed(bmpOut, topDown ? -height : height);
+  write16(bmpOut, 1);
+  write16(bmpOut, 2);
+  write32(bmpOut, 0);
+  write32(bmpOut, imageSize);
+  write32(bmpOut, 2835);
+  write32(bmpOut, 2835);
+  write32(bmpOut, 4);
+  write32(bmpOut, 4);
+
+  uint8_t palette[16] = {0x00, 0x00, 0x00, 0x00, 0x55, 0x55, 0x55, 0x00,
+                         0xAA, 0xAA, 0xAA, 0x00, 0xFF, 0xFF, 0xFF, 0x00};
+  for (const uint8_t i : palette) {
+    bmpOut.write(i);
+  }
+}
+}  // namespace
+
+bool GrayBmpToBmpConverter::grayBmpToBmpStreamInternal(FsFile& grayBmp, FsFile& bmpOut, int targetWidth,
+                                                       int targetHeight, bool oneBit, bool crop) {
+  LOG_DBG("GBM", "Converting gray master to %s BMP (target: %dx%d)", oneBit ? "1-bit" : "2-bit", targetWidth,
+          targetHeight);
+
+  // The master is written by the decoders: top-down, 8 bits per pixel, uncompressed
+  uint8_t header[HEADER_SIZE];
+  if (grayBmp.read(header, HEADER_SIZE) != HEADER_SIZE || header[0] != 'B' || header[1] != 'M') {
+    LOG_ERR("GBM", "Invalid gray master header");
+    return false;
+  }
+  const uint32_t dataOffset = readLE32(header + 10);
+  const auto srcWidth = static_cast<int32_t>(readLE32(header + 18));
+  const auto srcHeight = -static_cast<int32_t>(readLE32(header + 22));
+  const uint16_t bpp = header[28] | (header[29] << 8);
+  if (bpp != 8 || readLE32(header + 30) != 0 || srcWidth <= 0 || srcHeight <= 0 || !grayBmp.seek(dataOffset)) {
+    LOG_ERR("GBM", "Gray master is not a top-down 8-bit BMP");
+    return false;
+  }
+  const int srcBytesPerRow = (srcWidth + 3) / 4 * 4;
+
+  // Output dimensions and 16.16 fixed-point scale factors (same logic as JpegToBmpConverter)
+  const float scaleToFitWidth = static_cast<float>(targetWidth) / srcWidth;
+  const float scaleToFitHeight = static_cast<float>(targetHeight) / srcHeight;
+  float scale = 1.0;
+  if (crop) {
+    scale = (scaleToFitWidth > scaleToFitHeight) ? scaleToFitWidth : scaleToFitHeight;
+  } else {
+    scale = (scaleToFitWidth < scaleToFitHeight) ? scaleToFitWidth : scaleToFitHeight;
+  }
+  int outWidth = static_cast<int>(srcWidth * scale);
+  int outHeight = static_cast<int>(srcHeight * scale);
+  if (outWidth < 1) outWidth = 1;
+  if (outHeight < 1) outHeight = 1;
+  const uint32_t scaleX_fp = (static_cast<uint32_t>(srcWidth) << 16) / outWidth;
+  const uint32_t scaleY_fp = (static_cast<uint32_t>(srcHeight) << 16) / outHeight;
+
+  LOG_DBG("GBM", "Scaling %dx%d -> %dx%d (target %dx%d)", srcWidth, srcHeight, outWidth, outHeight, targetWidth,
+          targetHeight);
+
+  int bytesPerRow;
+  if (oneBit) {
+    writeBmpHeader1bit(bmpOut, outWidth, outHeight);
+    bytesPerRow = (outWidth + 31) / 32 * 4;
+  } else {
+    writeBmpHeader2bit(bmpOut, outWidth, outHeight);
+    bytesPerRow = (outWidth * 2 + 31) / 32 * 4;
+  }
+
+  auto* rowBuffer = static_cast<uint8_t*>(malloc(bytesPerRow));
+  auto* srcRow = static_cast<uint8_t*>(malloc(srcBytesPerRow));
+  auto* scaledRow = static_cast<uint8_t*>(malloc(outWidth));
+  auto* rowAccum = static_cast<uint32_t*>(calloc(outWidth, sizeof(uint32_t)));
+  auto* rowCount = static_cast<uint16_t*>(calloc(outWidth, sizeof(uint16_t)));
+  if (!rowBuffer || !srcRow || !scaledRow || !rowAccum || !rowCount) {
+    LOG_ERR("GBM", "Failed to allocate row buffers");
+    free(rowBuffer);
+    free(srcRow);
+    free(scaledRow);
+    free(rowAccum);
+    free(rowCount);
+    return false;
+  }
+
+  using Method = BmpRowQuantizer::Method;
+  Method method = Method::Simple;
+  if (oneBit) {
+    method = USE_ORDERED_THUMBNAILS ? Method::Ordered : Method::Atkinson;
+  } else if (USE_ATKINSON) {
+    method = Method::Atkinson;
+  } else if (USE_FLOYD_STEINBERG) {
+    method = Method::FloydSteinberg;
+  }
+  BmpRowQuantizer quantizer(outWidth, oneBit, method);
+
+  bool success = true;
+  int currentOutY = 0;
+  uint32_t nextOutY_srcStart = scaleY_fp;
+
+  for (int y = 0; y < srcHeight && currentOutY < outHeight; y++) {
+    if (grayBmp.read(srcRow, srcBytesPerRow) != srcBytesPerRow) {
+      LOG_ERR("GBM", "Short read of gray master row %d", y);
+      success = false;
+      break;
+    }
+
+    // Area-averaging scaling (same as JpegToBmpConverter)
+    for (int outX = 0; outX < outWidth; outX++) {
+      const int srcXStart = (static_cast<uint32_t>(outX) * scaleX_fp) >> 16;
+      const int srcXEnd = (static_cast<uint32_t>(outX + 1) * scaleX_fp) >> 16;
+
+      int sum = 0;
+      int count = 0;
+      for (int srcX = srcXStart; srcX < srcXEnd && srcX < srcWidth; srcX++) {
+        sum += srcRow[srcX];
+        count++;
+      }
+
+      if (count == 0 && srcXStart < srcWidth) {
+        sum = srcRow[srcXStart];
+        count = 1;
+      }
+
+      rowAccum[outX] += sum;
+      rowCount[outX] += count;
+    }
+
+    // Output all rows whose boundaries we've crossed (handles both up and downscaling)
+    const uint32_t srcY_fp = static_cast<uint32_t>(y + 1) << 16;
+    while (srcY_fp >= nextOutY_srcStart && currentOutY < outHeight) {
+      memset(rowBuffer, 0, bytesPerRow);
+      for (int x = 0; x < outWidth; x++) {
+        scaledRow[x] = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
+      }
+      quantizer.processRow(scaledRow, currentOutY, rowBuffer);
+      bmpOut.write(rowBuffer, bytesPerRow);
+      currentOutY++;
+
+      nextOutY_srcStart = static_cast<uint32_t>(currentOutY + 1) * scaleY_fp;
+      // For upscaling, the next output row may still be made of the same source rows
+      if (srcY_fp >= nextOutY_srcStart) {
+        continue;
+      }
+      memset(rowAccum, 0, outWidth * sizeof(uint32_t));
+      memset(rowCount, 0, outWidth * sizeof(uint16_t));
+    }
+  }
+
+  free(rowBuffer);
+  free(srcRow);
+  free(scaledRow);
+  free(rowAccum);
+  free(rowCount);
+
+  if (success) {
+    LOG_DBG("GBM", "Successfully converted gray master to BMP");
+  }
+  return success;
+}
+
+bool GrayBmpToBmpConverter::grayBmpToBmpStream(FsFile& grayBmp, FsFile& bmpOut, bool crop) {
+  return grayBmpToBmpStreamInternal(grayBmp, bmpOut, TARGET_MAX_WIDTH, TARGET_MAX_HEIGHT, false, crop);
+}
+
+bool GrayBmpToBmpConverter::grayBmpTo1BitBmpStreamWithSize(FsFile& grayBmp, FsFile& bmpOut, int targetMaxWidth,
+                                                           int targetMaxHeight) {
+  return grayBmpToBmpStreamInternal(grayBmp, bmpOut, targetMaxWidth, targetMaxHeight, true, true);
+}
+
+// Rows are made in the bitmap's own order, so bottom-up ones are read front to back like top-down ones and their
+// rendition is bottom-up too. Each output row averages a few evenly spaced rows from its band of source rows, seeking
+// over the others: a large image costs about as many row reads as the rendition has rows.
+bool GrayBmpToBmpConverter::bitmapToFitBmpStream(const Bitmap& bitmap, FsFile& bmpOut, const int targetMaxWidth,
+                                                 const int targetMaxHeight) {
+  const int srcWidth = bitmap.getWidth();
+  const int srcHeight = bitmap.getHeight();
+  const float scale = std::min({1.0f, static_cast<float>(targetMaxWidth) / srcWidth,
+                                static_cast<float>(targetMaxHeight) / srcHeight});
+  const int outWidth = std::max(1, static_cast<int>(srcWidth * scale));
+  const int outHeight = std::max(1, static_cast<int>(srcHeight * scale));
+  const uint32_t scaleX_fp = (static_cast<uint32_t>(srcWidth) << 16) / outWidth;
+
+  LOG_DBG("GBM", "Fitting %dx%d bitmap -> %dx%d", srcWidth, srcHeight, outWidth, outHeight);
+
+  const int bytesPerRow = (outWidth * 2 + 31) / 32 * 4;
+  auto* rowBuffer = static_cast<uint8_t*>(malloc(bitmap.getRowBytes()));
+  auto* srcRow = static_cast<uint8_t*>(malloc(srcWidth));
+  auto* scaledRow = static_cast<uint8_t*>(malloc(outWidth));
+  auto* outRow = static_cast<uint8_t*>(malloc(bytesPerRow));
+  auto* rowAccum = static_cast<uint32_t*>(malloc(outWidth * sizeof(uint32_t)));
+  if (!rowBuffer || !srcRow || !scaledRow || !outRow || !rowAccum) {
+    LOG_ERR("GBM", "Failed to allocate row buffers");
+    free(rowBuffer);
+    free(srcRow);
+    free(scaledRow);
+    free(outRow);
+    free(rowAccum);
+    return false;
+  }
+
+  writeBmpHeader2bit(bmpOut, outWidth, outHeight, bitmap.isTopDown());
+  BmpRowQuantizer quantizer(outWidth, false, USE_ATKINSON ? BmpRowQuantizer::Method::Atkinson
+                                                          : BmpRowQuantizer::Method::FloydSteinberg);
+
+  bool success = true;
+  int nextRow = 0;  // Row the bitmap reads next, to seek only when rows are skipped
+  for (int outY = 0; outY < outHeight && success; outY++) {
+    const int bandStart = static_cast<int>(static_cast<int64_t>(outY) * srcHeight / outHeight);
+    const int bandEnd =
+        std::max(bandStart + 1, static_cast<int>(static_cast<int64_t>(outY + 1) * srcHeight / outHeight));
+    const int rows = std::min(MAX_ROWS_PER_OUTPUT_ROW, bandEnd - bandStart);
+
+    memset(rowAccum, 0, outWidth * sizeof(uint32_t));
+    int colStart = 0;
+    for (int i = 0; i < rows; i++) {
+      const int row = bandStart + (bandEnd - bandStart) * (2 * i + 1) / (2 * rows);
+      if ((row != nextRow && bitmap.seekToRow(row) != BmpReaderError::Ok) ||
+          bitmap.readNextRowGray(srcRow, rowBuffer) != BmpReaderError::Ok) {
+        LOG_ERR("GBM", "Failed to read bitmap row %d", row);
+        success = false;
+        break;
+      }
+      nextRow = row + 1;
+
+      // Box filter across the columns each output pixel covers
+      colStart = 0;
+      for (int outX = 0; outX < outWidth; outX++) {
+        const int colEnd = std::min(srcWidth, std::max(colStart + 1, static_cast<int>((outX + 1) * scaleX_fp >> 16)));
+        uint32_t sum = 0;
+        for (int x = colStart; x < colEnd; x++) {
+          sum += srcRow[x];
+        }
+        rowAccum[outX] += sum / (colEnd - colStart);
+        colStart = colEnd;
+      }
+    }
+    if (!success) {
+      break;
+    }
+
+    for (int x = 0; x < outWidth; x++) {
+      scaledRow[x] = static_cast<uint8_t>(rowAccum[x] / rows);
+    }
+    memset(outRow, 0, bytesPerRow);
+    quantizer.processRow(scaledRow, outY, outRow);
+    if (bmpOut.write(outRow, bytesPerRow) != static_cast<size_t>(bytesPerRow)) {
+      LOG_ERR("GBM", "Failed to write fitted row %d", outY);
+      success = false;
+    }
+  }
+
+  free(rowBuffer);
+  free(srcRow);
+  free(scaledRow);
+  free(outRow);
+  free(rowAccum);
+  return success;
+}
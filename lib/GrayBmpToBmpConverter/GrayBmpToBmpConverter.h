@@ -0,0 +1,21 @@
+#pragma once
+
+class Bitmap;
+class FsFile;
+
+// Produces cover variants from the 8-bit grayscale master the image decoders write once per book
+// (JpegToBmpConverter::jpegFileToGrayMasterStream, PngToBmpConverter::pngFileToGrayMasterStream). Each variant is
+// an area-averaged resampling of the master, dithered like a direct conversion, so no variant decodes the image again.
+class GrayBmpToBmpConverter {
+  static bool grayBmpToBmpStreamInternal(FsFile& grayBmp, FsFile& bmpOut, int targetWidth, int targetHeight,
+                                         bool oneBit, bool crop);
+
+ public:
+  // 2-bit BMP at the default target size, as JpegToBmpConverter::jpegFileToBmpStream
+  static bool grayBmpToBmpStream(FsFile& grayBmp, FsFile& bmpOut, bool crop = true);
+  // 1-bit BMP filling the target size, as JpegToBmpConverter::jpegFileTo1BitBmpStreamWithSize
+  static bool grayBmpTo1BitBmpStreamWithSize(FsFile& grayBmp, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  // 2-bit BMP of a parsed bitmap of any depth, shrunk to fit the target size (never enlarged), for showing a large
+  // image at screen size without reading all of it. The bitmap is left positioned anywhere in its rows.
+  static bool bitmapToFitBmpStream(const Bitmap& bitmap, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
+};
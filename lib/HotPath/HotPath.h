@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+Define HOT_PATH_IN_IRAM=1 (the "iram" environment in platformio.ini does) to run the glyph, inflate and line breaking
+hot paths from IRAM and keep copies of the small font tables they read in DRAM. Code and const data otherwise run
+from flash through the cache, which the UI code competes for, and a miss costs tens of cycles.
+
+On the ESP32-C3 IRAM and DRAM share the same SRAM, so every byte of code moved there comes off the heap: compare the
+benchmark results of both environments (heap_total included) before turning it on for a release.
+
+    HOT_CODE void drawPixel(...);   // in IRAM with the flag, in flash without
+
+Inline functions (utf8NextCodepoint and the like) take no attribute, they go wherever their caller does. Host builds
+always leave everything in place.
+*/
+
+#ifndef HOT_PATH_IN_IRAM
+#define HOT_PATH_IN_IRAM 0
+#endif
+
+#if HOT_PATH_IN_IRAM && defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define HOT_CODE IRAM_ATTR
+#else
+#undef HOT_PATH_IN_IRAM
+#define HOT_PATH_IN_IRAM 0
+#define HOT_CODE
+#endif
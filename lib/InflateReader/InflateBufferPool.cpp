@@ -0,0 +1,97 @@
+#include "InflateBufferPool.h"
+
+#include <Logging.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// Each buffer is allocated by whoever first holds its flag and kept from then on
+uint8_t* pooledWindow = nullptr;
+std::atomic<bool> windowInUse{false};
+uint8_t* pooledChunks[InflateBufferPool::CHUNK_COUNT] = {};
+std::atomic<bool> chunkInUse[InflateBufferPool::CHUNK_COUNT] = {};
+}  // namespace
+
+bool InflateWindowLease::acquire() {
+  release();
+
+  if (!windowInUse.exchange(true)) {
+    if (!pooledWindow) {
+      pooledWindow = static_cast<uint8_t*>(malloc(InflateBufferPool::WINDOW_SIZE));
+    }
+    if (pooledWindow) {
+      buffer = pooledWindow;
+      pooled = true;
+    } else {
+      windowInUse = false;
+    }
+  }
+  if (!buffer) {
+    // Pooled window already leased (or never allocatable): fall back to one of our own
+    buffer = static_cast<uint8_t*>(malloc(InflateBufferPool::WINDOW_SIZE));
+  }
+  if (!buffer) {
+    LOG_ERR("INF", "Inflate window busy and no memory for another");
+    return false;
+  }
+  // Back-references must not see a previous stream's data
+  memset(buffer, 0, InflateBufferPool::WINDOW_SIZE);
+  return true;
+}
+
+void InflateWindowLease::release() {
+  if (!buffer) {
+    return;
+  }
+  if (pooled) {
+    windowInUse = false;
+  } else {
+    free(buffer);
+  }
+  buffer = nullptr;
+  pooled = false;
+}
+
+bool ChunkBufferLease::acquire(const size_t size) {
+  release();
+
+  if (size <= InflateBufferPool::CHUNK_SIZE) {
+    for (int i = 0; i < InflateBufferPool::CHUNK_COUNT && !buffer; i++) {
+      if (chunkInUse[i].exchange(true)) {
+        continue;
+      }
+      if (!pooledChunks[i]) {
+        pooledChunks[i] = static_cast<uint8_t*>(malloc(InflateBufferPool::CHUNK_SIZE));
+      }
+      if (pooledChunks[i]) {
+        buffer = pooledChunks[i];
+        poolSlot = i;
+      } else {
+        chunkInUse[i] = false;
+      }
+    }
+  }
+  if (!buffer) {
+    buffer = static_cast<uint8_t*>(malloc(size));
+  }
+  if (!buffer) {
+    LOG_ERR("INF", "No buffer free for a %zu byte chunk", size);
+    return false;
+  }
+  return true;
+}
+
+void ChunkBufferLease::release() {
+  if (!buffer) {
+    return;
+  }
+  if (poolSlot >= 0) {
+    chunkInUse[poolSlot] = false;
+  } else {
+    free(buffer);
+  }
+  buffer = nullptr;
+  poolSlot = -1;
+}
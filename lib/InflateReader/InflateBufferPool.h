@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Long-lived buffers for deflate decoding, shared by everything that inflates (ZIP entries, PNG covers).
+//
+// The 32KB window and the I/O chunk buffers are allocated on first use and then kept, instead of being malloc'd and
+// freed for every entry, which costs time and fragments a heap without PSRAM. A lease whose pooled buffer is already
+// out (nested inflates, or the other task) gets a private allocation instead. A lease that can't get memory at all
+// comes back empty: callers treat that as "busy", fail the operation cleanly and let it be retried later.
+namespace InflateBufferPool {
+constexpr size_t WINDOW_SIZE = 32768;
+// Requests up to this size are served from the pooled chunks
+constexpr size_t CHUNK_SIZE = 4096;
+constexpr int CHUNK_COUNT = 2;
+}  // namespace InflateBufferPool
+
+// The inflate window (back-reference ring buffer). Empty until acquire() succeeds; released on destruction.
+class InflateWindowLease {
+ public:
+  InflateWindowLease() = default;
+  ~InflateWindowLease() { release(); }
+  InflateWindowLease(const InflateWindowLease&) = delete;
+  InflateWindowLease& operator=(const InflateWindowLease&) = delete;
+
+  bool acquire();
+  void release();
+  uint8_t* get() const { return buffer; }
+  explicit operator bool() const { return buffer != nullptr; }
+
+ private:
+  uint8_t* buffer = nullptr;
+  bool pooled = false;
+};
+
+// An I/O buffer of at least `size` bytes. Empty until acquire() succeeds; released on destruction.
+class ChunkBufferLease {
+ public:
+  ChunkBufferLease() = default;
+  ~ChunkBufferLease() { release(); }
+  ChunkBufferLease(const ChunkBufferLease&) = delete;
+  ChunkBufferLease& operator=(const ChunkBufferLease&) = delete;
+
+  bool acquire(size_t size);
+  void release();
+  uint8_t* get() const { return buffer; }
+  explicit operator bool() const { return buffer != nullptr; }
+
+ private:
+  uint8_t* buffer = nullptr;
+  int poolSlot = -1;
+};
@@ -1,12 +1,10 @@
 #include "InflateReader.h"
 
+#include <Trace.h>
+
 #include <cstring>
 #include <type_traits>
 
-namespace {
-constexpr size_t INFLATE_DICT_SIZE = 32768;
-}
-
 // Guarantee the cast pattern in the header comment is valid.
 static_assert(std::is_standard_layout<InflateReader>::value,
               "InflateReader must be standard-layout for the uzlib callback cast to work");
@@ -14,23 +12,18 @@ static_assert(std::is_standard_layout<InflateReader>::value,
 InflateReader::~InflateReader() { deinit(); }
 
 bool InflateReader::init(const bool streaming) {
-  deinit();  // free any previously allocated ring buffer and reset state
+  deinit();  // return any previously leased window and reset state
 
-  if (streaming) {
-    ringBuffer = static_cast<uint8_t*>(malloc(INFLATE_DICT_SIZE));
-    if (!ringBuffer) return false;
-    memset(ringBuffer, 0, INFLATE_DICT_SIZE);
+  if (streaming && !window.acquire()) {
+    return false;
   }
 
-  uzlib_uncompress_init(&decomp, ringBuffer, ringBuffer ? INFLATE_DICT_SIZE : 0);
+  uzlib_uncompress_init(&decomp, window.get(), window ? InflateBufferPool::WINDOW_SIZE : 0);
   return true;
 }
 
 void InflateReader::deinit() {
-  if (ringBuffer) {
-    free(ringBuffer);
-    ringBuffer = nullptr;
-  }
+  window.release();
   memset(&decomp, 0, sizeof(decomp));
 }
 
@@ -47,7 +40,7 @@ void InflateReader::skipZlibHeader() {
 }
 
 bool InflateReader::read(uint8_t* dest, size_t len) {
-  if (!ringBuffer) {
+  if (!window) {
     // One-shot mode: back-references use absolute offset from dest_start.
     // Valid only when read() is called once with the full output buffer.
     decomp.dest_start = dest;
@@ -55,13 +48,14 @@ bool InflateReader::read(uint8_t* dest, size_t len) {
   decomp.dest = dest;
   decomp.dest_limit = dest + len;
 
+  TRACE_SCOPE(Inflate, len);
   const int res = uzlib_uncompress(&decomp);
   if (res < 0) return false;
   return decomp.dest == decomp.dest_limit;
 }
 
 InflateStatus InflateReader::readAtMost(uint8_t* dest, size_t maxLen, size_t* produced) {
-  if (!ringBuffer) {
+  if (!window) {
     // One-shot mode: back-references use absolute offset from dest_start.
     // Valid only when readAtMost() is called once with the full output buffer.
     decomp.dest_start = dest;
@@ -69,6 +63,7 @@ InflateStatus InflateReader::readAtMost(uint8_t* dest, size_t maxLen, size_t* pr
   decomp.dest = dest;
   decomp.dest_limit = dest + maxLen;
 
+  TRACE_SCOPE(Inflate, maxLen);
   const int res = uzlib_uncompress(&decomp);
   *produced = static_cast<size_t>(decomp.dest - dest);
 
@@ -4,6 +4,8 @@
 
 #include <cstddef>
 
+#include "InflateBufferPool.h"
+
 // Return value for readAtMost().
 enum class InflateStatus {
   Ok,     // Output buffer full; more compressed data remains.
@@ -15,8 +17,8 @@ enum class InflateStatus {
 //
 // Two modes:
 //   init(false)  — one-shot: input is a contiguous buffer, call read() once.
-//   init(true)   — streaming: allocates a 32KB ring buffer for back-references
-//                  across multiple read() / readAtMost() calls.
+//   init(true)   — streaming: leases the shared 32KB window (InflateBufferPool)
+//                  for back-references across multiple read() / readAtMost() calls.
 //
 // Streaming callback pattern:
 //   The uzlib read callback receives a `struct uzlib_uncomp*` with no separate
@@ -44,12 +46,12 @@ class InflateReader {
   InflateReader(const InflateReader&) = delete;
   InflateReader& operator=(const InflateReader&) = delete;
 
-  // Initialise decompressor. streaming=true allocates a 32KB ring buffer needed
+  // Initialise decompressor. streaming=true leases the 32KB window needed
   // when read() or readAtMost() will be called multiple times.
-  // Returns false only in streaming mode if the ring buffer allocation fails.
+  // Returns false only in streaming mode if no window is available (busy, retry later).
   bool init(bool streaming = false);
 
-  // Release the ring buffer and reset internal state.
+  // Return the window and reset internal state.
   void deinit();
 
   // Set the entire compressed input as a contiguous memory buffer.
@@ -81,5 +83,5 @@ class InflateReader {
 
  private:
   uzlib_uncomp decomp = {};
-  uint8_t* ringBuffer = nullptr;
+  InflateWindowLease window;
 };
@@ -1,19 +1,22 @@
 #pragma once
 
 class FsFile;
-class Print;
 class ZipFile;
 
 class JpegToBmpConverter {
   static unsigned char jpegReadCallback(unsigned char* pBuf, unsigned char buf_size,
                                         unsigned char* pBytes_actually_read, void* pCallback_data);
-  static bool jpegFileToBmpStreamInternal(class FsFile& jpegFile, Print& bmpOut, int targetWidth, int targetHeight,
-                                          bool oneBit, bool crop = true);
+  static bool jpegFileToBmpStreamInternal(class FsFile& jpegFile, FsFile& bmpOut, int targetWidth, int targetHeight,
+                                          bool oneBit, bool crop = true, bool grayMaster = false);
 
  public:
-  static bool jpegFileToBmpStream(FsFile& jpegFile, Print& bmpOut, bool crop = true);
+  static bool jpegFileToBmpStream(FsFile& jpegFile, FsFile& bmpOut, bool crop = true);
   // Convert with custom target size (for thumbnails)
-  static bool jpegFileToBmpStreamWithSize(FsFile& jpegFile, Print& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  static bool jpegFileToBmpStreamWithSize(FsFile& jpegFile, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
   // Convert to 1-bit BMP (black and white only, no grays) for fast home screen rendering
-  static bool jpegFileTo1BitBmpStreamWithSize(FsFile& jpegFile, Print& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  static bool jpegFileTo1BitBmpStreamWithSize(FsFile& jpegFile, FsFile& bmpOut, int targetMaxWidth,
+                                              int targetMaxHeight);
+  // Convert to an 8-bit grayscale BMP of the decoded gray levels, scaled down to fill the target size, as the master
+  // the cover variants are resampled from (see GrayBmpToBmpConverter)
+  static bool jpegFileToGrayMasterStream(FsFile& jpegFile, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
 };
@@ -0,0 +1,292 @@
+#include "ChapterXPointer.h"
+
+#include <Epub/parsers/ChapterTokenizer.h>
+#include <Logging.h>
+#include <ZipFile.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr size_t SCAN_BUFFER_SIZE = 1024;
+// Their text has no text positions (ChapterHtmlSlimParser leaves it out too)
+constexpr const char* RAW_TEXT_TAGS[] = {"head", "script", "style"};
+
+bool isWhitespace(const char c) { return c == ' ' || c == '\r' || c == '\n' || c == '\t'; }
+bool isContinuationByte(const char c) { return (static_cast<uint8_t>(c) & 0xC0) == 0x80; }
+
+// One step of an xpointer: an element by name and index among its same-named siblings, or with textIndex set the
+// textIndex-th text node of the previous step's element and a character offset in it
+struct Step {
+  std::string name;
+  int index = 1;
+  int textIndex = 0;
+  int offset = 0;
+};
+
+// "name", "name[3]", "text()[2].14" or "p[5].0" (an offset on an element points at its start)
+bool parseStep(const std::string& token, Step& step) {
+  std::string head = token;
+  const size_t dot = token.find('.');
+  if (dot != std::string::npos) {
+    step.offset = atoi(token.c_str() + dot + 1);
+    head = token.substr(0, dot);
+  }
+  const size_t bracket = head.find('[');
+  step.name = head.substr(0, bracket);
+  if (bracket != std::string::npos) {
+    step.index = atoi(head.c_str() + bracket + 1);
+  }
+  if (step.name == "text()") {
+    step.textIndex = step.index;
+  }
+  return !step.name.empty() && step.index > 0;
+}
+
+bool parseXPointer(const std::string& xpointer, std::vector<Step>& steps) {
+  size_t start = 0;
+  while (start < xpointer.size()) {
+    if (xpointer[start] != '/') {
+      return false;
+    }
+    const size_t end = std::min(xpointer.find('/', start + 1), xpointer.size());
+    Step step;
+    if (!parseStep(xpointer.substr(start + 1, end - start - 1), step)) {
+      return false;
+    }
+    // Only the last step may be a text node
+    if (!steps.empty() && steps.back().textIndex > 0) {
+      return false;
+    }
+    steps.push_back(std::move(step));
+    start = end;
+  }
+  return !steps.empty() && steps[0].name == "body" && steps[0].textIndex == 0;
+}
+
+// Tokenizer handlers for one conversion. Keeps the open elements from body down with their sibling counts, and
+// counts text positions the way the section builder does.
+class XPointerScanner {
+ public:
+  std::unique_ptr<ChapterTokenizer> tokenizer;
+  bool done = false;
+
+  // fromTextPosition(): stop at the character at position and describe where it is
+  uint32_t targetPosition = UINT32_MAX;
+  std::string xpointer;
+
+  // toTextPosition(): stop at the place steps lead to and take its position
+  std::vector<Step> steps;
+  uint32_t foundPosition = 0;
+
+  static void startElement(void* userData, const char* name, const char** /*atts*/) {
+    auto* self = static_cast<XPointerScanner*>(userData);
+    self->depth++;
+    self->endTextRun();
+    if (self->rawDepth > 0) {
+      return;
+    }
+    for (const char* rawTag : RAW_TEXT_TAGS) {
+      if (strcmp(name, rawTag) == 0) {
+        self->rawDepth = self->depth;
+        self->tokenizer->skipElementContent(name);
+        return;
+      }
+    }
+    if (self->frames.empty()) {
+      if (strcmp(name, "body") == 0) {
+        self->frames.push_back({name, 1, {}, 0});
+        self->matchStep();
+      }
+      return;
+    }
+    Frame& parent = self->frames.back();
+    uint16_t index = 1;
+    bool counted = false;
+    for (auto& [childName, count] : parent.childCounts) {
+      if (childName == name) {
+        index = ++count;
+        counted = true;
+        break;
+      }
+    }
+    if (!counted) {
+      parent.childCounts.emplace_back(name, 1);
+    }
+    self->frames.push_back({name, index, {}, 0});
+    self->matchStep();
+  }
+
+  static void endElement(void* userData, const char* /*name*/) {
+    auto* self = static_cast<XPointerScanner*>(userData);
+    self->endTextRun();
+    if (self->rawDepth == self->depth) {
+      self->rawDepth = 0;
+    } else if (self->rawDepth == 0 && !self->frames.empty()) {
+      // Leaving the element the xpointer points into without finding its text node: take where its text ends
+      if (!self->steps.empty() && self->steps.back().textIndex > 0 &&
+          self->matched == static_cast<int>(self->frames.size()) &&
+          self->matched == static_cast<int>(self->steps.size()) - 1) {
+        self->finish();
+      }
+      if (self->matched == static_cast<int>(self->frames.size())) {
+        self->matched--;
+      }
+      self->frames.pop_back();
+    }
+    self->depth--;
+  }
+
+  static void characterData(void* userData, const char* s, const int len) {
+    auto* self = static_cast<XPointerScanner*>(userData);
+    if (self->rawDepth > 0) {
+      return;
+    }
+    for (int i = 0; i < len && !self->done; i++) {
+      const bool whitespace = isWhitespace(s[i]);
+      if (!whitespace && !self->textRunCounted && !self->frames.empty()) {
+        self->textRunCounted = true;
+        self->frames.back().textNodes++;
+      }
+      const bool startsCharacter = !isContinuationByte(s[i]);
+      if (startsCharacter && self->inTargetTextNode() && self->textRunChars >= self->steps.back().offset) {
+        self->finish();
+        return;
+      }
+      if (!whitespace) {
+        if (self->position == self->targetPosition && !self->frames.empty()) {
+          self->describe();
+          return;
+        }
+        self->position++;
+      }
+      self->textRunChars += startsCharacter;
+    }
+  }
+
+ private:
+  struct Frame {
+    std::string name;
+    uint16_t index;
+    std::vector<std::pair<std::string, uint16_t>> childCounts;
+    uint16_t textNodes;
+  };
+
+  std::vector<Frame> frames;
+  int depth = 0;
+  int rawDepth = 0;  // Depth of the head, script or style element being skipped, 0 if none
+  uint32_t position = 0;
+  // The text since the last tag: whether it's a text node of its own yet, and its characters so far
+  bool textRunCounted = false;
+  int textRunChars = 0;
+  // How many of the open frames, from body, are the elements steps names
+  int matched = 0;
+
+  void endTextRun() {
+    // The text node the xpointer names is shorter than its offset: take where it ends
+    if (inTargetTextNode()) {
+      finish();
+    }
+    textRunCounted = false;
+    textRunChars = 0;
+  }
+
+  void matchStep() {
+    const int level = static_cast<int>(frames.size()) - 1;
+    if (done || matched != level || level >= static_cast<int>(steps.size())) {
+      return;
+    }
+    const Step& step = steps[level];
+    if (step.textIndex == 0 && step.name == frames.back().name && step.index == frames.back().index) {
+      matched++;
+      if (matched == static_cast<int>(steps.size())) {
+        finish();
+      }
+    }
+  }
+
+  bool inTargetTextNode() const {
+    return !done && !steps.empty() && steps.back().textIndex > 0 && textRunCounted &&
+           matched == static_cast<int>(steps.size()) - 1 && matched == static_cast<int>(frames.size()) &&
+           frames.back().textNodes == steps.back().textIndex;
+  }
+
+  void finish() {
+    foundPosition = position;
+    done = true;
+  }
+
+  void describe() {
+    xpointer.clear();
+    for (size_t i = 0; i < frames.size(); i++) {
+      xpointer += "/" + frames[i].name;
+      if (i > 0) {
+        xpointer += "[" + std::to_string(frames[i].index) + "]";
+      }
+    }
+    xpointer += "/text()";
+    if (frames.back().textNodes > 1) {
+      xpointer += "[" + std::to_string(frames.back().textNodes) + "]";
+    }
+    xpointer += "." + std::to_string(textRunChars);
+    done = true;
+  }
+};
+
+bool scan(const Epub& epub, const int spineIndex, XPointerScanner& scanner) {
+  if (spineIndex < 0 || spineIndex >= epub.getSpineItemsCount()) {
+    return false;
+  }
+  auto source = epub.openItemStream(epub.getSpineItem(spineIndex).href, SCAN_BUFFER_SIZE);
+  if (!source) {
+    LOG_ERR("KXP", "Failed to open spine item %d", spineIndex);
+    return false;
+  }
+  scanner.tokenizer = ChapterTokenizer::create(
+      false, {&scanner, XPointerScanner::startElement, XPointerScanner::endElement, XPointerScanner::characterData});
+  if (!scanner.tokenizer) {
+    return false;
+  }
+  while (!scanner.done) {
+    char* const buffer = scanner.tokenizer->getBuffer(SCAN_BUFFER_SIZE);
+    const int len = buffer ? source->readEntryStream(reinterpret_cast<uint8_t*>(buffer), SCAN_BUFFER_SIZE) : -1;
+    if (len < 0) {
+      LOG_ERR("KXP", "Failed to read spine item %d", spineIndex);
+      break;
+    }
+    if (!scanner.tokenizer->parseBuffer(len, len == 0)) {
+      LOG_DBG("KXP", "Parse error in spine item %d at line %lu", spineIndex, scanner.tokenizer->getCurrentLine());
+      break;
+    }
+    if (len == 0) {
+      break;
+    }
+  }
+  scanner.tokenizer.reset();
+  return scanner.done;
+}
+}  // namespace
+
+bool ChapterXPointer::fromTextPosition(const Epub& epub, const int spineIndex, const uint32_t position,
+                                       std::string& xpointer) {
+  XPointerScanner scanner;
+  scanner.targetPosition = position;
+  if (!scan(epub, spineIndex, scanner)) {
+    return false;
+  }
+  xpointer = std::move(scanner.xpointer);
+  return true;
+}
+
+bool ChapterXPointer::toTextPosition(const Epub& epub, const int spineIndex, const std::string& xpointer,
+                                     uint32_t& position) {
+  XPointerScanner scanner;
+  if (!parseXPointer(xpointer, scanner.steps) || !scan(epub, spineIndex, scanner)) {
+    return false;
+  }
+  position = scanner.foundPosition;
+  return true;
+}
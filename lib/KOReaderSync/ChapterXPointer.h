@@ -0,0 +1,31 @@
+#pragma once
+#include <Epub.h>
+
+#include <cstdint>
+#include <string>
+
+/**
+ * KOReader (CREngine) xpointers within a spine item, e.g. "/body/div[2]/p[5]/text().12", to and from the text
+ * positions sections record for their pages (Section::getPageTextPosition).
+ *
+ * An xpointer here is the part after "/body/DocFragment[N]". Elements are numbered among their siblings of the same
+ * name from 1, text nodes among those of their element that aren't only whitespace, and the offset after the dot
+ * counts characters from the start of the text node. Each conversion streams the item's XHTML once, without layout.
+ */
+class ChapterXPointer {
+ public:
+  /**
+   * Xpointer of the character at a text position.
+   *
+   * @return false if the item can't be read or its text ends before position
+   */
+  static bool fromTextPosition(const Epub& epub, int spineIndex, uint32_t position, std::string& xpointer);
+
+  /**
+   * Text position of the place an xpointer points to: the character at its offset, or for an element the start of
+   * its text.
+   *
+   * @return false if the item can't be read or has no such element
+   */
+  static bool toTextPosition(const Epub& epub, int spineIndex, const std::string& xpointer, uint32_t& position);
+};
@@ -34,6 +34,13 @@ void legacyDeobfuscate(std::string& data) {
 }
 }  // namespace
 
+KOReaderCredentialStore& KOReaderCredentialStore::getInstance() {
+  // A function-local static is initialized exactly once, even when the loop and render tasks get here together
+  static const bool loaded = (instance.loadFromFile(), true);
+  (void)loaded;
+  return instance;
+}
+
 bool KOReaderCredentialStore::saveToFile() const {
   Storage.mkdir("/.crosspoint");
   return JsonSettingsIO::saveKOReader(*this, KOREADER_FILE_JSON);
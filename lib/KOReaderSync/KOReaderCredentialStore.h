@@ -27,6 +27,7 @@ class KOReaderCredentialStore {
   std::string password;
   std::string serverUrl;                                            // Custom sync server URL (empty = default)
   DocumentMatchMethod matchMethod = DocumentMatchMethod::FILENAME;  // Default to filename for compatibility
+  bool autoSync = false;                                            // Queue positions on close, sent when WiFi is up
 
   // Private constructor for singleton
   KOReaderCredentialStore() = default;
@@ -41,8 +42,8 @@ class KOReaderCredentialStore {
   KOReaderCredentialStore(const KOReaderCredentialStore&) = delete;
   KOReaderCredentialStore& operator=(const KOReaderCredentialStore&) = delete;
 
-  // Get singleton instance
-  static KOReaderCredentialStore& getInstance() { return instance; }
+  // Get singleton instance, read from SD on first use since most sessions never touch sync
+  static KOReaderCredentialStore& getInstance();
 
   // Save/load from SD card
   bool saveToFile() const;
@@ -72,6 +73,10 @@ class KOReaderCredentialStore {
   // Document matching method
   void setMatchMethod(DocumentMatchMethod method);
   DocumentMatchMethod getMatchMethod() const { return matchMethod; }
+
+  // Automatic progress sync
+  void setAutoSync(bool enabled) { autoSync = enabled; }
+  bool isAutoSync() const { return autoSync; }
 };
 
 // Helper macro to access credential store
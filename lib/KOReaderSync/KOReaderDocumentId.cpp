@@ -3,8 +3,31 @@
 #include <HalStorage.h>
 #include <Logging.h>
 #include <MD5Builder.h>
+#include <Serialization.h>
 
 namespace {
+constexpr char CACHE_FILE[] = "/kosync_id.bin";
+constexpr uint8_t CACHE_VERSION = 1;
+constexpr size_t HASH_LENGTH = 32;
+
+// What the cached hash was calculated for: it's recalculated when the file is replaced or written
+struct FileStamp {
+  uint32_t size = 0;
+  uint16_t date = 0;
+  uint16_t time = 0;
+
+  bool operator==(const FileStamp& other) const {
+    return size == other.size && date == other.date && time == other.time;
+  }
+};
+
+FileStamp stampOf(FsFile& file) {
+  FileStamp stamp;
+  stamp.size = file.fileSize();
+  file.getModifyDateTime(&stamp.date, &stamp.time);
+  return stamp;
+}
+
 // Extract filename from path (everything after last '/')
 std::string getFilename(const std::string& path) {
   const size_t pos = path.rfind('/');
@@ -94,3 +117,47 @@ std::string KOReaderDocumentId::calculate(const std::string& filePath) {
 
   return result;
 }
+
+std::string KOReaderDocumentId::calculate(const std::string& filePath, const std::string& cacheDir) {
+  FsFile file;
+  if (!Storage.openFileForRead("KODoc", filePath, file)) {
+    LOG_DBG("KODoc", "Failed to open file: %s", filePath.c_str());
+    return "";
+  }
+  const FileStamp stamp = stampOf(file);
+  file.close();
+
+  const std::string cachePath = cacheDir + CACHE_FILE;
+  FsFile cache;
+  if (Storage.exists(cachePath.c_str()) && Storage.openFileForRead("KODoc", cachePath, cache)) {
+    uint8_t version = 0;
+    FileStamp cachedStamp;
+    std::string cachedHash;
+    serialization::readPod(cache, version);
+    serialization::readPod(cache, cachedStamp.size);
+    serialization::readPod(cache, cachedStamp.date);
+    serialization::readPod(cache, cachedStamp.time);
+    if (version == CACHE_VERSION && cachedStamp == stamp) {
+      serialization::readString(cache, cachedHash);
+    }
+    cache.close();
+    if (cachedHash.size() == HASH_LENGTH) {
+      LOG_DBG("KODoc", "Cached hash: %s", cachedHash.c_str());
+      return cachedHash;
+    }
+  }
+
+  std::string result = calculate(filePath);
+  if (result.size() == HASH_LENGTH) {
+    Storage.mkdir(cacheDir.c_str());
+    if (Storage.openFileForWrite("KODoc", cachePath, cache)) {
+      serialization::writePod(cache, CACHE_VERSION);
+      serialization::writePod(cache, stamp.size);
+      serialization::writePod(cache, stamp.date);
+      serialization::writePod(cache, stamp.time);
+      serialization::writeString(cache, result);
+      cache.close();
+    }
+  }
+  return result;
+}
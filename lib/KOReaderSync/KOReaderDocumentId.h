@@ -24,6 +24,16 @@ class KOReaderDocumentId {
    */
   static std::string calculate(const std::string& filePath);
 
+  /**
+   * Same as calculate(), but the hash is kept in the book's cache directory and reused while the file's size and
+   * modification time stay the same.
+   *
+   * @param filePath Path to the file (typically an EPUB)
+   * @param cacheDir The book's cache directory
+   * @return 32-character lowercase hex string, or empty string on failure
+   */
+  static std::string calculate(const std::string& filePath, const std::string& cacheDir);
+
   /**
    * Calculate document hash from filename only (filename-based sync mode).
    * This is simpler and works when files have the same name across devices.
@@ -3,6 +3,13 @@
 #include <Logging.h>
 
 #include <cmath>
+#include <cstdlib>
+
+#include "ChapterXPointer.h"
+
+namespace {
+constexpr char DOC_FRAGMENT_PREFIX[] = "/body/DocFragment[";
+}  // namespace
 
 KOReaderPosition ProgressMapper::toKOReader(const std::shared_ptr<Epub>& epub, const CrossPointPosition& pos) {
   KOReaderPosition result;
@@ -16,8 +23,7 @@ KOReaderPosition ProgressMapper::toKOReader(const std::shared_ptr<Epub>& epub, c
   // Calculate overall book progress (0.0-1.0)
   result.percentage = epub->calculateProgress(pos.spineIndex, intraSpineProgress);
 
-  // Generate XPath with estimated paragraph position based on page
-  result.xpath = generateXPath(pos.spineIndex, pos.pageNumber, pos.totalPages);
+  result.xpath = generateXPath(*epub, pos);
 
   // Get chapter info for logging
   const int tocIndex = epub->getTocIndexForSpineIndex(pos.spineIndex);
@@ -100,15 +106,49 @@ CrossPointPosition ProgressMapper::toCrossPoint(const std::shared_ptr<Epub>& epu
     }
   }
 
-  LOG_DBG("ProgressMapper", "KOReader -> CrossPoint: %.2f%% at %s -> spine=%d, page=%d", koPos.percentage * 100,
-          koPos.xpath.c_str(), result.spineIndex, result.pageNumber);
+  // An xpointer below the DocFragment's body names the exact place, which the reader finds among the pages of its
+  // layout
+  int xpathSpineIndex = 0;
+  std::string xpointer;
+  uint32_t textPosition = 0;
+  if (parseXPath(koPos.xpath, xpathSpineIndex, xpointer) && xpathSpineIndex < spineCount && xpointer != "/body" &&
+      ChapterXPointer::toTextPosition(*epub, xpathSpineIndex, xpointer, textPosition)) {
+    if (xpathSpineIndex != result.spineIndex) {
+      result.spineIndex = xpathSpineIndex;
+      result.pageNumber = 0;
+    }
+    result.textPosition = textPosition;
+  }
+
+  LOG_DBG("ProgressMapper", "KOReader -> CrossPoint: %.2f%% at %s -> spine=%d, page=%d, text position %u",
+          koPos.percentage * 100, koPos.xpath.c_str(), result.spineIndex, result.pageNumber,
+          static_cast<unsigned>(result.textPosition));
 
   return result;
 }
 
-std::string ProgressMapper::generateXPath(int spineIndex, int pageNumber, int totalPages) {
-  // Use 0-based DocFragment indices for KOReader
-  // Use a simple xpath pointing to the DocFragment - KOReader will use the percentage for fine positioning within it
-  // Avoid specifying paragraph numbers as they may not exist in the target document
-  return "/body/DocFragment[" + std::to_string(spineIndex) + "]/body";
+std::string ProgressMapper::generateXPath(const Epub& epub, const CrossPointPosition& pos) {
+  // DocFragment indices count spine items from 1, like every index in an XPath
+  const std::string docFragment = DOC_FRAGMENT_PREFIX + std::to_string(pos.spineIndex + 1) + "]";
+  std::string xpointer;
+  if (pos.textPosition != CrossPointPosition::NO_TEXT_POSITION &&
+      ChapterXPointer::fromTextPosition(epub, pos.spineIndex, pos.textPosition, xpointer)) {
+    return docFragment + xpointer;
+  }
+  // KOReader uses the percentage for fine positioning within the DocFragment
+  return docFragment + "/body";
+}
+
+bool ProgressMapper::parseXPath(const std::string& xpath, int& spineIndex, std::string& rest) {
+  constexpr size_t prefixLength = sizeof(DOC_FRAGMENT_PREFIX) - 1;
+  if (xpath.compare(0, prefixLength, DOC_FRAGMENT_PREFIX) != 0) {
+    return false;
+  }
+  const size_t close = xpath.find(']', prefixLength);
+  if (close == std::string::npos) {
+    return false;
+  }
+  spineIndex = atoi(xpath.c_str() + prefixLength) - 1;
+  rest = xpath.substr(close + 1);
+  return spineIndex >= 0;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <Epub.h>
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -8,9 +9,14 @@
  * CrossPoint position representation.
  */
 struct CrossPointPosition {
+  static constexpr uint32_t NO_TEXT_POSITION = UINT32_MAX;
+
   int spineIndex;  // Current spine item (chapter) index
   int pageNumber;  // Current page within the spine item
   int totalPages;  // Total pages in the current spine item
+  // Text position of the page's start in the spine item (Section::getPageTextPosition), which pins the page down
+  // exactly; NO_TEXT_POSITION if not known
+  uint32_t textPosition = NO_TEXT_POSITION;
 };
 
 /**
@@ -27,9 +33,11 @@ struct KOReaderPosition {
  * CrossPoint tracks position as (spineIndex, pageNumber).
  * KOReader uses XPath-like strings + percentage.
  *
- * Since CrossPoint discards HTML structure during parsing, we generate
- * synthetic XPath strings based on spine index, using percentage as the
- * primary sync mechanism.
+ * When the position's text position is known, the XPath is a real xpointer
+ * to the first character of the page (ChapterXPointer), and one received is
+ * turned back into a text position, which the reader resolves to the page
+ * holding it. Otherwise the XPath only names the spine item and percentage
+ * does the positioning.
  */
 class ProgressMapper {
  public:
@@ -46,7 +54,8 @@ class ProgressMapper {
    * Convert KOReader position to CrossPoint format.
    *
    * Note: The returned pageNumber may be approximate since different
-   * rendering settings produce different page counts.
+   * rendering settings produce different page counts. When the xpointer
+   * resolves, textPosition is set and spineIndex is the one it names.
    *
    * @param epub The EPUB book
    * @param koPos KOReader position
@@ -60,8 +69,14 @@ class ProgressMapper {
  private:
   /**
    * Generate XPath for KOReader compatibility.
-   * Format: /body/DocFragment[spineIndex+1]/body
-   * Since CrossPoint doesn't preserve HTML structure, we rely on percentage for positioning.
+   * Format: /body/DocFragment[spineIndex+1]/body, followed by the path to
+   * the page's first character when its text position is known.
+   */
+  static std::string generateXPath(const Epub& epub, const CrossPointPosition& pos);
+
+  /**
+   * Spine index of the DocFragment an XPath starts with and the rest of it,
+   * e.g. "/body/div[2]/p[5]/text().12"; false if it doesn't start with one.
    */
-  static std::string generateXPath(int spineIndex, int pageNumber, int totalPages);
+  static bool parseXPath(const std::string& xpath, int& spineIndex, std::string& rest);
 };
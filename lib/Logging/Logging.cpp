@@ -1,5 +1,6 @@
 #include "Logging.h"
 
+#ifndef LOG_DEFERRED
 // Since logging can take a large amount of flash, we want to make the format string as short as possible.
 // This logPrintf prepend the timestamp, level and origin to the user-provided message, so that the user only needs to
 // provide the format string for the message itself.
@@ -45,3 +46,320 @@ void logPrintf(const char* level, const char* origin, const char* format, ...) {
   va_end(args);
   logSerial.print(buf);
 }
+
+#else
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdarg>
+#include <cstring>
+
+#ifndef LOG_DEFERRED_BUFFER_SIZE
+#define LOG_DEFERRED_BUFFER_SIZE 4096
+#endif
+
+// Deferred mode: the caller only copies the format pointer and its arguments into a ring buffer, a task at idle
+// priority does the formatting and the serial write. %s arguments are copied, everything else is kept raw.
+namespace {
+constexpr size_t MAX_RECORD_SIZE = 160;
+constexpr size_t MAX_STRING_ARG = 48;  // Longer %s arguments are cut
+constexpr size_t MAX_SPEC_LENGTH = 16;
+constexpr uint32_t DRAIN_STACK_SIZE = 3072;
+
+enum class ArgKind : uint8_t { None, Int, Long, LongLong, SizeT, Double, String, Pointer };
+
+struct RecordHeader {
+  unsigned long ms;
+  const char* level;
+  const char* origin;
+  const char* format;
+};
+
+// One conversion of a format string and what it takes from the arguments
+struct Conversion {
+  const char* start;  // At the '%'
+  const char* end;    // Past the conversion character
+  ArgKind kind;
+  uint8_t starCount;  // A '*' width or precision takes an int before the value
+};
+
+// Finds the next conversion from p on; false once there is none. "%%" and unknown conversions come back as None.
+bool nextConversion(const char* p, Conversion& conversion) {
+  p = strchr(p, '%');
+  if (!p) {
+    return false;
+  }
+  conversion.start = p++;
+  conversion.starCount = 0;
+  while (*p && strchr("-+ #0", *p)) {
+    p++;
+  }
+  for (int field = 0; field < 2; field++) {
+    if (*p == '*') {
+      conversion.starCount++;
+      p++;
+    }
+    while (isdigit(static_cast<unsigned char>(*p))) {
+      p++;
+    }
+    if (field == 0 && *p == '.') {
+      p++;
+    } else {
+      break;
+    }
+  }
+  int longs = 0;
+  bool sizeT = false;
+  while (*p && strchr("hlzjt", *p)) {
+    longs += *p == 'l' ? 1 : *p == 'j' ? 2 : 0;
+    sizeT = sizeT || *p == 'z' || *p == 't';
+    p++;
+  }
+  const char type = *p;
+  conversion.end = type ? p + 1 : p;
+  if (type && strchr("diuxXoc", type)) {
+    conversion.kind = longs >= 2   ? ArgKind::LongLong
+                      : longs == 1 ? ArgKind::Long
+                      : sizeT      ? ArgKind::SizeT
+                                   : ArgKind::Int;
+  } else if (type && strchr("fFeEgGaA", type)) {
+    conversion.kind = ArgKind::Double;
+  } else if (type == 's') {
+    conversion.kind = ArgKind::String;
+  } else if (type == 'p') {
+    conversion.kind = ArgKind::Pointer;
+  } else {
+    conversion.kind = ArgKind::None;
+  }
+  return true;
+}
+
+template <typename T>
+bool put(uint8_t* record, size_t& pos, const T value) {
+  if (pos + sizeof(T) > MAX_RECORD_SIZE) {
+    return false;
+  }
+  memcpy(record + pos, &value, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+
+template <typename T>
+bool take(const uint8_t* record, const size_t size, size_t& pos, T& value) {
+  if (pos + sizeof(T) > size) {
+    return false;
+  }
+  memcpy(&value, record + pos, sizeof(T));
+  pos += sizeof(T);
+  return true;
+}
+
+// Copies one argument out of args into the record; false once the record is full
+bool packArg(uint8_t* record, size_t& pos, const ArgKind kind, va_list& args) {
+  switch (kind) {
+    case ArgKind::Int:
+      return put(record, pos, va_arg(args, int));
+    case ArgKind::Long:
+      return put(record, pos, va_arg(args, long));
+    case ArgKind::LongLong:
+      return put(record, pos, va_arg(args, long long));
+    case ArgKind::SizeT:
+      return put(record, pos, va_arg(args, size_t));
+    case ArgKind::Double:
+      return put(record, pos, va_arg(args, double));
+    case ArgKind::Pointer:
+      return put(record, pos, va_arg(args, void*));
+    case ArgKind::String: {
+      const char* str = va_arg(args, const char*);
+      if (!str) {
+        str = "(null)";
+      }
+      const size_t length = strnlen(str, MAX_STRING_ARG);
+      if (pos + length + 1 > MAX_RECORD_SIZE) {
+        return false;
+      }
+      memcpy(record + pos, str, length);
+      record[pos + length] = '\0';
+      pos += length + 1;
+      return true;
+    }
+    case ArgKind::None:
+      break;
+  }
+  return true;
+}
+
+template <typename T>
+int formatValue(char* out, const size_t size, const char* spec, const int* stars, const uint8_t starCount,
+                const T value) {
+  switch (starCount) {
+    case 0:
+      return snprintf(out, size, spec, value);
+    case 1:
+      return snprintf(out, size, spec, stars[0], value);
+    default:
+      return snprintf(out, size, spec, stars[0], stars[1], value);
+  }
+}
+
+// Formats one argument of the record with its conversion; the length snprintf reports, or -1 once the record runs out
+int formatArg(char* out, const size_t size, const char* spec, const int* stars, const Conversion& conversion,
+              const uint8_t* record, const size_t recordSize, size_t& pos) {
+  switch (conversion.kind) {
+#define LOG_FORMAT_ARG(kind, type)                                                     \
+  case ArgKind::kind: {                                                                \
+    type value;                                                                        \
+    if (!take(record, recordSize, pos, value)) {                                       \
+      return -1;                                                                       \
+    }                                                                                  \
+    return formatValue(out, size, spec, stars, conversion.starCount, value);           \
+  }
+    LOG_FORMAT_ARG(Int, int)
+    LOG_FORMAT_ARG(Long, long)
+    LOG_FORMAT_ARG(LongLong, long long)
+    LOG_FORMAT_ARG(SizeT, size_t)
+    LOG_FORMAT_ARG(Double, double)
+    LOG_FORMAT_ARG(Pointer, void*)
+#undef LOG_FORMAT_ARG
+    case ArgKind::String: {
+      if (pos >= recordSize) {
+        return -1;
+      }
+      const char* str = reinterpret_cast<const char*>(record + pos);
+      pos += strnlen(str, recordSize - pos) + 1;
+      return formatValue(out, size, spec, stars, conversion.starCount, str);
+    }
+    case ArgKind::None:
+      break;
+  }
+  return 0;
+}
+
+// Same layout as the direct logPrintf: timestamp, level, origin, then the message
+void formatRecord(const uint8_t* record, const size_t recordSize, char* out, const size_t outSize) {
+  RecordHeader header;
+  memcpy(&header, record, sizeof(header));
+  size_t pos = sizeof(header);
+  int len = snprintf(out, outSize, "[%lu] %s [%s] ", header.ms, header.level, header.origin);
+  size_t used = len > 0 ? std::min(static_cast<size_t>(len), outSize - 1) : 0;
+
+  const auto append = [&](const char* text, const size_t length) {
+    const size_t n = used + 1 < outSize ? std::min(length, outSize - 1 - used) : 0;
+    memcpy(out + used, text, n);
+    used += n;
+    out[used] = '\0';
+  };
+
+  const char* p = header.format;
+  Conversion conversion;
+  while (used + 1 < outSize && nextConversion(p, conversion)) {
+    append(p, conversion.start - p);
+    p = conversion.end;
+    if (conversion.kind == ArgKind::None) {
+      // "%%" and conversions that take nothing from the arguments
+      if (conversion.end - conversion.start == 2 && conversion.start[1] == '%') {
+        append("%", 1);
+      }
+      continue;
+    }
+    const size_t specLength = conversion.end - conversion.start;
+    int stars[2] = {0, 0};
+    bool complete = specLength < MAX_SPEC_LENGTH;
+    for (uint8_t i = 0; i < conversion.starCount && complete; i++) {
+      complete = take(record, recordSize, pos, stars[i]);
+    }
+    char spec[MAX_SPEC_LENGTH];
+    if (complete) {
+      memcpy(spec, conversion.start, specLength);
+      spec[specLength] = '\0';
+      len = formatArg(out + used, outSize - used, spec, stars, conversion, record, recordSize, pos);
+      complete = len >= 0;
+    }
+    if (!complete) {
+      // The arguments were cut to fit the record
+      append("...\n", 4);
+      return;
+    }
+    used = std::min(used + static_cast<size_t>(len), outSize - 1);
+  }
+  append(p, strlen(p));
+}
+
+RingbufHandle_t ring = nullptr;
+std::atomic<uint32_t> pending{0};
+std::atomic<uint32_t> dropped{0};
+
+void drainTask(void*) {
+  char line[256];
+  while (true) {
+    size_t size = 0;
+    auto* record = static_cast<uint8_t*>(xRingbufferReceive(ring, &size, portMAX_DELAY));
+    if (!record) {
+      continue;
+    }
+    const uint32_t lost = dropped.exchange(0);
+    if (lost > 0 && logSerial) {
+      snprintf(line, sizeof(line), "[LOG] %u messages dropped, the queue was full\n", static_cast<unsigned>(lost));
+      logSerial.print(line);
+    }
+    formatRecord(record, size, line, sizeof(line));
+    vRingbufferReturnItem(ring, record);
+    if (logSerial) {
+      logSerial.print(line);
+    }
+    pending--;
+  }
+}
+
+bool startDrain() {
+  static const bool started = [] {
+    ring = xRingbufferCreate(LOG_DEFERRED_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT);
+    return ring && xTaskCreate(&drainTask, "LogDrain", DRAIN_STACK_SIZE, nullptr, tskIDLE_PRIORITY, nullptr) == pdPASS;
+  }();
+  return started;
+}
+}  // namespace
+
+void logPrintf(const char* level, const char* origin, const char* format, ...) {
+  if (!logSerial || !startDrain()) {
+    return;
+  }
+  uint8_t record[MAX_RECORD_SIZE];
+  const RecordHeader header{millis(), level, origin, format};
+  memcpy(record, &header, sizeof(header));
+  size_t pos = sizeof(header);
+
+  va_list args;
+  va_start(args, format);
+  const char* p = format;
+  Conversion conversion;
+  bool fits = true;
+  while (fits && nextConversion(p, conversion)) {
+    p = conversion.end;
+    for (uint8_t i = 0; i < conversion.starCount && fits; i++) {
+      fits = put(record, pos, va_arg(args, int));
+    }
+    fits = fits && packArg(record, pos, conversion.kind, args);
+  }
+  va_end(args);
+
+  // Never waits: with the queue full the line is dropped and counted
+  pending++;
+  if (xRingbufferSend(ring, record, pos, 0) != pdTRUE) {
+    pending--;
+    dropped++;
+  }
+}
+
+void logFlush(const uint32_t maxMs) {
+  const unsigned long start = millis();
+  while (pending.load() > 0 && millis() - start < maxMs) {
+    vTaskDelay(1);
+  }
+}
+#endif  // LOG_DEFERRED
@@ -12,6 +12,10 @@ Define LOG_LEVEL to control log verbosity:
 2 = ERR + INF + DBG
 If not defined, defaults to 0
 
+Define LOG_DEFERRED to take the formatting and the serial write off the calling task: the LOG_* macros only queue the
+format string and their arguments, and a task at idle priority writes the lines out. Lines are dropped (and counted)
+while the queue is full, and whatever is still queued is lost on a crash.
+
 If you have a legitimate need for raw Serial access (e.g., binary data,
 special formatting), use the underlying logSerial object directly:
     logSerial.printf("Special case: %d\n", value);
@@ -29,6 +33,13 @@ static HWCDC& logSerial = Serial;
 
 void logPrintf(const char* level, const char* origin, const char* format, ...);
 
+#ifdef LOG_DEFERRED
+// Waits up to maxMs for the queued lines to be written, before a restart or deep sleep
+void logFlush(uint32_t maxMs = 200);
+#else
+inline void logFlush(uint32_t = 0) {}
+#endif
+
 #ifdef ENABLE_SERIAL_LOG
 #if LOG_LEVEL >= 0
 #define LOG_ERR(origin, format, ...) logPrintf("[ERR]", origin, format "\n", ##__VA_ARGS__)
@@ -0,0 +1,122 @@
+#include "OpdsEntryIndex.h"
+
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+
+namespace {
+constexpr char INDEX_FILE[] = "/.crosspoint/opds_entries.bin";
+// Longer strings can only come from a damaged file
+constexpr uint32_t MAX_FIELD_LENGTH = 4096;
+
+bool writeField(FsFile& file, const std::string& s) {
+  serialization::writeVarint(file, s.size());
+  return file.write(reinterpret_cast<const uint8_t*>(s.data()), s.size()) == s.size();
+}
+
+bool readField(FsFile& file, std::string& s) {
+  uint32_t len;
+  if (!serialization::readVarint(file, len) || len > MAX_FIELD_LENGTH) {
+    return false;
+  }
+  s.resize(len);
+  return file.read(reinterpret_cast<uint8_t*>(&s[0]), len) == static_cast<int>(len);
+}
+}  // namespace
+
+bool OpdsEntryIndex::reset() {
+  count = 0;
+  writeOffset = 0;
+  pageOffsets.clear();
+  page.clear();
+  loadedPage = 0;
+
+  if (!file) {
+    Storage.mkdir("/.crosspoint");
+    file = Storage.open(INDEX_FILE, O_RDWR | O_CREAT | O_TRUNC);
+    if (!file) {
+      LOG_ERR("OPDS", "Failed to create %s", INDEX_FILE);
+      return false;
+    }
+    return true;
+  }
+  return file.truncate(0);
+}
+
+void OpdsEntryIndex::close() {
+  if (file) {
+    file.close();
+    Storage.remove(INDEX_FILE);
+  }
+  count = 0;
+  writeOffset = 0;
+  pageOffsets.clear();
+  page.clear();
+  page.shrink_to_fit();
+}
+
+bool OpdsEntryIndex::add(const OpdsEntry& entry) {
+  if (!file || !file.seek(writeOffset)) {
+    return false;
+  }
+
+  // Record: type, then the length prefixed title, author and href. The id isn't needed for browsing.
+  const uint8_t type = static_cast<uint8_t>(entry.type);
+  if (file.write(&type, 1) != 1 || !writeField(file, entry.title) || !writeField(file, entry.author) ||
+      !writeField(file, entry.href)) {
+    LOG_ERR("OPDS", "Failed to write entry %zu to the index", count);
+    return false;
+  }
+
+  if (count % pageSize == 0) {
+    pageOffsets.push_back(writeOffset);
+  }
+  if (count / pageSize == loadedPage) {
+    page.push_back(entry);
+  }
+  writeOffset = file.position();
+  count++;
+  return true;
+}
+
+bool OpdsEntryIndex::readEntry(OpdsEntry& entry) {
+  uint8_t type;
+  if (file.read(&type, 1) != 1) {
+    return false;
+  }
+  entry.type = type == static_cast<uint8_t>(OpdsEntryType::BOOK) ? OpdsEntryType::BOOK : OpdsEntryType::NAVIGATION;
+  return readField(file, entry.title) && readField(file, entry.author) && readField(file, entry.href);
+}
+
+bool OpdsEntryIndex::loadPage(const size_t pageIndex) {
+  if (pageIndex == loadedPage && !page.empty()) {
+    return true;
+  }
+  page.clear();
+  loadedPage = pageIndex;
+  if (!file || pageIndex >= pageOffsets.size() || !file.seek(pageOffsets[pageIndex])) {
+    return false;
+  }
+
+  const size_t first = pageIndex * pageSize;
+  const size_t last = std::min(first + pageSize, count);
+  page.reserve(last - first);
+  for (size_t i = first; i < last; i++) {
+    OpdsEntry entry;
+    if (!readEntry(entry)) {
+      LOG_ERR("OPDS", "Failed to read entry %zu from the index", i);
+      page.clear();
+      return false;
+    }
+    page.push_back(std::move(entry));
+  }
+  return true;
+}
+
+const OpdsEntry* OpdsEntryIndex::get(const size_t index) const {
+  if (index / pageSize != loadedPage || index % pageSize >= page.size()) {
+    return nullptr;
+  }
+  return &page[index % pageSize];
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "OpdsParser.h"
+
+/**
+ * Entries of the OPDS feed being browsed, kept in a file on the SD card so that a long feed (and the further pages of
+ * it loaded so far) never has to fit in RAM. Only the entries of one page of the list are held in memory.
+ *
+ * Usage:
+ *   OpdsEntryIndex index(itemsPerPage);
+ *   index.reset();
+ *   parser.setEntryCallback([&](const OpdsEntry& entry) { index.add(entry); });
+ *   ...
+ *   index.loadPage(selected / itemsPerPage);
+ *   const OpdsEntry* entry = index.get(selected);
+ *
+ * Not thread safe: callers serialize access with the render lock.
+ */
+class OpdsEntryIndex {
+ public:
+  explicit OpdsEntryIndex(size_t pageSize) : pageSize(pageSize) {}
+  ~OpdsEntryIndex() { close(); }
+
+  // Disable copy
+  OpdsEntryIndex(const OpdsEntryIndex&) = delete;
+  OpdsEntryIndex& operator=(const OpdsEntryIndex&) = delete;
+
+  /**
+   * Start over with no entries, the first page loaded.
+   * @return false if the index file couldn't be created
+   */
+  bool reset();
+
+  /**
+   * Close and delete the index file.
+   */
+  void close();
+
+  /**
+   * Append an entry. If it belongs to the loaded page it's available from get() right away.
+   */
+  bool add(const OpdsEntry& entry);
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  /**
+   * Read the entries of a page into memory, replacing the ones of the page loaded before.
+   */
+  bool loadPage(size_t pageIndex);
+
+  /**
+   * @return The entry, or nullptr if it's not on the loaded page
+   */
+  const OpdsEntry* get(size_t index) const;
+
+ private:
+  size_t pageSize;
+  FsFile file;
+  size_t count = 0;
+  uint32_t writeOffset = 0;
+  std::vector<uint32_t> pageOffsets;  // Where each page's first entry starts in the file
+  std::vector<OpdsEntry> page;
+  size_t loadedPage = 0;
+
+  bool readEntry(OpdsEntry& entry);
+};
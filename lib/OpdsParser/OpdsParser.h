@@ -2,6 +2,7 @@
 #include <Print.h>
 #include <expat.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -42,9 +43,14 @@ using OpdsBook = OpdsEntry;
  *       }
  *     }
  *   }
+ *
+ * Large feeds can be handled as they arrive instead: with an entry callback set, each entry is handed to it once
+ * parsed and none are collected.
  */
 class OpdsParser final : public Print {
  public:
+  using EntryCallback = std::function<void(const OpdsEntry&)>;
+
   OpdsParser();
   ~OpdsParser();
 
@@ -74,6 +80,16 @@ class OpdsParser final : public Print {
    */
   std::vector<OpdsEntry> getBooks() const;
 
+  /**
+   * Hand entries to the callback as they're parsed instead of collecting them.
+   */
+  void setEntryCallback(EntryCallback callback) { onEntry = std::move(callback); }
+
+  /**
+   * The feed's rel="next" link (its next page), empty if it has none.
+   */
+  const std::string& getNextHref() const { return nextHref; }
+
   /**
    * Clear all parsed entries.
    */
@@ -90,7 +106,9 @@ class OpdsParser final : public Print {
 
   XML_Parser parser = nullptr;
   std::vector<OpdsEntry> entries;
+  EntryCallback onEntry;
   OpdsEntry currentEntry;
+  std::string nextHref;
   std::string currentText;
 
   // Parser state
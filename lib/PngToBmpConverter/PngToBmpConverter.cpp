@@ -4,8 +4,10 @@
 #include <InflateReader.h>
 #include <Logging.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <memory>
 
 #include "BitmapHelpers.h"
 
@@ -15,6 +17,7 @@
 constexpr bool USE_8BIT_OUTPUT = false;
 constexpr bool USE_ATKINSON = true;
 constexpr bool USE_FLOYD_STEINBERG = false;
+constexpr bool USE_ORDERED_THUMBNAILS = false;
 constexpr bool USE_PRESCALE = true;
 constexpr int TARGET_MAX_WIDTH = 480;
 constexpr int TARGET_MAX_HEIGHT = 800;
@@ -82,11 +85,12 @@ bool readBE32(FsFile& file, uint32_t& value) {
   return true;
 }
 
-void writeBmpHeader8bit(Print& bmpOut, const int width, const int height) {
+void writeBmpHeader8bit(FsFile& bmpOut, const int width, const int height) {
   const int bytesPerRow = (width + 3) / 4 * 4;
   const int imageSize = bytesPerRow * height;
   const uint32_t paletteSize = 256 * 4;
   const uint32_t fileSize = 14 + 40 + paletteSize + imageSize;
+  Storage.preAllocate("PNG", bmpOut, fileSize);
 
   bmpOut.write('B');
   bmpOut.write('M');
@@ -114,10 +118,11 @@ void writeBmpHeader8bit(Print& bmpOut, const int width, const int height) {
   }
 }
 
-void writeBmpHeader1bit(Print& bmpOut, const int width, const int height) {
+void writeBmpHeader1bit(FsFile& bmpOut, const int width, const int height) {
   const int bytesPerRow = (width + 31) / 32 * 4;
   const int imageSize = bytesPerRow * height;
   const uint32_t fileSize = 62 + imageSize;
+  Storage.preAllocate("PNG", bmpOut, fileSize);
 
   bmpOut.write('B');
   bmpOut.write('M');
@@ -143,10 +148,11 @@ void writeBmpHeader1bit(Print& bmpOut, const int width, const int height) {
   }
 }
 
-void writeBmpHeader2bit(Print& bmpOut, const int width, const int height) {
+void writeBmpHeader2bit(FsFile& bmpOut, const int width, const int height) {
   const int bytesPerRow = (width * 2 + 31) / 32 * 4;
   const int imageSize = bytesPerRow * height;
   const uint32_t fileSize = 70 + imageSize;
+  Storage.preAllocate("PNG", bmpOut, fileSize);
 
   bmpOut.write('B');
   bmpOut.write('M');
@@ -396,9 +402,11 @@ static void convertScanlineToGray(const PngDecodeContext& ctx, uint8_t* grayRow)
   }
 }
 
-bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOut, int targetWidth, int targetHeight,
-                                                   bool oneBit, bool crop) {
-  LOG_DBG("PNG", "Converting PNG to %s BMP (target: %dx%d)", oneBit ? "1-bit" : "2-bit", targetWidth, targetHeight);
+bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, FsFile& bmpOut, int targetWidth,
+                                                   int targetHeight, bool oneBit, bool crop, bool grayMaster) {
+  LOG_DBG("PNG", "Converting PNG to %s BMP (target: %dx%d)", grayMaster ? "8-bit" : oneBit ? "1-bit" : "2-bit",
+          targetWidth, targetHeight);
+  const bool eightBit = grayMaster || (USE_8BIT_OUTPUT && !oneBit);
 
   // Verify PNG signature
   uint8_t sig[8];
@@ -498,8 +506,9 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
     return false;
   }
 
-  // Initialize decode context
-  PngDecodeContext ctx = {};
+  // Initialize decode context. It holds the inflate decoder and its Huffman lookup tables, so it lives on the heap.
+  auto ctxOwner = std::unique_ptr<PngDecodeContext>(new PngDecodeContext());
+  PngDecodeContext& ctx = *ctxOwner;
   ctx.file = &pngFile;
   ctx.width = width;
   ctx.height = height;
@@ -556,9 +565,9 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
     return false;
   }
 
-  // Initialize streaming decompressor with 32KB ring buffer for back-reference history
+  // Initialize streaming decompressor with the shared 32KB window for back-reference history
   if (!ctx.reader.init(true)) {
-    LOG_ERR("PNG", "Failed to init inflate reader");
+    LOG_ERR("PNG", "Inflate window busy, retry later");
     free(ctx.currentRow);
     free(ctx.previousRow);
     return false;
@@ -584,6 +593,8 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
     } else {
       scale = (scaleToFitWidth < scaleToFitHeight) ? scaleToFitWidth : scaleToFitHeight;
     }
+    // A master is scaled once more for each variant, so scaling it up past the image would add nothing
+    if (grayMaster && scale > 1.0f) scale = 1.0f;
 
     outWidth = static_cast<int>(width * scale);
     outHeight = static_cast<int>(height * scale);
@@ -600,7 +611,7 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
 
   // Write BMP header
   int bytesPerRow;
-  if (USE_8BIT_OUTPUT && !oneBit) {
+  if (eightBit) {
     writeBmpHeader8bit(bmpOut, outWidth, outHeight);
     bytesPerRow = (outWidth + 3) / 4 * 4;
   } else if (oneBit) {
@@ -621,19 +632,16 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
   }
 
   // Create ditherers (same as JpegToBmpConverter)
-  AtkinsonDitherer* atkinsonDitherer = nullptr;
-  FloydSteinbergDitherer* fsDitherer = nullptr;
-  Atkinson1BitDitherer* atkinson1BitDitherer = nullptr;
-
+  using Method = BmpRowQuantizer::Method;
+  Method method = Method::Simple;
   if (oneBit) {
-    atkinson1BitDitherer = new Atkinson1BitDitherer(outWidth);
-  } else if (!USE_8BIT_OUTPUT) {
-    if (USE_ATKINSON) {
-      atkinsonDitherer = new AtkinsonDitherer(outWidth);
-    } else if (USE_FLOYD_STEINBERG) {
-      fsDitherer = new FloydSteinbergDitherer(outWidth);
-    }
+    method = USE_ORDERED_THUMBNAILS ? Method::Ordered : Method::Atkinson;
+  } else if (USE_ATKINSON) {
+    method = Method::Atkinson;
+  } else if (USE_FLOYD_STEINBERG) {
+    method = Method::FloydSteinberg;
   }
+  BmpRowQuantizer quantizer(outWidth, oneBit, method);
 
   // Scaling accumulators
   uint32_t* rowAccum = nullptr;
@@ -648,15 +656,13 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
   }
 
   // Allocate grayscale row buffer - batch-convert each scanline to avoid
-  // per-pixel getPixelGray() switch overhead in the hot loops
-  auto* grayRow = static_cast<uint8_t*>(malloc(width));
+  // per-pixel getPixelGray() switch overhead in the hot loops. Once accumulated, a scaled scanline is no longer needed,
+  // so the buffer then holds the averaged output rows as they are quantized.
+  auto* grayRow = static_cast<uint8_t*>(malloc(std::max(static_cast<int>(width), outWidth)));
   if (!grayRow) {
     LOG_ERR("PNG", "Failed to allocate grayscale row buffer");
     delete[] rowAccum;
     delete[] rowCount;
-    delete atkinsonDitherer;
-    delete fsDitherer;
-    delete atkinson1BitDitherer;
     free(rowBuffer);
     free(ctx.currentRow);
     free(ctx.previousRow);
@@ -681,38 +687,12 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
       // Direct output (no scaling)
       memset(rowBuffer, 0, bytesPerRow);
 
-      if (USE_8BIT_OUTPUT && !oneBit) {
-        for (int x = 0; x < outWidth; x++) {
-          rowBuffer[x] = adjustPixel(grayRow[x]);
-        }
-      } else if (oneBit) {
+      if (eightBit) {
         for (int x = 0; x < outWidth; x++) {
-          const uint8_t bit =
-              atkinson1BitDitherer ? atkinson1BitDitherer->processPixel(grayRow[x], x) : quantize1bit(grayRow[x], x, y);
-          const int byteIndex = x / 8;
-          const int bitOffset = 7 - (x % 8);
-          rowBuffer[byteIndex] |= (bit << bitOffset);
+          rowBuffer[x] = grayMaster ? grayRow[x] : adjustPixel(grayRow[x]);
         }
-        if (atkinson1BitDitherer) atkinson1BitDitherer->nextRow();
       } else {
-        for (int x = 0; x < outWidth; x++) {
-          const uint8_t gray = adjustPixel(grayRow[x]);
-          uint8_t twoBit;
-          if (atkinsonDitherer) {
-            twoBit = atkinsonDitherer->processPixel(gray, x);
-          } else if (fsDitherer) {
-            twoBit = fsDitherer->processPixel(gray, x);
-          } else {
-            twoBit = quantize(gray, x, y);
-          }
-          const int byteIndex = (x * 2) / 8;
-          const int bitOffset = 6 - ((x * 2) % 8);
-          rowBuffer[byteIndex] |= (twoBit << bitOffset);
-        }
-        if (atkinsonDitherer)
-          atkinsonDitherer->nextRow();
-        else if (fsDitherer)
-          fsDitherer->nextRow();
+        quantizer.processRow(grayRow, y, rowBuffer);
       }
       bmpOut.write(rowBuffer, bytesPerRow);
     } else {
@@ -745,40 +725,16 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
       while (srcY_fp >= nextOutY_srcStart && currentOutY < outHeight) {
         memset(rowBuffer, 0, bytesPerRow);
 
-        if (USE_8BIT_OUTPUT && !oneBit) {
-          for (int x = 0; x < outWidth; x++) {
-            const uint8_t gray = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
-            rowBuffer[x] = adjustPixel(gray);
-          }
-        } else if (oneBit) {
+        if (eightBit) {
           for (int x = 0; x < outWidth; x++) {
             const uint8_t gray = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
-            const uint8_t bit =
-                atkinson1BitDitherer ? atkinson1BitDitherer->processPixel(gray, x) : quantize1bit(gray, x, currentOutY);
-            const int byteIndex = x / 8;
-            const int bitOffset = 7 - (x % 8);
-            rowBuffer[byteIndex] |= (bit << bitOffset);
+            rowBuffer[x] = grayMaster ? gray : adjustPixel(gray);
           }
-          if (atkinson1BitDitherer) atkinson1BitDitherer->nextRow();
         } else {
           for (int x = 0; x < outWidth; x++) {
-            const uint8_t gray = adjustPixel((rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0);
-            uint8_t twoBit;
-            if (atkinsonDitherer) {
-              twoBit = atkinsonDitherer->processPixel(gray, x);
-            } else if (fsDitherer) {
-              twoBit = fsDitherer->processPixel(gray, x);
-            } else {
-              twoBit = quantize(gray, x, currentOutY);
-            }
-            const int byteIndex = (x * 2) / 8;
-            const int bitOffset = 6 - ((x * 2) % 8);
-            rowBuffer[byteIndex] |= (twoBit << bitOffset);
+            grayRow[x] = (rowCount[x] > 0) ? (rowAccum[x] / rowCount[x]) : 0;
           }
-          if (atkinsonDitherer)
-            atkinsonDitherer->nextRow();
-          else if (fsDitherer)
-            fsDitherer->nextRow();
+          quantizer.processRow(grayRow, currentOutY, rowBuffer);
         }
 
         bmpOut.write(rowBuffer, bytesPerRow);
@@ -808,9 +764,6 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
   free(grayRow);
   delete[] rowAccum;
   delete[] rowCount;
-  delete atkinsonDitherer;
-  delete fsDitherer;
-  delete atkinson1BitDitherer;
   free(rowBuffer);
   free(ctx.currentRow);
   free(ctx.previousRow);
@@ -821,16 +774,21 @@ bool PngToBmpConverter::pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOu
   return success;
 }
 
-bool PngToBmpConverter::pngFileToBmpStream(FsFile& pngFile, Print& bmpOut, bool crop) {
+bool PngToBmpConverter::pngFileToBmpStream(FsFile& pngFile, FsFile& bmpOut, bool crop) {
   return pngFileToBmpStreamInternal(pngFile, bmpOut, TARGET_MAX_WIDTH, TARGET_MAX_HEIGHT, false, crop);
 }
 
-bool PngToBmpConverter::pngFileToBmpStreamWithSize(FsFile& pngFile, Print& bmpOut, int targetMaxWidth,
+bool PngToBmpConverter::pngFileToBmpStreamWithSize(FsFile& pngFile, FsFile& bmpOut, int targetMaxWidth,
                                                    int targetMaxHeight) {
   return pngFileToBmpStreamInternal(pngFile, bmpOut, targetMaxWidth, targetMaxHeight, false);
 }
 
-bool PngToBmpConverter::pngFileTo1BitBmpStreamWithSize(FsFile& pngFile, Print& bmpOut, int targetMaxWidth,
+bool PngToBmpConverter::pngFileTo1BitBmpStreamWithSize(FsFile& pngFile, FsFile& bmpOut, int targetMaxWidth,
                                                        int targetMaxHeight) {
   return pngFileToBmpStreamInternal(pngFile, bmpOut, targetMaxWidth, targetMaxHeight, true, true);
 }
+
+bool PngToBmpConverter::pngFileToGrayMasterStream(FsFile& pngFile, FsFile& bmpOut, int targetMaxWidth,
+                                                  int targetMaxHeight) {
+  return pngFileToBmpStreamInternal(pngFile, bmpOut, targetMaxWidth, targetMaxHeight, false, true, true);
+}
@@ -1,14 +1,14 @@
 #pragma once
 
 class FsFile;
-class Print;
 
 class PngToBmpConverter {
-  static bool pngFileToBmpStreamInternal(FsFile& pngFile, Print& bmpOut, int targetWidth, int targetHeight, bool oneBit,
-                                         bool crop = true);
+  static bool pngFileToBmpStreamInternal(FsFile& pngFile, FsFile& bmpOut, int targetWidth, int targetHeight,
+                                         bool oneBit, bool crop = true, bool grayMaster = false);
 
  public:
-  static bool pngFileToBmpStream(FsFile& pngFile, Print& bmpOut, bool crop = true);
-  static bool pngFileToBmpStreamWithSize(FsFile& pngFile, Print& bmpOut, int targetMaxWidth, int targetMaxHeight);
-  static bool pngFileTo1BitBmpStreamWithSize(FsFile& pngFile, Print& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  static bool pngFileToBmpStream(FsFile& pngFile, FsFile& bmpOut, bool crop = true);
+  static bool pngFileToBmpStreamWithSize(FsFile& pngFile, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  static bool pngFileTo1BitBmpStreamWithSize(FsFile& pngFile, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
+  static bool pngFileToGrayMasterStream(FsFile& pngFile, FsFile& bmpOut, int targetMaxWidth, int targetMaxHeight);
 };
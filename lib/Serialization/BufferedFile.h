@@ -0,0 +1,135 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Block buffers in front of an FsFile, for the serialization:: helpers and the cache formats built on them. Fields are
+// written and read a few bytes at a time; with these, the file only sees one call per sector instead of one per field.
+// Both take the size of an SD sector; larger requests go straight to the file.
+namespace serialization {
+constexpr size_t FILE_BUFFER_SIZE = 512;
+}
+
+// Collects writes and hands them to the file in blocks. Whatever is left is written by flush() or the destructor, so
+// check flush() to learn whether everything made it to the card.
+class BufferedFileWriter {
+ public:
+  explicit BufferedFileWriter(FsFile& file) : file(file) {}
+  ~BufferedFileWriter() { flush(); }
+  BufferedFileWriter(const BufferedFileWriter&) = delete;
+  BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+  // Once a write to the file has failed everything after it is dropped, and 0 is returned
+  size_t write(const void* data, const size_t len) {
+    if (failed || len == 0) {
+      return 0;
+    }
+    if (used + len > sizeof(buffer) && !flush()) {
+      return 0;
+    }
+    if (len >= sizeof(buffer)) {
+      if (file.write(static_cast<const uint8_t*>(data), len) != len) {
+        failed = true;
+        return 0;
+      }
+      return len;
+    }
+    memcpy(buffer + used, data, len);
+    used += len;
+    return len;
+  }
+  size_t write(const uint8_t value) { return write(&value, 1); }
+
+  // Writes the buffered bytes out; false if any write failed so far
+  bool flush() {
+    if (used > 0 && !failed) {
+      failed = file.write(buffer, used) != used;
+    }
+    used = 0;
+    return !failed;
+  }
+
+  // Where the next byte will go, counting what is still buffered
+  uint32_t position() const { return static_cast<uint32_t>(file.position()) + used; }
+  bool seek(const uint32_t position) { return flush() && file.seek(position); }
+
+ private:
+  FsFile& file;
+  uint8_t buffer[serialization::FILE_BUFFER_SIZE];
+  size_t used = 0;
+  bool failed = false;
+};
+
+// Reads the file ahead in blocks. The file's own position runs ahead of position(); seek the file before using it
+// directly again, or let another reader take over through seek().
+class BufferedFileReader {
+ public:
+  explicit BufferedFileReader(FsFile& file) : file(file), bufferStart(static_cast<uint32_t>(file.position())) {}
+  BufferedFileReader(const BufferedFileReader&) = delete;
+  BufferedFileReader& operator=(const BufferedFileReader&) = delete;
+
+  // Same contract as FsFile::read: the number of bytes read, short at the end of the file, -1 on an error
+  int read(void* out, size_t len) {
+    auto* dest = static_cast<uint8_t*>(out);
+    size_t done = 0;
+    while (len > 0) {
+      if (pos == filled) {
+        if (len >= sizeof(buffer)) {
+          // Large reads bypass the buffer, the next small one refills it
+          const int direct = file.read(dest, len);
+          if (direct < 0) {
+            return done > 0 ? static_cast<int>(done) : -1;
+          }
+          bufferStart += filled + direct;
+          pos = filled = 0;
+          return static_cast<int>(done) + direct;
+        }
+        if (!refill()) {
+          break;
+        }
+      }
+      const size_t n = std::min(len, filled - pos);
+      memcpy(dest, buffer + pos, n);
+      pos += n;
+      dest += n;
+      done += n;
+      len -= n;
+    }
+    return static_cast<int>(done);
+  }
+
+  uint32_t position() const { return bufferStart + pos; }
+  int available() const { return static_cast<int>(filled - pos) + file.available(); }
+
+  // Stays within the buffer when it can
+  bool seek(const uint32_t position) {
+    if (position >= bufferStart && position <= bufferStart + filled) {
+      pos = position - bufferStart;
+      return true;
+    }
+    pos = filled = 0;
+    bufferStart = position;
+    return file.seek(position);
+  }
+
+ private:
+  FsFile& file;
+  uint8_t buffer[serialization::FILE_BUFFER_SIZE];
+  uint32_t bufferStart;  // File offset of buffer[0]
+  size_t filled = 0;
+  size_t pos = 0;
+
+  bool refill() {
+    bufferStart += filled;
+    pos = filled = 0;
+    const int n = file.read(buffer, sizeof(buffer));
+    if (n <= 0) {
+      return false;
+    }
+    filled = static_cast<size_t>(n);
+    return true;
+  }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Reads a record that is already in memory, with the same read() as FsFile, so the serialization:: helpers decode it
+// the way they would decode the file
+class MemoryReader {
+ public:
+  MemoryReader(const uint8_t* data, const size_t size) : data(data), size(size) {}
+
+  // The number of bytes read, short at the end of the record
+  int read(void* out, const size_t len) {
+    const size_t n = std::min(len, size - pos);
+    if (n > 0) {
+      memcpy(out, data + pos, n);
+    }
+    pos += n;
+    return static_cast<int>(n);
+  }
+
+  size_t position() const { return pos; }
+  size_t remaining() const { return size - pos; }
+
+ private:
+  const uint8_t* data;
+  size_t size;
+  size_t pos = 0;
+};
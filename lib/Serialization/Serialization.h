@@ -3,14 +3,17 @@
 
 #include <iostream>
 
+#include "BufferedFile.h"
+
+// The File overloads take an FsFile, or a BufferedFileWriter/BufferedFileReader in front of one
 namespace serialization {
 template <typename T>
 static void writePod(std::ostream& os, const T& value) {
   os.write(reinterpret_cast<const char*>(&value), sizeof(T));
 }
 
-template <typename T>
-static void writePod(FsFile& file, const T& value) {
+template <typename T, typename File>
+static void writePod(File& file, const T& value) {
   file.write(reinterpret_cast<const uint8_t*>(&value), sizeof(T));
 }
 
@@ -19,8 +22,8 @@ static void readPod(std::istream& is, T& value) {
   is.read(reinterpret_cast<char*>(&value), sizeof(T));
 }
 
-template <typename T>
-static void readPod(FsFile& file, T& value) {
+template <typename T, typename File>
+static void readPod(File& file, T& value) {
   file.read(reinterpret_cast<uint8_t*>(&value), sizeof(T));
 }
 
@@ -30,7 +33,8 @@ static void writeString(std::ostream& os, const std::string& s) {
   os.write(s.data(), len);
 }
 
-static void writeString(FsFile& file, const std::string& s) {
+template <typename File>
+static void writeString(File& file, const std::string& s) {
   const uint32_t len = s.size();
   writePod(file, len);
   file.write(reinterpret_cast<const uint8_t*>(s.data()), len);
@@ -43,10 +47,40 @@ static void readString(std::istream& is, std::string& s) {
   is.read(&s[0], len);
 }
 
-static void readString(FsFile& file, std::string& s) {
+template <typename File>
+static void readString(File& file, std::string& s) {
   uint32_t len;
   readPod(file, len);
   s.resize(len);
   file.read(&s[0], len);
 }
+
+// LEB128-style unsigned varint: 7 bits per byte, high bit set on all but the last byte
+template <typename File>
+static void writeVarint(File& file, uint32_t value) {
+  uint8_t buf[5];
+  size_t len = 0;
+  while (value >= 0x80) {
+    buf[len++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  buf[len++] = static_cast<uint8_t>(value);
+  file.write(buf, len);
+}
+
+template <typename File>
+static bool readVarint(File& file, uint32_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    uint8_t byte;
+    if (file.read(&byte, 1) != 1) {
+      return false;
+    }
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;  // Over-long encoding
+}
 }  // namespace serialization
@@ -0,0 +1,202 @@
+#include "Trace.h"
+
+#ifdef ENABLE_TRACE
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 2048
+#endif
+
+namespace {
+constexpr uint32_t RING_SIZE = TRACE_RING_SIZE;
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "TRACE_RING_SIZE must be a power of two");
+constexpr uint8_t MAX_TASKS = 8;
+constexpr uint8_t OTHER_TASK = MAX_TASKS;
+
+constexpr const char* EVENT_NAMES[] = {"PageTurn", "SdRead",      "Inflate",   "Parse",
+                                       "Layout",   "GlyphRender", "PlaneCopy", "PanelRefresh"};
+static_assert(sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]) == static_cast<size_t>(TraceEvent::EVENT_COUNT),
+              "Every trace event needs a name");
+
+struct Entry {
+  uint32_t us;
+  uint32_t arg;
+  TraceEvent event;
+  char phase;
+  uint8_t task;
+};
+
+Entry ring[RING_SIZE];
+std::atomic<uint32_t> recorded{0};
+std::atomic<bool> paused{false};
+
+// Tasks seen so far, so a record only keeps a small index; the name is taken once, when a task is first seen
+TaskHandle_t tasks[MAX_TASKS];
+char taskNames[MAX_TASKS][configMAX_TASK_NAME_LEN];
+std::atomic<uint8_t> taskCount{0};
+portMUX_TYPE taskMux = portMUX_INITIALIZER_UNLOCKED;
+
+uint8_t currentTask() {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  const uint8_t known = taskCount.load(std::memory_order_acquire);
+  for (uint8_t i = 0; i < known; i++) {
+    if (tasks[i] == self) {
+      return i;
+    }
+  }
+  uint8_t index = OTHER_TASK;
+  portENTER_CRITICAL(&taskMux);
+  const uint8_t count = taskCount.load(std::memory_order_relaxed);
+  if (count < MAX_TASKS) {
+    tasks[count] = self;
+    strncpy(taskNames[count], pcTaskGetName(self), sizeof(taskNames[count]) - 1);
+    taskNames[count][sizeof(taskNames[count]) - 1] = '\0';
+    taskCount.store(count + 1, std::memory_order_release);
+    index = count;
+  }
+  portEXIT_CRITICAL(&taskMux);
+  return index;
+}
+
+// Calls fn(event, beginIndex, endIndex) for each span in the ring whose begin and end are both still in it. A task's
+// spans nest, so an end closes the innermost open span of its event; deeper ones left open by it are dropped.
+constexpr uint8_t MAX_SPAN_DEPTH = 8;
+
+template <typename Fn>
+void forEachSpan(const uint32_t first, const uint32_t total, const Fn& fn) {
+  uint32_t open[MAX_TASKS + 1][MAX_SPAN_DEPTH];
+  uint8_t depth[MAX_TASKS + 1] = {};
+  for (uint32_t i = first; i < total; i++) {
+    const Entry& entry = ring[i & (RING_SIZE - 1)];
+    if (entry.task > OTHER_TASK) {
+      continue;
+    }
+    uint8_t& taskDepth = depth[entry.task];
+    if (entry.phase == 'B') {
+      if (taskDepth < MAX_SPAN_DEPTH) {
+        open[entry.task][taskDepth++] = i;
+      }
+      continue;
+    }
+    for (uint8_t d = taskDepth; d > 0; d--) {
+      const uint32_t begin = open[entry.task][d - 1];
+      if (ring[begin & (RING_SIZE - 1)].event == entry.event) {
+        fn(entry.event, begin, i);
+        taskDepth = d - 1;
+        break;
+      }
+    }
+  }
+}
+}  // namespace
+
+namespace Trace {
+
+void record(const TraceEvent event, const char phase, const uint32_t arg) {
+  if (paused.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const uint32_t slot = recorded.fetch_add(1, std::memory_order_relaxed) & (RING_SIZE - 1);
+  ring[slot] = {static_cast<uint32_t>(esp_timer_get_time()), arg, event, phase, currentTask()};
+}
+
+void dump(const std::function<void(const char* data, size_t len)>& write) {
+  paused = true;
+  // Let a record that got past the check before the pause finish its slot
+  vTaskDelay(1);
+
+  const uint32_t total = recorded.load();
+  const uint32_t count = total < RING_SIZE ? total : RING_SIZE;
+  const uint32_t first = total - count;
+  const uint32_t origin = count > 0 ? ring[first & (RING_SIZE - 1)].us : 0;
+
+  char line[160];
+  int len = snprintf(line, sizeof(line), "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  write(line, len);
+  bool comma = false;
+  const uint8_t knownTasks = taskCount.load();
+  for (uint8_t i = 0; i < knownTasks; i++) {
+    len = snprintf(line, sizeof(line),
+                   "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                   comma ? ",\n" : "\n", i, taskNames[i]);
+    write(line, len);
+    comma = true;
+  }
+  for (uint32_t i = first; i < total; i++) {
+    const Entry& entry = ring[i & (RING_SIZE - 1)];
+    const auto event = static_cast<size_t>(entry.event);
+    if (event >= static_cast<size_t>(TraceEvent::EVENT_COUNT)) {
+      continue;
+    }
+    // Unsigned difference, so a wrap of the 32 bit timer within the ring still comes out right
+    const uint32_t ts = entry.us - origin;
+    if (entry.phase == 'B') {
+      len = snprintf(line, sizeof(line),
+                     "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%lu,\"pid\":1,\"tid\":%u,\"args\":{\"arg\":%lu}}",
+                     comma ? ",\n" : "\n", EVENT_NAMES[event], static_cast<unsigned long>(ts), entry.task,
+                     static_cast<unsigned long>(entry.arg));
+    } else {
+      len = snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%lu,\"pid\":1,\"tid\":%u}",
+                     comma ? ",\n" : "\n", EVENT_NAMES[event], static_cast<unsigned long>(ts), entry.task);
+    }
+    write(line, len);
+    comma = true;
+  }
+  len = snprintf(line, sizeof(line), "\n]}\n");
+  write(line, len);
+
+  recorded = 0;
+  paused = false;
+}
+
+const char* eventName(const TraceEvent event) {
+  return event < TraceEvent::EVENT_COUNT ? EVENT_NAMES[static_cast<size_t>(event)] : "";
+}
+
+bool summarize(EventTotals* totals, const bool lastPageTurn) {
+  const uint32_t total = recorded.load();
+  const uint32_t count = total < RING_SIZE ? total : RING_SIZE;
+  const uint32_t first = total - count;
+
+  uint32_t windowBegin = first;
+  uint32_t windowEnd = total;
+  if (lastPageTurn) {
+    bool found = false;
+    forEachSpan(first, total, [&](const TraceEvent event, const uint32_t begin, const uint32_t end) {
+      if (event == TraceEvent::PageTurn) {
+        windowBegin = begin;
+        windowEnd = end + 1;
+        found = true;
+      }
+    });
+    if (!found) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < static_cast<size_t>(TraceEvent::EVENT_COUNT); i++) {
+    totals[i] = {};
+  }
+  bool any = false;
+  forEachSpan(windowBegin, windowEnd, [&](const TraceEvent event, const uint32_t begin, const uint32_t end) {
+    if (event >= TraceEvent::EVENT_COUNT) {
+      return;
+    }
+    const Entry& b = ring[begin & (RING_SIZE - 1)];
+    EventTotals& t = totals[static_cast<size_t>(event)];
+    t.count++;
+    t.totalUs += ring[end & (RING_SIZE - 1)].us - b.us;
+    t.argSum += b.arg;
+    any = true;
+  });
+  return any;
+}
+
+}  // namespace Trace
+#endif
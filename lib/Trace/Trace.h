@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/*
+Define ENABLE_TRACE to record hot path spans into a fixed ring in RAM (the "trace" environment in platformio.ini does)
+Without it the macros expand to nothing, their arguments are not evaluated.
+
+A record is {event, begin/end, timestamp, arg, task}, nothing is formatted until the ring is dumped as Chrome trace
+JSON, to be opened in Perfetto (ui.perfetto.dev) or chrome://tracing:
+    TRACE_SCOPE(Layout, wordCount);       // spans to the end of the enclosing block
+    TRACE_BEGIN(Parse, len); ... TRACE_END(Parse);
+
+Timestamps are in microseconds from the system timer rather than in CPU cycles: HalPowerManager changes the clock
+while a page turn runs, and cycles counted at different clocks can't be put on one time line.
+*/
+
+enum class TraceEvent : uint8_t {
+  PageTurn,
+  SdRead,
+  Inflate,
+  Parse,
+  Layout,
+  GlyphRender,
+  PlaneCopy,
+  PanelRefresh,
+  EVENT_COUNT,
+};
+
+#ifdef ENABLE_TRACE
+namespace Trace {
+
+void record(TraceEvent event, char phase, uint32_t arg);
+
+// Writes the ring through write as Chrome trace JSON and empties it. Recording is paused meanwhile.
+void dump(const std::function<void(const char* data, size_t len)>& write);
+
+// Spans closed in the ring, per event; the args of SdRead spans are the bytes read
+struct EventTotals {
+  uint32_t count;
+  uint32_t totalUs;
+  uint32_t argSum;
+};
+
+const char* eventName(TraceEvent event);
+// Adds up the spans in the ring into totals (one per event), or with lastPageTurn only those that ended within the
+// last complete PageTurn span, for its breakdown. False if there's no such span. Recording goes on meanwhile, a span
+// recorded over while it's read may be miscounted.
+bool summarize(EventTotals* totals, bool lastPageTurn);
+
+class Scope {
+ public:
+  Scope(const TraceEvent event, const uint32_t arg) : event(event) { record(event, 'B', arg); }
+  ~Scope() { record(event, 'E', 0); }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+ private:
+  TraceEvent event;
+};
+
+}  // namespace Trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(event, arg) \
+  Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(TraceEvent::event, static_cast<uint32_t>(arg))
+#define TRACE_BEGIN(event, arg) Trace::record(TraceEvent::event, 'B', static_cast<uint32_t>(arg))
+#define TRACE_END(event) Trace::record(TraceEvent::event, 'E', 0)
+#else
+#define TRACE_SCOPE(event, arg)
+#define TRACE_BEGIN(event, arg)
+#define TRACE_END(event)
+#endif
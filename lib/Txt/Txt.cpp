@@ -1,14 +1,24 @@
 #include "Txt.h"
 
+#include <BookCacheKey.h>
 #include <FsHelpers.h>
 #include <JpegToBmpConverter.h>
 #include <Logging.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
 Txt::Txt(std::string path, std::string cacheBasePath)
     : filepath(std::move(path)), cacheBasePath(std::move(cacheBasePath)) {
-  // Generate cache path from file path hash
-  const size_t hash = std::hash<std::string>{}(filepath);
-  cachePath = this->cacheBasePath + "/txt_" + std::to_string(hash);
+  cachePath = BookCacheKey::cachePath(filepath, this->cacheBasePath, "txt_");
+}
+
+Txt::~Txt() {
+  if (windowFile) {
+    windowFile.close();
+  }
+  free(windowBuffer);
 }
 
 bool Txt::load() {
@@ -190,3 +200,54 @@ bool Txt::readContent(uint8_t* buffer, size_t offset, size_t length) const {
 
   return bytesRead > 0;
 }
+
+std::string_view Txt::readWindow(const size_t offset, const size_t length) {
+  if (!loaded || offset >= fileSize) {
+    return {};
+  }
+  const size_t wanted = std::min({length, fileSize - offset, READ_WINDOW_SIZE});
+  const size_t windowEnd = windowOffset + windowLength;
+  if (offset >= windowOffset && offset + wanted <= windowEnd) {
+    return {windowBuffer + (offset - windowOffset), wanted};
+  }
+
+  if (!windowBuffer) {
+    windowBuffer = static_cast<char*>(malloc(READ_WINDOW_SIZE));
+    if (!windowBuffer) {
+      LOG_ERR("TXT", "Failed to allocate %zu byte read window", READ_WINDOW_SIZE);
+      return {};
+    }
+  }
+  if (!windowFile && !Storage.openFileForRead("TXT", filepath, windowFile)) {
+    return {};
+  }
+
+  // Moving forward into the window keeps its tail and reads on after it, anything else starts the window over
+  size_t kept = 0;
+  size_t readFrom = offset;
+  if (offset >= windowOffset && offset < windowEnd) {
+    kept = windowEnd - offset;
+    memmove(windowBuffer, windowBuffer + (offset - windowOffset), kept);
+    readFrom = windowEnd;
+  }
+  windowOffset = offset;
+  windowLength = kept;
+  if (windowFile.position() != readFrom && !windowFile.seek(readFrom)) {
+    LOG_ERR("TXT", "Failed to seek to %zu", readFrom);
+    windowLength = 0;
+    return {};
+  }
+
+  const size_t toRead = std::min(READ_WINDOW_SIZE, fileSize - offset) - kept;
+  const int bytesRead = windowFile.read(windowBuffer + kept, toRead);
+  if (bytesRead > 0) {
+    windowLength += static_cast<size_t>(bytesRead);
+  }
+  if (windowLength < wanted) {
+    LOG_ERR("TXT", "Short read at %zu", readFrom);
+    windowFile.close();
+    windowLength = 0;
+    return {};
+  }
+  return {windowBuffer, wanted};
+}
@@ -4,6 +4,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 
 class Txt {
   std::string filepath;
@@ -12,8 +13,19 @@ class Txt {
   bool loaded = false;
   size_t fileSize = 0;
 
+  // Read window for readWindow(), allocated and opened on first use
+  FsFile windowFile;
+  char* windowBuffer = nullptr;
+  size_t windowOffset = 0;
+  size_t windowLength = 0;
+
  public:
+  static constexpr size_t READ_WINDOW_SIZE = 8 * 1024;
+
   explicit Txt(std::string path, std::string cacheBasePath);
+  ~Txt();
+  Txt(const Txt&) = delete;
+  Txt& operator=(const Txt&) = delete;
 
   bool load();
   [[nodiscard]] const std::string& getPath() const { return filepath; }
@@ -30,4 +42,8 @@ class Txt {
 
   // Read content from file
   [[nodiscard]] bool readContent(uint8_t* buffer, size_t offset, size_t length) const;
+  // The length bytes from offset (fewer at the end of the file, at most READ_WINDOW_SIZE), out of a window kept over
+  // the file. The file stays open, and moving forward only reads what lies past the window, so paging through the
+  // file mostly reuses bytes already read. Valid until the next call, empty on a read error.
+  [[nodiscard]] std::string_view readWindow(size_t offset, size_t length);
 };
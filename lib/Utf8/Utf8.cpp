@@ -1,5 +1,7 @@
 #include "Utf8.h"
 
+#include <cstring>
+
 int utf8CodepointLen(const unsigned char c) {
   if (c < 0x80) return 1;          // 0xxxxxxx
   if ((c >> 5) == 0x6) return 2;   // 110xxxxx
@@ -8,11 +10,7 @@ int utf8CodepointLen(const unsigned char c) {
   return 1;                        // fallback for invalid
 }
 
-uint32_t utf8NextCodepoint(const unsigned char** string) {
-  if (**string == 0) {
-    return 0;
-  }
-
+uint32_t utf8DecodeMultibyte(const unsigned char** string) {
   const int bytes = utf8CodepointLen(**string);
   const uint8_t* chr = *string;
   *string += bytes;
@@ -30,6 +28,36 @@ uint32_t utf8NextCodepoint(const unsigned char** string) {
   return cp;
 }
 
+size_t utf8DecodeCodepoints(const char* text, const size_t length, uint32_t* out, const size_t capacity,
+                            size_t* used) {
+  const auto* const start = reinterpret_cast<const unsigned char*>(text);
+  const unsigned char* p = start;
+  const unsigned char* const end = start + length;
+  size_t count = 0;
+  while (count < capacity && p < end) {
+    if (end - p >= 4 && capacity - count >= 4) {
+      uint32_t word;
+      memcpy(&word, p, sizeof(word));
+      // Every byte 0x01 to 0x7F: none has its top bit set, and none is zero to borrow from its top bit
+      if (((word | (word - 0x01010101u)) & 0x80808080u) == 0) {
+        out[count] = p[0];
+        out[count + 1] = p[1];
+        out[count + 2] = p[2];
+        out[count + 3] = p[3];
+        count += 4;
+        p += 4;
+        continue;
+      }
+    }
+    if (*p == 0 || (*p >= 0x80 && utf8CodepointLen(*p) > end - p)) {
+      break;
+    }
+    out[count++] = utf8NextCodepoint(&p);
+  }
+  *used = static_cast<size_t>(p - start);
+  return count;
+}
+
 size_t utf8RemoveLastChar(std::string& str) {
   if (str.empty()) return 0;
   size_t pos = str.size() - 1;
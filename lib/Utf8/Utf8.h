@@ -1,10 +1,30 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #define REPLACEMENT_GLYPH 0xFFFD
 
-uint32_t utf8NextCodepoint(const unsigned char** string);
+// Decodes the sequence of the non-ASCII lead byte string points at, advancing past it
+uint32_t utf8DecodeMultibyte(const unsigned char** string);
+
+// Decodes the codepoint string points at and advances past it, or returns 0 at the terminator. ASCII is decoded
+// inline, so the text loops only call out for the other scripts.
+inline uint32_t utf8NextCodepoint(const unsigned char** string) {
+  const unsigned char c = **string;
+  if (c < 0x80) {
+    if (c != 0) {
+      ++*string;
+    }
+    return c;
+  }
+  return utf8DecodeMultibyte(string);
+}
+
+// Decodes up to capacity codepoints of the first length bytes of text into out, returning how many and setting *used
+// to the bytes they took up. It stops early at a terminator or a sequence cut short by the end. Runs of ASCII are
+// taken a word at a time: four bytes checked with one mask and widened without decoding.
+size_t utf8DecodeCodepoints(const char* text, size_t length, uint32_t* out, size_t capacity, size_t* used);
 // Remove the last UTF-8 codepoint from a std::string and return the new size.
 size_t utf8RemoveLastChar(std::string& str);
 // Truncate string by removing N UTF-8 codepoints from the end.
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <BookCacheKey.h>
+
 #include <memory>
 #include <string>
 #include <vector>
@@ -26,10 +28,12 @@ class Xtc {
   std::unique_ptr<xtc::XtcParser> parser;
   bool loaded;
 
+  // Thumbnail from the one stored in the file, if it has one at least as large as the card
+  bool generateThumbBmpFromEmbedded(int height) const;
+
  public:
   explicit Xtc(std::string filepath, const std::string& cacheDir) : filepath(std::move(filepath)), loaded(false) {
-    // Create cache key based on filepath (same as Epub)
-    cachePath = cacheDir + "/xtc_" + std::to_string(std::hash<std::string>{}(this->filepath));
+    cachePath = BookCacheKey::cachePath(this->filepath, cacheDir, "xtc_");
   }
   ~Xtc() = default;
 
@@ -0,0 +1,154 @@
+/**
+ * XtcPageStash.cpp
+ *
+ * PackBits compression of stashed page bitmaps
+ * XTC ebook support for CrossPoint Reader
+ */
+
+#include "XtcPageStash.h"
+
+#include <Logging.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace xtc {
+
+namespace {
+// PackBits: a control byte n below 128 is followed by n + 1 literal bytes, one above 128 by a byte repeated 257 - n
+// times
+constexpr uint8_t MAX_BLOCK = 128;
+constexpr uint8_t MIN_RUN = 3;  // Shorter runs are cheaper as literals
+constexpr size_t REPLAY_CHUNK = 512;
+}  // namespace
+
+PageStash::~PageStash() { release(); }
+
+bool PageStash::begin(const uint32_t pageIndex) {
+  clear();
+  if (!m_data) {
+    m_data = static_cast<uint8_t*>(malloc(CAPACITY));
+    if (!m_data) {
+      LOG_ERR("XTC", "Failed to allocate %zu byte page stash", CAPACITY);
+      return false;
+    }
+  }
+  m_page = pageIndex;
+  m_state = State::Filling;
+  return true;
+}
+
+void PageStash::clear() {
+  m_state = State::Empty;
+  m_size = 0;
+  m_rawSize = 0;
+  m_literalLength = 0;
+  m_runLength = 0;
+}
+
+void PageStash::release() {
+  clear();
+  free(m_data);
+  m_data = nullptr;
+}
+
+bool PageStash::put(const uint8_t byte) {
+  if (m_size >= CAPACITY) {
+    m_state = State::Empty;
+    return false;
+  }
+  m_data[m_size++] = byte;
+  return true;
+}
+
+// Writes out the pending run, as a repeat block if it's long enough and into the literal block otherwise
+void PageStash::endRun() {
+  if (m_runLength >= MIN_RUN) {
+    m_literalLength = 0;
+    if (put(static_cast<uint8_t>(257 - m_runLength))) {
+      put(m_runByte);
+    }
+  } else {
+    for (uint8_t i = 0; i < m_runLength && m_state == State::Filling; i++) {
+      if (m_literalLength == 0) {
+        m_literalStart = m_size;
+        if (!put(0)) {
+          break;
+        }
+      }
+      if (!put(m_runByte)) {
+        break;
+      }
+      m_data[m_literalStart] = m_literalLength++;
+      if (m_literalLength == MAX_BLOCK) {
+        m_literalLength = 0;
+      }
+    }
+  }
+  m_runLength = 0;
+}
+
+void PageStash::append(const uint8_t* data, const size_t size) {
+  if (m_state != State::Filling) {
+    return;
+  }
+  for (size_t i = 0; i < size && m_state == State::Filling; i++) {
+    if (m_runLength > 0 && (data[i] != m_runByte || m_runLength == MAX_BLOCK)) {
+      endRun();
+    }
+    m_runByte = data[i];
+    m_runLength++;
+  }
+  m_rawSize += size;
+}
+
+void PageStash::finish(const size_t bitmapSize) {
+  if (m_state != State::Filling) {
+    return;
+  }
+  endRun();
+  if (m_state != State::Filling || m_rawSize != bitmapSize) {
+    LOG_DBG("XTC", "Page %lu not stashed (%zu of %zu bytes)", m_page, m_rawSize, bitmapSize);
+    clear();
+    return;
+  }
+  m_state = State::Complete;
+  LOG_DBG("XTC", "Stashed page %lu in %zu bytes", m_page, m_size);
+}
+
+void PageStash::replay(const std::function<void(const uint8_t* data, size_t size, size_t offset)>& callback) const {
+  if (m_state != State::Complete) {
+    return;
+  }
+  uint8_t chunk[REPLAY_CHUNK];
+  size_t filled = 0;
+  size_t offset = 0;
+  const auto emit = [&](const uint8_t byte) {
+    chunk[filled++] = byte;
+    if (filled == REPLAY_CHUNK) {
+      callback(chunk, filled, offset);
+      offset += filled;
+      filled = 0;
+    }
+  };
+
+  size_t pos = 0;
+  while (pos < m_size) {
+    const uint8_t control = m_data[pos++];
+    if (control < MAX_BLOCK) {
+      for (int i = 0; i <= control; i++) {
+        emit(m_data[pos++]);
+      }
+    } else {
+      const uint8_t byte = m_data[pos++];
+      for (int i = 0; i < 257 - control; i++) {
+        emit(byte);
+      }
+    }
+  }
+  if (filled > 0) {
+    callback(chunk, filled, offset);
+  }
+}
+
+}  // namespace xtc
@@ -0,0 +1,70 @@
+/**
+ * XtcPageStash.h
+ *
+ * Page bitmaps kept in RAM between page turns
+ * XTC ebook support for CrossPoint Reader
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace xtc {
+
+/**
+ * Page Stash
+ *
+ * Holds the bitmap of one page, PackBits compressed: the white margins and gaps of a text page shrink to a few
+ * bytes, so it takes a fraction of the 48KB (XTG) or 96KB (XTH) it has in the file. It is filled with the chunks
+ * XtcParser::loadPageStreaming hands out and replayed the same way. Pages that don't fit aren't kept.
+ */
+class PageStash {
+ public:
+  static constexpr size_t CAPACITY = 24 * 1024;
+
+  PageStash() = default;
+  ~PageStash();
+  PageStash(const PageStash&) = delete;
+  PageStash& operator=(const PageStash&) = delete;
+
+  // Starts stashing a page, dropping the one held before. False if the buffer can't be allocated.
+  bool begin(uint32_t pageIndex);
+  // Next bytes of the page's bitmap
+  void append(const uint8_t* data, size_t size);
+  // Keeps the page if all bitmapSize bytes of it fitted
+  void finish(size_t bitmapSize);
+  void clear();
+  // Also frees the buffer
+  void release();
+
+  bool holds(uint32_t pageIndex) const { return m_state == State::Complete && m_page == pageIndex; }
+  size_t getCompressedSize() const { return m_size; }
+
+  /**
+   * Replay the stashed page
+   *
+   * @param callback Receives the bitmap in chunks, as from XtcParser::loadPageStreaming
+   */
+  void replay(const std::function<void(const uint8_t* data, size_t size, size_t offset)>& callback) const;
+
+ private:
+  enum class State : uint8_t { Empty, Filling, Complete };
+
+  uint8_t* m_data = nullptr;
+  size_t m_size = 0;     // Compressed bytes written
+  size_t m_rawSize = 0;  // Bitmap bytes taken in
+  uint32_t m_page = 0;
+  State m_state = State::Empty;
+  // Encoder state: the open literal block (its control byte in m_data) and the run of equal bytes after it
+  size_t m_literalStart = 0;
+  uint8_t m_literalLength = 0;
+  uint8_t m_runByte = 0;
+  uint8_t m_runLength = 0;
+
+  bool put(uint8_t byte);
+  void endRun();
+};
+
+}  // namespace xtc
@@ -11,10 +11,40 @@
 #include <HalStorage.h>
 #include <Logging.h>
 
+#include <InflateReader.h>
+
+#include <algorithm>
 #include <cstring>
+#include <memory>
 
 namespace xtc {
 
+namespace {
+// Compressed bytes read from the file at a time
+constexpr size_t PAGE_INFLATE_INPUT_SIZE = 1024;
+
+struct PageInflateCtx {
+  InflateReader reader;  // Must be first — callback casts uzlib_uncomp* to PageInflateCtx*
+  FsFile* file = nullptr;
+  size_t remaining = 0;  // Compressed bytes not read yet
+  uint8_t* input = nullptr;
+};
+
+int pageInflateRead(uzlib_uncomp* uncomp) {
+  auto* ctx = reinterpret_cast<PageInflateCtx*>(uncomp);
+  if (ctx->remaining == 0) return -1;
+
+  const size_t toRead = std::min(ctx->remaining, PAGE_INFLATE_INPUT_SIZE);
+  const size_t bytesRead = ctx->file->read(ctx->input, toRead);
+  if (bytesRead == 0 || bytesRead > toRead) return -1;
+  ctx->remaining -= bytesRead;
+
+  uncomp->source = ctx->input + 1;
+  uncomp->source_limit = ctx->input + bytesRead;
+  return ctx->input[0];
+}
+}  // namespace
+
 XtcParser::XtcParser()
     : m_isOpen(false),
       m_defaultWidth(DISPLAY_WIDTH),
@@ -90,6 +120,7 @@ void XtcParser::close() {
     m_isOpen = false;
   }
   m_pageTable.clear();
+  m_pageTableFirst = 0;
   m_chapters.clear();
   m_title.clear();
   m_hasChapters = false;
@@ -169,40 +200,47 @@ XtcError XtcParser::readPageTable() {
     return XtcError::CORRUPTED_HEADER;
   }
 
-  // Seek to page table
-  if (!m_file.seek(m_header.pageTableOffset)) {
-    LOG_DBG("XTC", "Failed to seek to page table at %llu", m_header.pageTableOffset);
-    return XtcError::READ_ERROR;
+  // Entries are read a window at a time as pages are looked up, see loadPageTableWindow(). Here the table is only
+  // checked to be all there, and the first window read for the page size.
+  const uint64_t tableEnd =
+      m_header.pageTableOffset + static_cast<uint64_t>(m_header.pageCount) * sizeof(PageTableEntry);
+  if (tableEnd > m_file.size()) {
+    LOG_DBG("XTC", "Page table of %u entries at %llu is cut off", m_header.pageCount, m_header.pageTableOffset);
+    return XtcError::CORRUPTED_HEADER;
   }
 
-  m_pageTable.resize(m_header.pageCount);
-
-  // Read page table entries
-  for (uint16_t i = 0; i < m_header.pageCount; i++) {
-    PageTableEntry entry;
-    size_t bytesRead = m_file.read(reinterpret_cast<uint8_t*>(&entry), sizeof(PageTableEntry));
-    if (bytesRead != sizeof(PageTableEntry)) {
-      LOG_DBG("XTC", "Failed to read page table entry %u", i);
+  m_pageTable.clear();
+  m_pageTableFirst = 0;
+  if (m_header.pageCount > 0) {
+    if (!loadPageTableWindow(0)) {
       return XtcError::READ_ERROR;
     }
-
-    m_pageTable[i].offset = static_cast<uint32_t>(entry.dataOffset);
-    m_pageTable[i].size = entry.dataSize;
-    m_pageTable[i].width = entry.width;
-    m_pageTable[i].height = entry.height;
-    m_pageTable[i].bitDepth = m_bitDepth;
-
-    // Update default dimensions from first page
-    if (i == 0) {
-      m_defaultWidth = entry.width;
-      m_defaultHeight = entry.height;
-    }
+    // Default dimensions from first page
+    m_defaultWidth = m_pageTable[0].width;
+    m_defaultHeight = m_pageTable[0].height;
   }
 
-  LOG_DBG("XTC", "Read %u page table entries", m_header.pageCount);
+  LOG_DBG("XTC", "Page table: %u entries, %u read", m_header.pageCount, static_cast<unsigned>(m_pageTable.size()));
   return XtcError::OK;
 }
 
+bool XtcParser::loadPageTableWindow(const uint32_t pageIndex) {
+  // A few pages before the wanted one are kept too, for paging back
+  const uint32_t first = pageIndex > PAGE_TABLE_LOOKBACK ? pageIndex - PAGE_TABLE_LOOKBACK : 0;
+  const uint32_t count = std::min<uint32_t>(PAGE_TABLE_WINDOW, m_header.pageCount - first);
+
+  m_pageTable.resize(count);
+  const size_t bytes = count * sizeof(PageTableEntry);
+  if (!m_file.seek(m_header.pageTableOffset + static_cast<uint64_t>(first) * sizeof(PageTableEntry)) ||
+      m_file.read(reinterpret_cast<uint8_t*>(m_pageTable.data()), bytes) != static_cast<int>(bytes)) {
+    LOG_DBG("XTC", "Failed to read page table entries %u-%u", first, first + count - 1);
+    m_pageTable.clear();
+    return false;
+  }
+  m_pageTableFirst = first;
+  return true;
+}
+
 XtcError XtcParser::readChapters() {
   m_hasChapters = false;
   m_chapters.clear();
@@ -309,32 +347,43 @@ XtcError XtcParser::readChapters() {
   return XtcError::OK;
 }
 
-bool XtcParser::getPageInfo(uint32_t pageIndex, PageInfo& info) const {
-  if (pageIndex >= m_pageTable.size()) {
+bool XtcParser::getPageInfo(uint32_t pageIndex, PageInfo& info) {
+  if (pageIndex >= m_header.pageCount) {
     return false;
   }
-  info = m_pageTable[pageIndex];
+  if ((pageIndex < m_pageTableFirst || pageIndex >= m_pageTableFirst + m_pageTable.size()) &&
+      !loadPageTableWindow(pageIndex)) {
+    return false;
+  }
+
+  const PageTableEntry& entry = m_pageTable[pageIndex - m_pageTableFirst];
+  info.offset = static_cast<uint32_t>(entry.dataOffset);
+  info.size = entry.dataSize;
+  info.width = entry.width;
+  info.height = entry.height;
+  info.bitDepth = m_bitDepth;
+  info.padding = 0;
   return true;
 }
 
-size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSize) {
+XtcError XtcParser::readPageHeader(const uint32_t pageIndex, size_t& bitmapSize, size_t& compressedSize) {
   if (!m_isOpen) {
-    m_lastError = XtcError::FILE_NOT_FOUND;
-    return 0;
+    return XtcError::FILE_NOT_FOUND;
   }
 
   if (pageIndex >= m_header.pageCount) {
-    m_lastError = XtcError::PAGE_OUT_OF_RANGE;
-    return 0;
+    return XtcError::PAGE_OUT_OF_RANGE;
   }
 
-  const PageInfo& page = m_pageTable[pageIndex];
+  PageInfo page;
+  if (!getPageInfo(pageIndex, page)) {
+    return XtcError::READ_ERROR;
+  }
 
   // Seek to page data
   if (!m_file.seek(page.offset)) {
     LOG_DBG("XTC", "Failed to seek to page %u at offset %lu", pageIndex, page.offset);
-    m_lastError = XtcError::READ_ERROR;
-    return 0;
+    return XtcError::READ_ERROR;
   }
 
   // Read page header (XTG for 1-bit, XTH for 2-bit - same structure)
@@ -342,23 +391,21 @@ size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSiz
   size_t headerRead = m_file.read(reinterpret_cast<uint8_t*>(&pageHeader), sizeof(XtgPageHeader));
   if (headerRead != sizeof(XtgPageHeader)) {
     LOG_DBG("XTC", "Failed to read page header for page %u", pageIndex);
-    m_lastError = XtcError::READ_ERROR;
-    return 0;
+    return XtcError::READ_ERROR;
   }
 
-  // Verify page magic (XTG for 1-bit, XTH for 2-bit)
+  // Verify page magic (XTG for 1-bit, XTH for 2-bit, or their compressed XTGZ/XTHZ)
   const uint32_t expectedMagic = (m_bitDepth == 2) ? XTH_MAGIC : XTG_MAGIC;
-  if (pageHeader.magic != expectedMagic) {
+  const uint32_t compressedMagic = (m_bitDepth == 2) ? XTHZ_MAGIC : XTGZ_MAGIC;
+  if (pageHeader.magic != expectedMagic && pageHeader.magic != compressedMagic) {
     LOG_DBG("XTC", "Invalid page magic for page %u: 0x%08X (expected 0x%08X)", pageIndex, pageHeader.magic,
             expectedMagic);
-    m_lastError = XtcError::INVALID_MAGIC;
-    return 0;
+    return XtcError::INVALID_MAGIC;
   }
 
   // Calculate bitmap size based on bit depth
   // XTG (1-bit): Row-major, ((width+7)/8) * height bytes
   // XTH (2-bit): Two bit planes, column-major, ((width * height + 7) / 8) * 2 bytes
-  size_t bitmapSize;
   if (m_bitDepth == 2) {
     // XTH: two bit planes, each containing (width * height) bits rounded up to bytes
     bitmapSize = ((static_cast<size_t>(pageHeader.width) * pageHeader.height + 7) / 8) * 2;
@@ -366,6 +413,25 @@ size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSiz
     bitmapSize = ((pageHeader.width + 7) / 8) * pageHeader.height;
   }
 
+  compressedSize = 0;
+  if (pageHeader.magic == compressedMagic) {
+    if (pageHeader.compression != PAGE_COMPRESSION_DEFLATE || pageHeader.dataSize == 0) {
+      LOG_DBG("XTC", "Unsupported compression %u for page %u", pageHeader.compression, pageIndex);
+      return XtcError::DECOMPRESSION_ERROR;
+    }
+    compressedSize = pageHeader.dataSize;
+  }
+  return XtcError::OK;
+}
+
+size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSize) {
+  size_t bitmapSize = 0;
+  size_t compressedSize = 0;
+  m_lastError = readPageHeader(pageIndex, bitmapSize, compressedSize);
+  if (m_lastError != XtcError::OK) {
+    return 0;
+  }
+
   // Check buffer size
   if (bufferSize < bitmapSize) {
     LOG_DBG("XTC", "Buffer too small: need %u, have %u", bitmapSize, bufferSize);
@@ -373,6 +439,28 @@ size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSiz
     return 0;
   }
 
+  if (compressedSize > 0) {
+    // The whole bitmap is inflated into the buffer, so back-references can point into it and no window is needed
+    ChunkBufferLease inputLease;
+    auto ctx = std::unique_ptr<PageInflateCtx>(new PageInflateCtx());
+    if (!inputLease.acquire(PAGE_INFLATE_INPUT_SIZE) || !ctx->reader.init(false)) {
+      LOG_DBG("XTC", "Inflate buffers busy for page %u", pageIndex);
+      m_lastError = XtcError::MEMORY_ERROR;
+      return 0;
+    }
+    ctx->file = &m_file;
+    ctx->remaining = compressedSize;
+    ctx->input = inputLease.get();
+    ctx->reader.setReadCallback(pageInflateRead);
+    if (!ctx->reader.read(buffer, bitmapSize)) {
+      LOG_DBG("XTC", "Failed to inflate page %u", pageIndex);
+      m_lastError = XtcError::DECOMPRESSION_ERROR;
+      return 0;
+    }
+    m_lastError = XtcError::OK;
+    return bitmapSize;
+  }
+
   // Read bitmap data
   size_t bytesRead = m_file.read(buffer, bitmapSize);
   if (bytesRead != bitmapSize) {
@@ -385,46 +473,112 @@ size_t XtcParser::loadPage(uint32_t pageIndex, uint8_t* buffer, size_t bufferSiz
   return bytesRead;
 }
 
-XtcError XtcParser::loadPageStreaming(uint32_t pageIndex,
-                                      std::function<void(const uint8_t* data, size_t size, size_t offset)> callback,
-                                      size_t chunkSize) {
-  if (!m_isOpen) {
-    return XtcError::FILE_NOT_FOUND;
+bool XtcParser::getThumbnailInfo(PageInfo& info) {
+  if (!m_isOpen || !m_header.hasThumbnails || m_header.thumbOffset == 0) {
+    return false;
   }
 
-  if (pageIndex >= m_header.pageCount) {
-    return XtcError::PAGE_OUT_OF_RANGE;
+  XtgPageHeader thumbHeader;
+  const uint64_t fileSize = m_file.size();
+  if (m_header.thumbOffset + sizeof(XtgPageHeader) > fileSize || !m_file.seek(m_header.thumbOffset) ||
+      m_file.read(reinterpret_cast<uint8_t*>(&thumbHeader), sizeof(XtgPageHeader)) != sizeof(XtgPageHeader)) {
+    LOG_DBG("XTC", "Failed to read thumbnail header at offset %llu", m_header.thumbOffset);
+    return false;
   }
 
-  const PageInfo& page = m_pageTable[pageIndex];
-
-  // Seek to page data
-  if (!m_file.seek(page.offset)) {
-    return XtcError::READ_ERROR;
+  // Only raw images: a thumbnail is small enough that compressing it saves little
+  if (thumbHeader.magic != XTG_MAGIC && thumbHeader.magic != XTH_MAGIC) {
+    LOG_DBG("XTC", "Invalid thumbnail magic: 0x%08X", thumbHeader.magic);
+    return false;
   }
-
-  // Read and skip page header (XTG for 1-bit, XTH for 2-bit)
-  XtgPageHeader pageHeader;
-  size_t headerRead = m_file.read(reinterpret_cast<uint8_t*>(&pageHeader), sizeof(XtgPageHeader));
-  const uint32_t expectedMagic = (m_bitDepth == 2) ? XTH_MAGIC : XTG_MAGIC;
-  if (headerRead != sizeof(XtgPageHeader) || pageHeader.magic != expectedMagic) {
-    return XtcError::READ_ERROR;
+  if (thumbHeader.width == 0 || thumbHeader.height == 0 || thumbHeader.width > DISPLAY_WIDTH ||
+      thumbHeader.height > DISPLAY_HEIGHT) {
+    LOG_DBG("XTC", "Invalid thumbnail size %ux%u", thumbHeader.width, thumbHeader.height);
+    return false;
   }
 
-  // Calculate bitmap size based on bit depth
-  // XTG (1-bit): Row-major, ((width+7)/8) * height bytes
-  // XTH (2-bit): Two bit planes, ((width * height + 7) / 8) * 2 bytes
+  const uint8_t bitDepth = (thumbHeader.magic == XTH_MAGIC) ? 2 : 1;
   size_t bitmapSize;
-  if (m_bitDepth == 2) {
-    bitmapSize = ((static_cast<size_t>(pageHeader.width) * pageHeader.height + 7) / 8) * 2;
+  if (bitDepth == 2) {
+    bitmapSize = ((static_cast<size_t>(thumbHeader.width) * thumbHeader.height + 7) / 8) * 2;
   } else {
-    bitmapSize = ((pageHeader.width + 7) / 8) * pageHeader.height;
+    bitmapSize = ((thumbHeader.width + 7) / 8) * thumbHeader.height;
+  }
+  const uint64_t dataOffset = m_header.thumbOffset + sizeof(XtgPageHeader);
+  if (dataOffset + bitmapSize > fileSize) {
+    LOG_DBG("XTC", "Thumbnail of %u bytes at offset %llu is cut off", bitmapSize, dataOffset);
+    return false;
+  }
+
+  info.offset = static_cast<uint32_t>(dataOffset);
+  info.size = static_cast<uint32_t>(bitmapSize);
+  info.width = thumbHeader.width;
+  info.height = thumbHeader.height;
+  info.bitDepth = bitDepth;
+  info.padding = 0;
+  return true;
+}
+
+size_t XtcParser::loadThumbnail(uint8_t* buffer, const size_t bufferSize) {
+  // Leaves the file right after the thumbnail's header
+  PageInfo info;
+  if (!getThumbnailInfo(info)) {
+    return 0;
+  }
+  if (bufferSize < info.size) {
+    LOG_DBG("XTC", "Buffer too small: need %u, have %u", info.size, bufferSize);
+    return 0;
+  }
+  const size_t bytesRead = m_file.read(buffer, info.size);
+  if (bytesRead != info.size) {
+    LOG_DBG("XTC", "Thumbnail read error: expected %u, got %u", info.size, bytesRead);
+    return 0;
+  }
+  return bytesRead;
+}
+
+XtcError XtcParser::loadPageStreaming(uint32_t pageIndex,
+                                      std::function<void(const uint8_t* data, size_t size, size_t offset)> callback,
+                                      size_t chunkSize) {
+  size_t bitmapSize = 0;
+  size_t compressedSize = 0;
+  const XtcError error = readPageHeader(pageIndex, bitmapSize, compressedSize);
+  if (error != XtcError::OK) {
+    return error;
   }
 
   // Read in chunks
   std::vector<uint8_t> chunk(chunkSize);
   size_t totalRead = 0;
 
+  if (compressedSize > 0) {
+    // Inflated a chunk at a time, through the shared inflate window
+    ChunkBufferLease inputLease;
+    auto ctx = std::unique_ptr<PageInflateCtx>(new PageInflateCtx());
+    if (!inputLease.acquire(PAGE_INFLATE_INPUT_SIZE) || !ctx->reader.init(true)) {
+      LOG_DBG("XTC", "Inflate buffers busy for page %u", pageIndex);
+      return XtcError::MEMORY_ERROR;
+    }
+    ctx->file = &m_file;
+    ctx->remaining = compressedSize;
+    ctx->input = inputLease.get();
+    ctx->reader.setReadCallback(pageInflateRead);
+
+    while (totalRead < bitmapSize) {
+      size_t produced = 0;
+      const InflateStatus status =
+          ctx->reader.readAtMost(chunk.data(), std::min(chunkSize, bitmapSize - totalRead), &produced);
+      if (status == InflateStatus::Error || produced == 0) {
+        LOG_DBG("XTC", "Failed to inflate page %u after %u bytes", pageIndex, totalRead);
+        return XtcError::DECOMPRESSION_ERROR;
+      }
+
+      callback(chunk.data(), produced, totalRead);
+      totalRead += produced;
+    }
+    return XtcError::OK;
+  }
+
   while (totalRead < bitmapSize) {
     size_t toRead = std::min(chunkSize, bitmapSize - totalRead);
     size_t bytesRead = m_file.read(chunk.data(), toRead);
@@ -26,6 +26,10 @@ namespace xtc {
  */
 class XtcParser {
  public:
+  // Page table entries kept in RAM, and how many of them come before the page they were read for
+  static constexpr uint32_t PAGE_TABLE_WINDOW = 64;
+  static constexpr uint32_t PAGE_TABLE_LOOKBACK = 8;
+
   XtcParser();
   ~XtcParser();
 
@@ -41,8 +45,8 @@ class XtcParser {
   uint16_t getHeight() const { return m_defaultHeight; }
   uint8_t getBitDepth() const { return m_bitDepth; }  // 1 = XTC/XTG, 2 = XTCH/XTH
 
-  // Page information
-  bool getPageInfo(uint32_t pageIndex, PageInfo& info) const;
+  // Page information, fetching its part of the page table if it isn't in RAM
+  bool getPageInfo(uint32_t pageIndex, PageInfo& info);
 
   /**
    * Load page bitmap (raw 1-bit data, skipping XTG header)
@@ -67,6 +71,12 @@ class XtcParser {
                              std::function<void(const uint8_t* data, size_t size, size_t offset)> callback,
                              size_t chunkSize = 1024);
 
+  // The thumbnail stored in the file: an uncompressed XTG or XTH image at the header's thumbOffset, its bit depth
+  // given by its own magic. False if the file has none or it doesn't look like one.
+  bool getThumbnailInfo(PageInfo& info);
+  // Reads the thumbnail's bitmap like loadPage() does a page's; 0 on failure
+  size_t loadThumbnail(uint8_t* buffer, size_t bufferSize);
+
   // Get title/author from metadata
   std::string getTitle() const { return m_title; }
   std::string getAuthor() const { return m_author; }
@@ -84,7 +94,9 @@ class XtcParser {
   FsFile m_file;
   bool m_isOpen;
   XtcHeader m_header;
-  std::vector<PageInfo> m_pageTable;
+  // Window of the page table, from page m_pageTableFirst on
+  std::vector<PageTableEntry> m_pageTable;
+  uint32_t m_pageTableFirst = 0;
   std::vector<ChapterInfo> m_chapters;
   std::string m_title;
   std::string m_author;
@@ -95,8 +107,11 @@ class XtcParser {
   XtcError m_lastError;
 
   // Internal helper functions
+  // Seeks to the page and reads its header; compressedSize is 0 for raw pages
+  XtcError readPageHeader(uint32_t pageIndex, size_t& bitmapSize, size_t& compressedSize);
   XtcError readHeader();
   XtcError readPageTable();
+  bool loadPageTableWindow(uint32_t pageIndex);
   XtcError readTitle();
   XtcError readAuthor();
   XtcError readChapters();
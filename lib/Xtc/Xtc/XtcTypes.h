@@ -26,6 +26,14 @@ constexpr uint32_t XTCH_MAGIC = 0x48435458;  // "XTCH" in little-endian (2-bit h
 constexpr uint32_t XTG_MAGIC = 0x00475458;  // "XTG\0" for 1-bit page data
 // "XTH\0" = 0x58, 0x54, 0x48, 0x00
 constexpr uint32_t XTH_MAGIC = 0x00485458;  // "XTH\0" for 2-bit page data
+// "XTGZ" / "XTHZ": the same pages with a compressed bitmap, see XtgPageHeader::compression. A new magic rather than
+// just the compression field, so readers that only know the raw pages reject them instead of drawing garbage.
+constexpr uint32_t XTGZ_MAGIC = 0x5A475458;  // "XTGZ" for compressed 1-bit page data
+constexpr uint32_t XTHZ_MAGIC = 0x5A485458;  // "XTHZ" for compressed 2-bit page data
+
+// XtgPageHeader::compression of XTGZ/XTHZ pages: the bitmap is one raw DEFLATE stream (RFC 1951, no zlib header) of
+// dataSize bytes
+constexpr uint8_t PAGE_COMPRESSION_DEFLATE = 1;
 
 // XTeink X4 display resolution
 constexpr uint16_t DISPLAY_WIDTH = 480;
@@ -70,8 +78,8 @@ struct XtgPageHeader {
   uint16_t width;       // 0x04: Image width (pixels)
   uint16_t height;      // 0x06: Image height (pixels)
   uint8_t colorMode;    // 0x08: Color mode (0=monochrome)
-  uint8_t compression;  // 0x09: Compression (0=uncompressed)
-  uint32_t dataSize;    // 0x0A: Image data size (bytes)
+  uint8_t compression;  // 0x09: Compression (0=uncompressed, PAGE_COMPRESSION_DEFLATE for XTGZ/XTHZ)
+  uint32_t dataSize;    // 0x0A: Image data size (bytes, compressed size for XTGZ/XTHZ)
   uint64_t md5;         // 0x0E: MD5 checksum (first 8 bytes, optional)
   // Followed by bitmap data at offset 0x16 (22)
   //
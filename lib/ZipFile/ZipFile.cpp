@@ -3,8 +3,11 @@
 #include <HalStorage.h>
 #include <InflateReader.h>
 #include <Logging.h>
+#include <Trace.h>
 
 #include <algorithm>
+#include <cstring>
+#include <utility>
 
 struct ZipInflateCtx {
   InflateReader reader;  // Must be first — callback casts uzlib_uncomp* to ZipInflateCtx*
@@ -18,12 +21,20 @@ namespace {
 constexpr uint16_t ZIP_METHOD_STORED = 0;
 constexpr uint16_t ZIP_METHOD_DEFLATED = 8;
 
+constexpr uint32_t ZIP_INDEX_MAGIC = 0x31585a49;  // "IZX1"
+// magic, zip size, entry count
+constexpr uint32_t ZIP_INDEX_HEADER_SIZE = 12;
+constexpr uint32_t ZIP_INDEX_PAGE_ENTRIES = 32;
+constexpr uint32_t ZIP_INDEX_BUILD_BATCH = 512;
+
 int zipReadCallback(uzlib_uncomp* uncomp) {
   auto* ctx = reinterpret_cast<ZipInflateCtx*>(uncomp);
   if (ctx->fileRemaining == 0) return -1;
 
   const size_t toRead = ctx->fileRemaining < ctx->readBufSize ? ctx->fileRemaining : ctx->readBufSize;
+  TRACE_BEGIN(SdRead, toRead);
   const size_t bytesRead = ctx->file->read(ctx->readBuf, toRead);
+  TRACE_END(SdRead);
   ctx->fileRemaining -= bytesRead;
 
   if (bytesRead == 0) return -1;
@@ -34,70 +45,203 @@ int zipReadCallback(uzlib_uncomp* uncomp) {
 }
 }  // namespace
 
-bool ZipFile::loadAllFileStatSlims() {
-  const bool wasOpen = isOpen();
-  if (!wasOpen && !open()) {
+ZipFile::ZipFile(const std::string& filePath, std::string indexPath)
+    : filePath(filePath), indexPath(std::move(indexPath)) {}
+
+ZipFile::~ZipFile() {
+  endEntryStream();
+  if (indexFile) {
+    indexFile.close();
+  }
+}
+
+bool ZipFile::readIndexHeader(const uint32_t zipSize) {
+  if (!Storage.exists(indexPath.c_str()) || !Storage.openFileForRead("ZIP", indexPath, indexFile)) {
     return false;
   }
 
-  if (!loadZipDetails()) {
-    if (!wasOpen) {
-      close();
-    }
+  uint32_t magic = 0;
+  uint32_t indexedZipSize = 0;
+  indexCount = 0;
+  indexFile.read(&magic, 4);
+  indexFile.read(&indexedZipSize, 4);
+  indexFile.read(&indexCount, 4);
+  if (magic != ZIP_INDEX_MAGIC || indexedZipSize != zipSize) {
+    LOG_DBG("ZIP", "Stale zip index %s", indexPath.c_str());
+    indexFile.close();
     return false;
   }
 
-  file.seek(zipDetails.centralDirOffset);
+  // Page hashes follow the entries
+  const uint32_t pageCount = (indexCount + ZIP_INDEX_PAGE_ENTRIES - 1) / ZIP_INDEX_PAGE_ENTRIES;
+  indexPageHashes.resize(pageCount);
+  if (!indexFile.seek(ZIP_INDEX_HEADER_SIZE + indexCount * sizeof(IndexEntry)) ||
+      indexFile.read(indexPageHashes.data(), pageCount * sizeof(uint64_t)) !=
+          static_cast<int>(pageCount * sizeof(uint64_t))) {
+    LOG_ERR("ZIP", "Truncated zip index %s", indexPath.c_str());
+    indexPageHashes.clear();
+    indexFile.close();
+    return false;
+  }
+  return true;
+}
 
-  uint32_t sig;
+bool ZipFile::buildIndex(const uint32_t zipSize) {
+  if (!loadZipDetails()) {
+    return false;
+  }
+
+  FsFile out;
+  if (!Storage.openFileForWrite("ZIP", indexPath, out)) {
+    return false;
+  }
+  const unsigned long start = millis();
+
+  // Header is rewritten with the entry count at the end
+  uint32_t count = 0;
+  out.write(reinterpret_cast<const uint8_t*>(&ZIP_INDEX_MAGIC), 4);
+  out.write(reinterpret_cast<const uint8_t*>(&zipSize), 4);
+  out.write(reinterpret_cast<const uint8_t*>(&count), 4);
+
+  // Entries are sorted one slice of the hash range at a time, re-reading the central directory for each slice, so
+  // only about ZIP_INDEX_BUILD_BATCH of them are in RAM even for books with thousands of resources
+  const uint32_t passes = std::max<uint32_t>(
+      1, (zipDetails.totalEntries + ZIP_INDEX_BUILD_BATCH - 1) / ZIP_INDEX_BUILD_BATCH);
+  std::vector<IndexEntry> batch;
+  std::vector<uint64_t> pageHashes;
+  batch.reserve(std::min<uint32_t>(zipDetails.totalEntries, ZIP_INDEX_BUILD_BATCH));
   char itemName[256];
-  fileStatSlimCache.clear();
-  fileStatSlimCache.reserve(zipDetails.totalEntries);
+  bool ok = true;
+
+  for (uint32_t pass = 0; ok && pass < passes; pass++) {
+    const uint32_t lo = pass * 0x10000 / passes;
+    const uint32_t hi = (pass + 1) * 0x10000 / passes;
+
+    file.seek(zipDetails.centralDirOffset);
+    uint32_t sig;
+    while (file.available()) {
+      file.read(&sig, 4);
+      if (sig != 0x02014b50) break;  // End of list
+
+      IndexEntry entry = {};
+      file.seekCur(6);
+      file.read(&entry.method, 2);
+      file.seekCur(8);
+      file.read(&entry.compressedSize, 4);
+      file.read(&entry.uncompressedSize, 4);
+      uint16_t nameLen, m, k;
+      file.read(&nameLen, 2);
+      file.read(&m, 2);
+      file.read(&k, 2);
+      file.seekCur(8);
+      file.read(&entry.localHeaderOffset, 4);
+      if (nameLen >= sizeof(itemName)) {
+        // Can't be looked up by name either
+        file.seekCur(nameLen + m + k);
+        continue;
+      }
+      file.read(itemName, nameLen);
+      file.seekCur(m + k);
 
-  while (file.available()) {
-    file.read(&sig, 4);
-    if (sig != 0x02014b50) break;  // End of list
+      entry.hash = fnvHash64(itemName, nameLen);
+      entry.len = nameLen;
+      const uint32_t slice = entry.hash >> 48;
+      if (slice >= lo && slice < hi) {
+        batch.push_back(entry);
+      }
+    }
 
-    FileStatSlim fileStat = {};
+    std::sort(batch.begin(), batch.end(), [](const IndexEntry& a, const IndexEntry& b) {
+      return a.hash < b.hash || (a.hash == b.hash && a.len < b.len);
+    });
+    for (const auto& entry : batch) {
+      if (count % ZIP_INDEX_PAGE_ENTRIES == 0) {
+        pageHashes.push_back(entry.hash);
+      }
+      if (out.write(reinterpret_cast<const uint8_t*>(&entry), sizeof(entry)) != sizeof(entry)) {
+        ok = false;
+        break;
+      }
+      count++;
+    }
+    batch.clear();
+  }
 
-    file.seekCur(6);
-    file.read(&fileStat.method, 2);
-    file.seekCur(8);
-    file.read(&fileStat.compressedSize, 4);
-    file.read(&fileStat.uncompressedSize, 4);
-    uint16_t nameLen, m, k;
-    file.read(&nameLen, 2);
-    file.read(&m, 2);
-    file.read(&k, 2);
-    file.seekCur(8);
-    file.read(&fileStat.localHeaderOffset, 4);
-    file.read(itemName, nameLen);
-    itemName[nameLen] = '\0';
+  if (ok) {
+    const size_t pageBytes = pageHashes.size() * sizeof(uint64_t);
+    ok = out.write(reinterpret_cast<const uint8_t*>(pageHashes.data()), pageBytes) == pageBytes && out.seek(8) &&
+         out.write(reinterpret_cast<const uint8_t*>(&count), 4) == 4;
+  }
+  out.close();
+  if (!ok) {
+    LOG_ERR("ZIP", "Failed to write zip index %s", indexPath.c_str());
+    Storage.remove(indexPath.c_str());
+    return false;
+  }
 
-    fileStatSlimCache.emplace(itemName, fileStat);
+  // The scan moved the cursor
+  lastCentralDirPosValid = false;
+  LOG_DBG("ZIP", "Indexed %u entries in %u passes in %lu ms", count, passes, millis() - start);
+  return true;
+}
 
-    // Skip the rest of this entry (extra field + comment)
-    file.seekCur(m + k);
+bool ZipFile::loadIndex() {
+  if (indexChecked) {
+    return indexUsable;
   }
+  indexChecked = true;
 
-  // Set cursor to start of central directory for sequential access
-  lastCentralDirPos = zipDetails.centralDirOffset;
-  lastCentralDirPosValid = true;
-
+  const bool wasOpen = isOpen();
+  if (!wasOpen && !open()) {
+    return false;
+  }
+  const auto zipSize = static_cast<uint32_t>(file.size());
+  indexUsable = readIndexHeader(zipSize) || (buildIndex(zipSize) && readIndexHeader(zipSize));
   if (!wasOpen) {
     close();
   }
-  return true;
+  return indexUsable;
 }
 
-bool ZipFile::loadFileStatSlim(const char* filename, FileStatSlim* fileStat) {
-  if (!fileStatSlimCache.empty()) {
-    const auto it = fileStatSlimCache.find(filename);
-    if (it != fileStatSlimCache.end()) {
-      *fileStat = it->second;
+bool ZipFile::lookupIndex(const char* filename, FileStatSlim* fileStat) {
+  const size_t nameLen = strlen(filename);
+  const uint64_t hash = fnvHash64(filename, nameLen);
+
+  // Entries with this hash start in the last page whose first hash is below it, or in a page starting with it
+  const auto first = std::lower_bound(indexPageHashes.begin(), indexPageHashes.end(), hash);
+  const auto last = std::upper_bound(first, indexPageHashes.end(), hash);
+  const uint32_t firstPage = first == indexPageHashes.begin() ? 0 : first - indexPageHashes.begin() - 1;
+  const uint32_t endPage = std::max<uint32_t>(last - indexPageHashes.begin(), firstPage + 1);
+
+  IndexEntry entries[ZIP_INDEX_PAGE_ENTRIES];
+  for (uint32_t page = firstPage; page < endPage; page++) {
+    const uint32_t firstEntry = page * ZIP_INDEX_PAGE_ENTRIES;
+    if (firstEntry >= indexCount) break;
+    const uint32_t n = std::min<uint32_t>(ZIP_INDEX_PAGE_ENTRIES, indexCount - firstEntry);
+    if (!indexFile.seek(ZIP_INDEX_HEADER_SIZE + firstEntry * sizeof(IndexEntry)) ||
+        indexFile.read(entries, n * sizeof(IndexEntry)) != static_cast<int>(n * sizeof(IndexEntry))) {
+      LOG_ERR("ZIP", "Failed to read zip index %s", indexPath.c_str());
+      return false;
+    }
+
+    const IndexEntry key = {hash, static_cast<uint16_t>(nameLen), 0, 0, 0, 0};
+    const auto it = std::lower_bound(entries, entries + n, key, [](const IndexEntry& a, const IndexEntry& b) {
+      return a.hash < b.hash || (a.hash == b.hash && a.len < b.len);
+    });
+    if (it != entries + n && it->hash == hash && it->len == nameLen) {
+      fileStat->method = it->method;
+      fileStat->compressedSize = it->compressedSize;
+      fileStat->uncompressedSize = it->uncompressedSize;
+      fileStat->localHeaderOffset = it->localHeaderOffset;
       return true;
     }
-    return false;
+  }
+  return false;
+}
+
+bool ZipFile::loadFileStatSlim(const char* filename, FileStatSlim* fileStat) {
+  if (!indexPath.empty() && loadIndex()) {
+    return lookupIndex(filename, fileStat);
   }
 
   const bool wasOpen = isOpen();
@@ -307,10 +451,44 @@ bool ZipFile::getInflatedFileSize(const char* filename, size_t* size) {
   return true;
 }
 
+int ZipFile::fillUncompressedSizesFromIndex(const std::vector<SizeTarget>& targets, std::vector<uint32_t>& sizes) {
+  // The index and the targets are both sorted by (hash, len), so one walk through the index matches them all
+  const auto below = [](const SizeTarget& target, const IndexEntry& entry) {
+    return target.hash < entry.hash || (target.hash == entry.hash && target.len < entry.len);
+  };
+  int matched = 0;
+  auto target = targets.begin();
+  IndexEntry entries[ZIP_INDEX_PAGE_ENTRIES];
+  for (uint32_t firstEntry = 0; firstEntry < indexCount && target != targets.end();
+       firstEntry += ZIP_INDEX_PAGE_ENTRIES) {
+    const uint32_t n = std::min<uint32_t>(ZIP_INDEX_PAGE_ENTRIES, indexCount - firstEntry);
+    if (!indexFile.seek(ZIP_INDEX_HEADER_SIZE + firstEntry * sizeof(IndexEntry)) ||
+        indexFile.read(entries, n * sizeof(IndexEntry)) != static_cast<int>(n * sizeof(IndexEntry))) {
+      LOG_ERR("ZIP", "Failed to read zip index %s", indexPath.c_str());
+      break;
+    }
+    for (uint32_t i = 0; i < n && target != targets.end(); i++) {
+      while (target != targets.end() && below(*target, entries[i])) {
+        ++target;
+      }
+      for (auto it = target; it != targets.end() && it->hash == entries[i].hash && it->len == entries[i].len; ++it) {
+        if (it->index < sizes.size()) {
+          sizes[it->index] = entries[i].uncompressedSize;
+          matched++;
+        }
+      }
+    }
+  }
+  return matched;
+}
+
 int ZipFile::fillUncompressedSizes(std::vector<SizeTarget>& targets, std::vector<uint32_t>& sizes) {
   if (targets.empty()) {
     return 0;
   }
+  if (!indexPath.empty() && loadIndex()) {
+    return fillUncompressedSizesFromIndex(targets, sizes);
+  }
 
   const bool wasOpen = isOpen();
   if (!wasOpen && !open()) {
@@ -456,10 +634,11 @@ uint8_t* ZipFile::readFileToMemory(const char* filename, size_t* size, const boo
 
     bool success = false;
     {
-      InflateReader r;
-      r.init(false);
-      r.setSource(deflatedData, deflatedDataSize);
-      success = r.read(data, inflatedDataSize);
+      // With its Huffman lookup tables the decoder is too large for the stack
+      auto reader = std::unique_ptr<InflateReader>(new InflateReader());
+      reader->init(false);
+      reader->setSource(deflatedData, deflatedDataSize);
+      success = reader->read(data, inflatedDataSize);
     }
     free(deflatedData);
 
@@ -505,73 +684,62 @@ bool ZipFile::readFileToStream(const char* filename, Print& out, const size_t ch
 
   if (fileStat.method == ZIP_METHOD_STORED) {
     // no deflation, just read content
-    const auto buffer = static_cast<uint8_t*>(malloc(chunkSize));
-    if (!buffer) {
-      LOG_ERR("ZIP", "Failed to allocate memory for buffer");
+    ChunkBufferLease bufferLease;
+    if (!bufferLease.acquire(chunkSize)) {
+      LOG_ERR("ZIP", "Buffers busy, retry %s later", filename);
       if (!wasOpen) {
         close();
       }
       return false;
     }
+    uint8_t* buffer = bufferLease.get();
 
     size_t remaining = inflatedDataSize;
     while (remaining > 0) {
       const size_t dataRead = file.read(buffer, remaining < chunkSize ? remaining : chunkSize);
       if (dataRead == 0) {
         LOG_ERR("ZIP", "Could not read more bytes");
-        free(buffer);
         if (!wasOpen) {
           close();
         }
         return false;
       }
 
-      out.write(buffer, dataRead);
+      if (out.write(buffer, dataRead) != dataRead) {
+        LOG_ERR("ZIP", "Failed to write all output bytes to stream");
+        if (!wasOpen) {
+          close();
+        }
+        return false;
+      }
       remaining -= dataRead;
     }
 
     if (!wasOpen) {
       close();
     }
-    free(buffer);
     return true;
   }
 
   if (fileStat.method == ZIP_METHOD_DEFLATED) {
-    auto* fileReadBuffer = static_cast<uint8_t*>(malloc(chunkSize));
-    if (!fileReadBuffer) {
-      LOG_ERR("ZIP", "Failed to allocate memory for zip file read buffer");
+    ChunkBufferLease readLease;
+    ChunkBufferLease outputLease;
+    auto ctxOwner = std::unique_ptr<ZipInflateCtx>(new ZipInflateCtx());
+    ZipInflateCtx& ctx = *ctxOwner;
+    if (!readLease.acquire(chunkSize) || !outputLease.acquire(chunkSize) || !ctx.reader.init(true)) {
+      LOG_ERR("ZIP", "Inflate buffers busy, retry %s later", filename);
       if (!wasOpen) {
         close();
       }
       return false;
     }
+    uint8_t* outputBuffer = outputLease.get();
 
-    auto* outputBuffer = static_cast<uint8_t*>(malloc(chunkSize));
-    if (!outputBuffer) {
-      LOG_ERR("ZIP", "Failed to allocate memory for output buffer");
-      free(fileReadBuffer);
-      if (!wasOpen) {
-        close();
-      }
-      return false;
-    }
-
-    ZipInflateCtx ctx;
     ctx.file = &file;
     ctx.fileRemaining = deflatedDataSize;
-    ctx.readBuf = fileReadBuffer;
+    ctx.readBuf = readLease.get();
     ctx.readBufSize = chunkSize;
 
-    if (!ctx.reader.init(true)) {
-      LOG_ERR("ZIP", "Failed to init inflate reader");
-      free(outputBuffer);
-      free(fileReadBuffer);
-      if (!wasOpen) {
-        close();
-      }
-      return false;
-    }
     ctx.reader.setReadCallback(zipReadCallback);
 
     bool success = false;
@@ -616,9 +784,7 @@ bool ZipFile::readFileToStream(const char* filename, Print& out, const size_t ch
     if (!wasOpen) {
       close();
     }
-    free(outputBuffer);
-    free(fileReadBuffer);
-    return success;  // ctx.reader destructor frees the ring buffer
+    return success;  // the leases and ctx.reader hand their buffers back to the pool
   }
 
   if (!wasOpen) {
@@ -628,3 +794,147 @@ bool ZipFile::readFileToStream(const char* filename, Print& out, const size_t ch
   LOG_ERR("ZIP", "Unsupported compression method");
   return false;
 }
+
+bool ZipFile::beginEntryStream(const char* filename, const size_t readChunkSize) {
+  endEntryStream();
+
+  const bool wasOpen = isOpen();
+  if (!wasOpen && !open()) {
+    return false;
+  }
+
+  FileStatSlim fileStat = {};
+  if (!loadFileStatSlim(filename, &fileStat)) {
+    if (!wasOpen) {
+      close();
+    }
+    return false;
+  }
+
+  const long fileOffset = getDataOffset(fileStat);
+  if (fileOffset < 0) {
+    if (!wasOpen) {
+      close();
+    }
+    return false;
+  }
+
+  if (fileStat.method != ZIP_METHOD_STORED && fileStat.method != ZIP_METHOD_DEFLATED) {
+    LOG_ERR("ZIP", "Unsupported compression method");
+    if (!wasOpen) {
+      close();
+    }
+    return false;
+  }
+
+  file.seek(fileOffset);
+  streamDataOffset = fileOffset;
+  streamMethod = fileStat.method;
+  streamInflatedSize = fileStat.uncompressedSize;
+  streamProduced = 0;
+  streamDone = streamInflatedSize == 0;
+
+  if (streamMethod == ZIP_METHOD_DEFLATED) {
+    streamCtx.reset(new ZipInflateCtx());
+    if (!streamReadLease.acquire(readChunkSize) || !streamCtx->reader.init(true)) {
+      LOG_ERR("ZIP", "Inflate buffers busy, retry %s later", filename);
+      streamCtx.reset();
+      streamReadLease.release();
+      if (!wasOpen) {
+        close();
+      }
+      return false;
+    }
+    streamCtx->file = &file;
+    streamCtx->fileRemaining = fileStat.compressedSize;
+    streamCtx->readBuf = streamReadLease.get();
+    streamCtx->readBufSize = readChunkSize;
+    streamCtx->reader.setReadCallback(zipReadCallback);
+  }
+
+  streamClosesFile = !wasOpen;
+  streamActive = true;
+  return true;
+}
+
+int ZipFile::readEntryStream(uint8_t* dest, const size_t maxLen) {
+  if (!streamActive) {
+    LOG_ERR("ZIP", "readEntryStream called without an open entry stream");
+    return -1;
+  }
+  if (streamDone) {
+    return 0;
+  }
+
+  if (streamMethod == ZIP_METHOD_STORED) {
+    const size_t remaining = streamInflatedSize - streamProduced;
+    const size_t dataRead = file.read(dest, remaining < maxLen ? remaining : maxLen);
+    if (dataRead == 0) {
+      LOG_ERR("ZIP", "Could not read more bytes");
+      return -1;
+    }
+    streamProduced += dataRead;
+    streamDone = streamProduced == streamInflatedSize;
+    return static_cast<int>(dataRead);
+  }
+
+  size_t produced;
+  const InflateStatus status = streamCtx->reader.readAtMost(dest, maxLen, &produced);
+  streamProduced += produced;
+  if (status == InflateStatus::Error) {
+    LOG_ERR("ZIP", "Decompression failed");
+    return -1;
+  }
+  if (streamProduced > streamInflatedSize) {
+    LOG_ERR("ZIP", "Decompressed size exceeds expected (%u > %u)", streamProduced, streamInflatedSize);
+    return -1;
+  }
+  if (status == InflateStatus::Done) {
+    if (streamProduced != streamInflatedSize) {
+      LOG_ERR("ZIP", "Decompressed size mismatch (expected %u, got %u)", streamInflatedSize, streamProduced);
+      return -1;
+    }
+    streamDone = true;
+  }
+  return static_cast<int>(produced);
+}
+
+bool ZipFile::seekEntryStream(const size_t pos) {
+  if (!streamActive || pos > streamInflatedSize) {
+    return false;
+  }
+
+  if (streamMethod == ZIP_METHOD_STORED) {
+    if (!file.seek(streamDataOffset + pos)) {
+      return false;
+    }
+    streamProduced = pos;
+    streamDone = streamProduced == streamInflatedSize;
+    return true;
+  }
+
+  if (pos < streamProduced) {
+    return false;
+  }
+  uint8_t scratch[256];
+  while (streamProduced < pos) {
+    const size_t wanted = pos - streamProduced;
+    if (readEntryStream(scratch, wanted < sizeof(scratch) ? wanted : sizeof(scratch)) <= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ZipFile::endEntryStream() {
+  if (!streamActive) {
+    return;
+  }
+  streamCtx.reset();  // InflateReader destructor returns the window
+  streamReadLease.release();
+  streamActive = false;
+  streamDone = false;
+  if (streamClosesFile) {
+    close();
+  }
+}
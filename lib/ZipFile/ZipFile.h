@@ -1,10 +1,13 @@
 #pragma once
 #include <HalStorage.h>
+#include <InflateBufferPool.h>
 
+#include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+struct ZipInflateCtx;
+
 class ZipFile {
  public:
   struct FileStatSlim {
@@ -27,6 +30,9 @@ class ZipFile {
     uint16_t index;  // Caller's index (e.g. spine index)
   };
 
+  // Where a book cache directory keeps the central directory index of its archive
+  static std::string getIndexPath(const std::string& cacheDir) { return cacheDir + "/zip.idx"; }
+
   // FNV-1a 64-bit hash computed from char buffer (no std::string allocation)
   static uint64_t fnvHash64(const char* s, size_t len) {
     uint64_t hash = 14695981039346656037ull;
@@ -38,30 +44,65 @@ class ZipFile {
   }
 
  private:
+  // One row of the central directory index, sorted by (hash, len)
+  struct IndexEntry {
+    uint64_t hash;
+    uint16_t len;
+    uint16_t method;
+    uint32_t compressedSize;
+    uint32_t uncompressedSize;
+    uint32_t localHeaderOffset;
+  };
+
   const std::string& filePath;
   FsFile file;
   ZipDetails zipDetails = {0, 0, false};
-  std::unordered_map<std::string, FileStatSlim> fileStatSlimCache;
+
+  // Central directory index persisted at indexPath (see the constructor). Only the first hash of each page of
+  // entries is held in RAM; a lookup reads the one page that can hold the entry.
+  std::string indexPath;
+  FsFile indexFile;
+  std::vector<uint64_t> indexPageHashes;
+  uint32_t indexCount = 0;
+  bool indexChecked = false;
+  bool indexUsable = false;
 
   // Cursor for sequential central-dir scanning optimization
   uint32_t lastCentralDirPos = 0;
   bool lastCentralDirPosValid = false;
 
+  // Pull-style entry stream state (see beginEntryStream)
+  std::unique_ptr<ZipInflateCtx> streamCtx;
+  ChunkBufferLease streamReadLease;
+  uint16_t streamMethod = 0;
+  uint32_t streamInflatedSize = 0;
+  uint32_t streamProduced = 0;
+  uint32_t streamDataOffset = 0;
+  bool streamActive = false;
+  bool streamDone = false;
+  bool streamClosesFile = false;  // The zip was opened for the stream, not by hand
+
   bool loadFileStatSlim(const char* filename, FileStatSlim* fileStat);
+  bool loadIndex();
+  bool readIndexHeader(uint32_t zipSize);
+  bool buildIndex(uint32_t zipSize);
+  bool lookupIndex(const char* filename, FileStatSlim* fileStat);
+  int fillUncompressedSizesFromIndex(const std::vector<SizeTarget>& targets, std::vector<uint32_t>& sizes);
   long getDataOffset(const FileStatSlim& fileStat);
   bool loadZipDetails();
 
  public:
-  explicit ZipFile(const std::string& filePath) : filePath(filePath) {}
-  ~ZipFile() = default;
+  // With indexPath set, entries are looked up by binary search in a hash-sorted copy of the central directory kept
+  // in that file, which is written on the first lookup. Otherwise each lookup scans the central directory.
+  explicit ZipFile(const std::string& filePath, std::string indexPath = "");
+  ~ZipFile();
   // Zip file can be opened and closed by hand in order to allow for quick calculation of inflated file size
   // It is NOT recommended to pre-open it for any kind of inflation due to memory constraints
   bool isOpen() const { return !!file; }
   bool open();
   bool close();
-  bool loadAllFileStatSlims();
   bool getInflatedFileSize(const char* filename, size_t* size);
-  // Batch lookup: scan ZIP central dir once and fill sizes for matching targets.
+  // Batch lookup: scan ZIP central dir (or the index, with one) once and fill sizes for matching targets.
   // targets must be sorted by (hash, len). sizes[target.index] receives uncompressedSize.
   // Returns number of targets matched.
   int fillUncompressedSizes(std::vector<SizeTarget>& targets, std::vector<uint32_t>& sizes);
@@ -69,4 +110,18 @@ class ZipFile {
   // These functions will open and close the zip as needed
   uint8_t* readFileToMemory(const char* filename, size_t* size = nullptr, bool trailingNullByte = false);
   bool readFileToStream(const char* filename, Print& out, size_t chunkSize);
+
+  // Pull-style streaming of a single entry, for consumers that drive the reads themselves (e.g. feeding a parser
+  // one buffer at a time without staging the entry on the SD card). The zip stays open until endEntryStream(), which
+  // closes it unless it was opened by hand, and a deflated entry holds the 32KB inflate window for that long.
+  // readEntryStream() returns the number of bytes produced (0 once the entry is exhausted) or -1 on error.
+  bool beginEntryStream(const char* filename, size_t readChunkSize);
+  int readEntryStream(uint8_t* dest, size_t maxLen);
+  // Move to an offset within the entry: anywhere in a stored entry, only forward in a deflated one (the skipped
+  // bytes are inflated and dropped). Returns false if the position can't be reached.
+  bool seekEntryStream(size_t pos);
+  size_t getEntryStreamPosition() const { return streamProduced; }
+  bool isEntryStreamDone() const { return streamDone; }
+  size_t getEntryStreamSize() const { return streamInflatedSize; }
+  void endEntryStream();
 };
@@ -1,5 +1,9 @@
 #include <HalDisplay.h>
 #include <HalGPIO.h>
+#include <HalPowerManager.h>
+#include <Trace.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
 
 #define SD_SPI_MISO 7
 
@@ -21,6 +25,17 @@ void HalDisplay::drawImageTransparent(const uint8_t* imageData, uint16_t x, uint
   einkDisplay.drawImageTransparent(imageData, x, y, w, h, fromProgmem);
 }
 
+namespace {
+// Marks a refresh call as running for as long as it's in scope
+class RefreshScope {
+  std::atomic<bool>& flag;
+
+ public:
+  explicit RefreshScope(std::atomic<bool>& flag) : flag(flag) { flag = true; }
+  ~RefreshScope() { flag = false; }
+};
+}  // namespace
+
 EInkDisplay::RefreshMode convertRefreshMode(HalDisplay::RefreshMode mode) {
   switch (mode) {
     case HalDisplay::FULL_REFRESH:
@@ -34,13 +49,44 @@ EInkDisplay::RefreshMode convertRefreshMode(HalDisplay::RefreshMode mode) {
 }
 
 void HalDisplay::displayBuffer(HalDisplay::RefreshMode mode, bool turnOffScreen) {
+  HalPowerManager::Lock powerLock(HalPowerManager::PanelWait);
+  RefreshScope refreshScope(refreshing);
+  TRACE_SCOPE(PanelRefresh, mode);
   einkDisplay.displayBuffer(convertRefreshMode(mode), turnOffScreen);
 }
 
 void HalDisplay::refreshDisplay(HalDisplay::RefreshMode mode, bool turnOffScreen) {
+  HalPowerManager::Lock powerLock(HalPowerManager::PanelWait);
+  RefreshScope refreshScope(refreshing);
+  TRACE_SCOPE(PanelRefresh, mode);
   einkDisplay.refreshDisplay(convertRefreshMode(mode), turnOffScreen);
 }
 
+void HalDisplay::displayWindow(const uint16_t x, const uint16_t y, const uint16_t width, const uint16_t height,
+                               const bool turnOffScreen) {
+  HalPowerManager::Lock powerLock(HalPowerManager::PanelWait);
+  RefreshScope refreshScope(refreshing);
+  TRACE_SCOPE(PanelRefresh, static_cast<uint32_t>(width) * height);
+  einkDisplay.displayWindow(x, y, width, height, turnOffScreen);
+}
+
+bool HalDisplay::isBusy() const { return digitalRead(EPD_BUSY) == HIGH; }
+
+bool HalDisplay::lightSleepWhileBusy(const uint32_t maxMs) const {
+  if (!refreshing || !isBusy()) {
+    return false;
+  }
+  // Level triggered, so BUSY dropping just before the sleep starts wakes it right away
+  gpio_wakeup_enable(static_cast<gpio_num_t>(EPD_BUSY), GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  esp_sleep_enable_timer_wakeup(static_cast<uint64_t>(maxMs) * 1000);
+  esp_light_sleep_start();
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+  gpio_wakeup_disable(static_cast<gpio_num_t>(EPD_BUSY));
+  return true;
+}
+
 void HalDisplay::deepSleep() { einkDisplay.deepSleep(); }
 
 uint8_t* HalDisplay::getFrameBuffer() const { return einkDisplay.getFrameBuffer(); }
@@ -55,4 +101,9 @@ void HalDisplay::copyGrayscaleMsbBuffers(const uint8_t* msbBuffer) { einkDisplay
 
 void HalDisplay::cleanupGrayscaleBuffers(const uint8_t* bwBuffer) { einkDisplay.cleanupGrayscaleBuffers(bwBuffer); }
 
-void HalDisplay::displayGrayBuffer(bool turnOffScreen) { einkDisplay.displayGrayBuffer(turnOffScreen); }
+void HalDisplay::displayGrayBuffer(bool turnOffScreen) {
+  HalPowerManager::Lock powerLock(HalPowerManager::PanelWait);
+  RefreshScope refreshScope(refreshing);
+  TRACE_SCOPE(PanelRefresh, 0);
+  einkDisplay.displayGrayBuffer(turnOffScreen);
+}
@@ -2,6 +2,8 @@
 #include <Arduino.h>
 #include <EInkDisplay.h>
 
+#include <atomic>
+
 class HalDisplay {
  public:
   // Constructor with pin configuration
@@ -35,6 +37,17 @@ class HalDisplay {
 
   void displayBuffer(RefreshMode mode = RefreshMode::FAST_REFRESH, bool turnOffScreen = false);
   void refreshDisplay(RefreshMode mode = RefreshMode::FAST_REFRESH, bool turnOffScreen = false);
+  // Fast refresh of a physical panel region; x and width must be multiples of 8
+  void displayWindow(uint16_t x, uint16_t y, uint16_t width, uint16_t height, bool turnOffScreen = false);
+  // True while the panel is refreshing. The refresh calls above wait for this to clear, polling the busy pin and
+  // leaving the SPI bus alone until then.
+  bool isBusy() const;
+  // True while one of the refresh calls is running, on whichever task made it
+  bool isRefreshing() const { return refreshing.load(); }
+  // For another task than the one refreshing, with nothing else to do: light sleeps until the panel drops BUSY or
+  // maxMs have passed. The refreshing task is stopped along with everything else and finds BUSY clear on wake.
+  // Returns false without sleeping if no refresh is waiting on the panel.
+  bool lightSleepWhileBusy(uint32_t maxMs) const;
 
   // Power management
   void deepSleep();
@@ -51,4 +64,5 @@ class HalDisplay {
 
  private:
   EInkDisplay einkDisplay;
+  std::atomic<bool> refreshing{false};
 };
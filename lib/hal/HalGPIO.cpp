@@ -5,9 +5,49 @@ void HalGPIO::begin() {
   inputMgr.begin();
   SPI.begin(EPD_SCLK, SPI_MISO, EPD_MOSI, EPD_CS);
   pinMode(UART0_RXD, INPUT);
+
+  // One slot: the waiting loop only needs to know that something changed, update() reads what
+  inputEdges = xQueueCreate(1, sizeof(uint8_t));
+  if (inputEdges) {
+    attachInterruptArg(digitalPinToInterrupt(InputManager::POWER_BUTTON_PIN), &onInputEdge, this, CHANGE);
+  }
 }
 
-void HalGPIO::update() { inputMgr.update(); }
+void IRAM_ATTR HalGPIO::onInputEdge(void* param) {
+  const auto* self = static_cast<HalGPIO*>(param);
+  const uint8_t edge = 1;
+  BaseType_t woken = pdFALSE;
+  xQueueOverwriteFromISR(self->inputEdges, &edge, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void HalGPIO::update() {
+  if (inputPending) {
+    // Already polled by pollForInput(); polling again would lose its edges
+    inputPending = false;
+    return;
+  }
+  inputMgr.update();
+}
+
+bool HalGPIO::pollForInput() {
+  if (!inputPending) {
+    inputMgr.update();
+    inputPending = inputMgr.wasAnyPressed() || inputMgr.wasAnyReleased();
+  }
+  return inputPending;
+}
+
+void HalGPIO::waitForInput(const uint32_t timeoutMs) {
+  if (!inputEdges) {
+    delay(timeoutMs);
+    return;
+  }
+  uint8_t edge;
+  xQueueReceive(inputEdges, &edge, pdMS_TO_TICKS(timeoutMs));
+}
 
 bool HalGPIO::isPressed(uint8_t buttonIndex) const { return inputMgr.isPressed(buttonIndex); }
 
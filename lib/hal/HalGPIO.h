@@ -3,6 +3,8 @@
 #include <Arduino.h>
 #include <BatteryMonitor.h>
 #include <InputManager.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 
 // Display SPI pins (custom pins for XteinkX4, not hardware SPI defaults)
 #define EPD_SCLK 8   // SPI Clock
@@ -22,6 +24,10 @@ class HalGPIO {
 #if CROSSPOINT_EMULATED == 0
   InputManager inputMgr;
 #endif
+  bool inputPending = false;
+  QueueHandle_t inputEdges = nullptr;  // Posted to by the power button interrupt
+
+  static void onInputEdge(void* param);
 
  public:
   HalGPIO() = default;
@@ -31,6 +37,12 @@ class HalGPIO {
 
   // Button input methods
   void update();
+  // Poll the buttons from inside long-running work. A press or release seen here is kept for the next update(), so
+  // the main loop still gets it.
+  bool pollForInput();
+  // Blocks for at most timeoutMs, returning as soon as the power button goes down or up. The other buttons sit on
+  // resistor ladders read through the ADC, which can't raise an interrupt, so those are only seen by polling update().
+  void waitForInput(uint32_t timeoutMs);
   bool isPressed(uint8_t buttonIndex) const;
   bool wasPressed(uint8_t buttonIndex) const;
   bool wasAnyPressed() const;
@@ -54,3 +66,5 @@ class HalGPIO {
   static constexpr uint8_t BTN_DOWN = 5;
   static constexpr uint8_t BTN_POWER = 6;
 };
+
+extern HalGPIO gpio;  // Singleton, defined in main.cpp
@@ -4,6 +4,7 @@
 #include <WiFi.h>
 #include <esp_sleep.h>
 
+#include <algorithm>
 #include <cassert>
 
 #include "HalGPIO.h"
@@ -13,43 +14,84 @@ HalPowerManager powerManager;  // Singleton instance
 void HalPowerManager::begin() {
   pinMode(BAT_GPIO0, INPUT);
   normalFreq = getCpuFrequencyMhz();
+  currentFreq = normalFreq;
+  stateSince = millis();
   modeMutex = xSemaphoreCreateMutex();
   assert(modeMutex != nullptr);
+  sampleBattery(true);
 }
 
-void HalPowerManager::setPowerSaving(bool enabled) {
-  if (normalFreq <= 0) {
-    return;  // invalid state
+int HalPowerManager::workloadFrequency(const Workload workload) const {
+  switch (workload) {
+    case PanelWait:
+    case Network:
+      // Bound by the panel or the radio, not the CPU. Below the APB clock SPI transfers (the frame, SD reads) would
+      // slow down and WiFi wouldn't work.
+      return std::min(normalFreq, APB_FREQ);
+    case Render:
+    case Indexing:
+    case Decoding:
+    default:
+      return normalFreq;
+  }
+}
+
+void HalPowerManager::applyFrequency() {
+  // The innermost lock of each task counts; the fastest of those wins
+  int targetFreq = 0;
+  uint8_t state = IDLE_STATE;
+  for (uint8_t i = 0; i < activeLockCount; i++) {
+    bool innermost = true;
+    for (uint8_t j = i + 1; j < activeLockCount; j++) {
+      if (activeLocks[j].task == activeLocks[i].task) {
+        innermost = false;
+        break;
+      }
+    }
+    const int freq = workloadFrequency(activeLocks[i].workload);
+    if (innermost && freq > targetFreq) {
+      targetFreq = freq;
+      state = activeLocks[i].workload;
+    }
   }
 
-  auto wifiMode = WiFi.getMode();
-  if (wifiMode != WIFI_MODE_NULL) {
+  const bool wifiActive = WiFi.getMode() != WIFI_MODE_NULL;
+  if (activeLockCount == 0) {
     // Wifi is active, force disabling power saving
-    enabled = false;
+    const bool lowPower = powerSavingRequested && !wifiActive;
+    targetFreq = lowPower ? LOW_POWER_FREQ : normalFreq;
+    state = lowPower ? LOW_POWER_STATE : IDLE_STATE;
+  } else if (wifiActive) {
+    targetFreq = std::max(targetFreq, std::min(normalFreq, APB_FREQ));
   }
 
-  // Note: We don't use mutex here to avoid too much overhead,
-  // it's not very important if we read a slightly stale value for currentLockMode
-  const LockMode mode = currentLockMode;
+  const unsigned long now = millis();
+  stateTime[currentState] += now - stateSince;
+  stateSince = now;
+  currentState = state;
 
-  if (mode == None && enabled && !isLowPower) {
-    LOG_DBG("PWR", "Going to low-power mode");
-    if (!setCpuFrequencyMhz(LOW_POWER_FREQ)) {
-      LOG_DBG("PWR", "Failed to set CPU frequency = %d MHz", LOW_POWER_FREQ);
-      return;
-    }
-    isLowPower = true;
+  if (targetFreq == currentFreq) {
+    return;
+  }
+  if (!setCpuFrequencyMhz(targetFreq)) {
+    LOG_DBG("PWR", "Failed to set CPU frequency = %d MHz", targetFreq);
+    return;
+  }
+  currentFreq = targetFreq;
+}
 
-  } else if ((!enabled || mode != None) && isLowPower) {
-    LOG_DBG("PWR", "Restoring normal CPU frequency");
-    if (!setCpuFrequencyMhz(normalFreq)) {
-      LOG_DBG("PWR", "Failed to set CPU frequency = %d MHz", normalFreq);
-      return;
-    }
-    isLowPower = false;
+void HalPowerManager::setPowerSaving(bool enabled) {
+  if (normalFreq <= 0) {
+    return;  // invalid state
   }
 
-  // Otherwise, no change needed
+  xSemaphoreTake(modeMutex, portMAX_DELAY);
+  if (enabled != powerSavingRequested) {
+    LOG_DBG("PWR", enabled ? "Going to low-power mode" : "Restoring normal CPU frequency");
+    powerSavingRequested = enabled;
+  }
+  applyFrequency();
+  xSemaphoreGive(modeMutex);
 }
 
 void HalPowerManager::startDeepSleep(HalGPIO& gpio) const {
@@ -61,35 +103,86 @@ void HalPowerManager::startDeepSleep(HalGPIO& gpio) const {
   // Arm the wakeup trigger *after* the button is released
   esp_deep_sleep_enable_gpio_wakeup(1ULL << InputManager::POWER_BUTTON_PIN, ESP_GPIO_WAKEUP_GPIO_LOW);
   // Enter Deep Sleep
+  logFlush();
   esp_deep_sleep_start();
 }
 
-uint16_t HalPowerManager::getBatteryPercentage() const {
+namespace {
+// A new battery reading moves the average by a quarter of its distance
+constexpr int batteryAverageWeight = 4;
+constexpr uint16_t batteryAverageOne = 16;  // One percent in the average
+}  // namespace
+
+void HalPowerManager::sampleBattery(const bool force) {
+  if (batterySampled && !force && millis() - lastBatterySample < BATTERY_SAMPLE_MS) {
+    return;
+  }
   static const BatteryMonitor battery = BatteryMonitor(BAT_GPIO0);
-  return battery.readPercentage();
+  const auto reading = static_cast<uint16_t>(std::min<uint16_t>(battery.readPercentage(), 100) * batteryAverageOne);
+  lastBatterySample = millis();
+  if (!batterySampled) {
+    batterySampled = true;
+    batteryAverage = reading;
+    batteryPercentage = reading / batteryAverageOne;
+    return;
+  }
+  batteryAverage = static_cast<uint16_t>(batteryAverage + (reading - batteryAverage) / batteryAverageWeight);
+  const int shown = batteryPercentage * batteryAverageOne;
+  if (std::abs(batteryAverage - shown) >= batteryAverageOne) {
+    batteryPercentage = (batteryAverage + batteryAverageOne / 2) / batteryAverageOne;
+    batteryChanged = true;
+  }
+}
+
+bool HalPowerManager::takeBatteryChanged() {
+  const bool changed = batteryChanged;
+  batteryChanged = false;
+  return changed;
 }
 
-HalPowerManager::Lock::Lock() {
+unsigned long HalPowerManager::getWorkloadTime(const Workload workload) const {
+  return workload < WORKLOAD_COUNT ? stateTime[workload] : 0;
+}
+
+void HalPowerManager::logTelemetry() const {
+  LOG_DBG("PWR", "CPU time (s): render %lu, indexing %lu, decoding %lu, panel wait %lu, network %lu, idle %lu, "
+          "low power %lu",
+          stateTime[Render] / 1000, stateTime[Indexing] / 1000, stateTime[Decoding] / 1000,
+          stateTime[PanelWait] / 1000, stateTime[Network] / 1000, stateTime[IDLE_STATE] / 1000,
+          stateTime[LOW_POWER_STATE] / 1000);
+}
+
+HalPowerManager::Lock::Lock(const Workload workload) {
+  if (!powerManager.modeMutex) {
+    return;
+  }
   xSemaphoreTake(powerManager.modeMutex, portMAX_DELAY);
-  // Current limitation: only one lock at a time
-  if (powerManager.currentLockMode != None) {
-    LOG_ERR("PWR", "Lock already held, ignore");
-    valid = false;
+  if (powerManager.activeLockCount == MAX_LOCKS) {
+    LOG_ERR("PWR", "Too many locks held, ignore");
   } else {
-    powerManager.currentLockMode = NormalSpeed;
+    powerManager.activeLocks[powerManager.activeLockCount++] = {this, xTaskGetCurrentTaskHandle(), workload};
     valid = true;
+    // Immediately switch to the clock this workload needs
+    powerManager.applyFrequency();
   }
   xSemaphoreGive(powerManager.modeMutex);
-  if (valid) {
-    // Immediately restore normal CPU frequency if currently in low-power mode
-    powerManager.setPowerSaving(false);
-  }
 }
 
 HalPowerManager::Lock::~Lock() {
+  if (!valid) {
+    return;
+  }
   xSemaphoreTake(powerManager.modeMutex, portMAX_DELAY);
-  if (valid) {
-    powerManager.currentLockMode = None;
+  for (uint8_t i = 0; i < powerManager.activeLockCount; i++) {
+    if (powerManager.activeLocks[i].lock == this) {
+      for (uint8_t j = i + 1; j < powerManager.activeLockCount; j++) {
+        powerManager.activeLocks[j - 1] = powerManager.activeLocks[j];
+      }
+      powerManager.activeLockCount--;
+      break;
+    }
   }
+  // Back to what the enclosing lock needs; with none left the main loop's power saving picks up again
+  powerManager.applyFrequency();
   xSemaphoreGive(powerManager.modeMutex);
 }
@@ -4,6 +4,7 @@
 #include <InputManager.h>
 #include <Logging.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
 
 #include <cassert>
 
@@ -13,38 +14,58 @@ class HalPowerManager;
 extern HalPowerManager powerManager;  // Singleton
 
 class HalPowerManager {
-  int normalFreq = 0;  // MHz
-  bool isLowPower = false;
-
-  enum LockMode { None, NormalSpeed };
-  LockMode currentLockMode = None;
-  SemaphoreHandle_t modeMutex = nullptr;  // Protect access to currentLockMode
-
  public:
+  // What a Lock is held for, which decides the CPU clock while it's held
+  enum Workload : uint8_t {
+    Render,     // Drawing a frame: short, full speed
+    Indexing,   // Parsing and laying out book content: long and CPU bound, full speed
+    Decoding,   // Image decoding and inflate: likewise
+    PanelWait,  // Sending a frame and waiting out the e-ink refresh on the BUSY line
+    Network,    // Waiting on WiFi transfers
+    WORKLOAD_COUNT
+  };
+
   static constexpr int LOW_POWER_FREQ = 10;                    // MHz
   static constexpr unsigned long IDLE_POWER_SAVING_MS = 3000;  // ms
+  // Lowest clock that keeps the APB (and with it SPI and the WiFi radio) at full speed
+  static constexpr int APB_FREQ = 80;  // MHz
+  static constexpr unsigned long BATTERY_SAMPLE_MS = 30000;
 
   void begin();
 
-  // Control CPU frequency for power saving
+  // Control CPU frequency for power saving while no Lock is held
   void setPowerSaving(bool enabled);
 
   // Setup wake up GPIO and enter deep sleep
   // Should be called inside main loop() to handle the currentLockMode
   void startDeepSleep(HalGPIO& gpio) const;
 
-  // Get battery percentage (range 0-100)
-  uint16_t getBatteryPercentage() const;
+  // Battery percentage (range 0-100) as last sampled and filtered
+  uint16_t getBatteryPercentage() const { return batteryPercentage; }
+  // Reads the battery once BATTERY_SAMPLE_MS have passed since the last reading, or right away with force; begin()
+  // takes the first reading. Readings are smoothed by an exponential moving average, and the percentage given out
+  // only moves once the average is a whole percent away from it, so ADC noise doesn't make it flicker.
+  void sampleBattery(bool force = false);
+  // True once after the percentage given out has changed
+  bool takeBatteryChanged();
+
+  // Time spent (ms) in each workload since boot, and with no Lock held at normal and at low clock
+  unsigned long getWorkloadTime(Workload workload) const;
+  unsigned long getIdleTime() const { return stateTime[IDLE_STATE]; }
+  unsigned long getLowPowerTime() const { return stateTime[LOW_POWER_STATE]; }
+  void logTelemetry() const;
 
   // RAII helper class to manage power saving locks
   // Usage: create an instance of Lock in a scope to disable power saving, for example when running a task that needs
   // full performance. When the Lock instance is destroyed (goes out of scope), power saving will be re-enabled.
+  // Locks nest: the innermost Lock of each task sets what that task needs, and the CPU runs at the fastest clock any
+  // task needs. So a PanelWait inside a Render lock drops the clock for the refresh and restores it after.
   class Lock {
     friend class HalPowerManager;
     bool valid = false;
 
    public:
-    explicit Lock();
+    explicit Lock(Workload workload = Render);
     ~Lock();
 
     // Non-copyable and non-movable
@@ -53,4 +74,37 @@ class HalPowerManager {
     Lock(Lock&&) = delete;
     Lock& operator=(Lock&&) = delete;
   };
+
+ private:
+  // Telemetry states: the workloads, then no Lock at normal and at low clock
+  static constexpr uint8_t IDLE_STATE = WORKLOAD_COUNT;
+  static constexpr uint8_t LOW_POWER_STATE = WORKLOAD_COUNT + 1;
+  static constexpr uint8_t STATE_COUNT = WORKLOAD_COUNT + 2;
+  static constexpr uint8_t MAX_LOCKS = 8;
+
+  struct ActiveLock {
+    const Lock* lock;
+    TaskHandle_t task;
+    Workload workload;
+  };
+
+  int normalFreq = 0;  // MHz
+  int currentFreq = 0;
+  bool powerSavingRequested = false;
+  ActiveLock activeLocks[MAX_LOCKS] = {};  // In the order they were taken
+  uint8_t activeLockCount = 0;
+  SemaphoreHandle_t modeMutex = nullptr;  // Protect access to activeLocks and the clock
+  uint8_t currentState = IDLE_STATE;
+  unsigned long stateSince = 0;
+  unsigned long stateTime[STATE_COUNT] = {};
+  // Filtered battery percentage in 1/16 percent, and the one given out
+  uint16_t batteryAverage = 0;
+  uint16_t batteryPercentage = 0;
+  bool batterySampled = false;
+  bool batteryChanged = false;
+  unsigned long lastBatterySample = 0;
+
+  int workloadFrequency(Workload workload) const;
+  // Picks the clock for the locks held now and switches to it; call with modeMutex held
+  void applyFrequency();
 };
@@ -1,14 +1,46 @@
 #include "HalStorage.h"
 
+#include <Logging.h>
 #include <SDCardManager.h>
 
 #define SDCard SDCardManager::getInstance()
 
+namespace {
+// FNV-1a over the path as FAT compares it: case-insensitive, repeated and trailing slashes ignored
+uint64_t pathHash(const char* path) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char* c = path; *c; c++) {
+    if (*c == '/' && (c[1] == '/' || c[1] == '\0')) {
+      continue;
+    }
+    const char lower = *c >= 'A' && *c <= 'Z' ? static_cast<char>(*c - 'A' + 'a') : *c;
+    hash = (hash ^ static_cast<uint8_t>(lower)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Holds the path cache's mutex for a scope
+class PathLock {
+ public:
+  explicit PathLock(SemaphoreHandle_t mutex) : mutex(mutex) { xSemaphoreTake(mutex, portMAX_DELAY); }
+  ~PathLock() { xSemaphoreGive(mutex); }
+  PathLock(const PathLock&) = delete;
+  PathLock& operator=(const PathLock&) = delete;
+
+ private:
+  SemaphoreHandle_t mutex;
+};
+}  // namespace
+
 HalStorage HalStorage::instance;
 
-HalStorage::HalStorage() {}
+HalStorage::HalStorage() : pathMutex(xSemaphoreCreateMutex()) {}
 
-bool HalStorage::begin() { return SDCard.begin(); }
+bool HalStorage::begin() {
+  PathLock lock(pathMutex);
+  forgetPaths(false);
+  return SDCard.begin();
+}
 
 bool HalStorage::ready() const { return SDCard.ready(); }
 
@@ -24,24 +56,104 @@ size_t HalStorage::readFileToBuffer(const char* path, char* buffer, size_t buffe
   return SDCard.readFileToBuffer(path, buffer, bufferSize, maxBytes);
 }
 
-bool HalStorage::writeFile(const char* path, const String& content) { return SDCard.writeFile(path, content); }
+bool HalStorage::writeFile(const char* path, const String& content) {
+  PathLock lock(pathMutex);
+  const bool written = SDCard.writeFile(path, content);
+  if (written) {
+    rememberPath(path, true);
+  } else {
+    forgetPath(path);
+  }
+  return written;
+}
 
-bool HalStorage::ensureDirectoryExists(const char* path) { return SDCard.ensureDirectoryExists(path); }
+bool HalStorage::ensureDirectoryExists(const char* path) {
+  PathLock lock(pathMutex);
+  // Parent directories may have been created along with it
+  forgetPaths(true);
+  const bool created = SDCard.ensureDirectoryExists(path);
+  if (created) {
+    rememberPath(path, true);
+  }
+  return created;
+}
 
-FsFile HalStorage::open(const char* path, const oflag_t oflag) { return SDCard.open(path, oflag); }
+FsFile HalStorage::open(const char* path, const oflag_t oflag) {
+  PathLock lock(pathMutex);
+  const PathEntry* entry = findPath(pathHash(path));
+  if (entry && !entry->exists && !(oflag & O_CREAT)) {
+    return FsFile();
+  }
+  FsFile file = SDCard.open(path, oflag);
+  if (file) {
+    rememberPath(path, true);
+  } else if (oflag & O_CREAT) {
+    forgetPath(path);
+  }
+  return file;
+}
 
-bool HalStorage::mkdir(const char* path, const bool pFlag) { return SDCard.mkdir(path, pFlag); }
+bool HalStorage::mkdir(const char* path, const bool pFlag) {
+  PathLock lock(pathMutex);
+  forgetPaths(true);
+  const bool created = SDCard.mkdir(path, pFlag);
+  if (created) {
+    rememberPath(path, true);
+  }
+  return created;
+}
 
-bool HalStorage::exists(const char* path) { return SDCard.exists(path); }
+bool HalStorage::exists(const char* path) {
+  PathLock lock(pathMutex);
+  if (const PathEntry* entry = findPath(pathHash(path))) {
+    return entry->exists;
+  }
+  const bool found = SDCard.exists(path);
+  rememberPath(path, found);
+  return found;
+}
 
-bool HalStorage::remove(const char* path) { return SDCard.remove(path); }
+bool HalStorage::remove(const char* path) {
+  PathLock lock(pathMutex);
+  const bool removed = SDCard.remove(path);
+  if (removed) {
+    rememberPath(path, false);
+  } else {
+    forgetPath(path);
+  }
+  return removed;
+}
 
-bool HalStorage::rename(const char* oldPath, const char* newPath) { return SDCard.rename(oldPath, newPath); }
+bool HalStorage::rename(const char* oldPath, const char* newPath) {
+  PathLock lock(pathMutex);
+  // A directory takes everything below it along
+  forgetPaths(false);
+  return SDCard.rename(oldPath, newPath);
+}
 
-bool HalStorage::rmdir(const char* path) { return SDCard.rmdir(path); }
+bool HalStorage::rmdir(const char* path) {
+  PathLock lock(pathMutex);
+  const bool removed = SDCard.rmdir(path);
+  if (removed) {
+    rememberPath(path, false);
+  } else {
+    forgetPath(path);
+  }
+  return removed;
+}
 
 bool HalStorage::openFileForRead(const char* moduleName, const char* path, FsFile& file) {
-  return SDCard.openFileForRead(moduleName, path, file);
+  PathLock lock(pathMutex);
+  const PathEntry* entry = findPath(pathHash(path));
+  if (entry && !entry->exists) {
+    LOG_ERR(moduleName, "File does not exist: %s", path);
+    return false;
+  }
+  const bool opened = SDCard.openFileForRead(moduleName, path, file);
+  if (opened) {
+    rememberPath(path, true);
+  }
+  return opened;
 }
 
 bool HalStorage::openFileForRead(const char* moduleName, const std::string& path, FsFile& file) {
@@ -53,7 +165,14 @@ bool HalStorage::openFileForRead(const char* moduleName, const String& path, FsF
 }
 
 bool HalStorage::openFileForWrite(const char* moduleName, const char* path, FsFile& file) {
-  return SDCard.openFileForWrite(moduleName, path, file);
+  PathLock lock(pathMutex);
+  const bool opened = SDCard.openFileForWrite(moduleName, path, file);
+  if (opened) {
+    rememberPath(path, true);
+  } else {
+    forgetPath(path);
+  }
+  return opened;
 }
 
 bool HalStorage::openFileForWrite(const char* moduleName, const std::string& path, FsFile& file) {
@@ -64,4 +183,61 @@ bool HalStorage::openFileForWrite(const char* moduleName, const String& path, Fs
   return openFileForWrite(moduleName, path.c_str(), file);
 }
 
-bool HalStorage::removeDir(const char* path) { return SDCard.removeDir(path); }
\ No newline at end of file
+bool HalStorage::removeDir(const char* path) {
+  PathLock lock(pathMutex);
+  forgetPaths(false);
+  return SDCard.removeDir(path);
+}
+
+bool HalStorage::preAllocate(const char* moduleName, FsFile& file, const uint64_t size) {
+  if (size == 0 || file.size() != 0) {
+    return false;
+  }
+  if (!file.preAllocate(size)) {
+    LOG_DBG(moduleName, "No contiguous run of %llu bytes, the file grows as written",
+            static_cast<unsigned long long>(size));
+    return false;
+  }
+  return true;
+}
+
+HalStorage::PathEntry* HalStorage::findPath(const uint64_t hash) {
+  for (auto& entry : pathCache) {
+    if (entry.lastUse != 0 && entry.hash == hash) {
+      entry.lastUse = ++pathClock;
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void HalStorage::rememberPath(const char* path, const bool exists) {
+  const uint64_t hash = pathHash(path);
+  PathEntry* entry = findPath(hash);
+  if (!entry) {
+    // A free slot, or else the least recently used one
+    entry = &pathCache[0];
+    for (auto& candidate : pathCache) {
+      if (candidate.lastUse < entry->lastUse) {
+        entry = &candidate;
+      }
+    }
+    entry->hash = hash;
+    entry->lastUse = ++pathClock;
+  }
+  entry->exists = exists;
+}
+
+void HalStorage::forgetPath(const char* path) {
+  if (PathEntry* entry = findPath(pathHash(path))) {
+    entry->lastUse = 0;
+  }
+}
+
+void HalStorage::forgetPaths(const bool missingOnly) {
+  for (auto& entry : pathCache) {
+    if (!missingOnly || !entry.exists) {
+      entry.lastUse = 0;
+    }
+  }
+}
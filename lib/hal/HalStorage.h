@@ -2,7 +2,10 @@
 
 #include <FS.h>  // need to be included before SdFat.h for compatibility with FS.h's File class
 #include <SDCardManager.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
+#include <cstdint>
 #include <vector>
 
 class HalStorage {
@@ -39,13 +42,38 @@ class HalStorage {
   bool openFileForWrite(const char* moduleName, const std::string& path, FsFile& file);
   bool openFileForWrite(const char* moduleName, const String& path, FsFile& file);
   bool removeDir(const char* path);
+  // Reserves size bytes of contiguous clusters for a file just opened for writing, so it isn't extended cluster by
+  // cluster as it's written. The file's size becomes size: one written short must be truncated to what was written.
+  // A card too fragmented for a contiguous run just leaves the file to grow as usual; false then.
+  bool preAllocate(const char* moduleName, FsFile& file, uint64_t size);
 
   static HalStorage& getInstance() { return instance; }
 
  private:
   static HalStorage instance;
 
+  // exists() and open() walk the card's directories along the whole path, and the same few paths (covers, section
+  // and image caches) are looked up over and over. Whether they exist or not is remembered for the most recent ones,
+  // and kept up to date by the calls here that change the card. Changes made through an FsFile itself, like
+  // FsFile::rename(), aren't seen: go through the calls here instead. Every task using the card shares the cache, so
+  // pathMutex is held across each call that reads or updates it.
+  struct PathEntry {
+    uint64_t hash;
+    uint32_t lastUse;  // 0 for a free slot
+    bool exists;
+  };
+  static constexpr size_t PATH_CACHE_SIZE = 24;
+
   bool initialized = false;
+  SemaphoreHandle_t pathMutex = nullptr;
+  PathEntry pathCache[PATH_CACHE_SIZE] = {};
+  uint32_t pathClock = 0;
+
+  PathEntry* findPath(uint64_t hash);
+  void rememberPath(const char* path, bool exists);
+  void forgetPath(const char* path);
+  // All entries, or only the paths known to be missing
+  void forgetPaths(bool missingOnly);
 };
 
 #define Storage HalStorage::getInstance()
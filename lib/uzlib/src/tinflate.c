@@ -64,26 +64,26 @@ unsigned short dist_base[30];
 
 #else
 
-const unsigned char length_bits[30] = {
+UZLIB_CONF_HOT_DATA const unsigned char length_bits[30] = {
    0, 0, 0, 0, 0, 0, 0, 0,
    1, 1, 1, 1, 2, 2, 2, 2,
    3, 3, 3, 3, 4, 4, 4, 4,
    5, 5, 5, 5
 };
-const unsigned short length_base[30] = {
+UZLIB_CONF_HOT_DATA const unsigned short length_base[30] = {
    3, 4, 5, 6, 7, 8, 9, 10,
    11, 13, 15, 17, 19, 23, 27, 31,
    35, 43, 51, 59, 67, 83, 99, 115,
    131, 163, 195, 227, 258
 };
 
-const unsigned char dist_bits[30] = {
+UZLIB_CONF_HOT_DATA const unsigned char dist_bits[30] = {
    0, 0, 0, 0, 1, 1, 2, 2,
    3, 3, 4, 4, 5, 5, 6, 6,
    7, 7, 8, 8, 9, 9, 10, 10,
    11, 11, 12, 12, 13, 13
 };
-const unsigned short dist_base[30] = {
+UZLIB_CONF_HOT_DATA const unsigned short dist_base[30] = {
    1, 2, 3, 4, 5, 7, 9, 13,
    17, 25, 33, 49, 65, 97, 129, 193,
    257, 385, 513, 769, 1025, 1537, 2049, 3073,
@@ -122,10 +122,50 @@ static void tinf_build_bits_base(unsigned char *bits, unsigned short *base, int
 }
 #endif
 
+#if UZLIB_CONF_FAST_BITS
+/* fill the direct lookup table of a tree from its code lengths, once
+   its code length counts are known */
+static void tinf_build_fast(TINF_TREE *t, const unsigned char *lengths, unsigned int num)
+{
+   unsigned short next[16];
+   unsigned int i, code;
+
+   memset(t->fast, 0, sizeof(t->fast));
+
+   /* first canonical code of each length */
+   next[0] = 0;
+   for (code = 0, i = 1; i < 16; ++i)
+   {
+      code = (code + t->table[i - 1]) << 1;
+      next[i] = code;
+   }
+
+   for (i = 0; i < num; ++i)
+   {
+      unsigned int len = lengths[i], rev = 0, j;
+
+      if (len == 0 || len > UZLIB_CONF_FAST_BITS) continue;
+
+      /* the stream holds codes MSB first, the bit buffer LSB first */
+      code = next[len]++;
+      for (j = 0; j < len; ++j) rev |= ((code >> j) & 1) << (len - 1 - j);
+
+      /* every index whose low len bits are the code */
+      for (j = rev; j < (1 << UZLIB_CONF_FAST_BITS); j += 1 << len)
+      {
+         t->fast[j] = (len << 9) | i;
+      }
+   }
+}
+#endif
+
 /* build the fixed huffman trees */
 static void tinf_build_fixed_trees(TINF_TREE *lt, TINF_TREE *dt)
 {
    int i;
+#if UZLIB_CONF_FAST_BITS
+   unsigned char lengths[288];
+#endif
 
    /* build fixed length tree */
    for (i = 0; i < 7; ++i) lt->table[i] = 0;
@@ -145,6 +185,17 @@ static void tinf_build_fixed_trees(TINF_TREE *lt, TINF_TREE *dt)
    dt->table[5] = 32;
 
    for (i = 0; i < 32; ++i) dt->trans[i] = i;
+
+#if UZLIB_CONF_FAST_BITS
+   for (i = 0; i < 144; ++i) lengths[i] = 8;
+   for (; i < 256; ++i) lengths[i] = 9;
+   for (; i < 280; ++i) lengths[i] = 7;
+   for (; i < 288; ++i) lengths[i] = 8;
+   tinf_build_fast(lt, lengths, 288);
+
+   for (i = 0; i < 32; ++i) lengths[i] = 5;
+   tinf_build_fast(dt, lengths, 32);
+#endif
 }
 
 /* given an array of code lengths, build a tree */
@@ -184,13 +235,17 @@ static void tinf_build_tree(TINF_TREE *t, const unsigned char *lengths, unsigned
    {
       if (lengths[i]) t->trans[offs[lengths[i]]++] = i;
    }
+
+   #if UZLIB_CONF_FAST_BITS
+   tinf_build_fast(t, lengths, num);
+   #endif
 }
 
 /* ---------------------- *
  * -- decode functions -- *
  * ---------------------- */
 
-unsigned char uzlib_get_byte(TINF_DATA *d)
+UZLIB_CONF_HOT unsigned char uzlib_get_byte(TINF_DATA *d)
 {
     /* If end of source buffer is not reached, return next byte from source
        buffer. */
@@ -237,7 +292,7 @@ uint32_t tinf_get_be_uint32(TINF_DATA *d)
 }
 
 /* get one bit from source stream */
-static int tinf_getbit(TINF_DATA *d)
+static UZLIB_CONF_HOT int tinf_getbit(TINF_DATA *d)
 {
    unsigned int bit;
 
@@ -256,11 +311,45 @@ static int tinf_getbit(TINF_DATA *d)
    return bit;
 }
 
+#if UZLIB_CONF_FAST_BITS
+/* top up the bit buffer from bytes already in the source buffer. This
+   never calls the read callback, so it can't hit EOF early; a buffer
+   refill only happens from tinf_getbit(), with the bit buffer empty. */
+static UZLIB_CONF_HOT void tinf_fill_bits(TINF_DATA *d)
+{
+   while (d->bitcount <= 24 && d->source < d->source_limit)
+   {
+      d->tag |= (unsigned int)*d->source++ << d->bitcount;
+      d->bitcount += 8;
+   }
+}
+#endif
+
+/* drop the bits left of the current byte and hand the whole bytes still
+   in the bit buffer back to the source buffer they came from */
+static void tinf_align_to_byte(TINF_DATA *d)
+{
+   d->source -= d->bitcount >> 3;
+   d->tag = 0;
+   d->bitcount = 0;
+}
+
 /* read a num bit value from a stream and add base */
-static unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
+static UZLIB_CONF_HOT unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
 {
    unsigned int val = 0;
 
+   #if UZLIB_CONF_FAST_BITS
+   tinf_fill_bits(d);
+   if (num && d->bitcount >= (unsigned int)num)
+   {
+      val = d->tag & ((1u << num) - 1);
+      d->tag >>= num;
+      d->bitcount -= num;
+      return val + base;
+   }
+   #endif
+
    /* read num bits */
    if (num)
    {
@@ -275,10 +364,27 @@ static unsigned int tinf_read_bits(TINF_DATA *d, int num, int base)
 }
 
 /* given a data stream and a tree, decode a symbol */
-static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
+static UZLIB_CONF_HOT int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
 {
    int sum = 0, cur = 0, len = 0;
 
+   #if UZLIB_CONF_FAST_BITS
+   {
+      unsigned int entry, bits;
+
+      tinf_fill_bits(d);
+      entry = t->fast[d->tag & ((1 << UZLIB_CONF_FAST_BITS) - 1)];
+      bits = entry >> 9;
+      /* bits past bitcount are zero, so a short enough code is complete */
+      if (entry && bits <= d->bitcount)
+      {
+         d->tag >>= bits;
+         d->bitcount -= bits;
+         return entry & 0x1ff;
+      }
+   }
+   #endif
+
    /* get more bits while code value is above sum */
    do {
 
@@ -404,7 +510,7 @@ static int tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
  * ----------------------------- */
 
 /* given a stream and two trees, inflate next chunk of output (a byte or more) */
-static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
+static UZLIB_CONF_HOT int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 {
     if (d->curlen == 0) {
         unsigned int offs;
@@ -499,11 +605,14 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 }
 
 /* inflate next byte from uncompressed block of data */
-static int tinf_inflate_uncompressed_block(TINF_DATA *d)
+static UZLIB_CONF_HOT int tinf_inflate_uncompressed_block(TINF_DATA *d)
 {
     if (d->curlen == 0) {
         unsigned int length, invlength;
 
+        /* the block starts on a byte boundary */
+        tinf_align_to_byte(d);
+
         /* get length */
         length = uzlib_get_byte(d);
         length += 256 * uzlib_get_byte(d);
@@ -516,9 +625,6 @@ static int tinf_inflate_uncompressed_block(TINF_DATA *d)
         /* increment length to properly return TINF_DONE below, without
            producing data at the same time */
         d->curlen = length + 1;
-
-        /* make sure we start next block on a byte boundary */
-        d->bitcount = 0;
     }
 
     if (--d->curlen == 0) {
@@ -552,6 +658,7 @@ void uzlib_init(void)
 void uzlib_uncompress_init(TINF_DATA *d, void *dict, unsigned int dictLen)
 {
    d->eof = 0;
+   d->tag = 0;
    d->bitcount = 0;
    d->bfinal = 0;
    d->btype = -1;
@@ -562,7 +669,7 @@ void uzlib_uncompress_init(TINF_DATA *d, void *dict, unsigned int dictLen)
 }
 
 /* inflate next output bytes from compressed stream */
-int uzlib_uncompress(TINF_DATA *d)
+UZLIB_CONF_HOT int uzlib_uncompress(TINF_DATA *d)
 {
     do {
         int res;
@@ -616,6 +723,11 @@ next_blk:
             goto next_blk;
         }
 
+        if (res == TINF_DONE) {
+            /* leave the source just past the stream, for its trailer */
+            tinf_align_to_byte(d);
+        }
+
         if (res != TINF_OK) {
             return res;
         }
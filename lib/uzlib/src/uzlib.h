@@ -78,6 +78,11 @@ extern "C" {
 typedef struct {
    unsigned short table[16];  /* table of code length counts */
    unsigned short trans[288]; /* code -> symbol translation table */
+#if UZLIB_CONF_FAST_BITS
+   /* (code length << 9) | symbol, indexed by the next UZLIB_CONF_FAST_BITS
+      input bits; 0 where the code is longer */
+   unsigned short fast[1 << UZLIB_CONF_FAST_BITS];
+#endif
 } TINF_TREE;
 
 struct uzlib_uncomp {
@@ -29,4 +29,29 @@
 #define UZLIB_CONF_USE_MEMCPY 0
 #endif
 
+#ifndef UZLIB_CONF_FAST_BITS
+/* Width in bits of the direct lookup table each Huffman tree keeps for
+   its short codes: a symbol whose code is at most this long is decoded
+   with one table lookup instead of bit by bit. Longer codes, and codes
+   met while fewer bits are buffered, take the bit by bit path. Each
+   tree then uses 2 << UZLIB_CONF_FAST_BITS more bytes (two trees per
+   decompressor). 0 disables the tables. */
+#define UZLIB_CONF_FAST_BITS 9
+#endif
+
+#ifndef UZLIB_CONF_HOT
+/* Placement of the bit reader, the symbol decoder and the block inflate
+   loop, and of the length and distance tables they read. With
+   HOT_PATH_IN_IRAM on an ESP32 they run from IRAM and the tables sit in
+   DRAM, instead of both being fetched from flash through the cache. */
+#if defined(HOT_PATH_IN_IRAM) && HOT_PATH_IN_IRAM && defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define UZLIB_CONF_HOT IRAM_ATTR
+#define UZLIB_CONF_HOT_DATA DRAM_ATTR
+#else
+#define UZLIB_CONF_HOT
+#define UZLIB_CONF_HOT_DATA
+#endif
+#endif
+
 #endif /* UZLIB_CONF_H_INCLUDED */
@@ -1,6 +1,7 @@
 import os
 import re
 import gzip
+import hashlib
 
 SRC_DIR = "src"
 
@@ -66,6 +67,9 @@ for root, _, files in os.walk(SRC_DIR):
                 h.write(f"}};\n\n")
                 h.write(f"constexpr size_t {base_name}CompressedSize = {len(compressed)};\n")
                 h.write(f"constexpr size_t {base_name}OriginalSize = {len(minified)};\n")
+                # Strong validator for If-None-Match, the page only changes with the firmware
+                etag = hashlib.sha256(compressed).hexdigest()[:16]
+                h.write(f"constexpr char {base_name}ETag[] = \"\\\"{etag}\\\"\";\n")
 
             print(f"Generated: {header_path}")
             print(f"  Original: {len(html_content)} bytes")
@@ -25,7 +25,7 @@ def load_image(path, width, height):
         background = Image.new('RGBA', img.size, (255, 255, 255, 255))
         background.paste(img, mask=img.split()[3])
         img = background
-    # Rotate 90 degrees counterclockwise
+    # Rotate 90 degrees counterclockwise: the rows become panel rows in portrait, which drawIcon copies a byte at a time
     img = img.rotate(90, expand=True)
     return img
 
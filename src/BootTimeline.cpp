@@ -0,0 +1,71 @@
+#include "BootTimeline.h"
+
+#include <Arduino.h>
+#include <HalStorage.h>
+#include <Logging.h>
+
+#include <cstdio>
+
+namespace {
+constexpr char BOOT_LOG_FILE[] = "/.crosspoint/boot.log";
+constexpr int MAX_LOGGED_BOOTS = 8;
+constexpr int MAX_STAGES = 24;
+
+struct Stage {
+  const char* name;
+  unsigned long us;
+};
+
+Stage stages[MAX_STAGES];
+int stageCount = 0;
+
+void appendToLog(const String& line) {
+  // Drop the oldest boots so that with the new one no more than MAX_LOGGED_BOOTS are kept
+  String log = Storage.exists(BOOT_LOG_FILE) ? Storage.readFile(BOOT_LOG_FILE) : String();
+  int lines = 0;
+  for (size_t i = 0; i < log.length(); i++) {
+    if (log[i] == '\n') lines++;
+  }
+  while (lines >= MAX_LOGGED_BOOTS) {
+    const int end = log.indexOf('\n');
+    log = log.substring(end + 1);
+    lines--;
+  }
+  log += line;
+  Storage.mkdir("/.crosspoint");
+  if (!Storage.writeFile(BOOT_LOG_FILE, log)) {
+    LOG_ERR("BOOT", "Failed to write the boot log");
+  }
+}
+}  // namespace
+
+namespace BootTimeline {
+
+void mark(const char* stage) {
+  if (stageCount < MAX_STAGES) {
+    stages[stageCount++] = {stage, micros()};
+  }
+}
+
+void finish(const bool writeLog) {
+  String line = CROSSPOINT_VERSION;
+  unsigned long previous = 0;
+  char entry[48];
+  for (int i = 0; i < stageCount; i++) {
+    const unsigned long took = stages[i].us - previous;
+    LOG_INF("BOOT", "%-12s at %8lu us, took %7lu us", stages[i].name, stages[i].us, took);
+    snprintf(entry, sizeof(entry), " %s=%lu", stages[i].name, took);
+    line += entry;
+    previous = stages[i].us;
+  }
+  snprintf(entry, sizeof(entry), " total=%lu\n", previous);
+  line += entry;
+  LOG_INF("BOOT", "Setup done after %lu us", previous);
+  stageCount = 0;
+
+  if (writeLog) {
+    appendToLog(line);
+  }
+}
+
+}  // namespace BootTimeline
@@ -0,0 +1,14 @@
+#pragma once
+
+// Records how long each step of setup() takes, so slow boots can be traced to the step at fault. A stage is marked as
+// it completes with micros() since the chip started. finish() prints the timeline on serial and appends it as one line
+// to /.crosspoint/boot.log, which keeps the last few boots.
+namespace BootTimeline {
+
+// stage must be a string literal, only the pointer is kept
+void mark(const char* stage);
+
+// Print and store the timeline; without writeLog (no SD card) it is printed only
+void finish(bool writeLog = true);
+
+}  // namespace BootTimeline
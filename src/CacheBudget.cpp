@@ -0,0 +1,325 @@
+#include "CacheBudget.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "CrossPointSettings.h"
+
+namespace {
+constexpr uint8_t CACHE_INDEX_FILE_VERSION = 1;
+constexpr char CACHE_INDEX_FILE[] = "/.crosspoint/cache_index.bin";
+constexpr char CACHE_ROOT[] = "/.crosspoint";
+// Caches tracked; more are left alone until some are removed
+constexpr size_t MAX_ENTRIES = 256;
+constexpr uint32_t MAX_DIR_NAME_LENGTH = 64;
+const char* CACHE_PREFIXES[] = {"epub_", "xtc_", "txt_", "bmp_"};
+
+bool endsWith(const char* name, const char* suffix) {
+  const size_t len = strlen(name);
+  const size_t suffixLen = strlen(suffix);
+  return len >= suffixLen && strcasecmp(name + len - suffixLen, suffix) == 0;
+}
+
+// Names of the entries of a directory, directories or files only, so they can be removed after the listing is closed
+std::vector<std::string> listDir(const std::string& path, const bool directories) {
+  std::vector<std::string> names;
+  FsFile dir = Storage.open(path.c_str());
+  if (!dir || !dir.isDirectory()) {
+    if (dir) dir.close();
+    return names;
+  }
+  char name[128];
+  for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    if (file.isDirectory() == directories) {
+      file.getName(name, sizeof(name));
+      names.emplace_back(name);
+    }
+    file.close();
+  }
+  dir.close();
+  return names;
+}
+}  // namespace
+
+CacheBudget CacheBudget::instance;
+
+bool CacheBudget::isBookCache(const char* name) {
+  return std::any_of(std::begin(CACHE_PREFIXES), std::end(CACHE_PREFIXES),
+                     [name](const char* prefix) { return strncmp(name, prefix, strlen(prefix)) == 0; });
+}
+
+uint32_t CacheBudget::totalKb() const {
+  uint32_t total = 0;
+  for (const auto& entry : entries) {
+    for (const uint32_t kb : entry.kb) {
+      total += kb;
+    }
+  }
+  return total;
+}
+
+uint32_t CacheBudget::budgetKb() const { return SETTINGS.getCacheLimitKb(); }
+
+CacheBudget::Entry* CacheBudget::findEntry(const std::string& dir) {
+  const auto it = std::find_if(entries.begin(), entries.end(), [&dir](const Entry& entry) { return entry.dir == dir; });
+  return it != entries.end() ? &*it : nullptr;
+}
+
+CacheBudget::Entry* CacheBudget::evictionCandidate(const Tier tier) {
+  const auto latest = std::max_element(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return a.lastRead < b.lastRead;
+  });
+  Entry* candidate = nullptr;
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (it != latest && it->measured && it->kb[tier] > 0 && (!candidate || it->lastRead < candidate->lastRead)) {
+      candidate = &*it;
+    }
+  }
+  return candidate;
+}
+
+void CacheBudget::touch(const std::string& cachePath) {
+  const std::string dir = cachePath.substr(cachePath.rfind('/') + 1);
+  Entry* entry = findEntry(dir);
+  if (!entry) {
+    if (entries.size() >= MAX_ENTRIES) {
+      // The least recently read cache is no longer tracked, so the open book always is
+      entries.erase(std::min_element(entries.begin(), entries.end(),
+                                     [](const Entry& a, const Entry& b) { return a.lastRead < b.lastRead; }));
+    }
+    entries.emplace_back();
+    entry = &entries.back();
+    entry->dir = dir;
+  }
+  entry->lastRead = ++clock;
+  // It grows while the book is read
+  entry->measured = false;
+  saveToFile();
+}
+
+bool CacheBudget::hasWork() {
+  if (!scanned) {
+    return true;
+  }
+  if (std::any_of(entries.begin(), entries.end(), [](const Entry& entry) { return !entry.measured; })) {
+    return true;
+  }
+  return totalKb() > budgetKb() && (evictionCandidate(FRAMES) || evictionCandidate(PIXELS) ||
+                                    evictionCandidate(SECTIONS));
+}
+
+void CacheBudget::runStep() {
+  if (!scanned) {
+    scan();
+    return;
+  }
+
+  const auto unmeasured =
+      std::find_if(entries.begin(), entries.end(), [](const Entry& entry) { return !entry.measured; });
+  if (unmeasured != entries.end()) {
+    measure(*unmeasured);
+    return;
+  }
+
+  if (totalKb() <= budgetKb()) {
+    return;
+  }
+  for (const Tier tier : {FRAMES, PIXELS, SECTIONS}) {
+    if (Entry* entry = evictionCandidate(tier)) {
+      evict(*entry, tier);
+      return;
+    }
+  }
+}
+
+void CacheBudget::scan() {
+  scanned = true;
+  std::vector<std::string> dirs = listDir(CACHE_ROOT, true);
+  dirs.erase(std::remove_if(dirs.begin(), dirs.end(), [](const std::string& dir) { return !isBookCache(dir.c_str()); }),
+             dirs.end());
+
+  entries.erase(std::remove_if(entries.begin(), entries.end(),
+                               [&dirs](const Entry& entry) {
+                                 return std::find(dirs.begin(), dirs.end(), entry.dir) == dirs.end();
+                               }),
+                entries.end());
+  for (const auto& dir : dirs) {
+    if (entries.size() >= MAX_ENTRIES) {
+      LOG_DBG("CBM", "Tracking %zu caches, the rest are left alone", entries.size());
+      break;
+    }
+    if (!findEntry(dir)) {
+      // Never read since it's tracked, so first in line
+      entries.emplace_back();
+      entries.back().dir = dir;
+    }
+  }
+  LOG_DBG("CBM", "Tracking %zu book caches", entries.size());
+  saveToFile();
+}
+
+// frames/ below sections/ hold page frames and the rest of sections/ section data. In the cache's own directory img_*
+// files are section data too, unless they are decoded pixel caches (.pxc).
+void CacheBudget::addUp(const std::string& path, const Tier tier, uint32_t* kb) {
+  FsFile dir = Storage.open(path.c_str());
+  if (!dir || !dir.isDirectory()) {
+    if (dir) dir.close();
+    return;
+  }
+  char name[128];
+  for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    if (file.isDirectory()) {
+      file.close();
+      Tier childTier = tier;
+      if (tier == KEPT && strcmp(name, "sections") == 0) {
+        childTier = SECTIONS;
+      } else if (tier == SECTIONS && strcmp(name, "frames") == 0) {
+        childTier = FRAMES;
+      }
+      addUp(path + "/" + name, childTier, kb);
+      continue;
+    }
+    Tier fileTier = tier;
+    if (tier == KEPT && endsWith(name, ".pxc")) {
+      fileTier = PIXELS;
+    } else if (tier == KEPT && strncmp(name, "img_", 4) == 0) {
+      fileTier = SECTIONS;
+    }
+    kb[fileTier] += static_cast<uint32_t>((file.size() + 1023) / 1024);
+    file.close();
+  }
+  dir.close();
+  esp_task_wdt_reset();
+}
+
+void CacheBudget::measure(Entry& entry) {
+  const std::string path = std::string(CACHE_ROOT) + "/" + entry.dir;
+  if (!Storage.exists(path.c_str())) {
+    entries.erase(entries.begin() + (&entry - entries.data()));
+    saveToFile();
+    return;
+  }
+  std::fill(std::begin(entry.kb), std::end(entry.kb), 0);
+  addUp(path, KEPT, entry.kb);
+  entry.measured = true;
+  LOG_DBG("CBM", "%s: %u KB frames, %u KB pixels, %u KB sections, %u KB kept", entry.dir.c_str(),
+          static_cast<unsigned>(entry.kb[FRAMES]), static_cast<unsigned>(entry.kb[PIXELS]),
+          static_cast<unsigned>(entry.kb[SECTIONS]), static_cast<unsigned>(entry.kb[KEPT]));
+  saveToFile();
+}
+
+void CacheBudget::evict(Entry& entry, const Tier tier) {
+  const std::string path = std::string(CACHE_ROOT) + "/" + entry.dir;
+  const std::string sectionsDir = path + "/sections";
+  LOG_DBG("CBM", "Over budget (%u of %u KB), evicting tier %u of %s", static_cast<unsigned>(totalKb()),
+          static_cast<unsigned>(budgetKb()), static_cast<unsigned>(tier), entry.dir.c_str());
+
+  bool ok = true;
+  if (tier == FRAMES) {
+    for (const auto& layout : listDir(sectionsDir, true)) {
+      const std::string framesDir = sectionsDir + "/" + layout + "/frames";
+      if (Storage.exists(framesDir.c_str())) {
+        ok = Storage.removeDir(framesDir.c_str()) && ok;
+      }
+    }
+  } else {
+    for (const auto& file : listDir(path, false)) {
+      if (tier == PIXELS ? endsWith(file.c_str(), ".pxc") : strncmp(file.c_str(), "img_", 4) == 0) {
+        ok = Storage.remove((path + "/" + file).c_str()) && ok;
+      }
+    }
+    if (tier == SECTIONS && Storage.exists(sectionsDir.c_str())) {
+      ok = Storage.removeDir(sectionsDir.c_str()) && ok;
+    }
+  }
+  if (!ok) {
+    // Not retried: it would be tried again on every idle step
+    LOG_ERR("CBM", "Could not remove everything from %s", path.c_str());
+  }
+
+  // Sections take their frames and extracted images along
+  entry.kb[tier] = 0;
+  if (tier == SECTIONS) {
+    entry.kb[FRAMES] = 0;
+    entry.kb[PIXELS] = 0;
+  }
+  saveToFile();
+}
+
+bool CacheBudget::saveToFile() const {
+  Storage.mkdir(CACHE_ROOT);
+  FsFile outputFile;
+  if (!Storage.openFileForWrite("CBM", CACHE_INDEX_FILE, outputFile)) {
+    return false;
+  }
+  BufferedFileWriter out(outputFile);
+  serialization::writePod(out, CACHE_INDEX_FILE_VERSION);
+  serialization::writePod(out, clock);
+  serialization::writePod(out, static_cast<uint16_t>(entries.size()));
+  for (const auto& entry : entries) {
+    serialization::writeString(out, entry.dir);
+    serialization::writePod(out, entry.lastRead);
+    serialization::writePod(out, static_cast<uint8_t>(entry.measured));
+    for (const uint32_t kb : entry.kb) {
+      serialization::writePod(out, kb);
+    }
+  }
+  const bool ok = out.flush();
+  outputFile.close();
+  return ok;
+}
+
+bool CacheBudget::loadFromFile() {
+  if (!Storage.exists(CACHE_INDEX_FILE)) {
+    return false;
+  }
+  FsFile inputFile;
+  if (!Storage.openFileForRead("CBM", CACHE_INDEX_FILE, inputFile)) {
+    return false;
+  }
+  BufferedFileReader in(inputFile);
+
+  uint8_t version;
+  serialization::readPod(in, version);
+  if (version != CACHE_INDEX_FILE_VERSION) {
+    LOG_ERR("CBM", "Deserialization failed: Unknown version %u", version);
+    inputFile.close();
+    return false;
+  }
+
+  uint16_t count = 0;
+  serialization::readPod(in, clock);
+  serialization::readPod(in, count);
+  entries.clear();
+  entries.reserve(std::min<size_t>(count, MAX_ENTRIES));
+  for (uint16_t i = 0; i < count && i < MAX_ENTRIES; i++) {
+    Entry entry;
+    uint8_t measured = 0;
+    uint32_t len = 0;
+    serialization::readPod(in, len);
+    if (len > MAX_DIR_NAME_LENGTH) {
+      break;
+    }
+    entry.dir.resize(len);
+    in.read(&entry.dir[0], len);
+    serialization::readPod(in, entry.lastRead);
+    serialization::readPod(in, measured);
+    for (uint32_t& kb : entry.kb) {
+      serialization::readPod(in, kb);
+    }
+    if (!isBookCache(entry.dir.c_str())) {
+      break;
+    }
+    entry.measured = measured != 0;
+    entries.push_back(std::move(entry));
+  }
+  inputFile.close();
+  LOG_DBG("CBM", "Loaded %zu book caches", entries.size());
+  return true;
+}
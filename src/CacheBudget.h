@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keeps the book caches in /.crosspoint (epub_*, xtc_*, txt_*, bmp_*) within the size chosen in the settings. Each cache is
+// tracked in /.crosspoint/cache_index.bin with what it holds and when its book was last opened. Over the budget, what
+// is cheapest to build again goes first: rendered page frames, then decoded image caches, then the laid out sections
+// with their extracted images, each from the least recently read book on. Metadata, covers and reading progress are
+// never removed, and neither is anything of the book read last.
+//
+// Sizing a cache means walking its directory, so the work is done one step at a time from idle screens.
+class CacheBudget {
+  // Static instance
+  static CacheBudget instance;
+
+  enum Tier : uint8_t { FRAMES, PIXELS, SECTIONS, KEPT, TIER_COUNT };
+
+  struct Entry {
+    std::string dir;  // Name in /.crosspoint
+    uint32_t lastRead = 0;
+    uint32_t kb[TIER_COUNT] = {};
+    bool measured = false;
+  };
+
+  std::vector<Entry> entries;
+  uint32_t clock = 0;
+  bool scanned = false;
+
+  uint32_t totalKb() const;
+  uint32_t budgetKb() const;
+  Entry* findEntry(const std::string& dir);
+  // The least recently read entry still holding something of tier, other than the book read last
+  Entry* evictionCandidate(Tier tier);
+  void scan();
+  void measure(Entry& entry);
+  // Adds the sizes of everything below path to kb, by tier
+  static void addUp(const std::string& path, Tier tier, uint32_t* kb);
+  void evict(Entry& entry, Tier tier);
+
+ public:
+  ~CacheBudget() = default;
+
+  // Get singleton instance
+  static CacheBudget& getInstance() { return instance; }
+  // Whether the directory name in /.crosspoint is one of the book caches, which Clear cache removes too
+  static bool isBookCache(const char* name);
+
+  // A book with its cache at cachePath was opened: it's now the most recently read, and measured again later
+  void touch(const std::string& cachePath);
+  // Caches were removed behind the manager's back; the next step looks at /.crosspoint again
+  void rescan() { scanned = false; }
+
+  bool hasWork();
+  // One step of scanning, measuring or evicting. Takes the SD card for a moment; call with the render lock held.
+  void runStep();
+
+  bool saveToFile() const;
+  bool loadFromFile();
+};
+
+// Helper macro to access the cache budget
+#define CACHE_BUDGET CacheBudget::getInstance()
@@ -0,0 +1,206 @@
+#include "CoverJobQueue.h"
+
+#include <Arduino.h>
+#include <Epub.h>
+#include <Epub/Section.h>
+#include <HalPowerManager.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <Xtc.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "CrossPointSettings.h"
+#include "SdFonts.h"
+#include "activities/reader/EpubReaderActivity.h"
+#include "components/ThumbnailAtlas.h"
+#include "components/UITheme.h"
+#include "network/BookCatalog.h"
+#include "util/StringUtils.h"
+
+namespace {
+constexpr uint8_t COVER_JOBS_FILE_VERSION = 1;
+constexpr char COVER_JOBS_FILE[] = "/.crosspoint/jobs.bin";
+constexpr int MAX_COVER_JOBS = 64;
+// Quiet time after the last enqueue before jobs run
+constexpr unsigned long SETTLE_DELAY_MS = 5000;
+// The first section is only laid out with this much heap free, as for the reader's own pre-indexing
+constexpr uint32_t PREINDEX_MIN_FREE_HEAP = 96 * 1024;
+// Build slice between watchdog resets
+constexpr uint32_t PREINDEX_SLICE_MS = 500;
+
+bool isCoverSource(const std::string& path) {
+  return StringUtils::checkFileExtension(path, ".epub") || StringUtils::checkFileExtension(path, ".xtc") ||
+         StringUtils::checkFileExtension(path, ".xtch");
+}
+
+// Lays out the section the reader opens a new book at, with the current reader settings, unless it's cached already
+void preindexOpeningSection(const std::shared_ptr<Epub>& epub, GfxRenderer& renderer) {
+  if (ESP.getFreeHeap() < PREINDEX_MIN_FREE_HEAP) {
+    LOG_DBG("CJQ", "Not enough heap to pre-index %s", epub->getPath().c_str());
+    return;
+  }
+  if (SETTINGS.sdFontFamily[0] != '\0' && SD_FONTS.getFontId() == 0) {
+    // An SD card font is loaded by the reader; laid out in the built-in one, the section would go unused
+    return;
+  }
+  uint16_t viewportWidth, viewportHeight;
+  EpubReaderActivity::getOpeningViewport(renderer, &viewportWidth, &viewportHeight);
+  const int spineIndex = EpubReaderActivity::getOpeningSpineIndex(*epub);
+  if (spineIndex < 0 || spineIndex >= epub->getSpineItemsCount()) {
+    return;
+  }
+
+  Section::setMaxCachedLayouts(SETTINGS.cachedLayoutsPerBook);
+  Section section(epub, spineIndex, renderer);
+  if (section.loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                              SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                              viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle)) {
+    return;
+  }
+  if (!section.beginSectionBuild(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                 SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                                 viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle)) {
+    LOG_ERR("CJQ", "Pre-index of section %d failed to start", spineIndex);
+    return;
+  }
+  Section::BuildStatus status;
+  while ((status = section.continueSectionBuild(PREINDEX_SLICE_MS)) == Section::BuildStatus::InProgress) {
+    esp_task_wdt_reset();
+  }
+  LOG_DBG("CJQ", "Pre-index of section %d %s", spineIndex, status == Section::BuildStatus::Done ? "done" : "failed");
+}
+}  // namespace
+
+CoverJobQueue CoverJobQueue::instance;
+
+void CoverJobQueue::enqueue(const std::string& bookPath, const bool shownNow) {
+  if (!isCoverSource(bookPath)) {
+    return;
+  }
+  if (!shownNow) {
+    lastEnqueueTime = millis();
+  }
+  const auto queued = std::find(jobs.begin(), jobs.end(), bookPath);
+  if (queued != jobs.end()) {
+    if (shownNow) {
+      std::rotate(jobs.begin(), queued, queued + 1);
+    }
+    return;
+  }
+  if (jobs.size() >= MAX_COVER_JOBS) {
+    LOG_DBG("CJQ", "Queue full, dropping %s", jobs.front().c_str());
+    jobs.erase(jobs.begin());
+  }
+  jobs.insert(shownNow ? jobs.begin() : jobs.end(), bookPath);
+  LOG_DBG("CJQ", "Queued covers for %s (%zu pending)", bookPath.c_str(), jobs.size());
+  saveToFile();
+}
+
+bool CoverJobQueue::isPending(const std::string& bookPath) const {
+  return std::find(jobs.begin(), jobs.end(), bookPath) != jobs.end();
+}
+
+bool CoverJobQueue::isSettled() const { return millis() - lastEnqueueTime >= SETTLE_DELAY_MS; }
+
+std::string CoverJobQueue::runNext(GfxRenderer& renderer) {
+  if (jobs.empty()) {
+    return "";
+  }
+  // Dropped before running, so a book that crashes the decoder isn't retried on every boot
+  const std::string path = jobs.front();
+  jobs.erase(jobs.begin());
+  saveToFile();
+
+  if (!Storage.exists(path.c_str())) {
+    return path;
+  }
+
+  const unsigned long start = millis();
+  HalPowerManager::Lock powerLock(HalPowerManager::Indexing);
+  const int thumbHeight = UITheme::getInstance().getMetrics().homeCoverHeight;
+  std::string thumbPath;
+  bool success = false;
+  if (StringUtils::checkFileExtension(path, ".epub")) {
+    auto epub = std::shared_ptr<Epub>(new Epub(path, "/.crosspoint"));
+    // With the CSS, so the first open finds everything cached
+    if (epub->load(true, false)) {
+      const bool cropped = SETTINGS.sleepScreenCoverMode == CrossPointSettings::SLEEP_SCREEN_COVER_MODE::CROP;
+      success = epub->generateCoverBmp(cropped) && epub->generateThumbBmp(thumbHeight);
+      thumbPath = epub->getThumbBmpPath(thumbHeight);
+      BookCatalog::describe(path.c_str(), epub->getTitle(), epub->getAuthor());
+      preindexOpeningSection(epub, renderer);
+    }
+  } else {
+    Xtc xtc(path, "/.crosspoint");
+    if (xtc.load()) {
+      success = xtc.generateCoverBmp() && xtc.generateThumbBmp(thumbHeight);
+      thumbPath = xtc.getThumbBmpPath(thumbHeight);
+      BookCatalog::describe(path.c_str(), xtc.getTitle(), xtc.getAuthor());
+    }
+  }
+
+  // A book that was overwritten keeps its old thumbnail in the atlas otherwise
+  ThumbnailAtlas atlas(thumbHeight);
+  if (success && atlas.contains(path)) {
+    atlas.store(path, thumbPath);
+  }
+  LOG_DBG("CJQ", "Ingest of %s %s in %lu ms", path.c_str(), success ? "done" : "failed", millis() - start);
+  return path;
+}
+
+bool CoverJobQueue::saveToFile() const {
+  if (jobs.empty()) {
+    if (Storage.exists(COVER_JOBS_FILE)) {
+      Storage.remove(COVER_JOBS_FILE);
+    }
+    return true;
+  }
+
+  Storage.mkdir("/.crosspoint");
+  FsFile outputFile;
+  if (!Storage.openFileForWrite("CJQ", COVER_JOBS_FILE, outputFile)) {
+    return false;
+  }
+  serialization::writePod(outputFile, COVER_JOBS_FILE_VERSION);
+  serialization::writePod(outputFile, static_cast<uint8_t>(jobs.size()));
+  for (const auto& job : jobs) {
+    serialization::writeString(outputFile, job);
+  }
+  outputFile.close();
+  return true;
+}
+
+bool CoverJobQueue::loadFromFile() {
+  if (!Storage.exists(COVER_JOBS_FILE)) {
+    return false;
+  }
+  FsFile inputFile;
+  if (!Storage.openFileForRead("CJQ", COVER_JOBS_FILE, inputFile)) {
+    return false;
+  }
+
+  uint8_t version;
+  serialization::readPod(inputFile, version);
+  if (version != COVER_JOBS_FILE_VERSION) {
+    LOG_ERR("CJQ", "Deserialization failed: Unknown version %u", version);
+    inputFile.close();
+    return false;
+  }
+
+  uint8_t count;
+  serialization::readPod(inputFile, count);
+  jobs.clear();
+  jobs.reserve(count);
+  for (uint8_t i = 0; i < count; i++) {
+    std::string path;
+    serialization::readString(inputFile, path);
+    jobs.push_back(std::move(path));
+  }
+  inputFile.close();
+  LOG_DBG("CJQ", "Loaded %zu pending cover jobs", jobs.size());
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+
+class GfxRenderer;
+
+// Books that still have to be ingested: for an EPUB its metadata cache (OPF, TOC, book.bin and CSS), the section the
+// reader opens it at, and for EPUB and XTC the cover and home screen thumbnail BMPs. Books arriving over the web
+// server, WebDAV or OPDS are queued here and worked off one at a time while the device sits on an idle screen, so
+// neither the home screen nor the first open of a new book stalls. Persisted to /.crosspoint/jobs.bin.
+class CoverJobQueue {
+  // Static instance
+  static CoverJobQueue instance;
+
+  std::vector<std::string> jobs;
+  unsigned long lastEnqueueTime = 0;
+
+ public:
+  ~CoverJobQueue() = default;
+
+  // Get singleton instance
+  static CoverJobQueue& getInstance() { return instance; }
+
+  // Queue a book for ingest; other file types are ignored. A book a screen is showing a placeholder for goes first and
+  // doesn't hold the queue back for the settle time.
+  void enqueue(const std::string& bookPath, bool shownNow = false);
+  bool isPending(const std::string& bookPath) const;
+  bool isEmpty() const { return jobs.empty(); }
+  // True once nothing has been queued for a few seconds, so a batch of uploads isn't interrupted by a job
+  bool isSettled() const;
+
+  // Ingests the oldest queued book and drops it from the queue, whether or not that worked. The renderer measures text
+  // for the section layout; call with the render lock held, its orientation is changed for a moment.
+  // Returns the book's path, or an empty string when the queue is empty.
+  std::string runNext(GfxRenderer& renderer);
+
+  bool saveToFile() const;
+  bool loadFromFile();
+};
+
+// Helper macro to access the cover job queue
+#define COVER_JOBS CoverJobQueue::getInstance()
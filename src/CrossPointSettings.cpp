@@ -8,6 +8,8 @@
 #include <cstring>
 #include <string>
 
+#include "SdFonts.h"
+#include "SettingsSnapshot.h"
 #include "fontIds.h"
 
 // Initialize the static instance
@@ -26,6 +28,54 @@ constexpr uint8_t SETTINGS_FILE_VERSION = 1;
 constexpr char SETTINGS_FILE_BIN[] = "/.crosspoint/settings.bin";
 constexpr char SETTINGS_FILE_JSON[] = "/.crosspoint/settings.json";
 constexpr char SETTINGS_FILE_BAK[] = "/.crosspoint/settings.bin.bak";
+constexpr char SETTINGS_FILE_SNAPSHOT[] = "/.crosspoint/settings.snap";
+// Bumped whenever snapshotFields changes, or what a field's values mean does
+constexpr uint16_t SETTINGS_SNAPSHOT_VERSION = 1;
+
+// Every setting in the order of the snapshot, for a SettingsSnapshot::Writer or Reader
+template <typename Settings, typename Archive>
+void snapshotFields(Settings& s, Archive& a) {
+  a.field(s.sleepScreen);
+  a.field(s.sleepScreenCoverMode);
+  a.field(s.sleepScreenCoverFilter);
+  a.field(s.statusBar);
+  a.field(s.statusBarChapterPageCount);
+  a.field(s.statusBarBookProgressPercentage);
+  a.field(s.statusBarProgressBar);
+  a.field(s.statusBarProgressBarThickness);
+  a.field(s.statusBarTitle);
+  a.field(s.statusBarBattery);
+  a.field(s.extraParagraphSpacing);
+  a.field(s.textAntiAliasing);
+  a.field(s.shortPwrBtn);
+  a.field(s.orientation);
+  a.field(s.frontButtonLayout);
+  a.field(s.sideButtonLayout);
+  a.field(s.frontButtonBack);
+  a.field(s.frontButtonConfirm);
+  a.field(s.frontButtonLeft);
+  a.field(s.frontButtonRight);
+  a.field(s.fontFamily);
+  a.field(s.fontSize);
+  a.field(s.lineSpacing);
+  a.field(s.paragraphAlignment);
+  a.field(s.sleepTimeout);
+  a.field(s.refreshFrequency);
+  a.field(s.hyphenationEnabled);
+  a.field(s.screenMargin);
+  a.field(s.opdsServerUrl);
+  a.field(s.opdsUsername);
+  a.secret(s.opdsPassword);
+  a.field(s.sdFontFamily);
+  a.field(s.hideBatteryPercentage);
+  a.field(s.longPressChapterSkip);
+  a.field(s.uiTheme);
+  a.field(s.fadingFix);
+  a.field(s.embeddedStyle);
+  a.field(s.cachedLayoutsPerBook);
+  a.field(s.pageFrameCache);
+  a.field(s.cacheLimit);
+}
 
 // Convert legacy front button layout into explicit logical->hardware mapping.
 void applyLegacyFrontButtonLayout(CrossPointSettings& settings) {
@@ -78,11 +128,47 @@ void CrossPointSettings::validateFrontButtonMapping(CrossPointSettings& settings
 
 bool CrossPointSettings::saveToFile() const {
   Storage.mkdir("/.crosspoint");
-  return JsonSettingsIO::saveSettings(*this, SETTINGS_FILE_JSON);
+  if (!JsonSettingsIO::saveSettings(*this, SETTINGS_FILE_JSON)) {
+    return false;
+  }
+  saveSnapshot();
+  return true;
+}
+
+void CrossPointSettings::saveSnapshot() const {
+  SettingsSnapshot::Writer writer;
+  snapshotFields(*this, writer);
+  if (!SettingsSnapshot::save(SETTINGS_FILE_SNAPSHOT, SETTINGS_FILE_JSON, SETTINGS_SNAPSHOT_VERSION,
+                              writer.payload())) {
+    // A snapshot left from before no longer matches the JSON, so it won't be taken
+    LOG_ERR("CPS", "Failed to write settings snapshot");
+  }
+}
+
+bool CrossPointSettings::loadFromSnapshot() {
+  std::string payload;
+  if (!SettingsSnapshot::load(SETTINGS_FILE_SNAPSHOT, SETTINGS_FILE_JSON, SETTINGS_SNAPSHOT_VERSION, payload)) {
+    return false;
+  }
+  // The payload passed its CRC, so a short one means snapshotFields changed without its version; the JSON load that
+  // follows sets every field again
+  SettingsSnapshot::Reader reader(payload);
+  snapshotFields(*this, reader);
+  if (!reader.complete()) {
+    LOG_ERR("CPS", "Settings snapshot doesn't match its version");
+    return false;
+  }
+  validateFrontButtonMapping(*this);
+  LOG_DBG("CPS", "Settings loaded from snapshot");
+  return true;
 }
 
 bool CrossPointSettings::loadFromFile() {
-  // Try JSON first
+  if (loadFromSnapshot()) {
+    return true;
+  }
+
+  // Try JSON next
   if (Storage.exists(SETTINGS_FILE_JSON)) {
     String json = Storage.readFile(SETTINGS_FILE_JSON);
     if (!json.isEmpty()) {
@@ -94,6 +180,8 @@ bool CrossPointSettings::loadFromFile() {
         } else {
           LOG_ERR("CPS", "Failed to resave settings after format update");
         }
+      } else if (result) {
+        saveSnapshot();
       }
       return result;
     }
@@ -277,6 +365,22 @@ unsigned long CrossPointSettings::getSleepTimeoutMs() const {
   }
 }
 
+uint32_t CrossPointSettings::getCacheLimitKb() const {
+  switch (cacheLimit) {
+    case CACHE_256_MB:
+      return 256UL * 1024;
+    case CACHE_512_MB:
+      return 512UL * 1024;
+    case CACHE_1_GB:
+    default:
+      return 1024UL * 1024;
+    case CACHE_2_GB:
+      return 2048UL * 1024;
+    case CACHE_UNLIMITED:
+      return UINT32_MAX;
+  }
+}
+
 int CrossPointSettings::getRefreshFrequency() const {
   switch (refreshFrequency) {
     case REFRESH_1:
@@ -294,6 +398,10 @@ int CrossPointSettings::getRefreshFrequency() const {
 }
 
 int CrossPointSettings::getReaderFontId() const {
+  // A family from the SD card takes the place of the built-in one while it is loaded
+  if (sdFontFamily[0] != '\0' && SD_FONTS.getFontId() != 0) {
+    return SD_FONTS.getFontId();
+  }
   switch (fontFamily) {
     case BOOKERLY:
     default:
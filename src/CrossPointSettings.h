@@ -116,6 +116,16 @@ class CrossPointSettings {
     SLEEP_TIMEOUT_COUNT
   };
 
+  // Total size the book caches on the SD card are kept within
+  enum CACHE_LIMIT {
+    CACHE_256_MB = 0,
+    CACHE_512_MB = 1,
+    CACHE_1_GB = 2,
+    CACHE_2_GB = 3,
+    CACHE_UNLIMITED = 4,
+    CACHE_LIMIT_COUNT
+  };
+
   // E-ink refresh frequency (pages between full refreshes)
   enum REFRESH_FREQUENCY {
     REFRESH_1 = 0,
@@ -183,6 +193,8 @@ class CrossPointSettings {
   char opdsServerUrl[128] = "";
   char opdsUsername[64] = "";
   char opdsPassword[64] = "";
+  // Reader font family from the SD card, a folder of /fonts (see SdFonts); empty for the built-in fontFamily
+  char sdFontFamily[32] = "";
   // Hide battery percentage
   uint8_t hideBatteryPercentage = HIDE_NEVER;
   // Long-press chapter skip on side buttons
@@ -193,6 +205,12 @@ class CrossPointSettings {
   uint8_t fadingFix = 0;
   // Use book's embedded CSS styles for EPUB rendering (1 = enabled, 0 = disabled)
   uint8_t embeddedStyle = 1;
+  // Number of indexed layouts (font, margins, orientation...) kept per book before the least recent is dropped
+  uint8_t cachedLayoutsPerBook = 2;
+  // Keep rendered EPUB pages on the SD card so paging back shows them without rendering again
+  uint8_t pageFrameCache = 0;
+  // Book caches beyond this are trimmed from the least recently read books on
+  uint8_t cacheLimit = CACHE_1_GB;
 
   ~CrossPointSettings() = default;
 
@@ -214,10 +232,14 @@ class CrossPointSettings {
 
  private:
   bool loadFromBinaryFile();
+  // Binary copy of the JSON read at boot in its place, see SettingsSnapshot
+  void saveSnapshot() const;
+  bool loadFromSnapshot();
 
  public:
   float getReaderLineCompression() const;
   unsigned long getSleepTimeoutMs() const;
+  uint32_t getCacheLimitKb() const;
   int getRefreshFrequency() const;
 };
 
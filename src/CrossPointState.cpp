@@ -5,26 +5,73 @@
 #include <Logging.h>
 #include <Serialization.h>
 
+#include "SettingsSnapshot.h"
+
 namespace {
 constexpr uint8_t STATE_FILE_VERSION = 4;
 constexpr char STATE_FILE_BIN[] = "/.crosspoint/state.bin";
 constexpr char STATE_FILE_JSON[] = "/.crosspoint/state.json";
 constexpr char STATE_FILE_BAK[] = "/.crosspoint/state.bin.bak";
+constexpr char STATE_FILE_SNAPSHOT[] = "/.crosspoint/state.snap";
+// Bumped whenever snapshotFields changes
+constexpr uint16_t STATE_SNAPSHOT_VERSION = 1;
+
+template <typename State, typename Archive>
+void snapshotFields(State& s, Archive& a) {
+  a.field(s.openEpubPath);
+  a.field(s.lastSleepImage);
+  a.field(s.readerActivityLoadCount);
+  a.field(s.lastSleepFromReader);
+}
 }  // namespace
 
 CrossPointState CrossPointState::instance;
 
 bool CrossPointState::saveToFile() const {
   Storage.mkdir("/.crosspoint");
-  return JsonSettingsIO::saveState(*this, STATE_FILE_JSON);
+  if (!JsonSettingsIO::saveState(*this, STATE_FILE_JSON)) {
+    return false;
+  }
+  saveSnapshot();
+  return true;
+}
+
+void CrossPointState::saveSnapshot() const {
+  SettingsSnapshot::Writer writer;
+  snapshotFields(*this, writer);
+  if (!SettingsSnapshot::save(STATE_FILE_SNAPSHOT, STATE_FILE_JSON, STATE_SNAPSHOT_VERSION, writer.payload())) {
+    LOG_ERR("CPS", "Failed to write state snapshot");
+  }
+}
+
+bool CrossPointState::loadFromSnapshot() {
+  std::string payload;
+  if (!SettingsSnapshot::load(STATE_FILE_SNAPSHOT, STATE_FILE_JSON, STATE_SNAPSHOT_VERSION, payload)) {
+    return false;
+  }
+  SettingsSnapshot::Reader reader(payload);
+  snapshotFields(*this, reader);
+  if (!reader.complete()) {
+    LOG_ERR("CPS", "State snapshot doesn't match its version");
+    return false;
+  }
+  return true;
 }
 
 bool CrossPointState::loadFromFile() {
-  // Try JSON first
+  if (loadFromSnapshot()) {
+    return true;
+  }
+
+  // Try JSON next
   if (Storage.exists(STATE_FILE_JSON)) {
     String json = Storage.readFile(STATE_FILE_JSON);
     if (!json.isEmpty()) {
-      return JsonSettingsIO::loadState(*this, json.c_str());
+      if (!JsonSettingsIO::loadState(*this, json.c_str())) {
+        return false;
+      }
+      saveSnapshot();
+      return true;
     }
   }
 
@@ -22,6 +22,9 @@ class CrossPointState {
 
  private:
   bool loadFromBinaryFile();
+  // Binary copy of the JSON read at boot in its place, see SettingsSnapshot
+  void saveSnapshot() const;
+  bool loadFromSnapshot();
 };
 
 // Helper macro to access settings
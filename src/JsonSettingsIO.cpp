@@ -5,6 +5,7 @@
 #include <Logging.h>
 #include <ObfuscationUtils.h>
 
+#include <cstdio>
 #include <cstring>
 
 #include "CrossPointSettings.h"
@@ -119,12 +120,16 @@ bool JsonSettingsIO::saveSettings(const CrossPointSettings& s, const char* path)
   doc["opdsServerUrl"] = s.opdsServerUrl;
   doc["opdsUsername"] = s.opdsUsername;
   doc["opdsPassword_obf"] = obfuscation::obfuscateToBase64(s.opdsPassword);
+  doc["sdFontFamily"] = s.sdFontFamily;
   doc["hideBatteryPercentage"] = s.hideBatteryPercentage;
   doc["longPressChapterSkip"] = s.longPressChapterSkip;
   doc["hyphenationEnabled"] = s.hyphenationEnabled;
   doc["uiTheme"] = s.uiTheme;
   doc["fadingFix"] = s.fadingFix;
   doc["embeddedStyle"] = s.embeddedStyle;
+  doc["cachedLayoutsPerBook"] = s.cachedLayoutsPerBook;
+  doc["pageFrameCache"] = s.pageFrameCache;
+  doc["cacheLimit"] = s.cacheLimit;
   doc["statusBarChapterPageCount"] = s.statusBarChapterPageCount;
   doc["statusBarBookProgressPercentage"] = s.statusBarBookProgressPercentage;
   doc["statusBarProgressBar"] = s.statusBarProgressBar;
@@ -186,6 +191,10 @@ bool JsonSettingsIO::loadSettings(CrossPointSettings& s, const char* json, bool*
   s.uiTheme = doc["uiTheme"] | (uint8_t)S::LYRA;
   s.fadingFix = doc["fadingFix"] | (uint8_t)0;
   s.embeddedStyle = doc["embeddedStyle"] | (uint8_t)1;
+  s.cachedLayoutsPerBook = doc["cachedLayoutsPerBook"] | (uint8_t)2;
+  if (s.cachedLayoutsPerBook < 1 || s.cachedLayoutsPerBook > 5) s.cachedLayoutsPerBook = 2;
+  s.pageFrameCache = doc["pageFrameCache"] | (uint8_t)0;
+  s.cacheLimit = clamp(doc["cacheLimit"] | (uint8_t)S::CACHE_1_GB, S::CACHE_LIMIT_COUNT, S::CACHE_1_GB);
 
   const char* url = doc["opdsServerUrl"] | "";
   strncpy(s.opdsServerUrl, url, sizeof(s.opdsServerUrl) - 1);
@@ -203,6 +212,10 @@ bool JsonSettingsIO::loadSettings(CrossPointSettings& s, const char* json, bool*
   }
   strncpy(s.opdsPassword, pass.c_str(), sizeof(s.opdsPassword) - 1);
   s.opdsPassword[sizeof(s.opdsPassword) - 1] = '\0';
+
+  const char* sdFont = doc["sdFontFamily"] | "";
+  strncpy(s.sdFontFamily, sdFont, sizeof(s.sdFontFamily) - 1);
+  s.sdFontFamily[sizeof(s.sdFontFamily) - 1] = '\0';
   LOG_DBG("CPS", "Settings loaded from file");
 
   if (doc.containsKey("statusBarChapterPageCount")) {
@@ -228,6 +241,7 @@ bool JsonSettingsIO::saveKOReader(const KOReaderCredentialStore& store, const ch
   doc["password_obf"] = obfuscation::obfuscateToBase64(store.getPassword());
   doc["serverUrl"] = store.getServerUrl();
   doc["matchMethod"] = static_cast<uint8_t>(store.getMatchMethod());
+  doc["autoSync"] = store.isAutoSync();
 
   String json;
   serializeJson(doc, json);
@@ -253,6 +267,7 @@ bool JsonSettingsIO::loadKOReader(KOReaderCredentialStore& store, const char* js
   store.serverUrl = doc["serverUrl"] | std::string("");
   uint8_t method = doc["matchMethod"] | (uint8_t)0;
   store.matchMethod = static_cast<DocumentMatchMethod>(method);
+  store.autoSync = doc["autoSync"] | false;
 
   LOG_DBG("KRS", "Loaded KOReader credentials for user: %s", store.username.c_str());
   return true;
@@ -269,6 +284,13 @@ bool JsonSettingsIO::saveWifi(const WifiCredentialStore& store, const char* path
     JsonObject obj = arr.add<JsonObject>();
     obj["ssid"] = cred.ssid;
     obj["password_obf"] = obfuscation::obfuscateToBase64(cred.password);
+    if (cred.channel > 0) {
+      char bssid[18];
+      snprintf(bssid, sizeof(bssid), "%02x:%02x:%02x:%02x:%02x:%02x", cred.bssid[0], cred.bssid[1], cred.bssid[2],
+               cred.bssid[3], cred.bssid[4], cred.bssid[5]);
+      obj["bssid"] = bssid;
+      obj["channel"] = cred.channel;
+    }
   }
 
   String json;
@@ -299,6 +321,11 @@ bool JsonSettingsIO::loadWifi(WifiCredentialStore& store, const char* json, bool
       cred.password = obj["password"] | std::string("");
       if (!cred.password.empty() && needsResave) *needsResave = true;
     }
+    const char* bssid = obj["bssid"] | "";
+    if (sscanf(bssid, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &cred.bssid[0], &cred.bssid[1], &cred.bssid[2], &cred.bssid[3],
+               &cred.bssid[4], &cred.bssid[5]) == 6) {
+      cred.channel = obj["channel"] | 0;
+    }
     store.credentials.push_back(cred);
   }
 
@@ -0,0 +1,128 @@
+#include "KOReaderSyncQueue.h"
+
+#include <HalStorage.h>
+#include <KOReaderSyncClient.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+
+namespace {
+constexpr uint8_t KOSYNC_QUEUE_FILE_VERSION = 1;
+constexpr char KOSYNC_QUEUE_FILE[] = "/.crosspoint/kosync_queue.bin";
+constexpr int MAX_PENDING = 32;
+}  // namespace
+
+KOReaderSyncQueue KOReaderSyncQueue::instance;
+
+void KOReaderSyncQueue::record(const std::string& documentHash, const std::string& progress, const float percentage) {
+  if (documentHash.empty()) {
+    return;
+  }
+  auto it = std::find_if(pending.begin(), pending.end(),
+                         [&documentHash](const PendingProgress& p) { return p.document == documentHash; });
+  if (it != pending.end()) {
+    pending.erase(it);
+  } else if (pending.size() >= MAX_PENDING) {
+    LOG_DBG("KOSQ", "Queue full, dropping %s", pending.front().document.c_str());
+    pending.erase(pending.begin());
+  }
+  pending.push_back({documentHash, progress, percentage});
+  LOG_DBG("KOSQ", "Queued %s at %.2f%% (%zu pending)", documentHash.c_str(), percentage * 100, pending.size());
+  saveToFile();
+}
+
+void KOReaderSyncQueue::remove(const std::string& documentHash) {
+  auto it = std::find_if(pending.begin(), pending.end(),
+                         [&documentHash](const PendingProgress& p) { return p.document == documentHash; });
+  if (it != pending.end()) {
+    pending.erase(it);
+    saveToFile();
+  }
+}
+
+int KOReaderSyncQueue::flush() {
+  int sent = 0;
+  while (!pending.empty()) {
+    const PendingProgress& next = pending.front();
+    KOReaderProgress progress;
+    progress.document = next.document;
+    progress.progress = next.progress;
+    progress.percentage = next.percentage;
+
+    const auto result = KOReaderSyncClient::updateProgress(progress);
+    if (result == KOReaderSyncClient::NETWORK_ERROR || result == KOReaderSyncClient::AUTH_FAILED ||
+        result == KOReaderSyncClient::NO_CREDENTIALS) {
+      // Nothing else would get through either
+      LOG_ERR("KOSQ", "Sync stopped: %s, %zu left", KOReaderSyncClient::errorString(result), pending.size());
+      break;
+    }
+    if (result == KOReaderSyncClient::OK) {
+      sent++;
+    } else {
+      // Retrying a position the server refuses would hold up the rest of the queue for good
+      LOG_ERR("KOSQ", "Dropping %s: %s", next.document.c_str(), KOReaderSyncClient::errorString(result));
+    }
+    pending.erase(pending.begin());
+  }
+  saveToFile();
+  LOG_DBG("KOSQ", "Sent %d queued positions", sent);
+  return sent;
+}
+
+bool KOReaderSyncQueue::saveToFile() const {
+  if (pending.empty()) {
+    if (Storage.exists(KOSYNC_QUEUE_FILE)) {
+      Storage.remove(KOSYNC_QUEUE_FILE);
+    }
+    return true;
+  }
+
+  Storage.mkdir("/.crosspoint");
+  FsFile outputFile;
+  if (!Storage.openFileForWrite("KOSQ", KOSYNC_QUEUE_FILE, outputFile)) {
+    return false;
+  }
+  serialization::writePod(outputFile, KOSYNC_QUEUE_FILE_VERSION);
+  serialization::writePod(outputFile, static_cast<uint8_t>(pending.size()));
+  for (const auto& entry : pending) {
+    serialization::writeString(outputFile, entry.document);
+    serialization::writeString(outputFile, entry.progress);
+    serialization::writePod(outputFile, entry.percentage);
+  }
+  outputFile.close();
+  return true;
+}
+
+bool KOReaderSyncQueue::loadFromFile() {
+  if (!Storage.exists(KOSYNC_QUEUE_FILE)) {
+    return false;
+  }
+  FsFile inputFile;
+  if (!Storage.openFileForRead("KOSQ", KOSYNC_QUEUE_FILE, inputFile)) {
+    return false;
+  }
+
+  uint8_t version;
+  serialization::readPod(inputFile, version);
+  if (version != KOSYNC_QUEUE_FILE_VERSION) {
+    LOG_ERR("KOSQ", "Deserialization failed: Unknown version %u", version);
+    inputFile.close();
+    return false;
+  }
+
+  uint8_t count;
+  serialization::readPod(inputFile, count);
+  pending.clear();
+  pending.reserve(count);
+  for (uint8_t i = 0; i < count; i++) {
+    PendingProgress entry;
+    serialization::readString(inputFile, entry.document);
+    serialization::readString(inputFile, entry.progress);
+    serialization::readPod(inputFile, entry.percentage);
+    pending.push_back(std::move(entry));
+  }
+  inputFile.close();
+  LOG_DBG("KOSQ", "Loaded %zu queued positions", pending.size());
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Reading positions waiting to be sent to the KOReader sync server. With auto sync on, the reader records the
+// position of a book here when it's closed, and all pending books are sent in one go the next time WiFi is up (for
+// the web server, or a manual sync), instead of bringing WiFi up for every book. Only the latest position of each
+// document is kept. Persisted to /.crosspoint/kosync_queue.bin.
+class KOReaderSyncQueue {
+  struct PendingProgress {
+    std::string document;  // Document hash
+    std::string progress;  // XPath-like progress string
+    float percentage;
+  };
+
+  // Static instance
+  static KOReaderSyncQueue instance;
+
+  std::vector<PendingProgress> pending;
+
+ public:
+  ~KOReaderSyncQueue() = default;
+
+  // Get singleton instance
+  static KOReaderSyncQueue& getInstance() { return instance; }
+
+  // Queue the position of a document, replacing one queued for it before
+  void record(const std::string& documentHash, const std::string& progress, float percentage);
+  // Drop what's queued for a document, e.g. once it has been synced by hand
+  void remove(const std::string& documentHash);
+  bool isEmpty() const { return pending.empty(); }
+
+  // Sends the queued positions; WiFi must be connected. Stops at the first network or authentication error, keeping
+  // what's left for the next time. Returns the number of positions sent.
+  int flush();
+
+  bool saveToFile() const;
+  bool loadFromFile();
+};
+
+// Helper macro to access the sync queue
+#define KOSYNC_QUEUE KOReaderSyncQueue::getInstance()
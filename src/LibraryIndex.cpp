@@ -0,0 +1,577 @@
+#include "LibraryIndex.h"
+
+#include <BufferedFile.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+namespace {
+constexpr char LIBRARY_DIR[] = "/.crosspoint/library";
+constexpr char INDEX_TEMP_FILE[] = "/.crosspoint/library/index.tmp";
+constexpr char RUNS_FILE[] = "/.crosspoint/library/runs.tmp";
+constexpr char MERGED_RUNS_FILE[] = "/.crosspoint/library/merged.tmp";
+constexpr uint32_t INDEX_MAGIC = 0x5842494C;  // "LIBX"
+constexpr uint8_t INDEX_VERSION = 1;
+// Folder listings kept; storing one more clears the others
+constexpr int MAX_STORED_FOLDERS = 32;
+constexpr uint16_t MAX_NAME_LENGTH = 500;
+// Names sorted in RAM at a time while building
+constexpr size_t CHUNK_BYTES = 8 * 1024;
+// Runs merged at a time, each read through its own file and buffer
+constexpr size_t MAX_MERGE_RUNS = 8;
+// Offsets collected before they're written to the table
+constexpr size_t TABLE_BATCH = 64;
+// Books and images the library lists
+const char* LISTED_EXTENSIONS[] = {".epub", ".xtch", ".xtc", ".txt", ".md", ".bmp"};
+
+using EntryCallback = std::function<void(const char* name)>;
+
+bool isListedFile(const char* name) {
+  const char* extension = strrchr(name, '.');
+  if (!extension) {
+    return false;
+  }
+  for (const char* listed : LISTED_EXTENSIONS) {
+    if (strcasecmp(extension, listed) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool openFolder(const std::string& path, FsFile& dir) {
+  dir = Storage.open(path.c_str());
+  if (!dir || !dir.isDirectory()) {
+    if (dir) dir.close();
+    return false;
+  }
+  dir.rewindDirectory();
+  return true;
+}
+
+// Passes up to maxEntries more of the folder's listed entries to onEntry, folders with a trailing '/'; true at the
+// end of the folder
+bool readFolderEntries(FsFile& dir, const size_t maxEntries, const EntryCallback& onEntry) {
+  char name[MAX_NAME_LENGTH + 1];
+  for (size_t read = 0; read < maxEntries; read++) {
+    FsFile file = dir.openNextFile();
+    if (!file) {
+      return true;
+    }
+    file.getName(name, MAX_NAME_LENGTH);
+    if (name[0] == '.' || strcmp(name, "System Volume Information") == 0) {
+      file.close();
+      continue;
+    }
+
+    if (file.isDirectory()) {
+      strcat(name, "/");
+      onEntry(name);
+    } else if (isListedFile(name)) {
+      onEntry(name);
+    }
+    file.close();
+  }
+  return false;
+}
+
+uint32_t hashName(const char* name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) {
+    hash = (hash ^ static_cast<uint8_t>(*name)) * 16777619u;
+  }
+  return hash;
+}
+
+// Directories first, then a naive natural sort
+bool entryLess(const char* s1, const char* s2) {
+  const size_t len1 = strlen(s1);
+  const size_t len2 = strlen(s2);
+  const bool isDir1 = len1 > 0 && s1[len1 - 1] == '/';
+  const bool isDir2 = len2 > 0 && s2[len2 - 1] == '/';
+  if (isDir1 != isDir2) return isDir1;
+
+  // Iterate while both strings have characters
+  while (*s1 && *s2) {
+    // Check if both are at the start of a number
+    if (isdigit(*s1) && isdigit(*s2)) {
+      // Skip leading zeros
+      while (*s1 == '0') s1++;
+      while (*s2 == '0') s2++;
+
+      // Count digits to compare lengths first
+      int digits1 = 0, digits2 = 0;
+      while (isdigit(s1[digits1])) digits1++;
+      while (isdigit(s2[digits2])) digits2++;
+
+      // Different length so return smaller integer value
+      if (digits1 != digits2) return digits1 < digits2;
+
+      // Same length so compare digit by digit
+      for (int i = 0; i < digits1; i++) {
+        if (s1[i] != s2[i]) return s1[i] < s2[i];
+      }
+
+      // Numbers equal so advance pointers
+      s1 += digits1;
+      s2 += digits2;
+    } else {
+      // Regular case-insensitive character comparison
+      char c1 = tolower(*s1);
+      char c2 = tolower(*s2);
+      if (c1 != c2) return c1 < c2;
+      s1++;
+      s2++;
+    }
+  }
+
+  // One string is prefix of other
+  return *s1 == '\0' && *s2 != '\0';
+}
+
+std::string indexPath(const std::string& folder) {
+  char name[16];
+  snprintf(name, sizeof(name), "/%08x.idx", static_cast<unsigned>(hashName(folder.c_str())));
+  return LIBRARY_DIR + std::string(name);
+}
+
+template <typename File>
+void writeName(File& out, const char* name) {
+  const auto len = static_cast<uint16_t>(std::min<size_t>(strlen(name), MAX_NAME_LENGTH));
+  serialization::writePod(out, len);
+  out.write(name, len);
+}
+
+template <typename File>
+bool readName(File& in, std::string& name) {
+  uint16_t len = 0;
+  if (in.read(&len, sizeof(len)) != sizeof(len) || len > MAX_NAME_LENGTH) {
+    return false;
+  }
+  name.resize(len);
+  return in.read(&name[0], len) == len;
+}
+
+// Sorts the names collected in chunk, each NUL-terminated and starting at one of starts
+void sortChunk(const std::vector<char>& chunk, std::vector<uint32_t>& starts) {
+  std::sort(starts.begin(), starts.end(),
+            [&chunk](const uint32_t a, const uint32_t b) { return entryLess(&chunk[a], &chunk[b]); });
+}
+
+// Sorted runs of names, one behind the other in a scratch file
+struct RunFile {
+  FsFile file;
+  std::unique_ptr<BufferedFileWriter> out;
+  std::vector<uint32_t> starts;
+
+  bool create(const char* path) {
+    if (!Storage.openFileForWrite("LIB", path, file)) {
+      return false;
+    }
+    out = std::unique_ptr<BufferedFileWriter>(new BufferedFileWriter(file));
+    return true;
+  }
+
+  void beginRun() { starts.push_back(out->position()); }
+
+  // Finishes writing; the runs end where the file does
+  bool finish(uint32_t& end) {
+    const bool ok = out->flush();
+    end = out->position();
+    out.reset();
+    file.close();
+    return ok;
+  }
+};
+
+// Reads one sorted run back, name by name
+struct RunReader {
+  FsFile file;
+  std::unique_ptr<BufferedFileReader> in;
+  uint32_t end = 0;
+  std::string head;
+
+  ~RunReader() {
+    if (file) {
+      file.close();
+    }
+  }
+
+  bool open(const char* path, const uint32_t start, const uint32_t runEnd) {
+    if (!Storage.openFileForRead("LIB", path, file) || !file.seek(start)) {
+      return false;
+    }
+    in = std::unique_ptr<BufferedFileReader>(new BufferedFileReader(file));
+    end = runEnd;
+    return true;
+  }
+
+  // Moves head to the next name; false at the end of the run
+  bool next() { return in->position() < end && readName(*in, head); }
+};
+
+// Merges runs [first, last) of the file at path, passing the names to onEntry in order
+bool mergeRuns(const char* path, const std::vector<uint32_t>& starts, const size_t first, const size_t last,
+               const uint32_t end, const EntryCallback& onEntry) {
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (size_t i = first; i < last; i++) {
+    std::unique_ptr<RunReader> reader(new RunReader);
+    if (!reader->open(path, starts[i], i + 1 < starts.size() ? starts[i + 1] : end)) {
+      return false;
+    }
+    if (reader->next()) {
+      readers.push_back(std::move(reader));
+    }
+  }
+
+  while (!readers.empty()) {
+    size_t smallest = 0;
+    for (size_t i = 1; i < readers.size(); i++) {
+      if (entryLess(readers[i]->head.c_str(), readers[smallest]->head.c_str())) {
+        smallest = i;
+      }
+    }
+    onEntry(readers[smallest]->head.c_str());
+    if (!readers[smallest]->next()) {
+      readers.erase(readers.begin() + smallest);
+    }
+  }
+  return true;
+}
+
+// Writes the index file: the header, the table of name offsets, then the names as they are added. The table is
+// written as zeros first and filled in as the names go out, a batch of offsets at a time.
+class IndexWriter {
+ public:
+  explicit IndexWriter(FsFile& file) : out(file) {}
+
+  void begin(const std::string& folder, const uint32_t count, const uint32_t nameHash) {
+    this->count = count;
+    tableOffset = sizeof(INDEX_MAGIC) + sizeof(INDEX_VERSION) + 3 * sizeof(uint32_t) + sizeof(uint16_t) +
+                  std::min<size_t>(folder.size(), MAX_NAME_LENGTH);
+    serialization::writePod(out, INDEX_MAGIC);
+    serialization::writePod(out, INDEX_VERSION);
+    serialization::writePod(out, count);
+    serialization::writePod(out, nameHash);
+    serialization::writePod(out, tableOffset);
+    writeName(out, folder.c_str());
+    const uint32_t zero = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      serialization::writePod(out, zero);
+    }
+  }
+
+  void add(const char* name) {
+    if (written + pending >= count) {
+      return;
+    }
+    offsets[pending++] = out.position();
+    writeName(out, name);
+    if (pending == TABLE_BATCH) {
+      writeTable();
+    }
+  }
+
+  // False if a write failed or fewer names came than announced
+  bool finish() {
+    writeTable();
+    return out.flush() && !failed && written == count;
+  }
+
+ private:
+  BufferedFileWriter out;
+  uint32_t count = 0;
+  uint32_t tableOffset = 0;
+  uint32_t offsets[TABLE_BATCH] = {};
+  size_t pending = 0;
+  uint32_t written = 0;
+  bool failed = false;
+
+  void writeTable() {
+    if (pending == 0) {
+      return;
+    }
+    const uint32_t back = out.position();
+    const size_t bytes = pending * sizeof(uint32_t);
+    if (!out.seek(tableOffset + written * sizeof(uint32_t)) || out.write(offsets, bytes) != bytes || !out.seek(back)) {
+      failed = true;
+    }
+    written += pending;
+    pending = 0;
+  }
+};
+
+// Makes room for one more folder listing, keeping the one at keep
+void pruneStoredFolders(const std::string& keep) {
+  FsFile dir;
+  if (!openFolder(LIBRARY_DIR, dir)) {
+    return;
+  }
+  std::vector<std::string> stored;
+  char name[32];
+  for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    file.getName(name, sizeof(name));
+    const size_t len = strlen(name);
+    if (len > 4 && strcmp(name + len - 4, ".idx") == 0) {
+      stored.emplace_back(std::string(LIBRARY_DIR) + "/" + name);
+    }
+    file.close();
+  }
+  dir.close();
+
+  if (stored.size() < MAX_STORED_FOLDERS) {
+    return;
+  }
+  for (const auto& path : stored) {
+    if (path != keep) {
+      Storage.remove(path.c_str());
+    }
+  }
+}
+}  // namespace
+
+bool LibraryIndex::open(const std::string& path) {
+  close();
+  const std::string filePath = indexPath(path);
+  if (!Storage.exists(filePath.c_str()) || !Storage.openFileForRead("LIB", filePath, file)) {
+    return false;
+  }
+
+  uint32_t magic = 0;
+  uint8_t version = 0;
+  std::string storedFolder;
+  serialization::readPod(file, magic);
+  serialization::readPod(file, version);
+  serialization::readPod(file, count);
+  serialization::readPod(file, nameHash);
+  serialization::readPod(file, tableOffset);
+  const uint32_t fileSize = static_cast<uint32_t>(file.size());
+  if (magic != INDEX_MAGIC || version != INDEX_VERSION || !readName(file, storedFolder) || storedFolder != path ||
+      tableOffset > fileSize || count > (fileSize - tableOffset) / sizeof(uint32_t)) {
+    LOG_DBG("LIB", "No usable listing stored for %s", path.c_str());
+    close();
+    return false;
+  }
+  folder = path;
+  return true;
+}
+
+bool LibraryIndex::build(const std::string& path) {
+  close();
+  FsFile dir;
+  if (!openFolder(path, dir)) {
+    LOG_ERR("LIB", "Could not open folder %s", path.c_str());
+    return false;
+  }
+  Storage.mkdir(LIBRARY_DIR);
+  const std::string filePath = indexPath(path);
+  pruneStoredFolders(filePath);
+
+  // Sort the entries in chunks; whenever one fills up it goes to the scratch file as a sorted run
+  std::vector<char> chunk;
+  std::vector<uint32_t> starts;
+  chunk.reserve(CHUNK_BYTES + MAX_NAME_LENGTH + 1);
+  RunFile runs;
+  uint32_t total = 0;
+  uint32_t hash = 0;
+  bool ok = true;
+  const auto writeRun = [&] {
+    if (!runs.out && !runs.create(RUNS_FILE)) {
+      ok = false;
+    }
+    if (ok) {
+      sortChunk(chunk, starts);
+      runs.beginRun();
+      for (const uint32_t start : starts) {
+        writeName(*runs.out, &chunk[start]);
+      }
+    }
+    chunk.clear();
+    starts.clear();
+  };
+  readFolderEntries(dir, SIZE_MAX, [&](const char* name) {
+    starts.push_back(static_cast<uint32_t>(chunk.size()));
+    chunk.insert(chunk.end(), name, name + strlen(name) + 1);
+    total++;
+    hash += hashName(name);
+    if (chunk.size() >= CHUNK_BYTES) {
+      writeRun();
+    }
+  });
+  dir.close();
+
+  uint32_t runsEnd = 0;
+  const char* runsPath = RUNS_FILE;
+  if (runs.out) {
+    if (!chunk.empty()) {
+      writeRun();
+    }
+    std::vector<char>().swap(chunk);
+    std::vector<uint32_t>().swap(starts);
+    ok = runs.finish(runsEnd) && ok;
+
+    // Too many runs to merge in one go: merge them in groups into longer runs, until few enough are left
+    const char* otherPath = MERGED_RUNS_FILE;
+    while (ok && runs.starts.size() > MAX_MERGE_RUNS) {
+      RunFile merged;
+      ok = merged.create(otherPath);
+      for (size_t first = 0; ok && first < runs.starts.size(); first += MAX_MERGE_RUNS) {
+        merged.beginRun();
+        ok = mergeRuns(runsPath, runs.starts, first, std::min(first + MAX_MERGE_RUNS, runs.starts.size()), runsEnd,
+                       [&merged](const char* name) { writeName(*merged.out, name); });
+      }
+      if (merged.out) {
+        ok = merged.finish(runsEnd) && ok;
+      }
+      Storage.remove(runsPath);
+      std::swap(runsPath, otherPath);
+      runs.starts.swap(merged.starts);
+    }
+  } else {
+    sortChunk(chunk, starts);
+  }
+
+  FsFile outFile;
+  if (ok && Storage.openFileForWrite("LIB", INDEX_TEMP_FILE, outFile)) {
+    IndexWriter out(outFile);
+    out.begin(path, total, hash);
+    if (runs.starts.empty()) {
+      for (const uint32_t start : starts) {
+        out.add(&chunk[start]);
+      }
+    } else {
+      ok = mergeRuns(runsPath, runs.starts, 0, runs.starts.size(), runsEnd,
+                     [&out](const char* name) { out.add(name); });
+    }
+    ok = out.finish() && ok;
+    outFile.close();
+  } else {
+    ok = false;
+  }
+  if (!runs.starts.empty()) {
+    Storage.remove(runsPath);
+  }
+
+  if (!ok) {
+    LOG_ERR("LIB", "Failed to store the listing of %s", path.c_str());
+    Storage.remove(INDEX_TEMP_FILE);
+    return false;
+  }
+  Storage.remove(filePath.c_str());
+  if (!Storage.rename(INDEX_TEMP_FILE, filePath.c_str())) {
+    LOG_ERR("LIB", "Failed to save the listing of %s", path.c_str());
+    Storage.remove(INDEX_TEMP_FILE);
+    return false;
+  }
+  LOG_DBG("LIB", "Stored %u entries of %s", static_cast<unsigned>(total), path.c_str());
+  return open(path);
+}
+
+void LibraryIndex::close() {
+  if (file) {
+    file.close();
+  }
+  if (checkDir) {
+    checkDir.close();
+  }
+  folder.clear();
+  count = 0;
+  window.clear();
+  windowFirst = 0;
+}
+
+bool LibraryIndex::loadWindow(const size_t first) {
+  window.clear();
+  windowFirst = first;
+  uint32_t offset = 0;
+  if (!file.seek(tableOffset + first * sizeof(uint32_t)) || file.read(&offset, sizeof(offset)) != sizeof(offset) ||
+      !file.seek(offset)) {
+    return false;
+  }
+  BufferedFileReader in(file);
+  const size_t rows = std::min(WINDOW_ROWS, count - first);
+  window.resize(rows);
+  for (size_t i = 0; i < rows; i++) {
+    if (!readName(in, window[i])) {
+      LOG_ERR("LIB", "Stored listing of %s is damaged", folder.c_str());
+      window.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+const std::string& LibraryIndex::name(const size_t index) {
+  if (index >= count) {
+    return empty;
+  }
+  if (index < windowFirst || index >= windowFirst + window.size()) {
+    if (!loadWindow(index - index % (WINDOW_ROWS / 3))) {
+      return empty;
+    }
+  }
+  return window[index - windowFirst];
+}
+
+size_t LibraryIndex::find(const std::string& target) {
+  // Names that compare equal (differing in case only, say) sit side by side; the search lands on the first of them
+  std::string probe;
+  const auto readAt = [this, &probe](const size_t index) {
+    uint32_t offset = 0;
+    return file.seek(tableOffset + index * sizeof(uint32_t)) && file.read(&offset, sizeof(offset)) == sizeof(offset) &&
+           file.seek(offset) && readName(file, probe);
+  };
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (!readAt(mid)) {
+      return 0;
+    }
+    if (entryLess(probe.c_str(), target.c_str())) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  for (size_t i = low; i < count && readAt(i) && !entryLess(target.c_str(), probe.c_str()); i++) {
+    if (probe == target) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+bool LibraryIndex::beginCheck() {
+  if (checkDir) {
+    checkDir.close();
+  }
+  checkCount = 0;
+  checkHash = 0;
+  return file && openFolder(folder, checkDir);
+}
+
+LibraryIndex::CheckStatus LibraryIndex::continueCheck(const size_t maxEntries) {
+  if (!checkDir) {
+    return CheckStatus::Failed;
+  }
+  if (!readFolderEntries(checkDir, maxEntries, [this](const char* name) {
+        checkCount++;
+        checkHash += hashName(name);
+      })) {
+    return CheckStatus::Running;
+  }
+  checkDir.close();
+  if (checkCount == count && checkHash == nameHash) {
+    return CheckStatus::Unchanged;
+  }
+  LOG_DBG("LIB", "%s changed since it was stored", folder.c_str());
+  return CheckStatus::Changed;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Sorted listing of one library folder, kept on the SD card in /.crosspoint/library/ so the library screen reads in
+// only the rows it shows: RAM use is the same for a folder of any size. Folders first, then files, in natural order
+// (case-insensitive, numbers by value); hidden entries and files the reader can't open are left out.
+//
+// The file holds a header, the offset of every name, then the names in order. It's built by an external merge sort:
+// the entries are sorted in RAM a few KB at a time, the sorted runs go to a scratch file and are then merged.
+// A stored listing is shown as it is and checked against the folder afterwards, by count and a hash over the names,
+// a few entries at a time; if the folder changed it's built again. FAT doesn't keep directory modification times up
+// to date, so they can't tell.
+class LibraryIndex {
+ public:
+  enum class CheckStatus { Running, Unchanged, Changed, Failed };
+
+  LibraryIndex() = default;
+  ~LibraryIndex() { close(); }
+  LibraryIndex(const LibraryIndex&) = delete;
+  LibraryIndex& operator=(const LibraryIndex&) = delete;
+
+  // Opens the listing stored for folder; false if there is none (or it can't be read)
+  bool open(const std::string& folder);
+  // Lists the folder again and opens the result; false if the folder can't be read
+  bool build(const std::string& folder);
+  void close();
+
+  size_t size() const { return count; }
+  // Name of an entry, folders with a trailing '/'. The rows around it are read in together, unless already in RAM.
+  const std::string& name(size_t index);
+  // Index of the entry called name (binary search), 0 if there is none
+  size_t find(const std::string& name);
+
+  // Reads the folder up to maxEntries entries per call, to compare it with the open listing
+  bool beginCheck();
+  CheckStatus continueCheck(size_t maxEntries);
+
+ private:
+  // Rows read in at a time. Loaded from a multiple of WINDOW_ROWS / 3 on, so a page of up to two thirds of it is
+  // always read in one go.
+  static constexpr size_t WINDOW_ROWS = 48;
+
+  FsFile file;
+  std::string folder;
+  uint32_t count = 0;
+  uint32_t nameHash = 0;
+  uint32_t tableOffset = 0;
+  std::vector<std::string> window;
+  size_t windowFirst = 0;
+  std::string empty;
+
+  FsFile checkDir;
+  uint32_t checkCount = 0;
+  uint32_t checkHash = 0;
+
+  bool loadWindow(size_t first);
+};
@@ -0,0 +1,442 @@
+#include "LibrarySearchIndex.h"
+
+#include <Arduino.h>
+#include <BufferedFile.h>
+#include <Epub/BookSearchIndex.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "network/BookCatalog.h"
+
+namespace {
+constexpr char INDEX_FILE[] = "/.crosspoint/library_search.bin";
+constexpr char INDEX_TEMP_FILE[] = "/.crosspoint/library_search.tmp";
+constexpr char RUNS_FILE[] = "/.crosspoint/library_search.runs";
+constexpr uint32_t INDEX_MAGIC = 0x5852534C;  // "LSRX"
+constexpr uint8_t INDEX_VERSION = 1;
+constexpr uint32_t HEADER_SIZE = sizeof(INDEX_MAGIC) + sizeof(INDEX_VERSION) + 3 * sizeof(uint32_t);
+constexpr uint16_t MAX_PATH_LENGTH = 500;
+// Folders above a book whose names count as its words
+constexpr int FOLDER_LEVELS = 2;
+// Offsets collected before they're written to the table
+constexpr size_t TABLE_BATCH = 64;
+// Entries each run is read ahead by while merging
+constexpr size_t MERGE_READ_ENTRIES = 8;
+// Books a word may match before the rest are left out; a query this loose has to be typed further anyway
+constexpr size_t MAX_WORD_BOOKS = 2048;
+
+template <typename File>
+void writeStoredPath(File& out, const char* path) {
+  const auto len = static_cast<uint16_t>(std::min<size_t>(strlen(path), MAX_PATH_LENGTH));
+  serialization::writePod(out, len);
+  out.write(path, len);
+}
+
+template <typename File>
+bool readStoredPath(File& in, std::string& path) {
+  uint16_t len = 0;
+  if (in.read(&len, sizeof(len)) != sizeof(len) || len > MAX_PATH_LENGTH) {
+    return false;
+  }
+  path.resize(len);
+  return in.read(&path[0], len) == len;
+}
+
+// The words of a book: those of its file name without the extension and of the folders right above it
+void bookWords(const std::string& path, std::vector<std::string>& words) {
+  size_t end = path.rfind('.');
+  size_t slash = path.rfind('/');
+  if (end == std::string::npos || (slash != std::string::npos && end < slash)) {
+    end = path.size();
+  }
+  for (int level = 0; level <= FOLDER_LEVELS && slash != std::string::npos; level++) {
+    BookSearchIndex::splitTerms(path.substr(slash + 1, end - slash - 1), words);
+    if (slash == 0) {
+      break;
+    }
+    end = slash;
+    slash = path.rfind('/', slash - 1);
+  }
+}
+
+bool startsWith(const std::string& word, const std::string& prefix) {
+  return word.compare(0, prefix.size(), prefix) == 0;
+}
+
+// By word, then book
+template <typename Entry>
+bool entryLess(const Entry& a, const Entry& b) {
+  const int order = memcmp(a.term, b.term, sizeof(a.term));
+  return order != 0 ? order < 0 : a.book < b.book;
+}
+
+// Sorted runs read back a few entries at a time, all through one file
+template <typename Entry>
+struct RunCursor {
+  uint32_t next;
+  uint32_t end;
+  Entry entries[MERGE_READ_ENTRIES];
+  size_t pos = 0;
+  size_t count = 0;
+
+  const Entry& head() const { return entries[pos]; }
+
+  // Moves to the next entry; false at the end of the run (or if it can't be read)
+  bool advance(FsFile& file) {
+    if (++pos < count) {
+      return true;
+    }
+    const size_t left = (end - next) / sizeof(Entry);
+    count = std::min(left, MERGE_READ_ENTRIES);
+    pos = 0;
+    const size_t bytes = count * sizeof(Entry);
+    if (count == 0 || !file.seek(next) || file.read(entries, bytes) != static_cast<int>(bytes)) {
+      return false;
+    }
+    next += bytes;
+    return true;
+  }
+};
+}  // namespace
+
+bool LibrarySearchIndex::build() {
+  const unsigned long start = millis();
+  uint32_t books = 0;
+  if (!BookCatalog::forEach([&books](const BookCatalog::Book&) { books++; })) {
+    LOG_ERR("LSI", "No book catalog to index");
+    return false;
+  }
+  books = std::min<uint32_t>(books, UINT16_MAX);
+
+  FsFile runsFile;
+  FsFile outFile;
+  if (!Storage.openFileForWrite("LSI", RUNS_FILE, runsFile)) {
+    return false;
+  }
+  if (!Storage.openFileForWrite("LSI", INDEX_TEMP_FILE, outFile)) {
+    runsFile.close();
+    Storage.remove(RUNS_FILE);
+    return false;
+  }
+
+  // The header and the path table are written as zeros first; the table is filled in as the paths go out, a batch
+  // of offsets at a time, and the header once the entries are in. The words are sorted a run at a time meanwhile.
+  bool ok = true;
+  std::vector<uint32_t> runStarts;
+  {
+    BufferedFileWriter out(outFile);
+    BufferedFileWriter runs(runsFile);
+    for (uint32_t i = 0; i < HEADER_SIZE; i++) {
+      out.write(static_cast<uint8_t>(0));
+    }
+    const uint32_t zero = 0;
+    for (uint32_t i = 0; i < books; i++) {
+      serialization::writePod(out, zero);
+    }
+
+    std::vector<Entry> run;
+    run.reserve(RUN_ENTRIES);
+    const auto writeRun = [&] {
+      std::sort(run.begin(), run.end(), entryLess<Entry>);
+      runStarts.push_back(runs.position());
+      const size_t bytes = run.size() * sizeof(Entry);
+      ok = runs.write(run.data(), bytes) == bytes && ok;
+      run.clear();
+    };
+
+    uint32_t offsets[TABLE_BATCH];
+    size_t pending = 0;
+    uint32_t written = 0;
+    const auto writeTable = [&] {
+      const uint32_t back = out.position();
+      const size_t bytes = pending * sizeof(uint32_t);
+      ok = out.seek(HEADER_SIZE + written * sizeof(uint32_t)) && out.write(offsets, bytes) == bytes &&
+           out.seek(back) && ok;
+      written += pending;
+      pending = 0;
+    };
+
+    uint32_t book = 0;
+    std::vector<std::string> words;
+    BookCatalog::forEach([&](const BookCatalog::Book& catalogBook) {
+      if (book >= books) {
+        return;
+      }
+      const char* path = catalogBook.path;
+      offsets[pending++] = out.position();
+      writeStoredPath(out, path);
+      if (pending == TABLE_BATCH) {
+        writeTable();
+      }
+
+      // Words that share their first TERM_BYTES are one entry
+      words.clear();
+      bookWords(path, words);
+      for (auto& word : words) {
+        word.resize(std::min(word.size(), TERM_BYTES));
+      }
+      std::sort(words.begin(), words.end());
+      words.erase(std::unique(words.begin(), words.end()), words.end());
+      for (const auto& word : words) {
+        Entry entry = {};
+        memcpy(entry.term, word.data(), word.size());
+        entry.book = static_cast<uint16_t>(book);
+        run.push_back(entry);
+        if (run.size() == RUN_ENTRIES) {
+          writeRun();
+        }
+      }
+      book++;
+    });
+    if (pending > 0) {
+      writeTable();
+    }
+    if (!run.empty()) {
+      writeRun();
+    }
+    ok = runs.flush() && written == books && ok;
+    ok = out.flush() && ok;
+  }
+  runsFile.close();
+
+  // Merge the runs behind the paths
+  const uint32_t entriesStart = static_cast<uint32_t>(outFile.size());
+  uint32_t entries = 0;
+  FsFile runsIn;
+  if (ok && Storage.openFileForRead("LSI", RUNS_FILE, runsIn)) {
+    std::vector<RunCursor<Entry>> cursors;
+    cursors.reserve(runStarts.size());
+    const uint32_t runsEnd = static_cast<uint32_t>(runsIn.size());
+    for (size_t i = 0; i < runStarts.size(); i++) {
+      RunCursor<Entry> cursor;
+      cursor.next = runStarts[i];
+      cursor.end = i + 1 < runStarts.size() ? runStarts[i + 1] : runsEnd;
+      if (cursor.advance(runsIn)) {
+        cursors.push_back(cursor);
+      }
+    }
+    outFile.seek(entriesStart);
+    BufferedFileWriter out(outFile);
+    while (!cursors.empty()) {
+      size_t smallest = 0;
+      for (size_t i = 1; i < cursors.size(); i++) {
+        if (entryLess(cursors[i].head(), cursors[smallest].head())) {
+          smallest = i;
+        }
+      }
+      ok = out.write(&cursors[smallest].head(), sizeof(Entry)) == sizeof(Entry) && ok;
+      entries++;
+      if (!cursors[smallest].advance(runsIn)) {
+        cursors.erase(cursors.begin() + smallest);
+      }
+    }
+    ok = out.flush() && ok;
+    runsIn.close();
+  } else {
+    ok = false;
+  }
+  Storage.remove(RUNS_FILE);
+
+  if (ok && outFile.seek(0)) {
+    serialization::writePod(outFile, INDEX_MAGIC);
+    serialization::writePod(outFile, INDEX_VERSION);
+    serialization::writePod(outFile, books);
+    serialization::writePod(outFile, entries);
+    serialization::writePod(outFile, entriesStart);
+  } else {
+    ok = false;
+  }
+  outFile.close();
+
+  Storage.remove(INDEX_FILE);
+  if (!ok || !Storage.rename(INDEX_TEMP_FILE, INDEX_FILE)) {
+    LOG_ERR("LSI", "Failed to store the library search index");
+    Storage.remove(INDEX_TEMP_FILE);
+    return false;
+  }
+  LOG_DBG("LSI", "Indexed %u words of %u books in %lu ms", static_cast<unsigned>(entries),
+          static_cast<unsigned>(books), millis() - start);
+  return true;
+}
+
+bool LibrarySearchIndex::open() {
+  close();
+  if (!Storage.exists(INDEX_FILE) && !build()) {
+    return false;
+  }
+  if (!Storage.openFileForRead("LSI", INDEX_FILE, file)) {
+    return false;
+  }
+  uint32_t magic = 0;
+  uint8_t version = 0;
+  serialization::readPod(file, magic);
+  serialization::readPod(file, version);
+  serialization::readPod(file, bookCount);
+  serialization::readPod(file, entryCount);
+  serialization::readPod(file, entriesOffset);
+  const uint32_t fileSize = static_cast<uint32_t>(file.size());
+  if (magic != INDEX_MAGIC || version != INDEX_VERSION || entriesOffset > fileSize ||
+      entryCount != (fileSize - entriesOffset) / sizeof(Entry) || bookCount > UINT16_MAX) {
+    LOG_ERR("LSI", "Library search index is damaged");
+    close();
+    invalidate();
+    return false;
+  }
+  return true;
+}
+
+void LibrarySearchIndex::close() {
+  if (file) {
+    file.close();
+  }
+  bookCount = 0;
+  entryCount = 0;
+  entriesOffset = 0;
+}
+
+bool LibrarySearchIndex::isStored() { return Storage.exists(INDEX_FILE); }
+
+void LibrarySearchIndex::invalidate() {
+  if (Storage.exists(INDEX_FILE)) {
+    Storage.remove(INDEX_FILE);
+  }
+}
+
+bool LibrarySearchIndex::readEntry(const uint32_t index, Entry& entry) {
+  return file.seek(entriesOffset + index * sizeof(Entry)) &&
+         file.read(&entry, sizeof(entry)) == static_cast<int>(sizeof(entry));
+}
+
+bool LibrarySearchIndex::findBound(const std::string& prefix, const bool orAbove, uint32_t& index) {
+  const size_t len = std::min(prefix.size(), TERM_BYTES);
+  uint32_t low = 0;
+  uint32_t high = entryCount;
+  Entry entry;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (!readEntry(mid, entry)) {
+      return false;
+    }
+    const int order = memcmp(entry.term, prefix.data(), len);
+    if (order < 0 || (orAbove && order == 0)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  index = low;
+  return true;
+}
+
+bool LibrarySearchIndex::readPath(const uint32_t book, std::string& path) {
+  uint32_t offset = 0;
+  return book < bookCount && file.seek(HEADER_SIZE + book * sizeof(uint32_t)) &&
+         file.read(&offset, sizeof(offset)) == sizeof(offset) && file.seek(offset) && readStoredPath(file, path);
+}
+
+bool LibrarySearchIndex::search(const std::string& query, const size_t maxResults, std::vector<Book>& books) {
+  books.clear();
+  std::vector<std::string> words;
+  BookSearchIndex::splitTerms(query, words);
+  if (!file || words.empty()) {
+    return static_cast<bool>(file);
+  }
+
+  // Where the entries starting with each word are; the books of the fewest of them are the candidates, and the other
+  // words' entries narrow those down
+  struct Range {
+    uint32_t first;
+    uint32_t last;
+  };
+  std::vector<Range> ranges(words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    if (!findBound(words[i], false, ranges[i].first) || !findBound(words[i], true, ranges[i].last)) {
+      return false;
+    }
+    if (ranges[i].first == ranges[i].last) {
+      return true;
+    }
+  }
+  std::vector<size_t> order(words.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&ranges](const size_t a, const size_t b) {
+    return ranges[a].last - ranges[a].first < ranges[b].last - ranges[b].first;
+  });
+
+  std::vector<uint16_t> candidates;
+  std::vector<uint16_t> matches;
+  bool needsCheck = false;
+  for (const size_t word : order) {
+    if (words[word].size() > TERM_BYTES) {
+      needsCheck = true;
+    }
+    const Range& range = ranges[word];
+    if (!candidates.empty() && range.last - range.first > MAX_WORD_BOOKS) {
+      // Too common to read through; checked against the candidates' paths instead
+      needsCheck = true;
+      continue;
+    }
+    matches.clear();
+    if (!file.seek(entriesOffset + range.first * sizeof(Entry))) {
+      return false;
+    }
+    BufferedFileReader in(file);
+    Entry entry;
+    for (uint32_t i = range.first; i < range.last && matches.size() < MAX_WORD_BOOKS; i++) {
+      if (in.read(&entry, sizeof(entry)) != static_cast<int>(sizeof(entry))) {
+        return false;
+      }
+      matches.push_back(entry.book);
+    }
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    if (candidates.empty()) {
+      candidates.swap(matches);
+    } else {
+      const auto end = std::set_intersection(candidates.begin(), candidates.end(), matches.begin(), matches.end(),
+                                             candidates.begin());
+      candidates.erase(end, candidates.end());
+    }
+    if (candidates.empty()) {
+      return true;
+    }
+  }
+
+  std::vector<std::string> pathWords;
+  for (const uint16_t book : candidates) {
+    if (books.size() >= maxResults) {
+      break;
+    }
+    Book result;
+    if (!readPath(book, result.path)) {
+      return false;
+    }
+    if (needsCheck) {
+      pathWords.clear();
+      bookWords(result.path, pathWords);
+      const bool hasAll = std::all_of(words.begin(), words.end(), [&pathWords](const std::string& word) {
+        return std::any_of(pathWords.begin(), pathWords.end(),
+                           [&word](const std::string& pathWord) { return startsWith(pathWord, word); });
+      });
+      if (!hasAll) {
+        continue;
+      }
+    }
+    const size_t slash = result.path.rfind('/');
+    const size_t dot = result.path.rfind('.');
+    result.folder = slash == 0 || slash == std::string::npos ? "/" : result.path.substr(0, slash);
+    result.title = result.path.substr(slash + 1, dot != std::string::npos && dot > slash ? dot - slash - 1
+                                                                                         : std::string::npos);
+    books.push_back(std::move(result));
+  }
+  std::sort(books.begin(), books.end(),
+            [](const Book& a, const Book& b) { return strcasecmp(a.title.c_str(), b.title.c_str()) < 0; });
+  return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Words of every book's title and author, sorted, for finding books as their name is typed. Kept in
+// /.crosspoint/library_search.bin and built from the book catalog (BookCatalog), which drops it whenever it changes.
+// The catalog knows paths only: a book's words are those of its file name and of the two folders above it, which
+// with the Author/Title/ folders Calibre sends books to are the author and title.
+//
+// The file holds a header, the offset of every book's path, the paths, then the words as fixed-size entries of a
+// zero-padded word prefix of TERM_BYTES and a book number, sorted by word. Each lookup is a binary search of the
+// entries on the SD card for the words starting with what was typed, so nothing has to be read in up front. Built
+// like LibraryIndex: the entries are sorted in RAM in runs of RUN_ENTRIES, which are merged in one pass.
+class LibrarySearchIndex {
+ public:
+  struct Book {
+    std::string path;
+    std::string title;  // File name without its extension
+    std::string folder;
+  };
+
+  LibrarySearchIndex() = default;
+  ~LibrarySearchIndex() { close(); }
+  LibrarySearchIndex(const LibrarySearchIndex&) = delete;
+  LibrarySearchIndex& operator=(const LibrarySearchIndex&) = delete;
+
+  // Opens the stored index, building it (and the catalog, if need be) when there is none
+  bool open();
+  void close();
+
+  // Books with a word starting with each word of query (so a word being typed finds them too), by title. At most
+  // maxResults of them.
+  bool search(const std::string& query, size_t maxResults, std::vector<Book>& books);
+
+  // Whether open() finds an index or has to build one
+  static bool isStored();
+  // Drop the stored index, the next open() builds it again
+  static void invalidate();
+
+ private:
+  static constexpr size_t TERM_BYTES = 14;
+  static constexpr size_t RUN_ENTRIES = 512;
+
+  struct Entry {
+    char term[TERM_BYTES];
+    uint16_t book;
+  };
+  static_assert(sizeof(Entry) == 16, "entries are stored as they are in RAM");
+
+  FsFile file;
+  uint32_t bookCount = 0;
+  uint32_t entryCount = 0;
+  uint32_t entriesOffset = 0;
+
+  static bool build();
+  bool readEntry(uint32_t index, Entry& entry);
+  // First entry whose word doesn't start below prefix, or with orAbove, the first one past those that start with it
+  bool findBound(const std::string& prefix, bool orAbove, uint32_t& index);
+  bool readPath(uint32_t book, std::string& path);
+};
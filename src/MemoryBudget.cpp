@@ -0,0 +1,80 @@
+#include "MemoryBudget.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <WiFi.h>
+
+#include "activities/RenderLock.h"
+
+namespace {
+constexpr unsigned long POLL_INTERVAL_MS = 250;
+// Free heap each mode needs kept: the reader's pre-indexing and image decoding, the WiFi stack's buffers, and
+// whatever a screen opened from the home screen may load
+constexpr uint32_t MIN_FREE_HEAP[MemoryBudget::MODE_COUNT] = {96 * 1024, 96 * 1024, 64 * 1024};
+// Free heap beyond the minimum before a squeezed level gets its limits back, so they don't flip on every poll
+constexpr uint32_t RECOVERY_MARGIN = 16 * 1024;
+constexpr const char* MODE_NAMES[MemoryBudget::MODE_COUNT] = {"browsing", "reading", "transfer"};
+}  // namespace
+
+MemoryBudget MemoryBudget::instance;
+
+void MemoryBudget::add(Consumer consumer) {
+  const uint32_t target = targetFor(consumer, getMode());
+  consumer.limit(target);
+  consumers.push_back(std::move(consumer));
+  limits.push_back(target);
+}
+
+MemoryBudget::Mode MemoryBudget::getMode() const {
+  return WiFi.getMode() != WIFI_MODE_NULL ? Transfer : selectedMode;
+}
+
+uint32_t MemoryBudget::targetFor(const Consumer& consumer, const Mode mode) const {
+  const uint32_t preferred = consumer.preferredBytes[mode];
+  if (consumer.priority < squeezedLevels && consumer.minBytes < preferred) {
+    return consumer.minBytes;
+  }
+  return preferred;
+}
+
+void MemoryBudget::apply(const Mode mode) {
+  bool changed = false;
+  for (size_t i = 0; i < consumers.size() && !changed; i++) {
+    changed = targetFor(consumers[i], mode) != limits[i];
+  }
+  if (!changed) {
+    return;
+  }
+
+  RenderLock lock;
+  for (size_t i = 0; i < consumers.size(); i++) {
+    const uint32_t target = targetFor(consumers[i], mode);
+    if (target == limits[i]) {
+      continue;
+    }
+    const uint32_t before = consumers[i].usage();
+    consumers[i].limit(target);
+    limits[i] = target;
+    LOG_DBG("MEM", "%s limited to %u bytes (held %u, now %u)", consumers[i].name, target, before,
+            consumers[i].usage());
+  }
+}
+
+void MemoryBudget::poll() {
+  if (consumers.empty() || millis() - lastPoll < POLL_INTERVAL_MS || RenderLock::peek()) {
+    return;
+  }
+  lastPoll = millis();
+
+  const Mode mode = getMode();
+  const uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < MIN_FREE_HEAP[mode] && squeezedLevels < PRIORITY_COUNT) {
+    squeezedLevels++;
+    LOG_DBG("MEM", "Low heap in %s (%u bytes), squeezing %u priority levels", MODE_NAMES[mode], freeHeap,
+            squeezedLevels);
+  } else if (freeHeap >= MIN_FREE_HEAP[mode] + RECOVERY_MARGIN && squeezedLevels > 0) {
+    squeezedLevels--;
+  }
+
+  apply(mode);
+}
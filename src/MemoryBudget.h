@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Shares the heap between the caches that keep RAM across pages and screens. Each registers with the bytes it would
+// like in every mode (reading, file transfer, browsing) and the least it can work with; the budget tells it its limit
+// whenever the mode changes, and when free heap falls below what the mode needs kept free, puts consumers down to
+// their minimum one priority level at a time, lowest first, until there is enough again. They get their limit back
+// once free heap has recovered. Buffers that only live for one operation still check the heap themselves.
+class MemoryBudget {
+  // Static instance
+  static MemoryBudget instance;
+
+ public:
+  enum Mode : uint8_t { Browsing, Reading, Transfer, MODE_COUNT };
+  enum Priority : uint8_t { Low, Normal, High, PRIORITY_COUNT };
+
+  struct Consumer {
+    const char* name;
+    Priority priority;
+    uint32_t minBytes;
+    uint32_t preferredBytes[MODE_COUNT];
+    std::function<uint32_t()> usage;
+    // Sets the most RAM the consumer may hold, freeing what's over right away
+    std::function<void(uint32_t bytes)> limit;
+  };
+
+  ~MemoryBudget() = default;
+
+  // Get singleton instance
+  static MemoryBudget& getInstance() { return instance; }
+
+  void add(Consumer consumer);
+
+  // The readers switch to Reading while a book is open; Transfer is taken whenever WiFi is on, whatever was set
+  void setMode(Mode mode) { selectedMode = mode; }
+  Mode getMode() const;
+
+  // Called from the main loop, looks at the heap every few hundred ms. Takes the render lock to change a limit.
+  void poll();
+
+ private:
+  std::vector<Consumer> consumers;
+  std::vector<uint32_t> limits;  // Limit each consumer was last given
+  Mode selectedMode = Browsing;
+  // Priority levels put down to their minimum, from Low up
+  uint8_t squeezedLevels = 0;
+  unsigned long lastPoll = 0;
+
+  uint32_t targetFor(const Consumer& consumer, Mode mode) const;
+  // Gives every consumer whose target for the mode changed its new limit
+  void apply(Mode mode);
+};
+
+// Helper macro to access the memory budget
+#define MEMORY_BUDGET MemoryBudget::getInstance()
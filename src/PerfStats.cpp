@@ -0,0 +1,43 @@
+#include "PerfStats.h"
+
+namespace {
+const FontDecompressor* fontDecompressor = nullptr;
+uint32_t pageTimes[PerfStats::PAGE_HISTORY];
+uint32_t pageCount = 0;
+uint32_t loopMax = 0;
+uint32_t loopMaxSinceTaken = 0;
+}  // namespace
+
+namespace PerfStats {
+
+void begin(const FontDecompressor* fonts) { fontDecompressor = fonts; }
+
+const FontDecompressor* getFontDecompressor() { return fontDecompressor; }
+
+void pageRendered(const uint32_t ms) { pageTimes[pageCount++ % PAGE_HISTORY] = ms; }
+
+void loopDone(const uint32_t ms) {
+  if (ms > loopMax) loopMax = ms;
+  if (ms > loopMaxSinceTaken) loopMaxSinceTaken = ms;
+}
+
+uint32_t getPageCount() { return pageCount; }
+
+size_t getRecentPages(uint32_t* out, const size_t maxCount) {
+  const size_t kept = pageCount < PAGE_HISTORY ? pageCount : PAGE_HISTORY;
+  const size_t count = kept < maxCount ? kept : maxCount;
+  for (size_t i = 0; i < count; i++) {
+    out[i] = pageTimes[(pageCount - count + i) % PAGE_HISTORY];
+  }
+  return count;
+}
+
+uint32_t takeLoopMax() {
+  const uint32_t ms = loopMaxSinceTaken;
+  loopMaxSinceTaken = 0;
+  return ms;
+}
+
+uint32_t getLoopMax() { return loopMax; }
+
+}  // namespace PerfStats
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+class FontDecompressor;
+
+// Timings gathered while the device is in use, for the live telemetry the web server streams to its dashboard: how
+// long the last pages took to render and the longest main loop iteration. The reader and the web server never run
+// together, so the page timings a session shows are those of the reading before it.
+namespace PerfStats {
+
+// Page render times kept, oldest dropped first
+constexpr size_t PAGE_HISTORY = 16;
+
+// The font decompressor whose cache statistics are reported
+void begin(const FontDecompressor* fonts);
+const FontDecompressor* getFontDecompressor();
+
+void pageRendered(uint32_t ms);
+void loopDone(uint32_t ms);
+
+// Pages rendered since boot
+uint32_t getPageCount();
+// Copies the render times kept (ms), oldest first; returns how many were copied
+size_t getRecentPages(uint32_t* out, size_t maxCount);
+// Longest loop iteration since the last call, and since boot
+uint32_t takeLoopMax();
+uint32_t getLoopMax();
+
+}  // namespace PerfStats
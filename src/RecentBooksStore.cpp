@@ -9,6 +9,7 @@
 
 #include <algorithm>
 
+#include "SettingsSnapshot.h"
 #include "util/StringUtils.h"
 
 namespace {
@@ -16,6 +17,9 @@ constexpr uint8_t RECENT_BOOKS_FILE_VERSION = 3;
 constexpr char RECENT_BOOKS_FILE_BIN[] = "/.crosspoint/recent.bin";
 constexpr char RECENT_BOOKS_FILE_JSON[] = "/.crosspoint/recent.json";
 constexpr char RECENT_BOOKS_FILE_BAK[] = "/.crosspoint/recent.bin.bak";
+constexpr char RECENT_BOOKS_FILE_SNAPSHOT[] = "/.crosspoint/recent.snap";
+// Bumped whenever the snapshot's fields change
+constexpr uint16_t RECENT_BOOKS_SNAPSHOT_VERSION = 1;
 constexpr int MAX_RECENT_BOOKS = 10;
 }  // namespace
 
@@ -56,7 +60,51 @@ void RecentBooksStore::updateBook(const std::string& path, const std::string& ti
 
 bool RecentBooksStore::saveToFile() const {
   Storage.mkdir("/.crosspoint");
-  return JsonSettingsIO::saveRecentBooks(*this, RECENT_BOOKS_FILE_JSON);
+  if (!JsonSettingsIO::saveRecentBooks(*this, RECENT_BOOKS_FILE_JSON)) {
+    return false;
+  }
+  saveSnapshot();
+  return true;
+}
+
+void RecentBooksStore::saveSnapshot() const {
+  SettingsSnapshot::Writer writer;
+  writer.field(static_cast<uint8_t>(recentBooks.size()));
+  for (const auto& book : recentBooks) {
+    writer.field(book.path);
+    writer.field(book.title);
+    writer.field(book.author);
+    writer.field(book.coverBmpPath);
+  }
+  if (!SettingsSnapshot::save(RECENT_BOOKS_FILE_SNAPSHOT, RECENT_BOOKS_FILE_JSON, RECENT_BOOKS_SNAPSHOT_VERSION,
+                              writer.payload())) {
+    LOG_ERR("RBS", "Failed to write recent books snapshot");
+  }
+}
+
+bool RecentBooksStore::loadFromSnapshot() {
+  std::string payload;
+  if (!SettingsSnapshot::load(RECENT_BOOKS_FILE_SNAPSHOT, RECENT_BOOKS_FILE_JSON, RECENT_BOOKS_SNAPSHOT_VERSION,
+                              payload)) {
+    return false;
+  }
+  SettingsSnapshot::Reader reader(payload);
+  uint8_t count = 0;
+  reader.field(count);
+  std::vector<RecentBook> books(std::min<int>(count, MAX_RECENT_BOOKS));
+  for (auto& book : books) {
+    reader.field(book.path);
+    reader.field(book.title);
+    reader.field(book.author);
+    reader.field(book.coverBmpPath);
+  }
+  if (!reader.complete()) {
+    LOG_ERR("RBS", "Recent books snapshot doesn't match its version");
+    return false;
+  }
+  recentBooks = std::move(books);
+  LOG_DBG("RBS", "Recent books loaded from snapshot (%d entries)", getCount());
+  return true;
 }
 
 RecentBook RecentBooksStore::getDataFromBook(std::string path) const {
@@ -90,11 +138,19 @@ RecentBook RecentBooksStore::getDataFromBook(std::string path) const {
 }
 
 bool RecentBooksStore::loadFromFile() {
-  // Try JSON first
+  if (loadFromSnapshot()) {
+    return true;
+  }
+
+  // Try JSON next
   if (Storage.exists(RECENT_BOOKS_FILE_JSON)) {
     String json = Storage.readFile(RECENT_BOOKS_FILE_JSON);
     if (!json.isEmpty()) {
-      return JsonSettingsIO::loadRecentBooks(*this, json.c_str());
+      if (!JsonSettingsIO::loadRecentBooks(*this, json.c_str())) {
+        return false;
+      }
+      saveSnapshot();
+      return true;
     }
   }
 
@@ -50,6 +50,9 @@ class RecentBooksStore {
 
  private:
   bool loadFromBinaryFile();
+  // Binary copy of the JSON read at boot in its place, see SettingsSnapshot
+  void saveSnapshot() const;
+  bool loadFromSnapshot();
 };
 
 // Helper macro to access recent books store
@@ -0,0 +1,142 @@
+#include "SdFonts.h"
+
+#include <GfxRenderer.h>
+#include <HalStorage.h>
+#include <Logging.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "CrossPointSettings.h"
+
+namespace {
+constexpr char FONTS_DIR[] = "/fonts";
+constexpr char FONT_EXTENSION[] = ".epdfont";
+// In the order EpdFontFamily takes them
+constexpr const char* STYLE_NAMES[] = {"regular", "bold", "italic", "bolditalic"};
+
+struct Size {
+  int points;
+  std::string prefix;  // File name up to the style: <name>_<size>_
+};
+
+// The sizes a family folder has a regular face of, smallest first
+std::vector<Size> familySizes(const std::string& dirPath) {
+  std::vector<Size> sizes;
+  FsFile dir = Storage.open(dirPath.c_str());
+  if (dir && dir.isDirectory()) {
+    const std::string suffix = std::string("_") + STYLE_NAMES[0] + FONT_EXTENSION;
+    char name[128];
+    for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      file.getName(name, sizeof(name));
+      const std::string filename = name;
+      file.close();
+      if (filename[0] == '.' || filename.size() <= suffix.size() ||
+          filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        continue;
+      }
+      const std::string prefix = filename.substr(0, filename.size() - suffix.size() + 1);
+      const size_t sizeStart = prefix.rfind('_', prefix.size() - 2);
+      if (sizeStart == std::string::npos) {
+        continue;
+      }
+      const int points = atoi(prefix.c_str() + sizeStart + 1);
+      if (points > 0) {
+        sizes.push_back({points, prefix});
+      }
+    }
+  }
+  if (dir) dir.close();
+  std::sort(sizes.begin(), sizes.end(), [](const Size& a, const Size& b) { return a.points < b.points; });
+  return sizes;
+}
+
+// Stable over reboots, so the layouts cached with it stay valid, and apart for every family and size
+int fontIdFor(const std::string& path) {
+  uint32_t hash = 2166136261u;  // FNV-1a
+  for (const char c : path) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash == 0 ? 1 : static_cast<int>(hash);
+}
+}  // namespace
+
+SdFonts SdFonts::instance;
+
+std::vector<std::string> SdFonts::listFamilies() {
+  std::vector<std::string> families;
+  FsFile dir = Storage.open(FONTS_DIR);
+  if (dir && dir.isDirectory()) {
+    char name[128];
+    for (FsFile entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+      entry.getName(name, sizeof(name));
+      const bool isFamily = entry.isDirectory() && name[0] != '.';
+      entry.close();
+      // Names longer than the setting holds couldn't be chosen
+      if (isFamily && strlen(name) < sizeof(SETTINGS.sdFontFamily) &&
+          !familySizes(std::string(FONTS_DIR) + "/" + name).empty()) {
+        families.emplace_back(name);
+      }
+    }
+  }
+  if (dir) dir.close();
+  std::sort(families.begin(), families.end());
+  return families;
+}
+
+void SdFonts::unload(GfxRenderer& renderer) {
+  if (fontId != 0) {
+    renderer.removeFont(fontId);
+    LOG_DBG("SDF", "Unloaded %s", loadedFamily.c_str());
+  }
+  fontId = 0;
+  family.reset();
+  for (int i = 0; i < 4; i++) {
+    faces[i].reset();
+    files[i].close();
+  }
+  loadedFamily.clear();
+}
+
+bool SdFonts::load(GfxRenderer& renderer, const std::string& name, const uint8_t fontSize) {
+  const std::string dirPath = std::string(FONTS_DIR) + "/" + name;
+  const std::vector<Size> sizes = familySizes(dirPath);
+  if (sizes.empty()) {
+    LOG_ERR("SDF", "No fonts in %s", dirPath.c_str());
+    return false;
+  }
+  const Size& size = sizes[std::min<size_t>(fontSize, sizes.size() - 1)];
+
+  for (int i = 0; i < 4; i++) {
+    const std::string path = dirPath + "/" + size.prefix + STYLE_NAMES[i] + FONT_EXTENSION;
+    if ((i == 0 || Storage.exists(path.c_str())) && files[i].open(path.c_str())) {
+      faces[i] = std::unique_ptr<EpdFont>(new EpdFont(files[i].getData()));
+    } else if (i == 0) {
+      return false;
+    }
+  }
+  family = std::unique_ptr<EpdFontFamily>(
+      new EpdFontFamily(faces[0].get(), faces[1].get(), faces[2].get(), faces[3].get()));
+  fontId = fontIdFor(dirPath + "/" + size.prefix);
+  renderer.insertFont(fontId, *family);
+  LOG_DBG("SDF", "Loaded %s at %d pt", name.c_str(), size.points);
+  return true;
+}
+
+void SdFonts::apply(GfxRenderer& renderer) {
+  const std::string wanted = SETTINGS.sdFontFamily;
+  if (wanted == loadedFamily && SETTINGS.fontSize == loadedSize) {
+    return;
+  }
+  unload(renderer);
+  if (wanted.empty()) {
+    return;
+  }
+  if (!load(renderer, wanted, SETTINGS.fontSize)) {
+    // Reading goes on in the built-in font; tried again when the settings change
+    unload(renderer);
+  }
+  loadedFamily = wanted;
+  loadedSize = SETTINGS.fontSize;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <EpdFont.h>
+#include <EpdFontFamily.h>
+#include <EpdFontFile.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class GfxRenderer;
+
+// Reader font families from the SD card, for fonts that aren't built into the firmware. A family is a folder of
+// /fonts holding the .epdfont files of lib/EpdFont/scripts/fontconvert.py --binary, named like the built-in fonts:
+// <name>_<size>_<style>.epdfont, style being regular, bold, italic or bolditalic (only regular is needed). Its sizes
+// take the place of the font size setting's, from the smallest on.
+//
+// The family chosen in the settings is loaded at the chosen size, one at a time: the tables of its faces are read
+// into RAM, their glyphs stay in the files and are read in by the FontDecompressor as pages need them.
+class SdFonts {
+  // Static instance
+  static SdFonts instance;
+
+  std::string loadedFamily;
+  uint8_t loadedSize = 0;
+  int fontId = 0;
+  EpdFontFile files[4];
+  std::unique_ptr<EpdFont> faces[4];
+  std::unique_ptr<EpdFontFamily> family;
+
+  void unload(GfxRenderer& renderer);
+  bool load(GfxRenderer& renderer, const std::string& name, uint8_t fontSize);
+
+ public:
+  ~SdFonts() = default;
+
+  // Get singleton instance
+  static SdFonts& getInstance() { return instance; }
+
+  // Names of the families in /fonts, sorted
+  static std::vector<std::string> listFamilies();
+
+  // Loads the family and size of the settings into the renderer, unless they are loaded already, or unloads the one
+  // loaded when the settings name none. Call where no page is being drawn, before laying out or showing a book.
+  void apply(GfxRenderer& renderer);
+
+  // Renderer font of the loaded family, 0 when none is
+  int getFontId() const { return fontId; }
+};
+
+// Helper macro to access the SD card fonts
+#define SD_FONTS SdFonts::getInstance()
@@ -62,6 +62,13 @@ inline std::vector<SettingInfo> getSettingsList() {
                           StrId::STR_CAT_READER),
       SettingInfo::Toggle(StrId::STR_TEXT_AA, &CrossPointSettings::textAntiAliasing, "textAntiAliasing",
                           StrId::STR_CAT_READER),
+      SettingInfo::Value(StrId::STR_CACHED_LAYOUTS, &CrossPointSettings::cachedLayoutsPerBook, {1, 5, 1},
+                         "cachedLayoutsPerBook", StrId::STR_CAT_READER),
+      SettingInfo::Toggle(StrId::STR_PAGE_FRAME_CACHE, &CrossPointSettings::pageFrameCache, "pageFrameCache",
+                          StrId::STR_CAT_READER),
+      SettingInfo::Enum(StrId::STR_CACHE_LIMIT, &CrossPointSettings::cacheLimit,
+                        {StrId::STR_MB_256, StrId::STR_MB_512, StrId::STR_GB_1, StrId::STR_GB_2, StrId::STR_UNLIMITED},
+                        "cacheLimit", StrId::STR_CAT_READER),
       // --- Controls ---
       SettingInfo::Enum(StrId::STR_SIDE_BTN_LAYOUT, &CrossPointSettings::sideButtonLayout,
                         {StrId::STR_PREV_NEXT, StrId::STR_NEXT_PREV}, "sideButtonLayout", StrId::STR_CAT_CONTROLS),
@@ -0,0 +1,151 @@
+#include "SettingsSnapshot.h"
+
+#include <HalStorage.h>
+#include <Logging.h>
+#include <ObfuscationUtils.h>
+#include <Serialization.h>
+
+#include <algorithm>
+
+namespace {
+constexpr uint32_t SNAPSHOT_MAGIC = 0x4E535043;  // "CPSN"
+// The stores are a few hundred bytes; anything past this is not a snapshot
+constexpr uint32_t MAX_PAYLOAD_SIZE = 16 * 1024;
+
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t jsonDate;
+  uint16_t jsonTime;
+  uint16_t reserved;
+  uint32_t jsonSize;
+  uint32_t payloadSize;
+  uint32_t payloadCrc;
+};
+
+uint32_t crc32(const std::string& data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (const char c : data) {
+    crc ^= static_cast<uint8_t>(c);
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+// Size and modification time of the JSON, which change with every write to it from a computer
+bool stampJson(const char* jsonPath, Header& header) {
+  FsFile json;
+  if (!Storage.openFileForRead("SNP", jsonPath, json)) {
+    return false;
+  }
+  header.jsonSize = static_cast<uint32_t>(json.fileSize());
+  json.getModifyDateTime(&header.jsonDate, &header.jsonTime);
+  json.close();
+  return true;
+}
+}  // namespace
+
+namespace SettingsSnapshot {
+
+void Writer::field(const std::string& value) {
+  const auto len = static_cast<uint16_t>(std::min<size_t>(value.size(), UINT16_MAX));
+  data.push_back(static_cast<char>(len & 0xFF));
+  data.push_back(static_cast<char>(len >> 8));
+  data.append(value, 0, len);
+}
+
+void Writer::secret(const std::string& value) {
+  std::string obfuscated = value;
+  obfuscation::xorTransform(obfuscated);
+  field(obfuscated);
+}
+
+void Reader::field(uint8_t& value) {
+  if (!ok || pos + 1 > data.size()) {
+    ok = false;
+    return;
+  }
+  value = static_cast<uint8_t>(data[pos++]);
+}
+
+void Reader::field(std::string& value) {
+  if (!ok || pos + 2 > data.size()) {
+    ok = false;
+    return;
+  }
+  const size_t len = static_cast<uint8_t>(data[pos]) | static_cast<uint8_t>(data[pos + 1]) << 8;
+  if (pos + 2 + len > data.size()) {
+    ok = false;
+    return;
+  }
+  value.assign(data, pos + 2, len);
+  pos += 2 + len;
+}
+
+void Reader::secret(std::string& value) {
+  field(value);
+  obfuscation::xorTransform(value);
+}
+
+bool save(const char* path, const char* jsonPath, const uint16_t version, const std::string& payload) {
+  Header header = {};
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = version;
+  header.payloadSize = static_cast<uint32_t>(payload.size());
+  header.payloadCrc = crc32(payload);
+  if (!stampJson(jsonPath, header)) {
+    return false;
+  }
+
+  FsFile file;
+  if (!Storage.openFileForWrite("SNP", path, file)) {
+    return false;
+  }
+  serialization::writePod(file, header);
+  const size_t written = file.write(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+  file.close();
+  if (written != payload.size()) {
+    LOG_ERR("SNP", "Failed to write %s", path);
+    Storage.remove(path);
+    return false;
+  }
+  return true;
+}
+
+bool load(const char* path, const char* jsonPath, const uint16_t version, std::string& payload) {
+  if (!Storage.exists(path)) {
+    return false;
+  }
+  FsFile file;
+  if (!Storage.openFileForRead("SNP", path, file)) {
+    return false;
+  }
+  Header header = {};
+  const int headerBytes = file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header));
+  const bool headerRead = headerBytes == static_cast<int>(sizeof(header)) && header.magic == SNAPSHOT_MAGIC &&
+                          header.version == version && header.payloadSize <= MAX_PAYLOAD_SIZE;
+  if (headerRead) {
+    payload.resize(header.payloadSize);
+  }
+  const bool payloadRead =
+      headerRead && file.read(reinterpret_cast<uint8_t*>(&payload[0]), payload.size()) == static_cast<int>(payload.size());
+  file.close();
+  if (!payloadRead || crc32(payload) != header.payloadCrc) {
+    LOG_DBG("SNP", "%s is not a snapshot of version %u", path, version);
+    payload.clear();
+    return false;
+  }
+
+  Header current = {};
+  if (!stampJson(jsonPath, current) || current.jsonSize != header.jsonSize || current.jsonDate != header.jsonDate ||
+      current.jsonTime != header.jsonTime) {
+    LOG_DBG("SNP", "%s changed since %s was taken", jsonPath, path);
+    payload.clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace SettingsSnapshot
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Binary copy of a JSON store, written next to it whenever the store is saved and read at boot in its place: one
+// small read and no JSON document. The JSON stays the file to edit; a snapshot is only taken while the JSON is the
+// size and modification time it was written next to, and its payload must pass a CRC and carry the store's version.
+namespace SettingsSnapshot {
+
+// Fields are appended in the order a Reader takes them back
+class Writer {
+ public:
+  void field(const uint8_t value) { data.push_back(static_cast<char>(value)); }
+  void field(const std::string& value);
+  template <size_t N>
+  void field(const char (&value)[N]) {
+    field(std::string(value, strnlen(value, N - 1)));
+  }
+  // Obfuscated with the device key, like the JSON does for passwords
+  void secret(const std::string& value);
+
+  const std::string& payload() const { return data; }
+
+ private:
+  std::string data;
+};
+
+// Every read past the end of the payload leaves the field alone and fails the whole snapshot
+class Reader {
+ public:
+  explicit Reader(const std::string& payload) : data(payload) {}
+
+  void field(uint8_t& value);
+  void field(bool& value) {
+    uint8_t byte = value;
+    field(byte);
+    value = byte != 0;
+  }
+  void field(std::string& value);
+  template <size_t N>
+  void field(char (&value)[N]) {
+    std::string text;
+    field(text);
+    strncpy(value, text.c_str(), N - 1);
+    value[N - 1] = '\0';
+  }
+  void secret(std::string& value);
+  template <size_t N>
+  void secret(char (&value)[N]) {
+    std::string text;
+    secret(text);
+    strncpy(value, text.c_str(), N - 1);
+    value[N - 1] = '\0';
+  }
+
+  // Whether every field was read and the payload took no more
+  bool complete() const { return ok && pos == data.size(); }
+
+ private:
+  const std::string& data;
+  size_t pos = 0;
+  bool ok = true;
+};
+
+// Writes the payload of the store saved to jsonPath, once the JSON is written
+bool save(const char* path, const char* jsonPath, uint16_t version, const std::string& payload);
+// The payload of the snapshot at path, if it is whole, of version and the JSON hasn't changed since it was taken
+bool load(const char* path, const char* jsonPath, uint16_t version, std::string& payload);
+
+}  // namespace SettingsSnapshot
@@ -0,0 +1,372 @@
+#include "SleepScreenCache.h"
+
+#include <Bitmap.h>
+#include <Epub.h>
+#include <GfxRenderer.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <PackBits.h>
+#include <Serialization.h>
+#include <Txt.h>
+#include <Xtc.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "CrossPointSettings.h"
+#include "CrossPointState.h"
+#include "util/StringUtils.h"
+
+namespace {
+constexpr uint8_t SLEEP_CACHE_FILE_VERSION = 1;
+constexpr char SLEEP_CACHE_DIR[] = "/.crosspoint/sleep";
+// Slices of 8 panel rows, each packed through a small stack buffer, as for the wake frame
+constexpr size_t SLICE_SIZE = HalDisplay::DISPLAY_WIDTH_BYTES * 8;
+constexpr size_t SLICE_COUNT = HalDisplay::BUFFER_SIZE / SLICE_SIZE;
+static_assert(SLICE_SIZE * SLICE_COUNT == HalDisplay::BUFFER_SIZE, "Frame slices must cover the whole buffer");
+
+// The planes a cache file holds, in this order
+enum Plane : uint8_t { BW_PLANE, LSB_PLANE, MSB_PLANE, PLANE_COUNT };
+
+bool isCachedGray(const Bitmap& bitmap) {
+  return bitmap.hasGreyscale() &&
+         SETTINGS.sleepScreenCoverFilter == CrossPointSettings::SLEEP_SCREEN_COVER_FILTER::NO_FILTER;
+}
+
+// Name of the cache file of the image at path, as its file and the settings stand now; empty if it can't be opened
+std::string cacheFilePath(const std::string& path, const bool dithering, const GfxRenderer::Orientation orientation) {
+  FsFile file;
+  if (!Storage.openFileForRead("SLC", path, file)) {
+    return "";
+  }
+  const auto size = static_cast<uint32_t>(file.size());
+  uint16_t date = 0, time = 0;
+  file.getModifyDateTime(&date, &time);
+  file.close();
+
+  uint64_t hash = 14695981039346656037ull;
+  const auto mix = [&hash](const uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      hash = (hash ^ ((value >> (8 * i)) & 0xFF)) * 1099511628211ull;
+    }
+  };
+  for (const char c : path) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+  }
+  mix(size);
+  mix(static_cast<uint32_t>(date) << 16 | time);
+  mix(SETTINGS.sleepScreenCoverMode | SETTINGS.sleepScreenCoverFilter << 8 | static_cast<uint32_t>(orientation) << 16 |
+      static_cast<uint32_t>(dithering) << 24);
+
+  char name[sizeof(SLEEP_CACHE_DIR) + 22];
+  snprintf(name, sizeof(name), "%s/%016llx.bin", SLEEP_CACHE_DIR, static_cast<unsigned long long>(hash));
+  return name;
+}
+
+// Where the bitmap goes: centred, scaled down to the screen if it's larger, and with the Crop cover mode cut to the
+// screen's aspect ratio
+void placeBitmap(const Bitmap& bitmap, const int pageWidth, const int pageHeight, int* x, int* y, float* cropX,
+                 float* cropY) {
+  *cropX = 0;
+  *cropY = 0;
+  LOG_DBG("SLC", "bitmap %d x %d, screen %d x %d", bitmap.getWidth(), bitmap.getHeight(), pageWidth, pageHeight);
+  if (bitmap.getWidth() > pageWidth || bitmap.getHeight() > pageHeight) {
+    // image will scale, make sure placement is right
+    float ratio = static_cast<float>(bitmap.getWidth()) / static_cast<float>(bitmap.getHeight());
+    const float screenRatio = static_cast<float>(pageWidth) / static_cast<float>(pageHeight);
+
+    LOG_DBG("SLC", "bitmap ratio: %f, screen ratio: %f", ratio, screenRatio);
+    if (ratio > screenRatio) {
+      // image wider than viewport ratio, scaled down image needs to be centered vertically
+      if (SETTINGS.sleepScreenCoverMode == CrossPointSettings::SLEEP_SCREEN_COVER_MODE::CROP) {
+        *cropX = 1.0f - (screenRatio / ratio);
+        LOG_DBG("SLC", "Cropping bitmap x: %f", *cropX);
+        ratio = (1.0f - *cropX) * static_cast<float>(bitmap.getWidth()) / static_cast<float>(bitmap.getHeight());
+      }
+      *x = 0;
+      *y = std::round((static_cast<float>(pageHeight) - static_cast<float>(pageWidth) / ratio) / 2);
+      LOG_DBG("SLC", "Centering with ratio %f to y=%d", ratio, *y);
+    } else {
+      // image taller than viewport ratio, scaled down image needs to be centered horizontally
+      if (SETTINGS.sleepScreenCoverMode == CrossPointSettings::SLEEP_SCREEN_COVER_MODE::CROP) {
+        *cropY = 1.0f - (ratio / screenRatio);
+        LOG_DBG("SLC", "Cropping bitmap y: %f", *cropY);
+        ratio = static_cast<float>(bitmap.getWidth()) / ((1.0f - *cropY) * static_cast<float>(bitmap.getHeight()));
+      }
+      *x = std::round((static_cast<float>(pageWidth) - static_cast<float>(pageHeight) * ratio) / 2);
+      *y = 0;
+      LOG_DBG("SLC", "Centering with ratio %f to x=%d", ratio, *x);
+    }
+  } else {
+    // center the image
+    *x = (pageWidth - bitmap.getWidth()) / 2;
+    *y = (pageHeight - bitmap.getHeight()) / 2;
+  }
+}
+
+bool writePlane(FsFile& file, const uint8_t* frame) {
+  uint8_t packed[PackBits::maxPackedSize(SLICE_SIZE)];
+  for (size_t i = 0; i < SLICE_COUNT; i++) {
+    const auto sliceSize = static_cast<uint16_t>(PackBits::pack(frame + i * SLICE_SIZE, SLICE_SIZE, packed));
+    serialization::writePod(file, sliceSize);
+    if (file.write(packed, sliceSize) != sliceSize) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool readPlane(FsFile& file, uint8_t* frame) {
+  uint8_t packed[PackBits::maxPackedSize(SLICE_SIZE)];
+  for (size_t i = 0; i < SLICE_COUNT; i++) {
+    uint16_t sliceSize = 0;
+    serialization::readPod(file, sliceSize);
+    if (sliceSize > sizeof(packed) || file.read(packed, sliceSize) != sliceSize ||
+        !PackBits::unpack(packed, sliceSize, frame + i * SLICE_SIZE, SLICE_SIZE)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Shows the planes of a cache file; false if there is none or it's unreadable, with nothing shown yet
+bool showCached(GfxRenderer& renderer, const std::string& cachePath) {
+  FsFile file;
+  if (!Storage.exists(cachePath.c_str()) || !Storage.openFileForRead("SLC", cachePath, file)) {
+    return false;
+  }
+  const unsigned long start = millis();
+  uint8_t version = 0, planes = 0;
+  serialization::readPod(file, version);
+  serialization::readPod(file, planes);
+  uint8_t* frame = renderer.getFrameBuffer();
+  if (version != SLEEP_CACHE_FILE_VERSION || (planes != 1 && planes != PLANE_COUNT) || !readPlane(file, frame)) {
+    LOG_ERR("SLC", "Unusable sleep screen cache %s", cachePath.c_str());
+    file.close();
+    Storage.remove(cachePath.c_str());
+    return false;
+  }
+  renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+
+  if (planes == PLANE_COUNT) {
+    bool ok = readPlane(file, frame);
+    if (ok) {
+      renderer.copyGrayscaleLsbBuffers();
+      ok = readPlane(file, frame);
+    }
+    if (ok) {
+      renderer.copyGrayscaleMsbBuffers();
+      renderer.displayGrayBuffer();
+    } else {
+      // The BW image is up already, it stays
+      LOG_ERR("SLC", "Gray planes of %s are unreadable", cachePath.c_str());
+      file.close();
+      Storage.remove(cachePath.c_str());
+      return true;
+    }
+  }
+  file.close();
+  LOG_DBG("SLC", "Sleep screen from %s in %lu ms", cachePath.c_str(), millis() - start);
+  return true;
+}
+
+// Draws the image at path plane by plane, storing each in cachePath, and shows them if display is set. Without a
+// writable cache file the image is still drawn.
+bool convert(GfxRenderer& renderer, const std::string& path, const bool dithering, const std::string& cachePath,
+             const bool display) {
+  FsFile bmpFile;
+  if (!Storage.openFileForRead("SLC", path, bmpFile)) {
+    return false;
+  }
+  Bitmap bitmap(bmpFile, dithering);
+  if (bitmap.parseHeaders() != BmpReaderError::Ok) {
+    bmpFile.close();
+    return false;
+  }
+  const unsigned long start = millis();
+  const int pageWidth = renderer.getScreenWidth();
+  const int pageHeight = renderer.getScreenHeight();
+  int x, y;
+  float cropX, cropY;
+  placeBitmap(bitmap, pageWidth, pageHeight, &x, &y, &cropX, &cropY);
+  const bool hasGreyscale = isCachedGray(bitmap);
+
+  Storage.mkdir(SLEEP_CACHE_DIR);
+  FsFile cacheFile;
+  bool caching = Storage.openFileForWrite("SLC", cachePath, cacheFile);
+  if (caching) {
+    serialization::writePod(cacheFile, SLEEP_CACHE_FILE_VERSION);
+    serialization::writePod(cacheFile, static_cast<uint8_t>(hasGreyscale ? PLANE_COUNT : 1));
+  }
+  const auto storePlane = [&]() {
+    if (caching && !writePlane(cacheFile, renderer.getFrameBuffer())) {
+      LOG_ERR("SLC", "Failed to write %s", cachePath.c_str());
+      caching = false;
+    }
+  };
+
+  LOG_DBG("SLC", "drawing to %d x %d", x, y);
+  renderer.clearScreen();
+  renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, cropX, cropY);
+  if (SETTINGS.sleepScreenCoverFilter == CrossPointSettings::SLEEP_SCREEN_COVER_FILTER::INVERTED_BLACK_AND_WHITE) {
+    renderer.invertScreen();
+  }
+  storePlane();
+  if (display) {
+    renderer.displayBuffer(HalDisplay::HALF_REFRESH);
+  }
+
+  if (hasGreyscale) {
+    bitmap.rewindToData();
+    renderer.clearScreen(0x00);
+    renderer.setRenderMode(GfxRenderer::GRAYSCALE_LSB);
+    renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, cropX, cropY);
+    storePlane();
+    if (display) {
+      renderer.copyGrayscaleLsbBuffers();
+    }
+
+    bitmap.rewindToData();
+    renderer.clearScreen(0x00);
+    renderer.setRenderMode(GfxRenderer::GRAYSCALE_MSB);
+    renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, cropX, cropY);
+    storePlane();
+    if (display) {
+      renderer.copyGrayscaleMsbBuffers();
+      renderer.displayGrayBuffer();
+    }
+    renderer.setRenderMode(GfxRenderer::BW);
+  }
+  bmpFile.close();
+
+  if (cacheFile) {
+    cacheFile.close();
+    if (!caching) {
+      Storage.remove(cachePath.c_str());
+    }
+  }
+  LOG_DBG("SLC", "Converted %s in %lu ms", path.c_str(), millis() - start);
+  return true;
+}
+
+// The cover the sleep screen would show for the book at bookPath, if the book's cache has it
+std::string coverBmpPath(const std::string& bookPath) {
+  if (StringUtils::checkFileExtension(bookPath, ".xtc") || StringUtils::checkFileExtension(bookPath, ".xtch")) {
+    return Xtc(bookPath, "/.crosspoint").getCoverBmpPath();
+  }
+  if (StringUtils::checkFileExtension(bookPath, ".txt")) {
+    return Txt(bookPath, "/.crosspoint").getCoverBmpPath();
+  }
+  if (StringUtils::checkFileExtension(bookPath, ".epub")) {
+    const bool cropped = SETTINGS.sleepScreenCoverMode == CrossPointSettings::SLEEP_SCREEN_COVER_MODE::CROP;
+    return Epub(bookPath, "/.crosspoint").getCoverBmpPath(cropped);
+  }
+  return "";
+}
+}  // namespace
+
+SleepScreenCache SleepScreenCache::instance;
+
+bool SleepScreenCache::show(GfxRenderer& renderer, const std::string& path, const bool dithering) const {
+  const std::string cachePath = cacheFilePath(path, dithering, renderer.getOrientation());
+  if (cachePath.empty()) {
+    return false;
+  }
+  return showCached(renderer, cachePath) || convert(renderer, path, dithering, cachePath, true);
+}
+
+void SleepScreenCache::scan(const GfxRenderer& renderer) {
+  scanned = true;
+  pending.clear();
+
+  std::vector<Source> sources;
+  const uint8_t mode = SETTINGS.sleepScreen;
+  if (mode == CrossPointSettings::SLEEP_SCREEN_MODE::CUSTOM ||
+      mode == CrossPointSettings::SLEEP_SCREEN_MODE::COVER_CUSTOM) {
+    FsFile dir = Storage.open("/sleep");
+    if (dir && dir.isDirectory()) {
+      char name[128];
+      for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+        file.getName(name, sizeof(name));
+        const std::string filename = name;
+        // As SleepActivity picks them
+        if (!file.isDirectory() && filename[0] != '.' && filename.size() > 4 &&
+            filename.compare(filename.size() - 4, 4, ".bmp") == 0) {
+          sources.push_back({"/sleep/" + filename, true});
+        }
+        file.close();
+      }
+    }
+    if (dir) dir.close();
+    if (Storage.exists("/sleep.bmp")) {
+      sources.push_back({"/sleep.bmp", true});
+    }
+  }
+  if ((mode == CrossPointSettings::SLEEP_SCREEN_MODE::COVER ||
+       mode == CrossPointSettings::SLEEP_SCREEN_MODE::COVER_CUSTOM) &&
+      !APP_STATE.openEpubPath.empty()) {
+    const std::string cover = coverBmpPath(APP_STATE.openEpubPath);
+    if (!cover.empty() && Storage.exists(cover.c_str())) {
+      sources.push_back({cover, false});
+    }
+  }
+
+  std::vector<std::string> wanted;
+  for (const auto& source : sources) {
+    const std::string cachePath = cacheFilePath(source.path, source.dithering, renderer.getOrientation());
+    if (cachePath.empty()) {
+      continue;
+    }
+    wanted.push_back(cachePath.substr(sizeof(SLEEP_CACHE_DIR)));
+    if (!Storage.exists(cachePath.c_str())) {
+      pending.push_back(source);
+    }
+  }
+
+  // Caches of images that are gone, changed or drawn differently now
+  std::vector<std::string> stale;
+  FsFile dir = Storage.open(SLEEP_CACHE_DIR);
+  if (dir && dir.isDirectory()) {
+    char name[128];
+    for (FsFile file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      file.getName(name, sizeof(name));
+      if (!file.isDirectory() && std::find(wanted.begin(), wanted.end(), name) == wanted.end()) {
+        stale.emplace_back(name);
+      }
+      file.close();
+    }
+  }
+  if (dir) dir.close();
+  for (const auto& name : stale) {
+    Storage.remove((std::string(SLEEP_CACHE_DIR) + "/" + name).c_str());
+  }
+  LOG_DBG("SLC", "%zu sleep images, %zu to convert, %zu stale caches removed", sources.size(), pending.size(),
+          stale.size());
+}
+
+void SleepScreenCache::runStep(GfxRenderer& renderer) {
+  if (!scanned) {
+    scan(renderer);
+    return;
+  }
+  if (pending.empty()) {
+    return;
+  }
+  const Source source = pending.front();
+  pending.erase(pending.begin());
+
+  const std::string cachePath = cacheFilePath(source.path, source.dithering, renderer.getOrientation());
+  // The screen being shown is drawn over; without the memory to put it back the image waits for the sleep screen
+  if (cachePath.empty() || !renderer.storeBwBuffer()) {
+    return;
+  }
+  const bool grayPixelsDrawn = renderer.wereGrayPixelsDrawn();
+  if (!convert(renderer, source.path, source.dithering, cachePath, false)) {
+    LOG_DBG("SLC", "Not a usable sleep image: %s", source.path.c_str());
+  }
+  renderer.restoreBwBuffer();
+  if (!grayPixelsDrawn) {
+    renderer.resetGrayPixelsDrawn();
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class GfxRenderer;
+
+// Sleep images as the panel shows them: the BW frame buffer and, for images with gray, the LSB and MSB planes, stored
+// PackBits-compressed in 8-row slices in /.crosspoint/sleep/<key>.bin. The key hashes the image's path, size and
+// modification time with what changes how it's drawn (cover mode, filter, orientation, dithering), so an edited image
+// or a settings change simply misses. Going to sleep with a cached image reads the planes straight into the frame
+// buffer instead of decoding, scaling and dithering the BMP, twice over for gray.
+//
+// An image is cached the first time it's shown. The images of /sleep, /sleep.bmp and the cover of the open book are
+// also converted ahead of time from idle screens, one per step, after boot and whenever files may have changed.
+class SleepScreenCache {
+  // Static instance
+  static SleepScreenCache instance;
+
+  struct Source {
+    std::string path;
+    bool dithering;
+  };
+
+  std::vector<Source> pending;
+  bool scanned = false;
+
+  void scan(const GfxRenderer& renderer);
+
+ public:
+  ~SleepScreenCache() = default;
+
+  // Get singleton instance
+  static SleepScreenCache& getInstance() { return instance; }
+
+  // Shows the BMP at path as the sleep screen, centred and scaled to the screen with the sleep screen settings: from
+  // its cached planes when they're there, otherwise drawn and cached on the way. False if it isn't a usable BMP.
+  bool show(GfxRenderer& renderer, const std::string& path, bool dithering) const;
+
+  // Files the sleep screen may come from have changed; the next step looks for them again
+  void rescan() { scanned = false; }
+
+  bool hasWork() const { return !scanned || !pending.empty(); }
+  // One step of looking for sleep images or converting one of them. Draws into the frame buffer and puts it back
+  // afterwards; call with the render lock held.
+  void runStep(GfxRenderer& renderer);
+};
+
+// Helper macro to access the sleep screen cache
+#define SLEEP_SCREENS SleepScreenCache::getInstance()
@@ -0,0 +1,95 @@
+#include "WakeFrame.h"
+
+#include <Arduino.h>
+#include <HalDisplay.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <PackBits.h>
+#include <Serialization.h>
+
+namespace {
+constexpr char WAKE_FRAME_FILE[] = "/.crosspoint/wake_frame.bin";
+constexpr uint8_t WAKE_FRAME_FILE_VERSION = 1;
+// Slices of 8 panel rows, each packed through a small stack buffer
+constexpr size_t SLICE_SIZE = HalDisplay::DISPLAY_WIDTH_BYTES * 8;
+constexpr size_t SLICE_COUNT = HalDisplay::BUFFER_SIZE / SLICE_SIZE;
+static_assert(SLICE_SIZE * SLICE_COUNT == HalDisplay::BUFFER_SIZE, "Frame slices must cover the whole buffer");
+}  // namespace
+
+namespace WakeFrame {
+
+bool save(const uint8_t* frame, const std::string& bookPath) {
+  if (!frame || bookPath.empty()) {
+    return false;
+  }
+  const unsigned long start = millis();
+  Storage.mkdir("/.crosspoint");
+  FsFile file;
+  if (!Storage.openFileForWrite("WKF", WAKE_FRAME_FILE, file)) {
+    return false;
+  }
+  serialization::writePod(file, WAKE_FRAME_FILE_VERSION);
+  serialization::writeString(file, bookPath);
+
+  uint8_t packed[PackBits::maxPackedSize(SLICE_SIZE)];
+  size_t total = 0;
+  for (size_t i = 0; i < SLICE_COUNT; i++) {
+    const auto sliceSize = static_cast<uint16_t>(PackBits::pack(frame + i * SLICE_SIZE, SLICE_SIZE, packed));
+    serialization::writePod(file, sliceSize);
+    if (file.write(packed, sliceSize) != sliceSize) {
+      LOG_ERR("WKF", "Failed to save the wake frame");
+      file.close();
+      clear();
+      return false;
+    }
+    total += sizeof(sliceSize) + sliceSize;
+  }
+  file.close();
+  LOG_DBG("WKF", "Saved wake frame of %s: %u bytes in %lu ms", bookPath.c_str(), total, millis() - start);
+  return true;
+}
+
+bool restore(HalDisplay& display, const std::string& bookPath) {
+  FsFile file;
+  if (!Storage.exists(WAKE_FRAME_FILE) || !Storage.openFileForRead("WKF", WAKE_FRAME_FILE, file)) {
+    return false;
+  }
+  const unsigned long start = millis();
+  uint8_t version = 0;
+  std::string path;
+  serialization::readPod(file, version);
+  bool ok = version == WAKE_FRAME_FILE_VERSION;
+  if (ok) {
+    serialization::readString(file, path);
+    ok = path == bookPath;
+  }
+
+  // Straight into the frame buffer: nothing has been drawn yet, and after a bad slice the boot screen draws over it
+  uint8_t* frame = display.getFrameBuffer();
+  uint8_t packed[PackBits::maxPackedSize(SLICE_SIZE)];
+  for (size_t i = 0; ok && i < SLICE_COUNT; i++) {
+    uint16_t sliceSize = 0;
+    serialization::readPod(file, sliceSize);
+    ok = sliceSize <= sizeof(packed) && file.read(packed, sliceSize) == sliceSize &&
+         PackBits::unpack(packed, sliceSize, frame + i * SLICE_SIZE, SLICE_SIZE);
+  }
+  file.close();
+  clear();
+  if (!ok) {
+    LOG_DBG("WKF", "No usable wake frame for %s", bookPath.c_str());
+    return false;
+  }
+
+  // Clears the sleep screen cleanly; the reader's own first render then only refreshes the same page
+  display.displayBuffer(HalDisplay::HALF_REFRESH);
+  LOG_DBG("WKF", "Restored wake frame in %lu ms", millis() - start);
+  return true;
+}
+
+void clear() {
+  if (Storage.exists(WAKE_FRAME_FILE)) {
+    Storage.remove(WAKE_FRAME_FILE);
+  }
+}
+
+}  // namespace WakeFrame
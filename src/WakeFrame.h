@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class HalDisplay;
+
+// The reader page on screen when the device went to sleep, so waking into that book can put it back on the panel
+// straight away instead of showing the boot screen until the book is loaded and the page laid out again. The BW frame
+// buffer is stored PackBits-compressed in 8-row slices in /.crosspoint/wake_frame.bin, with the path of the book.
+namespace WakeFrame {
+
+// Save the frame buffer as the page of bookPath; call before the sleep screen draws over it
+bool save(const uint8_t* frame, const std::string& bookPath);
+
+// Show the saved page if it's of bookPath. The file is used up either way, so a stale page is never shown twice.
+bool restore(HalDisplay& display, const std::string& bookPath);
+
+void clear();
+
+}  // namespace WakeFrame
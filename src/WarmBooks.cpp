@@ -0,0 +1,67 @@
+#include "WarmBooks.h"
+
+#include <BookCacheKey.h>
+#include <Epub.h>
+#include <Logging.h>
+
+namespace {
+constexpr size_t MAX_WARM_BOOKS = 2;
+}  // namespace
+
+WarmBooks WarmBooks::instance;
+
+void WarmBooks::park(std::shared_ptr<Epub> epub) {
+  if (!epub || epub.use_count() > 1 || epub->getHeapUsage() > maxBytes) {
+    return;
+  }
+  epub->suspend();
+  books.insert(books.begin(), std::move(epub));
+  fit();
+  LOG_DBG("WRM", "Keeping %zu books loaded (%zu bytes)", books.size(), getHeapUsage());
+}
+
+std::shared_ptr<Epub> WarmBooks::take(const std::string& path) {
+  for (auto it = books.begin(); it != books.end(); ++it) {
+    if ((*it)->getPath() != path) {
+      continue;
+    }
+    std::shared_ptr<Epub> epub = std::move(*it);
+    books.erase(it);
+    // A file replaced under the same name has another cache key
+    if (BookCacheKey::cachePath(path, "/.crosspoint", "epub_") != epub->getCachePath() || !epub->resume()) {
+      LOG_DBG("WRM", "Kept book changed, loading it again: %s", path.c_str());
+      return nullptr;
+    }
+    LOG_DBG("WRM", "Reopening kept book: %s", path.c_str());
+    return epub;
+  }
+  return nullptr;
+}
+
+void WarmBooks::setLimit(const size_t bytes) {
+  maxBytes = bytes;
+  fit();
+}
+
+size_t WarmBooks::getHeapUsage() const {
+  size_t total = 0;
+  for (const auto& book : books) {
+    total += book->getHeapUsage();
+  }
+  return total;
+}
+
+void WarmBooks::fit() {
+  size_t total = 0;
+  size_t kept = 0;
+  while (kept < books.size() && kept < MAX_WARM_BOOKS && total + books[kept]->getHeapUsage() <= maxBytes) {
+    total += books[kept]->getHeapUsage();
+    kept++;
+  }
+  if (kept < books.size()) {
+    LOG_DBG("WRM", "Letting go of %zu kept books", books.size() - kept);
+    books.resize(kept);
+  }
+}
+
+void WarmBooks::clear() { books.clear(); }
@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+class Epub;
+
+// EPUBs closed in the reader a short while ago, kept loaded (metadata, spine and TOC tables, resident CSS rules) with
+// their files closed, so switching back to one from the recent books skips Epub::load(). At most a couple of books
+// are kept, within the RAM the MemoryBudget grants them, which is nothing while free heap runs low.
+class WarmBooks {
+  // Static instance
+  static WarmBooks instance;
+
+  std::vector<std::shared_ptr<Epub>> books;  // Most recently closed first
+  size_t maxBytes = 48 * 1024;
+
+  // Lets go of the oldest books beyond the count or the byte limit
+  void fit();
+
+ public:
+  ~WarmBooks() = default;
+
+  // Get singleton instance
+  static WarmBooks& getInstance() { return instance; }
+
+  // Keeps a book the reader is done with, unless something else still holds it or it doesn't fit the budget
+  void park(std::shared_ptr<Epub> epub);
+  // The kept book at path, ready to read, or null when there is none or its cache changed since it was closed
+  std::shared_ptr<Epub> take(const std::string& path);
+  // RAM all kept books may hold together, letting go of the oldest beyond it
+  void setLimit(size_t bytes);
+  size_t getHeapUsage() const;
+  void clear();
+};
+
+// Helper macro to access the warm books
+#define WARM_BOOKS WarmBooks::getInstance()
@@ -6,6 +6,8 @@
 #include <ObfuscationUtils.h>
 #include <Serialization.h>
 
+#include <cstring>
+
 // Initialize the static instance
 WifiCredentialStore WifiCredentialStore::instance;
 
@@ -150,6 +152,21 @@ const WifiCredential* WifiCredentialStore::findCredential(const std::string& ssi
   return nullptr;
 }
 
+void WifiCredentialStore::setAccessPoint(const std::string& ssid, const uint8_t* bssid, const int32_t channel) {
+  const auto cred = find_if(credentials.begin(), credentials.end(),
+                            [&ssid](const WifiCredential& cred) { return cred.ssid == ssid; });
+  if (cred == credentials.end() || !bssid || channel <= 0) {
+    return;
+  }
+  if (cred->channel != channel || memcmp(cred->bssid, bssid, sizeof(cred->bssid)) != 0) {
+    memcpy(cred->bssid, bssid, sizeof(cred->bssid));
+    cred->channel = channel;
+    LOG_DBG("WCS", "Access point of %s: %02x:%02x:%02x:%02x:%02x:%02x on channel %d", ssid.c_str(), bssid[0],
+            bssid[1], bssid[2], bssid[3], bssid[4], bssid[5], channel);
+    saveToFile();
+  }
+}
+
 bool WifiCredentialStore::hasSavedCredential(const std::string& ssid) const { return findCredential(ssid) != nullptr; }
 
 void WifiCredentialStore::setLastConnectedSsid(const std::string& ssid) {
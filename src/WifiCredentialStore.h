@@ -1,10 +1,14 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <vector>
 
 struct WifiCredential {
   std::string ssid;
   std::string password;  // Plaintext in memory; obfuscated with hardware key on disk
+  // Access point of the last connection, so reconnecting can go straight to it without a scan
+  uint8_t bssid[6] = {};
+  int32_t channel = 0;  // 0 while not known
 };
 
 class WifiCredentialStore;
@@ -58,6 +62,9 @@ class WifiCredentialStore {
   // Check if a network is saved
   bool hasSavedCredential(const std::string& ssid) const;
 
+  // Remember the access point a saved network was last joined through
+  void setAccessPoint(const std::string& ssid, const uint8_t* bssid, int32_t channel);
+
   // Last connected network
   void setLastConnectedSsid(const std::string& ssid);
   const std::string& getLastConnectedSsid() const;
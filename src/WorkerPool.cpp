@@ -0,0 +1,54 @@
+#include "WorkerPool.h"
+
+#include <Logging.h>
+
+#include <cstdio>
+
+namespace {
+// Same priority as the loop task, so a job and the UI take turns while the other waits on the network or the card
+constexpr UBaseType_t workerPriority = 1;
+}  // namespace
+
+WorkerPool WorkerPool::instance;
+
+bool WorkerPool::start() {
+  jobs = xQueueCreateStatic(QUEUE_LENGTH, sizeof(Job), queueStorage, &queueControl);
+  if (!jobs) {
+    LOG_ERR("WRK", "Failed to create the job queue");
+    return false;
+  }
+  for (size_t i = 0; i < WORKER_COUNT; i++) {
+    char name[configMAX_TASK_NAME_LEN];
+    snprintf(name, sizeof(name), "Worker%u", static_cast<unsigned>(i));
+    // Static tasks can't fail for want of memory, only with a null buffer
+    xTaskCreateStatic(&workerTrampoline, name, WORKER_STACK_SIZE, this, workerPriority, workerStacks[i],
+                      &workerControl[i]);
+  }
+  LOG_DBG("WRK", "Started %u workers", static_cast<unsigned>(WORKER_COUNT));
+  return true;
+}
+
+bool WorkerPool::submit(const JobFunction fn, void* param, const char* name) {
+  if (!jobs && !start()) {
+    return false;
+  }
+  const Job job{fn, param, name};
+  if (xQueueSend(jobs, &job, 0) != pdTRUE) {
+    LOG_ERR("WRK", "No room for job %s", name);
+    return false;
+  }
+  return true;
+}
+
+void WorkerPool::workerTrampoline(void* param) { static_cast<WorkerPool*>(param)->workerLoop(); }
+
+void WorkerPool::workerLoop() {
+  Job job;
+  while (true) {
+    if (xQueueReceive(jobs, &job, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    LOG_DBG("WRK", "Running %s", job.name);
+    job.fn(job.param);
+  }
+}
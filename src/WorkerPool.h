@@ -0,0 +1,51 @@
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <cstddef>
+#include <cstdint>
+
+// Background jobs run on a few worker tasks whose stacks, control blocks and job queue are reserved at build time,
+// instead of a task of their own created and deleted around each one. A task's stack is the largest block a job
+// needs, and allocating it from the heap while Wi-Fi and TLS take theirs leaves holes behind once the task is gone.
+// The workers are started by the first submit() and wait on the queue from then on.
+class WorkerPool {
+  // Static instance
+  static WorkerPool instance;
+
+ public:
+  // One worker can be held by a long job, like the upload writer, while the other takes the short ones
+  static constexpr size_t WORKER_COUNT = 2;
+  static constexpr uint32_t WORKER_STACK_SIZE = 4096;
+  static constexpr size_t QUEUE_LENGTH = 4;
+
+  using JobFunction = void (*)(void* param);
+
+  // Get singleton instance
+  static WorkerPool& getInstance() { return instance; }
+
+  // Queues fn(param) for the next free worker; name is for the log. False if the queue is full: with every worker
+  // busy and QUEUE_LENGTH jobs waiting, a caller should give up rather than wait.
+  bool submit(JobFunction fn, void* param, const char* name);
+
+ private:
+  struct Job {
+    JobFunction fn;
+    void* param;
+    const char* name;
+  };
+
+  QueueHandle_t jobs = nullptr;
+  StaticQueue_t queueControl = {};
+  uint8_t queueStorage[QUEUE_LENGTH * sizeof(Job)] = {};
+  StaticTask_t workerControl[WORKER_COUNT] = {};
+  StackType_t workerStacks[WORKER_COUNT][WORKER_STACK_SIZE] = {};
+
+  bool start();
+  static void workerTrampoline(void* param);
+  void workerLoop();
+};
+
+// Helper macro to access the worker pool
+#define WORKERS WorkerPool::getInstance()
@@ -2,6 +2,7 @@
 #include <Logging.h>
 
 #include <cassert>
+#include <climits>
 #include <memory>
 #include <string>
 #include <utility>
@@ -42,6 +43,9 @@ class Activity {
 
   virtual bool skipLoopDelay() { return false; }
   virtual bool preventAutoSleep() { return false; }
+  // Milliseconds until loop() has something due that no button brings about, like an automatic page turn. The main
+  // loop waits no longer than this for input.
+  virtual unsigned long msUntilLoopDeadline() { return ULONG_MAX; }
   virtual bool isReaderActivity() const { return false; }
 
   // Start a new activity without destroying the current one
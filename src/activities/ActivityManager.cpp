@@ -2,10 +2,13 @@
 
 #include <HalPowerManager.h>
 
+#include "HeapTelemetry.h"
+
 #include "boot_sleep/BootActivity.h"
 #include "boot_sleep/SleepActivity.h"
 #include "browser/OpdsBookBrowserActivity.h"
 #include "home/HomeActivity.h"
+#include "home/LibrarySearchActivity.h"
 #include "home/MyLibraryActivity.h"
 #include "home/RecentBooksActivity.h"
 #include "network/CrossPointWebServerActivity.h"
@@ -14,6 +17,7 @@
 #include "util/FullScreenMessageActivity.h"
 
 void ActivityManager::begin() {
+  HeapTelemetry::begin();
   xTaskCreate(&renderTaskTrampoline, "ActivityManagerRender",
               8192,              // Stack size
               this,              // Parameters
@@ -35,13 +39,15 @@ void ActivityManager::renderTaskLoop() {
     // where the main task deletes the activity between the null-check and render().
     RenderLock lock;
     if (currentActivity) {
-      HalPowerManager::Lock powerLock;  // Ensure we don't go into low-power mode while rendering
+      // Ensure we don't go into low-power mode while rendering
+      HalPowerManager::Lock powerLock(HalPowerManager::Render);
       currentActivity->render(std::move(lock));
     }
   }
 }
 
 void ActivityManager::loop() {
+  HeapTelemetry::sample();
   if (currentActivity) {
     // Note: do not hold a lock here, the loop() method must be responsible for acquire one if needed
     currentActivity->loop();
@@ -74,6 +80,7 @@ void ActivityManager::loop() {
         currentActivity = std::move(stackActivities.back());
         stackActivities.pop_back();
         LOG_DBG("ACT", "Popped from activity stack, new size = %zu", stackActivities.size());
+        HeapTelemetry::enter(currentActivity->name);
         // Handle result if necessary
         if (currentActivity->resultHandler) {
           LOG_DBG("ACT", "Handling result for popped activity");
@@ -113,6 +120,7 @@ void ActivityManager::loop() {
       }
       pendingAction = PendingAction::None;
       currentActivity = std::move(pendingActivity);
+      HeapTelemetry::enter(currentActivity->name);
 
       lock.unlock();  // onEnter may acquire its own lock
       currentActivity->onEnter();
@@ -137,6 +145,7 @@ void ActivityManager::exitActivity(const RenderLock& lock) {
   if (currentActivity) {
     currentActivity->onExit();
     currentActivity.reset();
+    HeapTelemetry::exit();
   }
 }
 
@@ -150,6 +159,7 @@ void ActivityManager::replaceActivity(std::unique_ptr<Activity>&& newActivity) {
   } else {
     // No current activity, safe to launch immediately
     currentActivity = std::move(newActivity);
+    HeapTelemetry::enter(currentActivity->name);
     currentActivity->onEnter();
   }
 }
@@ -164,6 +174,10 @@ void ActivityManager::goToMyLibrary(std::string path) {
   replaceActivity(std::make_unique<MyLibraryActivity>(renderer, mappedInput, std::move(path)));
 }
 
+void ActivityManager::goToLibrarySearch() {
+  replaceActivity(std::make_unique<LibrarySearchActivity>(renderer, mappedInput));
+}
+
 void ActivityManager::goToRecentBooks() {
   replaceActivity(std::make_unique<RecentBooksActivity>(renderer, mappedInput));
 }
@@ -214,6 +228,10 @@ bool ActivityManager::isReaderActivity() const { return currentActivity && curre
 
 bool ActivityManager::skipLoopDelay() const { return currentActivity && currentActivity->skipLoopDelay(); }
 
+unsigned long ActivityManager::msUntilLoopDeadline() const {
+  return currentActivity ? currentActivity->msUntilLoopDeadline() : ULONG_MAX;
+}
+
 void ActivityManager::requestUpdate(bool immediate) {
   if (immediate) {
     if (renderTaskHandle) {
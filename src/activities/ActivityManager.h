@@ -76,6 +76,7 @@ class ActivityManager {
   void goToFileTransfer();
   void goToSettings();
   void goToMyLibrary(std::string path = {});
+  void goToLibrarySearch();
   void goToRecentBooks();
   void goToBrowser();
   void goToReader(std::string path);
@@ -94,6 +95,7 @@ class ActivityManager {
   bool preventAutoSleep() const;
   bool isReaderActivity() const;
   bool skipLoopDelay() const;
+  unsigned long msUntilLoopDeadline() const;
 
   // If immediate is true, the update will be triggered immediately.
   // Otherwise, it will be deferred until the end of the current loop iteration.
@@ -25,6 +25,7 @@ struct MenuResult {
 
 struct ChapterResult {
   int spineIndex = 0;
+  std::string anchor;  // Id the TOC entry points to in the spine item, if any
 };
 
 struct PercentResult {
@@ -38,6 +39,12 @@ struct PageResult {
 struct SyncResult {
   int spineIndex = 0;
   int page = 0;
+  uint32_t textPosition = UINT32_MAX;  // Section::findTextPositionPage() of the page to open, if known
+};
+
+struct SearchResult {
+  int spineIndex = 0;
+  int page = 0;
 };
 
 enum class NetworkMode;
@@ -51,7 +58,7 @@ struct FootnoteResult {
 };
 
 using ResultVariant = std::variant<std::monostate, WifiResult, KeyboardResult, MenuResult, ChapterResult, PercentResult,
-                                   PageResult, SyncResult, NetworkModeResult, FootnoteResult>;
+                                   PageResult, SyncResult, SearchResult, NetworkModeResult, FootnoteResult>;
 
 struct ActivityResult {
   bool isCancelled = false;
@@ -0,0 +1,127 @@
+#include "HeapTelemetry.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace {
+using HeapTelemetry::MAX_ACTIVITIES;
+constexpr unsigned long SAMPLE_INTERVAL_MS = 250;
+constexpr uint32_t HEAP_CAPS = MALLOC_CAP_8BIT;
+
+HeapTelemetry::ActivityStats stats[MAX_ACTIVITIES];
+size_t statsCount = 0;
+int current = -1;
+unsigned long lastSample = 0;
+uint32_t lastWatermark = 0;
+uint32_t failuresSeen = 0;
+
+// Bumped from inside the allocator, so no more than an atomic increment
+std::atomic<uint32_t> allocFailures{0};
+
+void onAllocFailed(size_t size, uint32_t caps, const char* functionName) {
+  (void)size;
+  (void)caps;
+  (void)functionName;
+  allocFailures.fetch_add(1, std::memory_order_relaxed);
+}
+
+int findOrAdd(const std::string& name) {
+  for (size_t i = 0; i < statsCount; i++) {
+    if (strncmp(stats[i].name, name.c_str(), sizeof(stats[i].name) - 1) == 0) {
+      return static_cast<int>(i);
+    }
+  }
+  if (statsCount == MAX_ACTIVITIES) {
+    return -1;
+  }
+  auto& entry = stats[statsCount];
+  strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+  entry.name[sizeof(entry.name) - 1] = '\0';
+  entry.visits = 0;
+  entry.minFree = UINT32_MAX;
+  entry.minLargestBlock = UINT32_MAX;
+  entry.allocFailures = 0;
+  return static_cast<int>(statsCount++);
+}
+}  // namespace
+
+namespace HeapTelemetry {
+
+void begin() {
+  heap_caps_register_failed_alloc_callback(&onAllocFailed);
+  lastWatermark = heap_caps_get_minimum_free_size(HEAP_CAPS);
+}
+
+void enter(const std::string& name) {
+  exit();
+  current = findOrAdd(name);
+  if (current < 0) {
+    LOG_DBG("HEAP", "No room to track %s", name.c_str());
+    return;
+  }
+  if (stats[current].visits < UINT16_MAX) {
+    stats[current].visits++;
+  }
+  failuresSeen = allocFailures.load(std::memory_order_relaxed);
+  sample(true);
+}
+
+void exit() {
+  if (current < 0) {
+    return;
+  }
+  sample(true);
+  const auto& entry = stats[current];
+  LOG_DBG("HEAP", "%s: lowest free %u, smallest largest block %u, %u failed allocations", entry.name, entry.minFree,
+          entry.minLargestBlock, entry.allocFailures);
+  current = -1;
+}
+
+void sample(const bool force) {
+  const unsigned long now = millis();
+  if (current < 0 || (!force && now - lastSample < SAMPLE_INTERVAL_MS)) {
+    return;
+  }
+  lastSample = now;
+  auto& entry = stats[current];
+
+  const uint32_t freeNow = heap_caps_get_free_size(HEAP_CAPS);
+  const uint32_t largest = heap_caps_get_largest_free_block(HEAP_CAPS);
+  entry.minFree = std::min(entry.minFree, freeNow);
+  entry.minLargestBlock = std::min(entry.minLargestBlock, static_cast<uint32_t>(largest));
+
+  // The allocator's low-water mark catches dips between samples, but only those that set a new low since boot
+  const uint32_t watermark = heap_caps_get_minimum_free_size(HEAP_CAPS);
+  if (watermark < lastWatermark) {
+    entry.minFree = std::min(entry.minFree, watermark);
+    lastWatermark = watermark;
+  }
+
+  const uint32_t failures = allocFailures.load(std::memory_order_relaxed);
+  entry.allocFailures += failures - failuresSeen;
+  failuresSeen = failures;
+}
+
+uint32_t getAllocFailures() { return allocFailures.load(std::memory_order_relaxed); }
+
+const char* getCurrent() { return current >= 0 ? stats[current].name : ""; }
+
+size_t snapshot(ActivityStats* out, const size_t maxCount) {
+  size_t count = 0;
+  if (current >= 0 && count < maxCount) {
+    out[count++] = stats[current];
+  }
+  for (size_t i = 0; i < statsCount && count < maxCount; i++) {
+    if (static_cast<int>(i) != current) {
+      out[count++] = stats[i];
+    }
+  }
+  return count;
+}
+
+}  // namespace HeapTelemetry
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Heap use per activity, to see which screens and books push the device into exhaustion or fragmentation. The time
+// an activity is in front (from its onEnter, or from when the one on top of it is popped, until it is exited or has
+// another pushed on top) is attributed to it: the lowest free heap, the smallest largest free block and the number of
+// failed allocations while it was showing, summed up over all its visits since boot.
+namespace HeapTelemetry {
+
+// Activities tracked at most, later ones are not recorded
+constexpr size_t MAX_ACTIVITIES = 24;
+
+struct ActivityStats {
+  char name[24];
+  uint16_t visits;
+  uint32_t minFree;
+  uint32_t minLargestBlock;
+  uint32_t allocFailures;
+};
+
+// Registers the failed allocation hook
+void begin();
+
+// The activity in front changed; closes the window of the previous one
+void enter(const std::string& name);
+void exit();
+
+// Called from the main loop, samples only every few hundred ms unless forced
+void sample(bool force = false);
+
+// Failed allocations since boot
+uint32_t getAllocFailures();
+// Name of the activity in front, empty if none
+const char* getCurrent();
+
+// Copies at most maxCount records into out, the one in front first; returns how many were copied
+size_t snapshot(ActivityStats* out, size_t maxCount);
+
+}  // namespace HeapTelemetry
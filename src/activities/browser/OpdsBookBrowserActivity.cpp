@@ -1,5 +1,6 @@
 #include "OpdsBookBrowserActivity.h"
 
+#include <BookCacheKey.h>
 #include <Epub.h>
 #include <GfxRenderer.h>
 #include <I18n.h>
@@ -7,24 +8,26 @@
 #include <OpdsStream.h>
 #include <WiFi.h>
 
+#include "CoverJobQueue.h"
 #include "CrossPointSettings.h"
 #include "MappedInputManager.h"
 #include "activities/network/WifiSelectionActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "network/BookCatalog.h"
 #include "network/HttpDownloader.h"
 #include "util/StringUtils.h"
 #include "util/UrlUtils.h"
 
 namespace {
-constexpr int PAGE_ITEMS = 23;
+// Feeds fetched before, revalidated with a conditional GET when visited again
+constexpr char FEED_CACHE_DIR[] = "/.crosspoint/opds";
 }  // namespace
 
 void OpdsBookBrowserActivity::onEnter() {
   Activity::onEnter();
 
   state = BrowserState::CHECK_WIFI;
-  entries.clear();
   navigationHistory.clear();
   currentPath = "";  // Root path - user provides full URL in settings
   selectorIndex = 0;
@@ -42,7 +45,8 @@ void OpdsBookBrowserActivity::onExit() {
   // Turn off WiFi when exiting
   WiFi.mode(WIFI_OFF);
 
-  entries.clear();
+  entries.close();
+  nextPageHref.clear();
   navigationHistory.clear();
 }
 
@@ -99,8 +103,10 @@ void OpdsBookBrowserActivity::loop() {
   // Handle browsing state
   if (state == BrowserState::BROWSING) {
     if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-      if (!entries.empty()) {
-        const auto& entry = entries[selectorIndex];
+      const OpdsEntry* selected = entries.get(selectorIndex);
+      if (selected) {
+        // Copied, a navigation replaces the entries
+        const OpdsEntry entry = *selected;
         if (entry.type == OpdsEntryType::BOOK) {
           downloadBook(entry);
         } else {
@@ -115,22 +121,22 @@ void OpdsBookBrowserActivity::loop() {
     if (!entries.empty()) {
       buttonNavigator.onNextRelease([this] {
         selectorIndex = ButtonNavigator::nextIndex(selectorIndex, entries.size());
-        requestUpdate();
+        onSelectionChanged();
       });
 
       buttonNavigator.onPreviousRelease([this] {
         selectorIndex = ButtonNavigator::previousIndex(selectorIndex, entries.size());
-        requestUpdate();
+        onSelectionChanged();
       });
 
       buttonNavigator.onNextContinuous([this] {
         selectorIndex = ButtonNavigator::nextPageIndex(selectorIndex, entries.size(), PAGE_ITEMS);
-        requestUpdate();
+        onSelectionChanged();
       });
 
       buttonNavigator.onPreviousContinuous([this] {
         selectorIndex = ButtonNavigator::previousPageIndex(selectorIndex, entries.size(), PAGE_ITEMS);
-        requestUpdate();
+        onSelectionChanged();
       });
     }
   }
@@ -186,7 +192,8 @@ void OpdsBookBrowserActivity::render(RenderLock&&) {
   // Browsing state
   // Show appropriate button hint based on selected entry type
   const char* confirmLabel = tr(STR_OPEN);
-  if (!entries.empty() && entries[selectorIndex].type == OpdsEntryType::BOOK) {
+  const OpdsEntry* selected = entries.get(selectorIndex);
+  if (selected && selected->type == OpdsEntryType::BOOK) {
     confirmLabel = tr(STR_DOWNLOAD);
   }
   const auto labels = mappedInput.mapLabels(tr(STR_BACK), confirmLabel, tr(STR_DIR_UP), tr(STR_DIR_DOWN));
@@ -202,7 +209,11 @@ void OpdsBookBrowserActivity::render(RenderLock&&) {
   renderer.fillRect(0, 60 + (selectorIndex % PAGE_ITEMS) * 30 - 2, pageWidth - 1, 30);
 
   for (size_t i = pageStartIndex; i < entries.size() && i < static_cast<size_t>(pageStartIndex + PAGE_ITEMS); i++) {
-    const auto& entry = entries[i];
+    const OpdsEntry* entryPtr = entries.get(i);
+    if (!entryPtr) {
+      break;
+    }
+    const auto& entry = *entryPtr;
 
     // Format display text with type indicator
     std::string displayText;
@@ -224,7 +235,7 @@ void OpdsBookBrowserActivity::render(RenderLock&&) {
   renderer.displayBuffer();
 }
 
-void OpdsBookBrowserActivity::fetchFeed(const std::string& path) {
+void OpdsBookBrowserActivity::fetchFeed(const std::string& path, const bool append) {
   const char* serverUrl = SETTINGS.opdsServerUrl;
   if (strlen(serverUrl) == 0) {
     state = BrowserState::ERROR;
@@ -236,16 +247,54 @@ void OpdsBookBrowserActivity::fetchFeed(const std::string& path) {
   std::string url = UrlUtils::buildUrl(serverUrl, path);
   LOG_DBG("OPDS", "Fetching: %s", url.c_str());
 
+  if (!append) {
+    RenderLock lock(*this);
+    nextPageHref.clear();
+    selectorIndex = 0;
+    if (!entries.reset()) {
+      state = BrowserState::ERROR;
+      errorMessage = tr(STR_PARSE_FEED_FAILED);
+      requestUpdate();
+      return;
+    }
+  }
+
+  // Entries go to the index as they're parsed; the list is shown as soon as the first screenful is in, while the
+  // rest of the feed is still arriving
   OpdsParser parser;
+  parser.setEntryCallback([this](const OpdsEntry& entry) {
+    RenderLock lock(*this);
+    entries.add(entry);
+    if (state == BrowserState::LOADING && entries.size() == PAGE_ITEMS) {
+      state = BrowserState::BROWSING;
+      requestUpdate(true);
+    }
+  });
 
+  bool fetched;
   {
     OpdsParserStream stream{parser};
-    if (!HttpDownloader::fetchUrl(url, stream)) {
-      state = BrowserState::ERROR;
-      errorMessage = tr(STR_FETCH_FEED_FAILED);
-      requestUpdate();
-      return;
+    fetched = HttpDownloader::fetchUrlCached(url, stream, FEED_CACHE_DIR);
+  }
+
+  if (append) {
+    // A next page that fails only ends the list early
+    if (!fetched || !parser) {
+      LOG_ERR("OPDS", "Failed to fetch the next page: %s", url.c_str());
+      nextPageHref.clear();
+    } else {
+      nextPageHref = parser.getNextHref();
     }
+    LOG_DBG("OPDS", "Now %zu entries", entries.size());
+    requestUpdate();
+    return;
+  }
+
+  if (!fetched) {
+    state = BrowserState::ERROR;
+    errorMessage = tr(STR_FETCH_FEED_FAILED);
+    requestUpdate();
+    return;
   }
 
   if (!parser) {
@@ -255,9 +304,8 @@ void OpdsBookBrowserActivity::fetchFeed(const std::string& path) {
     return;
   }
 
-  entries = std::move(parser).getEntries();
-  LOG_DBG("OPDS", "Found %d entries", entries.size());
-  selectorIndex = 0;
+  nextPageHref = parser.getNextHref();
+  LOG_DBG("OPDS", "Found %zu entries", entries.size());
 
   if (entries.empty()) {
     state = BrowserState::ERROR;
@@ -270,6 +318,23 @@ void OpdsBookBrowserActivity::fetchFeed(const std::string& path) {
   requestUpdate();
 }
 
+void OpdsBookBrowserActivity::onSelectionChanged() {
+  {
+    RenderLock lock(*this);
+    entries.loadPage(selectorIndex / PAGE_ITEMS);
+  }
+
+  // Reaching the last page of what's been fetched brings in the feed's next page
+  const size_t lastPage = (entries.size() - 1) / PAGE_ITEMS;
+  if (!nextPageHref.empty() && static_cast<size_t>(selectorIndex) / PAGE_ITEMS == lastPage) {
+    requestUpdate(true);  // Show the new selection before the fetch
+    const std::string nextPage = nextPageHref;
+    fetchFeed(nextPage, true);
+    return;
+  }
+  requestUpdate();
+}
+
 void OpdsBookBrowserActivity::navigateToEntry(const OpdsEntry& entry) {
   // Push current path to history before navigating
   navigationHistory.push_back(currentPath);
@@ -277,7 +342,6 @@ void OpdsBookBrowserActivity::navigateToEntry(const OpdsEntry& entry) {
 
   state = BrowserState::LOADING;
   statusMessage = tr(STR_LOADING);
-  entries.clear();
   selectorIndex = 0;
   requestUpdate(true);  // Force update to show loading state immediately before fetch
 
@@ -295,7 +359,6 @@ void OpdsBookBrowserActivity::navigateBack() {
 
     state = BrowserState::LOADING;
     statusMessage = tr(STR_LOADING);
-    entries.clear();
     selectorIndex = 0;
     requestUpdate();
 
@@ -333,9 +396,14 @@ void OpdsBookBrowserActivity::downloadBook(const OpdsEntry& book) {
     LOG_DBG("OPDS", "Download complete: %s", filename.c_str());
 
     // Invalidate any existing cache for this file to prevent stale metadata issues
+    // unless another copy of the same book already uses it
     Epub epub(filename, "/.crosspoint");
-    epub.clearCache();
-    LOG_DBG("OPDS", "Cleared cache for: %s", filename.c_str());
+    if (!BookCacheKey::shared(filename, "/.crosspoint")) {
+      epub.clearCache();
+      LOG_DBG("OPDS", "Cleared cache for: %s", filename.c_str());
+    }
+    COVER_JOBS.enqueue(filename);
+    BookCatalog::add(filename.c_str(), downloadProgress);
 
     state = BrowserState::BROWSING;
     requestUpdate();
@@ -1,4 +1,5 @@
 #pragma once
+#include <OpdsEntryIndex.h>
 #include <OpdsParser.h>
 
 #include <functional>
@@ -33,9 +34,12 @@ class OpdsBookBrowserActivity final : public Activity {
   void render(RenderLock&&) override;
 
  private:
+  static constexpr int PAGE_ITEMS = 23;
+
   ButtonNavigator buttonNavigator;
   BrowserState state = BrowserState::LOADING;
-  std::vector<OpdsEntry> entries;
+  OpdsEntryIndex entries{PAGE_ITEMS};          // Entries of the feed and its pages fetched so far, on the SD card
+  std::string nextPageHref;                    // Next page of the feed, fetched once the last entries are reached
   std::vector<std::string> navigationHistory;  // Stack of previous feed paths for back navigation
   std::string currentPath;                     // Current feed path being displayed
   int selectorIndex = 0;
@@ -47,7 +51,8 @@ class OpdsBookBrowserActivity final : public Activity {
   void checkAndConnectWifi();
   void launchWifiSelection();
   void onWifiSelectionComplete(bool connected);
-  void fetchFeed(const std::string& path);
+  void fetchFeed(const std::string& path, bool append = false);
+  void onSelectionChanged();
   void navigateToEntry(const OpdsEntry& entry);
   void navigateBack();
   void downloadBook(const OpdsEntry& book);
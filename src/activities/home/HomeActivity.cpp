@@ -1,26 +1,33 @@
 #include "HomeActivity.h"
 
 #include <Bitmap.h>
-#include <Epub.h>
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
 #include <Utf8.h>
-#include <Xtc.h>
 
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
+#include "CacheBudget.h"
+#include "CoverJobQueue.h"
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "MappedInputManager.h"
 #include "RecentBooksStore.h"
+#include "SleepScreenCache.h"
+#include "components/ThumbnailAtlas.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
-#include "util/StringUtils.h"
+
+namespace {
+// Time without input before the home screen runs a cover job
+constexpr unsigned long coverJobIdleDelayMs = 3000;
+}  // namespace
 
 int HomeActivity::getMenuItemCount() const {
-  int count = 4;  // My Library, Recents, File transfer, Settings
+  int count = 5;  // My Library, Find Book, Recents, File transfer, Settings
   if (!recentBooks.empty()) {
     count += recentBooks.size();
   }
@@ -52,56 +59,20 @@ void HomeActivity::loadRecentBooks(int maxBooks) {
 
 void HomeActivity::loadRecentCovers(int coverHeight) {
   recentsLoading = true;
-  bool showingLoading = false;
-  Rect popupRect;
 
-  int progress = 0;
-  for (RecentBook& book : recentBooks) {
-    if (!book.coverBmpPath.empty()) {
+  ThumbnailAtlas atlas(coverHeight);
+  for (const RecentBook& book : recentBooks) {
+    if (!book.coverBmpPath.empty() && !atlas.contains(book.path)) {
       std::string coverPath = UITheme::getCoverThumbPath(book.coverBmpPath, coverHeight);
-      if (!Storage.exists(coverPath.c_str())) {
-        // If epub, try to load the metadata for title/author and cover
-        if (StringUtils::checkFileExtension(book.path, ".epub")) {
-          Epub epub(book.path, "/.crosspoint");
-          // Skip loading css since we only need metadata here
-          epub.load(false, true);
-
-          // Try to generate thumbnail image for Continue Reading card
-          if (!showingLoading) {
-            showingLoading = true;
-            popupRect = GUI.drawPopup(renderer, tr(STR_LOADING_POPUP));
-          }
-          GUI.fillPopupProgress(renderer, popupRect, 10 + progress * (90 / recentBooks.size()));
-          bool success = epub.generateThumbBmp(coverHeight);
-          if (!success) {
-            RECENT_BOOKS.updateBook(book.path, book.title, book.author, "");
-            book.coverBmpPath = "";
-          }
-          coverRendered = false;
-          requestUpdate();
-        } else if (StringUtils::checkFileExtension(book.path, ".xtch") ||
-                   StringUtils::checkFileExtension(book.path, ".xtc")) {
-          // Handle XTC file
-          Xtc xtc(book.path, "/.crosspoint");
-          if (xtc.load()) {
-            // Try to generate thumbnail image for Continue Reading card
-            if (!showingLoading) {
-              showingLoading = true;
-              popupRect = GUI.drawPopup(renderer, tr(STR_LOADING_POPUP));
-            }
-            GUI.fillPopupProgress(renderer, popupRect, 10 + progress * (90 / recentBooks.size()));
-            bool success = xtc.generateThumbBmp(coverHeight);
-            if (!success) {
-              RECENT_BOOKS.updateBook(book.path, book.title, book.author, "");
-              book.coverBmpPath = "";
-            }
-            coverRendered = false;
-            requestUpdate();
-          }
-        }
+      if (Storage.exists(coverPath.c_str())) {
+        // Copy it into the atlas so the next home screen reads all covers from one file
+        atlas.store(book.path, coverPath);
+      } else {
+        // The placeholder stays until the cover job queue has made the thumbnail, rather than the home screen
+        // waiting on the decode
+        COVER_JOBS.enqueue(book.path, true);
       }
     }
-    progress++;
   }
 
   recentsLoaded = true;
@@ -115,6 +86,7 @@ void HomeActivity::onEnter() {
   hasOpdsUrl = strlen(SETTINGS.opdsServerUrl) > 0;
 
   selectorIndex = 0;
+  lastInputTime = millis();
 
   const auto& metrics = UITheme::getInstance().getMetrics();
   loadRecentBooks(metrics.homeRecentBooksCount);
@@ -190,6 +162,7 @@ void HomeActivity::loop() {
     int idx = 0;
     int menuSelectedIndex = selectorIndex - static_cast<int>(recentBooks.size());
     const int myLibraryIdx = idx++;
+    const int findBookIdx = idx++;
     const int recentsIdx = idx++;
     const int opdsLibraryIdx = hasOpdsUrl ? idx++ : -1;
     const int fileTransferIdx = idx++;
@@ -199,6 +172,8 @@ void HomeActivity::loop() {
       onSelectBook(recentBooks[selectorIndex].path);
     } else if (menuSelectedIndex == myLibraryIdx) {
       onMyLibraryOpen();
+    } else if (menuSelectedIndex == findBookIdx) {
+      onFindBookOpen();
     } else if (menuSelectedIndex == recentsIdx) {
       onRecentsOpen();
     } else if (menuSelectedIndex == opdsLibraryIdx) {
@@ -209,6 +184,48 @@ void HomeActivity::loop() {
       onSettingsOpen();
     }
   }
+
+  // Work off queued cover jobs while the home screen is left alone
+  if (mappedInput.wasAnyPressed()) {
+    lastInputTime = millis();
+  }
+  if (recentsLoaded && !COVER_JOBS.isEmpty() && COVER_JOBS.isSettled() &&
+      millis() - lastInputTime >= coverJobIdleDelayMs && !RenderLock::peek()) {
+    std::string bookPath;
+    {
+      RenderLock lock(*this);
+      bookPath = COVER_JOBS.runNext(renderer);
+    }
+    // The job may have started a cache
+    CACHE_BUDGET.rescan();
+    const bool isRecent = std::any_of(recentBooks.begin(), recentBooks.end(),
+                                      [&bookPath](const RecentBook& book) { return book.path == bookPath; });
+    if (isRecent) {
+      const int coverHeight = UITheme::getInstance().getMetrics().homeCoverHeight;
+      for (RecentBook& book : recentBooks) {
+        if (book.path == bookPath && !book.coverBmpPath.empty() &&
+            !Storage.exists(UITheme::getCoverThumbPath(book.coverBmpPath, coverHeight).c_str())) {
+          // No cover to be had: don't queue it again on the next home screen
+          RECENT_BOOKS.updateBook(book.path, book.title, book.author, "");
+          book.coverBmpPath = "";
+        }
+      }
+      // Replace its placeholder with the new cover; only the cover tile changes, so the panel refreshes that window
+      recentsLoaded = false;
+      coverRendered = false;
+      requestUpdate();
+    }
+  } else if (recentsLoaded && COVER_JOBS.isEmpty() && millis() - lastInputTime >= coverJobIdleDelayMs &&
+             !RenderLock::peek() && CACHE_BUDGET.hasWork()) {
+    // Then keep the book caches within their budget, a step per loop
+    RenderLock lock(*this);
+    CACHE_BUDGET.runStep();
+  } else if (recentsLoaded && COVER_JOBS.isEmpty() && millis() - lastInputTime >= coverJobIdleDelayMs &&
+             !RenderLock::peek() && SLEEP_SCREENS.hasWork()) {
+    // And have the sleep screen ready to show without decoding it
+    RenderLock lock(*this);
+    SLEEP_SCREENS.runStep(renderer);
+  }
 }
 
 void HomeActivity::render(RenderLock&&) {
@@ -226,14 +243,14 @@ void HomeActivity::render(RenderLock&&) {
                           std::bind(&HomeActivity::storeCoverBuffer, this));
 
   // Build menu items dynamically
-  std::vector<const char*> menuItems = {tr(STR_BROWSE_FILES), tr(STR_MENU_RECENT_BOOKS), tr(STR_FILE_TRANSFER),
-                                        tr(STR_SETTINGS_TITLE)};
-  std::vector<UIIcon> menuIcons = {Folder, Recent, Transfer, Settings};
+  std::vector<const char*> menuItems = {tr(STR_BROWSE_FILES), tr(STR_FIND_BOOK), tr(STR_MENU_RECENT_BOOKS),
+                                        tr(STR_FILE_TRANSFER), tr(STR_SETTINGS_TITLE)};
+  std::vector<UIIcon> menuIcons = {Folder, Book, Recent, Transfer, Settings};
 
   if (hasOpdsUrl) {
-    // Insert OPDS Browser after My Library
-    menuItems.insert(menuItems.begin() + 2, tr(STR_OPDS_BROWSER));
-    menuIcons.insert(menuIcons.begin() + 2, Library);
+    // Insert OPDS Browser after Recent Books
+    menuItems.insert(menuItems.begin() + 3, tr(STR_OPDS_BROWSER));
+    menuIcons.insert(menuIcons.begin() + 3, Library);
   }
 
   GUI.drawButtonMenu(
@@ -263,6 +280,8 @@ void HomeActivity::onSelectBook(const std::string& path) { activityManager.goToR
 
 void HomeActivity::onMyLibraryOpen() { activityManager.goToMyLibrary(); }
 
+void HomeActivity::onFindBookOpen() { activityManager.goToLibrarySearch(); }
+
 void HomeActivity::onRecentsOpen() { activityManager.goToRecentBooks(); }
 
 void HomeActivity::onSettingsOpen() { activityManager.goToSettings(); }
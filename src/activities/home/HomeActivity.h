@@ -16,12 +16,14 @@ class HomeActivity final : public Activity {
   bool recentsLoaded = false;
   bool firstRenderDone = false;
   bool hasOpdsUrl = false;
+  unsigned long lastInputTime = 0;
   bool coverRendered = false;      // Track if cover has been rendered once
   bool coverBufferStored = false;  // Track if cover buffer is stored
   uint8_t* coverBuffer = nullptr;  // HomeActivity's own buffer for cover image
   std::vector<RecentBook> recentBooks;
   void onSelectBook(const std::string& path);
   void onMyLibraryOpen();
+  void onFindBookOpen();
   void onRecentsOpen();
   void onSettingsOpen();
   void onFileTransferOpen();
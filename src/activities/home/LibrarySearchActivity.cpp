@@ -0,0 +1,99 @@
+#include "LibrarySearchActivity.h"
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+
+#include "MappedInputManager.h"
+#include "activities/ActivityManager.h"
+#include "components/UITheme.h"
+#include "fontIds.h"
+
+namespace {
+constexpr size_t maxQueryLength = 64;
+constexpr size_t maxResults = 50;
+}  // namespace
+
+LibrarySearchActivity::LibrarySearchActivity(GfxRenderer& renderer, MappedInputManager& mappedInput)
+    : KeyboardEntryActivity(renderer, mappedInput, tr(STR_FIND_BOOK), "", maxQueryLength) {}
+
+void LibrarySearchActivity::onEnter() {
+  if (!LibrarySearchIndex::isStored()) {
+    // The first search after the library changed builds the index, which takes a while on a large card
+    RenderLock lock(*this);
+    GUI.drawPopup(renderer, tr(STR_INDEXING));
+  }
+  indexOpen = index.open();
+  KeyboardEntryActivity::onEnter();
+}
+
+void LibrarySearchActivity::onExit() {
+  index.close();
+  KeyboardEntryActivity::onExit();
+}
+
+void LibrarySearchActivity::loop() {
+  if (!choosing) {
+    KeyboardEntryActivity::loop();
+    return;
+  }
+
+  const int resultCount = static_cast<int>(results.size());
+  buttonNavigator.onNext([this, resultCount] {
+    selectorIndex = ButtonNavigator::nextIndex(selectorIndex, resultCount);
+    requestUpdate();
+  });
+  buttonNavigator.onPrevious([this, resultCount] {
+    selectorIndex = ButtonNavigator::previousIndex(selectorIndex, resultCount);
+    requestUpdate();
+  });
+
+  // Pressed rather than released, like the keys: the press of OK that got here isn't released yet
+  if (mappedInput.wasPressed(MappedInputManager::Button::Confirm) && selectorIndex < resultCount) {
+    activityManager.goToReader(results[selectorIndex].path);
+    return;
+  }
+  if (mappedInput.wasPressed(MappedInputManager::Button::Back)) {
+    choosing = false;
+    requestUpdate();
+  }
+}
+
+void LibrarySearchActivity::onTextChanged() {
+  std::vector<LibrarySearchIndex::Book> found;
+  if (indexOpen) {
+    index.search(text, maxResults, found);
+  }
+  RenderLock lock(*this);
+  results.swap(found);
+}
+
+void LibrarySearchActivity::onComplete(std::string /*text*/) {
+  if (results.empty()) {
+    return;
+  }
+  choosing = true;
+  selectorIndex = 0;
+  requestUpdate();
+}
+
+void LibrarySearchActivity::renderContent(const Rect& rect) {
+  if (results.empty()) {
+    if (text.find_first_not_of(' ') != std::string::npos) {
+      renderer.drawCenteredText(UI_10_FONT_ID, rect.y + rect.height / 3, tr(STR_NO_BOOKS_FOUND));
+    }
+    return;
+  }
+  // Only the list and the input field change from one key to the next, so the display refreshes just those
+  GUI.drawList(
+      renderer, rect, static_cast<int>(results.size()), choosing ? selectorIndex : -1,
+      [this](const int index) { return results[index].title; }, [this](const int index) { return results[index].folder; });
+}
+
+void LibrarySearchActivity::renderButtonHints() {
+  if (!choosing) {
+    KeyboardEntryActivity::renderButtonHints();
+    return;
+  }
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_OPEN), tr(STR_DIR_UP), tr(STR_DIR_DOWN));
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "../util/KeyboardEntryActivity.h"
+#include "LibrarySearchIndex.h"
+#include "util/ButtonNavigator.h"
+
+// Finds books by title and author as they are typed: the books matching the text so far are listed between the
+// input field and the keyboard, looked up again with every key. OK on the keyboard moves to the list to pick one.
+class LibrarySearchActivity final : public KeyboardEntryActivity {
+ public:
+  explicit LibrarySearchActivity(GfxRenderer& renderer, MappedInputManager& mappedInput);
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+
+ protected:
+  void onTextChanged() override;
+  bool hasContent() const override { return true; }
+  void renderContent(const Rect& rect) override;
+  void renderButtonHints() override;
+  void onComplete(std::string text) override;
+
+ private:
+  LibrarySearchIndex index;
+  bool indexOpen = false;
+  // Shown under the RenderLock, replaced as a whole after each lookup
+  std::vector<LibrarySearchIndex::Book> results;
+  // Picking from the results instead of typing
+  bool choosing = false;
+  int selectorIndex = 0;
+  ButtonNavigator buttonNavigator;
+};
@@ -1,105 +1,41 @@
 #include "MyLibraryActivity.h"
 
 #include <GfxRenderer.h>
-#include <HalStorage.h>
 #include <I18n.h>
 
-#include <algorithm>
-
 #include "MappedInputManager.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
-#include "util/StringUtils.h"
 
 namespace {
 constexpr unsigned long GO_HOME_MS = 1000;
+// Folder entries read per loop() while checking a stored listing, few enough not to hold up button handling
+constexpr size_t CHECK_ENTRIES_PER_LOOP = 16;
 }  // namespace
 
-void sortFileList(std::vector<std::string>& strs) {
-  std::sort(begin(strs), end(strs), [](const std::string& str1, const std::string& str2) {
-    // Directories first
-    bool isDir1 = str1.back() == '/';
-    bool isDir2 = str2.back() == '/';
-    if (isDir1 != isDir2) return isDir1;
-
-    // Start naive natural sort
-    const char* s1 = str1.c_str();
-    const char* s2 = str2.c_str();
-
-    // Iterate while both strings have characters
-    while (*s1 && *s2) {
-      // Check if both are at the start of a number
-      if (isdigit(*s1) && isdigit(*s2)) {
-        // Skip leading zeros and track them
-        const char* start1 = s1;
-        const char* start2 = s2;
-        while (*s1 == '0') s1++;
-        while (*s2 == '0') s2++;
-
-        // Count digits to compare lengths first
-        int len1 = 0, len2 = 0;
-        while (isdigit(s1[len1])) len1++;
-        while (isdigit(s2[len2])) len2++;
-
-        // Different length so return smaller integer value
-        if (len1 != len2) return len1 < len2;
-
-        // Same length so compare digit by digit
-        for (int i = 0; i < len1; i++) {
-          if (s1[i] != s2[i]) return s1[i] < s2[i];
-        }
-
-        // Numbers equal so advance pointers
-        s1 += len1;
-        s2 += len2;
-      } else {
-        // Regular case-insensitive character comparison
-        char c1 = tolower(*s1);
-        char c2 = tolower(*s2);
-        if (c1 != c2) return c1 < c2;
-        s1++;
-        s2++;
-      }
-    }
-
-    // One string is prefix of other
-    return *s1 == '\0' && *s2 != '\0';
-  });
-}
-
 void MyLibraryActivity::loadFiles() {
-  files.clear();
-
-  auto root = Storage.open(basepath.c_str());
-  if (!root || !root.isDirectory()) {
-    if (root) root.close();
+  checking = false;
+  if (listing.open(basepath)) {
+    // Shown as stored, loop() checks it against the folder
+    checking = listing.beginCheck();
     return;
   }
+  listing.build(basepath);
+}
 
-  root.rewindDirectory();
-
-  char name[500];
-  for (auto file = root.openNextFile(); file; file = root.openNextFile()) {
-    file.getName(name, sizeof(name));
-    if (name[0] == '.' || strcmp(name, "System Volume Information") == 0) {
-      file.close();
-      continue;
-    }
-
-    if (file.isDirectory()) {
-      files.emplace_back(std::string(name) + "/");
-    } else {
-      auto filename = std::string(name);
-      if (StringUtils::checkFileExtension(filename, ".epub") || StringUtils::checkFileExtension(filename, ".xtch") ||
-          StringUtils::checkFileExtension(filename, ".xtc") || StringUtils::checkFileExtension(filename, ".txt") ||
-          StringUtils::checkFileExtension(filename, ".md") || StringUtils::checkFileExtension(filename, ".bmp")) {
-        files.emplace_back(filename);
-      }
-    }
-    file.close();
+void MyLibraryActivity::continueCheck() {
+  RenderLock lock(*this);
+  const auto status = listing.continueCheck(CHECK_ENTRIES_PER_LOOP);
+  if (status == LibraryIndex::CheckStatus::Running) {
+    return;
+  }
+  checking = false;
+  if (status == LibraryIndex::CheckStatus::Changed) {
+    const std::string selected = listing.name(selectorIndex);
+    listing.build(basepath);
+    selectorIndex = listing.find(selected);
+    requestUpdate();
   }
-  root.close();
-  sortFileList(files);
 }
 
 void MyLibraryActivity::onEnter() {
@@ -113,13 +49,19 @@ void MyLibraryActivity::onEnter() {
 
 void MyLibraryActivity::onExit() {
   Activity::onExit();
-  files.clear();
+  checking = false;
+  listing.close();
 }
 
 void MyLibraryActivity::loop() {
+  if (checking) {
+    continueCheck();
+  }
+
   // Long press BACK (1s+) goes to root folder
   if (mappedInput.isPressed(MappedInputManager::Button::Back) && mappedInput.getHeldTime() >= GO_HOME_MS &&
       basepath != "/") {
+    RenderLock lock(*this);
     basepath = "/";
     loadFiles();
     selectorIndex = 0;
@@ -129,18 +71,24 @@ void MyLibraryActivity::loop() {
   const int pageItems = UITheme::getInstance().getNumberOfItemsPerPage(renderer, true, false, true, false);
 
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-    if (files.empty()) {
+    RenderLock lock(*this);
+    if (listing.size() == 0) {
       return;
     }
 
     if (basepath.back() != '/') basepath += "/";
-    if (files[selectorIndex].back() == '/') {
-      basepath += files[selectorIndex].substr(0, files[selectorIndex].length() - 1);
+    const std::string selected = listing.name(selectorIndex);
+    if (selected.empty()) {
+      return;
+    }
+    if (selected.back() == '/') {
+      basepath += selected.substr(0, selected.length() - 1);
       loadFiles();
       selectorIndex = 0;
       requestUpdate();
     } else {
-      onSelectBook(basepath + files[selectorIndex]);
+      lock.unlock();
+      onSelectBook(basepath + selected);
       return;
     }
   }
@@ -149,6 +97,7 @@ void MyLibraryActivity::loop() {
     // Short press: go up one directory, or go home if at root
     if (mappedInput.getHeldTime() < GO_HOME_MS) {
       if (basepath != "/") {
+        RenderLock lock(*this);
         const std::string oldPath = basepath;
 
         basepath.replace(basepath.find_last_of('/'), std::string::npos, "");
@@ -157,7 +106,7 @@ void MyLibraryActivity::loop() {
 
         const auto pos = oldPath.find_last_of('/');
         const std::string dirName = oldPath.substr(pos + 1) + "/";
-        selectorIndex = findEntry(dirName);
+        selectorIndex = listing.find(dirName);
 
         requestUpdate();
       } else {
@@ -166,7 +115,7 @@ void MyLibraryActivity::loop() {
     }
   }
 
-  int listSize = static_cast<int>(files.size());
+  int listSize = static_cast<int>(listing.size());
   buttonNavigator.onNextRelease([this, listSize] {
     selectorIndex = ButtonNavigator::nextIndex(static_cast<int>(selectorIndex), listSize);
     requestUpdate();
@@ -208,13 +157,13 @@ void MyLibraryActivity::render(RenderLock&&) {
 
   const int contentTop = metrics.topPadding + metrics.headerHeight + metrics.verticalSpacing;
   const int contentHeight = pageHeight - contentTop - metrics.buttonHintsHeight - metrics.verticalSpacing;
-  if (files.empty()) {
+  if (listing.size() == 0) {
     renderer.drawText(UI_10_FONT_ID, metrics.contentSidePadding, contentTop + 20, tr(STR_NO_BOOKS_FOUND));
   } else {
     GUI.drawList(
-        renderer, Rect{0, contentTop, pageWidth, contentHeight}, files.size(), selectorIndex,
-        [this](int index) { return getFileName(files[index]); }, nullptr,
-        [this](int index) { return UITheme::getFileIcon(files[index]); });
+        renderer, Rect{0, contentTop, pageWidth, contentHeight}, listing.size(), selectorIndex,
+        [this](int index) { return getFileName(listing.name(index)); }, nullptr,
+        [this](int index) { return UITheme::getFileIcon(listing.name(index)); });
   }
 
   // Help text
@@ -224,9 +173,3 @@ void MyLibraryActivity::render(RenderLock&&) {
 
   renderer.displayBuffer();
 }
-
-size_t MyLibraryActivity::findEntry(const std::string& name) const {
-  for (size_t i = 0; i < files.size(); i++)
-    if (files[i] == name) return i;
-  return 0;
-}
\ No newline at end of file
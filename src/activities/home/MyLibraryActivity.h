@@ -1,9 +1,9 @@
 #pragma once
 #include <functional>
 #include <string>
-#include <vector>
 
 #include "../Activity.h"
+#include "LibraryIndex.h"
 #include "RecentBooksStore.h"
 #include "util/ButtonNavigator.h"
 
@@ -15,11 +15,14 @@ class MyLibraryActivity final : public Activity {
 
   // Files state
   std::string basepath = "/";
-  std::vector<std::string> files;
+  // Read from the card as rows are shown, so under the RenderLock outside render()
+  LibraryIndex listing;
+  // A stored listing is being checked against the folder, a few entries per loop()
+  bool checking = false;
 
   // Data loading
   void loadFiles();
-  size_t findEntry(const std::string& name) const;
+  void continueCheck();
 
  public:
   explicit MyLibraryActivity(GfxRenderer& renderer, MappedInputManager& mappedInput, std::string initialPath = "/")
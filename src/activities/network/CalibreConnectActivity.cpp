@@ -10,6 +10,7 @@
 #include "WifiSelectionActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "network/BookCatalog.h"
 
 namespace {
 constexpr const char* HOSTNAME = "crosspoint";
@@ -79,6 +80,13 @@ void CalibreConnectActivity::startWebServer() {
     LOG_DBG("CAL", "mDNS started: http://%s.local/", HOSTNAME);
   }
 
+  // The plugin asks for the whole book list as soon as it connects. Have the catalog ready before then, so the list
+  // is answered from it in batches instead of with a scan of the card inside the request.
+  uint32_t catalogGeneration = 0;
+  if (!BookCatalog::getGeneration(catalogGeneration)) {
+    LOG_ERR("CAL", "Book catalog unavailable");
+  }
+
   webServer.reset(new CrossPointWebServer());
   webServer->begin();
 
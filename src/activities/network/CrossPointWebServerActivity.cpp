@@ -9,8 +9,11 @@
 
 #include <cstddef>
 
+#include "CoverJobQueue.h"
+#include "KOReaderSyncQueue.h"
 #include "MappedInputManager.h"
 #include "NetworkModeSelectionActivity.h"
+#include "SleepScreenCache.h"
 #include "WifiSelectionActivity.h"
 #include "activities/network/CalibreConnectActivity.h"
 #include "components/UITheme.h"
@@ -60,6 +63,9 @@ void CrossPointWebServerActivity::onEnter() {
 
 void CrossPointWebServerActivity::onExit() {
   Activity::onExit();
+  // Sleep images may have been uploaded or removed
+  SLEEP_SCREENS.rescan();
+  QrUtils::releaseCache();
 
   LOG_DBG("WEBACT", "Free heap at onExit start: %d bytes", ESP.getFreeHeap());
 
@@ -238,6 +244,11 @@ void CrossPointWebServerActivity::startAccessPoint() {
 }
 
 void CrossPointWebServerActivity::startWebServer() {
+  // Joined a network: send the queued reading positions while WiFi is up anyway
+  if (!isApMode && !KOSYNC_QUEUE.isEmpty()) {
+    KOSYNC_QUEUE.flush();
+  }
+
   LOG_DBG("WEBACT", "Starting web server...");
 
   // Create the web server instance
@@ -332,6 +343,14 @@ void CrossPointWebServerActivity::loop() {
         }
       }
       lastHandleClientTime = millis();
+
+      // Ingest uploaded books, one per loop, once the uploads have stopped for a while
+      if (!COVER_JOBS.isEmpty() && COVER_JOBS.isSettled() && !webServer->getWsUploadStatus().inProgress) {
+        RenderLock lock(*this);
+        esp_task_wdt_reset();
+        COVER_JOBS.runNext(renderer);
+        esp_task_wdt_reset();
+      }
     }
 
     // Handle exit on Back button (also check outside loop)
@@ -224,10 +224,21 @@ void WifiSelectionActivity::attemptConnection() {
   String hostname = "CrossPoint-Reader-" + mac;
   WiFi.setHostname(hostname.c_str());
 
-  if (selectedRequiresPassword && !enteredPassword.empty()) {
-    WiFi.begin(selectedSSID.c_str(), enteredPassword.c_str());
+  beginConnection(true);
+}
+
+void WifiSelectionActivity::beginConnection(const bool useAccessPointHint) {
+  const char* password = selectedRequiresPassword && !enteredPassword.empty() ? enteredPassword.c_str() : nullptr;
+
+  // A saved network is joined through the access point it was joined through last time, which skips the scan of
+  // all channels
+  const auto* cred = WIFI_STORE.findCredential(selectedSSID);
+  usingAccessPointHint = useAccessPointHint && cred && cred->channel > 0;
+  if (usingAccessPointHint) {
+    LOG_DBG("WIFI", "Connecting to %s on channel %d", selectedSSID.c_str(), cred->channel);
+    WiFi.begin(selectedSSID.c_str(), password, cred->channel, cred->bssid);
   } else {
-    WiFi.begin(selectedSSID.c_str());
+    WiFi.begin(selectedSSID.c_str(), password);
   }
 }
 
@@ -251,6 +262,7 @@ void WifiSelectionActivity::checkConnectionStatus() {
     {
       RenderLock lock(*this);
       WIFI_STORE.setLastConnectedSsid(selectedSSID);
+      WIFI_STORE.setAccessPoint(selectedSSID, WiFi.BSSID(), WiFi.channel());
     }
 
     // If we entered a new password, ask if user wants to save it
@@ -269,6 +281,17 @@ void WifiSelectionActivity::checkConnectionStatus() {
     return;
   }
 
+  // The access point may have moved to another channel, or the network to another access point: try again the usual
+  // way, scanning for it
+  if (usingAccessPointHint && (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL ||
+                               millis() - connectionStartTime > FAST_CONNECT_TIMEOUT_MS)) {
+    LOG_DBG("WIFI", "Remembered access point of %s not reached, scanning", selectedSSID.c_str());
+    WiFi.disconnect();
+    connectionStartTime = millis();
+    beginConnection(false);
+    return;
+  }
+
   if (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL) {
     connectionError = tr(STR_ERROR_GENERAL_FAILURE);
     if (status == WL_NO_SSID_AVAIL) {
@@ -327,6 +350,7 @@ void WifiSelectionActivity::loop() {
         // User chose "Yes" - save the password
         RenderLock lock(*this);
         WIFI_STORE.addCredential(selectedSSID, enteredPassword);
+        WIFI_STORE.setAccessPoint(selectedSSID, WiFi.BSSID(), WiFi.channel());
       }
       // Complete - parent will start web server
       onComplete(true);
@@ -78,8 +78,13 @@ class WifiSelectionActivity final : public Activity {
 
   // Connection timeout
   static constexpr unsigned long CONNECTION_TIMEOUT_MS = 15000;
+  // Time the remembered access point gets before connecting falls back to a scan
+  static constexpr unsigned long FAST_CONNECT_TIMEOUT_MS = 4000;
   unsigned long connectionStartTime = 0;
 
+  // Connecting straight to the access point and channel of the last connection
+  bool usingAccessPointHint = false;
+
   void renderNetworkList() const;
   void renderPasswordEntry() const;
   void renderConnecting() const;
@@ -92,6 +97,7 @@ class WifiSelectionActivity final : public Activity {
   void processWifiScanResults();
   void selectNetwork(int index);
   void attemptConnection();
+  void beginConnection(bool useAccessPointHint);
   void checkConnectionStatus();
   std::string getSignalStrengthIndicator(int32_t rssi) const;
 
@@ -4,28 +4,56 @@
 #include <Epub/blocks/TextBlock.h>
 #include <FsHelpers.h>
 #include <GfxRenderer.h>
+#include <HalGPIO.h>
+#include <HalPowerManager.h>
 #include <HalStorage.h>
 #include <I18n.h>
 #include <Logging.h>
+#include <Trace.h>
 
+#include "CacheBudget.h"
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "EpubReaderChapterSelectionActivity.h"
 #include "EpubReaderFootnotesActivity.h"
 #include "EpubReaderPercentSelectionActivity.h"
+#include "EpubReaderSearchResultsActivity.h"
 #include "KOReaderCredentialStore.h"
+#include "KOReaderDocumentId.h"
 #include "KOReaderSyncActivity.h"
+#include "KOReaderSyncQueue.h"
 #include "MappedInputManager.h"
+#include "MemoryBudget.h"
+#include "PerfStats.h"
+#include "ProgressMapper.h"
 #include "QrDisplayActivity.h"
 #include "RecentBooksStore.h"
+#include "SdFonts.h"
+#include "WarmBooks.h"
+#include "activities/util/KeyboardEntryActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "util/RefreshUtils.h"
 #include "util/ScreenshotUtil.h"
 
 namespace {
-// pagesPerRefresh now comes from SETTINGS.getRefreshFrequency()
+// Half refresh cadence comes from RefreshUtils::nextPageRefreshMode()
 constexpr unsigned long skipChapterMs = 700;
 constexpr unsigned long goHomeMs = 1000;
+// Idle pre-indexing: wait this long after the last page turn, then build in slices of at most this long so
+// button presses are still picked up promptly by the next loop() iteration
+constexpr unsigned long preindexIdleDelayMs = 1000;
+constexpr uint32_t preindexSliceMs = 40;
+// A section build holds the XML parser, CSS rules and a partial ParsedText; don't compete with the foreground
+// reader for heap (CssParser starts dropping styles below 48KB free)
+constexpr uint32_t preindexMinFreeHeap = 96 * 1024;
+// Images of this many pages after the current one get their pixel caches built while idle
+constexpr int predecodePageCount = 2;
+// Longest search query, and most matches listed. A page the index gives through a hash collision is left out, so a
+// few more pages than that are looked at.
+constexpr size_t maxSearchQueryLength = 64;
+constexpr size_t maxSearchResults = 50;
+constexpr size_t maxSearchHits = 64;
 // pages per minute, first item is 1 to prevent division by zero if accessed
 const std::vector<int> PAGE_TURN_LABELS = {1, 1, 3, 6, 12};
 
@@ -62,6 +90,41 @@ void applyReaderOrientation(GfxRenderer& renderer, const uint8_t orientation) {
 
 }  // namespace
 
+void EpubReaderActivity::getContentMargins(const GfxRenderer& renderer, const bool automaticPageTurn, int* top,
+                                           int* right, int* bottom, int* left) {
+  // Apply screen viewable areas and additional padding
+  renderer.getOrientedViewableTRBL(top, right, bottom, left);
+  *top += SETTINGS.screenMargin;
+  *left += SETTINGS.screenMargin;
+  *right += SETTINGS.screenMargin;
+
+  const uint8_t statusBarHeight = UITheme::getInstance().getStatusBarHeight();
+
+  // reserves space for automatic page turn indicator when no status bar or progress bar only
+  if (automaticPageTurn && (statusBarHeight == 0 || statusBarHeight == UITheme::getInstance().getProgressBarHeight())) {
+    *bottom +=
+        std::max(SETTINGS.screenMargin,
+                 static_cast<uint8_t>(statusBarHeight + UITheme::getInstance().getMetrics().statusBarVerticalMargin));
+  } else {
+    *bottom += std::max(SETTINGS.screenMargin, statusBarHeight);
+  }
+}
+
+void EpubReaderActivity::getOpeningViewport(GfxRenderer& renderer, uint16_t* width, uint16_t* height) {
+  const auto previousOrientation = renderer.getOrientation();
+  applyReaderOrientation(renderer, SETTINGS.orientation);
+  int top, right, bottom, left;
+  getContentMargins(renderer, false, &top, &right, &bottom, &left);
+  *width = renderer.getScreenWidth() - left - right;
+  *height = renderer.getScreenHeight() - top - bottom;
+  renderer.setOrientation(previousOrientation);
+}
+
+int EpubReaderActivity::getOpeningSpineIndex(const Epub& epub) {
+  // A book opened for the first time starts at its text reference rather than the cover
+  return epub.getSpineIndexForTextReference();
+}
+
 void EpubReaderActivity::onEnter() {
   Activity::onEnter();
 
@@ -72,28 +135,26 @@ void EpubReaderActivity::onEnter() {
   // Configure screen orientation based on settings
   // NOTE: This affects layout math and must be applied before any render calls.
   applyReaderOrientation(renderer, SETTINGS.orientation);
+  SD_FONTS.apply(renderer);
 
   epub->setupCacheDir();
-
-  FsFile f;
-  if (Storage.openFileForRead("ERS", epub->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[6];
-    int dataSize = f.read(data, 6);
-    if (dataSize == 4 || dataSize == 6) {
-      currentSpineIndex = data[0] + (data[1] << 8);
-      nextPageNumber = data[2] + (data[3] << 8);
-      cachedSpineIndex = currentSpineIndex;
-      LOG_DBG("ERS", "Loaded cache: %d, %d", currentSpineIndex, nextPageNumber);
-    }
-    if (dataSize == 6) {
-      cachedChapterTotalPageCount = data[4] + (data[5] << 8);
-    }
-    f.close();
+  Section::setMaxCachedLayouts(SETTINGS.cachedLayoutsPerBook);
+
+  uint8_t data[6];
+  const size_t dataSize = progressJournal.open(epub->getCachePath(), data, sizeof(data));
+  if (dataSize == 4 || dataSize == 6) {
+    currentSpineIndex = data[0] + (data[1] << 8);
+    nextPageNumber = data[2] + (data[3] << 8);
+    cachedSpineIndex = currentSpineIndex;
+    LOG_DBG("ERS", "Loaded cache: %d, %d", currentSpineIndex, nextPageNumber);
+  }
+  if (dataSize == 6) {
+    cachedChapterTotalPageCount = data[4] + (data[5] << 8);
   }
   // We may want a better condition to detect if we are opening for the first time.
   // This will trigger if the book is re-opened at Chapter 0.
   if (currentSpineIndex == 0) {
-    int textSpineIndex = epub->getSpineIndexForTextReference();
+    int textSpineIndex = getOpeningSpineIndex(*epub);
     if (textSpineIndex != 0) {
       currentSpineIndex = textSpineIndex;
       LOG_DBG("ERS", "Opened for first time, navigating to text reference at index %d", textSpineIndex);
@@ -104,6 +165,8 @@ void EpubReaderActivity::onEnter() {
   APP_STATE.openEpubPath = epub->getPath();
   APP_STATE.saveToFile();
   RECENT_BOOKS.addBook(epub->getPath(), epub->getTitle(), epub->getAuthor(), epub->getThumbBmpPath());
+  CACHE_BUDGET.touch(epub->getCachePath());
+  MEMORY_BUDGET.setMode(MemoryBudget::Reading);
 
   // Trigger first update
   requestUpdate();
@@ -111,14 +174,29 @@ void EpubReaderActivity::onEnter() {
 
 void EpubReaderActivity::onExit() {
   Activity::onExit();
+  MEMORY_BUDGET.setMode(MemoryBudget::Browsing);
 
   // Reset orientation back to portrait for the rest of the UI
   renderer.setOrientation(GfxRenderer::Orientation::Portrait);
 
   APP_STATE.readerActivityLoadCount = 0;
   APP_STATE.saveToFile();
+  queueSyncProgress();
+  progressJournal.close();
+  preindexSection.reset();
+  frameCache.reset();
   section.reset();
-  epub.reset();
+  // Kept loaded for a while, so switching back to the book is quick
+  WARM_BOOKS.park(std::move(epub));
+  renderer.clearFontCache();  // Glyph groups cached across pages aren't needed outside the reader
+}
+
+unsigned long EpubReaderActivity::msUntilLoopDeadline() {
+  if (!automaticPageTurnActive) {
+    return ULONG_MAX;
+  }
+  const unsigned long sinceTurn = millis() - lastPageTurnTime;
+  return sinceTurn >= pageTurnDuration ? 0 : pageTurnDuration - sinceTurn;
 }
 
 void EpubReaderActivity::loop() {
@@ -128,6 +206,17 @@ void EpubReaderActivity::loop() {
     return;
   }
 
+  if (progressJournal.isFlushDue()) {
+    RenderLock lock(*this);
+    progressJournal.flush();
+  }
+
+  // Between page turns the status bar battery is refreshed on its own, and only when its percentage changed
+  if (powerManager.takeBatteryChanged() && section && !section->isBuilding() && !RenderLock::peek()) {
+    RenderLock lock(*this);
+    GUI.redrawStatusBarBattery(renderer);
+  }
+
   if (automaticPageTurnActive) {
     if (mappedInput.wasReleased(MappedInputManager::Button::Confirm) ||
         mappedInput.wasReleased(MappedInputManager::Button::Back)) {
@@ -157,16 +246,21 @@ void EpubReaderActivity::loop() {
   // Enter reader menu activity.
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
     const int currentPage = section ? section->currentPage + 1 : 0;
-    const int totalPages = section ? section->pageCount : 0;
+    const int totalPages = knownPageCount();
     float bookProgress = 0.0f;
-    if (epub->getBookSize() > 0 && section && section->pageCount > 0) {
-      const float chapterProgress = static_cast<float>(section->currentPage) / static_cast<float>(section->pageCount);
+    if (epub->getBookSize() > 0 && totalPages > 0) {
+      const float chapterProgress = static_cast<float>(section->currentPage) / static_cast<float>(totalPages);
       bookProgress = epub->calculateProgress(currentSpineIndex, chapterProgress) * 100.0f;
     }
+    int bookPage, bookPageCount;
+    if (getBookPagePosition(bookPage, bookPageCount)) {
+      bookProgress = static_cast<float>(bookPage) * 100.0f / static_cast<float>(bookPageCount);
+    }
     const int bookProgressPercent = clampPercent(static_cast<int>(bookProgress + 0.5f));
     startActivityForResult(std::make_unique<EpubReaderMenuActivity>(
                                renderer, mappedInput, epub->getTitle(), currentPage, totalPages, bookProgressPercent,
-                               SETTINGS.orientation, !currentPageFootnotes.empty()),
+                               SETTINGS.orientation, !currentPageFootnotes.empty(),
+                               getBookPagePosition(bookPage, bookPageCount)),
                            [this](const ActivityResult& result) {
                              // Always apply orientation change even if the menu was cancelled
                              const auto& menu = std::get<MenuResult>(result.data);
@@ -209,6 +303,15 @@ void EpubReaderActivity::loop() {
                                     mappedInput.wasReleased(MappedInputManager::Button::Right));
 
   if (!prevTriggered && !nextTriggered) {
+    if (section && section->isBuilding()) {
+      continueProgressiveBuild();
+    } else {
+      prefetchNeighbourPages();
+      predecodeUpcomingImages();
+      scanPageNotes();
+      preindexNeighbourSection();
+      buildSearchIndex();
+    }
     return;
   }
 
@@ -263,6 +366,14 @@ void EpubReaderActivity::jumpToPercent(int percent) {
   // Normalize input to 0-100 to avoid invalid jumps.
   percent = clampPercent(percent);
 
+  // With every chapter's page count known this is a page of the book, found exactly
+  int bookPage, bookPageCount;
+  if (getBookPagePosition(bookPage, bookPageCount)) {
+    const uint32_t targetPage = static_cast<uint32_t>(static_cast<uint64_t>(bookPageCount) * percent / 100);
+    jumpToBookPage(std::min(targetPage, static_cast<uint32_t>(bookPageCount - 1)));
+    return;
+  }
+
   // Convert percent into a byte-like absolute position across the spine sizes.
   // Use an overflow-safe computation: (bookSize / 100) * percent + (bookSize % 100) * percent / 100
   size_t targetSize =
@@ -319,17 +430,38 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
       startActivityForResult(
           std::make_unique<EpubReaderChapterSelectionActivity>(renderer, mappedInput, epub, path, spineIdx),
           [this](const ActivityResult& result) {
-            if (!result.isCancelled && currentSpineIndex != std::get<ChapterResult>(result.data).spineIndex) {
+            if (result.isCancelled) {
+              return;
+            }
+            const auto& chapter = std::get<ChapterResult>(result.data);
+            if (currentSpineIndex != chapter.spineIndex || !chapter.anchor.empty()) {
               RenderLock lock(*this);
-              currentSpineIndex = std::get<ChapterResult>(result.data).spineIndex;
-              nextPageNumber = 0;
-              section.reset();
+              goToAnchor(chapter.spineIndex, chapter.anchor);
             }
           });
       break;
     }
     case EpubReaderMenuActivity::MenuAction::FOOTNOTES: {
-      startActivityForResult(std::make_unique<EpubReaderFootnotesActivity>(renderer, mappedInput, currentPageFootnotes),
+      {
+        RenderLock lock(*this);
+        footnotePreviews.assign(currentPageFootnotes.size(), "");
+        bool popupShown = false;
+        for (size_t i = 0; i < currentPageFootnotes.size(); i++) {
+          std::string id;
+          const int spineIndex = resolveNote(currentPageFootnotes[i].href, id);
+          if (spineIndex < 0) {
+            continue;
+          }
+          if (!getBookNotes().isScanned(spineIndex) && !popupShown) {
+            GUI.drawPopup(renderer, tr(STR_LOADING));
+            popupShown = true;
+          }
+          getBookNotes().scan(*epub, spineIndex);
+          getBookNotes().getNote(spineIndex, id, footnotePreviews[i]);
+        }
+      }
+      startActivityForResult(std::make_unique<EpubReaderFootnotesActivity>(renderer, mappedInput, currentPageFootnotes,
+                                                                           footnotePreviews),
                              [this](const ActivityResult& result) {
                                if (!result.isCancelled) {
                                  const auto& footnoteResult = std::get<FootnoteResult>(result.data);
@@ -339,10 +471,24 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
                              });
       break;
     }
+    case EpubReaderMenuActivity::MenuAction::SEARCH: {
+      startActivityForResult(std::make_unique<KeyboardEntryActivity>(renderer, mappedInput, tr(STR_SEARCH),
+                                                                     searchQuery, maxSearchQueryLength, false),
+                             [this](const ActivityResult& result) {
+                               if (!result.isCancelled) {
+                                 searchQuery = std::get<KeyboardResult>(result.data).text;
+                                 searchBook();
+                               }
+                             });
+      break;
+    }
     case EpubReaderMenuActivity::MenuAction::GO_TO_PERCENT: {
       float bookProgress = 0.0f;
-      if (epub && epub->getBookSize() > 0 && section && section->pageCount > 0) {
-        const float chapterProgress = static_cast<float>(section->currentPage) / static_cast<float>(section->pageCount);
+      int bookPage, bookPageCount;
+      if (getBookPagePosition(bookPage, bookPageCount)) {
+        bookProgress = static_cast<float>(bookPage - 1) * 100.0f / static_cast<float>(bookPageCount);
+      } else if (epub && epub->getBookSize() > 0 && knownPageCount() > 0) {
+        const float chapterProgress = static_cast<float>(section->currentPage) / static_cast<float>(knownPageCount());
         bookProgress = epub->calculateProgress(currentSpineIndex, chapterProgress) * 100.0f;
       }
       const int initialPercent = clampPercent(static_cast<int>(bookProgress + 0.5f));
@@ -355,20 +501,30 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
           });
       break;
     }
+    case EpubReaderMenuActivity::MenuAction::GO_TO_PAGE: {
+      int bookPage, bookPageCount;
+      if (!getBookPagePosition(bookPage, bookPageCount)) {
+        break;
+      }
+      startActivityForResult(
+          std::make_unique<EpubReaderPercentSelectionActivity>(renderer, mappedInput, bookPage, bookPageCount),
+          [this](const ActivityResult& result) {
+            if (!result.isCancelled) {
+              jumpToBookPage(std::get<PageResult>(result.data).page);
+            }
+          });
+      break;
+    }
     case EpubReaderMenuActivity::MenuAction::DISPLAY_QR: {
       if (section && section->currentPage >= 0 && section->currentPage < section->pageCount) {
         auto p = section->loadPageFromSectionFile();
         if (p) {
           std::string fullText;
-          for (const auto& el : p->elements) {
-            if (el->getTag() == TAG_PageLine) {
-              const auto& line = static_cast<const PageLine&>(*el);
-              if (line.getBlock()) {
-                const auto& words = line.getBlock()->getWords();
-                for (const auto& w : words) {
-                  if (!fullText.empty()) fullText += " ";
-                  fullText += w;
-                }
+          for (const auto& el : p->getElements()) {
+            if (el.tag == TAG_PageLine) {
+              for (const auto& w : el.line->getWords()) {
+                if (!fullText.empty()) fullText += " ";
+                fullText += w;
               }
             }
           }
@@ -393,11 +549,19 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
         if (epub && section) {
           uint16_t backupSpine = currentSpineIndex;
           uint16_t backupPage = section->currentPage;
-          uint16_t backupPageCount = section->pageCount;
+          uint16_t backupPageCount = knownPageCount();
+          preindexSection.reset();
+          searchSection.reset();
+          searchIndex.reset();
           section.reset();
+          // The journal lives in the cache directory: closed before it goes, started over once it's back
+          progressJournal.close();
           epub->clearCache();
           epub->setupCacheDir();
+          uint8_t unused[6];
+          progressJournal.open(epub->getCachePath(), unused, sizeof(unused));
           saveProgress(backupSpine, backupPage, backupPageCount);
+          progressJournal.flush();
         }
       }
       onGoHome();
@@ -414,14 +578,17 @@ void EpubReaderActivity::onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction
     case EpubReaderMenuActivity::MenuAction::SYNC: {
       if (KOREADER_STORE.hasCredentials()) {
         const int currentPage = section ? section->currentPage : 0;
-        const int totalPages = section ? section->pageCount : 0;
+        const int totalPages = knownPageCount();
         startActivityForResult(
             std::make_unique<KOReaderSyncActivity>(renderer, mappedInput, epub, epub->getPath(), currentSpineIndex,
-                                                   currentPage, totalPages),
+                                                   currentPage, totalPages, currentTextPosition()),
             [this](const ActivityResult& result) {
               if (!result.isCancelled) {
                 const auto& sync = std::get<SyncResult>(result.data);
-                if (currentSpineIndex != sync.spineIndex || (section && section->currentPage != sync.page)) {
+                if (sync.textPosition != UINT32_MAX) {
+                  RenderLock lock(*this);
+                  goToTextPosition(sync.spineIndex, sync.textPosition, sync.page);
+                } else if (currentSpineIndex != sync.spineIndex || (section && section->currentPage != sync.page)) {
                   RenderLock lock(*this);
                   currentSpineIndex = sync.spineIndex;
                   nextPageNumber = sync.page;
@@ -446,7 +613,7 @@ void EpubReaderActivity::applyOrientation(const uint8_t orientation) {
     RenderLock lock(*this);
     if (section) {
       cachedSpineIndex = currentSpineIndex;
-      cachedChapterTotalPageCount = section->pageCount;
+      cachedChapterTotalPageCount = knownPageCount();
       nextPageNumber = section->currentPage;
     }
 
@@ -480,7 +647,7 @@ void EpubReaderActivity::toggleAutoPageTurn(const uint8_t selectedPageTurnOption
     RenderLock lock(*this);
     if (section) {
       cachedSpineIndex = currentSpineIndex;
-      cachedChapterTotalPageCount = section->pageCount;
+      cachedChapterTotalPageCount = knownPageCount();
       nextPageNumber = section->currentPage;
     }
     section.reset();
@@ -488,40 +655,542 @@ void EpubReaderActivity::toggleAutoPageTurn(const uint8_t selectedPageTurnOption
 }
 
 void EpubReaderActivity::pageTurn(bool isForwardTurn) {
+  lastPageTurnTime = millis();
+  if (RenderLock::peek()) {
+    // A page is being rendered: count the turn for the next render, which the current one makes way for
+    pendingPageTurns += isForwardTurn ? 1 : -1;
+    requestUpdate();
+    return;
+  }
+  {
+    RenderLock lock(*this);
+    if (section) {
+      turnPage(isForwardTurn);
+    }
+  }
+  requestUpdate();
+}
+
+void EpubReaderActivity::turnPage(bool isForwardTurn) {
   if (isForwardTurn) {
     if (section->currentPage < section->pageCount - 1) {
       section->currentPage++;
-    } else {
-      // We don't want to delete the section mid-render, so grab the semaphore
-      {
-        RenderLock lock(*this);
+    } else if (section->isBuilding()) {
+      // Reading ahead of a progressive build: lay out the next page right away instead of waiting for idle slices
+      HalPowerManager::Lock powerLock(HalPowerManager::Indexing);
+      if (section->continueSectionBuild(0, section->currentPage + 2) == Section::BuildStatus::Failed) {
+        LOG_ERR("ERS", "Failed to persist page data to SD");
+        nextPageNumber = section->currentPage + 1;
+        section.reset();
+      } else if (section->currentPage < section->pageCount - 1) {
+        section->currentPage++;
+      } else {
+        // The chapter ended on the current page
         nextPageNumber = 0;
         currentSpineIndex++;
         section.reset();
       }
+    } else {
+      nextPageNumber = 0;
+      currentSpineIndex++;
+      section.reset();
     }
   } else {
     if (section->currentPage > 0) {
       section->currentPage--;
     } else if (currentSpineIndex > 0) {
-      // We don't want to delete the section mid-render, so grab the semaphore
-      {
-        RenderLock lock(*this);
-        nextPageNumber = UINT16_MAX;
-        currentSpineIndex--;
-        section.reset();
+      nextPageNumber = UINT16_MAX;
+      currentSpineIndex--;
+      section.reset();
+    }
+  }
+}
+
+// Pressing next five times during a render shows the fifth page next. Turns that run into another chapter stop at
+// its edge: the rest would need its section loaded first.
+void EpubReaderActivity::applyPendingPageTurns() {
+  int turns = pendingPageTurns.exchange(0);
+  while (turns != 0 && section) {
+    turnPage(turns > 0);
+    turns += turns > 0 ? -1 : 1;
+  }
+}
+
+// Decode the pages either side of the one on screen once its display refresh is done, so the next page turn only
+// has to render. Section keeps them within a small byte budget and drops them when the heap runs low.
+void EpubReaderActivity::prefetchNeighbourPages() {
+  if (neighbourPagesPrefetched || !section || RenderLock::peek()) {
+    return;
+  }
+
+  RenderLock lock(*this);
+  if (!section || neighbourPagesPrefetched) {
+    return;
+  }
+  section->prefetchNeighbourPages();
+  neighbourPagesPrefetched = true;
+}
+
+// Decode the images of the next few pages into their pixel caches while the reader is idle, so an image-heavy page
+// renders from cache on first view. One image per call; a button press abandons the decode (leaving no cache file)
+// and the next idle call starts it over.
+void EpubReaderActivity::predecodeUpcomingImages() {
+  if (upcomingImagesPredecoded || !section || section->isBuilding() ||
+      millis() - lastPageTurnTime < preindexIdleDelayMs || RenderLock::peek()) {
+    return;
+  }
+
+  RenderLock lock(*this);
+  if (!section || upcomingImagesPredecoded || ESP.getFreeHeap() < preindexMinFreeHeap) {
+    return;
+  }
+  HalPowerManager::Lock powerLock(HalPowerManager::Decoding);
+
+  // Same origin as render() uses for the page
+  int marginTop, marginRight, marginBottom, marginLeft;
+  renderer.getOrientedViewableTRBL(&marginTop, &marginRight, &marginBottom, &marginLeft);
+  marginTop += SETTINGS.screenMargin;
+  marginLeft += SETTINGS.screenMargin;
+
+  const auto inputPending = [] { return gpio.pollForInput(); };
+  for (int offset = 1; offset <= predecodePageCount; offset++) {
+    const auto page = section->peekPage(section->currentPage + offset);
+    if (!page) {
+      break;
+    }
+    for (const auto& element : page->getElements()) {
+      if (element.tag != TAG_PageImage) {
+        continue;
+      }
+      const auto status =
+          element.image->buildCache(renderer, element.xPos + marginLeft, element.yPos + marginTop, inputPending);
+      if (status == ImageBlock::CacheStatus::Built || status == ImageBlock::CacheStatus::Aborted) {
+        return;
       }
     }
   }
-  lastPageTurnTime = millis();
+  upcomingImagesPredecoded = true;
+}
+
+BookNotes& EpubReaderActivity::getBookNotes() {
+  if (!bookNotes) {
+    bookNotes.reset(new BookNotes(epub->getCachePath() + "/notes.bin"));
+  }
+  return *bookNotes;
+}
+
+int EpubReaderActivity::resolveNote(const char* href, std::string& id) const {
+  const char* hash = strchr(href, '#');
+  if (!hash || hash[1] == '\0') {
+    return -1;
+  }
+  id = hash + 1;
+  // Footnotes keep the href as written, relative to the chapter they're in
+  return hash == href ? currentSpineIndex : epub->resolveHrefToSpineIndex(href);
+}
+
+void EpubReaderActivity::scanPageNotes() {
+  if (pageNotesScanned || !section || section->isBuilding() || millis() - lastPageTurnTime < preindexIdleDelayMs ||
+      RenderLock::peek()) {
+    return;
+  }
+
+  RenderLock lock(*this);
+  if (pageNotesScanned || ESP.getFreeHeap() < preindexMinFreeHeap) {
+    return;
+  }
+  // One chapter per call
+  for (const auto& footnote : currentPageFootnotes) {
+    std::string id;
+    const int spineIndex = resolveNote(footnote.href, id);
+    if (spineIndex < 0 || getBookNotes().isScanned(spineIndex)) {
+      continue;
+    }
+    HalPowerManager::Lock powerLock(HalPowerManager::Decoding);
+    const bool scanned = getBookNotes().scan(*epub, spineIndex, [] { return gpio.pollForInput(); });
+    // One cut short by a button press starts over on a later call; an unreadable one isn't tried again for this page
+    if (!scanned && !gpio.pollForInput()) {
+      pageNotesScanned = true;
+    }
+    return;
+  }
+  pageNotesScanned = true;
+}
+
+// Build the section file of the next (then previous) spine item in small slices while the reader is idle, so
+// crossing a chapter boundary doesn't stall on "Indexing...". Each call holds the render lock for at most one
+// slice; a paused build keeps its parser state and resumes on the next idle call. If the user lands on the
+// section being built, render() adopts it and finishes it in the foreground.
+// On USB power the job then carries on through the rest of the book, so every chapter's page count ends up in the
+// book page index and later chapter opens are cache hits.
+void EpubReaderActivity::preindexNeighbourSection() {
+  if (!section || section->isBuilding() || millis() - lastPageTurnTime < preindexIdleDelayMs) {
+    return;
+  }
+  const bool indexWholeBook =
+      !wholeBookIndexFailed && pageIndex && !pageIndex->isComplete() && gpio.isUsbConnected();
+  if (!preindexSection && preindexDoneForSpine == currentSpineIndex && !indexWholeBook) {
+    return;
+  }
+
+  // Don't delay a render (or display refresh) that is already in flight
+  if (RenderLock::peek()) {
+    return;
+  }
+
+  RenderLock lock(*this);
+  if (!section || sectionViewportWidth == 0 || sectionViewportHeight == 0) {
+    return;
+  }
+  // Index at full CPU speed even once the main loop dropped into power saving
+  HalPowerManager::Lock powerLock(HalPowerManager::Indexing);
+
+  if (!preindexSection) {
+    if (ESP.getFreeHeap() < preindexMinFreeHeap) {
+      return;
+    }
+
+    // Returns true once there is nothing more to do for this candidate this call (build started or failed)
+    const auto tryCandidate = [this](const int candidate) {
+      auto candidateSection = std::unique_ptr<Section>(new Section(epub, candidate, renderer));
+      if (candidateSection->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                            SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment,
+                                            sectionViewportWidth, sectionViewportHeight, SETTINGS.hyphenationEnabled,
+                                            SETTINGS.embeddedStyle)) {
+        recordPageCount(*candidateSection);
+        return false;  // Already indexed
+      }
+      if (!candidateSection->beginSectionBuild(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                               SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment,
+                                               sectionViewportWidth, sectionViewportHeight,
+                                               SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle)) {
+        LOG_ERR("ERS", "Pre-index of section %d failed to start", candidate);
+        preindexDoneForSpine = currentSpineIndex;
+        wholeBookIndexFailed = true;
+        return true;
+      }
+      LOG_DBG("ERS", "Pre-indexing section %d", candidate);
+      preindexSection = std::move(candidateSection);
+      // Starting a build opens the chapter stream and sets up the parser, which is enough for this slice
+      return true;
+    };
+
+    if (preindexDoneForSpine != currentSpineIndex) {
+      for (const int candidate : {currentSpineIndex + 1, currentSpineIndex - 1}) {
+        if (candidate >= 0 && candidate < epub->getSpineItemsCount() && tryCandidate(candidate)) {
+          return;
+        }
+      }
+      preindexDoneForSpine = currentSpineIndex;
+    }
+
+    if (indexWholeBook) {
+      const int candidate = pageIndex->firstUnknown();
+      // An already indexed chapter only needs its count recorded; the next call moves on
+      if (candidate >= 0 && candidate != currentSpineIndex) {
+        tryCandidate(candidate);
+      } else if (candidate == currentSpineIndex) {
+        recordPageCount(*section);
+      }
+    }
+    return;
+  }
+
+  const auto status = preindexSection->continueSectionBuild(preindexSliceMs);
+  if (status == Section::BuildStatus::InProgress) {
+    return;
+  }
+
+  if (status == Section::BuildStatus::Done) {
+    LOG_DBG("ERS", "Pre-indexed section %d (%d pages)", preindexSection->getSpineIndex(), preindexSection->pageCount);
+    recordPageCount(*preindexSection);
+  } else {
+    LOG_ERR("ERS", "Pre-index of section %d failed", preindexSection->getSpineIndex());
+    preindexDoneForSpine = currentSpineIndex;
+    wholeBookIndexFailed = true;
+  }
+  // On success the next idle call moves on to the other neighbour (or the next chapter of the book)
+  preindexSection.reset();
+}
+
+// Store a finished section's page count in the book page index of its layout
+void EpubReaderActivity::recordPageCount(const Section& indexed) {
+  if (indexed.isBuilding()) {
+    return;
+  }
+  const std::string indexPath = indexed.getLayoutDir() + "/pages.bin";
+  if (!pageIndex || pageIndex->getPath() != indexPath) {
+    pageIndex.reset(new BookPageIndex(indexPath, epub->getSpineItemsCount()));
+    pageIndex->load();
+  }
+  if (pageIndex->setPageCount(indexed.getSpineIndex(), indexed.pageCount)) {
+    pageIndex->save();
+  }
+}
+
+void EpubReaderActivity::jumpToBookPage(const uint32_t bookPage) {
+  uint16_t pageInSpine = 0;
+  const int spineIndex = pageIndex ? pageIndex->findPage(bookPage, pageInSpine) : -1;
+  if (spineIndex < 0) {
+    return;
+  }
+  RenderLock lock(*this);
+  goToPage(spineIndex, pageInSpine);
   requestUpdate();
 }
 
+void EpubReaderActivity::goToPage(const int spineIndex, const int page) {
+  if (section && !section->isBuilding() && spineIndex == currentSpineIndex) {
+    section->currentPage = page;
+  } else {
+    // A chapter that isn't on the card (any more) is only laid out up to the page
+    currentSpineIndex = spineIndex;
+    nextPageNumber = page;
+    pendingPercentJump = false;
+    section.reset();
+  }
+}
+
+// Position in the whole book, once every chapter's page count is known for the current layout
+bool EpubReaderActivity::getBookPagePosition(int& bookPage, int& bookPageCount) const {
+  if (!section || section->isBuilding() || !pageIndex || !pageIndex->isComplete()) {
+    return false;
+  }
+  bookPage = static_cast<int>(pageIndex->getPagesBefore(currentSpineIndex)) + section->currentPage + 1;
+  bookPageCount = static_cast<int>(pageIndex->getTotalPages());
+  return bookPageCount > 0;
+}
+
+BookSearchIndex& EpubReaderActivity::getSearchIndex() {
+  const std::string indexPath = section->getLayoutDir() + "/search.bin";
+  if (!searchIndex || searchIndex->getPath() != indexPath) {
+    searchSection.reset();
+    searchIndex.reset(new BookSearchIndex(indexPath));
+    searchIndexBuilt = searchIndex->isBuilt();
+    searchIndexFailed = false;
+  }
+  return *searchIndex;
+}
+
+// One step of building the search index of the current layout: the pages of one chapter (or as many as fit in
+// timeBudgetMs), or the merge of them all into the index. A chapter that isn't on the card is laid out first with
+// layOut set; without it the build gives up there. InProgress while there is more to do; needs the render lock.
+BookSearchIndex::BuildStatus EpubReaderActivity::continueSearchIndexBuild(const uint32_t timeBudgetMs,
+                                                                          const bool layOut) {
+  BookSearchIndex& index = getSearchIndex();
+  if (searchIndexBuilt) {
+    return BookSearchIndex::BuildStatus::Done;
+  }
+  if (!index.isBuilding() && !index.beginBuild()) {
+    searchIndexFailed = true;
+    return BookSearchIndex::BuildStatus::Failed;
+  }
+
+  const int spineIndex = index.nextBuildSpine();
+  auto status = BookSearchIndex::BuildStatus::Failed;
+  if (spineIndex >= epub->getSpineItemsCount()) {
+    status = index.finishBuild(timeBudgetMs);
+    searchIndexBuilt = status == BookSearchIndex::BuildStatus::Done;
+  } else {
+    Section* source = section.get();
+    if (spineIndex != currentSpineIndex) {
+      if (!searchSection || searchSection->getSpineIndex() != spineIndex) {
+        searchSection.reset(new Section(epub, spineIndex, renderer));
+        if (searchSection->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                           SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment,
+                                           sectionViewportWidth, sectionViewportHeight, SETTINGS.hyphenationEnabled,
+                                           SETTINGS.embeddedStyle) ||
+            (layOut && searchSection->createSectionFile(
+                           SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                           SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, sectionViewportWidth,
+                           sectionViewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle))) {
+          recordPageCount(*searchSection);
+        } else if (layOut) {
+          // One that fails to lay out can't be read either; the rest of the book can still be searched
+          LOG_ERR("ERS", "Leaving section %d out of the search index", spineIndex);
+          searchSection.reset();
+          index.skipSection();
+          return BookSearchIndex::BuildStatus::InProgress;
+        } else {
+          LOG_ERR("ERS", "Section %d isn't there for the search index", spineIndex);
+          searchSection.reset();
+        }
+      }
+      source = searchSection.get();
+    }
+    if (source) {
+      status = index.addSectionPages(*source, timeBudgetMs);
+    }
+    if (status == BookSearchIndex::BuildStatus::Done) {
+      searchSection.reset();
+      status = BookSearchIndex::BuildStatus::InProgress;
+    }
+  }
+
+  if (status == BookSearchIndex::BuildStatus::Failed) {
+    LOG_ERR("ERS", "Search index build failed");
+    index.abortBuild();
+    searchSection.reset();
+    searchIndexFailed = true;
+  }
+  return status;
+}
+
+// On USB power, once the whole book is laid out, the search index is built as well, a slice per idle call, so the
+// first search doesn't have to wait for it
+void EpubReaderActivity::buildSearchIndex() {
+  if (!section || section->isBuilding() || preindexSection || millis() - lastPageTurnTime < preindexIdleDelayMs ||
+      !pageIndex || !pageIndex->isComplete() || !gpio.isUsbConnected() || RenderLock::peek()) {
+    return;
+  }
+
+  RenderLock lock(*this);
+  if (!section || section->isBuilding() || sectionViewportWidth == 0 || sectionViewportHeight == 0) {
+    return;
+  }
+  getSearchIndex();
+  if (searchIndexBuilt || searchIndexFailed || ESP.getFreeHeap() < preindexMinFreeHeap) {
+    return;
+  }
+  HalPowerManager::Lock powerLock(HalPowerManager::Indexing);
+  continueSearchIndexBuild(preindexSliceMs, false);
+}
+
+// Where a search result is, as the result list shows it: the chapter's title and the page, of the whole book when
+// that is known
+std::string EpubReaderActivity::searchResultLocation(const int spineIndex, const int page) const {
+  const int tocIndex = epub->getTocIndexForSpineIndex(spineIndex);
+  const std::string title = tocIndex != -1 ? epub->getTocItem(tocIndex).title : tr(STR_UNNAMED);
+  const int shownPage = pageIndex && pageIndex->isComplete()
+                            ? static_cast<int>(pageIndex->getPagesBefore(spineIndex)) + page + 1
+                            : page + 1;
+  char location[160];
+  snprintf(location, sizeof(location), tr(STR_SEARCH_RESULT_FORMAT), title.c_str(), shownPage);
+  return location;
+}
+
+// Look searchQuery up and list the pages it's on. The search index is built first if it isn't there yet, laying out
+// any chapter that isn't either, under a progress popup; a button press stops that, and the next search carries on.
+void EpubReaderActivity::searchBook() {
+  std::vector<EpubReaderSearchResultsActivity::Result> results;
+  {
+    RenderLock lock(*this);
+    if (!section || sectionViewportWidth == 0 || sectionViewportHeight == 0) {
+      return;
+    }
+    HalPowerManager::Lock powerLock(HalPowerManager::Indexing);
+    // Builds share the epub's CSS parser state: finish the current chapter's and drop a pre-index one
+    preindexSection.reset();
+    preindexDoneForSpine = -1;
+    if (section->isBuilding()) {
+      GUI.drawPopup(renderer, tr(STR_INDEXING));
+      if (section->continueSectionBuild() != Section::BuildStatus::Done) {
+        LOG_ERR("ERS", "Build of section %d failed", currentSpineIndex);
+        nextPageNumber = section->currentPage;
+        section.reset();
+        return;
+      }
+      recordPageCount(*section);
+    }
+
+    getSearchIndex();
+    if (!searchIndexBuilt) {
+      const Rect popup = GUI.drawPopup(renderer, tr(STR_INDEXING));
+      const int steps = epub->getSpineItemsCount() + 1;
+      int shownProgress = 0;
+      auto status = BookSearchIndex::BuildStatus::InProgress;
+      while (status == BookSearchIndex::BuildStatus::InProgress) {
+        if (gpio.pollForInput()) {
+          LOG_DBG("ERS", "Search index build interrupted");
+          return;
+        }
+        status = continueSearchIndexBuild(0, true);
+        const int progress = searchIndex->nextBuildSpine() * 100 / steps;
+        if (progress > shownProgress) {
+          GUI.fillPopupProgress(renderer, popup, progress);
+          shownProgress = progress;
+        }
+      }
+      if (status != BookSearchIndex::BuildStatus::Done) {
+        return;
+      }
+    }
+
+    GUI.drawPopup(renderer, tr(STR_SEARCHING));
+    std::vector<BookSearchIndex::Hit> hits;
+    searchIndex->search(searchQuery, maxSearchHits, hits);
+    std::vector<std::string> terms;
+    BookSearchIndex::splitTerms(searchQuery, terms);
+    std::unique_ptr<Section> hitSection;
+    for (const auto& hit : hits) {
+      if (results.size() >= maxSearchResults) {
+        break;
+      }
+      Section* source = section.get();
+      if (hit.spineIndex != currentSpineIndex) {
+        if (!hitSection || hitSection->getSpineIndex() != hit.spineIndex) {
+          hitSection.reset(new Section(epub, hit.spineIndex, renderer));
+          if (!hitSection->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                           SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment,
+                                           sectionViewportWidth, sectionViewportHeight, SETTINGS.hyphenationEnabled,
+                                           SETTINGS.embeddedStyle)) {
+            hitSection.reset();
+            continue;
+          }
+        }
+        source = hitSection.get();
+      }
+      const auto page = source->peekPage(hit.page);
+      std::string snippet;
+      if (page && BookSearchIndex::findOnPage(*page, terms, snippet)) {
+        results.push_back({hit.spineIndex, hit.page, searchResultLocation(hit.spineIndex, hit.page),
+                           std::move(snippet)});
+      }
+    }
+  }
+
+  startActivityForResult(std::make_unique<EpubReaderSearchResultsActivity>(renderer, mappedInput, searchQuery,
+                                                                           std::move(results)),
+                         [this](const ActivityResult& result) {
+                           if (!result.isCancelled) {
+                             const auto& found = std::get<SearchResult>(result.data);
+                             RenderLock lock(*this);
+                             goToPage(found.spineIndex, found.page);
+                           }
+                         });
+}
+
+// Lay out the rest of a chapter that was opened before its build finished, one slice per loop() iteration so page
+// turns stay responsive. The page count in the status bar becomes known on the next render after this completes.
+void EpubReaderActivity::continueProgressiveBuild() {
+  // Don't delay a render (or display refresh) that is already in flight
+  if (RenderLock::peek()) {
+    return;
+  }
+
+  RenderLock lock(*this);
+  if (!section || !section->isBuilding()) {
+    return;
+  }
+  HalPowerManager::Lock powerLock(HalPowerManager::Indexing);
+
+  const auto status = section->continueSectionBuild(preindexSliceMs);
+  if (status == Section::BuildStatus::Done) {
+    LOG_DBG("ERS", "Finished progressive build of section %d (%d pages)", currentSpineIndex, section->pageCount);
+    recordPageCount(*section);
+  } else if (status == Section::BuildStatus::Failed) {
+    LOG_ERR("ERS", "Progressive build of section %d failed", currentSpineIndex);
+    nextPageNumber = section->currentPage;
+    section.reset();
+  }
+}
+
 // TODO: Failure handling
 void EpubReaderActivity::render(RenderLock&& lock) {
   if (!epub) {
     return;
   }
+  applyPendingPageTurns();
 
   // edge case handling for sub-zero spine index
   if (currentSpineIndex < 0) {
@@ -541,50 +1210,67 @@ void EpubReaderActivity::render(RenderLock&& lock) {
     return;
   }
 
-  // Apply screen viewable areas and additional padding
   int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
-  renderer.getOrientedViewableTRBL(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom,
-                                   &orientedMarginLeft);
-  orientedMarginTop += SETTINGS.screenMargin;
-  orientedMarginLeft += SETTINGS.screenMargin;
-  orientedMarginRight += SETTINGS.screenMargin;
-
-  const uint8_t statusBarHeight = UITheme::getInstance().getStatusBarHeight();
-
-  // reserves space for automatic page turn indicator when no status bar or progress bar only
-  if (automaticPageTurnActive &&
-      (statusBarHeight == 0 || statusBarHeight == UITheme::getInstance().getProgressBarHeight())) {
-    orientedMarginBottom +=
-        std::max(SETTINGS.screenMargin,
-                 static_cast<uint8_t>(statusBarHeight + UITheme::getInstance().getMetrics().statusBarVerticalMargin));
-  } else {
-    orientedMarginBottom += std::max(SETTINGS.screenMargin, statusBarHeight);
-  }
+  getContentMargins(renderer, automaticPageTurnActive, &orientedMarginTop, &orientedMarginRight,
+                    &orientedMarginBottom, &orientedMarginLeft);
 
   if (!section) {
     const auto filepath = epub->getSpineItem(currentSpineIndex).href;
     LOG_DBG("ERS", "Loading file: %s, index: %d", filepath.c_str(), currentSpineIndex);
-    section = std::unique_ptr<Section>(new Section(epub, currentSpineIndex, renderer));
 
     const uint16_t viewportWidth = renderer.getScreenWidth() - orientedMarginLeft - orientedMarginRight;
     const uint16_t viewportHeight = renderer.getScreenHeight() - orientedMarginTop - orientedMarginBottom;
 
-    if (!section->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
-                                  SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
-                                  viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle)) {
-      LOG_DBG("ERS", "Cache not found, building...");
+    // A pre-index build of exactly this section can be finished in the foreground. Any other one must go: builds
+    // share the epub's CSS parser state, and its target was picked relative to the previous position.
+    std::unique_ptr<Section> adoptedSection;
+    if (preindexSection && preindexSection->getSpineIndex() == currentSpineIndex &&
+        viewportWidth == sectionViewportWidth && viewportHeight == sectionViewportHeight) {
+      adoptedSection = std::move(preindexSection);
+    }
+    preindexSection.reset();
+    preindexDoneForSpine = -1;
+    sectionViewportWidth = viewportWidth;
+    sectionViewportHeight = viewportHeight;
+
+    if (adoptedSection) {
+      LOG_DBG("ERS", "Finishing pre-index build of section %d", currentSpineIndex);
+      section = std::move(adoptedSection);
+      GUI.drawPopup(renderer, tr(STR_INDEXING));
+    } else {
+      section = std::unique_ptr<Section>(new Section(epub, currentSpineIndex, renderer));
+
+      if (!section->loadSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                    SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                                    viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle)) {
+        LOG_DBG("ERS", "Cache not found, building...");
 
-      const auto popupFn = [this]() { GUI.drawPopup(renderer, tr(STR_INDEXING)); };
+        const auto popupFn = [this]() { GUI.drawPopup(renderer, tr(STR_INDEXING)); };
+
+        if (!section->beginSectionBuild(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
+                                        SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
+                                        viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle,
+                                        popupFn)) {
+          LOG_ERR("ERS", "Failed to persist page data to SD");
+          section.reset();
+          return;
+        }
+      } else {
+        LOG_DBG("ERS", "Cache found, skipping build...");
+      }
+    }
 
-      if (!section->createSectionFile(SETTINGS.getReaderFontId(), SETTINGS.getReaderLineCompression(),
-                                      SETTINGS.extraParagraphSpacing, SETTINGS.paragraphAlignment, viewportWidth,
-                                      viewportHeight, SETTINGS.hyphenationEnabled, SETTINGS.embeddedStyle, popupFn)) {
+    if (section->isBuilding()) {
+      // Show the target page as soon as it is laid out and finish the chapter from loop(), unless the target
+      // depends on the chapter's final page count (last page, percent jump or reflow to a relative position)
+      const bool progressive = nextPageNumber != UINT16_MAX && !pendingPercentJump && pendingAnchor.empty() &&
+                               pendingTextPosition == UINT32_MAX &&
+                               !(cachedChapterTotalPageCount > 0 && currentSpineIndex == cachedSpineIndex);
+      if (section->continueSectionBuild(0, progressive ? nextPageNumber + 1 : 0) == Section::BuildStatus::Failed) {
         LOG_ERR("ERS", "Failed to persist page data to SD");
         section.reset();
         return;
       }
-    } else {
-      LOG_DBG("ERS", "Cache found, skipping build...");
     }
 
     if (nextPageNumber == UINT16_MAX) {
@@ -592,6 +1278,21 @@ void EpubReaderActivity::render(RenderLock&& lock) {
     } else {
       section->currentPage = nextPageNumber;
     }
+    if (!pendingAnchor.empty()) {
+      if (pendingAnchorSpineIndex == currentSpineIndex) {
+        section->currentPage = std::max(0, section->findAnchorPage(pendingAnchor));
+      }
+      pendingAnchor.clear();
+    }
+    if (pendingTextPosition != UINT32_MAX) {
+      const int page = pendingTextPositionSpineIndex == currentSpineIndex
+                           ? section->findTextPositionPage(pendingTextPosition)
+                           : -1;
+      if (page >= 0) {
+        section->currentPage = page;
+      }
+      pendingTextPosition = UINT32_MAX;
+    }
 
     // handles changes in reader settings and reset to approximate position based on cached progress
     if (cachedChapterTotalPageCount > 0) {
@@ -613,6 +1314,8 @@ void EpubReaderActivity::render(RenderLock&& lock) {
       section->currentPage = newPage;
       pendingPercentJump = false;
     }
+
+    recordPageCount(*section);
   }
 
   renderer.clearScreen();
@@ -636,6 +1339,7 @@ void EpubReaderActivity::render(RenderLock&& lock) {
   }
 
   {
+    TRACE_SCOPE(PageTurn, section->currentPage);
     auto p = section->loadPageFromSectionFile();
     if (!p) {
       LOG_ERR("ERS", "Failed to load page from SD - clearing section cache");
@@ -649,13 +1353,23 @@ void EpubReaderActivity::render(RenderLock&& lock) {
 
     // Collect footnotes from the loaded page
     currentPageFootnotes = std::move(p->footnotes);
+    neighbourPagesPrefetched = false;
+    upcomingImagesPredecoded = false;
+    pageNotesScanned = currentPageFootnotes.empty();
 
     const auto start = millis();
-    renderContents(std::move(p), orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft);
+    const bool rendered =
+        renderContents(std::move(p), orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft);
+    renderer.trimFontCache();
+    if (!rendered) {
+      // The next render, already requested, shows the page turned to
+      LOG_DBG("ERS", "Left page after %dms for a page turn", millis() - start);
+      return;
+    }
     LOG_DBG("ERS", "Rendered page in %dms", millis() - start);
-    renderer.clearFontCache();
+    PerfStats::pageRendered(millis() - start);
   }
-  saveProgress(currentSpineIndex, section->currentPage, section->pageCount);
+  saveProgress(currentSpineIndex, section->currentPage, knownPageCount());
 
   if (pendingScreenshot) {
     pendingScreenshot = false;
@@ -663,31 +1377,89 @@ void EpubReaderActivity::render(RenderLock&& lock) {
   }
 }
 
+void EpubReaderActivity::queueSyncProgress() {
+  if (!epub || !section || !KOREADER_STORE.isAutoSync() || !KOREADER_STORE.hasCredentials()) {
+    return;
+  }
+  const std::string documentHash = KOREADER_STORE.getMatchMethod() == DocumentMatchMethod::FILENAME
+                                       ? KOReaderDocumentId::calculateFromFilename(epub->getPath())
+                                       : KOReaderDocumentId::calculate(epub->getPath(), epub->getCachePath());
+  const CrossPointPosition position = {currentSpineIndex, section->currentPage, knownPageCount(),
+                                       currentTextPosition()};
+  const KOReaderPosition koPos = ProgressMapper::toKOReader(epub, position);
+  KOSYNC_QUEUE.record(documentHash, koPos.xpath, koPos.percentage);
+}
+
 void EpubReaderActivity::saveProgress(int spineIndex, int currentPage, int pageCount) {
-  FsFile f;
-  if (Storage.openFileForWrite("ERS", epub->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[6];
-    data[0] = currentSpineIndex & 0xFF;
-    data[1] = (currentSpineIndex >> 8) & 0xFF;
-    data[2] = currentPage & 0xFF;
-    data[3] = (currentPage >> 8) & 0xFF;
-    data[4] = pageCount & 0xFF;
-    data[5] = (pageCount >> 8) & 0xFF;
-    f.write(data, 6);
-    f.close();
-    LOG_DBG("ERS", "Progress saved: Chapter %d, Page %d", spineIndex, currentPage);
-  } else {
-    LOG_ERR("ERS", "Could not save progress!");
+  uint8_t data[6];
+  data[0] = spineIndex & 0xFF;
+  data[1] = (spineIndex >> 8) & 0xFF;
+  data[2] = currentPage & 0xFF;
+  data[3] = (currentPage >> 8) & 0xFF;
+  data[4] = pageCount & 0xFF;
+  data[5] = (pageCount >> 8) & 0xFF;
+  // Written by the journal once the reader settles on a page, or when the book is closed
+  progressJournal.record(data, sizeof(data));
+}
+// Frame cache of the current section's layout, or nullptr when rendered pages aren't being cached
+PageFrameCache* EpubReaderActivity::getFrameCache() {
+  if (!SETTINGS.pageFrameCache || !section) {
+    frameCache.reset();
+    return nullptr;
+  }
+  const std::string layoutDir = section->getLayoutDir();
+  if (!frameCache || frameCache->getLayoutDir() != layoutDir) {
+    frameCache.reset(new PageFrameCache(layoutDir));
   }
+  return frameCache.get();
 }
-void EpubReaderActivity::renderContents(std::unique_ptr<Page> page, const int orientedMarginTop,
+
+bool EpubReaderActivity::renderContents(std::unique_ptr<Page> page, const int orientedMarginTop,
                                         const int orientedMarginRight, const int orientedMarginBottom,
                                         const int orientedMarginLeft) {
   // Force special handling for pages with images when anti-aliasing is on
   bool imagePageWithAA = page->hasImages() && SETTINGS.textAntiAliasing;
-
-  page->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+  // Such a page renders its images four times (BW, re-render after blanking, LSB, MSB): load them only once
+  page->setImagePixelRetention(imagePageWithAA);
+
+  // A previously rendered frame of this page replaces rendering its planes; otherwise the planes rendered now are
+  // stored for next time. The BW plane is packed before the status bar is drawn and written after it is displayed.
+  PageFrameCache* frames = getFrameCache();
+  const PageFrameCache::FrameKey frameKey = {static_cast<uint8_t>(renderer.getOrientation()),
+                                             static_cast<uint8_t>(SETTINGS.textAntiAliasing ? 1 : 0),
+                                             static_cast<int16_t>(orientedMarginLeft),
+                                             static_cast<int16_t>(orientedMarginTop)};
+  const bool cachedFrame = frames && frames->open(currentSpineIndex, section->currentPage, frameKey);
+  std::vector<uint8_t> packedPlane;
+  const auto drawPlane = [&](const uint8_t plane, const GfxRenderer::RenderMode mode, const uint8_t clearColor) {
+    if (cachedFrame) {
+      if (frames->readPlane(plane, renderer.getFrameBuffer())) {
+        return;
+      }
+      // Unreadable cached plane: render it after all, over a cleared buffer
+      renderer.clearScreen(clearColor);
+    }
+    renderer.setRenderMode(mode);
+    page->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+    renderer.setRenderMode(GfxRenderer::BW);
+  };
+
+  renderer.resetGrayPixelsDrawn();
+  drawPlane(0, GfxRenderer::BW, 0xFF);
+  // Only the page content goes through the grayscale passes; they aren't needed if it has no gray pixels
+  // (1-bit fonts, or a page whose glyphs happen to be all black)
+  const bool grayPassNeeded = SETTINGS.textAntiAliasing && (cachedFrame ? frames->getPlaneCount() == 3
+                                                                         : renderer.wereGrayPixelsDrawn());
+  const bool storeFrame = frames && !cachedFrame && PageFrameCache::packPlane(renderer.getFrameBuffer(), packedPlane);
   renderStatusBar();
+  if (renderSuperseded()) {
+    // Turned past while it was drawn: the panel keeps the previous page until the next render
+    if (cachedFrame) {
+      frames->close();
+    }
+    page->setImagePixelRetention(false);
+    return false;
+  }
   if (imagePageWithAA) {
     // Double FAST_REFRESH with selective image blanking (pablohc's technique):
     // HALF_REFRESH sets particles too firmly for the grayscale LUT to adjust.
@@ -700,53 +1472,112 @@ void EpubReaderActivity::renderContents(std::unique_ptr<Page> page, const int or
       renderer.displayBuffer(HalDisplay::FAST_REFRESH);
 
       // Re-render page content to restore images into the blanked area
-      page->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+      drawPlane(0, GfxRenderer::BW, 0xFF);
       renderStatusBar();
       renderer.displayBuffer(HalDisplay::FAST_REFRESH);
     } else {
       renderer.displayBuffer(HalDisplay::HALF_REFRESH);
     }
     // Double FAST_REFRESH handles ghosting for image pages; don't count toward full refresh cadence
-  } else if (pagesUntilFullRefresh <= 1) {
-    renderer.displayBuffer(HalDisplay::HALF_REFRESH);
-    pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
   } else {
-    renderer.displayBuffer();
-    pagesUntilFullRefresh--;
+    renderer.displayBuffer(RefreshUtils::nextPageRefreshMode(renderer, pagesUntilFullRefresh));
+  }
+
+  bool writingFrame = storeFrame && frames->beginFrame(currentSpineIndex, section->currentPage, frameKey) &&
+                      frames->writePlane(packedPlane);
+  packedPlane.clear();
+  packedPlane.shrink_to_fit();
+  // Adds the current frame buffer as the next plane of the frame being written
+  const auto storePlane = [&]() {
+    writingFrame = writingFrame && PageFrameCache::packPlane(renderer.getFrameBuffer(), packedPlane) &&
+                   frames->writePlane(packedPlane);
+    packedPlane.clear();
+    packedPlane.shrink_to_fit();
+  };
+
+  // A frame is only kept with all the planes this page needs
+  const auto completeFrame = [&]() {
+    if (cachedFrame) {
+      frames->close();
+    } else if (writingFrame) {
+      frames->finishFrame();
+    } else if (storeFrame) {
+      frames->abortFrame();
+    }
+  };
+
+  if (!grayPassNeeded) {
+    completeFrame();
+    page->setImagePixelRetention(false);
+    return true;
+  }
+  if (renderSuperseded()) {
+    // Turned past once shown in black and white: skip the gray passes, and the frame that would lack them
+    if (cachedFrame) {
+      frames->close();
+    } else if (storeFrame) {
+      frames->abortFrame();
+    }
+    page->setImagePixelRetention(false);
+    return false;
   }
 
   // Save bw buffer to reset buffer state after grayscale data sync
   renderer.storeBwBuffer();
 
   // grayscale rendering
-  // TODO: Only do this if font supports it
-  if (SETTINGS.textAntiAliasing) {
+  if (cachedFrame) {
+    drawPlane(1, GfxRenderer::GRAYSCALE_LSB, 0x00);
+    renderer.copyGrayscaleLsbBuffers();
+    drawPlane(2, GfxRenderer::GRAYSCALE_MSB, 0x00);
+    renderer.copyGrayscaleMsbBuffers();
+    renderer.displayGrayBuffer();
+  } else if (!page->hasImages() && renderer.beginGrayscaleBoth()) {
+    // Text-only page: one traversal fills both gray planes
+    page->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+    if (storeFrame) storePlane();
+    // Leaves the MSB plane in the frame buffer
+    renderer.copyGrayscaleBothBuffers();
+    if (storeFrame) storePlane();
+    renderer.displayGrayBuffer();
+  } else {
     renderer.clearScreen(0x00);
     renderer.setRenderMode(GfxRenderer::GRAYSCALE_LSB);
     page->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+    if (storeFrame) storePlane();
     renderer.copyGrayscaleLsbBuffers();
 
     // Render and copy to MSB buffer
     renderer.clearScreen(0x00);
     renderer.setRenderMode(GfxRenderer::GRAYSCALE_MSB);
     page->render(renderer, SETTINGS.getReaderFontId(), orientedMarginLeft, orientedMarginTop);
+    if (storeFrame) storePlane();
     renderer.copyGrayscaleMsbBuffers();
 
     // display grayscale part
     renderer.displayGrayBuffer();
     renderer.setRenderMode(GfxRenderer::BW);
   }
+  completeFrame();
+
+  page->setImagePixelRetention(false);
 
   // restore the bw data
   renderer.restoreBwBuffer();
+  return true;
 }
 
 void EpubReaderActivity::renderStatusBar() const {
   // Calculate progress in book
   const int currentPage = section->currentPage + 1;
-  const float pageCount = section->pageCount;
+  const float pageCount = knownPageCount();
   const float sectionChapterProg = (pageCount > 0) ? (static_cast<float>(currentPage) / pageCount) : 0;
-  const float bookProgress = epub->calculateProgress(currentSpineIndex, sectionChapterProg) * 100;
+  float bookProgress = epub->calculateProgress(currentSpineIndex, sectionChapterProg) * 100;
+  // Exact position once every chapter of this layout has been paginated, rather than the byte-size estimate
+  int bookPage, bookPageCount;
+  if (getBookPagePosition(bookPage, bookPageCount)) {
+    bookProgress = static_cast<float>(bookPage) * 100.0f / static_cast<float>(bookPageCount);
+  }
 
   std::string title;
 
@@ -764,12 +1595,22 @@ void EpubReaderActivity::renderStatusBar() const {
     }
 
   } else if (SETTINGS.statusBarTitle == CrossPointSettings::STATUS_BAR_TITLE::CHAPTER_TITLE) {
-    title = tr(STR_UNNAMED);
-    const int tocIndex = epub->getTocIndexForSpineIndex(currentSpineIndex);
-    if (tocIndex != -1) {
-      const auto tocItem = epub->getTocItem(tocIndex);
-      title = tocItem.title;
+    if (statusBarTitleSpineIndex != currentSpineIndex || statusBarTitleScreenWidth != renderer.getScreenWidth()) {
+      statusBarChapterTitle = tr(STR_UNNAMED);
+      const int tocIndex = epub->getTocIndexForSpineIndex(currentSpineIndex);
+      if (tocIndex != -1) {
+        statusBarChapterTitle = epub->getTocItem(tocIndex).title;
+      }
+      // Widest the theme can give the title; it still fits it around the progress text of each page
+      const int maxTitleWidth =
+          renderer.getScreenWidth() - UITheme::getInstance().getMetrics().statusBarHorizontalMargin * 2 - 60;
+      if (renderer.getTextWidth(SMALL_FONT_ID, statusBarChapterTitle.c_str()) > maxTitleWidth) {
+        statusBarChapterTitle = renderer.truncatedText(SMALL_FONT_ID, statusBarChapterTitle.c_str(), maxTitleWidth);
+      }
+      statusBarTitleSpineIndex = currentSpineIndex;
+      statusBarTitleScreenWidth = renderer.getScreenWidth();
     }
+    title = statusBarChapterTitle;
 
   } else if (SETTINGS.statusBarTitle == CrossPointSettings::STATUS_BAR_TITLE::BOOK_TITLE) {
     title = epub->getTitle();
@@ -790,10 +1631,11 @@ void EpubReaderActivity::navigateToHref(const std::string& hrefStr, const bool s
 
   // Check for same-file anchor reference (#anchor only)
   bool sameFile = !hrefStr.empty() && hrefStr[0] == '#';
+  const size_t hashPos = hrefStr.find('#');
+  const std::string anchor = hashPos != std::string::npos ? hrefStr.substr(hashPos + 1) : "";
 
   int targetSpineIndex;
   if (sameFile) {
-    // Same file — navigate to page 0 of current spine item
     targetSpineIndex = currentSpineIndex;
   } else {
     targetSpineIndex = epub->resolveHrefToSpineIndex(hrefStr);
@@ -807,14 +1649,47 @@ void EpubReaderActivity::navigateToHref(const std::string& hrefStr, const bool s
 
   {
     RenderLock lock(*this);
-    currentSpineIndex = targetSpineIndex;
-    nextPageNumber = 0;
-    section.reset();
+    goToAnchor(targetSpineIndex, anchor);
   }
   requestUpdate();
   LOG_DBG("ERS", "Navigated to spine %d for href: %s", targetSpineIndex, hrefStr.c_str());
 }
 
+void EpubReaderActivity::goToAnchor(const int spineIndex, const std::string& anchor) {
+  // Within the open chapter this is a lookup in its section file, without loading the chapter again
+  if (section && !section->isBuilding() && spineIndex == currentSpineIndex) {
+    section->currentPage = std::max(0, section->findAnchorPage(anchor));
+    pendingAnchor.clear();
+    return;
+  }
+  currentSpineIndex = spineIndex;
+  nextPageNumber = 0;
+  pendingAnchor = anchor;
+  pendingAnchorSpineIndex = spineIndex;
+  section.reset();
+}
+
+void EpubReaderActivity::goToTextPosition(const int spineIndex, const uint32_t textPosition, const int page) {
+  if (section && !section->isBuilding() && spineIndex == currentSpineIndex) {
+    const int found = section->findTextPositionPage(textPosition);
+    section->currentPage = found >= 0 ? found : std::max(0, std::min<int>(page, section->pageCount - 1));
+    return;
+  }
+  currentSpineIndex = spineIndex;
+  nextPageNumber = page;
+  pendingTextPosition = textPosition;
+  pendingTextPositionSpineIndex = spineIndex;
+  section.reset();
+}
+
+uint32_t EpubReaderActivity::currentTextPosition() const {
+  uint32_t position = 0;
+  if (!section || !section->getPageTextPosition(section->currentPage, position)) {
+    return CrossPointPosition::NO_TEXT_POSITION;
+  }
+  return position;
+}
+
 void EpubReaderActivity::restoreSavedPosition() {
   if (footnoteDepth <= 0) return;
   footnoteDepth--;
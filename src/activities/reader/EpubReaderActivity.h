@@ -1,9 +1,16 @@
 #pragma once
 #include <Epub.h>
+#include <Epub/BookNotes.h>
+#include <Epub/BookPageIndex.h>
+#include <Epub/BookSearchIndex.h>
 #include <Epub/FootnoteEntry.h>
+#include <Epub/PageFrameCache.h>
 #include <Epub/Section.h>
 
+#include <atomic>
+
 #include "EpubReaderMenuActivity.h"
+#include "ProgressJournal.h"
 #include "activities/Activity.h"
 
 class EpubReaderActivity final : public Activity {
@@ -14,6 +21,7 @@ class EpubReaderActivity final : public Activity {
   int pagesUntilFullRefresh = 0;
   int cachedSpineIndex = 0;
   int cachedChapterTotalPageCount = 0;
+  ProgressJournal progressJournal;
   unsigned long lastPageTurnTime = 0UL;
   unsigned long pageTurnDuration = 0UL;
   // Signals that the next render should reposition within the newly loaded section
@@ -21,12 +29,52 @@ class EpubReaderActivity final : public Activity {
   bool pendingPercentJump = false;
   // Normalized 0.0-1.0 progress within the target spine item, computed from book percentage.
   float pendingSpineProgress = 0.0f;
+  // Id in spine item pendingAnchorSpineIndex to open at once it's loaded, from a link or TOC entry
+  std::string pendingAnchor;
+  int pendingAnchorSpineIndex = -1;
+  // Text position in spine item pendingTextPositionSpineIndex to open at once it's loaded, from a synced position;
+  // UINT32_MAX for none
+  uint32_t pendingTextPosition = UINT32_MAX;
+  int pendingTextPositionSpineIndex = -1;
   bool pendingScreenshot = false;
   bool skipNextButtonCheck = false;  // Skip button processing for one frame after subactivity exit
   bool automaticPageTurnActive = false;
+  // Page turns made while a render was running, folded into one count. The render task applies them before its next
+  // render; the render they interrupt drops its page at the next stage rather than refresh and gray it.
+  std::atomic<int> pendingPageTurns{0};
+
+  // Idle-time pre-indexing of the neighbouring spine items, built a slice at a time from loop()
+  std::unique_ptr<Section> preindexSection = nullptr;
+  int preindexDoneForSpine = -1;  // Spine index whose neighbours are known to be indexed (or failed)
+  bool neighbourPagesPrefetched = false;
+  bool upcomingImagesPredecoded = false;
+  uint16_t sectionViewportWidth = 0;
+  uint16_t sectionViewportHeight = 0;
+  // Page counts of every chapter in the current layout; filled in as sections are indexed
+  std::unique_ptr<BookPageIndex> pageIndex = nullptr;
+  bool wholeBookIndexFailed = false;  // Stop the whole-book job after a chapter fails to build
+  // Full-text search of the current layout, built once the whole book is laid out (or for the first search), and the
+  // chapter it's reading pages from
+  std::unique_ptr<BookSearchIndex> searchIndex = nullptr;
+  std::unique_ptr<Section> searchSection = nullptr;
+  bool searchIndexBuilt = false;
+  bool searchIndexFailed = false;  // Stop building it while idle after a failure; a search tries again
+  std::string searchQuery;
+  // Rendered pages of the current layout on the SD card, while the setting is on
+  std::unique_ptr<PageFrameCache> frameCache = nullptr;
+
+  // Chapter title of the status bar, looked up in the TOC and truncated to the bar width once per spine item and
+  // screen width (orientation), instead of on every page render
+  mutable std::string statusBarChapterTitle;
+  mutable int statusBarTitleSpineIndex = -1;
+  mutable int statusBarTitleScreenWidth = 0;
 
   // Footnote support
   std::vector<FootnoteEntry> currentPageFootnotes;
+  // Text of the notes footnotes lead to, found ahead of time for the footnote list to show in place
+  std::unique_ptr<BookNotes> bookNotes = nullptr;
+  std::vector<std::string> footnotePreviews;
+  bool pageNotesScanned = false;
   struct SavedPosition {
     int spineIndex;
     int pageNumber;
@@ -35,27 +83,73 @@ class EpubReaderActivity final : public Activity {
   SavedPosition savedPositions[MAX_FOOTNOTE_DEPTH] = {};
   int footnoteDepth = 0;
 
-  void renderContents(std::unique_ptr<Page> page, int orientedMarginTop, int orientedMarginRight,
+  // False if a page turn came in and the page was left before it was fully on the panel
+  bool renderContents(std::unique_ptr<Page> page, int orientedMarginTop, int orientedMarginRight,
                       int orientedMarginBottom, int orientedMarginLeft);
   void renderStatusBar() const;
+  PageFrameCache* getFrameCache();
   void saveProgress(int spineIndex, int currentPage, int pageCount);
+  // With KOReader auto sync on, queues the position to be sent the next time WiFi is up
+  void queueSyncProgress();
   // Jump to a percentage of the book (0-100), mapping it to spine and page.
   void jumpToPercent(int percent);
+  // Jump to a page (0-based) of the whole book; only once getBookPagePosition() knows the book's pages
+  void jumpToBookPage(uint32_t bookPage);
   void onReaderMenuConfirm(EpubReaderMenuActivity::MenuAction action);
   void applyOrientation(uint8_t orientation);
   void toggleAutoPageTurn(uint8_t selectedPageTurnOption);
   void pageTurn(bool isForwardTurn);
+  // Moves the position one page; needs the render lock
+  void turnPage(bool isForwardTurn);
+  void applyPendingPageTurns();
+  bool renderSuperseded() const { return pendingPageTurns.load() != 0; }
+  void prefetchNeighbourPages();
+  void predecodeUpcomingImages();
+  void preindexNeighbourSection();
+  void continueProgressiveBuild();
+  void recordPageCount(const Section& indexed);
+  bool getBookPagePosition(int& bookPage, int& bookPageCount) const;
+  // Moves to a page of a spine item; needs the render lock
+  void goToPage(int spineIndex, int page);
+  BookSearchIndex& getSearchIndex();
+  BookSearchIndex::BuildStatus continueSearchIndexBuild(uint32_t timeBudgetMs, bool layOut);
+  void buildSearchIndex();
+  std::string searchResultLocation(int spineIndex, int page) const;
+  void searchBook();
+  // Chapter page count, or 0 while the current section is still being laid out and the total isn't known yet
+  int knownPageCount() const { return section && !section->isBuilding() ? section->pageCount : 0; }
 
   // Footnote navigation
   void navigateToHref(const std::string& href, bool savePosition = false);
+  BookNotes& getBookNotes();
+  // Spine item and id a footnote's href leads to, -1 for the spine item if it's outside the book
+  int resolveNote(const char* href, std::string& id) const;
+  // Scans the chapters the current page's footnotes lead to for their text while the reader is idle, so the footnote
+  // list can show them
+  void scanPageNotes();
+  // Moves to the page of an id (or the start for none) in a spine item; needs the render lock
+  void goToAnchor(int spineIndex, const std::string& anchor);
+  // Moves to the page holding a text position in a spine item, or to page where that isn't known; needs the render lock
+  void goToTextPosition(int spineIndex, uint32_t textPosition, int page);
+  // Text position the current page starts at, CrossPointPosition::NO_TEXT_POSITION if not known
+  uint32_t currentTextPosition() const;
   void restoreSavedPosition();
 
  public:
-  explicit EpubReaderActivity(GfxRenderer& renderer, MappedInputManager& mappedInput, std::unique_ptr<Epub> epub)
+  explicit EpubReaderActivity(GfxRenderer& renderer, MappedInputManager& mappedInput, std::shared_ptr<Epub> epub)
       : Activity("EpubReader", renderer, mappedInput), epub(std::move(epub)) {}
   void onEnter() override;
   void onExit() override;
   void loop() override;
   void render(RenderLock&& lock) override;
   bool isReaderActivity() const override { return true; }
+  unsigned long msUntilLoopDeadline() override;
+
+  // Margins around the text in the renderer's current orientation, as pages are laid out and drawn
+  static void getContentMargins(const GfxRenderer& renderer, bool automaticPageTurn, int* top, int* right, int* bottom,
+                                int* left);
+  // Where and for which viewport a book opened for the first time is laid out, so that section can be indexed ahead
+  // of time. The viewport is that of the reader orientation; the renderer's orientation is left as it was.
+  static void getOpeningViewport(GfxRenderer& renderer, uint16_t* width, uint16_t* height);
+  static int getOpeningSpineIndex(const Epub& epub);
 };
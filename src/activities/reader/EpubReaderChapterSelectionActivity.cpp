@@ -3,11 +3,79 @@
 #include <GfxRenderer.h>
 #include <I18n.h>
 
+#include <algorithm>
+
 #include "MappedInputManager.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
 
-int EpubReaderChapterSelectionActivity::getTotalItems() const { return epub->getTocItemsCount(); }
+namespace {
+// TOCs with more entries than this start collapsed to their top level
+constexpr int largeTocThreshold = 200;
+}  // namespace
+
+int EpubReaderChapterSelectionActivity::getTotalItems() const {
+  return collapsible ? static_cast<int>(visibleEntries.size()) : epub->getTocItemsCount();
+}
+
+bool EpubReaderChapterSelectionActivity::hasChildren(const int row) const {
+  const int tocIndex = tocIndexAt(row);
+  return epub->getTocSubtreeEnd(tocIndex) > tocIndex + 1;
+}
+
+bool EpubReaderChapterSelectionActivity::isExpanded(const int row) const {
+  return row + 1 < getTotalItems() && tocIndexAt(row + 1) < epub->getTocSubtreeEnd(tocIndexAt(row));
+}
+
+void EpubReaderChapterSelectionActivity::expand(const int row) {
+  const int tocIndex = tocIndexAt(row);
+  const int end = epub->getTocSubtreeEnd(tocIndex);
+  std::vector<uint16_t> children;
+  for (int child = tocIndex + 1; child < end; child = std::max(child + 1, epub->getTocSubtreeEnd(child))) {
+    children.push_back(static_cast<uint16_t>(child));
+  }
+  visibleEntries.insert(visibleEntries.begin() + row + 1, children.begin(), children.end());
+  pageRowsStart = -1;
+}
+
+void EpubReaderChapterSelectionActivity::collapse(const int row) {
+  const int end = epub->getTocSubtreeEnd(tocIndexAt(row));
+  const auto first = visibleEntries.begin() + row + 1;
+  visibleEntries.erase(first, std::find_if(first, visibleEntries.end(),
+                                           [end](const uint16_t tocIndex) { return tocIndex >= end; }));
+  pageRowsStart = -1;
+}
+
+int EpubReaderChapterSelectionActivity::parentRow(const int row) const {
+  const int tocIndex = tocIndexAt(row);
+  for (int candidate = row - 1; candidate >= 0; candidate--) {
+    if (epub->getTocSubtreeEnd(tocIndexAt(candidate)) > tocIndex) {
+      return candidate;
+    }
+  }
+  return -1;
+}
+
+void EpubReaderChapterSelectionActivity::showTopLevel(const int currentTocIndex) {
+  const int tocCount = epub->getTocItemsCount();
+  visibleEntries.clear();
+  for (int tocIndex = 0; tocIndex < tocCount; tocIndex = std::max(tocIndex + 1, epub->getTocSubtreeEnd(tocIndex))) {
+    visibleEntries.push_back(static_cast<uint16_t>(tocIndex));
+  }
+
+  // Opens the subtrees down to the current chapter, each inserted right after the row being looked at
+  selectorIndex = 0;
+  for (int row = 0; row < static_cast<int>(visibleEntries.size()) && currentTocIndex >= 0; row++) {
+    const int tocIndex = visibleEntries[row];
+    if (tocIndex == currentTocIndex) {
+      selectorIndex = row;
+      break;
+    }
+    if (tocIndex < currentTocIndex && currentTocIndex < epub->getTocSubtreeEnd(tocIndex)) {
+      expand(row);
+    }
+  }
+}
 
 int EpubReaderChapterSelectionActivity::getPageItems() const {
   // Layout constants used in renderScreen
@@ -32,9 +100,14 @@ void EpubReaderChapterSelectionActivity::onEnter() {
     return;
   }
 
-  selectorIndex = epub->getTocIndexForSpineIndex(currentSpineIndex);
-  if (selectorIndex == -1) {
-    selectorIndex = 0;
+  collapsible = epub->getTocItemsCount() > largeTocThreshold;
+  if (collapsible) {
+    showTopLevel(epub->getTocIndexForSpineIndex(currentSpineIndex));
+  } else {
+    selectorIndex = epub->getTocIndexForSpineIndex(currentSpineIndex);
+    if (selectorIndex == -1) {
+      selectorIndex = 0;
+    }
   }
 
   // Trigger first update
@@ -47,15 +120,33 @@ void EpubReaderChapterSelectionActivity::loop() {
   const int pageItems = getPageItems();
   const int totalItems = getTotalItems();
 
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm) && collapsible && totalItems > 0 &&
+      hasChildren(selectorIndex) && !isExpanded(selectorIndex)) {
+    expand(selectorIndex);
+    requestUpdate();
+    return;
+  }
+  if (mappedInput.wasReleased(MappedInputManager::Button::Back) && collapsible && totalItems > 0) {
+    // Going back closes the subtree of the selected entry before leaving the list
+    const int parent = parentRow(selectorIndex);
+    if (parent >= 0) {
+      collapse(parent);
+      selectorIndex = parent;
+      requestUpdate();
+      return;
+    }
+  }
+
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-    const auto newSpineIndex = epub->getSpineIndexForTocIndex(selectorIndex);
+    const int tocIndex = tocIndexAt(selectorIndex);
+    const auto newSpineIndex = epub->getSpineIndexForTocIndex(tocIndex);
     if (newSpineIndex == -1) {
       ActivityResult result;
       result.isCancelled = true;
       setResult(std::move(result));
       finish();
     } else {
-      setResult(ChapterResult{newSpineIndex});
+      setResult(ChapterResult{newSpineIndex, epub->getTocItem(tocIndex).anchor});
       finish();
     }
   } else if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
@@ -86,6 +177,40 @@ void EpubReaderChapterSelectionActivity::loop() {
   });
 }
 
+void EpubReaderChapterSelectionActivity::loadPageRows(const int pageStartIndex, const int pageItems, const int contentX,
+                                                      const int contentWidth) {
+  pageRows.clear();
+  pageRowsStart = pageStartIndex;
+  pageRowsCount = pageItems;
+  pageRowsWidth = contentWidth;
+
+  // Titles are read a run of consecutive TOC entries at a time, the whole page at once unless subtrees are collapsed
+  const int pageEnd = std::min(pageStartIndex + pageItems, getTotalItems());
+  std::vector<BookMetadataCache::TocTitle> titles;
+  for (int row = pageStartIndex; row < pageEnd;) {
+    const int first = tocIndexAt(row);
+    int count = 1;
+    while (row + count < pageEnd && tocIndexAt(row + count) == first + count) {
+      count++;
+    }
+    epub->getTocTitles(first, count, titles);
+    for (const auto& item : titles) {
+      // Indent per TOC level while keeping content within the gutter-safe region.
+      const int indentSize = contentX + 20 + (item.level - 1) * 15;
+      std::string title = item.title;
+      if (collapsible && hasChildren(row)) {
+        title.insert(0, isExpanded(row) ? "- " : "+ ");
+      }
+      pageRows.push_back(
+          {renderer.truncatedText(UI_10_FONT_ID, title.c_str(), contentWidth - 40 - indentSize), indentSize});
+      row++;
+    }
+    if (titles.size() < static_cast<size_t>(count)) {
+      break;
+    }
+  }
+}
+
 void EpubReaderChapterSelectionActivity::render(RenderLock&&) {
   renderer.clearScreen();
 
@@ -103,7 +228,6 @@ void EpubReaderChapterSelectionActivity::render(RenderLock&&) {
   const int hintGutterHeight = isPortraitInverted ? 50 : 0;
   const int contentY = hintGutterHeight;
   const int pageItems = getPageItems();
-  const int totalItems = getTotalItems();
 
   // Manual centering to honor content gutters.
   const int titleX =
@@ -114,20 +238,13 @@ void EpubReaderChapterSelectionActivity::render(RenderLock&&) {
   // Highlight only the content area, not the hint gutters.
   renderer.fillRect(contentX, 60 + contentY + (selectorIndex % pageItems) * 30 - 2, contentWidth - 1, 30);
 
-  for (int i = 0; i < pageItems; i++) {
-    int itemIndex = pageStartIndex + i;
-    if (itemIndex >= totalItems) break;
+  if (pageStartIndex != pageRowsStart || pageItems != pageRowsCount || contentWidth != pageRowsWidth) {
+    loadPageRows(pageStartIndex, pageItems, contentX, contentWidth);
+  }
+  for (int i = 0; i < static_cast<int>(pageRows.size()); i++) {
     const int displayY = 60 + contentY + i * 30;
-    const bool isSelected = (itemIndex == selectorIndex);
-
-    auto item = epub->getTocItem(itemIndex);
-
-    // Indent per TOC level while keeping content within the gutter-safe region.
-    const int indentSize = contentX + 20 + (item.level - 1) * 15;
-    const std::string chapterName =
-        renderer.truncatedText(UI_10_FONT_ID, item.title.c_str(), contentWidth - 40 - indentSize);
-
-    renderer.drawText(UI_10_FONT_ID, indentSize, displayY, chapterName.c_str(), !isSelected);
+    const bool isSelected = (pageStartIndex + i == selectorIndex);
+    renderer.drawText(UI_10_FONT_ID, pageRows[i].indent, displayY, pageRows[i].title.c_str(), !isSelected);
   }
 
   const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), tr(STR_DIR_UP), tr(STR_DIR_DOWN));
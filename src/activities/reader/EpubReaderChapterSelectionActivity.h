@@ -2,6 +2,8 @@
 #include <Epub.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "../Activity.h"
 #include "util/ButtonNavigator.h"
@@ -13,6 +15,33 @@ class EpubReaderChapterSelectionActivity final : public Activity {
   int currentSpineIndex = 0;
   int selectorIndex = 0;
 
+  // Large TOCs are listed as a tree, top-level entries first with subtrees expanded on demand, and visibleEntries
+  // holds the TOC index of each row; smaller ones list every entry, a row's index being its TOC index
+  bool collapsible = false;
+  std::vector<uint16_t> visibleEntries;
+
+  // The rows of the list page on screen, read together and truncated to the row width once, so moving the selection
+  // within the page reads nothing and a book's TOC length doesn't matter
+  struct Row {
+    std::string title;
+    int indent;
+  };
+  std::vector<Row> pageRows;
+  int pageRowsStart = -1;
+  int pageRowsCount = 0;
+  int pageRowsWidth = 0;
+
+  void loadPageRows(int pageStartIndex, int pageItems, int contentX, int contentWidth);
+
+  int tocIndexAt(int row) const { return collapsible ? visibleEntries[row] : row; }
+  bool hasChildren(int row) const;
+  bool isExpanded(int row) const;
+  void expand(int row);
+  void collapse(int row);
+  // Row of the entry the one at row is nested under, -1 for a top-level one
+  int parentRow(int row) const;
+  void showTopLevel(int currentTocIndex);
+
   // Number of items that fit on a page, derived from logical screen height.
   // This adapts automatically when switching between portrait and landscape.
   int getPageItems() const;
@@ -66,8 +66,21 @@ void EpubReaderFootnotesActivity::render(RenderLock&&) {
   constexpr int lineHeight = 36;
   const int screenWidth = renderer.getScreenWidth();
   constexpr int marginLeft = 20;
+  constexpr int maxPreviewLines = 8;
 
-  const int visibleCount = std::max(1, (renderer.getScreenHeight() - startY) / lineHeight);
+  // The selected note's text goes under the list, so it can be read without going to it
+  std::vector<std::string> previewLines;
+  if (selectedIndex < static_cast<int>(previews.size()) && !previews[selectedIndex].empty()) {
+    previewLines = renderer.wrappedText(UI_10_FONT_ID, previews[selectedIndex].c_str(), screenWidth - 2 * marginLeft,
+                                        maxPreviewLines);
+  }
+  const int previewLineHeight = renderer.getLineHeight(UI_10_FONT_ID);
+  const int previewBottom = renderer.getScreenHeight() - UITheme::getInstance().getMetrics().buttonHintsHeight;
+  const int previewHeight = static_cast<int>(previewLines.size()) * previewLineHeight;
+  const int listBottom =
+      previewLines.empty() ? renderer.getScreenHeight() : previewBottom - previewHeight - 2 * marginLeft;
+
+  const int visibleCount = std::max(1, (listBottom - startY) / lineHeight);
   if (selectedIndex < scrollOffset) scrollOffset = selectedIndex;
   if (selectedIndex >= scrollOffset + visibleCount) scrollOffset = selectedIndex - visibleCount + 1;
 
@@ -87,6 +100,16 @@ void EpubReaderFootnotesActivity::render(RenderLock&&) {
     renderer.drawText(UI_10_FONT_ID, marginLeft, y + 4, label.c_str(), !isSelected);
   }
 
+  if (!previewLines.empty()) {
+    int y = listBottom + marginLeft / 2;
+    renderer.drawLine(marginLeft, y, screenWidth - marginLeft, y);
+    y += marginLeft / 2 + marginLeft / 4;
+    for (const auto& line : previewLines) {
+      renderer.drawText(UI_10_FONT_ID, marginLeft, y, line.c_str());
+      y += previewLineHeight;
+    }
+  }
+
   const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), "", "");
   GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
 
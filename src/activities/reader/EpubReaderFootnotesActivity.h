@@ -4,6 +4,7 @@
 
 #include <cstring>
 #include <functional>
+#include <string>
 #include <vector>
 
 #include "../Activity.h"
@@ -11,9 +12,11 @@
 
 class EpubReaderFootnotesActivity final : public Activity {
  public:
+  // previews holds the text of each footnote, empty where it isn't known
   explicit EpubReaderFootnotesActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
-                                       const std::vector<FootnoteEntry>& footnotes)
-      : Activity("EpubReaderFootnotes", renderer, mappedInput), footnotes(footnotes) {}
+                                       const std::vector<FootnoteEntry>& footnotes,
+                                       const std::vector<std::string>& previews)
+      : Activity("EpubReaderFootnotes", renderer, mappedInput), footnotes(footnotes), previews(previews) {}
 
   void onEnter() override;
   void onExit() override;
@@ -22,6 +25,7 @@ class EpubReaderFootnotesActivity final : public Activity {
 
  private:
   const std::vector<FootnoteEntry>& footnotes;
+  const std::vector<std::string>& previews;
   int selectedIndex = 0;
   int scrollOffset = 0;
   ButtonNavigator buttonNavigator;
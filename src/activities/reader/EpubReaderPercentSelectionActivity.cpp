@@ -8,9 +8,8 @@
 #include "fontIds.h"
 
 namespace {
-// Fine/coarse slider step sizes for percent adjustments.
+// Fine slider step size, the coarse one is 10% or 1% of the book's pages
 constexpr int kSmallStep = 1;
-constexpr int kLargeStep = 10;
 }  // namespace
 
 void EpubReaderPercentSelectionActivity::onEnter() {
@@ -21,14 +20,9 @@ void EpubReaderPercentSelectionActivity::onEnter() {
 
 void EpubReaderPercentSelectionActivity::onExit() { Activity::onExit(); }
 
-void EpubReaderPercentSelectionActivity::adjustPercent(const int delta) {
-  // Apply delta and clamp within 0-100.
-  percent += delta;
-  if (percent < 0) {
-    percent = 0;
-  } else if (percent > 100) {
-    percent = 100;
-  }
+void EpubReaderPercentSelectionActivity::adjustValue(const int delta) {
+  // Apply delta and clamp within bounds.
+  value = std::max(minValue, std::min(value + delta, maxValue));
   requestUpdate();
 }
 
@@ -43,26 +37,32 @@ void EpubReaderPercentSelectionActivity::loop() {
   }
 
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
-    setResult(PercentResult{percent});
+    if (pages) {
+      setResult(PageResult{static_cast<uint32_t>(value - 1)});
+    } else {
+      setResult(PercentResult{value});
+    }
     finish();
     return;
   }
 
-  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Left}, [this] { adjustPercent(-kSmallStep); });
-  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Right}, [this] { adjustPercent(kSmallStep); });
+  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Left}, [this] { adjustValue(-kSmallStep); });
+  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Right}, [this] { adjustValue(kSmallStep); });
 
-  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Up}, [this] { adjustPercent(kLargeStep); });
-  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Down}, [this] { adjustPercent(-kLargeStep); });
+  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Up}, [this] { adjustValue(largeStep); });
+  buttonNavigator.onPressAndContinuous({MappedInputManager::Button::Down}, [this] { adjustValue(-largeStep); });
 }
 
 void EpubReaderPercentSelectionActivity::render(RenderLock&&) {
   renderer.clearScreen();
 
-  // Title and numeric percent value.
-  renderer.drawCenteredText(UI_12_FONT_ID, 15, tr(STR_GO_TO_PERCENT), true, EpdFontFamily::BOLD);
+  // Title and numeric value.
+  renderer.drawCenteredText(UI_12_FONT_ID, 15, pages ? tr(STR_GO_TO_PAGE) : tr(STR_GO_TO_PERCENT), true,
+                            EpdFontFamily::BOLD);
 
-  const std::string percentText = std::to_string(percent) + "%";
-  renderer.drawCenteredText(UI_12_FONT_ID, 90, percentText.c_str(), true, EpdFontFamily::BOLD);
+  const std::string valueText =
+      pages ? std::to_string(value) + " / " + std::to_string(maxValue) : std::to_string(value) + "%";
+  renderer.drawCenteredText(UI_12_FONT_ID, 90, valueText.c_str(), true, EpdFontFamily::BOLD);
 
   // Draw slider track.
   const int screenWidth = renderer.getScreenWidth();
@@ -73,8 +73,9 @@ void EpubReaderPercentSelectionActivity::render(RenderLock&&) {
 
   renderer.drawRect(barX, barY, barWidth, barHeight);
 
-  // Fill slider based on percent.
-  const int fillWidth = (barWidth - 4) * percent / 100;
+  // Fill slider based on the value.
+  const int fillWidth = static_cast<int>(static_cast<int64_t>(barWidth - 4) * (value - minValue) /
+                                         std::max(1, maxValue - minValue));
   if (fillWidth > 0) {
     renderer.fillRect(barX + 2, barY + 2, fillWidth, barHeight - 4);
   }
@@ -84,7 +85,8 @@ void EpubReaderPercentSelectionActivity::render(RenderLock&&) {
   renderer.fillRect(knobX, barY - 4, 4, barHeight + 8, true);
 
   // Hint text for step sizes.
-  renderer.drawCenteredText(SMALL_FONT_ID, barY + 30, tr(STR_PERCENT_STEP_HINT), true);
+  renderer.drawCenteredText(SMALL_FONT_ID, barY + 30, pages ? tr(STR_PAGE_STEP_HINT) : tr(STR_PERCENT_STEP_HINT),
+                            true);
 
   // Button hints follow the current front button layout.
   const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), "-", "+");
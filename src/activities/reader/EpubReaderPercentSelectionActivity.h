@@ -1,15 +1,23 @@
 #pragma once
 
+#include <algorithm>
+
 #include "MappedInputManager.h"
 #include "activities/Activity.h"
 #include "util/ButtonNavigator.h"
 
 class EpubReaderPercentSelectionActivity final : public Activity {
  public:
-  // Slider-style percent selector for jumping within a book.
+  // Slider-style percent selector for jumping within a book. With a pageCount it selects a page of the book
+  // (1-based, returned 0-based as a PageResult) instead.
   explicit EpubReaderPercentSelectionActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
-                                              const int initialPercent)
-      : Activity("EpubReaderPercentSelection", renderer, mappedInput), percent(initialPercent) {}
+                                              const int initialValue, const int pageCount = 0)
+      : Activity("EpubReaderPercentSelection", renderer, mappedInput),
+        value(initialValue),
+        minValue(pageCount > 0 ? 1 : 0),
+        maxValue(pageCount > 0 ? pageCount : 100),
+        largeStep(pageCount > 0 ? std::max(1, pageCount / 100) : 10),
+        pages(pageCount > 0) {}
 
   void onEnter() override;
   void onExit() override;
@@ -17,11 +25,15 @@ class EpubReaderPercentSelectionActivity final : public Activity {
   void render(RenderLock&&) override;
 
  private:
-  // Current percent value (0-100) shown on the slider.
-  int percent = 0;
+  // Current value shown on the slider, a percent (0-100) or a page (1-pageCount)
+  int value = 0;
+  const int minValue;
+  const int maxValue;
+  const int largeStep;
+  const bool pages;
 
   ButtonNavigator buttonNavigator;
 
-  // Change the current percent by a delta and clamp within bounds.
-  void adjustPercent(int delta);
+  // Change the current value by a delta and clamp within bounds.
+  void adjustValue(int delta);
 };
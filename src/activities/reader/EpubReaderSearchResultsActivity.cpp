@@ -0,0 +1,101 @@
+#include "EpubReaderSearchResultsActivity.h"
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+
+#include <algorithm>
+
+#include "MappedInputManager.h"
+#include "components/UITheme.h"
+#include "fontIds.h"
+
+void EpubReaderSearchResultsActivity::onEnter() {
+  Activity::onEnter();
+  selectedIndex = 0;
+  requestUpdate();
+}
+
+void EpubReaderSearchResultsActivity::onExit() { Activity::onExit(); }
+
+void EpubReaderSearchResultsActivity::loop() {
+  if (mappedInput.wasReleased(MappedInputManager::Button::Back)) {
+    ActivityResult result;
+    result.isCancelled = true;
+    setResult(std::move(result));
+    finish();
+    return;
+  }
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
+    if (selectedIndex >= 0 && selectedIndex < static_cast<int>(results.size())) {
+      setResult(SearchResult{results[selectedIndex].spineIndex, results[selectedIndex].page});
+      finish();
+    }
+    return;
+  }
+
+  buttonNavigator.onNext([this] {
+    if (!results.empty()) {
+      selectedIndex = (selectedIndex + 1) % results.size();
+      requestUpdate();
+    }
+  });
+
+  buttonNavigator.onPrevious([this] {
+    if (!results.empty()) {
+      selectedIndex = (selectedIndex - 1 + results.size()) % results.size();
+      requestUpdate();
+    }
+  });
+}
+
+void EpubReaderSearchResultsActivity::render(RenderLock&&) {
+  renderer.clearScreen();
+
+  constexpr int marginLeft = 20;
+  const int screenWidth = renderer.getScreenWidth();
+  const int textWidth = screenWidth - 2 * marginLeft;
+
+  renderer.drawCenteredText(UI_12_FONT_ID, 15, tr(STR_SEARCH_RESULTS), true, EpdFontFamily::BOLD);
+  const std::string quoted = "\xE2\x80\x9C" + query + "\xE2\x80\x9D";
+  renderer.drawCenteredText(UI_10_FONT_ID, 45, renderer.truncatedText(UI_10_FONT_ID, quoted.c_str(), textWidth).c_str());
+
+  if (results.empty()) {
+    renderer.drawCenteredText(UI_10_FONT_ID, 110, tr(STR_NO_SEARCH_RESULTS));
+    const auto labels = mappedInput.mapLabels(tr(STR_BACK), "", "", "");
+    GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+    renderer.displayBuffer();
+    return;
+  }
+
+  // Two lines a result: where it is, then the words around the match
+  constexpr int startY = 80;
+  const int locationHeight = renderer.getLineHeight(UI_10_FONT_ID);
+  const int snippetHeight = renderer.getLineHeight(SMALL_FONT_ID);
+  const int rowHeight = locationHeight + snippetHeight + 12;
+  const int listBottom = renderer.getScreenHeight() - UITheme::getInstance().getMetrics().buttonHintsHeight;
+
+  const int visibleCount = std::max(1, (listBottom - startY) / rowHeight);
+  if (selectedIndex < scrollOffset) scrollOffset = selectedIndex;
+  if (selectedIndex >= scrollOffset + visibleCount) scrollOffset = selectedIndex - visibleCount + 1;
+
+  for (int i = scrollOffset; i < static_cast<int>(results.size()) && i < scrollOffset + visibleCount; i++) {
+    const int y = startY + (i - scrollOffset) * rowHeight;
+    const bool isSelected = (i == selectedIndex);
+
+    if (isSelected) {
+      renderer.fillRect(0, y, screenWidth, rowHeight, true);
+    }
+
+    const auto& result = results[i];
+    const std::string location = renderer.truncatedText(UI_10_FONT_ID, result.location.c_str(), textWidth, EpdFontFamily::BOLD);
+    renderer.drawText(UI_10_FONT_ID, marginLeft, y + 4, location.c_str(), !isSelected, EpdFontFamily::BOLD);
+    const std::string snippet = renderer.truncatedText(SMALL_FONT_ID, result.snippet.c_str(), textWidth);
+    renderer.drawText(SMALL_FONT_ID, marginLeft, y + 6 + locationHeight, snippet.c_str(), !isSelected);
+  }
+
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), "", "");
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+
+  renderer.displayBuffer();
+}
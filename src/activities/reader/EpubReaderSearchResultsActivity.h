@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../Activity.h"
+#include "util/ButtonNavigator.h"
+
+class EpubReaderSearchResultsActivity final : public Activity {
+ public:
+  struct Result {
+    int spineIndex;
+    int page;
+    std::string location;  // Chapter and page, as shown
+    std::string snippet;
+  };
+
+  explicit EpubReaderSearchResultsActivity(GfxRenderer& renderer, MappedInputManager& mappedInput, std::string query,
+                                           std::vector<Result> results)
+      : Activity("EpubReaderSearchResults", renderer, mappedInput),
+        query(std::move(query)),
+        results(std::move(results)) {}
+
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+  void render(RenderLock&&) override;
+
+ private:
+  std::string query;
+  std::vector<Result> results;
+  int selectedIndex = 0;
+  int scrollOffset = 0;
+  ButtonNavigator buttonNavigator;
+};
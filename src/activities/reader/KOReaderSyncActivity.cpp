@@ -8,7 +8,9 @@
 
 #include "KOReaderCredentialStore.h"
 #include "KOReaderDocumentId.h"
+#include "KOReaderSyncQueue.h"
 #include "MappedInputManager.h"
+#include "WorkerPool.h"
 #include "activities/network/WifiSelectionActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
@@ -86,7 +88,7 @@ void KOReaderSyncActivity::performSync() {
   if (KOREADER_STORE.getMatchMethod() == DocumentMatchMethod::FILENAME) {
     documentHash = KOReaderDocumentId::calculateFromFilename(epubPath);
   } else {
-    documentHash = KOReaderDocumentId::calculate(epubPath);
+    documentHash = KOReaderDocumentId::calculate(epubPath, epub->getCachePath());
   }
   if (documentHash.empty()) {
     {
@@ -100,6 +102,11 @@ void KOReaderSyncActivity::performSync() {
 
   LOG_DBG("KOSync", "Document hash: %s", documentHash.c_str());
 
+  // This book is synced by hand now, a queued position of it would only undo that. The other queued books go out
+  // while WiFi is up anyway.
+  KOSYNC_QUEUE.remove(documentHash);
+  KOSYNC_QUEUE.flush();
+
   {
     RenderLock lock(*this);
     statusMessage = tr(STR_FETCH_PROGRESS);
@@ -136,7 +143,7 @@ void KOReaderSyncActivity::performSync() {
   remotePosition = ProgressMapper::toCrossPoint(epub, koPos, currentSpineIndex, totalPagesInSpine);
 
   // Calculate local progress in KOReader format (for display)
-  CrossPointPosition localPos = {currentSpineIndex, currentPage, totalPagesInSpine};
+  CrossPointPosition localPos = {currentSpineIndex, currentPage, totalPagesInSpine, currentTextPosition};
   localProgress = ProgressMapper::toKOReader(epub, localPos);
 
   {
@@ -162,7 +169,7 @@ void KOReaderSyncActivity::performUpload() {
   requestUpdateAndWait();
 
   // Convert current position to KOReader format
-  CrossPointPosition localPos = {currentSpineIndex, currentPage, totalPagesInSpine};
+  CrossPointPosition localPos = {currentSpineIndex, currentPage, totalPagesInSpine, currentTextPosition};
   KOReaderPosition koPos = ProgressMapper::toKOReader(epub, localPos);
 
   KOReaderProgress progress;
@@ -208,21 +215,21 @@ void KOReaderSyncActivity::onEnter() {
     statusMessage = tr(STR_SYNCING_TIME);
     requestUpdate(true);
 
-    // Perform sync directly (will be handled in loop)
-    xTaskCreate(
-        [](void* param) {
-          auto* self = static_cast<KOReaderSyncActivity*>(param);
-          // Sync time first
-          syncTimeWithNTP();
-          {
-            RenderLock lock(*self);
-            self->statusMessage = tr(STR_CALC_HASH);
-          }
-          self->requestUpdate(true);
-          self->performSync();
-          vTaskDelete(nullptr);
-        },
-        "SyncTask", 4096, this, 1, nullptr);
+    // Perform sync directly, on a worker so the screen keeps updating (inline if none can take it)
+    const auto syncJob = [](void* param) {
+      auto* self = static_cast<KOReaderSyncActivity*>(param);
+      // Sync time first
+      syncTimeWithNTP();
+      {
+        RenderLock lock(*self);
+        self->statusMessage = tr(STR_CALC_HASH);
+      }
+      self->requestUpdate(true);
+      self->performSync();
+    };
+    if (!WORKERS.submit(syncJob, this, "SyncTask")) {
+      syncJob(this);
+    }
     return;
   }
 
@@ -378,7 +385,7 @@ void KOReaderSyncActivity::loop() {
     if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
       if (selectedOption == 0) {
         // Wifi will be turned off in onExit()
-        setResult(SyncResult{remotePosition.spineIndex, remotePosition.pageNumber});
+        setResult(SyncResult{remotePosition.spineIndex, remotePosition.pageNumber, remotePosition.textPosition});
         finish();
       } else if (selectedOption == 1) {
         // Upload local progress
@@ -402,7 +409,7 @@ void KOReaderSyncActivity::loop() {
         if (KOREADER_STORE.getMatchMethod() == DocumentMatchMethod::FILENAME) {
           documentHash = KOReaderDocumentId::calculateFromFilename(epubPath);
         } else {
-          documentHash = KOReaderDocumentId::calculate(epubPath);
+          documentHash = KOReaderDocumentId::calculate(epubPath, epub->getCachePath());
         }
       }
       performUpload();
@@ -22,13 +22,15 @@ class KOReaderSyncActivity final : public Activity {
  public:
   explicit KOReaderSyncActivity(GfxRenderer& renderer, MappedInputManager& mappedInput,
                                 const std::shared_ptr<Epub>& epub, const std::string& epubPath, int currentSpineIndex,
-                                int currentPage, int totalPagesInSpine)
+                                int currentPage, int totalPagesInSpine,
+                                uint32_t currentTextPosition = CrossPointPosition::NO_TEXT_POSITION)
       : Activity("KOReaderSync", renderer, mappedInput),
         epub(epub),
         epubPath(epubPath),
         currentSpineIndex(currentSpineIndex),
         currentPage(currentPage),
         totalPagesInSpine(totalPagesInSpine),
+        currentTextPosition(currentTextPosition),
         remoteProgress{},
         remotePosition{},
         localProgress{} {}
@@ -57,6 +59,7 @@ class KOReaderSyncActivity final : public Activity {
   int currentSpineIndex;
   int currentPage;
   int totalPagesInSpine;
+  uint32_t currentTextPosition;
 
   State state = WIFI_SELECTION;
   std::string statusMessage;
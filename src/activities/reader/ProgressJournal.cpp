@@ -0,0 +1,131 @@
+#include "ProgressJournal.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr char PROGRESS_FILE[] = "/progress.bin";
+}  // namespace
+
+uint8_t ProgressJournal::checkByte(const uint8_t* record) {
+  uint8_t sum = 0;
+  for (size_t i = 0; i < RECORD_SIZE - 1; i++) {
+    sum += record[i];
+  }
+  // Inverted, so a zeroed stretch of the file doesn't pass for a record
+  return static_cast<uint8_t>(~sum);
+}
+
+size_t ProgressJournal::open(const std::string& cacheDir, uint8_t* data, const size_t capacity) {
+  close();
+  savedSize = pendingSize = 0;
+  memset(saved, 0, sizeof(saved));
+  dirty = false;
+
+  const std::string path = cacheDir + PROGRESS_FILE;
+  file = Storage.open(path.c_str(), O_RDWR | O_CREAT);
+  if (!file) {
+    LOG_ERR("PRG", "Could not open %s", path.c_str());
+    return 0;
+  }
+
+  const uint32_t fileSize = static_cast<uint32_t>(file.size());
+  records = fileSize / RECORD_SIZE;
+  if (fileSize > 0 && fileSize < RECORD_SIZE) {
+    // The bare position written by older firmware; the first save compacts it into a record
+    const size_t size = std::min<size_t>(fileSize, MAX_DATA_SIZE);
+    if (file.read(saved, size) == static_cast<int>(size)) {
+      savedSize = size;
+    }
+    records = MAX_RECORDS;
+  } else if (records > 0) {
+    // Read the tail in one go and take the latest intact record; a save cut short leaves a torn one behind
+    uint8_t tail[MAX_RECORDS * RECORD_SIZE];
+    const uint32_t count = std::min(records, MAX_RECORDS);
+    const uint32_t tailBytes = count * RECORD_SIZE;
+    if (file.seek((records - count) * RECORD_SIZE) && file.read(tail, tailBytes) == static_cast<int>(tailBytes)) {
+      for (uint32_t i = count; i > 0; i--) {
+        const uint8_t* record = tail + (i - 1) * RECORD_SIZE;
+        const uint8_t size = record[MAX_DATA_SIZE];
+        if (size > 0 && size <= MAX_DATA_SIZE && record[RECORD_SIZE - 1] == checkByte(record)) {
+          memcpy(saved, record, MAX_DATA_SIZE);
+          savedSize = size;
+          break;
+        }
+      }
+    }
+  }
+
+  const size_t size = std::min<size_t>(savedSize, capacity);
+  memcpy(data, saved, size);
+  return size;
+}
+
+void ProgressJournal::record(const uint8_t* data, const size_t size) {
+  pendingSize = static_cast<uint8_t>(std::min(size, MAX_DATA_SIZE));
+  memset(pending, 0, sizeof(pending));
+  memcpy(pending, data, pendingSize);
+  if (pendingSize == savedSize && memcmp(pending, saved, sizeof(saved)) == 0) {
+    // Back on the page that is saved already
+    dirty = false;
+    return;
+  }
+
+  const unsigned long now = millis();
+  if (!dirty) {
+    firstDirtyAt = now;
+  }
+  lastRecordAt = now;
+  dirty = true;
+}
+
+bool ProgressJournal::isFlushDue() const {
+  if (!dirty) {
+    return false;
+  }
+  const unsigned long now = millis();
+  return now - lastRecordAt >= SETTLE_MS || now - firstDirtyAt >= MAX_DIRTY_MS;
+}
+
+bool ProgressJournal::flush() {
+  if (!dirty) {
+    return true;
+  }
+  if (!file) {
+    LOG_ERR("PRG", "Could not save progress, the journal is not open");
+    return false;
+  }
+
+  uint8_t record[RECORD_SIZE];
+  memcpy(record, pending, MAX_DATA_SIZE);
+  record[MAX_DATA_SIZE] = pendingSize;
+  record[RECORD_SIZE - 1] = checkByte(record);
+
+  // Compacting overwrites the first record and cuts the rest off; cut short, the previous save is still the last
+  // intact record
+  const bool compact = records >= MAX_RECORDS;
+  if (!file.seek(compact ? 0 : records * RECORD_SIZE) || file.write(record, RECORD_SIZE) != RECORD_SIZE ||
+      (compact && !file.truncate(RECORD_SIZE))) {
+    LOG_ERR("PRG", "Could not save progress!");
+    return false;
+  }
+  file.flush();
+
+  records = compact ? 1 : records + 1;
+  memcpy(saved, pending, sizeof(saved));
+  savedSize = pendingSize;
+  dirty = false;
+  LOG_DBG("PRG", "Progress saved (%u records)", static_cast<unsigned>(records));
+  return true;
+}
+
+void ProgressJournal::close() {
+  if (file) {
+    flush();
+    file.close();
+  }
+  records = 0;
+}
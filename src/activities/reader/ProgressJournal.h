@@ -0,0 +1,61 @@
+#pragma once
+#include <HalStorage.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Reading position of the open book, kept in <cache>/progress.bin. A page turn only records the position in RAM; it
+// goes to the file once the reader has settled on a page for a moment (or at the latest after MAX_DIRTY_MS of
+// paging), and when the book is closed, which going to sleep does too. Positions are appended as fixed-size records
+// to the file, kept open, so a save doesn't truncate and reallocate the file the way rewriting it did; the latest
+// intact record wins. When the journal is full it's compacted to one record in the same cluster.
+//
+// A record starts with the position as the file used to hold it, so older firmware still finds a position there (the
+// first record's); open() reads such files too. Not thread-safe: the readers record and flush under their RenderLock,
+// only isFlushDue() may be polled without it.
+class ProgressJournal {
+ public:
+  // Largest position a reader can record
+  static constexpr size_t MAX_DATA_SIZE = 8;
+  // Quiet time after the last page turn before the position is written
+  static constexpr unsigned long SETTLE_MS = 5000;
+  // A position is written after this long however fast pages are turned
+  static constexpr unsigned long MAX_DIRTY_MS = 60000;
+
+  ProgressJournal() = default;
+  ~ProgressJournal() { close(); }
+  ProgressJournal(const ProgressJournal&) = delete;
+  ProgressJournal& operator=(const ProgressJournal&) = delete;
+
+  // Opens the journal in cacheDir, which must exist, and reads the last saved position into data. Returns its size,
+  // 0 when nothing was saved yet.
+  size_t open(const std::string& cacheDir, uint8_t* data, size_t capacity);
+  // Remembers the position, to be written by a later flush(). size is at most MAX_DATA_SIZE.
+  void record(const uint8_t* data, size_t size);
+  // A recorded position has waited long enough to be written
+  bool isFlushDue() const;
+  // Writes the recorded position if it isn't saved yet; false if the write failed
+  bool flush();
+  // Flushes and closes the file, e.g. before the cache directory is removed
+  void close();
+
+ private:
+  // The position, its size and a check byte
+  static constexpr size_t RECORD_SIZE = MAX_DATA_SIZE + 2;
+  // Journal length before it's compacted, well within one cluster
+  static constexpr uint32_t MAX_RECORDS = 48;
+
+  FsFile file;
+  uint8_t pending[MAX_DATA_SIZE] = {};
+  uint8_t pendingSize = 0;
+  uint8_t saved[MAX_DATA_SIZE] = {};
+  uint8_t savedSize = 0;
+  uint32_t records = 0;  // Complete records in the file; the next one goes behind them
+  std::atomic<bool> dirty{false};
+  std::atomic<unsigned long> firstDirtyAt{0};
+  std::atomic<unsigned long> lastRecordAt{0};
+
+  static uint8_t checkByte(const uint8_t* record);
+};
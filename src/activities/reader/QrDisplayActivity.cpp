@@ -13,7 +13,10 @@ void QrDisplayActivity::onEnter() {
   requestUpdate();
 }
 
-void QrDisplayActivity::onExit() { Activity::onExit(); }
+void QrDisplayActivity::onExit() {
+  Activity::onExit();
+  QrUtils::releaseCache();
+}
 
 void QrDisplayActivity::loop() {
   if (mappedInput.wasReleased(MappedInputManager::Button::Back) ||
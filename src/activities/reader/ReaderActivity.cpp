@@ -7,6 +7,7 @@
 #include "EpubReaderActivity.h"
 #include "Txt.h"
 #include "TxtReaderActivity.h"
+#include "WarmBooks.h"
 #include "Xtc.h"
 #include "XtcReaderActivity.h"
 #include "activities/util/BmpViewerActivity.h"
@@ -27,18 +28,21 @@ bool ReaderActivity::isXtcFile(const std::string& path) {
 
 bool ReaderActivity::isTxtFile(const std::string& path) {
   return StringUtils::checkFileExtension(path, ".txt") ||
-         StringUtils::checkFileExtension(path, ".md");  // Treat .md as txt files (until we have a markdown reader)
+         StringUtils::checkFileExtension(path, ".md");  // Read as text, with basic Markdown styling
 }
 
 bool ReaderActivity::isBmpFile(const std::string& path) { return StringUtils::checkFileExtension(path, ".bmp"); }
 
-std::unique_ptr<Epub> ReaderActivity::loadEpub(const std::string& path) {
+std::shared_ptr<Epub> ReaderActivity::loadEpub(const std::string& path) {
   if (!Storage.exists(path.c_str())) {
     LOG_ERR("READER", "File does not exist: %s", path.c_str());
     return nullptr;
   }
 
-  auto epub = std::unique_ptr<Epub>(new Epub(path, "/.crosspoint"));
+  if (auto warm = WARM_BOOKS.take(path)) {
+    return warm;
+  }
+  auto epub = std::make_shared<Epub>(path, "/.crosspoint");
   if (epub->load(true, SETTINGS.embeddedStyle == 0)) {
     return epub;
   }
@@ -83,7 +87,7 @@ void ReaderActivity::goToLibrary(const std::string& fromBookPath) {
   activityManager.goToMyLibrary(std::move(initialPath));
 }
 
-void ReaderActivity::onGoToEpubReader(std::unique_ptr<Epub> epub) {
+void ReaderActivity::onGoToEpubReader(std::shared_ptr<Epub> epub) {
   const auto epubPath = epub->getPath();
   currentBookPath = epubPath;
   activityManager.replaceActivity(std::make_unique<EpubReaderActivity>(renderer, mappedInput, std::move(epub)));
@@ -1,25 +1,54 @@
 #include "TxtReaderActivity.h"
 
+#include <Epub/ParsedText.h>
+#include <Epub/hyphenation/Hyphenator.h>
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <I18n.h>
 #include <Serialization.h>
 #include <Utf8.h>
 
+#include <algorithm>
+
+#include "CacheBudget.h"
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "MappedInputManager.h"
+#include "MemoryBudget.h"
 #include "RecentBooksStore.h"
+#include "SdFonts.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "util/RefreshUtils.h"
+#include "util/StringUtils.h"
 
 namespace {
 constexpr unsigned long goHomeMs = 1000;
-constexpr size_t CHUNK_SIZE = 8 * 1024;  // 8KB chunk for reading
+constexpr size_t CHUNK_SIZE = Txt::READ_WINDOW_SIZE;  // A page is laid out from up to a full read window
 
 // Cache file magic and version
 constexpr uint32_t CACHE_MAGIC = 0x54585449;  // "TXTI"
-constexpr uint8_t CACHE_VERSION = 2;          // Increment when cache format changes
+constexpr uint8_t CACHE_VERSION = 4;          // Increment when cache format changes
+// Layout of the header (see loadPageIndexCache()), which the page offsets follow
+constexpr size_t CACHE_COMPLETE_POS = 27;  // The complete flag, then the page count
+constexpr size_t CACHE_HEADER_SIZE = 32;
+
+// Pages per offset kept in RAM; the offsets in between are read back from the index file
+constexpr int PAGE_CHECKPOINT_INTERVAL = 64;
+
+// Pages indexed per loop() while reading, and how many more make the index worth saving again
+constexpr size_t INDEX_PAGES_PER_LOOP = 8;
+constexpr size_t INDEX_CHECKPOINT_PAGES = 200;
+
+// Markdown bullet shown for "- ", "* " and "+ " list items
+constexpr char BULLET[] = "\xe2\x80\xa2";
+
+bool isWordSpace(const char c) { return c == ' ' || c == '\t'; }
+bool isEmphasisMarker(const char c) { return c == '*' || c == '_'; }
+// Closing punctuation an emphasis marker may be followed by, as in "*word*,"
+bool isClosingPunctuation(const char c) {
+  return c != '\0' && std::string_view(".,;:!?)]\"'").find(c) != std::string_view::npos;
+}
 }  // namespace
 
 void TxtReaderActivity::onEnter() {
@@ -28,6 +57,7 @@ void TxtReaderActivity::onEnter() {
   if (!txt) {
     return;
   }
+  SD_FONTS.apply(renderer);
 
   // Configure screen orientation based on settings
   switch (SETTINGS.orientation) {
@@ -48,6 +78,7 @@ void TxtReaderActivity::onEnter() {
   }
 
   txt->setupCacheDir();
+  markdown = StringUtils::checkFileExtension(txt->getPath(), ".md");
 
   // Save current txt as last opened file and add to recent books
   auto filePath = txt->getPath();
@@ -55,6 +86,8 @@ void TxtReaderActivity::onEnter() {
   APP_STATE.openEpubPath = filePath;
   APP_STATE.saveToFile();
   RECENT_BOOKS.addBook(filePath, fileName, "", "");
+  CACHE_BUDGET.touch(txt->getCachePath());
+  MEMORY_BUDGET.setMode(MemoryBudget::Reading);
 
   // Trigger first update
   requestUpdate();
@@ -62,18 +95,42 @@ void TxtReaderActivity::onEnter() {
 
 void TxtReaderActivity::onExit() {
   Activity::onExit();
+  MEMORY_BUDGET.setMode(MemoryBudget::Browsing);
 
   // Reset orientation back to portrait for the rest of the UI
   renderer.setOrientation(GfxRenderer::Orientation::Portrait);
 
-  pageOffsets.clear();
+  // Keep what was indexed so far, indexing resumes from there next time
+  if (initialized && !indexComplete) {
+    checkpointPageIndex();
+  }
+
+  pageCheckpoints.clear();
+  windowOffsets.clear();
+  unsavedOffsets.clear();
   currentPageLines.clear();
+  progressJournal.close();
   APP_STATE.readerActivityLoadCount = 0;
   APP_STATE.saveToFile();
   txt.reset();
+  renderer.clearFontCache();
 }
 
 void TxtReaderActivity::loop() {
+  if (progressJournal.isFlushDue()) {
+    RenderLock lock(*this);
+    progressJournal.flush();
+  }
+
+  // Carry on indexing in between page turns
+  if (initialized && !indexComplete) {
+    RenderLock lock(*this);
+    extendPageIndex(INDEX_PAGES_PER_LOOP);
+    if (indexComplete || unsavedOffsets.size() >= INDEX_CHECKPOINT_PAGES) {
+      checkpointPageIndex();
+    }
+  }
+
   // Long press BACK (1s+) goes to file selection
   if (mappedInput.isPressed(MappedInputManager::Button::Back) && mappedInput.getHeldTime() >= goHomeMs) {
     activityManager.goToMyLibrary(txt ? txt->getPath() : "");
@@ -107,9 +164,15 @@ void TxtReaderActivity::loop() {
   if (prevTriggered && currentPage > 0) {
     currentPage--;
     requestUpdate();
-  } else if (nextTriggered && currentPage < totalPages - 1) {
-    currentPage++;
-    requestUpdate();
+  } else if (nextTriggered) {
+    if (currentPage >= totalPages - 1 && !indexComplete) {
+      RenderLock lock(*this);
+      extendPageIndex(1);
+    }
+    if (currentPage < totalPages - 1) {
+      currentPage++;
+      requestUpdate();
+    }
   }
 }
 
@@ -122,6 +185,16 @@ void TxtReaderActivity::initializeReader() {
   cachedFontId = SETTINGS.getReaderFontId();
   cachedScreenMargin = SETTINGS.screenMargin;
   cachedParagraphAlignment = SETTINGS.paragraphAlignment;
+  cachedHyphenation = SETTINGS.hyphenationEnabled;
+
+  // Paragraphs are laid out like an EPUB's without CSS; plain text has no language to pick hyphenation patterns by, so
+  // only its own hyphens and overlong words are split
+  paragraphStyle = BlockStyle();
+  paragraphStyle.alignment = cachedParagraphAlignment == CrossPointSettings::BOOK_STYLE
+                                 ? CssTextAlign::Justify
+                                 : static_cast<CssTextAlign>(cachedParagraphAlignment);
+  paragraphStyle.textAlignDefined = true;
+  Hyphenator::setPreferredLanguage("");
 
   // Calculate viewport dimensions
   renderer.getOrientedViewableTRBL(&cachedOrientedMarginTop, &cachedOrientedMarginRight, &cachedOrientedMarginBottom,
@@ -134,68 +207,142 @@ void TxtReaderActivity::initializeReader() {
 
   viewportWidth = renderer.getScreenWidth() - cachedOrientedMarginLeft - cachedOrientedMarginRight;
   const int viewportHeight = renderer.getScreenHeight() - cachedOrientedMarginTop - cachedOrientedMarginBottom;
-  const int lineHeight = renderer.getLineHeight(cachedFontId);
+  lineHeight = static_cast<int>(renderer.getLineHeight(cachedFontId) * SETTINGS.getReaderLineCompression());
+  if (lineHeight < 1) lineHeight = 1;
 
   linesPerPage = viewportHeight / lineHeight;
   if (linesPerPage < 1) linesPerPage = 1;
 
   LOG_DBG("TRS", "Viewport: %dx%d, lines per page: %d", viewportWidth, viewportHeight, linesPerPage);
 
-  // Try to load cached page index first
+  // Try to load cached page index first. It may have been saved before indexing finished, then indexing carries on
+  // from there; either way, the first page can be shown right away.
   if (!loadPageIndexCache()) {
-    // Cache not found, build page index
-    buildPageIndex();
-    // Save to cache for next time
-    savePageIndexCache();
+    resetPageIndex();
+    LOG_DBG("TRS", "Indexing %zu bytes while reading", txt->getFileSize());
   }
 
   // Load saved progress
   loadProgress();
 
+  // Reopened past what was indexed: the pages up to the saved one are needed first
+  if (!indexComplete && currentPage >= totalPages) {
+    GUI.drawPopup(renderer, tr(STR_INDEXING));
+    extendPageIndex(currentPage + 1 - totalPages);
+    checkpointPageIndex();
+  }
+
   initialized = true;
 }
 
-void TxtReaderActivity::buildPageIndex() {
-  pageOffsets.clear();
-  pageOffsets.push_back(0);  // First page starts at offset 0
-
-  size_t offset = 0;
-  const size_t fileSize = txt->getFileSize();
+void TxtReaderActivity::resetPageIndex() {
+  pageCheckpoints.clear();
+  windowOffsets.clear();
+  unsavedOffsets.clear();
+  savedPageCount = 0;
+  savedIndexComplete = false;
+  totalPages = 0;
+  indexComplete = false;
+  addPage(0);  // First page starts at offset 0
+}
 
-  LOG_DBG("TRS", "Building page index for %zu bytes...", fileSize);
+void TxtReaderActivity::addPage(const uint32_t offset) {
+  if (totalPages % PAGE_CHECKPOINT_INTERVAL == 0) {
+    pageCheckpoints.push_back(offset);
+  }
+  unsavedOffsets.push_back(offset);
+  lastPageOffset = offset;
+  totalPages++;
+}
 
-  GUI.drawPopup(renderer, tr(STR_INDEXING));
+bool TxtReaderActivity::getPageOffset(const int page, uint32_t& offset) {
+  if (page < 0 || page >= totalPages) {
+    return false;
+  }
+  if (page >= savedPageCount) {
+    offset = unsavedOffsets[page - savedPageCount];
+    return true;
+  }
+  if (page < windowFirstPage || page >= windowFirstPage + static_cast<int>(windowOffsets.size())) {
+    if (!loadPageWindow(page / PAGE_CHECKPOINT_INTERVAL) ||
+        page >= windowFirstPage + static_cast<int>(windowOffsets.size())) {
+      return false;
+    }
+  }
+  offset = windowOffsets[page - windowFirstPage];
+  return true;
+}
 
-  while (offset < fileSize) {
-    std::vector<std::string> tempLines;
-    size_t nextOffset = offset;
+// Loads the offsets of the saved pages in one checkpoint interval from the index file. If that can't be read, they
+// are laid out again from the checkpoint.
+bool TxtReaderActivity::loadPageWindow(const int interval) {
+  windowFirstPage = interval * PAGE_CHECKPOINT_INTERVAL;
+  const int count = std::min(PAGE_CHECKPOINT_INTERVAL, savedPageCount - windowFirstPage);
+  windowOffsets.resize(count);
 
-    if (!loadPageAtOffset(offset, tempLines, nextOffset)) {
-      break;
+  FsFile f;
+  if (Storage.openFileForRead("TRS", txt->getCachePath() + "/index.bin", f)) {
+    const size_t bytes = count * sizeof(uint32_t);
+    const bool ok = f.seek(CACHE_HEADER_SIZE + windowFirstPage * sizeof(uint32_t)) &&
+                    f.read(reinterpret_cast<uint8_t*>(windowOffsets.data()), bytes) == static_cast<int>(bytes);
+    f.close();
+    if (ok) {
+      return true;
     }
+  }
 
-    if (nextOffset <= offset) {
-      // No progress made, avoid infinite loop
+  LOG_ERR("TRS", "Failed to read page index, laying out pages %d+ again", windowFirstPage);
+  windowOffsets.assign(1, pageCheckpoints[interval]);
+  while (static_cast<int>(windowOffsets.size()) < count) {
+    size_t nextOffset = windowOffsets.back();
+    if (!loadPageAtOffset(windowOffsets.back(), nullptr, nextOffset) || nextOffset <= windowOffsets.back()) {
       break;
     }
+    windowOffsets.push_back(nextOffset);
+  }
+  return true;
+}
 
-    offset = nextOffset;
-    if (offset < fileSize) {
-      pageOffsets.push_back(offset);
-    }
+// Lays out up to pageCount more pages after the last known one
+void TxtReaderActivity::extendPageIndex(const size_t pageCount) {
+  const size_t fileSize = txt->getFileSize();
 
-    // Yield to other tasks periodically
-    if (pageOffsets.size() % 20 == 0) {
-      vTaskDelay(1);
+  for (size_t i = 0; i < pageCount && !indexComplete; i++) {
+    const size_t offset = lastPageOffset;
+    size_t nextOffset = offset;
+
+    // No progress made also ends the index, to avoid an infinite loop
+    if (!loadPageAtOffset(offset, nullptr, nextOffset) || nextOffset <= offset || nextOffset >= fileSize) {
+      indexComplete = true;
+      LOG_DBG("TRS", "Built page index: %d pages", totalPages);
+      break;
     }
+    addPage(nextOffset);
+  }
+}
+
+void TxtReaderActivity::checkpointPageIndex() {
+  if (!unsavedOffsets.empty() || savedIndexComplete != indexComplete) {
+    savePageIndexCache();
   }
+}
 
-  totalPages = pageOffsets.size();
-  LOG_DBG("TRS", "Built page index: %d pages", totalPages);
+// Page count while indexing, from the pages found in the bytes indexed so far
+int TxtReaderActivity::estimatedTotalPages() const {
+  const size_t indexedBytes = lastPageOffset;
+  if (indexComplete || indexedBytes == 0) {
+    return totalPages;
+  }
+  const auto estimate = static_cast<int>(static_cast<uint64_t>(totalPages) * txt->getFileSize() / indexedBytes);
+  return std::max(estimate, totalPages);
 }
 
-bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>& outLines, size_t& nextOffset) {
-  outLines.clear();
+bool TxtReaderActivity::loadPageAtOffset(const size_t offset, std::vector<TextBlock::Ptr>* outLines,
+                                         size_t& nextOffset) {
+  if (outLines) {
+    outLines->clear();
+  }
+  int lineCount = 0;
   const size_t fileSize = txt->getFileSize();
 
   if (offset >= fileSize) {
@@ -203,121 +350,218 @@ bool TxtReaderActivity::loadPageAtOffset(size_t offset, std::vector<std::string>
   }
 
   // Read a chunk from file
-  size_t chunkSize = std::min(CHUNK_SIZE, fileSize - offset);
-  auto* buffer = static_cast<uint8_t*>(malloc(chunkSize + 1));
-  if (!buffer) {
-    LOG_ERR("TRS", "Failed to allocate %zu bytes", chunkSize);
+  const std::string_view chunk = txt->readWindow(offset, CHUNK_SIZE);
+  if (chunk.empty()) {
     return false;
   }
 
-  if (!txt->readContent(buffer, offset, chunkSize)) {
-    free(buffer);
-    return false;
-  }
-  buffer[chunkSize] = '\0';
-
-  // Parse lines from buffer
+  // Each source line is a paragraph
   size_t pos = 0;
 
-  while (pos < chunkSize && static_cast<int>(outLines.size()) < linesPerPage) {
-    // Find end of line
-    size_t lineEnd = pos;
-    while (lineEnd < chunkSize && buffer[lineEnd] != '\n') {
-      lineEnd++;
-    }
+  while (pos < chunk.size() && lineCount < linesPerPage) {
+    const size_t newline = chunk.find('\n', pos);
+    const size_t lineEnd = newline == std::string_view::npos ? chunk.size() : newline;
 
     // Check if we have a complete line
-    bool lineComplete = (lineEnd < chunkSize) || (offset + lineEnd >= fileSize);
-
-    if (!lineComplete && static_cast<int>(outLines.size()) > 0) {
-      // Incomplete line and we already have some lines, stop here
+    const bool lineComplete = newline != std::string_view::npos || offset + lineEnd >= fileSize;
+    if (!lineComplete && lineCount > 0) {
+      // Incomplete line and we already have some lines, the next page starts with it
       break;
     }
 
-    // Calculate the actual length of line content in the buffer (excluding newline)
-    size_t lineContentLen = lineEnd - pos;
-
-    // Check for carriage return
-    bool hasCR = (lineContentLen > 0 && buffer[pos + lineContentLen - 1] == '\r');
-    size_t displayLen = hasCR ? lineContentLen - 1 : lineContentLen;
-
-    // Extract line content for display (without CR/LF)
-    std::string line(reinterpret_cast<char*>(buffer + pos), displayLen);
-
-    // Track position within this source line (in bytes from pos)
-    size_t lineBytePos = 0;
+    std::string_view line = chunk.substr(pos, lineEnd - pos);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
 
-    // Word wrap if needed
-    while (!line.empty() && static_cast<int>(outLines.size()) < linesPerPage) {
-      int lineWidth = renderer.getTextWidth(cachedFontId, line.c_str());
+    uint32_t resumePosition = 0;
+    if (!layoutParagraph(line, offset + pos, lineComplete, lineCount, outLines, resumePosition)) {
+      // Page is full mid-line, or the rest of the line is past the window
+      pos = resumePosition - offset;
+      break;
+    }
+    pos = newline == std::string_view::npos ? lineEnd : lineEnd + 1;
+  }
 
-      if (lineWidth <= viewportWidth) {
-        outLines.push_back(line);
-        lineBytePos = displayLen;  // Consumed entire display content
-        line.clear();
-        break;
-      }
+  // Ensure we make progress even if calculations go wrong
+  if (pos == 0 && lineCount > 0) {
+    // Fallback: at minimum, consume something to avoid infinite loop
+    pos = 1;
+  }
 
-      // Find break point
-      size_t breakPos = line.length();
-      while (breakPos > 0 && renderer.getTextWidth(cachedFontId, line.substr(0, breakPos).c_str()) > viewportWidth) {
-        // Try to break at space
-        size_t spacePos = line.rfind(' ', breakPos - 1);
-        if (spacePos != std::string::npos && spacePos > 0) {
-          breakPos = spacePos;
-        } else {
-          // Break at character boundary for UTF-8
-          breakPos--;
-          // Make sure we don't break in the middle of a UTF-8 sequence
-          while (breakPos > 0 && (line[breakPos] & 0xC0) == 0x80) {
-            breakPos--;
-          }
-        }
-      }
+  nextOffset = std::min(offset + pos, fileSize);
+  return nextOffset > offset;
+}
 
-      if (breakPos == 0) {
-        breakPos = 1;
+bool TxtReaderActivity::layoutParagraph(const std::string_view line, const uint32_t position, const bool complete,
+                                        int& lineCount, std::vector<TextBlock::Ptr>* outLines,
+                                        uint32_t& resumePosition) {
+  // No first line indent, paragraphs are set apart by the blank lines the text has between them
+  ParsedText paragraph(true, cachedHyphenation, paragraphStyle, nullptr, &widthCache, &hyphenationCache);
+  uint32_t cutPosition = 0;
+  const bool cut = addParagraphWords(paragraph, line, position, complete, cutPosition);
+
+  if (paragraph.isEmpty()) {
+    // A blank line, kept except at the top of a page
+    if (lineCount > 0) {
+      if (outLines) {
+        outLines->emplace_back(nullptr);
       }
+      lineCount++;
+    }
+    return true;
+  }
 
-      outLines.push_back(line.substr(0, breakPos));
-
-      // Skip space at break point
-      size_t skipChars = breakPos;
-      if (breakPos < line.length() && line[breakPos] == ' ') {
-        skipChars++;
-      }
-      lineBytePos += skipChars;
-      line = line.substr(skipChars);
+  // Word positions are file offsets, so the line that doesn't fit any more is where the next page starts
+  bool full = false;
+  int keptLines = 0;
+  uint32_t lastLinePosition = position;
+  const auto addLine = [&](TextBlock::Ptr textBlock) {
+    if (full) {
+      return;
+    }
+    if (lineCount >= linesPerPage) {
+      full = true;
+      resumePosition = paragraph.getLinePosition();
+      return;
     }
+    lastLinePosition = paragraph.getLinePosition();
+    if (outLines) {
+      outLines->push_back(std::move(textBlock));
+    }
+    keptLines++;
+    lineCount++;
+  };
+  paragraph.layoutAndExtractLines(renderer, cachedFontId, static_cast<uint16_t>(viewportWidth), addLine);
+  if (full) {
+    return false;
+  }
+  if (!cut) {
+    return true;
+  }
 
-    // Determine how much of the source buffer we consumed
-    if (line.empty()) {
-      // Fully consumed this source line, move past the newline
-      pos = lineEnd + 1;
-    } else {
-      // Partially consumed - page is full mid-line
-      // Move pos to where we stopped in the line (NOT past the line)
-      pos = pos + lineBytePos;
-      break;
+  // The last line might have had room for the words left out; it's laid out again with them on the next page
+  if (keptLines > 1) {
+    if (outLines) {
+      outLines->pop_back();
     }
+    lineCount--;
+    resumePosition = lastLinePosition;
+  } else {
+    resumePosition = cutPosition;
   }
+  return false;
+}
 
-  // Ensure we make progress even if calculations go wrong
-  if (pos == 0 && !outLines.empty()) {
-    // Fallback: at minimum, consume something to avoid infinite loop
-    pos = 1;
+bool TxtReaderActivity::addParagraphWords(ParsedText& paragraph, const std::string_view line, const uint32_t position,
+                                          const bool complete, uint32_t& cutPosition) {
+  size_t pos = 0;
+  const auto skipSpaces = [&]() {
+    while (pos < line.size() && isWordSpace(line[pos])) {
+      pos++;
+    }
+  };
+  skipSpaces();
+
+  // Markdown block markers: a heading is bold throughout, a list item starts with a bullet
+  bool heading = false;
+  if (markdown) {
+    size_t level = 0;
+    while (pos + level < line.size() && line[pos + level] == '#') {
+      level++;
+    }
+    if (level >= 1 && level <= 6 && pos + level < line.size() && isWordSpace(line[pos + level])) {
+      heading = true;
+      pos += level;
+      skipSpaces();
+    } else if (pos + 1 < line.size() && (line[pos] == '-' || line[pos] == '*' || line[pos] == '+') &&
+               isWordSpace(line[pos + 1])) {
+      paragraph.addWord(BULLET, EpdFontFamily::REGULAR, false, false, position + pos);
+      pos += 2;
+      skipSpaces();
+    }
   }
 
-  nextOffset = offset + pos;
+  bool bold = false;
+  bool italic = false;
+  while (pos < line.size()) {
+    size_t end = pos;
+    while (end < line.size() && !isWordSpace(line[end])) {
+      end++;
+    }
 
-  // Make sure we don't go past the file
-  if (nextOffset > fileSize) {
-    nextOffset = fileSize;
-  }
+    // The first word is kept even when cut, for the page to make progress
+    if ((end == line.size() && !complete && !paragraph.isEmpty()) ||
+        paragraph.size() >= ParsedText::LAYOUT_WINDOW_WORDS) {
+      cutPosition = position + pos;
+      return true;
+    }
 
-  free(buffer);
+    std::string_view word = line.substr(pos, end - pos);
+    uint32_t wordPosition = position + pos;
+    pos = end;
+    skipSpaces();
+
+    // Inline emphasis, "**" / "__" for bold and "*" / "_" for italic, at the edges of words only so that snake_case
+    // and the like are left alone
+    bool closeBold = false;
+    bool closeItalic = false;
+    size_t tail = 0;
+    size_t tailMarkers = 0;
+    if (markdown) {
+      size_t first = 0;
+      while (first < word.size() && isEmphasisMarker(word[first])) {
+        first++;
+      }
+      // A word of nothing but markers is shown as it is
+      if (first < word.size()) {
+        while (!word.empty() && isEmphasisMarker(word[0])) {
+          if (word.size() >= 2 && word[1] == word[0]) {
+            bold = !bold;
+            word.remove_prefix(2);
+            wordPosition += 2;
+          } else {
+            italic = !italic;
+            word.remove_prefix(1);
+            wordPosition += 1;
+          }
+        }
+        tail = word.size();
+        while (tail > 0 && isClosingPunctuation(word[tail - 1])) {
+          tail--;
+        }
+        while (tail > tailMarkers + 1 && isEmphasisMarker(word[tail - tailMarkers - 1])) {
+          tailMarkers++;
+        }
+        if (tailMarkers >= 2) {
+          closeBold = bold;
+          closeItalic = italic && tailMarkers >= 3;
+        } else if (tailMarkers == 1) {
+          closeItalic = italic;
+        }
+        if (!closeBold && !closeItalic) {
+          tailMarkers = 0;
+        }
+      }
+    }
 
-  return !outLines.empty();
+    const auto style =
+        static_cast<EpdFontFamily::Style>(((bold || heading) ? EpdFontFamily::BOLD : EpdFontFamily::REGULAR) |
+                                          (italic ? EpdFontFamily::ITALIC : EpdFontFamily::REGULAR));
+    if (tailMarkers > 0) {
+      // The markers go, the punctuation after them stays
+      wordBuffer.assign(word.substr(0, tail - tailMarkers));
+      wordBuffer.append(word.substr(tail));
+      bold = bold && !closeBold;
+      italic = italic && !closeItalic;
+    } else {
+      wordBuffer.assign(word);
+    }
+    if (!wordBuffer.empty()) {
+      paragraph.addWord(wordBuffer.c_str(), style, false, false, wordPosition);
+    }
+  }
+  return false;
 }
 
 void TxtReaderActivity::render(RenderLock&&) {
@@ -330,7 +574,7 @@ void TxtReaderActivity::render(RenderLock&&) {
     initializeReader();
   }
 
-  if (pageOffsets.empty()) {
+  if (totalPages == 0) {
     renderer.clearScreen();
     renderer.drawCenteredText(UI_12_FONT_ID, 300, tr(STR_EMPTY_FILE), true, EpdFontFamily::BOLD);
     renderer.displayBuffer();
@@ -342,84 +586,62 @@ void TxtReaderActivity::render(RenderLock&&) {
   if (currentPage >= totalPages) currentPage = totalPages - 1;
 
   // Load current page content
-  size_t offset = pageOffsets[currentPage];
+  uint32_t offset = 0;
+  if (!getPageOffset(currentPage, offset)) {
+    LOG_ERR("TRS", "No offset for page %d", currentPage);
+  }
   size_t nextOffset;
   currentPageLines.clear();
-  loadPageAtOffset(offset, currentPageLines, nextOffset);
+  loadPageAtOffset(offset, &currentPageLines, nextOffset);
 
   renderer.clearScreen();
   renderPage();
-  renderer.clearFontCache();
+  renderer.trimFontCache();
 
   // Save progress
   saveProgress();
 }
 
 void TxtReaderActivity::renderPage() {
-  const int lineHeight = renderer.getLineHeight(cachedFontId);
-  const int contentWidth = viewportWidth;
-
-  // Render text lines with alignment
+  // The lines are laid out already, aligned and justified by ParsedText
   auto renderLines = [&]() {
     int y = cachedOrientedMarginTop;
     for (const auto& line : currentPageLines) {
-      if (!line.empty()) {
-        int x = cachedOrientedMarginLeft;
-
-        // Apply text alignment
-        switch (cachedParagraphAlignment) {
-          case CrossPointSettings::LEFT_ALIGN:
-          default:
-            // x already set to left margin
-            break;
-          case CrossPointSettings::CENTER_ALIGN: {
-            int textWidth = renderer.getTextWidth(cachedFontId, line.c_str());
-            x = cachedOrientedMarginLeft + (contentWidth - textWidth) / 2;
-            break;
-          }
-          case CrossPointSettings::RIGHT_ALIGN: {
-            int textWidth = renderer.getTextWidth(cachedFontId, line.c_str());
-            x = cachedOrientedMarginLeft + contentWidth - textWidth;
-            break;
-          }
-          case CrossPointSettings::JUSTIFIED:
-            // For plain text, justified is treated as left-aligned
-            // (true justification would require word spacing adjustments)
-            break;
-        }
-
-        renderer.drawText(cachedFontId, x, y, line.c_str());
+      if (line) {
+        line->render(renderer, cachedFontId, cachedOrientedMarginLeft, y);
       }
       y += lineHeight;
     }
   };
 
   // First pass: BW rendering
+  renderer.resetGrayPixelsDrawn();
   renderLines();
+  const bool grayPassNeeded = SETTINGS.textAntiAliasing && renderer.wereGrayPixelsDrawn();
   renderStatusBar();
 
-  if (pagesUntilFullRefresh <= 1) {
-    renderer.displayBuffer(HalDisplay::HALF_REFRESH);
-    pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
-  } else {
-    renderer.displayBuffer();
-    pagesUntilFullRefresh--;
-  }
+  renderer.displayBuffer(RefreshUtils::nextPageRefreshMode(renderer, pagesUntilFullRefresh));
 
-  // Grayscale rendering pass (for anti-aliased fonts)
-  if (SETTINGS.textAntiAliasing) {
+  // Grayscale rendering pass (for anti-aliased fonts), skipped when the text has no gray pixels
+  if (grayPassNeeded) {
     // Save BW buffer for restoration after grayscale pass
     renderer.storeBwBuffer();
 
-    renderer.clearScreen(0x00);
-    renderer.setRenderMode(GfxRenderer::GRAYSCALE_LSB);
-    renderLines();
-    renderer.copyGrayscaleLsbBuffers();
-
-    renderer.clearScreen(0x00);
-    renderer.setRenderMode(GfxRenderer::GRAYSCALE_MSB);
-    renderLines();
-    renderer.copyGrayscaleMsbBuffers();
+    if (renderer.beginGrayscaleBoth()) {
+      // Both gray planes in one pass over the lines
+      renderLines();
+      renderer.copyGrayscaleBothBuffers();
+    } else {
+      renderer.clearScreen(0x00);
+      renderer.setRenderMode(GfxRenderer::GRAYSCALE_LSB);
+      renderLines();
+      renderer.copyGrayscaleLsbBuffers();
+
+      renderer.clearScreen(0x00);
+      renderer.setRenderMode(GfxRenderer::GRAYSCALE_MSB);
+      renderLines();
+      renderer.copyGrayscaleMsbBuffers();
+    }
 
     renderer.displayGrayBuffer();
     renderer.setRenderMode(GfxRenderer::BW);
@@ -430,42 +652,37 @@ void TxtReaderActivity::renderPage() {
 }
 
 void TxtReaderActivity::renderStatusBar() const {
-  const float progress = totalPages > 0 ? (currentPage + 1) * 100.0f / totalPages : 0;
+  const int pageCount = estimatedTotalPages();
+  const float progress = pageCount > 0 ? (currentPage + 1) * 100.0f / pageCount : 0;
   std::string title;
   if (SETTINGS.statusBarTitle != CrossPointSettings::STATUS_BAR_TITLE::HIDE_TITLE) {
     title = txt->getTitle();
   }
-  GUI.drawStatusBar(renderer, progress, currentPage + 1, totalPages, title);
+  // A negative page count is shown as an estimate
+  GUI.drawStatusBar(renderer, progress, currentPage + 1, indexComplete ? pageCount : -pageCount, title);
 }
 
-void TxtReaderActivity::saveProgress() const {
-  FsFile f;
-  if (Storage.openFileForWrite("TRS", txt->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[4];
-    data[0] = currentPage & 0xFF;
-    data[1] = (currentPage >> 8) & 0xFF;
-    data[2] = 0;
-    data[3] = 0;
-    f.write(data, 4);
-    f.close();
-  }
+void TxtReaderActivity::saveProgress() {
+  uint8_t data[4];
+  data[0] = currentPage & 0xFF;
+  data[1] = (currentPage >> 8) & 0xFF;
+  data[2] = 0;
+  data[3] = 0;
+  progressJournal.record(data, sizeof(data));
 }
 
 void TxtReaderActivity::loadProgress() {
-  FsFile f;
-  if (Storage.openFileForRead("TRS", txt->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[4];
-    if (f.read(data, 4) == 4) {
-      currentPage = data[0] + (data[1] << 8);
-      if (currentPage >= totalPages) {
-        currentPage = totalPages - 1;
-      }
-      if (currentPage < 0) {
-        currentPage = 0;
-      }
-      LOG_DBG("TRS", "Loaded progress: page %d/%d", currentPage, totalPages);
+  uint8_t data[4];
+  if (progressJournal.open(txt->getCachePath(), data, sizeof(data)) == 4) {
+    currentPage = data[0] + (data[1] << 8);
+    // Past the end of an unfinished index is fine, initializeReader() indexes up to it
+    if (indexComplete && currentPage >= totalPages) {
+      currentPage = totalPages - 1;
     }
-    f.close();
+    if (currentPage < 0) {
+      currentPage = 0;
+    }
+    LOG_DBG("TRS", "Loaded progress: page %d/%d", currentPage, totalPages);
   }
 }
 
@@ -479,6 +696,8 @@ bool TxtReaderActivity::loadPageIndexCache() {
   // - int32_t: font ID (to invalidate cache on font change)
   // - int32_t: screen margin (to invalidate cache on margin change)
   // - uint8_t: paragraph alignment (to invalidate cache on alignment change)
+  // - uint8_t: hyphenation enabled (likewise)
+  // - uint8_t: whether the index is complete, or saved while it was being built
   // - uint32_t: total pages count
   // - N * uint32_t: page offsets
 
@@ -554,49 +773,107 @@ bool TxtReaderActivity::loadPageIndexCache() {
     return false;
   }
 
+  uint8_t hyphenation;
+  serialization::readPod(f, hyphenation);
+  if (hyphenation != (cachedHyphenation ? 1 : 0)) {
+    LOG_DBG("TRS", "Cache hyphenation mismatch, rebuilding");
+    f.close();
+    return false;
+  }
+
+  uint8_t complete;
+  serialization::readPod(f, complete);
+
   uint32_t numPages;
   serialization::readPod(f, numPages);
+  if (numPages == 0) {
+    LOG_DBG("TRS", "Cache has no pages, rebuilding");
+    f.close();
+    return false;
+  }
 
-  // Read page offsets
-  pageOffsets.clear();
-  pageOffsets.reserve(numPages);
+  // The count is written after the offsets, so there are never fewer offsets than it says
+  if (f.size() < CACHE_HEADER_SIZE + static_cast<size_t>(numPages) * sizeof(uint32_t)) {
+    LOG_DBG("TRS", "Cache page offsets truncated, rebuilding");
+    f.close();
+    return false;
+  }
 
-  for (uint32_t i = 0; i < numPages; i++) {
-    uint32_t offset;
-    serialization::readPod(f, offset);
-    pageOffsets.push_back(offset);
+  // Read page offsets, keeping the checkpoints and the last one
+  pageCheckpoints.clear();
+  pageCheckpoints.reserve((numPages + PAGE_CHECKPOINT_INTERVAL - 1) / PAGE_CHECKPOINT_INTERVAL);
+  uint32_t offsets[PAGE_CHECKPOINT_INTERVAL];
+  for (uint32_t first = 0; first < numPages; first += PAGE_CHECKPOINT_INTERVAL) {
+    const size_t count = std::min<size_t>(PAGE_CHECKPOINT_INTERVAL, numPages - first);
+    if (f.read(reinterpret_cast<uint8_t*>(offsets), count * sizeof(uint32_t)) !=
+        static_cast<int>(count * sizeof(uint32_t))) {
+      LOG_ERR("TRS", "Failed to read page index cache");
+      f.close();
+      return false;
+    }
+    pageCheckpoints.push_back(offsets[0]);
+    lastPageOffset = offsets[count - 1];
   }
 
   f.close();
-  totalPages = pageOffsets.size();
-  LOG_DBG("TRS", "Loaded page index cache: %d pages", totalPages);
+  windowOffsets.clear();
+  unsavedOffsets.clear();
+  totalPages = static_cast<int>(numPages);
+  savedPageCount = totalPages;
+  indexComplete = complete != 0;
+  savedIndexComplete = indexComplete;
+  LOG_DBG("TRS", "Loaded page index cache: %d pages%s", totalPages, indexComplete ? "" : " so far");
   return true;
 }
 
-void TxtReaderActivity::savePageIndexCache() const {
+// Appends the pages found since the last save to the index file, then updates its header
+void TxtReaderActivity::savePageIndexCache() {
   std::string cachePath = txt->getCachePath() + "/index.bin";
   FsFile f;
-  if (!Storage.openFileForWrite("TRS", cachePath, f)) {
-    LOG_ERR("TRS", "Failed to save page index cache");
-    return;
-  }
+  bool ok;
+  if (savedPageCount == 0) {
+    if (!Storage.openFileForWrite("TRS", cachePath, f)) {
+      LOG_ERR("TRS", "Failed to save page index cache");
+      return;
+    }
 
-  // Write header using serialization module
-  serialization::writePod(f, CACHE_MAGIC);
-  serialization::writePod(f, CACHE_VERSION);
-  serialization::writePod(f, static_cast<uint32_t>(txt->getFileSize()));
-  serialization::writePod(f, static_cast<int32_t>(viewportWidth));
-  serialization::writePod(f, static_cast<int32_t>(linesPerPage));
-  serialization::writePod(f, static_cast<int32_t>(cachedFontId));
-  serialization::writePod(f, static_cast<int32_t>(cachedScreenMargin));
-  serialization::writePod(f, cachedParagraphAlignment);
-  serialization::writePod(f, static_cast<uint32_t>(pageOffsets.size()));
+    // Write header using serialization module
+    serialization::writePod(f, CACHE_MAGIC);
+    serialization::writePod(f, CACHE_VERSION);
+    serialization::writePod(f, static_cast<uint32_t>(txt->getFileSize()));
+    serialization::writePod(f, static_cast<int32_t>(viewportWidth));
+    serialization::writePod(f, static_cast<int32_t>(linesPerPage));
+    serialization::writePod(f, static_cast<int32_t>(cachedFontId));
+    serialization::writePod(f, static_cast<int32_t>(cachedScreenMargin));
+    serialization::writePod(f, cachedParagraphAlignment);
+    serialization::writePod(f, static_cast<uint8_t>(cachedHyphenation ? 1 : 0));
+    ok = f.position() == CACHE_COMPLETE_POS;
+    // Not complete and no pages yet, until the offsets are in
+    serialization::writePod(f, static_cast<uint8_t>(0));
+    serialization::writePod(f, static_cast<uint32_t>(0));
+  } else {
+    f = Storage.open(cachePath.c_str(), O_RDWR);
+    ok = static_cast<bool>(f);
+  }
 
-  // Write page offsets
-  for (size_t offset : pageOffsets) {
-    serialization::writePod(f, static_cast<uint32_t>(offset));
+  // Count the new pages only once their offsets are written
+  const size_t bytes = unsavedOffsets.size() * sizeof(uint32_t);
+  ok = ok && f.seek(CACHE_HEADER_SIZE + savedPageCount * sizeof(uint32_t)) &&
+       f.write(reinterpret_cast<const uint8_t*>(unsavedOffsets.data()), bytes) == bytes && f.seek(CACHE_COMPLETE_POS);
+  if (ok) {
+    serialization::writePod(f, static_cast<uint8_t>(indexComplete ? 1 : 0));
+    serialization::writePod(f, static_cast<uint32_t>(totalPages));
+  }
+  if (f) {
+    f.close();
+  }
+  if (!ok) {
+    LOG_ERR("TRS", "Failed to save page index cache");
+    return;
   }
 
-  f.close();
-  LOG_DBG("TRS", "Saved page index cache: %d pages", totalPages);
+  savedPageCount = totalPages;
+  savedIndexComplete = indexComplete;
+  unsavedOffsets.clear();
+  LOG_DBG("TRS", "Saved page index cache: %d pages%s", totalPages, indexComplete ? "" : " so far");
 }
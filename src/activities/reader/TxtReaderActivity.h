@@ -1,30 +1,58 @@
 #pragma once
 
+#include <Epub/HyphenationCache.h>
+#include <Epub/WordWidthCache.h>
+#include <Epub/blocks/BlockStyle.h>
+#include <Epub/blocks/TextBlock.h>
 #include <Txt.h>
 
+#include <string_view>
 #include <vector>
 
 #include "CrossPointSettings.h"
+#include "ProgressJournal.h"
 #include "activities/Activity.h"
 
+class ParsedText;
+
 class TxtReaderActivity final : public Activity {
   std::unique_ptr<Txt> txt;
 
   int currentPage = 0;
   int totalPages = 1;
   int pagesUntilFullRefresh = 0;
+  ProgressJournal progressJournal;
 
-  // Streaming text reader - stores file offsets for each page
-  std::vector<size_t> pageOffsets;  // File offset for start of each page
-  std::vector<std::string> currentPageLines;
+  // Streaming text reader - the file offset of every page is in the index file. RAM only holds the offset of every
+  // PAGE_CHECKPOINT_INTERVAL-th page, those of the interval being read, and those found since the index was saved.
+  std::vector<uint32_t> pageCheckpoints;
+  std::vector<uint32_t> windowOffsets;  // Pages from windowFirstPage on
+  int windowFirstPage = 0;
+  std::vector<uint32_t> unsavedOffsets;  // Pages from savedPageCount on
+  int savedPageCount = 0;                // Pages in the index file
+  bool savedIndexComplete = false;
+  // The index is built while reading: until it's complete, the last known page is the one laid out next
+  uint32_t lastPageOffset = 0;
+  bool indexComplete = false;
+  // Lines of the page shown, laid out like an EPUB's by ParsedText; null for a blank line
+  std::vector<TextBlock::Ptr> currentPageLines;
+  std::string wordBuffer;  // The word being added, kept to reuse its capacity
   int linesPerPage = 0;
+  int lineHeight = 0;
   int viewportWidth = 0;
   bool initialized = false;
+  // .md files: # headings, list bullets and * / ** emphasis are styled instead of shown
+  bool markdown = false;
+  BlockStyle paragraphStyle;
+  // Kept across pages, the same words and splits keep coming up
+  WordWidthCache widthCache;
+  HyphenationCache hyphenationCache;
 
   // Cached settings for cache validation (different fonts/margins require re-indexing)
   int cachedFontId = 0;
   uint8_t cachedScreenMargin = 0;
   uint8_t cachedParagraphAlignment = CrossPointSettings::LEFT_ALIGN;
+  bool cachedHyphenation = false;
   int cachedOrientedMarginTop = 0;
   int cachedOrientedMarginRight = 0;
   int cachedOrientedMarginBottom = 0;
@@ -34,11 +62,26 @@ class TxtReaderActivity final : public Activity {
   void renderStatusBar() const;
 
   void initializeReader();
-  bool loadPageAtOffset(size_t offset, std::vector<std::string>& outLines, size_t& nextOffset);
-  void buildPageIndex();
+  // Lays out the page starting at offset. outLines may be null when only where the next page starts is needed.
+  bool loadPageAtOffset(size_t offset, std::vector<TextBlock::Ptr>* outLines, size_t& nextOffset);
+  // Lays out the source line at position as one paragraph, adding its lines to the page. False if the page filled up
+  // or the line runs past the read window, with where the next page starts in resumePosition.
+  bool layoutParagraph(std::string_view line, uint32_t position, bool complete, int& lineCount,
+                       std::vector<TextBlock::Ptr>* outLines, uint32_t& resumePosition);
+  // Adds the words of line to paragraph, in Markdown styles for .md files. True if some were left out, the last one
+  // when the read window cut it off, or those past a layout window; cutPosition is then where they start.
+  bool addParagraphWords(ParsedText& paragraph, std::string_view line, uint32_t position, bool complete,
+                         uint32_t& cutPosition);
+  void resetPageIndex();
+  void addPage(uint32_t offset);
+  bool getPageOffset(int page, uint32_t& offset);
+  bool loadPageWindow(int interval);
+  void extendPageIndex(size_t pageCount);
+  void checkpointPageIndex();
+  int estimatedTotalPages() const;
   bool loadPageIndexCache();
-  void savePageIndexCache() const;
-  void saveProgress() const;
+  void savePageIndexCache();
+  void saveProgress();
   void loadProgress();
 
  public:
@@ -49,4 +92,5 @@ class TxtReaderActivity final : public Activity {
   void loop() override;
   void render(RenderLock&&) override;
   bool isReaderActivity() const override { return true; }
+  bool skipLoopDelay() override { return initialized && !indexComplete; }
 };
@@ -12,17 +12,24 @@
 #include <HalStorage.h>
 #include <I18n.h>
 
+#include <algorithm>
+#include <cstring>
+
+#include "CacheBudget.h"
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
 #include "MappedInputManager.h"
+#include "MemoryBudget.h"
 #include "RecentBooksStore.h"
 #include "XtcReaderChapterSelectionActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
+#include "util/RefreshUtils.h"
 
 namespace {
 constexpr unsigned long skipPageMs = 700;
 constexpr unsigned long goHomeMs = 1000;
+constexpr size_t prefetchChunkSize = 2048;
 }  // namespace
 
 void XtcReaderActivity::onEnter() {
@@ -41,6 +48,8 @@ void XtcReaderActivity::onEnter() {
   APP_STATE.openEpubPath = xtc->getPath();
   APP_STATE.saveToFile();
   RECENT_BOOKS.addBook(xtc->getPath(), xtc->getTitle(), xtc->getAuthor(), xtc->getThumbBmpPath());
+  CACHE_BUDGET.touch(xtc->getCachePath());
+  MEMORY_BUDGET.setMode(MemoryBudget::Reading);
 
   // Trigger first update
   requestUpdate();
@@ -48,13 +57,24 @@ void XtcReaderActivity::onEnter() {
 
 void XtcReaderActivity::onExit() {
   Activity::onExit();
+  MEMORY_BUDGET.setMode(MemoryBudget::Browsing);
 
   APP_STATE.readerActivityLoadCount = 0;
   APP_STATE.saveToFile();
+  progressJournal.close();
+  for (auto& stash : pageStashes) {
+    stash.release();
+  }
   xtc.reset();
 }
 
 void XtcReaderActivity::loop() {
+  // The render task holds the lock through a refresh; a due save is rare enough to wait for it
+  if (progressJournal.isFlushDue()) {
+    RenderLock lock(*this);
+    progressJournal.flush();
+  }
+
   // Enter chapter selection activity
   if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
     if (xtc && xtc->hasChapters() && !xtc->getChapters().empty()) {
@@ -95,6 +115,7 @@ void XtcReaderActivity::loop() {
                                     mappedInput.wasReleased(MappedInputManager::Button::Right));
 
   if (!prevTriggered && !nextTriggered) {
+    prefetchPage();
     return;
   }
 
@@ -108,6 +129,7 @@ void XtcReaderActivity::loop() {
   const bool skipPages = SETTINGS.longPressChapterSkip && mappedInput.getHeldTime() > skipPageMs;
   const int skipAmount = skipPages ? 10 : 1;
 
+  turnDirection = prevTriggered ? -1 : 1;
   if (prevTriggered) {
     if (currentPage >= static_cast<uint32_t>(skipAmount)) {
       currentPage -= skipAmount;
@@ -139,10 +161,200 @@ void XtcReaderActivity::render(RenderLock&&) {
   }
 
   renderPage();
+  waitForPrefetch();
   saveProgress();
 }
 
+bool XtcReaderActivity::streamsPages() const {
+  return renderer.getOrientation() == GfxRenderer::Portrait && xtc->getPageWidth() == HalDisplay::DISPLAY_HEIGHT &&
+         xtc->getPageHeight() == HalDisplay::DISPLAY_WIDTH;
+}
+
+size_t XtcReaderActivity::pageBitmapSize() const {
+  return xtc->getBitDepth() == 2 ? HalDisplay::BUFFER_SIZE * 2 : HalDisplay::BUFFER_SIZE;
+}
+
+void XtcReaderActivity::prefetchPage() {
+  // Only while the panel refreshes, when the render task waits on it and leaves the card alone
+  if (!xtc || !renderer.isDisplayBusy() || !streamsPages()) {
+    return;
+  }
+  const int64_t page = static_cast<int64_t>(currentPage) + turnDirection;
+  if (page < 0 || page >= xtc->getPageCount()) {
+    return;
+  }
+  xtc::PageStash& stash = pageStashes[1 - shownStash];
+  if (stash.holds(static_cast<uint32_t>(page))) {
+    return;
+  }
+
+  // Announced before the display is checked again: if render() got past waitForPrefetch() in between, the refresh is
+  // over and nothing is read
+  prefetching = true;
+  if (renderer.isDisplayBusy() && stash.begin(static_cast<uint32_t>(page))) {
+    const xtc::XtcError error = xtc->loadPageStreaming(
+        static_cast<uint32_t>(page),
+        [&stash](const uint8_t* data, const size_t size, size_t) { stash.append(data, size); }, prefetchChunkSize);
+    if (error == xtc::XtcError::OK) {
+      stash.finish(pageBitmapSize());
+    } else {
+      stash.clear();
+    }
+  }
+  prefetching = false;
+}
+
+void XtcReaderActivity::waitForPrefetch() const {
+  while (prefetching) {
+    delay(1);
+  }
+}
+
 void XtcReaderActivity::renderPage() {
+  // XTC/XTCH pages are pre-rendered with status bar included, so render full page. Pages the size of the screen are
+  // streamed into the frame buffer a few rows at a time, anything else is loaded whole and copied with drawPixel.
+  if (streamsPages()) {
+    renderStreamedPage();
+  } else {
+    renderBufferedPage();
+  }
+}
+
+void XtcReaderActivity::renderLoadError(const char* message) const {
+  renderer.clearScreen();
+  renderer.drawCenteredText(UI_12_FONT_ID, 300, message, true, EpdFontFamily::BOLD);
+  renderer.displayBuffer();
+}
+
+bool XtcReaderActivity::streamPagePlanes(const GfxRenderer::PlaneOp firstPlaneOp,
+                                         const GfxRenderer::PlaneOp secondPlaneOp) {
+  // XTG (1-bit): one plane, row-major in portrait (60 bytes per row)
+  // XTH (2-bit): two planes, column-major with columns right to left, which in portrait are panel rows (100 bytes)
+  const bool twoPlanes = xtc->getBitDepth() == 2;
+  const GfxRenderer::Orientation layout =
+      twoPlanes ? GfxRenderer::LandscapeCounterClockwise : GfxRenderer::Portrait;
+  const size_t stride = twoPlanes ? HalDisplay::DISPLAY_WIDTH_BYTES : HalDisplay::DISPLAY_HEIGHT / 8;
+  const size_t planeSize = HalDisplay::BUFFER_SIZE;
+
+  // Chunks are gathered into blocks of STREAM_BLOCK_ROWS plane rows, whichever way the reads split them. A plane is
+  // a whole number of blocks.
+  uint8_t block[STREAM_BLOCK_ROWS * HalDisplay::DISPLAY_WIDTH_BYTES];
+  const size_t blockSize = STREAM_BLOCK_ROWS * stride;
+  const size_t bitmapSize = pageBitmapSize();
+  size_t blockStart = 0;
+  size_t filled = 0;
+  bool ok = true;
+
+  const auto blitChunk = [&](const uint8_t* data, size_t size, size_t) {
+    while (size > 0 && ok) {
+      const size_t n = std::min(size, blockSize - filled);
+      memcpy(block + filled, data, n);
+      filled += n;
+      data += n;
+      size -= n;
+      if (filled < blockSize) {
+        break;
+      }
+      if (blockStart >= bitmapSize) {
+        ok = false;
+        break;
+      }
+      const GfxRenderer::PlaneOp op = blockStart < planeSize ? firstPlaneOp : secondPlaneOp;
+      const int row = static_cast<int>((blockStart % planeSize) / stride);
+      ok = renderer.blitPlane1Bit(block, stride, layout, op, row, STREAM_BLOCK_ROWS);
+      blockStart += blockSize;
+      filled = 0;
+    }
+  };
+
+  xtc::PageStash& stash = pageStashes[shownStash];
+  xtc::XtcError error = xtc::XtcError::OK;
+  if (stash.holds(currentPage)) {
+    stash.replay(blitChunk);
+  } else {
+    const bool stashing = stash.begin(currentPage);
+    error = xtc->loadPageStreaming(
+        currentPage,
+        [&](const uint8_t* data, const size_t size, const size_t offset) {
+          if (stashing) {
+            stash.append(data, size);
+          }
+          blitChunk(data, size, offset);
+        },
+        blockSize);
+    if (error == xtc::XtcError::OK) {
+      stash.finish(bitmapSize);
+    } else {
+      stash.clear();
+    }
+  }
+
+  if (error != xtc::XtcError::OK || !ok || blockStart != bitmapSize || filled != 0) {
+    LOG_ERR("XTR", "Failed to stream page %lu (error %d, %zu of %zu bytes)", currentPage, static_cast<int>(error),
+            blockStart + filled, bitmapSize);
+    return false;
+  }
+  return true;
+}
+
+void XtcReaderActivity::renderStreamedPage() {
+  waitForPrefetch();
+  // Turned to the prefetched page
+  if (!pageStashes[shownStash].holds(currentPage) && pageStashes[1 - shownStash].holds(currentPage)) {
+    shownStash = 1 - shownStash;
+  }
+
+  if (xtc->getBitDepth() != 2) {
+    // XTC: 0 = black, 1 = white, like the frame buffer
+    if (!streamPagePlanes(GfxRenderer::PlaneOp::Copy)) {
+      renderLoadError(tr(STR_PAGE_LOAD_ERROR));
+      return;
+    }
+    renderer.displayBuffer(RefreshUtils::nextPageRefreshMode(renderer, pagesUntilFullRefresh));
+    LOG_DBG("XTR", "Rendered page %lu/%lu (1-bit)", currentPage + 1, xtc->getPageCount());
+    return;
+  }
+
+  // XTH pixel value = (bit1 << 1) | bit2: 0=White, 1=Dark Grey, 2=Light Grey, 3=Black. Each pass streams both
+  // planes, copying the first into the frame buffer and merging the second into it, so no page buffer is needed.
+  // The first pass stashes the page on the way, the others replay it from RAM if it fitted.
+
+  // Pass 1: BW buffer - all non-white pixels black, ~(bit1 | bit2)
+  if (!streamPagePlanes(GfxRenderer::PlaneOp::Copy, GfxRenderer::PlaneOp::Nor)) {
+    renderLoadError(tr(STR_PAGE_LOAD_ERROR));
+    return;
+  }
+
+  // Display BW, with a half refresh once enough pixels have changed since the last one
+  renderer.displayBuffer(RefreshUtils::nextPageRefreshMode(renderer, pagesUntilFullRefresh));
+  waitForPrefetch();
+
+  // Pass 2: LSB buffer - mark DARK gray only (XTH value 1), ~bit1 & bit2
+  // Pass 3: MSB buffer - mark LIGHT AND DARK gray (XTH value 1 or 2), bit1 ^ bit2
+  // In LUT: 0 bit = apply gray effect, 1 bit = untouched. If either can't be read the page stays black and white.
+  if (streamPagePlanes(GfxRenderer::PlaneOp::Invert, GfxRenderer::PlaneOp::And)) {
+    renderer.copyGrayscaleLsbBuffers();
+    if (streamPagePlanes(GfxRenderer::PlaneOp::Copy, GfxRenderer::PlaneOp::Xor)) {
+      renderer.copyGrayscaleMsbBuffers();
+      // Display grayscale overlay
+      renderer.displayGrayBuffer();
+      waitForPrefetch();
+    }
+  }
+
+  // Pass 4: Re-render BW to framebuffer (restore for next frame, instead of restoreBwBuffer)
+  if (!streamPagePlanes(GfxRenderer::PlaneOp::Copy, GfxRenderer::PlaneOp::Nor)) {
+    renderLoadError(tr(STR_PAGE_LOAD_ERROR));
+    return;
+  }
+
+  // Cleanup grayscale buffers with current frame buffer
+  renderer.cleanupGrayscaleWithFrameBuffer();
+
+  LOG_DBG("XTR", "Rendered page %lu/%lu (2-bit grayscale)", currentPage + 1, xtc->getPageCount());
+}
+
+void XtcReaderActivity::renderBufferedPage() {
   const uint16_t pageWidth = xtc->getPageWidth();
   const uint16_t pageHeight = xtc->getPageHeight();
   const uint8_t bitDepth = xtc->getBitDepth();
@@ -161,9 +373,7 @@ void XtcReaderActivity::renderPage() {
   uint8_t* pageBuffer = static_cast<uint8_t*>(malloc(pageBufferSize));
   if (!pageBuffer) {
     LOG_ERR("XTR", "Failed to allocate page buffer (%lu bytes)", pageBufferSize);
-    renderer.clearScreen();
-    renderer.drawCenteredText(UI_12_FONT_ID, 300, tr(STR_MEMORY_ERROR), true, EpdFontFamily::BOLD);
-    renderer.displayBuffer();
+    renderLoadError(tr(STR_MEMORY_ERROR));
     return;
   }
 
@@ -172,9 +382,7 @@ void XtcReaderActivity::renderPage() {
   if (bytesRead == 0) {
     LOG_ERR("XTR", "Failed to load page %lu", currentPage);
     free(pageBuffer);
-    renderer.clearScreen();
-    renderer.drawCenteredText(UI_12_FONT_ID, 300, tr(STR_PAGE_LOAD_ERROR), true, EpdFontFamily::BOLD);
-    renderer.displayBuffer();
+    renderLoadError(tr(STR_PAGE_LOAD_ERROR));
     return;
   }
 
@@ -182,9 +390,6 @@ void XtcReaderActivity::renderPage() {
   renderer.clearScreen();
 
   // Copy page bitmap using GfxRenderer's drawPixel
-  // XTC/XTCH pages are pre-rendered with status bar included, so render full page
-  const uint16_t maxSrcY = pageHeight;
-
   if (bitDepth == 2) {
     // XTH 2-bit mode: Two bit planes, column-major order
     // - Columns scanned right to left (x = width-1 down to 0)
@@ -209,60 +414,48 @@ void XtcReaderActivity::renderPage() {
       return (bit1 << 1) | bit2;
     };
 
+    // One pass into the cleared frame buffer: the pixels whose value isDrawn() accepts, drawn with state
+    auto drawPass = [&](auto isDrawn, const bool state) {
+      for (uint16_t y = 0; y < pageHeight; y++) {
+        for (uint16_t x = 0; x < pageWidth; x++) {
+          if (isDrawn(getPixelValue(x, y))) {
+            renderer.drawPixel(x, y, state);
+          }
+        }
+      }
+    };
+    const auto isInked = [](const uint8_t pv) { return pv >= 1; };
+
     // Optimized grayscale rendering without storeBwBuffer (saves 48KB peak memory)
     // Flow: BW display → LSB/MSB passes → grayscale display → re-render BW for next frame
 
     // Count pixel distribution for debugging
     uint32_t pixelCounts[4] = {0, 0, 0, 0};
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        pixelCounts[getPixelValue(x, y)]++;
-      }
+    for (size_t i = 0; i < planeSize; i++) {
+      pixelCounts[1] += __builtin_popcount(~plane1[i] & plane2[i] & 0xFF);
+      pixelCounts[2] += __builtin_popcount(plane1[i] & ~plane2[i] & 0xFF);
+      pixelCounts[3] += __builtin_popcount(plane1[i] & plane2[i]);
     }
+    pixelCounts[0] = planeSize * 8 - pixelCounts[1] - pixelCounts[2] - pixelCounts[3];
     LOG_DBG("XTR", "Pixel distribution: White=%lu, DarkGrey=%lu, LightGrey=%lu, Black=%lu", pixelCounts[0],
             pixelCounts[1], pixelCounts[2], pixelCounts[3]);
 
     // Pass 1: BW buffer - draw all non-white pixels as black
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        if (getPixelValue(x, y) >= 1) {
-          renderer.drawPixel(x, y, true);
-        }
-      }
-    }
+    drawPass(isInked, true);
 
-    // Display BW with conditional refresh based on pagesUntilFullRefresh
-    if (pagesUntilFullRefresh <= 1) {
-      renderer.displayBuffer(HalDisplay::HALF_REFRESH);
-      pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
-    } else {
-      renderer.displayBuffer();
-      pagesUntilFullRefresh--;
-    }
+    // Display BW, with a half refresh once enough pixels have changed since the last one
+    renderer.displayBuffer(RefreshUtils::nextPageRefreshMode(renderer, pagesUntilFullRefresh));
 
     // Pass 2: LSB buffer - mark DARK gray only (XTH value 1)
     // In LUT: 0 bit = apply gray effect, 1 bit = untouched
     renderer.clearScreen(0x00);
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        if (getPixelValue(x, y) == 1) {  // Dark grey only
-          renderer.drawPixel(x, y, false);
-        }
-      }
-    }
+    drawPass([](const uint8_t pv) { return pv == 1; }, false);  // Dark grey only
     renderer.copyGrayscaleLsbBuffers();
 
     // Pass 3: MSB buffer - mark LIGHT AND DARK gray (XTH value 1 or 2)
     // In LUT: 0 bit = apply gray effect, 1 bit = untouched
     renderer.clearScreen(0x00);
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        const uint8_t pv = getPixelValue(x, y);
-        if (pv == 1 || pv == 2) {  // Dark grey or Light grey
-          renderer.drawPixel(x, y, false);
-        }
-      }
-    }
+    drawPass([](const uint8_t pv) { return pv == 1 || pv == 2; }, false);
     renderer.copyGrayscaleMsbBuffers();
 
     // Display grayscale overlay
@@ -270,13 +463,7 @@ void XtcReaderActivity::renderPage() {
 
     // Pass 4: Re-render BW to framebuffer (restore for next frame, instead of restoreBwBuffer)
     renderer.clearScreen();
-    for (uint16_t y = 0; y < pageHeight; y++) {
-      for (uint16_t x = 0; x < pageWidth; x++) {
-        if (getPixelValue(x, y) >= 1) {
-          renderer.drawPixel(x, y, true);
-        }
-      }
-    }
+    drawPass(isInked, true);
 
     // Cleanup grayscale buffers with current frame buffer
     renderer.cleanupGrayscaleWithFrameBuffer();
@@ -289,7 +476,7 @@ void XtcReaderActivity::renderPage() {
     // 1-bit mode: 8 pixels per byte, MSB first
     const size_t srcRowBytes = (pageWidth + 7) / 8;  // 60 bytes for 480 width
 
-    for (uint16_t srcY = 0; srcY < maxSrcY; srcY++) {
+    for (uint16_t srcY = 0; srcY < pageHeight; srcY++) {
       const size_t srcRowStart = srcY * srcRowBytes;
 
       for (uint16_t srcX = 0; srcX < pageWidth; srcX++) {
@@ -311,43 +498,29 @@ void XtcReaderActivity::renderPage() {
   // XTC pages already have status bar pre-rendered, no need to add our own
 
   // Display with appropriate refresh
-  if (pagesUntilFullRefresh <= 1) {
-    renderer.displayBuffer(HalDisplay::HALF_REFRESH);
-    pagesUntilFullRefresh = SETTINGS.getRefreshFrequency();
-  } else {
-    renderer.displayBuffer();
-    pagesUntilFullRefresh--;
-  }
+  renderer.displayBuffer(RefreshUtils::nextPageRefreshMode(renderer, pagesUntilFullRefresh));
 
   LOG_DBG("XTR", "Rendered page %lu/%lu (%u-bit)", currentPage + 1, xtc->getPageCount(), bitDepth);
 }
 
-void XtcReaderActivity::saveProgress() const {
-  FsFile f;
-  if (Storage.openFileForWrite("XTR", xtc->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[4];
-    data[0] = currentPage & 0xFF;
-    data[1] = (currentPage >> 8) & 0xFF;
-    data[2] = (currentPage >> 16) & 0xFF;
-    data[3] = (currentPage >> 24) & 0xFF;
-    f.write(data, 4);
-    f.close();
-  }
+void XtcReaderActivity::saveProgress() {
+  uint8_t data[4];
+  data[0] = currentPage & 0xFF;
+  data[1] = (currentPage >> 8) & 0xFF;
+  data[2] = (currentPage >> 16) & 0xFF;
+  data[3] = (currentPage >> 24) & 0xFF;
+  progressJournal.record(data, sizeof(data));
 }
 
 void XtcReaderActivity::loadProgress() {
-  FsFile f;
-  if (Storage.openFileForRead("XTR", xtc->getCachePath() + "/progress.bin", f)) {
-    uint8_t data[4];
-    if (f.read(data, 4) == 4) {
-      currentPage = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
-      LOG_DBG("XTR", "Loaded progress: page %lu", currentPage);
-
-      // Validate page number
-      if (currentPage >= xtc->getPageCount()) {
-        currentPage = 0;
-      }
+  uint8_t data[4];
+  if (progressJournal.open(xtc->getCachePath(), data, sizeof(data)) == 4) {
+    currentPage = data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+    LOG_DBG("XTR", "Loaded progress: page %lu", currentPage);
+
+    // Validate page number
+    if (currentPage >= xtc->getPageCount()) {
+      currentPage = 0;
     }
-    f.close();
   }
 }
@@ -7,8 +7,13 @@
 
 #pragma once
 
+#include <GfxRenderer.h>
 #include <Xtc.h>
+#include <Xtc/XtcPageStash.h>
 
+#include <atomic>
+
+#include "ProgressJournal.h"
 #include "activities/Activity.h"
 
 class XtcReaderActivity final : public Activity {
@@ -16,9 +21,32 @@ class XtcReaderActivity final : public Activity {
 
   uint32_t currentPage = 0;
   int pagesUntilFullRefresh = 0;
+  int turnDirection = 1;  // The way the last page turn went, the page after it is prefetched
+  ProgressJournal progressJournal;
+
+  // The shown page, so XTCH passes after the first are replayed from RAM, and the next one, read by loop() while the
+  // panel refreshes. render() only reads the card or touches the stashes once no prefetch is running; the prefetch
+  // only starts while the panel is busy, when render() is waiting on it.
+  xtc::PageStash pageStashes[2];
+  uint8_t shownStash = 0;
+  std::atomic<bool> prefetching{false};
+
+  // Plane rows gathered per blit while streaming a page
+  static constexpr int STREAM_BLOCK_ROWS = 8;
 
+  bool streamsPages() const;
+  size_t pageBitmapSize() const;
+  void prefetchPage();
+  void waitForPrefetch() const;
   void renderPage();
-  void saveProgress() const;
+  void renderStreamedPage();
+  void renderBufferedPage();
+  void renderLoadError(const char* message) const;
+  // Streams the current page into the frame buffer, its first plane merged with firstPlaneOp and the second (XTH)
+  // with secondPlaneOp. Read from the shown stash if it holds the page, else from the card and stashed on the way.
+  bool streamPagePlanes(GfxRenderer::PlaneOp firstPlaneOp,
+                        GfxRenderer::PlaneOp secondPlaneOp = GfxRenderer::PlaneOp::Copy);
+  void saveProgress();
   void loadProgress();
 
  public:
@@ -0,0 +1,496 @@
+#include "BenchmarkActivity.h"
+
+#include <ArduinoJson.h>
+#include <Epub.h>
+#include <Epub/Page.h>
+#include <Epub/Section.h>
+#include <Epub/converters/ImageDecoderFactory.h>
+#include <Epub/converters/ImageSource.h>
+#include <GfxRenderer.h>
+#include <HalStorage.h>
+#include <I18n.h>
+#include <Logging.h>
+#include <ZipFile.h>
+#include <esp_task_wdt.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "CrossPointSettings.h"
+#include "MappedInputManager.h"
+#include "components/UITheme.h"
+#include "fontIds.h"
+
+namespace {
+constexpr char BENCH_DIR[] = "/.crosspoint/bench";
+constexpr char SD_TEST_FILE[] = "/.crosspoint/bench/sd.tmp";
+// The books of test/epubs, copied to this folder of the SD card
+constexpr char BOOKS_DIR[] = "/bench/";
+constexpr const char* BENCH_BOOKS[] = {"test_kerning_ligature.epub", "test_tables.epub", "test_mixed_images.epub",
+                                       "test_jpeg_images.epub", "test_png_images.epub"};
+constexpr char TEXT_BOOK[] = "test_kerning_ligature.epub";
+
+constexpr size_t SD_BLOCK_SIZE = 4096;
+constexpr size_t SD_FILE_SIZE = 1024 * 1024;
+constexpr size_t SD_BLOCK_COUNT = SD_FILE_SIZE / SD_BLOCK_SIZE;
+constexpr int SD_RANDOM_OPS = 256;
+
+constexpr int INFLATE_ROUNDS = 10;
+constexpr int GLYPH_LINES = 40;
+constexpr char GLYPH_SAMPLE[] = "The quick brown fox jumps over the lazy dog 0123456789";
+constexpr int PAGE_TURNS = 10;
+
+// Fixed layout, so results don't move with the reader settings
+constexpr int BENCH_MARGIN = 20;
+constexpr int BENCH_FONT_ID = BOOKERLY_14_FONT_ID;
+constexpr float BENCH_LINE_COMPRESSION = 1.0f;
+constexpr uint32_t BUILD_SLICE_MS = 500;
+
+struct BenchFont {
+  const char* name;
+  int id;
+};
+
+constexpr BenchFont BENCH_FONTS[] = {
+    {"bookerly_14", BOOKERLY_14_FONT_ID},
+#ifndef OMIT_FONTS
+    {"bookerly_12", BOOKERLY_12_FONT_ID},
+    {"bookerly_16", BOOKERLY_16_FONT_ID},
+    {"bookerly_18", BOOKERLY_18_FONT_ID},
+    {"notosans_12", NOTOSANS_12_FONT_ID},
+    {"notosans_14", NOTOSANS_14_FONT_ID},
+    {"notosans_16", NOTOSANS_16_FONT_ID},
+    {"notosans_18", NOTOSANS_18_FONT_ID},
+    {"opendyslexic_8", OPENDYSLEXIC_8_FONT_ID},
+    {"opendyslexic_10", OPENDYSLEXIC_10_FONT_ID},
+    {"opendyslexic_12", OPENDYSLEXIC_12_FONT_ID},
+    {"opendyslexic_14", OPENDYSLEXIC_14_FONT_ID},
+#endif  // OMIT_FONTS
+    {"ui_10", UI_10_FONT_ID},
+    {"ui_12", UI_12_FONT_ID},
+    {"small", SMALL_FONT_ID},
+};
+
+struct BenchImage {
+  const char* book;
+  const char* entry;
+  const char* key;
+};
+
+constexpr BenchImage BENCH_IMAGES[] = {
+    {"test_jpeg_images.epub", "OEBPS/images/scaling_test.jpg", "decode_scaling_jpg"},
+    {"test_jpeg_images.epub", "OEBPS/images/wide_scaling_test.jpg", "decode_wide_scaling_jpg"},
+    {"test_png_images.epub", "OEBPS/images/scaling_test.png", "decode_scaling_png"},
+    {"test_png_images.epub", "OEBPS/images/wide_scaling_test.png", "decode_wide_scaling_png"},
+};
+
+// Counts what is written to it and drops it
+class NullPrint final : public Print {
+ public:
+  size_t count = 0;
+  size_t write(const uint8_t) override {
+    count++;
+    return 1;
+  }
+  size_t write(const uint8_t*, const size_t size) override {
+    count += size;
+    return size;
+  }
+};
+
+// Same sequence on every run, so the random SD offsets are comparable between versions
+uint32_t nextRandom(uint32_t* state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 8;
+}
+
+float kilobytesPerSecond(const size_t bytes, const unsigned long us) {
+  return us > 0 ? static_cast<float>(bytes) / 1024.0f / (static_cast<float>(us) / 1000000.0f) : 0.0f;
+}
+
+std::string bookPath(const char* name) { return std::string(BOOKS_DIR) + name; }
+
+std::string bookKey(const char* name) {
+  std::string key(name);
+  const auto dot = key.rfind('.');
+  return dot == std::string::npos ? key : key.substr(0, dot);
+}
+
+std::shared_ptr<Epub> loadBook(const char* name) {
+  const std::string path = bookPath(name);
+  if (!Storage.exists(path.c_str())) {
+    LOG_DBG("BENCH", "%s missing, skipped", path.c_str());
+    return nullptr;
+  }
+  auto epub = std::make_shared<Epub>(path, "/.crosspoint");
+  if (!epub->load(true, false)) {
+    LOG_ERR("BENCH", "Failed to load %s", path.c_str());
+    return nullptr;
+  }
+  return epub;
+}
+
+void getViewport(const GfxRenderer& renderer, uint16_t* width, uint16_t* height) {
+  *width = static_cast<uint16_t>(renderer.getScreenWidth() - 2 * BENCH_MARGIN);
+  *height = static_cast<uint16_t>(renderer.getScreenHeight() - 2 * BENCH_MARGIN);
+}
+}  // namespace
+
+const BenchmarkActivity::Step BenchmarkActivity::STEPS[] = {
+    {"SD", &BenchmarkActivity::benchSd},
+    {"Inflate", &BenchmarkActivity::benchInflate},
+    {"Glyphs", &BenchmarkActivity::benchGlyphs},
+    {"Sections", &BenchmarkActivity::benchSections},
+    {"Images", &BenchmarkActivity::benchImages},
+    {"Page turns", &BenchmarkActivity::benchPageTurns},
+};
+const size_t BenchmarkActivity::STEP_COUNT = sizeof(STEPS) / sizeof(STEPS[0]);
+
+void BenchmarkActivity::onEnter() {
+  Activity::onEnter();
+
+  state = WARNING;
+  step = 0;
+  results.clear();
+  requestUpdate();
+}
+
+void BenchmarkActivity::onExit() { Activity::onExit(); }
+
+void BenchmarkActivity::addResult(std::string key, const float value, const char* unit) {
+  LOG_INF("BENCH", "%s: %.2f %s", key.c_str(), value, unit);
+  results.push_back({std::move(key), value, unit});
+}
+
+void BenchmarkActivity::loop() {
+  if (state == RUNNING) {
+    if (step < STEP_COUNT) {
+      // Show the step about to run; the renderer is then held for the whole step
+      requestUpdateAndWait();
+      {
+        RenderLock lock(*this);
+        (this->*STEPS[step].run)();
+        renderer.clearScreen();
+      }
+      step++;
+      return;
+    }
+    const bool ok = saveResults();
+    {
+      RenderLock lock(*this);
+      saved = ok;
+      selectedIndex = 0;
+      state = DONE;
+    }
+    requestUpdate();
+    return;
+  }
+
+  if (mappedInput.wasPressed(MappedInputManager::Button::Back)) {
+    finish();
+    return;
+  }
+
+  if (state == WARNING) {
+    if (mappedInput.wasPressed(MappedInputManager::Button::Confirm)) {
+      {
+        RenderLock lock(*this);
+        state = RUNNING;
+        LOG_INF("BENCH", "Starting benchmark of " CROSSPOINT_VERSION);
+        // Code moved to IRAM (HOT_PATH_IN_IRAM) comes off the heap, so the cost shows next to the speedup
+        addResult("heap_total", static_cast<float>(ESP.getHeapSize()) / 1024.0f, "KB");
+      }
+    }
+    return;
+  }
+
+  const int count = static_cast<int>(results.size());
+  buttonNavigator.onNextRelease([this, count] {
+    selectedIndex = ButtonNavigator::nextIndex(selectedIndex, count);
+    requestUpdate();
+  });
+  buttonNavigator.onPreviousRelease([this, count] {
+    selectedIndex = ButtonNavigator::previousIndex(selectedIndex, count);
+    requestUpdate();
+  });
+}
+
+void BenchmarkActivity::benchSd() {
+  auto* buffer = static_cast<uint8_t*>(malloc(SD_BLOCK_SIZE));
+  if (!buffer) {
+    LOG_ERR("BENCH", "Not enough memory for the SD test");
+    return;
+  }
+  for (size_t i = 0; i < SD_BLOCK_SIZE; i++) {
+    buffer[i] = static_cast<uint8_t>(i * 31);
+  }
+  Storage.mkdir(BENCH_DIR);
+
+  FsFile file;
+  if (Storage.openFileForWrite("BENCH", SD_TEST_FILE, file)) {
+    const unsigned long start = micros();
+    for (size_t i = 0; i < SD_BLOCK_COUNT; i++) {
+      file.write(buffer, SD_BLOCK_SIZE);
+      esp_task_wdt_reset();
+    }
+    file.flush();
+    file.close();
+    addResult("sd_seq_write", kilobytesPerSecond(SD_FILE_SIZE, micros() - start), "KB/s");
+  }
+
+  if (Storage.openFileForRead("BENCH", SD_TEST_FILE, file)) {
+    const unsigned long start = micros();
+    size_t total = 0;
+    for (size_t i = 0; i < SD_BLOCK_COUNT; i++) {
+      total += file.read(buffer, SD_BLOCK_SIZE);
+      esp_task_wdt_reset();
+    }
+    addResult("sd_seq_read", kilobytesPerSecond(total, micros() - start), "KB/s");
+
+    uint32_t seed = 1;
+    total = 0;
+    const unsigned long randomStart = micros();
+    for (int i = 0; i < SD_RANDOM_OPS; i++) {
+      file.seek((nextRandom(&seed) % SD_BLOCK_COUNT) * SD_BLOCK_SIZE);
+      total += file.read(buffer, SD_BLOCK_SIZE);
+      esp_task_wdt_reset();
+    }
+    file.close();
+    addResult("sd_random_read", kilobytesPerSecond(total, micros() - randomStart), "KB/s");
+  }
+
+  file = Storage.open(SD_TEST_FILE, O_RDWR);
+  if (file) {
+    uint32_t seed = 2;
+    size_t total = 0;
+    const unsigned long start = micros();
+    for (int i = 0; i < SD_RANDOM_OPS; i++) {
+      file.seek((nextRandom(&seed) % SD_BLOCK_COUNT) * SD_BLOCK_SIZE);
+      total += file.write(buffer, SD_BLOCK_SIZE);
+      esp_task_wdt_reset();
+    }
+    file.flush();
+    file.close();
+    addResult("sd_random_write", kilobytesPerSecond(total, micros() - start), "KB/s");
+  }
+
+  Storage.remove(SD_TEST_FILE);
+  free(buffer);
+}
+
+void BenchmarkActivity::benchInflate() {
+  // The chapters of the text book are deflated; the compressed side read from SD is small next to the output
+  const std::string path = bookPath(TEXT_BOOK);
+  if (!Storage.exists(path.c_str())) {
+    return;
+  }
+  ZipFile zip(path);
+  if (!zip.open()) {
+    return;
+  }
+  NullPrint sink;
+  char entry[32];
+  const unsigned long start = micros();
+  for (int round = 0; round < INFLATE_ROUNDS; round++) {
+    for (int chapter = 1;; chapter++) {
+      snprintf(entry, sizeof(entry), "OEBPS/chapter%d.xhtml", chapter);
+      if (!zip.readFileToStream(entry, sink, 1024)) {
+        break;
+      }
+    }
+    esp_task_wdt_reset();
+  }
+  const unsigned long took = micros() - start;
+  zip.close();
+  addResult("inflate", kilobytesPerSecond(sink.count, took) / 1024.0f, "MB/s");
+}
+
+void BenchmarkActivity::benchGlyphs() {
+  const size_t glyphs = strlen(GLYPH_SAMPLE) * GLYPH_LINES;
+  for (const auto& font : BENCH_FONTS) {
+    renderer.clearScreen();
+    const int lineHeight = renderer.getLineHeight(font.id);
+    // Warm the glyph cache of compressed fonts, so this measures drawing rather than decompression
+    renderer.drawText(font.id, 0, 0, GLYPH_SAMPLE);
+    const unsigned long start = micros();
+    for (int line = 0; line < GLYPH_LINES; line++) {
+      renderer.drawText(font.id, BENCH_MARGIN, (line * lineHeight) % renderer.getScreenHeight(), GLYPH_SAMPLE);
+    }
+    const unsigned long took = micros() - start;
+    addResult(std::string("glyphs_") + font.name, took > 0 ? glyphs * 1000000.0f / took : 0.0f, "glyphs/s");
+    esp_task_wdt_reset();
+  }
+  renderer.trimFontCache();
+}
+
+void BenchmarkActivity::benchSections() {
+  uint16_t viewportWidth, viewportHeight;
+  getViewport(renderer, &viewportWidth, &viewportHeight);
+  int mostPages = 0;
+
+  for (const char* name : BENCH_BOOKS) {
+    const unsigned long loadStart = millis();
+    auto epub = loadBook(name);
+    if (!epub) {
+      continue;
+    }
+    addResult(bookKey(name) + "_load", static_cast<float>(millis() - loadStart), "ms");
+
+    unsigned long buildTime = 0;
+    int pages = 0;
+    for (int spine = 0; spine < epub->getSpineItemsCount(); spine++) {
+      Section section(epub, spine, renderer);
+      const unsigned long start = millis();
+      if (!section.beginSectionBuild(BENCH_FONT_ID, BENCH_LINE_COMPRESSION, true, CrossPointSettings::JUSTIFIED,
+                                     viewportWidth, viewportHeight, false, true)) {
+        continue;
+      }
+      Section::BuildStatus status;
+      while ((status = section.continueSectionBuild(BUILD_SLICE_MS)) == Section::BuildStatus::InProgress) {
+        esp_task_wdt_reset();
+      }
+      buildTime += millis() - start;
+      if (status != Section::BuildStatus::Done) {
+        continue;
+      }
+      pages += section.pageCount;
+      if (strcmp(name, TEXT_BOOK) == 0 && section.pageCount > mostPages) {
+        mostPages = section.pageCount;
+        pageTurnSpine = spine;
+      }
+    }
+    addResult(bookKey(name) + "_sections", static_cast<float>(buildTime), "ms");
+    addResult(bookKey(name) + "_pages", static_cast<float>(pages), "pages");
+  }
+}
+
+void BenchmarkActivity::benchImages() {
+  RenderConfig config;
+  config.x = 0;
+  config.y = 0;
+  config.maxWidth = renderer.getScreenWidth();
+  config.maxHeight = renderer.getScreenHeight();
+
+  for (const auto& image : BENCH_IMAGES) {
+    const std::string path = bookPath(image.book);
+    if (!Storage.exists(path.c_str())) {
+      continue;
+    }
+    auto* decoder = ImageDecoderFactory::getDecoder(image.entry);
+    auto source = ImageSource::open(image.entry, path);
+    if (!decoder || !source) {
+      continue;
+    }
+    renderer.clearScreen();
+    const unsigned long start = millis();
+    const bool ok = decoder->decodeToFramebuffer(*source, renderer, config);
+    const unsigned long took = millis() - start;
+    if (ok) {
+      addResult(image.key, static_cast<float>(took), "ms");
+    }
+    esp_task_wdt_reset();
+  }
+}
+
+void BenchmarkActivity::benchPageTurns() {
+  if (pageTurnSpine < 0) {
+    return;
+  }
+  auto epub = loadBook(TEXT_BOOK);
+  if (!epub) {
+    return;
+  }
+  uint16_t viewportWidth, viewportHeight;
+  getViewport(renderer, &viewportWidth, &viewportHeight);
+  Section section(epub, pageTurnSpine, renderer);
+  if (!section.loadSectionFile(BENCH_FONT_ID, BENCH_LINE_COMPRESSION, true, CrossPointSettings::JUSTIFIED,
+                               viewportWidth, viewportHeight, false, true) ||
+      section.pageCount == 0) {
+    return;
+  }
+
+  for (const bool refresh : {false, true}) {
+    const unsigned long start = millis();
+    for (int i = 0; i < PAGE_TURNS; i++) {
+      // Off the page cache, like turning to a page that wasn't prefetched
+      section.clearPageCache();
+      section.currentPage = i % section.pageCount;
+      auto page = section.loadPageFromSectionFile();
+      if (!page) {
+        return;
+      }
+      renderer.clearScreen();
+      page->render(renderer, BENCH_FONT_ID, BENCH_MARGIN, BENCH_MARGIN);
+      if (refresh) {
+        renderer.displayBuffer();
+      }
+      esp_task_wdt_reset();
+    }
+    addResult(refresh ? "page_turn_with_refresh" : "page_turn", static_cast<float>(millis() - start) / PAGE_TURNS,
+              "ms");
+  }
+  renderer.trimFontCache();
+}
+
+bool BenchmarkActivity::saveResults() const {
+  JsonDocument doc;
+  doc["version"] = CROSSPOINT_VERSION;
+  JsonObject values = doc["results"].to<JsonObject>();
+  for (const auto& result : results) {
+    values[result.key] = result.value;
+  }
+
+  String json;
+  serializeJson(doc, json);
+  Storage.mkdir(BENCH_DIR);
+  const std::string path = std::string(BENCH_DIR) + "/" + CROSSPOINT_VERSION + ".json";
+  if (!Storage.writeFile(path.c_str(), json)) {
+    LOG_ERR("BENCH", "Failed to save %s", path.c_str());
+    return false;
+  }
+  LOG_INF("BENCH", "Results saved to %s", path.c_str());
+  return true;
+}
+
+void BenchmarkActivity::render(RenderLock&&) {
+  const auto& metrics = UITheme::getInstance().getMetrics();
+  const auto pageWidth = renderer.getScreenWidth();
+  const auto pageHeight = renderer.getScreenHeight();
+
+  renderer.clearScreen();
+  GUI.drawHeader(renderer, Rect{0, metrics.topPadding, pageWidth, metrics.headerHeight}, tr(STR_BENCHMARK));
+
+  if (state == WARNING) {
+    renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2 - 30, tr(STR_BENCHMARK_INFO), true);
+    renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2, tr(STR_BENCHMARK_BOOKS), true);
+    const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_BENCHMARK_START), "", "");
+    GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+    renderer.displayBuffer();
+    return;
+  }
+
+  if (state == RUNNING) {
+    const std::string progress = std::to_string(step + 1) + "/" + std::to_string(STEP_COUNT) + " " +
+                                 (step < STEP_COUNT ? STEPS[step].label : "");
+    renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2, progress.c_str(), true, EpdFontFamily::BOLD);
+    renderer.displayBuffer();
+    return;
+  }
+
+  GUI.drawSubHeader(renderer, Rect{0, metrics.topPadding + metrics.headerHeight, pageWidth, metrics.tabBarHeight},
+                    saved ? tr(STR_BENCHMARK_SAVED) : tr(STR_BENCHMARK_SAVE_FAILED));
+  const int topOffset = metrics.topPadding + metrics.headerHeight + metrics.tabBarHeight + metrics.verticalSpacing;
+  const int contentHeight = pageHeight - topOffset - metrics.buttonHintsHeight - metrics.verticalSpacing;
+  GUI.drawList(
+      renderer, Rect{0, topOffset, pageWidth, contentHeight}, static_cast<int>(results.size()), selectedIndex,
+      [this](int index) { return results[index].key; }, nullptr, nullptr,
+      [this](int index) {
+        char value[32];
+        snprintf(value, sizeof(value), "%.1f %s", results[index].value, results[index].unit);
+        return std::string(value);
+      });
+
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), "", tr(STR_DIR_UP), tr(STR_DIR_DOWN));
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+  renderer.displayBuffer();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "activities/Activity.h"
+#include "util/ButtonNavigator.h"
+
+/**
+ * Runs a fixed performance suite on the device: SD throughput, inflate, glyph rendering per built-in font, section
+ * builds and image decodes of the books in test/epubs (copied to /bench on the SD card), and a page turn loop without
+ * and with panel refresh. Results are written to /.crosspoint/bench/<version>.json, so firmware versions can be
+ * compared on the same device. Reached by holding Confirm on the Memory Usage screen.
+ */
+class BenchmarkActivity final : public Activity {
+ public:
+  explicit BenchmarkActivity(GfxRenderer& renderer, MappedInputManager& mappedInput)
+      : Activity("Benchmark", renderer, mappedInput) {}
+
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+  void render(RenderLock&&) override;
+  bool skipLoopDelay() override { return state == RUNNING; }
+  bool preventAutoSleep() override { return state == RUNNING; }
+
+ private:
+  enum State { WARNING, RUNNING, DONE };
+
+  struct Result {
+    std::string key;
+    float value;
+    const char* unit;
+  };
+
+  State state = WARNING;
+  size_t step = 0;
+  std::vector<Result> results;
+  bool saved = false;
+  // Spine item of the text book with the most pages, for the page turn loop
+  int pageTurnSpine = -1;
+  ButtonNavigator buttonNavigator;
+  int selectedIndex = 0;
+
+  void addResult(std::string key, float value, const char* unit);
+  bool saveResults() const;
+
+  void benchSd();
+  void benchInflate();
+  void benchGlyphs();
+  void benchSections();
+  void benchImages();
+  void benchPageTurns();
+
+  struct Step {
+    const char* label;
+    void (BenchmarkActivity::*run)();
+  };
+  static const Step STEPS[];
+  static const size_t STEP_COUNT;
+};
@@ -5,7 +5,9 @@
 #include <I18n.h>
 #include <Logging.h>
 
+#include "CacheBudget.h"
 #include "MappedInputManager.h"
+#include "WarmBooks.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
 
@@ -74,6 +76,7 @@ void ClearCacheActivity::render(RenderLock&&) {
 
 void ClearCacheActivity::clearCache() {
   LOG_DBG("CLEAR_CACHE", "Clearing cache...");
+  WARM_BOOKS.clear();
 
   // Open .crosspoint directory
   auto root = Storage.open("/.crosspoint");
@@ -94,8 +97,8 @@ void ClearCacheActivity::clearCache() {
     file.getName(name, sizeof(name));
     String itemName(name);
 
-    // Only delete directories starting with epub_ or xtc_
-    if (file.isDirectory() && (itemName.startsWith("epub_") || itemName.startsWith("xtc_"))) {
+    // Only delete the book caches the cache budget tracks, and the OPDS feed cache
+    if (file.isDirectory() && (CacheBudget::isBookCache(name) || itemName == "opds")) {
       String fullPath = "/.crosspoint/" + itemName;
       LOG_DBG("CLEAR_CACHE", "Removing cache: %s", fullPath.c_str());
 
@@ -112,6 +115,7 @@ void ClearCacheActivity::clearCache() {
     }
   }
   root.close();
+  CACHE_BUDGET.rescan();
 
   LOG_DBG("CLEAR_CACHE", "Cache cleared: %d removed, %d failed", clearedCount, failedCount);
 
@@ -0,0 +1,101 @@
+#include "HeapStatsActivity.h"
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+#include <esp_heap_caps.h>
+
+#include <string>
+
+#include "BenchmarkActivity.h"
+#include "MappedInputManager.h"
+#include "components/UITheme.h"
+
+namespace {
+// Holding Confirm this long opens the benchmark instead of refreshing
+constexpr unsigned long BENCHMARK_HOLD_MS = 1500;
+
+std::string kilobytes(const uint32_t bytes) { return std::to_string(bytes / 1024) + " KB"; }
+}  // namespace
+
+void HeapStatsActivity::onEnter() {
+  Activity::onEnter();
+
+  selectedIndex = 0;
+  refresh();
+}
+
+void HeapStatsActivity::onExit() { Activity::onExit(); }
+
+void HeapStatsActivity::refresh() {
+  HeapTelemetry::sample(true);
+  {
+    RenderLock lock(*this);
+    statsCount = static_cast<int>(HeapTelemetry::snapshot(stats, HeapTelemetry::MAX_ACTIVITIES));
+    freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    allocFailures = HeapTelemetry::getAllocFailures();
+    if (selectedIndex >= statsCount) {
+      selectedIndex = 0;
+    }
+  }
+  requestUpdate();
+}
+
+void HeapStatsActivity::loop() {
+  if (mappedInput.wasPressed(MappedInputManager::Button::Back)) {
+    finish();
+    return;
+  }
+
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
+    if (mappedInput.getHeldTime() >= BENCHMARK_HOLD_MS) {
+      startActivityForResult(std::make_unique<BenchmarkActivity>(renderer, mappedInput),
+                             [this](const ActivityResult&) { refresh(); });
+    } else {
+      refresh();
+    }
+    return;
+  }
+
+  buttonNavigator.onNextRelease([this] {
+    selectedIndex = ButtonNavigator::nextIndex(selectedIndex, statsCount);
+    requestUpdate();
+  });
+
+  buttonNavigator.onPreviousRelease([this] {
+    selectedIndex = ButtonNavigator::previousIndex(selectedIndex, statsCount);
+    requestUpdate();
+  });
+}
+
+void HeapStatsActivity::render(RenderLock&&) {
+  const auto& metrics = UITheme::getInstance().getMetrics();
+  const auto pageWidth = renderer.getScreenWidth();
+  const auto pageHeight = renderer.getScreenHeight();
+
+  renderer.clearScreen();
+
+  GUI.drawHeader(renderer, Rect{0, metrics.topPadding, pageWidth, metrics.headerHeight}, tr(STR_MEMORY_USAGE));
+  const std::string summary = std::string(tr(STR_HEAP_FREE)) + " " + kilobytes(freeHeap) + ", " +
+                              tr(STR_HEAP_LARGEST_BLOCK) + " " + kilobytes(largestBlock);
+  const std::string failures = std::to_string(allocFailures) + " " + tr(STR_FAILED_LOWER);
+  GUI.drawSubHeader(renderer, Rect{0, metrics.topPadding + metrics.headerHeight, pageWidth, metrics.tabBarHeight},
+                    summary.c_str(), failures.c_str());
+
+  const int topOffset = metrics.topPadding + metrics.headerHeight + metrics.tabBarHeight + metrics.verticalSpacing;
+  const int contentHeight = pageHeight - topOffset - metrics.buttonHintsHeight - metrics.verticalSpacing;
+  GUI.drawList(
+      renderer, Rect{0, topOffset, pageWidth, contentHeight}, statsCount, selectedIndex,
+      [this](int index) { return std::string(stats[index].name) + " (" + std::to_string(stats[index].visits) + ")"; },
+      [this](int index) {
+        return std::string(tr(STR_HEAP_LOWEST_FREE)) + " " + kilobytes(stats[index].minFree) + ", " +
+               tr(STR_HEAP_LARGEST_BLOCK) + " " + kilobytes(stats[index].minLargestBlock);
+      },
+      nullptr,
+      [this](int index) { return std::to_string(stats[index].allocFailures) + " " + tr(STR_FAILED_LOWER); });
+
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_REFRESH), tr(STR_DIR_UP), tr(STR_DIR_DOWN));
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+
+  renderer.displayBuffer();
+}
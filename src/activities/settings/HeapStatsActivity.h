@@ -0,0 +1,33 @@
+#pragma once
+
+#include "activities/Activity.h"
+#include "activities/HeapTelemetry.h"
+#include "util/ButtonNavigator.h"
+
+/**
+ * Shows the heap telemetry of the activities visited since boot: the lowest free heap, the smallest largest free block
+ * and the failed allocations of each.
+ */
+class HeapStatsActivity final : public Activity {
+ public:
+  explicit HeapStatsActivity(GfxRenderer& renderer, MappedInputManager& mappedInput)
+      : Activity("HeapStats", renderer, mappedInput) {}
+
+  void onEnter() override;
+  void onExit() override;
+  void loop() override;
+  void render(RenderLock&&) override;
+
+ private:
+  ButtonNavigator buttonNavigator;
+  int selectedIndex = 0;
+
+  // Taken on the main loop, the render task only reads this copy
+  HeapTelemetry::ActivityStats stats[HeapTelemetry::MAX_ACTIVITIES];
+  int statsCount = 0;
+  uint32_t freeHeap = 0;
+  uint32_t largestBlock = 0;
+  uint32_t allocFailures = 0;
+
+  void refresh();
+};
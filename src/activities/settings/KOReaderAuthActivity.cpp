@@ -7,6 +7,7 @@
 #include "KOReaderCredentialStore.h"
 #include "KOReaderSyncClient.h"
 #include "MappedInputManager.h"
+#include "WorkerPool.h"
 #include "activities/network/WifiSelectionActivity.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
@@ -60,14 +61,11 @@ void KOReaderAuthActivity::onEnter() {
     statusMessage = tr(STR_AUTHENTICATING);
     requestUpdate();
 
-    // Perform authentication in a separate task
-    xTaskCreate(
-        [](void* param) {
-          auto* self = static_cast<KOReaderAuthActivity*>(param);
-          self->performAuthentication();
-          vTaskDelete(nullptr);
-        },
-        "AuthTask", 4096, this, 1, nullptr);
+    // Perform authentication on a worker (inline if none can take it)
+    const auto authJob = [](void* param) { static_cast<KOReaderAuthActivity*>(param)->performAuthentication(); };
+    if (!WORKERS.submit(authJob, this, "AuthTask")) {
+      authJob(this);
+    }
     return;
   }
 
@@ -193,6 +193,7 @@ void OtaUpdateActivity::loop() {
   }
 
   if (state == SHUTTING_DOWN) {
+    logFlush();
     ESP.restart();
   }
 }
@@ -0,0 +1,78 @@
+#include "SdFontSelectActivity.h"
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "CrossPointSettings.h"
+#include "MappedInputManager.h"
+#include "SdFonts.h"
+
+void SdFontSelectActivity::onEnter() {
+  Activity::onEnter();
+
+  families = SdFonts::listFamilies();
+  const auto it = std::find(families.begin(), families.end(), SETTINGS.sdFontFamily);
+  selectedIndex = it != families.end() ? static_cast<int>(it - families.begin()) + 1 : 0;
+
+  requestUpdate();
+}
+
+void SdFontSelectActivity::loop() {
+  if (mappedInput.wasPressed(MappedInputManager::Button::Back)) {
+    finish();
+    return;
+  }
+
+  if (mappedInput.wasPressed(MappedInputManager::Button::Confirm)) {
+    handleSelection();
+    return;
+  }
+
+  buttonNavigator.onNextRelease([this] {
+    selectedIndex = ButtonNavigator::nextIndex(selectedIndex, itemCount());
+    requestUpdate();
+  });
+
+  buttonNavigator.onPreviousRelease([this] {
+    selectedIndex = ButtonNavigator::previousIndex(selectedIndex, itemCount());
+    requestUpdate();
+  });
+}
+
+void SdFontSelectActivity::handleSelection() {
+  // Loaded by the reader when it next opens a book
+  const std::string chosen = selectedIndex == 0 ? "" : families[selectedIndex - 1];
+  strncpy(SETTINGS.sdFontFamily, chosen.c_str(), sizeof(SETTINGS.sdFontFamily) - 1);
+  SETTINGS.sdFontFamily[sizeof(SETTINGS.sdFontFamily) - 1] = '\0';
+  finish();
+}
+
+void SdFontSelectActivity::render(RenderLock&&) {
+  renderer.clearScreen();
+
+  const auto pageWidth = renderer.getScreenWidth();
+  const auto pageHeight = renderer.getScreenHeight();
+  auto metrics = UITheme::getInstance().getMetrics();
+
+  GUI.drawHeader(renderer, Rect{0, metrics.topPadding, pageWidth, metrics.headerHeight}, tr(STR_EXT_READER_FONT));
+
+  const int contentTop = metrics.topPadding + metrics.headerHeight + metrics.verticalSpacing;
+  const int contentHeight = pageHeight - contentTop - metrics.buttonHintsHeight - metrics.verticalSpacing;
+  const std::string current = SETTINGS.sdFontFamily;
+  GUI.drawList(
+      renderer, Rect{0, contentTop, pageWidth, contentHeight}, itemCount(), selectedIndex,
+      [this](int index) { return index == 0 ? std::string(tr(STR_NONE_OPT)) : families[index - 1]; }, nullptr,
+      nullptr,
+      [this, &current](int index) {
+        return (index == 0 ? current.empty() : families[index - 1] == current) ? tr(STR_SELECTED) : "";
+      },
+      true);
+
+  const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), tr(STR_DIR_UP), tr(STR_DIR_DOWN));
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+
+  renderer.displayBuffer();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <GfxRenderer.h>
+#include <I18n.h>
+
+#include <string>
+#include <vector>
+
+#include "../Activity.h"
+#include "components/UITheme.h"
+#include "util/ButtonNavigator.h"
+
+class MappedInputManager;
+
+/**
+ * Activity for choosing the reader font family from the SD card (see SdFonts), or none for the built-in one
+ */
+class SdFontSelectActivity final : public Activity {
+ public:
+  explicit SdFontSelectActivity(GfxRenderer& renderer, MappedInputManager& mappedInput)
+      : Activity("SdFontSelect", renderer, mappedInput) {}
+
+  void onEnter() override;
+  void loop() override;
+  void render(RenderLock&&) override;
+
+ private:
+  ButtonNavigator buttonNavigator;
+  // The families in /fonts; item 0 is "None", item i the family i - 1
+  std::vector<std::string> families;
+  int selectedIndex = 0;
+
+  int itemCount() const { return static_cast<int>(families.size()) + 1; }
+  void handleSelection();
+};
@@ -6,12 +6,15 @@
 #include "ButtonRemapActivity.h"
 #include "CalibreSettingsActivity.h"
 #include "ClearCacheActivity.h"
+#include "HeapStatsActivity.h"
 #include "CrossPointSettings.h"
 #include "KOReaderSettingsActivity.h"
 #include "LanguageSelectActivity.h"
 #include "MappedInputManager.h"
 #include "OtaUpdateActivity.h"
+#include "SdFontSelectActivity.h"
 #include "SettingsList.h"
+#include "SleepScreenCache.h"
 #include "StatusBarSettingsActivity.h"
 #include "activities/network/WifiSelectionActivity.h"
 #include "components/UITheme.h"
@@ -52,7 +55,11 @@ void SettingsActivity::onEnter() {
   systemSettings.push_back(SettingInfo::Action(StrId::STR_CLEAR_READING_CACHE, SettingAction::ClearCache));
   systemSettings.push_back(SettingInfo::Action(StrId::STR_CHECK_UPDATES, SettingAction::CheckForUpdates));
   systemSettings.push_back(SettingInfo::Action(StrId::STR_LANGUAGE, SettingAction::Language));
+  systemSettings.push_back(SettingInfo::Action(StrId::STR_MEMORY_USAGE, SettingAction::MemoryUsage));
   readerSettings.push_back(SettingInfo::Action(StrId::STR_CUSTOMISE_STATUS_BAR, SettingAction::CustomiseStatusBar));
+  // After the font family and size, which it takes the place of
+  readerSettings.insert(readerSettings.begin() + 2,
+                        SettingInfo::Action(StrId::STR_EXT_READER_FONT, SettingAction::SdFont));
 
   // Reset selection to first category
   selectedCategoryIndex = 0;
@@ -90,6 +97,8 @@ void SettingsActivity::loop() {
 
   if (mappedInput.wasPressed(MappedInputManager::Button::Back)) {
     SETTINGS.saveToFile();
+    // The sleep screen settings may have changed how sleep images are drawn
+    SLEEP_SCREENS.rescan();
     onGoHome();
     return;
   }
@@ -187,6 +196,12 @@ void SettingsActivity::toggleCurrentSetting() {
       case SettingAction::Language:
         startActivityForResult(std::make_unique<LanguageSelectActivity>(renderer, mappedInput), resultHandler);
         break;
+      case SettingAction::MemoryUsage:
+        startActivityForResult(std::make_unique<HeapStatsActivity>(renderer, mappedInput), resultHandler);
+        break;
+      case SettingAction::SdFont:
+        startActivityForResult(std::make_unique<SdFontSelectActivity>(renderer, mappedInput), resultHandler);
+        break;
       case SettingAction::None:
         // Do nothing
         break;
@@ -237,6 +252,8 @@ void SettingsActivity::render(RenderLock&&) {
           valueText = I18N.get(setting.enumValues[value]);
         } else if (setting.type == SettingType::VALUE && setting.valuePtr != nullptr) {
           valueText = std::to_string(SETTINGS.*(setting.valuePtr));
+        } else if (setting.type == SettingType::ACTION && setting.action == SettingAction::SdFont) {
+          valueText = SETTINGS.sdFontFamily[0] != '\0' ? SETTINGS.sdFontFamily : tr(STR_NONE_OPT);
         }
         return valueText;
       },
@@ -22,6 +22,8 @@ enum class SettingAction {
   ClearCache,
   CheckForUpdates,
   Language,
+  MemoryUsage,
+  SdFont,
 };
 
 struct SettingInfo {
@@ -1,86 +1,53 @@
 #include "BmpViewerActivity.h"
 
 #include <Bitmap.h>
+#include <BookCacheKey.h>
 #include <GfxRenderer.h>
+#include <GrayBmpToBmpConverter.h>
 #include <HalStorage.h>
 #include <I18n.h>
 
+#include <algorithm>
+#include <cmath>
+
+#include "CacheBudget.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
 
+namespace {
+constexpr char CACHE_DIR[] = "/.crosspoint";
+}  // namespace
+
 BmpViewerActivity::BmpViewerActivity(GfxRenderer& renderer, MappedInputManager& mappedInput, std::string path)
     : Activity("BmpViewer", renderer, mappedInput), filePath(std::move(path)) {}
 
 void BmpViewerActivity::onEnter() {
   Activity::onEnter();
-  // Removed the redundant initial renderer.clearScreen()
-
-  FsFile file;
 
-  const auto pageWidth = renderer.getScreenWidth();
-  const auto pageHeight = renderer.getScreenHeight();
   Rect popupRect = GUI.drawPopup(renderer, tr(STR_LOADING_POPUP));
   GUI.fillPopupProgress(renderer, popupRect, 20);  // Initial 20% progress
-  // 1. Open the file
+
+  FsFile file;
   if (Storage.openFileForRead("BMP", filePath, file)) {
     Bitmap bitmap(file, true);
-
-    // 2. Parse headers to get dimensions
     if (bitmap.parseHeaders() == BmpReaderError::Ok) {
-      int x, y;
-
-      if (bitmap.getWidth() > pageWidth || bitmap.getHeight() > pageHeight) {
-        float ratio = static_cast<float>(bitmap.getWidth()) / static_cast<float>(bitmap.getHeight());
-        const float screenRatio = static_cast<float>(pageWidth) / static_cast<float>(pageHeight);
-
-        if (ratio > screenRatio) {
-          // Wider than screen
-          x = 0;
-          y = std::round((static_cast<float>(pageHeight) - static_cast<float>(pageWidth) / ratio) / 2);
-        } else {
-          // Taller than screen
-          x = std::round((static_cast<float>(pageWidth) - static_cast<float>(pageHeight) * ratio) / 2);
-          y = 0;
-        }
-      } else {
-        // Center small images
-        x = (pageWidth - bitmap.getWidth()) / 2;
-        y = (pageHeight - bitmap.getHeight()) / 2;
-      }
-
-      // 4. Prepare Rendering
-      const auto labels = mappedInput.mapLabels(tr(STR_BACK), "", "", "");
-      GUI.fillPopupProgress(renderer, popupRect, 50);
-
-      renderer.clearScreen();
-      // Assuming drawBitmap defaults to 0,0 crop if omitted, or pass explicitly: drawBitmap(bitmap, x, y, pageWidth,
-      // pageHeight, 0, 0)
-      renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, 0, 0);
-
-      // Draw UI hints on the base layer
-      GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
-      // Single pass for non-grayscale images
-
-      renderer.displayBuffer(HalDisplay::FULL_REFRESH);
-
+      imageWidth = bitmap.getWidth();
+      imageHeight = bitmap.getHeight();
     } else {
-      // Handle file parsing error
-      renderer.clearScreen();
-      renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2, "Invalid BMP File");
-      const auto labels = mappedInput.mapLabels(tr(STR_BACK), "", "", "");
-      GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
-      renderer.displayBuffer(HalDisplay::FAST_REFRESH);
+      errorMessage = "Invalid BMP File";
     }
-
     file.close();
   } else {
-    // Handle file open error
-    renderer.clearScreen();
-    renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2, "Could not open file");
-    const auto labels = mappedInput.mapLabels(tr(STR_BACK), "", "", "");
-    GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
-    renderer.displayBuffer(HalDisplay::FULL_REFRESH);
+    errorMessage = "Could not open file";
+  }
+
+  if (!errorMessage && isLargerThanScreen()) {
+    GUI.fillPopupProgress(renderer, popupRect, 50);
+    prepareFitCopy();
   }
+
+  fullRefresh = true;
+  requestUpdate();
 }
 
 void BmpViewerActivity::onExit() {
@@ -97,4 +64,160 @@ void BmpViewerActivity::loop() {
     onGoHome();
     return;
   }
-}
\ No newline at end of file
+
+  if (errorMessage || !isLargerThanScreen()) {
+    return;
+  }
+
+  const int pageWidth = renderer.getScreenWidth();
+  const int pageHeight = renderer.getScreenHeight();
+  if (mappedInput.wasReleased(MappedInputManager::Button::Confirm)) {
+    zoomed = !zoomed;
+    if (zoomed) {
+      // Start from the middle of the image
+      panX = (imageWidth - pageWidth) / 2;
+      panY = (imageHeight - pageHeight) / 2;
+      pan(0, 0);
+    }
+    fullRefresh = true;
+    requestUpdate();
+    return;
+  }
+
+  if (!zoomed) {
+    return;
+  }
+  // Half a screen per press, so some of what was shown stays in view
+  if (mappedInput.wasReleased(MappedInputManager::Button::Left)) {
+    pan(-pageWidth / 2, 0);
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Right)) {
+    pan(pageWidth / 2, 0);
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Up)) {
+    pan(0, -pageHeight / 2);
+  } else if (mappedInput.wasReleased(MappedInputManager::Button::Down)) {
+    pan(0, pageHeight / 2);
+  }
+}
+
+void BmpViewerActivity::render(RenderLock&&) {
+  const auto pageHeight = renderer.getScreenHeight();
+
+  renderer.clearScreen();
+  if (errorMessage) {
+    renderer.drawCenteredText(UI_10_FONT_ID, pageHeight / 2, errorMessage);
+  } else {
+    drawImage();
+  }
+
+  const bool canZoom = !errorMessage && isLargerThanScreen();
+  const char* confirmLabel = canZoom ? (zoomed ? tr(STR_FIT) : tr(STR_ZOOM)) : "";
+  const auto labels = zoomed ? mappedInput.mapLabels(tr(STR_BACK), confirmLabel, tr(STR_DIR_LEFT), tr(STR_DIR_RIGHT))
+                             : mappedInput.mapLabels(tr(STR_BACK), confirmLabel, "", "");
+  GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
+
+  // Single pass for non-grayscale images
+  renderer.displayBuffer(fullRefresh ? HalDisplay::FULL_REFRESH : HalDisplay::FAST_REFRESH);
+  fullRefresh = false;
+}
+
+bool BmpViewerActivity::isLargerThanScreen() const {
+  return imageWidth > renderer.getScreenWidth() || imageHeight > renderer.getScreenHeight();
+}
+
+// Makes the screen-sized copy shown when the image doesn't fit, once per image: the decimating conversion reads a
+// couple of source rows per screen row and seeks over the rest
+bool BmpViewerActivity::prepareFitCopy() {
+  const int pageWidth = renderer.getScreenWidth();
+  const int pageHeight = renderer.getScreenHeight();
+  const std::string cachePath = BookCacheKey::cachePath(filePath, CACHE_DIR, "bmp_");
+  const std::string path =
+      cachePath + "/fit_" + std::to_string(pageWidth) + "x" + std::to_string(pageHeight) + ".bmp";
+  if (Storage.exists(path.c_str())) {
+    fitPath = path;
+    CACHE_BUDGET.touch(cachePath);
+    return true;
+  }
+
+  FsFile file;
+  if (!Storage.openFileForRead("BMP", filePath, file)) {
+    return false;
+  }
+  Bitmap bitmap(file);
+  FsFile out;
+  bool ok = bitmap.parseHeaders() == BmpReaderError::Ok && Storage.mkdir(cachePath.c_str()) &&
+            Storage.openFileForWrite("BMP", path, out);
+  if (ok) {
+    ok = GrayBmpToBmpConverter::bitmapToFitBmpStream(bitmap, out, pageWidth, pageHeight);
+    out.close();
+    if (!ok) {
+      Storage.remove(path.c_str());
+    }
+  }
+  file.close();
+
+  if (!ok) {
+    LOG_ERR("BMP", "Failed to make the screen-sized copy of %s", filePath.c_str());
+    return false;
+  }
+  fitPath = path;
+  CACHE_BUDGET.touch(cachePath);
+  return true;
+}
+
+// Moves the zoomed view by dx, dy, keeping it within the image
+void BmpViewerActivity::pan(const int dx, const int dy) {
+  const int maxX = std::max(0, imageWidth - renderer.getScreenWidth());
+  const int maxY = std::max(0, imageHeight - renderer.getScreenHeight());
+  const int x = std::clamp(panX + dx, 0, maxX);
+  const int y = std::clamp(panY + dy, 0, maxY);
+  if (x == panX && y == panY && (dx != 0 || dy != 0)) {
+    return;
+  }
+  panX = x;
+  panY = y;
+  requestUpdate();
+}
+
+void BmpViewerActivity::drawImage() {
+  const int pageWidth = renderer.getScreenWidth();
+  const int pageHeight = renderer.getScreenHeight();
+
+  // The fit copy when there is one, the image itself when it fits or is zoomed in
+  const bool useFitCopy = !zoomed && !fitPath.empty();
+  FsFile file;
+  if (!Storage.openFileForRead("BMP", useFitCopy ? fitPath : filePath, file)) {
+    return;
+  }
+  Bitmap bitmap(file, true);
+  if (bitmap.parseHeaders() != BmpReaderError::Ok) {
+    file.close();
+    return;
+  }
+
+  if (zoomed) {
+    // A side narrower than the screen is centered
+    const int x = std::max(0, (pageWidth - bitmap.getWidth()) / 2);
+    const int y = std::max(0, (pageHeight - bitmap.getHeight()) / 2);
+    renderer.drawBitmapRegion(bitmap, panX, panY, x, y, pageWidth, pageHeight);
+  } else if (bitmap.getWidth() > pageWidth || bitmap.getHeight() > pageHeight) {
+    // No fit copy could be made: scaled while drawn, every row of the image read
+    int x, y;
+    const float ratio = static_cast<float>(bitmap.getWidth()) / static_cast<float>(bitmap.getHeight());
+    const float screenRatio = static_cast<float>(pageWidth) / static_cast<float>(pageHeight);
+    if (ratio > screenRatio) {
+      // Wider than screen
+      x = 0;
+      y = std::round((static_cast<float>(pageHeight) - static_cast<float>(pageWidth) / ratio) / 2);
+    } else {
+      // Taller than screen
+      x = std::round((static_cast<float>(pageWidth) - static_cast<float>(pageHeight) * ratio) / 2);
+      y = 0;
+    }
+    renderer.drawBitmap(bitmap, x, y, pageWidth, pageHeight, 0, 0);
+  } else {
+    // Center small images, and the fit copy
+    renderer.drawBitmap(bitmap, (pageWidth - bitmap.getWidth()) / 2, (pageHeight - bitmap.getHeight()) / 2, pageWidth,
+                        pageHeight, 0, 0);
+  }
+  file.close();
+}
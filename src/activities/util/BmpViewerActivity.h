@@ -13,7 +13,24 @@ class BmpViewerActivity final : public Activity {
   void onEnter() override;
   void onExit() override;
   void loop() override;
+  void render(RenderLock&&) override;
 
  private:
   std::string filePath;
-};
\ No newline at end of file
+  // Screen-sized copy of an image larger than the screen, cached so it opens without reading the whole image again;
+  // empty when the image fits or the copy couldn't be made
+  std::string fitPath;
+  const char* errorMessage = nullptr;
+  int imageWidth = 0;
+  int imageHeight = 0;
+  // Zoomed in, the image is shown at full size from (panX, panY), reading only the rows on screen
+  bool zoomed = false;
+  int panX = 0;
+  int panY = 0;
+  bool fullRefresh = true;
+
+  bool isLargerThanScreen() const;
+  bool prepareFitCopy();
+  void pan(int dx, int dy);
+  void drawImage();
+};
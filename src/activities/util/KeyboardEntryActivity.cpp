@@ -70,6 +70,7 @@ bool KeyboardEntryActivity::handleKeyPress() {
       // Space bar
       if (maxLength == 0 || text.length() < maxLength) {
         text += ' ';
+        onTextChanged();
       }
       return true;
     }
@@ -78,6 +79,7 @@ bool KeyboardEntryActivity::handleKeyPress() {
       // Backspace
       if (!text.empty()) {
         text.pop_back();
+        onTextChanged();
       }
       return true;
     }
@@ -101,6 +103,7 @@ bool KeyboardEntryActivity::handleKeyPress() {
     if (shiftState == 1) {
       shiftState = 0;
     }
+    onTextChanged();
   }
 
   return true;
@@ -242,10 +245,14 @@ void KeyboardEntryActivity::render(RenderLock&&) {
   GUI.drawTextField(renderer, Rect{0, inputStartY, pageWidth, inputHeight}, textWidth);
 
   // Draw keyboard - use compact spacing to fit 5 rows on screen
-  const int keyboardStartY = metrics.keyboardBottomAligned
+  const int contentStartY = inputStartY + inputHeight + metrics.verticalSpacing * 4;
+  const int keyboardStartY = metrics.keyboardBottomAligned || hasContent()
                                  ? pageHeight - metrics.buttonHintsHeight - metrics.verticalSpacing -
                                        (metrics.keyboardKeyHeight + metrics.keyboardKeySpacing) * NUM_ROWS
-                                 : inputStartY + inputHeight + metrics.verticalSpacing * 4;
+                                 : contentStartY;
+  if (hasContent()) {
+    renderContent(Rect{0, contentStartY, pageWidth, keyboardStartY - metrics.verticalSpacing - contentStartY});
+  }
   const int keyWidth = metrics.keyboardKeyWidth;
   const int keyHeight = metrics.keyboardKeyHeight;
   const int keySpacing = metrics.keyboardKeySpacing;
@@ -311,14 +318,18 @@ void KeyboardEntryActivity::render(RenderLock&&) {
     }
   }
 
+  renderButtonHints();
+
+  renderer.displayBuffer();
+}
+
+void KeyboardEntryActivity::renderButtonHints() {
   // Draw help text
   const auto labels = mappedInput.mapLabels(tr(STR_BACK), tr(STR_SELECT), tr(STR_DIR_LEFT), tr(STR_DIR_RIGHT));
   GUI.drawButtonHints(renderer, labels.btn1, labels.btn2, labels.btn3, labels.btn4);
 
   // Draw side button hints for Up/Down navigation
   GUI.drawSideButtonHints(renderer, ">", "<");
-
-  renderer.displayBuffer();
 }
 
 void KeyboardEntryActivity::onComplete(std::string text) {
@@ -8,6 +8,8 @@
 #include "../Activity.h"
 #include "util/ButtonNavigator.h"
 
+struct Rect;
+
 /**
  * Reusable keyboard entry activity for text input.
  * Can be started from any activity that needs text entry via startActivityForResult()
@@ -38,9 +40,20 @@ class KeyboardEntryActivity : public Activity {
   void loop() override;
   void render(RenderLock&&) override;
 
+ protected:
+  std::string text;
+
+  // Hooks for activities that show something along with the keyboard, e.g. what matches the text so far
+  virtual void onTextChanged() {}
+  // With content, the keyboard sits at the bottom of the screen and renderContent() draws between it and the input
+  // field
+  virtual bool hasContent() const { return false; }
+  virtual void renderContent(const Rect& /*rect*/) {}
+  virtual void renderButtonHints();
+  virtual void onComplete(std::string text);
+
  private:
   std::string title;
-  std::string text;
   size_t maxLength;
   bool isPassword;
 
@@ -52,7 +65,6 @@ class KeyboardEntryActivity : public Activity {
   int shiftState = 0;  // 0 = lower case, 1 = upper case, 2 = shift lock)
 
   // Handlers
-  void onComplete(std::string text);
   void onCancel();
 
   // Keyboard layout
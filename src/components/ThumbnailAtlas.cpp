@@ -0,0 +1,222 @@
+#include "ThumbnailAtlas.h"
+
+#include <Logging.h>
+#include <Serialization.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr uint32_t ATLAS_MAGIC = 0x31414854;  // "THA1"
+// magic, height, slot count, slot size
+constexpr uint32_t ATLAS_HEADER_SIZE = 12;
+// hash, size, stamp
+constexpr uint32_t ATLAS_SLOT_ENTRY_SIZE = 16;
+// File and info headers plus a 2-bit palette
+constexpr uint32_t MAX_BMP_HEADER_SIZE = 14 + 40 + 4 * 4;
+constexpr size_t COPY_CHUNK_SIZE = 512;
+
+uint64_t hashPath(const std::string& s) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : s) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+}  // namespace
+
+ThumbnailAtlas::ThumbnailAtlas(const int height)
+    : height(height),
+      // Room for a 2-bit thumbnail as wide as it is tall, or a 1-bit one twice as wide
+      slotSize(MAX_BMP_HEADER_SIZE + static_cast<uint32_t>((height * 2 + 31) / 32 * 4) * height),
+      path("/.crosspoint/thumbs_" + std::to_string(height) + ".atlas") {}
+
+ThumbnailAtlas::~ThumbnailAtlas() {
+  atlas.close();
+  single.close();
+}
+
+uint32_t ThumbnailAtlas::getSlotOffset(const int index) const {
+  return ATLAS_HEADER_SIZE + SLOT_COUNT * ATLAS_SLOT_ENTRY_SIZE + index * slotSize;
+}
+
+int ThumbnailAtlas::findSlot(const uint64_t hash) const {
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    if (slots[i].size > 0 && slots[i].hash == hash) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool ThumbnailAtlas::load(const bool forWrite) {
+  if (loaded && (writable || !forWrite)) {
+    return true;
+  }
+  if (loaded) {
+    // Open read-only so far: reopen for writing
+    atlas.close();
+    loaded = false;
+  }
+
+  if (forWrite) {
+    Storage.mkdir("/.crosspoint");
+    atlas = Storage.open(path.c_str(), O_RDWR | O_CREAT);
+    if (!atlas) {
+      LOG_ERR("THUMB", "Failed to open %s for writing", path.c_str());
+      return false;
+    }
+  } else if (!Storage.exists(path.c_str()) || !Storage.openFileForRead("THUMB", path, atlas)) {
+    return false;
+  }
+  writable = forWrite;
+
+  uint32_t magic = 0;
+  uint16_t fileHeight = 0;
+  uint16_t slotCount = 0;
+  uint32_t fileSlotSize = 0;
+  serialization::readPod(atlas, magic);
+  serialization::readPod(atlas, fileHeight);
+  serialization::readPod(atlas, slotCount);
+  serialization::readPod(atlas, fileSlotSize);
+  if (magic != ATLAS_MAGIC || fileHeight != height || slotCount != SLOT_COUNT || fileSlotSize != slotSize) {
+    if (forWrite) {
+      return reset();
+    }
+    LOG_DBG("THUMB", "Ignoring %s with a different layout", path.c_str());
+    atlas.close();
+    return false;
+  }
+
+  for (auto& slot : slots) {
+    serialization::readPod(atlas, slot.hash);
+    serialization::readPod(atlas, slot.size);
+    serialization::readPod(atlas, slot.stamp);
+  }
+  loaded = true;
+  return true;
+}
+
+bool ThumbnailAtlas::reset() {
+  memset(slots, 0, sizeof(slots));
+  atlas.truncate(0);
+  atlas.seek(0);
+  serialization::writePod(atlas, ATLAS_MAGIC);
+  serialization::writePod(atlas, static_cast<uint16_t>(height));
+  serialization::writePod(atlas, static_cast<uint16_t>(SLOT_COUNT));
+  serialization::writePod(atlas, slotSize);
+  for (int i = 0; i < SLOT_COUNT; i++) {
+    if (!writeSlotEntry(i)) {
+      LOG_ERR("THUMB", "Failed to initialise %s", path.c_str());
+      atlas.close();
+      return false;
+    }
+  }
+  LOG_DBG("THUMB", "Created %s", path.c_str());
+  loaded = true;
+  return true;
+}
+
+bool ThumbnailAtlas::writeSlotEntry(const int index) {
+  const Slot& slot = slots[index];
+  if (!atlas.seek(ATLAS_HEADER_SIZE + index * ATLAS_SLOT_ENTRY_SIZE)) {
+    return false;
+  }
+  return atlas.write(reinterpret_cast<const uint8_t*>(&slot.hash), sizeof(slot.hash)) == sizeof(slot.hash) &&
+         atlas.write(reinterpret_cast<const uint8_t*>(&slot.size), sizeof(slot.size)) == sizeof(slot.size) &&
+         atlas.write(reinterpret_cast<const uint8_t*>(&slot.stamp), sizeof(slot.stamp)) == sizeof(slot.stamp);
+}
+
+bool ThumbnailAtlas::contains(const std::string& bookPath) { return load(false) && findSlot(hashPath(bookPath)) >= 0; }
+
+bool ThumbnailAtlas::store(const std::string& bookPath, const std::string& thumbPath) {
+  FsFile thumb;
+  if (!Storage.openFileForRead("THUMB", thumbPath, thumb)) {
+    return false;
+  }
+  const uint32_t thumbSize = thumb.size();
+  if (thumbSize == 0 || thumbSize > slotSize) {
+    LOG_DBG("THUMB", "%s doesn't fit a %u byte slot", thumbPath.c_str(), slotSize);
+    thumb.close();
+    return false;
+  }
+  if (!load(true)) {
+    thumb.close();
+    return false;
+  }
+
+  const uint64_t hash = hashPath(bookPath);
+  uint32_t stamp = 0;
+  for (const auto& slot : slots) {
+    stamp = std::max(stamp, slot.stamp);
+  }
+  int index = findSlot(hash);
+  if (index < 0) {
+    // First free slot, otherwise the least recently stored one
+    index = 0;
+    for (int i = 0; i < SLOT_COUNT; i++) {
+      if (slots[i].size == 0) {
+        index = i;
+        break;
+      }
+      if (slots[i].stamp < slots[index].stamp) {
+        index = i;
+      }
+    }
+  }
+  // Slots below this one are always written out in full, so its offset is within the file
+  const uint32_t offset = getSlotOffset(index);
+  if (atlas.size() < offset) {
+    LOG_ERR("THUMB", "%s is shorter than slot %d", path.c_str(), index);
+    thumb.close();
+    return false;
+  }
+
+  // Free the slot while it's rewritten, so a failed copy leaves no half-written thumbnail behind
+  slots[index] = {0, 0, 0};
+  bool ok = writeSlotEntry(index) && atlas.seek(offset);
+  uint8_t buffer[COPY_CHUNK_SIZE];
+  uint32_t copied = 0;
+  while (ok && copied < thumbSize) {
+    const int n = thumb.read(buffer, std::min<uint32_t>(sizeof(buffer), thumbSize - copied));
+    ok = n > 0 && atlas.write(buffer, n) == static_cast<size_t>(n);
+    copied += n > 0 ? n : 0;
+  }
+  thumb.close();
+
+  // Pad the last slot of the file to its full size so the next one can be seeked to
+  if (ok && index < SLOT_COUNT - 1 && atlas.size() < offset + slotSize) {
+    memset(buffer, 0, sizeof(buffer));
+    for (uint32_t left = slotSize - copied; ok && left > 0;) {
+      const size_t n = std::min<uint32_t>(sizeof(buffer), left);
+      ok = atlas.write(buffer, n) == n;
+      left -= n;
+    }
+  }
+
+  if (ok) {
+    slots[index] = {hash, thumbSize, stamp + 1};
+    ok = writeSlotEntry(index);
+  }
+  atlas.flush();
+  if (!ok) {
+    LOG_ERR("THUMB", "Failed to store %s in %s", thumbPath.c_str(), path.c_str());
+    return false;
+  }
+  LOG_DBG("THUMB", "Stored %s in slot %d of %s", thumbPath.c_str(), index, path.c_str());
+  return true;
+}
+
+bool ThumbnailAtlas::openThumb(const std::string& bookPath, const std::string& thumbPath) {
+  usingAtlas = false;
+  single.close();
+
+  const int index = load(false) ? findSlot(hashPath(bookPath)) : -1;
+  if (index >= 0) {
+    usingAtlas = true;
+    thumbOffset = getSlotOffset(index);
+    return true;
+  }
+  return Storage.openFileForRead("THUMB", thumbPath, single);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <HalStorage.h>
+
+#include <cstdint>
+#include <string>
+
+// Home screen thumbnails of the recent books, kept together in /.crosspoint/thumbs_<height>.atlas so drawing the
+// covers takes one open and a seek per cover instead of opening a file in each book's cache directory.
+// The atlas has a fixed number of fixed-size slots, each holding the (already dithered) thumbnail BMP of one book,
+// indexed by a hash of the book path. When it is full the least recently stored slot is reused. Thumbnails too large
+// for a slot are only read from their own file.
+class ThumbnailAtlas {
+ public:
+  explicit ThumbnailAtlas(int height);
+  ~ThumbnailAtlas();
+  ThumbnailAtlas(const ThumbnailAtlas&) = delete;
+  ThumbnailAtlas& operator=(const ThumbnailAtlas&) = delete;
+
+  bool contains(const std::string& bookPath);
+  // Copies the thumbnail BMP at thumbPath into the atlas as the thumbnail of bookPath
+  bool store(const std::string& bookPath, const std::string& thumbPath);
+
+  // Points getFile() and getOffset() at the thumbnail of bookPath: its slot in the atlas when there is one,
+  // otherwise the BMP at thumbPath. Returns false if neither can be opened.
+  bool openThumb(const std::string& bookPath, const std::string& thumbPath);
+  FsFile& getFile() { return usingAtlas ? atlas : single; }
+  uint32_t getOffset() const { return usingAtlas ? thumbOffset : 0; }
+
+ private:
+  struct Slot {
+    uint64_t hash;
+    uint32_t size;  // 0 while the slot is free
+    uint32_t stamp;
+  };
+  static constexpr int SLOT_COUNT = 10;  // One per recent book
+
+  int height;
+  uint32_t slotSize;
+  std::string path;
+  FsFile atlas;
+  FsFile single;
+  bool loaded = false;
+  bool writable = false;
+  bool usingAtlas = false;
+  uint32_t thumbOffset = 0;
+  Slot slots[SLOT_COUNT] = {};
+
+  bool load(bool forWrite);
+  bool reset();
+  bool writeSlotEntry(int index);
+  int findSlot(uint64_t hash) const;
+  uint32_t getSlotOffset(int index) const;
+};
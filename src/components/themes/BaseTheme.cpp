@@ -10,12 +10,28 @@
 
 #include "I18n.h"
 #include "RecentBooksStore.h"
+#include "components/ThumbnailAtlas.h"
 #include "components/UITheme.h"
 #include "fontIds.h"
 
 // Internal constants
 namespace {
 constexpr int batteryPercentSpacing = 4;
+
+// Width the status bar keeps for the battery, the title stays clear of it
+int statusBarBatteryWidth(const bool showPercentage) { return showPercentage ? 50 : 20; }
+
+// Where the status bar draws the battery, left aligned on the line of the progress text
+Rect statusBarBatteryRect(const GfxRenderer& renderer, const int paddingBottom) {
+  const auto& metrics = UITheme::getInstance().getMetrics();
+  int orientedMarginTop, orientedMarginRight, orientedMarginBottom, orientedMarginLeft;
+  renderer.getOrientedViewableTRBL(&orientedMarginTop, &orientedMarginRight, &orientedMarginBottom,
+                                   &orientedMarginLeft);
+  const int textY = renderer.getScreenHeight() - UITheme::getInstance().getStatusBarHeight() - orientedMarginBottom -
+                    paddingBottom - 4;
+  return Rect{metrics.statusBarHorizontalMargin + orientedMarginLeft + 1, textY, metrics.batteryWidth,
+              metrics.batteryHeight};
+}
 constexpr int homeMenuMargin = 20;
 constexpr int homeMarginTop = 30;
 constexpr int subtitleY = 738;
@@ -351,14 +367,14 @@ void BaseTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, const std:
   int bookWidth, bookX;
   bool hasCoverImage = false;
 
+  ThumbnailAtlas atlas(BaseMetrics::values.homeCoverHeight);
   if (hasContinueReading && !recentBooks[0].coverBmpPath.empty()) {
     // Try to get actual image dimensions from BMP header
     const std::string coverBmpPath =
         UITheme::getCoverThumbPath(recentBooks[0].coverBmpPath, BaseMetrics::values.homeCoverHeight);
 
-    FsFile file;
-    if (Storage.openFileForRead("HOME", coverBmpPath, file)) {
-      Bitmap bitmap(file);
+    if (atlas.openThumb(recentBooks[0].path, coverBmpPath)) {
+      Bitmap bitmap(atlas.getFile(), false, atlas.getOffset());
       if (bitmap.parseHeaders() == BmpReaderError::Ok) {
         hasCoverImage = true;
         const int imgWidth = bitmap.getWidth();
@@ -378,7 +394,6 @@ void BaseTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, const std:
           bookWidth = rect.width / 2;  // Fallback
         }
       }
-      file.close();
     }
   }
 
@@ -407,9 +422,8 @@ void BaseTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, const std:
           UITheme::getCoverThumbPath(recentBooks[0].coverBmpPath, BaseMetrics::values.homeCoverHeight);
 
       // First time: load cover from SD and render
-      FsFile file;
-      if (Storage.openFileForRead("HOME", coverBmpPath, file)) {
-        Bitmap bitmap(file);
+      if (atlas.openThumb(recentBooks[0].path, coverBmpPath)) {
+        Bitmap bitmap(atlas.getFile(), false, atlas.getOffset());
         if (bitmap.parseHeaders() == BmpReaderError::Ok) {
           LOG_DBG("THEME", "Rendering bmp");
 
@@ -432,7 +446,6 @@ void BaseTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, const std:
             renderer.drawRect(bookX + 2, bookY + 2, bookWidth - 4, bookHeight - 4);
           }
         }
-        file.close();
       }
     }
 
@@ -611,7 +624,7 @@ Rect BaseTheme::drawPopup(const GfxRenderer& renderer, const char* message) cons
   const int textX = x + (w - textWidth) / 2;
   const int textY = y + margin - 2;
   renderer.drawText(UI_12_FONT_ID, textX, textY, message, true, EpdFontFamily::BOLD);
-  renderer.displayBuffer();
+  renderer.displayWindow(x - 2, y - 2, w + 4, h + 4);
   return Rect{x, y, w, h};
 }
 
@@ -625,7 +638,22 @@ void BaseTheme::fillPopupProgress(const GfxRenderer& renderer, const Rect& layou
 
   renderer.fillRect(barX, barY, fillWidth, barHeight, true);
 
-  renderer.displayBuffer(HalDisplay::FAST_REFRESH);
+  renderer.displayWindow(barX, barY, barWidth, barHeight);
+}
+
+void BaseTheme::redrawStatusBarBattery(GfxRenderer& renderer, const int paddingBottom) const {
+  if (!SETTINGS.statusBarBattery) {
+    return;
+  }
+  const bool showBatteryPercentage =
+      SETTINGS.hideBatteryPercentage == CrossPointSettings::HIDE_BATTERY_PERCENTAGE::HIDE_NEVER;
+  const Rect rect = statusBarBatteryRect(renderer, paddingBottom);
+  // The icon sits a little below the top of the percentage text
+  const int width = statusBarBatteryWidth(showBatteryPercentage);
+  const int height = std::max(rect.height + 6, renderer.getLineHeight(SMALL_FONT_ID));
+  renderer.fillRect(rect.x, rect.y, width, height, false);
+  GUI.drawBatteryLeft(renderer, rect, showBatteryPercentage);
+  renderer.displayWindow(rect.x, rect.y, width, height);
 }
 
 void BaseTheme::drawStatusBar(GfxRenderer& renderer, const float bookProgress, const int currentPage,
@@ -645,12 +673,20 @@ void BaseTheme::drawStatusBar(GfxRenderer& renderer, const float bookProgress, c
     // Right aligned text for progress counter
     char progressStr[32];
 
+    // A page count of 0 means the chapter is still being laid out, a negative one is an estimate
+    char pageCountStr[12] = "?";
+    if (pageCount > 0) {
+      snprintf(pageCountStr, sizeof(pageCountStr), "%d", pageCount);
+    } else if (pageCount < 0) {
+      snprintf(pageCountStr, sizeof(pageCountStr), "~%d", -pageCount);
+    }
+
     if (SETTINGS.statusBarBookProgressPercentage && SETTINGS.statusBarChapterPageCount) {
-      snprintf(progressStr, sizeof(progressStr), "%d/%d  %.0f%%", currentPage, pageCount, bookProgress);
+      snprintf(progressStr, sizeof(progressStr), "%d/%s  %.0f%%", currentPage, pageCountStr, bookProgress);
     } else if (SETTINGS.statusBarBookProgressPercentage) {
       snprintf(progressStr, sizeof(progressStr), "%.0f%%", bookProgress);
     } else {
-      snprintf(progressStr, sizeof(progressStr), "%d/%d", currentPage, pageCount);
+      snprintf(progressStr, sizeof(progressStr), "%d/%s", currentPage, pageCountStr);
     }
 
     progressTextWidth = renderer.getTextWidth(SMALL_FONT_ID, progressStr);
@@ -681,10 +717,7 @@ void BaseTheme::drawStatusBar(GfxRenderer& renderer, const float bookProgress, c
   const bool showBatteryPercentage =
       SETTINGS.hideBatteryPercentage == CrossPointSettings::HIDE_BATTERY_PERCENTAGE::HIDE_NEVER;
   if (SETTINGS.statusBarBattery) {
-    GUI.drawBatteryLeft(renderer,
-                        Rect{metrics.statusBarHorizontalMargin + orientedMarginLeft + 1, textY, metrics.batteryWidth,
-                             metrics.batteryHeight},
-                        showBatteryPercentage);
+    GUI.drawBatteryLeft(renderer, statusBarBatteryRect(renderer, paddingBottom), showBatteryPercentage);
   }
 
   // Draw Title
@@ -695,7 +728,7 @@ void BaseTheme::drawStatusBar(GfxRenderer& renderer, const float bookProgress, c
     const int rendererableScreenWidth =
         renderer.getScreenWidth() - (metrics.statusBarHorizontalMargin * 2) - orientedMarginLeft - orientedMarginRight;
 
-    const int batterySize = SETTINGS.statusBarBattery ? (showBatteryPercentage ? 50 : 20) : 0;
+    const int batterySize = SETTINGS.statusBarBattery ? statusBarBatteryWidth(showBatteryPercentage) : 0;
     const int titleMarginLeft = batterySize + 30;
     const int titleMarginRight = progressTextWidth + 30;
 
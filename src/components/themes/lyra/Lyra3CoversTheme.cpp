@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "RecentBooksStore.h"
+#include "components/ThumbnailAtlas.h"
 #include "components/UITheme.h"
 #include "components/icons/cover.h"
 #include "fontIds.h"
@@ -30,6 +31,7 @@ void Lyra3CoversTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, con
   // Only load from SD on first render, then use stored buffer
   if (hasContinueReading) {
     if (!coverRendered) {
+      ThumbnailAtlas atlas(Lyra3CoversMetrics::values.homeCoverHeight);
       for (int i = 0;
            i < std::min(static_cast<int>(recentBooks.size()), Lyra3CoversMetrics::values.homeRecentBooksCount); i++) {
         std::string coverPath = recentBooks[i].coverBmpPath;
@@ -42,9 +44,8 @@ void Lyra3CoversTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, con
               UITheme::getCoverThumbPath(coverPath, Lyra3CoversMetrics::values.homeCoverHeight);
 
           // First time: load cover from SD and render
-          FsFile file;
-          if (Storage.openFileForRead("HOME", coverBmpPath, file)) {
-            Bitmap bitmap(file);
+          if (atlas.openThumb(recentBooks[i].path, coverBmpPath)) {
+            Bitmap bitmap(atlas.getFile(), false, atlas.getOffset());
             if (bitmap.parseHeaders() == BmpReaderError::Ok) {
               float coverHeight = static_cast<float>(bitmap.getHeight());
               float coverWidth = static_cast<float>(bitmap.getWidth());
@@ -59,7 +60,8 @@ void Lyra3CoversTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, con
             } else {
               hasCover = false;
             }
-            file.close();
+          } else {
+            hasCover = false;
           }
         }
         // Draw either way
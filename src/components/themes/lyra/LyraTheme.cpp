@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "RecentBooksStore.h"
+#include "components/ThumbnailAtlas.h"
 #include "components/UITheme.h"
 #include "components/icons/book.h"
 #include "components/icons/book24.h"
@@ -436,9 +437,9 @@ void LyraTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, const std:
         const std::string coverBmpPath = UITheme::getCoverThumbPath(coverPath, LyraMetrics::values.homeCoverHeight);
 
         // First time: load cover from SD and render
-        FsFile file;
-        if (Storage.openFileForRead("HOME", coverBmpPath, file)) {
-          Bitmap bitmap(file);
+        ThumbnailAtlas atlas(LyraMetrics::values.homeCoverHeight);
+        if (atlas.openThumb(book.path, coverBmpPath)) {
+          Bitmap bitmap(atlas.getFile(), false, atlas.getOffset());
           if (bitmap.parseHeaders() == BmpReaderError::Ok) {
             coverWidth = bitmap.getWidth();
             renderer.drawBitmap(bitmap, tileX + hPaddingInSelection, tileY + hPaddingInSelection, coverWidth,
@@ -446,7 +447,8 @@ void LyraTheme::drawRecentBookCover(GfxRenderer& renderer, Rect rect, const std:
           } else {
             hasCover = false;
           }
-          file.close();
+        } else {
+          hasCover = false;
         }
       }
 
@@ -564,7 +566,7 @@ Rect LyraTheme::drawPopup(const GfxRenderer& renderer, const char* message) cons
   const int textX = x + (w - textWidth) / 2;
   const int textY = y + popupMarginY - 2;
   renderer.drawText(UI_12_FONT_ID, textX, textY, message, false, EpdFontFamily::REGULAR);
-  renderer.displayBuffer();
+  renderer.displayWindow(x - outline, y - outline, w + outline * 2, h + outline * 2);
 
   return Rect{x, y, w, h};
 }
@@ -582,7 +584,7 @@ void LyraTheme::fillPopupProgress(const GfxRenderer& renderer, const Rect& layou
 
   renderer.fillRect(barX, barY, fillWidth, barHeight, false);
 
-  renderer.displayBuffer(HalDisplay::FAST_REFRESH);
+  renderer.displayWindow(barX, barY, barWidth, barHeight);
 }
 
 void LyraTheme::drawTextField(const GfxRenderer& renderer, Rect rect, const int textWidth) const {
@@ -9,15 +9,24 @@
 #include <I18n.h>
 #include <Logging.h>
 #include <SPI.h>
+#include <Trace.h>
+#include <WiFi.h>
 #include <builtinFonts/all.h>
 
 #include <cstring>
 
+#include "BootTimeline.h"
+#include "CacheBudget.h"
+#include "CoverJobQueue.h"
 #include "CrossPointSettings.h"
 #include "CrossPointState.h"
-#include "KOReaderCredentialStore.h"
+#include "KOReaderSyncQueue.h"
 #include "MappedInputManager.h"
+#include "MemoryBudget.h"
+#include "PerfStats.h"
 #include "RecentBooksStore.h"
+#include "WakeFrame.h"
+#include "WarmBooks.h"
 #include "activities/Activity.h"
 #include "activities/ActivityManager.h"
 #include "components/UITheme.h"
@@ -121,6 +130,18 @@ EpdFont ui12RegularFont(&ubuntu_12_regular);
 EpdFont ui12BoldFont(&ubuntu_12_bold);
 EpdFontFamily ui12FontFamily(&ui12RegularFont, &ui12BoldFont);
 
+// Light sleep slice while the panel refreshes; short enough that a quick button tap is still seen between slices
+constexpr uint32_t PANEL_SLEEP_SLICE_MS = 40;
+// Longest wait between two passes of the loop, for the buttons that can only be polled; longer after inactivity
+constexpr unsigned long ACTIVE_POLL_MS = 10;
+constexpr unsigned long IDLE_POLL_MS = 50;
+// Wi-Fi, lwIP, the servers and TLS free their buffers in another order than they took them, which can leave the heap
+// in pieces too small for the reader's larger allocations (BW buffer chunks, image pixel caches, a private inflate
+// window). They allocate from the system heap with no region of their own to hand back, so once a session is over and
+// its tasks have let go, a heap with no block this large is mended by restarting into the same screen.
+constexpr uint32_t NETWORK_MIN_LARGEST_BLOCK = 40 * 1024;
+constexpr unsigned long NETWORK_SETTLE_MS = 3000;
+
 // measurement of power button press duration calibration value
 unsigned long t1 = 0;
 unsigned long t2 = 0;
@@ -177,21 +198,95 @@ void waitForPowerRelease() {
   }
 }
 
+// Light sleeps through a panel refresh the render task is waiting on. The buttons are polled between short slices so a
+// press during a refresh isn't missed. Not with WiFi up or on USB, where the connection or the USB serial would drop.
+// Returns whether it slept.
+bool sleepThroughPanelRefresh() {
+  if (!display.isRefreshing() || WiFi.getMode() != WIFI_MODE_NULL || gpio.isUsbConnected()) {
+    return false;
+  }
+  bool slept = false;
+  while (display.lightSleepWhileBusy(PANEL_SLEEP_SLICE_MS)) {
+    slept = true;
+    if (gpio.pollForInput()) {
+      break;
+    }
+  }
+  return slept;
+}
+
+// Saves what the next boot needs to come back to the reader, with its page up at once, if it is in front
+void saveStateForBoot() {
+  APP_STATE.lastSleepFromReader = activityManager.isReaderActivity();
+  APP_STATE.saveToFile();
+  if (APP_STATE.lastSleepFromReader) {
+    // The page is still in the frame buffer until the sleep screen draws over it
+    RenderLock lock;
+    WakeFrame::save(display.getFrameBuffer(), APP_STATE.openEpubPath);
+  } else {
+    WakeFrame::clear();
+  }
+}
+
 // Enter deep sleep mode
 void enterDeepSleep() {
   HalPowerManager::Lock powerLock;  // Ensure we are at normal CPU frequency for sleep preparation
-  APP_STATE.lastSleepFromReader = activityManager.isReaderActivity();
-  APP_STATE.saveToFile();
+  saveStateForBoot();
 
   activityManager.goToSleep();
 
   display.deepSleep();
+  powerManager.logTelemetry();
   LOG_DBG("MAIN", "Power button press calibration value: %lu ms", t2 - t1);
   LOG_DBG("MAIN", "Entering deep sleep");
 
   powerManager.startDeepSleep(gpio);
 }
 
+// Restarts if a network session left the heap too fragmented, see NETWORK_MIN_LARGEST_BLOCK
+void reclaimHeapAfterNetwork() {
+  static bool networkWasUp = false;
+  static unsigned long lastNetworkUse = 0;
+  if (WiFi.getMode() != WIFI_MODE_NULL) {
+    networkWasUp = true;
+    lastNetworkUse = millis();
+    return;
+  }
+  if (!networkWasUp || millis() - lastNetworkUse < NETWORK_SETTLE_MS || activityManager.preventAutoSleep() ||
+      RenderLock::peek()) {
+    return;
+  }
+  networkWasUp = false;
+
+  const uint32_t largestBlock = ESP.getMaxAllocHeap();
+  if (largestBlock >= NETWORK_MIN_LARGEST_BLOCK) {
+    LOG_DBG("MAIN", "Largest free block after network session: %u bytes", largestBlock);
+    return;
+  }
+  LOG_INF("MAIN", "Largest free block after network session is %u bytes, restarting", largestBlock);
+  HalPowerManager::Lock powerLock;
+  saveStateForBoot();
+  ESP.restart();
+}
+
+// Caches that hold RAM across pages and screens, given their share of the heap by the memory budget
+void registerMemoryConsumers() {
+  // Decompressed reader font groups: only of use while reading, a page's worth is kept even under pressure
+  MEMORY_BUDGET.add({"glyph cache",
+                     MemoryBudget::Normal,
+                     8 * 1024,
+                     {8 * 1024, 24 * 1024, 0},
+                     [] { return fontDecompressor.getCachedBytes(); },
+                     [](const uint32_t bytes) { fontDecompressor.setCacheBudget(bytes); }});
+  // Books closed a short while ago: only spare a reload, so they go first
+  MEMORY_BUDGET.add({"warm books",
+                     MemoryBudget::Low,
+                     0,
+                     {48 * 1024, 48 * 1024, 0},
+                     [] { return static_cast<uint32_t>(WARM_BOOKS.getHeapUsage()); },
+                     [](const uint32_t bytes) { WARM_BOOKS.setLimit(bytes); }});
+}
+
 void setupDisplayAndFonts() {
   display.begin();
   renderer.begin();
@@ -203,6 +298,9 @@ void setupDisplayAndFonts() {
     LOG_ERR("MAIN", "Font decompressor init failed");
   }
   renderer.setFontDecompressor(&fontDecompressor);
+  PerfStats::begin(&fontDecompressor);
+  registerMemoryConsumers();
+  BootTimeline::mark("display");
   renderer.insertFont(BOOKERLY_14_FONT_ID, bookerly14FontFamily);
 #ifndef OMIT_FONTS
   renderer.insertFont(BOOKERLY_12_FONT_ID, bookerly12FontFamily);
@@ -221,6 +319,7 @@ void setupDisplayAndFonts() {
   renderer.insertFont(UI_10_FONT_ID, ui10FontFamily);
   renderer.insertFont(UI_12_FONT_ID, ui12FontFamily);
   renderer.insertFont(SMALL_FONT_ID, smallFontFamily);
+  BootTimeline::mark("fonts");
   LOG_DBG("MAIN", "Fonts setup");
 }
 
@@ -229,6 +328,7 @@ void setup() {
 
   gpio.begin();
   powerManager.begin();
+  BootTimeline::mark("hal");
 
   // Only start serial if USB connected
   if (gpio.isUsbConnected()) {
@@ -239,6 +339,7 @@ void setup() {
       delay(10);
     }
   }
+  BootTimeline::mark("serial");
 
   // SD Card Initialization
   // We need 6 open files concurrently when parsing a new chapter
@@ -246,14 +347,17 @@ void setup() {
     LOG_ERR("MAIN", "SD card initialization failed");
     setupDisplayAndFonts();
     activityManager.goToFullScreenMessage("SD card error", EpdFontFamily::BOLD);
+    BootTimeline::finish(false);
     return;
   }
 
+  BootTimeline::mark("storage");
+
   SETTINGS.loadFromFile();
   I18N.loadSettings();
-  KOREADER_STORE.loadFromFile();
   UITheme::getInstance().reload();
   ButtonNavigator::setMappedInputManager(mappedInputManager);
+  BootTimeline::mark("settings");
 
   switch (gpio.getWakeupReason()) {
     case HalGPIO::WakeupReason::PowerButton:
@@ -272,21 +376,36 @@ void setup() {
     default:
       break;
   }
+  BootTimeline::mark("wakeup");
 
   // First serial output only here to avoid timing inconsistencies for power button press duration verification
   LOG_DBG("MAIN", "Starting CrossPoint version " CROSSPOINT_VERSION);
 
   setupDisplayAndFonts();
 
-  activityManager.goToBoot();
-
   APP_STATE.loadFromFile();
-  RECENT_BOOKS.loadFromFile();
-
   // Boot to home screen if no book is open, last sleep was not from reader, back button is held, or reader activity
   // crashed (indicated by readerActivityLoadCount > 0)
-  if (APP_STATE.openEpubPath.empty() || !APP_STATE.lastSleepFromReader ||
-      mappedInputManager.isPressed(MappedInputManager::Button::Back) || APP_STATE.readerActivityLoadCount > 0) {
+  const bool bootToHome = APP_STATE.openEpubPath.empty() || !APP_STATE.lastSleepFromReader ||
+                          mappedInputManager.isPressed(MappedInputManager::Button::Back) ||
+                          APP_STATE.readerActivityLoadCount > 0;
+
+  // Waking into a book puts its page back up right away instead of the boot screen, the reader loads behind it
+  if (bootToHome) {
+    WakeFrame::clear();
+  }
+  if (bootToHome || !WakeFrame::restore(display, APP_STATE.openEpubPath)) {
+    activityManager.goToBoot();
+  }
+  BootTimeline::mark("first screen");
+
+  RECENT_BOOKS.loadFromFile();
+  COVER_JOBS.loadFromFile();
+  CACHE_BUDGET.loadFromFile();
+  KOSYNC_QUEUE.loadFromFile();
+  BootTimeline::mark("stores");
+
+  if (bootToHome) {
     activityManager.goHome();
   } else {
     // Clear app state to avoid getting into a boot loop if the epub doesn't load
@@ -296,6 +415,8 @@ void setup() {
     APP_STATE.saveToFile();
     activityManager.goToReader(path);
   }
+  BootTimeline::mark("activity");
+  BootTimeline::finish();
 
   // Ensure we're not still holding the power button before leaving setup
   waitForPowerRelease();
@@ -307,6 +428,7 @@ void loop() {
   static unsigned long lastMemPrint = 0;
 
   gpio.update();
+  powerManager.sampleBattery();
 
   renderer.setFadingFix(SETTINGS.fadingFix);
 
@@ -329,6 +451,14 @@ void loop() {
         logSerial.write(buf, HalDisplay::BUFFER_SIZE);
         logSerial.printf("SCREENSHOT_END\n");
       }
+#ifdef ENABLE_TRACE
+      if (cmd == "TRACE") {
+        logSerial.printf("TRACE_START\n");
+        Trace::dump(
+            [](const char* data, const size_t len) { logSerial.write(reinterpret_cast<const uint8_t*>(data), len); });
+        logSerial.printf("TRACE_END\n");
+      }
+#endif
     }
   }
 
@@ -371,11 +501,21 @@ void loop() {
     return;
   }
 
+  // A screenshot taken during a render goes to the SD card once the render task is done with it
+  if (ScreenshotUtil::hasPending() && !RenderLock::peek()) {
+    RenderLock lock;
+    ScreenshotUtil::writePending();
+  }
+
+  reclaimHeapAfterNetwork();
+  MEMORY_BUDGET.poll();
+
   const unsigned long activityStartTime = millis();
   activityManager.loop();
   const unsigned long activityDuration = millis() - activityStartTime;
 
   const unsigned long loopDuration = millis() - loopStartTime;
+  PerfStats::loopDone(loopDuration);
   if (loopDuration > maxLoopDuration) {
     maxLoopDuration = loopDuration;
     if (maxLoopDuration > 50) {
@@ -389,14 +529,21 @@ void loop() {
   if (activityManager.skipLoopDelay()) {
     powerManager.setPowerSaving(false);  // Make sure we're at full performance when skipLoopDelay is requested
     yield();                             // Give FreeRTOS a chance to run tasks, but return immediately
-  } else {
-    if (millis() - lastActivityTime >= HalPowerManager::IDLE_POWER_SAVING_MS) {
+  } else if (!sleepThroughPanelRefresh()) {
+    // Wait for the power button, the next poll of the others, or the next deadline of the loop, whichever comes first
+    const unsigned long idleMs = millis() - lastActivityTime;
+    unsigned long waitMs;
+    if (idleMs >= HalPowerManager::IDLE_POWER_SAVING_MS) {
       // If we've been inactive for a while, increase the delay to save power
       powerManager.setPowerSaving(true);  // Lower CPU frequency after extended inactivity
-      delay(50);
+      waitMs = IDLE_POLL_MS;
     } else {
-      // Short delay to prevent tight loop while still being responsive
-      delay(10);
+      waitMs = std::min(ACTIVE_POLL_MS, HalPowerManager::IDLE_POWER_SAVING_MS - idleMs);
+    }
+    if (idleMs < sleepTimeoutMs) {
+      waitMs = std::min(waitMs, sleepTimeoutMs - idleMs);
     }
+    waitMs = std::min(waitMs, activityManager.msUntilLoopDeadline());
+    gpio.waitForInput(waitMs);
   }
 }
\ No newline at end of file
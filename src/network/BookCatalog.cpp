@@ -0,0 +1,408 @@
+#include "BookCatalog.h"
+
+#include <Arduino.h>
+#include <HalStorage.h>
+#include <Logging.h>
+#include <Serialization.h>
+#include <esp_random.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "LibrarySearchIndex.h"
+#include "util/StringUtils.h"
+
+namespace {
+constexpr char CATALOG_FILE[] = "/.crosspoint/book_catalog.bin";
+constexpr char CATALOG_TEMP_FILE[] = "/.crosspoint/book_catalog.tmp";
+constexpr uint8_t CATALOG_FILE_VERSION = 2;
+constexpr size_t MAX_PATH_LENGTH = 500;
+// Titles and authors are cut to what a length byte holds
+constexpr size_t MAX_NAME_LENGTH = UINT8_MAX;
+constexpr int MAX_SCAN_DEPTH = 8;
+// Books whose title and author a full scan carries over from the catalog it replaces, 16 bytes of RAM each
+constexpr size_t MAX_CARRIED_BOOKS = 2048;
+// Same folders as the web file browser hides, on top of anything starting with "."
+const char* SKIPPED_FOLDERS[] = {"System Volume Information", "XTCache"};
+
+struct Record {
+  std::string path;
+  uint32_t size = 0;
+  std::string title;
+  std::string author;
+};
+
+bool isBook(const std::string& path) {
+  return StringUtils::checkFileExtension(path, ".epub") || StringUtils::checkFileExtension(path, ".xtc") ||
+         StringUtils::checkFileExtension(path, ".xtch") || StringUtils::checkFileExtension(path, ".txt") ||
+         StringUtils::checkFileExtension(path, ".md");
+}
+
+bool isSkipped(const char* name) {
+  if (name[0] == '.') {
+    return true;
+  }
+  for (const char* skipped : SKIPPED_FOLDERS) {
+    if (strcmp(name, skipped) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// At most MAX_NAME_LENGTH bytes of name, not splitting a UTF-8 sequence
+uint8_t clippedLength(const std::string& name) {
+  size_t len = std::min(name.size(), MAX_NAME_LENGTH);
+  if (len < name.size()) {
+    while (len > 0 && (static_cast<uint8_t>(name[len]) & 0xC0) == 0x80) {
+      len--;
+    }
+  }
+  return static_cast<uint8_t>(len);
+}
+
+void writeRecord(FsFile& file, const Record& record) {
+  const auto pathLen = static_cast<uint16_t>(record.path.size());
+  const uint8_t titleLen = clippedLength(record.title);
+  const uint8_t authorLen = clippedLength(record.author);
+  serialization::writePod(file, record.size);
+  serialization::writePod(file, pathLen);
+  serialization::writePod(file, titleLen);
+  serialization::writePod(file, authorLen);
+  file.write(reinterpret_cast<const uint8_t*>(record.path.data()), pathLen);
+  file.write(reinterpret_cast<const uint8_t*>(record.title.data()), titleLen);
+  file.write(reinterpret_cast<const uint8_t*>(record.author.data()), authorLen);
+}
+
+// False at the end of the file, or where it stops making sense
+bool readRecord(FsFile& file, Record& record) {
+  uint16_t pathLen = 0;
+  uint8_t titleLen = 0;
+  uint8_t authorLen = 0;
+  if (file.available() < static_cast<int>(sizeof(record.size) + sizeof(pathLen) + 2)) {
+    return false;
+  }
+  serialization::readPod(file, record.size);
+  serialization::readPod(file, pathLen);
+  serialization::readPod(file, titleLen);
+  serialization::readPod(file, authorLen);
+  if (pathLen == 0 || pathLen > MAX_PATH_LENGTH) {
+    return false;
+  }
+  record.path.resize(pathLen);
+  record.title.resize(titleLen);
+  record.author.resize(authorLen);
+  return file.read(reinterpret_cast<uint8_t*>(&record.path[0]), pathLen) == pathLen &&
+         (titleLen == 0 || file.read(reinterpret_cast<uint8_t*>(&record.title[0]), titleLen) == titleLen) &&
+         (authorLen == 0 || file.read(reinterpret_cast<uint8_t*>(&record.author[0]), authorLen) == authorLen);
+}
+
+bool openCatalog(FsFile& file, uint32_t* generation = nullptr) {
+  if (!Storage.exists(CATALOG_FILE) || !Storage.openFileForRead("CAT", CATALOG_FILE, file)) {
+    return false;
+  }
+  uint8_t version = 0;
+  uint32_t fileGeneration = 0;
+  serialization::readPod(file, version);
+  serialization::readPod(file, fileGeneration);
+  if (version != CATALOG_FILE_VERSION) {
+    file.close();
+    return false;
+  }
+  if (generation) {
+    *generation = fileGeneration;
+  }
+  return true;
+}
+
+// A new catalog goes to a temporary file first. Its generation is random, so it doesn't repeat one from before the
+// catalog was dropped.
+bool beginWrite(FsFile& out) {
+  Storage.mkdir("/.crosspoint");
+  if (!Storage.openFileForWrite("CAT", CATALOG_TEMP_FILE, out)) {
+    return false;
+  }
+  serialization::writePod(out, CATALOG_FILE_VERSION);
+  serialization::writePod(out, static_cast<uint32_t>(esp_random()));
+  return true;
+}
+
+bool finishWrite(FsFile& out, const bool pathsChanged) {
+  out.close();
+  // The search index is built from the catalog's paths, it goes with them
+  if (pathsChanged) {
+    LibrarySearchIndex::invalidate();
+  }
+  Storage.remove(CATALOG_FILE);
+  if (!Storage.rename(CATALOG_TEMP_FILE, CATALOG_FILE)) {
+    Storage.remove(CATALOG_TEMP_FILE);
+    return false;
+  }
+  return true;
+}
+
+// Titles and authors of the catalog a full scan replaces, found again by path
+class CarriedNames {
+ public:
+  void load() {
+    if (!openCatalog(old)) {
+      return;
+    }
+    Record record;
+    uint32_t offset = old.position();
+    while (books.size() < MAX_CARRIED_BOOKS && readRecord(old, record)) {
+      if (!record.title.empty() || !record.author.empty()) {
+        books.push_back({BookCatalog::getId(record.path.c_str()), offset});
+      }
+      offset = old.position();
+    }
+    std::sort(books.begin(), books.end(), [](const Book& a, const Book& b) { return a.id < b.id; });
+  }
+
+  void fill(Record& record) {
+    const uint64_t id = BookCatalog::getId(record.path.c_str());
+    const auto it = std::lower_bound(books.begin(), books.end(), id,
+                                     [](const Book& book, const uint64_t value) { return book.id < value; });
+    Record carried;
+    if (it != books.end() && it->id == id && old.seek(it->offset) && readRecord(old, carried) &&
+        carried.path == record.path) {
+      record.title = std::move(carried.title);
+      record.author = std::move(carried.author);
+    }
+  }
+
+  ~CarriedNames() {
+    if (old) {
+      old.close();
+    }
+  }
+
+ private:
+  struct Book {
+    uint64_t id;
+    uint32_t offset;
+  };
+  FsFile old;
+  std::vector<Book> books;
+};
+
+void scanFolder(FsFile& out, std::string& path, const int depth, size_t& count, CarriedNames& carried) {
+  FsFile dir = Storage.open(path.empty() ? "/" : path.c_str());
+  if (!dir || !dir.isDirectory()) {
+    return;
+  }
+  char name[256];
+  Record record;
+  for (FsFile entry = dir.openNextFile(); entry; entry = dir.openNextFile()) {
+    entry.getName(name, sizeof(name));
+    const size_t parentLength = path.size();
+    if (!isSkipped(name) && parentLength + 1 + strlen(name) <= MAX_PATH_LENGTH) {
+      path += '/';
+      path += name;
+      if (entry.isDirectory()) {
+        if (depth < MAX_SCAN_DEPTH) {
+          entry.close();
+          scanFolder(out, path, depth + 1, count, carried);
+        }
+      } else if (isBook(name)) {
+        record.path = path;
+        record.size = entry.size();
+        record.title.clear();
+        record.author.clear();
+        carried.fill(record);
+        writeRecord(out, record);
+        count++;
+      }
+      path.resize(parentLength);
+    }
+    entry.close();
+    esp_task_wdt_reset();
+  }
+  dir.close();
+}
+
+bool build() {
+  const unsigned long start = millis();
+  CarriedNames carried;
+  carried.load();
+  FsFile out;
+  if (!beginWrite(out)) {
+    return false;
+  }
+  std::string path;
+  size_t count = 0;
+  scanFolder(out, path, 0, count, carried);
+
+  if (!finishWrite(out, true)) {
+    LOG_ERR("CAT", "Failed to save the book catalog");
+    return false;
+  }
+  LOG_DBG("CAT", "Catalog built: %u books in %lu ms", count, millis() - start);
+  return true;
+}
+
+// Copies the catalog through update, which may change a record or return false to leave it out, then appends append
+// if it has a path by then. Without a catalog there is nothing to keep up to date, it's built in full when asked for.
+void rewrite(const std::function<bool(Record&)>& update, const Record* append, const bool pathsChanged) {
+  FsFile in;
+  if (!openCatalog(in)) {
+    return;
+  }
+  FsFile out;
+  if (!beginWrite(out)) {
+    in.close();
+    BookCatalog::invalidate();
+    return;
+  }
+  Record record;
+  while (readRecord(in, record)) {
+    if (update(record)) {
+      writeRecord(out, record);
+    }
+  }
+  if (append && !append->path.empty()) {
+    writeRecord(out, *append);
+  }
+  in.close();
+  finishWrite(out, pathsChanged);
+}
+}  // namespace
+
+namespace BookCatalog {
+
+bool forEach(const std::function<void(const Book& book)>& callback) {
+  FsFile file;
+  if (!openCatalog(file)) {
+    if (!build() || !openCatalog(file)) {
+      return false;
+    }
+  }
+  Record record;
+  while (readRecord(file, record)) {
+    callback({record.path.c_str(), record.size, record.title.c_str(), record.author.c_str()});
+  }
+  file.close();
+  return true;
+}
+
+bool getGeneration(uint32_t& generation) {
+  FsFile file;
+  if (!openCatalog(file, &generation)) {
+    if (!build() || !openCatalog(file, &generation)) {
+      return false;
+    }
+  }
+  file.close();
+  return true;
+}
+
+void add(const char* path, const uint32_t size) {
+  if (isBook(path)) {
+    // A file replaced under the same name may be another book
+    Record added;
+    added.path = path;
+    added.size = size;
+    rewrite([path](const Record& record) { return record.path != path; }, &added, true);
+  }
+}
+
+void remove(const char* path) {
+  if (isBook(path)) {
+    rewrite([path](const Record& record) { return record.path != path; }, nullptr, true);
+  }
+}
+
+void move(const char* fromPath, const char* toPath) {
+  if (!isBook(fromPath) && !isBook(toPath)) {
+    return;
+  }
+  FsFile file = Storage.open(toPath);
+  const uint32_t size = file ? file.size() : 0;
+  if (file) {
+    file.close();
+  }
+  // The book keeps its title and author under the new name; one the catalog didn't have is added
+  Record added;
+  if (isBook(toPath)) {
+    added.path = toPath;
+    added.size = size;
+  }
+  rewrite(
+      [&](Record& record) {
+        if (record.path == toPath) {
+          return false;
+        }
+        if (record.path != fromPath) {
+          return true;
+        }
+        if (added.path.empty()) {
+          return false;
+        }
+        record.path = toPath;
+        record.size = size;
+        added.path.clear();
+        return true;
+      },
+      &added, true);
+}
+
+void describe(const char* path, const std::string& title, const std::string& author) {
+  // Read through first, so a book described already costs no write
+  FsFile file;
+  if (!openCatalog(file)) {
+    return;
+  }
+  Record record;
+  bool changed = false;
+  while (readRecord(file, record)) {
+    if (record.path == path) {
+      changed = record.title != title.substr(0, clippedLength(title)) ||
+                record.author != author.substr(0, clippedLength(author));
+      break;
+    }
+  }
+  file.close();
+  if (changed) {
+    rewrite(
+        [&](Record& record) {
+          if (record.path == path) {
+            record.title = title;
+            record.author = author;
+          }
+          return true;
+        },
+        nullptr, false);
+  }
+}
+
+uint64_t getId(const char* path) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char* c = path; *c; c++) {
+    hash ^= static_cast<uint8_t>(*c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool findById(const uint64_t id, std::string& path) {
+  bool found = false;
+  forEach([&](const Book& book) {
+    if (!found && getId(book.path) == id) {
+      path = book.path;
+      found = true;
+    }
+  });
+  return found;
+}
+
+void invalidate() {
+  LibrarySearchIndex::invalidate();
+  if (Storage.exists(CATALOG_FILE)) {
+    Storage.remove(CATALOG_FILE);
+  }
+}
+
+}  // namespace BookCatalog
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Every book on the SD card with its size, kept in a file so that a client asking for the whole library (such as the
+// Calibre plugin at the start of each session) is answered without walking all folders. Built by a full scan the
+// first time it's needed, or as the Calibre screen starts its server, and kept up to date by the places that add, move
+// or delete books; anything else that changes files drops it, to be built again.
+//
+// Books also get their title and author once their metadata has been read on the device (CoverJobQueue), so the web
+// UI can list the library without opening any of them. A full scan carries over what the last catalog knew.
+namespace BookCatalog {
+
+struct Book {
+  const char* path;
+  uint32_t size;
+  const char* title;  // Empty until the book's metadata was read
+  const char* author;
+};
+
+// Calls back for each book, building the catalog first if there is none. False if it couldn't be built.
+bool forEach(const std::function<void(const Book& book)>& callback);
+// Changes with every write of the catalog, for the ETag of responses built from it. Builds it if there is none.
+bool getGeneration(uint32_t& generation);
+
+// Keep the catalog in step with a change to one file. Anything that isn't a book is left out.
+void add(const char* path, uint32_t size);
+void remove(const char* path);
+void move(const char* fromPath, const char* toPath);
+// Records the title and author read from a book's metadata, unless the catalog has them already
+void describe(const char* path, const std::string& title, const std::string& author);
+
+// Stable id of a book in URLs: a 64-bit FNV-1a of its path
+uint64_t getId(const char* path);
+// Path of the book with the id, false if the catalog has none
+bool findById(uint64_t id, std::string& path);
+
+// Drop the catalog, the next forEach() scans the card again
+void invalidate();
+
+}  // namespace BookCatalog
@@ -1,20 +1,34 @@
 #include "CrossPointWebServer.h"
 
 #include <ArduinoJson.h>
+#include <BookCacheKey.h>
 #include <Epub.h>
+#include <FontDecompressor.h>
 #include <FsHelpers.h>
+#include <HalPowerManager.h>
 #include <HalStorage.h>
 #include <Logging.h>
+#include <Trace.h>
 #include <WiFi.h>
+#include <Xtc.h>
+#include <esp_heap_caps.h>
 #include <esp_task_wdt.h>
+#include <uri/UriBraces.h>
 
 #include <algorithm>
 
+#include "BookCatalog.h"
+#include "CoverJobQueue.h"
 #include "CrossPointSettings.h"
+#include "FileResponse.h"
+#include "PerfStats.h"
 #include "SettingsList.h"
 #include "WebDAVHandler.h"
+#include "activities/HeapTelemetry.h"
+#include "components/UITheme.h"
 #include "html/FilesPageHtml.generated.h"
 #include "html/HomePageHtml.generated.h"
+#include "html/PerfPageHtml.generated.h"
 #include "html/SettingsPageHtml.generated.h"
 #include "util/StringUtils.h"
 
@@ -25,6 +39,10 @@ const char* HIDDEN_ITEMS[] = {"System Volume Information", "XTCache"};
 constexpr size_t HIDDEN_ITEMS_COUNT = sizeof(HIDDEN_ITEMS) / sizeof(HIDDEN_ITEMS[0]);
 constexpr uint16_t UDP_PORTS[] = {54982, 48123, 39001, 44044, 59678};
 constexpr uint16_t LOCAL_UDP_PORT = 8134;
+// Most entries a paged /api/files response holds
+constexpr size_t MAX_FILE_LIST_PAGE = 500;
+// /api/books entries are sent in chunks of about this size rather than one by one
+constexpr size_t BOOK_LIST_BATCH_SIZE = 1400;
 
 // Static pointer for WebSocket callback (WebSocketsServer requires C-style callback)
 CrossPointWebServer* wsInstance = nullptr;
@@ -37,15 +55,72 @@ size_t wsUploadSize = 0;
 size_t wsUploadReceived = 0;
 unsigned long wsUploadStartTime = 0;
 bool wsUploadInProgress = false;
+uint8_t wsUploadClient = 0;
+UploadWriter wsUploadWriter;
+// Windowed uploads (STARTW) carry the offset of each chunk and are acked, so they can be resumed
+bool wsUploadWindowed = false;
+bool wsUploadSuspended = false;  // Cut off with its file kept, waiting for the client to resume it
 String wsLastCompleteName;
 size_t wsLastCompleteSize = 0;
+
+// Clients that asked for the telemetry stream, a bit per client number
+uint32_t wsTelemetryClients = 0;
+unsigned long wsTelemetryLastSent = 0;
+constexpr unsigned long TELEMETRY_INTERVAL_MS = 1000;
 unsigned long wsLastCompleteAt = 0;
 
+// Chunks a windowed client may have in flight, and the offset header in front of each
+constexpr int WS_MAX_WINDOW = 16;
+constexpr size_t WS_CHUNK_HEADER_SIZE = 4;
+
+String wsUploadFilePath() {
+  String filePath = wsUploadPath;
+  if (!filePath.endsWith("/")) filePath += "/";
+  filePath += wsUploadFileName;
+  return filePath;
+}
+
+// Drops the current or suspended upload along with what was written of its file
+void discardWsUpload() {
+  if (!wsUploadInProgress && !wsUploadSuspended) {
+    return;
+  }
+  WebDAVHandler::invalidateListingCache();
+  wsUploadWriter.abort();
+  if (wsUploadFile) {
+    wsUploadFile.close();
+  }
+  const String filePath = wsUploadFilePath();
+  Storage.remove(filePath.c_str());
+  BookCatalog::remove(filePath.c_str());
+  LOG_DBG("WS", "Deleted incomplete upload: %s", filePath.c_str());
+  wsUploadInProgress = false;
+  wsUploadSuspended = false;
+}
+
+// Writes out what a windowed upload has received and closes its file, so a new connection can pick it up there
+void suspendWsUpload() {
+  if (!wsUploadWriter.finish()) {
+    LOG_ERR("WS", "Failed to save the received part of %s", wsUploadFileName.c_str());
+    discardWsUpload();
+    return;
+  }
+  wsUploadFile.close();
+  wsUploadInProgress = false;
+  wsUploadSuspended = true;
+  LOG_DBG("WS", "Upload of %s suspended at %d of %d bytes", wsUploadFileName.c_str(), wsUploadReceived, wsUploadSize);
+}
+
 // Helper function to clear epub cache after upload
 void clearEpubCacheIfNeeded(const String& filePath) {
   // Only clear cache for .epub files
   if (StringUtils::checkFileExtension(filePath, ".epub")) {
-    Epub(filePath.c_str(), "/.crosspoint").clearCache();
+    const Epub epub(filePath.c_str(), "/.crosspoint");
+    if (BookCacheKey::shared(filePath.c_str(), "/.crosspoint")) {
+      LOG_DBG("WEB", "Keeping epub cache shared with another copy of: %s", filePath.c_str());
+      return;
+    }
+    epub.clearCache();
     LOG_DBG("WEB", "Cleared epub cache for: %s", filePath.c_str());
   }
 }
@@ -132,9 +207,15 @@ void CrossPointWebServer::begin() {
   LOG_DBG("WEB", "Setting up routes...");
   server->on("/", HTTP_GET, [this] { handleRoot(); });
   server->on("/files", HTTP_GET, [this] { handleFileList(); });
+  server->on("/perf", HTTP_GET, [this] { handlePerfPage(); });
 
   server->on("/api/status", HTTP_GET, [this] { handleStatus(); });
   server->on("/api/files", HTTP_GET, [this] { handleFileListData(); });
+  server->on("/api/books", HTTP_GET, [this] { handleBookList(); });
+  server->on(UriBraces("/api/books/{}/cover"), HTTP_GET, [this] { handleBookCover(); });
+#ifdef ENABLE_TRACE
+  server->on("/api/trace", HTTP_GET, [this] { handleTrace(); });
+#endif
   server->on("/download", HTTP_GET, [this] { handleDownload(); });
 
   // Upload endpoint with special handling for multipart form data
@@ -160,9 +241,10 @@ void CrossPointWebServer::begin() {
   server->onNotFound([this] { handleNotFound(); });
   LOG_DBG("WEB", "[MEM] Free heap after route setup: %d bytes", ESP.getFreeHeap());
 
-  // Collect WebDAV headers and register handler
-  const char* davHeaders[] = {"Depth", "Destination", "Overwrite", "If", "Lock-Token", "Timeout"};
-  server->collectHeaders(davHeaders, 6);
+  // Collect WebDAV headers (and those of conditional and range requests) and register handler
+  const char* collectedHeaders[] = {"Depth",   "Destination",   "Overwrite", "If",      "Lock-Token",
+                                    "Timeout", "If-None-Match", "If-Range",  "Range",   "If-Modified-Since"};
+  server->collectHeaders(collectedHeaders, sizeof(collectedHeaders) / sizeof(collectedHeaders[0]));
   server->addHandler(new WebDAVHandler());  // Note: WebDAVHandler will be deleted by WebServer when server is stopped
   LOG_DBG("WEB", "WebDAV handler initialized");
 
@@ -200,11 +282,11 @@ void CrossPointWebServer::stop() {
 
   LOG_DBG("WEB", "[MEM] Free heap before stop: %d bytes", ESP.getFreeHeap());
 
-  // Close any in-progress WebSocket upload
-  if (wsUploadInProgress && wsUploadFile) {
-    wsUploadFile.close();
-    wsUploadInProgress = false;
-  }
+  // Stop the writer of an in-progress HTTP upload before its file goes
+  upload.writer.abort();
+
+  // Drop any in-progress WebSocket upload, a suspended one can't be resumed once the server is gone
+  discardWsUpload();
 
   // Stop WebSocket server
   if (wsServer) {
@@ -212,6 +294,7 @@ void CrossPointWebServer::stop() {
     wsServer->close();
     wsServer.reset();
     wsInstance = nullptr;
+    wsTelemetryClients = 0;
     LOG_DBG("WEB", "WebSocket server stopped");
   }
 
@@ -263,6 +346,9 @@ void CrossPointWebServer::handleClient() {
   // Handle WebSocket events
   if (wsServer) {
     wsServer->loop();
+    if (wsTelemetryClients != 0 && millis() - wsTelemetryLastSent >= TELEMETRY_INTERVAL_MS) {
+      publishTelemetry();
+    }
   }
 
   // Respond to discovery broadcasts
@@ -300,16 +386,29 @@ CrossPointWebServer::WsUploadStatus CrossPointWebServer::getWsUploadStatus() con
   return status;
 }
 
-static void sendHtmlContent(WebServer* server, const char* data, size_t len) {
+// The pages are gzipped at build time. Browsers keep them and revalidate with their ETag on every visit, which only
+// costs a 304 until a firmware update changes the page.
+static void sendHtmlContent(WebServer* server, const char* data, size_t len, const char* etag) {
+  server->sendHeader("ETag", etag);
+  server->sendHeader("Cache-Control", "no-cache");
+  if (server->header("If-None-Match") == etag) {
+    server->send(304);
+    return;
+  }
   server->sendHeader("Content-Encoding", "gzip");
   server->send_P(200, "text/html", data, len);
 }
 
 void CrossPointWebServer::handleRoot() const {
-  sendHtmlContent(server.get(), HomePageHtml, sizeof(HomePageHtml));
+  sendHtmlContent(server.get(), HomePageHtml, sizeof(HomePageHtml), HomePageHtmlETag);
   LOG_DBG("WEB", "Served root page");
 }
 
+void CrossPointWebServer::handlePerfPage() const {
+  sendHtmlContent(server.get(), PerfPageHtml, sizeof(PerfPageHtml), PerfPageHtmlETag);
+  LOG_DBG("WEB", "Served performance page");
+}
+
 void CrossPointWebServer::handleNotFound() const {
   String message = "404 Not Found\n\n";
   message += "URI: " + server->uri() + "\n";
@@ -328,12 +427,109 @@ void CrossPointWebServer::handleStatus() const {
   doc["freeHeap"] = ESP.getFreeHeap();
   doc["uptime"] = millis() / 1000;
 
+  HeapTelemetry::sample(true);
+  JsonObject heap = doc["heap"].to<JsonObject>();
+  heap["free"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  heap["largestBlock"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  heap["minFree"] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  heap["allocFailures"] = HeapTelemetry::getAllocFailures();
+  heap["current"] = HeapTelemetry::getCurrent();
+  HeapTelemetry::ActivityStats stats[HeapTelemetry::MAX_ACTIVITIES];
+  const size_t count = HeapTelemetry::snapshot(stats, HeapTelemetry::MAX_ACTIVITIES);
+  JsonArray activities = heap["activities"].to<JsonArray>();
+  for (size_t i = 0; i < count; i++) {
+    JsonObject entry = activities.add<JsonObject>();
+    entry["name"] = stats[i].name;
+    entry["visits"] = stats[i].visits;
+    entry["minFree"] = stats[i].minFree;
+    entry["minLargestBlock"] = stats[i].minLargestBlock;
+    entry["allocFailures"] = stats[i].allocFailures;
+  }
+
   String json;
   serializeJson(doc, json);
   server->send(200, "application/json", json);
 }
 
-void CrossPointWebServer::scanFiles(const char* path, const std::function<void(FileInfo)>& callback) const {
+// A frame of the telemetry stream, sent to each client that asked for it. Times in ms unless named otherwise; the
+// CPU and font counters are totals since boot, the dashboard graphs their change between frames.
+void CrossPointWebServer::publishTelemetry() {
+  wsTelemetryLastSent = millis();
+
+  JsonDocument doc;
+  doc["type"] = "telemetry";
+  doc["uptime"] = millis();
+
+  JsonObject heap = doc["heap"].to<JsonObject>();
+  heap["free"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  heap["largestBlock"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  heap["minFree"] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+  JsonObject cpu = doc["cpu"].to<JsonObject>();
+  cpu["mhz"] = getCpuFrequencyMhz();
+  cpu["render"] = powerManager.getWorkloadTime(HalPowerManager::Render);
+  cpu["indexing"] = powerManager.getWorkloadTime(HalPowerManager::Indexing);
+  cpu["decoding"] = powerManager.getWorkloadTime(HalPowerManager::Decoding);
+  cpu["panelWait"] = powerManager.getWorkloadTime(HalPowerManager::PanelWait);
+  cpu["network"] = powerManager.getWorkloadTime(HalPowerManager::Network);
+  cpu["idle"] = powerManager.getIdleTime();
+  cpu["lowPower"] = powerManager.getLowPowerTime();
+
+  if (const FontDecompressor* fonts = PerfStats::getFontDecompressor()) {
+    const FontDecompressor::Stats& stats = fonts->getStats();
+    JsonObject fontCache = doc["fonts"].to<JsonObject>();
+    fontCache["hits"] = stats.hits;
+    fontCache["misses"] = stats.misses;
+    fontCache["direct"] = stats.direct;
+    fontCache["inflateUs"] = stats.inflateTimeUs;
+    fontCache["readUs"] = stats.readTimeUs;
+    fontCache["cachedBytes"] = fonts->getCachedBytes();
+  }
+
+  JsonObject pages = doc["pages"].to<JsonObject>();
+  pages["count"] = PerfStats::getPageCount();
+  uint32_t recent[PerfStats::PAGE_HISTORY];
+  const size_t recentCount = PerfStats::getRecentPages(recent, PerfStats::PAGE_HISTORY);
+  JsonArray recentPages = pages["recent"].to<JsonArray>();
+  for (size_t i = 0; i < recentCount; i++) {
+    recentPages.add(recent[i]);
+  }
+
+  JsonObject loop = doc["loop"].to<JsonObject>();
+  loop["max"] = PerfStats::takeLoopMax();
+  loop["maxSinceBoot"] = PerfStats::getLoopMax();
+
+#ifdef ENABLE_TRACE
+  constexpr size_t EVENT_COUNT = static_cast<size_t>(TraceEvent::EVENT_COUNT);
+  Trace::EventTotals totals[EVENT_COUNT];
+  if (Trace::summarize(totals, false)) {
+    const Trace::EventTotals& sd = totals[static_cast<size_t>(TraceEvent::SdRead)];
+    JsonObject sdRead = doc["sd"].to<JsonObject>();
+    sdRead["reads"] = sd.count;
+    sdRead["bytes"] = sd.argSum;
+    sdRead["us"] = sd.totalUs;
+  }
+  if (Trace::summarize(totals, true)) {
+    JsonObject pageTurn = doc["pageTurn"].to<JsonObject>();
+    for (size_t i = 0; i < EVENT_COUNT; i++) {
+      if (totals[i].count > 0) {
+        pageTurn[Trace::eventName(static_cast<TraceEvent>(i))] = totals[i].totalUs;
+      }
+    }
+  }
+#endif
+
+  String json;
+  serializeJson(doc, json);
+  for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+    if (wsTelemetryClients & (1u << num)) {
+      wsServer->sendTXT(num, json);
+    }
+  }
+}
+
+void CrossPointWebServer::scanFiles(const char* path, const std::function<void(FileInfo)>& callback,
+                                    uint32_t* cursor, const size_t limit) const {
   FsFile root = Storage.open(path);
   if (!root) {
     LOG_DBG("WEB", "Failed to open directory: %s", path);
@@ -348,6 +544,19 @@ void CrossPointWebServer::scanFiles(const char* path, const std::function<void(F
 
   LOG_DBG("WEB", "Scanning files in: %s", path);
 
+  // A cursor is the position in the directory of the entry after the last one handed out. Directory entries are 32
+  // bytes on both FAT and exFAT, anything else can't have come from here.
+  if (cursor && *cursor != 0) {
+    if (*cursor % 32 != 0 || !root.seek(*cursor)) {
+      LOG_DBG("WEB", "Invalid directory cursor %u for: %s", *cursor, path);
+      *cursor = 0;
+      root.close();
+      return;
+    }
+    *cursor = 0;
+  }
+
+  size_t listed = 0;
   FsFile file = root.openNextFile();
   char name[500];
   while (file) {
@@ -381,11 +590,17 @@ void CrossPointWebServer::scanFiles(const char* path, const std::function<void(F
       }
 
       callback(info);
+      listed++;
     }
 
     file.close();
     yield();               // Yield to allow WiFi and other tasks to process during long scans
     esp_task_wdt_reset();  // Reset watchdog to prevent timeout on large directories
+    if (cursor && limit > 0 && listed == limit) {
+      // Page is full, the next one starts here. Whether anything is left is only found out by the next call.
+      *cursor = static_cast<uint32_t>(root.position());
+      break;
+    }
     file = root.openNextFile();
   }
   root.close();
@@ -398,7 +613,7 @@ bool CrossPointWebServer::isEpubFile(const String& filename) const {
 }
 
 void CrossPointWebServer::handleFileList() const {
-  sendHtmlContent(server.get(), FilesPageHtml, sizeof(FilesPageHtml));
+  sendHtmlContent(server.get(), FilesPageHtml, sizeof(FilesPageHtml), FilesPageHtmlETag);
 }
 
 void CrossPointWebServer::handleFileListData() const {
@@ -416,15 +631,27 @@ void CrossPointWebServer::handleFileListData() const {
     }
   }
 
+  // With a limit the listing is paged: {"files":[...],"cursor":"..."}, the cursor (left out on the last page) is
+  // passed back for the next page. Without one every entry is sent, as a plain array.
+  const bool paged = server->hasArg("limit");
+  size_t limit = 0;
+  uint32_t cursor = 0;
+  if (paged) {
+    limit = std::min(static_cast<size_t>(std::max(server->arg("limit").toInt(), 1L)), MAX_FILE_LIST_PAGE);
+    if (server->hasArg("cursor")) {
+      cursor = strtoul(server->arg("cursor").c_str(), nullptr, 16);
+    }
+  }
+
   server->setContentLength(CONTENT_LENGTH_UNKNOWN);
   server->send(200, "application/json", "");
-  server->sendContent("[");
+  server->sendContent(paged ? "{\"files\":[" : "[");
   char output[512];
   constexpr size_t outputSize = sizeof(output);
   bool seenFirst = false;
   JsonDocument doc;
 
-  scanFiles(currentPath.c_str(), [this, &output, &doc, seenFirst](const FileInfo& info) mutable {
+  auto sendEntry = [this, &output, &doc, seenFirst](const FileInfo& info) mutable {
     doc.clear();
     doc["name"] = info.name;
     doc["size"] = info.size;
@@ -444,13 +671,137 @@ void CrossPointWebServer::handleFileListData() const {
       seenFirst = true;
     }
     server->sendContent(output);
-  });
-  server->sendContent("]");
+  };
+  scanFiles(currentPath.c_str(), sendEntry, paged ? &cursor : nullptr, limit);
+
+  if (!paged) {
+    server->sendContent("]");
+  } else if (cursor != 0) {
+    char tail[32];
+    snprintf(tail, sizeof(tail), "],\"cursor\":\"%lx\"}", static_cast<unsigned long>(cursor));
+    server->sendContent(tail);
+  } else {
+    server->sendContent("]}");
+  }
   // End of streamed response, empty chunk to signal client
   server->sendContent("");
   LOG_DBG("WEB", "Served file listing page for path: %s", currentPath.c_str());
 }
 
+void CrossPointWebServer::handleBookList() const {
+  // For files changed where the catalog doesn't see it, such as on a computer
+  if (server->hasArg("refresh")) {
+    BookCatalog::invalidate();
+  }
+
+  // The list only changes with the catalog, so a client holding on to it revalidates for a 304
+  uint32_t generation = 0;
+  if (!BookCatalog::getGeneration(generation)) {
+    LOG_ERR("WEB", "Book catalog unavailable");
+  }
+  char etag[16];
+  snprintf(etag, sizeof(etag), "\"%08lx\"", static_cast<unsigned long>(generation));
+  server->sendHeader("ETag", etag);
+  server->sendHeader("Cache-Control", "no-cache");
+  if (generation != 0 && server->header("If-None-Match") == etag) {
+    server->send(304);
+    return;
+  }
+
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(200, "application/json", "");
+  String batch = "[";
+  batch.reserve(BOOK_LIST_BATCH_SIZE + 1200);
+  char output[1200];
+  char id[17];
+  JsonDocument doc;
+  bool seenFirst = false;
+  size_t count = 0;
+
+  BookCatalog::forEach([&](const BookCatalog::Book& book) {
+    doc.clear();
+    snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(BookCatalog::getId(book.path)));
+    doc["id"] = id;
+    doc["path"] = book.path;
+    doc["size"] = book.size;
+    if (book.title[0] != '\0') {
+      doc["title"] = book.title;
+    }
+    if (book.author[0] != '\0') {
+      doc["author"] = book.author;
+    }
+    if (serializeJson(doc, output, sizeof(output)) >= sizeof(output)) {
+      return;
+    }
+    if (seenFirst) {
+      batch += ',';
+    }
+    seenFirst = true;
+    batch += output;
+    count++;
+    if (batch.length() >= BOOK_LIST_BATCH_SIZE) {
+      server->sendContent(batch);
+      batch = "";
+    }
+  });
+
+  batch += ']';
+  server->sendContent(batch);
+  // End of streamed response, empty chunk to signal client
+  server->sendContent("");
+  LOG_DBG("WEB", "Served book list: %u books", count);
+}
+
+// The home screen thumbnail of a book from /api/books, as a BMP. Its path in the book's cache directory comes from
+// the book's cache key, so the book itself isn't opened; one without a thumbnail yet is queued for one.
+void CrossPointWebServer::handleBookCover() const {
+  char* end = nullptr;
+  const String idArg = server->pathArg(0);
+  const uint64_t id = strtoull(idArg.c_str(), &end, 16);
+  std::string path;
+  if (idArg.isEmpty() || *end != '\0' || !BookCatalog::findById(id, path)) {
+    server->send(404, "text/plain", "Book not found");
+    return;
+  }
+
+  const int height = UITheme::getInstance().getMetrics().homeCoverHeight;
+  std::string thumbPath;
+  if (StringUtils::checkFileExtension(path, ".epub")) {
+    thumbPath = Epub(path, "/.crosspoint").getThumbBmpPath(height);
+  } else if (StringUtils::checkFileExtension(path, ".xtc") || StringUtils::checkFileExtension(path, ".xtch")) {
+    thumbPath = Xtc(path, "/.crosspoint").getThumbBmpPath(height);
+  }
+  FsFile file;
+  if (thumbPath.empty() || !Storage.exists(thumbPath.c_str()) || !(file = Storage.open(thumbPath.c_str()))) {
+    if (!thumbPath.empty()) {
+      COVER_JOBS.enqueue(path);
+    }
+    server->send(404, "text/plain", "No cover");
+    return;
+  }
+  server->sendHeader("Cache-Control", "no-cache");
+  FileResponse::send(*server, file, "image/bmp");
+  file.close();
+}
+
+#ifdef ENABLE_TRACE
+void CrossPointWebServer::handleTrace() const {
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(200, "application/json", "");
+  String batch;
+  batch.reserve(BOOK_LIST_BATCH_SIZE + 200);
+  Trace::dump([&](const char* data, const size_t len) {
+    batch.concat(data, len);
+    if (batch.length() >= BOOK_LIST_BATCH_SIZE) {
+      server->sendContent(batch);
+      batch = "";
+    }
+  });
+  server->sendContent(batch);
+  server->sendContent("");
+}
+#endif
+
 void CrossPointWebServer::handleDownload() const {
   if (!server->hasArg("path")) {
     server->send(400, "text/plain", "Missing path");
@@ -505,38 +856,14 @@ void CrossPointWebServer::handleDownload() const {
     filename = nameBuf;
   }
 
-  server->setContentLength(file.size());
   server->sendHeader("Content-Disposition", "attachment; filename=\"" + filename + "\"");
-  server->send(200, contentType.c_str(), "");
-
-  NetworkClient client = server->client();
-  client.write(file);
+  // Answers Range and conditional requests too, so interrupted downloads resume
+  FileResponse::send(*server, file, contentType);
   file.close();
 }
 
-// Diagnostic counters for upload performance analysis
+// Start of the upload, for the throughput log
 static unsigned long uploadStartTime = 0;
-static unsigned long totalWriteTime = 0;
-static size_t writeCount = 0;
-
-static bool flushUploadBuffer(CrossPointWebServer::UploadState& state) {
-  if (state.bufferPos > 0 && state.file) {
-    esp_task_wdt_reset();  // Reset watchdog before potentially slow SD write
-    const unsigned long writeStart = millis();
-    const size_t written = state.file.write(state.buffer.data(), state.bufferPos);
-    totalWriteTime += millis() - writeStart;
-    writeCount++;
-    esp_task_wdt_reset();  // Reset watchdog after SD write
-
-    if (written != state.bufferPos) {
-      LOG_DBG("WEB", "[UPLOAD] Buffer flush failed: expected %d, wrote %d", state.bufferPos, written);
-      state.bufferPos = 0;
-      return false;
-    }
-    state.bufferPos = 0;
-  }
-  return true;
-}
 
 void CrossPointWebServer::handleUpload(UploadState& state) const {
   static size_t lastLoggedSize = 0;
@@ -551,20 +878,23 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
   }
 
   const HTTPUpload& upload = server->upload();
+  // Creating, finishing or dropping the file changes what WebDAV listed
+  if (upload.status != UPLOAD_FILE_WRITE) {
+    WebDAVHandler::invalidateListingCache();
+  }
 
   if (upload.status == UPLOAD_FILE_START) {
     // Reset watchdog - this is the critical 1% crash point
     esp_task_wdt_reset();
 
+    // A previous upload that never got to its end still has the writer task on its file
+    state.writer.abort();
     state.fileName = upload.filename;
     state.size = 0;
     state.success = false;
     state.error = "";
     uploadStartTime = millis();
     lastLoggedSize = 0;
-    state.bufferPos = 0;
-    totalWriteTime = 0;
-    writeCount = 0;
 
     // Get upload path from query parameter (defaults to root if not specified)
     // Note: We use query parameter instead of form data because multipart form
@@ -607,32 +937,22 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
       return;
     }
     esp_task_wdt_reset();
+    if (!state.writer.begin(state.file)) {
+      state.error = "Not enough memory for the upload";
+      state.file.close();
+      Storage.remove(filePath.c_str());
+      return;
+    }
 
     LOG_DBG("WEB", "[UPLOAD] File created successfully: %s", filePath.c_str());
   } else if (upload.status == UPLOAD_FILE_WRITE) {
     if (state.file && state.error.isEmpty()) {
-      // Buffer incoming data and flush when buffer is full
-      // This reduces SD card write operations and improves throughput
-      const uint8_t* data = upload.buf;
-      size_t remaining = upload.currentSize;
-
-      while (remaining > 0) {
-        const size_t space = UploadState::UPLOAD_BUFFER_SIZE - state.bufferPos;
-        const size_t toCopy = (remaining < space) ? remaining : space;
-
-        memcpy(state.buffer.data() + state.bufferPos, data, toCopy);
-        state.bufferPos += toCopy;
-        data += toCopy;
-        remaining -= toCopy;
-
-        // Flush buffer when full
-        if (state.bufferPos >= UploadState::UPLOAD_BUFFER_SIZE) {
-          if (!flushUploadBuffer(state)) {
-            state.error = "Failed to write to SD card - disk may be full";
-            state.file.close();
-            return;
-          }
-        }
+      // Buffered and written to SD by the writer task, this only waits when it falls two buffers behind
+      if (!state.writer.write(upload.buf, upload.currentSize)) {
+        state.error = "Failed to write to SD card - disk may be full";
+        state.writer.abort();
+        state.file.close();
+        return;
       }
 
       state.size += upload.currentSize;
@@ -642,14 +962,14 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
         const unsigned long elapsed = millis() - uploadStartTime;
         const float kbps = (elapsed > 0) ? (state.size / 1024.0) / (elapsed / 1000.0) : 0;
         LOG_DBG("WEB", "[UPLOAD] %d bytes (%.1f KB), %.1f KB/s, %d writes", state.size, state.size / 1024.0, kbps,
-                writeCount);
+                state.writer.getWriteCount());
         lastLoggedSize = state.size;
       }
     }
   } else if (upload.status == UPLOAD_FILE_END) {
     if (state.file) {
-      // Flush any remaining buffered data
-      if (!flushUploadBuffer(state)) {
+      // Write what is still buffered and wait for the writer task
+      if (!state.writer.finish()) {
         state.error = "Failed to write final data to SD card";
       }
       state.file.close();
@@ -658,21 +978,24 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
         state.success = true;
         const unsigned long elapsed = millis() - uploadStartTime;
         const float avgKbps = (elapsed > 0) ? (state.size / 1024.0) / (elapsed / 1000.0) : 0;
+        const unsigned long totalWriteTime = state.writer.getWriteTime();
         const float writePercent = (elapsed > 0) ? (totalWriteTime * 100.0 / elapsed) : 0;
         LOG_DBG("WEB", "[UPLOAD] Complete: %s (%d bytes in %lu ms, avg %.1f KB/s)", state.fileName.c_str(), state.size,
                 elapsed, avgKbps);
-        LOG_DBG("WEB", "[UPLOAD] Diagnostics: %d writes, total write time: %lu ms (%.1f%%)", writeCount, totalWriteTime,
-                writePercent);
+        LOG_DBG("WEB", "[UPLOAD] Diagnostics: %d writes, total write time: %lu ms (%.1f%%)",
+                state.writer.getWriteCount(), totalWriteTime, writePercent);
 
         // Clear epub cache to prevent stale metadata issues when overwriting files
         String filePath = state.path;
         if (!filePath.endsWith("/")) filePath += "/";
         filePath += state.fileName;
         clearEpubCacheIfNeeded(filePath);
+        COVER_JOBS.enqueue(filePath.c_str());
+        BookCatalog::add(filePath.c_str(), state.size);
       }
     }
   } else if (upload.status == UPLOAD_FILE_ABORTED) {
-    state.bufferPos = 0;  // Discard buffered data
+    state.writer.abort();  // Discard buffered data
     if (state.file) {
       state.file.close();
       // Try to delete the incomplete file
@@ -680,6 +1003,7 @@ void CrossPointWebServer::handleUpload(UploadState& state) const {
       if (!filePath.endsWith("/")) filePath += "/";
       filePath += state.fileName;
       Storage.remove(filePath.c_str());
+      BookCatalog::remove(filePath.c_str());
     }
     state.error = "Upload aborted";
     LOG_DBG("WEB", "Upload aborted");
@@ -696,6 +1020,7 @@ void CrossPointWebServer::handleUploadPost(UploadState& state) const {
 }
 
 void CrossPointWebServer::handleCreateFolder() const {
+  WebDAVHandler::invalidateListingCache();
   // Get folder name from form data
   if (!server->hasArg("name")) {
     server->send(400, "text/plain", "Missing folder name");
@@ -746,6 +1071,7 @@ void CrossPointWebServer::handleCreateFolder() const {
 }
 
 void CrossPointWebServer::handleRename() const {
+  WebDAVHandler::invalidateListingCache();
   if (!server->hasArg("path") || !server->hasArg("name")) {
     server->send(400, "text/plain", "Missing path or new name");
     return;
@@ -814,11 +1140,13 @@ void CrossPointWebServer::handleRename() const {
     return;
   }
 
-  clearEpubCacheIfNeeded(itemPath);
-  const bool success = file.rename(newPath.c_str());
   file.close();
+  // Caches are keyed by the book's content, so the book keeps its cache under the new path
+  const bool success = Storage.rename(itemPath.c_str(), newPath.c_str());
 
   if (success) {
+    BookCatalog::move(itemPath.c_str(), newPath.c_str());
+    BookCacheKey::moved(itemPath.c_str(), newPath.c_str(), "/.crosspoint");
     LOG_DBG("WEB", "Renamed file: %s -> %s", itemPath.c_str(), newPath.c_str());
     server->send(200, "text/plain", "Renamed successfully");
   } else {
@@ -828,6 +1156,7 @@ void CrossPointWebServer::handleRename() const {
 }
 
 void CrossPointWebServer::handleMove() const {
+  WebDAVHandler::invalidateListingCache();
   if (!server->hasArg("path") || !server->hasArg("dest")) {
     server->send(400, "text/plain", "Missing path or destination");
     return;
@@ -907,11 +1236,13 @@ void CrossPointWebServer::handleMove() const {
     return;
   }
 
-  clearEpubCacheIfNeeded(itemPath);
-  const bool success = file.rename(newPath.c_str());
   file.close();
+  // Caches are keyed by the book's content, so the book keeps its cache under the new path
+  const bool success = Storage.rename(itemPath.c_str(), newPath.c_str());
 
   if (success) {
+    BookCatalog::move(itemPath.c_str(), newPath.c_str());
+    BookCacheKey::moved(itemPath.c_str(), newPath.c_str(), "/.crosspoint");
     LOG_DBG("WEB", "Moved file: %s -> %s", itemPath.c_str(), newPath.c_str());
     server->send(200, "text/plain", "Moved successfully");
   } else {
@@ -921,6 +1252,7 @@ void CrossPointWebServer::handleMove() const {
 }
 
 void CrossPointWebServer::handleDelete() const {
+  WebDAVHandler::invalidateListingCache();
   // Check if 'paths' argument is provided
   if (!server->hasArg("paths")) {
     server->send(400, "text/plain", "Missing paths");
@@ -1012,6 +1344,10 @@ void CrossPointWebServer::handleDelete() const {
       if (f) f.close();
       success = Storage.remove(itemPath.c_str());
       clearEpubCacheIfNeeded(itemPath);
+      BookCacheKey::forget(itemPath.c_str(), "/.crosspoint");
+      if (success) {
+        BookCatalog::remove(itemPath.c_str());
+      }
     }
 
     if (!success) {
@@ -1028,7 +1364,7 @@ void CrossPointWebServer::handleDelete() const {
 }
 
 void CrossPointWebServer::handleSettingsPage() const {
-  sendHtmlContent(server.get(), SettingsPageHtml, sizeof(SettingsPageHtml));
+  sendHtmlContent(server.get(), SettingsPageHtml, sizeof(SettingsPageHtml), SettingsPageHtmlETag);
   LOG_DBG("WEB", "Served settings page");
 }
 
@@ -1198,25 +1534,26 @@ void CrossPointWebServer::wsEventCallback(uint8_t num, WStype_t type, uint8_t* p
 
 // WebSocket event handler for fast binary uploads
 // Protocol:
-//   1. Client sends TEXT message: "START:<filename>:<size>:<path>"
-//   2. Client sends BINARY messages with file data chunks
-//   3. Server sends TEXT "PROGRESS:<received>:<total>" after each chunk
-//   4. Server sends TEXT "DONE" or "ERROR:<message>" when complete
+//   1. Client sends TEXT message: "START:<filename>:<size>:<path>", or "STARTW:<window>:<filename>:<size>:<path>" for
+//      a windowed upload
+//   2. Server sends TEXT "READY", or "READYW:<window>:<offset>" with the chunks the client may have in flight and the
+//      offset to start from (non-zero when resuming)
+//   3. Client sends BINARY messages with file data chunks; windowed ones start with their offset (uint32, LE)
+//   4. Server sends TEXT "PROGRESS:<received>:<total>" every 64KB, or "ACK:<received>" after each windowed chunk
+//   5. Server sends TEXT "DONE" or "ERROR:<message>" when complete
 void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_DISCONNECTED:
       LOG_DBG("WS", "Client %u disconnected", num);
-      // Clean up any in-progress upload
-      if (wsUploadInProgress && wsUploadFile) {
-        wsUploadFile.close();
-        // Delete incomplete file
-        String filePath = wsUploadPath;
-        if (!filePath.endsWith("/")) filePath += "/";
-        filePath += wsUploadFileName;
-        Storage.remove(filePath.c_str());
-        LOG_DBG("WS", "Deleted incomplete upload: %s", filePath.c_str());
+      wsTelemetryClients &= ~(1u << num);
+      // Clean up any in-progress upload, keeping what a windowed one received for a resume
+      if (wsUploadInProgress && num == wsUploadClient) {
+        if (wsUploadWindowed) {
+          suspendWsUpload();
+        } else {
+          discardWsUpload();
+        }
       }
-      wsUploadInProgress = false;
       break;
 
     case WStype_CONNECTED: {
@@ -1229,28 +1566,72 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
       String msg = String((char*)payload);
       LOG_DBG("WS", "Text from client %u: %s", num, msg.c_str());
 
-      if (msg.startsWith("START:")) {
-        // Parse: START:<filename>:<size>:<path>
-        int firstColon = msg.indexOf(':', 6);
+      if (msg == "TELEMETRY") {
+        wsTelemetryClients |= 1u << num;
+        wsTelemetryLastSent = millis() - TELEMETRY_INTERVAL_MS;
+        break;
+      }
+
+      const bool windowed = msg.startsWith("STARTW:");
+      if (windowed || msg.startsWith("START:")) {
+        // Parse: START:<filename>:<size>:<path> or STARTW:<window>:<filename>:<size>:<path>
+        int window = 0;
+        int nameStart = 6;
+        if (windowed) {
+          const int windowEnd = msg.indexOf(':', 7);
+          window = windowEnd > 0 ? msg.substring(7, windowEnd).toInt() : 0;
+          nameStart = windowEnd + 1;
+        }
+        int firstColon = msg.indexOf(':', nameStart);
         int secondColon = msg.indexOf(':', firstColon + 1);
 
-        if (firstColon > 0 && secondColon > 0) {
-          wsUploadFileName = msg.substring(6, firstColon);
-          wsUploadSize = msg.substring(firstColon + 1, secondColon).toInt();
-          wsUploadPath = msg.substring(secondColon + 1);
-          wsUploadReceived = 0;
-          wsUploadStartTime = millis();
+        if (nameStart > 0 && firstColon > 0 && secondColon > 0 && (!windowed || window > 0)) {
+          const String fileName = msg.substring(nameStart, firstColon);
+          const size_t size = msg.substring(firstColon + 1, secondColon).toInt();
+          String path = msg.substring(secondColon + 1);
 
           // Ensure path is valid
-          if (!wsUploadPath.startsWith("/")) wsUploadPath = "/" + wsUploadPath;
-          if (wsUploadPath.length() > 1 && wsUploadPath.endsWith("/")) {
-            wsUploadPath = wsUploadPath.substring(0, wsUploadPath.length() - 1);
+          if (!path.startsWith("/")) path = "/" + path;
+          if (path.length() > 1 && path.endsWith("/")) {
+            path = path.substring(0, path.length() - 1);
+          }
+
+          // The same windowed upload again: pick it up where it stopped. The old connection may not have been seen
+          // to drop yet, the new one takes over then.
+          esp_task_wdt_reset();
+          const bool sameUpload = wsUploadWindowed && windowed && fileName == wsUploadFileName &&
+                                  size == wsUploadSize && path == wsUploadPath;
+          if (sameUpload && wsUploadInProgress) {
+            suspendWsUpload();
+          }
+          if (sameUpload && wsUploadSuspended) {
+            wsUploadFile = Storage.open(wsUploadFilePath().c_str(), O_WRONLY);
+            if (wsUploadFile && wsUploadFile.seek(wsUploadFile.size()) && wsUploadWriter.begin(wsUploadFile)) {
+              wsUploadReceived = wsUploadFile.size();
+              wsUploadSuspended = false;
+              wsUploadInProgress = true;
+              wsUploadClient = num;
+              window = std::min(window, WS_MAX_WINDOW);
+              LOG_DBG("WS", "Resuming upload: %s at %d of %d bytes", wsUploadFileName.c_str(), wsUploadReceived,
+                      wsUploadSize);
+              wsServer->sendTXT(num, "READYW:" + String(window) + ":" + String(wsUploadReceived));
+              return;
+            }
+            LOG_DBG("WS", "Can't resume upload of %s, starting over", wsUploadFileName.c_str());
           }
+          discardWsUpload();
+
+          wsUploadFileName = fileName;
+          wsUploadSize = size;
+          wsUploadPath = path;
+          wsUploadReceived = 0;
+          wsUploadStartTime = millis();
+          wsUploadWindowed = windowed;
+          wsUploadClient = num;
 
           // Build file path
-          String filePath = wsUploadPath;
-          if (!filePath.endsWith("/")) filePath += "/";
-          filePath += wsUploadFileName;
+          const String filePath = wsUploadFilePath();
+          WebDAVHandler::invalidateListingCache();
 
           LOG_DBG("WS", "Starting upload: %s (%d bytes) to %s", wsUploadFileName.c_str(), wsUploadSize,
                   filePath.c_str());
@@ -1269,9 +1650,21 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
             return;
           }
           esp_task_wdt_reset();
+          if (!wsUploadWriter.begin(wsUploadFile)) {
+            wsUploadFile.close();
+            Storage.remove(filePath.c_str());
+            wsServer->sendTXT(num, "ERROR:Not enough memory");
+            wsUploadInProgress = false;
+            return;
+          }
 
           wsUploadInProgress = true;
-          wsServer->sendTXT(num, "READY");
+          if (windowed) {
+            window = std::min(window, WS_MAX_WINDOW);
+            wsServer->sendTXT(num, "READYW:" + String(window) + ":0");
+          } else {
+            wsServer->sendTXT(num, "READY");
+          }
         } else {
           wsServer->sendTXT(num, "ERROR:Invalid START format");
         }
@@ -1280,28 +1673,47 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
     }
 
     case WStype_BIN: {
-      if (!wsUploadInProgress || !wsUploadFile) {
+      if (!wsUploadInProgress || !wsUploadFile || num != wsUploadClient) {
         wsServer->sendTXT(num, "ERROR:No upload in progress");
         return;
       }
 
-      // Write binary data directly to file
-      esp_task_wdt_reset();
-      size_t written = wsUploadFile.write(payload, length);
-      esp_task_wdt_reset();
+      const uint8_t* data = payload;
+      size_t dataLength = length;
+      if (wsUploadWindowed) {
+        // Each chunk says where it goes; anything but the next byte expected means the client lost track
+        if (length < WS_CHUNK_HEADER_SIZE) {
+          wsServer->sendTXT(num, "ERROR:Invalid chunk");
+          return;
+        }
+        const uint32_t offset = static_cast<uint32_t>(payload[0]) | static_cast<uint32_t>(payload[1]) << 8 |
+                                static_cast<uint32_t>(payload[2]) << 16 | static_cast<uint32_t>(payload[3]) << 24;
+        if (offset != wsUploadReceived) {
+          LOG_DBG("WS", "Chunk at %u, expected %d", offset, wsUploadReceived);
+          wsServer->sendTXT(num, "ERROR:Out of sequence");
+          return;
+        }
+        data += WS_CHUNK_HEADER_SIZE;
+        dataLength -= WS_CHUNK_HEADER_SIZE;
+      }
 
-      if (written != length) {
-        wsUploadFile.close();
-        wsUploadInProgress = false;
+      // Handed to the writer task, which writes it to SD while the next chunks come in
+      esp_task_wdt_reset();
+      if (!wsUploadWriter.write(data, dataLength)) {
+        discardWsUpload();
         wsServer->sendTXT(num, "ERROR:Write failed - disk full?");
         return;
       }
 
-      wsUploadReceived += written;
+      wsUploadReceived += dataLength;
 
-      // Send progress update (every 64KB or at end)
+      // Acks move a windowed client on; a streaming one only gets progress updates (every 64KB or at end)
       static size_t lastProgressSent = 0;
-      if (wsUploadReceived - lastProgressSent >= 65536 || wsUploadReceived >= wsUploadSize) {
+      if (wsUploadWindowed) {
+        if (wsUploadReceived < wsUploadSize) {
+          wsServer->sendTXT(num, "ACK:" + String(wsUploadReceived));
+        }
+      } else if (wsUploadReceived - lastProgressSent >= 65536 || wsUploadReceived >= wsUploadSize) {
         String progress = "PROGRESS:" + String(wsUploadReceived) + ":" + String(wsUploadSize);
         wsServer->sendTXT(num, progress);
         lastProgressSent = wsUploadReceived;
@@ -1309,8 +1721,15 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
 
       // Check if upload complete
       if (wsUploadReceived >= wsUploadSize) {
+        lastProgressSent = 0;
+        if (!wsUploadWriter.finish()) {
+          discardWsUpload();
+          wsServer->sendTXT(num, "ERROR:Write failed - disk full?");
+          return;
+        }
         wsUploadFile.close();
         wsUploadInProgress = false;
+        WebDAVHandler::invalidateListingCache();
 
         wsLastCompleteName = wsUploadFileName;
         wsLastCompleteSize = wsUploadSize;
@@ -1323,13 +1742,12 @@ void CrossPointWebServer::onWebSocketEvent(uint8_t num, WStype_t type, uint8_t*
                 elapsed, kbps);
 
         // Clear epub cache to prevent stale metadata issues when overwriting files
-        String filePath = wsUploadPath;
-        if (!filePath.endsWith("/")) filePath += "/";
-        filePath += wsUploadFileName;
+        const String filePath = wsUploadFilePath();
         clearEpubCacheIfNeeded(filePath);
+        COVER_JOBS.enqueue(filePath.c_str());
+        BookCatalog::add(filePath.c_str(), wsUploadSize);
 
         wsServer->sendTXT(num, "DONE");
-        lastProgressSent = 0;
       }
       break;
     }
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include "UploadWriter.h"
+
 // Structure to hold file information
 struct FileInfo {
   String name;
@@ -38,14 +40,8 @@ class CrossPointWebServer {
     bool success = false;
     String error = "";
 
-    // Upload write buffer - batches small writes into larger SD card operations
-    // 4KB is a good balance: large enough to reduce syscall overhead, small enough
-    // to keep individual write times short and avoid watchdog issues
-    static constexpr size_t UPLOAD_BUFFER_SIZE = 4096;  // 4KB buffer
-    std::vector<uint8_t> buffer;
-    size_t bufferPos = 0;
-
-    UploadState() { buffer.resize(UPLOAD_BUFFER_SIZE); }
+    // Writes to file from its own task while the next data is received
+    UploadWriter writer;
   } upload;
 
   CrossPointWebServer();
@@ -81,18 +77,28 @@ class CrossPointWebServer {
   // WebSocket upload state
   void onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length);
   static void wsEventCallback(uint8_t num, WStype_t type, uint8_t* payload, size_t length);
+  // Sends a telemetry frame to the WebSocket clients that sent TELEMETRY
+  void publishTelemetry();
 
-  // File scanning
-  void scanFiles(const char* path, const std::function<void(FileInfo)>& callback) const;
+  // File scanning. With a cursor only up to limit entries are listed, starting at the cursor (0 for the first) and
+  // leaving it where the next page starts, or 0 if the directory has been listed to its end.
+  void scanFiles(const char* path, const std::function<void(FileInfo)>& callback, uint32_t* cursor = nullptr,
+                 size_t limit = 0) const;
   String formatFileSize(size_t bytes) const;
   bool isEpubFile(const String& filename) const;
 
   // Request handlers
   void handleRoot() const;
+  void handlePerfPage() const;
   void handleNotFound() const;
   void handleStatus() const;
   void handleFileList() const;
   void handleFileListData() const;
+  void handleBookList() const;
+  void handleBookCover() const;
+#ifdef ENABLE_TRACE
+  void handleTrace() const;
+#endif
   void handleDownload() const;
   void handleUpload(UploadState& state) const;
   void handleUploadPost(UploadState& state) const;
@@ -0,0 +1,171 @@
+#include "FileResponse.h"
+
+#include <Logging.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// Stack buffer for ranged responses, a whole file goes out through NetworkClient::write(Stream&)
+constexpr size_t SEND_CHUNK_SIZE = 2048;
+
+// A FAT timestamp as an HTTP date, "Sun, 06 Nov 1994 08:49:37 GMT". The card keeps no time zone, it's taken as GMT.
+void formatHttpDate(const uint16_t date, const uint16_t time, char* out, const size_t outSize) {
+  static const char* const DAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+  static const char* const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  static const int MONTH_OFFSETS[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
+  const int year = 1980 + (date >> 9);
+  const int month = std::clamp((date >> 5) & 0x0F, 1, 12);
+  const int day = std::clamp(date & 0x1F, 1, 31);
+  // Sakamoto's day of the week
+  const int y = month < 3 ? year - 1 : year;
+  const int weekday = (y + y / 4 - y / 100 + y / 400 + MONTH_OFFSETS[month - 1] + day) % 7;
+  snprintf(out, outSize, "%s, %02d %s %04d %02d:%02d:%02d GMT", DAYS[weekday], day, MONTHS[month - 1], year,
+           time >> 11, (time >> 5) & 0x3F, (time & 0x1F) * 2);
+}
+
+// If-None-Match is "*" or a list of entity tags, compared weakly: W/"x" matches "x"
+bool etagListMatches(const String& list, const char* etag) { return list == "*" || list.indexOf(etag) >= 0; }
+
+// Parses a "bytes=first-last", "bytes=first-" or "bytes=-suffix" range against the file size. False when there is no
+// single range to serve (malformed, or several ranges), the whole file is sent then. unsatisfiable is set for a range
+// that starts past the end of the file.
+bool parseRange(const String& header, const size_t size, size_t& first, size_t& last, bool& unsatisfiable) {
+  if (!header.startsWith("bytes=")) {
+    return false;
+  }
+  const char* spec = header.c_str() + 6;
+  const char* dash = strchr(spec, '-');
+  if (!dash || strchr(spec, ',')) {
+    return false;
+  }
+
+  char* end;
+  if (dash == spec) {
+    const unsigned long suffix = strtoul(dash + 1, &end, 10);
+    if (end == dash + 1 || *end != '\0') {
+      return false;
+    }
+    if (suffix == 0 || size == 0) {
+      unsatisfiable = true;
+      return true;
+    }
+    first = suffix >= size ? 0 : size - suffix;
+    last = size - 1;
+    return true;
+  }
+
+  first = strtoul(spec, &end, 10);
+  if (end != dash) {
+    return false;
+  }
+  if (first >= size) {
+    unsatisfiable = true;
+    return true;
+  }
+  if (dash[1] == '\0') {
+    last = size - 1;
+    return true;
+  }
+  last = strtoul(dash + 1, &end, 10);
+  if (*end != '\0' || last < first) {
+    return false;
+  }
+  last = std::min(last, size - 1);
+  return true;
+}
+}  // namespace
+
+void FileResponse::send(WebServer& server, FsFile& file, const String& contentType, const bool withBody) {
+  const size_t size = file.size();
+  uint16_t date = 0;
+  uint16_t time = 0;
+  file.getModifyDateTime(&date, &time);
+
+  // Size and modification time change whenever the file is written, which is all a strong validator needs here
+  char etag[32];
+  snprintf(etag, sizeof(etag), "\"%x-%04x%04x\"", static_cast<unsigned>(size), date, time);
+  char lastModified[32];
+  formatHttpDate(date, time, lastModified, sizeof(lastModified));
+  server.sendHeader("ETag", etag);
+  server.sendHeader("Last-Modified", lastModified);
+  server.sendHeader("Accept-Ranges", "bytes");
+
+  // If-None-Match takes precedence. If-Modified-Since is only compared for being the date sent, which is what clients
+  // send back; anything else gets the file.
+  const String ifNoneMatch = server.header("If-None-Match");
+  const bool notModified = ifNoneMatch.isEmpty() ? server.header("If-Modified-Since") == lastModified
+                                                 : etagListMatches(ifNoneMatch, etag);
+  if (notModified) {
+    server.send(304);
+    return;
+  }
+
+  // A Range whose If-Range no longer matches the file gets the whole file
+  size_t first = 0;
+  size_t last = size > 0 ? size - 1 : 0;
+  bool partial = false;
+  bool unsatisfiable = false;
+  const String range = server.header("Range");
+  const String ifRange = server.header("If-Range");
+  if (!range.isEmpty() && (ifRange.isEmpty() || ifRange == etag || ifRange == lastModified)) {
+    partial = parseRange(range, size, first, last, unsatisfiable);
+    if (!partial) {
+      // A malformed range may have been parsed part of the way
+      first = 0;
+      last = size > 0 ? size - 1 : 0;
+    }
+  }
+
+  char contentRange[48];
+  if (unsatisfiable) {
+    snprintf(contentRange, sizeof(contentRange), "bytes */%u", static_cast<unsigned>(size));
+    server.sendHeader("Content-Range", contentRange);
+    server.send(416, "text/plain", "Range Not Satisfiable");
+    return;
+  }
+
+  const size_t length = size > 0 ? last - first + 1 : 0;
+  server.setContentLength(length);
+  if (partial) {
+    snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u", static_cast<unsigned>(first),
+             static_cast<unsigned>(last), static_cast<unsigned>(size));
+    server.sendHeader("Content-Range", contentRange);
+    server.send(206, contentType.c_str(), "");
+  } else {
+    server.send(200, contentType.c_str(), "");
+  }
+  if (!withBody || length == 0) {
+    return;
+  }
+
+  NetworkClient client = server.client();
+  if (!partial) {
+    client.write(file);
+    return;
+  }
+
+  if (!file.seek(first)) {
+    LOG_ERR("WEB", "Failed to seek to %u for a range request", static_cast<unsigned>(first));
+    return;
+  }
+  uint8_t buffer[SEND_CHUNK_SIZE];
+  size_t remaining = length;
+  while (remaining > 0 && client.connected()) {
+    const int bytesRead = file.read(buffer, std::min(remaining, SEND_CHUNK_SIZE));
+    if (bytesRead <= 0) {
+      LOG_ERR("WEB", "Read failed with %u bytes of the range left", static_cast<unsigned>(remaining));
+      return;
+    }
+    if (client.write(buffer, bytesRead) != static_cast<size_t>(bytesRead)) {
+      // Client went away
+      return;
+    }
+    remaining -= bytesRead;
+    esp_task_wdt_reset();
+  }
+}
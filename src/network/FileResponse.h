@@ -0,0 +1,14 @@
+#pragma once
+#include <HalStorage.h>
+#include <WebServer.h>
+
+// Sends a file as the response to a GET or HEAD, with what lets clients skip and resume transfers: a strong ETag and
+// a Last-Modified taken from the file's size and modification time, 304 for a matching If-None-Match or
+// If-Modified-Since, and a single byte range (Range, If-Range) answered with 206. Needs the Range, If-Range,
+// If-None-Match and If-Modified-Since request headers collected.
+namespace FileResponse {
+
+// Headers of the response, such as Content-Disposition, may be added before. The file is left open.
+void send(WebServer& server, FsFile& file, const String& contentType, bool withBody = true);
+
+}  // namespace FileResponse
@@ -1,33 +1,39 @@
 #include "HttpDownloader.h"
 
 #include <HTTPClient.h>
+#include <HalPowerManager.h>
 #include <Logging.h>
 #include <NetworkClient.h>
 #include <NetworkClientSecure.h>
 #include <StreamString.h>
 #include <base64.h>
 
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <memory>
 
 #include "CrossPointSettings.h"
+#include "UploadWriter.h"
 #include "util/UrlUtils.h"
 
-bool HttpDownloader::fetchUrl(const std::string& url, Stream& outContent) {
-  // Use NetworkClientSecure for HTTPS, regular NetworkClient for HTTP
-  std::unique_ptr<NetworkClient> client;
+namespace {
+// Connections a download gets, each one resuming where the one before was cut off
+constexpr int MAX_ATTEMPTS = 3;
+constexpr unsigned long RETRY_DELAY_MS = 1000;
+
+// Use NetworkClientSecure for HTTPS, regular NetworkClient for HTTP
+std::unique_ptr<NetworkClient> createClient(const std::string& url) {
   if (UrlUtils::isHttpsUrl(url)) {
     auto* secureClient = new NetworkClientSecure();
     secureClient->setInsecure();
-    client.reset(secureClient);
-  } else {
-    client.reset(new NetworkClient());
+    return std::unique_ptr<NetworkClient>(secureClient);
   }
-  HTTPClient http;
-
-  LOG_DBG("HTTP", "Fetching: %s", url.c_str());
+  return std::unique_ptr<NetworkClient>(new NetworkClient());
+}
 
-  http.begin(*client, url.c_str());
+void addRequestHeaders(HTTPClient& http) {
   http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
   http.addHeader("User-Agent", "CrossPoint-ESP32-" CROSSPOINT_VERSION);
 
@@ -37,6 +43,47 @@ bool HttpDownloader::fetchUrl(const std::string& url, Stream& outContent) {
     String encoded = base64::encode(credentials.c_str());
     http.addHeader("Authorization", "Basic " + encoded);
   }
+}
+
+// Passes a response body on while keeping a copy of it in the cache
+class CachingStream final : public Stream {
+ public:
+  CachingStream(Stream& out, FsFile& file) : out(out), file(file) {}
+
+  int available() override { return 0; }
+  int peek() override { return -1; }
+  int read() override { return -1; }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    if (!failed && file.write(buffer, size) != size) {
+      failed = true;
+    }
+    return out.write(buffer, size);
+  }
+
+  bool failed = false;
+
+ private:
+  Stream& out;
+  FsFile& file;
+};
+
+void removePartial(const std::string& partPath, const std::string& validatorPath) {
+  Storage.remove(partPath.c_str());
+  Storage.remove(validatorPath.c_str());
+}
+}  // namespace
+
+bool HttpDownloader::fetchUrl(const std::string& url, Stream& outContent) {
+  HalPowerManager::Lock powerLock(HalPowerManager::Network);
+  std::unique_ptr<NetworkClient> client = createClient(url);
+  HTTPClient http;
+
+  LOG_DBG("HTTP", "Fetching: %s", url.c_str());
+
+  http.begin(*client, url.c_str());
+  addRequestHeaders(http);
 
   const int httpCode = http.GET();
   if (httpCode != HTTP_CODE_OK) {
@@ -62,51 +109,220 @@ bool HttpDownloader::fetchUrl(const std::string& url, std::string& outContent) {
   return true;
 }
 
-HttpDownloader::DownloadError HttpDownloader::downloadToFile(const std::string& url, const std::string& destPath,
-                                                             ProgressCallback progress) {
-  // Use NetworkClientSecure for HTTPS, regular NetworkClient for HTTP
-  std::unique_ptr<NetworkClient> client;
-  if (UrlUtils::isHttpsUrl(url)) {
-    auto* secureClient = new NetworkClientSecure();
-    secureClient->setInsecure();
-    client.reset(secureClient);
-  } else {
-    client.reset(new NetworkClient());
+bool HttpDownloader::fetchUrlCached(const std::string& url, Stream& outContent, const std::string& cacheDir) {
+  HalPowerManager::Lock powerLock(HalPowerManager::Network);
+  const std::string key = cacheDir + "/" + std::to_string(std::hash<std::string>{}(url));
+  const std::string bodyPath = key + ".body";
+  const std::string metaPath = key + ".meta";  // ETag and Last-Modified of the body, one per line
+  const std::string tmpPath = key + ".tmp";
+
+  String etag;
+  String lastModified;
+  if (Storage.exists(bodyPath.c_str())) {
+    const String meta = Storage.readFile(metaPath.c_str());
+    const int newline = meta.indexOf('\n');
+    if (newline >= 0) {
+      etag = meta.substring(0, newline);
+      lastModified = meta.substring(newline + 1);
+    }
   }
+  const bool cached = !etag.isEmpty() || !lastModified.isEmpty();
+
+  std::unique_ptr<NetworkClient> client = createClient(url);
   HTTPClient http;
 
-  LOG_DBG("HTTP", "Downloading: %s", url.c_str());
-  LOG_DBG("HTTP", "Destination: %s", destPath.c_str());
+  LOG_DBG("HTTP", "Fetching: %s%s", url.c_str(), cached ? " (cached)" : "");
 
   http.begin(*client, url.c_str());
-  http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-  http.addHeader("User-Agent", "CrossPoint-ESP32-" CROSSPOINT_VERSION);
-
-  // Add Basic HTTP auth if credentials are configured
-  if (strlen(SETTINGS.opdsUsername) > 0 && strlen(SETTINGS.opdsPassword) > 0) {
-    std::string credentials = std::string(SETTINGS.opdsUsername) + ":" + SETTINGS.opdsPassword;
-    String encoded = base64::encode(credentials.c_str());
-    http.addHeader("Authorization", "Basic " + encoded);
+  addRequestHeaders(http);
+  const char* responseHeaders[] = {"ETag", "Last-Modified"};
+  http.collectHeaders(responseHeaders, sizeof(responseHeaders) / sizeof(responseHeaders[0]));
+  if (!etag.isEmpty()) {
+    http.addHeader("If-None-Match", etag);
+  }
+  if (!lastModified.isEmpty()) {
+    http.addHeader("If-Modified-Since", lastModified);
   }
 
   const int httpCode = http.GET();
+  if (httpCode == HTTP_CODE_NOT_MODIFIED && cached) {
+    http.end();
+    LOG_DBG("HTTP", "Not modified, using %s", bodyPath.c_str());
+    return Storage.readFileToStream(bodyPath.c_str(), outContent, 1024);
+  }
   if (httpCode != HTTP_CODE_OK) {
-    LOG_ERR("HTTP", "Download failed: %d", httpCode);
+    LOG_ERR("HTTP", "Fetch failed: %d", httpCode);
     http.end();
-    return HTTP_ERROR;
+    return false;
+  }
+
+  const String newEtag = http.header("ETag");
+  const String newLastModified = http.header("Last-Modified");
+  const bool cacheable = !newEtag.isEmpty() || !newLastModified.isEmpty();
+  FsFile file;
+  if (cacheable) {
+    Storage.mkdir(cacheDir.c_str());
+  }
+  if (!cacheable || !Storage.openFileForWrite("HTTP", tmpPath, file)) {
+    // Nothing to revalidate it with (or nowhere to keep it): not cached
+    Storage.remove(bodyPath.c_str());
+    Storage.remove(metaPath.c_str());
+    http.writeToStream(&outContent);
+    http.end();
+    LOG_DBG("HTTP", "Fetch success");
+    return true;
+  }
+
+  CachingStream stream(outContent, file);
+  const bool complete = http.writeToStream(&stream) >= 0 && !stream.failed;
+  file.close();
+  http.end();
+
+  // Only a complete body replaces what was cached before
+  if (complete) {
+    Storage.remove(bodyPath.c_str());
+    if (Storage.rename(tmpPath.c_str(), bodyPath.c_str())) {
+      Storage.writeFile(metaPath.c_str(), newEtag + "\n" + newLastModified);
+    }
+  } else {
+    Storage.remove(tmpPath.c_str());
+  }
+
+  LOG_DBG("HTTP", "Fetch success");
+  return true;
+}
+
+HttpDownloader::DownloadError HttpDownloader::downloadToFile(const std::string& url, const std::string& destPath,
+                                                             ProgressCallback progress, const size_t chunkSize) {
+  HalPowerManager::Lock powerLock(HalPowerManager::Network);
+  // The download goes to a .part file, renamed once complete. What the server said identifies the file version (the
+  // validator) is kept next to it, so a download that was cut off - in this call or an earlier one - can be resumed.
+  const std::string partPath = destPath + ".part";
+  const std::string validatorPath = partPath + ".etag";
+
+  LOG_DBG("HTTP", "Downloading: %s", url.c_str());
+  LOG_DBG("HTTP", "Destination: %s", destPath.c_str());
+
+  auto* buffer = static_cast<uint8_t*>(malloc(chunkSize));
+  if (!buffer) {
+    LOG_ERR("HTTP", "Not enough memory for a %zu byte download buffer", chunkSize);
+    return FILE_ERROR;
+  }
+
+  DownloadError result = HTTP_ERROR;
+  for (int attempt = 1; attempt <= MAX_ATTEMPTS; attempt++) {
+    bool retry = false;
+    result = downloadAttempt(url, partPath, validatorPath, buffer, chunkSize, progress, retry);
+    if (result == OK || !retry || attempt == MAX_ATTEMPTS) {
+      break;
+    }
+    LOG_DBG("HTTP", "Download interrupted, retrying (%d of %d)", attempt + 1, MAX_ATTEMPTS);
+    delay(RETRY_DELAY_MS * attempt);
   }
+  free(buffer);
 
-  const size_t contentLength = http.getSize();
-  LOG_DBG("HTTP", "Content-Length: %zu", contentLength);
+  if (result != OK) {
+    return result;
+  }
 
   // Remove existing file if present
   if (Storage.exists(destPath.c_str())) {
     Storage.remove(destPath.c_str());
   }
+  Storage.remove(validatorPath.c_str());
+  if (!Storage.rename(partPath.c_str(), destPath.c_str())) {
+    LOG_ERR("HTTP", "Failed to move %s into place", partPath.c_str());
+    Storage.remove(partPath.c_str());
+    return FILE_ERROR;
+  }
+  return OK;
+}
+
+HttpDownloader::DownloadError HttpDownloader::downloadAttempt(const std::string& url, const std::string& partPath,
+                                                              const std::string& validatorPath, uint8_t* buffer,
+                                                              const size_t chunkSize,
+                                                              const ProgressCallback& progress, bool& retry) {
+  // Resume from the end of the .part file, if it's known which version of the file it belongs to
+  size_t offset = 0;
+  std::string validator;
+  if (Storage.exists(partPath.c_str())) {
+    FsFile part = Storage.open(partPath.c_str());
+    offset = part ? part.size() : 0;
+    part.close();
+    validator = Storage.readFile(validatorPath.c_str()).c_str();
+    if (offset == 0 || validator.empty()) {
+      offset = 0;
+      removePartial(partPath, validatorPath);
+    }
+  }
+
+  std::unique_ptr<NetworkClient> client = createClient(url);
+  HTTPClient http;
+  http.begin(*client, url.c_str());
+  addRequestHeaders(http);
+  const char* responseHeaders[] = {"ETag", "Last-Modified", "Content-Range"};
+  http.collectHeaders(responseHeaders, sizeof(responseHeaders) / sizeof(responseHeaders[0]));
+  if (offset > 0) {
+    // If-Range: the rest if the file is still the one the .part has the start of, otherwise all of it (200)
+    http.addHeader("Range", "bytes=" + String(static_cast<unsigned long>(offset)) + "-");
+    http.addHeader("If-Range", validator.c_str());
+    LOG_DBG("HTTP", "Resuming at %zu bytes", offset);
+  }
+
+  const int httpCode = http.GET();
+  size_t total = 0;
+  bool append = false;
+  if (httpCode == HTTP_CODE_PARTIAL_CONTENT && offset > 0) {
+    // Content-Range: bytes <first>-<last>/<size>
+    unsigned long first = 0;
+    unsigned long last = 0;
+    unsigned long size = 0;
+    if (sscanf(http.header("Content-Range").c_str(), "bytes %lu-%lu/%lu", &first, &last, &size) != 3 ||
+        first != offset) {
+      LOG_ERR("HTTP", "Unexpected Content-Range: %s", http.header("Content-Range").c_str());
+      http.end();
+      removePartial(partPath, validatorPath);
+      retry = true;
+      return HTTP_ERROR;
+    }
+    total = size;
+    append = true;
+  } else if (httpCode == HTTP_CODE_OK) {
+    const int contentLength = http.getSize();
+    total = contentLength > 0 ? contentLength : 0;
+    offset = 0;
+  } else {
+    LOG_ERR("HTTP", "Download failed: %d", httpCode);
+    http.end();
+    if (httpCode == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+      // The .part doesn't fit the file on the server, start over
+      removePartial(partPath, validatorPath);
+    }
+    // Negative codes are connection errors, worth another try; an HTTP error status isn't
+    retry = httpCode < 0 || httpCode == HTTP_CODE_RANGE_NOT_SATISFIABLE;
+    return HTTP_ERROR;
+  }
+  LOG_DBG("HTTP", "Content-Length: %zu", total);
 
-  // Open file for writing
   FsFile file;
-  if (!Storage.openFileForWrite("HTTP", destPath.c_str(), file)) {
+  if (append) {
+    file = Storage.open(partPath.c_str(), O_WRONLY);
+    if (file && !file.seek(offset)) {
+      file.close();
+    }
+  } else {
+    removePartial(partPath, validatorPath);
+    Storage.openFileForWrite("HTTP", partPath.c_str(), file);
+    // Only a strong ETag or a Last-Modified date can go in If-Range; without either it can't be resumed
+    String newValidator = http.header("ETag");
+    if (newValidator.isEmpty() || newValidator.startsWith("W/")) {
+      newValidator = http.header("Last-Modified");
+    }
+    if (!newValidator.isEmpty()) {
+      Storage.writeFile(validatorPath.c_str(), newValidator);
+    }
+  }
+  if (!file) {
     LOG_ERR("HTTP", "Failed to open file for writing");
     http.end();
     return FILE_ERROR;
@@ -114,58 +330,66 @@ HttpDownloader::DownloadError HttpDownloader::downloadToFile(const std::string&
 
   // Get the stream for chunked reading
   NetworkClient* stream = http.getStreamPtr();
-  if (!stream) {
+  UploadWriter writer;
+  if (!stream || !writer.begin(file)) {
     LOG_ERR("HTTP", "Failed to get stream");
     file.close();
-    Storage.remove(destPath.c_str());
     http.end();
-    return HTTP_ERROR;
+    retry = stream == nullptr;
+    return stream ? FILE_ERROR : HTTP_ERROR;
   }
 
-  // Download in chunks
-  uint8_t buffer[DOWNLOAD_CHUNK_SIZE];
+  // Download in chunks. SD writes run in the writer task, so reading from the socket only waits on the card when
+  // it has fallen two buffers behind.
+  const size_t remaining = total > offset ? total - offset : 0;
   size_t downloaded = 0;
-  const size_t total = contentLength > 0 ? contentLength : 0;
-
-  while (http.connected() && (contentLength == 0 || downloaded < contentLength)) {
+  while (http.connected() && (total == 0 || downloaded < remaining)) {
     const size_t available = stream->available();
     if (available == 0) {
       delay(1);
       continue;
     }
 
-    const size_t toRead = available < DOWNLOAD_CHUNK_SIZE ? available : DOWNLOAD_CHUNK_SIZE;
+    const size_t toRead = available < chunkSize ? available : chunkSize;
     const size_t bytesRead = stream->readBytes(buffer, toRead);
 
     if (bytesRead == 0) {
       break;
     }
 
-    const size_t written = file.write(buffer, bytesRead);
-    if (written != bytesRead) {
-      LOG_ERR("HTTP", "Write failed: wrote %zu of %zu bytes", written, bytesRead);
+    if (!writer.write(buffer, bytesRead)) {
+      LOG_ERR("HTTP", "Write failed at %zu bytes", offset + downloaded);
+      writer.abort();
       file.close();
-      Storage.remove(destPath.c_str());
       http.end();
+      removePartial(partPath, validatorPath);
       return FILE_ERROR;
     }
 
     downloaded += bytesRead;
 
     if (progress && total > 0) {
-      progress(downloaded, total);
+      progress(offset + downloaded, total);
     }
   }
 
+  // Whatever arrived is written out either way, a resume picks up after it
+  const bool written = writer.finish();
   file.close();
   http.end();
 
   LOG_DBG("HTTP", "Downloaded %zu bytes", downloaded);
 
+  if (!written) {
+    LOG_ERR("HTTP", "Write failed at the end of %s", partPath.c_str());
+    removePartial(partPath, validatorPath);
+    return FILE_ERROR;
+  }
+
   // Verify download size if known
-  if (contentLength > 0 && downloaded != contentLength) {
-    LOG_ERR("HTTP", "Size mismatch: got %zu, expected %zu", downloaded, contentLength);
-    Storage.remove(destPath.c_str());
+  if (total > 0 && downloaded != remaining) {
+    LOG_ERR("HTTP", "Connection lost at %zu of %zu bytes", offset + downloaded, total);
+    retry = true;
     return HTTP_ERROR;
   }
 
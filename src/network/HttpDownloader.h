@@ -29,16 +29,36 @@ class HttpDownloader {
 
   static bool fetchUrl(const std::string& url, Stream& stream);
 
+  /**
+   * Fetch a URL through a cache on the SD card. A response with an ETag or Last-Modified is kept in cacheDir, keyed
+   * by a hash of the URL; the next fetch of the URL is a conditional GET, and a 304 answer is served from the cache.
+   * @param url The URL to fetch
+   * @param stream Receives the content, from the network or the cache
+   * @param cacheDir Directory the cached responses are kept in
+   * @return true if fetch succeeded, false on error
+   */
+  static bool fetchUrlCached(const std::string& url, Stream& stream, const std::string& cacheDir);
+
+  // Bytes read from the connection at a time
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 4096;
+
   /**
    * Download a file to the SD card.
+   * Data goes to destPath.part first, which is renamed once complete. A dropped connection is retried, resuming with
+   * a Range request checked by If-Range against the ETag (or Last-Modified) of the first response; a .part left by
+   * an earlier call is resumed the same way.
    * @param url The URL to download
    * @param destPath The destination path on SD card
    * @param progress Optional progress callback
+   * @param chunkSize Size of the buffer reads from the connection go into
    * @return DownloadError indicating success or failure type
    */
   static DownloadError downloadToFile(const std::string& url, const std::string& destPath,
-                                      ProgressCallback progress = nullptr);
+                                      ProgressCallback progress = nullptr, size_t chunkSize = DEFAULT_CHUNK_SIZE);
 
  private:
-  static constexpr size_t DOWNLOAD_CHUNK_SIZE = 1024;
+  // One connection's worth of downloadToFile(); retry is set when another attempt could get further
+  static DownloadError downloadAttempt(const std::string& url, const std::string& partPath,
+                                       const std::string& validatorPath, uint8_t* buffer, size_t chunkSize,
+                                       const ProgressCallback& progress, bool& retry);
 };
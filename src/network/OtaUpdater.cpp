@@ -1,15 +1,40 @@
 #include "OtaUpdater.h"
 
 #include <ArduinoJson.h>
+#include <HalPowerManager.h>
+#include <HalStorage.h>
 #include <Logging.h>
+#include <Serialization.h>
+#include <mbedtls/sha256.h>
+
+#include <algorithm>
+#include <cstring>
 
 #include "esp_http_client.h"
-#include "esp_https_ota.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
 #include "esp_wifi.h"
 
 namespace {
 constexpr char latestReleaseUrl[] = "https://api.github.com/repos/crosspoint-reader/crosspoint-reader/releases/latest";
 
+/* Progress of an interrupted firmware download, so the next attempt resumes it */
+constexpr char OTA_PROGRESS_FILE[] = "/.crosspoint/ota_progress.bin";
+constexpr uint8_t OTA_PROGRESS_FILE_VERSION = 1;
+/* One flash sector: the image is erased, written and hashed a sector at a time */
+constexpr uint32_t OTA_CHUNK_SIZE = 4096;
+constexpr uint32_t OTA_MARKER_INTERVAL = 64 * 1024;
+constexpr int OTA_MAX_ATTEMPTS = 5;
+constexpr int OTA_MAX_REDIRECTS = 5;
+constexpr unsigned long OTA_RETRY_DELAY_MS = 2000;
+
+struct OtaProgress {
+  std::string url;
+  uint32_t size;
+  uint32_t partitionAddress;
+  uint32_t written;
+};
+
 /* This is buffer and size holder to keep upcoming data from latestReleaseUrl */
 char* local_buf;
 int output_len;
@@ -58,6 +83,162 @@ esp_err_t event_handler(esp_http_client_event_t* event) {
 
   return ESP_OK;
 } /* event_handler */
+
+bool loadOtaProgress(OtaProgress& progress) {
+  FsFile file;
+  if (!Storage.exists(OTA_PROGRESS_FILE) || !Storage.openFileForRead("OTA", OTA_PROGRESS_FILE, file)) {
+    return false;
+  }
+  uint8_t version = 0;
+  serialization::readPod(file, version);
+  if (version != OTA_PROGRESS_FILE_VERSION) {
+    file.close();
+    return false;
+  }
+  serialization::readString(file, progress.url);
+  serialization::readPod(file, progress.size);
+  serialization::readPod(file, progress.partitionAddress);
+  serialization::readPod(file, progress.written);
+  file.close();
+  return true;
+}
+
+void saveOtaProgress(const OtaProgress& progress) {
+  Storage.mkdir("/.crosspoint");
+  FsFile file;
+  if (!Storage.openFileForWrite("OTA", OTA_PROGRESS_FILE, file)) {
+    return;
+  }
+  serialization::writePod(file, OTA_PROGRESS_FILE_VERSION);
+  serialization::writeString(file, progress.url);
+  serialization::writePod(file, progress.size);
+  serialization::writePod(file, progress.partitionAddress);
+  serialization::writePod(file, progress.written);
+  file.close();
+}
+
+void clearOtaProgress() {
+  if (Storage.exists(OTA_PROGRESS_FILE)) {
+    Storage.remove(OTA_PROGRESS_FILE);
+  }
+}
+
+bool isRedirect(const int status) {
+  return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+}
+
+/*
+ * Downloads the rest of the image, from progress.written on, straight into the partition: one flash sector at a time,
+ * each erased right before it is written, and hashed as it goes. Progress is saved every OTA_MARKER_INTERVAL bytes.
+ * Returns HTTP_ERROR when the connection drops, which leaves progress.written at the end of the last whole sector.
+ */
+OtaUpdater::OtaUpdaterError downloadRest(const esp_partition_t* partition, OtaProgress& progress,
+                                         mbedtls_sha256_context& sha, uint8_t* buffer, size_t& processedSize,
+                                         bool& render) {
+  esp_http_client_config_t client_config = {
+      .url = progress.url.c_str(),
+      .timeout_ms = 15000,
+      /* Default HTTP client buffer size 512 byte only
+       * not sufficent to handle URL redirection cases or
+       * parsing of large HTTP headers.
+       */
+      .buffer_size = 8192,
+      .buffer_size_tx = 8192,
+      .skip_cert_common_name_check = true,
+      .crt_bundle_attach = esp_crt_bundle_attach,
+      .keep_alive_enable = true,
+  };
+
+  esp_http_client_handle_t client_handle = esp_http_client_init(&client_config);
+  if (!client_handle) {
+    LOG_ERR("OTA", "HTTP Client Handle Failed");
+    return OtaUpdater::INTERNAL_UPDATE_ERROR;
+  }
+  http_client_set_header_cb(client_handle);
+  if (progress.written > 0) {
+    char range[32];
+    snprintf(range, sizeof(range), "bytes=%u-", static_cast<unsigned>(progress.written));
+    esp_http_client_set_header(client_handle, "Range", range);
+  }
+
+  /* The release asset URL redirects to where the file is actually stored; the Range header goes along */
+  int status = 0;
+  for (int redirects = 0;; redirects++) {
+    const esp_err_t esp_err = esp_http_client_open(client_handle, 0);
+    if (esp_err != ESP_OK || esp_http_client_fetch_headers(client_handle) < 0) {
+      LOG_ERR("OTA", "esp_http_client_open Failed: %s", esp_err_to_name(esp_err));
+      esp_http_client_cleanup(client_handle);
+      return OtaUpdater::HTTP_ERROR;
+    }
+    status = esp_http_client_get_status_code(client_handle);
+    if (!isRedirect(status) || redirects == OTA_MAX_REDIRECTS) {
+      break;
+    }
+    esp_http_client_flush_response(client_handle, nullptr);
+    esp_http_client_set_redirection(client_handle);
+  }
+
+  if (status == 200 && progress.written > 0) {
+    LOG_DBG("OTA", "Range not honoured, starting over");
+    progress.written = 0;
+    mbedtls_sha256_starts(&sha, 0);
+  } else if (status == 416) {
+    /* Whatever the marker says doesn't match the file on the server */
+    LOG_ERR("OTA", "Range not satisfiable, starting over");
+    progress.written = 0;
+    mbedtls_sha256_starts(&sha, 0);
+    esp_http_client_cleanup(client_handle);
+    return OtaUpdater::HTTP_ERROR;
+  } else if (status != 200 && status != 206) {
+    LOG_ERR("OTA", "Download failed: HTTP %d", status);
+    esp_http_client_cleanup(client_handle);
+    return OtaUpdater::INTERNAL_UPDATE_ERROR;
+  }
+
+  OtaUpdater::OtaUpdaterError result = OtaUpdater::OK;
+  uint32_t sinceMarker = 0;
+  while (progress.written < progress.size) {
+    const uint32_t toRead = std::min<uint32_t>(OTA_CHUNK_SIZE, progress.size - progress.written);
+    uint32_t filled = 0;
+    while (filled < toRead) {
+      const int len = esp_http_client_read(client_handle, reinterpret_cast<char*>(buffer) + filled, toRead - filled);
+      if (len <= 0) {
+        break;
+      }
+      filled += len;
+    }
+    /* A partial sector is dropped, the next request starts again at its beginning */
+    if (filled < toRead) {
+      LOG_ERR("OTA", "Connection lost at %u bytes", progress.written + filled);
+      result = OtaUpdater::HTTP_ERROR;
+      break;
+    }
+
+    if (esp_partition_erase_range(partition, progress.written, OTA_CHUNK_SIZE) != ESP_OK ||
+        esp_partition_write(partition, progress.written, buffer, filled) != ESP_OK) {
+      LOG_ERR("OTA", "Flash write failed at %u bytes", progress.written);
+      result = OtaUpdater::INTERNAL_UPDATE_ERROR;
+      break;
+    }
+    mbedtls_sha256_update(&sha, buffer, filled);
+    progress.written += filled;
+    processedSize = progress.written;
+    /* Sent signal to  OtaUpdateActivity */
+    render = true;
+
+    sinceMarker += filled;
+    if (sinceMarker >= OTA_MARKER_INTERVAL) {
+      saveOtaProgress(progress);
+      sinceMarker = 0;
+    }
+  }
+
+  esp_http_client_cleanup(client_handle);
+  if (progress.written < progress.size) {
+    saveOtaProgress(progress);
+  }
+  return result;
+}
 } /* namespace */
 
 OtaUpdater::OtaUpdaterError OtaUpdater::checkForUpdate() {
@@ -118,6 +299,7 @@ OtaUpdater::OtaUpdaterError OtaUpdater::checkForUpdate() {
   filter["assets"][0]["name"] = true;
   filter["assets"][0]["browser_download_url"] = true;
   filter["assets"][0]["size"] = true;
+  filter["assets"][0]["digest"] = true;
   const DeserializationError error = deserializeJson(doc, local_buf, DeserializationOption::Filter(filter));
   if (error) {
     LOG_ERR("OTA", "JSON parse failed: %s", error.c_str());
@@ -141,6 +323,9 @@ OtaUpdater::OtaUpdaterError OtaUpdater::checkForUpdate() {
       otaUrl = doc["assets"][i]["browser_download_url"].as<std::string>();
       otaSize = doc["assets"][i]["size"].as<size_t>();
       totalSize = otaSize;
+      /* Published by GitHub as "sha256:<hex>", not there for older releases */
+      const std::string digest = doc["assets"][i]["digest"] | std::string("");
+      otaDigest = digest.rfind("sha256:", 0) == 0 ? digest.substr(7) : "";
       updateAvailable = true;
       break;
     }
@@ -205,65 +390,97 @@ OtaUpdater::OtaUpdaterError OtaUpdater::installUpdate() {
     return UPDATE_OLDER_ERROR;
   }
 
-  esp_https_ota_handle_t ota_handle = NULL;
-  esp_err_t esp_err;
   /* Signal for OtaUpdateActivity */
   render = false;
+  HalPowerManager::Lock powerLock(HalPowerManager::Network);
 
-  esp_http_client_config_t client_config = {
-      .url = otaUrl.c_str(),
-      .timeout_ms = 15000,
-      /* Default HTTP client buffer size 512 byte only
-       * not sufficent to handle URL redirection cases or
-       * parsing of large HTTP headers.
-       */
-      .buffer_size = 8192,
-      .buffer_size_tx = 8192,
-      .skip_cert_common_name_check = true,
-      .crt_bundle_attach = esp_crt_bundle_attach,
-      .keep_alive_enable = true,
-  };
+  const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+  if (!partition || otaSize == 0 || otaSize > partition->size) {
+    LOG_ERR("OTA", "No OTA partition for an image of %zu bytes", otaSize);
+    return INTERNAL_UPDATE_ERROR;
+  }
 
-  esp_https_ota_config_t ota_config = {
-      .http_config = &client_config,
-      .http_client_init_cb = http_client_set_header_cb,
-  };
+  /* Pick up where an interrupted download of the same image into the same partition left off */
+  OtaProgress progress = {otaUrl, static_cast<uint32_t>(otaSize), partition->address, 0};
+  OtaProgress saved;
+  if (loadOtaProgress(saved) && saved.url == progress.url && saved.size == progress.size &&
+      saved.partitionAddress == progress.partitionAddress && saved.written <= progress.size) {
+    progress.written = saved.written - saved.written % OTA_CHUNK_SIZE;
+  }
+
+  auto* buffer = static_cast<uint8_t*>(malloc(OTA_CHUNK_SIZE));
+  if (!buffer) {
+    LOG_ERR("OTA", "Not enough memory for the download buffer");
+    return OOM_ERROR;
+  }
+
+  /* The running hash of a resumed download starts from what is in flash already, which checks that part too */
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  for (uint32_t pos = 0; pos < progress.written; pos += OTA_CHUNK_SIZE) {
+    if (esp_partition_read(partition, pos, buffer, OTA_CHUNK_SIZE) != ESP_OK) {
+      LOG_ERR("OTA", "Failed to read back the partition, starting over");
+      progress.written = 0;
+      mbedtls_sha256_starts(&sha, 0);
+      break;
+    }
+    mbedtls_sha256_update(&sha, buffer, OTA_CHUNK_SIZE);
+  }
+  processedSize = progress.written;
+  if (progress.written > 0) {
+    LOG_INF("OTA", "Resuming update at %u of %u bytes", progress.written, progress.size);
+  }
 
   /* For better timing and connectivity, we disable power saving for WiFi */
   esp_wifi_set_ps(WIFI_PS_NONE);
 
-  esp_err = esp_https_ota_begin(&ota_config, &ota_handle);
-  if (esp_err != ESP_OK) {
-    LOG_DBG("OTA", "HTTP OTA Begin Failed: %s", esp_err_to_name(esp_err));
-    return INTERNAL_UPDATE_ERROR;
+  OtaUpdaterError result = OK;
+  for (int attempt = 1; attempt <= OTA_MAX_ATTEMPTS && progress.written < progress.size; attempt++) {
+    if (attempt > 1) {
+      LOG_DBG("OTA", "Download interrupted at %u bytes, retrying (%d of %d)", progress.written, attempt,
+              OTA_MAX_ATTEMPTS);
+      delay(OTA_RETRY_DELAY_MS);
+    }
+    result = downloadRest(partition, progress, sha, buffer, processedSize, render);
+    /* Only a dropped connection is worth another try */
+    if (result != HTTP_ERROR) {
+      break;
+    }
   }
 
-  do {
-    esp_err = esp_https_ota_perform(ota_handle);
-    processedSize = esp_https_ota_get_image_len_read(ota_handle);
-    /* Sent signal to  OtaUpdateActivity */
-    render = true;
-    delay(100);  // TODO: should we replace this with something better?
-  } while (esp_err == ESP_ERR_HTTPS_OTA_IN_PROGRESS);
-
   /* Return back to default power saving for WiFi in case of failing */
   esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+  free(buffer);
 
-  if (esp_err != ESP_OK) {
-    LOG_ERR("OTA", "esp_https_ota_perform Failed: %s", esp_err_to_name(esp_err));
-    esp_https_ota_finish(ota_handle);
-    return HTTP_ERROR;
+  if (progress.written < progress.size) {
+    mbedtls_sha256_free(&sha);
+    /* The marker stays, a later attempt resumes from it */
+    return result == OK ? HTTP_ERROR : result;
   }
 
-  if (!esp_https_ota_is_complete_data_received(ota_handle)) {
-    LOG_ERR("OTA", "esp_https_ota_is_complete_data_received Failed: %s", esp_err_to_name(esp_err));
-    esp_https_ota_finish(ota_handle);
-    return INTERNAL_UPDATE_ERROR;
+  uint8_t digest[32];
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  /* Complete either way: an image that turns out bad has to be downloaded again from the start */
+  clearOtaProgress();
+
+  if (!otaDigest.empty()) {
+    char hex[sizeof(digest) * 2 + 1];
+    for (size_t i = 0; i < sizeof(digest); i++) {
+      snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+    if (strcasecmp(hex, otaDigest.c_str()) != 0) {
+      LOG_ERR("OTA", "SHA-256 mismatch: got %s, published %s", hex, otaDigest.c_str());
+      return INTERNAL_UPDATE_ERROR;
+    }
+    LOG_DBG("OTA", "SHA-256 verified: %s", hex);
   }
 
-  esp_err = esp_https_ota_finish(ota_handle);
+  /* Also validates the image (its header, checksum and appended hash) before switching to it */
+  const esp_err_t esp_err = esp_ota_set_boot_partition(partition);
   if (esp_err != ESP_OK) {
-    LOG_ERR("OTA", "esp_https_ota_finish Failed: %s", esp_err_to_name(esp_err));
+    LOG_ERR("OTA", "esp_ota_set_boot_partition Failed: %s", esp_err_to_name(esp_err));
     return INTERNAL_UPDATE_ERROR;
   }
 
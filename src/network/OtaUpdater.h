@@ -7,6 +7,7 @@ class OtaUpdater {
   bool updateAvailable = false;
   std::string latestVersion;
   std::string otaUrl;
+  std::string otaDigest;  // Hex SHA-256 of the image, empty if the release doesn't publish one
   size_t otaSize = 0;
   size_t processedSize = 0;
   size_t totalSize = 0;
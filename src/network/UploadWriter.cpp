@@ -0,0 +1,160 @@
+#include "UploadWriter.h"
+
+#include <Arduino.h>
+#include <Logging.h>
+#include <esp_task_wdt.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "WorkerPool.h"
+
+namespace {
+// Sent back by the writer task once it has taken the stop block, nothing is left to wait for after it
+constexpr uint8_t TASK_STOPPED = 0xFF;
+constexpr TickType_t WAIT_SLICE = pdMS_TO_TICKS(100);
+}  // namespace
+
+bool UploadWriter::begin(FsFile& file) {
+  abort();
+  this->file = &file;
+  failed = false;
+  writeTime = 0;
+  writeCount = 0;
+  filling = -1;
+  fillPos = 0;
+
+  buffers[0] = static_cast<uint8_t*>(malloc(BUFFER_SIZE));
+  buffers[1] = static_cast<uint8_t*>(malloc(BUFFER_SIZE));
+  // Room for both buffers and the stop block, so handing one over never blocks
+  fullBlocks = xQueueCreate(3, sizeof(Block));
+  freeBlocks = xQueueCreate(3, sizeof(uint8_t));
+  if (!buffers[0] || !buffers[1] || !fullBlocks || !freeBlocks) {
+    LOG_ERR("WEB", "[UPLOAD] Not enough memory for the upload buffers");
+    release();
+    return false;
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    xQueueSend(freeBlocks, &i, 0);
+  }
+
+  // Runs on a worker of the pool at the loop task's priority, so the two take turns while the other waits on the socket
+  // or the card
+  if (!WORKERS.submit(&taskTrampoline, this, "UploadWriter")) {
+    LOG_ERR("WEB", "[UPLOAD] Failed to start the writer task");
+    release();
+    return false;
+  }
+  running = true;
+  return true;
+}
+
+void UploadWriter::taskTrampoline(void* param) {
+  static_cast<UploadWriter*>(param)->taskLoop();
+}
+
+void UploadWriter::taskLoop() {
+  Block block;
+  while (xQueueReceive(fullBlocks, &block, portMAX_DELAY) == pdTRUE && block.length > 0) {
+    // After a failure (or an abort) the rest is dropped, the buffers only go back
+    if (!failed) {
+      const unsigned long writeStart = millis();
+      const size_t written = file->write(buffers[block.index], block.length);
+      writeTime += millis() - writeStart;
+      writeCount++;
+      if (written != block.length) {
+        LOG_ERR("WEB", "[UPLOAD] SD write failed: expected %u, wrote %u", block.length, written);
+        failed = true;
+      }
+    }
+    xQueueSend(freeBlocks, &block.index, portMAX_DELAY);
+  }
+  // Nothing of this object may be touched once the stop is acknowledged, it can be gone right after
+  const uint8_t stopped = TASK_STOPPED;
+  xQueueSend(freeBlocks, &stopped, portMAX_DELAY);
+}
+
+void UploadWriter::takeFreeBuffer() {
+  uint8_t index;
+  // Both buffers are still being written: the only place the upload waits for the card
+  while (xQueueReceive(freeBlocks, &index, WAIT_SLICE) != pdTRUE) {
+    esp_task_wdt_reset();
+  }
+  filling = index;
+  fillPos = 0;
+}
+
+bool UploadWriter::write(const uint8_t* data, size_t len) {
+  if (!running) {
+    return false;
+  }
+  while (len > 0 && !failed) {
+    if (filling < 0) {
+      takeFreeBuffer();
+    }
+    const size_t toCopy = std::min(len, BUFFER_SIZE - fillPos);
+    memcpy(buffers[filling] + fillPos, data, toCopy);
+    fillPos += toCopy;
+    data += toCopy;
+    len -= toCopy;
+
+    if (fillPos == BUFFER_SIZE) {
+      const Block block{static_cast<uint8_t>(filling), static_cast<uint16_t>(BUFFER_SIZE)};
+      xQueueSend(fullBlocks, &block, portMAX_DELAY);
+      filling = -1;
+    }
+  }
+  return !failed;
+}
+
+void UploadWriter::stop(const bool writeRest) {
+  if (!running) {
+    return;
+  }
+  if (writeRest && filling >= 0 && fillPos > 0) {
+    const Block block{static_cast<uint8_t>(filling), static_cast<uint16_t>(fillPos)};
+    xQueueSend(fullBlocks, &block, portMAX_DELAY);
+  } else if (!writeRest) {
+    failed = true;
+  }
+  filling = -1;
+
+  const Block stopBlock{0, 0};
+  xQueueSend(fullBlocks, &stopBlock, portMAX_DELAY);
+  uint8_t index = 0;
+  while (index != TASK_STOPPED) {
+    if (xQueueReceive(freeBlocks, &index, WAIT_SLICE) != pdTRUE) {
+      esp_task_wdt_reset();
+    }
+  }
+  running = false;
+  release();
+}
+
+bool UploadWriter::finish() {
+  if (!running) {
+    return false;
+  }
+  stop(true);
+  return !failed;
+}
+
+void UploadWriter::abort() { stop(false); }
+
+void UploadWriter::release() {
+  free(buffers[0]);
+  free(buffers[1]);
+  buffers[0] = buffers[1] = nullptr;
+  if (fullBlocks) {
+    vQueueDelete(fullBlocks);
+    fullBlocks = nullptr;
+  }
+  if (freeBlocks) {
+    vQueueDelete(freeBlocks);
+    freeBlocks = nullptr;
+  }
+  file = nullptr;
+  filling = -1;
+  fillPos = 0;
+}
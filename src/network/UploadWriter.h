@@ -0,0 +1,60 @@
+#pragma once
+
+#include <HalStorage.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Writes an upload to SD from a worker of the WorkerPool, so the HTTP handler can keep reading from the socket while a
+// write is running. Data is copied into one of two buffers; a full buffer is handed to the writer task and filling
+// goes on in the other. The handler only waits when both buffers are still waiting to be written.
+class UploadWriter {
+ public:
+  // Batches small network chunks into larger SD writes, each short enough not to trip the watchdog
+  static constexpr size_t BUFFER_SIZE = 4096;
+
+  UploadWriter() = default;
+  ~UploadWriter() { abort(); }
+  UploadWriter(const UploadWriter&) = delete;
+  UploadWriter& operator=(const UploadWriter&) = delete;
+
+  // Starts writing to file, which must stay open until finish() or abort(). False if out of memory.
+  bool begin(FsFile& file);
+  // False once a write has failed, the upload should be given up then
+  bool write(const uint8_t* data, size_t len);
+  // Writes what is still buffered and waits for the writer task to be done. True if everything was written.
+  bool finish();
+  // Drops what is still buffered, waits for a running write and stops the writer task
+  void abort();
+
+  bool isActive() const { return running; }
+  // Diagnostics for the upload log
+  unsigned long getWriteTime() const { return writeTime.load(); }
+  size_t getWriteCount() const { return writeCount.load(); }
+
+ private:
+  struct Block {
+    uint8_t index;
+    uint16_t length;  // 0 stops the writer task
+  };
+
+  uint8_t* buffers[2] = {};
+  FsFile* file = nullptr;
+  bool running = false;  // The writer task is on a worker of the pool
+  QueueHandle_t fullBlocks = nullptr;  // Handler to writer task
+  QueueHandle_t freeBlocks = nullptr;  // Writer task back to handler
+  int filling = -1;                    // Buffer being filled, -1 if one has to be taken from freeBlocks first
+  size_t fillPos = 0;
+  std::atomic<bool> failed{false};
+  std::atomic<unsigned long> writeTime{0};
+  std::atomic<size_t> writeCount{0};
+
+  static void taskTrampoline(void* param);
+  void taskLoop();
+  void takeFreeBuffer();
+  void stop(bool writeRest);
+  void release();
+};
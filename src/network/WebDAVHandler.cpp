@@ -1,11 +1,20 @@
 #include "WebDAVHandler.h"
 
+#include <BookCacheKey.h>
 #include <Epub.h>
 #include <FsHelpers.h>
 #include <HalStorage.h>
 #include <Logging.h>
 #include <esp_task_wdt.h>
+#include <strings.h>
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "BookCatalog.h"
+#include "CoverJobQueue.h"
+#include "FileResponse.h"
 #include "util/StringUtils.h"
 
 namespace {
@@ -16,8 +25,182 @@ constexpr size_t HIDDEN_ITEMS_COUNT = sizeof(HIDDEN_ITEMS) / sizeof(HIDDEN_ITEMS
 // ESP32 doesn't have real-time clock set by default, so we use a fixed epoch date
 // as a fallback. The date is not critical for WebDAV Class 1 operations.
 const char* FIXED_DATE = "Thu, 01 Jan 2024 00:00:00 GMT";
+
+struct MimeType {
+  const char* extension;
+  const char* type;
+};
+constexpr MimeType MIME_TYPES[] = {
+    {".epub", "application/epub+zip"}, {".pdf", "application/pdf"},     {".txt", "text/plain"},
+    {".html", "text/html"},            {".htm", "text/html"},           {".css", "text/css"},
+    {".js", "application/javascript"}, {".json", "application/json"},   {".xml", "application/xml"},
+    {".jpg", "image/jpeg"},            {".jpeg", "image/jpeg"},         {".png", "image/png"},
+    {".gif", "image/gif"},             {".svg", "image/svg+xml"},       {".zip", "application/zip"},
+    {".gz", "application/gzip"},
+};
+
+// By extension, without the String copies of StringUtils::checkFileExtension, it runs for every PROPFIND entry
+const char* mimeTypeOf(const char* name, const size_t nameLen) {
+  for (const MimeType& mime : MIME_TYPES) {
+    const size_t extLen = strlen(mime.extension);
+    if (nameLen >= extLen && strncasecmp(name + nameLen - extLen, mime.extension, extLen) == 0) {
+      return mime.type;
+    }
+  }
+  return "application/octet-stream";
+}
+
+// Collects the XML of a multistatus response in one buffer, sent a TCP segment at a time instead of a chunk per
+// entry
+class XmlOut {
+ public:
+  explicit XmlOut(WebServer& s) : s(s) {}
+
+  void append(const char* text, size_t len) {
+    while (len > 0) {
+      const size_t toCopy = std::min(len, CAPACITY - used);
+      memcpy(buffer + used, text, toCopy);
+      used += toCopy;
+      text += toCopy;
+      len -= toCopy;
+      if (used == CAPACITY) {
+        flush();
+      }
+    }
+  }
+  void append(const char* text) { append(text, strlen(text)); }
+
+  void appendNumber(const size_t value) {
+    char digits[24];
+    append(digits, snprintf(digits, sizeof(digits), "%u", static_cast<unsigned>(value)));
+  }
+
+  // Percent-encodes what would break the href: URL delimiters and non-ASCII bytes
+  void appendEncodedPath(const char* path, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      const auto c = static_cast<uint8_t>(path[i]);
+      if (c == ' ' || c == '%' || c == '#' || c == '?' || c == '&' || c > 127) {
+        char hex[4];
+        snprintf(hex, sizeof(hex), "%%%02X", c);
+        append(hex, 3);
+      } else {
+        append(&path[i], 1);
+      }
+    }
+  }
+
+  void flush() {
+    if (used > 0) {
+      s.sendContent(buffer, used);
+      used = 0;
+    }
+  }
+
+ private:
+  // lwIP's default MSS
+  static constexpr size_t CAPACITY = 1436;
+  WebServer& s;
+  char buffer[CAPACITY];
+  size_t used = 0;
+};
+
+// A <D:response> for dirPath, or with a name for the entry of that name in it
+void writePropEntry(XmlOut& out, const String& dirPath, const char* name, const size_t nameLen, const bool isDir,
+                    const size_t size) {
+  out.append("<D:response><D:href>");
+  out.appendEncodedPath(dirPath.c_str(), dirPath.length());
+  if (nameLen > 0) {
+    if (!dirPath.endsWith("/")) out.append("/", 1);
+    out.appendEncodedPath(name, nameLen);
+  }
+  // Ensure directory hrefs end with /
+  if (isDir && (nameLen > 0 || !dirPath.endsWith("/"))) out.append("/", 1);
+  out.append("</D:href><D:propstat><D:prop>");
+
+  if (isDir) {
+    out.append("<D:resourcetype><D:collection/></D:resourcetype>");
+  } else {
+    out.append("<D:resourcetype/><D:getcontentlength>");
+    out.appendNumber(size);
+    out.append("</D:getcontentlength><D:getcontenttype>");
+    out.append(nameLen > 0 ? mimeTypeOf(name, nameLen) : mimeTypeOf(dirPath.c_str(), dirPath.length()));
+    out.append("</D:getcontenttype>");
+  }
+
+  out.append("<D:getlastmodified>");
+  out.append(FIXED_DATE);
+  out.append("</D:getlastmodified></D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n");
+}
+
+// Recently listed directories, so the repeated Depth: 1 PROPFINDs of a browsing client don't walk the card every
+// time. A listing is packed as entries of size (4 bytes, LE), directory flag (1), name length (2, LE) and the name.
+// Anything that changes files through the web server drops the whole cache.
+class ListingCache {
+ public:
+  static constexpr size_t SLOTS = 4;
+  static constexpr size_t BUDGET = 16 * 1024;  // Bytes of all listings together, bigger directories aren't kept
+
+  const std::vector<uint8_t>* find(const String& path) {
+    for (Listing& listing : listings) {
+      if (listing.path == path) {
+        listing.usedAt = ++clock;
+        return &listing.entries;
+      }
+    }
+    return nullptr;
+  }
+
+  void store(const String& path, std::vector<uint8_t>&& entries) {
+    if (entries.size() > BUDGET) {
+      return;
+    }
+    size_t total = entries.size();
+    for (const Listing& listing : listings) {
+      total += listing.entries.size();
+    }
+    // Least recently used go first
+    while (!listings.empty() && (listings.size() >= SLOTS || total > BUDGET)) {
+      auto oldest = std::min_element(listings.begin(), listings.end(),
+                                     [](const Listing& a, const Listing& b) { return a.usedAt < b.usedAt; });
+      total -= oldest->entries.size();
+      listings.erase(oldest);
+    }
+    entries.shrink_to_fit();
+    listings.push_back({path, std::move(entries), ++clock});
+  }
+
+  void clear() {
+    listings.clear();
+    listings.shrink_to_fit();
+  }
+
+ private:
+  struct Listing {
+    String path;
+    std::vector<uint8_t> entries;
+    uint32_t usedAt;
+  };
+  std::vector<Listing> listings;
+  uint32_t clock = 0;
+};
+
+ListingCache listingCache;
+
+void appendCachedEntry(std::vector<uint8_t>& entries, const char* name, const size_t nameLen, const bool isDir,
+                       const size_t size) {
+  const uint8_t header[7] = {static_cast<uint8_t>(size),       static_cast<uint8_t>(size >> 8),
+                             static_cast<uint8_t>(size >> 16), static_cast<uint8_t>(size >> 24),
+                             static_cast<uint8_t>(isDir),      static_cast<uint8_t>(nameLen),
+                             static_cast<uint8_t>(nameLen >> 8)};
+  entries.insert(entries.end(), header, header + sizeof(header));
+  entries.insert(entries.end(), name, name + nameLen);
+}
 }  // namespace
 
+WebDAVHandler::~WebDAVHandler() { invalidateListingCache(); }
+
+void WebDAVHandler::invalidateListingCache() { listingCache.clear(); }
+
 // ── RequestHandler interface ─────────────────────────────────────────────────
 
 bool WebDAVHandler::canHandle(WebServer& server, HTTPMethod method, const String& uri) {
@@ -98,15 +281,12 @@ void WebDAVHandler::raw(WebServer& server, const String& uri, HTTPRaw& raw) {
     if (_putOk) {
       String tempPath = _putPath + ".davtmp";
       if (_putExisted) Storage.remove(_putPath.c_str());
-      FsFile tmp = Storage.open(tempPath.c_str());
-      if (tmp) {
-        _putOk = tmp.rename(_putPath.c_str());
-        tmp.close();
-      } else {
-        _putOk = false;
-      }
+      _putOk = Storage.rename(tempPath.c_str(), _putPath.c_str());
       if (!_putOk) Storage.remove(tempPath.c_str());
     }
+    if (_putOk) {
+      BookCatalog::add(_putPath.c_str(), raw.totalSize);
+    }
     LOG_DBG("DAV", "PUT END: %u bytes, ok=%d", raw.totalSize, _putOk);
 
   } else if (raw.status == RAW_ABORTED) {
@@ -119,6 +299,14 @@ void WebDAVHandler::raw(WebServer& server, const String& uri, HTTPRaw& raw) {
 
 bool WebDAVHandler::handle(WebServer& server, HTTPMethod method, const String& uri) {
   (void)uri;
+  // Anything that may change files drops the cached listings
+  if (method != HTTP_OPTIONS && method != HTTP_PROPFIND && method != HTTP_GET && method != HTTP_HEAD) {
+    invalidateListingCache();
+    // A PUT keeps the book catalog up to date itself, other changes may touch whole folders
+    if (method != HTTP_PUT) {
+      BookCatalog::invalidate();
+    }
+  }
   switch (method) {
     case HTTP_OPTIONS:
       handleOptions(server);
@@ -184,56 +372,52 @@ void WebDAVHandler::handlePropfind(WebServer& s) {
     return;
   }
 
-  FsFile root = Storage.open(path.c_str());
-  if (!root) {
-    if (path == "/") {
-      // Root should always work — send minimal response
-      s.setContentLength(CONTENT_LENGTH_UNKNOWN);
-      s.send(207, "application/xml; charset=\"utf-8\"", "");
-      s.sendContent(
-          "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
-          "<D:multistatus xmlns:D=\"DAV:\">\n");
-      sendPropEntry(s, "/", true, 0, FIXED_DATE);
-      s.sendContent("</D:multistatus>\n");
-      s.sendContent("");
+  const std::vector<uint8_t>* cached = depth > 0 ? listingCache.find(path) : nullptr;
+  FsFile root;
+  if (!cached) {
+    root = Storage.open(path.c_str());
+    if (!root && path != "/") {
+      s.send(500, "text/plain", "Failed to open");
       return;
     }
-    s.send(500, "text/plain", "Failed to open");
-    return;
   }
-
-  bool isDir = root.isDirectory();
+  // Root should always work, without the directory it gets a minimal response
+  const bool isDir = cached || !root || root.isDirectory();
 
   s.setContentLength(CONTENT_LENGTH_UNKNOWN);
   s.send(207, "application/xml; charset=\"utf-8\"", "");
-  s.sendContent(
+  XmlOut out(s);
+  out.append(
       "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
       "<D:multistatus xmlns:D=\"DAV:\">\n");
 
   // Entry for the resource itself
-  if (isDir) {
-    sendPropEntry(s, path, true, 0, FIXED_DATE);
-  } else {
-    sendPropEntry(s, path, false, root.size(), FIXED_DATE);
-    root.close();
-    s.sendContent("</D:multistatus>\n");
-    s.sendContent("");
-    return;
-  }
+  writePropEntry(out, path, nullptr, 0, isDir, isDir ? 0 : root.size());
 
   // If depth > 0 and it's a directory, list children
-  if (depth > 0) {
+  if (cached) {
+    const uint8_t* entry = cached->data();
+    const uint8_t* const end = entry + cached->size();
+    while (entry < end) {
+      const size_t size = entry[0] | entry[1] << 8 | entry[2] << 16 | static_cast<size_t>(entry[3]) << 24;
+      const size_t nameLen = entry[5] | entry[6] << 8;
+      writePropEntry(out, path, reinterpret_cast<const char*>(entry + 7), nameLen, entry[4] != 0, size);
+      entry += 7 + nameLen;
+    }
+  } else if (depth > 0 && root && isDir) {
+    // Kept for the next PROPFIND unless it outgrows the cache
+    std::vector<uint8_t> entries;
+    bool caching = true;
     FsFile file = root.openNextFile();
     char name[500];
     while (file) {
-      file.getName(name, sizeof(name));
-      String fileName(name);
+      const size_t nameLen = file.getName(name, sizeof(name));
 
       // Skip hidden/protected items
-      bool shouldHide = fileName.startsWith(".");
+      bool shouldHide = name[0] == '.';
       if (!shouldHide) {
         for (size_t i = 0; i < HIDDEN_ITEMS_COUNT; i++) {
-          if (fileName.equals(HIDDEN_ITEMS[i])) {
+          if (strcmp(name, HIDDEN_ITEMS[i]) == 0) {
             shouldHide = true;
             break;
           }
@@ -241,14 +425,16 @@ void WebDAVHandler::handlePropfind(WebServer& s) {
       }
 
       if (!shouldHide) {
-        String childPath = path;
-        if (!childPath.endsWith("/")) childPath += "/";
-        childPath += fileName;
-
-        if (file.isDirectory()) {
-          sendPropEntry(s, childPath, true, 0, FIXED_DATE);
-        } else {
-          sendPropEntry(s, childPath, false, file.size(), FIXED_DATE);
+        const bool childIsDir = file.isDirectory();
+        const size_t size = childIsDir ? 0 : file.size();
+        writePropEntry(out, path, name, nameLen, childIsDir, size);
+        if (caching) {
+          appendCachedEntry(entries, name, nameLen, childIsDir, size);
+          if (entries.size() > ListingCache::BUDGET) {
+            caching = false;
+            entries.clear();
+            entries.shrink_to_fit();
+          }
         }
       }
 
@@ -257,44 +443,17 @@ void WebDAVHandler::handlePropfind(WebServer& s) {
       esp_task_wdt_reset();
       file = root.openNextFile();
     }
+    if (caching) {
+      listingCache.store(path, std::move(entries));
+    }
   }
 
-  root.close();
-  s.sendContent("</D:multistatus>\n");
-  s.sendContent("");
-}
-
-void WebDAVHandler::sendPropEntry(WebServer& s, const String& path, bool isDir, size_t size,
-                                  const String& lastModified) const {
-  String href;
-  urlEncodePath(path, href);
-  // Ensure directory hrefs end with /
-  if (isDir && !href.endsWith("/")) href += "/";
-
-  String xml = "<D:response><D:href>";
-  xml += href;
-  xml += "</D:href><D:propstat><D:prop>";
-
-  if (isDir) {
-    xml += "<D:resourcetype><D:collection/></D:resourcetype>";
-  } else {
-    xml += "<D:resourcetype/>";
-    xml += "<D:getcontentlength>";
-    xml += String(size);
-    xml += "</D:getcontentlength>";
-    String mime = getMimeType(path);
-    xml += "<D:getcontenttype>";
-    xml += mime;
-    xml += "</D:getcontenttype>";
+  if (root) {
+    root.close();
   }
-
-  xml += "<D:getlastmodified>";
-  xml += lastModified;
-  xml += "</D:getlastmodified>";
-
-  xml += "</D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n";
-
-  s.sendContent(xml);
+  out.append("</D:multistatus>\n");
+  out.flush();
+  s.sendContent("");
 }
 
 // ── GET ──────────────────────────────────────────────────────────────────────
@@ -325,12 +484,7 @@ void WebDAVHandler::handleGet(WebServer& s) {
     return;
   }
 
-  String contentType = getMimeType(path);
-  s.setContentLength(file.size());
-  s.send(200, contentType.c_str(), "");
-
-  NetworkClient client = s.client();
-  client.write(file);
+  FileResponse::send(s, file, getMimeType(path));
   file.close();
 }
 
@@ -362,9 +516,8 @@ void WebDAVHandler::handleHead(WebServer& s) {
     return;
   }
 
-  String contentType = getMimeType(path);
-  s.setContentLength(file.size());
-  s.send(200, contentType.c_str(), "");
+  // Same headers as the GET would have, without the body
+  FileResponse::send(s, file, getMimeType(path), false);
   file.close();
 }
 
@@ -388,6 +541,7 @@ void WebDAVHandler::handlePut(WebServer& s) {
   }
 
   clearEpubCacheIfNeeded(path);
+  COVER_JOBS.enqueue(path.c_str());
   s.send(_putExisted ? 204 : 201);
   LOG_DBG("DAV", "PUT complete: %s", path.c_str());
 }
@@ -438,6 +592,7 @@ void WebDAVHandler::handleDelete(WebServer& s) {
     file.close();
     clearEpubCacheIfNeeded(path);
     if (Storage.remove(path.c_str())) {
+      BookCacheKey::forget(path.c_str(), "/.crosspoint");
       s.send(204);
     } else {
       s.send(500, "text/plain", "Failed to delete file");
@@ -539,17 +694,11 @@ void WebDAVHandler::handleMove(WebServer& s) {
     Storage.remove(dstPath.c_str());
   }
 
-  FsFile file = Storage.open(srcPath.c_str());
-  if (!file) {
-    s.send(500, "text/plain", "Failed to open source");
-    return;
-  }
-
-  clearEpubCacheIfNeeded(srcPath);
-  bool success = file.rename(dstPath.c_str());
-  file.close();
+  // Caches are keyed by the book's content, so the book keeps its cache under the new path
+  bool success = Storage.rename(srcPath.c_str(), dstPath.c_str());
 
   if (success) {
+    BookCacheKey::moved(srcPath.c_str(), dstPath.c_str(), "/.crosspoint");
     s.send(dstExists ? 204 : 201);
   } else {
     s.send(500, "text/plain", "Move failed");
@@ -733,33 +882,6 @@ String WebDAVHandler::getDestinationPath(WebServer& s) const {
   return result;
 }
 
-void WebDAVHandler::urlEncodePath(const String& path, String& out) const {
-  out = "";
-  for (unsigned int i = 0; i < path.length(); i++) {
-    char c = path.charAt(i);
-    if (c == '/') {
-      out += '/';
-    } else if (c == ' ') {
-      out += "%20";
-    } else if (c == '%') {
-      out += "%25";
-    } else if (c == '#') {
-      out += "%23";
-    } else if (c == '?') {
-      out += "%3F";
-    } else if (c == '&') {
-      out += "%26";
-    } else if ((uint8_t)c > 127) {
-      // Encode non-ASCII bytes
-      char hex[4];
-      snprintf(hex, sizeof(hex), "%%%02X", (uint8_t)c);
-      out += hex;
-    } else {
-      out += c;
-    }
-  }
-}
-
 bool WebDAVHandler::isProtectedPath(const String& path) const {
   // Check every segment of the path, not just the last one.
   // This prevents access to e.g. /.hidden/somefile or /System Volume Information/foo
@@ -802,27 +924,14 @@ bool WebDAVHandler::getOverwrite(WebServer& s) const {
 
 void WebDAVHandler::clearEpubCacheIfNeeded(const String& path) const {
   if (StringUtils::checkFileExtension(path, ".epub")) {
-    Epub(path.c_str(), "/.crosspoint").clearCache();
+    const Epub epub(path.c_str(), "/.crosspoint");
+    if (BookCacheKey::shared(path.c_str(), "/.crosspoint")) {
+      LOG_DBG("DAV", "Keeping epub cache shared with another copy of: %s", path.c_str());
+      return;
+    }
+    epub.clearCache();
     LOG_DBG("DAV", "Cleared epub cache for: %s", path.c_str());
   }
 }
 
-String WebDAVHandler::getMimeType(const String& path) const {
-  if (StringUtils::checkFileExtension(path, ".epub")) return "application/epub+zip";
-  if (StringUtils::checkFileExtension(path, ".pdf")) return "application/pdf";
-  if (StringUtils::checkFileExtension(path, ".txt")) return "text/plain";
-  if (StringUtils::checkFileExtension(path, ".html") || StringUtils::checkFileExtension(path, ".htm"))
-    return "text/html";
-  if (StringUtils::checkFileExtension(path, ".css")) return "text/css";
-  if (StringUtils::checkFileExtension(path, ".js")) return "application/javascript";
-  if (StringUtils::checkFileExtension(path, ".json")) return "application/json";
-  if (StringUtils::checkFileExtension(path, ".xml")) return "application/xml";
-  if (StringUtils::checkFileExtension(path, ".jpg") || StringUtils::checkFileExtension(path, ".jpeg"))
-    return "image/jpeg";
-  if (StringUtils::checkFileExtension(path, ".png")) return "image/png";
-  if (StringUtils::checkFileExtension(path, ".gif")) return "image/gif";
-  if (StringUtils::checkFileExtension(path, ".svg")) return "image/svg+xml";
-  if (StringUtils::checkFileExtension(path, ".zip")) return "application/zip";
-  if (StringUtils::checkFileExtension(path, ".gz")) return "application/gzip";
-  return "application/octet-stream";
-}
+String WebDAVHandler::getMimeType(const String& path) const { return mimeTypeOf(path.c_str(), path.length()); }
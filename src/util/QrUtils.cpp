@@ -3,11 +3,29 @@
 #include <qrcode.h>
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
+#include <new>
 
 #include "Logging.h"
 
-void QrUtils::drawQrCode(const GfxRenderer& renderer, const Rect& bounds, const std::string& textPayload) {
+namespace {
+// Codes kept between renders: the web server screen shows two at a time, its Wi-Fi and URL codes
+constexpr size_t CACHE_SLOTS = 2;
+
+struct CachedQr {
+  std::string payload;
+  int maxDim = 0;
+  int displaySize = 0;  // Side in pixels, 0 for an empty slot
+  // Laid out for GfxRenderer::drawIcon, a clear bit for a dark pixel
+  std::unique_ptr<uint8_t[]> bitmap;
+};
+
+CachedQr cache[CACHE_SLOTS];
+size_t nextSlot = 0;
+
+// Encodes payload at a version picked by its length, false if it doesn't fit in it
+bool encode(const std::string& textPayload, std::unique_ptr<uint8_t[]>& qrcodeBytes, QRCode& qrcode) {
   // Dynamically calculate the QR code version based on text length
   // Version 4 holds ~114 bytes, Version 10 ~395, Version 20 ~1066, up to 40
   // qrcode.h max version is 40.
@@ -20,35 +38,98 @@ void QrUtils::drawQrCode(const GfxRenderer& renderer, const Rect& bounds, const
   if (len > 2110) version = 40;
 
   // Make sure we have a large enough buffer on the heap to avoid blowing the stack
-  uint32_t bufferSize = qrcode_getBufferSize(version);
-  auto qrcodeBytes = std::make_unique<uint8_t[]>(bufferSize);
+  const uint32_t bufferSize = qrcode_getBufferSize(version);
+  qrcodeBytes = std::make_unique<uint8_t[]>(bufferSize);
 
-  QRCode qrcode;
   // Initialize the QR code. We use ECC_LOW for max capacity.
-  int8_t res = qrcode_initText(&qrcode, qrcodeBytes.get(), version, ECC_LOW, textPayload.c_str());
+  if (qrcode_initText(&qrcode, qrcodeBytes.get(), version, ECC_LOW, textPayload.c_str()) != 0) {
+    // If it fails (e.g. text too large), log an error
+    LOG_ERR("QR", "Text too large for QR Code version %d", version);
+    return false;
+  }
+  return true;
+}
 
-  if (res == 0) {
-    // Determine the optimal pixel size.
-    const int maxDim = std::min(bounds.width, bounds.height);
+// Scales the modules px times into entry's bitmap. Stored row r, column c of drawIcon hold the pixel (size - 1 - r, c).
+bool buildBitmap(QRCode& qrcode, const int px, CachedQr& entry) {
+  const int size = qrcode.size * px;
+  const int rowBytes = (size + 7) / 8;
+  entry.bitmap.reset(new (std::nothrow) uint8_t[size * rowBytes]);
+  if (!entry.bitmap) {
+    return false;
+  }
+  memset(entry.bitmap.get(), 0xFF, size * rowBytes);
+  for (int r = 0; r < size; r++) {
+    const auto cx = static_cast<uint8_t>((size - 1 - r) / px);
+    uint8_t* row = entry.bitmap.get() + r * rowBytes;
+    for (int c = 0; c < size; c++) {
+      if (qrcode_getModule(&qrcode, cx, static_cast<uint8_t>(c / px))) {
+        row[c / 8] &= ~(0x80 >> (c % 8));
+      }
+    }
+  }
+  entry.displaySize = size;
+  return true;
+}
+}  // namespace
 
+void QrUtils::drawQrCode(const GfxRenderer& renderer, const Rect& bounds, const std::string& textPayload) {
+  const int maxDim = std::min(bounds.width, bounds.height);
+
+  const CachedQr* found = nullptr;
+  for (const auto& entry : cache) {
+    if (entry.displaySize > 0 && entry.maxDim == maxDim && entry.payload == textPayload) {
+      found = &entry;
+      break;
+    }
+  }
+
+  if (!found) {
+    std::unique_ptr<uint8_t[]> qrcodeBytes;
+    QRCode qrcode;
+    if (!encode(textPayload, qrcodeBytes, qrcode)) {
+      return;
+    }
+
+    // Determine the optimal pixel size.
     int px = maxDim / qrcode.size;
     if (px < 1) px = 1;
 
-    // Calculate centering X and Y
-    const int qrDisplaySize = qrcode.size * px;
-    const int xOff = bounds.x + (bounds.width - qrDisplaySize) / 2;
-    const int yOff = bounds.y + (bounds.height - qrDisplaySize) / 2;
-
-    // Draw the QR Code
-    for (uint8_t cy = 0; cy < qrcode.size; cy++) {
-      for (uint8_t cx = 0; cx < qrcode.size; cx++) {
-        if (qrcode_getModule(&qrcode, cx, cy)) {
-          renderer.fillRect(xOff + px * cx, yOff + px * cy, px, px, true);
+    CachedQr& entry = cache[nextSlot];
+    entry.displaySize = 0;
+    if (!buildBitmap(qrcode, px, entry)) {
+      // No room to keep it: drawn module by module this time
+      LOG_ERR("QR", "No memory for a %dpx QR code bitmap", qrcode.size * px);
+      const int qrDisplaySize = qrcode.size * px;
+      const int xOff = bounds.x + (bounds.width - qrDisplaySize) / 2;
+      const int yOff = bounds.y + (bounds.height - qrDisplaySize) / 2;
+      for (uint8_t cy = 0; cy < qrcode.size; cy++) {
+        for (uint8_t cx = 0; cx < qrcode.size; cx++) {
+          if (qrcode_getModule(&qrcode, cx, cy)) {
+            renderer.fillRect(xOff + px * cx, yOff + px * cy, px, px, true);
+          }
         }
       }
+      return;
     }
-  } else {
-    // If it fails (e.g. text too large), log an error
-    LOG_ERR("QR", "Text too large for QR Code version %d", version);
+    entry.payload = textPayload;
+    entry.maxDim = maxDim;
+    nextSlot = (nextSlot + 1) % CACHE_SLOTS;
+    found = &entry;
+  }
+
+  // Calculate centering X and Y
+  const int xOff = bounds.x + (bounds.width - found->displaySize) / 2;
+  const int yOff = bounds.y + (bounds.height - found->displaySize) / 2;
+  renderer.drawIcon(found->bitmap.get(), xOff, yOff, found->displaySize, found->displaySize);
+}
+
+void QrUtils::releaseCache() {
+  for (auto& entry : cache) {
+    entry.payload.clear();
+    entry.payload.shrink_to_fit();
+    entry.displaySize = 0;
+    entry.bitmap.reset();
   }
+  nextSlot = 0;
 }
@@ -8,7 +8,10 @@
 
 namespace QrUtils {
 
-// Renders a QR code with the given text payload within the specified bounding box.
+// Renders a QR code with the given text payload within the specified bounding box. The code is kept scaled into a
+// bitmap, so drawing the same payload at the same size again is a blit rather than another encoding.
 void drawQrCode(const GfxRenderer& renderer, const Rect& bounds, const std::string& textPayload);
+// Frees the kept bitmaps, for screens showing codes to call when they close
+void releaseCache();
 
 }  // namespace QrUtils
@@ -0,0 +1,28 @@
+#include "RefreshUtils.h"
+
+#include <Logging.h>
+
+#include "CrossPointSettings.h"
+
+namespace {
+// Tile-level churn of turning an average text page, in 1/1000 of the panel pixels
+constexpr uint32_t TEXT_PAGE_CHURN_PERMILLE = 40;
+// Low-churn pages stretch the cadence by at most this factor
+constexpr int MAX_CADENCE_STRETCH = 3;
+}  // namespace
+
+HalDisplay::RefreshMode RefreshUtils::nextPageRefreshMode(const GfxRenderer& renderer, int& pagesUntilFullRefresh) {
+  const int frequency = SETTINGS.getRefreshFrequency();
+  const uint32_t churn = renderer.getChurnSinceCleanRefresh();
+  const uint32_t budget = static_cast<uint32_t>(frequency) * TEXT_PAGE_CHURN_PERMILLE;
+
+  if (frequency <= 1 || pagesUntilFullRefresh <= 1 || churn >= budget) {
+    LOG_DBG("RFR", "Half refresh (churn %lu/%lu permille, %d pages left)", static_cast<unsigned long>(churn),
+            static_cast<unsigned long>(budget), pagesUntilFullRefresh);
+    pagesUntilFullRefresh = frequency * MAX_CADENCE_STRETCH;
+    return HalDisplay::HALF_REFRESH;
+  }
+
+  pagesUntilFullRefresh--;
+  return HalDisplay::FAST_REFRESH;
+}
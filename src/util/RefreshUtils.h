@@ -0,0 +1,12 @@
+#pragma once
+
+#include <GfxRenderer.h>
+
+namespace RefreshUtils {
+
+// Picks the refresh for a reader page that is about to be displayed. A half refresh cleans up ghosting once the
+// pixels flipped since the last clean refresh add up to the configured refresh frequency worth of text pages, or
+// when pagesUntilFullRefresh runs out as a hard cap for pages that barely change.
+HalDisplay::RefreshMode nextPageRefreshMode(const GfxRenderer& renderer, int& pagesUntilFullRefresh);
+
+}  // namespace RefreshUtils
@@ -5,44 +5,44 @@
 #include <GfxRenderer.h>
 #include <HalStorage.h>
 #include <Logging.h>
+#include <PackBits.h>
+#include <Serialization.h>
 
 #include <string>
+#include <vector>
 
 #include "Bitmap.h"  // Required for BmpHeader struct definition
 
-void ScreenshotUtil::takeScreenshot(GfxRenderer& renderer) {
-  const uint8_t* fb = renderer.getFrameBuffer();
-  if (fb) {
-    String filename_str = "/screenshots/screenshot-" + String(millis()) + ".bmp";
-    if (ScreenshotUtil::saveFramebufferAsBmp(filename_str.c_str(), fb, HalDisplay::DISPLAY_WIDTH,
-                                             HalDisplay::DISPLAY_HEIGHT)) {
-      LOG_DBG("SCR", "Screenshot saved to %s", filename_str.c_str());
-    } else {
-      LOG_ERR("SCR", "Failed to save screenshot");
-    }
-  } else {
-    LOG_ERR("SCR", "Framebuffer not available");
-  }
-
-  // Display a border around the screen to indicate a screenshot was taken
-  if (renderer.storeBwBuffer()) {
-    renderer.drawRect(6, 6, HalDisplay::DISPLAY_HEIGHT - 12, HalDisplay::DISPLAY_WIDTH - 12, 2, true);
-    renderer.displayBuffer();
-    delay(1000);
-    renderer.restoreBwBuffer();
-    renderer.displayBuffer(HalDisplay::RefreshMode::HALF_REFRESH);
+namespace {
+// Max row size for 480px width = 60 bytes; use fixed buffer to avoid VLA
+constexpr size_t kMaxRowSize = 64;
+// BMP rows packed together while a screenshot waits to be written
+constexpr int PENDING_SLICE_ROWS = 16;
+
+// The BMP's rows bottom-up, PENDING_SLICE_ROWS at a time, each slice a uint16_t of its packed size and the packed rows
+std::string pendingPath;
+std::vector<uint8_t> pendingRows;
+
+// Padded size of a 1-bit BMP row of the given width
+uint32_t bmpRowSize(const int height) { return (height + 31) / 32 * 4; }
+
+// BMP row outY of the frame buffer. Note: the width and height, we rotate the image 90d counter-clockwise to match
+// the default display orientation
+void fillBmpRow(const uint8_t* framebuffer, const int width, const int height, const int outY, uint8_t* rowBuffer) {
+  const int phyWidth = height;
+  memset(rowBuffer, 0, bmpRowSize(height));
+  // BMP rows are bottom-to-top, so outY=0 is the bottom of the displayed image
+  const int srcX = width - 1 - outY;  // phyHeight == width
+  for (int outX = 0; outX < phyWidth; outX++) {
+    // 90d counter-clockwise: source (srcX, srcY)
+    const int srcY = phyWidth - 1 - outX;  // phyWidth == height
+    const int fbIndex = srcY * (width / 8) + (srcX / 8);
+    const uint8_t pixel = (framebuffer[fbIndex] >> (7 - (srcX % 8))) & 0x01;
+    rowBuffer[outX / 8] |= pixel << (7 - (outX % 8));
   }
 }
 
-bool ScreenshotUtil::saveFramebufferAsBmp(const char* filename, const uint8_t* framebuffer, int width, int height) {
-  if (!framebuffer) {
-    return false;
-  }
-
-  // Note: the width and height, we rotate the image 90d counter-clockwise to match the default display orientation
-  int phyWidth = height;
-  int phyHeight = width;
-
+bool makeParentDir(const char* filename) {
   std::string path(filename);
   size_t last_slash = path.find_last_of('/');
   if (last_slash != std::string::npos) {
@@ -53,6 +53,21 @@ bool ScreenshotUtil::saveFramebufferAsBmp(const char* filename, const uint8_t* f
       }
     }
   }
+  return true;
+}
+
+// Writes a BMP of the given size, rowAt(outY, rowBuffer) filling each row, through a buffered writer into a file
+// allocated up front
+template <typename RowAt>
+bool writeBmp(const char* filename, const int phyWidth, const int phyHeight, RowAt rowAt) {
+  const uint32_t rowSizePadded = bmpRowSize(phyWidth);
+  if (rowSizePadded > kMaxRowSize) {
+    LOG_ERR("SCR", "Row size %u exceeds buffer capacity", rowSizePadded);
+    return false;
+  }
+  if (!makeParentDir(filename)) {
+    return false;
+  }
 
   FsFile file;
   if (!Storage.openFileForWrite("SCR", filename, file)) {
@@ -61,57 +76,120 @@ bool ScreenshotUtil::saveFramebufferAsBmp(const char* filename, const uint8_t* f
   }
 
   BmpHeader header;
-
   createBmpHeader(&header, phyWidth, phyHeight);
+  Storage.preAllocate("SCR", file, sizeof(header) + static_cast<uint64_t>(rowSizePadded) * phyHeight);
 
   bool write_error = false;
-  if (file.write(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)) {
-    write_error = true;
+  {
+    BufferedFileWriter out(file);
+    write_error = out.write(&header, sizeof(header)) != sizeof(header);
+    uint8_t rowBuffer[kMaxRowSize];
+    for (int outY = 0; outY < phyHeight && !write_error; outY++) {
+      if (!rowAt(outY, rowBuffer)) {
+        write_error = true;
+        break;
+      }
+      write_error = out.write(rowBuffer, rowSizePadded) != rowSizePadded;
+    }
+    write_error = !out.flush() || write_error;
   }
+  file.close();
 
   if (write_error) {
-    file.close();
-    Storage.remove(filename);
-    return false;
-  }
-
-  const uint32_t rowSizePadded = (phyWidth + 31) / 32 * 4;
-  // Max row size for 480px width = 60 bytes; use fixed buffer to avoid VLA
-  constexpr size_t kMaxRowSize = 64;
-  if (rowSizePadded > kMaxRowSize) {
-    LOG_ERR("SCR", "Row size %u exceeds buffer capacity", rowSizePadded);
-    file.close();
     Storage.remove(filename);
     return false;
   }
+  return true;
+}
+}  // namespace
 
-  // rotate the image 90d counter-clockwise on-the-fly while writing to save memory
-  uint8_t rowBuffer[kMaxRowSize];
-  memset(rowBuffer, 0, rowSizePadded);
-
-  for (int outY = 0; outY < phyHeight; outY++) {
-    for (int outX = 0; outX < phyWidth; outX++) {
-      // 90d counter-clockwise: source (srcX, srcY)
-      // BMP rows are bottom-to-top, so outY=0 is the bottom of the displayed image
-      int srcX = width - 1 - outY;     // phyHeight == width
-      int srcY = phyWidth - 1 - outX;  // phyWidth == height
-      int fbIndex = srcY * (width / 8) + (srcX / 8);
-      uint8_t pixel = (framebuffer[fbIndex] >> (7 - (srcX % 8))) & 0x01;
-      rowBuffer[outX / 8] |= pixel << (7 - (outX % 8));
+void ScreenshotUtil::takeScreenshot(GfxRenderer& renderer) {
+  const uint8_t* fb = renderer.getFrameBuffer();
+  if (fb) {
+    if (hasPending()) {
+      writePending();
     }
-    if (file.write(rowBuffer, rowSizePadded) != rowSizePadded) {
-      write_error = true;
-      break;
+    // Packed right away so the border below can be drawn over the frame buffer
+    constexpr int width = HalDisplay::DISPLAY_WIDTH;
+    constexpr int height = HalDisplay::DISPLAY_HEIGHT;
+    const uint32_t rowSize = bmpRowSize(height);
+    uint8_t slice[kMaxRowSize * PENDING_SLICE_ROWS];
+    uint8_t packed[PackBits::maxPackedSize(sizeof(slice))];
+    pendingRows.clear();
+    for (int outY = 0; outY < width; outY += PENDING_SLICE_ROWS) {
+      const int rows = std::min(PENDING_SLICE_ROWS, width - outY);
+      for (int r = 0; r < rows; r++) {
+        fillBmpRow(fb, width, height, outY + r, slice + r * rowSize);
+      }
+      const uint16_t packedSize = static_cast<uint16_t>(PackBits::pack(slice, rows * rowSize, packed));
+      pendingRows.insert(pendingRows.end(), reinterpret_cast<const uint8_t*>(&packedSize),
+                         reinterpret_cast<const uint8_t*>(&packedSize) + sizeof(packedSize));
+      pendingRows.insert(pendingRows.end(), packed, packed + packedSize);
     }
-    memset(rowBuffer, 0, rowSizePadded);  // Clear the buffer for the next row
+    pendingPath = std::string("/screenshots/screenshot-") + std::to_string(millis()) + ".bmp";
+    LOG_DBG("SCR", "Screenshot kept in %zu bytes until it's written", pendingRows.size());
+  } else {
+    LOG_ERR("SCR", "Framebuffer not available");
   }
 
-  file.close();
+  // Display a border around the screen to indicate a screenshot was taken
+  if (renderer.storeBwBuffer()) {
+    renderer.drawRect(6, 6, HalDisplay::DISPLAY_HEIGHT - 12, HalDisplay::DISPLAY_WIDTH - 12, 2, true);
+    renderer.displayBuffer();
+    delay(1000);
+    renderer.restoreBwBuffer();
+    renderer.displayBuffer(HalDisplay::RefreshMode::HALF_REFRESH);
+  }
+}
 
-  if (write_error) {
-    Storage.remove(filename);
+bool ScreenshotUtil::hasPending() { return !pendingPath.empty(); }
+
+void ScreenshotUtil::writePending() {
+  if (!hasPending()) {
+    return;
+  }
+  constexpr int width = HalDisplay::DISPLAY_WIDTH;
+  constexpr int height = HalDisplay::DISPLAY_HEIGHT;
+  const uint32_t rowSize = bmpRowSize(height);
+  uint8_t slice[kMaxRowSize * PENDING_SLICE_ROWS];
+  size_t offset = 0;
+  const bool saved = writeBmp(pendingPath.c_str(), height, width, [&](const int outY, uint8_t* rowBuffer) {
+    const int sliceRow = outY % PENDING_SLICE_ROWS;
+    if (sliceRow == 0) {
+      uint16_t packedSize = 0;
+      if (offset + sizeof(packedSize) > pendingRows.size()) {
+        return false;
+      }
+      memcpy(&packedSize, pendingRows.data() + offset, sizeof(packedSize));
+      offset += sizeof(packedSize);
+      const int rows = std::min(PENDING_SLICE_ROWS, width - outY);
+      if (offset + packedSize > pendingRows.size() ||
+          !PackBits::unpack(pendingRows.data() + offset, packedSize, slice, rows * rowSize)) {
+        return false;
+      }
+      offset += packedSize;
+    }
+    memcpy(rowBuffer, slice + sliceRow * rowSize, rowSize);
+    return true;
+  });
+  if (saved) {
+    LOG_DBG("SCR", "Screenshot saved to %s", pendingPath.c_str());
+  } else {
+    LOG_ERR("SCR", "Failed to save screenshot");
+  }
+  pendingPath.clear();
+  pendingRows.clear();
+  pendingRows.shrink_to_fit();
+}
+
+bool ScreenshotUtil::saveFramebufferAsBmp(const char* filename, const uint8_t* framebuffer, int width, int height) {
+  if (!framebuffer) {
     return false;
   }
 
-  return true;
+  // rotate the image 90d counter-clockwise on-the-fly while writing to save memory
+  return writeBmp(filename, height, width, [&](const int outY, uint8_t* rowBuffer) {
+    fillBmpRow(framebuffer, width, height, outY, rowBuffer);
+    return true;
+  });
 }
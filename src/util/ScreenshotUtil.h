@@ -3,6 +3,11 @@
 
 class ScreenshotUtil {
  public:
+  // Keeps the frame as BMP rows packed in RAM and flashes a border to confirm; the file is written by writePending()
   static void takeScreenshot(GfxRenderer& renderer);
+  static bool hasPending();
+  // Writes the screenshot taken last to /screenshots. From the main loop with the render lock held, so the render it
+  // was taken in doesn't wait on the SD card.
+  static void writePending();
   static bool saveFramebufferAsBmp(const char* filename, const uint8_t* framebuffer, int width, int height);
 };
@@ -0,0 +1,202 @@
+#include <Epub.h>
+#include <Epub/CacheBundle.h>
+#include <Epub/Section.h>
+#include <FontDecompressor.h>
+#include <GfxRenderer.h>
+#include <HalDisplay.h>
+#include <HalStorage.h>
+#include <builtinFonts/all.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../src/fontIds.h"
+
+// Builds the cache the device would for each EPUB given, with the same sources, and packs it as <book>.epub.cpcache
+// for the card: the device unpacks it the first time it opens the book instead of indexing it. The sections are laid
+// out with the parameters of a section file taken from the device (any /.crosspoint/epub_*/sections/*/<n>.bin of a
+// book read with the settings wanted), so they match the reader's font, spacing and screen.
+
+namespace {
+// Home screen covers of the built-in themes
+constexpr int DEFAULT_THUMB_HEIGHTS[] = {226, 400};
+
+struct ReaderFont {
+  int id;
+  const EpdFontData* regular;
+  const EpdFontData* bold;
+  const EpdFontData* italic;
+  const EpdFontData* boldItalic;
+};
+
+const ReaderFont READER_FONTS[] = {
+    {BOOKERLY_12_FONT_ID, &bookerly_12_regular, &bookerly_12_bold, &bookerly_12_italic, &bookerly_12_bolditalic},
+    {BOOKERLY_14_FONT_ID, &bookerly_14_regular, &bookerly_14_bold, &bookerly_14_italic, &bookerly_14_bolditalic},
+    {BOOKERLY_16_FONT_ID, &bookerly_16_regular, &bookerly_16_bold, &bookerly_16_italic, &bookerly_16_bolditalic},
+    {BOOKERLY_18_FONT_ID, &bookerly_18_regular, &bookerly_18_bold, &bookerly_18_italic, &bookerly_18_bolditalic},
+    {NOTOSANS_12_FONT_ID, &notosans_12_regular, &notosans_12_bold, &notosans_12_italic, &notosans_12_bolditalic},
+    {NOTOSANS_14_FONT_ID, &notosans_14_regular, &notosans_14_bold, &notosans_14_italic, &notosans_14_bolditalic},
+    {NOTOSANS_16_FONT_ID, &notosans_16_regular, &notosans_16_bold, &notosans_16_italic, &notosans_16_bolditalic},
+    {NOTOSANS_18_FONT_ID, &notosans_18_regular, &notosans_18_bold, &notosans_18_italic, &notosans_18_bolditalic},
+    {OPENDYSLEXIC_8_FONT_ID, &opendyslexic_8_regular, &opendyslexic_8_bold, &opendyslexic_8_italic,
+     &opendyslexic_8_bolditalic},
+    {OPENDYSLEXIC_10_FONT_ID, &opendyslexic_10_regular, &opendyslexic_10_bold, &opendyslexic_10_italic,
+     &opendyslexic_10_bolditalic},
+    {OPENDYSLEXIC_12_FONT_ID, &opendyslexic_12_regular, &opendyslexic_12_bold, &opendyslexic_12_italic,
+     &opendyslexic_12_bolditalic},
+    {OPENDYSLEXIC_14_FONT_ID, &opendyslexic_14_regular, &opendyslexic_14_bold, &opendyslexic_14_italic,
+     &opendyslexic_14_bolditalic},
+};
+
+void printUsage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s --layout SECTION.bin [--thumb HEIGHT ...] [--out DIR] book.epub ...\n"
+          "Builds each book's cache with the layout of SECTION.bin, a section file from the device, and writes it to\n"
+          "<book>.epub.cpcache next to the book (or in DIR). Copy it to the card next to the book. Home screen\n"
+          "thumbnails are made for the given heights (default: 226 and 400).\n",
+          program);
+}
+
+// Everything the device keeps in a book's cache but what it renders while reading
+std::vector<std::string> listCacheFiles(const std::string& cacheDir) {
+  std::vector<std::string> names;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(cacheDir, ec)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    const auto relative = std::filesystem::relative(entry.path(), cacheDir);
+    const bool skipped = std::any_of(relative.begin(), relative.end(), [](const std::filesystem::path& part) {
+      const std::string name = part.string();
+      return name == "frames" || name[0] == '.';
+    });
+    if (!skipped) {
+      names.push_back(relative.generic_string());
+    }
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+bool buildBundle(const std::string& path, const std::string& bundlePath, const Section::BuildParams& params,
+                 const std::vector<int>& thumbHeights, GfxRenderer& renderer) {
+  const std::string workDir = (std::filesystem::temp_directory_path() / "crosspoint_cache_builder").string();
+  Storage.removeDir(workDir.c_str());
+  Storage.mkdir(workDir.c_str());
+  // Epub::load() would unpack a bundle already there
+  Storage.remove((path + CacheBundle::EXTENSION).c_str());
+
+  auto epub = std::make_shared<Epub>(path, workDir);
+  if (!epub->load(true, false)) {
+    fprintf(stderr, "Failed to load %s\n", path.c_str());
+    return false;
+  }
+  int pages = 0;
+  for (int spine = 0; spine < epub->getSpineItemsCount(); spine++) {
+    Section section(epub, spine, renderer);
+    if (!section.createSectionFile(params.fontId, params.lineCompression, params.extraParagraphSpacing,
+                                   params.paragraphAlignment, params.viewportWidth, params.viewportHeight,
+                                   params.hyphenationEnabled, params.embeddedStyle)) {
+      fprintf(stderr, "Failed to index spine item %d of %s\n", spine, path.c_str());
+      return false;
+    }
+    pages += section.pageCount;
+  }
+  // Books without a cover image have none of these
+  epub->generateCoverBmp(false);
+  epub->generateCoverBmp(true);
+  for (const int height : thumbHeights) {
+    epub->generateThumbBmp(height);
+  }
+
+  const std::vector<std::string> names = listCacheFiles(epub->getCachePath());
+  const bool packed = CacheBundle::pack(bundlePath, path, epub->getCachePath(), names);
+  Storage.removeDir(workDir.c_str());
+  if (!packed) {
+    fprintf(stderr, "Failed to write %s\n", bundlePath.c_str());
+    return false;
+  }
+  std::error_code ec;
+  printf("%s: %d pages, %zu files, %ju KiB\n", bundlePath.c_str(), pages, names.size(),
+         static_cast<uintmax_t>(std::filesystem::file_size(bundlePath, ec) / 1024));
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string layoutPath;
+  std::string outDir;
+  std::vector<int> thumbHeights;
+  std::vector<std::string> books;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--layout" && i + 1 < argc) {
+      layoutPath = argv[++i];
+    } else if (arg == "--thumb" && i + 1 < argc) {
+      thumbHeights.push_back(atoi(argv[++i]));
+    } else if (arg == "--out" && i + 1 < argc) {
+      outDir = argv[++i];
+    } else if (arg == "--help" || arg == "-h") {
+      printUsage(argv[0]);
+      return 0;
+    } else if (!arg.empty() && arg[0] == '-') {
+      printUsage(argv[0]);
+      return 1;
+    } else {
+      books.push_back(std::filesystem::absolute(arg).string());
+    }
+  }
+  if (layoutPath.empty() || books.empty()) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  if (thumbHeights.empty()) {
+    thumbHeights.assign(std::begin(DEFAULT_THUMB_HEIGHTS), std::end(DEFAULT_THUMB_HEIGHTS));
+  }
+
+  Section::BuildParams params = {};
+  if (!Section::readBuildParams(layoutPath, params)) {
+    fprintf(stderr, "%s is not a section file of this firmware version\n", layoutPath.c_str());
+    return 1;
+  }
+  const auto font = std::find_if(std::begin(READER_FONTS), std::end(READER_FONTS),
+                                 [&params](const ReaderFont& candidate) { return candidate.id == params.fontId; });
+  if (font == std::end(READER_FONTS)) {
+    fprintf(stderr, "%s was laid out with a font this build doesn't have (%d)\n", layoutPath.c_str(), params.fontId);
+    return 1;
+  }
+
+  static HalDisplay display;
+  static GfxRenderer renderer(display);
+  static FontDecompressor fontDecompressor;
+  static EpdFont regularFont(font->regular);
+  static EpdFont boldFont(font->bold);
+  static EpdFont italicFont(font->italic);
+  static EpdFont boldItalicFont(font->boldItalic);
+  static EpdFontFamily fontFamily(&regularFont, &boldFont, &italicFont, &boldItalicFont);
+  display.begin();
+  renderer.begin();
+  if (!fontDecompressor.init()) {
+    fprintf(stderr, "Font decompressor init failed\n");
+    return 1;
+  }
+  renderer.setFontDecompressor(&fontDecompressor);
+  renderer.insertFont(params.fontId, fontFamily);
+
+  int failures = 0;
+  for (const auto& path : books) {
+    std::string bundlePath = path + CacheBundle::EXTENSION;
+    if (!outDir.empty()) {
+      bundlePath = (std::filesystem::path(outDir) / std::filesystem::path(bundlePath).filename()).string();
+    }
+    if (!buildBundle(path, bundlePath, params, thumbHeights, renderer)) {
+      failures++;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
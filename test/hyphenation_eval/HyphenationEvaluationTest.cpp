@@ -1,19 +1,49 @@
 #include <Utf8.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <new>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "lib/Epub/Epub/hyphenation/HyphenationCommon.h"
+#include "lib/Epub/Epub/hyphenation/Hyphenator.h"
 #include "lib/Epub/Epub/hyphenation/LanguageHyphenator.h"
 #include "lib/Epub/Epub/hyphenation/LanguageRegistry.h"
 
+// Heap allocations made by the whole program, so --bench can report allocations per word.
+std::atomic<unsigned long> gAllocationCount{0};
+
+void* operator new(size_t size) {
+  gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+// GCC doesn't see that operator new above is malloc-backed once these are inlined into std::allocator
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
 struct TestCase {
   std::string word;
   std::string hyphenated;
@@ -302,9 +332,81 @@ void printResults(const std::string& language, const std::vector<TestCase>& test
   }
 }
 
+struct BenchmarkResult {
+  size_t words = 0;
+  int passes = 0;
+  double seconds = 0.0;
+  unsigned long allocations = 0;
+  size_t breaks = 0;
+};
+
+// Runs Hyphenator::breakOffsets (the allocation-free overload the layout code uses) over every test word, repeating
+// until enough time has passed for a stable rate. One untimed pass first lets the scratch buffers grow.
+BenchmarkResult benchmarkLanguage(const LanguageConfig& lang, const std::vector<TestCase>& testCases) {
+  constexpr double kMinSeconds = 0.5;
+  constexpr int kMinPasses = 3;
+
+  Hyphenator::setPreferredLanguage(lang.primaryTag);
+  Hyphenator::BreakInfo breaks[Hyphenator::MAX_BREAKS];
+  const auto runPass = [&]() {
+    size_t total = 0;
+    for (const auto& testCase : testCases) {
+      total += Hyphenator::breakOffsets(testCase.word, false, breaks, Hyphenator::MAX_BREAKS);
+    }
+    return total;
+  };
+
+  BenchmarkResult result;
+  result.words = testCases.size();
+  result.breaks = runPass();
+
+  const unsigned long allocationsBefore = gAllocationCount.load();
+  const auto start = std::chrono::steady_clock::now();
+  size_t checksum = 0;
+  while (result.passes < kMinPasses || result.seconds < kMinSeconds) {
+    checksum += runPass();
+    result.passes++;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  result.allocations = gAllocationCount.load() - allocationsBefore;
+
+  if (checksum != result.breaks * result.passes) {
+    std::cerr << "Warning: " << lang.cliName << " break count changed between passes" << std::endl;
+  }
+  return result;
+}
+
+// Prints one JSON document so results from two commits can be diffed. breaks is the total number of break points
+// found per pass; if it changes, so did the hyphenation output.
+int runBenchmark(const std::vector<LanguageConfig>& languages) {
+  std::cout << "{\n  \"languages\": [";
+  bool first = true;
+  for (const auto& lang : languages) {
+    const std::vector<TestCase> testCases = loadTestData(lang.testDataFile);
+    if (testCases.empty()) {
+      std::cerr << "No test cases loaded for " << lang.cliName << ". Skipping." << std::endl;
+      continue;
+    }
+
+    const BenchmarkResult result = benchmarkLanguage(lang, testCases);
+    const double wordCount = static_cast<double>(result.words) * result.passes;
+    std::cout << (first ? "\n" : ",\n") << "    {\"language\": \"" << lang.cliName << "\", \"words\": " << result.words
+              << ", \"passes\": " << result.passes << ", \"seconds\": " << result.seconds
+              << ", \"wordsPerSecond\": " << static_cast<long long>(std::llround(wordCount / result.seconds))
+              << ", \"allocationsPerWord\": " << (result.allocations / wordCount) << ", \"breaks\": " << result.breaks
+              << "}";
+    first = false;
+  }
+  std::cout << "\n  ]\n}" << std::endl;
+  return 0;
+}
+
 int main(int argc, char* argv[]) {
-  const bool summaryMode = argc <= 1;
-  const std::string languageSelection = summaryMode ? "all" : argv[1];
+  // --bench [language]: throughput and allocations of Hyphenator::breakOffsets instead of accuracy
+  const bool benchMode = argc > 1 && std::string(argv[1]) == "--bench";
+  const int languageArg = benchMode ? 2 : 1;
+  const bool summaryMode = !benchMode && argc <= 1;
+  const std::string languageSelection = argc > languageArg ? argv[languageArg] : "all";
 
   std::vector<LanguageConfig> languages = resolveLanguages(languageSelection);
   if (languages.empty()) {
@@ -312,6 +414,10 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  if (benchMode) {
+    return runBenchmark(languages);
+  }
+
   for (const auto& lang : languages) {
     const auto* hyphenator = getLanguageHyphenatorForPrimaryTag(lang.primaryTag);
     if (!hyphenator) {
@@ -0,0 +1,277 @@
+#include <Epub.h>
+#include <Epub/Page.h>
+#include <Epub/Section.h>
+#include <Epub/css/CssStyle.h>
+#include <FontDecompressor.h>
+#include <GfxRenderer.h>
+#include <HalDisplay.h>
+#include <HalStorage.h>
+#include <builtinFonts/bookerly_14_bold.h>
+#include <builtinFonts/bookerly_14_bolditalic.h>
+#include <builtinFonts/bookerly_14_italic.h>
+#include <builtinFonts/bookerly_14_regular.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../src/fontIds.h"
+
+// Indexes and renders whole EPUBs on the host, with the same layout engine the device runs. Allocations and the heap
+// high-water mark are counted by hooking malloc, which only works with glibc; build with -DLAYOUT_BENCH_NO_ALLOC_HOOKS
+// to leave the allocator alone, e.g. under valgrind.
+
+#if defined(__GLIBC__) && !defined(LAYOUT_BENCH_NO_ALLOC_HOOKS)
+#include <malloc.h>
+#define LAYOUT_BENCH_ALLOC_HOOKS 1
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+namespace {
+std::atomic<unsigned long> allocationCount{0};
+std::atomic<size_t> liveBytes{0};
+std::atomic<size_t> peakBytes{0};
+
+void trackAlloc(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  const size_t size = malloc_usable_size(ptr);
+  const size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+  size_t peak = peakBytes.load(std::memory_order_relaxed);
+  while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void trackFree(void* ptr) {
+  if (ptr) {
+    liveBytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+  }
+}
+}  // namespace
+
+extern "C" void* malloc(size_t size) {
+  void* ptr = __libc_malloc(size);
+  trackAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  void* ptr = __libc_calloc(count, size);
+  trackAlloc(ptr);
+  return ptr;
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+  trackFree(ptr);
+  void* moved = __libc_realloc(ptr, size);
+  // A failed realloc leaves the old block in place
+  trackAlloc(moved ? moved : (size > 0 ? ptr : nullptr));
+  return moved;
+}
+
+extern "C" void free(void* ptr) {
+  trackFree(ptr);
+  __libc_free(ptr);
+}
+#endif
+
+namespace {
+// Same fixed layout as the on-device benchmark, so host and device numbers can be read side by side
+constexpr int MARGIN = 20;
+constexpr int FONT_ID = BOOKERLY_14_FONT_ID;
+constexpr float LINE_COMPRESSION = 1.0f;
+constexpr uint8_t ALIGNMENT = static_cast<uint8_t>(CssTextAlign::Justify);
+constexpr char DEFAULT_BOOKS_DIR[] = "test/epubs";
+
+struct BookResult {
+  std::string name;
+  int pages = 0;
+  double indexMs = 0;
+  double renderMs = 0;
+  unsigned long allocations = 0;
+  size_t peakHeap = 0;
+};
+
+struct HeapCounters {
+  unsigned long allocations = 0;
+  size_t peak = 0;
+};
+
+// Starts a fresh high-water mark from what is live now
+void resetHeapPeak() {
+#ifdef LAYOUT_BENCH_ALLOC_HOOKS
+  peakBytes = liveBytes.load();
+#endif
+}
+
+HeapCounters readHeapCounters() {
+#ifdef LAYOUT_BENCH_ALLOC_HOOKS
+  return {allocationCount.load(), peakBytes.load()};
+#else
+  return {};
+#endif
+}
+
+double elapsedMs(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+double perSecond(const int count, const double ms) { return ms > 0 ? count * 1000.0 / ms : 0; }
+
+void printUsage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [--runs N] [--cache DIR] [book.epub ...]\n"
+          "Indexes and renders every chapter of each book (default: the books in %s) and reports pages/second,\n"
+          "allocations and peak heap. The best of N runs is kept (default 1).\n",
+          program, DEFAULT_BOOKS_DIR);
+}
+
+bool benchmarkBook(const std::string& path, const std::string& cacheDir, GfxRenderer& renderer, BookResult& out) {
+  const uint16_t viewportWidth = renderer.getScreenWidth() - 2 * MARGIN;
+  const uint16_t viewportHeight = renderer.getScreenHeight() - 2 * MARGIN;
+  Storage.removeDir(cacheDir.c_str());
+  Storage.mkdir(cacheDir.c_str());
+
+  resetHeapPeak();
+  const HeapCounters before = readHeapCounters();
+  const auto indexStart = std::chrono::steady_clock::now();
+  auto epub = std::make_shared<Epub>(path, cacheDir);
+  if (!epub->load(true, false)) {
+    fprintf(stderr, "Failed to load %s\n", path.c_str());
+    return false;
+  }
+  int pages = 0;
+  for (int spine = 0; spine < epub->getSpineItemsCount(); spine++) {
+    Section section(epub, spine, renderer);
+    if (!section.beginSectionBuild(FONT_ID, LINE_COMPRESSION, true, ALIGNMENT, viewportWidth, viewportHeight, false,
+                                   true) ||
+        section.continueSectionBuild() != Section::BuildStatus::Done) {
+      fprintf(stderr, "Failed to index spine item %d of %s\n", spine, path.c_str());
+      return false;
+    }
+    pages += section.pageCount;
+  }
+  out.indexMs = elapsedMs(indexStart);
+
+  const auto renderStart = std::chrono::steady_clock::now();
+  for (int spine = 0; spine < epub->getSpineItemsCount(); spine++) {
+    Section section(epub, spine, renderer);
+    if (!section.loadSectionFile(FONT_ID, LINE_COMPRESSION, true, ALIGNMENT, viewportWidth, viewportHeight, false,
+                                 true)) {
+      fprintf(stderr, "Failed to load the index of spine item %d of %s\n", spine, path.c_str());
+      return false;
+    }
+    for (int page = 0; page < section.pageCount; page++) {
+      section.currentPage = page;
+      const auto loaded = section.loadPageFromSectionFile();
+      if (!loaded) {
+        fprintf(stderr, "Failed to load page %d of spine item %d of %s\n", page, spine, path.c_str());
+        return false;
+      }
+      renderer.clearScreen();
+      loaded->render(renderer, FONT_ID, MARGIN, MARGIN);
+      renderer.displayBuffer();
+    }
+  }
+  out.renderMs = elapsedMs(renderStart);
+
+  const HeapCounters after = readHeapCounters();
+  out.name = std::filesystem::path(path).filename().string();
+  out.pages = pages;
+  out.allocations = after.allocations - before.allocations;
+  out.peakHeap = after.peak;
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  int runs = 1;
+  std::string cacheDir = (std::filesystem::temp_directory_path() / "crosspoint_layout_bench").string();
+  std::vector<std::string> books;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--runs" && i + 1 < argc) {
+      runs = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--cache" && i + 1 < argc) {
+      cacheDir = argv[++i];
+    } else if (arg == "--help" || arg == "-h") {
+      printUsage(argv[0]);
+      return 0;
+    } else if (!arg.empty() && arg[0] == '-') {
+      printUsage(argv[0]);
+      return 1;
+    } else {
+      books.push_back(std::filesystem::absolute(arg).string());
+    }
+  }
+  if (books.empty()) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(DEFAULT_BOOKS_DIR, ec)) {
+      if (entry.path().extension() == ".epub") {
+        books.push_back(std::filesystem::absolute(entry.path()).string());
+      }
+    }
+    std::sort(books.begin(), books.end());
+  }
+  if (books.empty()) {
+    fprintf(stderr, "No books found, run from the repository root or pass the books to read\n");
+    return 1;
+  }
+
+  static HalDisplay display;
+  static GfxRenderer renderer(display);
+  static FontDecompressor fontDecompressor;
+  static EpdFont regularFont(&bookerly_14_regular);
+  static EpdFont boldFont(&bookerly_14_bold);
+  static EpdFont italicFont(&bookerly_14_italic);
+  static EpdFont boldItalicFont(&bookerly_14_bolditalic);
+  static EpdFontFamily fontFamily(&regularFont, &boldFont, &italicFont, &boldItalicFont);
+  display.begin();
+  renderer.begin();
+  if (!fontDecompressor.init()) {
+    fprintf(stderr, "Font decompressor init failed\n");
+    return 1;
+  }
+  renderer.setFontDecompressor(&fontDecompressor);
+  renderer.insertFont(FONT_ID, fontFamily);
+
+  printf("%-32s %6s %10s %9s %10s %9s %10s %10s\n", "book", "pages", "index ms", "pages/s", "render ms", "pages/s",
+         "allocs", "peak KiB");
+  int failures = 0;
+  for (const auto& path : books) {
+    BookResult best;
+    bool ok = true;
+    for (int run = 0; run < runs && ok; run++) {
+      BookResult result;
+      ok = benchmarkBook(path, cacheDir, renderer, result);
+      if (ok && (run == 0 || result.indexMs + result.renderMs < best.indexMs + best.renderMs)) {
+        best = result;
+      }
+    }
+    if (!ok) {
+      failures++;
+      continue;
+    }
+#ifdef LAYOUT_BENCH_ALLOC_HOOKS
+    printf("%-32s %6d %10.1f %9.1f %10.1f %9.1f %10lu %10zu\n", best.name.c_str(), best.pages, best.indexMs,
+           perSecond(best.pages, best.indexMs), best.renderMs, perSecond(best.pages, best.renderMs), best.allocations,
+           best.peakHeap / 1024);
+#else
+    printf("%-32s %6d %10.1f %9.1f %10.1f %9.1f %10s %10s\n", best.name.c_str(), best.pages, best.indexMs,
+           perSecond(best.pages, best.indexMs), best.renderMs, perSecond(best.pages, best.renderMs), "-", "-");
+#endif
+  }
+  Storage.removeDir(cacheDir.c_str());
+  return failures == 0 ? 0 : 1;
+}
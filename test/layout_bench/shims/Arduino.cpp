@@ -0,0 +1,31 @@
+#include <Arduino.h>
+#include <Logging.h>
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+
+EspClass ESP;
+
+namespace {
+const auto startTime = std::chrono::steady_clock::now();
+}  // namespace
+
+unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(const unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+void logPrintf(const char* level, const char* origin, const char* format, ...) {
+  fprintf(stderr, "[%lu] %s [%s] ", millis(), level, origin);
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+// Host stand-in for the parts of the Arduino core used by the layout and parsing engine
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "Print.h"
+#include "WString.h"
+
+#define PROGMEM
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline void yield() {}
+inline long random(const long max) { return max > 0 ? std::rand() % max : 0; }
+inline long random(const long min, const long max) { return max > min ? min + random(max - min) : min; }
+
+// What the engine asks of the ESP object. The heap figures are fixed at what a reader has free on the device, so the
+// memory guards take the same paths they take there.
+class EspClass {
+ public:
+  uint32_t getFreeHeap() const { return DEVICE_FREE_HEAP; }
+  uint32_t getMaxAllocHeap() const { return DEVICE_LARGEST_BLOCK; }
+  uint32_t getMinFreeHeap() const { return DEVICE_FREE_HEAP; }
+
+ private:
+  static constexpr uint32_t DEVICE_FREE_HEAP = 160 * 1024;
+  static constexpr uint32_t DEVICE_LARGEST_BLOCK = 96 * 1024;
+};
+
+extern EspClass ESP;
@@ -0,0 +1,25 @@
+#include <HalDisplay.h>
+
+void HalDisplay::clearScreen(const uint8_t color) const { memset(frameBuffer, color, BUFFER_SIZE); }
+
+void HalDisplay::drawImage(const uint8_t* imageData, const uint16_t x, const uint16_t y, const uint16_t w,
+                           const uint16_t h, bool) const {
+  // Same byte aligned copy the panel driver does, x and w in pixels
+  const uint16_t rowBytes = w / 8;
+  for (uint16_t row = 0; row < h && y + row < DISPLAY_HEIGHT; row++) {
+    for (uint16_t col = 0; col < rowBytes && x / 8 + col < DISPLAY_WIDTH_BYTES; col++) {
+      frameBuffer[(y + row) * DISPLAY_WIDTH_BYTES + x / 8 + col] = imageData[row * rowBytes + col];
+    }
+  }
+}
+
+void HalDisplay::drawImageTransparent(const uint8_t* imageData, const uint16_t x, const uint16_t y, const uint16_t w,
+                                      const uint16_t h, bool) const {
+  // Only black pixels (cleared bits) of the image are drawn
+  const uint16_t rowBytes = w / 8;
+  for (uint16_t row = 0; row < h && y + row < DISPLAY_HEIGHT; row++) {
+    for (uint16_t col = 0; col < rowBytes && x / 8 + col < DISPLAY_WIDTH_BYTES; col++) {
+      frameBuffer[(y + row) * DISPLAY_WIDTH_BYTES + x / 8 + col] &= imageData[row * rowBytes + col];
+    }
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Host stand-in for lib/hal's HalDisplay: the frame buffer lives in memory and refreshes are only counted
+
+#include <Arduino.h>
+
+class HalDisplay {
+ public:
+  enum RefreshMode { FULL_REFRESH, HALF_REFRESH, FAST_REFRESH };
+
+  static constexpr uint16_t DISPLAY_WIDTH = 800;
+  static constexpr uint16_t DISPLAY_HEIGHT = 480;
+  static constexpr uint16_t DISPLAY_WIDTH_BYTES = DISPLAY_WIDTH / 8;
+  static constexpr uint32_t BUFFER_SIZE = DISPLAY_WIDTH_BYTES * DISPLAY_HEIGHT;
+
+  void begin() { clearScreen(); }
+
+  void clearScreen(uint8_t color = 0xFF) const;
+  void drawImage(const uint8_t* imageData, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                 bool fromProgmem = false) const;
+  void drawImageTransparent(const uint8_t* imageData, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                            bool fromProgmem = false) const;
+
+  void displayBuffer(RefreshMode = FAST_REFRESH, bool = false) { refreshCount++; }
+  void refreshDisplay(RefreshMode = FAST_REFRESH, bool = false) { refreshCount++; }
+  void displayWindow(uint16_t, uint16_t, uint16_t, uint16_t, bool = false) { refreshCount++; }
+  bool isBusy() const { return false; }
+  bool isRefreshing() const { return false; }
+  bool lightSleepWhileBusy(uint32_t) const { return false; }
+  void deepSleep() {}
+
+  uint8_t* getFrameBuffer() const { return frameBuffer; }
+
+  void copyGrayscaleBuffers(const uint8_t*, const uint8_t*) {}
+  void copyGrayscaleLsbBuffers(const uint8_t*) {}
+  void copyGrayscaleMsbBuffers(const uint8_t*) {}
+  void cleanupGrayscaleBuffers(const uint8_t*) {}
+  void displayGrayBuffer(bool = false) { refreshCount++; }
+
+  // Refreshes asked for so far, for the benchmark to report
+  uint32_t getRefreshCount() const { return refreshCount; }
+
+ private:
+  mutable uint8_t frameBuffer[BUFFER_SIZE] = {};
+  uint32_t refreshCount = 0;
+};
@@ -0,0 +1,235 @@
+#include <HalStorage.h>
+#include <Logging.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+
+HalStorage HalStorage::instance;
+
+FsFile& FsFile::operator=(FsFile&& other) noexcept {
+  if (this != &other) {
+    close();
+    fd = other.fd;
+    directory = other.directory;
+    path = std::move(other.path);
+    other.fd = -1;
+    other.directory = false;
+  }
+  return *this;
+}
+
+bool FsFile::open(const char* filePath, const oflag_t oflag) {
+  close();
+  struct stat st{};
+  directory = stat(filePath, &st) == 0 && S_ISDIR(st.st_mode);
+  fd = ::open(filePath, directory ? O_RDONLY : oflag, 0644);
+  if (fd < 0) {
+    directory = false;
+    return false;
+  }
+  path = filePath;
+  return true;
+}
+
+bool FsFile::close() {
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  fd = -1;
+  directory = false;
+  return true;
+}
+
+int FsFile::read() {
+  uint8_t b;
+  return read(&b, 1) == 1 ? b : -1;
+}
+
+int FsFile::read(void* buffer, const size_t size) {
+  if (fd < 0 || directory) {
+    return -1;
+  }
+  return static_cast<int>(::read(fd, buffer, size));
+}
+
+size_t FsFile::write(const uint8_t* buffer, const size_t size) {
+  if (fd < 0 || directory) {
+    return 0;
+  }
+  const ssize_t written = ::write(fd, buffer, size);
+  return written < 0 ? 0 : static_cast<size_t>(written);
+}
+
+bool FsFile::seek(const uint64_t pos) { return fd >= 0 && lseek(fd, static_cast<off_t>(pos), SEEK_SET) >= 0; }
+
+bool FsFile::seekCur(const int64_t offset) {
+  return fd >= 0 && lseek(fd, static_cast<off_t>(offset), SEEK_CUR) >= 0;
+}
+
+uint64_t FsFile::position() const {
+  const off_t pos = fd >= 0 ? lseek(fd, 0, SEEK_CUR) : -1;
+  return pos < 0 ? 0 : static_cast<uint64_t>(pos);
+}
+
+uint64_t FsFile::size() const {
+  struct stat st{};
+  return fd >= 0 && fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+int FsFile::available() const {
+  const uint64_t total = size();
+  const uint64_t pos = position();
+  return pos < total ? static_cast<int>(total - pos) : 0;
+}
+
+bool FsFile::getModifyDateTime(uint16_t* date, uint16_t* time) const {
+  struct stat st{};
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    return false;
+  }
+  // FAT's packed local date and time, as SdFat returns them
+  struct tm local{};
+  localtime_r(&st.st_mtime, &local);
+  *date = static_cast<uint16_t>((local.tm_year - 80) << 9 | (local.tm_mon + 1) << 5 | local.tm_mday);
+  *time = static_cast<uint16_t>(local.tm_hour << 11 | local.tm_min << 5 | local.tm_sec / 2);
+  return true;
+}
+
+bool FsFile::truncate(const uint64_t length) { return fd >= 0 && ftruncate(fd, static_cast<off_t>(length)) == 0; }
+
+bool FsFile::preAllocate(const uint64_t length) { return length > 0 && size() == 0 && truncate(length); }
+
+size_t FsFile::getName(char* name, const size_t size) const {
+  if (size == 0) {
+    return 0;
+  }
+  const std::string base = std::filesystem::path(path).filename().string();
+  snprintf(name, size, "%s", base.c_str());
+  return strlen(name);
+}
+
+std::vector<String> HalStorage::listFiles(const char* path, const int maxFiles) {
+  std::vector<String> files;
+  DIR* dir = opendir(path);
+  if (!dir) {
+    return files;
+  }
+  while (const dirent* entry = readdir(dir)) {
+    if (static_cast<int>(files.size()) >= maxFiles) {
+      break;
+    }
+    if (entry->d_name[0] != '.') {
+      files.emplace_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  return files;
+}
+
+String HalStorage::readFile(const char* path) {
+  FsFile file;
+  if (!file.open(path)) {
+    return String();
+  }
+  std::string content(file.size(), '\0');
+  const int read = file.read(content.data(), content.size());
+  content.resize(read > 0 ? read : 0);
+  return String(content);
+}
+
+bool HalStorage::readFileToStream(const char* path, Print& out, const size_t chunkSize) {
+  FsFile file;
+  if (!file.open(path)) {
+    return false;
+  }
+  std::vector<uint8_t> buffer(chunkSize);
+  int read;
+  while ((read = file.read(buffer.data(), buffer.size())) > 0) {
+    out.write(buffer.data(), read);
+  }
+  return read == 0;
+}
+
+size_t HalStorage::readFileToBuffer(const char* path, char* buffer, const size_t bufferSize, const size_t maxBytes) {
+  if (!buffer || bufferSize == 0) {
+    return 0;
+  }
+  FsFile file;
+  if (!file.open(path)) {
+    buffer[0] = '\0';
+    return 0;
+  }
+  size_t toRead = bufferSize - 1;
+  if (maxBytes > 0 && maxBytes < toRead) {
+    toRead = maxBytes;
+  }
+  const int read = file.read(buffer, toRead);
+  const size_t count = read > 0 ? read : 0;
+  buffer[count] = '\0';
+  return count;
+}
+
+bool HalStorage::writeFile(const char* path, const String& content) {
+  FsFile file;
+  if (!openFileForWrite("STORAGE", path, file)) {
+    return false;
+  }
+  return file.write(content.c_str(), content.length()) == content.length();
+}
+
+FsFile HalStorage::open(const char* path, const oflag_t oflag) {
+  FsFile file;
+  file.open(path, oflag);
+  return file;
+}
+
+bool HalStorage::mkdir(const char* path, const bool pFlag) {
+  std::error_code ec;
+  if (pFlag) {
+    std::filesystem::create_directories(path, ec);
+  } else {
+    std::filesystem::create_directory(path, ec);
+  }
+  return !ec && std::filesystem::is_directory(path, ec);
+}
+
+bool HalStorage::exists(const char* path) { return access(path, F_OK) == 0; }
+
+bool HalStorage::remove(const char* path) { return unlink(path) == 0; }
+
+bool HalStorage::rename(const char* oldPath, const char* newPath) { return ::rename(oldPath, newPath) == 0; }
+
+bool HalStorage::rmdir(const char* path) { return ::rmdir(path) == 0; }
+
+bool HalStorage::openFileForRead(const char* moduleName, const char* path, FsFile& file) {
+  if (!file.open(path, O_RDONLY)) {
+    LOG_ERR(moduleName, "File does not exist: %s", path);
+    return false;
+  }
+  return true;
+}
+
+bool HalStorage::openFileForWrite(const char* moduleName, const char* path, FsFile& file) {
+  if (!file.open(path, O_RDWR | O_CREAT | O_TRUNC)) {
+    LOG_ERR(moduleName, "Failed to open file for writing: %s (%s)", path, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool HalStorage::removeDir(const char* path) {
+  std::error_code ec;
+  std::filesystem::remove_all(path, ec);
+  return !ec;
+}
+
+bool HalStorage::preAllocate(const char* moduleName, FsFile& file, const uint64_t size) {
+  (void)moduleName;
+  return size > 0 && file.preAllocate(size);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// Host stand-in for lib/hal's HalStorage: FsFile and Storage over POSIX, paths taken as host paths
+
+#include <Arduino.h>
+#include <fcntl.h>
+
+#include <string>
+#include <vector>
+
+using oflag_t = int;
+
+#ifndef O_WRITE
+#define O_WRITE O_WRONLY
+#endif
+
+class FsFile : public Print {
+ public:
+  FsFile() = default;
+  ~FsFile() override { close(); }
+  FsFile(const FsFile&) = delete;
+  FsFile& operator=(const FsFile&) = delete;
+  FsFile(FsFile&& other) noexcept { *this = std::move(other); }
+  FsFile& operator=(FsFile&& other) noexcept;
+
+  bool open(const char* path, oflag_t oflag = O_RDONLY);
+  bool close();
+  bool isOpen() const { return fd >= 0; }
+  explicit operator bool() const { return isOpen(); }
+
+  int read();
+  int read(void* buffer, size_t size);
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  size_t write(const void* buffer, const size_t size) { return write(static_cast<const uint8_t*>(buffer), size); }
+  void flush() override {}
+
+  bool seek(uint64_t pos);
+  bool seekSet(const uint64_t pos) { return seek(pos); }
+  bool seekCur(int64_t offset);
+  uint64_t position() const;
+  uint64_t curPosition() const { return position(); }
+  uint64_t size() const;
+  uint64_t fileSize() const { return size(); }
+  int available() const;
+  bool truncate(uint64_t length);
+  bool getModifyDateTime(uint16_t* date, uint16_t* time) const;
+  // Only sets the size, as SdFat's does, so a file not truncated after a short write shows
+  bool preAllocate(uint64_t length);
+  bool isDirectory() const { return directory; }
+  size_t getName(char* name, size_t size) const;
+
+ private:
+  int fd = -1;
+  bool directory = false;
+  std::string path;
+};
+
+class HalStorage {
+ public:
+  HalStorage() = default;
+  bool begin() { return true; }
+  bool ready() const { return true; }
+  std::vector<String> listFiles(const char* path = "/", int maxFiles = 200);
+  String readFile(const char* path);
+  bool readFileToStream(const char* path, Print& out, size_t chunkSize = 256);
+  size_t readFileToBuffer(const char* path, char* buffer, size_t bufferSize, size_t maxBytes = 0);
+  bool writeFile(const char* path, const String& content);
+  bool ensureDirectoryExists(const char* path) { return mkdir(path); }
+
+  FsFile open(const char* path, oflag_t oflag = O_RDONLY);
+  bool mkdir(const char* path, bool pFlag = true);
+  bool exists(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* oldPath, const char* newPath);
+  bool rmdir(const char* path);
+
+  bool openFileForRead(const char* moduleName, const char* path, FsFile& file);
+  bool openFileForRead(const char* moduleName, const std::string& path, FsFile& file) {
+    return openFileForRead(moduleName, path.c_str(), file);
+  }
+  bool openFileForRead(const char* moduleName, const String& path, FsFile& file) {
+    return openFileForRead(moduleName, path.c_str(), file);
+  }
+  bool openFileForWrite(const char* moduleName, const char* path, FsFile& file);
+  bool openFileForWrite(const char* moduleName, const std::string& path, FsFile& file) {
+    return openFileForWrite(moduleName, path.c_str(), file);
+  }
+  bool openFileForWrite(const char* moduleName, const String& path, FsFile& file) {
+    return openFileForWrite(moduleName, path.c_str(), file);
+  }
+  bool removeDir(const char* path);
+  bool preAllocate(const char* moduleName, FsFile& file, uint64_t size);
+
+  static HalStorage& getInstance() { return instance; }
+
+ private:
+  static HalStorage instance;
+};
+
+#define Storage HalStorage::getInstance()
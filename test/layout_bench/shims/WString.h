@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+// Host stand-in for the Arduino String, over std::string
+class String {
+ public:
+  String() = default;
+  String(const char* str) : value(str ? str : "") {}
+  String(const std::string& str) : value(str) {}
+
+  const char* c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.size(); }
+  bool isEmpty() const { return value.empty(); }
+  void reserve(const unsigned int size) { value.reserve(size); }
+  char operator[](const unsigned int index) const { return value[index]; }
+
+  String substring(const unsigned int from) const { return from < value.size() ? value.substr(from) : ""; }
+  String substring(const unsigned int from, const unsigned int to) const {
+    return from < value.size() && to > from ? value.substr(from, to - from) : "";
+  }
+  int indexOf(const char c, const unsigned int from = 0) const {
+    const auto pos = value.find(c, from);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+  }
+  bool startsWith(const String& prefix) const { return value.rfind(prefix.value, 0) == 0; }
+  bool endsWith(const String& suffix) const {
+    return value.size() >= suffix.value.size() &&
+           value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+  }
+  long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+
+  String& operator+=(const String& other) {
+    value += other.value;
+    return *this;
+  }
+  String& operator+=(const char c) {
+    value += c;
+    return *this;
+  }
+  bool concat(const char* str, const unsigned int len) {
+    value.append(str, len);
+    return true;
+  }
+  friend String operator+(String lhs, const String& rhs) { return lhs += rhs; }
+  bool operator==(const String& other) const { return value == other.value; }
+  bool operator!=(const String& other) const { return value != other.value; }
+
+ private:
+  std::string value;
+};